@@ -0,0 +1,21 @@
+#
+# libdeflate support
+#
+
+find_path(LIBDEFLATE_INCLUDE_DIR
+  NAMES libdeflate.h
+)
+find_library(LIBDEFLATE_LIBRARY
+  NAMES deflate
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Libdeflate REQUIRED_VARS
+                                  LIBDEFLATE_LIBRARY LIBDEFLATE_INCLUDE_DIR)
+
+if(LIBDEFLATE_FOUND)
+  set(LIBDEFLATE_LIBRARIES     ${LIBDEFLATE_LIBRARY})
+  set(LIBDEFLATE_INCLUDE_DIRS  ${LIBDEFLATE_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(LIBDEFLATE_INCLUDE_DIR LIBDEFLATE_LIBRARY)
@@ -0,0 +1,21 @@
+#
+# liburing support
+#
+
+find_path(LIBURING_INCLUDE_DIR
+  NAMES liburing.h
+)
+find_library(LIBURING_LIBRARY
+  NAMES uring
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Liburing REQUIRED_VARS
+                                  LIBURING_LIBRARY LIBURING_INCLUDE_DIR)
+
+if(LIBURING_FOUND)
+  set(LIBURING_LIBRARIES     ${LIBURING_LIBRARY})
+  set(LIBURING_INCLUDE_DIRS  ${LIBURING_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(LIBURING_INCLUDE_DIR LIBURING_LIBRARY)
@@ -45,6 +45,7 @@
 #include <zstandard_compression.h>
 
 /* system */
+#include <ctype.h>
 #include <err.h>
 #include <getopt.h>
 #include <stdbool.h>
@@ -59,6 +60,8 @@
 
 #define HELP 99
 
+#define BATCH_MAX_ARGUMENTS 16
+
 #define COMMAND_BACKUP "backup"
 #define COMMAND_LIST_BACKUP "list-backup"
 #define COMMAND_RESTORE "restore"
@@ -81,12 +84,18 @@
 #define COMMAND_CLEAR "clear"
 #define COMMAND_INFO "info"
 #define COMMAND_ANNOTATE "annotate"
+#define COMMAND_MERGE "merge"
+#define COMMAND_WAL_FETCH "wal-fetch"
+#define COMMAND_CHANGES "changes"
+#define COMMAND_RETENTION "retention"
 
 #define OUTPUT_FORMAT_JSON "json"
 #define OUTPUT_FORMAT_TEXT "text"
 
 #define UNSPECIFIED "Unspecified"
 
+static bool json_lines = false;
+
 static void help_backup(void);
 static void help_list_backup(void);
 static void help_restore(void);
@@ -94,6 +103,10 @@ static void help_verify(void);
 static void help_archive(void);
 static void help_delete(void);
 static void help_retain(void);
+static void help_merge(void);
+static void help_wal_fetch(void);
+static void help_changes(void);
+static void help_retention(void);
 static void help_expunge(void);
 static void help_decrypt(void);
 static void help_encrypt(void);
@@ -109,7 +122,7 @@ static void help_annotate(void);
 static void display_helper(char* command);
 
 static int backup(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, char* incremental, int32_t output_format);
-static int list_backup(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int list_backup(SSL* ssl, int socket, char* server, char* options, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int restore(SSL* ssl, int socket, char* server, char* backup_id, char* position, char* directory, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int verify(SSL* ssl, int socket, char* server, char* backup_id, char* directory, char* files, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int archive(SSL* ssl, int socket, char* server, char* backup_id, char* position, char* directory, uint8_t compression, uint8_t encryption, int32_t output_format);
@@ -121,6 +134,10 @@ static int ping(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, i
 static int reset(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int reload(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int retain(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int merge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int wal_fetch(SSL* ssl, int socket, char* server, char* file, char* path, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int changes(SSL* ssl, int socket, char* server, char* backup_id, char* limit, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int retention(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int expunge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int decrypt_data_client(char* from);
 static int encrypt_data_client(char* from);
@@ -136,6 +153,10 @@ static int conf_ls(SSL* ssl, int socket, uint8_t compression, uint8_t encryption
 static int conf_get(SSL* ssl, int socket, char* config_key, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int conf_set(SSL* ssl, int socket, char* config_key, char* config_value, uint8_t compression, uint8_t encryption, int32_t output_format);
 
+static int execute(SSL* ssl, int socket, int is_server_conn, struct pgmoneta_parsed_command* parsed, int32_t compression, int32_t encryption, int32_t output_format);
+static int batch(char* path, SSL* ssl, int* socket, bool local, int32_t compression, int32_t encryption, int32_t output_format);
+static int batch_arguments(char* line, char** argv, int size);
+
 static int process_result(SSL* ssl, int socket, int32_t output_format);
 static int process_get_result(SSL* ssl, int socket, char* param, int32_t output_format);
 static int process_ls_result(SSL* ssl, int socket, int32_t output_format);
@@ -159,6 +180,8 @@ static char* int_to_hex(uint32_t num);
 static void translate_backup_argument(struct json* j);
 static void translate_configuration(struct json* j);
 static void translate_response_argument(struct json* j);
+static void translate_changes_argument(struct json* j);
+static void translate_retention_argument(struct json* j);
 static void translate_servers_argument(struct json* j);
 static void translate_server_retention_argument(struct json* j, char* tag);
 static void translate_json_object(struct json* j);
@@ -192,12 +215,14 @@ usage(void)
    printf("  -F, --format text|json|raw                     Set the output format\n");
    printf("  -C, --compress none|gz|zstd|lz4|bz2            Compress the wire protocol\n");
    printf("  -E, --encrypt none|aes|aes256|aes192|aes128    Encrypt the wire protocol\n");
+   printf("  -B, --batch FILE|-                             Run the commands of a file, or stdin, over one connection\n");
    printf("  -?, --help                                     Display help\n");
    printf("\n");
    printf("Commands:\n");
    printf("  annotate                 Annotate a backup with comments\n");
    printf("  archive                  Archive a backup from a server\n");
    printf("  backup                   Backup a server\n");
+   printf("  changes                  The relations modified since a backup\n");
    printf("  clear <what>             Clear data, with:\n");
    printf("                           - 'prometheus' to reset the Prometheus statistics\n");
    printf("  compress                 Compress a file using configured method\n");
@@ -215,12 +240,15 @@ usage(void)
    printf("  expunge                  Expunge a backup from a server\n");
    printf("  info                     Information about a backup\n");
    printf("  list-backup              List the backups for a server\n");
+   printf("  merge                    Merge an incremental backup into a full backup\n");
    printf("  ping                     Check if pgmoneta is alive\n");
    printf("  restore                  Restore a backup from a server\n");
    printf("  retain                   Retain a backup from a server\n");
+   printf("  retention                What the retention policy deletes now\n");
    printf("  shutdown                 Shutdown pgmoneta\n");
    printf("  status [details]         Status of pgmoneta, with optional details\n");
    printf("  verify                   Verify a backup from a server\n");
+   printf("  wal-fetch                Fetch a WAL file from the archive, for restore_command\n");
    printf("\n");
    printf("pgmoneta: %s\n", PGMONETA_HOMEPAGE);
    printf("Report bugs: %s\n", PGMONETA_ISSUES);
@@ -238,7 +266,7 @@ const struct pgmoneta_command command_table[] = {
    {
       .command = "list-backup",
       .subcommand = "",
-      .accepted_argument_count = {1},
+      .accepted_argument_count = {1, 2},
       .action = MANAGEMENT_LIST_BACKUP,
       .deprecated = false,
       .log_message = "<list-backup> [%s]",
@@ -283,6 +311,38 @@ const struct pgmoneta_command command_table[] = {
       .deprecated = false,
       .log_message = "<retain> [%s]"
    },
+   {
+      .command = "merge",
+      .subcommand = "",
+      .accepted_argument_count = {2},
+      .action = MANAGEMENT_MERGE,
+      .deprecated = false,
+      .log_message = "<merge> [%s]"
+   },
+   {
+      .command = "wal-fetch",
+      .subcommand = "",
+      .accepted_argument_count = {3},
+      .action = MANAGEMENT_WAL_FETCH,
+      .deprecated = false,
+      .log_message = "<wal-fetch> [%s]"
+   },
+   {
+      .command = "changes",
+      .subcommand = "",
+      .accepted_argument_count = {2, 3},
+      .action = MANAGEMENT_CHANGES,
+      .deprecated = false,
+      .log_message = "<changes> [%s]"
+   },
+   {
+      .command = "retention",
+      .subcommand = "",
+      .accepted_argument_count = {1},
+      .action = MANAGEMENT_RETENTION,
+      .deprecated = false,
+      .log_message = "<retention> [%s]"
+   },
    {
       .command = "expunge",
       .subcommand = "",
@@ -427,6 +487,7 @@ main(int argc, char** argv)
    char* password = NULL;
    bool verbose = false;
    char* logfile = NULL;
+   char* batch_path = NULL;
    bool do_free = true;
    int c;
    int option_index = 0;
@@ -460,10 +521,11 @@ main(int argc, char** argv)
          {"format", required_argument, 0, 'F'},
          {"help", no_argument, 0, '?'},
          {"compress", required_argument, 0, 'C'},
-         {"encrypt", required_argument, 0, 'E'}
+         {"encrypt", required_argument, 0, 'E'},
+         {"batch", required_argument, 0, 'B'}
       };
 
-      c = getopt_long(argc, argv, "vV?c:h:p:U:P:L:F:C:E:",
+      c = getopt_long(argc, argv, "vV?c:h:p:U:P:L:F:C:E:B:",
                       long_options, &option_index);
 
       if (c == -1)
@@ -570,6 +632,9 @@ main(int argc, char** argv)
                exit(1);
             }
             break;
+         case 'B':
+            batch_path = optarg;
+            break;
          case '?':
             usage();
             exit(1);
@@ -662,7 +727,16 @@ main(int argc, char** argv)
          config = (struct configuration*)shmem;
       }
    }
-   if (!parse_command(argc, argv, optind, &parsed, command_table, command_count))
+   if (batch_path != NULL)
+   {
+      /* One JSON object per line */
+      json_lines = true;
+      if (output_format == MANAGEMENT_OUTPUT_FORMAT_TEXT)
+      {
+         output_format = MANAGEMENT_OUTPUT_FORMAT_JSON;
+      }
+   }
+   else if (!parse_command(argc, argv, optind, &parsed, command_table, command_count))
    {
       if (argc > optind)
       {
@@ -677,7 +751,8 @@ main(int argc, char** argv)
       goto done;
    }
 
-   need_server_conn = parsed.cmd->action != MANAGEMENT_COMPRESS && parsed.cmd->action != MANAGEMENT_DECOMPRESS && parsed.cmd->action != MANAGEMENT_ENCRYPT && parsed.cmd->action != MANAGEMENT_DECRYPT;
+   need_server_conn = batch_path != NULL ||
+                      (parsed.cmd->action != MANAGEMENT_COMPRESS && parsed.cmd->action != MANAGEMENT_DECOMPRESS && parsed.cmd->action != MANAGEMENT_ENCRYPT && parsed.cmd->action != MANAGEMENT_DECRYPT);
 
    if (configuration_path != NULL)
    {
@@ -777,200 +852,362 @@ password:
       is_server_conn = 1;
    }
 
+   if (batch_path != NULL)
+   {
+      exit_code = batch(batch_path, s_ssl, &socket, configuration_path != NULL, compression, encryption, output_format);
+      goto done;
+   }
+
 execute:
-   if (parsed.cmd->action == MANAGEMENT_BACKUP)
+   exit_code = execute(s_ssl, socket, is_server_conn, &parsed, compression, encryption, output_format);
+
+done:
+
+   if (s_ssl != NULL)
+   {
+      int res;
+      SSL_CTX* ctx = SSL_get_SSL_CTX(s_ssl);
+      res = SSL_shutdown(s_ssl);
+      if (res == 0)
+      {
+         SSL_shutdown(s_ssl);
+      }
+      SSL_free(s_ssl);
+      SSL_CTX_free(ctx);
+   }
+
+   pgmoneta_disconnect(socket);
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, size);
+
+   if (do_free)
+   {
+      free(password);
+   }
+
+   if (verbose)
+   {
+      if (exit_code == 0)
+      {
+         printf("Success (0)\n");
+      }
+      else
+      {
+         printf("Error (%d)\n", exit_code);
+      }
+   }
+
+   return exit_code;
+}
+
+static int
+execute(SSL* ssl, int socket, int is_server_conn, struct pgmoneta_parsed_command* parsed, int32_t compression, int32_t encryption, int32_t output_format)
+{
+   int exit_code = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (parsed->cmd->action == MANAGEMENT_BACKUP)
    {
-      if (parsed.args[1])
+      if (parsed->args[1])
       {
-         exit_code = backup(s_ssl, socket, parsed.args[0], compression, encryption, parsed.args[1], output_format);
+         exit_code = backup(ssl, socket, parsed->args[0], compression, encryption, parsed->args[1], output_format);
       }
       else
       {
-         exit_code = backup(s_ssl, socket, parsed.args[0], compression, encryption, NULL, output_format);
+         exit_code = backup(ssl, socket, parsed->args[0], compression, encryption, NULL, output_format);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_LIST_BACKUP)
+   else if (parsed->cmd->action == MANAGEMENT_LIST_BACKUP)
    {
-      exit_code = list_backup(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+      exit_code = list_backup(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_RESTORE)
+   else if (parsed->cmd->action == MANAGEMENT_RESTORE)
    {
-      if (parsed.args[3])
+      if (parsed->args[3])
       {
-         exit_code = restore(s_ssl, socket, parsed.args[0], parsed.args[1], parsed.args[2], parsed.args[3], compression, encryption, output_format);
+         exit_code = restore(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], parsed->args[3], compression, encryption, output_format);
       }
       else
       {
-         exit_code = restore(s_ssl, socket, parsed.args[0], parsed.args[1], NULL, parsed.args[2], compression, encryption, output_format);
+         exit_code = restore(ssl, socket, parsed->args[0], parsed->args[1], NULL, parsed->args[2], compression, encryption, output_format);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_VERIFY)
+   else if (parsed->cmd->action == MANAGEMENT_VERIFY)
    {
-      if (parsed.args[3])
+      if (parsed->args[3])
       {
-         exit_code = verify(s_ssl, socket, parsed.args[0], parsed.args[1], parsed.args[2], parsed.args[3], compression, encryption, output_format);
+         exit_code = verify(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], parsed->args[3], compression, encryption, output_format);
       }
       else
       {
-         exit_code = verify(s_ssl, socket, parsed.args[0], parsed.args[1], parsed.args[2], "failed", compression, encryption, output_format);
+         exit_code = verify(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], "failed", compression, encryption, output_format);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_ARCHIVE)
+   else if (parsed->cmd->action == MANAGEMENT_ARCHIVE)
    {
-      if (parsed.args[3])
+      if (parsed->args[3])
       {
-         exit_code = archive(s_ssl, socket, parsed.args[0], parsed.args[1], parsed.args[2], parsed.args[3], compression, encryption, output_format);
+         exit_code = archive(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], parsed->args[3], compression, encryption, output_format);
       }
       else
       {
-         exit_code = archive(s_ssl, socket, parsed.args[0], parsed.args[1], NULL, parsed.args[2], compression, encryption, output_format);
+         exit_code = archive(ssl, socket, parsed->args[0], parsed->args[1], NULL, parsed->args[2], compression, encryption, output_format);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_DELETE)
+   else if (parsed->cmd->action == MANAGEMENT_DELETE)
+   {
+      exit_code = delete(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_SHUTDOWN)
+   {
+      exit_code = pgmoneta_shutdown(ssl, socket, compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_STATUS)
+   {
+      exit_code = status(ssl, socket, compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_STATUS_DETAILS)
+   {
+      exit_code = details(ssl, socket, compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_PING)
    {
-      exit_code = delete(s_ssl, socket, parsed.args[0], parsed.args[1], compression, encryption, output_format);
+      exit_code = ping(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_SHUTDOWN)
+   else if (parsed->cmd->action == MANAGEMENT_RESET)
    {
-      exit_code = pgmoneta_shutdown(s_ssl, socket, compression, encryption, output_format);
+      exit_code = reset(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_STATUS)
+   else if (parsed->cmd->action == MANAGEMENT_RELOAD)
    {
-      exit_code = status(s_ssl, socket, compression, encryption, output_format);
+      exit_code = reload(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_STATUS_DETAILS)
+   else if (parsed->cmd->action == MANAGEMENT_RETAIN)
    {
-      exit_code = details(s_ssl, socket, compression, encryption, output_format);
+      exit_code = retain(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_PING)
+   else if (parsed->cmd->action == MANAGEMENT_MERGE)
    {
-      exit_code = ping(s_ssl, socket, compression, encryption, output_format);
+      exit_code = merge(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_RESET)
+   else if (parsed->cmd->action == MANAGEMENT_WAL_FETCH)
    {
-      exit_code = reset(s_ssl, socket, compression, encryption, output_format);
+      exit_code = wal_fetch(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_RELOAD)
+   else if (parsed->cmd->action == MANAGEMENT_CHANGES)
    {
-      exit_code = reload(s_ssl, socket, compression, encryption, output_format);
+      exit_code = changes(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_RETAIN)
+   else if (parsed->cmd->action == MANAGEMENT_RETENTION)
    {
-      exit_code = retain(s_ssl, socket, parsed.args[0], parsed.args[1], compression, encryption, output_format);
+      exit_code = retention(ssl, socket, parsed->args[0], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_EXPUNGE)
+   else if (parsed->cmd->action == MANAGEMENT_EXPUNGE)
    {
-      exit_code = expunge(s_ssl, socket, parsed.args[0], parsed.args[1], compression, encryption, output_format);
+      exit_code = expunge(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_DECRYPT)
+   else if (parsed->cmd->action == MANAGEMENT_DECRYPT)
    {
       if (is_server_conn)
       {
-         exit_code = decrypt_data_server(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+         exit_code = decrypt_data_server(ssl, socket, parsed->args[0], compression, encryption, output_format);
       }
       else
       {
-         exit_code = decrypt_data_client(parsed.args[0]);
+         exit_code = decrypt_data_client(parsed->args[0]);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_ENCRYPT)
+   else if (parsed->cmd->action == MANAGEMENT_ENCRYPT)
    {
       if (is_server_conn)
       {
-         exit_code = encrypt_data_server(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+         exit_code = encrypt_data_server(ssl, socket, parsed->args[0], compression, encryption, output_format);
       }
       else
       {
-         exit_code = encrypt_data_client(parsed.args[0]);
+         exit_code = encrypt_data_client(parsed->args[0]);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_DECOMPRESS)
+   else if (parsed->cmd->action == MANAGEMENT_DECOMPRESS)
    {
       if (is_server_conn)
       {
-         exit_code = decompress_data_server(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+         exit_code = decompress_data_server(ssl, socket, parsed->args[0], compression, encryption, output_format);
       }
       else
       {
-         exit_code = decompress_data_client(parsed.args[0]);
+         exit_code = decompress_data_client(parsed->args[0]);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_COMPRESS)
+   else if (parsed->cmd->action == MANAGEMENT_COMPRESS)
    {
       if (is_server_conn)
       {
-         exit_code = compress_data_server(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+         exit_code = compress_data_server(ssl, socket, parsed->args[0], compression, encryption, output_format);
       }
       else
       {
-         exit_code = compress_data_client(parsed.args[0], config->compression_type);
+         exit_code = compress_data_client(parsed->args[0], config->compression_type);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_INFO)
+   else if (parsed->cmd->action == MANAGEMENT_INFO)
    {
-      exit_code = info(s_ssl, socket, parsed.args[0], parsed.args[1], compression, encryption, output_format);
+      exit_code = info(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_ANNOTATE)
+   else if (parsed->cmd->action == MANAGEMENT_ANNOTATE)
    {
-      exit_code = annotate(s_ssl, socket, parsed.args[0], parsed.args[1], parsed.args[2], parsed.args[3], parsed.args[4], compression, encryption, output_format);
+      exit_code = annotate(ssl, socket, parsed->args[0], parsed->args[1], parsed->args[2], parsed->args[3], parsed->args[4], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONF_LS)
+   else if (parsed->cmd->action == MANAGEMENT_CONF_LS)
    {
-      exit_code = conf_ls(s_ssl, socket, compression, encryption, output_format);
+      exit_code = conf_ls(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONF_GET)
+   else if (parsed->cmd->action == MANAGEMENT_CONF_GET)
    {
-      if (parsed.args[0])
+      if (parsed->args[0])
       {
-         exit_code = conf_get(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+         exit_code = conf_get(ssl, socket, parsed->args[0], compression, encryption, output_format);
       }
       else
       {
-         exit_code = conf_get(s_ssl, socket, NULL, compression, encryption, output_format);
+         exit_code = conf_get(ssl, socket, NULL, compression, encryption, output_format);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONF_SET)
+   else if (parsed->cmd->action == MANAGEMENT_CONF_SET)
    {
-      exit_code = conf_set(s_ssl, socket, parsed.args[0], parsed.args[1], compression, encryption, output_format);
+      exit_code = conf_set(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
 
-done:
+   return exit_code;
+}
 
-   if (s_ssl != NULL)
+static int
+batch(char* path, SSL* ssl, int* socket, bool local, int32_t compression, int32_t encryption, int32_t output_format)
+{
+   FILE* file = NULL;
+   char* line = NULL;
+   size_t line_size = 0;
+   int argc;
+   char* argv[BATCH_MAX_ARGUMENTS];
+   bool first = true;
+   int exit_code = 0;
+   size_t command_count = sizeof(command_table) / sizeof(struct pgmoneta_command);
+   struct pgmoneta_parsed_command parsed;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!strcmp(path, "-"))
    {
-      int res;
-      SSL_CTX* ctx = SSL_get_SSL_CTX(s_ssl);
-      res = SSL_shutdown(s_ssl);
-      if (res == 0)
+      file = stdin;
+   }
+   else
+   {
+      file = fopen(path, "r");
+   }
+
+   if (file == NULL)
+   {
+      warnx("pgmoneta-cli: Could not open batch file '%s'", path);
+      return 1;
+   }
+
+   while (getline(&line, &line_size, file) != -1)
+   {
+      argc = batch_arguments(line, &argv[0], BATCH_MAX_ARGUMENTS);
+
+      if (argc == 0 || argv[0][0] == '#')
       {
-         SSL_shutdown(s_ssl);
+         continue;
+      }
+
+      memset(&parsed, 0, sizeof(parsed));
+
+      if (!parse_command(argc, &argv[0], 0, &parsed, command_table, command_count))
+      {
+         exit_code = 1;
+         continue;
+      }
+
+      /* The local management socket is closed by pgmoneta after each command */
+      if (local && !first)
+      {
+         pgmoneta_disconnect(*socket);
+         *socket = -1;
+
+         if (pgmoneta_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, socket))
+         {
+            exit_code = 1;
+            break;
+         }
+      }
+
+      first = false;
+
+      if (execute(ssl, *socket, 1, &parsed, compression, encryption, output_format))
+      {
+         exit_code = 1;
       }
-      SSL_free(s_ssl);
-      SSL_CTX_free(ctx);
    }
 
-   pgmoneta_disconnect(socket);
-   pgmoneta_stop_logging();
-   pgmoneta_destroy_shared_memory(shmem, size);
+   free(line);
 
-   if (do_free)
+   if (file != stdin)
    {
-      free(password);
+      fclose(file);
    }
 
-   if (verbose)
+   return exit_code;
+}
+
+static int
+batch_arguments(char* line, char** argv, int size)
+{
+   int argc = 0;
+   char* p = line;
+
+   while (*p != '\0' && argc < size)
    {
-      if (exit_code == 0)
+      while (isspace((unsigned char)*p))
       {
-         printf("Success (0)\n");
+         p++;
+      }
+
+      if (*p == '\0')
+      {
+         break;
+      }
+
+      if (*p == '"')
+      {
+         p++;
+         argv[argc++] = p;
+
+         while (*p != '\0' && *p != '"')
+         {
+            p++;
+         }
       }
       else
       {
-         printf("Error (%d)\n", exit_code);
+         argv[argc++] = p;
+
+         while (*p != '\0' && !isspace((unsigned char)*p))
+         {
+            p++;
+         }
+      }
+
+      if (*p != '\0')
+      {
+         *p = '\0';
+         p++;
       }
    }
 
-   return exit_code;
+   return argc;
 }
 
 static void
@@ -984,14 +1221,14 @@ static void
 help_list_backup(void)
 {
    printf("List backups for a server\n");
-   printf("  pgmoneta-cli list-backup <server>\n");
+   printf("  pgmoneta-cli list-backup <server> [[sort=asc|desc|limit=X|cursor=X|filter=X|fields=X],*]\n");
 }
 
 static void
 help_restore(void)
 {
    printf("Restore a backup for a server\n");
-   printf("  pgmoneta-cli restore <server> <timestamp|oldest|newest> [[current|name=X|xid=X|lsn=X|time=X|inclusive=X|timeline=X|action=X|primary|replica],*] <directory>\n");
+   printf("  pgmoneta-cli restore <server> <timestamp|oldest|newest> [[current|name=X|xid=X|lsn=X|time=X|inclusive=X|timeline=X|action=X|primary|replica|database=X|tablespace=X],*] <directory>\n");
 }
 
 static void
@@ -1022,6 +1259,34 @@ help_retain(void)
    printf("  pgmoneta-cli retain <server> <timestamp|oldest|newest>\n");
 }
 
+static void
+help_merge(void)
+{
+   printf("Merge an incremental backup and its parents into a full backup for a server\n");
+   printf("  pgmoneta-cli merge <server> <timestamp|oldest|newest>\n");
+}
+
+static void
+help_wal_fetch(void)
+{
+   printf("Fetch a WAL file from the archive of a server, for use as restore_command\n");
+   printf("  pgmoneta-cli wal-fetch <server> <file> <path>\n");
+}
+
+static void
+help_changes(void)
+{
+   printf("List the relations of a server modified since a backup, with the most modified first\n");
+   printf("  pgmoneta-cli changes <server> <timestamp|oldest|newest> [limit]\n");
+}
+
+static void
+help_retention(void)
+{
+   printf("List the backups and the WAL that the retention policy of a server deletes now, without deleting them\n");
+   printf("  pgmoneta-cli retention <server>\n");
+}
+
 static void
 help_expunge(void)
 {
@@ -1140,6 +1405,22 @@ display_helper(char* command)
    {
       help_retain();
    }
+   else if (!strcmp(command, COMMAND_MERGE))
+   {
+      help_merge();
+   }
+   else if (!strcmp(command, COMMAND_WAL_FETCH))
+   {
+      help_wal_fetch();
+   }
+   else if (!strcmp(command, COMMAND_CHANGES))
+   {
+      help_changes();
+   }
+   else if (!strcmp(command, COMMAND_RETENTION))
+   {
+      help_retention();
+   }
    else if (!strcmp(command, COMMAND_EXPUNGE))
    {
       help_expunge();
@@ -1215,9 +1496,9 @@ error:
 }
 
 static int
-list_backup(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format)
+list_backup(SSL* ssl, int socket, char* server, char* options, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
-   if (pgmoneta_management_request_list_backup(ssl, socket, server, compression, encryption, output_format))
+   if (pgmoneta_management_request_list_backup(ssl, socket, server, options, compression, encryption, output_format))
    {
       goto error;
    }
@@ -1454,6 +1735,121 @@ error:
    return 1;
 }
 
+static int
+merge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   if (pgmoneta_management_request_merge(ssl, socket, server, backup_id, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_result(ssl, socket, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+wal_fetch(SSL* ssl, int socket, char* server, char* file, char* path, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   bool status = false;
+   char* destination = NULL;
+   char cwd[MAX_PATH];
+   struct json* read = NULL;
+   struct json* outcome = NULL;
+
+   /* The restore_command runs in the data directory, which pgmoneta doesn't know */
+   if (path[0] != '/')
+   {
+      memset(&cwd[0], 0, sizeof(cwd));
+      if (getcwd(&cwd[0], sizeof(cwd)) == NULL)
+      {
+         goto error;
+      }
+
+      destination = pgmoneta_append(destination, &cwd[0]);
+      destination = pgmoneta_append_char(destination, '/');
+   }
+   destination = pgmoneta_append(destination, path);
+
+   if (pgmoneta_management_request_wal_fetch(ssl, socket, server, file, destination, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_management_read_json(ssl, socket, NULL, NULL, &read))
+   {
+      goto error;
+   }
+
+   outcome = (struct json*)pgmoneta_json_get(read, MANAGEMENT_CATEGORY_OUTCOME);
+   status = (bool)pgmoneta_json_get(outcome, MANAGEMENT_ARGUMENT_STATUS);
+
+   /* The restore_command must fail when the file isn't there */
+   if (!status)
+   {
+      goto error;
+   }
+
+   pgmoneta_json_destroy(read);
+   free(destination);
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(read);
+   free(destination);
+
+   return 1;
+}
+
+static int
+changes(SSL* ssl, int socket, char* server, char* backup_id, char* limit, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   if (pgmoneta_management_request_changes(ssl, socket, server, backup_id, limit, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_result(ssl, socket, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+retention(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   if (pgmoneta_management_request_retention(ssl, socket, server, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_result(ssl, socket, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
 static int
 expunge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
@@ -1870,7 +2266,7 @@ process_result(SSL* ssl, int socket, int32_t output_format)
    }
    else
    {
-      pgmoneta_json_print(read, FORMAT_JSON);
+      pgmoneta_json_print(read, json_lines ? FORMAT_JSON_COMPACT : FORMAT_JSON);
    }
 
    pgmoneta_json_destroy(read);
@@ -1929,7 +2325,7 @@ process_get_result(SSL* ssl, int socket, char* config_key, int32_t output_format
       }
       else
       {
-         pgmoneta_json_print(json_res, FORMAT_JSON);
+         pgmoneta_json_print(json_res, json_lines ? FORMAT_JSON_COMPACT : FORMAT_JSON);
       }
    }
    else
@@ -2322,6 +2718,18 @@ translate_command(int32_t cmd_code)
       case MANAGEMENT_RETAIN:
          command_output = pgmoneta_append(command_output, COMMAND_RETAIN);
          break;
+      case MANAGEMENT_MERGE:
+         command_output = pgmoneta_append(command_output, COMMAND_MERGE);
+         break;
+      case MANAGEMENT_WAL_FETCH:
+         command_output = pgmoneta_append(command_output, COMMAND_WAL_FETCH);
+         break;
+      case MANAGEMENT_CHANGES:
+         command_output = pgmoneta_append(command_output, COMMAND_CHANGES);
+         break;
+      case MANAGEMENT_RETENTION:
+         command_output = pgmoneta_append(command_output, COMMAND_RETENTION);
+         break;
       case MANAGEMENT_EXPUNGE:
          command_output = pgmoneta_append(command_output, COMMAND_EXPUNGE);
          break;
@@ -2455,6 +2863,12 @@ translate_encryption(int32_t encryption_code)
       case ENCRYPTION_AES_128_CTR:
          encryption_output = pgmoneta_append(encryption_output, "aes-128-ctr");
          break;
+      case ENCRYPTION_AES_256_GCM:
+         encryption_output = pgmoneta_append(encryption_output, "aes-256-gcm");
+         break;
+      case ENCRYPTION_CHACHA20_POLY1305:
+         encryption_output = pgmoneta_append(encryption_output, "chacha20-poly1305");
+         break;
       default:
          encryption_output = pgmoneta_append(encryption_output, "none");
          break;
@@ -2752,6 +3166,54 @@ translate_response_argument(struct json* response)
    free(translated_used_space);
 }
 
+static void
+translate_changes_argument(struct json* response)
+{
+   char* translated_delta = NULL;
+
+   translated_delta = pgmoneta_translate_file_size((uint64_t)pgmoneta_json_get(response, MANAGEMENT_ARGUMENT_DELTA));
+   if (translated_delta)
+   {
+      pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_DELTA, (uintptr_t)translated_delta, ValueString);
+   }
+
+   free(translated_delta);
+}
+
+static void
+translate_retention_argument(struct json* response)
+{
+   char* translated = NULL;
+   char* keys[] = {MANAGEMENT_ARGUMENT_BACKUP_SIZE, MANAGEMENT_ARGUMENT_WAL_SIZE, MANAGEMENT_ARGUMENT_RECLAIMED};
+   struct json* backups = NULL;
+   struct json_iterator* backup_it = NULL;
+
+   for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+   {
+      translated = pgmoneta_translate_file_size((uint64_t)pgmoneta_json_get(response, keys[i]));
+      if (translated)
+      {
+         pgmoneta_json_put(response, keys[i], (uintptr_t)translated, ValueString);
+      }
+      free(translated);
+   }
+
+   backups = (struct json*)pgmoneta_json_get(response, MANAGEMENT_ARGUMENT_BACKUPS);
+   pgmoneta_json_iterator_create(backups, &backup_it);
+   while (pgmoneta_json_iterator_next(backup_it))
+   {
+      struct json* backup = (struct json*)pgmoneta_value_data(backup_it->value);
+
+      translated = pgmoneta_translate_file_size((uint64_t)pgmoneta_json_get(backup, MANAGEMENT_ARGUMENT_BACKUP_SIZE));
+      if (translated)
+      {
+         pgmoneta_json_put(backup, MANAGEMENT_ARGUMENT_BACKUP_SIZE, (uintptr_t)translated, ValueString);
+      }
+      free(translated);
+   }
+   pgmoneta_json_iterator_destroy(backup_it);
+}
+
 static void
 translate_server_retention_argument(struct json* response, char* tag)
 {
@@ -2767,6 +3229,9 @@ translate_servers_argument(struct json* response)
    char* translated_workspace_size = NULL;
    char* translated_hotstandby_size = NULL;
    char* translated_server_size = NULL;
+   char* translated_progress_bytes = NULL;
+   char* translated_progress_throughput = NULL;
+   struct json* progress = NULL;
 
    translated_workspace_size = pgmoneta_translate_file_size((int64_t)pgmoneta_json_get(response,
                                                                                        MANAGEMENT_ARGUMENT_WORKSPACE_FREE_SPACE));
@@ -2792,6 +3257,25 @@ translate_servers_argument(struct json* response)
    translate_server_retention_argument(response, MANAGEMENT_ARGUMENT_RETENTION_MONTHS);
    translate_server_retention_argument(response, MANAGEMENT_ARGUMENT_RETENTION_YEARS);
 
+   progress = (struct json*)pgmoneta_json_get(response, MANAGEMENT_ARGUMENT_PROGRESS);
+   if (progress != NULL)
+   {
+      translated_progress_bytes = pgmoneta_translate_file_size((int64_t)pgmoneta_json_get(progress, MANAGEMENT_ARGUMENT_BYTES));
+      if (translated_progress_bytes)
+      {
+         pgmoneta_json_put(progress, MANAGEMENT_ARGUMENT_BYTES, (uintptr_t)translated_progress_bytes, ValueString);
+      }
+
+      translated_progress_throughput = pgmoneta_translate_file_size((int64_t)pgmoneta_json_get(progress, MANAGEMENT_ARGUMENT_THROUGHPUT));
+      if (translated_progress_throughput)
+      {
+         translated_progress_throughput = pgmoneta_append(translated_progress_throughput, "/s");
+         pgmoneta_json_put(progress, MANAGEMENT_ARGUMENT_THROUGHPUT, (uintptr_t)translated_progress_throughput, ValueString);
+      }
+   }
+
+   free(translated_progress_throughput);
+   free(translated_progress_bytes);
    free(translated_server_size);
    free(translated_hotstandby_size);
    free(translated_workspace_size);
@@ -2935,11 +3419,18 @@ translate_json_object(struct json* j)
             case MANAGEMENT_BACKUP:
             case MANAGEMENT_RESTORE:
             case MANAGEMENT_RETAIN:
+            case MANAGEMENT_MERGE:
             case MANAGEMENT_EXPUNGE:
             case MANAGEMENT_INFO:
             case MANAGEMENT_ANNOTATE:
                translate_backup_argument(response);
                break;
+            case MANAGEMENT_CHANGES:
+               translate_changes_argument(response);
+               break;
+            case MANAGEMENT_RETENTION:
+               translate_retention_argument(response);
+               break;
             case MANAGEMENT_STATUS:
                translate_response_argument(response);
                servers = (struct json*)pgmoneta_json_get(response, MANAGEMENT_ARGUMENT_SERVERS);
@@ -33,9 +33,90 @@
 extern "C" {
 #endif
 
+#include <deque.h>
+#include <info.h>
 #include <json.h>
+#include <page.h>
+#include <streamer.h>
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <zstd.h>
+
+#define TAR_STREAM_BUFFERS     8
+#define TAR_STREAM_BUFFER_SIZE (1024 * 1024)
+
+#define TAR_BACKUP_WINDOW 2
+
+/** @struct tar_totals
+ * Defines the totals of the files extracted from tar archives
+ */
+struct tar_totals
+{
+   size_t block_size; /**< The block size of the destination */
+   uint64_t bytes;    /**< The size of the files */
+   uint64_t disk;     /**< The size of the files and links on disk */
+   uint64_t files;    /**< The number of files */
+   uint64_t biggest;  /**< The size of the biggest file on disk */
+};
+
+/** @struct tar_stream
+ * Defines a tar archive that is extracted while it is received
+ */
+struct tar_stream
+{
+   pthread_mutex_t lock;                      /**< The lock */
+   pthread_cond_t readable;                   /**< Signaled when a buffer is queued */
+   pthread_cond_t writable;                   /**< Signaled when a buffer is released */
+   pthread_t thread;                          /**< The extraction thread */
+   char destination[MAX_PATH];                /**< The destination directory */
+   char* buffers[TAR_STREAM_BUFFERS];         /**< The buffers */
+   size_t sizes[TAR_STREAM_BUFFERS];          /**< The amount of data in each buffer */
+   int head;                                  /**< The buffer being filled */
+   int tail;                                  /**< The next buffer to extract */
+   int queued;                                /**< The number of queued buffers */
+   bool holding;                              /**< Is the tail buffer in use by the extraction */
+   bool done;                                 /**< All data has been written */
+   bool failed;                               /**< Has the extraction failed */
+   bool started;                              /**< Is the extraction thread running */
+   struct deque* hashes;                      /**< The SHA-256 of the extracted files, or NULL */
+   struct page_checksums* checksums;          /**< Verifies the page checksums of the relation files, or NULL */
+   struct tar_totals* totals;                 /**< Adds up the extracted files, or NULL */
+   ZSTD_DCtx* dctx;                           /**< Decompresses server side zstd as it is written, or NULL */
+};
+
+/** @struct tar_member
+ * Defines an entry of a tar archive that is written straight from a backup
+ */
+struct tar_member
+{
+   char from[MAX_PATH];       /**< The path in the backup */
+   char name[MAX_PATH];       /**< The path in the archive */
+   char link[MAX_PATH];       /**< The target of a link */
+   unsigned int type;         /**< The file type */
+   mode_t mode;               /**< The permissions */
+   size_t size;               /**< The size of the file */
+   bool decode;               /**< Is the file decrypted and decompressed */
+   bool ready;                /**< Has the file been decoded */
+   bool failed;               /**< Has the decoding failed */
+   char* data;                /**< The decoded file */
+   struct tar_backup* tar;    /**< The archive */
+};
+
+/** @struct tar_backup
+ * Defines a tar archive that is written straight from a backup. The workers
+ * decode the files ahead of the writer, which adds them in order
+ */
+struct tar_backup
+{
+   pthread_mutex_t lock;          /**< The lock */
+   pthread_cond_t decoded;        /**< Signaled when a file has been decoded */
+   struct tar_member** members;   /**< The entries */
+   int number_of_members;         /**< The number of entries */
+   struct streamer* streamer;     /**< The compression and encryption of the archive */
+};
 
 /**
  * Create an archive
@@ -50,13 +131,56 @@ void
 pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* request);
 
 /**
- * Extract from a tar file to a given directory
+ * Extract from a tar file to a given directory. With workers the headers are read in
+ * order, and the data of the regular files is copied out of the archive by the workers,
+ * in ranges for the large files. The caller waits for the workers
  * @param file_path The tar file path
  * @param destination The destination to extract to
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_extract_tar_file(char* file_path, char* destination, struct workers* workers);
+
+/**
+ * Create a tar stream that extracts to a given directory in the background.
+ * Server side zstd is decompressed by the writer, so the decompression runs
+ * next to the extraction instead of in front of it
+ * @param destination The destination to extract to
+ * @param compression The compression of the archive
+ * @param hashes The optional deque that receives the SHA-256 of each regular file, tagged by its path
+ * @param checksums The optional page checksums to verify on the relation files
+ * @param totals The optional totals that the extracted files are added to
+ * @param stream The resulting stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_tar_stream_create(char* destination, int compression, struct deque* hashes, struct page_checksums* checksums, struct tar_totals* totals, struct tar_stream** stream);
+
+/**
+ * Write tar data to the stream, waits while all buffers are in use
+ * @param stream The stream
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1 if the extraction has failed
+ */
+int
+pgmoneta_tar_stream_write(struct tar_stream* stream, void* data, size_t size);
+
+/**
+ * Finish the tar stream and wait for the extraction to complete
+ * @param stream The stream
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_extract_tar_file(char* file_path, char* destination);
+pgmoneta_tar_stream_finish(struct tar_stream* stream);
+
+/**
+ * Destroy the tar stream, finishing it if needed
+ * @param stream The stream
+ */
+void
+pgmoneta_tar_stream_destroy(struct tar_stream* stream);
 
 /**
  * Create a tar archive of the given directory
@@ -68,6 +192,19 @@ pgmoneta_extract_tar_file(char* file_path, char* destination);
 int
 pgmoneta_tar_directory(char* src, char* dst, char* destination);
 
+/**
+ * Create a tar archive of a full backup straight from the backup directory, without
+ * restoring it first. The files are decoded by the workers and the archive is compressed
+ * and encrypted while it is written
+ * @param server The server
+ * @param backup The backup
+ * @param dst The destination tar file path, the compression and encryption suffixes are added
+ * @param destination The destination name
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_tar_backup(int server, struct backup* backup, char* dst, char* destination);
+
 #ifdef __cplusplus
 }
 #endif
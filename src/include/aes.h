@@ -39,6 +39,36 @@ extern "C" {
 
 #include <openssl/ssl.h>
 
+#define AEAD_MAGIC        "PGMAEAD1"
+#define AEAD_MAGIC_SIZE   8
+#define AEAD_PREFIX_SIZE  8
+#define AEAD_NONCE_SIZE   12
+#define AEAD_TAG_SIZE     16
+#define AEAD_KEY_SIZE     32
+#define AEAD_HEADER_SIZE  24
+#define AEAD_CHUNK_SIZE   (1024 * 1024)
+
+/** @struct aead
+ * Defines a chunked authenticated encryption stream. The stream writes a header
+ * followed by chunks of at most chunk_size bytes, each sealed with its own tag
+ */
+struct aead
+{
+   int mode;                                             /**< The encryption mode */
+   EVP_CIPHER_CTX* ctx;                                  /**< The cipher context */
+   bool owner;                                           /**< Does the stream own the context and the buffers */
+   bool header;                                          /**< Has the header been written */
+   unsigned char prefix[AEAD_PREFIX_SIZE];               /**< The nonce prefix of the file */
+   uint32_t index;                                       /**< The index of the current chunk */
+   size_t chunk_size;                                    /**< The size of a chunk */
+   unsigned char* buffer;                                /**< The plaintext of the current chunk */
+   size_t length;                                        /**< The length of the current chunk */
+   unsigned char* out;                                   /**< The sealed chunk */
+   int (*output)(void* data, void* buffer, size_t size); /**< The output function */
+   void* data;                                           /**< The data of the output function */
+   unsigned char head[AEAD_HEADER_SIZE];                 /**< The header of a stream being opened */
+};
+
 /**
  * Encrypt a string
  * @param plaintext The string
@@ -66,11 +96,12 @@ pgmoneta_decrypt(char* ciphertext, int ciphertext_length, char* password, char**
 /**
  * Encrypt the files under the directory in place recursively, also remove unencrypted files.
  * @param d The data directory
+ * @param manifest The manifest listing the files (backup.manifest), or NULL to walk the directory
  * @param workers The optional workers
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_encrypt_data(char* d, struct workers* workers);
+pgmoneta_encrypt_data(char* d, char* manifest, struct workers* workers);
 
 /**
  * Encrypt the files under the tablespace directories in place recursively, also remove unencrypted files.
@@ -83,11 +114,12 @@ pgmoneta_encrypt_tablespaces(char* root, struct workers* workers);
 
 /**
  * Encrypt the files under the directory in place, also remove unencrypted files.
+ * @param server The server index
  * @param d The wal directory
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_encrypt_wal(char* d);
+pgmoneta_encrypt_wal(int server, char* d);
 
 /**
  * Encrypt a single file, also remove the original file
@@ -138,6 +170,17 @@ pgmoneta_decrypt_directory(char* d, struct workers* workers);
 void
 pgmoneta_decrypt_request(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
 
+/**
+ * Create a cipher context using the master key. The context produces
+ * the same output as the file based encryption
+ * @param mode The encryption mode
+ * @param enc 1 for encrypt, 0 for decrypt
+ * @param ctx The resulting context
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_cipher_context_create(int mode, int enc, EVP_CIPHER_CTX** ctx);
+
 /**
  *
  * Encrypt a buffer
@@ -164,6 +207,110 @@ pgmoneta_encrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsign
 int
 pgmoneta_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** dec_buffer, size_t* dec_size, int mode);
 
+/**
+ * Is the encryption mode an authenticated (chunked) mode
+ * @param mode The encryption mode
+ * @return True if the mode is aes-256-gcm or chacha20-poly1305, otherwise false
+ */
+bool
+pgmoneta_aead_mode(int mode);
+
+/**
+ * Create an authenticated encryption stream
+ * @param mode The encryption mode
+ * @param output The function receiving the encrypted data
+ * @param data The data passed to the output function
+ * @param aead The resulting stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_create(int mode, int (*output)(void* data, void* buffer, size_t size), void* data, struct aead** aead);
+
+/**
+ * Encrypt data with an authenticated encryption stream
+ * @param aead The stream
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_update(struct aead* aead, void* data, size_t size);
+
+/**
+ * Seal the final chunk of an authenticated encryption stream
+ * @param aead The stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_finish(struct aead* aead);
+
+/**
+ * Create an authenticated decryption stream. The mode and the chunk size
+ * are taken from the header of the data
+ * @param output The function receiving the decrypted data
+ * @param data The data passed to the output function
+ * @param aead The resulting stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_open_create(int (*output)(void* data, void* buffer, size_t size), void* data, struct aead** aead);
+
+/**
+ * Decrypt data with an authenticated decryption stream. Each chunk is
+ * authenticated before it is passed to the output function
+ * @param aead The stream
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_open_update(struct aead* aead, void* data, size_t size);
+
+/**
+ * Open the final chunk of an authenticated decryption stream
+ * @param aead The stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_open_finish(struct aead* aead);
+
+/**
+ * Destroy an authenticated encryption stream
+ * @param aead The stream
+ */
+void
+pgmoneta_aead_destroy(struct aead* aead);
+
+/**
+ * Is the file written with an authenticated encryption mode
+ * @param path The file
+ * @return True if the file starts with the header, otherwise false
+ */
+bool
+pgmoneta_aead_file(char* path);
+
+/**
+ * Get the plaintext size of a file written with an authenticated encryption mode
+ * @param path The file
+ * @param size The plaintext size
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_size(char* path, size_t* size);
+
+/**
+ * Decrypt a range of a file written with an authenticated encryption mode.
+ * Only the chunks covering the range are read and authenticated
+ * @param path The file
+ * @param offset The plaintext offset
+ * @param length The number of bytes to read
+ * @param buffer The buffer receiving the plaintext
+ * @param read The number of bytes read
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_aead_read(char* path, size_t offset, size_t length, void* buffer, size_t* read);
+
 #ifdef __cplusplus
 }
 #endif
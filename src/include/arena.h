@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_ARENA_H
+#define PGMONETA_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define ARENA_DEFAULT_SIZE (1024 * 1024)
+#define ARENA_ALIGNMENT    16
+#define ARENA_FREE_LISTS   64
+
+/** @struct arena_chunk
+ * Defines a chunk of an arena
+ */
+struct arena_chunk
+{
+   struct arena_chunk* next; /**< The next chunk */
+   size_t size;              /**< The size of the data */
+   size_t used;              /**< The number of bytes handed out */
+   char data[] __attribute__ ((aligned (64))); /**< The data */
+};
+
+/** @struct arena
+ * Defines an arena, where allocations are released all at once. Small allocations
+ * that are freed on their own are kept on free lists by size and reused
+ */
+struct arena
+{
+   size_t chunk_size;            /**< The size of a new chunk, doubling up to ARENA_DEFAULT_SIZE */
+   struct arena_chunk* chunks;   /**< The chunks */
+   struct arena_chunk* current;  /**< The chunk allocations are taken from */
+   void** free_lists;            /**< The free lists per ARENA_ALIGNMENT bytes of size, created on the first free */
+   bool thread_safe;             /**< If allocations and frees can come from many threads */
+   pthread_mutex_t lock;         /**< The lock of a thread safe arena */
+};
+
+/**
+ * Create an arena
+ * @param chunk_size The size of the first chunk, or 0 for the default
+ * @param thread_safe If allocations and frees can come from many threads, a reset or
+ *                    destroy still needs the other threads to be done with the arena
+ * @param arena The arena
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_arena_create(size_t chunk_size, bool thread_safe, struct arena** arena);
+
+/**
+ * Allocate zeroed memory from an arena. The memory is aligned to ARENA_ALIGNMENT, and
+ * to 64 bytes when every allocation of the arena is a multiple of 64 bytes
+ * @param arena The arena
+ * @param size The size
+ * @return The memory, or NULL upon failure
+ */
+void*
+pgmoneta_arena_alloc(struct arena* arena, size_t size);
+
+/**
+ * Give memory back to an arena, so a later allocation of the same size can reuse it
+ * @param arena The arena
+ * @param ptr The memory
+ * @param size The size it was allocated with
+ */
+void
+pgmoneta_arena_free(struct arena* arena, void* ptr, size_t size);
+
+/**
+ * Release all allocations of an arena, keeping its chunks for reuse
+ * @param arena The arena
+ */
+void
+pgmoneta_arena_reset(struct arena* arena);
+
+/**
+ * Destroy an arena
+ * @param arena The arena
+ */
+void
+pgmoneta_arena_destroy(struct arena* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
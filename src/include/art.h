@@ -33,6 +33,7 @@
 extern "C" {
 #endif
 
+#include <arena.h>
 #include <deque.h>
 #include <value.h>
 
@@ -51,6 +52,10 @@ struct art
 {
    struct art_node* root;                 /**< The root node of ART */
    uint64_t size;                         /**< The size of the ART */
+   struct arena* arena;                   /**< The arena of the nodes and leaves */
+   bool concurrent;                       /**< If the tree takes inserts and searches from many threads */
+   uint64_t version;                      /**< The version lock of the root pointer of a concurrent tree */
+   struct art_retired* retired;           /**< The values replaced in a concurrent tree */
 };
 
 /** @struct art_iterator
@@ -73,6 +78,32 @@ struct art_iterator
 int
 pgmoneta_art_create(struct art** tree);
 
+/**
+ * Initializes an adaptive radix tree that many threads can insert into and search at
+ * the same time, without a global lock. Searches never lock and inserts only lock the
+ * nodes they change. A replaced value is released when the tree is destroyed, since
+ * other threads may still use it. Printing reads a copy of the keys, so it can run next to
+ * the inserts. Deleting, clearing, iterating and destroying the tree must not run at the
+ * same time as any other operation
+ * @param tree [out] The tree
+ * @return 0 on success, 1 if otherwise
+ */
+int
+pgmoneta_art_create_concurrent(struct art** tree);
+
+/**
+ * Build an adaptive radix tree from keys in sorted order in a single pass,
+ * the keys are copied while the values are sometimes not(depending on value type)
+ * @param keys The keys, in strcmp order without duplicates
+ * @param values The values
+ * @param type The value type
+ * @param number_of_keys The number of keys
+ * @param tree [out] The tree
+ * @return 0 on success, 1 if the keys are not sorted
+ */
+int
+pgmoneta_art_create_sorted(char** keys, uintptr_t* values, enum value_type type, uint64_t number_of_keys, struct art** tree);
+
 /**
  * inserts a new value into the art tree,note that the key is copied while the value is sometimes not(depending on value type)
  * @param t The tree
@@ -130,6 +161,17 @@ pgmoneta_art_delete(struct art* t, char* key);
 int
 pgmoneta_art_clear(struct art* t);
 
+/**
+ * Call a function on every key value pair in the ART tree, in key order.
+ * The walk stops at the first call that doesn't return 0
+ * @param t The tree
+ * @param cb The callback
+ * @param data The data passed to the callback
+ * @return 0 on success, otherwise the value the callback returned
+ */
+int
+pgmoneta_art_iterate(struct art* t, art_callback cb, void* data);
+
 /**
  * Get the next key value pair into iterator
  * @param iter The iterator
@@ -51,14 +51,16 @@ void
 pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload);
 
 /**
- * List backups for a server
+ * List backups for a server from its catalog. The request can sort the backups by label,
+ * filter them, project their fields, and page through them with a limit and a cursor
  * @param client_fd The client
  * @param server The server
  * @param compression The compress method for wire protocol
  * @param encryption The encrypt method for wire protocol
  * @param payload The payload
+ * @return 0 upon success, otherwise 1
  */
-void
+int
 pgmoneta_list_backup(int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload);
 
 /**
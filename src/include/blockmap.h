@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_BLOCKMAP_H
+#define PGMONETA_BLOCKMAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+
+/* system */
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BLOCKMAP_INDEX "backup.blockmap"
+
+/** @struct blockmap_run
+ * Defines consecutive blocks whose newest version is held by the same incremental backup
+ */
+struct blockmap_run
+{
+   uint32_t start;           /**< The first block */
+   uint32_t count;           /**< The number of blocks */
+   char label[MISC_LENGTH];  /**< The label of the backup */
+};
+
+/** @struct blockmap
+ * Defines which backup of a chain holds the newest version of each block of a relation file
+ */
+struct blockmap
+{
+   char full[MISC_LENGTH];    /**< The label of the backup holding the full file, used for blocks outside the runs */
+   int number_of_runs;        /**< The number of runs */
+   struct blockmap_run* runs; /**< The runs, ordered by block */
+};
+
+/**
+ * Create the block map index of an incremental backup from the INCREMENTAL files
+ * in its data directory and the block map index of its parent
+ * @param server The server
+ * @param label The label of the incremental backup
+ * @param parent_label The label of the parent backup
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_blockmap_create(int server, char* label, char* parent_label);
+
+/**
+ * Read the block map index of a backup
+ * @param server The server
+ * @param label The label of the backup
+ * @param index The resulting index, keyed by the path relative to the data directory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_blockmap_read(int server, char* label, struct art** index);
+
+/**
+ * Get the block map of a relation file
+ * @param index The index
+ * @param relative The path relative to the data directory, without the INCREMENTAL prefix
+ * @param blockmap The resulting block map, NULL if the file isn't in the index
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_blockmap_get(struct art* index, char* relative, struct blockmap** blockmap);
+
+/**
+ * Get the label of the backup holding the newest version of a block
+ * @param blockmap The block map
+ * @param block The block number
+ * @return The label
+ */
+char*
+pgmoneta_blockmap_source(struct blockmap* blockmap, uint32_t block);
+
+/**
+ * Destroy a block map
+ * @param blockmap The block map
+ */
+void
+pgmoneta_blockmap_destroy(struct blockmap* blockmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
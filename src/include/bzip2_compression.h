@@ -41,11 +41,12 @@ extern "C" {
 /**
  * BZip a data directory
  * @param directory The directory
+ * @param manifest The manifest listing the files (backup.manifest), or NULL to walk the directory
  * @param workers The optional workers
  * @return 0 upon success, otherwise 1.
  */
 int
-pgmoneta_bzip2_data(char* directory, struct workers* workers);
+pgmoneta_bzip2_data(char* directory, char* manifest, struct workers* workers);
 
 /**
  * Compress tablespace directories
@@ -57,10 +58,11 @@ pgmoneta_bzip2_tablespaces(char* root, struct workers* workers);
 
 /**
  * BZip a WAL directory
+ * @param server The server index
  * @param directory The directory
  */
 void
-pgmoneta_bzip2_wal(char* directory);
+pgmoneta_bzip2_wal(int server, char* directory);
 
 /**
  * BUNZip a directory
@@ -91,6 +93,17 @@ pgmoneta_bzip2_request(SSL* ssl, int client_fd, uint8_t compression, uint8_t enc
 int
 pgmoneta_bzip2_file(char* from, char* to);
 
+/**
+ * BZip a file as independent streams that are compressed by the workers, and joined
+ * once the last one is done. A small file, or no workers, is compressed as a whole
+ * @param from The from name
+ * @param to The to name
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1.
+ */
+int
+pgmoneta_bzip2_file_split(char* from, char* to, struct workers* workers);
+
 /**
  * BUNZip decompress a single file, also remove the original file
  * @param ssl The SSL
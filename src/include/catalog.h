@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_CATALOG_H
+#define PGMONETA_CATALOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+#include <info.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#define CATALOG_MAGIC   "PGMCATLG"
+#define CATALOG_VERSION 1
+#define CATALOG_SUFFIX  ".catalog"
+
+/**
+ * Load the backups of a directory from its catalog. The catalog is next to
+ * the directory, and is only used when the modification time of the directory
+ * matches the one it was built from
+ * @param directory The backup directory of a server
+ * @param number_of_backups The number of backups
+ * @param backups The backups
+ * @return 0 upon success, otherwise 1 when the catalog is missing or stale
+ */
+int
+pgmoneta_catalog_load(char* directory, int* number_of_backups, struct backup*** backups);
+
+/**
+ * Store the backups of a directory in its catalog
+ * @param directory The backup directory of a server
+ * @param mtime The modification time of the directory before it was read
+ * @param number_of_backups The number of backups
+ * @param backups The backups
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_catalog_store(char* directory, struct timespec* mtime, int number_of_backups, struct backup** backups);
+
+/**
+ * Get the version of the backups of a directory. A new or a deleted backup
+ * changes the directory, and a changed backup.info rewrites the catalog, so
+ * the version changes with the backups
+ * @param directory The backup directory of a server
+ * @param version [out] The version
+ * @return 0 upon success, otherwise 1 when the catalog is missing
+ */
+int
+pgmoneta_catalog_version(char* directory, int64_t* version);
+
+/**
+ * Refresh a backup in the catalog after its backup.info has changed
+ * @param directory The directory of the backup
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_catalog_update(char* directory);
+
+/**
+ * Find a backup by its identifier. The backups are sorted by label, so a label
+ * or a prefix of one is found by a binary search
+ * @param number_of_backups The number of backups
+ * @param backups The backups, sorted by label
+ * @param identifier The identifier (oldest, newest, latest, a label or a prefix of a label)
+ * @return The index of the valid backup, otherwise -1
+ */
+int
+pgmoneta_catalog_search(int number_of_backups, struct backup** backups, char* identifier);
+
+/**
+ * Find the newest backup that ended before the recovery target of a position.
+ * The end positions and the end times follow the labels, so the backup is
+ * found by a binary search
+ * @param number_of_backups The number of backups
+ * @param backups The backups, sorted by label
+ * @param position The position with a lsn=X or a time=X target
+ * @param index [out] The index of the valid backup, or -1 if the position has no such target
+ * @return 0 upon success, otherwise 1 if no backup ended before the target
+ */
+int
+pgmoneta_catalog_target(int number_of_backups, struct backup** backups, char* position, int* index);
+
+/**
+ * Get the chain of a backup, from the backup itself to its full backup
+ * @param number_of_backups The number of backups
+ * @param backups The backups, sorted by label
+ * @param index The index of the backup
+ * @param chain [out] The indexes of the backups in the chain
+ * @param length [out] The length of the chain
+ * @return 0 upon success, otherwise 1 if a backup of the chain is missing or not valid
+ */
+int
+pgmoneta_catalog_chain(int number_of_backups, struct backup** backups, int index, int** chain, int* length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
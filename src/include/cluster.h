@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_CLUSTER_H
+#define PGMONETA_CLUSTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+/**
+ * Is the cluster mode enabled
+ * @return True if enabled, otherwise false
+ */
+bool
+pgmoneta_cluster_enabled(void);
+
+/**
+ * Join the cluster, and claim the first servers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_cluster_join(void);
+
+/**
+ * Renew the heartbeat of this node and the leases of its servers, give up the
+ * servers over its share of the alive nodes, and claim the free and expired ones
+ */
+void
+pgmoneta_cluster_balance(void);
+
+/**
+ * Leave the cluster, and release the leases of this node
+ */
+void
+pgmoneta_cluster_leave(void);
+
+/**
+ * Does this node own a server. Always true without the cluster mode
+ * @param server The server index
+ * @return True if owned, otherwise false
+ */
+bool
+pgmoneta_cluster_owns(int server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
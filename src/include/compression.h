@@ -29,6 +29,9 @@
 #ifndef PGMONETA_COMPRESSION_H
 #define PGMONETA_COMPRESSION_H
 
+#include <stdbool.h>
+#include <stdlib.h>
+
 typedef int (*compression_func)(char*, char*);
 
 /**
@@ -47,4 +50,52 @@ typedef int (*compression_func)(char*, char*);
 int
 pgmoneta_decompress(char* from, char* to);
 
+/**
+ * Start adapting the compression level of this process to the throughput target
+ * of a server, which is the lowest of backup_max_rate and network_max_rate.
+ * Nothing is adapted when the server has no target.
+ *
+ * @param server  The server
+ * @param minimum The fastest level
+ * @param maximum The strongest level
+ * @param level   The level to start from
+ */
+void
+pgmoneta_compression_adaptive_start(int server, int minimum, int maximum, int level);
+
+/**
+ * Get the compression level for the next file.
+ *
+ * @param level The level to use when no adaptation is active
+ *
+ * @return The level
+ */
+int
+pgmoneta_compression_adaptive_level(int level);
+
+/**
+ * Account for a compressed file, adjusting the level once a measurement window has passed.
+ *
+ * @param bytes The number of input bytes
+ */
+void
+pgmoneta_compression_adaptive_update(size_t bytes);
+
+/**
+ * Stop adapting the compression level.
+ */
+void
+pgmoneta_compression_adaptive_stop(void);
+
+/**
+ * Probe a file with samples of its content to see if it is worth compressing.
+ * Only probes when compression_probe is on.
+ *
+ * @param path The file
+ *
+ * @return True if the file should be stored as is, otherwise false
+ */
+bool
+pgmoneta_compression_incompressible(char* path);
+
 #endif //PGMONETA_COMPRESSION_H
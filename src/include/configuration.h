@@ -50,7 +50,16 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_MANAGEMENT             "management"
 #define CONFIGURATION_ARGUMENT_COMPRESSION            "compression"
 #define CONFIGURATION_ARGUMENT_COMPRESSION_LEVEL      "compression_level"
+#define CONFIGURATION_ARGUMENT_WAL_COMPRESSION        "wal_compression"
+#define CONFIGURATION_ARGUMENT_WAL_COMPRESSION_LEVEL  "wal_compression_level"
 #define CONFIGURATION_ARGUMENT_WORKERS                "workers"
+#define CONFIGURATION_ARGUMENT_WORKERS_PER_DEVICE     "workers_per_device"
+#define CONFIGURATION_ARGUMENT_WORKERS_AUTOSCALE      "workers_autoscale"
+#define CONFIGURATION_ARGUMENT_CPU_AFFINITY           "cpu_affinity"
+#define CONFIGURATION_ARGUMENT_MEMORY_BUDGET          "memory_budget"
+#define CONFIGURATION_ARGUMENT_BACKUP_DURABILITY      "backup_durability"
+#define CONFIGURATION_ARGUMENT_RESTORE_DURABILITY     "restore_durability"
+#define CONFIGURATION_ARGUMENT_BACKUP_SPLICE          "backup_splice"
 #define CONFIGURATION_ARGUMENT_STORAGE_ENGINE         "storage_engine"
 #define CONFIGURATION_ARGUMENT_ENCRYPTION             "encryption"
 #define CONFIGURATION_ARGUMENT_CREATE_SLOT            "create_slot"
@@ -76,6 +85,8 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX        "log_line_prefix"
 #define CONFIGURATION_ARGUMENT_LOG_MODE               "log_mode"
 #define CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT       "blocking_timeout"
+#define CONFIGURATION_ARGUMENT_MANAGEMENT_WORKERS     "management_workers"
+#define CONFIGURATION_ARGUMENT_AUTHENTICATION_TIMEOUT "authentication_timeout"
 #define CONFIGURATION_ARGUMENT_TLS                    "tls"
 #define CONFIGURATION_ARGUMENT_TLS_CERT_FILE          "tls_cert_file"
 #define CONFIGURATION_ARGUMENT_TLS_KEY_FILE           "tls_key_file"
@@ -86,20 +97,79 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_MANIFEST               "manifest"
 #define CONFIGURATION_ARGUMENT_KEEP_ALIVE             "keep_alive"
 #define CONFIGURATION_ARGUMENT_NODELAY                "nodelay"
+#define CONFIGURATION_ARGUMENT_SOCKET_BUFFER_SIZE     "socket_buffer_size"
+#define CONFIGURATION_ARGUMENT_KTLS                   "ktls"
 #define CONFIGURATION_ARGUMENT_NON_BLOCKING           "non_blocking"
 #define CONFIGURATION_ARGUMENT_BACKLOG                "backlog"
 #define CONFIGURATION_ARGUMENT_HUGEPAGE               "hugepage"
 #define CONFIGURATION_ARGUMENT_PIDFILE                "pidfile"
 #define CONFIGURATION_ARGUMENT_UPDATE_PROCESS_TITLE   "update_process_title"
+#define CONFIGURATION_ARGUMENT_WAL_STREAM_COMPRESSION "wal_stream_compression"
+#define CONFIGURATION_ARGUMENT_WAL_SYNCHRONOUS        "wal_synchronous"
+#define CONFIGURATION_ARGUMENT_WAL_PREALLOC           "wal_prealloc"
+#define CONFIGURATION_ARGUMENT_WAL_FANOUT_SIZE        "wal_fanout_size"
+#define CONFIGURATION_ARGUMENT_WAL_RECEIVERS          "wal_receivers"
+#define CONFIGURATION_ARGUMENT_BACKUP_PIPELINE        "backup_pipeline"
+#define CONFIGURATION_ARGUMENT_BACKUP_CONNECTIONS     "backup_connections"
+#define CONFIGURATION_ARGUMENT_SEEKABLE_FRAME_SIZE    "seekable_frame_size"
+#define CONFIGURATION_ARGUMENT_COMPRESSION_DICTIONARY "compression_dictionary"
+#define CONFIGURATION_ARGUMENT_COMPRESSION_ADAPTIVE   "compression_adaptive"
+#define CONFIGURATION_ARGUMENT_COMPRESSION_PROBE      "compression_probe"
+#define CONFIGURATION_ARGUMENT_DEDUPLICATION          "deduplication"
+#define CONFIGURATION_ARGUMENT_PAGE_FILTER            "page_filter"
+#define CONFIGURATION_ARGUMENT_LINK_VERIFY            "link_verify"
+#define CONFIGURATION_ARGUMENT_IO_ENGINE              "io_engine"
+#define CONFIGURATION_ARGUMENT_IO_CACHE               "io_cache"
+#define CONFIGURATION_ARGUMENT_GZIP_ENGINE            "gzip_engine"
+#define CONFIGURATION_ARGUMENT_SPARSE_FILES           "sparse_files"
+#define CONFIGURATION_ARGUMENT_WAL_PACK               "wal_pack"
+#define CONFIGURATION_ARGUMENT_WAL_COMPACTION         "wal_compaction"
+#define CONFIGURATION_ARGUMENT_VERIFY_MODE            "verify_mode"
+#define CONFIGURATION_ARGUMENT_VERIFY_SAMPLE          "verify_sample"
+#define CONFIGURATION_ARGUMENT_VERIFY_FAIL_FAST       "verify_fail_fast"
+#define CONFIGURATION_ARGUMENT_TRACE_SAMPLE           "trace_sample"
+#define CONFIGURATION_ARGUMENT_TRACE_EVENTS           "trace_events"
+#define CONFIGURATION_ARGUMENT_S3_PART_SIZE           "s3_part_size"
+#define CONFIGURATION_ARGUMENT_S3_CONCURRENCY         "s3_concurrency"
+#define CONFIGURATION_ARGUMENT_S3_UNSIGNED_PAYLOAD    "s3_unsigned_payload"
+#define CONFIGURATION_ARGUMENT_AZURE_BLOCK_SIZE       "azure_block_size"
+#define CONFIGURATION_ARGUMENT_WAL_ARCHIVE_QUEUE      "wal_archive_queue"
+#define CONFIGURATION_ARGUMENT_WAL_ARCHIVE_RETRIES    "wal_archive_retries"
+#define CONFIGURATION_ARGUMENT_SSH_RETRIES            "ssh_retries"
+#define CONFIGURATION_ARGUMENT_SSH_MANIFEST_DIFF      "ssh_manifest_diff"
+#define CONFIGURATION_ARGUMENT_STORAGE_MAX_RATE       "storage_max_rate"
+#define CONFIGURATION_ARGUMENT_RETENTION_LOCAL        "retention_local"
+#define CONFIGURATION_ARGUMENT_RETENTION_REMOTE       "retention_remote"
+#define CONFIGURATION_ARGUMENT_WAL_INDEX              "wal_index"
+#define CONFIGURATION_ARGUMENT_RESTORE_PREWARM        "restore_prewarm"
+#define CONFIGURATION_ARGUMENT_SCHEDULER_WORKERS      "scheduler_workers"
+#define CONFIGURATION_ARGUMENT_SCHEDULER_DISK         "scheduler_disk"
+#define CONFIGURATION_ARGUMENT_SCHEDULER_NETWORK      "scheduler_network"
+#define CONFIGURATION_ARGUMENT_DELETE_MAX_RATE        "delete_max_rate"
+#define CONFIGURATION_ARGUMENT_TOTAL_MAX_RATE         "total_max_rate"
+#define CONFIGURATION_ARGUMENT_MAX_RATE_BURST         "max_rate_burst"
+#define CONFIGURATION_ARGUMENT_WAL_PREFETCH           "wal_prefetch"
+#define CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE        "backup_schedule"
+#define CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE_JITTER "backup_schedule_jitter"
+#define CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE_MAX    "backup_schedule_max"
+#define CONFIGURATION_ARGUMENT_BACKUP_THROTTLE_LAG    "backup_throttle_lag"
+#define CONFIGURATION_ARGUMENT_BACKUP_THROTTLE_ACTIVE "backup_throttle_active"
+#define CONFIGURATION_ARGUMENT_BACKUP_THROTTLE_IO     "backup_throttle_io"
+#define CONFIGURATION_ARGUMENT_CLUSTER_DIR            "cluster_dir"
+#define CONFIGURATION_ARGUMENT_CLUSTER_NODE           "cluster_node"
+#define CONFIGURATION_ARGUMENT_CLUSTER_LEASE          "cluster_lease"
+#define CONFIGURATION_ARGUMENT_BACKUP_VOLUMES         "backup_volumes"
 #define CONFIGURATION_ARGUMENT_PORT                    "port"
 #define CONFIGURATION_ARGUMENT_USER                    "user"
 #define CONFIGURATION_ARGUMENT_WAL_SLOT                "wal_slot"
 #define CONFIGURATION_ARGUMENT_FOLLOW                  "follow"
 #define CONFIGURATION_ARGUMENT_WAL_SHIPPING            "wal_shipping"
+#define CONFIGURATION_ARGUMENT_BACKUP_STANDBYS         "backup_standbys"
 #define CONFIGURATION_ARGUMENT_WORKSPACE               "workspace"
 #define CONFIGURATION_ARGUMENT_HOT_STANDBY             "hot_standby"
 #define CONFIGURATION_ARGUMENT_HOT_STANDBY_OVERRIDES   "hot_standby_overrides"
 #define CONFIGURATION_ARGUMENT_HOT_STANDBY_TABLESPACES "hot_standby_tablespaces"
+#define CONFIGURATION_ARGUMENT_HOT_STANDBY_WAL         "hot_standby_wal"
 #define CONFIGURATION_ARGUMENT_EXTRA                   "extra"
 #define CONFIGURATION_ARGUMENT_MAIN_CONF_PATH          "main_configuration_path"
 #define CONFIGURATION_ARGUMENT_USER_CONF_PATH          "users_configuration_path"
@@ -172,6 +242,14 @@ pgmoneta_validate_admins_configuration(void* shmem);
 int
 pgmoneta_reload_configuration(bool* restart);
 
+/**
+ * Get the index of a server from the server index
+ * @param name The name of the server
+ * @return The index of the server, or -1 if there is no such server
+ */
+int
+pgmoneta_server_index(char* name);
+
 /**
  * Get a configuration parameter value
  * @param ssl The SSL connection
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_CRON_H
+#define PGMONETA_CRON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <json.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CRON_INTERVAL 10
+
+/** @struct cron
+ * Defines a parsed cron expression
+ */
+struct cron
+{
+   uint64_t minutes;  /**< The minutes 0-59 */
+   uint32_t hours;    /**< The hours 0-23 */
+   uint32_t days;     /**< The days of the month 1-31 */
+   uint16_t months;   /**< The months 1-12 */
+   uint8_t weekdays;  /**< The days of the week 0-6, Sunday is 0 */
+   bool any_day;      /**< Is the day of the month a wildcard */
+   bool any_weekday;  /**< Is the day of the week a wildcard */
+};
+
+/**
+ * Parse a cron expression of five fields, or one of @hourly, @daily, @weekly and @monthly
+ * @param expression The expression
+ * @param cron The resulting cron
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_cron_parse(char* expression, struct cron* cron);
+
+/**
+ * Does a cron match a time in the local time zone
+ * @param cron The cron
+ * @param t The time
+ * @return True if matching, otherwise false
+ */
+bool
+pgmoneta_cron_match(struct cron* cron, time_t t);
+
+/**
+ * Get the backup schedule of a server
+ * @param server The server index
+ * @return The cron expression, or an empty string if none
+ */
+char*
+pgmoneta_cron_backup_schedule(int server);
+
+/**
+ * Select the servers whose scheduled backup should start now. A server becomes due
+ * when its schedule matches, delayed by a random jitter, and due servers start with
+ * the oldest newest valid backup first within the backup_schedule_max cap
+ * @param now The current time
+ * @param servers The selected server indexes, at least NUMBER_OF_SERVERS elements
+ * @param number_of_servers The number of selected servers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_cron_backups(time_t now, int* servers, int* number_of_servers);
+
+/**
+ * Create the management payload of a scheduled backup
+ * @param server The server index
+ * @param payload The resulting payload
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_cron_backup_payload(int server, struct json** payload);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -51,7 +51,8 @@ struct csv_reader
  */
 struct csv_writer
 {
-   FILE* file; /**< The file */
+   FILE* file;  /**< The file */
+   bool stream; /**< Is the file owned by the caller, with buffered rows and quoted columns */
 };
 
 /**
@@ -99,6 +100,16 @@ pgmoneta_csv_reader_destroy(struct csv_reader* reader);
 int
 pgmoneta_csv_writer_init(char* path, struct csv_writer** writer);
 
+/**
+ * Create a csv writer on an open file, such as stdout. The rows are not flushed one
+ * by one, the columns are quoted when needed, and the file is not closed by the writer
+ * @param file The file
+ * @param writer The writer
+ * @return 0 on success, 1 if otherwise
+ */
+int
+pgmoneta_csv_writer_create(FILE* file, struct csv_writer** writer);
+
 /**
  * Write a row to csv file
  * @param writer The csv writer
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_DEDUP_H
+#define PGMONETA_DEDUP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+#include <workers.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define DEDUP_MAGIC        "PGMCDC01"
+#define DEDUP_MAGIC_SIZE   8
+#define DEDUP_HASH_SIZE    32
+#define DEDUP_ENTRY_SIZE   (DEDUP_HASH_SIZE + 4)
+#define DEDUP_HEADER_SIZE  (DEDUP_MAGIC_SIZE + 8 + 4)
+
+#define DEDUP_MINIMUM_CHUNK (4 * 1024)
+#define DEDUP_AVERAGE_BITS  14
+#define DEDUP_MAXIMUM_CHUNK (64 * 1024)
+#define DEDUP_MINIMUM_FILE  (64 * 1024)
+
+#define DEDUP_DIRECTORY  "chunks/"
+#define DEDUP_REFCOUNT   "refcount"
+#define DEDUP_REFERENCES "dedup.chunks"
+
+/**
+ * Deduplicate the files of a backup data directory against the chunk store of the server.
+ * Each file is split into content defined chunks, unknown chunks are added to the store
+ * and the file is replaced by a recipe listing its chunks. The chunks referenced by the
+ * backup are written to the backup directory and their reference counts are increased
+ * @param server The server
+ * @param backup_base The backup base directory
+ * @param backup_data The backup data directory
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_store(int server, char* backup_base, char* backup_data, struct workers* workers);
+
+/**
+ * Rebuild the files of a directory from their recipes
+ * @param server The server
+ * @param directory The directory
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_restore(int server, char* directory, struct workers* workers);
+
+/**
+ * Is the file a recipe
+ * @param path The file
+ * @return True if the file is a recipe, otherwise false
+ */
+bool
+pgmoneta_dedup_is_recipe(char* path);
+
+/**
+ * Read the chunks referenced by a backup
+ * @param backup_base The backup base directory
+ * @param hashes The hashes of the chunks
+ * @param number_of_hashes The number of hashes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_references(char* backup_base, unsigned char** hashes, size_t* number_of_hashes);
+
+/**
+ * Release chunks, chunks without references are removed from the store
+ * @param server The server
+ * @param hashes The hashes of the chunks
+ * @param number_of_hashes The number of hashes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_release(int server, unsigned char* hashes, size_t number_of_hashes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,6 +33,7 @@
 extern "C" {
 #endif
 
+#include <arena.h>
 #include <value.h>
 
 #include <pthread.h>
@@ -45,11 +46,22 @@ extern "C" {
 struct deque_node
 {
    struct value* data;      /**< The value */
+   struct value value;      /**< The storage of the value */
    char* tag;               /**< The tag */
    struct deque_node* next; /**< The next pointer */
    struct deque_node* prev; /**< The previous pointer */
 };
 
+/** @struct deque_cell
+ * Defines a cell of the ring of a lock free deque
+ */
+struct deque_cell
+{
+   uint64_t sequence;       /**< The position the cell is ready for */
+   struct value value;      /**< The value */
+   char* tag;               /**< The tag */
+};
+
 /** @struct deque
  * Defines a deque
  */
@@ -60,6 +72,11 @@ struct deque
    pthread_rwlock_t mutex;   /**< The mutex of the deque */
    struct deque_node* start; /**< The start node */
    struct deque_node* end;   /**< The end node */
+   struct arena* arena;      /**< The arena of the nodes */
+   struct deque_cell* ring;  /**< The ring of a lock free deque, or NULL */
+   uint64_t ring_mask;       /**< The number of cells of the ring minus one */
+   uint64_t ring_head;       /**< The position of the ring polled next */
+   uint64_t ring_tail;       /**< The position of the ring added next */
 };
 
 /** @struct deque_iterator
@@ -82,6 +99,19 @@ struct deque_iterator
 int
 pgmoneta_deque_create(bool thread_safe, struct deque** deque);
 
+/**
+ * Create a thread safe deque for many threads adding and polling at the same time.
+ * Adds and polls go through a lock free ring, and only take the lock when the ring
+ * is full or the values have been moved out of it. The other functions first move
+ * the ring into the deque under the lock, so iteration heavy uses are better off
+ * with pgmoneta_deque_create
+ * @param capacity The number of cells of the ring, rounded up to a power of two, or 0 for the default
+ * @param deque The deque
+ * @return 0 if success, otherwise 1
+ */
+int
+pgmoneta_deque_create_lock_free(uint32_t capacity, struct deque** deque);
+
 /**
  * Add a node to deque's tail, the tag will be copied
  * This function is thread safe
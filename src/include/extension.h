@@ -42,6 +42,19 @@ extern "C" {
 #define MAX_QUERY_LENGTH 16384
 #define PGMONETA_CHUNK_SIZE 8192
 
+#define EXT_FETCH_CHUNK_SIZE (1024 * 1024)
+
+/** @struct ext_fetch
+ * Defines a file fetched from the server
+ */
+struct ext_fetch
+{
+   char* path;   /**< The path on the server */
+   char* dest;   /**< The path of the copy */
+   size_t size;  /**< The number of bytes fetched */
+   bool missing; /**< Was the file missing on the server */
+};
+
 /**
  * Check if the server has the extension installed
  * @param ssl The SSL structure
@@ -126,6 +139,31 @@ pgmoneta_ext_get_files(SSL* ssl, int socket, const char* file_path, struct query
 int
 pgmoneta_ext_send_file_chunk(SSL* ssl, int socket, const char* dest_path, char* base64_data, struct query_response** qr);
 
+/**
+ * Fetch a file with a binary COPY of pg_read_binary_file(), which sends the
+ * file in chunks of EXT_FETCH_CHUNK_SIZE bytes without an encoding
+ * @param ssl The SSL structure
+ * @param socket The socket
+ * @param fetch The file, whose size and missing flag are set
+ * @param bucket The rate limit bucket, or NULL
+ * @param network_bucket The network rate limit bucket, or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_ext_fetch_file(SSL* ssl, int socket, struct ext_fetch* fetch, struct token_bucket* bucket, struct token_bucket* network_bucket);
+
+/**
+ * Fetch files over several connections, one worker thread for each
+ * @param ssl The SSL structures
+ * @param sockets The sockets
+ * @param number_of_connections The number of connections
+ * @param files The files
+ * @param number_of_files The number of files
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_ext_fetch_files(SSL** ssl, int* sockets, int number_of_connections, struct ext_fetch* files, int number_of_files);
+
 /**
  * Promote a standby (replica) server to become the primary server
  * @param ssl The SSL structure
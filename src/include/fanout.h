@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_FANOUT_H
+#define PGMONETA_FANOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define FANOUT_MAX_SINKS 4
+
+#define FANOUT_EVENT_OPEN  0
+#define FANOUT_EVENT_DATA  1
+#define FANOUT_EVENT_CLOSE 2
+
+struct fanout;
+
+/** @struct fanout_sink
+ * Defines a target that receives a copy of the WAL stream
+ */
+struct fanout_sink
+{
+   char name[MISC_LENGTH];                                              /**< The name of the sink */
+   int (*open)(struct fanout_sink* sink, char* filename, int segsize);  /**< Open a segment */
+   int (*write)(struct fanout_sink* sink, void* data, size_t size);     /**< Write to the segment */
+   int (*close)(struct fanout_sink* sink, char* filename, bool partial); /**< Close the segment */
+   void* data;                                                          /**< The sink specific data */
+   atomic_ullong* lag;                                                  /**< The lag in bytes, or NULL */
+   struct fanout* fanout;                                               /**< The fan-out */
+   pthread_t thread;                                                    /**< The thread draining the ring */
+   uint64_t tail;                                                       /**< The position consumed by the sink */
+   bool failed;                                                         /**< Has the sink failed */
+};
+
+/** @struct fanout
+ * Defines a fan-out of a stream to several sinks through a shared ring buffer.
+ * The producer copies the data once into the ring, and every sink drains it on its
+ * own thread. The producer blocks when the slowest sink is a full ring behind.
+ * Without a ring the sinks are called synchronously
+ */
+struct fanout
+{
+   pthread_mutex_t lock;                          /**< The lock */
+   pthread_cond_t readable;                       /**< Signaled when data is added */
+   pthread_cond_t writable;                       /**< Signaled when data is consumed */
+   unsigned char* ring;                           /**< The ring buffer */
+   size_t capacity;                               /**< The capacity of the ring buffer */
+   uint64_t head;                                 /**< The position written by the producer */
+   bool done;                                     /**< Is the producer done */
+   int number_of_sinks;                           /**< The number of sinks */
+   struct fanout_sink* sinks[FANOUT_MAX_SINKS];   /**< The sinks */
+};
+
+/**
+ * Create a fan-out
+ * @param capacity The capacity of the ring buffer, 0 for synchronous sinks
+ * @param fanout The resulting fan-out
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_fanout_create(size_t capacity, struct fanout** fanout);
+
+/**
+ * Add a sink to a fan-out, and start draining for it
+ * @param fanout The fan-out
+ * @param sink The sink, the sink and its data are freed by the fan-out
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_fanout_add(struct fanout* fanout, struct fanout_sink* sink);
+
+/**
+ * Open a segment on all sinks
+ * @param fanout The fan-out
+ * @param filename The segment name
+ * @param segsize The segment size
+ * @return 0 upon success, otherwise 1 if a sink has failed
+ */
+int
+pgmoneta_fanout_open(struct fanout* fanout, char* filename, int segsize);
+
+/**
+ * Write data to all sinks
+ * @param fanout The fan-out
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1 if a sink has failed
+ */
+int
+pgmoneta_fanout_write(struct fanout* fanout, void* data, size_t size);
+
+/**
+ * Close a segment on all sinks
+ * @param fanout The fan-out
+ * @param filename The segment name
+ * @param partial Is the segment incomplete
+ * @return 0 upon success, otherwise 1 if a sink has failed
+ */
+int
+pgmoneta_fanout_close(struct fanout* fanout, char* filename, bool partial);
+
+/**
+ * Destroy a fan-out. The sinks drain the ring before they are freed
+ * @param fanout The fan-out
+ */
+void
+pgmoneta_fanout_destroy(struct fanout* fanout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
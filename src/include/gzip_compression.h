@@ -41,11 +41,12 @@ extern "C" {
 /**
  * GZip a data directory
  * @param directory The directory
+ * @param manifest The manifest listing the files (backup.manifest), or NULL to walk the directory
  * @param workers The optional workers
  * @return 0 upon success, otherwise 1.
  */
 int
-pgmoneta_gzip_data(char* directory, struct workers* workers);
+pgmoneta_gzip_data(char* directory, char* manifest, struct workers* workers);
 
 /**
  * GZip tablespace directories
@@ -57,10 +58,11 @@ pgmoneta_gzip_tablespaces(char* root, struct workers* workers);
 
 /**
  * GZip a WAL directory
+ * @param server The server index
  * @param directory The directory
  */
 void
-pgmoneta_gzip_wal(char* directory);
+pgmoneta_gzip_wal(int server, char* directory);
 
 /**
  * GZip a single file, also remove the original file
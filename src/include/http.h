@@ -43,6 +43,8 @@ extern "C" {
 #define HTTP_GET 0
 #define HTTP_PUT 1
 
+#define HTTP_RETRIES 3
+
 /**
  * Add a header
  * @param chunk A linked list of strings
@@ -80,6 +82,33 @@ pgmoneta_http_set_request_option(CURL* handle, bool request_type);
 int
 pgmoneta_http_set_url_option(CURL* handle, char* url);
 
+/**
+ * Create an easy handle. A handle keeps its connections open between requests,
+ * the handles of a process share their DNS cache and TLS sessions, and HTTP/2
+ * is used when the server offers it
+ * @return The handle, or NULL
+ */
+CURL*
+pgmoneta_http_handle_create(void);
+
+/**
+ * Reset a handle for the next request. The open connections are kept
+ * @param handle The handle
+ */
+void
+pgmoneta_http_handle_reset(CURL* handle);
+
+/**
+ * Perform a request, and retry it with backoff when it fails on the network
+ * or with HTTP 429 or 5xx. The request must not upload through a read callback
+ * @param handle The handle
+ * @param out The stream of the response, it is rewound for a retry, or NULL
+ * @param code The HTTP response code
+ * @return The result of the last attempt
+ */
+CURLcode
+pgmoneta_http_perform(CURL* handle, FILE* out, long* code);
+
 #ifdef __cplusplus
 }
 #endif
@@ -43,6 +43,7 @@ extern "C" {
 #define INFO_PGMONETA_VERSION          "PGMONETA_VERSION"
 #define INFO_BACKUP                    "BACKUP"
 #define INFO_BIGGEST_FILE              "BIGGEST_FILE"
+#define INFO_CHECKSUM_FAILURES         "CHECKSUM_FAILURES"
 #define INFO_CHKPT_WALPOS              "CHKPT_WALPOS"
 #define INFO_COMMENTS                  "COMMENTS"
 #define INFO_COMPRESSION               "COMPRESSION"
@@ -58,6 +59,9 @@ extern "C" {
 #define INFO_REMOTE_SSH_ELAPSED        "REMOTE_SSH_ELAPSED"
 #define INFO_REMOTE_S3_ELAPSED         "REMOTE_S3_ELAPSED"
 #define INFO_REMOTE_AZURE_ELAPSED      "REMOTE_AZURE_ELAPSED"
+#define INFO_DEDUPLICATION             "DEDUPLICATION"
+#define INFO_DICTIONARY                "DICTIONARY"
+#define INFO_DURABLE                   "DURABLE"
 #define INFO_ENCRYPTION                "ENCRYPTION"
 #define INFO_END_TIMELINE              "END_TIMELINE"
 #define INFO_END_WALPOS                "END_WALPOS"
@@ -67,6 +71,7 @@ extern "C" {
 #define INFO_LABEL                     "LABEL"
 #define INFO_MAJOR_VERSION             "MAJOR_VERSION"
 #define INFO_MINOR_VERSION             "MINOR_VERSION"
+#define INFO_PAGE_FILTER               "PAGE_FILTER"
 #define INFO_RESTORE                   "RESTORE"
 #define INFO_START_TIMELINE            "START_TIMELINE"
 #define INFO_START_WALPOS              "START_WALPOS"
@@ -124,12 +129,29 @@ struct backup
    int hash_algorithm;                                            /**< The hash algorithm for the manifest */
    int compression;                                               /**< The compression type */
    int encryption;                                                /**< The encryption type */
+   uint32_t dictionary;                                           /**< The zstd dictionary identifier, 0 for none */
+   bool deduplication;                                            /**< Are the data files stored in the chunk store */
+   bool page_filter;                                              /**< Are the relation files packed by the page filter */
+   uint64_t checksum_failures;                                    /**< The number of pages that failed the checksum verification */
+   bool durable;                                                  /**< Was the backup synced to disk */
    char comments[MAX_COMMENT];                                    /**< The comments */
    char extra[MAX_EXTRA_PATH];                                    /**< The extra directory */
    int type;                                                      /**< The backup type */
    char parent_label[MISC_LENGTH];                                /**< The label of backup's parent, only used when backup is incremental */
 } __attribute__ ((aligned (64)));
 
+/** @struct info_batch
+ * Defines a set of backup information updates that are written at once
+ */
+struct info_batch
+{
+   char directory[MAX_PATH]; /**< The backup directory */
+   int number_of_keys;       /**< The number of keys */
+   int capacity;             /**< The capacity of the arrays */
+   char** keys;              /**< The keys, in file order */
+   char** values;            /**< The values */
+};
+
 /**
  * Create a backup information file
  * @param directory The backup directory
@@ -139,6 +161,66 @@ struct backup
 void
 pgmoneta_create_info(char* directory, char* label, int status);
 
+/**
+ * Begin a batch of backup information updates
+ * @param directory The backup directory
+ * @param batch The resulting batch
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_info_begin(char* directory, struct info_batch** batch);
+
+/**
+ * Set a key in a batch: unsigned long
+ * @param batch The batch
+ * @param key The key
+ * @param value The value
+ */
+void
+pgmoneta_info_set_unsigned_long(struct info_batch* batch, char* key, unsigned long value);
+
+/**
+ * Set a key in a batch: float
+ * @param batch The batch
+ * @param key The key
+ * @param value The value
+ */
+void
+pgmoneta_info_set_double(struct info_batch* batch, char* key, double value);
+
+/**
+ * Set a key in a batch: string
+ * @param batch The batch
+ * @param key The key
+ * @param value The value
+ */
+void
+pgmoneta_info_set_string(struct info_batch* batch, char* key, char* value);
+
+/**
+ * Set a key in a batch: bool
+ * @param batch The batch
+ * @param key The key
+ * @param value The value
+ */
+void
+pgmoneta_info_set_bool(struct info_batch* batch, char* key, bool value);
+
+/**
+ * Write a batch to backup.info in one step, and destroy it
+ * @param batch The batch
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_info_commit(struct info_batch* batch);
+
+/**
+ * Destroy a batch without writing it
+ * @param batch The batch
+ */
+void
+pgmoneta_info_abort(struct info_batch* batch);
+
 /**
  * Update backup information: unsigned long
  * @param directory The backup directory
@@ -282,8 +364,9 @@ pgmoneta_get_backup_child(int server, struct backup* backup, struct backup** chi
  * @param compression The compress method for wire protocol
  * @param encryption The encrypt method for wire protocol
  * @param payload The payload
+ * @return 0 upon success, otherwise 1
  */
-void
+int
 pgmoneta_info_request(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload);
 
 /**
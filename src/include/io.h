@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_IO_H
+#define PGMONETA_IO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define IO_QUEUE_DEPTH  16
+#define IO_BUFFER_SIZE  (256 * 1024)
+#define IO_SQPOLL_IDLE  1000
+
+#define IO_DIRECT_SIZE  (64 * 1024 * 1024)
+#define IO_DIRECT_ALIGN 4096
+
+struct io_ring;
+
+/** @struct io_reader
+ * Defines a sequential reader that keeps reads in flight ahead of the consumer
+ */
+struct io_reader
+{
+   int fd;                           /**< The file descriptor */
+   struct io_ring* ring;             /**< The ring, or NULL for plain reads */
+   off_t start;                      /**< The offset where reading started */
+   off_t size;                       /**< The offset where reading stops */
+   off_t next;                       /**< The offset of the next read */
+   int head;                         /**< The slot that is consumed next */
+   size_t consumed;                  /**< The bytes of the head slot already consumed */
+   off_t offsets[IO_QUEUE_DEPTH];    /**< The file offset of each slot */
+   size_t lengths[IO_QUEUE_DEPTH];   /**< The bytes wanted by each slot */
+   size_t filled[IO_QUEUE_DEPTH];    /**< The bytes read into each slot */
+   bool active[IO_QUEUE_DEPTH];      /**< Does the slot hold a chunk of the file */
+   bool pending[IO_QUEUE_DEPTH];     /**< Is a read in flight for the slot */
+   bool error;                       /**< Did a read fail */
+   char* direct;                     /**< The aligned buffer of O_DIRECT reads, or NULL */
+   off_t direct_offset;              /**< The file offset of the aligned buffer */
+   size_t direct_filled;             /**< The bytes read into the aligned buffer */
+};
+
+/**
+ * Is the io_uring engine configured and usable by the calling thread.
+ * The ring is created on first use and cached with the worker
+ * @return True if io_uring can be used, otherwise false
+ */
+bool
+pgmoneta_io_uring_available(void);
+
+/**
+ * Copy a file through the io_uring engine, with many reads and writes in flight
+ * @param fd_from The source file descriptor
+ * @param fd_to The destination file descriptor
+ * @param size The number of bytes to copy
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_io_copy(int fd_from, int fd_to, off_t size);
+
+/**
+ * Drop the pages of a file from the page cache when io_cache is drop or direct.
+ * The pages of a written file are written back first, so they can be dropped
+ * @param fd The file descriptor
+ * @param written Was the file written
+ */
+void
+pgmoneta_io_drop(int fd, bool written);
+
+/**
+ * Open a file for sequential reading. The io_uring engine is used
+ * when it is available, otherwise plain reads are done. With io_cache = direct
+ * a large file is read with O_DIRECT through an aligned buffer
+ * @param path The path of the file
+ * @param offset The offset to start reading from
+ * @param length The number of bytes to read, or 0 for the rest of the file
+ * @param reader The resulting reader
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_io_reader_open(char* path, off_t offset, size_t length, struct io_reader** reader);
+
+/**
+ * Read the next bytes of a file, like fread()
+ * @param reader The reader
+ * @param buffer The buffer
+ * @param length The number of bytes wanted
+ * @return The number of bytes read, less than length at the end of the file or upon error
+ */
+size_t
+pgmoneta_io_reader_read(struct io_reader* reader, void* buffer, size_t length);
+
+/**
+ * Did a read of the reader fail
+ * @param reader The reader
+ * @return True upon error, otherwise false
+ */
+bool
+pgmoneta_io_reader_error(struct io_reader* reader);
+
+/**
+ * Close a reader, waiting for reads that are still in flight
+ * @param reader The reader
+ */
+void
+pgmoneta_io_reader_close(struct io_reader* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -40,6 +40,9 @@ extern "C" {
 
 /* System */
 #include <stdarg.h>
+#include <stdio.h>
+
+#define JSON_WRITER_FLUSH_SIZE 65536
 
 enum json_type {
    JSONUnknown,
@@ -73,6 +76,18 @@ struct json
    void* elements;                /**< The json elements, could be an array or some kv pairs */
 };
 
+/** @struct json_writer
+ * Defines a streaming json writer. The document is serialized straight into
+ * a growable buffer, which is flushed to the file when there is one
+ */
+struct json_writer
+{
+   char* buffer;    /**< The buffer */
+   size_t size;     /**< The number of bytes in the buffer */
+   size_t capacity; /**< The capacity of the buffer */
+   FILE* file;      /**< The file, or NULL to keep the whole document in the buffer */
+};
+
 /** @struct json_reader
  * Defines a JSON reader
  */
@@ -305,6 +320,50 @@ pgmoneta_json_read_file(char* path, struct json** obj);
 int
 pgmoneta_json_write_file(char* path, struct json* obj);
 
+/**
+ * Create a json writer
+ * @param file The file to write to, or NULL to keep the document in memory
+ * @param writer [out] The writer
+ * @return 0 if success, 1 if otherwise
+ */
+int
+pgmoneta_json_writer_create(FILE* file, struct json_writer** writer);
+
+/**
+ * Serialize a json object into the writer in a single pass
+ * @param writer The writer
+ * @param object The json object
+ * @param format The format, FORMAT_JSON or FORMAT_JSON_COMPACT
+ * @param tag The optional tag
+ * @param indent The indent
+ * @return 0 if success, 1 if otherwise
+ */
+int
+pgmoneta_json_writer_write(struct json_writer* writer, struct json* object, int32_t format, char* tag, int indent);
+
+/**
+ * Flush the buffered bytes to the file of the writer
+ * @param writer The writer
+ * @return 0 if success, 1 if otherwise
+ */
+int
+pgmoneta_json_writer_flush(struct json_writer* writer);
+
+/**
+ * Take the document out of an in memory writer, the writer is left empty
+ * @param writer The writer
+ * @return The string, which the caller must free
+ */
+char*
+pgmoneta_json_writer_take(struct json_writer* writer);
+
+/**
+ * Destroy a json writer, without flushing it
+ * @param writer The writer
+ */
+void
+pgmoneta_json_writer_destroy(struct json_writer* writer);
+
 #ifdef __cplusplus
 }
 #endif
@@ -52,9 +52,11 @@ int
 pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* changed, struct art* added, struct workers* workers);
 
 /**
- * Relink link two directories
- * @param from The from directory
- * @param to The to directory
+ * Relink the files of a newer backup that link into a backup which is about to be
+ * deleted. Only the links into the deleted backup are visited, and its files are
+ * moved into the newer backup instead of copied
+ * @param from The from directory, the deleted backup
+ * @param to The to directory, the newer backup
  * @param workers The optional workers
  * @return 0 upon success, otherwise 1
  */
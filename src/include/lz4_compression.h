@@ -40,14 +40,18 @@ extern "C" {
 
 #define BLOCK_BYTES 1024 * 4
 
+#define LZ4_ADAPTIVE_MINIMUM 1
+#define LZ4_ADAPTIVE_MAXIMUM 8
+
 /**
  * Compress a data directory with Lz4
  * @param directory The directory
+ * @param manifest The manifest listing the files (backup.manifest), or NULL to walk the directory
  * @param workers The optional workers
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_lz4c_data(char* directory, struct workers* workers);
+pgmoneta_lz4c_data(char* directory, char* manifest, struct workers* workers);
 
 /**
  * Compress tablespace directories
@@ -59,10 +63,11 @@ pgmoneta_lz4c_tablespaces(char* root, struct workers* workers);
 
 /**
  * Compress a WAL directory with Lz4
+ * @param server The server index
  * @param directory The directory
  */
 void
-pgmoneta_lz4c_wal(char* directory);
+pgmoneta_lz4c_wal(int server, char* directory);
 
 /**
  * Decompress a Lz4 directory
@@ -89,6 +89,10 @@ extern "C" {
 #define MANAGEMENT_UPDATE_USER    26
 #define MANAGEMENT_REMOVE_USER    27
 #define MANAGEMENT_LIST_USERS     28
+#define MANAGEMENT_MERGE          29
+#define MANAGEMENT_WAL_FETCH      30
+#define MANAGEMENT_CHANGES        31
+#define MANAGEMENT_RETENTION      32
 
 /**
  * Management categories
@@ -102,11 +106,16 @@ extern "C" {
  * Management arguments
  */
 #define MANAGEMENT_ARGUMENT_ACTION                "Action"
+#define MANAGEMENT_ARGUMENT_ACTIVE                "Active"
 #define MANAGEMENT_ARGUMENT_ALL                   "All"
+#define MANAGEMENT_ARGUMENT_ALIVE                 "Alive"
 #define MANAGEMENT_ARGUMENT_BACKUP                "Backup"
 #define MANAGEMENT_ARGUMENT_BACKUPS               "Backups"
 #define MANAGEMENT_ARGUMENT_BACKUP_SIZE           "BackupSize"
 #define MANAGEMENT_ARGUMENT_BIGGEST_FILE_SIZE     "BiggestFileSize"
+#define MANAGEMENT_ARGUMENT_BLOCKS                "Blocks"
+#define MANAGEMENT_ARGUMENT_BUSY                  "Busy"
+#define MANAGEMENT_ARGUMENT_BYTES                 "Bytes"
 #define MANAGEMENT_ARGUMENT_CALCULATED            "Calculated"
 #define MANAGEMENT_ARGUMENT_CHECKPOINT_HILSN      "CheckpointHiLSN"
 #define MANAGEMENT_ARGUMENT_CHECKPOINT_LOLSN      "CheckpointLoLSN"
@@ -119,6 +128,8 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_COMPRESSION           "Compression"
 #define MANAGEMENT_ARGUMENT_CONFIG_KEY            "ConfigKey"
 #define MANAGEMENT_ARGUMENT_CONFIG_VALUE          "ConfigValue"
+#define MANAGEMENT_ARGUMENT_CREATED               "Created"
+#define MANAGEMENT_ARGUMENT_CURSOR                "Cursor"
 #define MANAGEMENT_ARGUMENT_DELTA                 "Delta"
 #define MANAGEMENT_ARGUMENT_DESTINATION_FILE      "DestinationFile"
 #define MANAGEMENT_ARGUMENT_DIRECTORY             "Directory"
@@ -130,34 +141,51 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_END_TIMELINE          "EndTimeline"
 #define MANAGEMENT_ARGUMENT_ERROR                 "Error"
 #define MANAGEMENT_ARGUMENT_FAILED                "Failed"
+#define MANAGEMENT_ARGUMENT_FIELDS                "Fields"
 #define MANAGEMENT_ARGUMENT_FILENAME              "FileName"
 #define MANAGEMENT_ARGUMENT_FILES                 "Files"
+#define MANAGEMENT_ARGUMENT_FILTER                "Filter"
 #define MANAGEMENT_ARGUMENT_FREE_SPACE            "FreeSpace"
 #define MANAGEMENT_ARGUMENT_HASH_ALGORITHM        "HashAlgorithm"
 #define MANAGEMENT_ARGUMENT_HOT_STANDBY_SIZE      "HotStandbySize"
+#define MANAGEMENT_ARGUMENT_IDLE                  "Idle"
 #define MANAGEMENT_ARGUMENT_INCREMENTAL           "Incremental"
 #define MANAGEMENT_ARGUMENT_INCREMENTAL_PARENT    "IncrementalParent"
 #define MANAGEMENT_ARGUMENT_KEEP                  "Keep"
 #define MANAGEMENT_ARGUMENT_KEY                   "Key"
+#define MANAGEMENT_ARGUMENT_LIMIT                 "Limit"
 #define MANAGEMENT_ARGUMENT_MAJOR_VERSION         "MajorVersion"
 #define MANAGEMENT_ARGUMENT_MINOR_VERSION         "MinorVersion"
+#define MANAGEMENT_ARGUMENT_NEXT_CURSOR           "NextCursor"
+#define MANAGEMENT_ARGUMENT_NODE                  "Node"
+#define MANAGEMENT_ARGUMENT_NODES                 "Nodes"
 #define MANAGEMENT_ARGUMENT_NUMBER_OF_BACKUPS     "NumberOfBackups"
+#define MANAGEMENT_ARGUMENT_NUMBER_OF_NODES       "NumberOfNodes"
+#define MANAGEMENT_ARGUMENT_NUMBER_OF_RELATIONS   "NumberOfRelations"
 #define MANAGEMENT_ARGUMENT_NUMBER_OF_SERVERS     "NumberOfServers"
 #define MANAGEMENT_ARGUMENT_NUMBER_OF_TABLESPACES "NumberOfTablespaces"
+#define MANAGEMENT_ARGUMENT_NUMBER_OF_WAL         "NumberOfWAL"
 #define MANAGEMENT_ARGUMENT_OFFLINE               "Offline"
 #define MANAGEMENT_ARGUMENT_ORIGINAL              "Original"
 #define MANAGEMENT_ARGUMENT_OUTPUT                "Output"
 #define MANAGEMENT_ARGUMENT_POSITION              "Position"
+#define MANAGEMENT_ARGUMENT_RELATION              "Relation"
+#define MANAGEMENT_ARGUMENT_RELATIONS             "Relations"
+#define MANAGEMENT_ARGUMENT_PROGRESS              "Progress"
+#define MANAGEMENT_ARGUMENT_QUEUE_WAIT            "QueueWait"
+#define MANAGEMENT_ARGUMENT_RECLAIMED             "Reclaimed"
 #define MANAGEMENT_ARGUMENT_RESTART               "Restart"
 #define MANAGEMENT_ARGUMENT_RESTORE_SIZE          "RestoreSize"
 #define MANAGEMENT_ARGUMENT_RETENTION_DAYS        "RetentionDays"
 #define MANAGEMENT_ARGUMENT_RETENTION_MONTHS      "RetentionMonths"
 #define MANAGEMENT_ARGUMENT_RETENTION_WEEKS       "RetentionWeeks"
 #define MANAGEMENT_ARGUMENT_RETENTION_YEARS       "RetentionYears"
+#define MANAGEMENT_ARGUMENT_SAMPLE                "Sample"
 #define MANAGEMENT_ARGUMENT_SERVER                "Server"
 #define MANAGEMENT_ARGUMENT_SERVERS               "Servers"
 #define MANAGEMENT_ARGUMENT_SERVER_SIZE           "ServerSize"
 #define MANAGEMENT_ARGUMENT_SERVER_VERSION        "ServerVersion"
+#define MANAGEMENT_ARGUMENT_SORT                  "Sort"
 #define MANAGEMENT_ARGUMENT_SOURCE_FILE           "SourceFile"
 #define MANAGEMENT_ARGUMENT_START_HILSN           "StartHiLSN"
 #define MANAGEMENT_ARGUMENT_START_LOLSN           "StartLoLSN"
@@ -166,13 +194,20 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_TABLESPACE            "Tablespace"
 #define MANAGEMENT_ARGUMENT_TABLESPACES           "Tablespaces"
 #define MANAGEMENT_ARGUMENT_TABLESPACE_NAME       "TablespaceName"
+#define MANAGEMENT_ARGUMENT_TASKS                 "Tasks"
+#define MANAGEMENT_ARGUMENT_THROUGHPUT            "Throughput"
 #define MANAGEMENT_ARGUMENT_TIME                  "Time"
 #define MANAGEMENT_ARGUMENT_TIMESTAMP             "Timestamp"
 #define MANAGEMENT_ARGUMENT_TOTAL_SPACE           "TotalSpace"
+#define MANAGEMENT_ARGUMENT_TRUNCATED             "Truncated"
 #define MANAGEMENT_ARGUMENT_USED_SPACE            "UsedSpace"
 #define MANAGEMENT_ARGUMENT_VALID                 "Valid"
+#define MANAGEMENT_ARGUMENT_VERIFIED              "Verified"
+#define MANAGEMENT_ARGUMENT_VERIFIED_SIZE         "VerifiedSize"
 #define MANAGEMENT_ARGUMENT_WAL                   "WAL"
+#define MANAGEMENT_ARGUMENT_WAL_SIZE              "WALSize"
 #define MANAGEMENT_ARGUMENT_WORKERS               "Workers"
+#define MANAGEMENT_ARGUMENT_WORKER_POOL           "WorkerPool"
 #define MANAGEMENT_ARGUMENT_WORKSPACE_FREE_SPACE  "WorkspaceFreeSpace"
 
 /**
@@ -203,6 +238,7 @@ extern "C" {
 #define MANAGEMENT_ERROR_LIST_BACKUP_NETWORK      203
 #define MANAGEMENT_ERROR_LIST_BACKUP_NOSERVER     204
 #define MANAGEMENT_ERROR_LIST_BACKUP_NOFORK       205
+#define MANAGEMENT_ERROR_LIST_BACKUP_ARGUMENTS    206
 
 #define MANAGEMENT_ERROR_DELETE_SETUP    300
 #define MANAGEMENT_ERROR_DELETE_EXECUTE  301
@@ -310,6 +346,32 @@ extern "C" {
 #define MANAGEMENT_ERROR_CONF_SET_NETWORK                   2206
 #define MANAGEMENT_ERROR_CONF_SET_ERROR                     2207
 
+#define MANAGEMENT_ERROR_MERGE_NOBACKUP 2300
+#define MANAGEMENT_ERROR_MERGE_NOSERVER 2301
+#define MANAGEMENT_ERROR_MERGE_NOFORK   2302
+#define MANAGEMENT_ERROR_MERGE_FULL     2303
+#define MANAGEMENT_ERROR_MERGE_ACTIVE   2304
+#define MANAGEMENT_ERROR_MERGE_NETWORK  2305
+#define MANAGEMENT_ERROR_MERGE_ERROR    2306
+
+#define MANAGEMENT_ERROR_WAL_FETCH_NOSERVER 2400
+#define MANAGEMENT_ERROR_WAL_FETCH_NOFORK   2401
+#define MANAGEMENT_ERROR_WAL_FETCH_NOFILE   2402
+#define MANAGEMENT_ERROR_WAL_FETCH_NETWORK  2403
+#define MANAGEMENT_ERROR_WAL_FETCH_ERROR    2404
+
+#define MANAGEMENT_ERROR_CHANGES_NOBACKUP 2500
+#define MANAGEMENT_ERROR_CHANGES_NOSERVER 2501
+#define MANAGEMENT_ERROR_CHANGES_NOFORK   2502
+#define MANAGEMENT_ERROR_CHANGES_NOINDEX  2503
+#define MANAGEMENT_ERROR_CHANGES_NETWORK  2504
+#define MANAGEMENT_ERROR_CHANGES_ERROR    2505
+
+#define MANAGEMENT_ERROR_RETENTION_NOSERVER 2600
+#define MANAGEMENT_ERROR_RETENTION_NOFORK   2601
+#define MANAGEMENT_ERROR_RETENTION_NETWORK  2602
+#define MANAGEMENT_ERROR_RETENTION_ERROR    2603
+
 /**
  * Output formats
  */
@@ -378,13 +440,14 @@ pgmoneta_management_request_backup(SSL* ssl, int socket, char* server, uint8_t c
  * @param ssl The SSL connection
  * @param socket The socket descriptor
  * @param server The server
+ * @param options The sort=X, limit=X, cursor=X, filter=X and fields=X options, separated by commas; can be NULL
  * @param compression The compress method for wire protocol
  * @param encryption The encrypt method for wire protocol
  * @param output_format The output format
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_management_request_list_backup(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
+pgmoneta_management_request_list_backup(SSL* ssl, int socket, char* server, char* options, uint8_t compression, uint8_t encryption, int32_t output_format);
 
 /**
  * Create a restore request
@@ -572,6 +635,63 @@ pgmoneta_management_request_conf_set(SSL* ssl, int socket, char* config_key, cha
 int
 pgmoneta_management_request_retain(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format);
 
+/**
+ * Create a merge request
+ * @param ssl The SSL connection
+ * @param socket The socket descriptor
+ * @param server The server
+ * @param backup_id The backup
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_management_request_merge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format);
+
+/**
+ * Create a WAL fetch request
+ * @param ssl The SSL connection
+ * @param socket The socket descriptor
+ * @param server The server
+ * @param file The name of the WAL file
+ * @param destination The absolute path to restore the WAL file to
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_management_request_wal_fetch(SSL* ssl, int socket, char* server, char* file, char* destination, uint8_t compression, uint8_t encryption, int32_t output_format);
+
+/**
+ * Create a changes request
+ * @param ssl The SSL connection
+ * @param socket The socket descriptor
+ * @param server The server
+ * @param backup_id The backup
+ * @param limit The number of relations to list, or NULL for the default
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_management_request_changes(SSL* ssl, int socket, char* server, char* backup_id, char* limit, uint8_t compression, uint8_t encryption, int32_t output_format);
+
+/**
+ * Create a retention request
+ * @param ssl The SSL connection
+ * @param socket The socket descriptor
+ * @param server The server
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_management_request_retention(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
+
 /**
  * Create an expunge request
  * @param ssl The SSL connection
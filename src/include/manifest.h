@@ -39,9 +39,30 @@ extern "C" {
 #define MANIFEST_CHUNK_SIZE 8192
 
 // simple manifest csv structure definition in case we want to change later
-#define MANIFEST_COLUMN_COUNT 2
+#define MANIFEST_COLUMN_COUNT 3
+#define MANIFEST_MINIMUM_COLUMN_COUNT 2 // manifests written before the size column
 #define MANIFEST_PATH_INDEX 0
 #define MANIFEST_CHECKSUM_INDEX 1
+#define MANIFEST_SIZE_INDEX 2
+
+// the binary copy of backup.manifest, next to it
+#define MANIFEST_MAP_SUFFIX  ".map"
+#define MANIFEST_MAP_MAGIC   0x50474D4D
+#define MANIFEST_MAP_VERSION 1
+
+#define MANIFEST_FILE_DELETED 0
+#define MANIFEST_FILE_CHANGED 1
+#define MANIFEST_FILE_ADDED   2
+
+/**
+ * Callback for a difference between two manifests
+ * @param type The type of difference, MANIFEST_FILE_DELETED, MANIFEST_FILE_CHANGED or MANIFEST_FILE_ADDED
+ * @param path The path of the file
+ * @param checksum The checksum of the file
+ * @param data The data of the callback
+ * @return 0 to continue, otherwise 1
+ */
+typedef int (*manifest_diff_cb)(int type, char* path, char* checksum, void* data);
 
 /** @struct manifest_file
  * Defines a manifest file
@@ -61,13 +82,112 @@ struct manifest_chunk
    int size;                                        /**< The size of the chunk */
 };
 
+/** @struct manifest_listing
+ * Defines a file listed by a manifest
+ */
+struct manifest_listing
+{
+   char* path;    /**< The path of the file, relative to the data directory */
+   int64_t size;  /**< The size of the file, -1 when the manifest has no sizes */
+};
+
+/** @struct manifest_map_header
+ * Defines the header of a binary manifest. It is followed by the entries,
+ * sorted by path, and by the strings they point to
+ */
+struct manifest_map_header
+{
+   uint32_t magic;           /**< The magic number */
+   uint32_t version;         /**< The version of the format */
+   uint32_t number_of_files; /**< The number of entries */
+   uint32_t strings;         /**< The size of the strings */
+};
+
+/** @struct manifest_map_entry
+ * Defines a file in a binary manifest
+ */
+struct manifest_map_entry
+{
+   uint32_t path;     /**< The offset of the path in the strings */
+   uint32_t checksum; /**< The offset of the checksum in the strings */
+   int64_t size;      /**< The size of the file, -1 when the manifest has no sizes */
+};
+
+/** @struct manifest_map
+ * Defines a binary manifest mapped into memory, the pages are shared by
+ * every process that maps it through the page cache
+ */
+struct manifest_map
+{
+   void* base;                          /**< The start of the mapping */
+   size_t length;                       /**< The length of the mapping */
+   uint32_t number_of_files;            /**< The number of entries */
+   struct manifest_map_entry* entries;  /**< The entries, sorted by path */
+   char* strings;                       /**< The strings */
+};
+
 /**
- * Verify checksum of the manifest and the checksum
+ * Write the binary copy of a manifest, backup.manifest.map. Nothing is written
+ * for a manifest that isn't sorted by path, and an earlier copy is removed
+ * @param manifest The path to the manifest (backup.manifest)
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_manifest_map_create(char* manifest);
+
+/**
+ * Map the binary copy of a manifest. A missing or older copy is written first
+ * @param manifest The path to the manifest (backup.manifest)
+ * @param map [out] The map
+ * @return 0 on success, otherwise 1 and the manifest has to be read instead
+ */
+int
+pgmoneta_manifest_map_open(char* manifest, struct manifest_map** map);
+
+/**
+ * Find a file in a binary manifest
+ * @param map The map
+ * @param path The path of the file, relative to the data directory
+ * @return The entry, or NULL
+ */
+struct manifest_map_entry*
+pgmoneta_manifest_map_find(struct manifest_map* map, char* path);
+
+/**
+ * Get the path of an entry of a binary manifest
+ * @param map The map
+ * @param entry The entry
+ * @return The path
+ */
+char*
+pgmoneta_manifest_map_path(struct manifest_map* map, struct manifest_map_entry* entry);
+
+/**
+ * Get the checksum of an entry of a binary manifest
+ * @param map The map
+ * @param entry The entry
+ * @return The checksum
+ */
+char*
+pgmoneta_manifest_map_checksum(struct manifest_map* map, struct manifest_map_entry* entry);
+
+/**
+ * Unmap a binary manifest
+ * @param map The map
+ */
+void
+pgmoneta_manifest_map_close(struct manifest_map* map);
+
+/**
+ * Verify checksum of the manifest and the checksum. The files are hashed
+ * in parallel by the workers of the server, largest first
  * @param root The root directory holding the manifest
+ * @param server The server
+ * @param checksums The optional SHA-256 of the files keyed by their path, used instead of reading SHA256 files again
  * @return 0 if verification turns out ok, 1 otherwise
  */
 int
-pgmoneta_manifest_checksum_verify(char* root);
+pgmoneta_manifest_checksum_verify(char* root, int server, struct art* checksums);
 
 /**
  * Compare manifests
@@ -81,6 +201,45 @@ pgmoneta_manifest_checksum_verify(char* root);
 int
 pgmoneta_compare_manifests(char* old_manifest, char* new_manifest, struct art** deleted_files, struct art** changed_files, struct art** added_files);
 
+/**
+ * Is a manifest sorted by path
+ * @param manifest The path to the manifest
+ * @return True if the paths are strictly increasing, otherwise false
+ */
+bool
+pgmoneta_manifest_is_sorted(char* manifest);
+
+/**
+ * Compare two manifests sorted by path in a single pass. The differences are
+ * passed to the callback as they are found, no file list is kept in memory
+ * @param old_manifest The path to the old manifest
+ * @param new_manifest The path to the new manifest
+ * @param callback The callback
+ * @param data The data of the callback
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_manifest_diff(char* old_manifest, char* new_manifest, manifest_diff_cb callback, void* data);
+
+/**
+ * Get the files listed by a manifest, without reading the directories
+ * @param manifest The path to the manifest
+ * @param by_size Sort the files by size, largest first, instead of by path
+ * @param files [out] The files
+ * @param number_of_files [out] The number of files
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_manifest_files(char* manifest, bool by_size, struct manifest_listing** files, int* number_of_files);
+
+/**
+ * Destroy the files listed by a manifest
+ * @param files The files
+ * @param number_of_files The number of files
+ */
+void
+pgmoneta_manifest_files_destroy(struct manifest_listing* files, int number_of_files);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,6 +37,13 @@ extern "C" {
 
 #include <stdlib.h>
 
+#define MEMORY_POOL_CLASSES 14 /* 512 bytes up to 4 MB */
+#define MEMORY_POOL_DEPTH   8  /* The buffers a thread keeps per class */
+
+#define STREAM_BUFFER_SIZE 1048576 /* The initial size of a stream buffer */
+
+#define MEMORY_HUGEPAGE_SIZE 2097152 /* The size from which pool buffers are mapped on huge pages */
+
 /** @struct stream_buffer
  * Defines a streaming buffer
  */
@@ -50,13 +57,13 @@ struct stream_buffer
 } __attribute__ ((aligned (64)));
 
 /**
- * Initialize a memory segment for the process local message structure
+ * Initialize a memory segment for the thread local message structure
  */
 void
 pgmoneta_memory_init(void);
 
 /**
- * Get the message structure
+ * Get the message structure of the thread, which is initialized on first use
  * @return The structure
  */
 struct message*
@@ -109,7 +116,16 @@ void
 pgmoneta_memory_stream_buffer_init(struct stream_buffer** buffer);
 
 /**
- * Enlarge the buffer, doesn't guarantee success
+ * Compact a stream buffer by moving the unconsumed data to the front.
+ * Messages pointing into the buffer are no longer valid afterwards
+ * @param buffer The stream buffer
+ */
+void
+pgmoneta_memory_stream_buffer_compact(struct stream_buffer* buffer);
+
+/**
+ * Enlarge the buffer, doesn't guarantee success. The buffer is at least
+ * doubled and compacted, so messages pointing into it are no longer valid
  * @param buffer The stream buffer
  * @param bytes_needed The number of bytes needed
  * @return 0 upon success, otherwise 1
@@ -124,6 +140,63 @@ pgmoneta_memory_stream_buffer_enlarge(struct stream_buffer* buffer, int bytes_ne
 void
 pgmoneta_memory_stream_buffer_free(struct stream_buffer* buffer);
 
+/**
+ * Reserve memory of memory_budget for up to a number of units of parallel work,
+ * so a workflow runs with less parallelism instead of running out of memory
+ * @param unit The memory of a unit
+ * @param wanted The wanted number of units
+ * @return The number of units reserved, 0 if the budget is used up
+ */
+int
+pgmoneta_memory_acquire(size_t unit, int wanted);
+
+/**
+ * Add memory that is needed in any case to the memory of the budget in use
+ * @param size The size
+ */
+void
+pgmoneta_memory_account(size_t size);
+
+/**
+ * Give memory back to the budget
+ * @param size The size
+ */
+void
+pgmoneta_memory_release(size_t size);
+
+/**
+ * Get a buffer from the pool. Buffers are rounded up to a power of two size class
+ * and each thread keeps the buffers it frees for its next allocations, so a
+ * receive loop doesn't go to malloc for every message. The buffer is aligned
+ * to ALIGNMENT_SIZE. Unless hugepage is off, buffers of MEMORY_HUGEPAGE_SIZE and
+ * up are mapped on huge pages, or advised for transparent huge pages
+ * @param size The size
+ * @return The buffer, or NULL upon failure
+ */
+void*
+pgmoneta_memory_pool_alloc(size_t size);
+
+/**
+ * Get the usable size of a pool buffer
+ * @param buffer The buffer
+ * @return The size
+ */
+size_t
+pgmoneta_memory_pool_size(void* buffer);
+
+/**
+ * Give a buffer back to the pool
+ * @param buffer The buffer, which must come from pgmoneta_memory_pool_alloc
+ */
+void
+pgmoneta_memory_pool_free(void* buffer);
+
+/**
+ * Free the buffers the current thread keeps
+ */
+void
+pgmoneta_memory_pool_clear(void);
+
 #ifdef __cplusplus
 }
 #endif
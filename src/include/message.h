@@ -34,6 +34,7 @@ extern "C" {
 #endif
 
 #include <memory.h>
+#include <page.h>
 #include <pgmoneta.h>
 #include <tablespace.h>
 
@@ -46,6 +47,8 @@ extern "C" {
 #define MESSAGE_STATUS_OK    1
 #define MESSAGE_STATUS_ERROR 2
 
+struct tar_totals;
+
 extern struct token_bucket bucket;
 
 /** @struct message
@@ -490,7 +493,9 @@ pgmoneta_consume_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer,
 
 /**
  * Consume the data in copy stream buffer similar to pgmoneta_consume_copy_stream.
- * Instead of creating a new message each time, reuse the same message buffer each time
+ * Instead of creating a new message each time, reuse the same message buffer each time.
+ * The message data points into the stream buffer without a copy, and stays valid until
+ * pgmoneta_consume_copy_stream_end or the next read from the connection
  * Must be used with pgmoneta_consume_copy_stream_end
  * @param ssl The SSL structure
  * @param socket The socket
@@ -502,6 +507,15 @@ pgmoneta_consume_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer,
 int
 pgmoneta_consume_copy_stream_start(SSL* ssl, int socket, struct stream_buffer* buffer, struct message* message, struct token_bucket* network_bucket);
 
+/**
+ * Is there a complete message in the copy stream buffer that can be consumed
+ * without reading from the connection
+ * @param buffer The stream buffer
+ * @return true if there is, otherwise false
+ */
+bool
+pgmoneta_copy_stream_has_message(struct stream_buffer* buffer);
+
 /**
  * Finish consuming the buffer, prepare for the next message to be consumed
  * @param buffer The stream buffer
@@ -524,6 +538,7 @@ pgmoneta_consume_data_row_messages(SSL* ssl, int socket, struct stream_buffer* b
 /**
  * Receive backup tar files from the copy stream and write to disk
  * This functionality is for server version < 15
+ * @param server The server
  * @param ssl The SSL structure
  * @param socket The socket
  * @param buffer The stream buffer
@@ -531,14 +546,17 @@ pgmoneta_consume_data_row_messages(SSL* ssl, int socket, struct stream_buffer* b
  * @param tablespaces The user level tablespaces
  * @param bucket The rate limit bucket
  * @param network_bucket The network rate limit bucket
+ * @param pages The page checksums to verify while receiving, or NULL
+ * @param totals The totals of the files of the data directory, or NULL
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket);
+pgmoneta_receive_archive_files(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket, struct page_checksums* pages, struct tar_totals* totals);
 
 /**
  * Receive backup tar files from the copy stream and write to disk
  * This functionality is for server version >= 15
+ * @param server The server
  * @param ssl The SSL structure
  * @param socket The socket
  * @param buffer The stream buffer
@@ -546,10 +564,12 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
  * @param tablespaces The user level tablespaces
  * @param bucket The rate limit bucket
  * @param network_bucket The network rate limit bucket
+ * @param pages The page checksums to verify while receiving, or NULL
+ * @param totals The totals of the files of the data directory, or NULL
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket);
+pgmoneta_receive_archive_stream(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket, struct page_checksums* pages, struct tar_totals* totals);
 
 /**
  * Receive mainfest file from the copy stream and write to disk
@@ -566,8 +586,9 @@ pgmoneta_receive_manifest_file(SSL* ssl, int socket, struct stream_buffer* buffe
 
 /**
  * Receive extra file from the server side
- * @param ssl The SSL structure
- * @param socket The socket
+ * @param ssl The SSL structures
+ * @param sockets The sockets
+ * @param number_of_connections The number of connections that fetch the files
  * @param username The current server username
  * @param source_dir The directory for the extra files on server side
  * @param target_dir The target directory for writing the extra files
@@ -575,7 +596,7 @@ pgmoneta_receive_manifest_file(SSL* ssl, int socket, struct stream_buffer* buffe
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_receive_extra_files(SSL* ssl, int socket, char* username, char* source_dir, char* target_dir, char** info_extra);
+pgmoneta_receive_extra_files(SSL** ssl, int* sockets, int number_of_connections, char* username, char* source_dir, char* target_dir, char** info_extra);
 
 /**
  * Send a file from the client side to the extension side
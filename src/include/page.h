@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_PAGE_H
+#define PGMONETA_PAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+#include <workers.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PAGE_MAGIC       "PGMPAG01"
+#define PAGE_MAGIC_SIZE  8
+#define PAGE_HEADER_SIZE (PAGE_MAGIC_SIZE + 8 + 4)
+
+#define PAGE_ZERO 0
+#define PAGE_HOLE 1
+#define PAGE_RAW  2
+
+/** @struct page_checksums
+ * Defines the verification of the page checksums of a backup
+ */
+struct page_checksums
+{
+   size_t block_size;      /**< The size of a block */
+   size_t relseg_size;     /**< The number of blocks in a segment */
+   uint64_t lsn;           /**< The start of the backup, newer pages can be torn and aren't verified */
+   atomic_ullong blocks;   /**< The number of verified blocks */
+   atomic_ullong failures; /**< The number of blocks with a wrong checksum */
+};
+
+/** @struct page_verify
+ * Defines the verification of a relation file while it streams by
+ */
+struct page_verify
+{
+   struct page_checksums* checksums; /**< The verification of the backup */
+   char path[MAX_PATH];              /**< The relation file */
+   uint32_t block;                   /**< The number of the next block */
+   size_t length;                    /**< The number of bytes of the partial block */
+   unsigned char* page;              /**< The partial block */
+};
+
+/**
+ * Pack the relation files of a backup data directory. Zero pages are replaced by a marker
+ * and the free space between pd_lower and pd_upper of a page is left out when it only holds zeros.
+ * A file that does not get smaller is kept as is
+ * @param server The server
+ * @param directory The directory
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_page_pack(int server, char* directory, struct workers* workers);
+
+/**
+ * Rebuild the packed files of a directory
+ * @param directory The directory
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_page_unpack(char* directory, struct workers* workers);
+
+/**
+ * Compute the checksum of a page like PostgreSQL does. The sums run in lanes
+ * that the compiler vectorizes
+ * @param page The page
+ * @param block_size The size of the page
+ * @param block The block number of the page
+ * @return The checksum
+ */
+uint16_t
+pgmoneta_page_checksum(const unsigned char* page, size_t block_size, uint32_t block);
+
+/**
+ * Start the verification of a file, if it is a relation file
+ * @param checksums The verification of the backup
+ * @param path The path of the file
+ * @param verify The verification of the file
+ * @return True if the file is verified, otherwise false
+ */
+bool
+pgmoneta_page_verify_start(struct page_checksums* checksums, char* path, struct page_verify* verify);
+
+/**
+ * Verify the next data of a file
+ * @param verify The verification of the file
+ * @param data The data
+ * @param size The size of the data
+ */
+void
+pgmoneta_page_verify_update(struct page_verify* verify, const void* data, size_t size);
+
+/**
+ * Finish the verification of a file
+ * @param verify The verification of the file
+ */
+void
+pgmoneta_page_verify_finish(struct page_verify* verify);
+
+/**
+ * Is the file packed
+ * @param path The file
+ * @return True if the file is packed, otherwise false
+ */
+bool
+pgmoneta_page_is_packed(char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
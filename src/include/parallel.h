@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_PARALLEL_H
+#define PGMONETA_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <tablespace.h>
+#include <utils.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The progress journal of a backup, it is kept when the backup fails */
+#define PARALLEL_PROGRESS "backup.progress"
+
+/**
+ * Take a full backup by copying the files of the server over several connections
+ * between pg_backup_start() and pg_backup_stop(). The files are copied largest first,
+ * and the WAL of the backup and the manifest are added once the copy is done.
+ * Each copied file is added to a progress journal, and when the directory already
+ * has one the files that are unchanged on the server since then aren't copied again
+ * @param server The server
+ * @param label The label of the backup
+ * @param backup_base The directory of the backup
+ * @param tablespaces The tablespaces
+ * @param hash The hash algorithm of the manifest
+ * @param bucket The backup rate limit bucket
+ * @param network_bucket The network rate limit bucket
+ * @param startpos [out] The start WAL position, at least 20 characters
+ * @param start_timeline [out] The start timeline
+ * @param endpos [out] The end WAL position, at least 20 characters
+ * @param end_timeline [out] The end timeline
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_parallel_backup(int server, char* label, char* backup_base, struct tablespace* tablespaces, int hash,
+                         struct token_bucket* bucket, struct token_bucket* network_bucket,
+                         char* startpos, uint32_t* start_timeline, char* endpos, uint32_t* end_timeline);
+
+/**
+ * Does a backup directory have the progress journal of a failed parallel backup
+ * @param backup_base The directory of the backup
+ * @return True if the backup can be resumed, otherwise false
+ */
+bool
+pgmoneta_parallel_resumable(char* backup_base);
+
+/**
+ * Find the newest backup of a server that can be resumed
+ * @param server The server
+ * @param label [out] The label of the backup, or NULL if there is none
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_parallel_resume_label(int server, char** label);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
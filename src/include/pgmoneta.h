@@ -62,6 +62,12 @@ extern "C" {
 #define DEFAULT_BURST 65536
 #define DEFAULT_EVERY 1
 
+#define S3_MINIMUM_PART_SIZE (5 * 1024 * 1024)
+#define S3_DEFAULT_PART_SIZE (16 * 1024 * 1024)
+
+#define AZURE_MINIMUM_BLOCK_SIZE (1024 * 1024)
+#define AZURE_DEFAULT_BLOCK_SIZE (16 * 1024 * 1024)
+
 #define MAX_USERNAME_LENGTH  128
 #define MAX_PASSWORD_LENGTH 1024
 
@@ -71,7 +77,11 @@ extern "C" {
 #define MAX_EXTRA_PATH 8192
 
 #define MAX_EXTRA 64
+
+#define MAX_BACKUP_VOLUMES 8
 #define NUMBER_OF_SERVERS 64
+#define MAX_MANAGEMENT_WORKERS 64
+#define SERVER_INDEX_SIZE 128
 #define NUMBER_OF_USERS   64
 #define NUMBER_OF_ADMINS   8
 
@@ -86,6 +96,10 @@ extern "C" {
 #define AUTH_ERROR        2
 #define AUTH_TIMEOUT      3
 
+#define SCRAM_KEY_LENGTH 32
+#define MANAGEMENT_SALT_LENGTH 16
+#define MANAGEMENT_TICKET_KEYS_LENGTH 80
+
 #define ENCRYPTION_NONE     0
 #define ENCRYPTION_AES_256_CBC  1
 #define ENCRYPTION_AES_192_CBC  2
@@ -93,11 +107,17 @@ extern "C" {
 #define ENCRYPTION_AES_256_CTR  4
 #define ENCRYPTION_AES_192_CTR  5
 #define ENCRYPTION_AES_128_CTR  6
+#define ENCRYPTION_AES_256_GCM  7
+#define ENCRYPTION_CHACHA20_POLY1305 8
 
 #define HUGEPAGE_OFF 0
 #define HUGEPAGE_TRY 1
 #define HUGEPAGE_ON  2
 
+#define DURABILITY_SYNCFS       0
+#define DURABILITY_FSYNC        1
+#define DURABILITY_WRITE_BEHIND 2
+
 #define COMPRESSION_NONE         0
 #define COMPRESSION_CLIENT_GZIP  1
 #define COMPRESSION_CLIENT_ZSTD  2
@@ -112,6 +132,19 @@ extern "C" {
 #define STORAGE_ENGINE_S3    1 << 2
 #define STORAGE_ENGINE_AZURE 1 << 3
 
+#define IO_ENGINE_SYNC     0
+#define IO_ENGINE_IO_URING 1
+
+#define IO_CACHE_KEEP   0
+#define IO_CACHE_DROP   1
+#define IO_CACHE_DIRECT 2
+
+#define GZIP_ENGINE_ZLIB       0
+#define GZIP_ENGINE_LIBDEFLATE 1
+
+#define VERIFY_MODE_RESTORE 0
+#define VERIFY_MODE_STREAM  1
+
 #define UPDATE_PROCESS_TITLE_NEVER   0
 #define UPDATE_PROCESS_TITLE_STRICT  1
 #define UPDATE_PROCESS_TITLE_MINIMAL 2
@@ -132,6 +165,8 @@ extern "C" {
 #define BULLET_POINT          "- "
 
 #define INCREMENTAL_PREFIX "INCREMENTAL."
+#define INCREMENTAL_PREFIX_LENGTH (sizeof(INCREMENTAL_PREFIX) - 1)
+#define INCREMENTAL_MAGIC 0xd3ae1f0d
 
 #define likely(x)    __builtin_expect (!!(x), 1)
 #define unlikely(x)  __builtin_expect (!!(x), 0)
@@ -202,6 +237,145 @@ extern void* shmem;
  */
 extern void* prometheus_cache_shmem;
 
+#define PROMETHEUS_BACKUP_ELAPSED_BUCKETS 8
+#define PROMETHEUS_NODE_BUCKETS           8
+#define PROMETHEUS_NODES                  24
+#define PROMETHEUS_NODE_NAME_LENGTH       32
+#define PROMETHEUS_NODE_READY             2
+#define PROMETHEUS_LATENCY_BUCKETS        8
+
+#define PROMETHEUS_WAL_WRITE 0
+#define PROMETHEUS_WAL_FLUSH 1
+#define PROMETHEUS_WAL_CLOSE 2
+#define PROMETHEUS_WAL_LATENCIES 3
+
+#define SCHEDULER_WORKERS   0
+#define SCHEDULER_DISK      1
+#define SCHEDULER_NETWORK   2
+#define SCHEDULER_RESOURCES 3
+
+#define SCHEDULER_PRIORITY_WAL     0
+#define SCHEDULER_PRIORITY_RESTORE 1
+#define SCHEDULER_PRIORITY_BACKUP  2
+#define SCHEDULER_PRIORITY_VERIFY  3
+
+#define SCHEDULER_MAX_SLOTS   256
+#define SCHEDULER_MAX_WAITERS 64
+
+/** @struct prometheus_histogram
+ * Defines a latency histogram
+ */
+struct prometheus_histogram
+{
+   atomic_ulong bucket[PROMETHEUS_LATENCY_BUCKETS]; /**< The observations per bucket */
+   atomic_ulong count;                              /**< The number of observations */
+   atomic_ullong sum;                               /**< The sum of the observations in microseconds */
+};
+
+/** @struct prometheus_node
+ * Defines the Prometheus metrics of a workflow node for a server
+ */
+struct prometheus_node
+{
+   atomic_schar state;                                      /**< The state of the slot */
+   char name[PROMETHEUS_NODE_NAME_LENGTH];                  /**< The name of the node */
+   atomic_ulong elapsed_bucket[PROMETHEUS_NODE_BUCKETS];    /**< The durations per bucket */
+   atomic_ulong throughput_bucket[PROMETHEUS_NODE_BUCKETS]; /**< The throughputs per bucket */
+   atomic_ulong count;                                      /**< The number of runs */
+   atomic_ullong elapsed_sum;                               /**< The sum of the durations in milliseconds */
+   atomic_ullong throughput_sum;                            /**< The sum of the throughputs in kB/s */
+   atomic_ullong bytes_in;                                  /**< The bytes before the runs */
+   atomic_ullong bytes_out;                                 /**< The bytes after the runs */
+   atomic_ullong files;                                     /**< The files after the runs */
+};
+
+/** @struct prometheus_server
+ * Defines the Prometheus metrics of a server. The workflows keep them up to date,
+ * so a scrape doesn't have to look at the backup directories
+ */
+struct prometheus_server
+{
+   atomic_ullong backup_oldest;                                           /**< The label of the oldest valid backup */
+   atomic_ullong backup_newest;                                           /**< The label of the newest valid backup */
+   atomic_uint backup_count;                                              /**< The number of valid backups */
+   atomic_ullong backup_newest_size;                                      /**< The size of the newest valid backup */
+   atomic_ullong restore_newest_size;                                     /**< The restore size of the newest valid backup */
+   atomic_ullong backup_total_size;                                       /**< The size of the backup directory */
+   atomic_ullong wal_total_size;                                          /**< The size of the WAL directories */
+   atomic_ullong total_size;                                              /**< The size of the server directories */
+   atomic_ulong wal_segments;                                             /**< The number of WAL segments received */
+   atomic_uint trash_backups;                                             /**< The number of backups waiting in the trash */
+   atomic_ullong trash_files;                                             /**< The number of files unlinked from the trash */
+   atomic_ulong backup_elapsed_bucket[PROMETHEUS_BACKUP_ELAPSED_BUCKETS]; /**< The backup durations per bucket */
+   atomic_ulong backup_elapsed_count;                                     /**< The number of backup durations */
+   atomic_ullong backup_elapsed_sum;                                      /**< The sum of the backup durations in seconds */
+   struct prometheus_node nodes[PROMETHEUS_NODES];                        /**< The workflow nodes */
+   atomic_ullong wal_received;                                            /**< The WAL bytes received */
+   atomic_ullong wal_receive_rate;                                        /**< The WAL bytes received per second */
+   atomic_ullong wal_primary_lsn;                                         /**< The WAL end position sent by the primary */
+   atomic_ullong wal_behind;                                              /**< The WAL bytes behind the primary */
+   struct prometheus_histogram wal_latency[PROMETHEUS_WAL_LATENCIES];     /**< The write, flush and close latencies */
+   atomic_ullong backups_version;                                         /**< Incremented when the backups change, so their metrics are built again */
+} __attribute__ ((aligned (64)));
+
+/** @struct token_bucket
+ * Defines token bucket structure. A bucket takes its tokens from its parent too,
+ * and a bucket without a rate only passes them on
+ */
+struct token_bucket
+{
+   unsigned long burst;         /**< Default value is 0, no limit */
+   atomic_ulong cur_tokens;     /**< The current tokens */
+   long max_rate;               /**< The maximum rate */
+   int every;                   /**< The every rate */
+   atomic_ulong last_time;      /**< The last time updated */
+   atomic_ullong consumed;      /**< The tokens taken through the bucket */
+   struct token_bucket* parent; /**< The parent bucket, or NULL */
+};
+
+/** @struct progress
+ * Defines the progress of the running workflows of a server
+ */
+struct progress
+{
+   atomic_int active;          /**< The number of running workflows */
+   atomic_llong start;         /**< The start time of the first running workflow */
+   atomic_ullong bytes;        /**< The bytes processed */
+   atomic_ullong files;        /**< The files processed */
+   atomic_int nodes;           /**< The number of nodes done */
+   atomic_int number_of_nodes; /**< The number of nodes */
+   char node[MISC_LENGTH];     /**< The name of the last node started */
+};
+
+/** @struct server_state
+ * Defines the runtime state of a server. Each server has its own cache line aligned block,
+ * so the WAL receivers and the workflows of different servers don't share cache lines
+ */
+struct server_state
+{
+   atomic_ullong wal_lsn;                   /**< The current WAL log sequence number */
+   atomic_bool backup;                      /**< Is there an active backup */
+   atomic_ulong restore;                    /**< Is there an active restore */
+   atomic_ulong archiving;                  /**< Is there an active archiving */
+   atomic_bool delete;                      /**< Is there an active delete */
+   atomic_int trash;                        /**< The pid of the process that reclaims the trash, 0 if none */
+   atomic_bool wal;                         /**< Is there an active wal */
+   atomic_bool wal_pending;                 /**< Are there closed WAL segments waiting for the post-processing */
+   atomic_ullong wal_shipping_lag;          /**< The WAL shipping lag in bytes */
+   atomic_ullong wal_ssh_lag;               /**< The SSH storage engine WAL lag in bytes */
+   atomic_ullong wal_archive_lag;           /**< The WAL archive lag in bytes */
+   atomic_ulong wal_archive_failed;         /**< The number of WAL segments that could not be archived */
+   atomic_ullong wal_directory_size;        /**< The cached size of the WAL directory */
+   atomic_llong wal_directory_mtime;        /**< The modification time of the WAL directory for the cached size */
+   atomic_bool wal_restart;                 /**< Restart the WAL streaming with the reloaded connection settings */
+   atomic_llong retention_version;          /**< The version of the catalog that the last retention plan deleted nothing from */
+   atomic_llong retention_until;            /**< The time until the last retention plan holds */
+   atomic_ulong operation_count;            /**< Operation count of the server */
+   atomic_ulong failed_operation_count;     /**< Failed operation count of the server */
+   atomic_llong last_operation_time;        /**< Last operation time of the server */
+   atomic_llong last_failed_operation_time; /**< Last failed operation time of the server */
+} __attribute__ ((aligned (64)));
+
 /** @struct server
  * Defines a server
  */
@@ -213,19 +387,18 @@ struct server
    char username[MAX_USERNAME_LENGTH];      /**< The user name */
    char wal_slot[MISC_LENGTH];              /**< The WAL slot name */
    char current_wal_filename[MISC_LENGTH];  /**< The current WAL filename*/
-   char current_wal_lsn[MISC_LENGTH];       /**< The current WAL log sequence number*/
    char follow[MISC_LENGTH];                /**< Follow a server */
    char workspace[MAX_PATH];                /**< A workspace for combining incremental backups */
+   char backup_schedule[MISC_LENGTH];       /**< The cron expression of the scheduled backups */
+   time_t schedule_due;                     /**< The time the scheduled backup starts, 0 if none */
+   time_t schedule_minute;                  /**< The minute the schedule last matched */
+   bool cluster_owned;                      /**< Does this node of the cluster own the server */
    int retention_days;                      /**< The retention days for the server */
    int retention_weeks;                     /**< The retention weeks for the server */
    int retention_months;                    /**< The retention months for the server */
    int retention_years;                     /**< The retention years for the server */
+   int retention_local;                     /**< The number of days the data of a backup stays on local storage */
    int create_slot;                         /**< Create a slot */
-   atomic_bool backup;                      /**< Is there an active backup */
-   atomic_ulong restore;                    /**< Is there an active restore */
-   atomic_ulong archiving;                  /**< Is there an active archiving */
-   atomic_bool delete;                      /**< Is there an active delete */
-   atomic_bool wal;                         /**< Is there an active wal */
    int wal_size;                            /**< The size of the WAL files */
    size_t block_size;                       /**< The size of a block in relation files*/
    size_t segment_size;                     /**< The max size of a relation file segment*/
@@ -236,15 +409,16 @@ struct server
    bool valid;                              /**< Is the server valid */
    int version;                             /**< The major version of the server*/
    int minor_version;                       /**< The minor version of the server*/
-   atomic_ulong operation_count;            /**< Operation count of the server */
-   atomic_ulong failed_operation_count;     /**< Failed operation count of the server */
    uint32_t cur_timeline;                   /**< Current timeline the server is on*/
-   atomic_llong last_operation_time;        /**< Last operation time of the server */
-   atomic_llong last_failed_operation_time; /**< Last failed operation time of the server */
+   struct prometheus_server metrics;        /**< The Prometheus metrics of the server */
+   struct progress progress;                /**< The progress of the running workflows of the server */
+   struct token_bucket network_bucket;      /**< The network rate shared by the workflows of the server */
    char wal_shipping[MAX_PATH];             /**< The WAL shipping directory */
+   char backup_standbys[MAX_PATH];          /**< The standbys the backups are taken from */
    char hot_standby[MAX_PATH];              /**< The hot standby directory */
    char hot_standby_overrides[MAX_PATH];    /**< The hot standby overrides directory */
    char hot_standby_tablespaces[MAX_PATH];  /**< The hot standby tablespaces mappings */
+   bool hot_standby_wal;                    /**< Feed the streamed WAL into the hot standby */
    char tls_cert_file[MISC_LENGTH];         /**< TLS certificate path */
    char tls_key_file[MISC_LENGTH];          /**< TLS key path */
    char tls_ca_file[MISC_LENGTH];           /**< TLS CA certificate path */
@@ -252,6 +426,8 @@ struct server
    int backup_max_rate;                     /**< Number of tokens added to the bucket with each replenishment for backup. */
    int network_max_rate;                    /**< Number of bytes of tokens added every one second to limit the netowrk backup rate */
    int manifest;                            /**< The manifest hash algorithm */
+   int wal_compression_type;                /**< The WAL compression type, -1 for the global setting */
+   int wal_compression_level;               /**< The WAL compression level, -1 for the global setting */
    int number_of_extra;                     /**< The number of source directory*/
    char extra[MAX_EXTRA][MAX_EXTRA_PATH];   /**< Source directory*/
    bool ext_valid;                          /**< Is the extension valid */
@@ -267,6 +443,17 @@ struct user
    char password[MAX_PASSWORD_LENGTH]; /**< The password */
 } __attribute__ ((aligned (64)));
 
+/** @struct scram_key
+ * Defines a cached SCRAM salted password. The salt and the iteration count of a
+ * role don't change, so the key is reused by the next authentication
+ */
+struct scram_key
+{
+   bool valid;                           /**< Is the key valid */
+   unsigned char hash[SCRAM_KEY_LENGTH]; /**< The SHA-256 of the password, the salt and the iteration count */
+   unsigned char key[SCRAM_KEY_LENGTH];  /**< The salted password */
+};
+
 /** @struct prometheus_cache
  * A structure to handle the Prometheus response
  * so that it is possible to serve the very same
@@ -298,6 +485,28 @@ struct prometheus
    atomic_ulong logging_warn;  /**< Logging: WARN */
    atomic_ulong logging_error; /**< Logging: ERROR */
    atomic_ulong logging_fatal; /**< Logging: FATAL */
+
+   atomic_ullong memory_pool_allocations; /**< The buffers handed out by the memory pool */
+   atomic_ullong memory_pool_cache_hits;  /**< The buffers reused from a thread cache */
+   atomic_ullong memory_pool_oversized;   /**< The buffers larger than the largest size class */
+
+   atomic_int worker_alive;                       /**< The alive workers */
+   atomic_int worker_active;                      /**< The workers running a task */
+   atomic_ullong worker_busy;                     /**< The time the workers ran tasks in microseconds */
+   atomic_ullong worker_idle;                     /**< The time the workers waited for tasks in microseconds */
+   struct prometheus_histogram worker_task;       /**< The run time of the tasks */
+   struct prometheus_histogram worker_queue_wait; /**< The time the tasks waited in a queue */
+} __attribute__ ((aligned (64)));
+
+/** @struct scheduler
+ * Defines the resources shared by the workflows of all processes. A slot holds the
+ * pid of its owner, and a waiter holds the pid and the priority of a process waiting
+ * for a slot, so the entries of a process that died can be taken back
+ */
+struct scheduler
+{
+   atomic_int slots[SCHEDULER_RESOURCES][SCHEDULER_MAX_SLOTS];       /**< The slots per resource */
+   atomic_llong waiters[SCHEDULER_RESOURCES][SCHEDULER_MAX_WAITERS]; /**< The waiters per resource */
 } __attribute__ ((aligned (64)));
 
 /** @struct configuration
@@ -322,6 +531,9 @@ struct configuration
    int compression_type;  /**< The compression type */
    int compression_level; /**< The compression level */
 
+   int wal_compression_type;  /**< The WAL compression type, -1 for compression */
+   int wal_compression_level; /**< The WAL compression level, -1 for compression_level */
+
    int create_slot;                    /**< Create a slot */
 
    int storage_engine;  /**< The storage engine */
@@ -332,23 +544,31 @@ struct configuration
    char ssh_username[MISC_LENGTH]; /**< The SSH username */
    char ssh_base_dir[MAX_PATH];    /**< The SSH base directory */
    char ssh_ciphers[MISC_LENGTH];  /**< The SSH supported ciphers */
+   int ssh_retries;                /**< The number of times an interrupted SSH transfer is resumed */
+   bool ssh_manifest_diff;         /**< Use the manifest to send only the changed files */
 
    char s3_aws_region[MISC_LENGTH];         /**< The AWS region */
    char s3_access_key_id[MISC_LENGTH];      /**< The IAM Access Key ID */
    char s3_secret_access_key[MISC_LENGTH];  /**< The IAM Secret Access Key */
    char s3_bucket[MISC_LENGTH];          /**< The S3 bucket */
    char s3_base_dir[MAX_PATH];           /**< The S3 base directory */
+   int s3_part_size;                     /**< The size of the parts of a multipart upload */
+   int s3_concurrency;                   /**< The number of S3 requests in flight */
+   bool s3_unsigned_payload;             /**< Don't sign the payload of the S3 requests */
 
    char azure_storage_account[MISC_LENGTH];    /**< The Azure storage account name */
    char azure_container[MISC_LENGTH];          /**< The Azure container name */
    char azure_shared_key[MISC_LENGTH];         /**< The Azure storage account key */
    char azure_base_dir[MAX_PATH];              /**< The Azure base directory */
+   int azure_block_size;                       /**< The size of the blocks of a block blob */
 
    int retention_days;                  /**< The retention days for the server */
    int retention_weeks;                 /**< The retention weeks for the server */
    int retention_months;                /**< The retention months for the server */
    int retention_years;                 /**< The retention years for the server */
    int retention_interval;              /**< The retention interval */
+   int retention_local;                 /**< The number of days the data of a backup stays on local storage */
+   bool retention_remote;               /**< Delete the copy on the storage engine with the backup */
 
    char workspace[MAX_PATH]; /**< A workspace for combining incremental backups */
 
@@ -367,10 +587,19 @@ struct configuration
    char tls_ca_file[MISC_LENGTH];   /**< TLS CA certificate path */
 
    int blocking_timeout;       /**< The blocking timeout in seconds */
+   int management_workers;     /**< The number of management workers */
    int authentication_timeout; /**< The authentication timeout in seconds */
    char pidfile[MAX_PATH];     /**< File containing the PID */
 
    int workers;                /**< The number of workers */
+   int workers_per_device;     /**< The number of workers that can run a task on the same device, 0 for no limit */
+   bool workers_autoscale;     /**< Change the number of running workers with the throughput of the tasks */
+   char cpu_affinity[MISC_LENGTH]; /**< The CPUs of the workers, the WAL receivers and the metrics server */
+   size_t memory_budget;       /**< The memory that the workers, compression and stream buffers can use, 0 for no limit */
+   atomic_ullong memory_used;  /**< The memory of the budget in use */
+   int backup_durability;      /**< How the files of a backup are made durable */
+   int restore_durability;     /**< How the files of a restore are made durable */
+   bool backup_splice;         /**< Move the files of a plain backup from the socket to the disk with splice */
 
    atomic_ulong active_restores; /**< The number of active restores */
    atomic_ulong active_archives; /**< The number of active archives */
@@ -380,29 +609,130 @@ struct configuration
    char libev[MISC_LENGTH]; /**< Name of libev mode */
    bool keep_alive;         /**< Use keep alive */
    bool nodelay;            /**< Use NODELAY */
+   int socket_buffer_size;  /**< The size of SO_RCVBUF and SO_SNDBUF, 0 for the default */
+   bool ktls;               /**< Use kernel TLS for server connections */
    bool non_blocking;       /**< Use non blocking */
    int backlog;             /**< The backlog for listen */
    unsigned char hugepage;  /**< Huge page support */
 
    char unix_socket_dir[MISC_LENGTH]; /**< The directory for the Unix Domain Socket */
 
+   atomic_ulong reload_generation; /**< Incremented by each reload, so the WAL receivers pick up the new settings */
+   atomic_int wal_notify;          /**< The pid of the main process to signal when a WAL segment is closed, 0 if none */
+
+   atomic_schar scram_lock;                        /**< The lock of the SCRAM keys */
+   int scram_next;                                 /**< The next SCRAM key to replace */
+   struct scram_key scram_keys[NUMBER_OF_SERVERS]; /**< The SCRAM keys of the server connections */
+
+   char management_salt[MANAGEMENT_SALT_LENGTH];                    /**< The SCRAM salt of the management users */
+   unsigned char management_tickets[MANAGEMENT_TICKET_KEYS_LENGTH]; /**< The keys of the TLS session tickets of the management connections */
+
    int number_of_servers;        /**< The number of servers */
+   int server_index[SERVER_INDEX_SIZE]; /**< The servers by the hash of their name, the index plus one, 0 if free */
    int number_of_users;          /**< The number of users */
    int number_of_admins;         /**< The number of admins */
 
    int backup_max_rate; /**< Number of tokens added to the bucket with each replenishment for backup. */
    int network_max_rate;    /**< Number of bytes of tokens added every one second to limit the netowrk backup rate */
+   int storage_max_rate;    /**< Number of bytes of tokens added every one second to limit the remote storage engine */
 
    int manifest;  /**< The manifest hash algorithm */
 
+   bool wal_stream_compression; /**< Compress and encrypt WAL while streaming */
+
+   bool wal_synchronous; /**< Sync the WAL before reporting it as flushed, for a synchronous standby */
+
+   int wal_prealloc; /**< The number of pre-allocated WAL segments */
+
+   int wal_fanout_size; /**< The size of the WAL fan-out ring buffer */
+
+   int wal_archive_queue; /**< The size of the WAL archive queue */
+
+   int wal_archive_retries; /**< The number of retries of a WAL archive upload */
+
+   int wal_receivers; /**< The number of multiplexed WAL receiver processes */
+
+   bool backup_pipeline; /**< Use the single pass backup pipeline */
+
+   int backup_connections; /**< The number of connections that copy a full backup */
+
+   int seekable_frame_size; /**< The frame size of seekable zstd files */
+
+   bool compression_dictionary; /**< Use trained zstd dictionaries */
+
+   bool compression_adaptive; /**< Adapt the compression level to the throughput target */
+   bool compression_probe; /**< Store the files that do not compress as is */
+
+   bool deduplication; /**< Deduplicate full backups in a chunk store */
+   bool page_filter; /**< Pack the relation files of full backups */
+
+   int link_verify; /**< The percentage of linked files verified byte for byte */
+
+   int io_engine; /**< The file I/O engine */
+
+   int io_cache; /**< The page cache use of the file I/O */
+
+   int gzip_engine; /**< The gzip compression engine */
+
+   bool sparse_files; /**< Leave the zero blocks of restored files as holes */
+
+   int wal_pack; /**< The number of archived WAL segments in a pack */
+
+   bool wal_compaction; /**< Move the full page images out of the WAL packs before the newest full backup */
+
+   int verify_mode; /**< The verification mode */
+
+   int verify_sample; /**< The percentage of files verified */
+
+   bool verify_fail_fast; /**< Stop the verification at the first failure */
+
+   int trace_sample; /**< The percentage of workflows traced */
+
+   int trace_events; /**< The number of events kept for the trace of a workflow */
+
+   bool wal_index; /**< Build WAL segment indexes */
+
+   size_t restore_prewarm; /**< The size of the blocks written for pg_prewarm by a restore, 0 for none */
+
+   int scheduler_workers; /**< The worker threads of all workflows */
+
+   int scheduler_disk; /**< The disk heavy workflow nodes of all workflows */
+
+   int scheduler_network; /**< The network heavy workflow nodes of all workflows */
+
+   int delete_max_rate; /**< The number of files unlinked per second from the trash */
+
+   int total_max_rate; /**< The number of bytes per second shared by the backups and storage transfers of all servers */
+   int max_rate_burst; /**< The number of bytes a rate limit lets through at once */
+   struct token_bucket network_bucket; /**< The network rate shared by all servers */
+
+   int wal_prefetch; /**< The number of WAL segments decoded ahead of a wal-fetch */
+
+   char backup_schedule[MISC_LENGTH]; /**< The cron expression of the scheduled backups of all servers */
+   int backup_schedule_jitter; /**< The maximum random delay of a scheduled backup in seconds */
+   int backup_schedule_max; /**< The maximum number of concurrent backups a schedule starts, 0 for no limit */
+
+   int backup_throttle_lag; /**< The replication lag in bytes that throttles a backup, 0 to ignore */
+   int backup_throttle_active; /**< The number of active sessions that throttles a backup, 0 to ignore */
+   int backup_throttle_io; /**< The number of sessions waiting for I/O that throttles a backup, 0 to ignore */
+
+   char cluster_dir[MAX_PATH]; /**< The directory shared by the nodes of a cluster, empty without a cluster */
+   char cluster_node[MISC_LENGTH]; /**< The name of this node in the cluster */
+   int cluster_lease; /**< The lease time of the servers of a node in seconds */
+
+   char backup_volumes[MAX_BACKUP_VOLUMES][MAX_PATH]; /**< The directories the backups are spread over */
+   int number_of_backup_volumes; /**< The number of backup volumes */
+
 #ifdef DEBUG
    bool link; /**< Do linking */
 #endif
 
    struct server servers[NUMBER_OF_SERVERS];       /**< The servers */
+   struct server_state states[NUMBER_OF_SERVERS];  /**< The runtime state of the servers */
    struct user users[NUMBER_OF_USERS];             /**< The users */
    struct user admins[NUMBER_OF_ADMINS];           /**< The admins */
    struct prometheus prometheus;                   /**< The Prometheus metrics */
+   struct scheduler scheduler;                     /**< The resource scheduler */
 } __attribute__ ((aligned (64)));
 
 #ifdef __cplusplus
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PGMONETA_PROBES_H
+#define PGMONETA_PROBES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Static probes for perf, bpftrace and SystemTap. A probe is a nop unless a
+ * tracer is attached, and the macros are empty when sys/sdt.h was not found.
+ *
+ * The probes of the pgmoneta provider are
+ *
+ *   workflow__node__start(name)            A workflow node starts
+ *   workflow__node__done(name, status)     A workflow node is done
+ *   worker__task__start(worker)            A worker starts a task
+ *   worker__task__done(worker, usec)       A worker is done with a task
+ *   file__open(path)                       A WAL segment is opened
+ *   file__close(path)                      A WAL segment is closed
+ *   compress__block(bytes, finish)         A block of a base backup is compressed
+ *   network__read(socket, bytes)           A read from a network socket
+ */
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define PGMONETA_PROBE1(name, a)       DTRACE_PROBE1(pgmoneta, name, a)
+#define PGMONETA_PROBE2(name, a, b)    DTRACE_PROBE2(pgmoneta, name, a, b)
+
+#else
+
+#define PGMONETA_PROBE1(name, a)       ((void)0)
+#define PGMONETA_PROBE2(name, a, b)    ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
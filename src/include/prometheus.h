@@ -35,6 +35,7 @@ extern "C" {
 
 #include <ev.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 /*
  * Value to disable the Prometheus cache,
@@ -58,11 +59,25 @@ extern "C" {
 #define PROMETHEUS_DEFAULT_CACHE_SIZE (256 * 1024)
 
 /**
- * Create a prometheus instance
- * @param fd The client descriptor
+ * Start the metrics server. It is a thread of the main process that serves
+ * the scrapes, and keeps the connections of the clients open
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_prometheus_start(void);
+
+/**
+ * Hand a client connection to the metrics server
+ * @param client_fd The client descriptor
+ */
+void
+pgmoneta_prometheus_serve(int client_fd);
+
+/**
+ * Stop the metrics server, and close the client connections
  */
 void
-pgmoneta_prometheus(int fd);
+pgmoneta_prometheus_stop(void);
 
 /**
  * Reset the counters and histograms
@@ -101,6 +116,112 @@ pgmoneta_init_prometheus_cache(size_t* p_size, void** p_shmem);
 void
 pgmoneta_prometheus_logging(int logging);
 
+/**
+ * Read the backups and the directory sizes of a server into its metrics
+ * @param server The server index
+ */
+void
+pgmoneta_prometheus_refresh(int server);
+
+/**
+ * Add a new backup to the metrics of a server without walking its directories
+ * @param server The server index
+ * @param size The size of the backup on disk
+ */
+void
+pgmoneta_prometheus_backup_added(int server, uint64_t size);
+
+/**
+ * Add the duration of a backup
+ * @param server The server index
+ * @param seconds The duration in seconds
+ */
+void
+pgmoneta_prometheus_backup_elapsed(int server, double seconds);
+
+/**
+ * Add a received WAL segment
+ * @param server The server index
+ * @param size The size of the segment on disk
+ */
+void
+pgmoneta_prometheus_wal_segment(int server, size_t size);
+
+/**
+ * Add received WAL data
+ * @param server The server index
+ * @param bytes The number of bytes
+ */
+void
+pgmoneta_prometheus_wal_received(int server, size_t bytes);
+
+/**
+ * Set the WAL receive rate
+ * @param server The server index
+ * @param rate The bytes per second
+ */
+void
+pgmoneta_prometheus_wal_rate(int server, uint64_t rate);
+
+/**
+ * Set the WAL end position of the primary
+ * @param server The server index
+ * @param primary The WAL end position sent by the primary
+ * @param received The received position
+ */
+void
+pgmoneta_prometheus_wal_primary(int server, uint64_t primary, uint64_t received);
+
+/**
+ * Add a WAL latency
+ * @param server The server index
+ * @param type The latency type (PROMETHEUS_WAL_WRITE, PROMETHEUS_WAL_FLUSH or PROMETHEUS_WAL_CLOSE)
+ * @param seconds The latency in seconds
+ */
+void
+pgmoneta_prometheus_wal_latency(int server, int type, double seconds);
+
+/**
+ * Change the number of alive workers
+ * @param delta The change
+ */
+void
+pgmoneta_prometheus_worker_alive(int delta);
+
+/**
+ * Change the number of workers running a task
+ * @param delta The change
+ */
+void
+pgmoneta_prometheus_worker_active(int delta);
+
+/**
+ * Add a task run by a worker
+ * @param queue_wait The time the task waited in a queue in seconds
+ * @param seconds The run time in seconds
+ */
+void
+pgmoneta_prometheus_worker_task(double queue_wait, double seconds);
+
+/**
+ * Add the time a worker waited for tasks
+ * @param seconds The time in seconds
+ */
+void
+pgmoneta_prometheus_worker_idle(double seconds);
+
+/**
+ * Add a run of a workflow node
+ * @param server The server index
+ * @param name The name of the node
+ * @param seconds The duration in seconds
+ * @param bytes_in The bytes before the node
+ * @param bytes_out The bytes after the node
+ * @param files The files after the node
+ */
+void
+pgmoneta_prometheus_workflow_node(int server, char* name, double seconds, uint64_t bytes_in, uint64_t bytes_out, uint64_t files);
+
 #ifdef __cplusplus
 }
 #endif
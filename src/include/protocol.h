@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_PROTOCOL_H
+#define PGMONETA_PROTOCOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* system */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The protocol is big-endian, so the loads and stores swap on little-endian hosts */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PROTOCOL_BE16(x) (x)
+#define PROTOCOL_BE32(x) (x)
+#define PROTOCOL_BE64(x) (x)
+#else
+#define PROTOCOL_BE16(x) __builtin_bswap16(x)
+#define PROTOCOL_BE32(x) __builtin_bswap32(x)
+#define PROTOCOL_BE64(x) __builtin_bswap64(x)
+#endif
+
+#define PROTOCOL_XLOGDATA_SIZE  25 /* 'w', start, end and send time */
+#define PROTOCOL_KEEPALIVE_SIZE 18 /* 'k', end, send time and reply */
+
+/** @struct protocol_xlogdata
+ * The header of an XLogData message of the replication protocol
+ */
+struct protocol_xlogdata
+{
+   uint64_t start;    /**< The WAL position of the data */
+   uint64_t end;      /**< The current end of WAL on the server */
+   int64_t send_time; /**< The send time, microseconds since 2000-01-01 */
+};
+
+/** @struct protocol_keepalive
+ * A primary keepalive message of the replication protocol
+ */
+struct protocol_keepalive
+{
+   uint64_t end;      /**< The current end of WAL on the server */
+   int64_t send_time; /**< The send time, microseconds since 2000-01-01 */
+   bool reply;        /**< Does the server ask for a reply */
+};
+
+/**
+ * Load a big-endian uint16
+ * @param data Pointer to the data, which may be unaligned
+ * @return The value
+ */
+static inline uint16_t
+pgmoneta_protocol_load16(const void* data)
+{
+   uint16_t v;
+
+   memcpy(&v, data, sizeof(v));
+
+   return PROTOCOL_BE16(v);
+}
+
+/**
+ * Load a big-endian uint32
+ * @param data Pointer to the data, which may be unaligned
+ * @return The value
+ */
+static inline uint32_t
+pgmoneta_protocol_load32(const void* data)
+{
+   uint32_t v;
+
+   memcpy(&v, data, sizeof(v));
+
+   return PROTOCOL_BE32(v);
+}
+
+/**
+ * Load a big-endian uint64
+ * @param data Pointer to the data, which may be unaligned
+ * @return The value
+ */
+static inline uint64_t
+pgmoneta_protocol_load64(const void* data)
+{
+   uint64_t v;
+
+   memcpy(&v, data, sizeof(v));
+
+   return PROTOCOL_BE64(v);
+}
+
+/**
+ * Store a big-endian uint16
+ * @param data Pointer to the data, which may be unaligned
+ * @param v The value
+ */
+static inline void
+pgmoneta_protocol_store16(void* data, uint16_t v)
+{
+   v = PROTOCOL_BE16(v);
+
+   memcpy(data, &v, sizeof(v));
+}
+
+/**
+ * Store a big-endian uint32
+ * @param data Pointer to the data, which may be unaligned
+ * @param v The value
+ */
+static inline void
+pgmoneta_protocol_store32(void* data, uint32_t v)
+{
+   v = PROTOCOL_BE32(v);
+
+   memcpy(data, &v, sizeof(v));
+}
+
+/**
+ * Store a big-endian uint64
+ * @param data Pointer to the data, which may be unaligned
+ * @param v The value
+ */
+static inline void
+pgmoneta_protocol_store64(void* data, uint64_t v)
+{
+   v = PROTOCOL_BE64(v);
+
+   memcpy(data, &v, sizeof(v));
+}
+
+/**
+ * Decode the header of an XLogData message
+ * @param data The CopyData payload, starting with the 'w'
+ * @param length The length of the payload
+ * @param xlogdata The header
+ * @return True if the payload holds a complete header, otherwise false
+ */
+static inline bool
+pgmoneta_protocol_xlogdata(const void* data, size_t length, struct protocol_xlogdata* xlogdata)
+{
+   const uint8_t* p = (const uint8_t*)data;
+
+   if (length < PROTOCOL_XLOGDATA_SIZE || p[0] != 'w')
+   {
+      return false;
+   }
+
+   xlogdata->start = pgmoneta_protocol_load64(p + 1);
+   xlogdata->end = pgmoneta_protocol_load64(p + 9);
+   xlogdata->send_time = (int64_t)pgmoneta_protocol_load64(p + 17);
+
+   return true;
+}
+
+/**
+ * Decode a primary keepalive message
+ * @param data The CopyData payload, starting with the 'k'
+ * @param length The length of the payload
+ * @param keepalive The keepalive
+ * @return True if the payload is a complete keepalive, otherwise false
+ */
+static inline bool
+pgmoneta_protocol_keepalive(const void* data, size_t length, struct protocol_keepalive* keepalive)
+{
+   const uint8_t* p = (const uint8_t*)data;
+
+   if (length < PROTOCOL_KEEPALIVE_SIZE || p[0] != 'k')
+   {
+      return false;
+   }
+
+   keepalive->end = pgmoneta_protocol_load64(p + 1);
+   keepalive->send_time = (int64_t)pgmoneta_protocol_load64(p + 9);
+   keepalive->reply = p[17] != 0;
+
+   return true;
+}
+
+/**
+ * Is a message kind kept by the COPY stream reader
+ * @param kind The message kind
+ * @return True for DataRow, RowDescription, CopyData, CopyDone, CopyFail,
+ *         CopyBothResponse, CopyOutResponse, ErrorResponse and CommandComplete
+ */
+static inline bool
+pgmoneta_protocol_copy_kind(char kind)
+{
+   switch (kind)
+   {
+      case 'C':
+      case 'D':
+      case 'E':
+      case 'H':
+      case 'T':
+      case 'W':
+      case 'c':
+      case 'd':
+      case 'f':
+         return true;
+      default:
+         return false;
+   }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -39,8 +39,26 @@ extern "C" {
 #include <json.h>
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+/* The first OID of the objects created by the users, the databases below are created by initdb */
+#define RESTORE_FIRST_USER_OID 16384
+
+/** @struct restore_filter
+ * Defines the databases and the tablespaces selected by a restore. The relation files
+ * of the other databases and tablespaces are restored as sparse files of the same size
+ */
+struct restore_filter
+{
+   uint32_t databases[MAX_NUMBER_OF_TABLESPACES];   /**< The OIDs of the selected databases */
+   int number_of_databases;                         /**< The number of selected databases */
+   uint32_t tablespaces[MAX_NUMBER_OF_TABLESPACES]; /**< The OIDs of the selected tablespaces */
+   int number_of_tablespaces;                       /**< The number of selected tablespaces */
+   struct art* sizes;                               /**< The size of each file of the backup keyed by its path */
+};
+
 /**
  * Fill the passed arugment with the last files names to restore
  * @param output The string array that will be filled with the last files names to restore
@@ -77,6 +95,65 @@ pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
 int
 pgmoneta_restore_backup(struct art* nodes);
 
+/**
+ * Write the postgresql.conf of a replica, commenting out the old recovery settings
+ * and adding the ones of the position
+ * @param server The server
+ * @param position The position
+ * @param in The restored postgresql.conf, or NULL
+ * @param out The new postgresql.conf
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_restore_recovery_conf(int server, char* position, FILE* in, FILE* out);
+
+/**
+ * Write the postgresql.auto.conf of a primary, commenting out primary_conninfo
+ * @param in The restored postgresql.auto.conf, or NULL
+ * @param out The new postgresql.auto.conf
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_restore_primary_conf(FILE* in, FILE* out);
+
+/**
+ * Create the filter of a selective restore from the database=X and tablespace=X keys of the position
+ * @param server The server
+ * @param label The label of the backup being restored
+ * @param backup The backup
+ * @param position The position
+ * @param filter [out] The filter, or NULL if the position selects everything
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_restore_filter_create(int server, char* label, struct backup* backup, char* position, struct restore_filter** filter);
+
+/**
+ * Is a file left out by a filter
+ * @param filter The filter
+ * @param path The path of the file relative to the data directory
+ * @return True if the file is a relation file of a database or a tablespace that is not selected
+ */
+bool
+pgmoneta_restore_filter_excluded(struct restore_filter* filter, char* path);
+
+/**
+ * Restore a file left out by a filter as a sparse file of its size in the backup
+ * @param filter The filter
+ * @param path The path of the file relative to the data directory
+ * @param to The restored file
+ * @return 0 if the file was left out, otherwise 1 and the file must be restored
+ */
+int
+pgmoneta_restore_filter_file(struct restore_filter* filter, char* path, char* to);
+
+/**
+ * Destroy a filter
+ * @param filter The filter
+ */
+void
+pgmoneta_restore_filter_destroy(struct restore_filter* filter);
+
 /**
  * Combine the provided backups
  * @param server The server
@@ -87,11 +164,12 @@ pgmoneta_restore_backup(struct art* nodes);
  * @param prior_backup_dirs The root directory of prior incremental/full backups, from newest to oldest
  * @param bck The backup to be restored
  * @param manifest The manifest of the incremental backup to be combined
+ * @param filter The filter of a selective restore, or NULL
  * @return 0 on success, 1 if otherwise
  */
 int
 pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs,
-                         struct backup* bck, struct json* manifest);
+                         struct backup* bck, struct json* manifest, struct restore_filter* filter);
 
 #ifdef __cplusplus
 }
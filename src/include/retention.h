@@ -33,7 +33,36 @@
 extern "C" {
 #endif
 
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <info.h>
+#include <json.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+/** @struct retention_plan
+ * Defines what the retention of a server deletes
+ */
+struct retention_plan
+{
+   int number_of_backups;     /**< The number of backups */
+   struct backup** backups;   /**< The backups, sorted by label */
+   bool* deletes;             /**< Is the backup deleted, for each backup */
+   int number_of_deletes;     /**< The number of deleted backups */
+   uint64_t backup_size;      /**< The size of the deleted backups */
+   char* oldest_wal;          /**< The oldest WAL segment that is kept, or NULL */
+   bool all_wal;              /**< Are all the WAL segments deleted */
+   int number_of_wal;         /**< The number of deleted WAL segments */
+   char** wal;                /**< The deleted WAL segments */
+   uint64_t wal_size;         /**< The size of the deleted WAL segments */
+   time_t until;              /**< The plan holds until then, as long as the backups don't change */
+};
 
 /**
  * Retention
@@ -42,6 +71,48 @@ extern "C" {
 void
 pgmoneta_retention(char** argv);
 
+/**
+ * Plan the retention of a server from its catalog. The backups are read once,
+ * the children of a backup are counted instead of being looked up, and a
+ * backup is deleted when it isn't retained and all of its children are deleted.
+ * The WAL segments older than the oldest backup that is left are listed once
+ * @param server The server
+ * @param plan [out] The plan
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_retention_plan(int server, struct retention_plan** plan);
+
+/**
+ * Delete the WAL segments of a plan, and the ones of the WAL shipping directory.
+ * The segments are moved to the trash in one batch, which reclaims their space
+ * in the background
+ * @param server The server
+ * @param plan The plan
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_retention_wal(int server, struct retention_plan* plan);
+
+/**
+ * Destroy a plan
+ * @param plan The plan
+ */
+void
+pgmoneta_retention_plan_destroy(struct retention_plan* plan);
+
+/**
+ * Show the retention plan of a server without deleting anything
+ * @param ssl The SSL connection
+ * @param client_fd The client
+ * @param server The server
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param payload The payload
+ */
+void
+pgmoneta_retention_request(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload);
+
 #ifdef __cplusplus
 }
 #endif
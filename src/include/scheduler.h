@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_SCHEDULER_H
+#define PGMONETA_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+/**
+ * Set the priority of the process, SCHEDULER_PRIORITY_BACKUP by default
+ * @param priority The priority
+ */
+void
+pgmoneta_scheduler_priority(int priority);
+
+/**
+ * Acquire slots of a resource shared by the workflows of all processes. The call
+ * waits while all slots are taken or while a process of a higher priority waits.
+ * A process that already holds slots of the resource takes what is free without
+ * waiting, so nested worker pools can't wait for themselves
+ * @param resource The resource
+ * @param wanted The number of slots wanted
+ * @param granted The number of slots granted, which may be 0 for a nested request
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_scheduler_acquire(int resource, int wanted, int* granted);
+
+/**
+ * Take the free slots of a resource without waiting, for parallelism that only pays
+ * off while the slots are idle. Nothing is taken while a process of a higher priority waits
+ * @param resource The resource
+ * @param wanted The number of slots wanted
+ * @return The number of slots taken, which may be 0
+ */
+int
+pgmoneta_scheduler_take(int resource, int wanted);
+
+/**
+ * Release slots of a resource
+ * @param resource The resource
+ * @param granted The number of slots granted
+ */
+void
+pgmoneta_scheduler_release(int resource, int granted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
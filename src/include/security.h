@@ -46,6 +46,14 @@ extern "C" {
 #define HASH_ALGORITHM_SHA384  4
 #define HASH_ALGORITHM_SHA512  5
 
+/**
+ * Connect the servers from this process to another host, like a standby
+ * @param host The host, or NULL to connect to the host of the server again
+ * @param port The port
+ */
+void
+pgmoneta_server_source(char* host, int port);
+
 /**
  * Authenticate a user
  * @param server The server
@@ -70,6 +78,15 @@ pgmoneta_server_authenticate(int server, char* database, char* username, char* p
 int
 pgmoneta_remote_management_auth(int client_fd, char* address, SSL** client_ssl);
 
+/**
+ * Generate the SCRAM salt and the TLS session ticket keys of the remote management.
+ * They are shared by the processes, so a management client can resume its TLS session
+ * and its salted password is cached
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_remote_management_init(void);
+
 /**
  * Connect using SCRAM-SHA256
  * @param username The user name
@@ -49,6 +49,18 @@ pgmoneta_server_info(int srv);
 bool
 pgmoneta_server_valid(int srv);
 
+/**
+ * Select the standby of a server with the least replay lag to take a backup from.
+ * The host is empty when there is no standby, and the backup is taken from the server
+ * @param srv The server index
+ * @param host The resulting host
+ * @param length The length of the host
+ * @param port The resulting port
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_server_backup_source(int srv, char* host, size_t length, int* port);
+
 #ifdef __cplusplus
 }
 #endif
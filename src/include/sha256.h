@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_SHA256_H
+#define PGMONETA_SHA256_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <art.h>
+#include <deque.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define SHA256_LENGTH        32
+#define SHA256_HEX_LENGTH    65
+#define SHA256_BLOCK         64
+#define SHA256_LANES         8
+#define SHA256_SMALL_FILE    (64 * 1024)
+#define SHA256_BUFFER_SIZE   (1024 * 1024)
+
+#define SHA256_INDEX         "backup.checksums"
+
+/** @struct sha256_job
+ * Defines a file to hash
+ */
+struct sha256_job
+{
+   char* path;   /**< The path of the file */
+   char* sha256; /**< The resulting hash, NULL upon failure */
+};
+
+/**
+ * Are the buffers hashed in parallel lanes on this CPU
+ * @return True if multi-buffer hashing is available, otherwise false
+ */
+bool
+pgmoneta_sha256_multi_buffer(void);
+
+/**
+ * Hash a number of buffers. The buffers are hashed SHA256_LANES at a time
+ * when the CPU supports it, otherwise one after the other
+ * @param data The buffers
+ * @param sizes The sizes of the buffers
+ * @param number_of_buffers The number of buffers
+ * @param digests The resulting digests
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_sha256_buffers(unsigned char** data, size_t* sizes, int number_of_buffers, unsigned char digests[][SHA256_LENGTH]);
+
+/**
+ * Hash a file using the digest context and buffer of the current thread
+ * @param path The path of the file
+ * @param sha256 The resulting hash
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_sha256_file(char* path, char** sha256);
+
+/**
+ * Hash a range of a file using the digest context and buffer of the current thread
+ * @param path The path of the file
+ * @param offset The offset of the range
+ * @param size The size of the range, or 0 for the rest of the file
+ * @param sha256 The resulting hash
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_sha256_file_range(char* path, off_t offset, size_t size, char** sha256);
+
+/**
+ * Hash a number of files. Files up to SHA256_SMALL_FILE are read into memory
+ * and hashed together in lanes, larger files are streamed one at a time
+ * @param jobs The files
+ * @param number_of_jobs The number of files
+ * @return 0 upon success, otherwise 1 if any file could not be hashed
+ */
+int
+pgmoneta_sha256_files(struct sha256_job* jobs, int number_of_jobs);
+
+/**
+ * Format a digest as a hex string
+ * @param digest The digest
+ * @param sha256 The resulting string
+ */
+void
+pgmoneta_sha256_hex(unsigned char* digest, char** sha256);
+
+/**
+ * Write the checksum index of a backup. Each file is recorded with its
+ * size and modification time, so a later change of the file invalidates
+ * its entry
+ * @param backup_base The backup base directory
+ * @param hashes The SHA-256 of the files, tagged by their absolute path
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_sha256_index_write(char* backup_base, struct deque* hashes);
+
+/**
+ * Read the checksum index of a backup
+ * @param backup_base The backup base directory
+ * @param index The resulting index, keyed by the path relative to the backup base
+ * @return 0 upon success, otherwise 1 if there is no index
+ */
+int
+pgmoneta_sha256_index_read(char* backup_base, struct art** index);
+
+/**
+ * Look up a file in the checksum index
+ * @param index The index, may be NULL
+ * @param relative The path relative to the backup base, a leading '/' is ignored
+ * @param path The path of the file
+ * @return The SHA-256 if the file is unchanged since it was indexed, otherwise NULL
+ */
+char*
+pgmoneta_sha256_index_lookup(struct art* index, char* relative, char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,11 +34,218 @@ extern "C" {
 #endif
 
 /* pgmoneta */
+#include <deque.h>
+#include <utils.h>
+#include <workers.h>
 #include <workflow.h>
 
 /* system */
 #include <libssh/libssh.h>
 #include <libssh/sftp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/** @struct storage_backend
+ * Defines the operations of a remote storage engine. The paths are relative to
+ * the base directory of the engine. A backend is shared by the threads of a
+ * transfer, and every thread keeps its own connection to the remote side
+ */
+struct storage_backend
+{
+   char name[MISC_LENGTH];                                                             /**< The name of the backend */
+   int (*put)(struct storage_backend* backend, char* local_path, char* remote_path);   /**< Upload a file */
+   int (*get)(struct storage_backend* backend, char* remote_path, char* local_path);   /**< Download a file */
+   int (*list)(struct storage_backend* backend, char* remote_path, struct deque** names); /**< List a directory */
+   int (*remove)(struct storage_backend* backend, char* remote_path);                  /**< Remove a file */
+   int (*remove_directory)(struct storage_backend* backend, char* remote_path);        /**< Remove a directory and all its files with as few requests as possible */
+   int (*stream)(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out); /**< Download a file, or a range of it when length is above 0, into a stream */
+   size_t range_size;                                                                  /**< The size of the ranges of a download, 0 to download files whole */
+};
+
+/** @struct storage_transfer
+ * Defines a set of asynchronous operations on a backend. The operations are run by
+ * the workers, and the bytes they move are limited by storage_max_rate
+ */
+struct storage_transfer
+{
+   struct storage_backend* backend; /**< The backend */
+   struct workers* workers;         /**< The workers, or NULL to run the operations inline */
+   struct token_bucket* bucket;     /**< The rate limit, or NULL */
+   struct backup* backup;           /**< The backup that is restored, or NULL */
+   atomic_ullong bytes;             /**< The number of bytes moved */
+   atomic_int failed;               /**< The number of failed operations */
+};
+
+/**
+ * Create the backend of the configured remote storage engine
+ * @param backend The resulting backend, or NULL for the local storage engine
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_backend_create(struct storage_backend** backend);
+
+/**
+ * Destroy a backend
+ * @param backend The backend
+ */
+void
+pgmoneta_storage_backend_destroy(struct storage_backend* backend);
+
+/**
+ * Create a transfer on a backend
+ * @param server The server index, its workers run the operations
+ * @param backend The backend
+ * @param transfer The resulting transfer
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_transfer_create(int server, struct storage_backend* backend, struct storage_transfer** transfer);
+
+/**
+ * Queue the upload of a file
+ * @param transfer The transfer
+ * @param local_path The local path
+ * @param remote_path The remote path
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_put(struct storage_transfer* transfer, char* local_path, char* remote_path);
+
+/**
+ * Queue the download of a file
+ * @param transfer The transfer
+ * @param remote_path The remote path
+ * @param local_path The local path
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_get(struct storage_transfer* transfer, char* remote_path, char* local_path);
+
+/**
+ * Queue the removal of a file
+ * @param transfer The transfer
+ * @param remote_path The remote path
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_remove(struct storage_transfer* transfer, char* remote_path);
+
+/**
+ * Queue the upload of a directory and all its files
+ * @param transfer The transfer
+ * @param local_root The local directory
+ * @param remote_root The remote directory
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_put_directory(struct storage_transfer* transfer, char* local_root, char* remote_root);
+
+/**
+ * List a remote directory
+ * @param backend The backend
+ * @param remote_path The remote directory
+ * @param names The resulting names
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_list(struct storage_backend* backend, char* remote_path, struct deque** names);
+
+/**
+ * Wait for the queued operations of a transfer
+ * @param transfer The transfer
+ * @return 0 if all operations succeeded, otherwise 1
+ */
+int
+pgmoneta_storage_transfer_wait(struct storage_transfer* transfer);
+
+/**
+ * Destroy a transfer, the queued operations are finished first
+ * @param transfer The transfer
+ */
+void
+pgmoneta_storage_transfer_destroy(struct storage_transfer* transfer);
+
+/**
+ * Download the metadata of a backup from the remote storage engine, so a backup
+ * whose local directory is gone can be restored
+ * @param server The server index
+ * @param label The label of the backup
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_fetch_backup(int server, char* label);
+
+/**
+ * Restore the data of a full backup from the remote storage engine. The files are
+ * decrypted and decompressed while they are downloaded, and plain files are
+ * downloaded as parallel ranges
+ * @param server The server index
+ * @param backup The backup
+ * @param to The target directory
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_restore(int server, struct backup* backup, char* to);
+
+/**
+ * Get the number of days the data of a backup stays on local storage
+ * @param server The server index
+ * @return The number of days, 0 when only the remote copy is kept
+ */
+int
+pgmoneta_storage_retention_local(int server);
+
+/**
+ * Move the data of a backup to the remote storage engine. The backup is uploaded
+ * unless the remote side already has it, and only its metadata is kept locally
+ * @param server The server index
+ * @param backup The backup
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_tier(int server, struct backup* backup);
+
+/**
+ * Download the data of a backup, and of the parents of an incremental backup,
+ * when it only exists on the remote storage engine. The files are kept as they
+ * were stored
+ * @param server The server index
+ * @param backup The backup
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_storage_recall(int server, struct backup* backup);
+
+/**
+ * Remove the remote copy of a backup. It runs in the background, next to the
+ * local deletion
+ * @param server The server index
+ * @param label The label of the backup
+ */
+void
+pgmoneta_storage_remove_backup(int server, char* label);
+
+/**
+ * Create the backend of the SSH storage engine
+ * @return The backend
+ */
+struct storage_backend*
+pgmoneta_storage_backend_ssh(void);
+
+/**
+ * Create the backend of the S3 storage engine
+ * @return The backend
+ */
+struct storage_backend*
+pgmoneta_storage_backend_s3(void);
+
+/**
+ * Create the backend of the Azure storage engine
+ * @return The backend
+ */
+struct storage_backend*
+pgmoneta_storage_backend_azure(void);
 
 /**
  * Create a workflow for the local storage engine
@@ -90,6 +297,26 @@ pgmoneta_sftp_wal_open(int server, char* filename, int segsize, sftp_file* file)
  */
 int
 pgmoneta_sftp_wal_close(int server, char* filename, bool partial, sftp_file* file);
+
+/**
+ * Is the restore directory a remote host, f.ex. ssh://user@host:22/path
+ * @param target The restore directory
+ * @return True if remote, otherwise false
+ */
+bool
+pgmoneta_sftp_restore_target(char* target);
+
+/**
+ * Restore a full backup directly to a remote host. The files are decrypted and
+ * decompressed while they are sent, each worker uses its own SSH session
+ * @param server The server index
+ * @param backup The backup
+ * @param position The position, or NULL
+ * @param target The restore directory, f.ex. ssh://user@host:22/path
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_sftp_restore(int server, struct backup* backup, char* position, char* target);
 #ifdef __cplusplus
 }
 #endif
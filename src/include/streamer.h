@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_STREAMER_H
+#define PGMONETA_STREAMER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+#include <lz4_compression.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bzlib.h>
+#include <lz4.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <openssl/evp.h>
+
+/** @struct streamer
+ * Defines a streamer that compresses and encrypts data in a single pass
+ * while writing it to a file. The output is identical to the data that
+ * the file based compression and encryption functions produce
+ */
+struct streamer
+{
+   int compression;                   /**< The compression type */
+   int encryption;                    /**< The encryption mode */
+   FILE* file;                        /**< The output file */
+   ZSTD_CCtx* zstd;                   /**< The Zstandard context */
+   int zstd_threads;                  /**< The Zstandard workers held from scheduler_workers and memory_budget */
+   LZ4_stream_t* lz4;                 /**< The LZ4 stream */
+   char lz4_buffer[2][BLOCK_BYTES];   /**< The LZ4 double buffer */
+   int lz4_index;                     /**< The active LZ4 buffer */
+   size_t lz4_length;                 /**< The number of bytes in the active LZ4 buffer */
+   z_stream* gzip;                    /**< The GZip stream */
+   bz_stream* bzip2;                  /**< The BZip2 stream */
+   EVP_CIPHER_CTX* cipher;            /**< The cipher context */
+   struct aead* aead;                 /**< The authenticated encryption stream */
+   unsigned char* buffer;             /**< The output buffer */
+   size_t buffer_size;                /**< The size of the output buffer */
+   unsigned char* cipher_buffer;      /**< The cipher buffer */
+   size_t cipher_buffer_size;         /**< The size of the cipher buffer */
+   EVP_MD_CTX* digest;                /**< The SHA-256 context of the output */
+   size_t bytes_in;                   /**< The number of bytes received */
+   size_t bytes_out;                  /**< The number of bytes written */
+};
+
+/** @struct destreamer
+ * Defines a destreamer that decrypts and decompresses data in a single pass
+ * while writing it to a file. It reverses the output of a streamer and of the
+ * file based compression and encryption functions
+ */
+struct destreamer
+{
+   int compression;                   /**< The compression type */
+   int encryption;                    /**< The encryption mode */
+   FILE* file;                        /**< The output file */
+   ZSTD_DCtx* zstd;                   /**< The Zstandard context */
+   bool zstd_started;                 /**< Has the dictionary of the data been resolved */
+   size_t zstd_remaining;             /**< The result of the last Zstandard call, 0 at the end of a frame */
+   LZ4_streamDecode_t* lz4;           /**< The LZ4 stream */
+   char lz4_buffer[2][BLOCK_BYTES];   /**< The LZ4 double buffer */
+   int lz4_index;                     /**< The active LZ4 buffer */
+   int lz4_block;                     /**< The size of the current LZ4 block, 0 while its size is read, -1 after the last block */
+   size_t lz4_length;                 /**< The number of bytes of the current LZ4 block, or of its size */
+   z_stream* gzip;                    /**< The GZip stream */
+   bool gzip_end;                     /**< Has the current GZip member ended */
+   bz_stream* bzip2;                  /**< The BZip2 stream */
+   bool bzip2_end;                    /**< Has the current BZip2 stream ended */
+   EVP_CIPHER_CTX* cipher;            /**< The cipher context */
+   struct aead* aead;                 /**< The authenticated decryption stream */
+   unsigned char* buffer;             /**< The decompression buffer */
+   size_t buffer_size;                /**< The size of the decompression buffer */
+   unsigned char* cipher_buffer;      /**< The cipher buffer */
+   size_t cipher_buffer_size;         /**< The size of the cipher buffer */
+   size_t bytes_in;                   /**< The number of bytes received */
+   size_t bytes_out;                  /**< The number of bytes written */
+   bool sparse;                       /**< Are zero blocks left as holes in the output file */
+   bool hole;                         /**< Does the output end in a hole */
+};
+
+/**
+ * Create a streamer
+ * @param compression The compression type
+ * @param level The compression level
+ * @param encryption The encryption mode
+ * @param file The output file
+ * @param streamer The resulting streamer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_streamer_create(int compression, int level, int encryption, FILE* file, struct streamer** streamer);
+
+/**
+ * Write data through the streamer
+ * @param streamer The streamer
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_streamer_write(struct streamer* streamer, void* data, size_t size);
+
+/**
+ * Finish the streamer, flushing the compression and encryption state to the file.
+ * The file itself is not closed
+ * @param streamer The streamer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_streamer_finish(struct streamer* streamer);
+
+/**
+ * Calculate the SHA-256 of the output while streaming, must be called
+ * before the first write
+ * @param streamer The streamer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_streamer_digest(struct streamer* streamer);
+
+/**
+ * Get the SHA-256 of the output of a finished streamer
+ * @param streamer The streamer
+ * @param sha256 The resulting hex string, must be freed
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_streamer_sha256(struct streamer* streamer, char** sha256);
+
+/**
+ * Destroy a streamer
+ * @param streamer The streamer
+ */
+void
+pgmoneta_streamer_destroy(struct streamer* streamer);
+
+/**
+ * Create a destreamer
+ * @param compression The compression type
+ * @param encryption The encryption mode, the mode of authenticated data is read from its header
+ * @param file The output file
+ * @param destreamer The resulting destreamer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_destreamer_create(int compression, int encryption, FILE* file, struct destreamer** destreamer);
+
+/**
+ * Write data through the destreamer
+ * @param destreamer The destreamer
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_destreamer_write(struct destreamer* destreamer, void* data, size_t size);
+
+/**
+ * Finish the destreamer, checking that the data was complete and flushing it to the file.
+ * The file itself is not closed
+ * @param destreamer The destreamer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_destreamer_finish(struct destreamer* destreamer);
+
+/**
+ * Destroy a destreamer
+ * @param destreamer The destreamer
+ */
+void
+pgmoneta_destreamer_destroy(struct destreamer* destreamer);
+
+/**
+ * Decrypt and decompress a file in a single pass. The compression type and the
+ * encryption are taken from the suffixes of the file, f.ex. ".zstd.aes"
+ * @param from The file
+ * @param to The decoded file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_destreamer_file(char* from, char* to);
+
+/**
+ * Decrypt and decompress a file in a single pass into an open stream. The compression
+ * type and the encryption are taken from the suffixes of the file, files without one are copied
+ * @param from The file
+ * @param out The stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_destreamer_stream(char* from, FILE* out);
+
+/**
+ * Decrypt and decompress the start of a file into an open stream. The decoding stops
+ * once at least the given number of bytes are written, so f.ex. a header can be read
+ * without decoding the whole file. An authenticated file isn't verified by this
+ * @param from The file
+ * @param size The number of bytes needed
+ * @param out The stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_destreamer_head(char* from, size_t size, FILE* out);
+
+/**
+ * Get the file suffix for a compression type and an encryption mode, f.ex. ".zstd.aes"
+ * @param compression The compression type
+ * @param encryption The encryption mode
+ * @return The suffix, must be freed
+ */
+char*
+pgmoneta_streamer_suffix(int compression, int encryption);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
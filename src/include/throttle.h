@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_THROTTLE_H
+#define PGMONETA_THROTTLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define THROTTLE_INTERVAL 5
+#define THROTTLE_MIN_RATE (1024 * 1024)
+
+/**
+ * Is the load-aware backup throttle enabled
+ * @return True if enabled, otherwise false
+ */
+bool
+pgmoneta_throttle_enabled(void);
+
+/**
+ * Start the load-aware throttle of the backups of a server. A process probes
+ * the load of the server, and adjusts the network rate shared by the
+ * backups of the server until the backup ends
+ * @param server The server index
+ * @return The pid of the throttle process, or 0 if not started
+ */
+pid_t
+pgmoneta_throttle_start(int server);
+
+/**
+ * Stop the load-aware throttle of a server, and restore its configured network rate
+ * @param server The server index
+ * @param pid The pid of the throttle process
+ */
+void
+pgmoneta_throttle_stop(int server, pid_t pid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_TRACE_H
+#define PGMONETA_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_WORKFLOW "workflow"
+#define TRACE_NODE     "node"
+#define TRACE_WORKER   "worker"
+#define TRACE_NETWORK  "network"
+#define TRACE_STORAGE  "storage"
+
+/* a network read is only traced when it waited this long, in microseconds */
+#define TRACE_SLOW_READ 1000
+
+/**
+ * Start the trace of a workflow when it is sampled. A nested workflow
+ * is part of the trace of the workflow that runs it
+ */
+void
+pgmoneta_trace_start(void);
+
+/**
+ * Is the workflow traced
+ * @return True if traced, otherwise false
+ */
+bool
+pgmoneta_trace_enabled(void);
+
+/**
+ * Get the time of the trace
+ * @return The time in microseconds, or 0 when the workflow isn't traced
+ */
+uint64_t
+pgmoneta_trace_now(void);
+
+/**
+ * Add an event that ends now. The oldest event is dropped when the trace is full
+ * @param category The category
+ * @param name The name
+ * @param detail The detail, like the file, or NULL
+ * @param start The start from pgmoneta_trace_now()
+ */
+void
+pgmoneta_trace_event(char* category, char* name, char* detail, uint64_t start);
+
+/**
+ * Write the trace of a workflow to the trace directory of the server, and stop it
+ * @param server The server index
+ * @param label The label of the workflow, or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_trace_finish(int server, char* label);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_TRASH_H
+#define PGMONETA_TRASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+/**
+ * Move a directory to the trash of a server. The directory is renamed, so it is
+ * gone at once and its space is reclaimed later
+ * @param server The server
+ * @param directory The directory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_trash_move(int server, char* directory);
+
+/**
+ * Move files of a directory to the trash of a server in one batch. The files
+ * are renamed into a new directory of the trash, the ones on another file
+ * system are deleted
+ * @param server The server
+ * @param directory The directory of the files
+ * @param number_of_files The number of files
+ * @param files The names of the files
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_trash_files(int server, char* directory, int number_of_files, char** files);
+
+/**
+ * Reclaim the space of the trash of a server with parallel unlinks, limited by
+ * delete_max_rate. Only one process reclaims the trash of a server at a time
+ * @param server The server
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_trash_reclaim(int server);
+
+/**
+ * Reclaim the trash of a server in a background process
+ * @param server The server
+ */
+void
+pgmoneta_trash_reclaim_background(int server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
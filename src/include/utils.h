@@ -39,14 +39,19 @@ extern "C" {
 #include <pgmoneta.h>
 #include <info.h>
 #include <message.h>
+#include <protocol.h>
 #include <workers.h>
 
 #include <stdlib.h>
 
+struct restore_filter;
+
 #define SHORT_TIME_LENGHT 8 + 1
 #define LONG_TIME_LENGHT  16 + 1
 #define UTC_TIME_LENGTH   29 + 1
 
+#define SPARSE_BLOCK_SIZE 4096
+
 /** Define Windows 20 palette colors as constants using ANSI codes **/
 #define COLOR_BLACK         "\033[30m"
 #define COLOR_DARK_RED      "\033[31m"
@@ -128,18 +133,6 @@ struct pgmoneta_parsed_command
    char* args[MISC_LENGTH];            /**< The arguments */
 };
 
-/** @struct token_bucket
- * Defines token bucket structure
- */
-struct token_bucket
-{
-   unsigned long burst;     /**< Default value is 0, no limit */
-   atomic_ulong cur_tokens; /**< The current tokens */
-   long max_rate;           /**< The maximum rate */
-   int every;               /**< The every rate */
-   atomic_ulong last_time;  /**< The last time updated */
-};
-
 /**
  * Utility function to parse the command line
  * and search for a command.
@@ -241,144 +234,198 @@ pgmoneta_extract_message_from_data(char type, void* data, size_t data_size, stru
  * @param data Pointer to the data
  * @return The byte
  */
-signed char
-pgmoneta_read_byte(void* data);
+static inline signed char
+pgmoneta_read_byte(void* data)
+{
+   return *((signed char*)data);
+}
 
 /**
  * Read an uint8
  * @param data Pointer to the data
  * @return The uint8
  */
-uint8_t
-pgmoneta_read_uint8(void* data);
+static inline uint8_t
+pgmoneta_read_uint8(void* data)
+{
+   return *((uint8_t*)data);
+}
 
 /**
  * Read an int16
  * @param data Pointer to the data
  * @return The int16
  */
-int16_t
-pgmoneta_read_int16(void* data);
+static inline int16_t
+pgmoneta_read_int16(void* data)
+{
+   return (int16_t)pgmoneta_protocol_load16(data);
+}
 
 /**
  * Read an uint16
  * @param data Pointer to the data
  * @return The uint16
  */
-uint16_t
-pgmoneta_read_uint16(void* data);
+static inline uint16_t
+pgmoneta_read_uint16(void* data)
+{
+   return pgmoneta_protocol_load16(data);
+}
 
 /**
  * Read an int32
  * @param data Pointer to the data
  * @return The int32
  */
-int32_t
-pgmoneta_read_int32(void* data);
+static inline int32_t
+pgmoneta_read_int32(void* data)
+{
+   return (int32_t)pgmoneta_protocol_load32(data);
+}
 
 /**
  * Read an uint32
  * @param data Pointer to the data
  * @return The uint32
  */
-uint32_t
-pgmoneta_read_uint32(void* data);
+static inline uint32_t
+pgmoneta_read_uint32(void* data)
+{
+   return pgmoneta_protocol_load32(data);
+}
 
 /**
  * Read an int64
  * @param data Pointer to the data
  * @return The int64
  */
-int64_t
-pgmoneta_read_int64(void* data);
+static inline int64_t
+pgmoneta_read_int64(void* data)
+{
+   return (int64_t)pgmoneta_protocol_load64(data);
+}
 
 /**
  * Read an uint64
  * @param data Pointer to the data
  * @return The uint64
  */
-uint64_t
-pgmoneta_read_uint64(void* data);
+static inline uint64_t
+pgmoneta_read_uint64(void* data)
+{
+   return pgmoneta_protocol_load64(data);
+}
 
 /**
  * Read a bool
  * @param data Pointer to the data
  * @return The bool
  */
-bool
-pgmoneta_read_bool(void* data);
+static inline bool
+pgmoneta_read_bool(void* data)
+{
+   return *((bool*)data);
+}
 
 /**
  * Write a byte
  * @param data Pointer to the data
  * @param b The byte
  */
-void
-pgmoneta_write_byte(void* data, signed char b);
+static inline void
+pgmoneta_write_byte(void* data, signed char b)
+{
+   *((signed char*)data) = b;
+}
 
 /**
  * Write a uint8
  * @param data Pointer to the data
  * @param b The uint8
  */
-void
-pgmoneta_write_uint8(void* data, uint8_t b);
+static inline void
+pgmoneta_write_uint8(void* data, uint8_t b)
+{
+   *((uint8_t*)data) = b;
+}
 
 /**
  * Write an int16
  * @param data Pointer to the data
  * @param i The int16
  */
-void
-pgmoneta_write_int16(void* data, int16_t i);
+static inline void
+pgmoneta_write_int16(void* data, int16_t i)
+{
+   pgmoneta_protocol_store16(data, (uint16_t)i);
+}
 
 /**
  * Write an uint16
  * @param data Pointer to the data
  * @param i The uint16
  */
-void
-pgmoneta_write_uint16(void* data, uint16_t i);
+static inline void
+pgmoneta_write_uint16(void* data, uint16_t i)
+{
+   pgmoneta_protocol_store16(data, i);
+}
 
 /**
  * Write an int32
  * @param data Pointer to the data
  * @param i The int32
  */
-void
-pgmoneta_write_int32(void* data, int32_t i);
+static inline void
+pgmoneta_write_int32(void* data, int32_t i)
+{
+   pgmoneta_protocol_store32(data, (uint32_t)i);
+}
 
 /**
  * Write an uint32
  * @param data Pointer to the data
  * @param i The uint32
  */
-void
-pgmoneta_write_uint32(void* data, uint32_t i);
+static inline void
+pgmoneta_write_uint32(void* data, uint32_t i)
+{
+   pgmoneta_protocol_store32(data, i);
+}
 
 /**
  * Write an int64
  * @param data Pointer to the data
  * @param i The int64
  */
-void
-pgmoneta_write_int64(void* data, int64_t i);
+static inline void
+pgmoneta_write_int64(void* data, int64_t i)
+{
+   pgmoneta_protocol_store64(data, (uint64_t)i);
+}
 
 /**
  * Write an uint64
  * @param data Pointer to the data
  * @param i The uint64
  */
-void
-pgmoneta_write_uint64(void* data, uint64_t i);
+static inline void
+pgmoneta_write_uint64(void* data, uint64_t i)
+{
+   pgmoneta_protocol_store64(data, i);
+}
 
 /**
  * Write an bool
  * @param data Pointer to the data
  * @param i The bool
  */
-void
-pgmoneta_write_bool(void* data, bool b);
+static inline void
+pgmoneta_write_bool(void* data, bool b)
+{
+   *((bool*)data) = b;
+}
 
 /**
  * Read a string
@@ -510,6 +557,25 @@ pgmoneta_base64_decode(char* encoded, size_t encoded_length, void** raw, size_t*
 void
 pgmoneta_set_proc_title(int argc, char** argv, char* s1, char* s2);
 
+/**
+ * Parse a CPU list, like 0-3,8,10-11
+ * @param list The CPU list
+ * @param cpus The CPUs
+ * @param size The size of the CPUs array
+ * @return The number of CPUs, or -1 if the list isn't valid
+ */
+int
+pgmoneta_cpu_list(char* list, int* cpus, int size);
+
+/**
+ * Pin the calling thread to the CPUs of cpu_affinity, or do nothing if it isn't set.
+ * The memory that the thread touches first is then allocated on the NUMA node of its CPUs
+ * @param index The index of the CPU in the list, modulo its length, or -1 for all the CPUs
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_cpu_affinity(int index);
+
 /**
  * Provide the application version number as a unique value composed of the three
  * specified parts. For example, when invoked with (1,5,0) it returns 10500.
@@ -653,6 +719,26 @@ pgmoneta_remove_suffix(char* orig, char* suffix);
 unsigned long
 pgmoneta_directory_size(char* directory);
 
+/**
+ * Calculate the size of the WAL directory of a server. The size is cached in
+ * shared memory until the directory changes
+ * @param server The server
+ * @return The size in bytes
+ */
+unsigned long
+pgmoneta_server_wal_size(int server);
+
+/**
+ * Calculate the size of a server from the sizes recorded for its backups and
+ * the size of its WAL directory, without walking the backups
+ * @param server The server
+ * @param number_of_backups The number of backups
+ * @param backups The backups
+ * @return The size in bytes
+ */
+unsigned long
+pgmoneta_server_size(int server, int number_of_backups, struct backup** backups);
+
 /**
  * Get directories
  * @param base The base directory
@@ -708,11 +794,12 @@ pgmoneta_delete_file(char* file, struct workers* workers);
  * @param server The server name
  * @param id The identifier
  * @param backup The backup
+ * @param filter The filter of a selective restore, or NULL
  * @param workers The optional workers
  * @return The result
  */
 int
-pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct workers* workers);
+pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct restore_filter* filter, struct workers* workers);
 
 /**
  * Copy a PostgreSQL installation
@@ -754,6 +841,51 @@ pgmoneta_list_directory(char* directory);
 int
 pgmoneta_copy_file(char* from, char* to, struct workers* workers);
 
+/**
+ * Decrypt and decompress a file into another file in a single pass
+ * @param from The compressed and/or encrypted file
+ * @param to The decoded file
+ * @param workers The workers
+ * @return The result
+ */
+int
+pgmoneta_decode_file(char* from, char* to, struct workers* workers);
+
+/**
+ * Flush the file system holding a path to disk. Copies are not synced one
+ * by one, so a workflow calls this once it has written all of its files
+ * @param path The path
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_sync_filesystem(char* path);
+
+/**
+ * Set how the files written by the workflow of this process are made durable
+ * @param mode The mode (DURABILITY_SYNCFS, DURABILITY_FSYNC or DURABILITY_WRITE_BEHIND)
+ */
+void
+pgmoneta_durability(int mode);
+
+/**
+ * Make a written file durable according to the mode of the process. With
+ * syncfs nothing is done, since the file system is synced once at the end
+ * of the workflow. Write behind starts the write back of the file without
+ * waiting for it, so the final sync has little left to do
+ * @param fd The file descriptor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_durability_file(int fd);
+
+/**
+ * Make a written file durable according to the mode of the process
+ * @param path The path of the file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_durability_path(char* path);
+
 /**
  * Move a file
  * @param from The from file
@@ -804,6 +936,15 @@ pgmoneta_is_directory(char* directory);
 bool
 pgmoneta_is_file(char* file);
 
+/**
+ * Are all the bytes zero
+ * @param data The data
+ * @param size The size of the data
+ * @return True if all the bytes are zero, otherwise false
+ */
+bool
+pgmoneta_is_zero(void* data, size_t size);
+
 /**
  * Compare files
  * @param f1 The first file path
@@ -856,15 +997,16 @@ bool
 pgmoneta_is_symlink_valid(char* path);
 
 /**
- * Copy WAL files
+ * Copy WAL files. Compressed and encrypted segments are decoded while they are copied
  * @param from The from directory
  * @param to The to directory
  * @param start The start file
+ * @param end The last WAL segment to copy, or NULL for all
  * @param workers The optional workers
  * @return The result
  */
 int
-pgmoneta_copy_wal_files(char* from, char* to, char* start, struct workers* workers);
+pgmoneta_copy_wal_files(char* from, char* to, char* start, char* end, struct workers* workers);
 
 /**
  * Get the number of WAL files
@@ -876,6 +1018,17 @@ pgmoneta_copy_wal_files(char* from, char* to, char* start, struct workers* worke
 int
 pgmoneta_number_of_wal_files(char* directory, char* from, char* to);
 
+/**
+ * Get the number of WAL files in a sorted list of files
+ * @param number_of_files The number of files
+ * @param files The sorted file names
+ * @param from The from WAL file
+ * @param to The to WAL file; can be NULL
+ * @return The result
+ */
+int
+pgmoneta_number_of_wal_files_in(int number_of_files, char** files, char* from, char* to);
+
 /**
  * Get the free space for a path
  * @param path The path
@@ -1011,6 +1164,14 @@ pgmoneta_get_server_backup(int server);
 char*
 pgmoneta_get_server_wal(int server);
 
+/**
+ * Get the WAL index directory for a server
+ * @param server The server
+ * @return The WAL index directory
+ */
+char*
+pgmoneta_get_server_wal_index(int server);
+
 /**
  * Get the wal shipping directory for a server
  * @param server The server
@@ -1211,7 +1372,7 @@ bool
 pgmoneta_is_compressed_archive(char* file_path);
 
 /**
- * Init a token bucket
+ * Init a token bucket, which has no parent
  * @param tb The token bucket
  * @param max_rate The number of bytes of tokens added every one second
  * @return 0 upon success, otherwise 1
@@ -1219,6 +1380,30 @@ pgmoneta_is_compressed_archive(char* file_path);
 int
 pgmoneta_token_bucket_init(struct token_bucket* tb, long max_rate);
 
+/**
+ * Init the token buckets in shared memory, the global one from total_max_rate
+ * and one per server from network_max_rate that takes from the global one.
+ * Their burst is raised to max_rate_burst
+ */
+void
+pgmoneta_token_bucket_init_shared(void);
+
+/**
+ * Change the rate of a token bucket that is in use, keeping its parent
+ * @param tb The token bucket
+ * @param max_rate The number of bytes of tokens added every one second, 0 for no limit
+ */
+void
+pgmoneta_token_bucket_rate(struct token_bucket* tb, long max_rate);
+
+/**
+ * Is a token bucket, or one of its parents, limited
+ * @param tb The token bucket
+ * @return true if limited, otherwise false
+ */
+bool
+pgmoneta_token_bucket_limited(struct token_bucket* tb);
+
 /**
  * Free the memory of the token bucket
  * @param tb The token bucket
@@ -1244,7 +1429,8 @@ int
 pgmoneta_token_bucket_consume(struct token_bucket* tb, unsigned long tokens);
 
 /**
- * Get tokens from token bucket once
+ * Get tokens from token bucket once. The tokens are taken from the parents too,
+ * and given back when a parent doesn't have them
  * @param tb The token bucket
  * @param tokens Needed tokens
  * @return 0 upon success, otherwise 1
@@ -111,6 +111,27 @@ pgmoneta_value_create(enum value_type type, uintptr_t data, struct value** value
 int
 pgmoneta_value_create_with_config(uintptr_t data, struct value_config* config, struct value** value);
 
+/**
+ * Initialize a value that is embedded in another structure, see pgmoneta_value_create
+ * @param type The value type
+ * @param data The value data, type cast it to uintptr_t before passing into function
+ * @param value The value
+ * @return 0 on success, 1 if otherwise
+ */
+int
+pgmoneta_value_init(enum value_type type, uintptr_t data, struct value* value);
+
+/**
+ * Initialize a value that is embedded in another structure with a config,
+ * see pgmoneta_value_create_with_config
+ * @param data The value data, type cast it to uintptr_t before passing into function
+ * @param config The configuration
+ * @param value The value
+ * @return 0 on success, 1 if otherwise
+ */
+int
+pgmoneta_value_init_with_config(uintptr_t data, struct value_config* config, struct value* value);
+
 /**
  * Destroy a value along with the data within
  * @param value The value
@@ -119,6 +140,14 @@ pgmoneta_value_create_with_config(uintptr_t data, struct value_config* config, s
 int
 pgmoneta_value_destroy(struct value* value);
 
+/**
+ * Destroy the data within a value that is embedded in another structure,
+ * the value itself is not freed
+ * @param value The value
+ */
+void
+pgmoneta_value_release(struct value* value);
+
 /**
  * Get the raw data from the value, which can be casted back to its original type
  * @param value The value
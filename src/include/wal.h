@@ -37,6 +37,8 @@ extern "C" {
 #include <stdint.h>
 #include <stdlib.h>
 
+#define WAL_REPLAY_BUCKETS 32
+
 /** @struct timeline_history
  * Defines a timeline history
  */
@@ -48,6 +50,19 @@ struct timeline_history
    struct timeline_history* next; /**< the next history entry */
 };
 
+/** @struct wal_replay
+ * Defines the outcome of a replayed replication stream
+ */
+struct wal_replay
+{
+   uint64_t messages;                     /**< The number of WAL data messages */
+   uint64_t bytes;                        /**< The number of WAL bytes */
+   double elapsed;                        /**< The seconds from the first message to the end of the stream */
+   double latency_total;                  /**< The total seconds spent processing the messages */
+   double latency_max;                    /**< The longest processing of a message in seconds */
+   uint64_t latency[WAL_REPLAY_BUCKETS];  /**< The messages per latency, bucket i is below 2^i microseconds */
+};
+
 /**
  * Receive WAL
  * @param srv The server index
@@ -56,6 +71,43 @@ struct timeline_history
 void
 pgmoneta_wal(int srv, char** argv);
 
+/**
+ * Receive WAL for several servers in a single process
+ * @param servers The server indexes
+ * @param number_of_servers The number of servers
+ * @param argv The argv
+ */
+void
+pgmoneta_wal_multiplex(int* servers, int number_of_servers, char** argv);
+
+/**
+ * Fill the pool of pre-allocated WAL segments for a server
+ * @param srv The server index
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_wal_prealloc(int srv);
+
+/**
+ * Move a complete WAL segment into the pool of pre-allocated segments
+ * @param directory The WAL directory
+ * @param path The path of the segment
+ * @return 0 if the segment was recycled, otherwise 1
+ */
+int
+pgmoneta_wal_recycle(char* directory, char* path);
+
+/**
+ * Compress and encrypt the segments of a WAL directory that are still raw. A segment
+ * is compressed and encrypted in one pass, and the segments are handed to the workers
+ * of the server oldest first, so a backlog is cleared in parallel and in order
+ * @param srv The server index
+ * @param directory The WAL directory
+ * @return 0 on success, otherwise 1
+ */
+int
+pgmoneta_wal_compress_pending(int srv, char* directory);
+
 /**
  * Find and extract the history info from .history file of given server and timeline
  * @param srv The server index
@@ -73,6 +125,37 @@ pgmoneta_get_timeline_history(int srv, uint32_t tli, struct timeline_history** h
 void
 pgmoneta_free_timeline_history(struct timeline_history* history);
 
+/**
+ * Receive a replication stream that is already started, as the WAL receiver of a server
+ * does, until the source sends CopyDone or closes the socket. The stream has no
+ * authentication or replication commands, so a benchmark can replay recorded or generated
+ * CopyData messages against the receive path. The socket is closed
+ * @param srv The server index
+ * @param socket The socket
+ * @param timeline The timeline
+ * @param start The position of the first message, at the start of a segment
+ * @param replay [out] The outcome
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_replay(int srv, int socket, uint32_t timeline, uint64_t start, struct wal_replay* replay);
+
+/**
+ * Get the WAL compression type for a server
+ * @param srv The server index
+ * @return The compression type
+ */
+int
+pgmoneta_get_wal_compression(int srv);
+
+/**
+ * Get the WAL compression level for a server
+ * @param srv The server index
+ * @return The compression level
+ */
+int
+pgmoneta_get_wal_compression_level(int srv);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALARCHIVE_H
+#define PGMONETA_WALARCHIVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+#include <storage.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** @struct wal_segment
+ * Defines a completed WAL segment waiting for its upload
+ */
+struct wal_segment
+{
+   char filename[MISC_LENGTH];  /**< The name of the segment */
+   size_t size;                 /**< The size of the segment */
+   int attempts;                /**< The number of failed uploads */
+   time_t retry;                /**< The earliest time of the next upload */
+   struct wal_segment* next;    /**< The next segment */
+};
+
+/** @struct wal_archive
+ * Defines the archiving of completed WAL segments to the object storage of the
+ * storage engine, through its storage backend. The segments are uploaded by a thread of their own, so the WAL
+ * stream never waits for the remote side. A failed upload is retried with a
+ * growing delay until wal_archive_retries is reached
+ */
+struct wal_archive
+{
+   int srv;                                                     /**< The server index */
+   char* directory;                                             /**< The WAL directory */
+   struct storage_backend* backend;                             /**< The storage backend */
+   pthread_t thread;                                            /**< The upload thread */
+   pthread_mutex_t lock;                                        /**< The lock */
+   pthread_cond_t pending;                                      /**< Signaled when a segment is added */
+   struct wal_segment* head;                                    /**< The first segment in the queue */
+   struct wal_segment* tail;                                    /**< The last segment in the queue */
+   int number_of_segments;                                      /**< The number of segments in the queue */
+   bool done;                                                   /**< Is the archive stopping */
+};
+
+/**
+ * Create a WAL archive for a server. No archive is created unless the
+ * storage engine is S3 or Azure
+ * @param srv The server index
+ * @param directory The WAL directory
+ * @param archive The resulting archive, or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_archive_create(int srv, char* directory, struct wal_archive** archive);
+
+/**
+ * Queue a completed WAL segment. When the queue is full the oldest segment
+ * is dropped
+ * @param archive The archive, or NULL
+ * @param filename The name of the segment, without the compression and encryption suffix
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_archive_add(struct wal_archive* archive, char* filename);
+
+/**
+ * Destroy a WAL archive. The upload in progress is finished, the segments
+ * still in the queue are left to the local WAL directory
+ * @param archive The archive
+ */
+void
+pgmoneta_wal_archive_destroy(struct wal_archive* archive);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
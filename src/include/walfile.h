@@ -29,6 +29,7 @@
 #ifndef PGMONETA_WALFILE_H
 #define PGMONETA_WALFILE_H
 
+#include <arena.h>
 #include <deque.h>
 #include <walfile/wal_reader.h>
 
@@ -76,6 +77,8 @@ struct xlog_long_page_header_data
  *                   Each page contains metadata about the organization of that page.
  *   - records: A deque that holds the WAL records stored in the WAL file.
  *              Each element has a `struct decoded_xlog_record` data type.
+ *   - arena: The arena the records and their data are allocated from, so they are released all at once.
+ *            When NULL each record is allocated on its own.
  */
 struct walfile
 {
@@ -83,6 +86,7 @@ struct walfile
    struct xlog_long_page_header_data* long_phd;   /**< Extended XLOG page header. */
    struct deque* page_headers;                    /**< Deque of page headers in the WAL file. */
    struct deque* records;                         /**< Deque of records in the WAL file. */
+   struct arena* arena;                           /**< Arena of the records, or NULL. */
 };
 
 /**
@@ -95,6 +99,57 @@ struct walfile
 int
 pgmoneta_read_walfile(int server, char* path, struct walfile** wf);
 
+/**
+ * Read a WAL file, skipping the records that do not match a filter. Compressed
+ * and encrypted files are decoded in memory
+ * @param server The server index
+ * @param path The path to the WAL file
+ * @param filter The filter, or NULL for all records
+ * @param wf The WAL file structure to populate
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_read_walfile_filter(int server, char* path, struct wal_filter* filter, struct walfile** wf);
+
+/**
+ * Read a WAL segment held in memory
+ * @param server The server index
+ * @param name The name of the segment
+ * @param data The segment
+ * @param size The size of the segment
+ * @param wf The WAL file structure to populate
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_read_walfile_buffer(int server, char* name, char* data, size_t size, struct walfile** wf);
+
+/**
+ * Aggregate the records of a WAL file, or of the WAL segments of a directory, without
+ * formatting them. The segments are decoded and counted in parallel, and the counters are merged
+ * @param path The path to the WAL file or directory
+ * @param type The type of output description
+ * @param output The output file, or NULL for stdout
+ * @param rms The resource managers
+ * @param start_lsn The start LSN
+ * @param end_lsn The end LSN
+ * @param xids The XIDs
+ * @param limit The number of relations shown, 0 for all
+ * @param workers The number of segments decoded in parallel
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_describe_walfile_stats(char* path, enum value_type type, char* output,
+                                struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids,
+                                uint32_t limit, int workers);
+
+/**
+ * Get the name of the WAL segment a file holds, without its compression and encryption suffixes
+ * @param file The path to the WAL file
+ * @return The segment name, or NULL upon failure
+ */
+char*
+pgmoneta_walfile_segment_name(char* file);
+
 /**
  * Write a WAL file
  * @param wf The WAL file structure
@@ -113,9 +168,10 @@ void
 pgmoneta_destroy_walfile(struct walfile* wf);
 
 /**
- * Describe a WAL file
- * @param path The path to the WAL file
+ * Describe a WAL file, or the WAL segments of a directory in order
+ * @param path The path to the WAL file or directory
  * @param type The type of output description
+ * @param csv Are the records written as CSV rows, instead of the type
  * @param output The output descriptor
  * @param quiet Is the WAL file printed
  * @param color Are colors used
@@ -124,11 +180,12 @@ pgmoneta_destroy_walfile(struct walfile* wf);
  * @param end_lsn The end LSN
  * @param xids The XIDs
  * @param limit The limit
+ * @param workers The number of segments decoded in parallel
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_describe_walfile(char* path, enum value_type type, char* output, bool quiet, bool color,
+pgmoneta_describe_walfile(char* path, enum value_type type, bool csv, char* output, bool quiet, bool color,
                           struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids,
-                          uint32_t limit);
+                          uint32_t limit, int workers);
 
 #endif //PGMONETA_WALFILE_H
@@ -64,6 +64,8 @@ typedef int64_t timestamp_tz;
 #define InvalidXLogRecPtr          0
 #define InvalidBuffer              0
 #define XLOG_PAGE_MAGIC            0xD10D  // WAL version indicator
+#define XLP_FIRST_IS_CONTRECORD    0x0001  // The page starts with the rest of a record
+#define XLP_LONG_HEADER            0x0002  // The page has a long header
 #define InvalidOid                 ((oid) 0)
 #define FLEXIBLE_ARRAY_MEMBER      /* empty */
 #define INVALID_REP_ORIGIN_ID      0
@@ -157,6 +159,7 @@ enum wal_level
 
 struct walfile;                         /* Forward declaration of walfile, defined in walfile.h. */
 struct xlog_long_page_header_data;      /* Forward declaration of xlog_long_page_header_data, defined in walfile.h */
+struct csv_writer;                      /* Forward declaration of csv_writer, defined in csv.h */
 
 /**
  * @struct xlog_page_header_data
@@ -328,13 +331,92 @@ struct rel_file_node
    oid relNode;      /**< Relation OID. */
 };
 
+/**
+ * @struct wal_filter
+ * @brief The filters applied while a WAL file is decoded.
+ *
+ * Fields:
+ * - rms: The resource managers, or NULL for all.
+ * - start_lsn: The start LSN, or 0 for no limit.
+ * - end_lsn: The end LSN, or 0 for no limit.
+ * - xids: The XIDs, or NULL for all.
+ */
+struct wal_filter
+{
+   struct deque* rms;   /**< The resource managers, or NULL for all. */
+   uint64_t start_lsn;  /**< The start LSN, or 0 for no limit. */
+   uint64_t end_lsn;    /**< The end LSN, or 0 for no limit. */
+   struct deque* xids;  /**< The XIDs, or NULL for all. */
+};
+
+#define WAL_STATS_RMGRS 256
+
+/**
+ * @struct wal_stats_relation
+ * @brief The counters of a relation in the WAL statistics.
+ *
+ * Fields:
+ * - rlocator: The relation.
+ * - records: The records that reference the relation.
+ * - fpi: The full page images of the relation.
+ * - used: Is the slot of the hash table in use.
+ */
+struct wal_stats_relation
+{
+   struct rel_file_locator rlocator;   /**< The relation. */
+   uint64_t records;                   /**< The records that reference the relation. */
+   uint64_t fpi;                       /**< The full page images of the relation. */
+   bool used;                          /**< Is the slot of the hash table in use. */
+};
+
+/**
+ * @struct wal_stats
+ * @brief The aggregated statistics of WAL records.
+ *
+ * The relations are kept in an open addressing hash table, so a record is
+ * counted without an allocation.
+ *
+ * Fields:
+ * - records: The number of records.
+ * - bytes: The total length of the records.
+ * - fpi: The number of full page images.
+ * - fpi_bytes: The length of the full page images.
+ * - rm_records: The records per resource manager.
+ * - rm_bytes: The length of the records per resource manager.
+ * - rm_fpi_bytes: The length of the full page images per resource manager.
+ * - commits: The number of commits.
+ * - aborts: The number of aborts.
+ * - first_commit: The time of the first commit.
+ * - last_commit: The time of the last commit.
+ * - relations: The hash table of the relations.
+ * - relations_size: The number of slots of the hash table.
+ * - number_of_relations: The number of relations.
+ */
+struct wal_stats
+{
+   uint64_t records;                            /**< The number of records. */
+   uint64_t bytes;                              /**< The total length of the records. */
+   uint64_t fpi;                                /**< The number of full page images. */
+   uint64_t fpi_bytes;                          /**< The length of the full page images. */
+   uint64_t rm_records[WAL_STATS_RMGRS];        /**< The records per resource manager. */
+   uint64_t rm_bytes[WAL_STATS_RMGRS];          /**< The length of the records per resource manager. */
+   uint64_t rm_fpi_bytes[WAL_STATS_RMGRS];      /**< The length of the full page images per resource manager. */
+   uint64_t commits;                            /**< The number of commits. */
+   uint64_t aborts;                             /**< The number of aborts. */
+   timestamp_tz first_commit;                   /**< The time of the first commit. */
+   timestamp_tz last_commit;                    /**< The time of the last commit. */
+   struct wal_stats_relation* relations;        /**< The hash table of the relations. */
+   size_t relations_size;                       /**< The number of slots of the hash table. */
+   size_t number_of_relations;                  /**< The number of relations. */
+};
+
 /* External variables */
 extern struct server* server_config;
 
 /* Function definitions */
 
 /**
- * Parses a WAL file and populates server information.
+ * Parses a WAL file and populates server information. The file is mapped into memory.
  *
  * @param path The file path of the WAL file.
  * @param server The index of the server structure, if -1, config.servers[0] will be initialized based on magic value.
@@ -344,6 +426,35 @@ extern struct server* server_config;
 int
 pgmoneta_wal_parse_wal_file(char* path, int server, struct walfile* wal_file);
 
+/**
+ * Parses a WAL file from an open stream. Records that do not match the filter
+ * are skipped from their header without decoding their data.
+ *
+ * @param file The stream positioned at the start of the WAL file.
+ * @param name The WAL segment name the LSNs are derived from.
+ * @param server The index of the server structure, if -1, config.servers[0] will be initialized based on magic value.
+ * @param filter The filter, or NULL for all records.
+ * @param wal_file The WAL file structure to be populated with parsed data.
+ * @return 0 on success, otherwise 1.
+ */
+int
+pgmoneta_wal_parse_wal_stream(FILE* file, char* name, int server, struct wal_filter* filter, struct walfile* wal_file);
+
+/**
+ * Parses a WAL file held in memory. Records on a single page are decoded where they are,
+ * and only the records that cross a page boundary are reassembled.
+ *
+ * @param data The WAL file.
+ * @param size The size of the WAL file.
+ * @param name The WAL segment name the LSNs are derived from.
+ * @param server The index of the server structure, if -1, config.servers[0] will be initialized based on magic value.
+ * @param filter The filter, or NULL for all records.
+ * @param wal_file The WAL file structure to be populated with parsed data.
+ * @return 0 on success, otherwise 1.
+ */
+int
+pgmoneta_wal_parse_wal_buffer(char* data, size_t size, char* name, int server, struct wal_filter* filter, struct walfile* wal_file);
+
 /**
  * Retrieves block data from the decoded XLOG record.
  *
@@ -402,6 +513,73 @@ void
 pgmoneta_wal_record_display(struct decoded_xlog_record* record, uint16_t magic_value, enum value_type type, FILE* out, bool quiet, bool color,
                             struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids, uint32_t limit);
 
+/**
+ * Write the header row of the CSV output of WAL records
+ * @param writer The CSV writer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_record_csv_header(struct csv_writer* writer);
+
+/**
+ * Write a decoded WAL record as a CSV row, with the same columns as the JSON output
+ * @param record The decoded WAL record
+ * @param magic_value The magic value associated with the WAL record
+ * @param writer The CSV writer
+ * @param rms The resource managers
+ * @param start_lsn The start LSN
+ * @param end_lsn The end LSN
+ * @param xids The XIDs
+ * @param limit The limit
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_record_csv(struct decoded_xlog_record* record, uint16_t magic_value, struct csv_writer* writer,
+                        struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids, uint32_t limit);
+
+/**
+ * Create WAL statistics
+ * @param stats [out] The statistics
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_stats_create(struct wal_stats** stats);
+
+/**
+ * Add a decoded WAL record to the statistics, without formatting it
+ * @param stats The statistics
+ * @param record The decoded WAL record
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_stats_add(struct wal_stats* stats, struct decoded_xlog_record* record);
+
+/**
+ * Merge WAL statistics into others
+ * @param stats The statistics
+ * @param other The statistics that are merged
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_stats_merge(struct wal_stats* stats, struct wal_stats* other);
+
+/**
+ * Display WAL statistics
+ * @param stats The statistics
+ * @param type The type of output (ValueString or ValueJSON)
+ * @param out The output descriptor
+ * @param limit The number of relations shown, 0 for all
+ */
+void
+pgmoneta_wal_stats_display(struct wal_stats* stats, enum value_type type, FILE* out, uint32_t limit);
+
+/**
+ * Destroy WAL statistics
+ * @param stats The statistics
+ */
+void
+pgmoneta_wal_stats_destroy(struct wal_stats* stats);
+
 /**
  * Encodes a WAL record into a buffer.
  *
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALINDEX_H
+#define PGMONETA_WALINDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WALINDEX_MAGIC   "PGMWALIX"
+#define WALINDEX_VERSION 2
+#define WALINDEX_SUFFIX  ".index"
+
+#define WALINDEX_RELATION_CREATED (1 << 0)
+#define WALINDEX_DATABASE_CREATED (1 << 1)
+
+/** @struct walindex_relation
+ * The blocks of a relation fork touched by a WAL segment. A database created by the
+ * segment has an entry of its own with a relation file number of 0
+ */
+struct walindex_relation
+{
+   uint32_t spcoid;         /**< The tablespace OID */
+   uint32_t dboid;          /**< The database OID */
+   uint32_t relnumber;      /**< The relation file number, 0 for a database */
+   uint32_t fork;           /**< The fork number */
+   uint32_t min_block;      /**< The lowest block touched */
+   uint32_t max_block;      /**< The highest block touched */
+   uint32_t blocks;         /**< The number of distinct blocks touched */
+   uint32_t truncate_block; /**< The lowest block the fork was truncated to, UINT32_MAX if it wasn't */
+   uint32_t flags;          /**< The WALINDEX_RELATION_CREATED and WALINDEX_DATABASE_CREATED flags */
+};
+
+/** @struct walindex
+ * The summary of a WAL segment
+ */
+struct walindex
+{
+   char magic[8];                       /**< The magic */
+   uint32_t version;                    /**< The version of the format */
+   uint32_t timeline;                   /**< The timeline */
+   uint32_t segment_size;               /**< The size of the segment */
+   uint32_t number_of_records;          /**< The number of records */
+   uint64_t min_lsn;                    /**< The LSN of the first record */
+   uint64_t max_lsn;                    /**< The LSN of the last record */
+   uint32_t min_xid;                    /**< The lowest XID */
+   uint32_t max_xid;                    /**< The highest XID */
+   uint32_t min_commit_xid;             /**< The lowest XID committed or aborted */
+   uint32_t max_commit_xid;             /**< The highest XID committed or aborted */
+   uint32_t number_of_commits;          /**< The number of commit and abort records */
+   uint32_t number_of_relations;        /**< The number of relation forks */
+   int64_t min_commit_time;             /**< The first commit time, microseconds since the epoch */
+   int64_t max_commit_time;             /**< The last commit time, microseconds since the epoch */
+   struct walindex_relation* relations; /**< The relation forks, only when read with relations */
+   uint32_t* block_numbers;             /**< The blocks touched, sorted per relation fork, only when read with relations */
+};
+
+/**
+ * Build the index of an archived WAL segment
+ * @param server The server
+ * @param path The path of the WAL segment, which may be compressed and encrypted
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walindex_create(int server, char* path);
+
+/**
+ * Read the index of a WAL segment
+ * @param server The server
+ * @param segment The name of the WAL segment
+ * @param relations Read the relation summaries too
+ * @param index The index
+ * @return 0 upon success, otherwise 1 when there is no index
+ */
+int
+pgmoneta_walindex_read(int server, char* segment, bool relations, struct walindex** index);
+
+/**
+ * Find the last WAL segment a recovery target needs, so a restore can leave out the
+ * segments after it. Times are compared with a day of margin since the time zone of
+ * the target is not known
+ * @param server The server
+ * @param start The first WAL segment of the backup
+ * @param position The recovery position
+ * @param end The last WAL segment to copy, or NULL when the indexes don't cover the target
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walindex_find(int server, char* start, char* position, char** end);
+
+/**
+ * Write the blocks touched by the indexed WAL segments of a timeline as the autoprewarm.blocks
+ * file of pg_prewarm. The segments are read from the newest one, so the most recently
+ * touched blocks are kept when there are more than the maximum
+ * @param server The server
+ * @param start The first WAL segment of the backup, which gives the timeline
+ * @param end The last WAL segment replayed, or NULL for the newest one
+ * @param max_blocks The maximum number of blocks
+ * @param path The path of the file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walindex_prewarm(int server, char* start, char* end, uint64_t max_blocks, char* path);
+
+/**
+ * Delete the indexes of the WAL segments that are no longer archived
+ * @param server The server
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walindex_prune(int server);
+
+/**
+ * Destroy an index
+ * @param index The index
+ */
+void
+pgmoneta_walindex_destroy(struct walindex* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
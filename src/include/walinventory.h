@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALINVENTORY_H
+#define PGMONETA_WALINVENTORY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WALINVENTORY_MAGIC   "PGMWALIN"
+#define WALINVENTORY_VERSION 1
+#define WALINVENTORY_SUFFIX  ".inventory"
+
+/** @struct walinventory_segment
+ * A segment of the WAL directory of a server
+ */
+struct walinventory_segment
+{
+   char name[MISC_LENGTH];  /**< The name of the segment, with the suffixes of its file */
+   char file[MISC_LENGTH];  /**< The file holding the segment, the segment itself or a pack */
+   uint32_t timeline;       /**< The timeline, 0 if the name is not a segment */
+   uint64_t size;           /**< The size of the file, a pack is counted on its last segment */
+   int32_t compression;     /**< The compression type */
+   int32_t encryption;      /**< The encryption type */
+   bool packed;             /**< Is the segment in a pack */
+   bool indexed;            /**< Has the segment a WAL index */
+};
+
+/** @struct walinventory
+ * The segments of the WAL directory of a server, sorted by name
+ */
+struct walinventory
+{
+   int number_of_segments;                 /**< The number of segments */
+   struct walinventory_segment* segments; /**< The segments */
+};
+
+/** @struct walinventory_stamp
+ * The modification times of the WAL directories before a change
+ */
+struct walinventory_stamp
+{
+   struct timespec wal;   /**< The WAL directory */
+   struct timespec index; /**< The WAL index directory */
+};
+
+/**
+ * Load the inventory of the WAL directory of a server. The inventory is next to
+ * the directory, and is refreshed when the modification time of the directory or
+ * of the WAL index directory differs from the one it was built from. Only the new
+ * files are looked at by a refresh
+ * @param server The server
+ * @param inventory [out] The inventory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walinventory_load(int server, struct walinventory** inventory);
+
+/**
+ * Get the files of the WAL directory of a server from its inventory, like
+ * pgmoneta_get_wal_files does from the directory
+ * @param server The server
+ * @param number_of_files [out] The number of files
+ * @param files [out] The files, sorted
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walinventory_files(int server, int* number_of_files, char*** files);
+
+/**
+ * Get the names of the segments of a server from its inventory, with the packs expanded
+ * @param server The server
+ * @param number_of_segments [out] The number of segments
+ * @param segments [out] The names, sorted
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walinventory_segments(int server, int* number_of_segments, char*** segments);
+
+/**
+ * Find the segments of a range by a binary search
+ * @param inventory The inventory
+ * @param from The first segment
+ * @param to The segment after the range, or NULL for the newest one
+ * @param start [out] The index of the first segment of the range
+ * @param end [out] The index after the last segment of the range
+ */
+void
+pgmoneta_walinventory_range(struct walinventory* inventory, char* from, char* to, int* start, int* end);
+
+/**
+ * Get the size on disk of the segments of a range
+ * @param inventory The inventory
+ * @param from The first segment
+ * @param to The segment after the range, or NULL for the newest one
+ * @return The size
+ */
+uint64_t
+pgmoneta_walinventory_size(struct walinventory* inventory, char* from, char* to);
+
+/**
+ * Take the modification times of the WAL directories of a server before a change
+ * @param server The server
+ * @param stamp [out] The modification times
+ */
+void
+pgmoneta_walinventory_begin(int server, struct walinventory_stamp* stamp);
+
+/**
+ * Update the inventory of a server after files of the WAL directory were closed or
+ * deleted. The inventory is only updated when it is still the one of the directory
+ * before the change, otherwise it is refreshed by the next load
+ * @param server The server
+ * @param stamp The modification times before the change
+ * @param number_of_added The number of new files
+ * @param added The names of the new files
+ * @param number_of_removed The number of deleted files
+ * @param removed The names of the deleted files
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walinventory_update(int server, struct walinventory_stamp* stamp, int number_of_added, char** added,
+                             int number_of_removed, char** removed);
+
+/**
+ * Destroy an inventory
+ * @param inventory The inventory
+ */
+void
+pgmoneta_walinventory_destroy(struct walinventory* inventory);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALK_H
+#define PGMONETA_WALK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#define WALK_FILE      0
+#define WALK_DIRECTORY 1
+#define WALK_LINK      2
+#define WALK_OTHER     3
+
+#define WALK_CONTINUE 0
+#define WALK_SKIP     1
+#define WALK_STOP     2
+
+#define WALK_STAT (1 << 0)
+#define WALK_FLAT (1 << 1)
+
+/** @struct walk_entry
+ * Defines an entry of a directory tree
+ */
+struct walk_entry
+{
+   int dirfd;         /**< The descriptor of the directory of the entry */
+   char* name;        /**< The name of the entry */
+   char* directory;   /**< The path of the directory of the entry */
+   char* path;        /**< The path of the entry */
+   int type;          /**< The type of the entry */
+   int depth;         /**< The depth of the entry, 0 for the entries of the root */
+   struct stat* st;   /**< The status of the entry, only with WALK_STAT */
+};
+
+/**
+ * The function called for an entry of a directory tree. A directory is
+ * descended after the function returned WALK_CONTINUE for it, WALK_SKIP leaves
+ * it out, and WALK_STOP ends the walk as failed
+ */
+typedef int (*walk_callback)(struct walk_entry* entry, void* arg);
+
+/**
+ * Walk a directory tree. The entries are read relative to the descriptor of their
+ * directory, and with several threads the directories are read in parallel. The
+ * callback is called by one thread at a time, and the order of the directories
+ * is not defined. The entries . and .. are left out, and symbolic links are not followed
+ * @param root The root directory
+ * @param flags WALK_STAT to stat every entry, WALK_FLAT to not descend
+ * @param threads The number of threads, 1 or less for the calling thread only
+ * @param callback The callback
+ * @param arg The argument of the callback
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walk(char* root, int flags, int threads, walk_callback callback, void* arg);
+
+/**
+ * Walk the files of a backup data directory as listed by its manifest, without reading
+ * the directories. Only files are passed to the callback, relative to the descriptor of
+ * their directory. A file is only checked to exist with WALK_STAT. The tablespaces are left
+ * out, and pg_wal, which the manifest does not list, is walked. Without a manifest the
+ * directory is walked
+ * @param root The data directory
+ * @param manifest The path to the manifest (backup.manifest), or NULL
+ * @param flags WALK_STAT to stat every entry
+ * @param threads The number of threads, with more than 1 the files are ordered by size, largest first
+ * @param callback The callback
+ * @param arg The argument of the callback
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walk_manifest(char* root, char* manifest, int flags, int threads, walk_callback callback, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
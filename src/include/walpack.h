@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALPACK_H
+#define PGMONETA_WALPACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WALPACK_MAGIC         "PGMWPK02"
+#define WALPACK_MAGIC_V1      "PGMWPK01"
+#define WALPACK_MAGIC_COMPACT "PGMWPC02"
+#define WALPACK_FPI_MAGIC     "PGMFPI01"
+#define WALPACK_MAGIC_SIZE    8
+#define WALPACK_HEADER_SIZE   (WALPACK_MAGIC_SIZE + 4)
+#define WALPACK_NAME_SIZE     32
+#define WALPACK_ENTRY_SIZE    (WALPACK_NAME_SIZE + 8 + 8 + 8 + 8)
+#define WALPACK_ENTRY_SIZE_V1 (WALPACK_NAME_SIZE + 8 + 8 + 8)
+#define WALPACK_NO_REFERENCE  UINT64_MAX
+#define WALPACK_SUFFIX        ".walpack"
+
+/**
+ * Pack runs of wal_pack consecutive segments of a WAL directory into pack files.
+ * A pack is named after its last segment, and holds an index followed by one
+ * Zstandard frame per segment. The first segment is compressed on its own, and
+ * the others use it as a prefix, so a segment is read by decompressing at most
+ * two frames. Encrypted segments are not packed
+ * @param server The server
+ * @param directory The WAL directory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walpack_directory(int server, char* directory);
+
+/**
+ * Compact the packs of a WAL directory that end before the newest full backup.
+ * The full page images of each segment are moved out of the segment, and stored
+ * together ordered by relation and block, so the versions of a page are next to
+ * each other. A segment is put back byte for byte when it is extracted
+ * @param server The server
+ * @param directory The WAL directory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walpack_compact(int server, char* directory);
+
+/**
+ * Is the file a pack
+ * @param name The file name
+ * @return True if the file is a pack, otherwise false
+ */
+bool
+pgmoneta_is_walpack(char* name);
+
+/**
+ * Get the segments of a pack
+ * @param path The pack
+ * @param number_of_members The number of segments
+ * @param members The names of the segments
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walpack_members(char* path, int* number_of_members, char*** members);
+
+/**
+ * Find the pack that holds a segment
+ * @param directory The WAL directory
+ * @param name The segment
+ * @return The path of the pack, or NULL if no pack holds the segment
+ */
+char*
+pgmoneta_walpack_find(char* directory, char* name);
+
+/**
+ * Extract a segment from a pack
+ * @param path The pack
+ * @param name The segment
+ * @param to The destination file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walpack_extract(char* path, char* name, char* to);
+
+/**
+ * Extract the segments of a pack within a range
+ * @param path The pack
+ * @param directory The destination directory
+ * @param start The first segment
+ * @param end The last segment, or NULL for all segments from the start
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walpack_extract_range(char* path, char* directory, char* start, char* end);
+
+/**
+ * Replace the packs of a sorted list of WAL files by their segments
+ * @param directory The WAL directory
+ * @param number_of_files The number of files
+ * @param files The files
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_walpack_expand(char* directory, int* number_of_files, char*** files);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
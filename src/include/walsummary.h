@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALSUMMARY_H
+#define PGMONETA_WALSUMMARY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <json.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <openssl/ssl.h>
+
+#define WALSUMMARY_CHANGES_LIMIT 25
+
+/** @struct walsummary_relation
+ * The blocks of a relation fork modified in a range of WAL
+ */
+struct walsummary_relation
+{
+   bool created;            /**< Was the fork created in the range */
+   uint32_t truncate_block; /**< The blocks from here on count as modified, UINT32_MAX if the fork wasn't truncated */
+   uint32_t number_of_bits; /**< The number of blocks the bitmap covers */
+   uint32_t blocks;         /**< The number of blocks set in the bitmap */
+   uint8_t* bitmap;         /**< The modified blocks */
+};
+
+/** @struct walsummary
+ * The relation forks and databases modified in a range of WAL
+ */
+struct walsummary
+{
+   struct art* relations; /**< The relation forks, keyed by their path relative to the data directory */
+   struct art* databases; /**< The databases created in the range, keyed by their directory */
+};
+
+/**
+ * Create the summary of a range of WAL from the WAL indexes of its segments.
+ * The index of the last segment is waited for, since the segment may not be
+ * archived yet when a backup has just finished
+ * @param server The server
+ * @param timeline The timeline
+ * @param start_lsn The start of the range
+ * @param end_lsn The end of the range
+ * @param summary The summary
+ * @return 0 upon success, otherwise 1 when a segment of the range has no index
+ */
+int
+pgmoneta_walsummary_create(int server, uint32_t timeline, uint64_t start_lsn, uint64_t end_lsn, struct walsummary** summary);
+
+/**
+ * Is a block of a relation fork modified
+ * @param relation The relation fork, or NULL when the fork isn't in the summary
+ * @param block The block number
+ * @return True if modified, otherwise false
+ */
+bool
+pgmoneta_walsummary_modified(struct walsummary_relation* relation, uint32_t block);
+
+/**
+ * Turn the relation files of a full backup into incremental files that hold only
+ * the blocks modified since the start of the parent backup. This gives incremental
+ * backups for the versions without the WAL summarizer of PostgreSQL 17
+ * @param server The server
+ * @param label The label of the backup
+ * @param parent_label The label of the parent backup
+ * @param timeline The starting timeline of the backup
+ * @param startpos The WAL starting position of the backup
+ * @return 0 upon success, otherwise 1 and the backup stays a full backup
+ */
+int
+pgmoneta_walsummary_incremental(int server, char* label, char* parent_label, uint32_t timeline, char* startpos);
+
+/**
+ * List the relation forks of a server modified since the start of a backup, up to the
+ * newest WAL index, with the most modified first. The number of modified blocks gives
+ * the size of the next incremental backup
+ * @param ssl The SSL connection
+ * @param client_fd The client
+ * @param server The server
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol
+ * @param payload The payload
+ */
+void
+pgmoneta_walsummary_changes(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload);
+
+/**
+ * Destroy a summary
+ * @param summary The summary
+ */
+void
+pgmoneta_walsummary_destroy(struct walsummary* summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,21 +34,52 @@ extern "C" {
 #endif
 
 #include <pgmoneta.h>
+#include <arena.h>
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define WORKER_CONTEXT_ZSTD_COMPRESS   0
+#define WORKER_CONTEXT_ZSTD_DECOMPRESS 1
+#define WORKER_CONTEXT_LZ4_COMPRESS    2
+#define WORKER_CONTEXT_GZIP_COMPRESS   3
+#define WORKER_CONTEXT_GZIP_DECOMPRESS 4
+#define WORKER_CONTEXT_CIPHER          5
+#define WORKER_CONTEXT_SHA256          6
+#define WORKER_CONTEXT_IO_URING        7
+#define WORKER_CONTEXT_SFTP            8
+#define WORKER_CONTEXT_AZURE           9
+#define WORKER_CONTEXT_S3              10
+#define WORKER_CONTEXT_LIBDEFLATE      11
+#define WORKER_CONTEXTS                12
+
+#define WORKER_BUFFER_IN  0
+#define WORKER_BUFFER_OUT 1
+#define WORKER_BUFFERS    2
+
+#define WORKER_DEVICES 16
+
+#define WORKER_MEMORY (4 * 1024 * 1024) /* The memory of memory_budget for a worker and its buffers */
+
+#define WORKER_SCALE_INTERVAL 1.0  /* The seconds between changes of the running workers */
+#define WORKER_SCALE_CHANGE   0.05 /* The change of the throughput that counts as better or worse */
+#define WORKER_SCALE_IO       0.5  /* The CPU time per run time below which the tasks wait on I/O */
 
 struct worker_input;
 
-/** @struct semaphore
- * Defines a semaphore
+/** @struct worker_cache
+ * Defines the compression contexts and buffers kept by a thread between files
  */
-struct semaphore
+struct worker_cache
 {
-   pthread_mutex_t mutex; /**< The mutex of the semaphore */
-   pthread_cond_t cond;   /**< The condition of the semaphore */
-   int value;             /**< The current value */
+   void* contexts[WORKER_CONTEXTS];                  /**< The contexts */
+   void (*destroy[WORKER_CONTEXTS])(void* context); /**< The functions that free the contexts */
+   void* buffers[WORKER_BUFFERS];                    /**< The buffers */
+   size_t buffer_sizes[WORKER_BUFFERS];              /**< The sizes of the buffers */
 };
 
 /** @struct task
@@ -56,20 +87,29 @@ struct semaphore
  */
 struct task
 {
-   struct task* previous;                  /**< The previous task */
    void (*function)(struct worker_input*); /**< The task */
    struct worker_input* wi;                /**< The input */
+   size_t size;                            /**< The size of the work */
+   int device;                             /**< The index of the device of the work, -1 if none */
+   struct timespec queued;                 /**< The time the task was queued */
+};
+
+struct worker_device
+{
+   dev_t device;       /**< The device */
+   atomic_int running; /**< The number of running tasks on the device */
 };
 
 /** @struct queue
- * Defines a queue
+ * Defines the task deque of a worker. The owner takes the newest task,
+ * other workers steal the oldest one
  */
 struct queue
 {
    pthread_mutex_t rwmutex;     /**< The read/write mutex */
-   struct task* front;          /**< The first task */
-   struct task* rear;           /**< The last task */
-   struct semaphore* has_tasks; /**< Are there any tasks ? */
+   struct task** tasks;         /**< The ring of tasks */
+   int capacity;                /**< The capacity of the ring */
+   int front;                   /**< The index of the oldest task */
    int number_of_tasks;         /**< The number of tasks */
 };
 
@@ -79,7 +119,14 @@ struct queue
 struct worker
 {
    pthread_t pthread;       /**< The worker thread */
+   int index;               /**< The index of the worker */
+   struct queue queue;      /**< The tasks of the worker */
+   struct worker_cache cache; /**< The compression contexts of the worker */
    struct workers* workers; /**< Pointer to the root structure */
+   int tasks;               /**< The number of tasks run */
+   double busy;             /**< The time spent running tasks in seconds */
+   double idle;             /**< The time spent waiting for tasks in seconds */
+   double queue_wait;       /**< The time the tasks run waited in a queue in seconds */
 };
 
 /** @struct workers
@@ -88,12 +135,52 @@ struct worker
 struct workers
 {
    struct worker** worker;         /**< The list of workers */
+   int number_of_workers;          /**< The number of workers */
+   volatile bool keepalive;        /**< Do the workers of the pool keep running */
    volatile int number_of_alive;   /**< The number of alive workers */
    volatile int number_of_working; /**< The number of workers */
    pthread_mutex_t worker_lock;    /**< The worker lock */
    pthread_cond_t worker_all_idle; /**< Are workers idle */
+   pthread_cond_t has_tasks;       /**< Are there any tasks for sleeping workers */
+   atomic_int number_of_tasks;     /**< The number of queued tasks */
+   atomic_int number_of_pending;   /**< The number of queued and running tasks */
+   atomic_int number_of_sleeping;  /**< The number of sleeping workers */
+   atomic_uint next;               /**< The next worker for submissions from outside the pool */
+   bool planning;                  /**< Are tasks collected for scheduling */
+   struct task** plan;             /**< The collected tasks */
+   int plan_size;                  /**< The number of collected tasks */
+   int plan_capacity;              /**< The capacity of the collected tasks */
+   int slots;                      /**< The worker slots held from the scheduler */
+   size_t memory;                  /**< The memory held from memory_budget */
    bool outcome;                   /**< Outcome of the workers */
-   struct queue queue;             /**< The queue */
+   struct arena* arena;            /**< The arena of the interned directories */
+   char* interned;                 /**< The last interned directory */
+   pthread_mutex_t intern_lock;    /**< The lock of the interned directories */
+   int device_limit;               /**< The number of running tasks allowed on a device, 0 for no limit */
+   int number_of_devices;          /**< The number of devices */
+   struct worker_device devices[WORKER_DEVICES]; /**< The devices of the tasks */
+   pthread_mutex_t device_lock;    /**< The lock of the devices */
+   bool autoscale;                 /**< Is the number of running workers changed with the throughput */
+   atomic_int active;              /**< The number of workers that run tasks */
+   pthread_cond_t scaled;          /**< Signaled when workers are added back */
+   pthread_mutex_t scale_lock;     /**< The lock of the measurement */
+   struct timespec scale_start;    /**< The start of the measurement */
+   double scale_wall;              /**< The run time of the measured tasks in seconds */
+   double scale_cpu;               /**< The CPU time of the measured tasks in seconds */
+   uint64_t scale_bytes;           /**< The size of the measured tasks */
+   int scale_tasks;                /**< The number of measured tasks */
+   double scale_rate;              /**< The throughput of the previous measurement */
+   int scale_direction;            /**< The direction of the last change of the running workers */
+};
+
+/** @struct worker_split
+ * Defines a file that is processed as independent parts
+ */
+struct worker_split
+{
+   atomic_int remaining;  /**< The number of parts left */
+   int number_of_parts;   /**< The number of parts */
+   atomic_bool failed;    /**< Has any part failed */
 };
 
 /** @struct worker_input
@@ -101,14 +188,18 @@ struct workers
  */
 struct worker_input
 {
-   char directory[MAX_PATH]; /**< The directory */
-   char from[MAX_PATH];      /**< The from directory */
-   char to[MAX_PATH];        /**< The to directory */
-   int level;                /**< The compression level */
-   struct json* data;        /**< JSON data */
-   struct deque* failed;     /**< Failed files */
-   struct deque* all;        /**< All files */
-   struct workers* workers;  /**< The root structure */
+   char* directory;             /**< The directory, shared by the inputs of the workers */
+   char* from;                  /**< The from directory */
+   char* to;                    /**< The to directory */
+   int level;                   /**< The compression level */
+   struct json* data;           /**< JSON data */
+   struct deque* failed;        /**< Failed files */
+   struct deque* all;           /**< All files */
+   off_t offset;                /**< The offset of the part */
+   size_t length;               /**< The length of the part, 0 for the whole file */
+   struct worker_split* split;  /**< The split the part belongs to */
+   void* argument;              /**< The argument of the task */
+   struct workers* workers;     /**< The root structure */
 };
 
 /**
@@ -121,7 +212,9 @@ int
 pgmoneta_workers_initialize(int num, struct workers** workers);
 
 /**
- * Add work to the queue
+ * Add work to the queue. Work added from a worker goes to the deque of that
+ * worker, otherwise the deques are filled round-robin. Idle workers steal
+ * from the others
  * @param workers The workers
  * @param function The function pointer
  * @param wi The argument
@@ -130,6 +223,14 @@ pgmoneta_workers_initialize(int num, struct workers** workers);
 int
 pgmoneta_workers_add(struct workers* workers, void (*function)(struct worker_input*), struct worker_input* wi);
 
+/**
+ * Collect the work that is added from now on, and schedule it largest first
+ * once pgmoneta_workers_wait is called
+ * @param workers The workers
+ */
+void
+pgmoneta_workers_plan(struct workers* workers);
+
 /**
  * Wait for all queued work units to finish
  * @param workers The workers
@@ -152,7 +253,43 @@ int
 pgmoneta_get_number_of_workers(int server);
 
 /**
- * Create worker input
+ * Get a compression context of the current thread. A worker uses its own
+ * cache, other threads use a thread local one
+ * @param type The context type
+ * @return The context, or NULL if none has been stored yet
+ */
+void*
+pgmoneta_worker_context(int type);
+
+/**
+ * Store a compression context in the cache of the current thread. The cache
+ * owns the context from then on
+ * @param type The context type
+ * @param context The context
+ * @param destroy The function that frees the context
+ */
+void
+pgmoneta_worker_context_set(int type, void* context, void (*destroy)(void* context));
+
+/**
+ * Get a buffer of the current thread. The buffer is owned by the cache and
+ * is reused by the next caller on this thread
+ * @param type The buffer type
+ * @param size The minimum size
+ * @return The buffer, or NULL upon failure
+ */
+void*
+pgmoneta_worker_buffer(int type, size_t size);
+
+/**
+ * Free the compression contexts and buffers of the current thread
+ */
+void
+pgmoneta_worker_cache_clear(void);
+
+/**
+ * Create worker input. The input and its paths are one allocation, released with free(),
+ * and the directory is interned in the workers when there are workers
  * @param directory The directory path
  * @param from The from file path
  * @param to The to file path
@@ -38,6 +38,7 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define WORKFLOW_TYPE_BACKUP                0
 #define WORKFLOW_TYPE_RESTORE               1
@@ -48,13 +49,21 @@ extern "C" {
 #define WORKFLOW_TYPE_VERIFY                6
 #define WORKFLOW_TYPE_INCREMENTAL_BACKUP    7
 #define WORKFLOW_TYPE_RESTORE_INCREMENTAL   8
+#define WORKFLOW_TYPE_MERGE                 9
 
 #define PERMISSION_TYPE_BACKUP              0
-#define PERMISSION_TYPE_RESTORE             1
 #define PERMISSION_TYPE_ARCHIVE             2
 
 #define CLEANUP_TYPE_RESTORE                0
 
+#define WORKFLOW_RESOURCE_CPU               0
+#define WORKFLOW_RESOURCE_DISK              1
+#define WORKFLOW_RESOURCE_NETWORK           2
+#define WORKFLOW_RESOURCE_UPLOAD            3
+#define WORKFLOW_RESOURCE_UPLOAD_MULTI      4
+
+#define WORKFLOW_MAX_DEPENDENCIES           4
+
 #define NODE_ALL               "all"               /* All the files in a manifest */
 #define NODE_BACKUP            "backup"            /* The backup structure */
 #define NODE_BACKUPS           "backups"           /* A list of backups */
@@ -73,14 +82,32 @@ extern "C" {
 #define NODE_SERVER            "server"            /* The server number */
 #define NODE_SERVER_BACKUP     "server_backup"     /* The backup directory of the server */
 #define NODE_SERVER_BASE       "server_base"       /* The base directory of the server */
+#define NODE_SHA256            "sha256"            /* The SHA-256 of the backup files */
 #define NODE_TARGET_BASE       "target_base"       /* The target base directory */
 #define NODE_TARGET_FILE       "target_file"       /* The target file */
 #define NODE_TARGET_ROOT       "target_root"       /* The target root directory */
+#define NODE_THROUGHPUT        "throughput"        /* The verified bytes per second */
+#define NODE_VERIFIED          "verified"          /* The number of verified files */
+#define NODE_VERIFIED_SIZE     "verified_size"     /* The number of verified bytes */
+#define NODE_WORKFLOW          "workflow"          /* The workflow being run */
+
+/** @struct workflow_metrics
+ * Defines the metrics of a workflow node
+ */
+struct workflow_metrics
+{
+   double elapsed;     /**< The duration in seconds */
+   uint64_t bytes_in;  /**< The bytes of the directory before the node */
+   uint64_t bytes_out; /**< The bytes of the directory after the node */
+   uint64_t files;     /**< The files of the directory after the node */
+   bool accounted;     /**< Did the node report its bytes and files itself */
+};
 
 typedef char* (*name)(void);
 typedef int (*setup)(char*, struct art*);
 typedef int (*execute)(char*, struct art*);
 typedef int (*teardown)(char*, struct art*);
+typedef int (*process)(char*, struct art*, char*);
 
 /** @struct workflow
  * Defines a workflow
@@ -91,6 +118,15 @@ struct workflow
    setup setup;      /**< The setup  function pointer */
    execute execute;  /**< The execute function pointer */
    teardown teardown; /**< The taerdown function pointer */
+   process process;   /**< The per-file function pointer, NULL when the node needs the whole backup */
+
+   bool streamed;     /**< The files are handed to the process function by an earlier node, so execute is skipped */
+
+   struct workflow_metrics metrics; /**< The metrics of the execute function */
+
+   int resource;                                               /**< The resource class the execute function mostly uses */
+   int number_of_dependencies;                                 /**< The number of dependencies, 0 for the previous node */
+   struct workflow* dependencies[WORKFLOW_MAX_DEPENDENCIES];   /**< The nodes that must finish before this node */
 
    struct workflow* next; /**< The next workflow */
 };
@@ -116,6 +152,62 @@ pgmoneta_workflow_create(int workflow_type, int server, struct backup* backup);
 int
 pgmoneta_workflow_nodes(int server, char* identifier, struct art* nodes, struct backup** backup);
 
+/**
+ * Execute a workflow node and record its metrics
+ * @param workflow The workflow node
+ * @param nodes The nodes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_workflow_execute(struct workflow* workflow, struct art* nodes);
+
+/**
+ * Execute all nodes of a workflow. A node starts once its dependencies are done,
+ * and nodes of different resource classes run at the same time, so the nodes
+ * must be able to share a concurrent nodes tree
+ * @param workflow The workflow
+ * @param nodes The nodes
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_workflow_run(struct workflow* workflow, struct art* nodes);
+
+/**
+ * Make a workflow node wait for another node instead of the previous one
+ * @param workflow The workflow node
+ * @param dependency The node that must finish first
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_workflow_depends(struct workflow* workflow, struct workflow* dependency);
+
+/**
+ * Add to the progress of the running workflows of a server
+ * @param server The server index
+ * @param bytes The number of bytes processed
+ * @param files The number of files processed
+ */
+void
+pgmoneta_workflow_progress(int server, uint64_t bytes, uint64_t files);
+
+/**
+ * Report the bytes and files of the directory after the running node,
+ * so the directory is not walked for them
+ * @param bytes The number of bytes
+ * @param files The number of files
+ */
+void
+pgmoneta_workflow_account(uint64_t bytes, uint64_t files);
+
+/**
+ * Add the metrics of the workflow to a backup.info batch
+ * @param workflow The workflow
+ * @param info The batch
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_workflow_store_metrics(struct workflow* workflow, struct info_batch* info);
+
 /**
  * Destroy the workflow
  * @param workflow The workflow
@@ -133,6 +133,29 @@ pgmoneta_create_lz4(bool compress);
 struct workflow*
 pgmoneta_create_bzip2(bool compress);
 
+/**
+ * Create a workflow that compresses, encrypts and hashes each file in a single pass
+ * @return The workflow
+ */
+struct workflow*
+pgmoneta_create_pipeline(void);
+
+/**
+ * Create a workflow for the chunk store
+ * @param store true for storing the backup and false for rebuilding the files
+ * @return The workflow
+ */
+struct workflow*
+pgmoneta_create_dedup(bool store);
+
+/**
+ * Create a workflow for the page filter
+ * @param pack true for packing the relation files and false for rebuilding them
+ * @return The workflow
+ */
+struct workflow*
+pgmoneta_create_page(bool pack);
+
 /**
  * Create a workflow for symlinking
  * @return The workflow
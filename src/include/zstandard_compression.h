@@ -36,15 +36,43 @@ extern "C" {
 #include <json.h>
 #include <workers.h>
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <zstd.h>
+
+#define ZSTD_DEFAULT_NUMBER_OF_WORKERS 4
+#define ZSTD_WORKER_MEMORY (16 * 1024 * 1024) /* The memory of memory_budget for a Zstandard worker */
+#define ZSTD_THREAD_SIZE (8 * 1024 * 1024) /* The input for each Zstandard worker, about the job size of the low levels */
+
+/** @struct zstd_seekable
+ * Defines a seekable Zstandard file. The file is a sequence of independent
+ * frames followed by a seek table in a skippable frame
+ */
+struct zstd_seekable
+{
+   char path[MAX_PATH];              /**< The path of the file */
+   FILE* file;                       /**< The file */
+   uint32_t number_of_frames;        /**< The number of frames */
+   uint64_t* compressed_offsets;     /**< The compressed offset of each frame, plus the end */
+   uint64_t* decompressed_offsets;   /**< The decompressed offset of each frame, plus the end */
+   ZSTD_DCtx* dctx;                  /**< The decompression context */
+   int64_t frame;                    /**< The frame held in the decompressed buffer, -1 for none */
+   unsigned char* compressed;        /**< The compressed frame buffer */
+   size_t compressed_capacity;       /**< The capacity of the compressed frame buffer */
+   unsigned char* decompressed;      /**< The decompressed frame buffer */
+   size_t decompressed_capacity;     /**< The capacity of the decompressed frame buffer */
+};
 
 /**
  * Compress a data directory with Zstandard
  * @param directory The directory
+ * @param manifest The manifest listing the files (backup.manifest), or NULL to walk the directory
  * @param workers The optional workers
  */
 void
-pgmoneta_zstandardc_data(char* directory, struct workers* workers);
+pgmoneta_zstandardc_data(char* directory, char* manifest, struct workers* workers);
 
 /**
  * Compress tablespaces directories with Zstandard
@@ -56,10 +84,11 @@ pgmoneta_zstandardc_tablespaces(char* root, struct workers* workers);
 
 /**
  * Compress a WAL directory with Zstandard
+ * @param server The server index
  * @param directory The directory
  */
 void
-pgmoneta_zstandardc_wal(char* directory);
+pgmoneta_zstandardc_wal(int server, char* directory);
 
 /**
  * ZSTD decompress a single file, also remove the original file
@@ -109,6 +138,79 @@ pgmoneta_zstandardc_request(SSL* ssl, int client_fd, uint8_t compression, uint8_
 int
 pgmoneta_zstandardc_file(char* from, char* to);
 
+/**
+ * Open a seekable Zstandard file
+ * @param from The file
+ * @param seekable The resulting seekable file
+ * @return 0 if successful, otherwise 1 which includes files without a seek table
+ */
+int
+pgmoneta_zstandardd_seekable_open(char* from, struct zstd_seekable** seekable);
+
+/**
+ * Get the decompressed size of a seekable Zstandard file
+ * @param seekable The seekable file
+ * @return The size
+ */
+size_t
+pgmoneta_zstandardd_seekable_size(struct zstd_seekable* seekable);
+
+/**
+ * Read a range of a seekable Zstandard file, decompressing only the frames
+ * that hold it
+ * @param seekable The seekable file
+ * @param offset The decompressed offset
+ * @param length The length
+ * @param buffer The buffer to read into
+ * @return 0 if successful, otherwise 1
+ */
+int
+pgmoneta_zstandardd_seekable_read(struct zstd_seekable* seekable, off_t offset, size_t length, void* buffer);
+
+/**
+ * Close a seekable Zstandard file
+ * @param seekable The seekable file
+ */
+void
+pgmoneta_zstandardd_seekable_close(struct zstd_seekable* seekable);
+
+/**
+ * Train a Zstandard dictionary from the small files of a directory, and store it
+ * with the server. The dictionary also becomes the latest one of the server
+ * @param server The server
+ * @param directory The directory
+ * @param id The resulting dictionary identifier, 0 when there is too little data
+ * @return 0 if successful, otherwise 1
+ */
+int
+pgmoneta_zstandard_dictionary_train(int server, char* directory, uint32_t* id);
+
+/**
+ * Get the latest Zstandard dictionary of a server
+ * @param server The server
+ * @return The dictionary identifier, 0 for none
+ */
+uint32_t
+pgmoneta_zstandard_dictionary_latest(int server);
+
+/**
+ * Use a Zstandard dictionary for the small files compressed by this process
+ * @param server The server
+ * @param id The dictionary identifier, 0 for none
+ * @return 0 if successful, otherwise 1
+ */
+int
+pgmoneta_zstandard_dictionary_use(int server, uint32_t id);
+
+/**
+ * Get a Zstandard decompression dictionary. The dictionary is cached
+ * by the process and must not be freed
+ * @param id The dictionary identifier
+ * @return The dictionary, or NULL if it isn't found
+ */
+ZSTD_DDict*
+pgmoneta_zstandard_dictionary_get(uint32_t id);
+
 /**
  * ZSTD compress a string
  * @param s The original string
@@ -129,6 +231,25 @@ pgmoneta_zstdc_string(char* s, unsigned char** buffer, size_t* buffer_size);
 int
 pgmoneta_zstdd_string(unsigned char* compressed_buffer, size_t compressed_size, char** output_string);
 
+/**
+ * Get the workers of a Zstandard context for an input. The Zstandard workers take the
+ * free slots of scheduler_workers, which the worker pools hold too, and memory_budget, so the
+ * two levels of parallelism never use more threads than there are slots. An input gets none
+ * while the other tasks of the pool of the caller wait for a worker
+ * @param size The size of the input, 0 when it isn't known
+ * @param workers The worker pool of the caller, or NULL
+ * @return The number of Zstandard workers, 0 for none
+ */
+int
+pgmoneta_zstandard_threads(size_t size, struct workers* workers);
+
+/**
+ * Give back the workers of a Zstandard context
+ * @param threads The number of Zstandard workers
+ */
+void
+pgmoneta_zstandard_threads_release(int threads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,13 +32,32 @@
 #include <management.h>
 #include <security.h>
 #include <utils.h>
+#include <wal.h>
+#include <walk.h>
 #include <workers.h>
 
 /* System */
 #include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/rand.h>
 
 #define ENC_BUF_SIZE (1024 * 1024)
 
+#define AES_BLOCK       16
+#define AES_SPLIT_SIZE  (64 * 1024 * 1024)
+
+#define AEAD_SALT       "pgmoneta"
+#define AEAD_ITERATIONS 100000
+#define AEAD_MAX_CHUNK  (64 * 1024 * 1024)
+
+static unsigned char aead_key[AEAD_KEY_SIZE];
+static bool aead_key_valid = false;
+static pthread_mutex_t aead_key_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int encrypt_file(char* from, char* to, int enc);
 static int derive_key_iv(char* password, unsigned char* key, unsigned char* iv, int mode);
 static int aes_encrypt(char* plaintext, unsigned char* key, unsigned char* iv, char** ciphertext, int* ciphertext_length, int mode);
@@ -48,95 +67,85 @@ static const EVP_CIPHER* (*get_cipher_buffer(int mode))(void);
 
 static void do_encrypt_file(struct worker_input* wi);
 static void do_decrypt_file(struct worker_input* wi);
+static void do_ctr_part(struct worker_input* wi);
+static int cipher_context(int mode, int enc, off_t offset, EVP_CIPHER_CTX** ctx);
+static bool ctr_mode(int mode);
+static int ctr_split(char* from, char* to, int enc, struct workers* workers);
+static int ctr_range(char* from, char* to, int enc, off_t offset, size_t length);
 
 static int encrypt_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** res_buffer, size_t* res_size, int enc, int mode);
 
+static const EVP_CIPHER* (*get_aead_cipher(int mode))(void);
+static int aead_key_get(unsigned char* key);
+static EVP_CIPHER_CTX* aead_context(void);
+static void aead_free_context(void* context);
+static void aead_nonce(unsigned char* prefix, uint32_t index, unsigned char* nonce, unsigned char* aad, bool final);
+static int aead_seal(struct aead* aead, bool final);
+static int aead_open(EVP_CIPHER_CTX* ctx, int mode, unsigned char* prefix, uint32_t index, bool final,
+                     unsigned char* in, size_t in_length, unsigned char* out);
+static int aead_open_chunk(struct aead* aead, bool final);
+static int aead_parse_header(unsigned char* header, int* mode, size_t* chunk_size, unsigned char* prefix);
+static int aead_read_header(FILE* file, int* mode, size_t* chunk_size, unsigned char* prefix);
+static int aead_file_output(void* data, void* buffer, size_t size);
+static int aead_encrypt_file(char* from, char* to, int mode);
+static int aead_decrypt_file(char* from, char* to);
+static int encrypt_data_entry(struct walk_entry* entry, void* arg);
+
 int
-pgmoneta_encrypt_data(char* d, struct workers* workers)
+pgmoneta_encrypt_data(char* d, char* manifest, struct workers* workers)
+{
+   return pgmoneta_walk_manifest(d, manifest, 0, workers != NULL ? workers->number_of_workers : 1, encrypt_data_entry, workers);
+}
+
+static int
+encrypt_data_entry(struct walk_entry* entry, void* arg)
 {
-   char* from = NULL;
    char* to = NULL;
-   DIR* dir;
-   struct dirent* entry;
+   struct worker_input* wi = NULL;
+   struct workers* workers = (struct workers*)arg;
 
-   if (!(dir = opendir(d)))
+   if (entry->type == WALK_DIRECTORY)
    {
-      goto error;
+      return strcmp(entry->name, "pg_tblspc") == 0 ? WALK_SKIP : WALK_CONTINUE;
    }
 
-   while ((entry = readdir(dir)) != NULL)
+   if (pgmoneta_ends_with(entry->name, ".aes") ||
+       pgmoneta_ends_with(entry->name, ".partial") ||
+       pgmoneta_ends_with(entry->name, ".history") ||
+       pgmoneta_ends_with(entry->name, "backup_label") ||
+       pgmoneta_ends_with(entry->name, "backup_manifest"))
    {
-      if (entry->d_type == DT_DIR)
-      {
-         char path[1024];
-
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "pg_tblspc") == 0)
-         {
-            continue;
-         }
+      return WALK_CONTINUE;
+   }
 
-         snprintf(path, sizeof(path), "%s/%s", d, entry->d_name);
+   if (pgmoneta_exists(entry->path))
+   {
+      to = pgmoneta_append(to, entry->path);
+      to = pgmoneta_append(to, ".aes");
 
-         pgmoneta_encrypt_data(path, workers);
+      if (workers != NULL && workers->outcome && !ctr_split(entry->path, to, 1, workers))
+      {
+         // the parts are queued
       }
-      else
+      else if (!pgmoneta_create_worker_input(NULL, entry->path, to, 0, workers, &wi))
       {
-         if (!pgmoneta_ends_with(entry->d_name, ".aes") &&
-             !pgmoneta_ends_with(entry->d_name, ".partial") &&
-             !pgmoneta_ends_with(entry->d_name, ".history") &&
-             !pgmoneta_ends_with(entry->d_name, "backup_label") &&
-             !pgmoneta_ends_with(entry->d_name, "backup_manifest"))
+         if (workers != NULL)
          {
-            from = pgmoneta_append(from, d);
-            from = pgmoneta_append(from, "/");
-            from = pgmoneta_append(from, entry->d_name);
-
-            to = pgmoneta_append(to, d);
-            to = pgmoneta_append(to, "/");
-            to = pgmoneta_append(to, entry->d_name);
-            to = pgmoneta_append(to, ".aes");
-
-            if (pgmoneta_exists(from))
+            if (workers->outcome)
             {
-               struct worker_input* wi = NULL;
-
-               if (!pgmoneta_create_worker_input(NULL, from, to, 0, workers, &wi))
-               {
-                  if (workers != NULL)
-                  {
-                     if (workers->outcome)
-                     {
-                        pgmoneta_workers_add(workers, do_encrypt_file, wi);
-                     }
-                  }
-                  else
-                  {
-                     do_encrypt_file(wi);
-                  }
-               }
+               pgmoneta_workers_add(workers, do_encrypt_file, wi);
             }
-
-            free(from);
-            free(to);
-
-            from = NULL;
-            to = NULL;
+         }
+         else
+         {
+            do_encrypt_file(wi);
          }
       }
-   }
-
-   closedir(dir);
-
-   return 0;
-
-error:
 
-   if (dir != NULL)
-   {
-      closedir(dir);
+      free(to);
    }
 
-   return 1;
+   return WALK_CONTINUE;
 }
 
 static void
@@ -185,7 +194,7 @@ pgmoneta_encrypt_tablespaces(char* root, struct workers* workers)
 
          snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
 
-         pgmoneta_encrypt_data(path, workers);
+         pgmoneta_encrypt_data(path, NULL, workers);
       }
    }
 
@@ -194,17 +203,15 @@ pgmoneta_encrypt_tablespaces(char* root, struct workers* workers)
 }
 
 int
-pgmoneta_encrypt_wal(char* d)
+pgmoneta_encrypt_wal(int server, char* d)
 {
    char* from = NULL;
    char* to = NULL;
    DIR* dir;
    struct dirent* entry;
    char* compress_suffix = NULL;
-   struct configuration* config;
 
-   config = (struct configuration*)shmem;
-   switch (config->compression_type)
+   switch (pgmoneta_get_wal_compression(server))
    {
       case COMPRESSION_CLIENT_GZIP:
       case COMPRESSION_SERVER_GZIP:
@@ -237,7 +244,9 @@ pgmoneta_encrypt_wal(char* d)
    {
       if (entry->d_type == DT_REG)
       {
-         if (!pgmoneta_ends_with(entry->d_name, compress_suffix))
+         if (!pgmoneta_ends_with(entry->d_name, compress_suffix) ||
+             pgmoneta_is_encrypted_archive(entry->d_name) ||
+             pgmoneta_ends_with(entry->d_name, ".partial"))
          {
             continue;
          }
@@ -258,7 +267,10 @@ pgmoneta_encrypt_wal(char* d)
          if (pgmoneta_exists(from))
          {
             encrypt_file(from, to, 1);
-            pgmoneta_delete_file(from, NULL);
+            if (pgmoneta_wal_recycle(d, from))
+            {
+               pgmoneta_delete_file(from, NULL);
+            }
             pgmoneta_permission(to, 6, 0, 0);
          }
          else
@@ -476,7 +488,11 @@ pgmoneta_decrypt_directory(char* d, struct workers* workers)
             to = pgmoneta_append(to, "/");
             to = pgmoneta_append(to, name);
 
-            if (!pgmoneta_create_worker_input(NULL, from, to, 0, workers, &wi))
+            if (workers != NULL && workers->outcome && !ctr_split(from, to, 0, workers))
+            {
+               // the parts are queued
+            }
+            else if (!pgmoneta_create_worker_input(NULL, from, to, 0, workers, &wi))
             {
                if (workers != NULL)
                {
@@ -541,6 +557,36 @@ do_decrypt_file(struct worker_input* wi)
    free(wi);
 }
 
+static void
+do_ctr_part(struct worker_input* wi)
+{
+   if (ctr_range(wi->from, wi->to, wi->level, wi->offset, wi->length))
+   {
+      pgmoneta_log_error("AES: Could not process %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&wi->split->failed, true);
+   }
+
+   // the last part to finish removes the source file, or the partial result
+   if (atomic_fetch_sub(&wi->split->remaining, 1) == 1)
+   {
+      if (atomic_load(&wi->split->failed))
+      {
+         pgmoneta_delete_file(wi->to, NULL);
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      else
+      {
+         pgmoneta_delete_file(wi->from, NULL);
+      }
+      free(wi->split);
+   }
+
+   free(wi);
+}
+
 void
 pgmoneta_decrypt_request(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
@@ -833,32 +879,22 @@ static const EVP_CIPHER* (*get_cipher(int mode))(void)
    return &EVP_aes_256_cbc;
 }
 
-// enc: 1 for encrypt, 0 for decrypt
+int
+pgmoneta_cipher_context_create(int mode, int enc, EVP_CIPHER_CTX** ctx)
+{
+   return cipher_context(mode, enc, 0, ctx);
+}
+
 static int
-encrypt_file(char* from, char* to, int enc)
+cipher_context(int mode, int enc, off_t offset, EVP_CIPHER_CTX** ctx)
 {
    unsigned char key[EVP_MAX_KEY_LENGTH];
    unsigned char iv[EVP_MAX_IV_LENGTH];
+   uint64_t carry = 0;
    char* master_key = NULL;
-   EVP_CIPHER_CTX* ctx = NULL;
-   struct configuration* config;
-   const EVP_CIPHER* (* cipher_fp)(void) = NULL;
-   int cipher_block_size = 0;
-   int inbuf_size = 0;
-   int outbuf_size = 0;
-   FILE* in = NULL;
-   FILE* out = NULL;
-   int inl = 0;
-   int outl = 0;
-   int f_len = 0;
+   EVP_CIPHER_CTX* c = NULL;
 
-   config = (struct configuration*)shmem;
-   cipher_fp = get_cipher(config->encryption);
-   cipher_block_size = EVP_CIPHER_block_size(cipher_fp());
-   inbuf_size = ENC_BUF_SIZE;
-   outbuf_size = inbuf_size + cipher_block_size - 1;
-   unsigned char inbuf[inbuf_size];
-   unsigned char outbuf[outbuf_size];
+   *ctx = NULL;
 
    if (pgmoneta_get_master_key(&master_key))
    {
@@ -867,133 +903,353 @@ encrypt_file(char* from, char* to, int enc)
    }
    memset(&key, 0, sizeof(key));
    memset(&iv, 0, sizeof(iv));
-   if (derive_key_iv(master_key, key, iv, config->encryption) != 0)
+   if (derive_key_iv(master_key, key, iv, mode) != 0)
    {
       pgmoneta_log_fatal("derive_key_iv: Failed to derive key and iv");
       goto error;
    }
 
-   if (!(ctx = EVP_CIPHER_CTX_new()))
+   // a CTR stream at an offset starts with the counter of that block
+   carry = (uint64_t)offset / AES_BLOCK;
+   for (int i = AES_BLOCK - 1; i >= 0 && carry > 0; i--)
+   {
+      carry += iv[i];
+      iv[i] = (unsigned char)(carry & 0xFF);
+      carry >>= 8;
+   }
+
+   if (!(c = EVP_CIPHER_CTX_new()))
    {
       pgmoneta_log_fatal("EVP_CIPHER_CTX_new: Failed to get context");
       goto error;
    }
 
-   in = fopen(from, "rb");
-   if (in == NULL)
+   if (EVP_CipherInit_ex(c, get_cipher(mode)(), NULL, key, iv, enc) == 0)
    {
-      pgmoneta_log_error("fopen: Could not open %s", from);
+      pgmoneta_log_error("EVP_CipherInit_ex: Failed to initialize context");
       goto error;
    }
 
-   out = fopen(to, "w");
-   if (out == NULL)
+   *ctx = c;
+
+   free(master_key);
+
+   return 0;
+
+error:
+   if (c != NULL)
    {
-      pgmoneta_log_error("fopen: Could not open %s", to);
-      goto error;
+      EVP_CIPHER_CTX_free(c);
    }
 
-   if (EVP_CipherInit_ex(ctx, cipher_fp(), NULL, key, iv, enc) == 0)
+   free(master_key);
+
+   return 1;
+}
+
+static bool
+ctr_mode(int mode)
+{
+   return mode == ENCRYPTION_AES_256_CTR || mode == ENCRYPTION_AES_192_CTR || mode == ENCRYPTION_AES_128_CTR;
+}
+
+static int
+ctr_split(char* from, char* to, int enc, struct workers* workers)
+{
+   int fd = -1;
+   int parts = 0;
+   struct stat st;
+   struct worker_split* split = NULL;
+   struct worker_input* wi = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // CTR has no chaining, so the ranges of a large file are processed in parallel
+   if (!ctr_mode(config->encryption) || (enc == 0 && pgmoneta_aead_file(from)) ||
+       stat(from, &st) || st.st_size < 2 * AES_SPLIT_SIZE)
    {
-      pgmoneta_log_error("EVP_CipherInit_ex: ailed to initialize context");
-      goto error;
+      return 1;
    }
 
-   while ((inl = fread(inbuf, sizeof(char), inbuf_size, in)) > 0)
+   parts = (int)((st.st_size + AES_SPLIT_SIZE - 1) / AES_SPLIT_SIZE);
+
+   split = (struct worker_split*)malloc(sizeof(struct worker_split));
+   if (split == NULL)
    {
-      if (EVP_CipherUpdate(ctx, outbuf, &outl, inbuf, inl) == 0)
+      return 1;
+   }
+
+   split->number_of_parts = parts;
+   atomic_init(&split->remaining, parts);
+   atomic_init(&split->failed, false);
+
+   // the parts write into the file at their offsets
+   fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1 || ftruncate(fd, st.st_size))
+   {
+      if (fd != -1)
       {
-         pgmoneta_log_error("EVP_CipherUpdate: failed to process block");
-         goto error;
+         close(fd);
       }
-      if (fwrite(outbuf, sizeof(char), outl, out) != (size_t)outl)
+      free(split);
+      return 1;
+   }
+   close(fd);
+
+   for (int i = 0; i < parts; i++)
+   {
+      if (pgmoneta_create_worker_input(NULL, from, to, enc, workers, &wi))
       {
-         pgmoneta_log_error("fwrite: failed to write cipher");
-         goto error;
+         // the parts that are not queued count as failed
+         atomic_store(&split->failed, true);
+         if (atomic_fetch_sub(&split->remaining, parts - i) == parts - i)
+         {
+            pgmoneta_delete_file(to, NULL);
+            free(split);
+         }
+         workers->outcome = false;
+         return 0;
       }
+
+      wi->offset = (off_t)i * AES_SPLIT_SIZE;
+      wi->length = (size_t)MIN((off_t)AES_SPLIT_SIZE, st.st_size - wi->offset);
+      wi->split = split;
+
+      pgmoneta_workers_add(workers, do_ctr_part, wi);
    }
 
-   if (ferror(in))
+   return 0;
+}
+
+static int
+ctr_range(char* from, char* to, int enc, off_t offset, size_t length)
+{
+   int fd_in = -1;
+   int fd_out = -1;
+   int outl = 0;
+   size_t done = 0;
+   unsigned char* inbuf = NULL;
+   unsigned char* outbuf = NULL;
+   EVP_CIPHER_CTX* ctx = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   inbuf = pgmoneta_worker_buffer(WORKER_BUFFER_IN, ENC_BUF_SIZE);
+   outbuf = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, ENC_BUF_SIZE);
+
+   if (inbuf == NULL || outbuf == NULL || cipher_context(config->encryption, enc, offset, &ctx))
    {
-      pgmoneta_log_error("fread: error reading from file: %s", from);
       goto error;
    }
 
-   if (EVP_CipherFinal_ex(ctx, outbuf, &f_len) == 0)
+   fd_in = open(from, O_RDONLY);
+   fd_out = open(to, O_WRONLY);
+
+   if (fd_in == -1 || fd_out == -1)
    {
-      pgmoneta_log_error("EVP_CipherFinal_ex: failed to process final cipher block");
       goto error;
    }
 
-   if (f_len)
+   while (done < length)
    {
-      if (fwrite(outbuf, sizeof(char), f_len, out) != (size_t)f_len)
+      size_t size = MIN((size_t)ENC_BUF_SIZE, length - done);
+
+      if (pread(fd_in, inbuf, size, offset + (off_t)done) != (ssize_t)size)
+      {
+         goto error;
+      }
+
+      if (EVP_CipherUpdate(ctx, outbuf, &outl, inbuf, (int)size) == 0 || (size_t)outl != size)
+      {
+         pgmoneta_log_error("EVP_CipherUpdate: failed to process block");
+         goto error;
+      }
+
+      if (pwrite(fd_out, outbuf, size, offset + (off_t)done) != (ssize_t)size)
       {
-         pgmoneta_log_error("fwrite: failed to write final block");
          goto error;
       }
+
+      done += size;
    }
 
-   if (ctx)
+   EVP_CIPHER_CTX_free(ctx);
+   close(fd_in);
+
+   if (close(fd_out) != 0)
    {
-      EVP_CIPHER_CTX_free(ctx);
+      return 1;
    }
-   free(master_key);
-   fclose(in);
-   fclose(out);
+
    return 0;
 
 error:
-   if (ctx)
+
+   if (ctx != NULL)
    {
       EVP_CIPHER_CTX_free(ctx);
    }
 
-   free(master_key);
-
-   if (in != NULL)
+   if (fd_in != -1)
    {
-      fclose(in);
+      close(fd_in);
    }
 
-   if (out != NULL)
+   if (fd_out != -1)
    {
-      fclose(out);
+      close(fd_out);
    }
 
    return 1;
 }
 
-int
-pgmoneta_encrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** enc_buffer, size_t* enc_size, int mode)
-{
-   return encrypt_decrypt_buffer(origin_buffer, origin_size, enc_buffer, enc_size, 1, mode);
-}
-
-int
-pgmoneta_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** dec_buffer, size_t* dec_size, int mode)
-{
-   return encrypt_decrypt_buffer(origin_buffer, origin_size, dec_buffer, dec_size, 0, mode);
-}
-
+// enc: 1 for encrypt, 0 for decrypt
 static int
-encrypt_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** res_buffer, size_t* res_size, int enc, int mode)
+encrypt_file(char* from, char* to, int enc)
 {
-   unsigned char key[EVP_MAX_KEY_LENGTH];
-   unsigned char iv[EVP_MAX_IV_LENGTH];
-   char* master_key = NULL;
    EVP_CIPHER_CTX* ctx = NULL;
-   const EVP_CIPHER* (*cipher_fp)(void) = NULL;
-   size_t cipher_block_size = 0;
-   size_t outbuf_size = 0;
-   size_t outl = 0;
-   size_t f_len = 0;
+   struct configuration* config;
+   const EVP_CIPHER* (* cipher_fp)(void) = NULL;
+   int cipher_block_size = 0;
+   int inbuf_size = 0;
+   int outbuf_size = 0;
+   FILE* in = NULL;
+   FILE* out = NULL;
+   int inl = 0;
+   int outl = 0;
+   int f_len = 0;
 
-   cipher_fp = get_cipher_buffer(mode);
-   if (cipher_fp == NULL)
+   config = (struct configuration*)shmem;
+
+   if (enc == 1 && pgmoneta_aead_mode(config->encryption))
    {
-      pgmoneta_log_error("Invalid encryption method specified");
-      goto error;
+      return aead_encrypt_file(from, to, config->encryption);
+   }
+   else if (enc == 0 && pgmoneta_aead_file(from))
+   {
+      return aead_decrypt_file(from, to);
+   }
+
+   cipher_fp = get_cipher(config->encryption);
+   cipher_block_size = EVP_CIPHER_block_size(cipher_fp());
+   inbuf_size = ENC_BUF_SIZE;
+   outbuf_size = inbuf_size + cipher_block_size - 1;
+   unsigned char inbuf[inbuf_size];
+   unsigned char outbuf[outbuf_size];
+
+   if (pgmoneta_cipher_context_create(config->encryption, enc, &ctx))
+   {
+      goto error;
+   }
+
+   in = fopen(from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("fopen: Could not open %s", from);
+      goto error;
+   }
+
+   out = fopen(to, "w");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("fopen: Could not open %s", to);
+      goto error;
+   }
+
+   while ((inl = fread(inbuf, sizeof(char), inbuf_size, in)) > 0)
+   {
+      if (EVP_CipherUpdate(ctx, outbuf, &outl, inbuf, inl) == 0)
+      {
+         pgmoneta_log_error("EVP_CipherUpdate: failed to process block");
+         goto error;
+      }
+      if (fwrite(outbuf, sizeof(char), outl, out) != (size_t)outl)
+      {
+         pgmoneta_log_error("fwrite: failed to write cipher");
+         goto error;
+      }
+   }
+
+   if (ferror(in))
+   {
+      pgmoneta_log_error("fread: error reading from file: %s", from);
+      goto error;
+   }
+
+   if (EVP_CipherFinal_ex(ctx, outbuf, &f_len) == 0)
+   {
+      pgmoneta_log_error("EVP_CipherFinal_ex: failed to process final cipher block");
+      goto error;
+   }
+
+   if (f_len)
+   {
+      if (fwrite(outbuf, sizeof(char), f_len, out) != (size_t)f_len)
+      {
+         pgmoneta_log_error("fwrite: failed to write final block");
+         goto error;
+      }
+   }
+
+   if (ctx)
+   {
+      EVP_CIPHER_CTX_free(ctx);
+   }
+   fclose(in);
+   fclose(out);
+   return 0;
+
+error:
+   if (ctx)
+   {
+      EVP_CIPHER_CTX_free(ctx);
+   }
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_encrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** enc_buffer, size_t* enc_size, int mode)
+{
+   return encrypt_decrypt_buffer(origin_buffer, origin_size, enc_buffer, enc_size, 1, mode);
+}
+
+int
+pgmoneta_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** dec_buffer, size_t* dec_size, int mode)
+{
+   return encrypt_decrypt_buffer(origin_buffer, origin_size, dec_buffer, dec_size, 0, mode);
+}
+
+static int
+encrypt_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** res_buffer, size_t* res_size, int enc, int mode)
+{
+   unsigned char key[EVP_MAX_KEY_LENGTH];
+   unsigned char iv[EVP_MAX_IV_LENGTH];
+   char* master_key = NULL;
+   EVP_CIPHER_CTX* ctx = NULL;
+   const EVP_CIPHER* (*cipher_fp)(void) = NULL;
+   size_t cipher_block_size = 0;
+   size_t outbuf_size = 0;
+   size_t outl = 0;
+   size_t f_len = 0;
+
+   cipher_fp = get_cipher_buffer(mode);
+   if (cipher_fp == NULL)
+   {
+      pgmoneta_log_error("Invalid encryption method specified");
+      goto error;
    }
 
    cipher_block_size = EVP_CIPHER_block_size(cipher_fp());
@@ -1097,3 +1353,881 @@ static const EVP_CIPHER* (*get_cipher_buffer(int mode))(void)
    }
    return &EVP_aes_256_cbc;
 }
+
+bool
+pgmoneta_aead_mode(int mode)
+{
+   return mode == ENCRYPTION_AES_256_GCM || mode == ENCRYPTION_CHACHA20_POLY1305;
+}
+
+int
+pgmoneta_aead_create(int mode, int (*output)(void* data, void* buffer, size_t size), void* data, struct aead** aead)
+{
+   struct aead* a = NULL;
+
+   *aead = NULL;
+
+   if (!pgmoneta_aead_mode(mode))
+   {
+      pgmoneta_log_error("AEAD: Invalid encryption mode %d", mode);
+      goto error;
+   }
+
+   a = (struct aead*)malloc(sizeof(struct aead));
+   if (a == NULL)
+   {
+      goto error;
+   }
+
+   memset(a, 0, sizeof(struct aead));
+
+   a->mode = mode;
+   a->owner = true;
+   a->chunk_size = AEAD_CHUNK_SIZE;
+   a->output = output;
+   a->data = data;
+
+   if (RAND_bytes(a->prefix, AEAD_PREFIX_SIZE) != 1)
+   {
+      pgmoneta_log_error("AEAD: Could not generate nonce");
+      goto error;
+   }
+
+   a->ctx = EVP_CIPHER_CTX_new();
+   a->buffer = (unsigned char*)aligned_alloc(64, a->chunk_size);
+   a->out = (unsigned char*)aligned_alloc(64, a->chunk_size + AEAD_TAG_SIZE);
+
+   if (a->ctx == NULL || a->buffer == NULL || a->out == NULL)
+   {
+      pgmoneta_log_error("AEAD: Allocation failure");
+      goto error;
+   }
+
+   *aead = a;
+
+   return 0;
+
+error:
+
+   pgmoneta_aead_destroy(a);
+
+   return 1;
+}
+
+int
+pgmoneta_aead_update(struct aead* aead, void* data, size_t size)
+{
+   size_t offset = 0;
+   size_t chunk = 0;
+
+   while (offset < size)
+   {
+      /* Only seal a full chunk once more data arrives, so the final chunk is known */
+      if (aead->length == aead->chunk_size)
+      {
+         if (aead_seal(aead, false))
+         {
+            return 1;
+         }
+      }
+
+      chunk = MIN(size - offset, aead->chunk_size - aead->length);
+      memcpy(aead->buffer + aead->length, (unsigned char*)data + offset, chunk);
+
+      aead->length += chunk;
+      offset += chunk;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_aead_finish(struct aead* aead)
+{
+   return aead_seal(aead, true);
+}
+
+int
+pgmoneta_aead_open_create(int (*output)(void* data, void* buffer, size_t size), void* data, struct aead** aead)
+{
+   struct aead* a = NULL;
+
+   *aead = NULL;
+
+   a = (struct aead*)malloc(sizeof(struct aead));
+   if (a == NULL)
+   {
+      goto error;
+   }
+
+   memset(a, 0, sizeof(struct aead));
+
+   a->owner = true;
+   a->output = output;
+   a->data = data;
+
+   a->ctx = EVP_CIPHER_CTX_new();
+   if (a->ctx == NULL)
+   {
+      pgmoneta_log_error("AEAD: Allocation failure");
+      goto error;
+   }
+
+   *aead = a;
+
+   return 0;
+
+error:
+
+   pgmoneta_aead_destroy(a);
+
+   return 1;
+}
+
+int
+pgmoneta_aead_open_update(struct aead* aead, void* data, size_t size)
+{
+   size_t offset = 0;
+   size_t chunk = 0;
+
+   while (offset < size)
+   {
+      if (!aead->header)
+      {
+         chunk = MIN(size - offset, AEAD_HEADER_SIZE - aead->length);
+         memcpy(aead->head + aead->length, (unsigned char*)data + offset, chunk);
+
+         aead->length += chunk;
+         offset += chunk;
+
+         if (aead->length == AEAD_HEADER_SIZE)
+         {
+            if (aead_parse_header(aead->head, &aead->mode, &aead->chunk_size, aead->prefix))
+            {
+               pgmoneta_log_error("AEAD: Invalid header");
+               return 1;
+            }
+
+            aead->buffer = (unsigned char*)malloc(aead->chunk_size + AEAD_TAG_SIZE);
+            aead->out = (unsigned char*)malloc(aead->chunk_size);
+
+            if (aead->buffer == NULL || aead->out == NULL)
+            {
+               pgmoneta_log_error("AEAD: Allocation failure");
+               return 1;
+            }
+
+            aead->header = true;
+            aead->length = 0;
+         }
+
+         continue;
+      }
+
+      /* Only open a full chunk once more data arrives, so the final chunk is known */
+      if (aead->length == aead->chunk_size + AEAD_TAG_SIZE)
+      {
+         if (aead_open_chunk(aead, false))
+         {
+            return 1;
+         }
+      }
+
+      chunk = MIN(size - offset, aead->chunk_size + AEAD_TAG_SIZE - aead->length);
+      memcpy(aead->buffer + aead->length, (unsigned char*)data + offset, chunk);
+
+      aead->length += chunk;
+      offset += chunk;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_aead_open_finish(struct aead* aead)
+{
+   if (!aead->header || aead->length < AEAD_TAG_SIZE)
+   {
+      pgmoneta_log_error("AEAD: Truncated stream");
+      return 1;
+   }
+
+   return aead_open_chunk(aead, true);
+}
+
+void
+pgmoneta_aead_destroy(struct aead* aead)
+{
+   if (aead == NULL)
+   {
+      return;
+   }
+
+   if (aead->owner)
+   {
+      if (aead->ctx != NULL)
+      {
+         EVP_CIPHER_CTX_free(aead->ctx);
+      }
+
+      free(aead->buffer);
+      free(aead->out);
+      free(aead);
+   }
+}
+
+bool
+pgmoneta_aead_file(char* path)
+{
+   char magic[AEAD_MAGIC_SIZE];
+   FILE* file = NULL;
+   bool result = false;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      return false;
+   }
+
+   if (fread(magic, 1, AEAD_MAGIC_SIZE, file) == AEAD_MAGIC_SIZE &&
+       !memcmp(magic, AEAD_MAGIC, AEAD_MAGIC_SIZE))
+   {
+      result = true;
+   }
+
+   fclose(file);
+
+   return result;
+}
+
+int
+pgmoneta_aead_size(char* path, size_t* size)
+{
+   struct stat st;
+   FILE* file = NULL;
+   int mode;
+   size_t chunk_size;
+   size_t data;
+   size_t chunks;
+   unsigned char prefix[AEAD_PREFIX_SIZE];
+
+   *size = 0;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (aead_read_header(file, &mode, &chunk_size, prefix))
+   {
+      goto error;
+   }
+
+   if (fstat(fileno(file), &st) || (size_t)st.st_size < AEAD_HEADER_SIZE + AEAD_TAG_SIZE)
+   {
+      goto error;
+   }
+
+   data = (size_t)st.st_size - AEAD_HEADER_SIZE;
+   chunks = (data + chunk_size + AEAD_TAG_SIZE - 1) / (chunk_size + AEAD_TAG_SIZE);
+
+   *size = data - chunks * AEAD_TAG_SIZE;
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_aead_read(char* path, size_t offset, size_t length, void* buffer, size_t* read)
+{
+   struct stat st;
+   FILE* file = NULL;
+   EVP_CIPHER_CTX* ctx = NULL;
+   int mode;
+   size_t chunk_size;
+   size_t sealed_size;
+   size_t position;
+   size_t sealed;
+   size_t skip;
+   size_t n;
+   uint64_t index;
+   bool final;
+   unsigned char prefix[AEAD_PREFIX_SIZE];
+   unsigned char* in = NULL;
+   unsigned char* out = NULL;
+
+   *read = 0;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("AEAD: Could not open %s", path);
+      goto error;
+   }
+
+   if (aead_read_header(file, &mode, &chunk_size, prefix))
+   {
+      pgmoneta_log_error("AEAD: Invalid header in %s", path);
+      goto error;
+   }
+
+   if (fstat(fileno(file), &st))
+   {
+      goto error;
+   }
+
+   sealed_size = chunk_size + AEAD_TAG_SIZE;
+   ctx = aead_context();
+   in = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, sealed_size);
+   out = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_OUT, chunk_size);
+
+   if (ctx == NULL || in == NULL || out == NULL)
+   {
+      goto error;
+   }
+
+   index = offset / chunk_size;
+   skip = offset % chunk_size;
+
+   while (*read < length)
+   {
+      if (index > UINT32_MAX)
+      {
+         break;
+      }
+
+      position = AEAD_HEADER_SIZE + index * sealed_size;
+      if (position >= (size_t)st.st_size)
+      {
+         break;
+      }
+
+      sealed = MIN(sealed_size, (size_t)st.st_size - position);
+      final = position + sealed == (size_t)st.st_size;
+
+      if (sealed < AEAD_TAG_SIZE ||
+          fseeko(file, (off_t)position, SEEK_SET) ||
+          fread(in, 1, sealed, file) != sealed)
+      {
+         pgmoneta_log_error("AEAD: Could not read chunk %" PRIu64 " of %s", index, path);
+         goto error;
+      }
+
+      if (aead_open(ctx, mode, prefix, (uint32_t)index, final, in, sealed - AEAD_TAG_SIZE, out))
+      {
+         pgmoneta_log_error("AEAD: Authentication failed for chunk %" PRIu64 " of %s", index, path);
+         goto error;
+      }
+
+      if (skip >= sealed - AEAD_TAG_SIZE)
+      {
+         break;
+      }
+
+      n = MIN(length - *read, sealed - AEAD_TAG_SIZE - skip);
+      memcpy((unsigned char*)buffer + *read, out + skip, n);
+
+      *read += n;
+      skip = 0;
+      index++;
+
+      if (final)
+      {
+         break;
+      }
+   }
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static const EVP_CIPHER* (*get_aead_cipher(int mode))(void)
+{
+   if (mode == ENCRYPTION_CHACHA20_POLY1305)
+   {
+      return &EVP_chacha20_poly1305;
+   }
+   return &EVP_aes_256_gcm;
+}
+
+static int
+aead_key_get(unsigned char* key)
+{
+   char* master_key = NULL;
+
+   pthread_mutex_lock(&aead_key_lock);
+
+   if (!aead_key_valid)
+   {
+      if (pgmoneta_get_master_key(&master_key))
+      {
+         pgmoneta_log_error("pgmoneta_get_master_key: Invalid master key");
+         goto error;
+      }
+
+      if (PKCS5_PBKDF2_HMAC(master_key, strlen(master_key),
+                            (unsigned char*)AEAD_SALT, strlen(AEAD_SALT), AEAD_ITERATIONS,
+                            EVP_sha256(), AEAD_KEY_SIZE, aead_key) != 1)
+      {
+         pgmoneta_log_error("PKCS5_PBKDF2_HMAC: Failed to derive key");
+         goto error;
+      }
+
+      aead_key_valid = true;
+   }
+
+   memcpy(key, aead_key, AEAD_KEY_SIZE);
+
+   pthread_mutex_unlock(&aead_key_lock);
+
+   free(master_key);
+
+   return 0;
+
+error:
+
+   pthread_mutex_unlock(&aead_key_lock);
+
+   free(master_key);
+
+   return 1;
+}
+
+static EVP_CIPHER_CTX*
+aead_context(void)
+{
+   EVP_CIPHER_CTX* ctx = NULL;
+
+   ctx = (EVP_CIPHER_CTX*)pgmoneta_worker_context(WORKER_CONTEXT_CIPHER);
+   if (ctx == NULL)
+   {
+      ctx = EVP_CIPHER_CTX_new();
+      if (ctx == NULL)
+      {
+         pgmoneta_log_error("EVP_CIPHER_CTX_new: Failed to create context");
+         return NULL;
+      }
+
+      pgmoneta_worker_context_set(WORKER_CONTEXT_CIPHER, ctx, aead_free_context);
+   }
+
+   return ctx;
+}
+
+static void
+aead_free_context(void* context)
+{
+   EVP_CIPHER_CTX_free((EVP_CIPHER_CTX*)context);
+}
+
+static void
+aead_nonce(unsigned char* prefix, uint32_t index, unsigned char* nonce, unsigned char* aad, bool final)
+{
+   memcpy(nonce, prefix, AEAD_PREFIX_SIZE);
+   pgmoneta_write_uint32(nonce + AEAD_PREFIX_SIZE, index);
+
+   pgmoneta_write_uint32(aad, index);
+   aad[4] = final ? 1 : 0;
+}
+
+static int
+aead_seal(struct aead* aead, bool final)
+{
+   unsigned char key[AEAD_KEY_SIZE];
+   unsigned char nonce[AEAD_NONCE_SIZE];
+   unsigned char aad[5];
+   unsigned char header[AEAD_HEADER_SIZE];
+   int outl = 0;
+   int f_len = 0;
+
+   if (!aead->header)
+   {
+      memcpy(header, AEAD_MAGIC, AEAD_MAGIC_SIZE);
+      pgmoneta_write_uint32(header + 8, (uint32_t)aead->mode);
+      pgmoneta_write_uint32(header + 12, (uint32_t)aead->chunk_size);
+      memcpy(header + 16, aead->prefix, AEAD_PREFIX_SIZE);
+
+      if (aead->output(aead->data, header, AEAD_HEADER_SIZE))
+      {
+         goto error;
+      }
+
+      aead->header = true;
+   }
+
+   if (aead_key_get(key))
+   {
+      goto error;
+   }
+
+   aead_nonce(aead->prefix, aead->index, nonce, aad, final);
+
+   if (EVP_EncryptInit_ex(aead->ctx, get_aead_cipher(aead->mode)(), NULL, key, nonce) != 1 ||
+       EVP_EncryptUpdate(aead->ctx, NULL, &outl, aad, sizeof(aad)) != 1 ||
+       EVP_EncryptUpdate(aead->ctx, aead->out, &outl, aead->buffer, (int)aead->length) != 1 ||
+       EVP_EncryptFinal_ex(aead->ctx, aead->out + outl, &f_len) != 1 ||
+       EVP_CIPHER_CTX_ctrl(aead->ctx, EVP_CTRL_AEAD_GET_TAG, AEAD_TAG_SIZE, aead->out + aead->length) != 1)
+   {
+      pgmoneta_log_error("AEAD: Failed to seal chunk %u", aead->index);
+      goto error;
+   }
+
+   if (aead->output(aead->data, aead->out, aead->length + AEAD_TAG_SIZE))
+   {
+      goto error;
+   }
+
+   if (!final && aead->index == UINT32_MAX)
+   {
+      pgmoneta_log_error("AEAD: Too many chunks");
+      goto error;
+   }
+
+   aead->index++;
+   aead->length = 0;
+
+   OPENSSL_cleanse(key, sizeof(key));
+
+   return 0;
+
+error:
+
+   OPENSSL_cleanse(key, sizeof(key));
+
+   return 1;
+}
+
+static int
+aead_open(EVP_CIPHER_CTX* ctx, int mode, unsigned char* prefix, uint32_t index, bool final,
+          unsigned char* in, size_t in_length, unsigned char* out)
+{
+   unsigned char key[AEAD_KEY_SIZE];
+   unsigned char nonce[AEAD_NONCE_SIZE];
+   unsigned char aad[5];
+   int outl = 0;
+   int f_len = 0;
+
+   if (aead_key_get(key))
+   {
+      goto error;
+   }
+
+   aead_nonce(prefix, index, nonce, aad, final);
+
+   if (EVP_DecryptInit_ex(ctx, get_aead_cipher(mode)(), NULL, key, nonce) != 1 ||
+       EVP_DecryptUpdate(ctx, NULL, &outl, aad, sizeof(aad)) != 1 ||
+       EVP_DecryptUpdate(ctx, out, &outl, in, (int)in_length) != 1 ||
+       EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, AEAD_TAG_SIZE, in + in_length) != 1 ||
+       EVP_DecryptFinal_ex(ctx, out + outl, &f_len) != 1)
+   {
+      goto error;
+   }
+
+   OPENSSL_cleanse(key, sizeof(key));
+
+   return 0;
+
+error:
+
+   OPENSSL_cleanse(key, sizeof(key));
+
+   return 1;
+}
+
+static int
+aead_open_chunk(struct aead* aead, bool final)
+{
+   size_t length = aead->length - AEAD_TAG_SIZE;
+
+   if (aead_open(aead->ctx, aead->mode, aead->prefix, aead->index, final, aead->buffer, length, aead->out))
+   {
+      pgmoneta_log_error("AEAD: Authentication failed for chunk %u", aead->index);
+      return 1;
+   }
+
+   if (length > 0 && aead->output(aead->data, aead->out, length))
+   {
+      return 1;
+   }
+
+   if (!final && aead->index == UINT32_MAX)
+   {
+      pgmoneta_log_error("AEAD: Too many chunks");
+      return 1;
+   }
+
+   aead->index++;
+   aead->length = 0;
+
+   return 0;
+}
+
+static int
+aead_read_header(FILE* file, int* mode, size_t* chunk_size, unsigned char* prefix)
+{
+   unsigned char header[AEAD_HEADER_SIZE];
+
+   if (fread(header, 1, AEAD_HEADER_SIZE, file) != AEAD_HEADER_SIZE)
+   {
+      return 1;
+   }
+
+   return aead_parse_header(header, mode, chunk_size, prefix);
+}
+
+static int
+aead_parse_header(unsigned char* header, int* mode, size_t* chunk_size, unsigned char* prefix)
+{
+   if (memcmp(header, AEAD_MAGIC, AEAD_MAGIC_SIZE))
+   {
+      return 1;
+   }
+
+   *mode = (int)pgmoneta_read_uint32(header + 8);
+   *chunk_size = (size_t)pgmoneta_read_uint32(header + 12);
+   memcpy(prefix, header + 16, AEAD_PREFIX_SIZE);
+
+   if (!pgmoneta_aead_mode(*mode) || *chunk_size == 0 || *chunk_size > AEAD_MAX_CHUNK)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+aead_file_output(void* data, void* buffer, size_t size)
+{
+   if (fwrite(buffer, 1, size, (FILE*)data) != size)
+   {
+      pgmoneta_log_error("fwrite: failed to write cipher");
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+aead_encrypt_file(char* from, char* to, int mode)
+{
+   struct aead aead;
+   FILE* in = NULL;
+   FILE* out = NULL;
+   size_t n = 0;
+   int c;
+
+   memset(&aead, 0, sizeof(struct aead));
+
+   aead.mode = mode;
+   aead.chunk_size = AEAD_CHUNK_SIZE;
+   aead.output = aead_file_output;
+   aead.ctx = aead_context();
+   aead.buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, aead.chunk_size);
+   aead.out = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_OUT, aead.chunk_size + AEAD_TAG_SIZE);
+
+   if (aead.ctx == NULL || aead.buffer == NULL || aead.out == NULL)
+   {
+      goto error;
+   }
+
+   if (RAND_bytes(aead.prefix, AEAD_PREFIX_SIZE) != 1)
+   {
+      pgmoneta_log_error("AEAD: Could not generate nonce");
+      goto error;
+   }
+
+   in = fopen(from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("fopen: Could not open %s", from);
+      goto error;
+   }
+
+   out = fopen(to, "w");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("fopen: Could not open %s", to);
+      goto error;
+   }
+
+   aead.data = out;
+
+   /* Read whole chunks straight into the plaintext buffer */
+   while ((n = fread(aead.buffer + aead.length, 1, aead.chunk_size - aead.length, in)) > 0)
+   {
+      aead.length += n;
+
+      if (aead.length == aead.chunk_size)
+      {
+         c = fgetc(in);
+         if (c == EOF)
+         {
+            break;
+         }
+
+         ungetc(c, in);
+
+         if (aead_seal(&aead, false))
+         {
+            goto error;
+         }
+      }
+   }
+
+   if (ferror(in))
+   {
+      pgmoneta_log_error("fread: error reading from file: %s", from);
+      goto error;
+   }
+
+   if (aead_seal(&aead, true))
+   {
+      goto error;
+   }
+
+   fclose(in);
+   fclose(out);
+
+   return 0;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   return 1;
+}
+
+static int
+aead_decrypt_file(char* from, char* to)
+{
+   EVP_CIPHER_CTX* ctx = NULL;
+   FILE* in = NULL;
+   FILE* out = NULL;
+   int mode;
+   int c;
+   size_t chunk_size;
+   size_t n;
+   uint32_t index = 0;
+   bool final = false;
+   unsigned char prefix[AEAD_PREFIX_SIZE];
+   unsigned char* inbuf = NULL;
+   unsigned char* outbuf = NULL;
+
+   in = fopen(from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("fopen: Could not open %s", from);
+      goto error;
+   }
+
+   if (aead_read_header(in, &mode, &chunk_size, prefix))
+   {
+      pgmoneta_log_error("AEAD: Invalid header in %s", from);
+      goto error;
+   }
+
+   ctx = aead_context();
+   inbuf = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, chunk_size + AEAD_TAG_SIZE);
+   outbuf = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_OUT, chunk_size);
+
+   if (ctx == NULL || inbuf == NULL || outbuf == NULL)
+   {
+      goto error;
+   }
+
+   out = fopen(to, "w");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("fopen: Could not open %s", to);
+      goto error;
+   }
+
+   while (!final)
+   {
+      n = fread(inbuf, 1, chunk_size + AEAD_TAG_SIZE, in);
+
+      if (ferror(in))
+      {
+         pgmoneta_log_error("fread: error reading from file: %s", from);
+         goto error;
+      }
+
+      c = fgetc(in);
+      if (c == EOF)
+      {
+         final = true;
+      }
+      else
+      {
+         ungetc(c, in);
+      }
+
+      if (n < AEAD_TAG_SIZE)
+      {
+         pgmoneta_log_error("AEAD: Truncated file %s", from);
+         goto error;
+      }
+
+      if (aead_open(ctx, mode, prefix, index, final, inbuf, n - AEAD_TAG_SIZE, outbuf))
+      {
+         pgmoneta_log_error("AEAD: Authentication failed for chunk %u of %s", index, from);
+         goto error;
+      }
+
+      if (fwrite(outbuf, 1, n - AEAD_TAG_SIZE, out) != n - AEAD_TAG_SIZE)
+      {
+         pgmoneta_log_error("fwrite: failed to write plaintext");
+         goto error;
+      }
+
+      index++;
+   }
+
+   fclose(in);
+   fclose(out);
+
+   return 0;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   return 1;
+}
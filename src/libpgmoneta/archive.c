@@ -32,23 +32,69 @@
 #include <art.h>
 #include <gzip_compression.h>
 #include <info.h>
+#include <io.h>
 #include <json.h>
 #include <logging.h>
 #include <lz4_compression.h>
 #include <management.h>
 #include <network.h>
 #include <restore.h>
+#include <scheduler.h>
+#include <sha256.h>
+#include <streamer.h>
 #include <utils.h>
+#include <workers.h>
 #include <workflow.h>
 #include <zstandard_compression.h>
 
 #include <archive.h>
 #include <archive_entry.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <sys/stat.h>
+
+#define TAR_BLOCK_SIZE  512
+#define TAR_SPLIT_SIZE  (64 * 1024 * 1024)
+#define TAR_BUFFER_SIZE (1024 * 1024)
+
+/** @struct tar_extract
+ * Defines a regular file of an archive that the workers copy out in ranges
+ */
+struct tar_extract
+{
+   struct worker_split split; /**< The ranges */
+   off_t data;                /**< The offset of the data in the archive */
+   size_t size;               /**< The size of the file */
+};
 
 static void write_tar_file(struct archive* a, char* src, char* dst);
+static int extract_members(struct archive* a, char* file_path, char* destination, struct workers* workers);
+static int extract_create(struct archive_entry* entry, char* path);
+static int extract_queue(char* file_path, char* path, size_t size, int64_t end, struct workers* workers);
+static void do_extract_range(struct worker_input* wi);
+static int extract_entries(struct archive* a, char* destination, struct deque* hashes, struct page_checksums* checksums, struct tar_totals* totals);
+static void extract_totals(struct tar_totals* totals, struct archive_entry* entry);
+static int extract_entry_data(struct archive* a, struct archive* disk, EVP_MD_CTX* ctx, struct archive_entry* entry, char* path, struct deque* hashes, struct page_checksums* checksums);
+static void* tar_stream_extract(void* arg);
+static int tar_stream_next(struct tar_stream* stream);
+static ssize_t tar_stream_read(struct archive* a, void* client_data, const void** buffer);
+static int tar_add(struct tar_backup* tar, unsigned int type, char* from, char* name, char* link, mode_t mode, size_t size, bool decode);
+static int tar_collect(struct tar_backup* tar, char* from, char* name, bool decode);
+static int tar_collect_tablespaces(struct tar_backup* tar, struct backup* backup, char* from, char* destination, bool decode);
+static int tar_decode(struct tar_member* member);
+static void do_tar_decode(struct worker_input* wi);
+static void tar_queue(struct tar_member* member, struct workers* workers);
+static int tar_write_members(struct tar_backup* tar, struct archive* a, struct workers* workers, int number_of_workers);
+static int tar_write_file(struct archive* a, struct tar_member* member);
+static ssize_t tar_backup_write(struct archive* a, void* client_data, const void* buffer, size_t length);
+static void tar_backup_destroy(struct tar_backup* tar);
 
 void
 pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
@@ -73,13 +119,14 @@ pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
    struct configuration* config;
 
    pgmoneta_start_logging();
+   pgmoneta_scheduler_priority(SCHEDULER_PRIORITY_RESTORE);
 
    config = (struct configuration*)shmem;
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
 
    atomic_fetch_add(&config->active_archives, 1);
-   atomic_fetch_add(&config->servers[server].archiving, 1);
+   atomic_fetch_add(&config->states[server].archiving, 1);
 
    req = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
    identifier = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_BACKUP);
@@ -130,14 +177,18 @@ pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
       pgmoneta_delete_directory(real_directory);
    }
 
-   pgmoneta_mkdir(real_directory);
+   /* A full backup is archived straight from the backup directory, unless its relation files are packed */
+   if (backup->type != TYPE_FULL || backup->page_filter)
+   {
+      pgmoneta_mkdir(real_directory);
+   }
 
    if (pgmoneta_art_insert(nodes, NODE_TARGET_BASE, (uintptr_t)real_directory, ValueString))
    {
       goto error;
    }
 
-   if (!pgmoneta_restore_backup(nodes))
+   if ((backup->type == TYPE_FULL && !backup->page_filter) || !pgmoneta_restore_backup(nodes))
    {
       workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_ARCHIVE, server, backup);
 
@@ -154,7 +205,7 @@ pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
       current = workflow;
       while (current != NULL)
       {
-         if (current->execute(current->name(), nodes))
+         if (pgmoneta_workflow_execute(current, nodes))
          {
             goto error;
          }
@@ -228,7 +279,7 @@ pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
 
    pgmoneta_disconnect(client_fd);
 
-   atomic_fetch_sub(&config->servers[server].archiving, 1);
+   atomic_fetch_sub(&config->states[server].archiving, 1);
    atomic_fetch_sub(&config->active_archives, 1);
 
    pgmoneta_stop_logging();
@@ -249,7 +300,7 @@ error:
 
    pgmoneta_disconnect(client_fd);
 
-   atomic_fetch_sub(&config->servers[server].archiving, 1);
+   atomic_fetch_sub(&config->states[server].archiving, 1);
    atomic_fetch_sub(&config->active_archives, 1);
 
    pgmoneta_stop_logging();
@@ -262,11 +313,10 @@ error:
 }
 
 int
-pgmoneta_extract_tar_file(char* file_path, char* destination)
+pgmoneta_extract_tar_file(char* file_path, char* destination, struct workers* workers)
 {
    char* archive_name = NULL;
    struct archive* a;
-   struct archive_entry* entry;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -307,27 +357,17 @@ pgmoneta_extract_tar_file(char* file_path, char* destination)
       goto error;
    }
 
-   while (archive_read_next_header(a, &entry) == ARCHIVE_OK)
+   if (workers != NULL)
    {
-      char dst_file_path[MAX_PATH];
-      memset(dst_file_path, 0, sizeof(dst_file_path));
-      const char* entry_path = archive_entry_pathname(entry);
-      if (pgmoneta_ends_with(destination, "/"))
-      {
-         snprintf(dst_file_path, sizeof(dst_file_path), "%s%s", destination, entry_path);
-      }
-      else
+      if (extract_members(a, file_path, destination, workers))
       {
-         snprintf(dst_file_path, sizeof(dst_file_path), "%s/%s", destination, entry_path);
-      }
-
-      archive_entry_set_pathname(entry, dst_file_path);
-      if (archive_read_extract(a, entry, 0) != ARCHIVE_OK)
-      {
-         pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(a));
          goto error;
       }
    }
+   else if (extract_entries(a, destination, NULL, NULL, NULL))
+   {
+      goto error;
+   }
 
    free(archive_name);
 
@@ -343,6 +383,173 @@ error:
    return 1;
 }
 
+int
+pgmoneta_tar_stream_create(char* destination, int compression, struct deque* hashes, struct page_checksums* checksums, struct tar_totals* totals, struct tar_stream** stream)
+{
+   struct tar_stream* s = NULL;
+
+   *stream = NULL;
+
+   s = (struct tar_stream*)malloc(sizeof(struct tar_stream));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   memset(s, 0, sizeof(struct tar_stream));
+   snprintf(s->destination, sizeof(s->destination), "%s", destination);
+   s->hashes = hashes;
+   s->checksums = checksums;
+   s->totals = totals;
+
+   pthread_mutex_init(&s->lock, NULL);
+   pthread_cond_init(&s->readable, NULL);
+   pthread_cond_init(&s->writable, NULL);
+
+   if (compression == COMPRESSION_SERVER_ZSTD)
+   {
+      s->dctx = ZSTD_createDCtx();
+      if (s->dctx == NULL)
+      {
+         goto error;
+      }
+   }
+
+   for (int i = 0; i < TAR_STREAM_BUFFERS; i++)
+   {
+      s->buffers[i] = (char*)malloc(TAR_STREAM_BUFFER_SIZE);
+      if (s->buffers[i] == NULL)
+      {
+         goto error;
+      }
+   }
+
+   if (pthread_create(&s->thread, NULL, tar_stream_extract, s) != 0)
+   {
+      pgmoneta_log_error("Could not start the extraction to %s", destination);
+      goto error;
+   }
+   s->started = true;
+
+   *stream = s;
+
+   return 0;
+
+error:
+   pgmoneta_tar_stream_destroy(s);
+
+   return 1;
+}
+
+int
+pgmoneta_tar_stream_write(struct tar_stream* stream, void* data, size_t size)
+{
+   size_t n;
+   size_t ret;
+   bool full = false;
+   char* d = (char*)data;
+   ZSTD_inBuffer in = {data, size, 0};
+   ZSTD_outBuffer out;
+
+   if (stream->dctx != NULL)
+   {
+      // decompressed straight into the buffers, and a full buffer may leave output in the context
+      while (in.pos < in.size || full)
+      {
+         out.dst = stream->buffers[stream->head];
+         out.size = TAR_STREAM_BUFFER_SIZE;
+         out.pos = stream->sizes[stream->head];
+
+         ret = ZSTD_decompressStream(stream->dctx, &out, &in);
+         if (ZSTD_isError(ret))
+         {
+            pgmoneta_log_error("Could not decompress the tar stream for %s: %s", stream->destination, ZSTD_getErrorName(ret));
+            return 1;
+         }
+
+         stream->sizes[stream->head] = out.pos;
+
+         full = out.pos == out.size;
+         if (full && tar_stream_next(stream))
+         {
+            return 1;
+         }
+      }
+
+      return stream->failed ? 1 : 0;
+   }
+
+   while (size > 0)
+   {
+      n = MIN(size, TAR_STREAM_BUFFER_SIZE - stream->sizes[stream->head]);
+      memcpy(stream->buffers[stream->head] + stream->sizes[stream->head], d, n);
+      stream->sizes[stream->head] += n;
+      d += n;
+      size -= n;
+
+      if (stream->sizes[stream->head] == TAR_STREAM_BUFFER_SIZE && tar_stream_next(stream))
+      {
+         return 1;
+      }
+   }
+
+   return stream->failed ? 1 : 0;
+}
+
+int
+pgmoneta_tar_stream_finish(struct tar_stream* stream)
+{
+   if (stream == NULL || !stream->started)
+   {
+      return 1;
+   }
+
+   pthread_mutex_lock(&stream->lock);
+   if (!stream->done)
+   {
+      if (!stream->failed && stream->sizes[stream->head] > 0)
+      {
+         stream->head = (stream->head + 1) % TAR_STREAM_BUFFERS;
+         stream->queued++;
+      }
+      stream->done = true;
+      pthread_cond_signal(&stream->readable);
+   }
+   pthread_mutex_unlock(&stream->lock);
+
+   pthread_join(stream->thread, NULL);
+   stream->started = false;
+
+   return stream->failed ? 1 : 0;
+}
+
+void
+pgmoneta_tar_stream_destroy(struct tar_stream* stream)
+{
+   if (stream == NULL)
+   {
+      return;
+   }
+
+   if (stream->started)
+   {
+      pgmoneta_tar_stream_finish(stream);
+   }
+
+   for (int i = 0; i < TAR_STREAM_BUFFERS; i++)
+   {
+      free(stream->buffers[i]);
+   }
+
+   ZSTD_freeDCtx(stream->dctx);
+
+   pthread_cond_destroy(&stream->readable);
+   pthread_cond_destroy(&stream->writable);
+   pthread_mutex_destroy(&stream->lock);
+
+   free(stream);
+}
+
 int
 pgmoneta_tar_directory(char* src, char* dst, char* destination)
 {
@@ -372,6 +579,153 @@ error:
    return 1;
 }
 
+int
+pgmoneta_tar_backup(int server, struct backup* backup, char* dst, char* destination)
+{
+   char* from = NULL;
+   char* suffix = NULL;
+   char* file = NULL;
+   bool decode = false;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct tar_backup* tar = NULL;
+   struct archive* a = NULL;
+   FILE* out = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   from = pgmoneta_get_server_backup_identifier_data(server, backup->label);
+   decode = backup->compression != COMPRESSION_NONE || backup->encryption != ENCRYPTION_NONE;
+
+   tar = (struct tar_backup*)calloc(1, sizeof(struct tar_backup));
+   if (tar == NULL)
+   {
+      goto error;
+   }
+
+   pthread_mutex_init(&tar->lock, NULL);
+   pthread_cond_init(&tar->decoded, NULL);
+
+   if (tar_collect(tar, from, destination, decode))
+   {
+      goto error;
+   }
+
+   if (tar_collect_tablespaces(tar, backup, from, destination, decode))
+   {
+      goto error;
+   }
+
+   suffix = pgmoneta_streamer_suffix(config->compression_type, config->encryption);
+
+   file = pgmoneta_append(file, dst);
+   file = pgmoneta_append(file, suffix);
+
+   if (pgmoneta_exists(file))
+   {
+      pgmoneta_delete_file(file, NULL);
+   }
+
+   out = fopen(file, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("Could not create tar file %s", file);
+      goto error;
+   }
+
+   if (pgmoneta_streamer_create(config->compression_type, config->compression_level, config->encryption, out, &tar->streamer))
+   {
+      goto error;
+   }
+
+   a = archive_write_new();
+   archive_write_set_format_ustar(a);
+
+   if (archive_write_open(a, tar, NULL, tar_backup_write, NULL) != ARCHIVE_OK)
+   {
+      pgmoneta_log_error("Could not create tar file %s: %s", file, archive_error_string(a));
+      goto error;
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (tar_write_members(tar, a, workers, number_of_workers))
+   {
+      goto error;
+   }
+
+   if (archive_write_close(a) != ARCHIVE_OK)
+   {
+      pgmoneta_log_error("Could not finish tar file %s: %s", file, archive_error_string(a));
+      goto error;
+   }
+
+   archive_write_free(a);
+   a = NULL;
+
+   if (pgmoneta_streamer_finish(tar->streamer))
+   {
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   tar_backup_destroy(tar);
+
+   free(from);
+   free(suffix);
+   free(file);
+
+   return 0;
+
+error:
+
+   // the decoding that is still queued uses the members
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   if (a != NULL)
+   {
+      archive_write_free(a);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (file != NULL && pgmoneta_exists(file))
+   {
+      pgmoneta_delete_file(file, NULL);
+   }
+
+   tar_backup_destroy(tar);
+
+   free(from);
+   free(suffix);
+   free(file);
+
+   return 1;
+}
+
 static void
 write_tar_file(struct archive* a, char* src, char* dst)
 {
@@ -462,3 +816,1142 @@ write_tar_file(struct archive* a, char* src, char* dst)
 
    closedir(dir);
 }
+
+static int
+extract_entries(struct archive* a, char* destination, struct deque* hashes, struct page_checksums* checksums, struct tar_totals* totals)
+{
+   struct archive_entry* entry;
+   struct archive* disk = NULL;
+   EVP_MD_CTX* ctx = NULL;
+
+   if (hashes != NULL || checksums != NULL)
+   {
+      disk = archive_write_disk_new();
+      if (disk == NULL)
+      {
+         goto error;
+      }
+      archive_write_disk_set_options(disk, 0);
+   }
+
+   if (hashes != NULL)
+   {
+      ctx = EVP_MD_CTX_new();
+      if (ctx == NULL)
+      {
+         goto error;
+      }
+   }
+
+   while (archive_read_next_header(a, &entry) == ARCHIVE_OK)
+   {
+      char dst_file_path[MAX_PATH];
+      memset(dst_file_path, 0, sizeof(dst_file_path));
+      const char* entry_path = archive_entry_pathname(entry);
+      if (pgmoneta_ends_with(destination, "/"))
+      {
+         snprintf(dst_file_path, sizeof(dst_file_path), "%s%s", destination, entry_path);
+      }
+      else
+      {
+         snprintf(dst_file_path, sizeof(dst_file_path), "%s/%s", destination, entry_path);
+      }
+
+      archive_entry_set_pathname(entry, dst_file_path);
+
+      // regular files are hashed and verified on their way to disk so nobody has to read them back
+      if (disk != NULL && archive_entry_filetype(entry) == AE_IFREG && archive_entry_hardlink(entry) == NULL)
+      {
+         if (extract_entry_data(a, disk, ctx, entry, dst_file_path, hashes, checksums))
+         {
+            goto error;
+         }
+      }
+      else if (archive_read_extract(a, entry, 0) != ARCHIVE_OK)
+      {
+         pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(a));
+         goto error;
+      }
+
+      if (archive_entry_filetype(entry) == AE_IFREG && pgmoneta_durability_path(dst_file_path))
+      {
+         goto error;
+      }
+
+      extract_totals(totals, entry);
+   }
+
+   if (disk != NULL)
+   {
+      archive_write_close(disk);
+      archive_write_free(disk);
+   }
+   EVP_MD_CTX_free(ctx);
+
+   return 0;
+
+error:
+   if (disk != NULL)
+   {
+      archive_write_close(disk);
+      archive_write_free(disk);
+   }
+   EVP_MD_CTX_free(ctx);
+
+   return 1;
+}
+
+static int
+extract_members(struct archive* a, char* file_path, char* destination, struct workers* workers)
+{
+   struct archive_entry* entry;
+   char pending[MAX_PATH];
+   size_t pending_size = 0;
+   bool has_pending = false;
+   int status;
+
+   memset(pending, 0, sizeof(pending));
+
+   while ((status = archive_read_next_header(a, &entry)) == ARCHIVE_OK)
+   {
+      char dst_file_path[MAX_PATH];
+
+      // the data of the previous file ends where this header starts, so it can be handed out now
+      if (has_pending)
+      {
+         has_pending = false;
+         if (extract_queue(file_path, pending, pending_size, archive_read_header_position(a), workers))
+         {
+            goto error;
+         }
+      }
+
+      memset(dst_file_path, 0, sizeof(dst_file_path));
+      if (pgmoneta_ends_with(destination, "/"))
+      {
+         snprintf(dst_file_path, sizeof(dst_file_path), "%s%s", destination, archive_entry_pathname(entry));
+      }
+      else
+      {
+         snprintf(dst_file_path, sizeof(dst_file_path), "%s/%s", destination, archive_entry_pathname(entry));
+      }
+
+      archive_entry_set_pathname(entry, dst_file_path);
+
+      // the file is created here, so a hard link that follows it finds the inode
+      if (archive_entry_filetype(entry) == AE_IFREG && archive_entry_hardlink(entry) == NULL &&
+          archive_entry_sparse_count(entry) == 0 && archive_entry_size(entry) > 0)
+      {
+         if (extract_create(entry, dst_file_path))
+         {
+            goto error;
+         }
+
+         memcpy(pending, dst_file_path, sizeof(pending));
+         pending_size = (size_t)archive_entry_size(entry);
+         has_pending = true;
+      }
+      else
+      {
+         if (archive_read_extract(a, entry, 0) != ARCHIVE_OK)
+         {
+            pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(a));
+            goto error;
+         }
+
+         if (archive_entry_filetype(entry) == AE_IFREG && pgmoneta_durability_path(dst_file_path))
+         {
+            goto error;
+         }
+      }
+   }
+
+   if (status != ARCHIVE_EOF)
+   {
+      pgmoneta_log_error("Failed to read the tar file: %s", archive_error_string(a));
+      goto error;
+   }
+
+   // the last file ends at the end of archive marker
+   if (has_pending && extract_queue(file_path, pending, pending_size, archive_read_header_position(a), workers))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+extract_create(struct archive_entry* entry, char* path)
+{
+   char parent[MAX_PATH];
+   int fd;
+
+   fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, archive_entry_perm(entry));
+   if (fd == -1 && errno == ENOENT)
+   {
+      memset(parent, 0, sizeof(parent));
+      memcpy(parent, path, MIN(strlen(path), sizeof(parent) - 1));
+
+      if (pgmoneta_mkdir(dirname(parent)))
+      {
+         goto error;
+      }
+
+      fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, archive_entry_perm(entry));
+   }
+
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   // the ranges are written in any order into a file of the final size
+   if (ftruncate(fd, archive_entry_size(entry)))
+   {
+      close(fd);
+      goto error;
+   }
+
+   close(fd);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Failed to create %s: %s", path, strerror(errno));
+   errno = 0;
+
+   return 1;
+}
+
+static int
+extract_queue(char* file_path, char* path, size_t size, int64_t end, struct workers* workers)
+{
+   struct tar_extract* extract = NULL;
+   struct worker_input* wi = NULL;
+   size_t padded;
+
+   padded = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+
+   if (end < (int64_t)padded)
+   {
+      pgmoneta_log_error("Failed to find the data of %s", path);
+      return 1;
+   }
+
+   extract = (struct tar_extract*)malloc(sizeof(struct tar_extract));
+   if (extract == NULL)
+   {
+      return 1;
+   }
+
+   extract->data = (off_t)(end - (int64_t)padded);
+   extract->size = size;
+   extract->split.number_of_parts = (int)((size + TAR_SPLIT_SIZE - 1) / TAR_SPLIT_SIZE);
+   atomic_init(&extract->split.remaining, extract->split.number_of_parts);
+   atomic_init(&extract->split.failed, false);
+
+   for (int i = 0; i < extract->split.number_of_parts; i++)
+   {
+      if (pgmoneta_create_worker_input(NULL, file_path, path, 0, workers, &wi))
+      {
+         // the ranges that are not queued count as failed
+         atomic_store(&extract->split.failed, true);
+         if (atomic_fetch_sub(&extract->split.remaining, extract->split.number_of_parts - i) == extract->split.number_of_parts - i)
+         {
+            free(extract);
+         }
+         return 1;
+      }
+
+      wi->offset = (off_t)i * TAR_SPLIT_SIZE;
+      wi->length = MIN((size_t)TAR_SPLIT_SIZE, size - (size_t)wi->offset);
+      wi->split = &extract->split;
+      wi->argument = extract;
+
+      pgmoneta_workers_add(workers, do_extract_range, wi);
+   }
+
+   return 0;
+}
+
+static void
+do_extract_range(struct worker_input* wi)
+{
+   struct tar_extract* extract = (struct tar_extract*)wi->argument;
+   off_t in_offset = extract->data + wi->offset;
+   off_t out_offset = wi->offset;
+   size_t length = wi->length;
+   char* buffer = NULL;
+   int in = -1;
+   int out = -1;
+
+   in = open(wi->from, O_RDONLY);
+   out = open(wi->to, O_WRONLY);
+
+   if (in == -1 || out == -1)
+   {
+      goto error;
+   }
+
+#ifdef HAVE_LINUX
+   // the file system copies, or clones, the range without going through user space
+   while (length > 0)
+   {
+      loff_t i = in_offset;
+      loff_t o = out_offset;
+      ssize_t copied = copy_file_range(in, &i, out, &o, length, 0);
+
+      if (copied < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (copied <= 0)
+      {
+         errno = 0;
+         break;
+      }
+
+      in_offset += copied;
+      out_offset += copied;
+      length -= copied;
+   }
+#endif
+
+   if (length > 0)
+   {
+      buffer = pgmoneta_worker_buffer(WORKER_BUFFER_IN, TAR_BUFFER_SIZE);
+      if (buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   while (length > 0)
+   {
+      ssize_t r = pread(in, buffer, MIN(length, (size_t)TAR_BUFFER_SIZE), in_offset);
+
+      if (r <= 0)
+      {
+         goto error;
+      }
+
+      for (ssize_t w = 0; w < r;)
+      {
+         ssize_t n = pwrite(out, buffer + w, (size_t)(r - w), out_offset + w);
+
+         if (n < 0 && errno == EINTR)
+         {
+            continue;
+         }
+         if (n <= 0)
+         {
+            goto error;
+         }
+         w += n;
+      }
+
+      in_offset += r;
+      out_offset += r;
+      length -= (size_t)r;
+   }
+
+   close(in);
+   in = -1;
+
+   if (close(out))
+   {
+      out = -1;
+      goto error;
+   }
+   out = -1;
+
+   goto done;
+
+error:
+
+   pgmoneta_log_error("Failed to extract %s at %lld", wi->to, (long long)wi->offset);
+   atomic_store(&extract->split.failed, true);
+
+   if (in != -1)
+   {
+      close(in);
+   }
+   if (out != -1)
+   {
+      close(out);
+   }
+
+done:
+
+   // the last range to finish makes the file durable
+   if (atomic_fetch_sub(&extract->split.remaining, 1) == 1)
+   {
+      if (atomic_load(&extract->split.failed) || pgmoneta_durability_path(wi->to))
+      {
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      free(extract);
+   }
+
+   free(wi);
+}
+
+static void
+extract_totals(struct tar_totals* totals, struct archive_entry* entry)
+{
+   uint64_t size;
+   uint64_t disk;
+
+   if (totals == NULL)
+   {
+      return;
+   }
+
+   // the disk sizes are the ones of a walk of the directory, which rounds up to the blocks of the file system
+   if (archive_entry_filetype(entry) == AE_IFREG)
+   {
+      size = (uint64_t)archive_entry_size(entry);
+      disk = size;
+      if (totals->block_size > 0 && disk % totals->block_size != 0)
+      {
+         disk += totals->block_size - disk % totals->block_size;
+      }
+
+      totals->bytes += size;
+      totals->disk += disk;
+      totals->files++;
+      totals->biggest = MAX(totals->biggest, disk);
+   }
+   else if (archive_entry_filetype(entry) == AE_IFLNK)
+   {
+      totals->disk += totals->block_size;
+   }
+}
+
+static int
+extract_entry_data(struct archive* a, struct archive* disk, EVP_MD_CTX* ctx, struct archive_entry* entry, char* path, struct deque* hashes, struct page_checksums* checksums)
+{
+   static const unsigned char zero[8192] = {0};
+   const void* block = NULL;
+   size_t size = 0;
+   int64_t offset = 0;
+   int64_t position = 0;
+   unsigned char digest[SHA256_LENGTH];
+   unsigned int length = 0;
+   char* sha256 = NULL;
+   struct page_verify verify;
+   int status;
+
+   pgmoneta_page_verify_start(checksums, path, &verify);
+
+   if (archive_write_header(disk, entry) != ARCHIVE_OK)
+   {
+      pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(disk));
+      goto error;
+   }
+
+   if (hashes != NULL && !EVP_DigestInit_ex(ctx, EVP_sha256(), NULL))
+   {
+      goto error;
+   }
+
+   while ((status = archive_read_data_block(a, &block, &size, &offset)) == ARCHIVE_OK)
+   {
+      // holes of sparse entries read as zeros
+      while (position < offset)
+      {
+         size_t n = (size_t)MIN((int64_t)sizeof(zero), offset - position);
+
+         if (hashes != NULL)
+         {
+            EVP_DigestUpdate(ctx, zero, n);
+         }
+         pgmoneta_page_verify_update(&verify, zero, n);
+         position += n;
+      }
+
+      if (hashes != NULL && !EVP_DigestUpdate(ctx, block, size))
+      {
+         goto error;
+      }
+      pgmoneta_page_verify_update(&verify, block, size);
+      position += size;
+
+      if (archive_write_data_block(disk, block, size, offset) < 0)
+      {
+         pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(disk));
+         goto error;
+      }
+   }
+
+   if (status != ARCHIVE_EOF)
+   {
+      pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(a));
+      goto error;
+   }
+
+   while (position < archive_entry_size(entry))
+   {
+      size_t n = (size_t)MIN((int64_t)sizeof(zero), archive_entry_size(entry) - position);
+
+      if (hashes != NULL)
+      {
+         EVP_DigestUpdate(ctx, zero, n);
+      }
+      pgmoneta_page_verify_update(&verify, zero, n);
+      position += n;
+   }
+
+   pgmoneta_page_verify_finish(&verify);
+
+   if (archive_write_finish_entry(disk) != ARCHIVE_OK)
+   {
+      pgmoneta_log_error("Failed to extract entry: %s", archive_error_string(disk));
+      return 1;
+   }
+
+   if (hashes == NULL)
+   {
+      return 0;
+   }
+
+   if (!EVP_DigestFinal_ex(ctx, digest, &length))
+   {
+      return 1;
+   }
+
+   pgmoneta_sha256_hex(digest, &sha256);
+   if (sha256 != NULL)
+   {
+      pgmoneta_deque_add(hashes, path, (uintptr_t)sha256, ValueString);
+      free(sha256);
+   }
+
+   return 0;
+
+error:
+   pgmoneta_page_verify_finish(&verify);
+
+   return 1;
+}
+
+static void*
+tar_stream_extract(void* arg)
+{
+   const void* data = NULL;
+   struct archive* a = NULL;
+   struct tar_stream* stream = (struct tar_stream*)arg;
+
+   a = archive_read_new();
+   archive_read_support_format_tar(a);
+   // server side compression covers the whole archive
+   archive_read_support_filter_all(a);
+
+   if (archive_read_open(a, stream, NULL, tar_stream_read, NULL) != ARCHIVE_OK)
+   {
+      pgmoneta_log_error("Failed to open the tar stream for %s", stream->destination);
+      goto error;
+   }
+
+   if (extract_entries(a, stream->destination, stream->hashes, stream->checksums, stream->totals))
+   {
+      goto error;
+   }
+
+   // consume anything after the end of the archive
+   while (tar_stream_read(a, stream, &data) > 0)
+   {
+   }
+
+   archive_read_close(a);
+   archive_read_free(a);
+
+   return NULL;
+
+error:
+   pthread_mutex_lock(&stream->lock);
+   stream->failed = true;
+   pthread_cond_signal(&stream->writable);
+   pthread_mutex_unlock(&stream->lock);
+
+   archive_read_close(a);
+   archive_read_free(a);
+
+   return NULL;
+}
+
+static int
+tar_stream_next(struct tar_stream* stream)
+{
+   pthread_mutex_lock(&stream->lock);
+   stream->head = (stream->head + 1) % TAR_STREAM_BUFFERS;
+   stream->queued++;
+   pthread_cond_signal(&stream->readable);
+
+   // the next buffer is free once the extraction is done with it
+   while (!stream->failed && stream->queued == TAR_STREAM_BUFFERS)
+   {
+      pthread_cond_wait(&stream->writable, &stream->lock);
+   }
+   pthread_mutex_unlock(&stream->lock);
+
+   stream->sizes[stream->head] = 0;
+
+   return stream->failed ? 1 : 0;
+}
+
+static ssize_t
+tar_stream_read(struct archive* a, void* client_data, const void** buffer)
+{
+   ssize_t size = 0;
+   struct tar_stream* stream = (struct tar_stream*)client_data;
+
+   pthread_mutex_lock(&stream->lock);
+
+   // libarchive is done with the previous buffer once it asks for the next
+   if (stream->holding)
+   {
+      stream->tail = (stream->tail + 1) % TAR_STREAM_BUFFERS;
+      stream->queued--;
+      stream->holding = false;
+      pthread_cond_signal(&stream->writable);
+   }
+
+   while (stream->queued == 0 && !stream->done)
+   {
+      pthread_cond_wait(&stream->readable, &stream->lock);
+   }
+
+   if (stream->queued > 0)
+   {
+      *buffer = stream->buffers[stream->tail];
+      size = stream->sizes[stream->tail];
+      stream->holding = true;
+   }
+
+   pthread_mutex_unlock(&stream->lock);
+
+   return size;
+}
+
+static int
+tar_add(struct tar_backup* tar, unsigned int type, char* from, char* name, char* link, mode_t mode, size_t size, bool decode)
+{
+   struct tar_member* member = NULL;
+   struct tar_member** members = NULL;
+
+   if (strlen(from) >= MAX_PATH || strlen(name) >= MAX_PATH || (link != NULL && strlen(link) >= MAX_PATH))
+   {
+      pgmoneta_log_error("Path too long for the archive: %s", from);
+      goto error;
+   }
+
+   member = (struct tar_member*)calloc(1, sizeof(struct tar_member));
+   if (member == NULL)
+   {
+      goto error;
+   }
+
+   memcpy(member->from, from, strlen(from));
+   memcpy(member->name, name, strlen(name));
+   if (link != NULL)
+   {
+      memcpy(member->link, link, strlen(link));
+   }
+   member->type = type;
+   member->mode = mode;
+   member->size = size;
+   member->decode = decode;
+   member->tar = tar;
+
+   members = (struct tar_member**)realloc(tar->members, (tar->number_of_members + 1) * sizeof(struct tar_member*));
+   if (members == NULL)
+   {
+      goto error;
+   }
+
+   tar->members = members;
+   tar->members[tar->number_of_members] = member;
+   tar->number_of_members++;
+
+   return 0;
+
+error:
+
+   free(member);
+
+   return 1;
+}
+
+static int
+tar_collect(struct tar_backup* tar, char* from, char* name, bool decode)
+{
+   char* from_buffer = NULL;
+   char* name_buffer = NULL;
+   bool decode_file = false;
+   DIR* d = NULL;
+   struct dirent* entry;
+   struct stat s;
+
+   if (stat(from, &s) || tar_add(tar, AE_IFDIR, from, name, NULL, s.st_mode, 0, false))
+   {
+      goto error;
+   }
+
+   d = opendir(from);
+   if (d == NULL)
+   {
+      pgmoneta_log_error("Could not open directory: %s", from);
+      goto error;
+   }
+
+   while ((entry = readdir(d)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      from_buffer = pgmoneta_append(from_buffer, from);
+      if (!pgmoneta_ends_with(from_buffer, "/"))
+      {
+         from_buffer = pgmoneta_append(from_buffer, "/");
+      }
+      from_buffer = pgmoneta_append(from_buffer, entry->d_name);
+
+      name_buffer = pgmoneta_append(name_buffer, name);
+      name_buffer = pgmoneta_append(name_buffer, "/");
+      name_buffer = pgmoneta_append(name_buffer, entry->d_name);
+
+      if (lstat(from_buffer, &s))
+      {
+         goto error;
+      }
+
+      if (S_ISDIR(s.st_mode))
+      {
+         if (tar_collect(tar, from_buffer, name_buffer, decode))
+         {
+            goto error;
+         }
+      }
+      else if (S_ISREG(s.st_mode))
+      {
+         decode_file = decode && (pgmoneta_is_compressed_archive(from_buffer) || pgmoneta_is_encrypted_archive(from_buffer));
+
+         if (decode_file)
+         {
+            if (pgmoneta_ends_with(name_buffer, ".aes"))
+            {
+               name_buffer[strlen(name_buffer) - strlen(".aes")] = '\0';
+            }
+
+            if (pgmoneta_is_compressed_archive(name_buffer))
+            {
+               *strrchr(name_buffer, '.') = '\0';
+            }
+         }
+
+         if (tar_add(tar, AE_IFREG, from_buffer, name_buffer, NULL, s.st_mode, s.st_size, decode_file))
+         {
+            goto error;
+         }
+      }
+      /* Tablespace links are added with their tablespace */
+
+      free(from_buffer);
+      free(name_buffer);
+
+      from_buffer = NULL;
+      name_buffer = NULL;
+   }
+
+   closedir(d);
+
+   return 0;
+
+error:
+
+   if (d != NULL)
+   {
+      closedir(d);
+   }
+
+   free(from_buffer);
+   free(name_buffer);
+
+   return 1;
+}
+
+static int
+tar_collect_tablespaces(struct tar_backup* tar, struct backup* backup, char* from, char* destination, bool decode)
+{
+   char* from_tblspc = NULL;
+   char* link = NULL;
+   char* name = NULL;
+   char* target = NULL;
+   char* directory = NULL;
+   char path[MAX_PATH];
+   char tmp_tblspc_name[MISC_LENGTH];
+   char* tblspc_name = NULL;
+   bool found = false;
+   DIR* d = NULL;
+   struct dirent* entry;
+
+   if (backup->number_of_tablespaces == 0)
+   {
+      return 0;
+   }
+
+   from_tblspc = pgmoneta_append(from_tblspc, from);
+   if (!pgmoneta_ends_with(from_tblspc, "/"))
+   {
+      from_tblspc = pgmoneta_append(from_tblspc, "/");
+   }
+   from_tblspc = pgmoneta_append(from_tblspc, "pg_tblspc/");
+
+   d = opendir(from_tblspc);
+   if (d == NULL)
+   {
+      pgmoneta_log_error("Could not open the %s directory", from_tblspc);
+      goto error;
+   }
+
+   while ((entry = readdir(d)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      link = pgmoneta_append(link, from_tblspc);
+      link = pgmoneta_append(link, entry->d_name);
+
+      memset(&path[0], 0, sizeof(path));
+      if (readlink(link, &path[0], sizeof(path) - 1) == -1)
+      {
+         goto error;
+      }
+
+      if (pgmoneta_ends_with(&path[0], "/"))
+      {
+         memset(&tmp_tblspc_name[0], 0, sizeof(tmp_tblspc_name));
+         memcpy(&tmp_tblspc_name[0], &path[0], MIN(strlen(&path[0]) - 1, sizeof(tmp_tblspc_name) - 1));
+
+         tblspc_name = strrchr(&tmp_tblspc_name[0], '/') + 1;
+      }
+      else
+      {
+         tblspc_name = strrchr(&path[0], '/') + 1;
+      }
+
+      found = false;
+      for (uint64_t i = 0; !found && i < backup->number_of_tablespaces; i++)
+      {
+         found = !strcmp(tblspc_name, backup->tablespaces[i]);
+      }
+
+      if (found)
+      {
+         name = pgmoneta_append(name, destination);
+         name = pgmoneta_append(name, "/pg_tblspc/");
+         name = pgmoneta_append(name, entry->d_name);
+
+         // the same layout as a restore, next to the data directory
+         directory = pgmoneta_append(directory, destination);
+         directory = pgmoneta_append(directory, "-");
+         directory = pgmoneta_append(directory, tblspc_name);
+
+         target = pgmoneta_append(target, "../../");
+         target = pgmoneta_append(target, directory);
+         target = pgmoneta_append(target, "/");
+
+         if (tar_add(tar, AE_IFLNK, link, name, target, 0777, 0, false))
+         {
+            goto error;
+         }
+
+         if (tar_collect(tar, &path[0], directory, decode))
+         {
+            goto error;
+         }
+
+         free(name);
+         free(directory);
+         free(target);
+
+         name = NULL;
+         directory = NULL;
+         target = NULL;
+      }
+
+      free(link);
+      link = NULL;
+   }
+
+   closedir(d);
+
+   free(from_tblspc);
+
+   return 0;
+
+error:
+
+   if (d != NULL)
+   {
+      closedir(d);
+   }
+
+   free(from_tblspc);
+   free(link);
+   free(name);
+   free(directory);
+   free(target);
+
+   return 1;
+}
+
+static int
+tar_decode(struct tar_member* member)
+{
+   char* data = NULL;
+   size_t size = 0;
+   bool failed = false;
+   FILE* out = NULL;
+
+   out = open_memstream(&data, &size);
+   if (out == NULL || pgmoneta_destreamer_stream(member->from, out))
+   {
+      failed = true;
+   }
+
+   if (out != NULL && fclose(out) != 0)
+   {
+      failed = true;
+   }
+
+   pthread_mutex_lock(&member->tar->lock);
+   member->data = data;
+   member->size = size;
+   member->failed = failed;
+   member->ready = true;
+   pthread_cond_broadcast(&member->tar->decoded);
+   pthread_mutex_unlock(&member->tar->lock);
+
+   return failed ? 1 : 0;
+}
+
+static void
+do_tar_decode(struct worker_input* wi)
+{
+   tar_decode((struct tar_member*)wi->argument);
+
+   free(wi);
+}
+
+static void
+tar_queue(struct tar_member* member, struct workers* workers)
+{
+   struct worker_input* wi = NULL;
+
+   if (workers == NULL || pgmoneta_create_worker_input(NULL, member->from, NULL, 0, workers, &wi))
+   {
+      tar_decode(member);
+      return;
+   }
+
+   wi->argument = member;
+
+   pgmoneta_workers_add(workers, do_tar_decode, wi);
+}
+
+static int
+tar_write_members(struct tar_backup* tar, struct archive* a, struct workers* workers, int number_of_workers)
+{
+   int next = 0;
+   int in_flight = 0;
+   int window = 0;
+   struct tar_member* member = NULL;
+   struct archive_entry* entry = NULL;
+
+   window = MAX(1, number_of_workers * TAR_BACKUP_WINDOW);
+
+   for (int i = 0; i < tar->number_of_members; i++)
+   {
+      member = tar->members[i];
+
+      /* Keep the workers decoding the files that come next */
+      while (next < tar->number_of_members && (next <= i || (workers != NULL && in_flight < window)))
+      {
+         if (tar->members[next]->decode)
+         {
+            tar_queue(tar->members[next], workers);
+            in_flight++;
+         }
+         next++;
+      }
+
+      if (member->decode)
+      {
+         pthread_mutex_lock(&tar->lock);
+         while (!member->ready)
+         {
+            pthread_cond_wait(&tar->decoded, &tar->lock);
+         }
+         pthread_mutex_unlock(&tar->lock);
+
+         in_flight--;
+
+         if (member->failed)
+         {
+            pgmoneta_log_error("Could not decode %s", member->from);
+            goto error;
+         }
+      }
+
+      entry = archive_entry_new();
+      archive_entry_copy_pathname(entry, member->name);
+      archive_entry_set_filetype(entry, member->type);
+      archive_entry_set_perm(entry, member->mode);
+
+      if (member->type == AE_IFLNK)
+      {
+         archive_entry_set_symlink(entry, member->link);
+      }
+      else if (member->type == AE_IFREG)
+      {
+         archive_entry_set_size(entry, member->size);
+      }
+
+      if (archive_write_header(a, entry) != ARCHIVE_OK)
+      {
+         pgmoneta_log_error("Could not write header: %s", archive_error_string(a));
+         goto error;
+      }
+
+      if (member->type == AE_IFREG)
+      {
+         if (member->decode)
+         {
+            if (member->size > 0 && archive_write_data(a, member->data, member->size) < 0)
+            {
+               pgmoneta_log_error("Could not write %s: %s", member->name, archive_error_string(a));
+               goto error;
+            }
+
+            free(member->data);
+            member->data = NULL;
+         }
+         else if (tar_write_file(a, member))
+         {
+            goto error;
+         }
+      }
+
+      archive_entry_free(entry);
+      entry = NULL;
+   }
+
+   return 0;
+
+error:
+
+   if (entry != NULL)
+   {
+      archive_entry_free(entry);
+   }
+
+   return 1;
+}
+
+static int
+tar_write_file(struct archive* a, struct tar_member* member)
+{
+   size_t n = 0;
+   size_t total = 0;
+   unsigned char* buffer = NULL;
+   struct io_reader* in = NULL;
+
+   buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, IO_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_io_reader_open(member->from, 0, member->size, &in))
+   {
+      goto error;
+   }
+
+   while (total < member->size && (n = pgmoneta_io_reader_read(in, buffer, MIN(IO_BUFFER_SIZE, member->size - total))) > 0)
+   {
+      if (archive_write_data(a, buffer, n) < 0)
+      {
+         goto error;
+      }
+      total += n;
+   }
+
+   // the header already holds the size
+   if (pgmoneta_io_reader_error(in) || total != member->size)
+   {
+      goto error;
+   }
+
+   pgmoneta_io_reader_close(in);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Could not write %s: %s", member->name, archive_error_string(a));
+
+   pgmoneta_io_reader_close(in);
+
+   return 1;
+}
+
+static ssize_t
+tar_backup_write(struct archive* a, void* client_data, const void* buffer, size_t length)
+{
+   struct tar_backup* tar = (struct tar_backup*)client_data;
+
+   if (pgmoneta_streamer_write(tar->streamer, (void*)buffer, length))
+   {
+      return -1;
+   }
+
+   return length;
+}
+
+static void
+tar_backup_destroy(struct tar_backup* tar)
+{
+   if (tar == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < tar->number_of_members; i++)
+   {
+      free(tar->members[i]->data);
+      free(tar->members[i]);
+   }
+   free(tar->members);
+
+   pgmoneta_streamer_destroy(tar->streamer);
+
+   pthread_cond_destroy(&tar->decoded);
+   pthread_mutex_destroy(&tar->lock);
+
+   free(tar);
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pgmoneta.h>
+#include <arena.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static struct arena_chunk* arena_chunk_create(size_t size);
+static void* arena_take(struct arena* arena, size_t size);
+static void arena_give(struct arena* arena, void* ptr, size_t size);
+
+int
+pgmoneta_arena_create(size_t chunk_size, bool thread_safe, struct arena** arena)
+{
+   struct arena* a = NULL;
+
+   *arena = NULL;
+
+   a = (struct arena*)calloc(1, sizeof(struct arena));
+   if (a == NULL)
+   {
+      goto error;
+   }
+
+   a->chunk_size = chunk_size > 0 ? chunk_size : ARENA_DEFAULT_SIZE;
+   a->thread_safe = thread_safe;
+   if (thread_safe)
+   {
+      pthread_mutex_init(&a->lock, NULL);
+   }
+
+   *arena = a;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void*
+pgmoneta_arena_alloc(struct arena* arena, size_t size)
+{
+   void* p = NULL;
+
+   if (arena == NULL)
+   {
+      return NULL;
+   }
+
+   size = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+   if (size == 0)
+   {
+      size = ARENA_ALIGNMENT;
+   }
+
+   if (arena->thread_safe)
+   {
+      pthread_mutex_lock(&arena->lock);
+   }
+
+   p = arena_take(arena, size);
+
+   if (arena->thread_safe)
+   {
+      pthread_mutex_unlock(&arena->lock);
+   }
+
+   if (p != NULL)
+   {
+      memset(p, 0, size);
+   }
+
+   return p;
+}
+
+void
+pgmoneta_arena_free(struct arena* arena, void* ptr, size_t size)
+{
+   if (arena == NULL || ptr == NULL)
+   {
+      return;
+   }
+
+   size = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+   if (size == 0)
+   {
+      size = ARENA_ALIGNMENT;
+   }
+
+   // Larger blocks stay where they are until the arena is reset
+   if (size / ARENA_ALIGNMENT >= ARENA_FREE_LISTS)
+   {
+      return;
+   }
+
+   if (arena->thread_safe)
+   {
+      pthread_mutex_lock(&arena->lock);
+   }
+
+   arena_give(arena, ptr, size);
+
+   if (arena->thread_safe)
+   {
+      pthread_mutex_unlock(&arena->lock);
+   }
+}
+
+void
+pgmoneta_arena_reset(struct arena* arena)
+{
+   if (arena == NULL)
+   {
+      return;
+   }
+
+   if (arena->free_lists != NULL)
+   {
+      memset(arena->free_lists, 0, ARENA_FREE_LISTS * sizeof(void*));
+   }
+
+   for (struct arena_chunk* chunk = arena->chunks; chunk != NULL; chunk = chunk->next)
+   {
+      chunk->used = 0;
+   }
+
+   arena->current = arena->chunks;
+}
+
+void
+pgmoneta_arena_destroy(struct arena* arena)
+{
+   struct arena_chunk* chunk = NULL;
+   struct arena_chunk* next = NULL;
+
+   if (arena == NULL)
+   {
+      return;
+   }
+
+   chunk = arena->chunks;
+   while (chunk != NULL)
+   {
+      next = chunk->next;
+      free(chunk);
+      chunk = next;
+   }
+
+   if (arena->thread_safe)
+   {
+      pthread_mutex_destroy(&arena->lock);
+   }
+
+   free(arena->free_lists);
+   free(arena);
+}
+
+static struct arena_chunk*
+arena_chunk_create(size_t size)
+{
+   struct arena_chunk* chunk = NULL;
+   size_t length = sizeof(struct arena_chunk) + size;
+
+   // aligned_alloc needs a multiple of the alignment
+   length = (length + 63) & ~((size_t)63);
+
+   chunk = (struct arena_chunk*)aligned_alloc(64, length);
+   if (chunk == NULL)
+   {
+      return NULL;
+   }
+
+   chunk->next = NULL;
+   chunk->size = size;
+   chunk->used = 0;
+
+   return chunk;
+}
+
+static void*
+arena_take(struct arena* arena, size_t size)
+{
+   struct arena_chunk* chunk = NULL;
+   void* p = NULL;
+
+   if (arena->free_lists != NULL && size / ARENA_ALIGNMENT < ARENA_FREE_LISTS && arena->free_lists[size / ARENA_ALIGNMENT] != NULL)
+   {
+      p = arena->free_lists[size / ARENA_ALIGNMENT];
+      arena->free_lists[size / ARENA_ALIGNMENT] = *(void**)p;
+      return p;
+   }
+
+   // Chunks after the current one are either unused or left over from before a reset
+   while (arena->current != NULL && arena->current->size - arena->current->used < size)
+   {
+      if (arena->current->next == NULL)
+      {
+         break;
+      }
+      arena->current = arena->current->next;
+   }
+
+   if (arena->current == NULL || arena->current->size - arena->current->used < size)
+   {
+      chunk = arena_chunk_create(size > arena->chunk_size ? size : arena->chunk_size);
+      if (chunk == NULL)
+      {
+         return NULL;
+      }
+
+      if (arena->current == NULL)
+      {
+         arena->chunks = chunk;
+      }
+      else
+      {
+         arena->current->next = chunk;
+      }
+      arena->current = chunk;
+
+      if (arena->chunk_size < ARENA_DEFAULT_SIZE)
+      {
+         arena->chunk_size *= 2;
+      }
+   }
+
+   p = arena->current->data + arena->current->used;
+   arena->current->used += size;
+
+   return p;
+}
+
+static void
+arena_give(struct arena* arena, void* ptr, size_t size)
+{
+   if (arena->free_lists == NULL)
+   {
+      arena->free_lists = (void**)calloc(ARENA_FREE_LISTS, sizeof(void*));
+      if (arena->free_lists == NULL)
+      {
+         return;
+      }
+   }
+
+   *(void**)ptr = arena->free_lists[size / ARENA_ALIGNMENT];
+   arena->free_lists[size / ARENA_ALIGNMENT] = ptr;
+}
@@ -26,6 +26,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <arena.h>
 #include <art.h>
 #include <logging.h>
 #include <utils.h>
@@ -33,6 +34,11 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #define IS_LEAF(x) (((uintptr_t)(x) & 1))
 #define SET_LEAF(x) ((void*)((uintptr_t)(x) | 1))
@@ -59,6 +65,7 @@ struct art_node
    enum art_node_type type;                 /**< The node type */
    uint8_t num_children;                    /**< The number of children */
    unsigned char prefix[MAX_PREFIX_LEN];    /**< The (potentially partial) prefix, only record up to MAX_PREFIX_LEN characters */
+   uint64_t version;                        /**< The version lock, only used by concurrent trees */
 } __attribute__ ((aligned (64)));
 
 /**
@@ -66,11 +73,31 @@ struct art_node
  */
 struct art_leaf
 {
-   struct value* value;
+   struct value value;
    uint32_t key_len;
    unsigned char key[];
 } __attribute__ ((aligned (64)));
 
+// The first chunk of the arena of a tree, small since most trees only hold a few keys
+#define ART_ARENA_SIZE 1024
+
+/**
+ * A value replaced in a concurrent tree, readers may still hold its data
+ * so it is released when the tree is destroyed
+ */
+struct art_retired
+{
+   struct value value;
+   struct art_retired* next;
+};
+
+// The bits of a version lock, the rest counts the changes of the node
+#define VERSION_OBSOLETE 1
+#define VERSION_LOCKED   2
+
+// A leaf is rounded up like the nodes, so every allocation from the arena stays 64 byte aligned
+#define LEAF_SIZE(key_len) ((sizeof(struct art_leaf) + (key_len) + 63) & ~((size_t)63))
+
 /**
  * The ART node with only 4 children,
  * the key character and the children pointer are stored
@@ -134,24 +161,24 @@ static struct art_leaf*
 node_get_minimum(struct art_node* node);
 
 static void
-create_art_leaf(struct art_leaf** leaf, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config);
+create_art_leaf(struct arena* arena, struct art_leaf** leaf, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config);
 
 static void
-create_art_node(struct art_node** node, enum art_node_type type);
+create_art_node(struct arena* arena, struct art_node** node, enum art_node_type type);
 
 static void
-create_art_node4(struct art_node4** node);
+create_art_node4(struct arena* arena, struct art_node4** node);
 
 static void
-create_art_node16(struct art_node16** node);
+create_art_node16(struct arena* arena, struct art_node16** node);
 
 static void
-create_art_node48(struct art_node48** node);
+create_art_node48(struct arena* arena, struct art_node48** node);
 
 static void
-create_art_node256(struct art_node256** node);
+create_art_node256(struct arena* arena, struct art_node256** node);
 
-// Destroy ART nodes/leaves recursively
+// Release the values of the leaves recursively, the nodes go with the arena
 static void
 destroy_art_node(struct art_node* node);
 
@@ -216,10 +243,116 @@ find_index(unsigned char ch, const unsigned char* keys, int length);
  * @param type The value type
  * @param config The config
  * @param new If the key value is newly inserted (not replaced)
- * @return Old value if the key exists, otherwise NULL
+ */
+static void
+art_node_insert(struct arena* arena, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new);
+
+/**
+ * Expand a leaf into a Node4 holding it and a new leaf
+ * @param arena The arena
+ * @param node The leaf
+ * @param leaf The new leaf
+ * @param depth The depth into the leaf
+ * @return The new node
+ */
+static struct art_node*
+expand_leaf(struct arena* arena, struct art_node* node, struct art_leaf* leaf, uint32_t depth);
+
+/**
+ * Split a node whose prefix diverges from the key of a new leaf, the node
+ * moves below a new Node4 holding it and the new leaf
+ * @param arena The arena
+ * @param node The node
+ * @param leaf The new leaf
+ * @param depth The depth into the node
+ * @param diff_len Where the key diverges from the prefix
+ * @return The new node
+ */
+static struct art_node*
+split_node(struct arena* arena, struct art_node* node, struct art_leaf* leaf, uint32_t depth, uint32_t diff_len);
+
+/**
+ * Insert a value into a concurrent tree. Readers never lock, and a writer only locks the node
+ * it changes plus the parent when the node is replaced (optimistic lock coupling). Every node
+ * carries a version that is bumped on each change, so a thread that saw a node change midway
+ * starts over from the root. Nodes replaced by a bigger one are marked obsolete and stay in
+ * the arena until the tree is destroyed, so nobody ever follows a pointer into reused memory
+ * @param t The tree
+ * @param key The key
+ * @param key_len The length of the key
+ * @param value The value data
+ * @param type The value type
+ * @param config The config
+ * @param new If the key value is newly inserted (not replaced)
+ */
+static void
+art_concurrent_insert(struct art* t, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new);
+
+/**
+ * Search a concurrent tree without taking any lock
+ * @param t The tree
+ * @param key The key
+ * @param key_len The length of the key
+ * @return The value, or NULL if the key is not found
  */
 static struct value*
-art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new);
+art_concurrent_search(struct art* t, unsigned char* key, uint32_t key_len);
+
+/**
+ * Copy the keys of a concurrent tree into a new tree without taking any lock. Each node is
+ * read under its version and the copy starts over when a node changed, so inserts can go on.
+ * The copy shares the values, and releasing it leaves them alone
+ * @param t The tree
+ * @param snapshot [out] The copy
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+art_concurrent_snapshot(struct art* t, struct art** snapshot);
+
+/**
+ * Copy the leaves below a node of a concurrent tree
+ * @param node The node
+ * @param snapshot The copy
+ * @return 0 on success, 1 if a node changed while it was read
+ */
+static int
+art_concurrent_snapshot_node(struct art_node* node, struct art* snapshot);
+
+/**
+ * Add a child to a locked node that has room for it, so readers never see a torn child pointer
+ * @param node The node
+ * @param ch The key character
+ * @param child The child
+ */
+static void
+node_add_child_concurrent(struct art_node* node, unsigned char ch, void* child);
+
+/**
+ * Copy a full node into a bigger one, the old node is left as it is
+ * @param arena The arena
+ * @param node The node
+ * @return The new node
+ */
+static struct art_node*
+node_grow(struct arena* arena, struct art_node* node);
+
+static bool
+node_is_full(struct art_node* node);
+
+static bool
+version_read_lock(uint64_t* lock, uint64_t* version);
+
+static bool
+version_validate(uint64_t* lock, uint64_t version);
+
+static bool
+version_upgrade(uint64_t* lock, uint64_t version);
+
+static void
+version_unlock(uint64_t* lock);
+
+static void
+version_unlock_obsolete(uint64_t* lock);
 
 /**
  * Delete a value from a node recursively.
@@ -231,13 +364,13 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
  * @return Deleted value if the key exists, otherwise NULL
  */
 static struct art_leaf*
-art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len);
+art_node_delete(struct arena* arena, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len);
 
 static int
 art_node_iterate(struct art_node* node, art_callback cb, void* data);
 
 static void
-node_add_child(struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child);
+node_add_child(struct arena* arena, struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child);
 
 /**
  * Add a child to the node. The function assumes node is not NULL,
@@ -250,13 +383,13 @@ node_add_child(struct art_node* node, struct art_node** node_ref, unsigned char
  * @param child The child
  */
 static void
-node4_add_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child);
+node4_add_child(struct arena* arena, struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child);
 
 static void
-node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child);
+node16_add_child(struct arena* arena, struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child);
 
 static void
-node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child);
+node48_add_child(struct arena* arena, struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child);
 
 static void
 node256_add_child(struct art_node256* node, unsigned char ch, void* child);
@@ -265,19 +398,19 @@ node256_add_child(struct art_node256* node, unsigned char ch, void* child);
 // They also do not free the leaf node for bookkeeping purpose. The key insight is that due to path compression,
 // no node will have only one child, if node has only one child after deletion, it merges with this child
 static void
-node_remove_child(struct art_node* node, struct art_node** node_ref, unsigned char ch);
+node_remove_child(struct arena* arena, struct art_node* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch);
+node4_remove_child(struct arena* arena, struct art_node4* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node16_remove_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch);
+node16_remove_child(struct arena* arena, struct art_node16* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch);
+node48_remove_child(struct arena* arena, struct art_node48* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsigned char ch);
+node256_remove_child(struct arena* arena, struct art_node256* node, struct art_node** node_ref, unsigned char ch);
 
 static void
 copy_header(struct art_node* dest, struct art_node* src);
@@ -288,6 +421,20 @@ min(uint32_t a, uint32_t b);
 static struct value*
 art_search(struct art* t, unsigned char* key, uint32_t key_len);
 
+/**
+ * Build a subtree from a range of sorted keys
+ * @param keys The keys
+ * @param key_lens The lengths of the keys
+ * @param values The values
+ * @param type The value type
+ * @param start The first key of the range
+ * @param end The key after the range
+ * @param depth The depth into the keys
+ * @return The subtree
+ */
+static struct art_node*
+art_build_sorted(struct arena* arena, unsigned char** keys, uint32_t* key_lens, uintptr_t* values, enum value_type type, uint64_t start, uint64_t end, uint32_t depth);
+
 static int
 art_to_json_string_cb(void* param, const char* key, struct value* value);
 
@@ -306,15 +453,77 @@ to_compact_json_string(struct art* t, char* tag, int indent);
 static char*
 to_text_string(struct art* t, char* tag, int indent);
 
+static int
+art_create(bool concurrent, struct art** tree);
+
+static void
+art_retire(struct art* t, struct value* value);
+
 int
 pgmoneta_art_create(struct art** tree)
+{
+   return art_create(false, tree);
+}
+
+int
+pgmoneta_art_create_concurrent(struct art** tree)
+{
+   return art_create(true, tree);
+}
+
+int
+pgmoneta_art_create_sorted(char** keys, uintptr_t* values, enum value_type type, uint64_t number_of_keys, struct art** tree)
 {
    struct art* t = NULL;
-   t = malloc(sizeof(struct art));
-   t->size = 0;
-   t->root = NULL;
+   uint32_t* key_lens = NULL;
+
+   *tree = NULL;
+
+   for (uint64_t i = 1; i < number_of_keys; i++)
+   {
+      if (strcmp(keys[i - 1], keys[i]) >= 0)
+      {
+         pgmoneta_log_error("pgmoneta_art_create_sorted: %s is not after %s", keys[i], keys[i - 1]);
+         goto error;
+      }
+   }
+
+   if (number_of_keys > 0)
+   {
+      key_lens = malloc(number_of_keys * sizeof(uint32_t));
+      if (key_lens == NULL)
+      {
+         goto error;
+      }
+
+      for (uint64_t i = 0; i < number_of_keys; i++)
+      {
+         key_lens[i] = strlen(keys[i]) + 1;
+      }
+   }
+
+   if (pgmoneta_art_create(&t))
+   {
+      goto error;
+   }
+
+   if (number_of_keys > 0)
+   {
+      t->root = art_build_sorted(t->arena, (unsigned char**)keys, key_lens, values, type, 0, number_of_keys, 0);
+      t->size = number_of_keys;
+   }
+
+   free(key_lens);
+
    *tree = t;
+
    return 0;
+
+error:
+
+   free(key_lens);
+
+   return 1;
 }
 
 int
@@ -325,6 +534,11 @@ pgmoneta_art_destroy(struct art* tree)
       return 0;
    }
    destroy_art_node(tree->root);
+   for (struct art_retired* r = tree->retired; r != NULL; r = r->next)
+   {
+      pgmoneta_value_release(&r->value);
+   }
+   pgmoneta_arena_destroy(tree->arena);
    free(tree);
    return 0;
 }
@@ -394,7 +608,6 @@ pgmoneta_art_contains_key(struct art* t, char* key)
 int
 pgmoneta_art_insert(struct art* t, char* key, uintptr_t value, enum value_type type)
 {
-   struct value* old_val = NULL;
    bool new = false;
 
 #ifdef DEBUG
@@ -431,8 +644,16 @@ pgmoneta_art_insert(struct art* t, char* key, uintptr_t value, enum value_type t
       // c'mon, at least create a tree first...
       goto error;
    }
-   old_val = art_node_insert(t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, type, NULL, &new);
-   pgmoneta_value_destroy(old_val);
+   if (t->concurrent)
+   {
+      art_concurrent_insert(t, (unsigned char*)key, strlen(key) + 1, value, type, NULL, &new);
+      if (new)
+      {
+         __atomic_add_fetch(&t->size, 1, __ATOMIC_RELAXED);
+      }
+      return 0;
+   }
+   art_node_insert(t->arena, t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, type, NULL, &new);
    if (new)
    {
       t->size++;
@@ -445,14 +666,21 @@ error:
 int
 pgmoneta_art_insert_with_config(struct art* t, char* key, uintptr_t value, struct value_config* config)
 {
-   struct value* old_val = NULL;
    bool new = false;
    if (t == NULL || key == NULL)
    {
       goto error;
    }
-   old_val = art_node_insert(t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, ValueRef, config, &new);
-   pgmoneta_value_destroy(old_val);
+   if (t->concurrent)
+   {
+      art_concurrent_insert(t, (unsigned char*)key, strlen(key) + 1, value, ValueRef, config, &new);
+      if (new)
+      {
+         __atomic_add_fetch(&t->size, 1, __ATOMIC_RELAXED);
+      }
+      return 0;
+   }
+   art_node_insert(t->arena, t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, ValueRef, config, &new);
    if (new)
    {
       t->size++;
@@ -470,10 +698,14 @@ pgmoneta_art_delete(struct art* t, char* key)
    {
       return 1;
    }
-   l = art_node_delete(t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1);
+   l = art_node_delete(t->arena, t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1);
+   if (l == NULL)
+   {
+      return 0;
+   }
    t->size--;
-   pgmoneta_value_destroy(l->value);
-   free(l);
+   pgmoneta_value_release(&l->value);
+   pgmoneta_arena_free(t->arena, l, LEAF_SIZE(l->key_len));
    return 0;
 }
 
@@ -485,14 +717,45 @@ pgmoneta_art_clear(struct art* t)
       return 0;
    }
    destroy_art_node(t->root);
+   for (struct art_retired* r = t->retired; r != NULL; r = r->next)
+   {
+      pgmoneta_value_release(&r->value);
+   }
+   pgmoneta_arena_reset(t->arena);
+   t->retired = NULL;
    t->root = NULL;
    t->size = 0;
    return 0;
 }
 
+int
+pgmoneta_art_iterate(struct art* t, art_callback cb, void* data)
+{
+   if (t == NULL || cb == NULL)
+   {
+      return 0;
+   }
+   return art_iterate(t, cb, data);
+}
+
 char*
 pgmoneta_art_to_string(struct art* t, int32_t format, char* tag, int indent)
 {
+   char* str = NULL;
+   struct art* snapshot = NULL;
+
+   // the nodes of a concurrent tree may be inserted into while it is printed
+   if (t != NULL && t->concurrent)
+   {
+      if (art_concurrent_snapshot(t, &snapshot))
+      {
+         return NULL;
+      }
+      str = pgmoneta_art_to_string(snapshot, format, tag, indent);
+      pgmoneta_art_destroy(snapshot);
+      return str;
+   }
+
    if (format == FORMAT_JSON)
    {
       return to_json_string(t, tag, indent);
@@ -519,18 +782,17 @@ min(uint32_t a, uint32_t b)
 }
 
 static void
-create_art_leaf(struct art_leaf** leaf, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config)
+create_art_leaf(struct arena* arena, struct art_leaf** leaf, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config)
 {
    struct art_leaf* l = NULL;
-   l = malloc(sizeof(struct art_leaf) + key_len);
-   memset(l, 0, sizeof(struct art_leaf) + key_len);
+   l = pgmoneta_arena_alloc(arena, LEAF_SIZE(key_len));
    if (config != NULL)
    {
-      pgmoneta_value_create_with_config(value, config, &l->value);
+      pgmoneta_value_init_with_config(value, config, &l->value);
    }
    else
    {
-      pgmoneta_value_create(type, value, &l->value);
+      pgmoneta_value_init(type, value, &l->value);
    }
 
    l->key_len = key_len;
@@ -539,39 +801,35 @@ create_art_leaf(struct art_leaf** leaf, unsigned char* key, uint32_t key_len, ui
 }
 
 static void
-create_art_node(struct art_node** node, enum art_node_type type)
+create_art_node(struct arena* arena, struct art_node** node, enum art_node_type type)
 {
    struct art_node* n = NULL;
    switch (type)
    {
       case Node4:
       {
-         struct art_node4* n4 = malloc(sizeof(struct art_node4));
-         memset(n4, 0, sizeof(struct art_node4));
+         struct art_node4* n4 = pgmoneta_arena_alloc(arena, sizeof(struct art_node4));
          n4->node.type = Node4;
          n = (struct art_node*) n4;
          break;
       }
       case Node16:
       {
-         struct art_node16* n16 = malloc(sizeof(struct art_node16));
-         memset(n16, 0, sizeof(struct art_node16));
+         struct art_node16* n16 = pgmoneta_arena_alloc(arena, sizeof(struct art_node16));
          n16->node.type = Node16;
          n = (struct art_node*) n16;
          break;
       }
       case Node48:
       {
-         struct art_node48* n48 = malloc(sizeof(struct art_node48));
-         memset(n48, 0, sizeof(struct art_node48));
+         struct art_node48* n48 = pgmoneta_arena_alloc(arena, sizeof(struct art_node48));
          n48->node.type = Node48;
          n = (struct art_node*) n48;
          break;
       }
       case Node256:
       {
-         struct art_node256* n256 = malloc(sizeof(struct art_node256));
-         memset(n256, 0, sizeof(struct art_node256));
+         struct art_node256* n256 = pgmoneta_arena_alloc(arena, sizeof(struct art_node256));
          n256->node.type = Node256;
          n = (struct art_node*) n256;
          break;
@@ -581,34 +839,34 @@ create_art_node(struct art_node** node, enum art_node_type type)
 }
 
 static void
-create_art_node4(struct art_node4** node)
+create_art_node4(struct arena* arena, struct art_node4** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node4);
+   create_art_node(arena, &n, Node4);
    *node = (struct art_node4*)n;
 }
 
 static void
-create_art_node16(struct art_node16** node)
+create_art_node16(struct arena* arena, struct art_node16** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node16);
+   create_art_node(arena, &n, Node16);
    *node = (struct art_node16*)n;
 }
 
 static void
-create_art_node48(struct art_node48** node)
+create_art_node48(struct arena* arena, struct art_node48** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node48);
+   create_art_node(arena, &n, Node48);
    *node = (struct art_node48*)n;
 }
 
 static void
-create_art_node256(struct art_node256** node)
+create_art_node256(struct arena* arena, struct art_node256** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node256);
+   create_art_node(arena, &n, Node256);
    *node = (struct art_node256*)n;
 }
 
@@ -621,8 +879,7 @@ destroy_art_node(struct art_node* node)
    }
    if (IS_LEAF(node))
    {
-      pgmoneta_value_destroy(GET_LEAF(node)->value);
-      free(GET_LEAF(node));
+      pgmoneta_value_release(&GET_LEAF(node)->value);
       return;
    }
    switch (node->type)
@@ -674,7 +931,6 @@ destroy_art_node(struct art_node* node)
          break;
       }
    }
-   free(node);
 }
 
 static struct art_node**
@@ -695,12 +951,36 @@ node_get_child(struct art_node* node, unsigned char ch)
       case Node16:
       {
          struct art_node16* n = (struct art_node16*)node;
+#if defined(__SSE2__)
+         // compare all 16 key bytes at once, and ignore the slots past the children
+         __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)ch), _mm_loadu_si128((__m128i*)n->keys));
+         int mask = _mm_movemask_epi8(cmp) & ((1 << n->node.num_children) - 1);
+         if (mask == 0)
+         {
+            goto error;
+         }
+         return &n->children[__builtin_ctz(mask)];
+#elif defined(__ARM_NEON)
+         // narrow the comparison to four bits per key byte
+         uint8x16_t cmp = vceqq_u8(vdupq_n_u8(ch), vld1q_u8(n->keys));
+         uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+         if (n->node.num_children < 16)
+         {
+            mask &= (1ULL << (4 * n->node.num_children)) - 1;
+         }
+         if (mask == 0)
+         {
+            goto error;
+         }
+         return &n->children[__builtin_ctzll(mask) >> 2];
+#else
          int idx = find_index(ch, n->keys, n->node.num_children);
          if (idx == -1 || n->keys[idx] != ch)
          {
             goto error;
          }
          return &n->children[idx];
+#endif
       }
       case Node48:
       {
@@ -721,65 +1001,47 @@ error:
    return NULL;
 }
 
-static struct value*
-art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new)
+static void
+art_node_insert(struct arena* arena, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new)
 {
    struct art_leaf* leaf = NULL;
-   struct art_leaf* min_leaf = NULL;
-   uint32_t idx = 0;
    uint32_t diff_len = 0; // where the keys diverge
-   struct art_node* new_node = NULL;
    struct art_node** next = NULL;
-   unsigned char* leaf_key = NULL;
-   void* old_val = NULL;
+   struct value val;
    if (node == NULL)
    {
       // Lazy expansion, skip creating an inner node since it currently will have only this one leaf.
       // We will compare keys when reach leaf anyway, the path doesn't need to 100% match the key along the way
-      create_art_leaf(&leaf, key, key_len, value, type, config);
+      create_art_leaf(arena, &leaf, key, key_len, value, type, config);
       *node_ref = SET_LEAF(leaf);
       *new = true;
-      return NULL;
+      return;
    }
    // base case, reaching leaf, either replace or expand
    if (IS_LEAF(node))
    {
       // Lazy expansion, expand the leaf node to an inner node with 2 leaves
-      // If the key already exists, replace with new value and return old value
+      // If the key already exists, replace with new value and destroy the old value
       if (leaf_match(GET_LEAF(node), key, key_len))
       {
-         old_val = GET_LEAF(node)->value;
-         pgmoneta_value_create(type, value, &(GET_LEAF(node)->value));
-         return old_val;
-      }
-      // If the key does not match with existing key, old key and new key diverged some point after depth
-      // Even if we merely store a partial prefix for each node, it couldn't have diverged before depth.
-      // The reason is that when we find it diverged outside the partial prefix range,
-      // we compare with the existing key in the left most leaf and find an exact diverging point to split the node (see details below).
-      // This way we inductively guarantee that all children to a parent share the same prefix even if it's only partially stored
-      leaf_key = GET_LEAF(node)->key;
-      create_art_node(&new_node, Node4);
-      create_art_leaf(&leaf, key, key_len, value, type, config);
-      // Get the diverging index after point of depth
-      for (idx = depth; idx < min(key_len, GET_LEAF(node)->key_len); idx++)
-      {
-         if (key[idx] != leaf_key[idx])
+         // create the new value first, it may be made from the old one
+         if (config != NULL)
          {
-            break;
+            pgmoneta_value_init_with_config(value, config, &val);
          }
-         if (idx - depth < MAX_PREFIX_LEN)
+         else
          {
-            new_node->prefix[idx - depth] = key[idx];
+            pgmoneta_value_init(type, value, &val);
          }
+         pgmoneta_value_release(&GET_LEAF(node)->value);
+         GET_LEAF(node)->value = val;
+         return;
       }
-      new_node->prefix_len = idx - depth;
-      depth += new_node->prefix_len;
-      node_add_child(new_node, &new_node, key[depth], SET_LEAF(leaf));
-      node_add_child(new_node, &new_node, leaf_key[depth], (void*)node);
+      create_art_leaf(arena, &leaf, key, key_len, value, type, config);
       // replace with new node
-      *node_ref = new_node;
+      *node_ref = expand_leaf(arena, node, leaf, depth);
       *new = true;
-      return NULL;
+      return;
    }
 
    // There are several cases,
@@ -800,40 +1062,11 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
    if (diff_len < node->prefix_len)
    {
       // case 2, split the node
-      create_art_node(&new_node, Node4);
-      create_art_leaf(&leaf, key, key_len, value, type, config);
-      new_node->prefix_len = diff_len;
-      memcpy(new_node->prefix, node->prefix, min(MAX_PREFIX_LEN, diff_len));
-      // We need to know if new bytes that were once outside the partial prefix range will now come into the range
-      // If original key didn't fill up the partial prefix buffer in the first place,
-      // no new bytes will come into buffer when prefix shifts left
-      if (node->prefix_len <= MAX_PREFIX_LEN)
-      {
-         node->prefix_len = node->prefix_len - (diff_len + 1);
-         node_add_child(new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
-         node_add_child(new_node, &new_node, node->prefix[diff_len], node);
-         // Update node's prefix info since we move it downwards
-         // The first diverging character serves as the key byte in keys array,
-         // so we don't duplicate store it in the prefix.
-         // In other words, if prefix is the starting point,
-         // prefix + prefix_len - 1 is the last byte of the prefix,
-         // prefix + prefix_len is the indexing byte
-         // prefix + prefix_len + 1 is the starting point of the next prefix
-         memmove(node->prefix, node->prefix + diff_len + 1, node->prefix_len);
-      }
-      else
-      {
-         node->prefix_len = node->prefix_len - (diff_len + 1);
-         min_leaf = node_get_minimum(node);
-         node_add_child(new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
-         node_add_child(new_node, &new_node, min_leaf->key[depth + diff_len], node);
-         // node is moved downwards
-         memmove(node->prefix, min_leaf->key + depth + diff_len + 1, min(MAX_PREFIX_LEN, node->prefix_len));
-      }
+      create_art_leaf(arena, &leaf, key, key_len, value, type, config);
       // replace
-      *node_ref = new_node;
+      *node_ref = split_node(arena, node, leaf, depth, diff_len);
       *new = true;
-      return NULL;
+      return;
    }
    else
    {
@@ -847,21 +1080,94 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
          {
             node->num_children++;
          }
-         return art_node_insert(*next, next, depth + 1, key, key_len, value, type, config, new);
+         art_node_insert(arena, *next, next, depth + 1, key, key_len, value, type, config, new);
+         return;
       }
       else
       {
          // add a child to current node since the spot is available
-         create_art_leaf(&leaf, key, key_len, value, type, config);
-         node_add_child(node, node_ref, key[depth], SET_LEAF(leaf));
+         create_art_leaf(arena, &leaf, key, key_len, value, type, config);
+         node_add_child(arena, node, node_ref, key[depth], SET_LEAF(leaf));
          *new = true;
-         return NULL;
+         return;
+      }
+   }
+}
+
+static struct art_node*
+expand_leaf(struct arena* arena, struct art_node* node, struct art_leaf* leaf, uint32_t depth)
+{
+   struct art_node* new_node = NULL;
+   unsigned char* key = leaf->key;
+   unsigned char* leaf_key = GET_LEAF(node)->key;
+   uint32_t idx = 0;
+
+   // If the key does not match with existing key, old key and new key diverged some point after depth
+   // Even if we merely store a partial prefix for each node, it couldn't have diverged before depth.
+   // The reason is that when we find it diverged outside the partial prefix range,
+   // we compare with the existing key in the left most leaf and find an exact diverging point to split the node (see details below).
+   // This way we inductively guarantee that all children to a parent share the same prefix even if it's only partially stored
+   create_art_node(arena, &new_node, Node4);
+   // Get the diverging index after point of depth
+   for (idx = depth; idx < min(leaf->key_len, GET_LEAF(node)->key_len); idx++)
+   {
+      if (key[idx] != leaf_key[idx])
+      {
+         break;
+      }
+      if (idx - depth < MAX_PREFIX_LEN)
+      {
+         new_node->prefix[idx - depth] = key[idx];
       }
    }
+   new_node->prefix_len = idx - depth;
+   depth += new_node->prefix_len;
+   node_add_child(arena, new_node, &new_node, key[depth], SET_LEAF(leaf));
+   node_add_child(arena, new_node, &new_node, leaf_key[depth], (void*)node);
+   return new_node;
+}
+
+static struct art_node*
+split_node(struct arena* arena, struct art_node* node, struct art_leaf* leaf, uint32_t depth, uint32_t diff_len)
+{
+   struct art_node* new_node = NULL;
+   struct art_leaf* min_leaf = NULL;
+   unsigned char* key = leaf->key;
+
+   create_art_node(arena, &new_node, Node4);
+   new_node->prefix_len = diff_len;
+   memcpy(new_node->prefix, node->prefix, min(MAX_PREFIX_LEN, diff_len));
+   // We need to know if new bytes that were once outside the partial prefix range will now come into the range
+   // If original key didn't fill up the partial prefix buffer in the first place,
+   // no new bytes will come into buffer when prefix shifts left
+   if (node->prefix_len <= MAX_PREFIX_LEN)
+   {
+      node->prefix_len = node->prefix_len - (diff_len + 1);
+      node_add_child(arena, new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
+      node_add_child(arena, new_node, &new_node, node->prefix[diff_len], node);
+      // Update node's prefix info since we move it downwards
+      // The first diverging character serves as the key byte in keys array,
+      // so we don't duplicate store it in the prefix.
+      // In other words, if prefix is the starting point,
+      // prefix + prefix_len - 1 is the last byte of the prefix,
+      // prefix + prefix_len is the indexing byte
+      // prefix + prefix_len + 1 is the starting point of the next prefix
+      memmove(node->prefix, node->prefix + diff_len + 1, node->prefix_len);
+   }
+   else
+   {
+      node->prefix_len = node->prefix_len - (diff_len + 1);
+      min_leaf = node_get_minimum(node);
+      node_add_child(arena, new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
+      node_add_child(arena, new_node, &new_node, min_leaf->key[depth + diff_len], node);
+      // node is moved downwards
+      memmove(node->prefix, min_leaf->key + depth + diff_len + 1, min(MAX_PREFIX_LEN, node->prefix_len));
+   }
+   return new_node;
 }
 
 static struct art_leaf*
-art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len)
+art_node_delete(struct arena* arena, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len)
 {
    struct art_leaf* l = NULL;
    struct art_node** child = NULL;
@@ -904,7 +1210,7 @@ art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t dept
          if (leaf_match(GET_LEAF(*child), key, key_len))
          {
             l = GET_LEAF(*child);
-            node_remove_child(node, node_ref, key[depth]);
+            node_remove_child(arena, node, node_ref, key[depth]);
             return l;
          }
          else
@@ -914,7 +1220,7 @@ art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t dept
       }
       else
       {
-         return art_node_delete(*child, child, depth + 1, key, key_len);
+         return art_node_delete(arena, *child, child, depth + 1, key, key_len);
       }
    }
 }
@@ -933,7 +1239,7 @@ art_node_iterate(struct art_node* node, art_callback cb, void* data)
    if (IS_LEAF(node))
    {
       l = GET_LEAF(node);
-      return cb(data, (char*)l->key, l->value);
+      return cb(data, (char*)l->key, &l->value);
    }
    switch (node->type)
    {
@@ -1007,18 +1313,18 @@ art_node_iterate(struct art_node* node, art_callback cb, void* data)
 }
 
 static void
-node_add_child(struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child)
+node_add_child(struct arena* arena, struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    switch (node->type)
    {
       case Node4:
-         node4_add_child((struct art_node4*) node, node_ref, ch, child);
+         node4_add_child(arena, (struct art_node4*) node, node_ref, ch, child);
          break;
       case Node16:
-         node16_add_child((struct art_node16*) node, node_ref, ch, child);
+         node16_add_child(arena, (struct art_node16*) node, node_ref, ch, child);
          break;
       case Node48:
-         node48_add_child((struct art_node48*) node, node_ref, ch, child);
+         node48_add_child(arena, (struct art_node48*) node, node_ref, ch, child);
          break;
       case Node256:
          node256_add_child((struct art_node256*) node, ch, child);
@@ -1027,7 +1333,7 @@ node_add_child(struct art_node* node, struct art_node** node_ref, unsigned char
 }
 
 static void
-node4_add_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child)
+node4_add_child(struct arena* arena, struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    if (node->node.num_children < 4)
    {
@@ -1044,20 +1350,20 @@ node4_add_child(struct art_node4* node, struct art_node** node_ref, unsigned cha
    {
       // expand
       struct art_node16* new_node = NULL;
-      create_art_node16(&new_node);
+      create_art_node16(arena, &new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       memcpy(new_node->children, node->children, node->node.num_children * sizeof(void*));
       memcpy(new_node->keys, node->keys, node->node.num_children);
       // replace the node through node reference
       *node_ref = (struct art_node*)new_node;
-      free(node);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node4));
 
-      node16_add_child(new_node, node_ref, ch, child);
+      node16_add_child(arena, new_node, node_ref, ch, child);
    }
 }
 
 static void
-node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child)
+node16_add_child(struct arena* arena, struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    if (node->node.num_children < 16)
    {
@@ -1074,7 +1380,7 @@ node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned c
    {
       // expand
       struct art_node48* new_node = NULL;
-      create_art_node48(&new_node);
+      create_art_node48(arena, &new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       memcpy(new_node->children, node->children, node->node.num_children * sizeof(void*));
       for (int i = 0; i < node->node.num_children; i++)
@@ -1083,13 +1389,13 @@ node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned c
       }
       // replace the node through node reference
       *node_ref = (struct art_node*)new_node;
-      free(node);
-      node48_add_child(new_node, node_ref, ch, child);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node16));
+      node48_add_child(arena, new_node, node_ref, ch, child);
    }
 }
 
 static void
-node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child)
+node48_add_child(struct arena* arena, struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    if (node->node.num_children < 48)
    {
@@ -1107,7 +1413,7 @@ node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned c
    {
       // expand
       struct art_node256* new_node = NULL;
-      create_art_node256(&new_node);
+      create_art_node256(arena, &new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       for (int i = 0; i < 256; i++)
       {
@@ -1119,7 +1425,7 @@ node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned c
       }
       // replace the node through node reference
       *node_ref = (struct art_node*)new_node;
-      free(node);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node48));
       node256_add_child(new_node, ch, child);
    }
 }
@@ -1205,6 +1511,10 @@ check_prefix(struct art_node* node, unsigned char* key, uint32_t depth, uint32_t
    }
 
    leaf = node_get_minimum(node);
+   if (leaf == NULL || min(leaf->key_len, key_len) < depth)
+   {
+      return len;
+   }
    max_cmp = min(leaf->key_len, key_len) - depth;
    // continue comparing the real keys
    while (len < max_cmp && leaf->key[depth + len] == key[depth + len])
@@ -1251,18 +1561,18 @@ node_get_minimum(struct art_node* node)
          {
             struct art_node48* n = (struct art_node48*) node;
             int idx = 0;
-            while (n->keys[idx] == 0)
+            while (idx < 255 && n->keys[idx] == 0)
             {
                idx++;
             }
-            node = n->children[n->keys[idx] - 1];
+            node = n->keys[idx] != 0 ? n->children[n->keys[idx] - 1] : NULL;
             break;
          }
          case Node256:
          {
             struct art_node256* n = (struct art_node256*) node;
             int idx = 0;
-            while (n->children[idx] == NULL)
+            while (idx < 255 && n->children[idx] == NULL)
             {
                idx++;
             }
@@ -1279,27 +1589,27 @@ node_get_minimum(struct art_node* node)
 }
 
 static void
-node_remove_child(struct art_node* node, struct art_node** node_ref, unsigned char ch)
+node_remove_child(struct arena* arena, struct art_node* node, struct art_node** node_ref, unsigned char ch)
 {
    switch (node->type)
    {
       case Node4:
-         node4_remove_child((struct art_node4*)node, node_ref, ch);
+         node4_remove_child(arena, (struct art_node4*)node, node_ref, ch);
          break;
       case Node16:
-         node16_remove_child((struct art_node16*)node, node_ref, ch);
+         node16_remove_child(arena, (struct art_node16*)node, node_ref, ch);
          break;
       case Node48:
-         node48_remove_child((struct art_node48*)node, node_ref, ch);
+         node48_remove_child(arena, (struct art_node48*)node, node_ref, ch);
          break;
       case Node256:
-         node256_remove_child((struct art_node256*)node, node_ref, ch);
+         node256_remove_child(arena, (struct art_node256*)node, node_ref, ch);
          break;
    }
 }
 
 static void
-node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch)
+node4_remove_child(struct arena* arena, struct art_node4* node, struct art_node** node_ref, unsigned char ch)
 {
    int idx = 0;
    uint32_t len = 0;
@@ -1316,6 +1626,7 @@ node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned
       {
          // replace directly
          *node_ref = child;
+         pgmoneta_arena_free(arena, node, sizeof(struct art_node4));
          return;
       }
       // parent prefix bytes + byte index to child + child prefix bytes
@@ -1332,14 +1643,14 @@ node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned
       }
       child->prefix_len = node->node.prefix_len + 1 + child->prefix_len;
       memcpy(child->prefix, node->node.prefix, min(child->prefix_len, MAX_PREFIX_LEN));
-      free(node);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node4));
       // replace
       *node_ref = child;
    }
 }
 
 static void
-node16_remove_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch)
+node16_remove_child(struct arena* arena, struct art_node16* node, struct art_node** node_ref, unsigned char ch)
 {
    int idx = 0;
    struct art_node4* new_node = NULL;
@@ -1351,17 +1662,17 @@ node16_remove_child(struct art_node16* node, struct art_node** node_ref, unsigne
    // Trick from libart, do not downgrade immediately to avoid jumping on 4/5 boundary
    if (node->node.num_children <= 3)
    {
-      create_art_node4(&new_node);
+      create_art_node4(arena, &new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       memcpy(new_node->keys, node->keys, node->node.num_children);
       memcpy(new_node->children, node->children, node->node.num_children * sizeof(void*));
-      free(node);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node16));
       *node_ref = (struct art_node*)new_node;
    }
 }
 
 static void
-node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch)
+node48_remove_child(struct arena* arena, struct art_node48* node, struct art_node** node_ref, unsigned char ch)
 {
    int idx = node->keys[ch];
    int cnt = 0;
@@ -1372,7 +1683,7 @@ node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigne
 
    if (node->node.num_children <= 12)
    {
-      create_art_node16(&new_node);
+      create_art_node16(arena, &new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       for (int i = 0; i < 256; i++)
       {
@@ -1383,13 +1694,13 @@ node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigne
             cnt++;
          }
       }
-      free(node);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node48));
       *node_ref = (struct art_node*)new_node;
    }
 }
 
 static void
-node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsigned char ch)
+node256_remove_child(struct arena* arena, struct art_node256* node, struct art_node** node_ref, unsigned char ch)
 {
    int num = 0;
    for (int i = 0; i < 48; i++)
@@ -1410,7 +1721,7 @@ node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsig
 
    if (node->node.num_children <= 37)
    {
-      create_art_node48(&new_node);
+      create_art_node48(arena, &new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       for (int i = 0; i < 256; i++)
       {
@@ -1421,7 +1732,7 @@ node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsig
             cnt++;
          }
       }
-      free(node);
+      pgmoneta_arena_free(arena, node, sizeof(struct art_node256));
       *node_ref = (struct art_node*)new_node;
    }
 }
@@ -1469,7 +1780,7 @@ pgmoneta_art_iterator_next(struct art_iterator* iter)
       {
          iter->count++;
          iter->key = (char*)GET_LEAF(node)->key;
-         iter->value = GET_LEAF(node)->value;
+         iter->value = &GET_LEAF(node)->value;
          return true;
       }
       switch (node->type)
@@ -1581,7 +1892,15 @@ art_search(struct art* t, unsigned char* key, uint32_t key_len)
    struct art_node* node = NULL;
    struct art_node** child = NULL;
    uint32_t depth = 0;
-   if (t == NULL || t->root == NULL)
+   if (t == NULL)
+   {
+      return NULL;
+   }
+   if (t->concurrent)
+   {
+      return art_concurrent_search(t, key, key_len);
+   }
+   if (t->root == NULL)
    {
       return NULL;
    }
@@ -1594,14 +1913,10 @@ art_search(struct art* t, unsigned char* key, uint32_t key_len)
          {
             return NULL;
          }
-         return GET_LEAF(node)->value;
-      }
-      // optimistically check the prefix,
-      // we move forward as long as up to MAX_PREFIX_LEN characters match
-      if (check_prefix_partial(node, key, depth, key_len) != min(node->prefix_len, MAX_PREFIX_LEN))
-      {
-         return NULL;
+         return &GET_LEAF(node)->value;
       }
+      // optimistically skip the prefix, the leaf holds the full key and
+      // rejects a key that diverged inside a prefix
       depth += node->prefix_len;
       if (depth >= key_len)
       {
@@ -1616,6 +1931,641 @@ art_search(struct art* t, unsigned char* key, uint32_t key_len)
    return NULL;
 }
 
+static int
+art_create(bool concurrent, struct art** tree)
+{
+   struct art* t = NULL;
+   t = malloc(sizeof(struct art));
+   if (t == NULL)
+   {
+      goto error;
+   }
+   t->size = 0;
+   t->root = NULL;
+   t->concurrent = concurrent;
+   t->version = 0;
+   t->retired = NULL;
+   // concurrent writers allocate at the same time
+   if (pgmoneta_arena_create(ART_ARENA_SIZE, concurrent, &t->arena))
+   {
+      goto error;
+   }
+   *tree = t;
+   return 0;
+
+error:
+   free(t);
+   return 1;
+}
+
+static void
+art_retire(struct art* t, struct value* value)
+{
+   struct art_retired* r = NULL;
+   struct art_retired* head = NULL;
+
+   r = pgmoneta_arena_alloc(t->arena, sizeof(struct art_retired));
+   if (r == NULL)
+   {
+      return;
+   }
+   r->value = *value;
+
+   head = __atomic_load_n(&t->retired, __ATOMIC_RELAXED);
+   do
+   {
+      r->next = head;
+   }
+   while (!__atomic_compare_exchange_n(&t->retired, &head, r, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void
+art_concurrent_insert(struct art* t, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new)
+{
+   struct art_leaf* leaf = NULL;
+   struct art_node* node = NULL;
+   struct art_node* child = NULL;
+   struct art_node* new_node = NULL;
+   struct art_node** node_ref = NULL;
+   struct art_node** next = NULL;
+   uint64_t* parent_lock = NULL;
+   uint64_t parent_version = 0;
+   uint64_t version = 0;
+   uint32_t depth = 0;
+   uint32_t diff_len = 0;
+
+restart:
+   // the root pointer is guarded by the version of the tree as if the tree was its parent
+   parent_lock = &t->version;
+   if (!version_read_lock(parent_lock, &parent_version))
+   {
+      goto restart;
+   }
+   node_ref = &t->root;
+   depth = 0;
+
+   while (true)
+   {
+      node = __atomic_load_n(node_ref, __ATOMIC_ACQUIRE);
+
+      if (node == NULL)
+      {
+         // only the root of an empty tree
+         if (!version_upgrade(parent_lock, parent_version))
+         {
+            goto restart;
+         }
+         create_art_leaf(t->arena, &leaf, key, key_len, value, type, config);
+         __atomic_store_n(node_ref, SET_LEAF(leaf), __ATOMIC_RELEASE);
+         version_unlock(parent_lock);
+         *new = true;
+         return;
+      }
+
+      if (IS_LEAF(node))
+      {
+         // a leaf never changes, the slot holding it is guarded by the parent
+         if (!version_upgrade(parent_lock, parent_version))
+         {
+            goto restart;
+         }
+         create_art_leaf(t->arena, &leaf, key, key_len, value, type, config);
+         if (leaf_match(GET_LEAF(node), key, key_len))
+         {
+            // swap in a new leaf, readers may still be on the old one
+            art_retire(t, &GET_LEAF(node)->value);
+            __atomic_store_n(node_ref, SET_LEAF(leaf), __ATOMIC_RELEASE);
+         }
+         else
+         {
+            __atomic_store_n(node_ref, expand_leaf(t->arena, node, leaf, depth), __ATOMIC_RELEASE);
+            *new = true;
+         }
+         version_unlock(parent_lock);
+         return;
+      }
+
+      if (!version_read_lock(&node->version, &version))
+      {
+         goto restart;
+      }
+      // the node is still the child of the parent
+      if (!version_validate(parent_lock, parent_version))
+      {
+         goto restart;
+      }
+
+      diff_len = check_prefix(node, key, depth, key_len);
+      if (!version_validate(&node->version, version))
+      {
+         goto restart;
+      }
+
+      if (diff_len < node->prefix_len)
+      {
+         // the node moves below a new node, so both change
+         if (!version_upgrade(parent_lock, parent_version))
+         {
+            goto restart;
+         }
+         if (!version_upgrade(&node->version, version))
+         {
+            version_unlock(parent_lock);
+            goto restart;
+         }
+         create_art_leaf(t->arena, &leaf, key, key_len, value, type, config);
+         new_node = split_node(t->arena, node, leaf, depth, diff_len);
+         __atomic_store_n(node_ref, new_node, __ATOMIC_RELEASE);
+         version_unlock(&node->version);
+         version_unlock(parent_lock);
+         *new = true;
+         return;
+      }
+
+      depth += node->prefix_len;
+      if (depth >= key_len)
+      {
+         // only seen when the node changed under us
+         goto restart;
+      }
+      next = node_get_child(node, key[depth]);
+      child = next != NULL ? __atomic_load_n(next, __ATOMIC_ACQUIRE) : NULL;
+      if (!version_validate(&node->version, version))
+      {
+         goto restart;
+      }
+
+      if (child == NULL)
+      {
+         if (node_is_full(node))
+         {
+            // the node is replaced by a bigger copy, so both change
+            if (!version_upgrade(parent_lock, parent_version))
+            {
+               goto restart;
+            }
+            if (!version_upgrade(&node->version, version))
+            {
+               version_unlock(parent_lock);
+               goto restart;
+            }
+            create_art_leaf(t->arena, &leaf, key, key_len, value, type, config);
+            new_node = node_grow(t->arena, node);
+            node_add_child(t->arena, new_node, &new_node, key[depth], SET_LEAF(leaf));
+            __atomic_store_n(node_ref, new_node, __ATOMIC_RELEASE);
+            version_unlock_obsolete(&node->version);
+            version_unlock(parent_lock);
+         }
+         else
+         {
+            if (!version_upgrade(&node->version, version))
+            {
+               goto restart;
+            }
+            create_art_leaf(t->arena, &leaf, key, key_len, value, type, config);
+            node_add_child_concurrent(node, key[depth], SET_LEAF(leaf));
+            version_unlock(&node->version);
+         }
+         *new = true;
+         return;
+      }
+
+      parent_lock = &node->version;
+      parent_version = version;
+      node_ref = next;
+      depth++;
+   }
+}
+
+static struct value*
+art_concurrent_search(struct art* t, unsigned char* key, uint32_t key_len)
+{
+   struct art_node* node = NULL;
+   struct art_node* child = NULL;
+   struct art_node** next = NULL;
+   uint64_t version = 0;
+   uint32_t depth = 0;
+
+restart:
+   if (!version_read_lock(&t->version, &version))
+   {
+      goto restart;
+   }
+   node = __atomic_load_n(&t->root, __ATOMIC_ACQUIRE);
+   if (!version_validate(&t->version, version))
+   {
+      goto restart;
+   }
+   depth = 0;
+
+   while (node != NULL)
+   {
+      if (IS_LEAF(node))
+      {
+         // the leaf was reached through validated nodes and never changes
+         if (!leaf_match(GET_LEAF(node), key, key_len))
+         {
+            return NULL;
+         }
+         return &GET_LEAF(node)->value;
+      }
+      if (!version_read_lock(&node->version, &version))
+      {
+         goto restart;
+      }
+      depth += node->prefix_len;
+      if (depth >= key_len)
+      {
+         if (!version_validate(&node->version, version))
+         {
+            goto restart;
+         }
+         return NULL;
+      }
+      next = node_get_child(node, key[depth]);
+      child = next != NULL ? __atomic_load_n(next, __ATOMIC_ACQUIRE) : NULL;
+      if (!version_validate(&node->version, version))
+      {
+         goto restart;
+      }
+      node = child;
+      depth++;
+   }
+   return NULL;
+}
+
+static int
+art_concurrent_snapshot(struct art* t, struct art** snapshot)
+{
+   struct art* s = NULL;
+   struct art_node* root = NULL;
+   uint64_t version = 0;
+
+   *snapshot = NULL;
+
+   if (pgmoneta_art_create(&s))
+   {
+      goto error;
+   }
+
+restart:
+   pgmoneta_art_clear(s);
+   if (!version_read_lock(&t->version, &version))
+   {
+      goto restart;
+   }
+   root = __atomic_load_n(&t->root, __ATOMIC_ACQUIRE);
+   if (!version_validate(&t->version, version))
+   {
+      goto restart;
+   }
+   if (art_concurrent_snapshot_node(root, s))
+   {
+      goto restart;
+   }
+
+   *snapshot = s;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+art_concurrent_snapshot_node(struct art_node* node, struct art* snapshot)
+{
+   struct art_leaf* l = NULL;
+   struct value* copy = NULL;
+   struct art_node* children[256];
+   int number_of_children = 0;
+   int idx = 0;
+   uint64_t version = 0;
+   bool new = false;
+
+   if (node == NULL)
+   {
+      return 0;
+   }
+
+   if (IS_LEAF(node))
+   {
+      // a leaf never changes, so its value is shared as it is, without taking it over
+      l = GET_LEAF(node);
+      art_node_insert(snapshot->arena, snapshot->root, &snapshot->root, 0, l->key, l->key_len, 0, ValueRef, NULL, &new);
+      if (new)
+      {
+         snapshot->size++;
+      }
+      copy = art_search(snapshot, l->key, l->key_len);
+      copy->type = l->value.type;
+      copy->data = l->value.data;
+      copy->to_string = l->value.to_string;
+      return 0;
+   }
+
+   if (!version_read_lock(&node->version, &version))
+   {
+      return 1;
+   }
+
+   switch (node->type)
+   {
+      case Node4:
+      {
+         struct art_node4* n = (struct art_node4*)node;
+
+         for (int i = 0; i < MIN(__atomic_load_n(&node->num_children, __ATOMIC_ACQUIRE), 4); i++)
+         {
+            children[number_of_children++] = __atomic_load_n(&n->children[i], __ATOMIC_ACQUIRE);
+         }
+         break;
+      }
+      case Node16:
+      {
+         struct art_node16* n = (struct art_node16*)node;
+
+         for (int i = 0; i < MIN(__atomic_load_n(&node->num_children, __ATOMIC_ACQUIRE), 16); i++)
+         {
+            children[number_of_children++] = __atomic_load_n(&n->children[i], __ATOMIC_ACQUIRE);
+         }
+         break;
+      }
+      case Node48:
+      {
+         struct art_node48* n = (struct art_node48*)node;
+
+         for (int i = 0; i < 256; i++)
+         {
+            idx = n->keys[i];
+            if (idx != 0)
+            {
+               children[number_of_children++] = __atomic_load_n(&n->children[idx - 1], __ATOMIC_ACQUIRE);
+            }
+         }
+         break;
+      }
+      case Node256:
+      {
+         struct art_node256* n = (struct art_node256*)node;
+
+         for (int i = 0; i < 256; i++)
+         {
+            children[number_of_children] = __atomic_load_n(&n->children[i], __ATOMIC_ACQUIRE);
+            if (children[number_of_children] != NULL)
+            {
+               number_of_children++;
+            }
+         }
+         break;
+      }
+   }
+
+   // the children were read from a node nobody changed meanwhile
+   if (!version_validate(&node->version, version))
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < number_of_children; i++)
+   {
+      if (art_concurrent_snapshot_node(children[i], snapshot))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static void
+node_add_child_concurrent(struct art_node* node, unsigned char ch, void* child)
+{
+   unsigned char* keys = NULL;
+   struct art_node** children = NULL;
+   int idx = 0;
+   int n = node->num_children;
+
+   switch (node->type)
+   {
+      case Node4:
+      case Node16:
+      {
+         if (node->type == Node4)
+         {
+            keys = ((struct art_node4*)node)->keys;
+            children = ((struct art_node4*)node)->children;
+         }
+         else
+         {
+            keys = ((struct art_node16*)node)->keys;
+            children = ((struct art_node16*)node)->children;
+         }
+         idx = find_index(ch, keys, n) + 1;
+         // shift one slot at a time, readers may be looking at the children
+         for (int i = n; i > idx; i--)
+         {
+            keys[i] = keys[i - 1];
+            __atomic_store_n(&children[i], children[i - 1], __ATOMIC_RELAXED);
+         }
+         keys[idx] = ch;
+         __atomic_store_n(&children[idx], (struct art_node*)child, __ATOMIC_RELEASE);
+         break;
+      }
+      case Node48:
+      {
+         struct art_node48* n48 = (struct art_node48*)node;
+         int pos = 0;
+         while (n48->children[pos] != NULL)
+         {
+            pos++;
+         }
+         __atomic_store_n(&n48->children[pos], (struct art_node*)child, __ATOMIC_RELEASE);
+         n48->keys[ch] = pos + 1;
+         break;
+      }
+      case Node256:
+      {
+         struct art_node256* n256 = (struct art_node256*)node;
+         __atomic_store_n(&n256->children[ch], (struct art_node*)child, __ATOMIC_RELEASE);
+         break;
+      }
+   }
+   __atomic_store_n(&node->num_children, n + 1, __ATOMIC_RELEASE);
+}
+
+static struct art_node*
+node_grow(struct arena* arena, struct art_node* node)
+{
+   struct art_node* new_node = NULL;
+
+   switch (node->type)
+   {
+      case Node4:
+      {
+         struct art_node4* n = (struct art_node4*)node;
+         create_art_node(arena, &new_node, Node16);
+         copy_header(new_node, node);
+         memcpy(((struct art_node16*)new_node)->keys, n->keys, node->num_children);
+         memcpy(((struct art_node16*)new_node)->children, n->children, node->num_children * sizeof(void*));
+         break;
+      }
+      case Node16:
+      {
+         struct art_node16* n = (struct art_node16*)node;
+         create_art_node(arena, &new_node, Node48);
+         copy_header(new_node, node);
+         memcpy(((struct art_node48*)new_node)->children, n->children, node->num_children * sizeof(void*));
+         for (int i = 0; i < node->num_children; i++)
+         {
+            ((struct art_node48*)new_node)->keys[n->keys[i]] = i + 1;
+         }
+         break;
+      }
+      case Node48:
+      {
+         struct art_node48* n = (struct art_node48*)node;
+         create_art_node(arena, &new_node, Node256);
+         copy_header(new_node, node);
+         for (int i = 0; i < 256; i++)
+         {
+            if (n->keys[i] != 0)
+            {
+               ((struct art_node256*)new_node)->children[i] = n->children[n->keys[i] - 1];
+            }
+         }
+         break;
+      }
+      case Node256:
+         break;
+   }
+   return new_node;
+}
+
+static bool
+node_is_full(struct art_node* node)
+{
+   switch (node->type)
+   {
+      case Node4:
+         return node->num_children >= 4;
+      case Node16:
+         return node->num_children >= 16;
+      case Node48:
+         return node->num_children >= 48;
+      case Node256:
+         return false;
+   }
+   return false;
+}
+
+static bool
+version_read_lock(uint64_t* lock, uint64_t* version)
+{
+   uint64_t v = __atomic_load_n(lock, __ATOMIC_ACQUIRE);
+
+   if (v & (VERSION_LOCKED | VERSION_OBSOLETE))
+   {
+      return false;
+   }
+   *version = v;
+   return true;
+}
+
+static bool
+version_validate(uint64_t* lock, uint64_t version)
+{
+   // the reads of the node happen before the version is read again
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   return __atomic_load_n(lock, __ATOMIC_RELAXED) == version;
+}
+
+static bool
+version_upgrade(uint64_t* lock, uint64_t version)
+{
+   return __atomic_compare_exchange_n(lock, &version, version + VERSION_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void
+version_unlock(uint64_t* lock)
+{
+   // clears the lock bit and counts the change
+   __atomic_fetch_add(lock, VERSION_LOCKED, __ATOMIC_RELEASE);
+}
+
+static void
+version_unlock_obsolete(uint64_t* lock)
+{
+   __atomic_fetch_add(lock, VERSION_LOCKED + VERSION_OBSOLETE, __ATOMIC_RELEASE);
+}
+
+static struct art_node*
+art_build_sorted(struct arena* arena, unsigned char** keys, uint32_t* key_lens, uintptr_t* values, enum value_type type, uint64_t start, uint64_t end, uint32_t depth)
+{
+   struct art_leaf* leaf = NULL;
+   struct art_node* node = NULL;
+   uint32_t prefix_len = 0;
+   uint32_t max_len;
+   int number_of_children = 0;
+   uint64_t child_start;
+
+   if (end - start == 1)
+   {
+      create_art_leaf(arena, &leaf, keys[start], key_lens[start], values[start], type, NULL);
+      return (struct art_node*)SET_LEAF(leaf);
+   }
+
+   // the keys are sorted, so the prefix shared by the first and the last is shared by all
+   max_len = min(key_lens[start], key_lens[end - 1]);
+   while (depth + prefix_len < max_len && keys[start][depth + prefix_len] == keys[end - 1][depth + prefix_len])
+   {
+      prefix_len++;
+   }
+
+   for (uint64_t i = start; i < end; i++)
+   {
+      if (i == start || keys[i][depth + prefix_len] != keys[i - 1][depth + prefix_len])
+      {
+         number_of_children++;
+      }
+   }
+
+   if (number_of_children <= 4)
+   {
+      create_art_node(arena, &node, Node4);
+   }
+   else if (number_of_children <= 16)
+   {
+      create_art_node(arena, &node, Node16);
+   }
+   else if (number_of_children <= 48)
+   {
+      create_art_node(arena, &node, Node48);
+   }
+   else
+   {
+      create_art_node(arena, &node, Node256);
+   }
+
+   node->prefix_len = prefix_len;
+   memcpy(node->prefix, keys[start] + depth, min(prefix_len, MAX_PREFIX_LEN));
+
+   // the node is big enough, so adding the children in order never grows it
+   child_start = start;
+   for (uint64_t i = start + 1; i <= end; i++)
+   {
+      if (i == end || keys[i][depth + prefix_len] != keys[child_start][depth + prefix_len])
+      {
+         node_add_child(arena, node, &node, keys[child_start][depth + prefix_len],
+                               art_build_sorted(arena, keys, key_lens, values, type, child_start, i, depth + prefix_len + 1));
+         child_start = i;
+      }
+   }
+
+   return node;
+}
+
 static int
 art_to_json_string_cb(void* param, const char* key, struct value* value)
 {
@@ -36,8 +36,14 @@
 #include <management.h>
 #include <message.h>
 #include <network.h>
+#include <parallel.h>
+#include <prometheus.h>
+#include <storage.h>
+#include <throttle.h>
 #include <utils.h>
 #include <value.h>
+#include <volume.h>
+#include <walinventory.h>
 #include <workflow.h>
 
 /* system */
@@ -45,12 +51,68 @@
 #include <stdatomic.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <time.h>
 
+#define LIST_BACKUP_FIELD_KEEP               (1 << 0)
+#define LIST_BACKUP_FIELD_VALID              (1 << 1)
+#define LIST_BACKUP_FIELD_BACKUP_SIZE        (1 << 2)
+#define LIST_BACKUP_FIELD_RESTORE_SIZE       (1 << 3)
+#define LIST_BACKUP_FIELD_BIGGEST_FILE_SIZE  (1 << 4)
+#define LIST_BACKUP_FIELD_COMPRESSION        (1 << 5)
+#define LIST_BACKUP_FIELD_ENCRYPTION         (1 << 6)
+#define LIST_BACKUP_FIELD_COMMENTS           (1 << 7)
+#define LIST_BACKUP_FIELD_INCREMENTAL        (1 << 8)
+#define LIST_BACKUP_FIELD_INCREMENTAL_PARENT (1 << 9)
+#define LIST_BACKUP_FIELD_WAL                (1 << 10)
+#define LIST_BACKUP_FIELD_DELTA              (1 << 11)
+#define LIST_BACKUP_FIELD_ALL                ((1 << 12) - 1)
+
+#define LIST_BACKUP_FILTER_VALID       (1 << 0)
+#define LIST_BACKUP_FILTER_INVALID     (1 << 1)
+#define LIST_BACKUP_FILTER_KEEP        (1 << 2)
+#define LIST_BACKUP_FILTER_FULL        (1 << 3)
+#define LIST_BACKUP_FILTER_INCREMENTAL (1 << 4)
+
+static char* list_backup_fields[] = {
+   MANAGEMENT_ARGUMENT_KEEP,
+   MANAGEMENT_ARGUMENT_VALID,
+   MANAGEMENT_ARGUMENT_BACKUP_SIZE,
+   MANAGEMENT_ARGUMENT_RESTORE_SIZE,
+   MANAGEMENT_ARGUMENT_BIGGEST_FILE_SIZE,
+   MANAGEMENT_ARGUMENT_COMPRESSION,
+   MANAGEMENT_ARGUMENT_ENCRYPTION,
+   MANAGEMENT_ARGUMENT_COMMENTS,
+   MANAGEMENT_ARGUMENT_INCREMENTAL,
+   MANAGEMENT_ARGUMENT_INCREMENTAL_PARENT,
+   MANAGEMENT_ARGUMENT_WAL,
+   MANAGEMENT_ARGUMENT_DELTA
+};
+
+static char* list_backup_filters[] = {
+   "valid",
+   "invalid",
+   "keep",
+   "full",
+   "incremental"
+};
+
+static int list_backup_projection(char* fields, uint32_t* projection);
+static int list_backup_filter(char* filter, uint32_t* conditions);
+static bool list_backup_matches(struct backup* backup, uint32_t conditions);
+static int list_backup_start(int number_of_backups, struct backup** backups, char* cursor, bool descending);
+static int list_backup_put(int server, struct backup** backups, int index, uint32_t projection,
+                           int number_of_wal_files, char** wal_files, struct json** result);
+
 void
 pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
 {
    bool active = false;
+   bool started = false;
+   bool durable = false;
+   bool resume = false;
+   pid_t throttle = 0;
    char date_str[128];
    char* date = NULL;
    char* elapsed = NULL;
@@ -74,6 +136,7 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
    struct art* nodes = NULL;
    struct backup* backup = NULL;
    struct backup* child = NULL;
+   struct info_batch* info = NULL;
    struct json* req = NULL;
    struct json* response = NULL;
    struct configuration* config;
@@ -82,6 +145,8 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
 
    config = (struct configuration*)shmem;
 
+   pgmoneta_durability(config->backup_durability);
+
    if (!config->servers[server].valid)
    {
       pgmoneta_log_error("Backup: Server %s is not in a valid configuration", config->servers[server].name);
@@ -98,13 +163,16 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
       goto error;
    }
 
-   if (!atomic_compare_exchange_strong(&config->servers[server].backup, &active, true))
+   if (!atomic_compare_exchange_strong(&config->states[server].backup, &active, true))
    {
       pgmoneta_log_info("Backup: Active backup for server %s", config->servers[server].name);
       pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_BACKUP_ACTIVE, compression, encryption, payload);
 
       goto done;
    }
+   started = true;
+
+   throttle = pgmoneta_throttle_start(server);
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
 
@@ -116,12 +184,21 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
 
    strftime(&date_str[0], sizeof(date_str), "%Y%m%d%H%M%S", time_info);
 
-   date = pgmoneta_append(date, &date_str[0]);
+   // a full backup over several connections continues where a failed one stopped
+   if (incremental == NULL && config->backup_connections > 1 && !pgmoneta_parallel_resume_label(server, &date) && date != NULL)
+   {
+      resume = true;
+      pgmoneta_log_info("Backup: Resuming %s/%s", config->servers[server].name, date);
+   }
+   else
+   {
+      date = pgmoneta_append(date, &date_str[0]);
+   }
 
    server_backup = pgmoneta_get_server_backup(server);
    root = pgmoneta_get_server_backup_identifier(server, date);
 
-   if (pgmoneta_art_create(&nodes))
+   if (pgmoneta_art_create_concurrent(&nodes))
    {
       goto error;
    }
@@ -144,9 +221,9 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
    if (incremental != NULL)
    {
       backup_incremental = false;
-      if (config->servers[server].version < 17)
+      if (config->servers[server].version < 17 && !config->wal_index)
       {
-         pgmoneta_log_error("Incremental backup not supported for server %s at version %d",
+         pgmoneta_log_error("Incremental backup not supported for server %s at version %d without wal_index",
                             config->servers[server].name, config->servers[server].version);
          goto error;
       }
@@ -221,7 +298,12 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
       workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_BACKUP, server, NULL);
    }
 
-   pgmoneta_mkdir(root);
+   if (!resume && pgmoneta_volume_create(server, date))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_BACKUP_SETUP, compression, encryption, payload);
+      pgmoneta_log_error("Backup: Could not create %s", root);
+      goto error;
+   }
 
    d = pgmoneta_get_server_backup_identifier_data(server, date);
 
@@ -237,16 +319,11 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
       current = current->next;
    }
 
-   current = workflow;
-   while (current != NULL)
+   if (pgmoneta_workflow_run(workflow, nodes))
    {
-      if (current->execute(current->name(), nodes))
-      {
-         pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_BACKUP_EXECUTE, compression, encryption, payload);
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_BACKUP_EXECUTE, compression, encryption, payload);
 
-         goto error;
-      }
-      current = current->next;
+      goto error;
    }
 
    current = workflow;
@@ -261,8 +338,19 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
       current = current->next;
    }
 
+   durable = pgmoneta_sync_filesystem(root) == 0;
+
    size = pgmoneta_directory_size(d);
-   pgmoneta_update_info_unsigned_long(root, INFO_BACKUP, size);
+
+   if (!pgmoneta_info_begin(root, &info))
+   {
+      // written after the sync, so the backup is known to be on disk
+      pgmoneta_info_set_bool(info, INFO_DURABLE, durable);
+      pgmoneta_info_set_unsigned_long(info, INFO_BACKUP, size);
+      pgmoneta_workflow_store_metrics(workflow, info);
+      pgmoneta_info_commit(info);
+      info = NULL;
+   }
 
    if (pgmoneta_management_create_response(payload, server, &response))
    {
@@ -295,6 +383,9 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
 
    pgmoneta_update_info_double(root, INFO_ELAPSED, total_seconds);
 
+   pgmoneta_prometheus_backup_elapsed(server, total_seconds);
+   pgmoneta_prometheus_backup_added(server, size);
+
    if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
    {
       pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_BACKUP_NETWORK, compression, encryption, payload);
@@ -305,7 +396,8 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
 
    pgmoneta_log_info("Backup: %s/%s (Elapsed: %s)", config->servers[server].name, date, elapsed);
 
-   atomic_store(&config->servers[server].backup, false);
+   pgmoneta_throttle_stop(server, throttle);
+   atomic_store(&config->states[server].backup, false);
 
 done:
 
@@ -339,7 +431,19 @@ error:
 
    if (pgmoneta_exists(root))
    {
-      pgmoneta_delete_directory(root);
+      if (pgmoneta_parallel_resumable(root))
+      {
+         pgmoneta_log_info("Backup: Keeping %s to resume", root);
+      }
+      else
+      {
+         pgmoneta_delete_directory(root);
+      }
+   }
+   if (started)
+   {
+      pgmoneta_throttle_stop(server, throttle);
+      atomic_store(&config->states[server].backup, false);
    }
    for (int i = 0; i < number_of_backups; i++)
    {
@@ -369,40 +473,65 @@ error:
    exit(1);
 }
 
-void
+int
 pgmoneta_list_backup(int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
 {
    char* d = NULL;
-   char* wal_dir = NULL;
    char* elapsed = NULL;
+   char* sort = NULL;
+   char* cursor = NULL;
+   char* limit_value = NULL;
+   char* last = NULL;
+   char* next = NULL;
    struct timespec start_t;
    struct timespec end_t;
    double total_seconds;
+   bool descending = false;
+   uint32_t projection = LIST_BACKUP_FIELD_ALL;
+   uint32_t filter = 0;
+   int limit = 0;
+   int count = 0;
+   int i;
    int32_t number_of_backups = 0;
    struct backup** backups = NULL;
-   uint64_t wal = 0;
-   uint64_t delta = 0;
+   int number_of_wal_files = 0;
+   char** wal_files = NULL;
+   struct json* req = NULL;
    struct json* response = NULL;
-   struct deque* jl = NULL;
    struct json* j = NULL;
    struct json* bcks = NULL;
-   struct deque_iterator* diter = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
 
-   if (pgmoneta_deque_create(false, &jl))
+   req = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
+   sort = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_SORT);
+   cursor = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_CURSOR);
+   limit_value = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_LIMIT);
+
+   if (limit_value != NULL && atoi(limit_value) > 0)
    {
-      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_LIST_BACKUP_DEQUE_CREATE, compression, encryption, payload);
-      pgmoneta_log_error("List backup: Error creating the deque for %s", config->servers[server].name);
+      limit = atoi(limit_value);
+   }
+
+   if (sort != NULL && !strcasecmp(sort, "desc"))
+   {
+      descending = true;
+   }
+
+   if ((sort != NULL && strcasecmp(sort, "asc") && strcasecmp(sort, "desc")) ||
+       list_backup_projection((char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_FIELDS), &projection) ||
+       list_backup_filter((char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_FILTER), &filter))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_LIST_BACKUP_ARGUMENTS, compression, encryption, payload);
+      pgmoneta_log_warn("List backup: Invalid arguments for %s", config->servers[server].name);
 
       goto error;
    }
 
    d = pgmoneta_get_server_backup(server);
-   wal_dir = pgmoneta_get_server_wal(server);
 
    if (pgmoneta_get_backups(d, &number_of_backups, &backups))
    {
@@ -412,110 +541,53 @@ pgmoneta_list_backup(int client_fd, int server, uint8_t compression, uint8_t enc
       goto error;
    }
 
-   for (int i = 0; i < number_of_backups; i++)
+   // the WAL of the backups is the only part that isn't in the catalog
+   if (projection & (LIST_BACKUP_FIELD_WAL | LIST_BACKUP_FIELD_DELTA))
    {
-      if (backups[i] != NULL)
-      {
-         if (pgmoneta_json_create(&j))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)backups[i]->label, ValueString))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_KEEP, (uintptr_t)backups[i]->keep, ValueBool))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_VALID, (uintptr_t)backups[i]->valid, ValueInt8))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BACKUP_SIZE, (uintptr_t)backups[i]->backup_size, ValueUInt64))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_RESTORE_SIZE, (uintptr_t)backups[i]->restore_size, ValueUInt64))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BIGGEST_FILE_SIZE, (uintptr_t)backups[i]->biggest_file_size, ValueUInt64))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)backups[i]->compression, ValueInt32))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_ENCRYPTION, (uintptr_t)backups[i]->encryption, ValueInt32))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_COMMENTS, (uintptr_t)backups[i]->comments, ValueString))
-         {
-            goto json_error;
-         }
-
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_INCREMENTAL, (uintptr_t)backups[i]->type, ValueBool))
-         {
-            goto json_error;
-         }
+      pgmoneta_walinventory_segments(server, &number_of_wal_files, &wal_files);
+   }
 
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_INCREMENTAL_PARENT, (uintptr_t)backups[i]->parent_label, ValueString))
-         {
-            goto json_error;
-         }
+   if (pgmoneta_management_create_response(payload, server, &response))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
 
-         wal = pgmoneta_number_of_wal_files(wal_dir, &backups[i]->wal[0], NULL);
-         wal *= config->servers[server].wal_size;
+      goto error;
+   }
 
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_WAL, (uintptr_t)wal, ValueUInt64))
-         {
-            goto json_error;
-         }
+   if (pgmoneta_json_create(&bcks))
+   {
+      goto json_error;
+   }
 
-         delta = 0;
+   i = list_backup_start(number_of_backups, backups, cursor, descending);
 
-         if (i > 0)
+   while (i >= 0 && i < number_of_backups)
+   {
+      if (list_backup_matches(backups[i], filter))
+      {
+         if (limit > 0 && count == limit)
          {
-            delta = pgmoneta_number_of_wal_files(wal_dir, &backups[i - 1]->wal[0], &backups[i]->wal[0]);
-            delta *= config->servers[server].wal_size;
+            // there is more after this page, so the last label of the page continues it
+            next = last;
+            break;
          }
 
-         if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_WAL, (uintptr_t)delta, ValueUInt64))
+         if (list_backup_put(server, backups, i, projection, number_of_wal_files, wal_files, &j))
          {
             goto json_error;
          }
 
-         if (pgmoneta_deque_add(jl, NULL, (uintptr_t)j, ValueJSON))
+         if (pgmoneta_json_append(bcks, (uintptr_t)j, ValueJSON))
          {
             goto json_error;
          }
 
          j = NULL;
+         last = backups[i]->label;
+         count++;
       }
-   }
 
-   if (pgmoneta_management_create_response(payload, server, &response))
-   {
-      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
-
-      goto error;
+      i += descending ? -1 : 1;
    }
 
    if (pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_NUMBER_OF_BACKUPS, (uintptr_t)number_of_backups, ValueUInt32))
@@ -523,24 +595,15 @@ pgmoneta_list_backup(int client_fd, int server, uint8_t compression, uint8_t enc
       goto json_error;
    }
 
-   if (pgmoneta_json_create(&bcks))
-   {
-      goto error;
-   }
-
-   if (pgmoneta_deque_iterator_create(jl, &diter))
-   {
-      goto error;
-   }
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUPS, (uintptr_t)bcks, ValueJSON);
+   bcks = NULL;
 
-   while (pgmoneta_deque_iterator_next(diter))
+   if (next != NULL)
    {
-      pgmoneta_json_append(bcks, (uintptr_t)pgmoneta_value_data(diter->value), ValueJSON);
+      pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_NEXT_CURSOR, (uintptr_t)next, ValueString);
    }
 
-   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
-   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUPS, (uintptr_t)bcks, ValueJSON);
-
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
 
    if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
@@ -556,21 +619,22 @@ pgmoneta_list_backup(int client_fd, int server, uint8_t compression, uint8_t enc
 
    pgmoneta_json_destroy(payload);
 
-   for (int i = 0; i < number_of_backups; i++)
+   for (i = 0; i < number_of_backups; i++)
    {
       free(backups[i]);
    }
    free(backups);
 
+   for (i = 0; i < number_of_wal_files; i++)
+   {
+      free(wal_files[i]);
+   }
+   free(wal_files);
+
    free(d);
-   free(wal_dir);
    free(elapsed);
 
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_stop_logging();
-
-   exit(0);
+   return 0;
 
 json_error:
 
@@ -581,21 +645,25 @@ error:
 
    pgmoneta_json_destroy(payload);
 
-   for (int i = 0; i < number_of_backups; i++)
+   for (i = 0; i < number_of_backups; i++)
    {
       free(backups[i]);
    }
    free(backups);
 
-   free(d);
-   free(wal_dir);
-   free(elapsed);
+   for (i = 0; i < number_of_wal_files; i++)
+   {
+      free(wal_files[i]);
+   }
+   free(wal_files);
 
-   pgmoneta_disconnect(client_fd);
+   pgmoneta_json_destroy(bcks);
+   pgmoneta_json_destroy(j);
 
-   pgmoneta_stop_logging();
+   free(d);
+   free(elapsed);
 
-   exit(1);
+   return 1;
 }
 
 void
@@ -650,7 +718,7 @@ pgmoneta_delete_backup(int client_fd, int srv, uint8_t compression, uint8_t encr
    current = workflow;
    while (current != NULL)
    {
-      if (current->execute(current->name(), nodes))
+      if (pgmoneta_workflow_execute(current, nodes))
       {
          pgmoneta_management_response_error(NULL, client_fd, config->servers[srv].name, MANAGEMENT_ERROR_DELETE_EXECUTE, compression, encryption, payload);
 
@@ -671,6 +739,8 @@ pgmoneta_delete_backup(int client_fd, int srv, uint8_t compression, uint8_t encr
       current = current->next;
    }
 
+   pgmoneta_storage_remove_backup(srv, (char*)pgmoneta_art_search(nodes, NODE_LABEL));
+
    if (pgmoneta_management_create_response(payload, srv, &response))
    {
       pgmoneta_management_response_error(NULL, client_fd, config->servers[srv].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
@@ -741,3 +811,313 @@ pgmoneta_get_backup_max_rate(int server)
 
    return config->backup_max_rate;
 }
+
+static int
+list_backup_projection(char* fields, uint32_t* projection)
+{
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   bool found;
+   uint32_t result = 0;
+
+   *projection = LIST_BACKUP_FIELD_ALL;
+
+   if (fields == NULL || strlen(fields) == 0)
+   {
+      return 0;
+   }
+
+   copy = strdup(fields);
+   if (copy == NULL)
+   {
+      goto error;
+   }
+
+   token = strtok_r(copy, ",:", &saveptr);
+   while (token != NULL)
+   {
+      // the server and the label identify a backup, so they are always there
+      found = !strcasecmp(token, MANAGEMENT_ARGUMENT_SERVER) || !strcasecmp(token, MANAGEMENT_ARGUMENT_BACKUP);
+
+      for (size_t i = 0; !found && i < sizeof(list_backup_fields) / sizeof(list_backup_fields[0]); i++)
+      {
+         if (!strcasecmp(token, list_backup_fields[i]))
+         {
+            result |= 1 << i;
+            found = true;
+         }
+      }
+
+      if (!found)
+      {
+         pgmoneta_log_debug("List backup: Unknown field %s", token);
+         goto error;
+      }
+
+      token = strtok_r(NULL, ",:", &saveptr);
+   }
+
+   *projection = result;
+
+   free(copy);
+
+   return 0;
+
+error:
+
+   free(copy);
+
+   return 1;
+}
+
+static int
+list_backup_filter(char* filter, uint32_t* conditions)
+{
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   bool found;
+   uint32_t result = 0;
+
+   *conditions = 0;
+
+   if (filter == NULL || strlen(filter) == 0)
+   {
+      return 0;
+   }
+
+   copy = strdup(filter);
+   if (copy == NULL)
+   {
+      goto error;
+   }
+
+   token = strtok_r(copy, ",:", &saveptr);
+   while (token != NULL)
+   {
+      found = false;
+
+      for (size_t i = 0; !found && i < sizeof(list_backup_filters) / sizeof(list_backup_filters[0]); i++)
+      {
+         if (!strcasecmp(token, list_backup_filters[i]))
+         {
+            result |= 1 << i;
+            found = true;
+         }
+      }
+
+      if (!found)
+      {
+         pgmoneta_log_debug("List backup: Unknown filter %s", token);
+         goto error;
+      }
+
+      token = strtok_r(NULL, ",:", &saveptr);
+   }
+
+   *conditions = result;
+
+   free(copy);
+
+   return 0;
+
+error:
+
+   free(copy);
+
+   return 1;
+}
+
+static bool
+list_backup_matches(struct backup* backup, uint32_t conditions)
+{
+   if (backup == NULL)
+   {
+      return false;
+   }
+
+   if ((conditions & LIST_BACKUP_FILTER_VALID) && backup->valid != VALID_TRUE)
+   {
+      return false;
+   }
+
+   if ((conditions & LIST_BACKUP_FILTER_INVALID) && backup->valid != VALID_FALSE)
+   {
+      return false;
+   }
+
+   if ((conditions & LIST_BACKUP_FILTER_KEEP) && !backup->keep)
+   {
+      return false;
+   }
+
+   if ((conditions & LIST_BACKUP_FILTER_FULL) && backup->type != TYPE_FULL)
+   {
+      return false;
+   }
+
+   if ((conditions & LIST_BACKUP_FILTER_INCREMENTAL) && backup->type != TYPE_INCREMENTAL)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static int
+list_backup_start(int number_of_backups, struct backup** backups, char* cursor, bool descending)
+{
+   int lo;
+   int hi;
+   int mid;
+
+   if (cursor == NULL || strlen(cursor) == 0)
+   {
+      return descending ? number_of_backups - 1 : 0;
+   }
+
+   /* The catalog is sorted by label, so the page after the cursor starts at the first label past it */
+   lo = 0;
+   hi = number_of_backups;
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (strcmp(backups[mid]->label, cursor) < 0 || (!descending && !strcmp(backups[mid]->label, cursor)))
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+
+   return descending ? lo - 1 : lo;
+}
+
+static int
+list_backup_put(int server, struct backup** backups, int index, uint32_t projection,
+                int number_of_wal_files, char** wal_files, struct json** result)
+{
+   uint64_t wal = 0;
+   uint64_t delta = 0;
+   struct backup* backup = backups[index];
+   struct json* j = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *result = NULL;
+
+   if (pgmoneta_json_create(&j))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)backup->label, ValueString))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_KEEP) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_KEEP, (uintptr_t)backup->keep, ValueBool))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_VALID) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_VALID, (uintptr_t)backup->valid, ValueInt8))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_BACKUP_SIZE) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BACKUP_SIZE, (uintptr_t)backup->backup_size, ValueUInt64))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_RESTORE_SIZE) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_RESTORE_SIZE, (uintptr_t)backup->restore_size, ValueUInt64))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_BIGGEST_FILE_SIZE) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BIGGEST_FILE_SIZE, (uintptr_t)backup->biggest_file_size, ValueUInt64))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_COMPRESSION) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)backup->compression, ValueInt32))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_ENCRYPTION) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_ENCRYPTION, (uintptr_t)backup->encryption, ValueInt32))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_COMMENTS) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_COMMENTS, (uintptr_t)backup->comments, ValueString))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_INCREMENTAL) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_INCREMENTAL, (uintptr_t)backup->type, ValueBool))
+   {
+      goto error;
+   }
+
+   if ((projection & LIST_BACKUP_FIELD_INCREMENTAL_PARENT) &&
+       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_INCREMENTAL_PARENT, (uintptr_t)backup->parent_label, ValueString))
+   {
+      goto error;
+   }
+
+   if (projection & LIST_BACKUP_FIELD_WAL)
+   {
+      wal = pgmoneta_number_of_wal_files_in(number_of_wal_files, wal_files, &backup->wal[0], NULL);
+      wal *= config->servers[server].wal_size;
+
+      if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_WAL, (uintptr_t)wal, ValueUInt64))
+      {
+         goto error;
+      }
+   }
+
+   if (projection & LIST_BACKUP_FIELD_DELTA)
+   {
+      // the delta is the WAL since the previous backup, whatever the page holds
+      if (index > 0 && backups[index - 1] != NULL)
+      {
+         delta = pgmoneta_number_of_wal_files_in(number_of_wal_files, wal_files, &backups[index - 1]->wal[0], &backup->wal[0]);
+         delta *= config->servers[server].wal_size;
+      }
+
+      if (pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_DELTA, (uintptr_t)delta, ValueUInt64))
+      {
+         goto error;
+      }
+   }
+
+   *result = j;
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(j);
+
+   return 1;
+}
@@ -0,0 +1,609 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <blockmap.h>
+#include <csv.h>
+#include <info.h>
+#include <logging.h>
+#include <utils.h>
+
+/* system */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static int blockmap_walk(int server, char* data, char* relative_dir, char* label, char* parent_label,
+                         struct art* parent_index, struct csv_writer* writer);
+static int blockmap_write(int server, char* path, char* relative, char* label, char* parent_label,
+                          struct art* parent_index, struct csv_writer* writer);
+static int read_incremental_blocks(int server, char* path, uint32_t* num_blocks, uint32_t** blocks);
+static char* blockmap_index_path(int server, char* label);
+
+int
+pgmoneta_blockmap_create(int server, char* label, char* parent_label)
+{
+   char* server_dir = NULL;
+   char* data = NULL;
+   char* index_path = NULL;
+   char* tmp_path = NULL;
+   struct backup* parent = NULL;
+   struct art* parent_index = NULL;
+   struct csv_writer* writer = NULL;
+
+   server_dir = pgmoneta_get_server_backup(server);
+   if (pgmoneta_get_backup(server_dir, parent_label, &parent) || parent == NULL)
+   {
+      goto error;
+   }
+
+   // blocks that aren't in any incremental file of the chain come from the full backup,
+   // so an incremental parent needs an index of its own
+   if (parent->type != TYPE_FULL && pgmoneta_blockmap_read(server, parent_label, &parent_index))
+   {
+      pgmoneta_log_debug("Block map: no index for %s", parent_label);
+      goto error;
+   }
+
+   data = pgmoneta_get_server_backup_identifier_data(server, label);
+   index_path = blockmap_index_path(server, label);
+   tmp_path = pgmoneta_append(tmp_path, index_path);
+   tmp_path = pgmoneta_append(tmp_path, ".tmp");
+
+   if (pgmoneta_csv_writer_init(tmp_path, &writer))
+   {
+      goto error;
+   }
+
+   if (blockmap_walk(server, data, NULL, label, parent_label, parent_index, writer))
+   {
+      goto error;
+   }
+
+   pgmoneta_csv_writer_destroy(writer);
+   writer = NULL;
+
+   if (rename(tmp_path, index_path))
+   {
+      goto error;
+   }
+
+   pgmoneta_art_destroy(parent_index);
+   free(parent);
+   free(server_dir);
+   free(data);
+   free(index_path);
+   free(tmp_path);
+
+   return 0;
+
+error:
+   pgmoneta_csv_writer_destroy(writer);
+   if (tmp_path != NULL)
+   {
+      remove(tmp_path);
+   }
+   pgmoneta_art_destroy(parent_index);
+   free(parent);
+   free(server_dir);
+   free(data);
+   free(index_path);
+   free(tmp_path);
+
+   return 1;
+}
+
+int
+pgmoneta_blockmap_read(int server, char* label, struct art** index)
+{
+   char* index_path = NULL;
+   char* entry = NULL;
+   char relative[MAX_PATH];
+   struct csv_reader* reader = NULL;
+   struct art* a = NULL;
+   char** cols = NULL;
+   int number_of_columns = 0;
+
+   *index = NULL;
+
+   memset(relative, 0, sizeof(relative));
+
+   index_path = blockmap_index_path(server, label);
+
+   if (!pgmoneta_exists(index_path))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_csv_reader_init(index_path, &reader))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_art_create(&a))
+   {
+      goto error;
+   }
+
+   // a file starts with "path,full" and is followed by a "path,start,count,label" row per run
+   while (pgmoneta_csv_next_row(reader, &number_of_columns, &cols))
+   {
+      if (number_of_columns == 2)
+      {
+         if (entry != NULL)
+         {
+            pgmoneta_art_insert(a, relative, (uintptr_t)entry, ValueString);
+            free(entry);
+            entry = NULL;
+         }
+
+         memset(relative, 0, sizeof(relative));
+         snprintf(relative, sizeof(relative), "%s", cols[0]);
+         entry = pgmoneta_append(entry, cols[1]);
+      }
+      else if (number_of_columns == 4 && entry != NULL && !strcmp(relative, cols[0]))
+      {
+         entry = pgmoneta_append_char(entry, ' ');
+         entry = pgmoneta_append(entry, cols[1]);
+         entry = pgmoneta_append_char(entry, ':');
+         entry = pgmoneta_append(entry, cols[2]);
+         entry = pgmoneta_append_char(entry, ':');
+         entry = pgmoneta_append(entry, cols[3]);
+      }
+
+      free(cols);
+      cols = NULL;
+   }
+
+   if (entry != NULL)
+   {
+      pgmoneta_art_insert(a, relative, (uintptr_t)entry, ValueString);
+      free(entry);
+      entry = NULL;
+   }
+
+   pgmoneta_csv_reader_destroy(reader);
+   free(index_path);
+
+   *index = a;
+
+   return 0;
+
+error:
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_art_destroy(a);
+   free(index_path);
+   free(entry);
+
+   return 1;
+}
+
+int
+pgmoneta_blockmap_get(struct art* index, char* relative, struct blockmap** blockmap)
+{
+   char* entry = NULL;
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   struct blockmap* b = NULL;
+   struct blockmap_run* runs = NULL;
+
+   *blockmap = NULL;
+
+   if (index == NULL || relative == NULL)
+   {
+      goto error;
+   }
+
+   entry = (char*)pgmoneta_art_search(index, relative);
+   if (entry == NULL)
+   {
+      return 0;
+   }
+
+   copy = pgmoneta_append(NULL, entry);
+
+   b = (struct blockmap*)malloc(sizeof(struct blockmap));
+   if (b == NULL)
+   {
+      goto error;
+   }
+   memset(b, 0, sizeof(struct blockmap));
+
+   token = strtok_r(copy, " ", &saveptr);
+   if (token == NULL)
+   {
+      goto error;
+   }
+   snprintf(b->full, sizeof(b->full), "%s", token);
+
+   while ((token = strtok_r(NULL, " ", &saveptr)) != NULL)
+   {
+      struct blockmap_run run;
+
+      memset(&run, 0, sizeof(struct blockmap_run));
+      if (sscanf(token, "%u:%u:%127s", &run.start, &run.count, run.label) != 3 || run.count == 0)
+      {
+         goto error;
+      }
+
+      runs = realloc(b->runs, (b->number_of_runs + 1) * sizeof(struct blockmap_run));
+      if (runs == NULL)
+      {
+         goto error;
+      }
+      b->runs = runs;
+      b->runs[b->number_of_runs++] = run;
+   }
+
+   free(copy);
+
+   *blockmap = b;
+
+   return 0;
+
+error:
+   pgmoneta_blockmap_destroy(b);
+   free(copy);
+
+   return 1;
+}
+
+char*
+pgmoneta_blockmap_source(struct blockmap* blockmap, uint32_t block)
+{
+   int low = 0;
+   int high = 0;
+
+   high = blockmap->number_of_runs - 1;
+
+   while (low <= high)
+   {
+      int mid = low + (high - low) / 2;
+      struct blockmap_run* run = &blockmap->runs[mid];
+
+      if (block < run->start)
+      {
+         high = mid - 1;
+      }
+      else if (block >= run->start + run->count)
+      {
+         low = mid + 1;
+      }
+      else
+      {
+         return run->label;
+      }
+   }
+
+   return blockmap->full;
+}
+
+void
+pgmoneta_blockmap_destroy(struct blockmap* blockmap)
+{
+   if (blockmap != NULL)
+   {
+      free(blockmap->runs);
+   }
+   free(blockmap);
+}
+
+static int
+blockmap_walk(int server, char* data, char* relative_dir, char* label, char* parent_label,
+              struct art* parent_index, struct csv_writer* writer)
+{
+   char dir_path[MAX_PATH];
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+
+   memset(dir_path, 0, sizeof(dir_path));
+   if (relative_dir == NULL)
+   {
+      snprintf(dir_path, sizeof(dir_path), "%s", data);
+   }
+   else
+   {
+      snprintf(dir_path, sizeof(dir_path), "%s%s", data, relative_dir);
+   }
+
+   if (!(dir = opendir(dir_path)))
+   {
+      pgmoneta_log_error("Block map: could not open directory %s", dir_path);
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      int n;
+      int r;
+      char path[MAX_PATH];
+      char relative[MAX_PATH];
+      struct stat st;
+
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      memset(path, 0, sizeof(path));
+      memset(relative, 0, sizeof(relative));
+      n = snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+      if (relative_dir == NULL)
+      {
+         r = snprintf(relative, sizeof(relative), "%s", entry->d_name);
+      }
+      else
+      {
+         r = snprintf(relative, sizeof(relative), "%s/%s", relative_dir, entry->d_name);
+      }
+
+      if (n < 0 || (size_t)n >= sizeof(path) || r < 0 || (size_t)r >= sizeof(relative))
+      {
+         pgmoneta_log_warn("Block map: Skipping %s/%s, the path is too long", dir_path, entry->d_name);
+         continue;
+      }
+
+      // tablespaces are linked from pg_tblspc
+      if (stat(path, &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         if (blockmap_walk(server, data, relative, label, parent_label, parent_index, writer))
+         {
+            goto error;
+         }
+      }
+      else if (S_ISREG(st.st_mode) && pgmoneta_starts_with(entry->d_name, INCREMENTAL_PREFIX))
+      {
+         memset(relative, 0, sizeof(relative));
+         if (relative_dir == NULL)
+         {
+            snprintf(relative, sizeof(relative), "%s", entry->d_name + INCREMENTAL_PREFIX_LENGTH);
+         }
+         else
+         {
+            snprintf(relative, sizeof(relative), "%s/%s", relative_dir, entry->d_name + INCREMENTAL_PREFIX_LENGTH);
+         }
+
+         if (blockmap_write(server, path, relative, label, parent_label, parent_index, writer))
+         {
+            goto error;
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return 1;
+}
+
+static int
+blockmap_write(int server, char* path, char* relative, char* label, char* parent_label,
+               struct art* parent_index, struct csv_writer* writer)
+{
+   uint32_t num_blocks = 0;
+   uint32_t* blocks = NULL;
+   uint32_t length = 0;
+   char** sources = NULL;
+   struct blockmap* parent = NULL;
+   char* full = NULL;
+   char* cols[4];
+
+   if (read_incremental_blocks(server, path, &num_blocks, &blocks))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_blockmap_get(parent_index, relative, &parent))
+   {
+      goto error;
+   }
+
+   // a file that was full in the parent comes from there
+   full = parent != NULL ? parent->full : parent_label;
+
+   if (parent != NULL && parent->number_of_runs > 0)
+   {
+      struct blockmap_run* last = &parent->runs[parent->number_of_runs - 1];
+      length = last->start + last->count;
+   }
+
+   for (uint32_t i = 0; i < num_blocks; i++)
+   {
+      if (blocks[i] + 1 > length)
+      {
+         length = blocks[i] + 1;
+      }
+   }
+
+   if (length > 0)
+   {
+      sources = (char**)calloc(length, sizeof(char*));
+      if (sources == NULL)
+      {
+         goto error;
+      }
+   }
+
+   // the newest version of a block is in this backup if it was sent,
+   // otherwise wherever the parent has it
+   for (int i = 0; parent != NULL && i < parent->number_of_runs; i++)
+   {
+      for (uint32_t b = 0; b < parent->runs[i].count; b++)
+      {
+         sources[parent->runs[i].start + b] = parent->runs[i].label;
+      }
+   }
+
+   for (uint32_t i = 0; i < num_blocks; i++)
+   {
+      sources[blocks[i]] = label;
+   }
+
+   cols[0] = relative;
+   cols[1] = (char*)full;
+   if (pgmoneta_csv_write(writer, 2, cols))
+   {
+      goto error;
+   }
+
+   for (uint32_t b = 0; b < length;)
+   {
+      char start[MISC_LENGTH];
+      char count[MISC_LENGTH];
+      uint32_t n = 1;
+
+      if (sources[b] == NULL)
+      {
+         b++;
+         continue;
+      }
+
+      while (b + n < length && sources[b + n] == sources[b])
+      {
+         n++;
+      }
+
+      memset(start, 0, sizeof(start));
+      memset(count, 0, sizeof(count));
+      snprintf(start, sizeof(start), "%u", b);
+      snprintf(count, sizeof(count), "%u", n);
+
+      cols[0] = relative;
+      cols[1] = start;
+      cols[2] = count;
+      cols[3] = sources[b];
+      if (pgmoneta_csv_write(writer, 4, cols))
+      {
+         goto error;
+      }
+
+      b += n;
+   }
+
+   pgmoneta_blockmap_destroy(parent);
+   free(sources);
+   free(blocks);
+
+   return 0;
+
+error:
+   pgmoneta_log_error("Block map: unable to map %s", path);
+   pgmoneta_blockmap_destroy(parent);
+   free(sources);
+   free(blocks);
+
+   return 1;
+}
+
+static int
+read_incremental_blocks(int server, char* path, uint32_t* num_blocks, uint32_t** blocks)
+{
+   uint32_t header[3];
+   uint32_t* b = NULL;
+   FILE* f = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *num_blocks = 0;
+   *blocks = NULL;
+
+   f = fopen(path, "r");
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   // magic, number of blocks and truncation block length
+   if (fread(&header[0], sizeof(uint32_t), 3, f) != 3 || header[0] != INCREMENTAL_MAGIC ||
+       header[1] > (uint32_t)config->servers[server].relseg_size)
+   {
+      goto error;
+   }
+
+   if (header[1] > 0)
+   {
+      b = (uint32_t*)malloc(sizeof(uint32_t) * header[1]);
+      if (b == NULL || fread(b, sizeof(uint32_t), header[1], f) != header[1])
+      {
+         goto error;
+      }
+
+      for (uint32_t i = 0; i < header[1]; i++)
+      {
+         if (b[i] >= (uint32_t)config->servers[server].relseg_size)
+         {
+            goto error;
+         }
+      }
+   }
+
+   fclose(f);
+
+   *num_blocks = header[1];
+   *blocks = b;
+
+   return 0;
+
+error:
+   if (f != NULL)
+   {
+      fclose(f);
+   }
+   free(b);
+
+   return 1;
+}
+
+static char*
+blockmap_index_path(int server, char* label)
+{
+   char* p = NULL;
+
+   p = pgmoneta_get_server_backup_identifier(server, label);
+   p = pgmoneta_append(p, BLOCKMAP_INDEX);
+
+   return p;
+}
@@ -29,14 +29,19 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <bzip2_compression.h>
+#include <compression.h>
+#include <io.h>
 #include <logging.h>
 #include <management.h>
 #include <utils.h>
+#include <wal.h>
+#include <walk.h>
 #include <workers.h>
 
 /* system */
 #include <bzlib.h>
 #include <dirent.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -47,125 +52,130 @@
 
 #define BUFFER_LENGTH 8192
 
+#define BZIP2_BLOCK_SIZE   (900 * 1000)
+#define BZIP2_SPLIT_SIZE   (4 * BZIP2_BLOCK_SIZE)
+#define BZIP2_MAGIC_LENGTH 10
+
+/** @struct bzip2_data
+ * Defines a compression pass over a directory tree
+ */
+struct bzip2_data
+{
+   int level;                /**< The compression level */
+   struct workers* workers;  /**< The workers, or NULL */
+};
+
+/** @struct bzip2_split
+ * Defines a file that is compressed or decompressed as independent bzip2 streams
+ */
+struct bzip2_split
+{
+   struct worker_split split; /**< The parts */
+   bool wal;                  /**< Is the file a WAL segment, that is recycled */
+   off_t* offsets;            /**< The offsets of the parts in the compressed file, and its size */
+};
+
 static int bzip2_compress(char* from, int level, char* to);
+static int bzip2_compress_range(char* from, off_t offset, size_t length, int level, char* to);
+static int bzip2_split(char* directory, char* from, char* to, int level, size_t size, bool wal, struct workers* workers);
+static int bzip2_join(char* to, int number_of_parts);
+static void bzip2_parts_delete(char* to, int number_of_parts);
 static int bzip2_decompress(char* from, char* to);
-static int bzip2_decompress_file(char* from, char* to);
+static int bzip2_decompress_range(char* from, off_t offset, size_t length, char* to);
+static int bzip2_streams(char* from, struct bzip2_split** split);
+static int bzip2_split_decompress(char* directory, char* from, char* to, struct workers* workers);
 
 static void do_bzip2_compress(struct worker_input* wi);
+static void do_bzip2_compress_part(struct worker_input* wi);
 static void do_bzip2_decompress(struct worker_input* wi);
+static void do_bzip2_decompress_part(struct worker_input* wi);
+static int bzip2_data_entry(struct walk_entry* entry, void* arg);
 
 int
-pgmoneta_bzip2_data(char* directory, struct workers* workers)
+pgmoneta_bzip2_data(char* directory, char* manifest, struct workers* workers)
 {
-   char* from = NULL;
-   char* to = NULL;
-
-   DIR* dir;
-   struct dirent* entry;
-   int level;
-   struct worker_input* wi = NULL;
+   struct bzip2_data data;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   if (!(dir = opendir(directory)))
+   data.level = config->compression_level;
+   if (data.level < 1)
    {
-      goto error;
+      data.level = 1;
+   }
+   else if (data.level > 9)
+   {
+      data.level = 9;
    }
 
-   level = config->compression_level;
-   if (level < 1)
+   data.workers = workers;
+
+   return pgmoneta_walk_manifest(directory, manifest, 0, workers != NULL ? workers->number_of_workers : 1, bzip2_data_entry, &data);
+}
+
+static int
+bzip2_data_entry(struct walk_entry* entry, void* arg)
+{
+   char* to = NULL;
+   struct worker_input* wi = NULL;
+   struct bzip2_data* data = (struct bzip2_data*)arg;
+
+   if (pgmoneta_ends_with(entry->name, "backup_manifest"))
    {
-      level = 1;
+      return WALK_SKIP;
    }
-   else if (level > 9)
+
+   if (entry->type != WALK_FILE || pgmoneta_ends_with(entry->name, "backup_label") ||
+       pgmoneta_is_compressed_archive(entry->name) || pgmoneta_is_encrypted_archive(entry->name))
    {
-      level = 9;
+      return WALK_CONTINUE;
    }
 
-   while ((entry = readdir(dir)) != NULL)
+   if (pgmoneta_compression_incompressible(entry->path))
+   {
+      return WALK_CONTINUE;
+   }
+
+   to = pgmoneta_append(to, entry->path);
+   to = pgmoneta_append(to, ".bz2");
+
+   // large files are compressed as independent bzip2 streams in parallel
+   if (data->workers != NULL && pgmoneta_get_file_size(entry->path) > BZIP2_SPLIT_SIZE)
    {
-      if (pgmoneta_ends_with(entry->d_name, "backup_manifest"))
+      if (bzip2_split(entry->directory, entry->path, to, data->level, pgmoneta_get_file_size(entry->path), false, data->workers))
       {
-         continue;
+         goto error;
       }
-
-      if (entry->d_type == DT_DIR)
+   }
+   else if (!pgmoneta_create_worker_input(entry->directory, entry->path, to, data->level, data->workers, &wi))
+   {
+      if (data->workers != NULL)
       {
-         char path[MAX_PATH];
-
-         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+         if (data->workers->outcome)
          {
-            continue;
+            pgmoneta_workers_add(data->workers, do_bzip2_compress, wi);
          }
-
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
-
-         pgmoneta_bzip2_data(path, workers);
       }
-      else if (entry->d_type == DT_REG)
+      else
       {
-         if (pgmoneta_ends_with(entry->d_name, "backup_label"))
-         {
-            continue;
-         }
-         if (!pgmoneta_is_compressed_archive(entry->d_name) && !pgmoneta_is_encrypted_archive(entry->d_name))
-         {
-            from = pgmoneta_append(from, directory);
-            from = pgmoneta_append(from, "/");
-            from = pgmoneta_append(from, entry->d_name);
-
-            to = pgmoneta_append(to, directory);
-            to = pgmoneta_append(to, "/");
-            to = pgmoneta_append(to, entry->d_name);
-            to = pgmoneta_append(to, ".bz2");
-
-            if (!pgmoneta_create_worker_input(directory, from, to, level, workers, &wi))
-            {
-               if (workers != NULL)
-               {
-                  if (workers->outcome)
-                  {
-                     pgmoneta_workers_add(workers, do_bzip2_compress, wi);
-                  }
-               }
-               else
-               {
-                  do_bzip2_compress(wi);
-               }
-            }
-            else
-            {
-               goto error;
-            }
-
-            free(from);
-            free(to);
-
-            from = NULL;
-            to = NULL;
-         }
+         do_bzip2_compress(wi);
       }
    }
+   else
+   {
+      goto error;
+   }
 
-   closedir(dir);
-
-   free(from);
    free(to);
 
-   return 0;
+   return WALK_CONTINUE;
 
 error:
 
-   if (dir != NULL)
-   {
-      closedir(dir);
-   }
-
-   free(from);
    free(to);
 
-   return 1;
+   return WALK_STOP;
 }
 
 static void
@@ -186,6 +196,41 @@ do_bzip2_compress(struct worker_input* wi)
    free(wi);
 }
 
+static void
+do_bzip2_compress_part(struct worker_input* wi)
+{
+   char part[MAX_PATH];
+   struct bzip2_split* split = (struct bzip2_split*)wi->argument;
+
+   snprintf(part, sizeof(part), "%s.%d", wi->to, (int)(wi->offset / BZIP2_SPLIT_SIZE));
+
+   if (bzip2_compress_range(wi->from, wi->offset, wi->length, wi->level, part))
+   {
+      pgmoneta_log_error("Bzip2: Could not compress %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&split->split.failed, true);
+   }
+
+   // the last part to finish puts the file together
+   if (atomic_fetch_sub(&split->split.remaining, 1) == 1)
+   {
+      if (atomic_load(&split->split.failed) || bzip2_join(wi->to, split->split.number_of_parts))
+      {
+         bzip2_parts_delete(wi->to, split->split.number_of_parts);
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      else if (!split->wal || pgmoneta_wal_recycle(wi->directory, wi->from))
+      {
+         pgmoneta_delete_file(wi->from, NULL);
+      }
+      free(split);
+   }
+
+   free(wi);
+}
+
 void
 pgmoneta_bzip2_tablespaces(char* root, struct workers* workers)
 {
@@ -210,7 +255,7 @@ pgmoneta_bzip2_tablespaces(char* root, struct workers* workers)
 
          snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
 
-         pgmoneta_bzip2_data(path, workers);
+         pgmoneta_bzip2_data(path, NULL, workers);
       }
    }
 
@@ -218,25 +263,22 @@ pgmoneta_bzip2_tablespaces(char* root, struct workers* workers)
 }
 
 void
-pgmoneta_bzip2_wal(char* directory)
+pgmoneta_bzip2_wal(int server, char* directory)
 {
-
    char* from = NULL;
    char* to = NULL;
-
    DIR* dir;
    struct dirent* entry;
    int level;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
+   size_t size;
+   struct workers* workers = NULL;
 
    if (!(dir = opendir(directory)))
    {
       return;
    }
 
-   level = config->compression_level;
+   level = pgmoneta_get_wal_compression_level(server);
    if (level < 1)
    {
       level = 1;
@@ -246,6 +288,12 @@ pgmoneta_bzip2_wal(char* directory)
       level = 9;
    }
 
+   // the streams of a segment are compressed in parallel
+   if (pgmoneta_get_number_of_workers(server) > 0)
+   {
+      pgmoneta_workers_initialize(pgmoneta_get_number_of_workers(server), &workers);
+   }
+
    while ((entry = readdir(dir)) != NULL)
    {
       if (entry->d_type == DT_REG)
@@ -273,10 +321,28 @@ pgmoneta_bzip2_wal(char* directory)
 
          if (pgmoneta_exists(from))
          {
-            if (bzip2_compress(from, level, to))
+            size = pgmoneta_get_file_size(from);
+
+            if (workers != NULL && size > BZIP2_SPLIT_SIZE)
             {
-               pgmoneta_log_error("Bzip2: Could not compress %s/%s", directory, entry->d_name);
-               break;
+               if (bzip2_split(directory, from, to, level, size, true, workers))
+               {
+                  pgmoneta_log_error("Bzip2: Could not compress %s/%s", directory, entry->d_name);
+                  break;
+               }
+            }
+            else
+            {
+               if (bzip2_compress(from, level, to))
+               {
+                  pgmoneta_log_error("Bzip2: Could not compress %s/%s", directory, entry->d_name);
+                  break;
+               }
+
+               if (pgmoneta_wal_recycle(directory, from))
+               {
+                  pgmoneta_delete_file(from, NULL);
+               }
             }
          }
 
@@ -290,6 +356,16 @@ pgmoneta_bzip2_wal(char* directory)
 
    closedir(dir);
 
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         pgmoneta_log_error("Bzip2: Could not compress the WAL in %s", directory);
+      }
+      pgmoneta_workers_destroy(workers);
+   }
+
    free(from);
    free(to);
 }
@@ -315,7 +391,7 @@ pgmoneta_bunzip2_data(char* directory, struct workers* workers)
       {
          char path[MAX_PATH];
 
-         if (!strcmp(entry->d_name, ".") || strcmp(entry->d_name, ".."))
+         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
          {
             continue;
          }
@@ -328,7 +404,7 @@ pgmoneta_bunzip2_data(char* directory, struct workers* workers)
       {
          if (pgmoneta_ends_with(entry->d_name, ".bz2"))
          {
-            from = pgmoneta_append(from, entry->d_name);
+            from = pgmoneta_append(from, directory);
             from = pgmoneta_append(from, "/");
             from = pgmoneta_append(from, entry->d_name);
 
@@ -346,7 +422,13 @@ pgmoneta_bunzip2_data(char* directory, struct workers* workers)
             to = pgmoneta_append(to, "/");
             to = pgmoneta_append(to, name);
 
-            if (!pgmoneta_create_worker_input(directory, from, to, 0, workers, &wi))
+            // a file of several streams is decompressed as its parts in parallel
+            if (workers != NULL && pgmoneta_get_file_size(from) > BZIP2_BLOCK_SIZE &&
+                !bzip2_split_decompress(directory, from, to, workers))
+            {
+               /* Queued */
+            }
+            else if (!pgmoneta_create_worker_input(directory, from, to, 0, workers, &wi))
             {
                if (workers != NULL)
                {
@@ -500,6 +582,43 @@ do_bzip2_decompress(struct worker_input* wi)
    free(wi);
 }
 
+static void
+do_bzip2_decompress_part(struct worker_input* wi)
+{
+   char part[MAX_PATH];
+   struct bzip2_split* split = (struct bzip2_split*)wi->argument;
+
+   snprintf(part, sizeof(part), "%s.%d", wi->to, wi->level);
+
+   if (bzip2_decompress_range(wi->from, wi->offset, wi->length, part))
+   {
+      pgmoneta_log_error("Bzip2: Could not decompress %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&split->split.failed, true);
+   }
+
+   // the last part to finish puts the file together
+   if (atomic_fetch_sub(&split->split.remaining, 1) == 1)
+   {
+      if (atomic_load(&split->split.failed) || bzip2_join(wi->to, split->split.number_of_parts))
+      {
+         pgmoneta_log_error("Bzip2: Could not decompress %s", wi->from);
+         bzip2_parts_delete(wi->to, split->split.number_of_parts);
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      else
+      {
+         pgmoneta_delete_file(wi->from, NULL);
+      }
+      free(split->offsets);
+      free(split);
+   }
+
+   free(wi);
+}
+
 void
 pgmoneta_bzip2_request(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
@@ -624,19 +743,60 @@ error:
    return 1;
 }
 
+int
+pgmoneta_bzip2_file_split(char* from, char* to, struct workers* workers)
+{
+   int level;
+   size_t size;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   size = pgmoneta_get_file_size(from);
+
+   if (workers == NULL || size <= BZIP2_SPLIT_SIZE)
+   {
+      return pgmoneta_bzip2_file(from, to);
+   }
+
+   level = config->compression_level;
+   if (level < 1)
+   {
+      level = 1;
+   }
+   else if (level > 9)
+   {
+      level = 9;
+   }
+
+   return bzip2_split(NULL, from, to, level, size, false, workers);
+}
+
 static int
 bzip2_compress(char* from, int level, char* to)
 {
-   FILE* from_ptr = NULL;
-   FILE* to_ptr = NULL;
+   return bzip2_compress_range(from, 0, 0, level, to);
+}
 
-   char buf[BUFFER_LENGTH] = {0};
+static int
+bzip2_compress_range(char* from, off_t offset, size_t length, int level, char* to)
+{
+   struct io_reader* from_ptr = NULL;
+   FILE* to_ptr = NULL;
+   BZFILE* zip_file = NULL;
+   char* buf = NULL;
    size_t buf_len = BUFFER_LENGTH;
-   size_t length;
-   int bzip2_err = 1;
+   size_t remaining = length;
+   size_t n;
+   int bzip2_err = BZ_OK;
+
+   buf = pgmoneta_worker_buffer(WORKER_BUFFER_IN, buf_len);
+   if (buf == NULL)
+   {
+      goto error;
+   }
 
-   from_ptr = fopen(from, "r");
-   if (!from_ptr)
+   if (pgmoneta_io_reader_open(from, offset, length, &from_ptr))
    {
       goto error;
    }
@@ -647,41 +807,69 @@ bzip2_compress(char* from, int level, char* to)
       goto error;
    }
 
-   bzip2_err = BZ_OK;
-
-   BZFILE* zip_file = BZ2_bzWriteOpen(&bzip2_err, to_ptr, level, 0, 0);
+   zip_file = BZ2_bzWriteOpen(&bzip2_err, to_ptr, level, 0, 0);
    if (bzip2_err != BZ_OK)
    {
-      goto error_zip;
+      zip_file = NULL;
+      goto error;
    }
 
-   while ((length = fread(buf, sizeof(char), buf_len, from_ptr)) > 0)
+   for (;;)
    {
-      BZ2_bzWrite(&bzip2_err, zip_file, buf, strlen(buf));
+      n = buf_len;
+      if (length > 0)
+      {
+         n = MIN(n, remaining);
+      }
+
+      n = n > 0 ? pgmoneta_io_reader_read(from_ptr, buf, n) : 0;
+      if (n == 0)
+      {
+         break;
+      }
+
+      remaining -= MIN(remaining, n);
+
+      BZ2_bzWrite(&bzip2_err, zip_file, buf, (int)n);
       if (bzip2_err != BZ_OK)
       {
-         goto error_zip;
+         goto error;
       }
+   }
 
-      memset(buf, 0, buf_len);
+   if (pgmoneta_io_reader_error(from_ptr))
+   {
+      goto error;
    }
 
    BZ2_bzWriteClose(&bzip2_err, zip_file, 0, NULL, NULL);
+   zip_file = NULL;
+   if (bzip2_err != BZ_OK)
+   {
+      goto error;
+   }
 
-   fclose(from_ptr);
-   fclose(to_ptr);
+   pgmoneta_io_reader_close(from_ptr);
 
-   return 0;
+   fflush(to_ptr);
+   pgmoneta_io_drop(fileno(to_ptr), true);
 
-error_zip:
-   BZ2_bzWriteClose(&bzip2_err, zip_file, 0, NULL, NULL);
+   if (fclose(to_ptr) != 0)
+   {
+      return 1;
+   }
+
+   return 0;
 
 error:
-   if (from_ptr)
+
+   if (zip_file != NULL)
    {
-      fclose(from_ptr);
+      BZ2_bzWriteClose(&bzip2_err, zip_file, 1, NULL, NULL);
    }
 
+   pgmoneta_io_reader_close(from_ptr);
+
    if (to_ptr)
    {
       fclose(to_ptr);
@@ -691,95 +879,186 @@ error:
 }
 
 static int
-bzip2_decompress(char* from, char* to)
+bzip2_split(char* directory, char* from, char* to, int level, size_t size, bool wal, struct workers* workers)
 {
-   FILE* from_ptr = NULL;
-   FILE* to_ptr = NULL;
-
-   char buf[BUFFER_LENGTH] = {0};
-   size_t buf_len = BUFFER_LENGTH;
-   int length = 0;
-   int bzip2_err;
-   BZFILE* zip_file = NULL;
+   int parts;
+   struct bzip2_split* split = NULL;
+   struct worker_input* wi = NULL;
 
-   from_ptr = fopen(from, "r");
-   if (!from_ptr)
+   split = (struct bzip2_split*)calloc(1, sizeof(struct bzip2_split));
+   if (split == NULL)
    {
-      goto error;
+      return 1;
    }
 
-   to_ptr = fopen(to, "wb+");
-   if (!to_ptr)
+   parts = (size + BZIP2_SPLIT_SIZE - 1) / BZIP2_SPLIT_SIZE;
+
+   split->split.number_of_parts = parts;
+   atomic_init(&split->split.remaining, parts);
+   atomic_init(&split->split.failed, false);
+   split->wal = wal;
+
+   for (int i = 0; i < parts; i++)
    {
-      goto error;
+      if (pgmoneta_create_worker_input(directory, from, to, level, workers, &wi))
+      {
+         // the parts that are not queued count as failed
+         atomic_store(&split->split.failed, true);
+         if (atomic_fetch_sub(&split->split.remaining, parts - i) == parts - i)
+         {
+            bzip2_parts_delete(to, parts);
+            free(split);
+         }
+         return 1;
+      }
+
+      wi->offset = (off_t)i * BZIP2_SPLIT_SIZE;
+      wi->length = MIN((size_t)BZIP2_SPLIT_SIZE, size - (size_t)wi->offset);
+      wi->split = &split->split;
+      wi->argument = split;
+
+      pgmoneta_workers_add(workers, do_bzip2_compress_part, wi);
    }
 
-   zip_file = BZ2_bzReadOpen(&bzip2_err, from_ptr, 0, 0, NULL, 0);
-   if (bzip2_err != BZ_OK)
+   return 0;
+}
+
+/**
+ * Put the parts of a file together. Concatenated bzip2 streams are a valid
+ * bzip2 file, which bzip2 and pbzip2 read as one
+ * @param to The file
+ * @param number_of_parts The number of parts
+ * @return 0 upon success, otherwise 1
+ */
+static int
+bzip2_join(char* to, int number_of_parts)
+{
+   char part[MAX_PATH];
+   char buf[BUFFER_LENGTH];
+   size_t length;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   out = fopen(to, "wb");
+   if (out == NULL)
    {
-      goto error_unzip;
+      goto error;
    }
 
-   do
+   for (int i = 0; i < number_of_parts; i++)
    {
-      length = BZ2_bzRead(&bzip2_err, zip_file, buf, (int) buf_len);
-      if (bzip2_err != BZ_OK && bzip2_err != BZ_STREAM_END)
+      snprintf(part, sizeof(part), "%s.%d", to, i);
+
+      in = fopen(part, "rb");
+      if (in == NULL)
       {
-         goto error_unzip;
+         goto error;
       }
 
-      if (length > 0)
+      while ((length = fread(buf, 1, sizeof(buf), in)) > 0)
       {
-         if (fwrite(buf, 1, length, to_ptr) != (size_t)length)
+         if (fwrite(buf, 1, length, out) != length)
          {
-            goto error_unzip;
+            goto error;
          }
       }
 
-   }
-   while (bzip2_err == BZ_STREAM_END && length == BUFFER_LENGTH);
+      if (ferror(in))
+      {
+         goto error;
+      }
 
-   BZ2_bzReadClose(&bzip2_err, zip_file);
+      fclose(in);
+      in = NULL;
 
-   fclose(from_ptr);
-   fclose(to_ptr);
+      pgmoneta_delete_file(part, NULL);
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
 
    return 0;
 
-error_unzip:
-   if (zip_file != NULL)
+error:
+
+   pgmoneta_log_error("Bzip2: Could not join the parts of %s", to);
+
+   if (in != NULL)
    {
-      BZ2_bzReadClose(&bzip2_err, zip_file);
+      fclose(in);
    }
 
-error:
-   if (to_ptr)
+   if (out != NULL)
    {
-      fclose(to_ptr);
+      fclose(out);
    }
 
-   if (from_ptr)
+   if (pgmoneta_exists(to))
    {
-      fclose(from_ptr);
+      pgmoneta_delete_file(to, NULL);
    }
 
    return 1;
 }
 
+static void
+bzip2_parts_delete(char* to, int number_of_parts)
+{
+   char part[MAX_PATH];
+
+   for (int i = 0; i < number_of_parts; i++)
+   {
+      snprintf(part, sizeof(part), "%s.%d", to, i);
+      if (pgmoneta_exists(part))
+      {
+         pgmoneta_delete_file(part, NULL);
+      }
+   }
+}
+
 static int
-bzip2_decompress_file(char* from, char* to)
+bzip2_decompress(char* from, char* to)
 {
-   FILE* from_ptr = NULL;
-   FILE* to_ptr = NULL;
+   return bzip2_decompress_range(from, 0, 0, to);
+}
 
-   char buf[BUFFER_LENGTH] = {0};
-   size_t buf_len = BUFFER_LENGTH;
-   int length = 0;
-   int bzip2_err = 1;
-   BZFILE* zip_file = NULL;
+/**
+ * Decompress the bzip2 streams in a range of a file
+ * @param from The compressed file
+ * @param offset The offset of the first stream
+ * @param length The number of bytes, or 0 for the rest of the file
+ * @param to The decompressed file
+ * @return 0 upon success, otherwise 1
+ */
+static int
+bzip2_decompress_range(char* from, off_t offset, size_t length, char* to)
+{
+   struct io_reader* from_ptr = NULL;
+   FILE* to_ptr = NULL;
+   char* in = NULL;
+   char* out = NULL;
+   size_t remaining = length;
+   size_t n;
+   char* next_in = NULL;
+   unsigned int avail_in;
+   bool started = false;
+   bool eof = false;
+   int ret;
+   bz_stream strm;
+
+   memset(&strm, 0, sizeof(bz_stream));
+
+   in = pgmoneta_worker_buffer(WORKER_BUFFER_IN, BUFFER_LENGTH);
+   out = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, BUFFER_LENGTH);
+   if (in == NULL || out == NULL)
+   {
+      goto error;
+   }
 
-   from_ptr = fopen(from, "r");
-   if (!from_ptr)
+   if (pgmoneta_io_reader_open(from, offset, length, &from_ptr))
    {
       goto error;
    }
@@ -790,65 +1069,315 @@ bzip2_decompress_file(char* from, char* to)
       goto error;
    }
 
-   zip_file = BZ2_bzReadOpen(&bzip2_err, from_ptr, 0, 0, NULL, 0);
-   if (bzip2_err != BZ_OK)
+   if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
    {
-      goto error_unzip;
+      goto error;
    }
+   started = true;
 
-   do
+   for (;;)
    {
-      length = BZ2_bzRead(&bzip2_err, zip_file, buf, (int)buf_len);
-      if (bzip2_err != BZ_OK && bzip2_err != BZ_STREAM_END)
+      if (strm.avail_in == 0 && !eof)
+      {
+         n = BUFFER_LENGTH;
+         if (length > 0)
+         {
+            n = MIN(n, remaining);
+         }
+
+         n = n > 0 ? pgmoneta_io_reader_read(from_ptr, in, n) : 0;
+         if (pgmoneta_io_reader_error(from_ptr))
+         {
+            goto error;
+         }
+
+         remaining -= MIN(remaining, n);
+         eof = n == 0;
+
+         strm.next_in = in;
+         strm.avail_in = (unsigned int)n;
+      }
+
+      strm.next_out = out;
+      strm.avail_out = BUFFER_LENGTH;
+
+      ret = BZ2_bzDecompress(&strm);
+      if (ret != BZ_OK && ret != BZ_STREAM_END)
       {
-         goto error_unzip;
+         goto error;
       }
 
-      if (length > 0)
+      if (fwrite(out, 1, BUFFER_LENGTH - strm.avail_out, to_ptr) != BUFFER_LENGTH - strm.avail_out)
+      {
+         goto error;
+      }
+
+      if (ret == BZ_STREAM_END)
       {
-         if (fwrite(buf, 1, length, to_ptr) != (size_t)length)
+         // a file can hold several streams, each one starts a new decompression
+         next_in = strm.next_in;
+         avail_in = strm.avail_in;
+
+         BZ2_bzDecompressEnd(&strm);
+         started = false;
+
+         if (avail_in == 0 && !eof)
+         {
+            n = BUFFER_LENGTH;
+            if (length > 0)
+            {
+               n = MIN(n, remaining);
+            }
+
+            n = n > 0 ? pgmoneta_io_reader_read(from_ptr, in, n) : 0;
+            if (pgmoneta_io_reader_error(from_ptr))
+            {
+               goto error;
+            }
+
+            remaining -= MIN(remaining, n);
+            eof = n == 0;
+
+            next_in = in;
+            avail_in = (unsigned int)n;
+         }
+
+         // anything but another stream is trailing data, like bzip2 does
+         if (avail_in == 0 || next_in[0] != 'B')
          {
-            goto error_unzip;
+            break;
          }
-      }
 
+         memset(&strm, 0, sizeof(bz_stream));
+         if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+         {
+            goto error;
+         }
+         started = true;
+
+         strm.next_in = next_in;
+         strm.avail_in = avail_in;
+      }
+      else if (eof && strm.avail_in == 0 && strm.avail_out > 0)
+      {
+         // the stream is truncated
+         goto error;
+      }
    }
-   while (bzip2_err != BZ_STREAM_END);
 
-   BZ2_bzReadClose(&bzip2_err, zip_file);
-   zip_file = NULL;
+   pgmoneta_io_reader_close(from_ptr);
 
-   fclose(from_ptr);
-   fclose(to_ptr);
+   fflush(to_ptr);
+   pgmoneta_io_drop(fileno(to_ptr), true);
+
+   if (fclose(to_ptr) != 0)
+   {
+      return 1;
+   }
 
    return 0;
 
-error_unzip:
-   if (zip_file)
+error:
+
+   if (started)
    {
-      BZ2_bzReadClose(&bzip2_err, zip_file);
+      BZ2_bzDecompressEnd(&strm);
    }
 
-error:
+   pgmoneta_io_reader_close(from_ptr);
+
    if (to_ptr)
    {
       fclose(to_ptr);
    }
 
-   if (from_ptr)
+   return 1;
+}
+
+/**
+ * Find the streams of a compressed file, and group them into parts of at least
+ * BZIP2_BLOCK_SIZE compressed bytes. A stream starts on a byte with its header
+ * and the magic of its first block, which is how pbzip2 finds them too
+ * @param from The compressed file
+ * @param split The parts
+ * @return 0 upon success, otherwise 1 when the file is not worth splitting
+ */
+static int
+bzip2_streams(char* from, struct bzip2_split** split)
+{
+   static const char block_magic[] = {0x31, 0x41, 0x59, 0x26, 0x53, 0x59};
+   FILE* f = NULL;
+   char* buf = NULL;
+   size_t buf_len = 1024 * 1024;
+   size_t kept = 0;
+   size_t n;
+   off_t position = 0;
+   off_t last = 0;
+   char* p = NULL;
+   char* end = NULL;
+   int capacity = 16;
+   int number_of_parts = 0;
+   off_t* offsets = NULL;
+   off_t* o = NULL;
+   struct bzip2_split* s = NULL;
+
+   *split = NULL;
+
+   buf = (char*)malloc(buf_len + BZIP2_MAGIC_LENGTH);
+   offsets = (off_t*)malloc(capacity * sizeof(off_t));
+   if (buf == NULL || offsets == NULL)
+   {
+      goto error;
+   }
+
+   f = fopen(from, "rb");
+   if (f == NULL)
    {
-      fclose(from_ptr);
+      goto error;
    }
 
+   offsets[number_of_parts++] = 0;
+
+   // the last bytes of a read are kept, so a header that crosses reads is found
+   while ((n = fread(buf + kept, 1, buf_len, f)) > 0)
+   {
+      n += kept;
+      end = buf + n;
+      p = buf;
+
+      while ((p = memmem(p, end - p, "BZh", 3)) != NULL && end - p >= BZIP2_MAGIC_LENGTH)
+      {
+         off_t offset = position + (p - buf);
+
+         if (p[3] >= '1' && p[3] <= '9' && !memcmp(p + 4, block_magic, sizeof(block_magic)) &&
+             offset - last >= BZIP2_BLOCK_SIZE)
+         {
+            if (number_of_parts == capacity)
+            {
+               capacity *= 2;
+               o = (off_t*)realloc(offsets, capacity * sizeof(off_t));
+               if (o == NULL)
+               {
+                  goto error;
+               }
+               offsets = o;
+            }
+
+            offsets[number_of_parts++] = offset;
+            last = offset;
+         }
+
+         p++;
+      }
+
+      kept = MIN(n, (size_t)BZIP2_MAGIC_LENGTH - 1);
+      memmove(buf, end - kept, kept);
+      position += n - kept;
+   }
+
+   if (ferror(f) || number_of_parts < 2)
+   {
+      goto error;
+   }
+
+   // the end of the last part
+   o = (off_t*)realloc(offsets, (number_of_parts + 1) * sizeof(off_t));
+   if (o == NULL)
+   {
+      goto error;
+   }
+   offsets = o;
+   offsets[number_of_parts] = position + kept;
+
+   s = (struct bzip2_split*)calloc(1, sizeof(struct bzip2_split));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   s->split.number_of_parts = number_of_parts;
+   atomic_init(&s->split.remaining, number_of_parts);
+   atomic_init(&s->split.failed, false);
+   s->offsets = offsets;
+
+   fclose(f);
+   free(buf);
+
+   *split = s;
+
+   return 0;
+
+error:
+
+   if (f != NULL)
+   {
+      fclose(f);
+   }
+
+   free(buf);
+   free(offsets);
+
    return 1;
 }
 
+static int
+bzip2_split_decompress(char* directory, char* from, char* to, struct workers* workers)
+{
+   int parts;
+   struct bzip2_split* split = NULL;
+   struct worker_input* wi = NULL;
+
+   if (bzip2_streams(from, &split))
+   {
+      return 1;
+   }
+
+   parts = split->split.number_of_parts;
+
+   for (int i = 0; i < parts; i++)
+   {
+      if (pgmoneta_create_worker_input(directory, from, to, i, workers, &wi))
+      {
+         if (i == 0)
+         {
+            // nothing is queued, so the file is decompressed as a whole
+            free(split->offsets);
+            free(split);
+            return 1;
+         }
+
+         // the parts that are not queued count as failed
+         atomic_store(&split->split.failed, true);
+         if (atomic_fetch_sub(&split->split.remaining, parts - i) == parts - i)
+         {
+            bzip2_parts_delete(to, parts);
+            free(split->offsets);
+            free(split);
+         }
+         if (workers != NULL)
+         {
+            workers->outcome = false;
+         }
+         return 0;
+      }
+
+      wi->offset = split->offsets[i];
+      wi->length = (size_t)(split->offsets[i + 1] - split->offsets[i]);
+      wi->split = &split->split;
+      wi->argument = split;
+
+      pgmoneta_workers_add(workers, do_bzip2_decompress_part, wi);
+   }
+
+   return 0;
+}
+
 int
 pgmoneta_bunzip2_file(char* from, char* to)
 {
    if (pgmoneta_ends_with(from, ".bz2"))
    {
-      if (bzip2_decompress_file(from, to))
+      if (bzip2_decompress(from, to))
       {
          pgmoneta_log_error("Bzip2: Could not decompress %s", from);
          goto error;
@@ -0,0 +1,930 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <catalog.h>
+#include <info.h>
+#include <logging.h>
+#include <utils.h>
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define CATALOG_MAGIC_SIZE   8
+#define CATALOG_RACY_SECONDS 2
+
+/**
+ * The header of a catalog
+ */
+struct catalog_header
+{
+   char magic[CATALOG_MAGIC_SIZE]; /**< The magic */
+   uint32_t version;               /**< The version of the format */
+   uint32_t record_size;           /**< The size of the backup structure */
+   uint32_t number_of_backups;     /**< The number of backups */
+   int64_t mtime_sec;              /**< The modification time of the directory, seconds */
+   int64_t mtime_nsec;             /**< The modification time of the directory, nanoseconds */
+};
+
+static char* catalog_path(char* directory, char* suffix);
+static int catalog_mtime(char* directory, struct timespec* mtime);
+static int catalog_lock(char* directory);
+static void catalog_unlock(int fd);
+static int catalog_read(char* directory, struct catalog_header* header, int* number_of_backups, struct backup*** backups);
+static int catalog_write(char* directory, struct catalog_header* header, int number_of_backups, struct backup** backups);
+static int catalog_write_backup(FILE* file, struct backup* backup);
+static int catalog_read_backup(char* buffer, size_t size, size_t* offset, struct backup* backup);
+static int catalog_read_bytes(char* buffer, size_t size, size_t* offset, void* dst, size_t length);
+static void catalog_free(int number_of_backups, struct backup** backups);
+static int catalog_lower_bound(int number_of_backups, struct backup** backups, char* label);
+static uint64_t catalog_end_lsn(struct backup* backup);
+static time_t catalog_end_time(struct backup* backup);
+
+int
+pgmoneta_catalog_load(char* directory, int* number_of_backups, struct backup*** backups)
+{
+   struct timespec mtime;
+   struct catalog_header header;
+
+   *number_of_backups = 0;
+   *backups = NULL;
+
+   if (catalog_mtime(directory, &mtime))
+   {
+      goto error;
+   }
+
+   if (catalog_read(directory, &header, number_of_backups, backups))
+   {
+      goto error;
+   }
+
+   if (header.mtime_sec != (int64_t)mtime.tv_sec || header.mtime_nsec != (int64_t)mtime.tv_nsec)
+   {
+      catalog_free(*number_of_backups, *backups);
+      *number_of_backups = 0;
+      *backups = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_catalog_store(char* directory, struct timespec* mtime, int number_of_backups, struct backup** backups)
+{
+   int fd = -1;
+   int ret;
+   struct timespec now;
+   struct catalog_header header;
+
+   /* File times are coarse, so a change right after the directory was read could keep its time */
+   clock_gettime(CLOCK_REALTIME, &now);
+   if (now.tv_sec - mtime->tv_sec < CATALOG_RACY_SECONDS)
+   {
+      return 0;
+   }
+
+   memset(&header, 0, sizeof(struct catalog_header));
+   memcpy(&header.magic[0], CATALOG_MAGIC, CATALOG_MAGIC_SIZE);
+   header.version = CATALOG_VERSION;
+   header.record_size = sizeof(struct backup);
+   header.number_of_backups = number_of_backups;
+   header.mtime_sec = mtime->tv_sec;
+   header.mtime_nsec = mtime->tv_nsec;
+
+   fd = catalog_lock(directory);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   ret = catalog_write(directory, &header, number_of_backups, backups);
+
+   catalog_unlock(fd);
+
+   return ret;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_catalog_version(char* directory, int64_t* version)
+{
+   char* path = NULL;
+   int64_t d;
+   int64_t c;
+   struct timespec mtime;
+   struct stat st;
+
+   *version = 0;
+
+   path = catalog_path(directory, CATALOG_SUFFIX);
+
+   if (catalog_mtime(directory, &mtime) || stat(path, &st))
+   {
+      goto error;
+   }
+
+   // both only move forward, so the newest of them changes when one of them does
+   d = (int64_t)mtime.tv_sec * 1000000000LL + mtime.tv_nsec;
+   c = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+   *version = MAX(d, c);
+
+   free(path);
+
+   return 0;
+
+error:
+
+   errno = 0;
+   free(path);
+
+   return 1;
+}
+
+int
+pgmoneta_catalog_update(char* directory)
+{
+   char* root = NULL;
+   char* label = NULL;
+   char* sep = NULL;
+   int fd = -1;
+   int index = -1;
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
+   struct backup** bcks = NULL;
+   struct backup* backup = NULL;
+   struct timespec mtime;
+   struct catalog_header header;
+
+   root = pgmoneta_append(root, directory);
+   while (strlen(root) > 1 && pgmoneta_ends_with(root, "/"))
+   {
+      root[strlen(root) - 1] = '\0';
+   }
+
+   sep = strrchr(root, '/');
+   if (sep == NULL || sep == root)
+   {
+      goto error;
+   }
+
+   *sep = '\0';
+   label = sep + 1;
+
+   fd = catalog_lock(root);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   /* A missing or stale catalog is rebuilt by the next read */
+   if (catalog_mtime(root, &mtime) || catalog_read(root, &header, &number_of_backups, &backups))
+   {
+      goto done;
+   }
+
+   if (header.mtime_sec != (int64_t)mtime.tv_sec || header.mtime_nsec != (int64_t)mtime.tv_nsec)
+   {
+      goto done;
+   }
+
+   if (pgmoneta_get_backup(root, label, &backup))
+   {
+      goto error;
+   }
+
+   for (int i = 0; index == -1 && i < number_of_backups; i++)
+   {
+      if (!strcmp(backups[i]->label, label))
+      {
+         index = i;
+      }
+   }
+
+   if (index != -1)
+   {
+      free(backups[index]);
+      backups[index] = backup;
+      backup = NULL;
+   }
+   else
+   {
+      bcks = (struct backup**)realloc(backups, (number_of_backups + 1) * sizeof(struct backup*));
+      if (bcks == NULL)
+      {
+         goto error;
+      }
+      backups = bcks;
+
+      index = number_of_backups;
+      while (index > 0 && strcmp(backups[index - 1]->label, label) > 0)
+      {
+         backups[index] = backups[index - 1];
+         index--;
+      }
+      backups[index] = backup;
+      backup = NULL;
+      number_of_backups++;
+   }
+
+   header.number_of_backups = number_of_backups;
+
+   if (catalog_write(root, &header, number_of_backups, backups))
+   {
+      goto error;
+   }
+
+done:
+
+   catalog_unlock(fd);
+   catalog_free(number_of_backups, backups);
+   free(root);
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      catalog_unlock(fd);
+   }
+
+   /* Drop the catalog, so the next read rebuilds it */
+   if (root != NULL)
+   {
+      char* path = catalog_path(root, CATALOG_SUFFIX);
+
+      if (path != NULL)
+      {
+         unlink(path);
+      }
+      free(path);
+   }
+
+   free(backup);
+   catalog_free(number_of_backups, backups);
+   free(root);
+
+   return 1;
+}
+
+int
+pgmoneta_catalog_search(int number_of_backups, struct backup** backups, char* identifier)
+{
+   int index = -1;
+
+   if (identifier == NULL || backups == NULL)
+   {
+      return -1;
+   }
+
+   if (!strcmp(identifier, "oldest"))
+   {
+      for (int i = 0; index == -1 && i < number_of_backups; i++)
+      {
+         if (backups[i]->valid == VALID_TRUE)
+         {
+            index = i;
+         }
+      }
+   }
+   else if (!strcmp(identifier, "latest") || !strcmp(identifier, "newest"))
+   {
+      for (int i = number_of_backups - 1; index == -1 && i >= 0; i--)
+      {
+         if (backups[i]->valid == VALID_TRUE)
+         {
+            index = i;
+         }
+      }
+   }
+   else
+   {
+      /* A label sorts before the labels it is a prefix of */
+      int first = catalog_lower_bound(number_of_backups, backups, identifier);
+
+      if (first < number_of_backups && !strcmp(backups[first]->label, identifier) && backups[first]->valid == VALID_TRUE)
+      {
+         index = first;
+      }
+
+      for (int i = first; index == -1 && i < number_of_backups && pgmoneta_starts_with(backups[i]->label, identifier); i++)
+      {
+         if (backups[i]->valid == VALID_TRUE)
+         {
+            index = i;
+         }
+      }
+   }
+
+   return index;
+}
+
+int
+pgmoneta_catalog_target(int number_of_backups, struct backup** backups, char* position, int* index)
+{
+   char tokens[512];
+   char* ptr = NULL;
+   bool has_lsn = false;
+   bool has_time = false;
+   uint64_t lsn = 0;
+   time_t target_time = 0;
+   int low = 0;
+   int high = number_of_backups;
+
+   *index = -1;
+
+   if (position == NULL)
+   {
+      return 0;
+   }
+
+   memset(&tokens[0], 0, sizeof(tokens));
+   snprintf(&tokens[0], sizeof(tokens), "%s", position);
+
+   ptr = strtok(&tokens[0], ",");
+
+   while (ptr != NULL)
+   {
+      if (pgmoneta_starts_with(ptr, "lsn="))
+      {
+         uint32_t hi = 0;
+         uint32_t lo = 0;
+
+         if (sscanf(ptr + strlen("lsn="), "%X/%X", &hi, &lo) == 2)
+         {
+            lsn = ((uint64_t)hi << 32) | lo;
+            has_lsn = true;
+         }
+      }
+      else if (pgmoneta_starts_with(ptr, "time="))
+      {
+         struct tm tm;
+
+         memset(&tm, 0, sizeof(struct tm));
+
+         /* The labels are in local time */
+         if (strptime(ptr + strlen("time="), "%Y-%m-%d %H:%M:%S", &tm) != NULL)
+         {
+            tm.tm_isdst = -1;
+            target_time = mktime(&tm);
+            has_time = true;
+         }
+      }
+
+      ptr = strtok(NULL, ",");
+   }
+
+   if (!has_lsn && !has_time)
+   {
+      return 0;
+   }
+
+   /* The first backup that ended after the target */
+   while (low < high)
+   {
+      int middle = low + (high - low) / 2;
+      bool before = has_lsn ? catalog_end_lsn(backups[middle]) <= lsn : catalog_end_time(backups[middle]) <= target_time;
+
+      if (before)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+
+   for (int i = low - 1; *index == -1 && i >= 0; i--)
+   {
+      if (backups[i]->valid == VALID_TRUE)
+      {
+         *index = i;
+      }
+   }
+
+   if (*index == -1)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_catalog_chain(int number_of_backups, struct backup** backups, int index, int** chain, int* length)
+{
+   int* c = NULL;
+   int n = 0;
+   int current = index;
+
+   *chain = NULL;
+   *length = 0;
+
+   if (index < 0 || index >= number_of_backups)
+   {
+      goto error;
+   }
+
+   c = (int*)malloc(number_of_backups * sizeof(int));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   c[n++] = current;
+
+   while (backups[current]->type != TYPE_FULL)
+   {
+      int parent = catalog_lower_bound(number_of_backups, backups, backups[current]->parent_label);
+
+      if (strlen(backups[current]->parent_label) == 0 || parent >= number_of_backups ||
+          strcmp(backups[parent]->label, backups[current]->parent_label) ||
+          backups[parent]->valid != VALID_TRUE || n >= number_of_backups)
+      {
+         pgmoneta_log_debug("Catalog: Missing parent %s of %s", backups[current]->parent_label, backups[current]->label);
+         goto error;
+      }
+
+      current = parent;
+      c[n++] = current;
+   }
+
+   *chain = c;
+   *length = n;
+
+   return 0;
+
+error:
+
+   free(c);
+
+   return 1;
+}
+
+static char*
+catalog_path(char* directory, char* suffix)
+{
+   char* path = NULL;
+
+   path = pgmoneta_append(path, directory);
+   while (path != NULL && strlen(path) > 1 && pgmoneta_ends_with(path, "/"))
+   {
+      path[strlen(path) - 1] = '\0';
+   }
+   path = pgmoneta_append(path, suffix);
+
+   return path;
+}
+
+static int
+catalog_mtime(char* directory, struct timespec* mtime)
+{
+   struct stat st;
+
+   if (stat(directory, &st))
+   {
+      return 1;
+   }
+
+   *mtime = st.st_mtim;
+
+   return 0;
+}
+
+static int
+catalog_lock(char* directory)
+{
+   char* path = NULL;
+   int fd = -1;
+
+   path = catalog_path(directory, CATALOG_SUFFIX ".lock");
+   if (path == NULL)
+   {
+      return -1;
+   }
+
+   /* The workflows of a server may run in different processes */
+   fd = open(path, O_CREAT | O_RDWR, 0600);
+   if (fd == -1 || flock(fd, LOCK_EX))
+   {
+      pgmoneta_log_debug("Catalog: Could not lock %s", path);
+      if (fd != -1)
+      {
+         close(fd);
+      }
+      fd = -1;
+   }
+
+   free(path);
+
+   return fd;
+}
+
+static void
+catalog_unlock(int fd)
+{
+   flock(fd, LOCK_UN);
+   close(fd);
+}
+
+static int
+catalog_read(char* directory, struct catalog_header* header, int* number_of_backups, struct backup*** backups)
+{
+   char* path = NULL;
+   char* buffer = NULL;
+   size_t offset = 0;
+   int n = 0;
+   FILE* file = NULL;
+   struct stat st;
+   struct backup** bcks = NULL;
+
+   *number_of_backups = 0;
+   *backups = NULL;
+
+   path = catalog_path(directory, CATALOG_SUFFIX);
+   if (path == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fstat(fileno(file), &st) || st.st_size < (off_t)sizeof(struct catalog_header))
+   {
+      goto error;
+   }
+
+   buffer = (char*)malloc(st.st_size);
+   if (buffer == NULL || fread(buffer, 1, st.st_size, file) != (size_t)st.st_size)
+   {
+      goto error;
+   }
+
+   if (catalog_read_bytes(buffer, st.st_size, &offset, header, sizeof(struct catalog_header)))
+   {
+      goto error;
+   }
+
+   if (memcmp(&header->magic[0], CATALOG_MAGIC, CATALOG_MAGIC_SIZE) ||
+       header->version != CATALOG_VERSION ||
+       header->record_size != sizeof(struct backup))
+   {
+      goto error;
+   }
+
+   bcks = (struct backup**)calloc(header->number_of_backups + 1, sizeof(struct backup*));
+   if (bcks == NULL)
+   {
+      goto error;
+   }
+
+   for (n = 0; n < (int)header->number_of_backups; n++)
+   {
+      bcks[n] = (struct backup*)calloc(1, sizeof(struct backup));
+      if (bcks[n] == NULL)
+      {
+         goto error;
+      }
+
+      if (catalog_read_backup(buffer, st.st_size, &offset, bcks[n]))
+      {
+         n++;
+         goto error;
+      }
+   }
+
+   if (offset != (size_t)st.st_size)
+   {
+      goto error;
+   }
+
+   *number_of_backups = n;
+   *backups = bcks;
+
+   fclose(file);
+   free(buffer);
+   free(path);
+
+   return 0;
+
+error:
+
+   catalog_free(n, bcks);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   free(buffer);
+   free(path);
+
+   return 1;
+}
+
+static int
+catalog_write(char* directory, struct catalog_header* header, int number_of_backups, struct backup** backups)
+{
+   char* path = NULL;
+   char* tmp = NULL;
+   FILE* file = NULL;
+
+   path = catalog_path(directory, CATALOG_SUFFIX);
+   tmp = catalog_path(directory, CATALOG_SUFFIX ".tmp");
+   if (path == NULL || tmp == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(tmp, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_debug("Catalog: Could not create %s due to %s", tmp, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   if (fwrite(header, 1, sizeof(struct catalog_header), file) != sizeof(struct catalog_header))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      if (catalog_write_backup(file, backups[i]))
+      {
+         goto error;
+      }
+   }
+
+   if (fflush(file) || fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   /* Readers don't lock, so the catalog is replaced in one step */
+   if (rename(tmp, path))
+   {
+      goto error;
+   }
+
+   free(path);
+   free(tmp);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   if (tmp != NULL)
+   {
+      unlink(tmp);
+   }
+   free(path);
+   free(tmp);
+
+   return 1;
+}
+
+static int
+catalog_write_backup(FILE* file, struct backup* backup)
+{
+   uint32_t tablespaces;
+   uint32_t comments;
+   uint32_t extra;
+   size_t start = offsetof(struct backup, start_lsn_hi32);
+   size_t type = offsetof(struct backup, type);
+
+   /* The tablespace and text arrays are mostly empty, so only their content is stored */
+   tablespaces = backup->number_of_tablespaces < MAX_NUMBER_OF_TABLESPACES ? backup->number_of_tablespaces : MAX_NUMBER_OF_TABLESPACES;
+   comments = strnlen(backup->comments, MAX_COMMENT - 1);
+   extra = strnlen(backup->extra, MAX_EXTRA_PATH - 1);
+
+   if (fwrite(backup, 1, offsetof(struct backup, tablespaces), file) != offsetof(struct backup, tablespaces))
+   {
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < tablespaces; i++)
+   {
+      if (fwrite(backup->tablespaces[i], 1, MISC_LENGTH, file) != MISC_LENGTH ||
+          fwrite(backup->tablespaces_oids[i], 1, MISC_LENGTH, file) != MISC_LENGTH ||
+          fwrite(backup->tablespaces_paths[i], 1, MAX_PATH, file) != MAX_PATH)
+      {
+         goto error;
+      }
+   }
+
+   if (fwrite((char*)backup + start, 1, offsetof(struct backup, comments) - start, file) != offsetof(struct backup, comments) - start)
+   {
+      goto error;
+   }
+
+   if (fwrite(&comments, 1, sizeof(uint32_t), file) != sizeof(uint32_t) ||
+       fwrite(backup->comments, 1, comments, file) != comments ||
+       fwrite(&extra, 1, sizeof(uint32_t), file) != sizeof(uint32_t) ||
+       fwrite(backup->extra, 1, extra, file) != extra)
+   {
+      goto error;
+   }
+
+   if (fwrite((char*)backup + type, 1, sizeof(struct backup) - type, file) != sizeof(struct backup) - type)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+catalog_read_backup(char* buffer, size_t size, size_t* offset, struct backup* backup)
+{
+   uint32_t tablespaces;
+   uint32_t comments;
+   uint32_t extra;
+   size_t start = offsetof(struct backup, start_lsn_hi32);
+   size_t type = offsetof(struct backup, type);
+
+   if (catalog_read_bytes(buffer, size, offset, backup, offsetof(struct backup, tablespaces)))
+   {
+      goto error;
+   }
+
+   tablespaces = backup->number_of_tablespaces < MAX_NUMBER_OF_TABLESPACES ? backup->number_of_tablespaces : MAX_NUMBER_OF_TABLESPACES;
+
+   for (uint32_t i = 0; i < tablespaces; i++)
+   {
+      if (catalog_read_bytes(buffer, size, offset, backup->tablespaces[i], MISC_LENGTH) ||
+          catalog_read_bytes(buffer, size, offset, backup->tablespaces_oids[i], MISC_LENGTH) ||
+          catalog_read_bytes(buffer, size, offset, backup->tablespaces_paths[i], MAX_PATH))
+      {
+         goto error;
+      }
+   }
+
+   if (catalog_read_bytes(buffer, size, offset, (char*)backup + start, offsetof(struct backup, comments) - start))
+   {
+      goto error;
+   }
+
+   if (catalog_read_bytes(buffer, size, offset, &comments, sizeof(uint32_t)) || comments >= MAX_COMMENT ||
+       catalog_read_bytes(buffer, size, offset, backup->comments, comments))
+   {
+      goto error;
+   }
+
+   if (catalog_read_bytes(buffer, size, offset, &extra, sizeof(uint32_t)) || extra >= MAX_EXTRA_PATH ||
+       catalog_read_bytes(buffer, size, offset, backup->extra, extra))
+   {
+      goto error;
+   }
+
+   if (catalog_read_bytes(buffer, size, offset, (char*)backup + type, sizeof(struct backup) - type))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+catalog_read_bytes(char* buffer, size_t size, size_t* offset, void* dst, size_t length)
+{
+   if (*offset + length > size)
+   {
+      return 1;
+   }
+
+   memcpy(dst, buffer + *offset, length);
+   *offset += length;
+
+   return 0;
+}
+
+static void
+catalog_free(int number_of_backups, struct backup** backups)
+{
+   if (backups == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+}
+
+static int
+catalog_lower_bound(int number_of_backups, struct backup** backups, char* label)
+{
+   int low = 0;
+   int high = number_of_backups;
+
+   while (low < high)
+   {
+      int middle = low + (high - low) / 2;
+
+      if (strcmp(backups[middle]->label, label) < 0)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+
+   return low;
+}
+
+static uint64_t
+catalog_end_lsn(struct backup* backup)
+{
+   return ((uint64_t)backup->end_lsn_hi32 << 32) | backup->end_lsn_lo32;
+}
+
+static time_t
+catalog_end_time(struct backup* backup)
+{
+   struct tm tm;
+
+   memset(&tm, 0, sizeof(struct tm));
+
+   if (strptime(backup->label, "%Y%m%d%H%M%S", &tm) == NULL)
+   {
+      return 0;
+   }
+
+   tm.tm_isdst = -1;
+
+   return mktime(&tm) + (time_t)backup->total_elapsed_time;
+}
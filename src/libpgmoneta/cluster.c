@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <cluster.h>
+#include <logging.h>
+#include <utils.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static char* node_path(char* node);
+static char* lease_path(int server);
+static int read_lease(char* path, char* node, time_t* expiry);
+static int write_lease(char* path, time_t expiry, bool exclusive);
+static int alive_nodes(time_t now);
+static bool claim(int server, time_t now);
+static void lose(int server, char* holder);
+
+bool
+pgmoneta_cluster_enabled(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return strlen(config->cluster_dir) > 0;
+}
+
+int
+pgmoneta_cluster_join(void)
+{
+   char* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!pgmoneta_cluster_enabled())
+   {
+      return 0;
+   }
+
+   d = pgmoneta_append(NULL, config->cluster_dir);
+   d = pgmoneta_append(d, "/nodes/");
+   if (pgmoneta_mkdir(d))
+   {
+      goto error;
+   }
+   free(d);
+
+   d = pgmoneta_append(NULL, config->cluster_dir);
+   d = pgmoneta_append(d, "/leases/");
+   if (pgmoneta_mkdir(d))
+   {
+      goto error;
+   }
+   free(d);
+   d = NULL;
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      config->servers[i].cluster_owned = false;
+   }
+
+   pgmoneta_log_info("Cluster: Joined %s as %s", config->cluster_dir, config->cluster_node);
+
+   pgmoneta_cluster_balance();
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Cluster: Could not create %s", d);
+   free(d);
+
+   return 1;
+}
+
+void
+pgmoneta_cluster_balance(void)
+{
+   int alive;
+   int share;
+   int owned = 0;
+   time_t now;
+   time_t expiry;
+   time_t holder_expiry;
+   char holder[MISC_LENGTH];
+   char* path = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!pgmoneta_cluster_enabled())
+   {
+      return;
+   }
+
+   now = time(NULL);
+   expiry = now + config->cluster_lease;
+
+   path = node_path(config->cluster_node);
+   if (write_lease(path, expiry, false))
+   {
+      pgmoneta_log_warn("Cluster: Could not write the heartbeat %s", path);
+   }
+   free(path);
+
+   alive = alive_nodes(now);
+   share = (config->number_of_servers + alive - 1) / alive;
+
+   /* Renew the leases of this node, and notice the ones taken over */
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (!config->servers[i].cluster_owned)
+      {
+         continue;
+      }
+
+      path = lease_path(i);
+      if (read_lease(path, &holder[0], &holder_expiry))
+      {
+         lose(i, NULL);
+      }
+      else if (strcmp(holder, config->cluster_node))
+      {
+         lose(i, &holder[0]);
+      }
+      else
+      {
+         write_lease(path, expiry, false);
+         owned++;
+      }
+      free(path);
+   }
+
+   /* Give up one server over the share at a time, one without an active backup */
+   for (int i = config->number_of_servers - 1; owned > share && i >= 0; i--)
+   {
+      if (config->servers[i].cluster_owned && !atomic_load(&config->states[i].backup))
+      {
+         path = lease_path(i);
+         unlink(path);
+         free(path);
+
+         pgmoneta_log_info("Cluster: Released %s for %d nodes", config->servers[i].name, alive);
+         lose(i, NULL);
+         owned--;
+         break;
+      }
+   }
+
+   for (int i = 0; owned < share && i < config->number_of_servers; i++)
+   {
+      if (!config->servers[i].cluster_owned && claim(i, now))
+      {
+         owned++;
+      }
+   }
+}
+
+void
+pgmoneta_cluster_leave(void)
+{
+   char* path = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!pgmoneta_cluster_enabled())
+   {
+      return;
+   }
+
+   /* The other nodes take over at once instead of at the end of the leases */
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (config->servers[i].cluster_owned)
+      {
+         path = lease_path(i);
+         unlink(path);
+         free(path);
+
+         config->servers[i].cluster_owned = false;
+      }
+   }
+
+   path = node_path(config->cluster_node);
+   unlink(path);
+   free(path);
+
+   pgmoneta_log_info("Cluster: Left %s", config->cluster_dir);
+}
+
+bool
+pgmoneta_cluster_owns(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!pgmoneta_cluster_enabled())
+   {
+      return true;
+   }
+
+   return config->servers[server].cluster_owned;
+}
+
+static char*
+node_path(char* node)
+{
+   char* path = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   path = pgmoneta_append(path, config->cluster_dir);
+   path = pgmoneta_append(path, "/nodes/");
+   path = pgmoneta_append(path, node);
+
+   return path;
+}
+
+static char*
+lease_path(int server)
+{
+   char* path = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   path = pgmoneta_append(path, config->cluster_dir);
+   path = pgmoneta_append(path, "/leases/");
+   path = pgmoneta_append(path, config->servers[server].name);
+
+   return path;
+}
+
+static int
+read_lease(char* path, char* node, time_t* expiry)
+{
+   long long e = 0;
+   FILE* file = NULL;
+
+   memset(node, 0, MISC_LENGTH);
+   *expiry = 0;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+   if (fscanf(file, "%127s %lld", node, &e) != 2)
+   {
+      fclose(file);
+      return 1;
+   }
+
+   fclose(file);
+
+   *expiry = (time_t)e;
+
+   return 0;
+}
+
+static int
+write_lease(char* path, time_t expiry, bool exclusive)
+{
+   int fd;
+   int length;
+   char line[MISC_LENGTH * 2];
+   char* tmp = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   length = snprintf(&line[0], sizeof(line), "%s %lld\n", config->cluster_node, (long long)expiry);
+
+   if (exclusive)
+   {
+      /* Only one node can create the lease */
+      fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+   }
+   else
+   {
+      tmp = pgmoneta_append(NULL, config->cluster_dir);
+      tmp = pgmoneta_append(tmp, "/.");
+      tmp = pgmoneta_append(tmp, config->cluster_node);
+      tmp = pgmoneta_append(tmp, ".tmp");
+
+      fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   }
+
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   if (write(fd, &line[0], length) != length || fsync(fd))
+   {
+      close(fd);
+      goto error;
+   }
+
+   close(fd);
+
+   if (tmp != NULL && rename(tmp, path))
+   {
+      goto error;
+   }
+
+   free(tmp);
+
+   return 0;
+
+error:
+
+   if (tmp != NULL)
+   {
+      unlink(tmp);
+   }
+   free(tmp);
+
+   return 1;
+}
+
+static int
+alive_nodes(time_t now)
+{
+   int alive = 0;
+   char node[MISC_LENGTH];
+   char* d = NULL;
+   char* path = NULL;
+   time_t expiry;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_append(NULL, config->cluster_dir);
+   d = pgmoneta_append(d, "/nodes/");
+
+   dir = opendir(d);
+   if (dir != NULL)
+   {
+      while ((entry = readdir(dir)) != NULL)
+      {
+         if (entry->d_name[0] == '.')
+         {
+            continue;
+         }
+
+         path = pgmoneta_append(NULL, d);
+         path = pgmoneta_append(path, entry->d_name);
+
+         if (!read_lease(path, &node[0], &expiry) && expiry >= now)
+         {
+            alive++;
+         }
+
+         free(path);
+      }
+
+      closedir(dir);
+   }
+
+   free(d);
+
+   return alive > 0 ? alive : 1;
+}
+
+static bool
+claim(int server, time_t now)
+{
+   bool claimed = false;
+   char holder[MISC_LENGTH];
+   char* path = NULL;
+   char* stale = NULL;
+   time_t expiry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   path = lease_path(server);
+
+   if (!read_lease(path, &holder[0], &expiry))
+   {
+      if (strcmp(holder, config->cluster_node) && expiry >= now)
+      {
+         goto done;
+      }
+
+      /* Move the expired lease away, only one node wins the rename */
+      stale = pgmoneta_append(NULL, path);
+      stale = pgmoneta_append(stale, ".stale.");
+      stale = pgmoneta_append(stale, config->cluster_node);
+
+      if (rename(path, stale))
+      {
+         goto done;
+      }
+
+      if (!read_lease(stale, &holder[0], &expiry) &&
+          strcmp(holder, config->cluster_node) && expiry >= now)
+      {
+         /* Renewed in the meantime, so put it back */
+         if (link(stale, path) && errno != EEXIST)
+         {
+            pgmoneta_log_warn("Cluster: Could not restore the lease of %s", config->servers[server].name);
+         }
+         unlink(stale);
+         goto done;
+      }
+
+      unlink(stale);
+   }
+
+   if (!write_lease(path, now + config->cluster_lease, true))
+   {
+      claimed = true;
+      config->servers[server].cluster_owned = true;
+      pgmoneta_log_info("Cluster: Claimed %s", config->servers[server].name);
+   }
+
+done:
+
+   free(path);
+   free(stale);
+
+   return claimed;
+}
+
+static void
+lose(int server, char* holder)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   config->servers[server].cluster_owned = false;
+
+   /* Stop the WAL streaming, the new owner streams from now on */
+   atomic_store(&config->states[server].wal_restart, true);
+
+   if (holder != NULL)
+   {
+      pgmoneta_log_warn("Cluster: %s was taken over by %s", config->servers[server].name, holder);
+   }
+}
@@ -26,14 +26,59 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <pgmoneta.h>
+#include <backup.h>
 #include <bzip2_compression.h>
 #include <compression.h>
 #include <gzip_compression.h>
 #include <logging.h>
 #include <lz4_compression.h>
+#include <network.h>
 #include <utils.h>
 #include <zstandard_compression.h>
 
+#include <fcntl.h>
+#include <lz4.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* The length of a measurement window in seconds */
+#define ADAPTIVE_WINDOW 1.0
+/* Go faster below this share of the target */
+#define ADAPTIVE_LOW    0.9
+/* Go stronger above this share of the target */
+#define ADAPTIVE_HIGH   1.25
+
+/* Files below this size are always compressed */
+#define PROBE_MINIMUM_SIZE (64 * 1024)
+/* The number of samples of a file */
+#define PROBE_SAMPLES      8
+/* The size of a sample */
+#define PROBE_SAMPLE_SIZE  4096
+/* The LZ4 output of the samples must be below this share of the input */
+#define PROBE_RATIO        0.97
+/* The collision entropy of the bytes must be below 7.5 bits, as 2^7.5 */
+#define PROBE_ENTROPY      181
+
+/** @struct adaptive
+ * Defines the adaptive compression level
+ */
+struct adaptive
+{
+   bool active;                  /**< Is the level adapted */
+   pthread_mutex_t lock;         /**< The lock */
+   int level;                    /**< The current level */
+   int minimum;                  /**< The fastest level */
+   int maximum;                  /**< The strongest level */
+   double target;                /**< The target in bytes per second */
+   size_t bytes;                 /**< The input bytes of the current window */
+   struct timespec start;        /**< The start of the current window */
+};
+
+static struct adaptive adaptive = {.active = false, .lock = PTHREAD_MUTEX_INITIALIZER};
+
 static int
 pgmoneta_decompression_file_callback(char* path, compression_func* decompress_cb)
 {
@@ -74,3 +119,193 @@ pgmoneta_decompress(char* from, char* to)
 error:
    return 1;
 }
+
+void
+pgmoneta_compression_adaptive_start(int server, int minimum, int maximum, int level)
+{
+   long backup_rate;
+   long network_rate;
+   double target = 0;
+
+   backup_rate = pgmoneta_get_backup_max_rate(server);
+   network_rate = pgmoneta_get_network_max_rate(server);
+
+   if (backup_rate > 0)
+   {
+      target = (double)backup_rate;
+   }
+
+   if (network_rate > 0 && (target == 0 || network_rate < target))
+   {
+      target = (double)network_rate;
+   }
+
+   pthread_mutex_lock(&adaptive.lock);
+
+   adaptive.active = target > 0;
+   adaptive.minimum = minimum;
+   adaptive.maximum = maximum;
+   adaptive.level = MAX(minimum, MIN(maximum, level));
+   adaptive.target = target;
+   adaptive.bytes = 0;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &adaptive.start);
+
+   pthread_mutex_unlock(&adaptive.lock);
+
+   if (target == 0)
+   {
+      pgmoneta_log_debug("Adaptive compression: No throughput target for server %d", server);
+   }
+}
+
+int
+pgmoneta_compression_adaptive_level(int level)
+{
+   int l = level;
+
+   pthread_mutex_lock(&adaptive.lock);
+   if (adaptive.active)
+   {
+      l = adaptive.level;
+   }
+   pthread_mutex_unlock(&adaptive.lock);
+
+   return l;
+}
+
+void
+pgmoneta_compression_adaptive_update(size_t bytes)
+{
+   struct timespec now;
+   double elapsed;
+   double rate;
+
+   pthread_mutex_lock(&adaptive.lock);
+
+   if (!adaptive.active)
+   {
+      goto done;
+   }
+
+   adaptive.bytes += bytes;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+   elapsed = pgmoneta_compute_duration(adaptive.start, now);
+
+   if (elapsed < ADAPTIVE_WINDOW)
+   {
+      goto done;
+   }
+
+   // compressing slower than the target makes compression the bottleneck, faster leaves time for a better ratio
+   rate = adaptive.bytes / elapsed;
+
+   if (rate < adaptive.target * ADAPTIVE_LOW && adaptive.level > adaptive.minimum)
+   {
+      adaptive.level--;
+      pgmoneta_log_debug("Adaptive compression: %.0f B/s for %.0f B/s, level %d", rate, adaptive.target, adaptive.level);
+   }
+   else if (rate > adaptive.target * ADAPTIVE_HIGH && adaptive.level < adaptive.maximum)
+   {
+      adaptive.level++;
+      pgmoneta_log_debug("Adaptive compression: %.0f B/s for %.0f B/s, level %d", rate, adaptive.target, adaptive.level);
+   }
+
+   adaptive.bytes = 0;
+   adaptive.start = now;
+
+done:
+
+   pthread_mutex_unlock(&adaptive.lock);
+}
+
+void
+pgmoneta_compression_adaptive_stop(void)
+{
+   pthread_mutex_lock(&adaptive.lock);
+   adaptive.active = false;
+   pthread_mutex_unlock(&adaptive.lock);
+}
+
+bool
+pgmoneta_compression_incompressible(char* path)
+{
+   int fd = -1;
+   struct stat st;
+   off_t offset;
+   ssize_t n;
+   int compressed;
+   uint64_t sampled = 0;
+   uint64_t output = 0;
+   uint64_t collisions = 0;
+   uint64_t counts[256];
+   char sample[PROBE_SAMPLE_SIZE];
+   char out[LZ4_COMPRESSBOUND(PROBE_SAMPLE_SIZE)];
+   bool incompressible = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!config->compression_probe)
+   {
+      return false;
+   }
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1)
+   {
+      return false;
+   }
+
+   if (fstat(fd, &st) || st.st_size < PROBE_MINIMUM_SIZE)
+   {
+      goto done;
+   }
+
+   memset(counts, 0, sizeof(counts));
+
+   // samples spread evenly over the file, from the start to the end
+   for (int i = 0; i < PROBE_SAMPLES; i++)
+   {
+      offset = (st.st_size - PROBE_SAMPLE_SIZE) / (PROBE_SAMPLES - 1) * i;
+
+      n = pread(fd, sample, sizeof(sample), offset);
+      if (n <= 0)
+      {
+         goto done;
+      }
+
+      for (ssize_t j = 0; j < n; j++)
+      {
+         counts[(unsigned char)sample[j]]++;
+      }
+
+      compressed = LZ4_compress_default(sample, out, (int)n, sizeof(out));
+      if (compressed <= 0)
+      {
+         goto done;
+      }
+
+      sampled += (uint64_t)n;
+      output += (uint64_t)compressed;
+   }
+
+   for (int i = 0; i < 256; i++)
+   {
+      collisions += counts[i] * counts[i];
+   }
+
+   // no repeated strings, and bytes spread nearly evenly, so entropy coding gains little too
+   incompressible = output >= PROBE_RATIO * sampled && collisions * PROBE_ENTROPY <= sampled * sampled;
+
+   if (incompressible)
+   {
+      pgmoneta_log_trace("Compression: Storing %s as is", path);
+   }
+
+done:
+
+   close(fd);
+
+   return incompressible;
+}
@@ -29,6 +29,7 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <configuration.h>
+#include <cron.h>
 #include <logging.h>
 #include <management.h>
 #include <network.h>
@@ -41,8 +42,10 @@
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -63,8 +66,13 @@ static int as_logging_type(char* str);
 static int as_logging_level(char* str);
 static int as_logging_mode(char* str);
 static int as_hugepage(char* str);
+static int as_durability(char* str);
 static int as_compression(char* str);
 static int as_storage_engine(char* str);
+static int as_io_engine(char* str);
+static int as_io_cache(char* str);
+static int as_gzip_engine(char* str);
+static int as_verify_mode(char* str);
 static char* as_ciphers(char* str);
 static int as_encryption_mode(char* str);
 static unsigned int as_update_process_title(char* str, unsigned int default_policy);
@@ -72,16 +80,21 @@ static int as_logging_rotation_size(char* str, int* size);
 static int as_logging_rotation_age(char* str, int* age);
 static int as_seconds(char* str, int* age, int default_age);
 static int as_bytes(char* str, int* bytes, int default_bytes);
+static int as_size(char* str, size_t* bytes, size_t default_bytes);
 static int as_retention(char* str, int* days, int* weeks, int* months, int* years);
 static int as_create_slot(char* str, int* create_slot);
 static char* get_retention_string(int rt_days, int rt_weeks, int rt_months, int rt_year);
 
 static bool transfer_configuration(struct configuration* config, struct configuration* reload);
-static int copy_server(struct server* dst, struct server* src);
+static int copy_server(struct server* dst, struct server_state* state, struct server* src);
 static void copy_user(struct user* dst, struct user* src);
 static int restart_bool(char* name, bool e, bool n);
 static int restart_int(char* name, int e, int n);
 static int restart_string(char* name, char* e, char* n);
+static int reconnect_int(char* name, int* e, int n);
+static int reconnect_string(char* name, char* e, char* n, size_t size);
+static void build_server_index(struct configuration* config);
+static uint32_t server_hash(char* name);
 
 static void add_configuration_response(struct json* res);
 static void add_servers_configuration_response(struct json* res);
@@ -90,6 +103,8 @@ static bool is_empty_string(char* s);
 static int remove_leading_whitespace_and_comments(char* s, char** trimmed_line);
 
 static void split_extra(const char* extra, char res[MAX_EXTRA][MAX_EXTRA_PATH], int* count);
+static int split_volumes(char* volumes, char res[MAX_BACKUP_VOLUMES][MAX_PATH], int* count);
+static char* get_volumes_string(char volumes[MAX_BACKUP_VOLUMES][MAX_PATH], int count);
 
 /**
  *
@@ -105,32 +120,67 @@ pgmoneta_init_configuration(void* shm)
 
    config->compression_type = COMPRESSION_CLIENT_ZSTD;
    config->compression_level = 3;
+   config->wal_compression_type = -1;
+   config->wal_compression_level = -1;
 
    config->encryption = ENCRYPTION_NONE;
 
    config->storage_engine = STORAGE_ENGINE_LOCAL;
 
    config->workers = 0;
+   config->workers_per_device = 0;
+   config->workers_autoscale = false;
+   config->memory_budget = 0;
+   atomic_init(&config->memory_used, 0);
+   config->backup_durability = DURABILITY_SYNCFS;
+   config->backup_splice = false;
+   config->restore_durability = DURABILITY_SYNCFS;
 
    config->retention_days = 7;
    config->retention_weeks = -1;
    config->retention_months = -1;
    config->retention_years = -1;
    config->retention_interval = 300;
+   config->cluster_lease = 30;
 
    config->tls = false;
 
    config->blocking_timeout = 30;
+   config->management_workers = 2;
    config->authentication_timeout = 5;
 
    config->keep_alive = true;
    config->nodelay = true;
+   config->socket_buffer_size = 0;
+   config->ktls = false;
    config->non_blocking = true;
    config->backlog = 16;
    config->hugepage = HUGEPAGE_TRY;
 
    atomic_init(&config->active_restores, 0);
    atomic_init(&config->active_archives, 0);
+   atomic_init(&config->reload_generation, 0);
+   atomic_init(&config->wal_notify, 0);
+   atomic_init(&config->scram_lock, STATE_FREE);
+
+   for (int i = 0; i < NUMBER_OF_SERVERS; i++)
+   {
+      struct server_state* state = &config->states[i];
+
+      atomic_init(&state->wal_lsn, 0);
+      atomic_init(&state->backup, false);
+      atomic_init(&state->restore, 0);
+      atomic_init(&state->archiving, 0);
+      atomic_init(&state->delete, false);
+      atomic_init(&state->trash, 0);
+      atomic_init(&state->wal, false);
+      atomic_init(&state->wal_pending, false);
+      atomic_init(&state->wal_restart, false);
+      atomic_init(&state->operation_count, 0);
+      atomic_init(&state->failed_operation_count, 0);
+      atomic_init(&state->last_operation_time, 0);
+      atomic_init(&state->last_failed_operation_time, 0);
+   }
 
    config->update_process_title = UPDATE_PROCESS_TITLE_VERBOSE;
 
@@ -144,6 +194,82 @@ pgmoneta_init_configuration(void* shm)
 
    config->manifest = HASH_ALGORITHM_SHA256;
 
+   config->wal_stream_compression = false;
+   config->wal_synchronous = false;
+
+   config->wal_prealloc = 0;
+
+   config->wal_fanout_size = 0;
+
+   config->wal_receivers = 0;
+
+   config->backup_pipeline = false;
+
+   config->backup_connections = 0;
+
+   config->seekable_frame_size = 0;
+
+   config->compression_dictionary = false;
+
+   config->compression_adaptive = false;
+   config->compression_probe = false;
+
+   config->deduplication = false;
+   config->page_filter = false;
+
+   config->link_verify = 0;
+
+   config->io_engine = IO_ENGINE_SYNC;
+   config->io_cache = IO_CACHE_KEEP;
+   config->gzip_engine = GZIP_ENGINE_ZLIB;
+   config->sparse_files = false;
+   config->wal_pack = 0;
+   config->wal_compaction = false;
+
+   config->verify_mode = VERIFY_MODE_RESTORE;
+
+   config->verify_sample = 100;
+
+   config->verify_fail_fast = false;
+   config->trace_sample = 0;
+   config->trace_events = 16384;
+
+   config->s3_part_size = S3_DEFAULT_PART_SIZE;
+
+   config->s3_concurrency = 4;
+
+   config->s3_unsigned_payload = false;
+
+   config->azure_block_size = AZURE_DEFAULT_BLOCK_SIZE;
+
+   config->wal_archive_queue = 64;
+
+   config->wal_archive_retries = 5;
+
+   config->ssh_retries = 3;
+
+   config->ssh_manifest_diff = false;
+
+   config->storage_max_rate = 0;
+
+   config->retention_local = 0;
+   config->retention_remote = true;
+
+   config->wal_index = false;
+   config->restore_prewarm = 0;
+
+   config->scheduler_workers = 0;
+
+   config->scheduler_disk = 0;
+
+   config->scheduler_network = 0;
+
+   config->delete_max_rate = 0;
+   config->total_max_rate = 0;
+   config->max_rate_burst = 0;
+
+   config->wal_prefetch = 8;
+
 #ifdef DEBUG
    config->link = true;
 #endif
@@ -223,23 +349,17 @@ pgmoneta_read_configuration(void* shm, char* filename)
                   memset(&srv, 0, sizeof(struct server));
                   memcpy(&srv.name, &section, strlen(section));
 
-                  atomic_init(&srv.backup, false);
-                  atomic_init(&srv.restore, 0);
-                  atomic_init(&srv.archiving, 0);
-                  atomic_init(&srv.delete, false);
-                  atomic_init(&srv.wal, false);
                   srv.wal_streaming = false;
                   srv.valid = false;
                   srv.cur_timeline = 1; // by default current timeline is 1
-                  atomic_init(&srv.operation_count, 0);
-                  atomic_init(&srv.failed_operation_count, 0);
-                  atomic_init(&srv.last_operation_time, 0);
-                  atomic_init(&srv.last_failed_operation_time, 0);
                   memset(srv.wal_shipping, 0, MAX_PATH);
                   srv.workers = -1;
                   srv.backup_max_rate = -1;
                   srv.network_max_rate = -1;
                   srv.manifest = HASH_ALGORITHM_DEFAULT;
+                  srv.wal_compression_type = -1;
+                  srv.wal_compression_level = -1;
+                  srv.retention_local = -1;
 
                   idx_server++;
                }
@@ -457,6 +577,22 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      memcpy(&srv.wal_shipping[0], value, max);
                   }
                }
+               else if (!strcmp(key, "backup_standbys"))
+               {
+                  if (strcmp(section, "pgmoneta") && strlen(section) > 0)
+                  {
+                     max = strlen(value);
+                     if (max > MAX_PATH - 1)
+                     {
+                        max = MAX_PATH - 1;
+                     }
+                     memcpy(&srv.backup_standbys[0], value, max);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "hot_standby"))
                {
                   if (strlen(section) > 0)
@@ -511,6 +647,26 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      memcpy(&srv.hot_standby_tablespaces, value, max);
                   }
                }
+               else if (!strcmp(key, "hot_standby_wal"))
+               {
+                  if (strlen(section) > 0 && strcmp(section, "pgmoneta"))
+                  {
+                     max = strlen(section);
+                     if (max > MISC_LENGTH - 1)
+                     {
+                        max = MISC_LENGTH - 1;
+                     }
+                     memcpy(&srv.name, section, max);
+                     if (as_bool(value, &srv.hot_standby_wal))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "metrics"))
                {
                   if (!strcmp(section, "pgmoneta"))
@@ -688,6 +844,34 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "management_workers"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->management_workers))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "authentication_timeout"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->authentication_timeout))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "pidfile"))
                {
                   if (!strcmp(section, "pgmoneta"))
@@ -715,6 +899,100 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = false;
                   }
                }
+               else if (!strcmp(key, "workers_per_device"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->workers_per_device))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "workers_autoscale"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->workers_autoscale))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "memory_budget"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_size(value, &config->memory_budget, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_durability"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->backup_durability = as_durability(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_splice"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->backup_splice))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "restore_durability"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->restore_durability = as_durability(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "cpu_affinity"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     max = strlen(value);
+                     if (max > MISC_LENGTH - 1)
+                     {
+                        max = MISC_LENGTH - 1;
+                     }
+                     memcpy(config->cpu_affinity, value, max);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "workers"))
                {
                   if (!strcmp(section, "pgmoneta"))
@@ -889,6 +1167,34 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "socket_buffer_size"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->socket_buffer_size, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "ktls"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->ktls))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "non_blocking"))
                {
                   if (!strcmp(section, "pgmoneta"))
@@ -953,6 +1259,54 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "wal_compression"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->wal_compression_type = as_compression(value);
+                  }
+                  else if (strlen(section) > 0)
+                  {
+                     max = strlen(section);
+                     if (max > MISC_LENGTH - 1)
+                     {
+                        max = MISC_LENGTH - 1;
+                     }
+                     memcpy(&srv.name, section, max);
+                     srv.wal_compression_type = as_compression(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_compression_level"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_compression_level))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else if (strlen(section) > 0)
+                  {
+                     max = strlen(section);
+                     if (max > MISC_LENGTH - 1)
+                     {
+                        max = MISC_LENGTH - 1;
+                     }
+                     memcpy(&srv.name, section, max);
+                     if (as_int(value, &srv.wal_compression_level))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "storage_engine"))
                {
                   if (!strcmp(section, "pgmoneta"))
@@ -1337,12 +1691,11 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
-#ifdef DEBUG
-               else if (!strcmp(key, "link"))
+               else if (!strcmp(key, "wal_stream_compression"))
                {
                   if (!strcmp(section, "pgmoneta"))
                   {
-                     if (as_bool(value, &config->link))
+                     if (as_bool(value, &config->wal_stream_compression))
                      {
                         unknown = true;
                      }
@@ -1352,1773 +1705,3436 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
-#endif
-               else
+               else if (!strcmp(key, "wal_synchronous"))
                {
-                  unknown = true;
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_synchronous))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
                }
-
-               if (unknown)
+               else if (!strcmp(key, "wal_prealloc"))
                {
-                  warnx("Unknown: Section=%s, Key=%s, Value=%s", strlen(section) > 0 ? section : "<unknown>", key, value);
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_prealloc))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_fanout_size"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->wal_fanout_size, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_receivers"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_receivers))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_pipeline"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->backup_pipeline))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_connections"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->backup_connections))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "seekable_frame_size"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->seekable_frame_size, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "compression_dictionary"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->compression_dictionary))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "compression_adaptive"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->compression_adaptive))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "compression_probe"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->compression_probe))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "deduplication"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->deduplication))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "page_filter"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->page_filter))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "link_verify"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->link_verify))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "io_engine"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->io_engine = as_io_engine(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "io_cache"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->io_cache = as_io_cache(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "gzip_engine"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->gzip_engine = as_gzip_engine(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "sparse_files"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->sparse_files))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_pack"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_pack))
+                     {
+                        unknown = true;
+                     }
+
+                     if (config->wal_pack < 0)
+                     {
+                        config->wal_pack = 0;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_compaction"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_compaction))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "verify_mode"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     config->verify_mode = as_verify_mode(value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "verify_sample"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->verify_sample))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "verify_fail_fast"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->verify_fail_fast))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "trace_sample"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->trace_sample))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
                }
+               else if (!strcmp(key, "trace_events"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->trace_events))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "s3_part_size"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->s3_part_size, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "s3_concurrency"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->s3_concurrency))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "s3_unsigned_payload"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->s3_unsigned_payload))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "azure_block_size"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->azure_block_size, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_archive_queue"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_archive_queue))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_archive_retries"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_archive_retries))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "ssh_retries"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->ssh_retries))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "ssh_manifest_diff"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->ssh_manifest_diff))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "storage_max_rate"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->storage_max_rate))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "retention_local"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->retention_local))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else if (strlen(section) > 0)
+                  {
+                     if (as_int(value, &srv.retention_local))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "retention_remote"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->retention_remote))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_index"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_index))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "restore_prewarm"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_size(value, &config->restore_prewarm, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "scheduler_workers"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->scheduler_workers))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "scheduler_disk"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->scheduler_disk))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "scheduler_network"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->scheduler_network))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "delete_max_rate"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->delete_max_rate))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "total_max_rate"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->total_max_rate))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "max_rate_burst"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->max_rate_burst, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_prefetch"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_prefetch))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_schedule"))
+               {
+                  max = strlen(value);
+                  if (max > MISC_LENGTH - 1)
+                  {
+                     max = MISC_LENGTH - 1;
+                  }
+
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     memset(&config->backup_schedule[0], 0, MISC_LENGTH);
+                     memcpy(&config->backup_schedule[0], value, max);
+                  }
+                  else if (strlen(section) > 0)
+                  {
+                     memset(&srv.backup_schedule[0], 0, MISC_LENGTH);
+                     memcpy(&srv.backup_schedule[0], value, max);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_schedule_jitter"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_seconds(value, &config->backup_schedule_jitter, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_schedule_max"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->backup_schedule_max))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_throttle_lag"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bytes(value, &config->backup_throttle_lag, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_throttle_active"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->backup_throttle_active))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_throttle_io"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->backup_throttle_io))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "cluster_dir"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     max = strlen(value);
+                     if (max > MAX_PATH - 1)
+                     {
+                        max = MAX_PATH - 1;
+                     }
+                     memcpy(&config->cluster_dir[0], value, max);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "cluster_node"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     max = strlen(value);
+                     if (max > MISC_LENGTH - 1)
+                     {
+                        max = MISC_LENGTH - 1;
+                     }
+                     memcpy(&config->cluster_node[0], value, max);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "backup_volumes"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (split_volumes(value, config->backup_volumes, &config->number_of_backup_volumes))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "cluster_lease"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_seconds(value, &config->cluster_lease, 30))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+#ifdef DEBUG
+               else if (!strcmp(key, "link"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->link))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+#endif
+               else
+               {
+                  unknown = true;
+               }
+
+               if (unknown)
+               {
+                  warnx("Unknown: Section=%s, Key=%s, Value=%s", strlen(section) > 0 ? section : "<unknown>", key, value);
+               }
+
+               free(key);
+               free(value);
+               key = NULL;
+               value = NULL;
+            }
+            else
+            {
+               warnx("Unknown: Section=%s, Line=%s", strlen(section) > 0 ? section : "<unknown>", line);
+            }
+         }
+      }
+      free(trimmed_line);
+      trimmed_line = NULL;
+   }
+
+   if (strlen(srv.name) > 0)
+   {
+      memcpy(&(config->servers[idx_server - 1]), &srv, sizeof(struct server));
+   }
+
+   config->number_of_servers = idx_server;
+
+   build_server_index(config);
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   free(trimmed_line);
+   trimmed_line = NULL;
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+/**
+ *
+ */
+int
+pgmoneta_validate_configuration(void* shm)
+{
+   bool found = false;
+   struct stat st;
+   struct cron cron;
+   struct configuration* config;
+
+   config = (struct configuration*)shm;
+
+   if (strlen(config->host) == 0)
+   {
+      pgmoneta_log_fatal("No host defined");
+      return 1;
+   }
+
+   if (strlen(config->unix_socket_dir) == 0)
+   {
+      pgmoneta_log_fatal("No unix_socket_dir defined");
+      return 1;
+   }
+
+   if (stat(config->unix_socket_dir, &st) == 0 && S_ISDIR(st.st_mode))
+   {
+      /* Ok */
+   }
+   else
+   {
+      pgmoneta_log_fatal("unix_socket_dir is not a directory (%s)", config->unix_socket_dir);
+      return 1;
+   }
+
+   if (strlen(config->base_dir) == 0)
+   {
+      pgmoneta_log_fatal("No base directory defined");
+      return 1;
+   }
+
+   if (stat(config->base_dir, &st) == 0 && S_ISDIR(st.st_mode))
+   {
+      /* Ok */
+   }
+   else
+   {
+      if (!pgmoneta_exists(config->base_dir))
+      {
+         if (pgmoneta_mkdir(config->base_dir))
+         {
+            pgmoneta_log_fatal("Can not create %s", config->base_dir);
+            return 1;
+         }
+      }
+      else
+      {
+         pgmoneta_log_fatal("base_dir is not a directory (%s)", config->base_dir);
+         return 1;
+      }
+   }
+
+   if (config->retention_years != -1 && config->retention_years < 1)
+   {
+      pgmoneta_log_fatal("%d is an invalid year configuration", config->retention_years);
+      return 1;
+   }
+   if (config->retention_months != -1)
+   {
+      if (config->retention_years != -1)
+      {
+         if (config->retention_months < 1 || config->retention_months > 12)
+         {
+            pgmoneta_log_fatal("%d is an invalid month configuration", config->retention_months);
+            return 1;
+         }
+      }
+      else if (config->retention_months < 1)
+      {
+         pgmoneta_log_fatal("%d is an invalid month configuration", config->retention_months);
+         return 1;
+      }
+   }
+
+   if (config->retention_weeks != -1)
+   {
+      if (config->retention_months != -1)
+      {
+         if (config->retention_weeks < 1 || config->retention_weeks > 4)
+         {
+            pgmoneta_log_fatal("%d is an invalid week configuration", config->retention_weeks);
+            return 1;
+         }
+      }
+      else if (config->retention_weeks < 1)
+      {
+         pgmoneta_log_fatal("%d is an invalid week configuration", config->retention_weeks);
+         return 1;
+      }
+   }
+   if (config->retention_days < 1)
+   {
+      pgmoneta_log_fatal("retention days should be at least 1");
+      return 1;
+   }
+   if (config->retention_interval < 1)
+   {
+      pgmoneta_log_fatal("retention interval should be at least 1");
+      return 1;
+   }
+
+   if (strlen(config->backup_schedule) > 0 && pgmoneta_cron_parse(config->backup_schedule, &cron))
+   {
+      pgmoneta_log_fatal("Invalid backup_schedule: %s", config->backup_schedule);
+      return 1;
+   }
+
+   if (config->backup_schedule_jitter < 0)
+   {
+      config->backup_schedule_jitter = 0;
+   }
+
+   if (config->backup_schedule_max < 0)
+   {
+      config->backup_schedule_max = 0;
+   }
+
+   if (config->backup_throttle_lag < 0)
+   {
+      config->backup_throttle_lag = 0;
+   }
+
+   if (config->backup_throttle_active < 0)
+   {
+      config->backup_throttle_active = 0;
+   }
+
+   if (config->backup_throttle_io < 0)
+   {
+      config->backup_throttle_io = 0;
+   }
+
+   if (strlen(config->cluster_dir) > 0)
+   {
+      if (strlen(config->cluster_node) == 0 &&
+          gethostname(&config->cluster_node[0], MISC_LENGTH - 1))
+      {
+         pgmoneta_log_fatal("cluster_node is not defined");
+         return 1;
+      }
+
+      if (strchr(config->cluster_node, '/') != NULL || config->cluster_node[0] == '.')
+      {
+         pgmoneta_log_fatal("Invalid cluster_node: %s", config->cluster_node);
+         return 1;
+      }
+
+      if (config->cluster_lease < 3)
+      {
+         pgmoneta_log_warn("cluster_lease should be at least 3 seconds");
+         config->cluster_lease = 3;
+      }
+   }
+
+   for (int i = 0; i < config->number_of_backup_volumes; i++)
+   {
+      if (stat(config->backup_volumes[i], &st) || !S_ISDIR(st.st_mode))
+      {
+         pgmoneta_log_fatal("backup_volumes: %s is not a directory", config->backup_volumes[i]);
+         return 1;
+      }
+   }
+
+   if (config->backlog < 16)
+   {
+      config->backlog = 16;
+   }
+
+   if (config->number_of_servers <= 0)
+   {
+      pgmoneta_log_fatal("No servers defined");
+      return 1;
+   }
+
+   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+   {
+      if (config->compression_level < 1)
+      {
+         config->compression_level = 1;
+      }
+      else if (config->compression_level > 9)
+      {
+         config->compression_level = 9;
+      }
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+   {
+      if (config->compression_level < -131072)
+      {
+         config->compression_level = -131072;
+      }
+      else if (config->compression_level > 22)
+      {
+         config->compression_level = 22;
+      }
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+   {
+      if (config->compression_level < 1)
+      {
+         config->compression_level = 1;
+      }
+      else if (config->compression_level > 12)
+      {
+         config->compression_level = 12;
+      }
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+   {
+      if (config->compression_level < 1)
+      {
+         config->compression_level = 1;
+      }
+      else if (config->compression_level > 9)
+      {
+         config->compression_level = 9;
+      }
+   }
+
+   if (config->workers < 0)
+   {
+      config->workers = 0;
+   }
+
+   if (config->management_workers < 0)
+   {
+      config->management_workers = 0;
+   }
+   else if (config->management_workers > MAX_MANAGEMENT_WORKERS)
+   {
+      config->management_workers = MAX_MANAGEMENT_WORKERS;
+   }
+
+   if (config->workers_per_device < 0)
+   {
+      config->workers_per_device = 0;
+   }
+
+   if (strlen(config->cpu_affinity) > 0 && pgmoneta_cpu_list(config->cpu_affinity, NULL, 0) == -1)
+   {
+      pgmoneta_log_fatal("cpu_affinity is not a CPU list (%s)", config->cpu_affinity);
+      return 1;
+   }
+
+   if (config->scheduler_workers < 0)
+   {
+      config->scheduler_workers = 0;
+   }
+   else if (config->scheduler_workers > SCHEDULER_MAX_SLOTS)
+   {
+      config->scheduler_workers = SCHEDULER_MAX_SLOTS;
+   }
+
+   if (config->scheduler_disk < 0)
+   {
+      config->scheduler_disk = 0;
+   }
+   else if (config->scheduler_disk > SCHEDULER_MAX_SLOTS)
+   {
+      config->scheduler_disk = SCHEDULER_MAX_SLOTS;
+   }
+
+   if (config->scheduler_network < 0)
+   {
+      config->scheduler_network = 0;
+   }
+   else if (config->scheduler_network > SCHEDULER_MAX_SLOTS)
+   {
+      config->scheduler_network = SCHEDULER_MAX_SLOTS;
+   }
+
+   if (config->s3_part_size < S3_MINIMUM_PART_SIZE)
+   {
+      config->s3_part_size = S3_MINIMUM_PART_SIZE;
+   }
+
+   if (config->s3_concurrency < 1)
+   {
+      config->s3_concurrency = 1;
+   }
+
+   if (config->azure_block_size < AZURE_MINIMUM_BLOCK_SIZE)
+   {
+      config->azure_block_size = AZURE_MINIMUM_BLOCK_SIZE;
+   }
+
+   if (config->ssh_retries < 0)
+   {
+      config->ssh_retries = 0;
+   }
+
+   if (config->wal_archive_queue < 1)
+   {
+      config->wal_archive_queue = 1;
+   }
+
+   if (config->wal_archive_retries < 0)
+   {
+      config->wal_archive_retries = 0;
+   }
+
+   if (config->verify_sample < 1)
+   {
+      config->verify_sample = 1;
+   }
+   else if (config->verify_sample > 100)
+   {
+      config->verify_sample = 100;
+   }
+
+   if (config->trace_sample < 0)
+   {
+      config->trace_sample = 0;
+   }
+   else if (config->trace_sample > 100)
+   {
+      config->trace_sample = 100;
+   }
+
+   if (config->trace_events < 1024)
+   {
+      config->trace_events = 1024;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (!strcmp(config->servers[i].name, "pgmoneta"))
+      {
+         pgmoneta_log_fatal("pgmoneta is a reserved word for a host");
+         return 1;
+      }
+
+      if (!strcmp(config->servers[i].name, "all"))
+      {
+         pgmoneta_log_fatal("all is a reserved word for a host");
+         return 1;
+      }
+
+      if (strlen(config->servers[i].host) == 0)
+      {
+         pgmoneta_log_fatal("No host defined for %s", config->servers[i].name);
+         return 1;
+      }
+
+      if (config->servers[i].port == 0)
+      {
+         pgmoneta_log_fatal("No port defined for %s", config->servers[i].name);
+         return 1;
+      }
+
+      if (strlen(config->servers[i].username) == 0)
+      {
+         pgmoneta_log_fatal("No user defined for %s", config->servers[i].name);
+         return 1;
+      }
+
+      if (strlen(config->servers[i].wal_slot) == 0)
+      {
+         pgmoneta_log_fatal("No WAL slot defined for %s", config->servers[i].name);
+         return 1;
+      }
+
+      if (strlen(config->servers[i].follow) > 0)
+      {
+         found = false;
+         for (int j = 0; !found && j < config->number_of_servers; j++)
+         {
+            if (!strcmp(config->servers[i].follow, config->servers[j].name))
+            {
+               found = true;
+            }
+         }
+
+         if (!found)
+         {
+            pgmoneta_log_fatal("Invalid follow value for %s", config->servers[i].name);
+            return 1;
+         }
+      }
+
+      if (strlen(config->servers[i].backup_schedule) > 0 && pgmoneta_cron_parse(config->servers[i].backup_schedule, &cron))
+      {
+         pgmoneta_log_fatal("Invalid backup_schedule for %s: %s", config->servers[i].name, config->servers[i].backup_schedule);
+         return 1;
+      }
+
+      if (config->servers[i].workers < -1)
+      {
+         config->servers[i].workers = -1;
+      }
+
+      if (config->servers[i].backup_max_rate < -1)
+      {
+         config->servers[i].backup_max_rate = -1;
+      }
+
+      if (config->servers[i].network_max_rate < -1)
+      {
+         config->servers[i].network_max_rate = -1;
+      }
+
+      if (config->servers[i].wal_compression_level < -1)
+      {
+         config->servers[i].wal_compression_level = -1;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ *
+ */
+int
+pgmoneta_read_users_configuration(void* shm, char* filename)
+{
+   FILE* file;
+   char line[LINE_LENGTH];
+   char* trimmed_line = NULL;
+   int index;
+   char* master_key = NULL;
+   char* username = NULL;
+   char* password = NULL;
+   char* decoded = NULL;
+   size_t decoded_length = 0;
+   char* ptr = NULL;
+   struct configuration* config;
+
+   file = fopen(filename, "r");
+
+   if (!file)
+   {
+      goto error;
+   }
+   if (pgmoneta_get_master_key(&master_key))
+   {
+      goto masterkey;
+   }
+
+   index = 0;
+   config = (struct configuration*)shm;
+
+   while (fgets(line, sizeof(line), file))
+   {
+
+      if (!is_empty_string(line))
+      {
+         if (!remove_leading_whitespace_and_comments(line, &trimmed_line))
+         {
+            if (is_empty_string(trimmed_line))
+            {
+               free(trimmed_line);
+               trimmed_line = NULL;
+               continue;
+            }
+         }
+         else
+         {
+            goto error;
+         }
+
+         ptr = strtok(trimmed_line, ":");
+
+         username = ptr;
+
+         ptr = strtok(NULL, ":");
+
+         if (ptr == NULL)
+         {
+            goto error;
+         }
+
+         if (pgmoneta_base64_decode(ptr, strlen(ptr), (void**)&decoded, &decoded_length))
+         {
+            goto error;
+         }
+
+         if (pgmoneta_decrypt(decoded, decoded_length, master_key, &password, ENCRYPTION_AES_256_CBC))
+         {
+            goto error;
+         }
+
+         if (strlen(username) < MAX_USERNAME_LENGTH &&
+             strlen(password) < MAX_PASSWORD_LENGTH)
+         {
+            memcpy(&config->users[index].username, username, strlen(username));
+            memcpy(&config->users[index].password, password, strlen(password));
+         }
+         else
+         {
+            warnx("pgmoneta: Invalid USER entry");
+            warnx("%s", line);
+         }
+
+         free(password);
+         free(decoded);
+
+         password = NULL;
+         decoded = NULL;
+
+         index++;
+
+      }
+      free(trimmed_line);
+      trimmed_line = NULL;
+   }
+
+   config->number_of_users = index;
+
+   if (config->number_of_users > NUMBER_OF_USERS)
+   {
+      goto above;
+   }
+
+   free(master_key);
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   free(trimmed_line);
+   trimmed_line = NULL;
+   free(master_key);
+   free(password);
+   free(decoded);
+
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 1;
+
+masterkey:
+
+   free(master_key);
+   free(password);
+   free(decoded);
+
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 2;
+
+above:
+
+   free(master_key);
+   free(password);
+   free(decoded);
+
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 3;
+}
+
+/**
+ *
+ */
+int
+pgmoneta_validate_users_configuration(void* shm)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shm;
+
+   if (config->number_of_users <= 0)
+   {
+      pgmoneta_log_fatal("No users defined");
+      return 1;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      bool found = false;
+
+      for (int j = 0; !found && j < config->number_of_users; j++)
+      {
+         if (!strcmp(config->servers[i].username, config->users[j].username))
+         {
+            found = true;
+         }
+      }
+
+      if (!found)
+      {
+         pgmoneta_log_fatal("Unknown user (\'%s\') defined for %s", config->servers[i].username, config->servers[i].name);
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ *
+ */
+int
+pgmoneta_read_admins_configuration(void* shm, char* filename)
+{
+   FILE* file;
+   char line[LINE_LENGTH];
+   char* trimmed_line = NULL;
+   int index;
+   char* master_key = NULL;
+   char* username = NULL;
+   char* password = NULL;
+   char* decoded = NULL;
+   size_t decoded_length = 0;
+   char* ptr = NULL;
+   struct configuration* config;
+
+   file = fopen(filename, "r");
+
+   if (!file)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_get_master_key(&master_key))
+   {
+      goto masterkey;
+   }
+
+   index = 0;
+   config = (struct configuration*)shm;
+
+   while (fgets(line, sizeof(line), file))
+   {
+
+      if (!is_empty_string(line))
+      {
+         if (!remove_leading_whitespace_and_comments(line, &trimmed_line))
+         {
+            if (is_empty_string(trimmed_line))
+            {
+               free(trimmed_line);
+               trimmed_line = NULL;
+               continue;
+            }
+         }
+         else
+         {
+            goto error;
+         }
+
+         ptr = strtok(trimmed_line, ":");
+
+         username = ptr;
+
+         ptr = strtok(NULL, ":");
+
+         if (ptr == NULL)
+         {
+            goto error;
+         }
+
+         if (pgmoneta_base64_decode(ptr, strlen(ptr), (void**)&decoded, &decoded_length))
+         {
+            goto error;
+         }
+
+         if (pgmoneta_decrypt(decoded, decoded_length, master_key, &password, ENCRYPTION_AES_256_CBC))
+         {
+            goto error;
+         }
+
+         if (strlen(username) < MAX_USERNAME_LENGTH &&
+             strlen(password) < MAX_PASSWORD_LENGTH)
+         {
+            memcpy(&config->admins[index].username, username, strlen(username));
+            memcpy(&config->admins[index].password, password, strlen(password));
+         }
+         else
+         {
+            warnx("pgmoneta: Invalid ADMIN entry");
+            warnx("%s", line);
+         }
+
+         free(password);
+         free(decoded);
+
+         password = NULL;
+         decoded = NULL;
+
+         index++;
+
+      }
+      free(trimmed_line);
+      trimmed_line = NULL;
+   }
+
+   config->number_of_admins = index;
+
+   if (config->number_of_admins > NUMBER_OF_ADMINS)
+   {
+      goto above;
+   }
+
+   free(master_key);
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   free(trimmed_line);
+   trimmed_line = NULL;
+   free(master_key);
+   free(password);
+   free(decoded);
+
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 1;
+
+masterkey:
+
+   free(master_key);
+   free(password);
+   free(decoded);
+
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 2;
+
+above:
+
+   free(master_key);
+   free(password);
+   free(decoded);
+
+   if (file)
+   {
+      fclose(file);
+   }
+
+   return 3;
+}
+
+/**
+ *
+ */
+int
+pgmoneta_validate_admins_configuration(void* shm)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shm;
+
+   if (config->management > 0 && config->number_of_admins == 0)
+   {
+      pgmoneta_log_warn("Remote management enabled, but no admins are defined");
+   }
+   else if (config->management == 0 && config->number_of_admins > 0)
+   {
+      pgmoneta_log_warn("Remote management disabled, but admins are defined");
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_reload_configuration(bool* restart)
+{
+   size_t reload_size;
+   struct configuration* reload = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *restart = false;
+
+   pgmoneta_log_trace("Configuration: %s", config->configuration_path);
+   pgmoneta_log_trace("Users: %s", config->users_path);
+   pgmoneta_log_trace("Admins: %s", config->admins_path);
+
+   reload_size = sizeof(struct configuration);
+
+   if (pgmoneta_create_shared_memory(reload_size, HUGEPAGE_OFF, (void**)&reload))
+   {
+      goto error;
+   }
+
+   pgmoneta_init_configuration((void*)reload);
+
+   if (pgmoneta_read_configuration((void*)reload, config->configuration_path))
+   {
+      goto error;
+   }
 
-               free(key);
-               free(value);
-               key = NULL;
-               value = NULL;
-            }
-            else
-            {
-               warnx("Unknown: Section=%s, Line=%s", strlen(section) > 0 ? section : "<unknown>", line);
-            }
-         }
+   if (pgmoneta_read_users_configuration((void*)reload, config->users_path))
+   {
+      goto error;
+   }
+
+   if (strcmp("", config->admins_path))
+   {
+      if (pgmoneta_read_admins_configuration((void*)reload, config->admins_path))
+      {
+         goto error;
       }
-      free(trimmed_line);
-      trimmed_line = NULL;
    }
 
-   if (strlen(srv.name) > 0)
+   if (pgmoneta_validate_configuration(reload))
    {
-      memcpy(&(config->servers[idx_server - 1]), &srv, sizeof(struct server));
+      goto error;
    }
 
-   config->number_of_servers = idx_server;
+   if (pgmoneta_validate_users_configuration(reload))
+   {
+      goto error;
+   }
 
-   fclose(file);
+   if (pgmoneta_validate_admins_configuration(reload))
+   {
+      goto error;
+   }
+
+   *restart = transfer_configuration(config, reload);
+
+   pgmoneta_destroy_shared_memory((void*)reload, reload_size);
+
+   pgmoneta_log_debug("Reload: Success");
 
    return 0;
 
 error:
+   *restart = true;
 
-   free(trimmed_line);
-   trimmed_line = NULL;
-   if (file)
+   if (reload != NULL)
    {
-      fclose(file);
+      pgmoneta_destroy_shared_memory((void*)reload, reload_size);
    }
 
+   pgmoneta_log_debug("Reload: Failure");
+
    return 1;
 }
 
-/**
- *
- */
-int
-pgmoneta_validate_configuration(void* shm)
-{
-   bool found = false;
-   struct stat st;
-   struct configuration* config;
+int
+pgmoneta_server_index(char* name)
+{
+   int srv;
+   uint32_t slot;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (name == NULL)
+   {
+      return -1;
+   }
+
+   slot = server_hash(name);
+
+   // the table is at least twice the number of servers, so there is always a free slot
+   while (config->server_index[slot] != 0)
+   {
+      srv = config->server_index[slot] - 1;
+
+      if (!strcmp(config->servers[srv].name, name))
+      {
+         return srv;
+      }
+
+      slot = (slot + 1) & (SERVER_INDEX_SIZE - 1);
+   }
+
+   return -1;
+}
+
+static void
+add_configuration_response(struct json* res)
+{
+   char* volumes = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   char* ret = get_retention_string(config->retention_days, config->retention_weeks, config->retention_months, config->retention_years);
+   // JSON of main configuration
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_HOST, (uintptr_t)config->host, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_UNIX_SOCKET_DIR, (uintptr_t)config->unix_socket_dir, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BASE_DIR, (uintptr_t)config->base_dir, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_METRICS, (uintptr_t)config->metrics, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_AGE, (uintptr_t)config->metrics_cache_max_age, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_SIZE, (uintptr_t)config->metrics_cache_max_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MANAGEMENT, (uintptr_t)config->management, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION, (uintptr_t)config->compression_type, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION_LEVEL, (uintptr_t)config->compression_level, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_COMPRESSION, (uintptr_t)config->wal_compression_type, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_COMPRESSION_LEVEL, (uintptr_t)config->wal_compression_level, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKERS, (uintptr_t)config->workers, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKERS_PER_DEVICE, (uintptr_t)config->workers_per_device, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKERS_AUTOSCALE, (uintptr_t)config->workers_autoscale, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CPU_AFFINITY, (uintptr_t)config->cpu_affinity, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MEMORY_BUDGET, (uintptr_t)config->memory_budget, ValueUInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_DURABILITY, (uintptr_t)config->backup_durability, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_SPLICE, (uintptr_t)config->backup_splice, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_RESTORE_DURABILITY, (uintptr_t)config->restore_durability, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_STORAGE_ENGINE, (uintptr_t)config->storage_engine, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_ENCRYPTION, (uintptr_t)config->encryption, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CREATE_SLOT, (uintptr_t)config->create_slot, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_HOSTNAME, (uintptr_t)config->ssh_hostname, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_USERNAME, (uintptr_t)config->ssh_username, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_BASE_DIR, (uintptr_t)config->ssh_base_dir, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_CIPHERS, (uintptr_t)config->ssh_ciphers, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_AWS_REGION, (uintptr_t)config->s3_aws_region, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_ACCESS_KEY_ID, (uintptr_t)config->s3_access_key_id, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_SECRET_ACCESS_KEY, (uintptr_t)config->s3_secret_access_key, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_BUCKET, (uintptr_t)config->s3_bucket, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_BASE_DIR, (uintptr_t)config->s3_base_dir, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_BASE_DIR, (uintptr_t)config->azure_base_dir, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_STORAGE_ACCOUNT, (uintptr_t)config->azure_storage_account, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_CONTAINER, (uintptr_t)config->azure_container, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_SHARED_KEY, (uintptr_t)config->azure_shared_key, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKSPACE, (uintptr_t)config->workspace, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_RETENTION, (uintptr_t)ret, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_TYPE, (uintptr_t)config->log_type, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_LEVEL, (uintptr_t)config->log_level, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_PATH, (uintptr_t)config->log_path, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_ROTATION_AGE, (uintptr_t)config->log_rotation_age, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_ROTATION_SIZE, (uintptr_t)config->log_rotation_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX, (uintptr_t)config->log_line_prefix, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_MODE, (uintptr_t)config->log_mode, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT, (uintptr_t)config->blocking_timeout, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MANAGEMENT_WORKERS, (uintptr_t)config->management_workers, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AUTHENTICATION_TIMEOUT, (uintptr_t)config->authentication_timeout, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS, (uintptr_t)config->tls, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS_CERT_FILE, (uintptr_t)config->tls_cert_file, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS_CA_FILE, (uintptr_t)config->tls_ca_file, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS_KEY_FILE, (uintptr_t)config->tls_key_file, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LIBEV, (uintptr_t)config->libev, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_MAX_RATE, (uintptr_t)config->backup_max_rate, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_NETWORK_MAX_RATE, (uintptr_t)config->network_max_rate, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MANIFEST, (uintptr_t)config->manifest, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_KEEP_ALIVE, (uintptr_t)config->keep_alive, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_NODELAY, (uintptr_t)config->nodelay, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SOCKET_BUFFER_SIZE, (uintptr_t)config->socket_buffer_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_KTLS, (uintptr_t)config->ktls, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_NON_BLOCKING, (uintptr_t)config->non_blocking, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKLOG, (uintptr_t)config->backlog, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_HUGEPAGE, (uintptr_t)config->hugepage, ValueChar);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_PIDFILE, (uintptr_t)config->pidfile, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_UPDATE_PROCESS_TITLE, (uintptr_t)config->update_process_title, ValueUInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_STREAM_COMPRESSION, (uintptr_t)config->wal_stream_compression, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_SYNCHRONOUS, (uintptr_t)config->wal_synchronous, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_PREALLOC, (uintptr_t)config->wal_prealloc, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_FANOUT_SIZE, (uintptr_t)config->wal_fanout_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_RECEIVERS, (uintptr_t)config->wal_receivers, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_PIPELINE, (uintptr_t)config->backup_pipeline, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_CONNECTIONS, (uintptr_t)config->backup_connections, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SEEKABLE_FRAME_SIZE, (uintptr_t)config->seekable_frame_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION_DICTIONARY, (uintptr_t)config->compression_dictionary, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION_ADAPTIVE, (uintptr_t)config->compression_adaptive, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION_PROBE, (uintptr_t)config->compression_probe, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_DEDUPLICATION, (uintptr_t)config->deduplication, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_PAGE_FILTER, (uintptr_t)config->page_filter, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LINK_VERIFY, (uintptr_t)config->link_verify, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_IO_ENGINE, (uintptr_t)config->io_engine, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_IO_CACHE, (uintptr_t)config->io_cache, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_GZIP_ENGINE, (uintptr_t)config->gzip_engine, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SPARSE_FILES, (uintptr_t)config->sparse_files, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_PACK, (uintptr_t)config->wal_pack, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_COMPACTION, (uintptr_t)config->wal_compaction, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_VERIFY_MODE, (uintptr_t)config->verify_mode, ValueInt32);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_VERIFY_SAMPLE, (uintptr_t)config->verify_sample, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_VERIFY_FAIL_FAST, (uintptr_t)config->verify_fail_fast, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TRACE_SAMPLE, (uintptr_t)config->trace_sample, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TRACE_EVENTS, (uintptr_t)config->trace_events, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_PART_SIZE, (uintptr_t)config->s3_part_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_CONCURRENCY, (uintptr_t)config->s3_concurrency, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_UNSIGNED_PAYLOAD, (uintptr_t)config->s3_unsigned_payload, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_BLOCK_SIZE, (uintptr_t)config->azure_block_size, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_ARCHIVE_QUEUE, (uintptr_t)config->wal_archive_queue, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_ARCHIVE_RETRIES, (uintptr_t)config->wal_archive_retries, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_RETRIES, (uintptr_t)config->ssh_retries, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_MANIFEST_DIFF, (uintptr_t)config->ssh_manifest_diff, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_STORAGE_MAX_RATE, (uintptr_t)config->storage_max_rate, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_RETENTION_LOCAL, (uintptr_t)config->retention_local, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_RETENTION_REMOTE, (uintptr_t)config->retention_remote, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_INDEX, (uintptr_t)config->wal_index, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_RESTORE_PREWARM, (uintptr_t)config->restore_prewarm, ValueUInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SCHEDULER_WORKERS, (uintptr_t)config->scheduler_workers, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SCHEDULER_DISK, (uintptr_t)config->scheduler_disk, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SCHEDULER_NETWORK, (uintptr_t)config->scheduler_network, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_DELETE_MAX_RATE, (uintptr_t)config->delete_max_rate, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TOTAL_MAX_RATE, (uintptr_t)config->total_max_rate, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MAX_RATE_BURST, (uintptr_t)config->max_rate_burst, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_PREFETCH, (uintptr_t)config->wal_prefetch, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE, (uintptr_t)config->backup_schedule, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE_JITTER, (uintptr_t)config->backup_schedule_jitter, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE_MAX, (uintptr_t)config->backup_schedule_max, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_THROTTLE_LAG, (uintptr_t)config->backup_throttle_lag, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_THROTTLE_ACTIVE, (uintptr_t)config->backup_throttle_active, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_THROTTLE_IO, (uintptr_t)config->backup_throttle_io, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CLUSTER_DIR, (uintptr_t)config->cluster_dir, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CLUSTER_NODE, (uintptr_t)config->cluster_node, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CLUSTER_LEASE, (uintptr_t)config->cluster_lease, ValueInt64);
+   volumes = get_volumes_string(config->backup_volumes, config->number_of_backup_volumes);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_VOLUMES, (uintptr_t)volumes, ValueString);
+   free(volumes);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MAIN_CONF_PATH, (uintptr_t)config->configuration_path, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_USER_CONF_PATH, (uintptr_t)config->users_path, ValueString);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_ADMIN_CONF_PATH, (uintptr_t)config->admins_path, ValueString);
+
+   free(ret);
+}
+
+static void
+add_servers_configuration_response(struct json* res)
+{
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   // JSON of server configuration
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      struct json* server_conf = NULL;
+      char* ret = get_retention_string(config->servers[i].retention_days, config->servers[i].retention_weeks, config->servers[i].retention_months, config->servers[i].retention_years);
+
+      if (pgmoneta_json_create(&server_conf))
+      {
+         return;
+      }
+
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOST, (uintptr_t)config->servers[i].host, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_PORT, (uintptr_t)config->servers[i].port, ValueInt64);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_USER, (uintptr_t)config->servers[i].username, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_SLOT, (uintptr_t)config->servers[i].wal_slot, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_CREATE_SLOT, (uintptr_t)config->servers[i].create_slot, ValueInt32);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_FOLLOW, (uintptr_t)config->servers[i].follow, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WORKSPACE, (uintptr_t)config->servers[i].workspace, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_BACKUP_SCHEDULE, (uintptr_t)config->servers[i].backup_schedule, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_RETENTION, (uintptr_t)ret, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_SHIPPING, (uintptr_t)config->servers[i].wal_shipping, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_BACKUP_STANDBYS, (uintptr_t)config->servers[i].backup_standbys, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY, (uintptr_t)config->servers[i].hot_standby, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY_OVERRIDES, (uintptr_t)config->servers[i].hot_standby_overrides, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY_TABLESPACES, (uintptr_t)config->servers[i].hot_standby_tablespaces, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY_WAL, (uintptr_t)config->servers[i].hot_standby_wal, ValueBool);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WORKERS, (uintptr_t)config->servers[i].workers, ValueInt64);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_BACKUP_MAX_RATE, (uintptr_t)config->servers[i].backup_max_rate, ValueInt64);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_NETWORK_MAX_RATE, (uintptr_t)config->servers[i].network_max_rate, ValueInt64);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_COMPRESSION, (uintptr_t)config->servers[i].wal_compression_type, ValueInt32);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_COMPRESSION_LEVEL, (uintptr_t)config->servers[i].wal_compression_level, ValueInt64);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_MANIFEST, (uintptr_t)config->servers[i].manifest, ValueInt64);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_CERT_FILE, (uintptr_t)config->servers[i].tls_cert_file, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_CA_FILE, (uintptr_t)config->servers[i].tls_ca_file, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_KEY_FILE, (uintptr_t)config->servers[i].tls_key_file, ValueString);
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_EXTRA, (uintptr_t)config->servers[i].extra, ValueString);
+
+      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_RETENTION_LOCAL, (uintptr_t)config->servers[i].retention_local, ValueInt64);
+
+      pgmoneta_json_put(res, config->servers[i].name, (uintptr_t)server_conf, ValueJSON);
+
+      free(ret);
+   }
+}
+
+void
+pgmoneta_conf_get(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   struct json* response = NULL;
+   char* elapsed = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double total_seconds;
+
+   pgmoneta_start_logging();
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   if (pgmoneta_management_create_response(payload, -1, &response))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_GET_ERROR, compression, encryption, payload);
+      pgmoneta_log_error("Conf Get: Error creating json object (%d)", MANAGEMENT_ERROR_CONF_GET_ERROR);
+      goto error;
+   }
+
+   add_configuration_response(response);
+   add_servers_configuration_response(response);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_GET_NETWORK, compression, encryption, payload);
+      pgmoneta_log_error("Conf Get: Error sending response");
+
+      goto error;
+   }
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+
+   pgmoneta_log_info("Conf Get (Elapsed: %s)", elapsed);
+
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   exit(0);
+error:
+
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   exit(1);
+
+}
+
+void
+pgmoneta_conf_set(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   struct json* response = NULL;
+   struct json* request = NULL;
+   char* config_key = NULL;
+   char* config_value = NULL;
+   char* elapsed = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double total_seconds;
+   char section[MISC_LENGTH];
+   char key[MISC_LENGTH];
+   struct configuration* config = NULL;
+   struct json* server_j = NULL;
+   size_t max;
+   int server_index = -1;
+   int begin = -1, end = -1;
+
+   pgmoneta_start_logging();
 
-   config = (struct configuration*)shm;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
 
-   if (strlen(config->host) == 0)
+   config = (struct configuration*)shmem;
+   // Extract config_key and config_value from request
+   request = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
+   if (!request)
    {
-      pgmoneta_log_fatal("No host defined");
-      return 1;
+      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_NOREQUEST, compression, encryption, payload);
+      pgmoneta_log_error("Conf Set: No request category found in payload (%d)", MANAGEMENT_ERROR_CONF_SET_NOREQUEST);
+      goto error;
    }
 
-   if (strlen(config->unix_socket_dir) == 0)
-   {
-      pgmoneta_log_fatal("No unix_socket_dir defined");
-      return 1;
-   }
+   config_key = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_CONFIG_KEY);
+   config_value = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_CONFIG_VALUE);
 
-   if (stat(config->unix_socket_dir, &st) == 0 && S_ISDIR(st.st_mode))
-   {
-      /* Ok */
-   }
-   else
+   if (!config_key || !config_value)
    {
-      pgmoneta_log_fatal("unix_socket_dir is not a directory (%s)", config->unix_socket_dir);
-      return 1;
+      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_NOCONFIG_KEY_OR_VALUE, compression, encryption, payload);
+      pgmoneta_log_error("Conf Set: No config key or config value in request (%d)", MANAGEMENT_ERROR_CONF_SET_NOCONFIG_KEY_OR_VALUE);
+      goto error;
    }
 
-   if (strlen(config->base_dir) == 0)
-   {
-      pgmoneta_log_fatal("No base directory defined");
-      return 1;
-   }
+   // Modify
+   memset(section, 0, MISC_LENGTH);
+   memset(key, 0, MISC_LENGTH);
 
-   if (stat(config->base_dir, &st) == 0 && S_ISDIR(st.st_mode))
-   {
-      /* Ok */
-   }
-   else
+   for (int i = 0; i < strlen(config_key); i++)
    {
-      if (!pgmoneta_exists(config->base_dir))
+      if (config_key[i] == '.')
       {
-         if (pgmoneta_mkdir(config->base_dir))
+         if (!strlen(section))
          {
-            pgmoneta_log_fatal("Can not create %s", config->base_dir);
-            return 1;
+            memcpy(section, &config_key[begin], end - begin + 1);
+            section[end - begin + 1] = '\0';
+            begin = end = -1;
+            continue;
          }
       }
-      else
+
+      if (begin < 0)
       {
-         pgmoneta_log_fatal("base_dir is not a directory (%s)", config->base_dir);
-         return 1;
+         begin = i;
       }
-   }
 
-   if (config->retention_years != -1 && config->retention_years < 1)
+      end = i;
+   }
+   // if the key has not been found, since there is no ending dot,
+   // try to extract it from the string
+   if (!strlen(key))
    {
-      pgmoneta_log_fatal("%d is an invalid year configuration", config->retention_years);
-      return 1;
+      memcpy(key, &config_key[begin], end - begin + 1);
+      key[end - begin + 1] = '\0';
    }
-   if (config->retention_months != -1)
+
+   if (strlen(section) > 0)
    {
-      if (config->retention_years != -1)
-      {
-         if (config->retention_months < 1 || config->retention_months > 12)
-         {
-            pgmoneta_log_fatal("%d is an invalid month configuration", config->retention_months);
-            return 1;
-         }
-      }
-      else if (config->retention_months < 1)
+      if (pgmoneta_json_create(&server_j))
       {
-         pgmoneta_log_fatal("%d is an invalid month configuration", config->retention_months);
-         return 1;
+         pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_ERROR, compression, encryption, payload);
+         pgmoneta_log_error("Conf Set: Error creating json object (%d)", MANAGEMENT_ERROR_CONF_SET_ERROR);
+         goto error;
       }
-   }
 
-   if (config->retention_weeks != -1)
-   {
-      if (config->retention_months != -1)
+      for (int i = 0; i < config->number_of_servers; i++)
       {
-         if (config->retention_weeks < 1 || config->retention_weeks > 4)
+         if (!strcmp(config->servers[i].name, section))
          {
-            pgmoneta_log_fatal("%d is an invalid week configuration", config->retention_weeks);
-            return 1;
+            server_index = i;
+            break;
          }
       }
-      else if (config->retention_weeks < 1)
+      if (server_index == -1)
       {
-         pgmoneta_log_fatal("%d is an invalid week configuration", config->retention_weeks);
-         return 1;
+         pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_UNKNOWN_SERVER, compression, encryption, payload);
+         pgmoneta_log_error("Conf Set: Unknown server value parsed (%d)", MANAGEMENT_ERROR_CONF_SET_UNKNOWN_SERVER);
+         goto error;
       }
    }
-   if (config->retention_days < 1)
-   {
-      pgmoneta_log_fatal("retention days should be at least 1");
-      return 1;
-   }
-   if (config->retention_interval < 1)
-   {
-      pgmoneta_log_fatal("retention interval should be at least 1");
-      return 1;
-   }
-
-   if (config->backlog < 16)
-   {
-      config->backlog = 16;
-   }
 
-   if (config->number_of_servers <= 0)
+   if (pgmoneta_management_create_response(payload, -1, &response))
    {
-      pgmoneta_log_fatal("No servers defined");
-      return 1;
+      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_ERROR, compression, encryption, payload);
+      pgmoneta_log_error("Conf Set: Error creating json object (%d)", MANAGEMENT_ERROR_CONF_SET_ERROR);
+      goto error;
    }
 
-   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
-   {
-      if (config->compression_level < 1)
-      {
-         config->compression_level = 1;
-      }
-      else if (config->compression_level > 9)
-      {
-         config->compression_level = 9;
-      }
-   }
-   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
-   {
-      if (config->compression_level < -131072)
-      {
-         config->compression_level = -131072;
-      }
-      else if (config->compression_level > 22)
-      {
-         config->compression_level = 22;
-      }
-   }
-   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+   if (strlen(key) && config_value)
    {
-      if (config->compression_level < 1)
-      {
-         config->compression_level = 1;
-      }
-      else if (config->compression_level > 12)
+      bool unknown = false;
+      if (!strcmp(key, "host"))
       {
-         config->compression_level = 12;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(&config->servers[server_index].host, config_value, max);
+            config->servers[server_index].host[max] = '\0';
+            pgmoneta_json_put(server_j, key, (uintptr_t)config_value, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(config->host, config_value, max);
+            config->host[max] = '\0';
+            pgmoneta_json_put(response, key, (uintptr_t)config_value, ValueString);
+         }
       }
-   }
-   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
-   {
-      if (config->compression_level < 1)
+      else if (!strcmp(key, "port"))
       {
-         config->compression_level = 1;
+         if (strlen(section) > 0)
+         {
+            if (as_int(config_value, &config->servers[server_index].port))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].port, ValueInt64);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-      else if (config->compression_level > 9)
+      else if (!strcmp(key, "user"))
       {
-         config->compression_level = 9;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MAX_USERNAME_LENGTH - 1)
+            {
+               max = MAX_USERNAME_LENGTH - 1;
+            }
+            memcpy(&config->servers[server_index].username, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].username, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-   }
-
-   if (config->workers < 0)
-   {
-      config->workers = 0;
-   }
-
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      if (!strcmp(config->servers[i].name, "pgmoneta"))
+      else if (!strcmp(key, "extra"))
       {
-         pgmoneta_log_fatal("pgmoneta is a reserved word for a host");
-         return 1;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MAX_PATH - 1)
+            {
+               max = MAX_PATH - 1;
+            }
+            int count = 0;
+            split_extra(config_value, config->servers[server_index].extra, &count);
+            config->servers[server_index].number_of_extra = count;
+            pgmoneta_json_put(server_j, key, (uintptr_t)config_value, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-
-      if (!strcmp(config->servers[i].name, "all"))
+      else if (!strcmp(key, "wal_slot"))
       {
-         pgmoneta_log_fatal("all is a reserved word for a host");
-         return 1;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(&config->servers[server_index].wal_slot, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].wal_slot, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-
-      if (strlen(config->servers[i].host) == 0)
+      else if (!strcmp(key, "create_slot"))
       {
-         pgmoneta_log_fatal("No host defined for %s", config->servers[i].name);
-         return 1;
-      }
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
 
-      if (config->servers[i].port == 0)
-      {
-         pgmoneta_log_fatal("No port defined for %s", config->servers[i].name);
-         return 1;
-      }
+            if (as_create_slot(config_value, &config->servers[server_index].create_slot))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].create_slot, ValueInt32);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
 
-      if (strlen(config->servers[i].username) == 0)
+            if (as_create_slot(config_value, &config->create_slot))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(response, key, (uintptr_t)config->create_slot, ValueInt32);
+         }
+      }
+      else if (!strcmp(key, "follow"))
       {
-         pgmoneta_log_fatal("No user defined for %s", config->servers[i].name);
-         return 1;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(&config->servers[server_index].follow, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].follow, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-
-      if (strlen(config->servers[i].wal_slot) == 0)
+      else if (!strcmp(key, "base_dir"))
       {
-         pgmoneta_log_fatal("No WAL slot defined for %s", config->servers[i].name);
-         return 1;
+         max = strlen(config_value);
+         if (max > MAX_PATH - 1)
+         {
+            max = MAX_PATH - 1;
+         }
+         memcpy(&config->base_dir[0], config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->base_dir, ValueString);
       }
-
-      if (strlen(config->servers[i].follow) > 0)
+      else if (!strcmp(key, "wal_shipping"))
       {
-         found = false;
-         for (int j = 0; !found && j < config->number_of_servers; j++)
+         if (strcmp(section, "pgmoneta") && strlen(section) > 0)
          {
-            if (!strcmp(config->servers[i].follow, config->servers[j].name))
+            max = strlen(config_value);
+            if (max > MAX_PATH - 1)
             {
-               found = true;
+               max = MAX_PATH - 1;
             }
+            memcpy(&config->servers[server_index].wal_shipping[0], config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].wal_shipping, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
-
-         if (!found)
+         else
          {
-            pgmoneta_log_fatal("Invalid follow value for %s", config->servers[i].name);
-            return 1;
+            unknown = true;
          }
       }
-
-      if (config->servers[i].workers < -1)
+      else if (!strcmp(key, "backup_standbys"))
       {
-         config->servers[i].workers = -1;
+         if (strcmp(section, "pgmoneta") && strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MAX_PATH - 1)
+            {
+               max = MAX_PATH - 1;
+            }
+            memset(&config->servers[server_index].backup_standbys[0], 0, MAX_PATH);
+            memcpy(&config->servers[server_index].backup_standbys[0], config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].backup_standbys, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-
-      if (config->servers[i].backup_max_rate < -1)
+      else if (!strcmp(key, "hot_standby"))
       {
-         config->servers[i].backup_max_rate = -1;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MAX_PATH - 1)
+            {
+               max = MAX_PATH - 1;
+            }
+            memcpy(&config->servers[server_index].hot_standby, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-
-      if (config->servers[i].network_max_rate < -1)
+      else if (!strcmp(key, "hot_standby_overrides"))
       {
-         config->servers[i].network_max_rate = -1;
+         if (strlen(section) > 0)
+         {
+            max = strlen(config_value);
+            if (max > MAX_PATH - 1)
+            {
+               max = MAX_PATH - 1;
+            }
+            memcpy(&config->servers[server_index].hot_standby_overrides, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby_overrides, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            unknown = true;
+         }
       }
-   }
-
-   return 0;
-}
-
-/**
- *
- */
-int
-pgmoneta_read_users_configuration(void* shm, char* filename)
-{
-   FILE* file;
-   char line[LINE_LENGTH];
-   char* trimmed_line = NULL;
-   int index;
-   char* master_key = NULL;
-   char* username = NULL;
-   char* password = NULL;
-   char* decoded = NULL;
-   size_t decoded_length = 0;
-   char* ptr = NULL;
-   struct configuration* config;
-
-   file = fopen(filename, "r");
-
-   if (!file)
-   {
-      goto error;
-   }
-   if (pgmoneta_get_master_key(&master_key))
-   {
-      goto masterkey;
-   }
-
-   index = 0;
-   config = (struct configuration*)shm;
-
-   while (fgets(line, sizeof(line), file))
-   {
-
-      if (!is_empty_string(line))
+      else if (!strcmp(key, "hot_standby_tablespaces"))
       {
-         if (!remove_leading_whitespace_and_comments(line, &trimmed_line))
+         if (strlen(section) > 0)
          {
-            if (is_empty_string(trimmed_line))
+            max = strlen(config_value);
+            if (max > MAX_PATH - 1)
             {
-               free(trimmed_line);
-               trimmed_line = NULL;
-               continue;
+               max = MAX_PATH - 1;
             }
+            memcpy(&config->servers[server_index].hot_standby_tablespaces, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby_tablespaces, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            goto error;
+            unknown = true;
          }
-
-         ptr = strtok(trimmed_line, ":");
-
-         username = ptr;
-
-         ptr = strtok(NULL, ":");
-
-         if (ptr == NULL)
+      }
+      else if (!strcmp(key, "hot_standby_wal"))
+      {
+         if (strlen(section) > 0)
          {
-            goto error;
+            if (as_bool(config_value, &config->servers[server_index].hot_standby_wal))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby_wal, ValueBool);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
-
-         if (pgmoneta_base64_decode(ptr, strlen(ptr), (void**)&decoded, &decoded_length))
+         else
          {
-            goto error;
+            unknown = true;
          }
-
-         if (pgmoneta_decrypt(decoded, decoded_length, master_key, &password, ENCRYPTION_AES_256_CBC))
+      }
+      else if (!strcmp(key, "metrics"))
+      {
+         if (as_int(config_value, &config->metrics))
          {
-            goto error;
+            unknown = true;
          }
-
-         if (strlen(username) < MAX_USERNAME_LENGTH &&
-             strlen(password) < MAX_PASSWORD_LENGTH)
+         pgmoneta_json_put(response, key, (uintptr_t)config->metrics, ValueInt64);
+      }
+      else if (!strcmp(key, "metrics_cache_max_size"))
+      {
+         if (as_bytes(config_value, &config->metrics_cache_max_size, 0))
          {
-            memcpy(&config->users[index].username, username, strlen(username));
-            memcpy(&config->users[index].password, password, strlen(password));
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->metrics_cache_max_size, ValueInt64);
+      }
+      else if (!strcmp(key, "metrics_cache_max_age"))
+      {
+         if (as_seconds(config_value, &config->metrics_cache_max_age, 0))
          {
-            warnx("pgmoneta: Invalid USER entry");
-            warnx("%s", line);
+            unknown = true;
          }
-
-         free(password);
-         free(decoded);
-
-         password = NULL;
-         decoded = NULL;
-
-         index++;
-
+         pgmoneta_json_put(response, key, (uintptr_t)config->metrics_cache_max_age, ValueInt64);
       }
-      free(trimmed_line);
-      trimmed_line = NULL;
-   }
-
-   config->number_of_users = index;
-
-   if (config->number_of_users > NUMBER_OF_USERS)
-   {
-      goto above;
-   }
-
-   free(master_key);
-
-   fclose(file);
-
-   return 0;
-
-error:
-
-   free(trimmed_line);
-   trimmed_line = NULL;
-   free(master_key);
-   free(password);
-   free(decoded);
-
-   if (file)
-   {
-      fclose(file);
-   }
-
-   return 1;
-
-masterkey:
-
-   free(master_key);
-   free(password);
-   free(decoded);
-
-   if (file)
-   {
-      fclose(file);
-   }
-
-   return 2;
-
-above:
-
-   free(master_key);
-   free(password);
-   free(decoded);
-
-   if (file)
-   {
-      fclose(file);
-   }
-
-   return 3;
-}
-
-/**
- *
- */
-int
-pgmoneta_validate_users_configuration(void* shm)
-{
-   struct configuration* config;
-
-   config = (struct configuration*)shm;
-
-   if (config->number_of_users <= 0)
-   {
-      pgmoneta_log_fatal("No users defined");
-      return 1;
-   }
-
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      bool found = false;
-
-      for (int j = 0; !found && j < config->number_of_users; j++)
+      else if (!strcmp(key, "management"))
       {
-         if (!strcmp(config->servers[i].username, config->users[j].username))
+         if (as_int(config_value, &config->management))
          {
-            found = true;
+            unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->management, ValueInt64);
       }
-
-      if (!found)
+      else if (!strcmp(key, "tls"))
       {
-         pgmoneta_log_fatal("Unknown user (\'%s\') defined for %s", config->servers[i].username, config->servers[i].name);
-         return 1;
+         if (as_bool(config_value, &config->tls))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->tls, ValueBool);
       }
-   }
-
-   return 0;
-}
-
-/**
- *
- */
-int
-pgmoneta_read_admins_configuration(void* shm, char* filename)
-{
-   FILE* file;
-   char line[LINE_LENGTH];
-   char* trimmed_line = NULL;
-   int index;
-   char* master_key = NULL;
-   char* username = NULL;
-   char* password = NULL;
-   char* decoded = NULL;
-   size_t decoded_length = 0;
-   char* ptr = NULL;
-   struct configuration* config;
-
-   file = fopen(filename, "r");
-
-   if (!file)
-   {
-      goto error;
-   }
-
-   if (pgmoneta_get_master_key(&master_key))
-   {
-      goto masterkey;
-   }
-
-   index = 0;
-   config = (struct configuration*)shm;
-
-   while (fgets(line, sizeof(line), file))
-   {
-
-      if (!is_empty_string(line))
+      else if (!strcmp(key, "tls_ca_file"))
       {
-         if (!remove_leading_whitespace_and_comments(line, &trimmed_line))
+         if (strlen(section) > 0)
          {
-            if (is_empty_string(trimmed_line))
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
             {
-               free(trimmed_line);
-               trimmed_line = NULL;
-               continue;
+               max = MISC_LENGTH - 1;
             }
+            memcpy(&config->servers[server_index].tls_ca_file, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].tls_ca_file, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            goto error;
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(config->tls_ca_file, config_value, max);
+            pgmoneta_json_put(response, key, (uintptr_t)config->tls_ca_file, ValueString);
          }
-
-         ptr = strtok(trimmed_line, ":");
-
-         username = ptr;
-
-         ptr = strtok(NULL, ":");
-
-         if (ptr == NULL)
+      }
+      else if (!strcmp(key, "tls_cert_file"))
+      {
+         if (strlen(section) > 0)
          {
-            goto error;
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(&config->servers[server_index].tls_cert_file, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].tls_cert_file, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
-
-         if (pgmoneta_base64_decode(ptr, strlen(ptr), (void**)&decoded, &decoded_length))
+         else
          {
-            goto error;
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(config->tls_cert_file, config_value, max);
+            pgmoneta_json_put(response, key, (uintptr_t)config->tls_cert_file, ValueString);
          }
-
-         if (pgmoneta_decrypt(decoded, decoded_length, master_key, &password, ENCRYPTION_AES_256_CBC))
+      }
+      else if (!strcmp(key, "tls_key_file"))
+      {
+         if (strlen(section) > 0)
          {
-            goto error;
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(&config->servers[server_index].tls_key_file, config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].tls_key_file, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
-
-         if (strlen(username) < MAX_USERNAME_LENGTH &&
-             strlen(password) < MAX_PASSWORD_LENGTH)
+         else
          {
-            memcpy(&config->admins[index].username, username, strlen(username));
-            memcpy(&config->admins[index].password, password, strlen(password));
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memcpy(config->tls_key_file, config_value, max);
+            pgmoneta_json_put(response, key, (uintptr_t)config->tls_key_file, ValueString);
          }
-         else
+      }
+      else if (!strcmp(key, "blocking_timeout"))
+      {
+         if (as_int(config_value, &config->blocking_timeout))
          {
-            warnx("pgmoneta: Invalid ADMIN entry");
-            warnx("%s", line);
+            unknown = true;
          }
-
-         free(password);
-         free(decoded);
-
-         password = NULL;
-         decoded = NULL;
-
-         index++;
-
+         pgmoneta_json_put(response, key, (uintptr_t)config->blocking_timeout, ValueInt64);
       }
-      free(trimmed_line);
-      trimmed_line = NULL;
-   }
-
-   config->number_of_admins = index;
-
-   if (config->number_of_admins > NUMBER_OF_ADMINS)
-   {
-      goto above;
-   }
-
-   free(master_key);
-
-   fclose(file);
-
-   return 0;
-
-error:
-
-   free(trimmed_line);
-   trimmed_line = NULL;
-   free(master_key);
-   free(password);
-   free(decoded);
-
-   if (file)
-   {
-      fclose(file);
-   }
-
-   return 1;
-
-masterkey:
-
-   free(master_key);
-   free(password);
-   free(decoded);
-
-   if (file)
-   {
-      fclose(file);
-   }
-
-   return 2;
-
-above:
-
-   free(master_key);
-   free(password);
-   free(decoded);
-
-   if (file)
-   {
-      fclose(file);
-   }
-
-   return 3;
-}
-
-/**
- *
- */
-int
-pgmoneta_validate_admins_configuration(void* shm)
-{
-   struct configuration* config;
-
-   config = (struct configuration*)shm;
-
-   if (config->management > 0 && config->number_of_admins == 0)
-   {
-      pgmoneta_log_warn("Remote management enabled, but no admins are defined");
-   }
-   else if (config->management == 0 && config->number_of_admins > 0)
-   {
-      pgmoneta_log_warn("Remote management disabled, but admins are defined");
-   }
-
-   return 0;
-}
-
-int
-pgmoneta_reload_configuration(bool* restart)
-{
-   size_t reload_size;
-   struct configuration* reload = NULL;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
-
-   *restart = false;
-
-   pgmoneta_log_trace("Configuration: %s", config->configuration_path);
-   pgmoneta_log_trace("Users: %s", config->users_path);
-   pgmoneta_log_trace("Admins: %s", config->admins_path);
-
-   reload_size = sizeof(struct configuration);
-
-   if (pgmoneta_create_shared_memory(reload_size, HUGEPAGE_OFF, (void**)&reload))
-   {
-      goto error;
-   }
-
-   pgmoneta_init_configuration((void*)reload);
-
-   if (pgmoneta_read_configuration((void*)reload, config->configuration_path))
-   {
-      goto error;
-   }
-
-   if (pgmoneta_read_users_configuration((void*)reload, config->users_path))
-   {
-      goto error;
-   }
-
-   if (strcmp("", config->admins_path))
-   {
-      if (pgmoneta_read_admins_configuration((void*)reload, config->admins_path))
+      else if (!strcmp(key, "management_workers"))
       {
-         goto error;
+         if (as_int(config_value, &config->management_workers))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->management_workers, ValueInt64);
       }
-   }
-
-   if (pgmoneta_validate_configuration(reload))
-   {
-      goto error;
-   }
-
-   if (pgmoneta_validate_users_configuration(reload))
-   {
-      goto error;
-   }
-
-   if (pgmoneta_validate_admins_configuration(reload))
-   {
-      goto error;
-   }
-
-   *restart = transfer_configuration(config, reload);
-
-   pgmoneta_destroy_shared_memory((void*)reload, reload_size);
-
-   pgmoneta_log_debug("Reload: Success");
-
-   return 0;
-
-error:
-   *restart = true;
-
-   if (reload != NULL)
-   {
-      pgmoneta_destroy_shared_memory((void*)reload, reload_size);
-   }
-
-   pgmoneta_log_debug("Reload: Failure");
-
-   return 1;
-}
-
-static void
-add_configuration_response(struct json* res)
-{
-   struct configuration* config = NULL;
-
-   config = (struct configuration*)shmem;
-
-   char* ret = get_retention_string(config->retention_days, config->retention_weeks, config->retention_months, config->retention_years);
-   // JSON of main configuration
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_HOST, (uintptr_t)config->host, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_UNIX_SOCKET_DIR, (uintptr_t)config->unix_socket_dir, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BASE_DIR, (uintptr_t)config->base_dir, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_METRICS, (uintptr_t)config->metrics, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_AGE, (uintptr_t)config->metrics_cache_max_age, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_SIZE, (uintptr_t)config->metrics_cache_max_size, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MANAGEMENT, (uintptr_t)config->management, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION, (uintptr_t)config->compression_type, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION_LEVEL, (uintptr_t)config->compression_level, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKERS, (uintptr_t)config->workers, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_STORAGE_ENGINE, (uintptr_t)config->storage_engine, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_ENCRYPTION, (uintptr_t)config->encryption, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CREATE_SLOT, (uintptr_t)config->create_slot, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_HOSTNAME, (uintptr_t)config->ssh_hostname, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_USERNAME, (uintptr_t)config->ssh_username, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_BASE_DIR, (uintptr_t)config->ssh_base_dir, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_SSH_CIPHERS, (uintptr_t)config->ssh_ciphers, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_AWS_REGION, (uintptr_t)config->s3_aws_region, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_ACCESS_KEY_ID, (uintptr_t)config->s3_access_key_id, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_SECRET_ACCESS_KEY, (uintptr_t)config->s3_secret_access_key, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_BUCKET, (uintptr_t)config->s3_bucket, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_S3_BASE_DIR, (uintptr_t)config->s3_base_dir, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_BASE_DIR, (uintptr_t)config->azure_base_dir, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_STORAGE_ACCOUNT, (uintptr_t)config->azure_storage_account, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_CONTAINER, (uintptr_t)config->azure_container, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_AZURE_SHARED_KEY, (uintptr_t)config->azure_shared_key, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKSPACE, (uintptr_t)config->workspace, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_RETENTION, (uintptr_t)ret, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_TYPE, (uintptr_t)config->log_type, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_LEVEL, (uintptr_t)config->log_level, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_PATH, (uintptr_t)config->log_path, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_ROTATION_AGE, (uintptr_t)config->log_rotation_age, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_ROTATION_SIZE, (uintptr_t)config->log_rotation_size, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX, (uintptr_t)config->log_line_prefix, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LOG_MODE, (uintptr_t)config->log_mode, ValueInt32);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT, (uintptr_t)config->blocking_timeout, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS, (uintptr_t)config->tls, ValueBool);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS_CERT_FILE, (uintptr_t)config->tls_cert_file, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS_CA_FILE, (uintptr_t)config->tls_ca_file, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_TLS_KEY_FILE, (uintptr_t)config->tls_key_file, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_LIBEV, (uintptr_t)config->libev, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKUP_MAX_RATE, (uintptr_t)config->backup_max_rate, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_NETWORK_MAX_RATE, (uintptr_t)config->network_max_rate, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MANIFEST, (uintptr_t)config->manifest, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_KEEP_ALIVE, (uintptr_t)config->keep_alive, ValueBool);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_NODELAY, (uintptr_t)config->nodelay, ValueBool);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_NON_BLOCKING, (uintptr_t)config->non_blocking, ValueBool);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_BACKLOG, (uintptr_t)config->backlog, ValueInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_HUGEPAGE, (uintptr_t)config->hugepage, ValueChar);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_PIDFILE, (uintptr_t)config->pidfile, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_UPDATE_PROCESS_TITLE, (uintptr_t)config->update_process_title, ValueUInt64);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MAIN_CONF_PATH, (uintptr_t)config->configuration_path, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_USER_CONF_PATH, (uintptr_t)config->users_path, ValueString);
-   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_ADMIN_CONF_PATH, (uintptr_t)config->admins_path, ValueString);
-
-   free(ret);
-}
-
-static void
-add_servers_configuration_response(struct json* res)
-{
-   struct configuration* config = NULL;
-
-   config = (struct configuration*)shmem;
-
-   // JSON of server configuration
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      struct json* server_conf = NULL;
-      char* ret = get_retention_string(config->servers[i].retention_days, config->servers[i].retention_weeks, config->servers[i].retention_months, config->servers[i].retention_years);
-
-      if (pgmoneta_json_create(&server_conf))
+      else if (!strcmp(key, "authentication_timeout"))
+      {
+         if (as_int(config_value, &config->authentication_timeout))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->authentication_timeout, ValueInt64);
+      }
+      else if (!strcmp(key, "pidfile"))
       {
-         return;
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(config->pidfile, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->pidfile, ValueString);
       }
-
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOST, (uintptr_t)config->servers[i].host, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_PORT, (uintptr_t)config->servers[i].port, ValueInt64);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_USER, (uintptr_t)config->servers[i].username, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_SLOT, (uintptr_t)config->servers[i].wal_slot, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_CREATE_SLOT, (uintptr_t)config->servers[i].create_slot, ValueInt32);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_FOLLOW, (uintptr_t)config->servers[i].follow, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WORKSPACE, (uintptr_t)config->servers[i].workspace, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_RETENTION, (uintptr_t)ret, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_SHIPPING, (uintptr_t)config->servers[i].wal_shipping, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY, (uintptr_t)config->servers[i].hot_standby, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY_OVERRIDES, (uintptr_t)config->servers[i].hot_standby_overrides, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_HOT_STANDBY_TABLESPACES, (uintptr_t)config->servers[i].hot_standby_tablespaces, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_WORKERS, (uintptr_t)config->servers[i].workers, ValueInt64);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_BACKUP_MAX_RATE, (uintptr_t)config->servers[i].backup_max_rate, ValueInt64);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_NETWORK_MAX_RATE, (uintptr_t)config->servers[i].network_max_rate, ValueInt64);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_MANIFEST, (uintptr_t)config->servers[i].manifest, ValueInt64);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_CERT_FILE, (uintptr_t)config->servers[i].tls_cert_file, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_CA_FILE, (uintptr_t)config->servers[i].tls_ca_file, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_TLS_KEY_FILE, (uintptr_t)config->servers[i].tls_key_file, ValueString);
-      pgmoneta_json_put(server_conf, CONFIGURATION_ARGUMENT_EXTRA, (uintptr_t)config->servers[i].extra, ValueString);
-
-      pgmoneta_json_put(res, config->servers[i].name, (uintptr_t)server_conf, ValueJSON);
-
-      free(ret);
-   }
-}
-
-void
-pgmoneta_conf_get(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
-{
-   struct json* response = NULL;
-   char* elapsed = NULL;
-   struct timespec start_t;
-   struct timespec end_t;
-   double total_seconds;
-
-   pgmoneta_start_logging();
-
-   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
-
-   if (pgmoneta_management_create_response(payload, -1, &response))
-   {
-      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_GET_ERROR, compression, encryption, payload);
-      pgmoneta_log_error("Conf Get: Error creating json object (%d)", MANAGEMENT_ERROR_CONF_GET_ERROR);
-      goto error;
-   }
-
-   add_configuration_response(response);
-   add_servers_configuration_response(response);
-
-   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
-
-   if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
-   {
-      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_GET_NETWORK, compression, encryption, payload);
-      pgmoneta_log_error("Conf Get: Error sending response");
-
-      goto error;
-   }
-
-   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
-
-   pgmoneta_log_info("Conf Get (Elapsed: %s)", elapsed);
-
-   pgmoneta_json_destroy(payload);
-
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_stop_logging();
-
-   exit(0);
-error:
-
-   pgmoneta_json_destroy(payload);
-
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_stop_logging();
-
-   exit(1);
-
-}
-
-void
-pgmoneta_conf_set(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
-{
-   struct json* response = NULL;
-   struct json* request = NULL;
-   char* config_key = NULL;
-   char* config_value = NULL;
-   char* elapsed = NULL;
-   struct timespec start_t;
-   struct timespec end_t;
-   double total_seconds;
-   char section[MISC_LENGTH];
-   char key[MISC_LENGTH];
-   struct configuration* config = NULL;
-   struct json* server_j = NULL;
-   size_t max;
-   int server_index = -1;
-   int begin = -1, end = -1;
-
-   pgmoneta_start_logging();
-
-   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
-
-   config = (struct configuration*)shmem;
-   // Extract config_key and config_value from request
-   request = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
-   if (!request)
-   {
-      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_NOREQUEST, compression, encryption, payload);
-      pgmoneta_log_error("Conf Set: No request category found in payload (%d)", MANAGEMENT_ERROR_CONF_SET_NOREQUEST);
-      goto error;
-   }
-
-   config_key = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_CONFIG_KEY);
-   config_value = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_CONFIG_VALUE);
-
-   if (!config_key || !config_value)
-   {
-      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_NOCONFIG_KEY_OR_VALUE, compression, encryption, payload);
-      pgmoneta_log_error("Conf Set: No config key or config value in request (%d)", MANAGEMENT_ERROR_CONF_SET_NOCONFIG_KEY_OR_VALUE);
-      goto error;
-   }
-
-   // Modify
-   memset(section, 0, MISC_LENGTH);
-   memset(key, 0, MISC_LENGTH);
-
-   for (int i = 0; i < strlen(config_key); i++)
-   {
-      if (config_key[i] == '.')
+      else if (!strcmp(key, "update_process_title"))
       {
-         if (!strlen(section))
+         config->update_process_title = as_update_process_title(config_value, UPDATE_PROCESS_TITLE_VERBOSE);
+         pgmoneta_json_put(response, key, (uintptr_t)config->update_process_title, ValueUInt64);
+      }
+      else if (!strcmp(key, "workers"))
+      {
+         if (strlen(section) > 0)
          {
-            memcpy(section, &config_key[begin], end - begin + 1);
-            section[end - begin + 1] = '\0';
-            begin = end = -1;
-            continue;
+            if (as_int(config_value, &config->servers[server_index].workers))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->workers, ValueInt64);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+         }
+         else
+         {
+            if (as_int(config_value, &config->workers))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(response, key, (uintptr_t)config->workers, ValueInt64);
          }
       }
-
-      if (begin < 0)
+      else if (!strcmp(key, "workers_per_device"))
       {
-         begin = i;
+         if (as_int(config_value, &config->workers_per_device))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->workers_per_device, ValueInt64);
       }
-
-      end = i;
-   }
-   // if the key has not been found, since there is no ending dot,
-   // try to extract it from the string
-   if (!strlen(key))
-   {
-      memcpy(key, &config_key[begin], end - begin + 1);
-      key[end - begin + 1] = '\0';
-   }
-
-   if (strlen(section) > 0)
-   {
-      if (pgmoneta_json_create(&server_j))
+      else if (!strcmp(key, "workers_autoscale"))
       {
-         pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_ERROR, compression, encryption, payload);
-         pgmoneta_log_error("Conf Set: Error creating json object (%d)", MANAGEMENT_ERROR_CONF_SET_ERROR);
-         goto error;
+         if (as_bool(config_value, &config->workers_autoscale))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->workers_autoscale, ValueBool);
+      }
+      else if (!strcmp(key, "memory_budget"))
+      {
+         if (as_size(config_value, &config->memory_budget, 0))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->memory_budget, ValueUInt64);
+      }
+      else if (!strcmp(key, "backup_durability"))
+      {
+         config->backup_durability = as_durability(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_durability, ValueInt32);
+      }
+      else if (!strcmp(key, "backup_splice"))
+      {
+         if (as_bool(config_value, &config->backup_splice))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_splice, ValueBool);
+      }
+      else if (!strcmp(key, "restore_durability"))
+      {
+         config->restore_durability = as_durability(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->restore_durability, ValueInt32);
+      }
+      else if (!strcmp(key, "cpu_affinity"))
+      {
+         if (pgmoneta_cpu_list(config_value, NULL, 0) == -1)
+         {
+            unknown = true;
+         }
+         else
+         {
+            max = strlen(config_value);
+            if (max > MISC_LENGTH - 1)
+            {
+               max = MISC_LENGTH - 1;
+            }
+            memset(config->cpu_affinity, 0, MISC_LENGTH);
+            memcpy(config->cpu_affinity, config_value, max);
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->cpu_affinity, ValueString);
+      }
+      else if (!strcmp(key, "log_type"))
+      {
+         config->log_type = as_logging_type(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_type, ValueInt32);
+      }
+      else if (!strcmp(key, "log_level"))
+      {
+         config->log_level = as_logging_level(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_level, ValueInt32);
+      }
+      else if (!strcmp(key, "log_path"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(config->log_path, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_path, ValueString);
+      }
+      else if (!strcmp(key, "log_rotation_size"))
+      {
+         if (as_logging_rotation_size(config_value, &config->log_rotation_size))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_rotation_size, ValueInt32);
+      }
+      else if (!strcmp(key, "log_rotation_age"))
+      {
+         if (as_logging_rotation_age(config_value, &config->log_rotation_age))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_rotation_age, ValueInt32);
       }
-
-      for (int i = 0; i < config->number_of_servers; i++)
+      else if (!strcmp(key, "log_line_prefix"))
       {
-         if (!strcmp(config->servers[i].name, section))
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            server_index = i;
-            break;
+            max = MISC_LENGTH - 1;
          }
+         memcpy(config->log_line_prefix, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_line_prefix, ValueString);
       }
-      if (server_index == -1)
+      else if (!strcmp(key, "log_mode"))
       {
-         pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_UNKNOWN_SERVER, compression, encryption, payload);
-         pgmoneta_log_error("Conf Set: Unknown server value parsed (%d)", MANAGEMENT_ERROR_CONF_SET_UNKNOWN_SERVER);
-         goto error;
+         config->log_mode = as_logging_mode(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->log_mode, ValueInt32);
       }
-   }
-
-   if (pgmoneta_management_create_response(payload, -1, &response))
-   {
-      pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_CONF_SET_ERROR, compression, encryption, payload);
-      pgmoneta_log_error("Conf Set: Error creating json object (%d)", MANAGEMENT_ERROR_CONF_SET_ERROR);
-      goto error;
-   }
-
-   if (strlen(key) && config_value)
-   {
-      bool unknown = false;
-      if (!strcmp(key, "host"))
+      else if (!strcmp(key, "unix_socket_dir"))
       {
-         if (strlen(section) > 0)
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-            memcpy(&config->servers[server_index].host, config_value, max);
-            config->servers[server_index].host[max] = '\0';
-            pgmoneta_json_put(server_j, key, (uintptr_t)config_value, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            max = MISC_LENGTH - 1;
          }
-         else
+         memcpy(config->unix_socket_dir, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->unix_socket_dir, ValueString);
+      }
+      else if (!strcmp(key, "libev"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-            memcpy(config->host, config_value, max);
-            config->host[max] = '\0';
-            pgmoneta_json_put(response, key, (uintptr_t)config_value, ValueString);
+            max = MISC_LENGTH - 1;
          }
+         memcpy(config->libev, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->libev, ValueString);
       }
-      else if (!strcmp(key, "port"))
+      else if (!strcmp(key, "keep_alive"))
       {
-         if (strlen(section) > 0)
+         if (as_bool(config_value, &config->keep_alive))
          {
-            if (as_int(config_value, &config->servers[server_index].port))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].port, ValueInt64);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->keep_alive, ValueBool);
+      }
+      else if (!strcmp(key, "nodelay"))
+      {
+         if (as_bool(config_value, &config->nodelay))
          {
             unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->nodelay, ValueBool);
       }
-      else if (!strcmp(key, "user"))
+      else if (!strcmp(key, "socket_buffer_size"))
       {
-         if (strlen(section) > 0)
+         if (as_bytes(config_value, &config->socket_buffer_size, 0))
          {
-            max = strlen(config_value);
-            if (max > MAX_USERNAME_LENGTH - 1)
-            {
-               max = MAX_USERNAME_LENGTH - 1;
-            }
-            memcpy(&config->servers[server_index].username, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].username, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->socket_buffer_size, ValueInt64);
+      }
+      else if (!strcmp(key, "ktls"))
+      {
+         if (as_bool(config_value, &config->ktls))
          {
             unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->ktls, ValueBool);
       }
-      else if (!strcmp(key, "extra"))
+      else if (!strcmp(key, "non_blocking"))
       {
-         if (strlen(section) > 0)
+         if (as_bool(config_value, &config->non_blocking))
          {
-            max = strlen(config_value);
-            if (max > MAX_PATH - 1)
-            {
-               max = MAX_PATH - 1;
-            }
-            int count = 0;
-            split_extra(config_value, config->servers[server_index].extra, &count);
-            config->servers[server_index].number_of_extra = count;
-            pgmoneta_json_put(server_j, key, (uintptr_t)config_value, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->non_blocking, ValueBool);
+      }
+      else if (!strcmp(key, "backlog"))
+      {
+         if (as_int(config_value, &config->backlog))
          {
             unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->backlog, ValueInt32);
       }
-      else if (!strcmp(key, "wal_slot"))
+      else if (!strcmp(key, "hugepage"))
+      {
+         config->hugepage = as_hugepage(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->hugepage, ValueChar);
+      }
+      else if (!strcmp(key, "compression"))
+      {
+         config->compression_type = as_compression(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->compression_type, ValueInt32);
+      }
+      else if (!strcmp(key, "compression_level"))
+      {
+         if (as_int(config_value, &config->compression_level))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->compression_level, ValueInt32);
+      }
+      else if (!strcmp(key, "wal_compression"))
       {
          if (strlen(section) > 0)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-            memcpy(&config->servers[server_index].wal_slot, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].wal_slot, ValueString);
+            config->servers[server_index].wal_compression_type = as_compression(config_value);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].wal_compression_type, ValueInt32);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            unknown = true;
+            config->wal_compression_type = as_compression(config_value);
+            pgmoneta_json_put(response, key, (uintptr_t)config->wal_compression_type, ValueInt32);
          }
       }
-      else if (!strcmp(key, "create_slot"))
+      else if (!strcmp(key, "wal_compression_level"))
       {
          if (strlen(section) > 0)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-
-            if (as_create_slot(config_value, &config->servers[server_index].create_slot))
+            if (as_int(config_value, &config->servers[server_index].wal_compression_level))
             {
                unknown = true;
             }
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].create_slot, ValueInt32);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].wal_compression_level, ValueInt32);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-
-            if (as_create_slot(config_value, &config->create_slot))
+            if (as_int(config_value, &config->wal_compression_level))
             {
                unknown = true;
             }
-            pgmoneta_json_put(response, key, (uintptr_t)config->create_slot, ValueInt32);
+            pgmoneta_json_put(response, key, (uintptr_t)config->wal_compression_level, ValueInt32);
          }
       }
-      else if (!strcmp(key, "follow"))
+      else if (!strcmp(key, "storage_engine"))
       {
-         if (strlen(section) > 0)
+         config->storage_engine = as_storage_engine(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->storage_engine, ValueInt32);
+      }
+      else if (!strcmp(key, "ssh_hostname"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-            memcpy(&config->servers[server_index].follow, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].follow, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            max = MISC_LENGTH - 1;
          }
-         else
+         memcpy(config->ssh_hostname, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_hostname, ValueString);
+      }
+      else if (!strcmp(key, "ssh_username"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(config->ssh_username, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_username, ValueString);
+      }
+      else if (!strcmp(key, "ssh_base_dir"))
+      {
+         max = strlen(config_value);
+         if (max > MAX_PATH - 1)
+         {
+            max = MAX_PATH - 1;
+         }
+         memcpy(&config->ssh_base_dir[0], config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_base_dir, ValueString);
+      }
+      else if (!strcmp(key, "ssh_ciphers"))
+      {
+         char* ciphers = as_ciphers(config_value);
+
+         max = strlen(ciphers);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(&config->ssh_ciphers[0], ciphers, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_ciphers, ValueString);
+
+         free(ciphers);
+      }
+      else if (!strcmp(key, "s3_aws_region"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(config->s3_aws_region, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_aws_region, ValueString);
+      }
+      else if (!strcmp(key, "s3_access_key_id"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(config->s3_access_key_id, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_access_key_id, ValueString);
+      }
+      else if (!strcmp(key, "s3_secret_access_key"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
+         {
+            max = MISC_LENGTH - 1;
+         }
+         memcpy(config->s3_secret_access_key, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_secret_access_key, ValueString);
+      }
+      else if (!strcmp(key, "s3_bucket"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            unknown = true;
+            max = MISC_LENGTH - 1;
          }
+         memcpy(config->s3_bucket, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_bucket, ValueString);
       }
-      else if (!strcmp(key, "base_dir"))
+      else if (!strcmp(key, "s3_base_dir"))
       {
          max = strlen(config_value);
          if (max > MAX_PATH - 1)
          {
             max = MAX_PATH - 1;
          }
-         memcpy(&config->base_dir[0], config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->base_dir, ValueString);
+         memcpy(config->s3_base_dir, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_base_dir, ValueString);
       }
-      else if (!strcmp(key, "wal_shipping"))
+      else if (!strcmp(key, "azure_storage_account"))
       {
-         if (strcmp(section, "pgmoneta") && strlen(section) > 0)
-         {
-            max = strlen(config_value);
-            if (max > MAX_PATH - 1)
-            {
-               max = MAX_PATH - 1;
-            }
-            memcpy(&config->servers[server_index].wal_shipping[0], config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].wal_shipping, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
-         }
-         else
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            unknown = true;
+            max = MISC_LENGTH - 1;
          }
+         memcpy(config->azure_storage_account, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->azure_storage_account, ValueString);
       }
-      else if (!strcmp(key, "hot_standby"))
+      else if (!strcmp(key, "azure_container"))
       {
-         if (strlen(section) > 0)
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            max = strlen(config_value);
-            if (max > MAX_PATH - 1)
-            {
-               max = MAX_PATH - 1;
-            }
-            memcpy(&config->servers[server_index].hot_standby, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            max = MISC_LENGTH - 1;
          }
-         else
+         memcpy(config->azure_container, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->azure_container, ValueString);
+      }
+      else if (!strcmp(key, "azure_shared_key"))
+      {
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            unknown = true;
+            max = MISC_LENGTH - 1;
          }
+         memcpy(config->azure_shared_key, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->azure_shared_key, ValueString);
       }
-      else if (!strcmp(key, "hot_standby_overrides"))
+      else if (!strcmp(key, "azure_base_dir"))
       {
-         if (strlen(section) > 0)
+         max = strlen(config_value);
+         if (max > MAX_PATH - 1)
          {
-            max = strlen(config_value);
-            if (max > MAX_PATH - 1)
-            {
-               max = MAX_PATH - 1;
-            }
-            memcpy(&config->servers[server_index].hot_standby_overrides, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby_overrides, ValueString);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            max = MAX_PATH - 1;
          }
-         else
+         memcpy(config->azure_base_dir, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->azure_base_dir, ValueString);
+      }
+      else if (!strcmp(key, "azure_base_dir"))
+      {
+         max = strlen(config_value);
+         if (max > MAX_PATH - 1)
          {
-            unknown = true;
+            max = MAX_PATH - 1;
          }
+         memcpy(config->workspace, config_value, max);
+         pgmoneta_json_put(response, key, (uintptr_t)config->workspace, ValueString);
       }
-      else if (!strcmp(key, "hot_standby_tablespaces"))
+      else if (!strcmp(key, "retention"))
       {
          if (strlen(section) > 0)
          {
-            max = strlen(config_value);
-            if (max > MAX_PATH - 1)
+            char* ret = get_retention_string(config->servers[server_index].retention_days, config->servers[server_index].retention_weeks, config->servers[server_index].retention_months, config->servers[server_index].retention_years);
+            config->servers[server_index].retention_days = -1;
+            config->servers[server_index].retention_weeks = -1;
+            config->servers[server_index].retention_months = -1;
+            config->servers[server_index].retention_years = -1;
+            if (as_retention(config_value, &config->servers[server_index].retention_days,
+                             &config->servers[server_index].retention_weeks,
+                             &config->servers[server_index].retention_months,
+                             &config->servers[server_index].retention_years))
             {
-               max = MAX_PATH - 1;
+               unknown = true;
             }
-            memcpy(&config->servers[server_index].hot_standby_tablespaces, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].hot_standby_tablespaces, ValueString);
+            pgmoneta_json_put(server_j, key, (uintptr_t)ret, ValueString);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            free(ret);
          }
          else
          {
-            unknown = true;
+            char* ret = get_retention_string(config->retention_days, config->retention_weeks, config->retention_months, config->retention_years);
+            config->retention_days = -1;
+            config->retention_weeks = -1;
+            config->retention_months = -1;
+            config->retention_years = -1;
+            if (as_retention(config_value, &config->retention_days,
+                             &config->retention_weeks,
+                             &config->retention_months,
+                             &config->retention_years))
+            {
+               unknown = true;
+            }
+            pgmoneta_json_put(response, key, (uintptr_t)ret, ValueString);
+            free(ret);
          }
       }
-      else if (!strcmp(key, "metrics"))
+      else if (!strcmp(key, "backup_schedule"))
       {
-         if (as_int(config_value, &config->metrics))
+         struct cron cron;
+
+         max = strlen(config_value);
+         if (max > MISC_LENGTH - 1)
          {
-            unknown = true;
+            max = MISC_LENGTH - 1;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->metrics, ValueInt64);
-      }
-      else if (!strcmp(key, "metrics_cache_max_size"))
-      {
-         if (as_bytes(config_value, &config->metrics_cache_max_size, 0))
+
+         if (max > 0 && pgmoneta_cron_parse(config_value, &cron))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->metrics_cache_max_size, ValueInt64);
-      }
-      else if (!strcmp(key, "metrics_cache_max_age"))
-      {
-         if (as_seconds(config_value, &config->metrics_cache_max_age, 0))
+         else if (strlen(section) > 0)
          {
-            unknown = true;
+            memset(&config->servers[server_index].backup_schedule[0], 0, MISC_LENGTH);
+            memcpy(&config->servers[server_index].backup_schedule[0], config_value, max);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].backup_schedule, ValueString);
+            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->metrics_cache_max_age, ValueInt64);
-      }
-      else if (!strcmp(key, "management"))
-      {
-         if (as_int(config_value, &config->management))
+         else
          {
-            unknown = true;
+            memset(&config->backup_schedule[0], 0, MISC_LENGTH);
+            memcpy(&config->backup_schedule[0], config_value, max);
+            pgmoneta_json_put(response, key, (uintptr_t)config->backup_schedule, ValueString);
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->management, ValueInt64);
       }
-      else if (!strcmp(key, "tls"))
+      else if (!strcmp(key, "encryption"))
       {
-         if (as_bool(config_value, &config->tls))
-         {
-            unknown = true;
-         }
-         pgmoneta_json_put(response, key, (uintptr_t)config->tls, ValueBool);
+         config->encryption = as_encryption_mode(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->encryption, ValueInt32);
       }
-      else if (!strcmp(key, "tls_ca_file"))
+      else if (!strcmp(key, "backup_max_rate"))
       {
          if (strlen(section) > 0)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
+            if (as_int(config_value, &config->servers[server_index].backup_max_rate))
             {
-               max = MISC_LENGTH - 1;
+               unknown = true;
             }
-            memcpy(&config->servers[server_index].tls_ca_file, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].tls_ca_file, ValueString);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].backup_max_rate, ValueInt32);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
+            if (as_int(config_value, &config->backup_max_rate))
             {
-               max = MISC_LENGTH - 1;
+               unknown = true;
             }
-            memcpy(config->tls_ca_file, config_value, max);
-            pgmoneta_json_put(response, key, (uintptr_t)config->tls_ca_file, ValueString);
+            pgmoneta_json_put(response, key, (uintptr_t)config->backup_max_rate, ValueInt32);
          }
       }
-      else if (!strcmp(key, "tls_cert_file"))
+      else if (!strcmp(key, "network_max_rate"))
       {
          if (strlen(section) > 0)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
+            if (as_int(config_value, &config->servers[server_index].network_max_rate))
             {
-               max = MISC_LENGTH - 1;
+               unknown = true;
             }
-            memcpy(&config->servers[server_index].tls_cert_file, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].tls_cert_file, ValueString);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].network_max_rate, ValueInt32);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
+            if (as_int(config_value, &config->network_max_rate))
             {
-               max = MISC_LENGTH - 1;
+               unknown = true;
             }
-            memcpy(config->tls_cert_file, config_value, max);
-            pgmoneta_json_put(response, key, (uintptr_t)config->tls_cert_file, ValueString);
+            pgmoneta_json_put(response, key, (uintptr_t)config->network_max_rate, ValueInt32);
          }
       }
-      else if (!strcmp(key, "tls_key_file"))
+      else if (!strcmp(key, "manifest"))
       {
          if (strlen(section) > 0)
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-            memcpy(&config->servers[server_index].tls_key_file, config_value, max);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].tls_key_file, ValueString);
+            config->servers[server_index].manifest = pgmoneta_get_hash_algorithm(config_value);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].manifest, ValueInt32);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
          }
          else
          {
-            max = strlen(config_value);
-            if (max > MISC_LENGTH - 1)
-            {
-               max = MISC_LENGTH - 1;
-            }
-            memcpy(config->tls_key_file, config_value, max);
-            pgmoneta_json_put(response, key, (uintptr_t)config->tls_key_file, ValueString);
+            config->manifest = pgmoneta_get_hash_algorithm(config_value);
+            pgmoneta_json_put(response, key, (uintptr_t)config->manifest, ValueInt32);
          }
       }
-      else if (!strcmp(key, "blocking_timeout"))
+      else if (!strcmp(key, "wal_stream_compression"))
       {
-         if (as_int(config_value, &config->blocking_timeout))
+         if (as_bool(config_value, &config->wal_stream_compression))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->blocking_timeout, ValueInt64);
-      }
-      else if (!strcmp(key, "pidfile"))
-      {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
-         {
-            max = MISC_LENGTH - 1;
-         }
-         memcpy(config->pidfile, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->pidfile, ValueString);
-      }
-      else if (!strcmp(key, "update_process_title"))
-      {
-         config->update_process_title = as_update_process_title(config_value, UPDATE_PROCESS_TITLE_VERBOSE);
-         pgmoneta_json_put(response, key, (uintptr_t)config->update_process_title, ValueUInt64);
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_stream_compression, ValueBool);
       }
-      else if (!strcmp(key, "workers"))
+      else if (!strcmp(key, "wal_synchronous"))
       {
-         if (strlen(section) > 0)
-         {
-            if (as_int(config_value, &config->servers[server_index].workers))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->workers, ValueInt64);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
-         }
-         else
+         if (as_bool(config_value, &config->wal_synchronous))
          {
-            if (as_int(config_value, &config->workers))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(response, key, (uintptr_t)config->workers, ValueInt64);
+            unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_synchronous, ValueBool);
       }
-      else if (!strcmp(key, "log_type"))
-      {
-         config->log_type = as_logging_type(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_type, ValueInt32);
-      }
-      else if (!strcmp(key, "log_level"))
-      {
-         config->log_level = as_logging_level(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_level, ValueInt32);
+      else if (!strcmp(key, "wal_prealloc"))
+      {
+         if (as_int(config_value, &config->wal_prealloc))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_prealloc, ValueInt64);
       }
-      else if (!strcmp(key, "log_path"))
+      else if (!strcmp(key, "wal_fanout_size"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_bytes(config_value, &config->wal_fanout_size, 0))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->log_path, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_path, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_fanout_size, ValueInt64);
       }
-      else if (!strcmp(key, "log_rotation_size"))
+      else if (!strcmp(key, "wal_receivers"))
       {
-         if (as_logging_rotation_size(config_value, &config->log_rotation_size))
+         if (as_int(config_value, &config->wal_receivers))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_rotation_size, ValueInt32);
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_receivers, ValueInt64);
       }
-      else if (!strcmp(key, "log_rotation_age"))
+      else if (!strcmp(key, "backup_pipeline"))
       {
-         if (as_logging_rotation_age(config_value, &config->log_rotation_age))
+         if (as_bool(config_value, &config->backup_pipeline))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_rotation_age, ValueInt32);
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_pipeline, ValueBool);
       }
-      else if (!strcmp(key, "log_line_prefix"))
+      else if (!strcmp(key, "backup_connections"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->backup_connections))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->log_line_prefix, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_line_prefix, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_connections, ValueInt64);
       }
-      else if (!strcmp(key, "log_mode"))
+      else if (!strcmp(key, "seekable_frame_size"))
       {
-         config->log_mode = as_logging_mode(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->log_mode, ValueInt32);
+         if (as_bytes(config_value, &config->seekable_frame_size, 0))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->seekable_frame_size, ValueInt64);
       }
-      else if (!strcmp(key, "unix_socket_dir"))
+      else if (!strcmp(key, "compression_dictionary"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_bool(config_value, &config->compression_dictionary))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->unix_socket_dir, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->unix_socket_dir, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->compression_dictionary, ValueBool);
       }
-      else if (!strcmp(key, "libev"))
+      else if (!strcmp(key, "compression_adaptive"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_bool(config_value, &config->compression_adaptive))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->libev, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->libev, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->compression_adaptive, ValueBool);
       }
-      else if (!strcmp(key, "keep_alive"))
+      else if (!strcmp(key, "compression_probe"))
       {
-         if (as_bool(config_value, &config->keep_alive))
+         if (as_bool(config_value, &config->compression_probe))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->keep_alive, ValueBool);
+         pgmoneta_json_put(response, key, (uintptr_t)config->compression_probe, ValueBool);
       }
-      else if (!strcmp(key, "nodelay"))
+      else if (!strcmp(key, "deduplication"))
       {
-         if (as_bool(config_value, &config->nodelay))
+         if (as_bool(config_value, &config->deduplication))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->nodelay, ValueBool);
+         pgmoneta_json_put(response, key, (uintptr_t)config->deduplication, ValueBool);
       }
-      else if (!strcmp(key, "non_blocking"))
+      else if (!strcmp(key, "page_filter"))
       {
-         if (as_bool(config_value, &config->non_blocking))
+         if (as_bool(config_value, &config->page_filter))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->non_blocking, ValueBool);
+         pgmoneta_json_put(response, key, (uintptr_t)config->page_filter, ValueBool);
       }
-      else if (!strcmp(key, "backlog"))
+      else if (!strcmp(key, "link_verify"))
       {
-         if (as_int(config_value, &config->backlog))
+         if (as_int(config_value, &config->link_verify))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->backlog, ValueInt32);
+         pgmoneta_json_put(response, key, (uintptr_t)config->link_verify, ValueInt64);
       }
-      else if (!strcmp(key, "hugepage"))
+      else if (!strcmp(key, "io_engine"))
       {
-         config->hugepage = as_hugepage(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->hugepage, ValueChar);
+         config->io_engine = as_io_engine(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->io_engine, ValueInt32);
       }
-      else if (!strcmp(key, "compression"))
+      else if (!strcmp(key, "io_cache"))
       {
-         config->compression_type = as_compression(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->compression_type, ValueInt32);
+         config->io_cache = as_io_cache(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->io_cache, ValueInt32);
       }
-      else if (!strcmp(key, "compression_level"))
+      else if (!strcmp(key, "gzip_engine"))
       {
-         if (as_int(config_value, &config->compression_level))
+         config->gzip_engine = as_gzip_engine(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->gzip_engine, ValueInt32);
+      }
+      else if (!strcmp(key, "sparse_files"))
+      {
+         if (as_bool(config_value, &config->sparse_files))
          {
             unknown = true;
          }
-         pgmoneta_json_put(response, key, (uintptr_t)config->compression_level, ValueInt32);
+         pgmoneta_json_put(response, key, (uintptr_t)config->sparse_files, ValueBool);
       }
-      else if (!strcmp(key, "storage_engine"))
+      else if (!strcmp(key, "wal_pack"))
       {
-         config->storage_engine = as_storage_engine(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->storage_engine, ValueInt32);
+         if (as_int(config_value, &config->wal_pack))
+         {
+            unknown = true;
+         }
+         if (config->wal_pack < 0)
+         {
+            config->wal_pack = 0;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_pack, ValueInt64);
       }
-      else if (!strcmp(key, "ssh_hostname"))
+      else if (!strcmp(key, "wal_compaction"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_bool(config_value, &config->wal_compaction))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->ssh_hostname, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_hostname, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_compaction, ValueBool);
       }
-      else if (!strcmp(key, "ssh_username"))
+      else if (!strcmp(key, "verify_mode"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         config->verify_mode = as_verify_mode(config_value);
+         pgmoneta_json_put(response, key, (uintptr_t)config->verify_mode, ValueInt32);
+      }
+      else if (!strcmp(key, "verify_sample"))
+      {
+         if (as_int(config_value, &config->verify_sample))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->ssh_username, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_username, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->verify_sample, ValueInt64);
       }
-      else if (!strcmp(key, "ssh_base_dir"))
+      else if (!strcmp(key, "verify_fail_fast"))
       {
-         max = strlen(config_value);
-         if (max > MAX_PATH - 1)
+         if (as_bool(config_value, &config->verify_fail_fast))
          {
-            max = MAX_PATH - 1;
+            unknown = true;
          }
-         memcpy(&config->ssh_base_dir[0], config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_base_dir, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->verify_fail_fast, ValueBool);
       }
-      else if (!strcmp(key, "ssh_ciphers"))
+      else if (!strcmp(key, "trace_sample"))
       {
-         char* ciphers = as_ciphers(config_value);
-
-         max = strlen(ciphers);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->trace_sample))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(&config->ssh_ciphers[0], ciphers, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_ciphers, ValueString);
-
-         free(ciphers);
+         pgmoneta_json_put(response, key, (uintptr_t)config->trace_sample, ValueInt64);
       }
-      else if (!strcmp(key, "s3_aws_region"))
+      else if (!strcmp(key, "trace_events"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->trace_events))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->s3_aws_region, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->s3_aws_region, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->trace_events, ValueInt64);
       }
-      else if (!strcmp(key, "s3_access_key_id"))
+      else if (!strcmp(key, "s3_part_size"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_bytes(config_value, &config->s3_part_size, 0))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->s3_access_key_id, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->s3_access_key_id, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_part_size, ValueInt64);
       }
-      else if (!strcmp(key, "s3_secret_access_key"))
+      else if (!strcmp(key, "s3_concurrency"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->s3_concurrency))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->s3_secret_access_key, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->s3_secret_access_key, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_concurrency, ValueInt64);
       }
-      else if (!strcmp(key, "s3_bucket"))
+      else if (!strcmp(key, "s3_unsigned_payload"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_bool(config_value, &config->s3_unsigned_payload))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->s3_bucket, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->s3_bucket, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->s3_unsigned_payload, ValueBool);
       }
-      else if (!strcmp(key, "s3_base_dir"))
+      else if (!strcmp(key, "azure_block_size"))
       {
-         max = strlen(config_value);
-         if (max > MAX_PATH - 1)
+         if (as_bytes(config_value, &config->azure_block_size, 0))
          {
-            max = MAX_PATH - 1;
+            unknown = true;
          }
-         memcpy(config->s3_base_dir, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->s3_base_dir, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->azure_block_size, ValueInt64);
       }
-      else if (!strcmp(key, "azure_storage_account"))
+      else if (!strcmp(key, "wal_archive_queue"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->wal_archive_queue))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->azure_storage_account, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->azure_storage_account, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_archive_queue, ValueInt64);
       }
-      else if (!strcmp(key, "azure_container"))
+      else if (!strcmp(key, "wal_archive_retries"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->wal_archive_retries))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->azure_container, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->azure_container, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_archive_retries, ValueInt64);
       }
-      else if (!strcmp(key, "azure_shared_key"))
+      else if (!strcmp(key, "ssh_retries"))
       {
-         max = strlen(config_value);
-         if (max > MISC_LENGTH - 1)
+         if (as_int(config_value, &config->ssh_retries))
          {
-            max = MISC_LENGTH - 1;
+            unknown = true;
          }
-         memcpy(config->azure_shared_key, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->azure_shared_key, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_retries, ValueInt64);
       }
-      else if (!strcmp(key, "azure_base_dir"))
+      else if (!strcmp(key, "ssh_manifest_diff"))
       {
-         max = strlen(config_value);
-         if (max > MAX_PATH - 1)
+         if (as_bool(config_value, &config->ssh_manifest_diff))
          {
-            max = MAX_PATH - 1;
+            unknown = true;
          }
-         memcpy(config->azure_base_dir, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->azure_base_dir, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->ssh_manifest_diff, ValueBool);
       }
-      else if (!strcmp(key, "azure_base_dir"))
+      else if (!strcmp(key, "storage_max_rate"))
       {
-         max = strlen(config_value);
-         if (max > MAX_PATH - 1)
+         if (as_int(config_value, &config->storage_max_rate))
          {
-            max = MAX_PATH - 1;
+            unknown = true;
          }
-         memcpy(config->workspace, config_value, max);
-         pgmoneta_json_put(response, key, (uintptr_t)config->workspace, ValueString);
+         pgmoneta_json_put(response, key, (uintptr_t)config->storage_max_rate, ValueInt64);
       }
-      else if (!strcmp(key, "retention"))
+      else if (!strcmp(key, "retention_local"))
       {
          if (strlen(section) > 0)
          {
-            char* ret = get_retention_string(config->servers[server_index].retention_days, config->servers[server_index].retention_weeks, config->servers[server_index].retention_months, config->servers[server_index].retention_years);
-            config->servers[server_index].retention_days = -1;
-            config->servers[server_index].retention_weeks = -1;
-            config->servers[server_index].retention_months = -1;
-            config->servers[server_index].retention_years = -1;
-            if (as_retention(config_value, &config->servers[server_index].retention_days,
-                             &config->servers[server_index].retention_weeks,
-                             &config->servers[server_index].retention_months,
-                             &config->servers[server_index].retention_years))
+            if (as_int(config_value, &config->servers[server_index].retention_local))
             {
                unknown = true;
             }
-            pgmoneta_json_put(server_j, key, (uintptr_t)ret, ValueString);
+            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].retention_local, ValueInt64);
             pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
-            free(ret);
          }
          else
          {
-            char* ret = get_retention_string(config->retention_days, config->retention_weeks, config->retention_months, config->retention_years);
-            config->retention_days = -1;
-            config->retention_weeks = -1;
-            config->retention_months = -1;
-            config->retention_years = -1;
-            if (as_retention(config_value, &config->retention_days,
-                             &config->retention_weeks,
-                             &config->retention_months,
-                             &config->retention_years))
+            if (as_int(config_value, &config->retention_local))
             {
                unknown = true;
             }
-            pgmoneta_json_put(response, key, (uintptr_t)ret, ValueString);
-            free(ret);
+            pgmoneta_json_put(response, key, (uintptr_t)config->retention_local, ValueInt64);
          }
       }
-      else if (!strcmp(key, "encryption"))
+      else if (!strcmp(key, "retention_remote"))
       {
-         config->encryption = as_encryption_mode(config_value);
-         pgmoneta_json_put(response, key, (uintptr_t)config->encryption, ValueInt32);
+         if (as_bool(config_value, &config->retention_remote))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->retention_remote, ValueBool);
       }
-      else if (!strcmp(key, "backup_max_rate"))
+      else if (!strcmp(key, "wal_index"))
       {
-         if (strlen(section) > 0)
+         if (as_bool(config_value, &config->wal_index))
          {
-            if (as_int(config_value, &config->servers[server_index].backup_max_rate))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].backup_max_rate, ValueInt32);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_index, ValueBool);
+      }
+      else if (!strcmp(key, "restore_prewarm"))
+      {
+         if (as_size(config_value, &config->restore_prewarm, 0))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->restore_prewarm, ValueUInt64);
+      }
+      else if (!strcmp(key, "scheduler_workers"))
+      {
+         if (as_int(config_value, &config->scheduler_workers))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->scheduler_workers, ValueInt64);
+      }
+      else if (!strcmp(key, "scheduler_disk"))
+      {
+         if (as_int(config_value, &config->scheduler_disk))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->scheduler_disk, ValueInt64);
+      }
+      else if (!strcmp(key, "scheduler_network"))
+      {
+         if (as_int(config_value, &config->scheduler_network))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->scheduler_network, ValueInt64);
+      }
+      else if (!strcmp(key, "delete_max_rate"))
+      {
+         if (as_int(config_value, &config->delete_max_rate))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->delete_max_rate, ValueInt64);
+      }
+      else if (!strcmp(key, "total_max_rate"))
+      {
+         if (as_int(config_value, &config->total_max_rate))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->total_max_rate, ValueInt64);
+      }
+      else if (!strcmp(key, "max_rate_burst"))
+      {
+         if (as_bytes(config_value, &config->max_rate_burst, 0))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->max_rate_burst, ValueInt64);
+      }
+      else if (!strcmp(key, "wal_prefetch"))
+      {
+         if (as_int(config_value, &config->wal_prefetch))
+         {
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_prefetch, ValueInt64);
+      }
+      else if (!strcmp(key, "backup_schedule_jitter"))
+      {
+         if (as_seconds(config_value, &config->backup_schedule_jitter, 0))
          {
-            if (as_int(config_value, &config->backup_max_rate))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(response, key, (uintptr_t)config->backup_max_rate, ValueInt32);
+            unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_schedule_jitter, ValueInt64);
       }
-      else if (!strcmp(key, "network_max_rate"))
+      else if (!strcmp(key, "backup_schedule_max"))
       {
-         if (strlen(section) > 0)
+         if (as_int(config_value, &config->backup_schedule_max))
          {
-            if (as_int(config_value, &config->servers[server_index].network_max_rate))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].network_max_rate, ValueInt32);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_schedule_max, ValueInt64);
+      }
+      else if (!strcmp(key, "backup_throttle_lag"))
+      {
+         if (as_bytes(config_value, &config->backup_throttle_lag, 0))
          {
-            if (as_int(config_value, &config->network_max_rate))
-            {
-               unknown = true;
-            }
-            pgmoneta_json_put(response, key, (uintptr_t)config->network_max_rate, ValueInt32);
+            unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_throttle_lag, ValueInt64);
       }
-      else if (!strcmp(key, "manifest"))
+      else if (!strcmp(key, "backup_throttle_active"))
       {
-         if (strlen(section) > 0)
+         if (as_int(config_value, &config->backup_throttle_active))
          {
-            config->servers[server_index].manifest = pgmoneta_get_hash_algorithm(config_value);
-            pgmoneta_json_put(server_j, key, (uintptr_t)config->servers[server_index].manifest, ValueInt32);
-            pgmoneta_json_put(response, config->servers[server_index].name, (uintptr_t)server_j, ValueJSON);
+            unknown = true;
          }
-         else
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_throttle_active, ValueInt64);
+      }
+      else if (!strcmp(key, "backup_throttle_io"))
+      {
+         if (as_int(config_value, &config->backup_throttle_io))
          {
-            config->manifest = pgmoneta_get_hash_algorithm(config_value);
-            pgmoneta_json_put(response, key, (uintptr_t)config->manifest, ValueInt32);
+            unknown = true;
          }
+         pgmoneta_json_put(response, key, (uintptr_t)config->backup_throttle_io, ValueInt64);
       }
       else
       {
@@ -3497,6 +5513,22 @@ as_hugepage(char* str)
    return HUGEPAGE_OFF;
 }
 
+static int
+as_durability(char* str)
+{
+   if (!strcasecmp(str, "fsync"))
+   {
+      return DURABILITY_FSYNC;
+   }
+
+   if (!strcasecmp(str, "write_behind"))
+   {
+      return DURABILITY_WRITE_BEHIND;
+   }
+
+   return DURABILITY_SYNCFS;
+}
+
 static int
 as_compression(char* str)
 {
@@ -3780,6 +5812,54 @@ as_storage_engine(char* str)
    return STORAGE_ENGINE_TYPES;
 }
 
+static int
+as_io_engine(char* str)
+{
+   if (!strcasecmp(str, "io_uring"))
+   {
+      return IO_ENGINE_IO_URING;
+   }
+
+   return IO_ENGINE_SYNC;
+}
+
+static int
+as_io_cache(char* str)
+{
+   if (!strcasecmp(str, "drop"))
+   {
+      return IO_CACHE_DROP;
+   }
+   else if (!strcasecmp(str, "direct"))
+   {
+      return IO_CACHE_DIRECT;
+   }
+
+   return IO_CACHE_KEEP;
+}
+
+static int
+as_gzip_engine(char* str)
+{
+   if (!strcasecmp(str, "libdeflate"))
+   {
+      return GZIP_ENGINE_LIBDEFLATE;
+   }
+
+   return GZIP_ENGINE_ZLIB;
+}
+
+static int
+as_verify_mode(char* str)
+{
+   if (!strcasecmp(str, "stream"))
+   {
+      return VERIFY_MODE_STREAM;
+   }
+
+   return VERIFY_MODE_RESTORE;
+}
+
 static char*
 as_ciphers(char* str)
 {
@@ -4039,11 +6119,28 @@ error:
 static int
 as_bytes(char* str, int* bytes, int default_bytes)
 {
-   int multiplier = 1;
+   size_t size = 0;
+
+   if (as_size(str, &size, default_bytes >= 0 ? (size_t)default_bytes : 0) || size > INT_MAX)
+   {
+      *bytes = default_bytes;
+      return 1;
+   }
+
+   *bytes = is_empty_string(str) ? default_bytes : (int)size;
+
+   return 0;
+}
+
+static int
+as_size(char* str, size_t* bytes, size_t default_bytes)
+{
+   size_t multiplier = 1;
    int index;
    char value[MISC_LENGTH];
    bool multiplier_set = false;
-   int i_value = default_bytes;
+   char* endptr = NULL;
+   unsigned long long u_value;
 
    if (is_empty_string(str))
    {
@@ -4052,7 +6149,7 @@ as_bytes(char* str, int* bytes, int default_bytes)
    }
 
    index = 0;
-   for (size_t i = 0; i < strlen(str); i++)
+   for (size_t i = 0; i < strlen(str) && index < MISC_LENGTH - 1; i++)
    {
       if (isdigit(str[i]))
       {
@@ -4100,27 +6197,23 @@ as_bytes(char* str, int* bytes, int default_bytes)
    }
 
    value[index] = '\0';
-   if (!as_int(value, &i_value))
-   {
-      // sanity check: the value
-      // must be a positive number!
-      if (i_value >= 0)
-      {
-         *bytes = i_value * multiplier;
-      }
-      else
-      {
-         goto error;
-      }
 
-      return 0;
-   }
-   else
+   errno = 0;
+   u_value = strtoull(value, &endptr, 10);
+   if (index == 0 || errno != 0 || *endptr != '\0' || u_value > SIZE_MAX / multiplier)
    {
-error:
-      *bytes = default_bytes;
-      return 1;
+      errno = 0;
+      goto error;
    }
+
+   *bytes = (size_t)u_value * multiplier;
+
+   return 0;
+
+error:
+
+   *bytes = default_bytes;
+   return 1;
 }
 
 static int
@@ -4161,6 +6254,16 @@ as_encryption_mode(char* str)
       return ENCRYPTION_AES_128_CTR;
    }
 
+   if (!strcasecmp(str, "aes-256-gcm"))
+   {
+      return ENCRYPTION_AES_256_GCM;
+   }
+
+   if (!strcasecmp(str, "chacha20-poly1305"))
+   {
+      return ENCRYPTION_CHACHA20_POLY1305;
+   }
+
    warnx("Unknown encryption mode: %s", str);
 
    return ENCRYPTION_NONE;
@@ -4254,6 +6357,8 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    config->create_slot = reload->create_slot;
    config->compression_type = reload->compression_type;
    config->compression_level = reload->compression_level;
+   config->wal_compression_type = reload->wal_compression_type;
+   config->wal_compression_level = reload->wal_compression_level;
    if (restart_string("workspace", config->workspace, reload->workspace))
    {
       changed = true;
@@ -4305,6 +6410,10 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    }
 
    config->blocking_timeout = reload->blocking_timeout;
+   if (restart_int("management_workers", config->management_workers, reload->management_workers))
+   {
+      changed = true;
+   }
    config->authentication_timeout = reload->authentication_timeout;
 
    if (strcmp("", reload->pidfile))
@@ -4318,6 +6427,8 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    }
    config->keep_alive = reload->keep_alive;
    config->nodelay = reload->nodelay;
+   config->socket_buffer_size = reload->socket_buffer_size;
+   config->ktls = reload->ktls;
    config->non_blocking = reload->non_blocking;
    config->backlog = reload->backlog;
    if (restart_int("hugepage", config->hugepage, reload->hugepage))
@@ -4335,7 +6446,7 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 
    for (int i = 0; i < NUMBER_OF_SERVERS; i++)
    {
-      if (copy_server(&config->servers[i], &reload->servers[i]))
+      if (copy_server(&config->servers[i], &config->states[i], &reload->servers[i]))
       {
          changed = true;
       }
@@ -4358,15 +6469,107 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    config->number_of_admins = reload->number_of_admins;
 
    config->workers = reload->workers;
+   config->workers_per_device = reload->workers_per_device;
+   config->workers_autoscale = reload->workers_autoscale;
+   memcpy(config->cpu_affinity, reload->cpu_affinity, MISC_LENGTH);
+   config->memory_budget = reload->memory_budget;
+   config->backup_durability = reload->backup_durability;
+   config->backup_splice = reload->backup_splice;
+   config->restore_durability = reload->restore_durability;
    config->backup_max_rate = reload->backup_max_rate;
    config->network_max_rate = reload->network_max_rate;
    config->manifest = reload->manifest;
+   config->wal_stream_compression = reload->wal_stream_compression;
+   config->wal_synchronous = reload->wal_synchronous;
+   config->wal_prealloc = reload->wal_prealloc;
+   config->wal_fanout_size = reload->wal_fanout_size;
+   if (restart_int("wal_receivers", config->wal_receivers, reload->wal_receivers))
+   {
+      changed = true;
+   }
+   config->backup_pipeline = reload->backup_pipeline;
+   config->backup_connections = reload->backup_connections;
+   config->seekable_frame_size = reload->seekable_frame_size;
+   config->compression_dictionary = reload->compression_dictionary;
+   config->compression_adaptive = reload->compression_adaptive;
+   config->compression_probe = reload->compression_probe;
+   config->deduplication = reload->deduplication;
+   config->page_filter = reload->page_filter;
+   config->link_verify = reload->link_verify;
+   config->io_engine = reload->io_engine;
+   config->io_cache = reload->io_cache;
+   config->gzip_engine = reload->gzip_engine;
+   config->sparse_files = reload->sparse_files;
+   config->wal_pack = reload->wal_pack;
+   config->wal_compaction = reload->wal_compaction;
+   config->verify_mode = reload->verify_mode;
+   config->verify_sample = reload->verify_sample;
+   config->verify_fail_fast = reload->verify_fail_fast;
+   config->trace_sample = reload->trace_sample;
+   config->trace_events = reload->trace_events;
+   config->s3_part_size = reload->s3_part_size;
+   config->s3_concurrency = reload->s3_concurrency;
+   config->s3_unsigned_payload = reload->s3_unsigned_payload;
+   config->azure_block_size = reload->azure_block_size;
+   config->wal_archive_queue = reload->wal_archive_queue;
+   config->wal_archive_retries = reload->wal_archive_retries;
+   config->ssh_retries = reload->ssh_retries;
+   config->ssh_manifest_diff = reload->ssh_manifest_diff;
+   config->storage_max_rate = reload->storage_max_rate;
+   config->retention_local = reload->retention_local;
+   config->retention_remote = reload->retention_remote;
+   config->wal_index = reload->wal_index;
+   config->restore_prewarm = reload->restore_prewarm;
+   config->scheduler_workers = reload->scheduler_workers;
+   config->scheduler_disk = reload->scheduler_disk;
+   config->scheduler_network = reload->scheduler_network;
+   config->delete_max_rate = reload->delete_max_rate;
+   config->total_max_rate = reload->total_max_rate;
+   config->max_rate_burst = reload->max_rate_burst;
+   config->wal_prefetch = reload->wal_prefetch;
+   memcpy(config->backup_schedule, reload->backup_schedule, MISC_LENGTH);
+   config->backup_schedule_jitter = reload->backup_schedule_jitter;
+   config->backup_schedule_max = reload->backup_schedule_max;
+   config->backup_throttle_lag = reload->backup_throttle_lag;
+   config->backup_throttle_active = reload->backup_throttle_active;
+   config->backup_throttle_io = reload->backup_throttle_io;
+   if (restart_string("cluster_dir", config->cluster_dir, reload->cluster_dir))
+   {
+      changed = true;
+   }
+   if (restart_string("cluster_node", config->cluster_node, reload->cluster_node))
+   {
+      changed = true;
+   }
+   if (restart_int("cluster_lease", config->cluster_lease, reload->cluster_lease))
+   {
+      changed = true;
+   }
+   memcpy(config->backup_volumes, reload->backup_volumes, sizeof(config->backup_volumes));
+   config->number_of_backup_volumes = reload->number_of_backup_volumes;
+
+   /* the WAL receivers apply the WAL settings at their next segment */
+   atomic_fetch_add(&config->reload_generation, 1);
 
    /* prometheus */
    atomic_init(&config->prometheus.logging_info, 0);
    atomic_init(&config->prometheus.logging_warn, 0);
    atomic_init(&config->prometheus.logging_error, 0);
    atomic_init(&config->prometheus.logging_fatal, 0);
+   atomic_init(&config->prometheus.memory_pool_allocations, 0);
+   atomic_init(&config->prometheus.memory_pool_cache_hits, 0);
+   atomic_init(&config->prometheus.memory_pool_oversized, 0);
+   atomic_init(&config->prometheus.worker_busy, 0);
+   atomic_init(&config->prometheus.worker_idle, 0);
+   for (int i = 0; i < PROMETHEUS_LATENCY_BUCKETS; i++)
+   {
+      atomic_init(&config->prometheus.worker_task.bucket[i], 0);
+      atomic_init(&config->prometheus.worker_queue_wait.bucket[i], 0);
+   }
+   atomic_init(&config->prometheus.worker_task.count, 0);
+   atomic_init(&config->prometheus.worker_task.sum, 0);
+   atomic_init(&config->prometheus.worker_queue_wait.count, 0);
+   atomic_init(&config->prometheus.worker_queue_wait.sum, 0);
 
 #ifdef HAVE_LINUX
    sd_notify(0, "READY=1");
@@ -4376,46 +6579,63 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 }
 
 static int
-copy_server(struct server* dst, struct server* src)
+copy_server(struct server* dst, struct server_state* state, struct server* src)
 {
    bool changed = false;
+   bool reconnect = false;
 
    if (restart_string("name", &dst->name[0], &src->name[0]))
    {
       changed = true;
    }
-   if (restart_string("host", &dst->host[0], &src->host[0]))
-   {
-      changed = true;
-   }
-   if (restart_int("port", dst->port, src->port))
-   {
-      changed = true;
-   }
-   if (restart_string("username", &dst->username[0], &src->username[0]))
+   else
    {
-      changed = true;
+      /* The connection settings of an existing server only need a new WAL stream */
+      if (reconnect_string("host", &dst->host[0], &src->host[0], MISC_LENGTH))
+      {
+         reconnect = true;
+      }
+      if (reconnect_int("port", &dst->port, src->port))
+      {
+         reconnect = true;
+      }
+      if (reconnect_string("username", &dst->username[0], &src->username[0], MAX_USERNAME_LENGTH))
+      {
+         reconnect = true;
+      }
+      if (reconnect_string("wal_slot", &dst->wal_slot[0], &src->wal_slot[0], MISC_LENGTH))
+      {
+         reconnect = true;
+      }
+      if (reconnect_string("tls_cert_file", dst->tls_cert_file, src->tls_cert_file, MISC_LENGTH))
+      {
+         reconnect = true;
+      }
+      if (reconnect_string("tls_key_file", dst->tls_key_file, src->tls_key_file, MISC_LENGTH))
+      {
+         reconnect = true;
+      }
+      if (reconnect_string("tls_ca_file", dst->tls_ca_file, src->tls_ca_file, MISC_LENGTH))
+      {
+         reconnect = true;
+      }
    }
    if (restart_string("workspace", &dst->workspace[0], &src->workspace[0]))
    {
       changed = true;
    }
    dst->create_slot = src->create_slot;
-   if (restart_string("wal_slot", &dst->wal_slot[0], &src->wal_slot[0]))
-   {
-      changed = true;
-   }
    if (restart_string("follow", &dst->follow[0], &src->follow[0]))
    {
       changed = true;
    }
-   if (restart_string("wal_shipping", &dst->wal_shipping[0], &src->wal_shipping[0]))
-   {
-      changed = true;
-   }
+   memcpy(&dst->backup_schedule[0], &src->backup_schedule[0], MISC_LENGTH);
+   memcpy(&dst->wal_shipping[0], &src->wal_shipping[0], MAX_PATH);
+   memcpy(&dst->backup_standbys[0], &src->backup_standbys[0], MAX_PATH);
    memcpy(&dst->hot_standby[0], &src->hot_standby[0], MAX_PATH);
    memcpy(&dst->hot_standby_overrides[0], &src->hot_standby_overrides[0], MAX_PATH);
    memcpy(&dst->hot_standby_tablespaces[0], &src->hot_standby_tablespaces[0], MAX_PATH);
+   dst->hot_standby_wal = src->hot_standby_wal;
    /* dst->cur_timeline = src->cur_timeline; */
    dst->retention_days = src->retention_days;
    dst->retention_weeks = src->retention_weeks;
@@ -4426,24 +6646,13 @@ copy_server(struct server* dst, struct server* src)
    /* dst->wal_streaming = src->wal_streaming; */
    /* dst->valid = src->valid; */
    /* memcpy(&dst->current_wal_filename[0], &src->current_wal_filename[0], MISC_LENGTH); */
-   /* memcpy(&dst->current_wal_lsn[0], &src->current_wal_lsn[0], MISC_LENGTH); */
    dst->workers = src->workers;
    dst->backup_max_rate = src->backup_max_rate;
    dst->network_max_rate = src->network_max_rate;
    dst->manifest = src->manifest;
-
-   if (restart_string("tls_cert_file", dst->tls_cert_file, src->tls_cert_file))
-   {
-      changed = true;
-   }
-   if (restart_string("tls_key_file", dst->tls_key_file, src->tls_key_file))
-   {
-      changed = true;
-   }
-   if (restart_string("tls_ca_file", dst->tls_ca_file, src->tls_ca_file))
-   {
-      changed = true;
-   }
+   dst->wal_compression_type = src->wal_compression_type;
+   dst->wal_compression_level = src->wal_compression_level;
+   dst->retention_local = src->retention_local;
 
    dst->number_of_extra = src->number_of_extra;
    for (int i = 0; i < MAX_EXTRA; i++)
@@ -4451,6 +6660,12 @@ copy_server(struct server* dst, struct server* src)
       memcpy(dst->extra[i], src->extra[i], MAX_EXTRA_PATH);
    }
 
+   if (reconnect)
+   {
+      pgmoneta_log_info("Reload: Restarting the WAL streaming for %s", dst->name);
+      atomic_store(&state->wal_restart, true);
+   }
+
    if (changed)
    {
       return 1;
@@ -4502,6 +6717,66 @@ restart_string(char* name, char* e, char* n)
    return 0;
 }
 
+static int
+reconnect_int(char* name, int* e, int n)
+{
+   if (*e != n)
+   {
+      pgmoneta_log_info("Reconnect required for %s - Existing %d New %d", name, *e, n);
+      *e = n;
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+reconnect_string(char* name, char* e, char* n, size_t size)
+{
+   if (strcmp(e, n))
+   {
+      pgmoneta_log_info("Reconnect required for %s - Existing %s New %s", name, e, n);
+      memcpy(e, n, size);
+      return 1;
+   }
+
+   return 0;
+}
+
+static void
+build_server_index(struct configuration* config)
+{
+   uint32_t slot;
+
+   memset(&config->server_index[0], 0, sizeof(config->server_index));
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      slot = server_hash(config->servers[i].name);
+
+      while (config->server_index[slot] != 0)
+      {
+         slot = (slot + 1) & (SERVER_INDEX_SIZE - 1);
+      }
+
+      config->server_index[slot] = i + 1;
+   }
+}
+
+static uint32_t
+server_hash(char* name)
+{
+   uint32_t hash = 2166136261u;
+
+   for (size_t i = 0; name[i] != '\0'; i++)
+   {
+      hash ^= (unsigned char)name[i];
+      hash *= 16777619u;
+   }
+
+   return hash & (SERVER_INDEX_SIZE - 1);
+}
+
 static bool
 is_empty_string(char* s)
 {
@@ -4598,3 +6873,58 @@ split_extra(const char* extra, char res[MAX_EXTRA][MAX_EXTRA_PATH], int* count)
 
    *count = i;
 }
+
+static int
+split_volumes(char* volumes, char res[MAX_BACKUP_VOLUMES][MAX_PATH], int* count)
+{
+   char temp[DEFAULT_BUFFER_SIZE];
+   char* token = NULL;
+   char* trimmed = NULL;
+   char* saveptr = NULL;
+
+   *count = 0;
+   memset(res, 0, MAX_BACKUP_VOLUMES * MAX_PATH);
+   memset(&temp[0], 0, sizeof(temp));
+   snprintf(&temp[0], sizeof(temp), "%s", volumes);
+
+   token = strtok_r(&temp[0], ",", &saveptr);
+   while (token != NULL)
+   {
+      trimmed = pgmoneta_remove_whitespace(token);
+
+      if (trimmed != NULL && strlen(trimmed) > 0)
+      {
+         if (*count == MAX_BACKUP_VOLUMES || strlen(trimmed) >= MAX_PATH)
+         {
+            free(trimmed);
+            return 1;
+         }
+
+         memcpy(res[*count], trimmed, strlen(trimmed));
+         (*count)++;
+      }
+
+      free(trimmed);
+      token = strtok_r(NULL, ",", &saveptr);
+   }
+
+   return 0;
+}
+
+static char*
+get_volumes_string(char volumes[MAX_BACKUP_VOLUMES][MAX_PATH], int count)
+{
+   char* s = NULL;
+
+   s = pgmoneta_append(s, "");
+   for (int i = 0; i < count; i++)
+   {
+      if (i > 0)
+      {
+         s = pgmoneta_append(s, ",");
+      }
+      s = pgmoneta_append(s, volumes[i]);
+   }
+
+   return s;
+}
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <cluster.h>
+#include <cron.h>
+#include <json.h>
+#include <logging.h>
+#include <management.h>
+
+/* system */
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int parse_field(char* field, int min, int max, uint64_t* bits, bool* any);
+static int parse_number(char* str, int* number);
+static int newest_compare(const void* a, const void* b);
+
+int
+pgmoneta_cron_parse(char* expression, struct cron* cron)
+{
+   char buffer[MISC_LENGTH];
+   char* fields[5];
+   char* token = NULL;
+   char* saveptr = NULL;
+   int number_of_fields = 0;
+   uint64_t bits = 0;
+   bool any = false;
+
+   if (expression == NULL || cron == NULL)
+   {
+      goto error;
+   }
+
+   memset(cron, 0, sizeof(struct cron));
+   memset(&buffer[0], 0, sizeof(buffer));
+
+   if (!strcmp(expression, "@hourly"))
+   {
+      snprintf(&buffer[0], sizeof(buffer), "0 * * * *");
+   }
+   else if (!strcmp(expression, "@daily") || !strcmp(expression, "@midnight"))
+   {
+      snprintf(&buffer[0], sizeof(buffer), "0 0 * * *");
+   }
+   else if (!strcmp(expression, "@weekly"))
+   {
+      snprintf(&buffer[0], sizeof(buffer), "0 0 * * 0");
+   }
+   else if (!strcmp(expression, "@monthly"))
+   {
+      snprintf(&buffer[0], sizeof(buffer), "0 0 1 * *");
+   }
+   else
+   {
+      if (strlen(expression) >= sizeof(buffer))
+      {
+         goto error;
+      }
+      memcpy(&buffer[0], expression, strlen(expression));
+   }
+
+   token = strtok_r(&buffer[0], " \t", &saveptr);
+   while (token != NULL)
+   {
+      if (number_of_fields == 5)
+      {
+         goto error;
+      }
+      fields[number_of_fields++] = token;
+      token = strtok_r(NULL, " \t", &saveptr);
+   }
+
+   if (number_of_fields != 5)
+   {
+      goto error;
+   }
+
+   if (parse_field(fields[0], 0, 59, &bits, &any))
+   {
+      goto error;
+   }
+   cron->minutes = bits;
+
+   if (parse_field(fields[1], 0, 23, &bits, &any))
+   {
+      goto error;
+   }
+   cron->hours = (uint32_t)bits;
+
+   if (parse_field(fields[2], 1, 31, &bits, &cron->any_day))
+   {
+      goto error;
+   }
+   cron->days = (uint32_t)bits;
+
+   if (parse_field(fields[3], 1, 12, &bits, &any))
+   {
+      goto error;
+   }
+   cron->months = (uint16_t)bits;
+
+   /* Both 0 and 7 are Sunday */
+   if (parse_field(fields[4], 0, 7, &bits, &cron->any_weekday))
+   {
+      goto error;
+   }
+   if (bits & (1ULL << 7))
+   {
+      bits |= 1ULL;
+   }
+   cron->weekdays = (uint8_t)(bits & 0x7F);
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+bool
+pgmoneta_cron_match(struct cron* cron, time_t t)
+{
+   struct tm tm;
+   bool day;
+   bool weekday;
+
+   if (cron == NULL || localtime_r(&t, &tm) == NULL)
+   {
+      return false;
+   }
+
+   if (!(cron->minutes & (1ULL << tm.tm_min)) ||
+       !(cron->hours & (1U << tm.tm_hour)) ||
+       !(cron->months & (1U << (tm.tm_mon + 1))))
+   {
+      return false;
+   }
+
+   day = (cron->days & (1U << tm.tm_mday)) != 0;
+   weekday = (cron->weekdays & (1U << tm.tm_wday)) != 0;
+
+   /* Like cron, a restricted day of the month and day of the week match either one */
+   if (cron->any_day && cron->any_weekday)
+   {
+      return true;
+   }
+   else if (cron->any_day)
+   {
+      return weekday;
+   }
+   else if (cron->any_weekday)
+   {
+      return day;
+   }
+
+   return day || weekday;
+}
+
+char*
+pgmoneta_cron_backup_schedule(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (strlen(config->servers[server].backup_schedule) > 0)
+   {
+      return config->servers[server].backup_schedule;
+   }
+
+   return config->backup_schedule;
+}
+
+int
+pgmoneta_cron_backups(time_t now, int* servers, int* number_of_servers)
+{
+   int active = 0;
+   int number_of_due = 0;
+   int slots = 0;
+   int due[NUMBER_OF_SERVERS];
+   time_t minute;
+   char* expression = NULL;
+   struct cron cron;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *number_of_servers = 0;
+   minute = now - (now % 60);
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      struct server* srv = &config->servers[i];
+
+      if (atomic_load(&config->states[i].backup))
+      {
+         active++;
+      }
+
+      expression = pgmoneta_cron_backup_schedule(i);
+
+      if (strlen(expression) == 0 || !pgmoneta_cluster_owns(i) || pgmoneta_cron_parse(expression, &cron))
+      {
+         srv->schedule_due = 0;
+         continue;
+      }
+
+      if (srv->schedule_minute != minute && pgmoneta_cron_match(&cron, now))
+      {
+         srv->schedule_minute = minute;
+
+         if (srv->schedule_due == 0)
+         {
+            srv->schedule_due = now;
+            if (config->backup_schedule_jitter > 0)
+            {
+               srv->schedule_due += random() % (config->backup_schedule_jitter + 1);
+            }
+            pgmoneta_log_debug("Cron: Backup of %s due in %ld seconds", srv->name, (long)(srv->schedule_due - now));
+         }
+      }
+
+      if (srv->schedule_due != 0 && srv->schedule_due <= now &&
+          srv->valid && srv->wal_streaming && !atomic_load(&config->states[i].backup))
+      {
+         due[number_of_due++] = i;
+      }
+   }
+
+   if (number_of_due == 0)
+   {
+      return 0;
+   }
+
+   qsort(&due[0], number_of_due, sizeof(int), newest_compare);
+
+   slots = number_of_due;
+   if (config->backup_schedule_max > 0)
+   {
+      slots = config->backup_schedule_max - active;
+      if (slots < 0)
+      {
+         slots = 0;
+      }
+   }
+
+   for (int i = 0; i < number_of_due && i < slots; i++)
+   {
+      servers[(*number_of_servers)++] = due[i];
+      config->servers[due[i]].schedule_due = 0;
+   }
+
+   if (number_of_due > slots)
+   {
+      pgmoneta_log_debug("Cron: %d scheduled backups wait for one of %d active backups", number_of_due - slots, active);
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_cron_backup_payload(int server, struct json** payload)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *payload = NULL;
+
+   if (pgmoneta_management_create_header(MANAGEMENT_BACKUP, 0, 0, MANAGEMENT_OUTPUT_FORMAT_JSON, &j))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
+
+   *payload = j;
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(j);
+
+   return 1;
+}
+
+static int
+parse_field(char* field, int min, int max, uint64_t* bits, bool* any)
+{
+   char buffer[MISC_LENGTH];
+   char* item = NULL;
+   char* saveptr = NULL;
+   char* slash = NULL;
+   char* dash = NULL;
+   int from;
+   int to;
+   int step;
+
+   *bits = 0;
+   *any = field[0] == '*';
+
+   memset(&buffer[0], 0, sizeof(buffer));
+   if (strlen(field) >= sizeof(buffer))
+   {
+      goto error;
+   }
+   memcpy(&buffer[0], field, strlen(field));
+
+   item = strtok_r(&buffer[0], ",", &saveptr);
+   if (item == NULL)
+   {
+      goto error;
+   }
+
+   while (item != NULL)
+   {
+      step = 1;
+
+      slash = strchr(item, '/');
+      if (slash != NULL)
+      {
+         *slash = '\0';
+         if (parse_number(slash + 1, &step) || step < 1)
+         {
+            goto error;
+         }
+      }
+
+      if (!strcmp(item, "*"))
+      {
+         from = min;
+         to = max;
+      }
+      else
+      {
+         dash = strchr(item, '-');
+         if (dash != NULL)
+         {
+            *dash = '\0';
+            if (parse_number(item, &from) || parse_number(dash + 1, &to))
+            {
+               goto error;
+            }
+         }
+         else
+         {
+            if (parse_number(item, &from))
+            {
+               goto error;
+            }
+            to = slash != NULL ? max : from;
+         }
+      }
+
+      if (from < min || to > max || from > to)
+      {
+         goto error;
+      }
+
+      for (int i = from; i <= to; i += step)
+      {
+         *bits |= 1ULL << i;
+      }
+
+      item = strtok_r(NULL, ",", &saveptr);
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+parse_number(char* str, int* number)
+{
+   char* end = NULL;
+   long l;
+
+   if (str == NULL || strlen(str) == 0)
+   {
+      return 1;
+   }
+
+   l = strtol(str, &end, 10);
+
+   if (*end != '\0' || l < 0 || l > 59)
+   {
+      return 1;
+   }
+
+   *number = (int)l;
+
+   return 0;
+}
+
+static int
+newest_compare(const void* a, const void* b)
+{
+   unsigned long long na;
+   unsigned long long nb;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   na = atomic_load(&config->servers[*(const int*)a].metrics.backup_newest);
+   nb = atomic_load(&config->servers[*(const int*)b].metrics.backup_newest);
+
+   if (na < nb)
+   {
+      return -1;
+   }
+   else if (na > nb)
+   {
+      return 1;
+   }
+
+   return 0;
+}
@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+static int csv_write_stream(struct csv_writer* writer, int num_col, char** cols);
+
 int
 pgmoneta_csv_reader_init(char* path, struct csv_reader** reader)
 {
@@ -122,6 +124,7 @@ int
 pgmoneta_csv_writer_init(char* path, struct csv_writer** writer)
 {
    struct csv_writer* w = malloc(sizeof(struct csv_writer));
+   w->stream = false;
    w->file = fopen(path, "w+");
    if (w->file == NULL)
    {
@@ -138,6 +141,32 @@ error:
    return 1;
 }
 
+int
+pgmoneta_csv_writer_create(FILE* file, struct csv_writer** writer)
+{
+   struct csv_writer* w = NULL;
+
+   *writer = NULL;
+
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+   w = malloc(sizeof(struct csv_writer));
+   if (w == NULL)
+   {
+      return 1;
+   }
+
+   w->file = file;
+   w->stream = true;
+
+   *writer = w;
+
+   return 0;
+}
+
 int
 pgmoneta_csv_write(struct csv_writer* writer, int num_col, char** cols)
 {
@@ -146,6 +175,10 @@ pgmoneta_csv_write(struct csv_writer* writer, int num_col, char** cols)
    {
       goto error;
    }
+   if (writer->stream)
+   {
+      return csv_write_stream(writer, num_col, cols);
+   }
    for (int i = 0; i < num_col; i++)
    {
       row = pgmoneta_append(row, cols[i]);
@@ -176,8 +209,57 @@ pgmoneta_csv_writer_destroy(struct csv_writer* writer)
    }
    if (writer->file != NULL)
    {
-      fclose(writer->file);
+      if (writer->stream)
+      {
+         fflush(writer->file);
+      }
+      else
+      {
+         fclose(writer->file);
+      }
    }
    free(writer);
    return 0;
 }
+
+static int
+csv_write_stream(struct csv_writer* writer, int num_col, char** cols)
+{
+   char* col = NULL;
+
+   for (int i = 0; i < num_col; i++)
+   {
+      col = cols[i] != NULL ? cols[i] : "";
+
+      if (i > 0)
+      {
+         fputc(',', writer->file);
+      }
+
+      // RFC 4180: a column with a separator, a quote or a line break is quoted, and its quotes doubled
+      if (strpbrk(col, ",\"\r\n") != NULL)
+      {
+         fputc('"', writer->file);
+         for (char* c = col; *c != '\0'; c++)
+         {
+            if (*c == '"')
+            {
+               fputc('"', writer->file);
+            }
+            fputc(*c, writer->file);
+         }
+         fputc('"', writer->file);
+      }
+      else
+      {
+         fputs(col, writer->file);
+      }
+   }
+
+   if (fputc('\n', writer->file) == EOF)
+   {
+      return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,1189 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <dedup.h>
+#include <logging.h>
+#include <utils.h>
+#include <workers.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <openssl/evp.h>
+
+#define DEDUP_READ_SIZE (1024 * 1024)
+
+/** @struct dedup
+ * Defines the chunk store being worked on by the current process
+ */
+struct dedup
+{
+   char store[MAX_PATH];        /**< The chunk store directory */
+   pthread_mutex_t lock;        /**< The lock of the references */
+   struct art* references;      /**< The chunks referenced by the backup */
+   atomic_ullong bytes;         /**< The number of bytes in the files */
+   atomic_ullong stored;        /**< The number of bytes added to the store */
+};
+
+static struct dedup dedup;
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void gear_init(void);
+static size_t dedup_cut(unsigned char* data, size_t length);
+static void dedup_hex(unsigned char* hash, char* hex);
+static void dedup_unhex(char* hex, unsigned char* hash);
+static int dedup_chunk_path(char* store, unsigned char* hash, char* path, size_t size);
+static int dedup_chunk_write(char* store, unsigned char* hash, unsigned char* data, size_t length, bool* added);
+static int dedup_store_directory(char* directory, struct workers* workers);
+static int dedup_restore_directory(char* directory, struct workers* workers);
+static void do_dedup_file(struct worker_input* wi);
+static void do_dedup_restore_file(struct worker_input* wi);
+static int dedup_refcount(char* store, unsigned char* hashes, size_t number_of_hashes, int delta);
+
+int
+pgmoneta_dedup_store(int server, char* backup_base, char* backup_data, struct workers* workers)
+{
+   char* store = NULL;
+   char* path = NULL;
+   unsigned char* hashes = NULL;
+   size_t number_of_hashes = 0;
+   FILE* file = NULL;
+   struct art_iterator* iter = NULL;
+
+   pthread_once(&gear_once, gear_init);
+
+   store = pgmoneta_get_server(server);
+   store = pgmoneta_append(store, DEDUP_DIRECTORY);
+
+   if (pgmoneta_mkdir(store))
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", store);
+      goto error;
+   }
+
+   memset(dedup.store, 0, sizeof(dedup.store));
+   snprintf(dedup.store, sizeof(dedup.store), "%s", store);
+   pthread_mutex_init(&dedup.lock, NULL);
+   atomic_init(&dedup.bytes, 0);
+   atomic_init(&dedup.stored, 0);
+
+   if (pgmoneta_art_create(&dedup.references))
+   {
+      goto error;
+   }
+
+   if (dedup_store_directory(backup_data, workers))
+   {
+      goto error;
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+   }
+
+   hashes = (unsigned char*)malloc(MAX(1, dedup.references->size) * DEDUP_HASH_SIZE);
+   if (hashes == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_art_iterator_create(dedup.references, &iter))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_art_iterator_next(iter))
+   {
+      dedup_unhex(iter->key, hashes + number_of_hashes * DEDUP_HASH_SIZE);
+      number_of_hashes++;
+   }
+
+   path = pgmoneta_append(path, backup_base);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   path = pgmoneta_append(path, DEDUP_REFERENCES);
+
+   file = fopen(path, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", path);
+      goto error;
+   }
+
+   if (number_of_hashes > 0 && fwrite(hashes, DEDUP_HASH_SIZE, number_of_hashes, file) != number_of_hashes)
+   {
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (dedup_refcount(store, hashes, number_of_hashes, 1))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("Dedup: %llu bytes in files, %llu bytes added to %s (%zu chunks)",
+                      (unsigned long long)atomic_load(&dedup.bytes), (unsigned long long)atomic_load(&dedup.stored),
+                      store, number_of_hashes);
+
+   pgmoneta_art_iterator_destroy(iter);
+   pgmoneta_art_destroy(dedup.references);
+   dedup.references = NULL;
+   pthread_mutex_destroy(&dedup.lock);
+
+   free(hashes);
+   free(path);
+   free(store);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   pgmoneta_art_iterator_destroy(iter);
+   pgmoneta_art_destroy(dedup.references);
+   dedup.references = NULL;
+
+   free(hashes);
+   free(path);
+   free(store);
+
+   return 1;
+}
+
+int
+pgmoneta_dedup_restore(int server, char* directory, struct workers* workers)
+{
+   char* store = NULL;
+
+   store = pgmoneta_get_server(server);
+   store = pgmoneta_append(store, DEDUP_DIRECTORY);
+
+   memset(dedup.store, 0, sizeof(dedup.store));
+   snprintf(dedup.store, sizeof(dedup.store), "%s", store);
+
+   if (dedup_restore_directory(directory, workers))
+   {
+      goto error;
+   }
+
+   free(store);
+
+   return 0;
+
+error:
+
+   free(store);
+
+   return 1;
+}
+
+bool
+pgmoneta_dedup_is_recipe(char* path)
+{
+   char magic[DEDUP_MAGIC_SIZE];
+   FILE* file = NULL;
+   bool result = false;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      return false;
+   }
+
+   if (fread(magic, 1, DEDUP_MAGIC_SIZE, file) == DEDUP_MAGIC_SIZE &&
+       !memcmp(magic, DEDUP_MAGIC, DEDUP_MAGIC_SIZE))
+   {
+      result = true;
+   }
+
+   fclose(file);
+
+   return result;
+}
+
+int
+pgmoneta_dedup_references(char* backup_base, unsigned char** hashes, size_t* number_of_hashes)
+{
+   char* path = NULL;
+   struct stat st;
+   FILE* file = NULL;
+   unsigned char* h = NULL;
+   size_t n = 0;
+
+   *hashes = NULL;
+   *number_of_hashes = 0;
+
+   path = pgmoneta_append(path, backup_base);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   path = pgmoneta_append(path, DEDUP_REFERENCES);
+
+   if (stat(path, &st))
+   {
+      // not a deduplicated backup
+      free(path);
+      return 0;
+   }
+
+   n = (size_t)st.st_size / DEDUP_HASH_SIZE;
+
+   h = (unsigned char*)malloc(MAX(1, n) * DEDUP_HASH_SIZE);
+   if (h == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (n > 0 && fread(h, DEDUP_HASH_SIZE, n, file) != n)
+   {
+      pgmoneta_log_error("Dedup: Could not read %s", path);
+      goto error;
+   }
+
+   fclose(file);
+
+   *hashes = h;
+   *number_of_hashes = n;
+
+   free(path);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(h);
+   free(path);
+
+   return 1;
+}
+
+int
+pgmoneta_dedup_release(int server, unsigned char* hashes, size_t number_of_hashes)
+{
+   char* store = NULL;
+   int ret;
+
+   if (number_of_hashes == 0)
+   {
+      return 0;
+   }
+
+   store = pgmoneta_get_server(server);
+   store = pgmoneta_append(store, DEDUP_DIRECTORY);
+
+   ret = dedup_refcount(store, hashes, number_of_hashes, -1);
+
+   free(store);
+
+   return ret;
+}
+
+static void
+gear_init(void)
+{
+   uint64_t x = 0x9E3779B97F4A7C15ULL;
+
+   /* splitmix64, the table has to be identical between runs */
+   for (int i = 0; i < 256; i++)
+   {
+      uint64_t z;
+
+      x += 0x9E3779B97F4A7C15ULL;
+      z = x;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      gear[i] = z ^ (z >> 31);
+   }
+}
+
+static size_t
+dedup_cut(unsigned char* data, size_t length)
+{
+   uint64_t hash = 0;
+   uint64_t mask_s;
+   uint64_t mask_l;
+   size_t normal;
+   size_t i;
+
+   /* FastCDC: a stricter mask before the average size, a looser one after */
+   mask_s = ((1ULL << (DEDUP_AVERAGE_BITS + 2)) - 1) << (64 - (DEDUP_AVERAGE_BITS + 2));
+   mask_l = ((1ULL << (DEDUP_AVERAGE_BITS - 2)) - 1) << (64 - (DEDUP_AVERAGE_BITS - 2));
+   normal = 1UL << DEDUP_AVERAGE_BITS;
+
+   if (length <= DEDUP_MINIMUM_CHUNK)
+   {
+      return length;
+   }
+
+   if (length > DEDUP_MAXIMUM_CHUNK)
+   {
+      length = DEDUP_MAXIMUM_CHUNK;
+   }
+
+   if (normal > length)
+   {
+      normal = length;
+   }
+
+   for (i = DEDUP_MINIMUM_CHUNK; i < normal; i++)
+   {
+      hash = (hash << 1) + gear[data[i]];
+      if (!(hash & mask_s))
+      {
+         return i + 1;
+      }
+   }
+
+   for (; i < length; i++)
+   {
+      hash = (hash << 1) + gear[data[i]];
+      if (!(hash & mask_l))
+      {
+         return i + 1;
+      }
+   }
+
+   return length;
+}
+
+static void
+dedup_hex(unsigned char* hash, char* hex)
+{
+   for (int i = 0; i < DEDUP_HASH_SIZE; i++)
+   {
+      sprintf(hex + i * 2, "%02x", hash[i]);
+   }
+   hex[DEDUP_HASH_SIZE * 2] = '\0';
+}
+
+static void
+dedup_unhex(char* hex, unsigned char* hash)
+{
+   unsigned int b;
+
+   for (int i = 0; i < DEDUP_HASH_SIZE; i++)
+   {
+      sscanf(hex + i * 2, "%2x", &b);
+      hash[i] = (unsigned char)b;
+   }
+}
+
+static int
+dedup_chunk_path(char* store, unsigned char* hash, char* path, size_t size)
+{
+   int n;
+   char hex[DEDUP_HASH_SIZE * 2 + 1];
+
+   dedup_hex(hash, hex);
+   n = snprintf(path, size, "%s%.2s/%s", store, hex, hex);
+
+   if (n < 0 || (size_t)n >= size)
+   {
+      pgmoneta_log_error("Dedup: The chunk path in %s is too long", store);
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+dedup_chunk_write(char* store, unsigned char* hash, unsigned char* data, size_t length, bool* added)
+{
+   int n;
+   char path[MAX_PATH];
+   char tmp[MAX_PATH];
+   char* directory = NULL;
+   FILE* file = NULL;
+
+   *added = false;
+
+   memset(tmp, 0, sizeof(tmp));
+
+   if (dedup_chunk_path(store, hash, path, sizeof(path)))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_exists(path))
+   {
+      return 0;
+   }
+
+   directory = pgmoneta_append(directory, path);
+   directory[strlen(store) + 2] = '\0';
+
+   if (pgmoneta_mkdir(directory))
+   {
+      goto error;
+   }
+
+   /* Workers may store the same chunk at the same time, rename makes it atomic */
+   n = snprintf(tmp, sizeof(tmp), "%s.%d.%lu", path, (int)getpid(), (unsigned long)pthread_self());
+   if (n < 0 || (size_t)n >= sizeof(tmp))
+   {
+      pgmoneta_log_error("Dedup: The temporary name of %s is too long", path);
+      memset(tmp, 0, sizeof(tmp));
+      goto error;
+   }
+
+   file = fopen(tmp, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", tmp);
+      goto error;
+   }
+
+   if (fwrite(data, 1, length, file) != length)
+   {
+      pgmoneta_log_error("Dedup: Could not write %s", tmp);
+      goto error;
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (rename(tmp, path))
+   {
+      pgmoneta_log_error("Dedup: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   *added = true;
+
+   free(directory);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   if (tmp[0] != '\0')
+   {
+      unlink(tmp);
+   }
+
+   free(directory);
+
+   return 1;
+}
+
+static int
+dedup_store_directory(char* directory, struct workers* workers)
+{
+   DIR* dir = NULL;
+   char* entry_path = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct worker_input* wi = NULL;
+
+   dir = opendir(directory);
+   if (dir == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not open %s", directory);
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      entry_path = pgmoneta_append(entry_path, directory);
+      if (!pgmoneta_ends_with(entry_path, "/"))
+      {
+         entry_path = pgmoneta_append(entry_path, "/");
+      }
+      entry_path = pgmoneta_append(entry_path, entry->d_name);
+
+      if (!lstat(entry_path, &st))
+      {
+         if (S_ISDIR(st.st_mode))
+         {
+            if (dedup_store_directory(entry_path, workers))
+            {
+               goto error;
+            }
+         }
+         else if (S_ISREG(st.st_mode) && st.st_size >= DEDUP_MINIMUM_FILE)
+         {
+            if (pgmoneta_create_worker_input(NULL, entry_path, NULL, 0, workers, &wi))
+            {
+               goto error;
+            }
+
+            if (workers != NULL)
+            {
+               if (workers->outcome)
+               {
+                  pgmoneta_workers_add(workers, do_dedup_file, wi);
+               }
+               else
+               {
+                  free(wi);
+               }
+            }
+            else
+            {
+               do_dedup_file(wi);
+            }
+         }
+      }
+
+      free(entry_path);
+      entry_path = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(entry_path);
+
+   return 1;
+}
+
+static void
+do_dedup_file(struct worker_input* wi)
+{
+   char tmp[MAX_PATH];
+   char hex[DEDUP_HASH_SIZE * 2 + 1];
+   unsigned char header[DEDUP_HEADER_SIZE];
+   unsigned char hash[DEDUP_HASH_SIZE];
+   unsigned char* buffer = NULL;
+   unsigned char* entries = NULL;
+   unsigned char* e = NULL;
+   size_t capacity = 0;
+   uint32_t number_of_entries = 0;
+   uint64_t size = 0;
+   size_t available = 0;
+   size_t position = 0;
+   size_t n;
+   size_t cut;
+   bool eof = false;
+   bool added;
+   unsigned int hash_length;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   memset(&tmp[0], 0, sizeof(tmp));
+
+   buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, DEDUP_READ_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   in = fopen(wi->from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not open %s", wi->from);
+      goto error;
+   }
+
+   while (!eof || position < available)
+   {
+      if (!eof && available - position < DEDUP_MAXIMUM_CHUNK)
+      {
+         memmove(buffer, buffer + position, available - position);
+         available -= position;
+         position = 0;
+
+         n = fread(buffer + available, 1, DEDUP_READ_SIZE - available, in);
+         available += n;
+
+         if (n == 0)
+         {
+            if (ferror(in))
+            {
+               pgmoneta_log_error("Dedup: Could not read %s", wi->from);
+               goto error;
+            }
+            eof = true;
+         }
+
+         continue;
+      }
+
+      cut = dedup_cut(buffer + position, available - position);
+
+      if (EVP_Digest(buffer + position, cut, hash, &hash_length, EVP_sha256(), NULL) != 1)
+      {
+         goto error;
+      }
+
+      if (dedup_chunk_write(dedup.store, hash, buffer + position, cut, &added))
+      {
+         goto error;
+      }
+
+      if (added)
+      {
+         atomic_fetch_add(&dedup.stored, cut);
+      }
+
+      if ((number_of_entries + 1) * DEDUP_ENTRY_SIZE > capacity)
+      {
+         capacity = MAX(64 * DEDUP_ENTRY_SIZE, capacity * 2);
+         e = (unsigned char*)realloc(entries, capacity);
+         if (e == NULL)
+         {
+            goto error;
+         }
+         entries = e;
+      }
+
+      memcpy(entries + number_of_entries * DEDUP_ENTRY_SIZE, hash, DEDUP_HASH_SIZE);
+      pgmoneta_write_uint32(entries + number_of_entries * DEDUP_ENTRY_SIZE + DEDUP_HASH_SIZE, (uint32_t)cut);
+      number_of_entries++;
+
+      size += cut;
+      position += cut;
+   }
+
+   fclose(in);
+   in = NULL;
+
+   memcpy(header, DEDUP_MAGIC, DEDUP_MAGIC_SIZE);
+   pgmoneta_write_uint64(header + DEDUP_MAGIC_SIZE, size);
+   pgmoneta_write_uint32(header + DEDUP_MAGIC_SIZE + 8, number_of_entries);
+
+   snprintf(tmp, sizeof(tmp), "%s.dedup", wi->from);
+
+   out = fopen(tmp, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", tmp);
+      goto error;
+   }
+
+   if (fwrite(header, 1, DEDUP_HEADER_SIZE, out) != DEDUP_HEADER_SIZE ||
+       (number_of_entries > 0 && fwrite(entries, DEDUP_ENTRY_SIZE, number_of_entries, out) != number_of_entries))
+   {
+      pgmoneta_log_error("Dedup: Could not write %s", tmp);
+      goto error;
+   }
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (rename(tmp, wi->from))
+   {
+      pgmoneta_log_error("Dedup: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   pthread_mutex_lock(&dedup.lock);
+   for (uint32_t i = 0; i < number_of_entries; i++)
+   {
+      dedup_hex(entries + i * DEDUP_ENTRY_SIZE, hex);
+      if (!pgmoneta_art_contains_key(dedup.references, hex))
+      {
+         pgmoneta_art_insert(dedup.references, hex, (uintptr_t)true, ValueBool);
+      }
+   }
+   pthread_mutex_unlock(&dedup.lock);
+
+   atomic_fetch_add(&dedup.bytes, size);
+
+   free(entries);
+   free(wi);
+
+   return;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (strlen(tmp) > 0)
+   {
+      unlink(tmp);
+   }
+
+   if (wi->workers != NULL)
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(entries);
+   free(wi);
+}
+
+static int
+dedup_restore_directory(char* directory, struct workers* workers)
+{
+   DIR* dir = NULL;
+   char* entry_path = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct worker_input* wi = NULL;
+
+   dir = opendir(directory);
+   if (dir == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not open %s", directory);
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      entry_path = pgmoneta_append(entry_path, directory);
+      if (!pgmoneta_ends_with(entry_path, "/"))
+      {
+         entry_path = pgmoneta_append(entry_path, "/");
+      }
+      entry_path = pgmoneta_append(entry_path, entry->d_name);
+
+      if (!lstat(entry_path, &st))
+      {
+         if (S_ISDIR(st.st_mode))
+         {
+            if (dedup_restore_directory(entry_path, workers))
+            {
+               goto error;
+            }
+         }
+         else if (S_ISREG(st.st_mode) && st.st_size >= DEDUP_HEADER_SIZE && pgmoneta_dedup_is_recipe(entry_path))
+         {
+            if (pgmoneta_create_worker_input(NULL, entry_path, NULL, 0, workers, &wi))
+            {
+               goto error;
+            }
+
+            if (workers != NULL)
+            {
+               if (workers->outcome)
+               {
+                  pgmoneta_workers_add(workers, do_dedup_restore_file, wi);
+               }
+               else
+               {
+                  free(wi);
+               }
+            }
+            else
+            {
+               do_dedup_restore_file(wi);
+            }
+         }
+      }
+
+      free(entry_path);
+      entry_path = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(entry_path);
+
+   return 1;
+}
+
+static void
+do_dedup_restore_file(struct worker_input* wi)
+{
+   char tmp[MAX_PATH];
+   char path[MAX_PATH];
+   unsigned char header[DEDUP_HEADER_SIZE];
+   unsigned char entry[DEDUP_ENTRY_SIZE];
+   unsigned char hash[DEDUP_HASH_SIZE];
+   unsigned char* buffer = NULL;
+   unsigned int hash_length;
+   uint64_t size = 0;
+   uint64_t written = 0;
+   uint32_t number_of_entries;
+   uint32_t length;
+   FILE* recipe = NULL;
+   FILE* chunk = NULL;
+   FILE* out = NULL;
+
+   memset(&tmp[0], 0, sizeof(tmp));
+
+   buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, DEDUP_MAXIMUM_CHUNK);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   recipe = fopen(wi->from, "rb");
+   if (recipe == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not open %s", wi->from);
+      goto error;
+   }
+
+   if (fread(header, 1, DEDUP_HEADER_SIZE, recipe) != DEDUP_HEADER_SIZE ||
+       memcmp(header, DEDUP_MAGIC, DEDUP_MAGIC_SIZE))
+   {
+      pgmoneta_log_error("Dedup: Invalid recipe %s", wi->from);
+      goto error;
+   }
+
+   size = pgmoneta_read_uint64(header + DEDUP_MAGIC_SIZE);
+   number_of_entries = pgmoneta_read_uint32(header + DEDUP_MAGIC_SIZE + 8);
+
+   snprintf(tmp, sizeof(tmp), "%s.dedup", wi->from);
+
+   out = fopen(tmp, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", tmp);
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < number_of_entries; i++)
+   {
+      if (fread(entry, 1, DEDUP_ENTRY_SIZE, recipe) != DEDUP_ENTRY_SIZE)
+      {
+         pgmoneta_log_error("Dedup: Truncated recipe %s", wi->from);
+         goto error;
+      }
+
+      length = pgmoneta_read_uint32(entry + DEDUP_HASH_SIZE);
+      if (length > DEDUP_MAXIMUM_CHUNK)
+      {
+         pgmoneta_log_error("Dedup: Invalid chunk length in %s", wi->from);
+         goto error;
+      }
+
+      if (dedup_chunk_path(dedup.store, entry, path, sizeof(path)))
+      {
+         goto error;
+      }
+
+      chunk = fopen(path, "rb");
+      if (chunk == NULL)
+      {
+         pgmoneta_log_error("Dedup: Missing chunk %s for %s", path, wi->from);
+         goto error;
+      }
+
+      if (fread(buffer, 1, length, chunk) != length)
+      {
+         pgmoneta_log_error("Dedup: Could not read chunk %s", path);
+         goto error;
+      }
+
+      fclose(chunk);
+      chunk = NULL;
+
+      if (EVP_Digest(buffer, length, hash, &hash_length, EVP_sha256(), NULL) != 1 ||
+          memcmp(hash, entry, DEDUP_HASH_SIZE))
+      {
+         pgmoneta_log_error("Dedup: Corrupted chunk %s", path);
+         goto error;
+      }
+
+      if (fwrite(buffer, 1, length, out) != length)
+      {
+         pgmoneta_log_error("Dedup: Could not write %s", tmp);
+         goto error;
+      }
+
+      written += length;
+   }
+
+   if (written != size)
+   {
+      pgmoneta_log_error("Dedup: Size mismatch for %s (%" PRIu64 " != %" PRIu64 ")", wi->from, written, size);
+      goto error;
+   }
+
+   fclose(recipe);
+   recipe = NULL;
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (rename(tmp, wi->from))
+   {
+      pgmoneta_log_error("Dedup: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   free(wi);
+
+   return;
+
+error:
+
+   if (recipe != NULL)
+   {
+      fclose(recipe);
+   }
+
+   if (chunk != NULL)
+   {
+      fclose(chunk);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (strlen(tmp) > 0)
+   {
+      unlink(tmp);
+   }
+
+   if (wi->workers != NULL)
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+dedup_refcount(char* store, unsigned char* hashes, size_t number_of_hashes, int delta)
+{
+   char lock_path[MAX_PATH];
+   char path[MAX_PATH];
+   char tmp[MAX_PATH];
+   char chunk[MAX_PATH];
+   char hex[DEDUP_HASH_SIZE * 2 + 1];
+   unsigned char record[DEDUP_ENTRY_SIZE];
+   unsigned char hash[DEDUP_HASH_SIZE];
+   uint32_t count;
+   size_t removed = 0;
+   int fd = -1;
+   FILE* file = NULL;
+   struct art* counts = NULL;
+   struct art_iterator* iter = NULL;
+
+   snprintf(lock_path, sizeof(lock_path), "%s%s.lock", store, DEDUP_REFCOUNT);
+   snprintf(path, sizeof(path), "%s%s", store, DEDUP_REFCOUNT);
+   snprintf(tmp, sizeof(tmp), "%s%s.tmp", store, DEDUP_REFCOUNT);
+
+   /* Backup and retention may run in different processes */
+   fd = open(lock_path, O_CREAT | O_RDWR, 0600);
+   if (fd == -1 || flock(fd, LOCK_EX))
+   {
+      pgmoneta_log_error("Dedup: Could not lock %s", lock_path);
+      goto error;
+   }
+
+   if (pgmoneta_art_create(&counts))
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file != NULL)
+   {
+      while (fread(record, 1, DEDUP_ENTRY_SIZE, file) == DEDUP_ENTRY_SIZE)
+      {
+         dedup_hex(record, hex);
+         pgmoneta_art_insert(counts, hex, (uintptr_t)pgmoneta_read_uint32(record + DEDUP_HASH_SIZE), ValueUInt32);
+      }
+
+      fclose(file);
+      file = NULL;
+   }
+
+   for (size_t i = 0; i < number_of_hashes; i++)
+   {
+      dedup_hex(hashes + i * DEDUP_HASH_SIZE, hex);
+      count = (uint32_t)pgmoneta_art_search(counts, hex);
+
+      if (delta > 0)
+      {
+         pgmoneta_art_insert(counts, hex, (uintptr_t)(count + 1), ValueUInt32);
+      }
+      else if (count <= 1)
+      {
+         pgmoneta_art_delete(counts, hex);
+
+         if (!dedup_chunk_path(store, hashes + i * DEDUP_HASH_SIZE, chunk, sizeof(chunk)) && pgmoneta_exists(chunk))
+         {
+            pgmoneta_delete_file(chunk, NULL);
+         }
+         removed++;
+      }
+      else
+      {
+         pgmoneta_art_insert(counts, hex, (uintptr_t)(count - 1), ValueUInt32);
+      }
+   }
+
+   file = fopen(tmp, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", tmp);
+      goto error;
+   }
+
+   if (pgmoneta_art_iterator_create(counts, &iter))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_art_iterator_next(iter))
+   {
+      dedup_unhex(iter->key, hash);
+      memcpy(record, hash, DEDUP_HASH_SIZE);
+      pgmoneta_write_uint32(record + DEDUP_HASH_SIZE, (uint32_t)iter->value->data);
+
+      if (fwrite(record, 1, DEDUP_ENTRY_SIZE, file) != DEDUP_ENTRY_SIZE)
+      {
+         pgmoneta_log_error("Dedup: Could not write %s", tmp);
+         goto error;
+      }
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (rename(tmp, path))
+   {
+      pgmoneta_log_error("Dedup: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   if (removed > 0)
+   {
+      pgmoneta_log_debug("Dedup: Released %zu chunks from %s", removed, store);
+   }
+
+   pgmoneta_art_iterator_destroy(iter);
+   pgmoneta_art_destroy(counts);
+
+   flock(fd, LOCK_UN);
+   close(fd);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   pgmoneta_art_iterator_destroy(iter);
+   pgmoneta_art_destroy(counts);
+
+   if (fd != -1)
+   {
+      flock(fd, LOCK_UN);
+      close(fd);
+   }
+
+   return 1;
+}
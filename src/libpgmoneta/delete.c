@@ -33,6 +33,9 @@
 #include <info.h>
 #include <link.h>
 #include <logging.h>
+#include <prometheus.h>
+#include <storage.h>
+#include <trash.h>
 #include <utils.h>
 #include <workflow.h>
 
@@ -85,7 +88,7 @@ pgmoneta_delete(int srv, char* label)
    current = workflow;
    while (current != NULL)
    {
-      if (current->execute(current->name(), nodes))
+      if (pgmoneta_workflow_execute(current, nodes))
       {
          goto error;
       }
@@ -106,6 +109,12 @@ pgmoneta_delete(int srv, char* label)
 
    pgmoneta_workflow_destroy(workflow);
 
+   pgmoneta_prometheus_refresh(srv);
+
+   pgmoneta_trash_reclaim_background(srv);
+
+   pgmoneta_storage_remove_backup(srv, label);
+
    return 0;
 
 error:
@@ -27,6 +27,7 @@
  */
 
 #include <pgmoneta.h>
+#include <arena.h>
 #include <deque.h>
 #include <logging.h>
 #include <utils.h>
@@ -35,17 +36,41 @@
 #include <stdlib.h>
 #include <string.h>
 
+// The first chunk of the arena of a deque, which grows with the deque
+#define DEQUE_ARENA_SIZE 1024
+
+// The default number of cells of the ring of a lock free deque
+#define DEQUE_RING_SIZE 1024
+
 // tag is copied if not NULL
 static void
 deque_offer(struct deque* deque, char* tag, uintptr_t data, enum value_type type, struct value_config* config);
 
 // tag is copied if not NULL
 static void
-deque_node_create(uintptr_t data, enum value_type type, char* tag, struct value_config* config, struct deque_node** node);
+deque_node_create(struct arena* arena, uintptr_t data, enum value_type type, char* tag, struct value_config* config, struct deque_node** node);
 
 // tag will always be freed
 static void
-deque_node_destroy(struct deque_node* node);
+deque_node_destroy(struct arena* arena, struct deque_node* node);
+
+// takes over the value and the tag, the write lock is held
+static void
+deque_append(struct deque* deque, struct value* value, char* tag);
+
+static bool
+ring_offer(struct deque* deque, struct value* value, char* tag);
+
+static bool
+ring_poll(struct deque* deque, struct value* value, char** tag);
+
+// move the ring into the deque
+static void
+deque_settle(struct deque* deque);
+
+// move the ring into the deque, the write lock is held
+static void
+ring_drain(struct deque* deque);
 
 static void
 deque_read_lock(struct deque* deque);
@@ -91,18 +116,73 @@ pgmoneta_deque_create(bool thread_safe, struct deque** deque)
 {
    struct deque* q = NULL;
    q = malloc(sizeof(struct deque));
+   if (q == NULL)
+   {
+      goto error;
+   }
    q->size = 0;
    q->thread_safe = thread_safe;
+   q->ring = NULL;
+   q->ring_mask = 0;
+   q->ring_head = 0;
+   q->ring_tail = 0;
+   if (pgmoneta_arena_create(DEQUE_ARENA_SIZE, false, &q->arena))
+   {
+      goto error;
+   }
    if (thread_safe)
    {
       pthread_rwlock_init(&q->mutex, NULL);
    }
-   deque_node_create(0, ValueInt32, NULL, NULL, &q->start);
-   deque_node_create(0, ValueInt32, NULL, NULL, &q->end);
+   deque_node_create(q->arena, 0, ValueInt32, NULL, NULL, &q->start);
+   deque_node_create(q->arena, 0, ValueInt32, NULL, NULL, &q->end);
    q->start->next = q->end;
    q->end->prev = q->start;
    *deque = q;
    return 0;
+
+error:
+   free(q);
+   return 1;
+}
+
+int
+pgmoneta_deque_create_lock_free(uint32_t capacity, struct deque** deque)
+{
+   struct deque* q = NULL;
+   uint64_t cells = 2;
+
+   if (pgmoneta_deque_create(true, &q))
+   {
+      goto error;
+   }
+
+   if (capacity == 0)
+   {
+      capacity = DEQUE_RING_SIZE;
+   }
+   while (cells < capacity)
+   {
+      cells *= 2;
+   }
+
+   q->ring = (struct deque_cell*)calloc(cells, sizeof(struct deque_cell));
+   if (q->ring == NULL)
+   {
+      goto error;
+   }
+   for (uint64_t i = 0; i < cells; i++)
+   {
+      q->ring[i].sequence = i;
+   }
+   q->ring_mask = cells - 1;
+
+   *deque = q;
+   return 0;
+
+error:
+   pgmoneta_deque_destroy(q);
+   return 1;
 }
 
 int
@@ -163,8 +243,27 @@ pgmoneta_deque_poll(struct deque* deque, char** tag)
 {
    struct deque_node* head = NULL;
    struct value* val = NULL;
+   struct value value;
+   char* t = NULL;
    uintptr_t data = 0;
-   if (deque == NULL || pgmoneta_deque_size(deque) == 0)
+   if (deque == NULL)
+   {
+      return 0;
+   }
+   // the values in the deque are older than the ones in the ring, the size is only a hint here
+   if (deque->ring != NULL && __atomic_load_n(&deque->size, __ATOMIC_RELAXED) == 0 && ring_poll(deque, &value, &t))
+   {
+      if (tag != NULL)
+      {
+         *tag = t;
+      }
+      else
+      {
+         free(t);
+      }
+      return pgmoneta_value_data(&value);
+   }
+   if (pgmoneta_deque_size(deque) == 0)
    {
       return 0;
    }
@@ -179,16 +278,15 @@ pgmoneta_deque_poll(struct deque* deque, char** tag)
    // remove node
    deque->start->next = head->next;
    head->next->prev = deque->start;
-   deque->size--;
+   __atomic_sub_fetch(&deque->size, 1, __ATOMIC_RELAXED);
    val = head->data;
    if (tag != NULL)
    {
       *tag = head->tag;
    }
-   free(head);
 
    data = pgmoneta_value_data(val);
-   free(val);
+   pgmoneta_arena_free(deque->arena, head, sizeof(struct deque_node));
 
    deque_unlock(deque);
    return data;
@@ -200,6 +298,7 @@ pgmoneta_deque_poll_last(struct deque* deque, char** tag)
    struct deque_node* tail = NULL;
    struct value* val = NULL;
    uintptr_t data = 0;
+   deque_settle(deque);
    if (deque == NULL || pgmoneta_deque_size(deque) == 0)
    {
       return 0;
@@ -214,17 +313,16 @@ pgmoneta_deque_poll_last(struct deque* deque, char** tag)
    // remove node
    deque->end->prev = tail->prev;
    tail->prev->next = deque->end;
-   deque->size--;
+   __atomic_sub_fetch(&deque->size, 1, __ATOMIC_RELAXED);
 
    val = tail->data;
    if (tag != NULL)
    {
       *tag = tail->tag;
    }
-   free(tail);
 
    data = pgmoneta_value_data(val);
-   free(val);
+   pgmoneta_arena_free(deque->arena, tail, sizeof(struct deque_node));
 
    deque_unlock(deque);
    return data;
@@ -235,6 +333,7 @@ pgmoneta_deque_peek(struct deque* deque, char** tag)
 {
    struct deque_node* head = NULL;
    struct value* val = NULL;
+   deque_settle(deque);
    if (deque == NULL || pgmoneta_deque_size(deque) == 0)
    {
       return 0;
@@ -261,6 +360,7 @@ pgmoneta_deque_peek_last(struct deque* deque, char** tag)
 {
    struct deque_node* tail = NULL;
    struct value* val = NULL;
+   deque_settle(deque);
    if (deque == NULL || pgmoneta_deque_size(deque) == 0)
    {
       return 0;
@@ -292,6 +392,7 @@ pgmoneta_deque_get(struct deque* deque, char* tag)
    pgmoneta_log_trace("pgmoneta_deque_get: %s", tag);
 #endif
 
+   deque_settle(deque);
    deque_read_lock(deque);
    n = deque_find(deque, tag);
    if (n == NULL)
@@ -312,6 +413,7 @@ pgmoneta_deque_exists(struct deque* deque, char* tag)
    bool ret = false;
    struct deque_node* n = NULL;
 
+   deque_settle(deque);
    deque_read_lock(deque);
 
    n = deque_find(deque, tag);
@@ -346,6 +448,7 @@ pgmoneta_deque_list(struct deque* deque)
 void
 pgmoneta_deque_sort(struct deque* deque)
 {
+   deque_settle(deque);
    deque_write_lock(deque);
    if (deque == NULL || deque->start == NULL || deque->end == NULL || deque->size <= 1)
    {
@@ -381,23 +484,28 @@ pgmoneta_deque_destroy(struct deque* deque)
    {
       return;
    }
+   deque_settle(deque);
    n = deque->start;
    while (n != NULL)
    {
       next = n->next;
-      deque_node_destroy(n);
+      pgmoneta_value_release(n->data);
+      free(n->tag);
       n = next;
    }
    if (deque->thread_safe)
    {
       pthread_rwlock_destroy(&deque->mutex);
    }
+   pgmoneta_arena_destroy(deque->arena);
+   free(deque->ring);
    free(deque);
 }
 
 char*
 pgmoneta_deque_to_string(struct deque* deque, int32_t format, char* tag, int indent)
 {
+   deque_settle(deque);
    if (format == FORMAT_JSON)
    {
       return to_json_string(deque, tag, indent);
@@ -424,6 +532,12 @@ pgmoneta_deque_size(struct deque* deque)
    deque_read_lock(deque);
    size = deque->size;
    deque_unlock(deque);
+   if (deque->ring != NULL)
+   {
+      // the head first, so the difference never goes below zero
+      size -= (uint32_t)__atomic_load_n(&deque->ring_head, __ATOMIC_ACQUIRE);
+      size += (uint32_t)__atomic_load_n(&deque->ring_tail, __ATOMIC_ACQUIRE);
+   }
    return size;
 }
 
@@ -435,6 +549,7 @@ pgmoneta_deque_iterator_create(struct deque* deque, struct deque_iterator** iter
    {
       return 1;
    }
+   deque_settle(deque);
    i = malloc(sizeof(struct deque_iterator));
    i->deque = deque;
    i->cur = deque->start;
@@ -504,8 +619,8 @@ pgmoneta_deque_iterator_has_next(struct deque_iterator* iter)
 static void
 deque_offer(struct deque* deque, char* tag, uintptr_t data, enum value_type type, struct value_config* config)
 {
-   struct deque_node* n = NULL;
-   struct deque_node* last = NULL;
+   struct value value;
+   char* t = NULL;
 
 #ifdef DEBUG
    if (deque == NULL)
@@ -528,30 +643,169 @@ deque_offer(struct deque* deque, char* tag, uintptr_t data, enum value_type type
    }
 #endif
 
-   deque_node_create(data, type, tag, config, &n);
+   if (config != NULL)
+   {
+      pgmoneta_value_init_with_config(data, config, &value);
+   }
+   else
+   {
+      pgmoneta_value_init(type, data, &value);
+   }
+   if (tag != NULL)
+   {
+      t = pgmoneta_append(NULL, tag);
+   }
+
+   if (deque->ring != NULL && ring_offer(deque, &value, t))
+   {
+      return;
+   }
+
    deque_write_lock(deque);
-   deque->size++;
+   if (deque->ring != NULL)
+   {
+      // the ring is full, so its values go first to keep the order
+      ring_drain(deque);
+   }
+   deque_append(deque, &value, t);
+   deque_unlock(deque);
+}
+
+static void
+deque_append(struct deque* deque, struct value* value, char* tag)
+{
+   struct deque_node* n = NULL;
+   struct deque_node* last = NULL;
+
+   n = pgmoneta_arena_alloc(deque->arena, sizeof(struct deque_node));
+   n->value = *value;
+   n->data = &n->value;
+   n->tag = tag;
+   __atomic_add_fetch(&deque->size, 1, __ATOMIC_RELAXED);
    last = deque->end->prev;
    last->next = n;
    n->prev = last;
    n->next = deque->end;
    deque->end->prev = n;
+}
+
+static bool
+ring_offer(struct deque* deque, struct value* value, char* tag)
+{
+   struct deque_cell* cell = NULL;
+   uint64_t pos = __atomic_load_n(&deque->ring_tail, __ATOMIC_RELAXED);
+   uint64_t sequence = 0;
+   int64_t diff = 0;
+
+   while (true)
+   {
+      cell = &deque->ring[pos & deque->ring_mask];
+      sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+      diff = (int64_t)sequence - (int64_t)pos;
+      if (diff == 0)
+      {
+         // the cell is free, claim the position
+         if (__atomic_compare_exchange_n(&deque->ring_tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         // the ring is full
+         return false;
+      }
+      else
+      {
+         pos = __atomic_load_n(&deque->ring_tail, __ATOMIC_RELAXED);
+      }
+   }
+
+   cell->value = *value;
+   cell->tag = tag;
+   __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+   return true;
+}
+
+static bool
+ring_poll(struct deque* deque, struct value* value, char** tag)
+{
+   struct deque_cell* cell = NULL;
+   uint64_t pos = __atomic_load_n(&deque->ring_head, __ATOMIC_RELAXED);
+   uint64_t sequence = 0;
+   int64_t diff = 0;
+
+   while (true)
+   {
+      cell = &deque->ring[pos & deque->ring_mask];
+      sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+      diff = (int64_t)sequence - (int64_t)(pos + 1);
+      if (diff == 0)
+      {
+         // the cell is filled, claim the position
+         if (__atomic_compare_exchange_n(&deque->ring_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         // the ring is empty
+         return false;
+      }
+      else
+      {
+         pos = __atomic_load_n(&deque->ring_head, __ATOMIC_RELAXED);
+      }
+   }
+
+   *value = cell->value;
+   *tag = cell->tag;
+   // the cell is free again one lap later
+   __atomic_store_n(&cell->sequence, pos + deque->ring_mask + 1, __ATOMIC_RELEASE);
+
+   return true;
+}
+
+static void
+deque_settle(struct deque* deque)
+{
+   if (deque == NULL || deque->ring == NULL)
+   {
+      return;
+   }
+
+   deque_write_lock(deque);
+   ring_drain(deque);
    deque_unlock(deque);
 }
 
 static void
-deque_node_create(uintptr_t data, enum value_type type, char* tag, struct value_config* config, struct deque_node** node)
+ring_drain(struct deque* deque)
+{
+   struct value value;
+   char* tag = NULL;
+
+   while (ring_poll(deque, &value, &tag))
+   {
+      deque_append(deque, &value, tag);
+   }
+}
+
+static void
+deque_node_create(struct arena* arena, uintptr_t data, enum value_type type, char* tag, struct value_config* config, struct deque_node** node)
 {
    struct deque_node* n = NULL;
-   n = malloc(sizeof(struct deque_node));
-   memset(n, 0, sizeof(struct deque_node));
+   n = pgmoneta_arena_alloc(arena, sizeof(struct deque_node));
+   n->data = &n->value;
    if (config != NULL)
    {
-      pgmoneta_value_create_with_config(data, config, &n->data);
+      pgmoneta_value_init_with_config(data, config, n->data);
    }
    else
    {
-      pgmoneta_value_create(type, data, &n->data);
+      pgmoneta_value_init(type, data, n->data);
    }
    if (tag != NULL)
    {
@@ -565,15 +819,15 @@ deque_node_create(uintptr_t data, enum value_type type, char* tag, struct value_
 }
 
 static void
-deque_node_destroy(struct deque_node* node)
+deque_node_destroy(struct arena* arena, struct deque_node* node)
 {
    if (node == NULL)
    {
       return;
    }
-   pgmoneta_value_destroy(node->data);
+   pgmoneta_value_release(node->data);
    free(node->tag);
-   free(node);
+   pgmoneta_arena_free(arena, node, sizeof(struct deque_node));
 }
 
 static void
@@ -774,8 +1028,8 @@ deque_remove(struct deque* deque, struct deque_node* node)
    struct deque_node* next = node->next;
    prev->next = next;
    next->prev = prev;
-   deque_node_destroy(node);
-   deque->size--;
+   deque_node_destroy(deque->arena, node);
+   __atomic_sub_fetch(&deque->size, 1, __ATOMIC_RELAXED);
    return prev;
 }
 
@@ -34,11 +34,62 @@
 #include <network.h>
 #include <security.h>
 #include <utils.h>
+#include <workers.h>
 
 /* system */
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define COPY_BINARY_HEADER_SIZE 19
+
+#define COPY_HEADER    0
+#define COPY_EXTENSION 1
+#define COPY_TUPLE     2
+#define COPY_LENGTH    3
+#define COPY_DATA      4
+#define COPY_DONE      5
+
+/** @struct copy_binary
+ * Defines the state of a binary COPY stream of single column tuples
+ */
+struct copy_binary
+{
+   int state;                                    /**< The state */
+   unsigned char field[COPY_BINARY_HEADER_SIZE]; /**< The bytes of the current fixed size field */
+   size_t filled;                                /**< The number of bytes in field */
+   size_t remaining;                             /**< The bytes left of the extension or the data */
+   bool null;                                    /**< Was a column NULL */
+   size_t size;                                  /**< The number of data bytes */
+};
+
+/** @struct fetch_state
+ * Defines the files shared by the fetch connections
+ */
+struct fetch_state
+{
+   struct ext_fetch* files; /**< The files */
+   int number_of_files;     /**< The number of files */
+   atomic_int next;         /**< The next file */
+   atomic_bool failed;      /**< Has a fetch failed */
+};
+
+/** @struct fetch_connection
+ * Defines a fetch connection
+ */
+struct fetch_connection
+{
+   SSL* ssl;                  /**< The SSL structure */
+   int socket;                /**< The socket */
+   struct fetch_state* state; /**< The shared state */
+};
 
 static int query_execute(SSL* ssl, int socket, char* qs, struct query_response** qr);
+static int copy_binary_feed(struct copy_binary* copy, unsigned char* data, size_t length, FILE* file);
+static size_t copy_binary_take(struct copy_binary* copy, unsigned char* data, size_t length, size_t needed);
+static int wait_ready(SSL* ssl, int socket, struct stream_buffer* buffer);
+static void fetch_files(struct worker_input* wi);
 
 int
 pgmoneta_ext_is_installed(SSL* ssl, int socket, struct query_response** qr)
@@ -100,6 +151,361 @@ pgmoneta_ext_promote(SSL* ssl, int socket, struct query_response** qr)
    return query_execute(ssl, socket, "SELECT pgmoneta_ext_promote();", qr);
 }
 
+int
+pgmoneta_ext_fetch_file(SSL* ssl, int socket, struct ext_fetch* fetch, struct token_bucket* bucket, struct token_bucket* network_bucket)
+{
+   char* path = NULL;
+   char* qs = NULL;
+   char c[2] = {0};
+   FILE* file = NULL;
+   struct copy_binary copy;
+   struct message* query_msg = NULL;
+   struct message msg;
+   struct stream_buffer* buffer = NULL;
+
+   memset(&copy, 0, sizeof(struct copy_binary));
+   memset(&msg, 0, sizeof(struct message));
+
+   fetch->size = 0;
+   fetch->missing = false;
+
+   for (size_t i = 0; i < strlen(fetch->path); i++)
+   {
+      c[0] = fetch->path[i];
+      path = pgmoneta_append(path, c);
+      if (fetch->path[i] == '\'')
+      {
+         path = pgmoneta_append(path, c);
+      }
+   }
+
+   // one tuple for each chunk, and a NULL tuple when the file is missing
+   qs = pgmoneta_format_and_append(NULL,
+                                   "COPY (SELECT pg_read_binary_file(f.p, o, %d, true)"
+                                   " FROM (SELECT '%s'::text AS p) AS f,"
+                                   " LATERAL generate_series(0, greatest(coalesce((pg_stat_file(f.p, true)).size, 0) - 1, 0), %d) AS o)"
+                                   " TO STDOUT (FORMAT binary);",
+                                   EXT_FETCH_CHUNK_SIZE, path, EXT_FETCH_CHUNK_SIZE);
+
+   if (pgmoneta_create_query_message(qs, &query_msg) != MESSAGE_STATUS_OK || query_msg == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(fetch->dest, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Fetch: Could not create %s", fetch->dest);
+      goto error;
+   }
+
+   pgmoneta_memory_stream_buffer_init(&buffer);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_write_message(ssl, socket, query_msg) != MESSAGE_STATUS_OK)
+   {
+      goto error;
+   }
+
+   while (msg.kind != 'C')
+   {
+      if (pgmoneta_consume_copy_stream_start(ssl, socket, buffer, &msg, network_bucket) != MESSAGE_STATUS_OK)
+      {
+         goto error;
+      }
+
+      if (msg.kind == 'E' || msg.kind == 'f')
+      {
+         pgmoneta_log_error("Fetch: Could not read %s", fetch->path);
+         pgmoneta_log_error_response_message(&msg);
+         pgmoneta_consume_copy_stream_end(buffer, &msg);
+         wait_ready(ssl, socket, buffer);
+         goto error;
+      }
+
+      if (msg.kind == 'd' && msg.length > 0)
+      {
+         if (bucket != NULL)
+         {
+            pgmoneta_token_bucket_consume(bucket, msg.length);
+         }
+
+         if (copy_binary_feed(&copy, (unsigned char*)msg.data, msg.length, file))
+         {
+            pgmoneta_log_error("Fetch: Could not write %s", fetch->dest);
+            goto error;
+         }
+      }
+
+      pgmoneta_consume_copy_stream_end(buffer, &msg);
+   }
+
+   // the connection takes the next query once ReadyForQuery is in
+   if (wait_ready(ssl, socket, buffer))
+   {
+      goto error;
+   }
+
+   if (copy.state != COPY_DONE)
+   {
+      pgmoneta_log_error("Fetch: Incomplete data for %s", fetch->path);
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   fetch->size = copy.size;
+   fetch->missing = copy.null;
+
+   if (fetch->missing)
+   {
+      remove(fetch->dest);
+   }
+
+   pgmoneta_memory_stream_buffer_free(buffer);
+   pgmoneta_free_message(query_msg);
+   free(path);
+   free(qs);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   pgmoneta_memory_stream_buffer_free(buffer);
+   pgmoneta_free_message(query_msg);
+   free(path);
+   free(qs);
+
+   return 1;
+}
+
+int
+pgmoneta_ext_fetch_files(SSL** ssl, int* sockets, int number_of_connections, struct ext_fetch* files, int number_of_files)
+{
+   struct fetch_state state;
+   struct fetch_connection* connections = NULL;
+   struct workers* workers = NULL;
+   struct worker_input* wi = NULL;
+
+   if (number_of_connections <= 1 || number_of_files <= 1)
+   {
+      for (int i = 0; i < number_of_files; i++)
+      {
+         if (pgmoneta_ext_fetch_file(ssl[0], sockets[0], &files[i], NULL, NULL))
+         {
+            goto error;
+         }
+      }
+
+      return 0;
+   }
+
+   memset(&state, 0, sizeof(struct fetch_state));
+   state.files = files;
+   state.number_of_files = number_of_files;
+   atomic_init(&state.next, 0);
+   atomic_init(&state.failed, false);
+
+   connections = (struct fetch_connection*)calloc(number_of_connections, sizeof(struct fetch_connection));
+   if (connections == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_workers_initialize(number_of_connections, &workers))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      connections[i].ssl = ssl[i];
+      connections[i].socket = sockets[i];
+      connections[i].state = &state;
+
+      if (pgmoneta_create_worker_input(NULL, "", "", 0, workers, &wi))
+      {
+         goto error;
+      }
+
+      wi->argument = &connections[i];
+
+      if (pgmoneta_workers_add(workers, fetch_files, wi))
+      {
+         free(wi);
+         goto error;
+      }
+   }
+
+   pgmoneta_workers_wait(workers);
+   if (!workers->outcome || atomic_load(&state.failed))
+   {
+      goto error;
+   }
+   pgmoneta_workers_destroy(workers);
+
+   free(connections);
+
+   return 0;
+
+error:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+   free(connections);
+
+   return 1;
+}
+
+static int
+copy_binary_feed(struct copy_binary* copy, unsigned char* data, size_t length, FILE* file)
+{
+   size_t n;
+
+   while (length > 0 && copy->state != COPY_DONE)
+   {
+      switch (copy->state)
+      {
+         case COPY_HEADER:
+            n = copy_binary_take(copy, data, length, COPY_BINARY_HEADER_SIZE);
+            if (copy->filled == COPY_BINARY_HEADER_SIZE)
+            {
+               if (memcmp(copy->field, "PGCOPY\n\377\r\n\0", 11))
+               {
+                  return 1;
+               }
+               copy->remaining = (uint32_t)pgmoneta_read_int32(copy->field + 15);
+               copy->filled = 0;
+               copy->state = copy->remaining > 0 ? COPY_EXTENSION : COPY_TUPLE;
+            }
+            break;
+         case COPY_EXTENSION:
+            n = length < copy->remaining ? length : copy->remaining;
+            copy->remaining -= n;
+            if (copy->remaining == 0)
+            {
+               copy->state = COPY_TUPLE;
+            }
+            break;
+         case COPY_TUPLE:
+            n = copy_binary_take(copy, data, length, 2);
+            if (copy->filled == 2)
+            {
+               copy->filled = 0;
+               copy->state = pgmoneta_read_int16(copy->field) == -1 ? COPY_DONE : COPY_LENGTH;
+            }
+            break;
+         case COPY_LENGTH:
+            n = copy_binary_take(copy, data, length, 4);
+            if (copy->filled == 4)
+            {
+               int32_t field_length = pgmoneta_read_int32(copy->field);
+
+               copy->filled = 0;
+               if (field_length < 0)
+               {
+                  copy->null = true;
+                  copy->state = COPY_TUPLE;
+               }
+               else
+               {
+                  copy->remaining = field_length;
+                  copy->state = field_length > 0 ? COPY_DATA : COPY_TUPLE;
+               }
+            }
+            break;
+         case COPY_DATA:
+            n = length < copy->remaining ? length : copy->remaining;
+            if (fwrite(data, 1, n, file) != n)
+            {
+               return 1;
+            }
+            copy->size += n;
+            copy->remaining -= n;
+            if (copy->remaining == 0)
+            {
+               copy->state = COPY_TUPLE;
+            }
+            break;
+         default:
+            return 1;
+      }
+
+      data += n;
+      length -= n;
+   }
+
+   return 0;
+}
+
+static size_t
+copy_binary_take(struct copy_binary* copy, unsigned char* data, size_t length, size_t needed)
+{
+   size_t n = needed - copy->filled;
+
+   if (n > length)
+   {
+      n = length;
+   }
+
+   memcpy(copy->field + copy->filled, data, n);
+   copy->filled += n;
+
+   return n;
+}
+
+static int
+wait_ready(SSL* ssl, int socket, struct stream_buffer* buffer)
+{
+   while (!pgmoneta_has_message('Z', buffer->buffer + buffer->cursor, buffer->end - buffer->cursor))
+   {
+      if (pgmoneta_read_copy_stream(ssl, socket, buffer) == MESSAGE_STATUS_ERROR)
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static void
+fetch_files(struct worker_input* wi)
+{
+   int i;
+   struct fetch_connection* connection = (struct fetch_connection*)wi->argument;
+   struct fetch_state* state = connection->state;
+
+   while (!atomic_load(&state->failed))
+   {
+      i = atomic_fetch_add(&state->next, 1);
+      if (i >= state->number_of_files)
+      {
+         break;
+      }
+
+      if (pgmoneta_ext_fetch_file(connection->ssl, connection->socket, &state->files[i], NULL, NULL))
+      {
+         atomic_store(&state->failed, true);
+         wi->workers->outcome = false;
+      }
+   }
+
+   pgmoneta_memory_destroy();
+
+   free(wi);
+}
+
 static int
 query_execute(SSL* ssl, int socket, char* qs, struct query_response** qr)
 {
@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <fanout.h>
+#include <logging.h>
+
+/* system */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The header of a record in the ring buffer
+ */
+struct fanout_record
+{
+   int event;      /**< The event */
+   int segsize;    /**< The segment size */
+   bool partial;   /**< Is the segment incomplete */
+   size_t length;  /**< The length of the payload */
+};
+
+static int fanout_publish(struct fanout* fanout, int event, int segsize, bool partial, void* payload, size_t length);
+static int fanout_dispatch(struct fanout_sink* sink, struct fanout_record* record, void* payload, size_t length);
+static void fanout_copy_in(struct fanout* fanout, uint64_t position, void* data, size_t size);
+static void fanout_copy_out(struct fanout* fanout, uint64_t position, void* data, size_t size);
+static uint64_t fanout_min_tail(struct fanout* fanout);
+static bool fanout_failed(struct fanout* fanout);
+static void* fanout_drain(void* arg);
+
+int
+pgmoneta_fanout_create(size_t capacity, struct fanout** fanout)
+{
+   struct fanout* f = NULL;
+
+   *fanout = NULL;
+
+   f = (struct fanout*)calloc(1, sizeof(struct fanout));
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   if (capacity > 0)
+   {
+      // a record must always fit, so keep room for the largest payload plus its header
+      if (capacity < 2 * sizeof(struct fanout_record) + MAX_PATH)
+      {
+         capacity = 2 * sizeof(struct fanout_record) + MAX_PATH;
+      }
+
+      f->ring = (unsigned char*)malloc(capacity);
+      if (f->ring == NULL)
+      {
+         goto error;
+      }
+   }
+
+   f->capacity = capacity;
+
+   pthread_mutex_init(&f->lock, NULL);
+   pthread_cond_init(&f->readable, NULL);
+   pthread_cond_init(&f->writable, NULL);
+
+   *fanout = f;
+
+   return 0;
+
+error:
+   free(f);
+
+   return 1;
+}
+
+int
+pgmoneta_fanout_add(struct fanout* fanout, struct fanout_sink* sink)
+{
+   if (fanout == NULL || sink == NULL || fanout->number_of_sinks >= FANOUT_MAX_SINKS)
+   {
+      return 1;
+   }
+
+   sink->fanout = fanout;
+   sink->failed = false;
+
+   pthread_mutex_lock(&fanout->lock);
+   sink->tail = fanout->head;
+   pthread_mutex_unlock(&fanout->lock);
+
+   if (sink->lag != NULL)
+   {
+      atomic_store(sink->lag, 0);
+   }
+
+   if (fanout->ring != NULL)
+   {
+      if (pthread_create(&sink->thread, NULL, fanout_drain, sink) != 0)
+      {
+         pgmoneta_log_error("Fan-out: Could not start %s", sink->name);
+         return 1;
+      }
+   }
+
+   fanout->sinks[fanout->number_of_sinks++] = sink;
+
+   return 0;
+}
+
+int
+pgmoneta_fanout_open(struct fanout* fanout, char* filename, int segsize)
+{
+   return fanout_publish(fanout, FANOUT_EVENT_OPEN, segsize, false, filename, strlen(filename) + 1);
+}
+
+int
+pgmoneta_fanout_write(struct fanout* fanout, void* data, size_t size)
+{
+   int ret = 0;
+   size_t chunk;
+   size_t offset = 0;
+
+   if (fanout == NULL)
+   {
+      return 0;
+   }
+
+   while (offset < size)
+   {
+      chunk = size - offset;
+      if (fanout->ring != NULL)
+      {
+         chunk = MIN(chunk, fanout->capacity / 2);
+      }
+
+      // the healthy sinks still get the whole write when another sink has failed
+      if (fanout_publish(fanout, FANOUT_EVENT_DATA, 0, false, (char*)data + offset, chunk))
+      {
+         ret = 1;
+      }
+
+      offset += chunk;
+   }
+
+   return ret;
+}
+
+int
+pgmoneta_fanout_close(struct fanout* fanout, char* filename, bool partial)
+{
+   return fanout_publish(fanout, FANOUT_EVENT_CLOSE, 0, partial, filename, strlen(filename) + 1);
+}
+
+void
+pgmoneta_fanout_destroy(struct fanout* fanout)
+{
+   if (fanout == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&fanout->lock);
+   fanout->done = true;
+   pthread_cond_broadcast(&fanout->readable);
+   pthread_mutex_unlock(&fanout->lock);
+
+   for (int i = 0; i < fanout->number_of_sinks; i++)
+   {
+      struct fanout_sink* sink = fanout->sinks[i];
+
+      if (fanout->ring != NULL)
+      {
+         pthread_join(sink->thread, NULL);
+      }
+
+      if (sink->lag != NULL)
+      {
+         atomic_store(sink->lag, 0);
+      }
+
+      free(sink->data);
+      free(sink);
+   }
+
+   pthread_cond_destroy(&fanout->readable);
+   pthread_cond_destroy(&fanout->writable);
+   pthread_mutex_destroy(&fanout->lock);
+
+   free(fanout->ring);
+   free(fanout);
+}
+
+static int
+fanout_publish(struct fanout* fanout, int event, int segsize, bool partial, void* payload, size_t length)
+{
+   size_t size;
+   struct fanout_record record;
+
+   if (fanout == NULL || fanout->number_of_sinks == 0)
+   {
+      return 0;
+   }
+
+   memset(&record, 0, sizeof(struct fanout_record));
+   record.event = event;
+   record.segsize = segsize;
+   record.partial = partial;
+   record.length = length;
+
+   if (fanout->ring == NULL)
+   {
+      for (int i = 0; i < fanout->number_of_sinks; i++)
+      {
+         struct fanout_sink* sink = fanout->sinks[i];
+
+         if (!sink->failed && fanout_dispatch(sink, &record, payload, length))
+         {
+            pgmoneta_log_error("Fan-out: %s failed", sink->name);
+            sink->failed = true;
+         }
+      }
+
+      return fanout_failed(fanout) ? 1 : 0;
+   }
+
+   size = sizeof(struct fanout_record) + length;
+
+   pthread_mutex_lock(&fanout->lock);
+
+   // back-pressure, wait for the slowest sink
+   while (fanout->capacity - (size_t)(fanout->head - fanout_min_tail(fanout)) < size)
+   {
+      pthread_cond_wait(&fanout->writable, &fanout->lock);
+   }
+
+   pthread_mutex_unlock(&fanout->lock);
+
+   // only the producer moves the head, and the sinks never read beyond it
+   fanout_copy_in(fanout, fanout->head, &record, sizeof(struct fanout_record));
+   fanout_copy_in(fanout, fanout->head + sizeof(struct fanout_record), payload, length);
+
+   pthread_mutex_lock(&fanout->lock);
+
+   fanout->head += size;
+
+   for (int i = 0; i < fanout->number_of_sinks; i++)
+   {
+      struct fanout_sink* sink = fanout->sinks[i];
+
+      if (sink->lag != NULL)
+      {
+         atomic_store(sink->lag, sink->failed ? 0 : fanout->head - sink->tail);
+      }
+   }
+
+   pthread_cond_broadcast(&fanout->readable);
+   pthread_mutex_unlock(&fanout->lock);
+
+   return fanout_failed(fanout) ? 1 : 0;
+}
+
+static int
+fanout_dispatch(struct fanout_sink* sink, struct fanout_record* record, void* payload, size_t length)
+{
+   switch (record->event)
+   {
+      case FANOUT_EVENT_OPEN:
+         return sink->open(sink, (char*)payload, record->segsize);
+      case FANOUT_EVENT_DATA:
+         return sink->write(sink, payload, length);
+      case FANOUT_EVENT_CLOSE:
+         return sink->close(sink, (char*)payload, record->partial);
+      default:
+         break;
+   }
+
+   return 1;
+}
+
+static void
+fanout_copy_in(struct fanout* fanout, uint64_t position, void* data, size_t size)
+{
+   size_t offset = position % fanout->capacity;
+   size_t first = MIN(size, fanout->capacity - offset);
+
+   memcpy(fanout->ring + offset, data, first);
+   if (first < size)
+   {
+      memcpy(fanout->ring, (char*)data + first, size - first);
+   }
+}
+
+static void
+fanout_copy_out(struct fanout* fanout, uint64_t position, void* data, size_t size)
+{
+   size_t offset = position % fanout->capacity;
+   size_t first = MIN(size, fanout->capacity - offset);
+
+   memcpy(data, fanout->ring + offset, first);
+   if (first < size)
+   {
+      memcpy((char*)data + first, fanout->ring, size - first);
+   }
+}
+
+static uint64_t
+fanout_min_tail(struct fanout* fanout)
+{
+   uint64_t tail = fanout->head;
+
+   for (int i = 0; i < fanout->number_of_sinks; i++)
+   {
+      // a failed sink no longer holds back the producer
+      if (!fanout->sinks[i]->failed && fanout->sinks[i]->tail < tail)
+      {
+         tail = fanout->sinks[i]->tail;
+      }
+   }
+
+   return tail;
+}
+
+static bool
+fanout_failed(struct fanout* fanout)
+{
+   bool failed = false;
+
+   pthread_mutex_lock(&fanout->lock);
+   for (int i = 0; i < fanout->number_of_sinks; i++)
+   {
+      if (fanout->sinks[i]->failed)
+      {
+         failed = true;
+      }
+   }
+   pthread_mutex_unlock(&fanout->lock);
+
+   return failed;
+}
+
+static void*
+fanout_drain(void* arg)
+{
+   bool failed = false;
+   uint64_t tail;
+   size_t offset;
+   size_t first;
+   char name[MAX_PATH];
+   struct fanout_record record;
+   struct fanout_sink* sink = (struct fanout_sink*)arg;
+   struct fanout* fanout = sink->fanout;
+
+   pthread_mutex_lock(&fanout->lock);
+
+   for (;;)
+   {
+      while (sink->tail == fanout->head && !fanout->done)
+      {
+         pthread_cond_wait(&fanout->readable, &fanout->lock);
+      }
+
+      if (sink->tail == fanout->head)
+      {
+         break;
+      }
+
+      tail = sink->tail;
+
+      pthread_mutex_unlock(&fanout->lock);
+
+      // the region up to the head is stable until the tail moves
+      fanout_copy_out(fanout, tail, &record, sizeof(struct fanout_record));
+      tail += sizeof(struct fanout_record);
+
+      if (record.event == FANOUT_EVENT_DATA)
+      {
+         // hand the ring memory directly to the sink, in at most two pieces
+         offset = tail % fanout->capacity;
+         first = MIN(record.length, fanout->capacity - offset);
+
+         failed = sink->write(sink, fanout->ring + offset, first) != 0;
+         if (!failed && first < record.length)
+         {
+            failed = sink->write(sink, fanout->ring, record.length - first) != 0;
+         }
+      }
+      else
+      {
+         memset(&name[0], 0, sizeof(name));
+         fanout_copy_out(fanout, tail, &name[0], MIN(record.length, sizeof(name) - 1));
+         failed = fanout_dispatch(sink, &record, &name[0], record.length) != 0;
+      }
+
+      tail += record.length;
+
+      pthread_mutex_lock(&fanout->lock);
+
+      if (failed)
+      {
+         pgmoneta_log_error("Fan-out: %s failed", sink->name);
+
+         // the producer no longer waits for the sink, so the ring behind the head
+         // is overwritten, and the sink must not read it again
+         sink->failed = true;
+         sink->tail = fanout->head;
+
+         if (sink->lag != NULL)
+         {
+            atomic_store(sink->lag, 0);
+         }
+
+         pthread_cond_broadcast(&fanout->writable);
+
+         while (!fanout->done)
+         {
+            pthread_cond_wait(&fanout->readable, &fanout->lock);
+         }
+
+         break;
+      }
+
+      sink->tail = tail;
+
+      if (sink->lag != NULL)
+      {
+         atomic_store(sink->lag, fanout->head - sink->tail);
+      }
+
+      pthread_cond_broadcast(&fanout->writable);
+   }
+
+   pthread_mutex_unlock(&fanout->lock);
+
+   return NULL;
+}
@@ -28,15 +28,20 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <compression.h>
 #include <gzip_compression.h>
+#include <io.h>
 #include <json.h>
 #include <logging.h>
 #include <management.h>
 #include <utils.h>
+#include <wal.h>
+#include <walk.h>
 #include <workers.h>
 
 /* system */
 #include <dirent.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,121 +50,154 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
 #define BUFFER_LENGTH 8192
 
+#define GZIP_SPLIT_SIZE (64 * 1024 * 1024)
+#define GZIP_CHUNK_SIZE (128 * 1024)
+#define GZIP_MEMBER_SIZE (4 * 1024 * 1024)
+
+/** @struct gz_context
+ * Defines a zlib stream kept by a thread between files
+ */
+struct gz_context
+{
+   z_stream stream; /**< The stream */
+   int level;       /**< The compression level, -1 for decompression */
+};
+
+#ifdef HAVE_LIBDEFLATE
+/** @struct gz_libdeflate_context
+ * Defines a libdeflate compressor kept by a thread between files
+ */
+struct gz_libdeflate_context
+{
+   struct libdeflate_compressor* compressor; /**< The compressor */
+   int level;                                /**< The compression level */
+};
+#endif
+
+/** @struct gz_data
+ * Defines a compression pass over a directory tree
+ */
+struct gz_data
+{
+   int level;                /**< The compression level */
+   struct workers* workers;  /**< The workers, or NULL */
+};
+
 static int gz_compress(char* from, int level, char* to);
+static int gz_compress_range(char* from, off_t offset, size_t length, int level, char* to);
+static int gz_split(char* directory, char* from, char* to, int level, size_t size, struct workers* workers);
+static int gz_join(char* from, char* to, int number_of_parts);
 static int gz_decompress(char* from, char* to);
+static z_stream* gz_deflate_stream(int level);
+static bool gz_libdeflate(void);
+#ifdef HAVE_LIBDEFLATE
+static int gz_libdeflate_compress_range(char* from, off_t offset, size_t length, int level, char* to);
+static struct libdeflate_compressor* gz_libdeflate_compressor(int level);
+static void gz_libdeflate_free_context(void* context);
+#endif
+static z_stream* gz_inflate_stream(void);
+static void gz_free_context(void* context);
+static int gz_data_entry(struct walk_entry* entry, void* arg);
 
 static void do_gz_compress(struct worker_input* wi);
+static void do_gz_compress_part(struct worker_input* wi);
 static void do_gz_decompress(struct worker_input* wi);
 
+#ifndef HAVE_LIBDEFLATE
+static atomic_bool libdeflate_missing = false;
+#endif
+
 int
-pgmoneta_gzip_data(char* directory, struct workers* workers)
+pgmoneta_gzip_data(char* directory, char* manifest, struct workers* workers)
 {
-   char* from = NULL;
-   char* to = NULL;
-   DIR* dir;
-   struct dirent* entry;
-   int level;
-   struct worker_input* wi = NULL;
+   struct gz_data data;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   if (!(dir = opendir(directory)))
+   data.level = config->compression_level;
+   if (data.level < 1)
    {
-      goto error;
+      data.level = 1;
+   }
+   else if (data.level > 9)
+   {
+      data.level = 9;
    }
 
-   level = config->compression_level;
-   if (level < 1)
+   data.workers = workers;
+
+   return pgmoneta_walk_manifest(directory, manifest, 0, workers != NULL ? workers->number_of_workers : 1, gz_data_entry, &data);
+}
+
+static int
+gz_data_entry(struct walk_entry* entry, void* arg)
+{
+   char* to = NULL;
+   struct worker_input* wi = NULL;
+   struct gz_data* data = (struct gz_data*)arg;
+
+   if (pgmoneta_ends_with(entry->name, "backup_manifest"))
    {
-      level = 1;
+      return WALK_SKIP;
    }
-   else if (level > 9)
+
+   if (entry->type != WALK_FILE ||
+       pgmoneta_is_compressed_archive(entry->name) || pgmoneta_is_encrypted_archive(entry->name))
    {
-      level = 9;
+      return WALK_CONTINUE;
    }
 
-   while ((entry = readdir(dir)) != NULL)
+   if (pgmoneta_compression_incompressible(entry->path))
    {
-      if (pgmoneta_ends_with(entry->d_name, "backup_manifest"))
+      return WALK_CONTINUE;
+   }
+
+   to = pgmoneta_append(to, entry->path);
+   to = pgmoneta_append(to, ".gz");
+
+   // large files are compressed as independent gzip members in parallel
+   if (data->workers != NULL && pgmoneta_get_file_size(entry->path) > GZIP_SPLIT_SIZE)
+   {
+      if (gz_split(entry->directory, entry->path, to, data->level, pgmoneta_get_file_size(entry->path), data->workers))
       {
-         continue;
+         goto error;
       }
-
-      if (entry->d_type == DT_DIR)
+   }
+   else if (!pgmoneta_create_worker_input(entry->directory, entry->path, to, data->level, data->workers, &wi))
+   {
+      if (data->workers != NULL)
       {
-         char path[1024];
-
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         if (data->workers->outcome)
          {
-            continue;
+            pgmoneta_workers_add(data->workers, do_gz_compress, wi);
          }
-
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
-
-         pgmoneta_gzip_data(path, workers);
       }
-      else if (entry->d_type == DT_REG)
+      else
       {
-         if (!pgmoneta_is_compressed_archive(entry->d_name) && !pgmoneta_is_encrypted_archive(entry->d_name))
-         {
-            from = pgmoneta_append(from, directory);
-            from = pgmoneta_append(from, "/");
-            from = pgmoneta_append(from, entry->d_name);
-
-            to = pgmoneta_append(to, directory);
-            to = pgmoneta_append(to, "/");
-            to = pgmoneta_append(to, entry->d_name);
-            to = pgmoneta_append(to, ".gz");
-
-            if (!pgmoneta_create_worker_input(directory, from, to, level, workers, &wi))
-            {
-               if (workers != NULL)
-               {
-                  if (workers->outcome)
-                  {
-                     pgmoneta_workers_add(workers, do_gz_compress, wi);
-                  }
-               }
-               else
-               {
-                  do_gz_compress(wi);
-               }
-            }
-            else
-            {
-               goto error;
-            }
-
-            free(from);
-            free(to);
-
-            from = NULL;
-            to = NULL;
-         }
+         do_gz_compress(wi);
       }
    }
+   else
+   {
+      goto error;
+   }
 
-   closedir(dir);
-
-   free(from);
    free(to);
 
-   return 0;
+   return WALK_CONTINUE;
 
 error:
 
-   if (dir != NULL)
-   {
-      closedir(dir);
-   }
-
-   free(from);
    free(to);
 
-   return 1;
+   return WALK_STOP;
 }
 
 static void
@@ -180,6 +218,36 @@ do_gz_compress(struct worker_input* wi)
    free(wi);
 }
 
+static void
+do_gz_compress_part(struct worker_input* wi)
+{
+   char part[MAX_PATH];
+   struct worker_split* split = wi->split;
+
+   snprintf(part, sizeof(part), "%s.%d", wi->to, (int)(wi->offset / GZIP_SPLIT_SIZE));
+
+   if (gz_compress_range(wi->from, wi->offset, wi->length, wi->level, part))
+   {
+      pgmoneta_log_error("Gzip: Could not compress %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&split->failed, true);
+   }
+
+   // the last part to finish puts the file together
+   if (atomic_fetch_sub(&split->remaining, 1) == 1)
+   {
+      if (atomic_load(&split->failed) || gz_join(wi->from, wi->to, split->number_of_parts))
+      {
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      free(split);
+   }
+
+   free(wi);
+}
+
 void
 pgmoneta_gzip_tablespaces(char* root, struct workers* workers)
 {
@@ -204,7 +272,7 @@ pgmoneta_gzip_tablespaces(char* root, struct workers* workers)
 
          snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
 
-         pgmoneta_gzip_data(path, workers);
+         pgmoneta_gzip_data(path, NULL, workers);
       }
    }
 
@@ -212,23 +280,20 @@ pgmoneta_gzip_tablespaces(char* root, struct workers* workers)
 }
 
 void
-pgmoneta_gzip_wal(char* directory)
+pgmoneta_gzip_wal(int server, char* directory)
 {
    char* from = NULL;
    char* to = NULL;
    DIR* dir;
    struct dirent* entry;
    int level;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
 
    if (!(dir = opendir(directory)))
    {
       return;
    }
 
-   level = config->compression_level;
+   level = pgmoneta_get_wal_compression_level(server);
    if (level < 1)
    {
       level = 1;
@@ -277,7 +342,10 @@ pgmoneta_gzip_wal(char* directory)
 
             if (pgmoneta_exists(from))
             {
-               pgmoneta_delete_file(from, NULL);
+               if (pgmoneta_wal_recycle(directory, from))
+               {
+                  pgmoneta_delete_file(from, NULL);
+               }
             }
             else
             {
@@ -832,24 +900,164 @@ do_gz_decompress(struct worker_input* wi)
 static int
 gz_compress(char* from, int level, char* to)
 {
+   return gz_compress_range(from, 0, 0, level, to);
+}
+
+static int
+gz_split(char* directory, char* from, char* to, int level, size_t size, struct workers* workers)
+{
+   struct worker_split* split = NULL;
+   struct worker_input* wi = NULL;
+
+   split = (struct worker_split*)malloc(sizeof(struct worker_split));
+   if (split == NULL)
+   {
+      return 1;
+   }
+
+   split->number_of_parts = (size + GZIP_SPLIT_SIZE - 1) / GZIP_SPLIT_SIZE;
+   atomic_init(&split->remaining, split->number_of_parts);
+   atomic_init(&split->failed, false);
+
+   for (int i = 0; i < split->number_of_parts; i++)
+   {
+      if (pgmoneta_create_worker_input(directory, from, to, level, workers, &wi))
+      {
+         // the parts that are not queued count as failed
+         atomic_store(&split->failed, true);
+         if (atomic_fetch_sub(&split->remaining, split->number_of_parts - i) == split->number_of_parts - i)
+         {
+            free(split);
+         }
+         return 1;
+      }
+
+      wi->offset = (off_t)i * GZIP_SPLIT_SIZE;
+      wi->length = MIN((size_t)GZIP_SPLIT_SIZE, size - (size_t)wi->offset);
+      wi->split = split;
+
+      pgmoneta_workers_add(workers, do_gz_compress_part, wi);
+   }
+
+   return 0;
+}
+
+static int
+gz_join(char* from, char* to, int number_of_parts)
+{
+   char part[MAX_PATH];
    char buf[BUFFER_LENGTH];
-   FILE* in = NULL;
-   char mode[4];
-   gzFile out = NULL;
    size_t length;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   out = fopen(to, "wb");
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   // concatenated gzip members are a valid gzip file
+   for (int i = 0; i < number_of_parts; i++)
+   {
+      snprintf(part, sizeof(part), "%s.%d", to, i);
+
+      in = fopen(part, "rb");
+      if (in == NULL)
+      {
+         goto error;
+      }
+
+      while ((length = fread(buf, 1, sizeof(buf), in)) > 0)
+      {
+         if (fwrite(buf, 1, length, out) != length)
+         {
+            goto error;
+         }
+      }
+
+      if (ferror(in))
+      {
+         goto error;
+      }
+
+      fclose(in);
+      in = NULL;
+
+      pgmoneta_delete_file(part, NULL);
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   pgmoneta_delete_file(from, NULL);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Gzip: Could not join the parts of %s", to);
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   for (int i = 0; i < number_of_parts; i++)
+   {
+      snprintf(part, sizeof(part), "%s.%d", to, i);
+      if (pgmoneta_exists(part))
+      {
+         pgmoneta_delete_file(part, NULL);
+      }
+   }
+
+   return 1;
+}
+
+static int
+gz_compress_range(char* from, off_t offset, size_t length, int level, char* to)
+{
+   unsigned char* buf = NULL;
+   unsigned char* zout = NULL;
+   struct io_reader* in = NULL;
+   FILE* out = NULL;
+   z_stream* strm = NULL;
+   size_t n;
+   size_t remaining = length;
+   int flush;
+   int ret;
 
-   in = fopen(from, "rb");
-   if (in == NULL)
+   if (gz_libdeflate())
+   {
+#ifdef HAVE_LIBDEFLATE
+      return gz_libdeflate_compress_range(from, offset, length, level, to);
+#endif
+   }
+
+   buf = pgmoneta_worker_buffer(WORKER_BUFFER_IN, GZIP_CHUNK_SIZE);
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, GZIP_CHUNK_SIZE);
+   strm = gz_deflate_stream(level);
+
+   if (buf == NULL || zout == NULL || strm == NULL)
    {
       goto error;
    }
 
-   memset(&mode[0], 0, sizeof(mode));
-   mode[0] = 'w';
-   mode[1] = 'b';
-   mode[2] = '0' + level;
+   if (pgmoneta_io_reader_open(from, offset, length, &in))
+   {
+      goto error;
+   }
 
-   out = gzopen(to, mode);
+   out = fopen(to, "wb");
    if (out == NULL)
    {
       goto error;
@@ -857,27 +1065,52 @@ gz_compress(char* from, int level, char* to)
 
    do
    {
-      length = fread(buf, 1, sizeof(buf), in);
+      n = GZIP_CHUNK_SIZE;
+      if (length > 0)
+      {
+         n = MIN(n, remaining);
+      }
 
-      if (ferror(in))
+      n = n > 0 ? pgmoneta_io_reader_read(in, buf, n) : 0;
+
+      if (pgmoneta_io_reader_error(in))
       {
          goto error;
       }
 
-      if (length > 0)
+      remaining -= MIN(remaining, n);
+      flush = (n == 0 || (length > 0 && remaining == 0)) ? Z_FINISH : Z_NO_FLUSH;
+
+      strm->next_in = buf;
+      strm->avail_in = (uInt)n;
+
+      do
       {
-         if (gzwrite(out, buf, (unsigned)length) != (int)length)
+         strm->next_out = zout;
+         strm->avail_out = GZIP_CHUNK_SIZE;
+
+         ret = deflate(strm, flush);
+         if (ret == Z_STREAM_ERROR)
+         {
+            goto error;
+         }
+
+         if (fwrite(zout, 1, GZIP_CHUNK_SIZE - strm->avail_out, out) != GZIP_CHUNK_SIZE - strm->avail_out)
          {
             goto error;
          }
       }
+      while (strm->avail_out == 0);
    }
-   while (length > 0);
+   while (flush != Z_FINISH);
 
-   fclose(in);
+   pgmoneta_io_reader_close(in);
    in = NULL;
 
-   if (gzclose(out) != Z_OK)
+   fflush(out);
+   pgmoneta_io_drop(fileno(out), true);
+
+   if (fclose(out) != 0)
    {
       out = NULL;
       goto error;
@@ -887,14 +1120,11 @@ gz_compress(char* from, int level, char* to)
 
 error:
 
-   if (in != NULL)
-   {
-      fclose(in);
-   }
+   pgmoneta_io_reader_close(in);
 
    if (out != NULL)
    {
-      gzclose(out);
+      fclose(out);
    }
 
    return 1;
@@ -903,18 +1133,24 @@ error:
 static int
 gz_decompress(char* from, char* to)
 {
-   char buf[BUFFER_LENGTH];
+   unsigned char* buf = NULL;
+   unsigned char* zout = NULL;
+   struct io_reader* in = NULL;
    FILE* out = NULL;
-   char mode[3];
-   gzFile in = NULL;
-   size_t length;
+   z_stream* strm = NULL;
+   size_t n;
+   int ret = Z_OK;
+
+   buf = pgmoneta_worker_buffer(WORKER_BUFFER_IN, GZIP_CHUNK_SIZE);
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, GZIP_CHUNK_SIZE);
+   strm = gz_inflate_stream();
 
-   memset(&mode[0], 0, sizeof(mode));
-   mode[0] = 'r';
-   mode[1] = 'b';
+   if (buf == NULL || zout == NULL || strm == NULL)
+   {
+      goto error;
+   }
 
-   in = gzopen(from, mode);
-   if (in == NULL)
+   if (pgmoneta_io_reader_open(from, 0, 0, &in))
    {
       goto error;
    }
@@ -925,37 +1161,251 @@ gz_decompress(char* from, char* to)
       goto error;
    }
 
-   do
+   while ((n = pgmoneta_io_reader_read(in, buf, GZIP_CHUNK_SIZE)) > 0)
    {
-      length = (int)gzread(in, buf, (unsigned)BUFFER_LENGTH);
+      strm->next_in = buf;
+      strm->avail_in = (uInt)n;
 
-      if (length > 0)
+      while (strm->avail_in > 0)
       {
-         if (fwrite(buf, 1, length, out) != length)
+         // a file can hold several gzip members, each one starts a new stream
+         if (ret == Z_STREAM_END)
+         {
+            inflateReset(strm);
+         }
+
+         strm->next_out = zout;
+         strm->avail_out = GZIP_CHUNK_SIZE;
+
+         ret = inflate(strm, Z_NO_FLUSH);
+         if (ret != Z_OK && ret != Z_STREAM_END)
+         {
+            goto error;
+         }
+
+         if (fwrite(zout, 1, GZIP_CHUNK_SIZE - strm->avail_out, out) != GZIP_CHUNK_SIZE - strm->avail_out)
          {
             goto error;
          }
       }
    }
-   while (length > 0);
 
-   if (gzclose(in) != Z_OK)
+   if (pgmoneta_io_reader_error(in))
    {
-      in = NULL;
       goto error;
    }
 
-   fclose(out);
+   // drain the output of the last member
+   while (ret == Z_OK)
+   {
+      strm->next_out = zout;
+      strm->avail_out = GZIP_CHUNK_SIZE;
+
+      ret = inflate(strm, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END)
+      {
+         goto error;
+      }
+
+      if (strm->avail_out == GZIP_CHUNK_SIZE && ret == Z_OK)
+      {
+         // the input ended in the middle of a member
+         goto error;
+      }
+
+      if (fwrite(zout, 1, GZIP_CHUNK_SIZE - strm->avail_out, out) != GZIP_CHUNK_SIZE - strm->avail_out)
+      {
+         goto error;
+      }
+   }
+
+   pgmoneta_io_reader_close(in);
+   in = NULL;
+
+   fflush(out);
+   pgmoneta_io_drop(fileno(out), true);
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
 
    return 0;
 
 error:
 
-   if (in != NULL)
+   pgmoneta_io_reader_close(in);
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   return 1;
+}
+
+static z_stream*
+gz_deflate_stream(int level)
+{
+   struct gz_context* context = NULL;
+
+   context = (struct gz_context*)pgmoneta_worker_context(WORKER_CONTEXT_GZIP_COMPRESS);
+   if (context != NULL && context->level == level)
+   {
+      if (deflateReset(&context->stream) != Z_OK)
+      {
+         return NULL;
+      }
+      return &context->stream;
+   }
+
+   context = (struct gz_context*)malloc(sizeof(struct gz_context));
+   if (context == NULL)
+   {
+      return NULL;
+   }
+
+   memset(context, 0, sizeof(struct gz_context));
+   context->level = level;
+
+   // 15 window bits plus 16 for the gzip wrapper
+   if (deflateInit2(&context->stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+   {
+      free(context);
+      return NULL;
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_GZIP_COMPRESS, context, gz_free_context);
+
+   return &context->stream;
+}
+
+static bool
+gz_libdeflate(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->gzip_engine != GZIP_ENGINE_LIBDEFLATE)
+   {
+      return false;
+   }
+
+#ifdef HAVE_LIBDEFLATE
+   return true;
+#else
+   if (!atomic_exchange(&libdeflate_missing, true))
+   {
+      pgmoneta_log_warn("gzip_engine = libdeflate, but pgmoneta was built without libdeflate");
+   }
+
+   return false;
+#endif
+}
+
+#ifdef HAVE_LIBDEFLATE
+static int
+gz_libdeflate_compress_range(char* from, off_t offset, size_t length, int level, char* to)
+{
+   unsigned char* buf = NULL;
+   unsigned char* zout = NULL;
+   struct io_reader* in = NULL;
+   FILE* out = NULL;
+   struct libdeflate_compressor* compressor = NULL;
+   size_t bound;
+   size_t n;
+   size_t compressed;
+   size_t remaining = length;
+   bool first = true;
+
+   compressor = gz_libdeflate_compressor(level);
+   if (compressor == NULL)
+   {
+      goto error;
+   }
+
+   bound = libdeflate_gzip_compress_bound(compressor, GZIP_MEMBER_SIZE);
+
+   buf = pgmoneta_worker_buffer(WORKER_BUFFER_IN, GZIP_MEMBER_SIZE);
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, bound);
+
+   if (buf == NULL || zout == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_io_reader_open(from, offset, length, &in))
    {
-      gzclose(in);
+      goto error;
+   }
+
+   out = fopen(to, "wb");
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   // each block is a gzip member of its own, an empty file still gets one member
+   while (true)
+   {
+      n = GZIP_MEMBER_SIZE;
+      if (length > 0)
+      {
+         n = MIN(n, remaining);
+      }
+
+      n = n > 0 ? pgmoneta_io_reader_read(in, buf, n) : 0;
+
+      if (pgmoneta_io_reader_error(in))
+      {
+         goto error;
+      }
+
+      if (n == 0 && !first)
+      {
+         break;
+      }
+
+      compressed = libdeflate_gzip_compress(compressor, buf, n, zout, bound);
+      if (compressed == 0)
+      {
+         goto error;
+      }
+
+      if (fwrite(zout, 1, compressed, out) != compressed)
+      {
+         goto error;
+      }
+
+      first = false;
+      remaining -= MIN(remaining, n);
+
+      if (n < GZIP_MEMBER_SIZE || (length > 0 && remaining == 0))
+      {
+         break;
+      }
    }
 
+   pgmoneta_io_reader_close(in);
+   in = NULL;
+
+   fflush(out);
+   pgmoneta_io_drop(fileno(out), true);
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_io_reader_close(in);
+
    if (out != NULL)
    {
       fclose(out);
@@ -963,3 +1413,95 @@ error:
 
    return 1;
 }
+
+static struct libdeflate_compressor*
+gz_libdeflate_compressor(int level)
+{
+   struct gz_libdeflate_context* context = NULL;
+
+   context = (struct gz_libdeflate_context*)pgmoneta_worker_context(WORKER_CONTEXT_LIBDEFLATE);
+   if (context != NULL && context->level == level)
+   {
+      return context->compressor;
+   }
+
+   context = (struct gz_libdeflate_context*)malloc(sizeof(struct gz_libdeflate_context));
+   if (context == NULL)
+   {
+      return NULL;
+   }
+
+   context->level = level;
+   context->compressor = libdeflate_alloc_compressor(level);
+   if (context->compressor == NULL)
+   {
+      free(context);
+      return NULL;
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_LIBDEFLATE, context, gz_libdeflate_free_context);
+
+   return context->compressor;
+}
+
+static void
+gz_libdeflate_free_context(void* context)
+{
+   struct gz_libdeflate_context* c = (struct gz_libdeflate_context*)context;
+
+   libdeflate_free_compressor(c->compressor);
+   free(c);
+}
+#endif
+
+static z_stream*
+gz_inflate_stream(void)
+{
+   struct gz_context* context = NULL;
+
+   context = (struct gz_context*)pgmoneta_worker_context(WORKER_CONTEXT_GZIP_DECOMPRESS);
+   if (context != NULL)
+   {
+      if (inflateReset(&context->stream) != Z_OK)
+      {
+         return NULL;
+      }
+      return &context->stream;
+   }
+
+   context = (struct gz_context*)malloc(sizeof(struct gz_context));
+   if (context == NULL)
+   {
+      return NULL;
+   }
+
+   memset(context, 0, sizeof(struct gz_context));
+   context->level = -1;
+
+   if (inflateInit2(&context->stream, 15 + 16) != Z_OK)
+   {
+      free(context);
+      return NULL;
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_GZIP_DECOMPRESS, context, gz_free_context);
+
+   return &context->stream;
+}
+
+static void
+gz_free_context(void* context)
+{
+   struct gz_context* c = (struct gz_context*)context;
+
+   if (c->level >= 0)
+   {
+      deflateEnd(&c->stream);
+   }
+   else
+   {
+      inflateEnd(&c->stream);
+   }
+
+   free(c);
+}
@@ -29,8 +29,26 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <http.h>
+#include <logging.h>
 #include <utils.h>
 
+/* system */
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static CURLSH* http_share(void);
+static void http_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+static void http_unlock(CURL* handle, curl_lock_data data, void* userptr);
+static void http_options(CURL* handle);
+static bool http_transient(CURLcode res, long code);
+
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+static CURLSH* share = NULL;
+static pid_t share_pid = 0;
+
 struct curl_slist*
 pgmoneta_http_add_header(struct curl_slist* chunk, char* header, char* value)
 {
@@ -125,3 +143,160 @@ error:
 
    return 1;
 }
+
+CURL*
+pgmoneta_http_handle_create(void)
+{
+   CURL* handle = NULL;
+
+   handle = curl_easy_init();
+   if (handle != NULL)
+   {
+      http_options(handle);
+   }
+
+   return handle;
+}
+
+void
+pgmoneta_http_handle_reset(CURL* handle)
+{
+   curl_easy_reset(handle);
+   http_options(handle);
+}
+
+CURLcode
+pgmoneta_http_perform(CURL* handle, FILE* out, long* code)
+{
+   CURLcode res;
+   off_t start = 0;
+   char* url = NULL;
+
+   *code = 0;
+
+   if (out != NULL)
+   {
+      start = ftello(out);
+   }
+
+   for (int attempt = 0;; attempt++)
+   {
+      res = curl_easy_perform(handle);
+
+      *code = 0;
+      if (res == CURLE_OK)
+      {
+         curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, code);
+      }
+
+      if (attempt >= HTTP_RETRIES || !http_transient(res, *code))
+      {
+         break;
+      }
+
+      // the response of the failed attempt is dropped
+      if (out != NULL)
+      {
+         fflush(out);
+         if (fseeko(out, start, SEEK_SET) || (fileno(out) >= 0 && ftruncate(fileno(out), start)))
+         {
+            break;
+         }
+      }
+
+      curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+      pgmoneta_log_debug("HTTP: Retrying %s (%s, %ld)", url != NULL ? url : "", curl_easy_strerror(res), *code);
+
+      // 200ms, 400ms and 800ms with a jitter, so the workers don't retry together
+      SLEEP((200000000L << attempt) + (random() % 100) * 1000000L);
+   }
+
+   return res;
+}
+
+static void
+http_options(CURL* handle)
+{
+   CURLSH* sh = NULL;
+
+   sh = http_share();
+   if (sh != NULL)
+   {
+      curl_easy_setopt(handle, CURLOPT_SHARE, sh);
+   }
+
+   curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+   curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+   curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+   curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+}
+
+static CURLSH*
+http_share(void)
+{
+   CURLSH* sh = NULL;
+
+   pthread_mutex_lock(&share_lock);
+
+   // a forked process doesn't use the connections of its parent
+   if (share == NULL || share_pid != getpid())
+   {
+      share = NULL;
+
+      for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+      {
+         pthread_mutex_init(&share_locks[i], NULL);
+      }
+
+      sh = curl_share_init();
+      if (sh != NULL)
+      {
+         curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, http_lock);
+         curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, http_unlock);
+         curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+         curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+         share = sh;
+         share_pid = getpid();
+      }
+   }
+
+   sh = share;
+
+   pthread_mutex_unlock(&share_lock);
+
+   return sh;
+}
+
+static void
+http_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+   pthread_mutex_lock(&share_locks[data]);
+}
+
+static void
+http_unlock(CURL* handle, curl_lock_data data, void* userptr)
+{
+   pthread_mutex_unlock(&share_locks[data]);
+}
+
+static bool
+http_transient(CURLcode res, long code)
+{
+   switch (res)
+   {
+      case CURLE_OK:
+         return code == 429 || code == 500 || code == 502 || code == 503 || code == 504;
+      case CURLE_COULDNT_RESOLVE_HOST:
+      case CURLE_COULDNT_CONNECT:
+      case CURLE_OPERATION_TIMEDOUT:
+      case CURLE_SSL_CONNECT_ERROR:
+      case CURLE_SEND_ERROR:
+      case CURLE_RECV_ERROR:
+      case CURLE_GOT_NOTHING:
+      case CURLE_PARTIAL_FILE:
+         return true;
+      default:
+         return false;
+   }
+}
@@ -28,6 +28,7 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <catalog.h>
 #include <info.h>
 #include <json.h>
 #include <logging.h>
@@ -38,13 +39,20 @@
 
 /* system */
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #define INFO_BUFFER_SIZE 8192
 
+// workflow nodes that run at the same time update the same backup.info
+static pthread_mutex_t info_update_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void info_batch_put(struct info_batch* batch, char* key, char* value);
+
 void
 pgmoneta_create_info(char* directory, char* label, int status)
 {
@@ -109,6 +117,8 @@ pgmoneta_create_info(char* directory, char* label, int status)
       fclose(sfile);
    }
 
+   pgmoneta_catalog_update(directory);
+
    free(s);
 
    return;
@@ -118,23 +128,28 @@ error:
    free(s);
 }
 
-void
-pgmoneta_update_info_unsigned_long(char* directory, char* key, unsigned long value)
+int
+pgmoneta_info_begin(char* directory, struct info_batch** batch)
 {
    char buffer[INFO_BUFFER_SIZE];
-   char line[INFO_BUFFER_SIZE];
-   bool found = false;
    char* s = NULL;
+   char* sep = NULL;
    FILE* sfile = NULL;
-   char* d = NULL;
-   FILE* dfile = NULL;
+   struct info_batch* b = NULL;
+
+   *batch = NULL;
+
+   b = (struct info_batch*)calloc(1, sizeof(struct info_batch));
+   if (b == NULL)
+   {
+      goto error;
+   }
+
+   snprintf(&b->directory[0], sizeof(b->directory), "%s", directory);
 
    s = pgmoneta_append(s, directory);
    s = pgmoneta_append(s, "/backup.info");
 
-   d = pgmoneta_append(d, directory);
-   d = pgmoneta_append(d, "/backup.info.tmp");
-
    sfile = fopen(s, "r");
    if (sfile == NULL)
    {
@@ -142,103 +157,97 @@ pgmoneta_update_info_unsigned_long(char* directory, char* key, unsigned long val
       errno = 0;
       goto error;
    }
-   dfile = fopen(d, "w");
-   if (dfile == NULL)
-   {
-      pgmoneta_log_error("Could not open file %s due to %s", d, strerror(errno));
-      errno = 0;
-      goto error;
-   }
 
    while ((fgets(&buffer[0], sizeof(buffer), sfile)) != NULL)
    {
-      char k[INFO_BUFFER_SIZE];
-      char v[INFO_BUFFER_SIZE];
-      char* ptr = NULL;
-
-      memset(&k[0], 0, sizeof(k));
-      memset(&v[0], 0, sizeof(v));
-
-      memset(&line[0], 0, sizeof(line));
-      memcpy(&line[0], &buffer[0], strlen(&buffer[0]));
-
-      ptr = strtok(&buffer[0], "=");
-      memcpy(&k[0], ptr, strlen(ptr));
-
-      ptr = strtok(NULL, "=");
-      memcpy(&v[0], ptr, strlen(ptr) - 1);
-
-      if (!strcmp(key, &k[0]))
+      sep = strchr(&buffer[0], '=');
+      if (sep == NULL)
       {
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "%s=%lu\n", key, value);
-         fputs(&line[0], dfile);
-         found = true;
+         continue;
       }
-      else
+
+      *sep = '\0';
+      if (strlen(sep + 1) > 0 && pgmoneta_ends_with(sep + 1, "\n"))
       {
-         fputs(&line[0], dfile);
+         sep[strlen(sep + 1)] = '\0';
       }
-   }
 
-   if (!found)
-   {
-      memset(&line[0], 0, sizeof(line));
-      pgmoneta_log_trace("%s=%lu", key, value);
-      snprintf(&line[0], sizeof(line), "%s=%lu\n", key, value);
-      fputs(&line[0], dfile);
+      info_batch_put(b, &buffer[0], sep + 1);
    }
 
-   if (sfile != NULL)
-   {
-      fsync(fileno(sfile));
-      fclose(sfile);
-   }
+   fclose(sfile);
+   free(s);
 
-   if (dfile != NULL)
-   {
-      fsync(fileno(dfile));
-      fclose(dfile);
-   }
+   *batch = b;
 
-   pgmoneta_move_file(d, s);
-   pgmoneta_permission(s, 6, 0, 0);
+   return 0;
+
+error:
 
+   pgmoneta_info_abort(b);
    free(s);
-   free(d);
 
-   return;
+   return 1;
+}
 
-error:
+void
+pgmoneta_info_set_unsigned_long(struct info_batch* batch, char* key, unsigned long value)
+{
+   char v[MISC_LENGTH];
 
-   free(s);
-   free(d);
+   memset(&v[0], 0, sizeof(v));
+   snprintf(&v[0], sizeof(v), "%lu", value);
+
+   pgmoneta_info_set_string(batch, key, &v[0]);
 }
 
 void
-pgmoneta_update_info_double(char* directory, char* key, double value)
+pgmoneta_info_set_double(struct info_batch* batch, char* key, double value)
+{
+   char v[MISC_LENGTH];
+
+   memset(&v[0], 0, sizeof(v));
+   snprintf(&v[0], sizeof(v), "%.4f", value);
+
+   pgmoneta_info_set_string(batch, key, &v[0]);
+}
+
+void
+pgmoneta_info_set_string(struct info_batch* batch, char* key, char* value)
+{
+   if (batch == NULL)
+   {
+      return;
+   }
+
+   pgmoneta_log_trace("%s=%s", key, value);
+   info_batch_put(batch, key, value);
+}
+
+void
+pgmoneta_info_set_bool(struct info_batch* batch, char* key, bool value)
+{
+   pgmoneta_info_set_unsigned_long(batch, key, value ? 1 : 0);
+}
+
+int
+pgmoneta_info_commit(struct info_batch* batch)
 {
-   char buffer[INFO_BUFFER_SIZE];
-   char line[INFO_BUFFER_SIZE];
-   bool found = false;
    char* s = NULL;
-   FILE* sfile = NULL;
    char* d = NULL;
    FILE* dfile = NULL;
 
-   s = pgmoneta_append(s, directory);
+   if (batch == NULL)
+   {
+      goto error;
+   }
+
+   s = pgmoneta_append(s, batch->directory);
    s = pgmoneta_append(s, "/backup.info");
 
-   d = pgmoneta_append(d, directory);
+   d = pgmoneta_append(d, batch->directory);
    d = pgmoneta_append(d, "/backup.info.tmp");
 
-   sfile = fopen(s, "r");
-   if (sfile == NULL)
-   {
-      pgmoneta_log_error("Could not open file %s due to %s", s, strerror(errno));
-      errno = 0;
-      goto error;
-   }
    dfile = fopen(d, "w");
    if (dfile == NULL)
    {
@@ -247,166 +256,92 @@ pgmoneta_update_info_double(char* directory, char* key, double value)
       goto error;
    }
 
-   while ((fgets(&buffer[0], sizeof(buffer), sfile)) != NULL)
-   {
-      char k[INFO_BUFFER_SIZE];
-      char v[INFO_BUFFER_SIZE];
-      char* ptr = NULL;
-
-      memset(&k[0], 0, sizeof(k));
-      memset(&v[0], 0, sizeof(v));
-
-      memset(&line[0], 0, sizeof(line));
-      memcpy(&line[0], &buffer[0], strlen(&buffer[0]));
-
-      ptr = strtok(&buffer[0], "=");
-      memcpy(&k[0], ptr, strlen(ptr));
-
-      ptr = strtok(NULL, "=");
-      memcpy(&v[0], ptr, strlen(ptr) - 1);
-
-      if (!strcmp(key, &k[0]))
-      {
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "%s=%.4f\n", key, value);
-         fputs(&line[0], dfile);
-         found = true;
-      }
-      else
-      {
-         fputs(&line[0], dfile);
-      }
-   }
-
-   if (!found)
+   for (int i = 0; i < batch->number_of_keys; i++)
    {
-      memset(&line[0], 0, sizeof(line));
-      pgmoneta_log_trace("%s=%.4f", key, value);
-      snprintf(&line[0], sizeof(line), "%s=%.4f\n", key, value);
-      fputs(&line[0], dfile);
+      fprintf(dfile, "%s=%s\n", batch->keys[i], batch->values[i]);
    }
 
-   if (sfile != NULL)
-   {
-      fsync(fileno(sfile));
-      fclose(sfile);
-   }
-
-   if (dfile != NULL)
-   {
-      fsync(fileno(dfile));
-      fclose(dfile);
-   }
+   fsync(fileno(dfile));
+   fclose(dfile);
 
    pgmoneta_move_file(d, s);
    pgmoneta_permission(s, 6, 0, 0);
 
+   pgmoneta_catalog_update(batch->directory);
+
+   pgmoneta_info_abort(batch);
    free(s);
    free(d);
 
-   return;
+   return 0;
 
 error:
 
+   pgmoneta_info_abort(batch);
    free(s);
    free(d);
+
+   return 1;
 }
 
 void
-pgmoneta_update_info_string(char* directory, char* key, char* value)
+pgmoneta_info_abort(struct info_batch* batch)
 {
-   char buffer[INFO_BUFFER_SIZE];
-   char line[INFO_BUFFER_SIZE];
-   bool found = false;
-   char* s = NULL;
-   FILE* sfile = NULL;
-   char* d = NULL;
-   FILE* dfile = NULL;
-
-   s = pgmoneta_append(s, directory);
-   s = pgmoneta_append(s, "/backup.info");
-
-   d = pgmoneta_append(d, directory);
-   d = pgmoneta_append(d, "/backup.info.tmp");
-
-   sfile = fopen(s, "r");
-   if (sfile == NULL)
+   if (batch == NULL)
    {
-      pgmoneta_log_error("Could not open file %s due to %s", s, strerror(errno));
-      errno = 0;
-      goto error;
-   }
-   dfile = fopen(d, "w");
-   if (dfile == NULL)
-   {
-      pgmoneta_log_error("Could not open file %s due to %s", d, strerror(errno));
-      errno = 0;
-      goto error;
+      return;
    }
 
-   while ((fgets(&buffer[0], sizeof(buffer), sfile)) != NULL)
+   for (int i = 0; i < batch->number_of_keys; i++)
    {
-      char k[INFO_BUFFER_SIZE];
-      char v[INFO_BUFFER_SIZE];
-      char* ptr = NULL;
-
-      memset(&k[0], 0, sizeof(k));
-      memset(&v[0], 0, sizeof(v));
-
-      memset(&line[0], 0, sizeof(line));
-      memcpy(&line[0], &buffer[0], strlen(&buffer[0]));
-
-      ptr = strtok(&buffer[0], "=");
-      memcpy(&k[0], ptr, strlen(ptr));
-
-      ptr = strtok(NULL, "=");
-      memcpy(&v[0], ptr, strlen(ptr) - 1);
-
-      if (!strcmp(key, &k[0]))
-      {
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "%s=%s\n", key, value);
-         fputs(&line[0], dfile);
-         found = true;
-      }
-      else
-      {
-         fputs(&line[0], dfile);
-      }
+      free(batch->keys[i]);
+      free(batch->values[i]);
    }
+   free(batch->keys);
+   free(batch->values);
+   free(batch);
+}
 
-   if (!found)
-   {
-      memset(&line[0], 0, sizeof(line));
-      pgmoneta_log_trace("%s=%s", key, value);
-      snprintf(&line[0], sizeof(line), "%s=%s\n", key, value);
-      fputs(&line[0], dfile);
-   }
+void
+pgmoneta_update_info_unsigned_long(char* directory, char* key, unsigned long value)
+{
+   struct info_batch* batch = NULL;
 
-   if (sfile != NULL)
+   pthread_mutex_lock(&info_update_lock);
+   if (!pgmoneta_info_begin(directory, &batch))
    {
-      fsync(fileno(sfile));
-      fclose(sfile);
+      pgmoneta_info_set_unsigned_long(batch, key, value);
+      pgmoneta_info_commit(batch);
    }
+   pthread_mutex_unlock(&info_update_lock);
+}
 
-   if (dfile != NULL)
+void
+pgmoneta_update_info_double(char* directory, char* key, double value)
+{
+   struct info_batch* batch = NULL;
+
+   pthread_mutex_lock(&info_update_lock);
+   if (!pgmoneta_info_begin(directory, &batch))
    {
-      fsync(fileno(dfile));
-      fclose(dfile);
+      pgmoneta_info_set_double(batch, key, value);
+      pgmoneta_info_commit(batch);
    }
+   pthread_mutex_unlock(&info_update_lock);
+}
 
-   pgmoneta_move_file(d, s);
-   pgmoneta_permission(s, 6, 0, 0);
-
-   free(s);
-   free(d);
-
-   return;
-
-error:
+void
+pgmoneta_update_info_string(char* directory, char* key, char* value)
+{
+   struct info_batch* batch = NULL;
 
-   free(s);
-   free(d);
+   pthread_mutex_lock(&info_update_lock);
+   if (!pgmoneta_info_begin(directory, &batch))
+   {
+      pgmoneta_info_set_string(batch, key, value);
+      pgmoneta_info_commit(batch);
+   }
+   pthread_mutex_unlock(&info_update_lock);
 }
 
 void
@@ -718,16 +653,28 @@ int
 pgmoneta_get_backups(char* directory, int* number_of_backups, struct backup*** backups)
 {
    char* d = NULL;
+   char* fn = NULL;
    struct backup** bcks = NULL;
    int number_of_directories;
+   int n = 0;
    char** dirs;
+   bool has_mtime;
+   struct stat st;
 
    *number_of_backups = 0;
    *backups = NULL;
 
+   if (!pgmoneta_catalog_load(directory, number_of_backups, backups))
+   {
+      return 0;
+   }
+
    number_of_directories = 0;
    dirs = NULL;
 
+   /* The catalog is built from the state of the directory before it is read */
+   has_mtime = !stat(directory, &st);
+
    pgmoneta_get_directories(directory, &number_of_directories, &dirs);
 
    bcks = (struct backup**)malloc(number_of_directories * sizeof(struct backup*));
@@ -743,11 +690,23 @@ pgmoneta_get_backups(char* directory, int* number_of_backups, struct backup*** b
    {
       d = pgmoneta_append(d, directory);
 
-      if (pgmoneta_get_backup(d, dirs[i], &bcks[i]))
+      // a backup that is still arriving from another pgmoneta has no backup.info yet
+      fn = pgmoneta_append(fn, d);
+      fn = pgmoneta_append(fn, "/");
+      fn = pgmoneta_append(fn, dirs[i]);
+      fn = pgmoneta_append(fn, "/backup.info");
+
+      if (!pgmoneta_exists(fn))
+      {
+         pgmoneta_log_debug("Skipping %s/%s without backup.info", directory, dirs[i]);
+      }
+      else if (pgmoneta_get_backup(d, dirs[i], &bcks[n++]))
       {
          goto error;
       }
 
+      free(fn);
+      fn = NULL;
       free(d);
       d = NULL;
    }
@@ -758,7 +717,13 @@ pgmoneta_get_backups(char* directory, int* number_of_backups, struct backup*** b
    }
    free(dirs);
 
-   *number_of_backups = number_of_directories;
+   // the arrival of a backup.info doesn't change the directory time, so no catalog until it is there
+   if (has_mtime && n == number_of_directories)
+   {
+      pgmoneta_catalog_store(directory, &st.st_mtim, n, bcks);
+   }
+
+   *number_of_backups = n;
    *backups = bcks;
 
    return 0;
@@ -766,6 +731,7 @@ pgmoneta_get_backups(char* directory, int* number_of_backups, struct backup*** b
 error:
 
    free(d);
+   free(fn);
 
    if (dirs != NULL)
    {
@@ -807,6 +773,7 @@ pgmoneta_get_backup_server(int server, char* identifier, struct backup** backup)
    char* id = NULL;
    char* root = NULL;
    char* base = NULL;
+   int index = -1;
    int number_of_backups = 0;
    struct backup** backups = NULL;
    struct backup* bck = NULL;
@@ -823,48 +790,10 @@ pgmoneta_get_backup_server(int server, char* identifier, struct backup** backup)
       goto error;
    }
 
-   if (!strcmp(identifier, "oldest"))
+   index = pgmoneta_catalog_search(number_of_backups, backups, identifier);
+   if (index != -1)
    {
-      for (int i = 0; id == NULL && i < number_of_backups; i++)
-      {
-         if (backups[i]->valid == VALID_TRUE)
-         {
-            id = backups[i]->label;
-         }
-      }
-   }
-   else if (!strcmp(identifier, "latest") || !strcmp(identifier, "newest"))
-   {
-      for (int i = number_of_backups - 1; id == NULL && i >= 0; i--)
-      {
-         if (backups[i]->valid == VALID_TRUE)
-         {
-            id = backups[i]->label;
-         }
-      }
-   }
-   else
-   {
-      /* Explicit search */
-      for (int i = 0; id == NULL && i < number_of_backups; i++)
-      {
-         if (!strcmp(backups[i]->label, identifier) && backups[i]->valid == VALID_TRUE)
-         {
-            id = backups[i]->label;
-         }
-      }
-
-      if (id == NULL)
-      {
-         /* Prefix search */
-         for (int i = 0; id == NULL && i < number_of_backups; i++)
-         {
-            if (pgmoneta_starts_with(backups[i]->label, identifier) && backups[i]->valid == VALID_TRUE)
-            {
-               id = backups[i]->label;
-            }
-         }
-      }
+      id = backups[index]->label;
    }
 
    if (id == NULL)
@@ -1112,6 +1041,26 @@ pgmoneta_get_backup_file(char* fn, struct backup** backup)
          {
             bck->hash_algorithm = atoi(&value[0]);
          }
+         else if (pgmoneta_starts_with(&key[0], INFO_DEDUPLICATION))
+         {
+            bck->deduplication = atoi(&value[0]) == 1 ? true : false;
+         }
+         else if (pgmoneta_starts_with(&key[0], INFO_PAGE_FILTER))
+         {
+            bck->page_filter = atoi(&value[0]) == 1 ? true : false;
+         }
+         else if (pgmoneta_starts_with(&key[0], INFO_DICTIONARY))
+         {
+            bck->dictionary = (uint32_t)strtoul(&value[0], NULL, 10);
+         }
+         else if (pgmoneta_starts_with(&key[0], INFO_DURABLE))
+         {
+            bck->durable = atoi(&value[0]) == 1 ? true : false;
+         }
+         else if (pgmoneta_starts_with(&key[0], INFO_CHECKSUM_FAILURES))
+         {
+            bck->checksum_failures = strtoull(&value[0], NULL, 10);
+         }
          else if (pgmoneta_starts_with(&key[0], INFO_COMMENTS))
          {
             memcpy(&bck->comments[0], &value[0], strlen(&value[0]));
@@ -1250,8 +1199,12 @@ error:
 int
 pgmoneta_get_backup_root(int server, struct backup* backup, struct backup** root)
 {
-   struct backup* p = NULL;
-   struct backup* bck = NULL;
+   char* d = NULL;
+   int index = -1;
+   int* chain = NULL;
+   int length = 0;
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
 
    *root = NULL;
 
@@ -1265,27 +1218,48 @@ pgmoneta_get_backup_root(int server, struct backup* backup, struct backup** root
       goto error;
    }
 
-   if (pgmoneta_get_backup_parent(server, backup, &p))
+   d = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_backups(d, &number_of_backups, &backups))
    {
       goto error;
    }
 
-   while (p->type != TYPE_FULL)
+   // the chain is followed in the loaded backups instead of reading each backup.info
+   index = pgmoneta_catalog_search(number_of_backups, backups, backup->parent_label);
+   if (index == -1 || strcmp(backups[index]->label, backup->parent_label))
    {
-      if (pgmoneta_get_backup_parent(server, p, &bck))
-      {
-         goto error;
-      }
-      free(p);
-      p = bck;
+      goto error;
    }
 
-   *root = p;
+   if (pgmoneta_catalog_chain(number_of_backups, backups, index, &chain, &length))
+   {
+      goto error;
+   }
+
+   *root = backups[chain[length - 1]];
+   backups[chain[length - 1]] = NULL;
+
+   free(chain);
+   free(d);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
 
    return 0;
 
 error:
-   free(p);
+   free(chain);
+   free(d);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
 
    return 1;
 }
@@ -1294,7 +1268,6 @@ int
 pgmoneta_get_backup_child(int server, struct backup* backup, struct backup** child)
 {
    char* d = NULL;
-   char* c_identifier = NULL;
    int number_of_backups = 0;
    struct backup** backups = NULL;
    struct backup* c = NULL;
@@ -1313,26 +1286,19 @@ pgmoneta_get_backup_child(int server, struct backup* backup, struct backup** chi
       goto error;
    }
 
-   for (int j = 0; c_identifier == NULL && j < number_of_backups; j++)
+   // the child is taken from the loaded backups instead of being looked up again
+   for (int j = 0; c == NULL && j < number_of_backups; j++)
    {
       if (!strcmp(backup->label, backups[j]->parent_label))
       {
-         c_identifier = pgmoneta_append(c_identifier, backups[j]->parent_label);
+         c = backups[j];
+         backups[j] = NULL;
       }
    }
 
-   if (c_identifier != NULL)
-   {
-      if (pgmoneta_get_backup_server(server, c_identifier, &c))
-      {
-         goto error;
-      }
-
-      *child = c;
-   }
+   *child = c;
 
    free(d);
-   free(c_identifier);
 
    for (int j = 0; j < number_of_backups; j++)
    {
@@ -1345,7 +1311,6 @@ pgmoneta_get_backup_child(int server, struct backup* backup, struct backup** chi
 error:
 
    free(d);
-   free(c_identifier);
 
    for (int j = 0; j < number_of_backups; j++)
    {
@@ -1356,7 +1321,7 @@ error:
    return 1;
 }
 
-void
+int
 pgmoneta_info_request(SSL* ssl, int client_fd, int server,
                       uint8_t compression, uint8_t encryption,
                       struct json* payload)
@@ -1509,11 +1474,7 @@ pgmoneta_info_request(SSL* ssl, int client_fd, int server,
    free(d);
    free(elapsed);
 
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_stop_logging();
-
-   exit(0);
+   return 0;
 
 error:
 
@@ -1529,11 +1490,7 @@ error:
 
    free(elapsed);
 
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_stop_logging();
-
-   exit(1);
+   return 1;
 }
 
 void
@@ -1728,3 +1685,46 @@ error:
 
    exit(1);
 }
+
+static void
+info_batch_put(struct info_batch* batch, char* key, char* value)
+{
+   char** keys = NULL;
+   char** values = NULL;
+
+   for (int i = 0; i < batch->number_of_keys; i++)
+   {
+      if (!strcmp(batch->keys[i], key))
+      {
+         free(batch->values[i]);
+         batch->values[i] = NULL;
+         batch->values[i] = pgmoneta_append(batch->values[i], value);
+         return;
+      }
+   }
+
+   if (batch->number_of_keys == batch->capacity)
+   {
+      int capacity = batch->capacity == 0 ? 32 : batch->capacity * 2;
+
+      keys = (char**)realloc(batch->keys, capacity * sizeof(char*));
+      if (keys == NULL)
+      {
+         return;
+      }
+      batch->keys = keys;
+
+      values = (char**)realloc(batch->values, capacity * sizeof(char*));
+      if (values == NULL)
+      {
+         return;
+      }
+      batch->values = values;
+
+      batch->capacity = capacity;
+   }
+
+   batch->keys[batch->number_of_keys] = pgmoneta_append(NULL, key);
+   batch->values[batch->number_of_keys] = pgmoneta_append(NULL, value);
+   batch->number_of_keys++;
+}
@@ -0,0 +1,795 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <io.h>
+#include <logging.h>
+#include <utils.h>
+#include <workers.h>
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <sys/uio.h>
+#endif
+
+#define IO_OP_READ  0
+#define IO_OP_WRITE 1
+
+static atomic_bool io_uring_failed = false;
+
+static size_t reader_direct(struct io_reader* reader, void* buffer, size_t length);
+
+#ifdef HAVE_LIBURING
+/** @struct io_ring
+ * Defines the ring of a thread, along with its registered buffers
+ */
+struct io_ring
+{
+   struct io_uring ring;                /**< The ring */
+   char* buffers;                       /**< The buffers, IO_BUFFER_SIZE bytes per slot */
+   struct iovec iovecs[IO_QUEUE_DEPTH]; /**< The buffer of each slot */
+   bool registered;                     /**< Are the buffers registered with the kernel */
+   bool busy;                           /**< Is the ring used by a copy or a reader */
+};
+
+static struct io_ring* ring_get(void);
+static void ring_destroy(void* context);
+static int ring_prepare(struct io_ring* r, int op, int fd, int slot, size_t offset_in_slot, size_t length, off_t offset);
+static void reader_submit(struct io_reader* reader, int slot);
+static int reader_wait(struct io_reader* reader, bool resubmit);
+#endif
+
+bool
+pgmoneta_io_uring_available(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->io_engine != IO_ENGINE_IO_URING || atomic_load(&io_uring_failed))
+   {
+      return false;
+   }
+
+#ifdef HAVE_LIBURING
+   struct io_ring* r = ring_get();
+
+   return r != NULL && !r->busy;
+#else
+   pgmoneta_log_warn("io_engine = io_uring, but pgmoneta was built without liburing");
+   atomic_store(&io_uring_failed, true);
+
+   return false;
+#endif
+}
+
+int
+pgmoneta_io_copy(int fd_from, int fd_to, off_t size)
+{
+#ifdef HAVE_LIBURING
+   int active = 0;
+   bool failed = false;
+   off_t next = 0;
+   off_t offsets[IO_QUEUE_DEPTH];
+   size_t lengths[IO_QUEUE_DEPTH];
+   size_t filled[IO_QUEUE_DEPTH];
+   size_t written[IO_QUEUE_DEPTH];
+   struct io_uring_cqe* cqe = NULL;
+   struct io_ring* r = NULL;
+
+   r = ring_get();
+
+   if (r == NULL || r->busy)
+   {
+      goto error;
+   }
+
+   r->busy = true;
+
+   /* Every slot moves one chunk through a read and then a write, so up to IO_QUEUE_DEPTH chunks are in flight */
+   for (int i = 0; i < IO_QUEUE_DEPTH && next < size; i++)
+   {
+      offsets[i] = next;
+      lengths[i] = MIN(IO_BUFFER_SIZE, (size_t)(size - next));
+      filled[i] = 0;
+      written[i] = 0;
+      next += lengths[i];
+
+      if (ring_prepare(r, IO_OP_READ, fd_from, i, 0, lengths[i], offsets[i]))
+      {
+         failed = true;
+         break;
+      }
+      active++;
+   }
+
+   io_uring_submit(&r->ring);
+
+   while (active > 0)
+   {
+      int ret;
+      int slot;
+      int op;
+      int res;
+
+      ret = io_uring_wait_cqe(&r->ring, &cqe);
+      if (ret == -EINTR)
+      {
+         continue;
+      }
+      else if (ret < 0)
+      {
+         /* The ring can't be drained, so it can't be handed out again either */
+         r->busy = false;
+         pgmoneta_worker_context_set(WORKER_CONTEXT_IO_URING, NULL, NULL);
+         goto error;
+      }
+
+      slot = (int)(cqe->user_data >> 1);
+      op = (int)(cqe->user_data & 1);
+      res = cqe->res;
+      io_uring_cqe_seen(&r->ring, cqe);
+
+      if (failed)
+      {
+         active--;
+         continue;
+      }
+
+      if (res == -EINTR || res == -EAGAIN)
+      {
+         res = 0;
+      }
+      else if (res <= 0)
+      {
+         /* A read of zero bytes means the file got shorter while it was copied */
+         pgmoneta_log_debug("io_uring: %s failed (%s)", op == IO_OP_READ ? "read" : "write", res < 0 ? strerror(-res) : "short");
+         failed = true;
+         active--;
+         continue;
+      }
+
+      if (op == IO_OP_READ)
+      {
+         filled[slot] += res;
+
+         if (filled[slot] < lengths[slot])
+         {
+            ret = ring_prepare(r, IO_OP_READ, fd_from, slot, filled[slot], lengths[slot] - filled[slot], offsets[slot] + filled[slot]);
+         }
+         else
+         {
+            ret = ring_prepare(r, IO_OP_WRITE, fd_to, slot, 0, filled[slot], offsets[slot]);
+         }
+      }
+      else
+      {
+         written[slot] += res;
+
+         if (written[slot] < filled[slot])
+         {
+            ret = ring_prepare(r, IO_OP_WRITE, fd_to, slot, written[slot], filled[slot] - written[slot], offsets[slot] + written[slot]);
+         }
+         else if (next < size)
+         {
+            offsets[slot] = next;
+            lengths[slot] = MIN(IO_BUFFER_SIZE, (size_t)(size - next));
+            filled[slot] = 0;
+            written[slot] = 0;
+            next += lengths[slot];
+
+            ret = ring_prepare(r, IO_OP_READ, fd_from, slot, 0, lengths[slot], offsets[slot]);
+         }
+         else
+         {
+            active--;
+            continue;
+         }
+      }
+
+      if (ret)
+      {
+         failed = true;
+         active--;
+         continue;
+      }
+
+      io_uring_submit(&r->ring);
+   }
+
+   r->busy = false;
+
+   if (failed)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+#else
+   return 1;
+#endif
+}
+
+void
+pgmoneta_io_drop(int fd, bool written)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->io_cache == IO_CACHE_KEEP || fd < 0)
+   {
+      return;
+   }
+
+#ifdef HAVE_LINUX
+   // dirty pages can't be dropped, so wait for their write back
+   if (written)
+   {
+      sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+   }
+#endif
+
+   posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+   errno = 0;
+}
+
+int
+pgmoneta_io_reader_open(char* path, off_t offset, size_t length, struct io_reader** reader)
+{
+   int fd = -1;
+   struct stat st;
+   struct io_reader* r = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *reader = NULL;
+
+   fd = open(path, O_RDONLY);
+
+   if (fd < 0)
+   {
+      goto error;
+   }
+
+   if (fstat(fd, &st))
+   {
+      goto error;
+   }
+
+   r = (struct io_reader*)calloc(1, sizeof(struct io_reader));
+
+   if (r == NULL)
+   {
+      goto error;
+   }
+
+   r->fd = fd;
+   r->size = st.st_size;
+   r->next = MIN(offset, st.st_size);
+   r->start = r->next;
+
+   if (length > 0 && r->next + (off_t)length < r->size)
+   {
+      r->size = r->next + (off_t)length;
+   }
+
+   if (config->io_cache != IO_CACHE_KEEP)
+   {
+      posix_fadvise(fd, r->start, r->size - r->start, POSIX_FADV_SEQUENTIAL);
+   }
+
+#ifdef HAVE_LINUX
+   // large files bypass the page cache, the reads are aligned to the start of the buffer
+   if (config->io_cache == IO_CACHE_DIRECT && r->size - r->start >= IO_DIRECT_SIZE &&
+       !pgmoneta_io_uring_available() && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) == 0)
+   {
+      if (posix_memalign((void**)&r->direct, IO_DIRECT_ALIGN, IO_BUFFER_SIZE))
+      {
+         r->direct = NULL;
+         fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      }
+      r->direct_offset = 0;
+      r->direct_filled = 0;
+   }
+   errno = 0;
+#endif
+
+#ifdef HAVE_LIBURING
+   if (pgmoneta_io_uring_available())
+   {
+      r->ring = ring_get();
+      r->ring->busy = true;
+
+      for (int i = 0; i < IO_QUEUE_DEPTH && r->next < r->size; i++)
+      {
+         reader_submit(r, i);
+      }
+
+      io_uring_submit(&r->ring->ring);
+   }
+#endif
+
+   *reader = r;
+
+   return 0;
+
+error:
+
+   if (fd >= 0)
+   {
+      close(fd);
+   }
+
+   free(r);
+
+   errno = 0;
+
+   return 1;
+}
+
+size_t
+pgmoneta_io_reader_read(struct io_reader* reader, void* buffer, size_t length)
+{
+   size_t copied = 0;
+   ssize_t n = 0;
+
+   if (reader == NULL || reader->error)
+   {
+      return 0;
+   }
+
+   if (reader->direct != NULL)
+   {
+      return reader_direct(reader, buffer, length);
+   }
+
+   if (reader->ring == NULL)
+   {
+      while (copied < length && reader->next < reader->size)
+      {
+         n = pread(reader->fd, (char*)buffer + copied, MIN(length - copied, (size_t)(reader->size - reader->next)), reader->next);
+
+         if (n < 0)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+
+            reader->error = true;
+            errno = 0;
+            break;
+         }
+         else if (n == 0)
+         {
+            break;
+         }
+
+         copied += n;
+         reader->next += n;
+      }
+
+      return copied;
+   }
+
+#ifdef HAVE_LIBURING
+   while (copied < length && !reader->error && reader->active[reader->head])
+   {
+      int slot = reader->head;
+      size_t take = 0;
+
+      while (reader->pending[slot])
+      {
+         if (reader_wait(reader, true))
+         {
+            return copied;
+         }
+      }
+
+      take = MIN(reader->filled[slot] - reader->consumed, length - copied);
+      memcpy((char*)buffer + copied, (char*)reader->ring->iovecs[slot].iov_base + reader->consumed, take);
+
+      reader->consumed += take;
+      copied += take;
+
+      if (reader->consumed == reader->filled[slot])
+      {
+         reader->consumed = 0;
+         reader->active[slot] = false;
+
+         /* The slot is free again, so put it to work on the next chunk */
+         if (reader->next < reader->size)
+         {
+            reader_submit(reader, slot);
+            io_uring_submit(&reader->ring->ring);
+         }
+
+         reader->head = (reader->head + 1) % IO_QUEUE_DEPTH;
+      }
+   }
+#endif
+
+   return copied;
+}
+
+bool
+pgmoneta_io_reader_error(struct io_reader* reader)
+{
+   return reader == NULL || reader->error;
+}
+
+void
+pgmoneta_io_reader_close(struct io_reader* reader)
+{
+   if (reader == NULL)
+   {
+      return;
+   }
+
+#ifdef HAVE_LIBURING
+   if (reader->ring != NULL)
+   {
+      bool drained = true;
+
+      for (int i = 0; drained && i < IO_QUEUE_DEPTH; i++)
+      {
+         while (drained && reader->pending[i])
+         {
+            if (reader_wait(reader, false))
+            {
+               drained = false;
+            }
+         }
+      }
+
+      reader->ring->busy = false;
+
+      if (!drained)
+      {
+         pgmoneta_worker_context_set(WORKER_CONTEXT_IO_URING, NULL, NULL);
+      }
+   }
+#endif
+
+   if (!reader->error && reader->direct == NULL)
+   {
+      struct configuration* config;
+
+      config = (struct configuration*)shmem;
+
+      if (config->io_cache != IO_CACHE_KEEP)
+      {
+         posix_fadvise(reader->fd, reader->start, reader->size - reader->start, POSIX_FADV_DONTNEED);
+         errno = 0;
+      }
+   }
+
+   close(reader->fd);
+   free(reader->direct);
+   free(reader);
+}
+
+static size_t
+reader_direct(struct io_reader* reader, void* buffer, size_t length)
+{
+   size_t copied = 0;
+   size_t take = 0;
+   ssize_t n = 0;
+
+   while (copied < length && reader->next < reader->size)
+   {
+      if (reader->next < reader->direct_offset ||
+          reader->next >= reader->direct_offset + (off_t)reader->direct_filled)
+      {
+         reader->direct_offset = reader->next & ~((off_t)IO_DIRECT_ALIGN - 1);
+         reader->direct_filled = 0;
+
+         n = pread(reader->fd, reader->direct, IO_BUFFER_SIZE, reader->direct_offset);
+
+         if (n < 0 && errno == EINTR)
+         {
+            continue;
+         }
+         else if (n < 0 && errno == EINVAL && (fcntl(reader->fd, F_GETFL) & O_DIRECT))
+         {
+            // the file system doesn't take direct reads, the buffer still works for plain reads
+            fcntl(reader->fd, F_SETFL, fcntl(reader->fd, F_GETFL) & ~O_DIRECT);
+            continue;
+         }
+         else if (n < 0)
+         {
+            reader->error = true;
+            errno = 0;
+            break;
+         }
+
+         reader->direct_filled = n;
+
+         if (reader->next >= reader->direct_offset + n)
+         {
+            break;
+         }
+      }
+
+      take = MIN(length - copied, (size_t)(reader->direct_offset + reader->direct_filled - reader->next));
+      take = MIN(take, (size_t)(reader->size - reader->next));
+      memcpy((char*)buffer + copied, reader->direct + (reader->next - reader->direct_offset), take);
+
+      copied += take;
+      reader->next += take;
+   }
+
+   return copied;
+}
+
+#ifdef HAVE_LIBURING
+static struct io_ring*
+ring_get(void)
+{
+   struct io_ring* r = NULL;
+   struct io_uring_params params;
+
+   r = (struct io_ring*)pgmoneta_worker_context(WORKER_CONTEXT_IO_URING);
+
+   if (r != NULL)
+   {
+      return r;
+   }
+
+   if (atomic_load(&io_uring_failed))
+   {
+      return NULL;
+   }
+
+   r = (struct io_ring*)calloc(1, sizeof(struct io_ring));
+
+   if (r == NULL)
+   {
+      goto error;
+   }
+
+   memset(&params, 0, sizeof(params));
+   params.flags = IORING_SETUP_SQPOLL;
+   params.sq_thread_idle = IO_SQPOLL_IDLE;
+
+   if (io_uring_queue_init_params(IO_QUEUE_DEPTH * 2, &r->ring, &params) < 0)
+   {
+      /* Submission queue polling needs privileges on older kernels */
+      memset(&params, 0, sizeof(params));
+
+      if (io_uring_queue_init_params(IO_QUEUE_DEPTH * 2, &r->ring, &params) < 0)
+      {
+         pgmoneta_log_warn("io_uring is not available, using plain reads and writes");
+         atomic_store(&io_uring_failed, true);
+         goto error;
+      }
+   }
+
+   if (posix_memalign((void**)&r->buffers, 4096, IO_QUEUE_DEPTH * IO_BUFFER_SIZE))
+   {
+      io_uring_queue_exit(&r->ring);
+      goto error;
+   }
+
+   for (int i = 0; i < IO_QUEUE_DEPTH; i++)
+   {
+      r->iovecs[i].iov_base = r->buffers + (i * IO_BUFFER_SIZE);
+      r->iovecs[i].iov_len = IO_BUFFER_SIZE;
+   }
+
+   r->registered = io_uring_register_buffers(&r->ring, r->iovecs, IO_QUEUE_DEPTH) == 0;
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_IO_URING, r, ring_destroy);
+
+   return r;
+
+error:
+
+   if (r != NULL)
+   {
+      free(r->buffers);
+   }
+   free(r);
+
+   return NULL;
+}
+
+static void
+ring_destroy(void* context)
+{
+   struct io_ring* r = (struct io_ring*)context;
+
+   if (r == NULL)
+   {
+      return;
+   }
+
+   if (r->registered)
+   {
+      io_uring_unregister_buffers(&r->ring);
+   }
+
+   io_uring_queue_exit(&r->ring);
+
+   free(r->buffers);
+   free(r);
+}
+
+static int
+ring_prepare(struct io_ring* r, int op, int fd, int slot, size_t offset_in_slot, size_t length, off_t offset)
+{
+   char* buffer = NULL;
+   struct io_uring_sqe* sqe = NULL;
+
+   sqe = io_uring_get_sqe(&r->ring);
+
+   if (sqe == NULL)
+   {
+      io_uring_submit(&r->ring);
+      sqe = io_uring_get_sqe(&r->ring);
+   }
+
+   if (sqe == NULL)
+   {
+      return 1;
+   }
+
+   buffer = (char*)r->iovecs[slot].iov_base + offset_in_slot;
+
+   if (op == IO_OP_READ)
+   {
+      if (r->registered)
+      {
+         io_uring_prep_read_fixed(sqe, fd, buffer, length, offset, slot);
+      }
+      else
+      {
+         io_uring_prep_read(sqe, fd, buffer, length, offset);
+      }
+   }
+   else
+   {
+      if (r->registered)
+      {
+         io_uring_prep_write_fixed(sqe, fd, buffer, length, offset, slot);
+      }
+      else
+      {
+         io_uring_prep_write(sqe, fd, buffer, length, offset);
+      }
+   }
+
+   sqe->user_data = ((uint64_t)slot << 1) | (uint64_t)op;
+
+   return 0;
+}
+
+static void
+reader_submit(struct io_reader* reader, int slot)
+{
+   reader->offsets[slot] = reader->next;
+   reader->lengths[slot] = MIN(IO_BUFFER_SIZE, (size_t)(reader->size - reader->next));
+   reader->filled[slot] = 0;
+   reader->active[slot] = true;
+   reader->next += reader->lengths[slot];
+
+   if (ring_prepare(reader->ring, IO_OP_READ, reader->fd, slot, 0, reader->lengths[slot], reader->offsets[slot]))
+   {
+      reader->error = true;
+      return;
+   }
+
+   reader->pending[slot] = true;
+}
+
+static int
+reader_wait(struct io_reader* reader, bool resubmit)
+{
+   int ret;
+   int slot;
+   int res;
+   struct io_uring_cqe* cqe = NULL;
+
+   do
+   {
+      ret = io_uring_wait_cqe(&reader->ring->ring, &cqe);
+   }
+   while (ret == -EINTR);
+
+   if (ret < 0)
+   {
+      reader->error = true;
+      goto error;
+   }
+
+   slot = (int)(cqe->user_data >> 1);
+   res = cqe->res;
+   io_uring_cqe_seen(&reader->ring->ring, cqe);
+
+   reader->pending[slot] = false;
+
+   if (!resubmit)
+   {
+      return 0;
+   }
+
+   if (res == -EINTR || res == -EAGAIN)
+   {
+      res = 0;
+   }
+   else if (res < 0)
+   {
+      pgmoneta_log_debug("io_uring: read failed (%s)", strerror(-res));
+      reader->error = true;
+      goto error;
+   }
+   else if (res == 0)
+   {
+      /* The file got shorter since it was opened */
+      reader->lengths[slot] = reader->filled[slot];
+      reader->next = reader->size;
+      return 0;
+   }
+
+   reader->filled[slot] += res;
+
+   if (reader->filled[slot] < reader->lengths[slot])
+   {
+      if (ring_prepare(reader->ring, IO_OP_READ, reader->fd, slot, reader->filled[slot],
+                       reader->lengths[slot] - reader->filled[slot], reader->offsets[slot] + reader->filled[slot]))
+      {
+         reader->error = true;
+         goto error;
+      }
+
+      reader->pending[slot] = true;
+      io_uring_submit(&reader->ring->ring);
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+#endif
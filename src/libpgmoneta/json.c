@@ -38,6 +38,23 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+
+struct json_token
+{
+   char* data;
+   size_t length;
+   size_t capacity;
+};
+
+struct json_parser
+{
+   char* str;
+   uint64_t len;
+   uint64_t idx;
+   struct json_token key;
+   struct json_token value;
+};
 
 static int advance_to_first_array_element(struct json_reader* reader);
 static int json_read(struct json_reader* reader);
@@ -48,11 +65,32 @@ static int json_stream_parse_item(struct json_reader* reader, struct json** item
 static bool type_allowed(enum value_type type);
 static char* item_to_string(struct json* item, int32_t format, char* tag, int indent);
 static char* array_to_string(struct json* array, int32_t format, char* tag, int indent);
-static int parse_string(char* str, uint64_t* index, struct json** obj);
+static int json_parse(char* str, uint64_t len, struct json** obj);
+static int parse_string(struct json_parser* parser, struct json** obj);
 static int json_add(struct json* obj, char* key, uintptr_t val, enum value_type type);
-static int fill_value(char* str, char* key, uint64_t* index, struct json* o);
-static bool value_start(char ch);
+static void skip_whitespace(struct json_parser* parser);
+static int token_append(struct json_token* token, char* s, size_t length);
+static int parse_quoted(struct json_parser* parser, struct json_token* token);
+static int fill_value(struct json_parser* parser, char* key, struct json* o);
 static int handle_escape_char(char* str, uint64_t* index, uint64_t len, char* ch);
+static int writer_append(struct json_writer* writer, char* s, size_t length);
+static int writer_puts(struct json_writer* writer, char* s);
+static int writer_indent(struct json_writer* writer, char* tag, int indent);
+static int writer_string(struct json_writer* writer, char* s);
+static int write_value(struct json_writer* writer, struct value* value, int32_t format, int indent);
+static int write_json(struct json_writer* writer, struct json* object, int32_t format, int indent);
+static int write_art(struct json_writer* writer, struct art* t, int32_t format, int indent);
+static int write_art_cb(void* param, const char* key, struct value* value);
+static int write_deque(struct json_writer* writer, struct deque* deque, int32_t format, int indent);
+
+struct write_param
+{
+   struct json_writer* writer;
+   int32_t format;
+   int indent;
+   uint64_t cnt;
+   uint64_t size;
+};
 
 int
 pgmoneta_json_reader_init(char* path, struct json_reader** reader)
@@ -116,7 +154,7 @@ int
 pgmoneta_json_locate(struct json_reader* reader, char** key_path, int key_path_length)
 {
    char ch = 0;
-   char* cur_key = NULL;
+   struct json_token cur_key = {0};
    if (reader == NULL || reader->state == InvalidState)
    {
       goto error;
@@ -135,7 +173,7 @@ pgmoneta_json_locate(struct json_reader* reader, char** key_path, int key_path_l
    for (int i = 0; i < key_path_length; i++)
    {
       char* key = key_path[i];
-      cur_key = NULL;
+      cur_key.length = 0;
       while (json_next_char(reader, &ch))
       {
          if (ch != '"' && ch != ':' && ch != '{' && ch != '}' &&
@@ -143,7 +181,10 @@ pgmoneta_json_locate(struct json_reader* reader, char** key_path, int key_path_l
          {
             if (reader->state == KeyStart)
             {
-               cur_key = pgmoneta_append_char(cur_key, ch);
+               if (token_append(&cur_key, &ch, 1))
+               {
+                  goto error;
+               }
             }
             continue;
          }
@@ -171,12 +212,12 @@ pgmoneta_json_locate(struct json_reader* reader, char** key_path, int key_path_l
          }
          else if (reader->state == ValueStart)
          {
-            if (cur_key == NULL)
+            if (cur_key.length == 0)
             {
                goto error;
             }
             // if the cur_key matches current key in path
-            if (!strcmp(cur_key, key))
+            if (!strcmp(cur_key.data, key))
             {
                if (i == key_path_length - 1)
                {
@@ -220,8 +261,7 @@ pgmoneta_json_locate(struct json_reader* reader, char** key_path, int key_path_l
                {
                   goto error;
                }
-               free(cur_key);
-               cur_key = NULL;
+               cur_key.length = 0;
             }
          }
          else if (reader->state == ValueEnd)
@@ -276,18 +316,17 @@ pgmoneta_json_locate(struct json_reader* reader, char** key_path, int key_path_l
          }
 
       }
-      free(cur_key);
-      cur_key = NULL;
+      cur_key.length = 0;
       if (!json_peek_next_char(reader, &ch))
       {
          goto error;
       }
    }
 done:
-   free(cur_key);
+   free(cur_key.data);
    return 0;
 error:
-   free(cur_key);
+   free(cur_key.data);
    reader->state = InvalidState;
    return 1;
 }
@@ -455,6 +494,20 @@ char*
 pgmoneta_json_to_string(struct json* object, int32_t format, char* tag, int indent)
 {
    char* str = NULL;
+   struct json_writer* writer = NULL;
+   if (format == FORMAT_JSON || format == FORMAT_JSON_COMPACT)
+   {
+      if (pgmoneta_json_writer_create(NULL, &writer))
+      {
+         return NULL;
+      }
+      if (pgmoneta_json_writer_write(writer, object, format, tag, indent) == 0)
+      {
+         str = pgmoneta_json_writer_take(writer);
+      }
+      pgmoneta_json_writer_destroy(writer);
+      return str;
+   }
    if (object == NULL || (object->type == JSONUnknown || object->elements == NULL))
    {
       str = pgmoneta_indent(str, tag, indent);
@@ -602,13 +655,12 @@ pgmoneta_json_iterator_has_next(struct json_iterator* iter)
 int
 pgmoneta_json_parse_string(char* str, struct json** obj)
 {
-   uint64_t idx = 0;
-   if (str == NULL || strlen(str) < 2)
+   if (str == NULL)
    {
       return 1;
    }
 
-   return parse_string(str, &idx, obj);
+   return json_parse(str, strlen(str), obj);
 }
 
 int
@@ -630,160 +682,131 @@ error:
 }
 
 static int
-parse_string(char* str, uint64_t* index, struct json** obj)
+json_parse(char* str, uint64_t len, struct json** obj)
 {
-   enum json_type type;
-   struct json* o = NULL;
-   uint64_t idx = *index;
-   char ch = str[idx];
-   char* key = NULL;
-   uint64_t len = strlen(str);
+   struct json_parser parser;
+   int ret;
 
-   if (ch == '{')
-   {
-      type = JSONItem;
-   }
-   else if (ch == '[')
+   *obj = NULL;
+
+   if (len < 2)
    {
-      type = JSONArray;
+      return 1;
    }
-   else
+
+   memset(&parser, 0, sizeof(struct json_parser));
+   parser.str = str;
+   parser.len = len;
+
+   ret = parse_string(&parser, obj);
+
+   free(parser.key.data);
+   free(parser.value.data);
+
+   return ret;
+}
+
+static int
+parse_string(struct json_parser* parser, struct json** obj)
+{
+   struct json* o = NULL;
+   struct json* val = NULL;
+   char* key = NULL;
+   char close;
+   bool first = true;
+
+   if (parser->idx >= parser->len || (parser->str[parser->idx] != '{' && parser->str[parser->idx] != '['))
    {
       goto error;
    }
-   idx++;
+   close = parser->str[parser->idx] == '{' ? '}' : ']';
+   parser->idx++;
+
    pgmoneta_json_create(&o);
-   if (type == JSONItem)
+
+   while (true)
    {
-      while (idx < len)
+      skip_whitespace(parser);
+      if (parser->idx == parser->len)
       {
-         // pre key
-         while (idx < len && isspace(str[idx]))
-         {
-            idx++;
-         }
-         if (idx == len)
-         {
-            goto error;
-         }
-         if (str[idx] == ',')
-         {
-            idx++;
-         }
-         else if (str[idx] == '}')
-         {
-            idx++;
-            break;
-         }
-         else if (!(str[idx] == '"' && o->type == JSONUnknown))
+         goto error;
+      }
+      if (parser->str[parser->idx] == close)
+      {
+         parser->idx++;
+         break;
+      }
+      if (!first)
+      {
+         // every entry but the first one must follow a comma
+         if (parser->str[parser->idx] != ',')
          {
-            // if it's first key we won't see comma, otherwise we must see comma
             goto error;
          }
-         while (idx < len && str[idx] != '"')
-         {
-            idx++;
-         }
-         if (idx == len)
+         parser->idx++;
+         skip_whitespace(parser);
+         if (parser->idx == parser->len)
          {
             goto error;
          }
-         idx++;
-         // The key
-         while (idx < len && str[idx] != '"')
-         {
-            char ec_ch;
-            // handle escape character
-            if (str[idx] == '\\')
-            {
-               if (handle_escape_char(str, &idx, len, &ec_ch))
-               {
-                  goto error;
-               }
-               key = pgmoneta_append_char(key, ec_ch);
-               continue;
-            }
+      }
+      first = false;
 
-            key = pgmoneta_append_char(key, str[idx++]);
-         }
-         if (idx == len || key == NULL)
-         {
-            goto error;
-         }
-         // The lands between
-         while (idx < len && (str[idx] == '"' || isspace(str[idx])))
-         {
-            idx++;
-         }
-         if (idx == len || str[idx] != ':')
+      if (close == '}')
+      {
+         // The key
+         if (parser->str[parser->idx] != '"' || parse_quoted(parser, &parser->key) || parser->key.length == 0)
          {
             goto error;
          }
-         while (idx < len && (str[idx] == ':' || isspace(str[idx])))
-         {
-            idx++;
-         }
-         if (idx == len)
+         skip_whitespace(parser);
+         if (parser->idx == parser->len || parser->str[parser->idx] != ':')
          {
             goto error;
          }
-         // The value
-         if (fill_value(str, key, &idx, o))
+         parser->idx++;
+         skip_whitespace(parser);
+         if (parser->idx == parser->len)
          {
             goto error;
          }
-         free(key);
-         key = NULL;
+         key = parser->key.data;
       }
-   }
-   else
-   {
-      while (idx < len)
+
+      // The value, a nested object reuses the key buffer so it gets a copy of the key
+      if (parser->str[parser->idx] == '{' || parser->str[parser->idx] == '[')
       {
-         while (idx < len && isspace(str[idx]))
-         {
-            idx++;
-         }
-         if (idx == len)
-         {
-            goto error;
-         }
-         if (str[idx] == ',')
-         {
-            idx++;
-         }
-         else if (str[idx] == ']')
-         {
-            idx++;
-            break;
-         }
-         else if (!(value_start(str[idx]) && o->type == JSONUnknown))
-         {
-            // if it's first key we won't see comma, otherwise we must see comma
-            goto error;
-         }
-         while (idx < len && !value_start(str[idx]))
-         {
-            idx++;
-         }
-         if (idx == len)
+         if (key != NULL)
          {
-            goto error;
+            key = strdup(key);
+            if (key == NULL)
+            {
+               goto error;
+            }
          }
-
-         if (fill_value(str, key, &idx, o))
+         if (parse_string(parser, &val))
          {
             goto error;
          }
+         json_add(o, key, (uintptr_t)val, ValueJSON);
+         val = NULL;
+         free(key);
+      }
+      else if (fill_value(parser, key, o))
+      {
+         goto error;
       }
+      key = NULL;
    }
 
-   *index = idx;
    *obj = o;
    return 0;
 error:
+   if (key != NULL && key != parser->key.data)
+   {
+      free(key);
+   }
    pgmoneta_json_destroy(o);
-   free(key);
    return 1;
 }
 
@@ -801,139 +824,178 @@ json_add(struct json* obj, char* key, uintptr_t val, enum value_type type)
    return pgmoneta_json_put(obj, key, val, type);
 }
 
-static bool
-value_start(char ch)
+static void
+skip_whitespace(struct json_parser* parser)
 {
-   return (isdigit(ch) || ch == '-' || ch == '+') || // number
-          (ch == '[') || // array
-          (ch == '{') || // item
-          (ch == '"' || ch == 'n') || // string or null string
-          (ch == 't' || ch == 'f'); // potential boolean value
+   while (parser->idx < parser->len && isspace((unsigned char)parser->str[parser->idx]))
+   {
+      parser->idx++;
+   }
 }
 
 static int
-fill_value(char* str, char* key, uint64_t* index, struct json* o)
+token_append(struct json_token* token, char* s, size_t length)
 {
-   uint64_t idx = *index;
-   uint64_t len = strlen(str);
-   if (str[idx] == '"')
+   size_t capacity;
+   char* data = NULL;
+
+   if (token->length + length + 1 > token->capacity)
+   {
+      capacity = token->capacity > 0 ? token->capacity : 64;
+      while (token->length + length + 1 > capacity)
+      {
+         capacity *= 2;
+      }
+      data = (char*)realloc(token->data, capacity);
+      if (data == NULL)
+      {
+         return 1;
+      }
+      token->data = data;
+      token->capacity = capacity;
+   }
+
+   memcpy(token->data + token->length, s, length);
+   token->length += length;
+   token->data[token->length] = '\0';
+
+   return 0;
+}
+
+static int
+parse_quoted(struct json_parser* parser, struct json_token* token)
+{
+   char* start = NULL;
+   char* end = parser->str + parser->len;
+   char* quote = NULL;
+   char* escape = NULL;
+   char ec_ch;
+
+   token->length = 0;
+   if (token_append(token, "", 0))
+   {
+      return 1;
+   }
+
+   // skip the opening quote
+   parser->idx++;
+
+   // memchr scans whole words at a time, so the plain runs between escapes
+   // are copied in one go instead of byte by byte
+   while (true)
    {
-      char* val = NULL;
-      idx++;
-      while (idx < len && str[idx] != '"')
+      start = parser->str + parser->idx;
+      if (quote == NULL || quote < start)
       {
-         char ec_ch;
-         if (str[idx] == '\\')
+         quote = memchr(start, '"', end - start);
+         if (quote == NULL)
          {
-            if (handle_escape_char(str, &idx, len, &ec_ch))
-            {
-               goto error;
-            }
-            val = pgmoneta_append_char(val, ec_ch);
-            continue;
+            return 1;
          }
-
-         val = pgmoneta_append_char(val, str[idx++]);
       }
-      if (idx == len)
+      escape = memchr(start, '\\', quote - start);
+      if (escape == NULL)
       {
-         goto error;
+         if (token_append(token, start, quote - start))
+         {
+            return 1;
+         }
+         parser->idx += quote - start + 1;
+         return 0;
       }
-      if (val == NULL)
+      if (token_append(token, start, escape - start))
       {
-         json_add(o, key, (uintptr_t)"", ValueString);
+         return 1;
       }
-      else
+      parser->idx += escape - start;
+      if (handle_escape_char(parser->str, &parser->idx, parser->len, &ec_ch) ||
+          token_append(token, &ec_ch, 1))
+      {
+         return 1;
+      }
+   }
+}
+
+static int
+fill_value(struct json_parser* parser, char* key, struct json* o)
+{
+   uint64_t start = parser->idx;
+   char* end = NULL;
+   char ch = parser->str[parser->idx];
+
+   if (ch == '"')
+   {
+      if (parse_quoted(parser, &parser->value))
       {
-         json_add(o, key, (uintptr_t)val, ValueString);
+         goto error;
       }
-      idx++;
-      free(val);
+      json_add(o, key, (uintptr_t)parser->value.data, ValueString);
    }
-   else if (str[idx] == '-' || str[idx] == '+' || isdigit(str[idx]))
+   else if (ch == '-' || ch == '+' || isdigit((unsigned char)ch))
    {
       bool has_digit = false;
-      char* val_str = NULL;
-      while (idx < len && (isdigit(str[idx]) || str[idx] == '.' || str[idx] == '-' || str[idx] == '+'))
+      while (parser->idx < parser->len)
       {
-         if (str[idx] == '.')
+         ch = parser->str[parser->idx];
+         if (ch == '.' || ch == 'e' || ch == 'E')
          {
             has_digit = true;
          }
-         val_str = pgmoneta_append_char(val_str, str[idx++]);
+         else if (!isdigit((unsigned char)ch) && ch != '-' && ch != '+')
+         {
+            break;
+         }
+         parser->idx++;
       }
+      errno = 0;
       if (has_digit)
       {
-         double val = 0.;
-         if (sscanf(val_str, "%lf", &val) != 1)
+         double val = strtod(parser->str + start, &end);
+         if (end != parser->str + parser->idx || errno != 0)
          {
-            free(val_str);
             goto error;
          }
          json_add(o, key, pgmoneta_value_from_double(val), ValueDouble);
-         free(val_str);
       }
       else
       {
-         int64_t val = 0;
-         if (sscanf(val_str, "%" PRId64, &val) != 1)
+         int64_t val = strtoll(parser->str + start, &end, 10);
+         if (end != parser->str + parser->idx || errno != 0)
          {
-            free(val_str);
             goto error;
          }
          json_add(o, key, (uintptr_t)val, ValueInt64);
-         free(val_str);
       }
    }
-   else if (str[idx] == '{')
+   else if (ch == 'n' || ch == 't' || ch == 'f')
    {
-      struct json* val = NULL;
-      if (parse_string(str, &idx, &val))
+      uint64_t length;
+      while (parser->idx < parser->len && parser->str[parser->idx] >= 'a' && parser->str[parser->idx] <= 'z')
       {
-         goto error;
-      }
-      json_add(o, key, (uintptr_t)val, ValueJSON);
-   }
-   else if (str[idx] == '[')
-   {
-      struct json* val = NULL;
-      if (parse_string(str, &idx, &val))
-      {
-         goto error;
-      }
-      json_add(o, key, (uintptr_t)val, ValueJSON);
-   }
-   else if (str[idx] == 'n' || str[idx] == 't' || str[idx] == 'f')
-   {
-      char* val = NULL;
-      while (idx < len && str[idx] >= 'a' && str[idx] <= 'z')
-      {
-         val = pgmoneta_append_char(val, str[idx++]);
+         parser->idx++;
       }
-      if (pgmoneta_compare_string(val, "null"))
+      length = parser->idx - start;
+      if (length == 4 && !strncmp(parser->str + start, "null", 4))
       {
          json_add(o, key, 0, ValueString);
       }
-      else if (pgmoneta_compare_string(val, "true"))
+      else if (length == 4 && !strncmp(parser->str + start, "true", 4))
       {
          json_add(o, key, true, ValueBool);
       }
-      else if (pgmoneta_compare_string(val, "false"))
+      else if (length == 5 && !strncmp(parser->str + start, "false", 5))
       {
          json_add(o, key, false, ValueBool);
       }
       else
       {
-         free(val);
          goto error;
       }
-      free(val);
    }
    else
    {
       goto error;
    }
-   *index = idx;
    return 0;
 error:
    return 1;
@@ -1115,16 +1177,40 @@ json_fast_forward_value(struct json_reader* reader, char ch)
    {
       has_next = json_next_char(reader, &ch);
    }
-   if (ch == '{')
+   if (ch == '{' || ch == '[')
    {
+      char open = ch;
+      char close = ch == '{' ? '}' : ']';
       int count = 1;
-      while (json_next_char(reader, &ch) && count != 0)
+      bool in_string = false;
+      bool escaped = false;
+      // stop right at the closing bracket, and don't count brackets inside of strings
+      while (count != 0 && json_next_char(reader, &ch))
       {
-         if (ch == '{')
+         if (in_string)
+         {
+            if (escaped)
+            {
+               escaped = false;
+            }
+            else if (ch == '\\')
+            {
+               escaped = true;
+            }
+            else if (ch == '"')
+            {
+               in_string = false;
+            }
+         }
+         else if (ch == '"')
+         {
+            in_string = true;
+         }
+         else if (ch == open)
          {
             count++;
          }
-         else if (ch == '}')
+         else if (ch == close)
          {
             count--;
          }
@@ -1136,49 +1222,34 @@ json_fast_forward_value(struct json_reader* reader, char ch)
    }
    else if (ch == '"')
    {
-      while (json_next_char(reader, &ch))
+      bool escaped = false;
+      bool closed = false;
+      while (!closed && json_next_char(reader, &ch))
       {
-         if (ch == '"')
+         if (escaped)
          {
-            break;
+            escaped = false;
          }
-      }
-      if (ch != '"')
-      {
-         goto error;
-      }
-   }
-   else if (ch == '[')
-   {
-      int count = 1;
-      while (json_next_char(reader, &ch) && count != 0)
-      {
-         if (ch == '[')
+         else if (ch == '\\')
          {
-            count++;
+            escaped = true;
          }
-         else if (ch == ']')
+         else if (ch == '"')
          {
-            count--;
+            closed = true;
          }
       }
-      if (count != 0)
+      if (!closed)
       {
          goto error;
       }
    }
    else if (isdigit(ch))
    {
-      while (json_next_char(reader, &ch))
-      {
-         if (!isdigit(ch) && ch != '.')
-         {
-            break;
-         }
-      }
-      if (isdigit(ch) || ch == '.')
+      // peek so the character after the number is left for the caller
+      while (json_peek_next_char(reader, &ch) && (isdigit(ch) || ch == '.'))
       {
-         goto error;
+         json_next_char(reader, &ch);
       }
    }
    else
@@ -1195,7 +1266,8 @@ static int
 json_stream_parse_item(struct json_reader* reader, struct json** item)
 {
    struct json* i = NULL;
-   char* key = NULL;
+   struct json_token key = {0};
+   struct json_token str = {0};
    char ch = 0;
    pgmoneta_json_create(&i);
    if (reader->state != ItemStart)
@@ -1209,7 +1281,10 @@ json_stream_parse_item(struct json_reader* reader, struct json** item)
       {
          if (reader->state == KeyStart)
          {
-            key = pgmoneta_append_char(key, ch);
+            if (token_append(&key, &ch, 1))
+            {
+               goto error;
+            }
          }
          continue;
       }
@@ -1248,7 +1323,7 @@ json_stream_parse_item(struct json_reader* reader, struct json** item)
       }
       else if (reader->state == ValueStart)
       {
-         if (key == NULL)
+         if (key.length == 0)
          {
             goto error;
          }
@@ -1258,34 +1333,35 @@ json_stream_parse_item(struct json_reader* reader, struct json** item)
             {
                goto error;
             }
-            free(key);
-            key = NULL;
+            key.length = 0;
          }
          else if (ch == '"' || isdigit(ch))
          {
             if (ch == '"')
             {
-               char* str = NULL;
+               str.length = 0;
                while (json_next_char(reader, &ch) && ch != '"')
                {
-                  str = pgmoneta_append_char(str, ch);
+                  if (token_append(&str, &ch, 1))
+                  {
+                     goto error;
+                  }
                }
                if (ch != '"')
                {
-                  free(str);
                   goto error;
                }
-               pgmoneta_json_put(i, key, (uintptr_t)str, ValueString);
-               free(key);
-               free(str);
-               key = NULL;
-               str = NULL;
+               pgmoneta_json_put(i, key.data, (uintptr_t)(str.length > 0 ? str.data : NULL), ValueString);
+               key.length = 0;
             }
             else
             {
                bool has_digit_point = false;
-               char* str = NULL;
-               str = pgmoneta_append_char(str, ch);
+               str.length = 0;
+               if (token_append(&str, &ch, 1))
+               {
+                  goto error;
+               }
                // peek first in case we advance to non-digit accidentally
                while (json_peek_next_char(reader, &ch) && (isdigit(ch) || ch == '.'))
                {
@@ -1293,7 +1369,6 @@ json_stream_parse_item(struct json_reader* reader, struct json** item)
                   {
                      if (has_digit_point)
                      {
-                        free(str);
                         goto error;
                      }
                      else
@@ -1301,41 +1376,36 @@ json_stream_parse_item(struct json_reader* reader, struct json** item)
                         has_digit_point = true;
                      }
                   }
-                  str = pgmoneta_append_char(str, ch);
+                  if (token_append(&str, &ch, 1))
+                  {
+                     goto error;
+                  }
                   // advance
                   json_next_char(reader, &ch);
                }
                if (isdigit(ch) || ch == '.')
                {
-                  free(str);
                   goto error;
                }
                if (has_digit_point)
                {
                   float num = 0;
-                  if (sscanf(str, "%f", &num) != 1)
+                  if (sscanf(str.data, "%f", &num) != 1)
                   {
-                     free(str);
                      goto error;
                   }
-                  free(str);
-                  str = NULL;
-                  pgmoneta_json_put(i, key, (uintptr_t)num, ValueFloat);
+                  pgmoneta_json_put(i, key.data, (uintptr_t)num, ValueFloat);
                }
                else
                {
                   int64_t num = 0;
-                  if (sscanf(str, "%" PRId64, &num) != 1)
+                  if (sscanf(str.data, "%" PRId64, &num) != 1)
                   {
-                     free(str);
                      goto error;
                   }
-                  free(str);
-                  str = NULL;
-                  pgmoneta_json_put(i, key, (uintptr_t)num, ValueInt64);
+                  pgmoneta_json_put(i, key.data, (uintptr_t)num, ValueInt64);
                }
-               free(key);
-               key = NULL;
+               key.length = 0;
             }
          }
          else
@@ -1361,11 +1431,14 @@ json_stream_parse_item(struct json_reader* reader, struct json** item)
          goto error;
       }
    }
+   free(key.data);
+   free(str.data);
    *item = i;
    return 0;
 error:
    pgmoneta_json_destroy(i);
-   free(key);
+   free(key.data);
+   free(str.data);
    return 1;
 }
 
@@ -1373,8 +1446,12 @@ int
 pgmoneta_json_read_file(char* path, struct json** obj)
 {
    FILE* file = NULL;
-   char buf[DEFAULT_BUFFER_SIZE];
+   struct stat st;
    char* str = NULL;
+   char* n = NULL;
+   size_t capacity = 0;
+   size_t length = 0;
+   size_t r;
    struct json* j = NULL;
 
    *obj = NULL;
@@ -1392,16 +1469,39 @@ pgmoneta_json_read_file(char* path, struct json** obj)
       goto error;
    }
 
-   memset(buf, 0, sizeof(buf));
+   // read the file in one go and parse it in place
+   if (fstat(fileno(file), &st) == 0 && st.st_size > 0)
+   {
+      capacity = (size_t)st.st_size + 1;
+   }
+   else
+   {
+      capacity = DEFAULT_BUFFER_SIZE;
+   }
+
+   str = (char*)malloc(capacity);
+   if (str == NULL)
+   {
+      goto error;
+   }
 
-   // save the last one for ending so that we get to use append
-   while (fread(buf, 1, DEFAULT_BUFFER_SIZE - 1, file) > 0)
+   while ((r = fread(str + length, 1, capacity - length - 1, file)) > 0)
    {
-      str = pgmoneta_append(str, buf);
-      memset(buf, 0, sizeof(buf));
+      length += r;
+      if (length == capacity - 1)
+      {
+         n = (char*)realloc(str, capacity * 2);
+         if (n == NULL)
+         {
+            goto error;
+         }
+         str = n;
+         capacity *= 2;
+      }
    }
+   str[length] = '\0';
 
-   if (pgmoneta_json_parse_string(str, &j))
+   if (json_parse(str, length, &j))
    {
       pgmoneta_log_error("Failed to parse json file %s", path);
       goto error;
@@ -1431,7 +1531,7 @@ int
 pgmoneta_json_write_file(char* path, struct json* obj)
 {
    FILE* file = NULL;
-   char* str = NULL;
+   struct json_writer* writer = NULL;
 
    if (path == NULL || obj == NULL)
    {
@@ -1445,24 +1545,27 @@ pgmoneta_json_write_file(char* path, struct json* obj)
       goto error;
    }
 
-   str = pgmoneta_json_to_string(obj, FORMAT_JSON, NULL, 0);
-   if (str == NULL)
+   if (pgmoneta_json_writer_create(file, &writer))
    {
       goto error;
    }
 
-   if (fputs(str, file) == EOF)
+   if (pgmoneta_json_writer_write(writer, obj, FORMAT_JSON, NULL, 0) || pgmoneta_json_writer_flush(writer))
    {
       pgmoneta_log_error("Failed to write json file %s", path);
       goto error;
    }
 
-   free(str);
-   fclose(file);
+   pgmoneta_json_writer_destroy(writer);
+   if (fclose(file) == EOF)
+   {
+      pgmoneta_log_error("Failed to write json file %s", path);
+      return 1;
+   }
    return 0;
 
 error:
-   free(str);
+   pgmoneta_json_writer_destroy(writer);
    if (file != NULL)
    {
       fclose(file);
@@ -1470,6 +1573,103 @@ error:
    return 1;
 }
 
+int
+pgmoneta_json_writer_create(FILE* file, struct json_writer** writer)
+{
+   struct json_writer* w = NULL;
+
+   *writer = NULL;
+
+   w = (struct json_writer*)malloc(sizeof(struct json_writer));
+   if (w == NULL)
+   {
+      return 1;
+   }
+
+   w->size = 0;
+   w->capacity = 1024;
+   w->file = file;
+   w->buffer = (char*)malloc(w->capacity);
+   if (w->buffer == NULL)
+   {
+      free(w);
+      return 1;
+   }
+
+   *writer = w;
+   return 0;
+}
+
+int
+pgmoneta_json_writer_write(struct json_writer* writer, struct json* object, int32_t format, char* tag, int indent)
+{
+   if (writer == NULL || (format != FORMAT_JSON && format != FORMAT_JSON_COMPACT))
+   {
+      return 1;
+   }
+
+   if (writer_indent(writer, tag, indent))
+   {
+      return 1;
+   }
+
+   return write_json(writer, object, format, indent);
+}
+
+int
+pgmoneta_json_writer_flush(struct json_writer* writer)
+{
+   if (writer == NULL)
+   {
+      return 1;
+   }
+
+   if (writer->file == NULL || writer->size == 0)
+   {
+      return 0;
+   }
+
+   if (fwrite(writer->buffer, 1, writer->size, writer->file) != writer->size)
+   {
+      return 1;
+   }
+   writer->size = 0;
+
+   return 0;
+}
+
+char*
+pgmoneta_json_writer_take(struct json_writer* writer)
+{
+   char* str = NULL;
+
+   if (writer == NULL || writer->buffer == NULL)
+   {
+      return NULL;
+   }
+
+   writer->buffer[writer->size] = '\0';
+   str = writer->buffer;
+
+   writer->buffer = NULL;
+   writer->size = 0;
+   writer->capacity = 0;
+
+   return str;
+}
+
+void
+pgmoneta_json_writer_destroy(struct json_writer* writer)
+{
+   if (writer == NULL)
+   {
+      return;
+   }
+
+   free(writer->buffer);
+   free(writer);
+}
+
 static bool
 type_allowed(enum value_type type)
 {
@@ -1506,3 +1706,345 @@ array_to_string(struct json* array, int32_t format, char* tag, int indent)
 {
    return pgmoneta_deque_to_string(array->elements, format, tag, indent);
 }
+
+static int
+writer_append(struct json_writer* writer, char* s, size_t length)
+{
+   size_t capacity;
+   char* buffer = NULL;
+
+   if (writer->buffer == NULL)
+   {
+      return 1;
+   }
+
+   // Keep a byte for the terminator that pgmoneta_json_writer_take adds
+   if (writer->size + length + 1 > writer->capacity)
+   {
+      if (writer->file != NULL && writer->size > 0)
+      {
+         if (pgmoneta_json_writer_flush(writer))
+         {
+            return 1;
+         }
+      }
+
+      capacity = writer->capacity;
+      while (writer->size + length + 1 > capacity)
+      {
+         capacity *= 2;
+      }
+
+      if (capacity != writer->capacity)
+      {
+         buffer = (char*)realloc(writer->buffer, capacity);
+         if (buffer == NULL)
+         {
+            return 1;
+         }
+         writer->buffer = buffer;
+         writer->capacity = capacity;
+      }
+   }
+
+   memcpy(writer->buffer + writer->size, s, length);
+   writer->size += length;
+
+   if (writer->file != NULL && writer->size >= JSON_WRITER_FLUSH_SIZE)
+   {
+      return pgmoneta_json_writer_flush(writer);
+   }
+
+   return 0;
+}
+
+static int
+writer_puts(struct json_writer* writer, char* s)
+{
+   return writer_append(writer, s, strlen(s));
+}
+
+static int
+writer_indent(struct json_writer* writer, char* tag, int indent)
+{
+   static char spaces[] = "                                ";
+
+   while (indent > 0)
+   {
+      int n = indent < (int)(sizeof(spaces) - 1) ? indent : (int)(sizeof(spaces) - 1);
+      if (writer_append(writer, spaces, n))
+      {
+         return 1;
+      }
+      indent -= n;
+   }
+
+   if (tag != NULL)
+   {
+      return writer_puts(writer, tag);
+   }
+
+   return 0;
+}
+
+static int
+writer_string(struct json_writer* writer, char* s)
+{
+   size_t start = 0;
+   size_t i = 0;
+   char escaped[2] = {'\\', 0};
+
+   if (writer_append(writer, "\"", 1))
+   {
+      return 1;
+   }
+
+   // Copy runs of plain characters in one go, escaping like pgmoneta_escape_string
+   for (i = 0; s[i] != '\0'; i++)
+   {
+      switch (s[i])
+      {
+         case '\\':
+         case '\"':
+            escaped[1] = s[i];
+            break;
+         case '\n':
+            escaped[1] = 'n';
+            break;
+         case '\t':
+            escaped[1] = 't';
+            break;
+         case '\r':
+            escaped[1] = 'r';
+            break;
+         default:
+            continue;
+      }
+      if (writer_append(writer, s + start, i - start) || writer_append(writer, escaped, 2))
+      {
+         return 1;
+      }
+      start = i + 1;
+   }
+
+   if (writer_append(writer, s + start, i - start))
+   {
+      return 1;
+   }
+
+   return writer_append(writer, "\"", 1);
+}
+
+static int
+write_value(struct json_writer* writer, struct value* value, int32_t format, int indent)
+{
+   char buf[MISC_LENGTH];
+   char* str = NULL;
+   int ret;
+
+   memset(buf, 0, MISC_LENGTH);
+
+   switch (value->type)
+   {
+      case ValueInt8:
+         snprintf(buf, MISC_LENGTH, "%" PRId8, (int8_t)value->data);
+         break;
+      case ValueUInt8:
+         snprintf(buf, MISC_LENGTH, "%" PRIu8, (uint8_t)value->data);
+         break;
+      case ValueInt16:
+         snprintf(buf, MISC_LENGTH, "%" PRId16, (int16_t)value->data);
+         break;
+      case ValueUInt16:
+         snprintf(buf, MISC_LENGTH, "%" PRIu16, (uint16_t)value->data);
+         break;
+      case ValueInt32:
+         snprintf(buf, MISC_LENGTH, "%" PRId32, (int32_t)value->data);
+         break;
+      case ValueUInt32:
+         snprintf(buf, MISC_LENGTH, "%" PRIu32, (uint32_t)value->data);
+         break;
+      case ValueInt64:
+         snprintf(buf, MISC_LENGTH, "%" PRId64, (int64_t)value->data);
+         break;
+      case ValueUInt64:
+         snprintf(buf, MISC_LENGTH, "%" PRIu64, (uint64_t)value->data);
+         break;
+      case ValueFloat:
+         snprintf(buf, MISC_LENGTH, "%f", pgmoneta_value_to_float(value->data));
+         break;
+      case ValueDouble:
+         snprintf(buf, MISC_LENGTH, "%f", pgmoneta_value_to_double(value->data));
+         break;
+      case ValueBool:
+         snprintf(buf, MISC_LENGTH, "%s", (bool)value->data ? "true" : "false");
+         break;
+      case ValueChar:
+         snprintf(buf, MISC_LENGTH, "'%c'", (char)value->data);
+         break;
+      case ValueString:
+      case ValueBASE64:
+      case ValueStringRef:
+      case ValueBASE64Ref:
+         if ((char*)value->data == NULL)
+         {
+            return writer_puts(writer, "null");
+         }
+         return writer_string(writer, (char*)value->data);
+      case ValueJSON:
+      case ValueJSONRef:
+         return write_json(writer, (struct json*)value->data, format, indent);
+      case ValueDeque:
+      case ValueDequeRef:
+         return write_deque(writer, (struct deque*)value->data, format, indent);
+      case ValueART:
+      case ValueARTRef:
+         return write_art(writer, (struct art*)value->data, format, indent);
+      default:
+         str = pgmoneta_value_to_string(value, format, NULL, 0);
+         if (str == NULL)
+         {
+            return 0;
+         }
+         ret = writer_puts(writer, str);
+         free(str);
+         return ret;
+   }
+
+   return writer_puts(writer, buf);
+}
+
+static int
+write_json(struct json_writer* writer, struct json* object, int32_t format, int indent)
+{
+   if (object == NULL || object->type == JSONUnknown || object->elements == NULL)
+   {
+      return writer_puts(writer, "{}");
+   }
+   if (object->type == JSONArray)
+   {
+      return write_deque(writer, (struct deque*)object->elements, format, indent);
+   }
+   return write_art(writer, (struct art*)object->elements, format, indent);
+}
+
+static int
+write_art(struct json_writer* writer, struct art* t, int32_t format, int indent)
+{
+   struct write_param param;
+
+   if (t == NULL || t->size == 0)
+   {
+      return writer_puts(writer, "{}");
+   }
+
+   param.writer = writer;
+   param.format = format;
+   param.indent = indent + INDENT_PER_LEVEL;
+   param.cnt = 0;
+   param.size = t->size;
+
+   if (writer_puts(writer, format == FORMAT_JSON ? "{\n" : "{"))
+   {
+      return 1;
+   }
+   if (pgmoneta_art_iterate(t, write_art_cb, &param))
+   {
+      return 1;
+   }
+   if (format == FORMAT_JSON && writer_indent(writer, NULL, indent))
+   {
+      return 1;
+   }
+   return writer_puts(writer, "}");
+}
+
+static int
+write_art_cb(void* param, const char* key, struct value* value)
+{
+   struct write_param* p = (struct write_param*)param;
+   bool pretty = p->format == FORMAT_JSON;
+   bool has_next;
+
+   p->cnt++;
+   has_next = p->cnt < p->size;
+
+   if (writer_indent(p->writer, NULL, pretty ? p->indent : 0) ||
+       writer_string(p->writer, (char*)key) ||
+       writer_puts(p->writer, pretty ? ": " : ":") ||
+       write_value(p->writer, value, p->format, pretty ? p->indent : 0))
+   {
+      return 1;
+   }
+
+   if (pretty)
+   {
+      return writer_puts(p->writer, has_next ? ",\n" : "\n");
+   }
+   return has_next ? writer_puts(p->writer, ",") : 0;
+}
+
+static int
+write_deque(struct json_writer* writer, struct deque* deque, int32_t format, int indent)
+{
+   struct deque_iterator* iter = NULL;
+   bool pretty = format == FORMAT_JSON;
+   int next_indent = pretty ? indent + INDENT_PER_LEVEL : 0;
+
+   if (deque == NULL || pgmoneta_deque_empty(deque))
+   {
+      return writer_puts(writer, "[]");
+   }
+
+   if (pgmoneta_deque_iterator_create(deque, &iter))
+   {
+      return 1;
+   }
+
+   if (writer_puts(writer, pretty ? "[\n" : "["))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_deque_iterator_next(iter))
+   {
+      if (writer_indent(writer, NULL, next_indent))
+      {
+         goto error;
+      }
+      if (iter->tag != NULL)
+      {
+         if (writer_puts(writer, iter->tag) || writer_puts(writer, pretty ? ": " : ":"))
+         {
+            goto error;
+         }
+      }
+      if (write_value(writer, iter->value, format, next_indent))
+      {
+         goto error;
+      }
+      if (pgmoneta_deque_iterator_has_next(iter))
+      {
+         if (writer_puts(writer, pretty ? ",\n" : ","))
+         {
+            goto error;
+         }
+      }
+      else if (pretty && writer_puts(writer, "\n"))
+      {
+         goto error;
+      }
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+
+   if (pretty && writer_indent(writer, NULL, indent))
+   {
+      return 1;
+   }
+   return writer_puts(writer, "]");
+
+error:
+   pgmoneta_deque_iterator_destroy(iter);
+   return 1;
+}
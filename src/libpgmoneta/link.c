@@ -36,16 +36,20 @@
 
 /* system */
 #include <dirent.h>
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 static void do_link(struct worker_input* wi);
+static int relink_plan(char* prefix, char* to, struct workers* workers);
 static void do_relink(struct worker_input* wi);
 static void do_comparefiles(struct worker_input* wi);
 static char* trim_suffix(char* str);
+static bool link_sample(char* path, int percentage);
 
 int
 pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* changed, struct art* added, struct workers* workers)
@@ -152,8 +156,21 @@ error:
 static void
 do_link(struct worker_input* wi)
 {
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
    if (pgmoneta_exists(wi->to))
    {
+      // the manifests decide, a sample of the files is compared to catch collisions
+      if (config->link_verify > 0 && link_sample(wi->from, config->link_verify) &&
+          !pgmoneta_compare_files(wi->from, wi->to))
+      {
+         pgmoneta_log_debug("Link: %s differs from %s", wi->from, wi->to);
+         free(wi);
+         return;
+      }
+
       if (pgmoneta_exists(wi->from))
       {
          pgmoneta_delete_file(wi->from, NULL);
@@ -175,37 +192,46 @@ do_link(struct worker_input* wi)
 int
 pgmoneta_relink(char* from, char* to, struct workers* workers)
 {
-   DIR* from_dir = opendir(from);
-   DIR* to_dir = opendir(to);
-   char* from_entry = NULL;
-   char* to_entry = NULL;
-   struct dirent* entry;
-   struct stat statbuf;
+   char* prefix = NULL;
+   int ret;
 
-   if (from_dir == NULL)
+   // the links of the newer backup are absolute paths into the deleted backup
+   prefix = pgmoneta_append(prefix, from);
+   if (!pgmoneta_ends_with(prefix, "/"))
    {
-      goto error;
+      prefix = pgmoneta_append(prefix, "/");
    }
 
+   ret = relink_plan(prefix, to, workers);
+
+   free(prefix);
+
+   return ret;
+}
+
+static int
+relink_plan(char* prefix, char* to, struct workers* workers)
+{
+   DIR* to_dir = NULL;
+   char* to_entry = NULL;
+   char* link = NULL;
+   struct dirent* entry;
+   struct stat statbuf;
+   unsigned char type;
+
+   to_dir = opendir(to);
    if (to_dir == NULL)
    {
       goto error;
    }
 
-   while ((entry = readdir(from_dir)))
+   while ((entry = readdir(to_dir)))
    {
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
       {
          continue;
       }
 
-      from_entry = pgmoneta_append(from_entry, from);
-      if (!pgmoneta_ends_with(from, "/"))
-      {
-         from_entry = pgmoneta_append(from_entry, "/");
-      }
-      from_entry = pgmoneta_append(from_entry, entry->d_name);
-
       to_entry = pgmoneta_append(to_entry, to);
       if (!pgmoneta_ends_with(to, "/"))
       {
@@ -213,20 +239,37 @@ pgmoneta_relink(char* from, char* to, struct workers* workers)
       }
       to_entry = pgmoneta_append(to_entry, entry->d_name);
 
-      if (!lstat(from_entry, &statbuf))
+      type = entry->d_type;
+      if (type == DT_UNKNOWN)
       {
-         if (S_ISDIR(statbuf.st_mode))
+         if (lstat(to_entry, &statbuf))
          {
-#ifdef DEBUG
-            pgmoneta_log_trace("FILETRACKER | %s | %s | %s | %s |", from_entry, to_entry, "Dir ", "Dir ");
-#endif
-            pgmoneta_relink(from_entry, to_entry, workers);
+            free(to_entry);
+            to_entry = NULL;
+            continue;
          }
-         else
+
+         type = S_ISDIR(statbuf.st_mode) ? DT_DIR : (S_ISLNK(statbuf.st_mode) ? DT_LNK : DT_REG);
+      }
+
+      if (type == DT_DIR)
+      {
+         relink_plan(prefix, to_entry, workers);
+      }
+      else if (type == DT_LNK)
+      {
+         link = pgmoneta_get_symlink(to_entry);
+
+         // only the files whose link goes away with the deleted backup
+         if (link != NULL && pgmoneta_starts_with(link, prefix))
          {
             struct worker_input* wi = NULL;
 
-            if (pgmoneta_create_worker_input(NULL, from_entry, to_entry, 0, workers, &wi))
+#ifdef DEBUG
+            pgmoneta_log_trace("FILETRACKER | %s | %s | %s | %s |", link, to_entry, "File", "Syml");
+#endif
+
+            if (pgmoneta_create_worker_input(NULL, link, to_entry, 0, workers, &wi))
             {
                goto error;
             }
@@ -237,47 +280,38 @@ pgmoneta_relink(char* from, char* to, struct workers* workers)
                {
                   pgmoneta_workers_add(workers, do_relink, wi);
                }
+               else
+               {
+                  free(wi);
+               }
             }
             else
             {
                do_relink(wi);
             }
          }
+
+         free(link);
+         link = NULL;
       }
 
-      free(from_entry);
       free(to_entry);
-
-      from_entry = NULL;
       to_entry = NULL;
    }
 
-   if (from_dir != NULL)
-   {
-      closedir(from_dir);
-   }
-
-   if (to_dir != NULL)
-   {
-      closedir(to_dir);
-   }
+   closedir(to_dir);
 
    return 0;
 
 error:
 
-   if (from_dir != NULL)
-   {
-      closedir(from_dir);
-   }
-
    if (to_dir != NULL)
    {
       closedir(to_dir);
    }
 
-   free(from_entry);
    free(to_entry);
+   free(link);
 
    return 1;
 }
@@ -286,67 +320,52 @@ static void
 do_relink(struct worker_input* wi)
 {
    char* link = NULL;
+   struct stat statbuf;
 
-#ifdef DEBUG
-   if (!pgmoneta_exists(wi->from))
+   if (lstat(wi->from, &statbuf))
    {
-      pgmoneta_log_trace("FILETRACKER | Unk  | %s |", wi->from);
+      pgmoneta_log_debug("do_relink: %s -> %s (%s)", wi->from, wi->to, strerror(errno));
+      errno = 0;
+      free(wi);
+      return;
    }
 
-   if (!pgmoneta_exists(wi->to))
+   if (S_ISLNK(statbuf.st_mode))
    {
-      pgmoneta_log_trace("FILETRACKER | Unk  | %s |", wi->to);
-   }
-#endif
+      link = pgmoneta_get_symlink(wi->from);
 
-   if (pgmoneta_is_symlink(wi->to))
-   {
-      if (pgmoneta_is_file(wi->from))
+      if (link != NULL)
       {
+         pgmoneta_delete_file(wi->to, NULL);
+         pgmoneta_symlink_file(wi->to, link);
 #ifdef DEBUG
-         pgmoneta_log_trace("FILETRACKER | %s | %s | %s | %s |", wi->from, wi->to,
-                            pgmoneta_is_symlink(wi->from) ? "Syml" : "File", pgmoneta_is_symlink(wi->to) ? "Syml" : "File");
-
-         pgmoneta_log_trace("FILETRACKER | Del  | %s |", wi->to);
-         pgmoneta_log_trace("FILETRACKER | Copy | %s | %s |", wi->from, wi->to);
+         pgmoneta_log_trace("FILETRACKER | Lnk | %s | %s |", wi->to, pgmoneta_is_symlink_valid(wi->to) ? "Yes " : "No  ");
 #endif
-         if (pgmoneta_exists(wi->to))
-         {
-            pgmoneta_delete_file(wi->to, NULL);
-         }
-         else
-         {
-            pgmoneta_log_debug("%s doesn't exists", wi->to);
-         }
-         pgmoneta_copy_file(wi->from, wi->to, wi->workers);
+
+         free(link);
       }
       else
       {
-         link = pgmoneta_get_symlink(wi->from);
-
-         if (link != NULL)
-         {
-            if (pgmoneta_exists(wi->to))
-            {
-               pgmoneta_delete_file(wi->to, NULL);
-            }
-            else
-            {
-               pgmoneta_log_debug("%s doesn't exists", wi->to);
-            }
-            pgmoneta_symlink_file(wi->to, link);
-#ifdef DEBUG
-            pgmoneta_log_trace("FILETRACKER | Lnk | %s | %s |", wi->to, pgmoneta_is_symlink_valid(wi->to) ? "Yes " : "No  ");
-            pgmoneta_log_trace("FILETRACKER | Lnk | %s | %s |", link, pgmoneta_is_symlink_valid(link) ? "Yes " : "No  ");
-#endif
-
-            free(link);
-         }
-         else
+         pgmoneta_log_debug("%s -> %s", wi->from, wi->to);
+      }
+   }
+   else if (S_ISREG(statbuf.st_mode))
+   {
+      // the deleted backup gives its file away, which also replaces the link atomically
+      if (rename(wi->from, wi->to))
+      {
+         if (errno != EXDEV)
          {
-            pgmoneta_log_debug("%s -> %s", wi->from, wi->to);
+            pgmoneta_log_debug("do_relink: %s -> %s (%s)", wi->from, wi->to, strerror(errno));
          }
+         errno = 0;
+
+         pgmoneta_delete_file(wi->to, NULL);
+         pgmoneta_copy_file(wi->from, wi->to, NULL);
       }
+#ifdef DEBUG
+      pgmoneta_log_trace("FILETRACKER | Move | %s | %s |", wi->from, wi->to);
+#endif
    }
    else
    {
@@ -511,3 +530,22 @@ trim_suffix(char* str)
    memcpy(res, str, len - 1);
    return res;
 }
+
+static bool
+link_sample(char* path, int percentage)
+{
+   uint32_t hash = 5381;
+
+   if (percentage >= 100)
+   {
+      return true;
+   }
+
+   // deterministic, so the same files are sampled for every backup
+   for (char* c = path; *c != '\0'; c++)
+   {
+      hash = ((hash << 5) + hash) + (unsigned char)*c;
+   }
+
+   return (int)(hash % 100) < percentage;
+}
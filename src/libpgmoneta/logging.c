@@ -44,6 +44,7 @@
 #include <unistd.h>
 
 #define LINE_LENGTH 32
+#define LOG_MESSAGE_LENGTH 1024
 
 FILE* log_file;
 
@@ -320,6 +321,16 @@ void
 pgmoneta_log_line(int level, char* file, int line, char* fmt, ...)
 {
    signed char isfree;
+   char buf[256];
+   char stack_message[LOG_MESSAGE_LENGTH];
+   char* message = NULL;
+   char* heap_message = NULL;
+   int length;
+   int n;
+   va_list vl;
+   struct tm tm;
+   time_t t;
+   char* filename;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -349,54 +360,129 @@ pgmoneta_log_line(int level, char* file, int line, char* fmt, ...)
             break;
       }
 
-retry:
-      isfree = STATE_FREE;
-
-      if (atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
+      if (config->log_type == PGMONETA_LOGGING_TYPE_SYSLOG)
       {
-         char buf[256];
-         va_list vl;
-         struct tm* tm;
-         time_t t;
-         char* filename;
-
-         t = time(NULL);
-         tm = localtime(&t);
+         /* syslog serializes the messages itself */
+         va_start(vl, fmt);
 
-         filename = strrchr(file, '/');
-         if (filename != NULL)
-         {
-            filename = filename + 1;
-         }
-         else
+         switch (level)
          {
-            filename = file;
+            case PGMONETA_LOGGING_LEVEL_DEBUG5:
+               vsyslog(LOG_DEBUG, fmt, vl);
+               break;
+            case PGMONETA_LOGGING_LEVEL_DEBUG1:
+               vsyslog(LOG_DEBUG, fmt, vl);
+               break;
+            case PGMONETA_LOGGING_LEVEL_INFO:
+               vsyslog(LOG_INFO, fmt, vl);
+               break;
+            case PGMONETA_LOGGING_LEVEL_WARN:
+               vsyslog(LOG_WARNING, fmt, vl);
+               break;
+            case PGMONETA_LOGGING_LEVEL_ERROR:
+               vsyslog(LOG_ERR, fmt, vl);
+               break;
+            case PGMONETA_LOGGING_LEVEL_FATAL:
+               vsyslog(LOG_CRIT, fmt, vl);
+               break;
+            default:
+               vsyslog(LOG_INFO, fmt, vl);
+               break;
          }
 
-         if (strlen(config->log_line_prefix) == 0)
+         va_end(vl);
+
+         return;
+      }
+
+      if (config->log_type != PGMONETA_LOGGING_TYPE_CONSOLE && config->log_type != PGMONETA_LOGGING_TYPE_FILE)
+      {
+         return;
+      }
+
+      t = time(NULL);
+      localtime_r(&t, &tm);
+
+      filename = strrchr(file, '/');
+      if (filename != NULL)
+      {
+         filename = filename + 1;
+      }
+      else
+      {
+         filename = file;
+      }
+
+      if (strlen(config->log_line_prefix) == 0)
+      {
+         memcpy(config->log_line_prefix, PGMONETA_LOGGING_DEFAULT_LOG_LINE_PREFIX, strlen(PGMONETA_LOGGING_DEFAULT_LOG_LINE_PREFIX));
+      }
+
+      buf[strftime(buf, sizeof(buf), config->log_line_prefix, &tm)] = '\0';
+
+      /* The line is formatted before the lock is taken, so the lock only covers the write */
+      message = &stack_message[0];
+
+      if (config->log_type == PGMONETA_LOGGING_TYPE_CONSOLE)
+      {
+         length = snprintf(message, LOG_MESSAGE_LENGTH, "%s %s%-5s\x1b[0m \x1b[90m%s:%d\x1b[0m ",
+                           buf, colors[level - 1], levels[level - 1], filename, line);
+      }
+      else
+      {
+         length = snprintf(message, LOG_MESSAGE_LENGTH, "%s %-5s %s:%d ",
+                           buf, levels[level - 1], filename, line);
+      }
+
+      if (length < 0 || length >= LOG_MESSAGE_LENGTH)
+      {
+         return;
+      }
+
+      va_start(vl, fmt);
+      n = vsnprintf(message + length, LOG_MESSAGE_LENGTH - length, fmt, vl);
+      va_end(vl);
+
+      if (n < 0)
+      {
+         return;
+      }
+
+      if (length + n + 1 >= LOG_MESSAGE_LENGTH)
+      {
+         heap_message = (char*)malloc(length + n + 2);
+
+         if (heap_message == NULL)
          {
-            memcpy(config->log_line_prefix, PGMONETA_LOGGING_DEFAULT_LOG_LINE_PREFIX, strlen(PGMONETA_LOGGING_DEFAULT_LOG_LINE_PREFIX));
+            return;
          }
 
+         memcpy(heap_message, message, length);
+
          va_start(vl, fmt);
+         vsnprintf(heap_message + length, n + 1, fmt, vl);
+         va_end(vl);
 
+         message = heap_message;
+      }
+
+      length += n;
+      message[length++] = '\n';
+      message[length] = '\0';
+
+retry:
+      isfree = STATE_FREE;
+
+      if (atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
+      {
          if (config->log_type == PGMONETA_LOGGING_TYPE_CONSOLE)
          {
-            buf[strftime(buf, sizeof(buf), config->log_line_prefix, tm)] = '\0';
-            fprintf(stdout, "%s %s%-5s\x1b[0m \x1b[90m%s:%d\x1b[0m ",
-                    buf, colors[level - 1], levels[level - 1],
-                    filename, line);
-            vfprintf(stdout, fmt, vl);
-            fprintf(stdout, "\n");
+            fwrite(message, 1, length, stdout);
             fflush(stdout);
          }
-         else if (config->log_type == PGMONETA_LOGGING_TYPE_FILE)
+         else if (log_file != NULL)
          {
-            buf[strftime(buf, sizeof(buf), config->log_line_prefix, tm)] = '\0';
-            fprintf(log_file, "%s %-5s %s:%d ",
-                    buf, levels[level - 1], filename, line);
-            vfprintf(log_file, fmt, vl);
-            fprintf(log_file, "\n");
+            fwrite(message, 1, length, log_file);
             fflush(log_file);
 
             if (log_rotation_required())
@@ -404,40 +490,13 @@ retry:
                log_file_rotate();
             }
          }
-         else if (config->log_type == PGMONETA_LOGGING_TYPE_SYSLOG)
-         {
-            switch (level)
-            {
-               case PGMONETA_LOGGING_LEVEL_DEBUG5:
-                  vsyslog(LOG_DEBUG, fmt, vl);
-                  break;
-               case PGMONETA_LOGGING_LEVEL_DEBUG1:
-                  vsyslog(LOG_DEBUG, fmt, vl);
-                  break;
-               case PGMONETA_LOGGING_LEVEL_INFO:
-                  vsyslog(LOG_INFO, fmt, vl);
-                  break;
-               case PGMONETA_LOGGING_LEVEL_WARN:
-                  vsyslog(LOG_WARNING, fmt, vl);
-                  break;
-               case PGMONETA_LOGGING_LEVEL_ERROR:
-                  vsyslog(LOG_ERR, fmt, vl);
-                  break;
-               case PGMONETA_LOGGING_LEVEL_FATAL:
-                  vsyslog(LOG_CRIT, fmt, vl);
-                  break;
-               default:
-                  vsyslog(LOG_INFO, fmt, vl);
-                  break;
-            }
-         }
-
-         va_end(vl);
 
          atomic_store(&config->log_lock, STATE_FREE);
       }
       else
-        SLEEP_AND_GOTO(1000000L,retry)
+        SLEEP_AND_GOTO(10000L,retry)
+
+      free(heap_message);
    }
 }
 
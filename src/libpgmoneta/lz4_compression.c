@@ -29,16 +29,22 @@
  */
 
 /* pgmoneta */
+#include <compression.h>
+#include <io.h>
 #include <logging.h>
 #include <lz4.h>
 #include <lz4_compression.h>
 #include <management.h>
 #include <pgmoneta.h>
 #include <utils.h>
+#include <wal.h>
+#include <walk.h>
 #include <workers.h>
 
 /* system */
 #include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,129 +52,178 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-static int lz4_compress(char* from, char* to);
+#define BUFFER_LENGTH   8192
+#define LZ4_SPLIT_SIZE  (64 * 1024 * 1024)
+#define LZ4_INDEX_MAGIC 0x184D2A5B
+
+/** @struct lz4_index
+ * Defines the block index of a file that was compressed as independent parts. The
+ * compressed and the uncompressed offset of each part is kept, and of the end
+ */
+struct lz4_index
+{
+   struct worker_split split; /**< The parts */
+   int64_t* offsets;          /**< The offsets, two per part and two for the end */
+};
+
+static int lz4_compress(char* from, char* to, int acceleration);
+static int lz4_compress_range(char* from, off_t offset, size_t length, int acceleration, char* to);
+static int lz4_split(char* directory, char* from, char* to, size_t size, struct workers* workers);
+static int lz4_join(char* from, char* to, int number_of_parts, size_t size);
 static int lz4_decompress(char* from, char* to);
+static int lz4_decompress_range(char* from, off_t offset, size_t length, char* to, off_t out_offset);
+static int lz4_index_read(char* from, struct lz4_index** index);
+static int lz4_split_decompress(char* directory, char* from, char* to, struct lz4_index* index, struct workers* workers);
+static LZ4_stream_t* lz4_stream(void);
+static void lz4_free_stream(void* stream);
 
 static void do_lz4_compress(struct worker_input* wi);
+static void do_lz4_compress_part(struct worker_input* wi);
 static void do_lz4_decompress(struct worker_input* wi);
+static void do_lz4_decompress_part(struct worker_input* wi);
+static int lz4_data_entry(struct walk_entry* entry, void* arg);
 
 int
-pgmoneta_lz4c_data(char* directory, struct workers* workers)
+pgmoneta_lz4c_data(char* directory, char* manifest, struct workers* workers)
+{
+   return pgmoneta_walk_manifest(directory, manifest, 0, workers != NULL ? workers->number_of_workers : 1, lz4_data_entry, workers);
+}
+
+static int
+lz4_data_entry(struct walk_entry* entry, void* arg)
 {
-   char* from = NULL;
    char* to = NULL;
-   DIR* dir;
    struct worker_input* wi = NULL;
-   struct dirent* entry;
+   struct workers* workers = (struct workers*)arg;
 
-   if (!(dir = opendir(directory)))
+   if (pgmoneta_ends_with(entry->name, "backup_manifest"))
    {
-      goto error;
+      return WALK_SKIP;
    }
 
-   while ((entry = readdir(dir)) != NULL)
+   if (entry->type != WALK_FILE || pgmoneta_ends_with(entry->name, "backup_label"))
    {
-      if (pgmoneta_ends_with(entry->d_name, "backup_manifest"))
-      {
-         continue;
-      }
-
-      if (entry->d_type == DT_DIR)
-      {
-         char path[1024];
+      return WALK_CONTINUE;
+   }
 
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
+   if (pgmoneta_compression_incompressible(entry->path))
+   {
+      return WALK_CONTINUE;
+   }
 
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+   to = pgmoneta_append(to, entry->path);
+   to = pgmoneta_append(to, ".lz4");
 
-         pgmoneta_lz4c_data(path, workers);
+   // large files are compressed as independent parts in parallel
+   if (workers != NULL && pgmoneta_get_file_size(entry->path) > LZ4_SPLIT_SIZE)
+   {
+      if (lz4_split(entry->directory, entry->path, to, pgmoneta_get_file_size(entry->path), workers))
+      {
+         goto error;
       }
-      else if (entry->d_type == DT_REG)
+   }
+   else if (!pgmoneta_create_worker_input(entry->directory, entry->path, to, 0, workers, &wi))
+   {
+      if (workers != NULL)
       {
-         if (pgmoneta_ends_with(entry->d_name, "backup_label"))
+         if (workers->outcome)
          {
-            continue;
+            pgmoneta_workers_add(workers, do_lz4_compress, wi);
          }
-
-         from = pgmoneta_append(from, directory);
-         from = pgmoneta_append(from, "/");
-         from = pgmoneta_append(from, entry->d_name);
-
-         to = pgmoneta_append(to, directory);
-         to = pgmoneta_append(to, "/");
-         to = pgmoneta_append(to, entry->d_name);
-         to = pgmoneta_append(to, ".lz4");
-
-         if (!pgmoneta_create_worker_input(directory, from, to, 0, workers, &wi))
-         {
-            if (workers != NULL)
-            {
-               if (workers->outcome)
-               {
-                  pgmoneta_workers_add(workers, do_lz4_compress, wi);
-               }
-            }
-            else
-            {
-               do_lz4_compress(wi);
-            }
-         }
-         else
-         {
-            goto error;
-         }
-
-         free(from);
-         free(to);
-
-         from = NULL;
-         to = NULL;
+      }
+      else
+      {
+         do_lz4_compress(wi);
       }
    }
+   else
+   {
+      goto error;
+   }
 
-   closedir(dir);
-
-   free(from);
    free(to);
 
-   return 0;
+   return WALK_CONTINUE;
 
 error:
 
-   if (dir != NULL)
-   {
-      closedir(dir);
-   }
-
-   free(from);
    free(to);
 
-   return 1;
+   return WALK_STOP;
 }
 
 static void
 do_lz4_compress(struct worker_input* wi)
 {
+   int level;
+   size_t size;
+
    if (pgmoneta_exists(wi->from))
    {
-      if (lz4_compress(wi->from, wi->to))
+      // a lower level is a higher acceleration
+      level = pgmoneta_compression_adaptive_level(LZ4_ADAPTIVE_MAXIMUM);
+      size = pgmoneta_get_file_size(wi->from);
+
+      if (lz4_compress(wi->from, wi->to, 1 << (LZ4_ADAPTIVE_MAXIMUM - level)))
       {
          pgmoneta_log_error("LZ4: Could not compress %s", wi->from);
       }
       else
       {
          pgmoneta_delete_file(wi->from, NULL);
+         pgmoneta_compression_adaptive_update(size);
       }
    }
 
    free(wi);
 }
 
+static void
+do_lz4_compress_part(struct worker_input* wi)
+{
+   char part[MAX_PATH];
+   struct worker_split* split = wi->split;
+
+   snprintf(part, sizeof(part), "%s.%d", wi->to, (int)(wi->offset / LZ4_SPLIT_SIZE));
+
+   if (lz4_compress_range(wi->from, wi->offset, wi->length, wi->level, part))
+   {
+      pgmoneta_log_error("LZ4: Could not compress %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&split->failed, true);
+   }
+   else
+   {
+      pgmoneta_compression_adaptive_update(wi->length);
+   }
+
+   // the last part to finish puts the file together
+   if (atomic_fetch_sub(&split->remaining, 1) == 1)
+   {
+      if (atomic_load(&split->failed) ||
+          lz4_join(wi->from, wi->to, split->number_of_parts, pgmoneta_get_file_size(wi->from)))
+      {
+         for (int i = 0; i < split->number_of_parts; i++)
+         {
+            snprintf(part, sizeof(part), "%s.%d", wi->to, i);
+            if (pgmoneta_exists(part))
+            {
+               pgmoneta_delete_file(part, NULL);
+            }
+         }
+
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      free(split);
+   }
+
+   free(wi);
+}
+
 void
-pgmoneta_lz4c_wal(char* directory)
+pgmoneta_lz4c_wal(int server, char* directory)
 {
    char* from = NULL;
    char* to = NULL;
@@ -205,11 +260,14 @@ pgmoneta_lz4c_wal(char* directory)
          to = pgmoneta_append(to, entry->d_name);
          to = pgmoneta_append(to, ".lz4");
 
-         lz4_compress(from, to);
+         lz4_compress(from, to, 1);
 
          if (pgmoneta_exists(from))
          {
-            pgmoneta_delete_file(from, NULL);
+            if (pgmoneta_wal_recycle(directory, from))
+            {
+               pgmoneta_delete_file(from, NULL);
+            }
          }
          else
          {
@@ -255,7 +313,7 @@ pgmoneta_lz4c_tablespaces(char* root, struct workers* workers)
 
          snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
 
-         pgmoneta_lz4c_data(path, workers);
+         pgmoneta_lz4c_data(path, NULL, workers);
       }
    }
 
@@ -269,6 +327,7 @@ pgmoneta_lz4d_data(char* directory, struct workers* workers)
    char* to = NULL;
    char* name = NULL;
    DIR* dir;
+   struct lz4_index* index = NULL;
    struct worker_input* wi = NULL;
    struct dirent* entry;
 
@@ -312,7 +371,16 @@ pgmoneta_lz4d_data(char* directory, struct workers* workers)
          to = pgmoneta_append(to, "/");
          to = pgmoneta_append(to, name);
 
-         if (!pgmoneta_create_worker_input(directory, from, to, 0, workers, &wi))
+         // a file with a block index is decompressed as its parts in parallel
+         if (workers != NULL && !lz4_index_read(from, &index))
+         {
+            if (lz4_split_decompress(directory, from, to, index, workers))
+            {
+               goto error;
+            }
+            index = NULL;
+         }
+         else if (!pgmoneta_create_worker_input(directory, from, to, 0, workers, &wi))
          {
             if (workers != NULL)
             {
@@ -381,6 +449,42 @@ do_lz4_decompress(struct worker_input* wi)
    free(wi);
 }
 
+static void
+do_lz4_decompress_part(struct worker_input* wi)
+{
+   struct lz4_index* index = (struct lz4_index*)wi->argument;
+   struct worker_split* split = wi->split;
+   int part = wi->level;
+
+   if (lz4_decompress_range(wi->from, wi->offset, wi->length, wi->to, (off_t)index->offsets[2 * part + 1]))
+   {
+      pgmoneta_log_error("LZ4: Could not decompress %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&split->failed, true);
+   }
+
+   // the last part to finish removes the compressed file, or the partial result
+   if (atomic_fetch_sub(&split->remaining, 1) == 1)
+   {
+      if (atomic_load(&split->failed))
+      {
+         pgmoneta_log_error("LZ4: Could not decompress %s", wi->from);
+         pgmoneta_delete_file(wi->to, NULL);
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      else
+      {
+         pgmoneta_delete_file(wi->from, NULL);
+      }
+      free(index->offsets);
+      free(index);
+   }
+
+   free(wi);
+}
+
 void
 pgmoneta_lz4d_request(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
@@ -589,7 +693,7 @@ pgmoneta_lz4c_file(char* from, char* to)
 {
    if (pgmoneta_exists(from))
    {
-      if (lz4_compress(from, to))
+      if (lz4_compress(from, to, 1))
       {
          pgmoneta_log_error("LZ4: Could not compress %s", from);
       }
@@ -603,19 +707,30 @@ pgmoneta_lz4c_file(char* from, char* to)
 }
 
 static int
-lz4_compress(char* from, char* to)
+lz4_compress(char* from, char* to, int acceleration)
+{
+   return lz4_compress_range(from, 0, 0, acceleration, to);
+}
+
+static int
+lz4_compress_range(char* from, off_t offset, size_t length, int acceleration, char* to)
 {
    LZ4_stream_t* lz4Stream = NULL;
-   FILE* fin = NULL;
+   struct io_reader* fin = NULL;
    FILE* fout = NULL;
    char buffIn[2][BLOCK_BYTES];
    int buffInIndex = 0;
    char buffOut[LZ4_COMPRESSBOUND(BLOCK_BYTES)];
+   size_t remaining = length;
+   size_t n;
 
-   lz4Stream = LZ4_createStream();
-   fin = fopen(from, "rb");
+   lz4Stream = lz4_stream();
+   if (lz4Stream == NULL)
+   {
+      goto error;
+   }
 
-   if (fin == NULL)
+   if (pgmoneta_io_reader_open(from, offset, length, &fin))
    {
       goto error;
    }
@@ -629,13 +744,21 @@ lz4_compress(char* from, char* to)
 
    for (;;)
    {
-      size_t read = fread(buffIn[buffInIndex], sizeof(char), BLOCK_BYTES, fin);
+      n = BLOCK_BYTES;
+      if (length > 0)
+      {
+         n = MIN(n, remaining);
+      }
+
+      size_t read = n > 0 ? pgmoneta_io_reader_read(fin, buffIn[buffInIndex], n) : 0;
       if (read == 0)
       {
          break;
       }
 
-      int compression = LZ4_compress_fast_continue(lz4Stream, buffIn[buffInIndex], buffOut, read, sizeof(buffOut), 1);
+      remaining -= MIN(remaining, read);
+
+      int compression = LZ4_compress_fast_continue(lz4Stream, buffIn[buffInIndex], buffOut, read, sizeof(buffOut), acceleration);
       if (compression <= 0)
       {
          break;
@@ -647,18 +770,26 @@ lz4_compress(char* from, char* to)
       buffInIndex = (buffInIndex + 1) % 2;
    }
 
-   fclose(fout);
-   fclose(fin);
-   LZ4_freeStream(lz4Stream);
+   if (pgmoneta_io_reader_error(fin))
+   {
+      goto error;
+   }
+
+   fflush(fout);
+   pgmoneta_io_drop(fileno(fout), true);
+
+   if (fclose(fout) != 0)
+   {
+      fout = NULL;
+      goto error;
+   }
+   pgmoneta_io_reader_close(fin);
 
    return 0;
 
 error:
 
-   if (fin != NULL)
-   {
-      fclose(fin);
-   }
+   pgmoneta_io_reader_close(fin);
 
    if (fout != NULL)
    {
@@ -668,6 +799,320 @@ error:
    return 1;
 }
 
+static int
+lz4_split(char* directory, char* from, char* to, size_t size, struct workers* workers)
+{
+   int level;
+   struct worker_split* split = NULL;
+   struct worker_input* wi = NULL;
+
+   split = (struct worker_split*)malloc(sizeof(struct worker_split));
+   if (split == NULL)
+   {
+      return 1;
+   }
+
+   split->number_of_parts = (size + LZ4_SPLIT_SIZE - 1) / LZ4_SPLIT_SIZE;
+   atomic_init(&split->remaining, split->number_of_parts);
+   atomic_init(&split->failed, false);
+
+   // a lower level is a higher acceleration
+   level = pgmoneta_compression_adaptive_level(LZ4_ADAPTIVE_MAXIMUM);
+
+   for (int i = 0; i < split->number_of_parts; i++)
+   {
+      if (pgmoneta_create_worker_input(directory, from, to, 1 << (LZ4_ADAPTIVE_MAXIMUM - level), workers, &wi))
+      {
+         // the parts that are not queued count as failed
+         atomic_store(&split->failed, true);
+         if (atomic_fetch_sub(&split->remaining, split->number_of_parts - i) == split->number_of_parts - i)
+         {
+            free(split);
+         }
+         return 1;
+      }
+
+      wi->offset = (off_t)i * LZ4_SPLIT_SIZE;
+      wi->length = MIN((size_t)LZ4_SPLIT_SIZE, size - (size_t)wi->offset);
+      wi->split = split;
+
+      pgmoneta_workers_add(workers, do_lz4_compress_part, wi);
+   }
+
+   return 0;
+}
+
+/**
+ * Put the parts of a file together, and add the block index. The blocks end with a
+ * block of size 0, followed by the offsets, the number of parts and LZ4_INDEX_MAGIC,
+ * so a reader that does not know the index stops at the end of the blocks
+ * @param from The uncompressed file
+ * @param to The compressed file
+ * @param number_of_parts The number of parts
+ * @param size The uncompressed size
+ * @return 0 upon success, otherwise 1
+ */
+static int
+lz4_join(char* from, char* to, int number_of_parts, size_t size)
+{
+   char part[MAX_PATH];
+   char buf[BUFFER_LENGTH];
+   size_t length;
+   int64_t offset = 0;
+   int32_t end = 0;
+   int32_t parts = number_of_parts;
+   uint32_t magic = LZ4_INDEX_MAGIC;
+   int64_t* offsets = NULL;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   offsets = (int64_t*)malloc(2 * (number_of_parts + 1) * sizeof(int64_t));
+   if (offsets == NULL)
+   {
+      goto error;
+   }
+
+   out = fopen(to, "wb");
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_parts; i++)
+   {
+      snprintf(part, sizeof(part), "%s.%d", to, i);
+
+      offsets[2 * i] = offset;
+      offsets[2 * i + 1] = (int64_t)i * LZ4_SPLIT_SIZE;
+
+      in = fopen(part, "rb");
+      if (in == NULL)
+      {
+         goto error;
+      }
+
+      while ((length = fread(buf, 1, sizeof(buf), in)) > 0)
+      {
+         if (fwrite(buf, 1, length, out) != length)
+         {
+            goto error;
+         }
+         offset += length;
+      }
+
+      if (ferror(in))
+      {
+         goto error;
+      }
+
+      fclose(in);
+      in = NULL;
+
+      pgmoneta_delete_file(part, NULL);
+   }
+
+   offsets[2 * number_of_parts] = offset;
+   offsets[2 * number_of_parts + 1] = (int64_t)size;
+
+   if (fwrite(&end, sizeof(end), 1, out) != 1 ||
+       fwrite(offsets, sizeof(int64_t), 2 * (number_of_parts + 1), out) != (size_t)(2 * (number_of_parts + 1)) ||
+       fwrite(&parts, sizeof(parts), 1, out) != 1 ||
+       fwrite(&magic, sizeof(magic), 1, out) != 1)
+   {
+      goto error;
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   pgmoneta_delete_file(from, NULL);
+
+   free(offsets);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("LZ4: Could not join the parts of %s", to);
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (pgmoneta_exists(to))
+   {
+      pgmoneta_delete_file(to, NULL);
+   }
+
+   free(offsets);
+
+   return 1;
+}
+
+/**
+ * Read the block index of a compressed file
+ * @param from The compressed file
+ * @param index The index
+ * @return 0 upon success, otherwise 1 when the file has no index
+ */
+static int
+lz4_index_read(char* from, struct lz4_index** index)
+{
+   int fd = -1;
+   struct stat st;
+   int32_t parts = 0;
+   uint32_t magic = 0;
+   int32_t end = -1;
+   off_t start;
+   size_t length;
+   struct lz4_index* i = NULL;
+
+   *index = NULL;
+
+   fd = open(from, O_RDONLY);
+   if (fd == -1 || fstat(fd, &st) || st.st_size < (off_t)(sizeof(end) + sizeof(parts) + sizeof(magic)))
+   {
+      goto error;
+   }
+
+   if (pread(fd, &parts, sizeof(parts), st.st_size - sizeof(magic) - sizeof(parts)) != sizeof(parts) ||
+       pread(fd, &magic, sizeof(magic), st.st_size - sizeof(magic)) != sizeof(magic) ||
+       magic != LZ4_INDEX_MAGIC || parts < 2)
+   {
+      goto error;
+   }
+
+   length = 2 * ((size_t)parts + 1) * sizeof(int64_t);
+   start = st.st_size - (off_t)(sizeof(magic) + sizeof(parts) + length + sizeof(end));
+   if (start < 0)
+   {
+      goto error;
+   }
+
+   i = (struct lz4_index*)calloc(1, sizeof(struct lz4_index));
+   if (i == NULL)
+   {
+      goto error;
+   }
+
+   i->offsets = (int64_t*)malloc(length);
+   if (i->offsets == NULL)
+   {
+      goto error;
+   }
+
+   if (pread(fd, &end, sizeof(end), start) != sizeof(end) || end != 0 ||
+       pread(fd, i->offsets, length, start + sizeof(end)) != (ssize_t)length)
+   {
+      goto error;
+   }
+
+   // the parts have to cover the blocks in order
+   if (i->offsets[0] != 0 || i->offsets[1] != 0 || i->offsets[2 * parts] != (int64_t)start)
+   {
+      goto error;
+   }
+
+   for (int p = 0; p < parts; p++)
+   {
+      if (i->offsets[2 * p + 2] <= i->offsets[2 * p] || i->offsets[2 * p + 3] <= i->offsets[2 * p + 1])
+      {
+         goto error;
+      }
+   }
+
+   i->split.number_of_parts = parts;
+   atomic_init(&i->split.remaining, parts);
+   atomic_init(&i->split.failed, false);
+
+   close(fd);
+
+   *index = i;
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   if (i != NULL)
+   {
+      free(i->offsets);
+      free(i);
+   }
+
+   return 1;
+}
+
+static int
+lz4_split_decompress(char* directory, char* from, char* to, struct lz4_index* index, struct workers* workers)
+{
+   int fd = -1;
+   int parts = index->split.number_of_parts;
+   struct worker_input* wi = NULL;
+
+   // the parts write into the file at their offsets
+   fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1 || ftruncate(fd, (off_t)index->offsets[2 * parts + 1]))
+   {
+      goto error;
+   }
+   close(fd);
+   fd = -1;
+
+   for (int i = 0; i < parts; i++)
+   {
+      if (pgmoneta_create_worker_input(directory, from, to, i, workers, &wi))
+      {
+         // the parts that are not queued count as failed
+         atomic_store(&index->split.failed, true);
+         if (atomic_fetch_sub(&index->split.remaining, parts - i) == parts - i)
+         {
+            goto error;
+         }
+         return 1;
+      }
+
+      wi->offset = (off_t)index->offsets[2 * i];
+      wi->length = (size_t)(index->offsets[2 * i + 2] - index->offsets[2 * i]);
+      wi->split = &index->split;
+      wi->argument = index;
+
+      pgmoneta_workers_add(workers, do_lz4_decompress_part, wi);
+   }
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   if (pgmoneta_exists(to))
+   {
+      pgmoneta_delete_file(to, NULL);
+   }
+
+   free(index->offsets);
+   free(index);
+
+   return 1;
+}
+
 static int
 lz4_decompress(char* from, char* to)
 {
@@ -750,6 +1195,90 @@ error:
    return 1;
 }
 
+static int
+lz4_decompress_range(char* from, off_t offset, size_t length, char* to, off_t out_offset)
+{
+   LZ4_streamDecode_t lz4StreamDecodeBody;
+   LZ4_streamDecode_t* lz4StreamDecode = NULL;
+   FILE* fin = NULL;
+   int fd = -1;
+   char buffIn[2][BLOCK_BYTES];
+   int buffInIndex = 0;
+   char buffOut[LZ4_COMPRESSBOUND(BLOCK_BYTES)];
+   size_t remaining = length;
+   int compression;
+   int decompression;
+
+   lz4StreamDecode = &lz4StreamDecodeBody;
+
+   fin = fopen(from, "rb");
+   if (fin == NULL || fseeko(fin, offset, SEEK_SET))
+   {
+      goto error;
+   }
+
+   fd = open(to, O_WRONLY);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   LZ4_setStreamDecode(lz4StreamDecode, NULL, 0);
+
+   while (remaining > 0)
+   {
+      if (remaining < sizeof(compression) || fread(&compression, 1, sizeof(compression), fin) != sizeof(compression))
+      {
+         goto error;
+      }
+      remaining -= sizeof(compression);
+
+      if (compression <= 0 || (size_t)compression > sizeof(buffOut) || (size_t)compression > remaining ||
+          fread(buffOut, 1, compression, fin) != (size_t)compression)
+      {
+         goto error;
+      }
+      remaining -= compression;
+
+      decompression = LZ4_decompress_safe_continue(lz4StreamDecode, buffOut, buffIn[buffInIndex], compression, BLOCK_BYTES);
+      if (decompression <= 0)
+      {
+         goto error;
+      }
+
+      if (pwrite(fd, buffIn[buffInIndex], decompression, out_offset) != decompression)
+      {
+         goto error;
+      }
+      out_offset += decompression;
+
+      buffInIndex = (buffInIndex + 1) % 2;
+   }
+
+   fclose(fin);
+
+   if (close(fd))
+   {
+      return 1;
+   }
+
+   return 0;
+
+error:
+
+   if (fin != NULL)
+   {
+      fclose(fin);
+   }
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
 int
 pgmoneta_lz4c_string(char* s, unsigned char** buffer, size_t* buffer_size)
 {
@@ -807,3 +1336,30 @@ pgmoneta_lz4d_string(unsigned char* compressed_buffer, size_t compressed_size, c
 
    return 0;
 }
+
+static LZ4_stream_t*
+lz4_stream(void)
+{
+   LZ4_stream_t* stream = NULL;
+
+   stream = (LZ4_stream_t*)pgmoneta_worker_context(WORKER_CONTEXT_LZ4_COMPRESS);
+   if (stream != NULL)
+   {
+      LZ4_resetStream_fast(stream);
+      return stream;
+   }
+
+   stream = LZ4_createStream();
+   if (stream != NULL)
+   {
+      pgmoneta_worker_context_set(WORKER_CONTEXT_LZ4_COMPRESS, stream, lz4_free_stream);
+   }
+
+   return stream;
+}
+
+static void
+lz4_free_stream(void* stream)
+{
+   LZ4_freeStream((LZ4_stream_t*)stream);
+}
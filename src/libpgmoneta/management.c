@@ -30,6 +30,7 @@
 #include <pgmoneta.h>
 #include <aes.h>
 #include <bzip2_compression.h>
+#include <configuration.h>
 #include <gzip_compression.h>
 #include <json.h>
 #include <logging.h>
@@ -39,6 +40,8 @@
 #include <zstandard_compression.h>
 
 /* system */
+#include <err.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <openssl/err.h>
@@ -89,8 +92,12 @@ error:
 }
 
 int
-pgmoneta_management_request_list_backup(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format)
+pgmoneta_management_request_list_backup(SSL* ssl, int socket, char* server, char* options, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   char* key = NULL;
    struct json* j = NULL;
    struct json* request = NULL;
 
@@ -106,17 +113,65 @@ pgmoneta_management_request_list_backup(SSL* ssl, int socket, char* server, uint
 
    pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)server, ValueString);
 
+   if (options != NULL)
+   {
+      copy = strdup(options);
+      if (copy == NULL)
+      {
+         goto error;
+      }
+
+      token = strtok_r(copy, ",", &saveptr);
+      while (token != NULL)
+      {
+         key = NULL;
+
+         if (pgmoneta_starts_with(token, "sort="))
+         {
+            key = MANAGEMENT_ARGUMENT_SORT;
+         }
+         else if (pgmoneta_starts_with(token, "limit="))
+         {
+            key = MANAGEMENT_ARGUMENT_LIMIT;
+         }
+         else if (pgmoneta_starts_with(token, "cursor="))
+         {
+            key = MANAGEMENT_ARGUMENT_CURSOR;
+         }
+         else if (pgmoneta_starts_with(token, "filter="))
+         {
+            key = MANAGEMENT_ARGUMENT_FILTER;
+         }
+         else if (pgmoneta_starts_with(token, "fields="))
+         {
+            key = MANAGEMENT_ARGUMENT_FIELDS;
+         }
+
+         if (key == NULL)
+         {
+            warnx("pgmoneta-cli: Unknown list-backup option %s", token);
+            goto error;
+         }
+
+         pgmoneta_json_put(request, key, (uintptr_t)(strchr(token, '=') + 1), ValueString);
+
+         token = strtok_r(NULL, ",", &saveptr);
+      }
+   }
+
    if (pgmoneta_management_write_json(ssl, socket, compression, encryption, j))
    {
       goto error;
    }
 
+   free(copy);
    pgmoneta_json_destroy(j);
 
    return 0;
 
 error:
 
+   free(copy);
    pgmoneta_json_destroy(j);
 
    return 1;
@@ -594,6 +649,151 @@ error:
    return 1;
 }
 
+int
+pgmoneta_management_request_merge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgmoneta_management_create_header(MANAGEMENT_MERGE, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)server, ValueString);
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)backup_id, ValueString);
+
+   if (pgmoneta_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(j);
+
+   return 1;
+}
+
+int
+pgmoneta_management_request_wal_fetch(SSL* ssl, int socket, char* server, char* file, char* destination, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgmoneta_management_create_header(MANAGEMENT_WAL_FETCH, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)server, ValueString);
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_FILENAME, (uintptr_t)file, ValueString);
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_DESTINATION_FILE, (uintptr_t)destination, ValueString);
+
+   if (pgmoneta_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(j);
+
+   return 1;
+}
+
+int
+pgmoneta_management_request_changes(SSL* ssl, int socket, char* server, char* backup_id, char* limit, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgmoneta_management_create_header(MANAGEMENT_CHANGES, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)server, ValueString);
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)backup_id, ValueString);
+
+   if (limit != NULL)
+   {
+      pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_LIMIT, (uintptr_t)limit, ValueString);
+   }
+
+   if (pgmoneta_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(j);
+
+   return 1;
+}
+
+int
+pgmoneta_management_request_retention(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgmoneta_management_create_header(MANAGEMENT_RETENTION, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(request, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)server, ValueString);
+
+   if (pgmoneta_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(j);
+
+   return 1;
+}
+
 int
 pgmoneta_management_request_expunge(SSL* ssl, int socket, char* server, char* backup_id, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
@@ -903,9 +1103,6 @@ pgmoneta_management_response_error(SSL* ssl, int socket, char* server, int32_t e
    int srv = -1;
    struct json* response = NULL;
    struct json* outcome = NULL;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
 
    if (pgmoneta_management_create_outcome_failure(payload, error, &outcome))
    {
@@ -914,13 +1111,7 @@ pgmoneta_management_response_error(SSL* ssl, int socket, char* server, int32_t e
 
    if (server != NULL && strlen(server) > 0)
    {
-      for (int i = 0; i < config->number_of_servers; i++)
-      {
-         if (!strcmp(server, config->servers[i].name))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
    }
 
    if (pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_RESPONSE) != 0)
@@ -1158,6 +1349,12 @@ pgmoneta_management_write_json(SSL* ssl, int socket, uint8_t compression, uint8_
    size_t encrypted_size = 0;
    size_t encoded_size = 0;
 
+   /* Operations started by the daemon itself have no client */
+   if (ssl == NULL && socket == -1)
+   {
+      return 0;
+   }
+
    s = pgmoneta_json_to_string(json, FORMAT_JSON_COMPACT, NULL, 0);
 
    if (write_uint8("pgmoneta-cli", ssl, socket, compression))
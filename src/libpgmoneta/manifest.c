@@ -35,24 +35,99 @@
 #include <manifest.h>
 #include <security.h>
 #include <utils.h>
+#include <workers.h>
 
 /* system */
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @struct manifest_diff_list
+ * Defines the files of one result set, in the sorted order of the manifests
+ */
+struct manifest_diff_list
+{
+   char** paths;          /**< The paths */
+   uintptr_t* checksums;  /**< The checksums */
+   uint64_t size;         /**< The number of files */
+   uint64_t capacity;     /**< The capacity of the arrays */
+};
+
+/** @struct manifest_diff
+ * Defines the result sets of a streaming manifest comparison
+ */
+struct manifest_diff
+{
+   struct manifest_diff_list deleted; /**< The deleted files */
+   struct manifest_diff_list changed; /**< The changed files */
+   struct manifest_diff_list added;   /**< The added files */
+   bool changes;                      /**< Was any difference found */
+};
+
+static void
+build_deque(struct deque* deque, struct csv_reader* reader, char** f, int cols);
+
+static void
+build_tree(struct art* tree, struct csv_reader* reader, char** f, int cols);
+
+static bool
+manifest_columns(int cols);
+
+static void
+manifest_value(char** f, int cols, char* value, size_t size);
+
+static bool
+manifest_equal(char* v1, char* v2);
+
+static bool
+manifest_next_row(struct csv_reader* reader, char*** row, char* value, size_t size);
+
+static int
+manifest_diff_art(int type, char* path, char* checksum, void* data);
+
+static int
+manifest_diff_list_add(struct manifest_diff_list* list, char* path, char* checksum);
+
+static struct art*
+manifest_diff_list_art(struct manifest_diff_list* list);
+
+static void
+manifest_diff_list_destroy(struct manifest_diff_list* list);
+
+static int
+manifest_listing_size_compare(const void* a, const void* b);
+
+static char*
+manifest_map_name(char* manifest);
 
 static void
-build_deque(struct deque* deque, struct csv_reader* reader, char** f);
+manifest_map_value(struct manifest_map* map, struct manifest_map_entry* entry, char* value, size_t size);
+
+static int
+manifest_map_diff(struct manifest_map* m1, struct manifest_map* m2, manifest_diff_cb callback, void* data);
 
 static void
-build_tree(struct art* tree, struct csv_reader* reader, char** f);
+do_checksum_verify(struct worker_input* wi);
+
+static int
+checksum_verify_file(struct json* file, char* path);
+
+static struct art* verify_checksums = NULL;
+
 
 int
-pgmoneta_manifest_checksum_verify(char* root)
+pgmoneta_manifest_checksum_verify(char* root, int server, struct art* checksums)
 {
    char manifest_path[MAX_PATH];
    char* key_path[1] = {"Files"};
    struct json_reader* reader = NULL;
    struct json* file = NULL;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
 
    memset(manifest_path, 0, MAX_PATH);
    if (pgmoneta_ends_with(root, "/"))
@@ -63,6 +138,9 @@ pgmoneta_manifest_checksum_verify(char* root)
    {
       snprintf(manifest_path, MAX_PATH, "%s/%s", root, "backup_manifest");
    }
+
+   verify_checksums = checksums;
+
    if (pgmoneta_json_reader_init(manifest_path, &reader))
    {
       goto error;
@@ -72,14 +150,26 @@ pgmoneta_manifest_checksum_verify(char* root)
       pgmoneta_log_error("cannot locate files array in manifest %s", manifest_path);
       goto error;
    }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+      {
+         // the largest files are hashed first so they do not end up last on a single worker
+         pgmoneta_workers_plan(workers);
+      }
+      else
+      {
+         number_of_workers = 0;
+      }
+   }
+
    while (pgmoneta_json_next_array_item(reader, &file))
    {
       char file_path[MAX_PATH];
-      size_t file_size = 0;
-      size_t file_size_manifest = 0;
-      char* hash = NULL;
-      char* algorithm = NULL;
-      char* checksum = NULL;
+      struct worker_input* wi = NULL;
+      int ret;
 
       memset(file_path, 0, MAX_PATH);
       if (pgmoneta_ends_with(root, "/"))
@@ -91,34 +181,54 @@ pgmoneta_manifest_checksum_verify(char* root)
          snprintf(file_path, MAX_PATH, "%s/%s", root, (char*)pgmoneta_json_get(file, "Path"));
       }
 
-      file_size = pgmoneta_get_file_size(file_path);
-      file_size_manifest = (int64_t)pgmoneta_json_get(file, "Size");
-      if (file_size != file_size_manifest)
+      if (number_of_workers > 0)
       {
-         pgmoneta_log_error("File size mismatch: %s, getting %lu, should be %lu", file_size, file_size_manifest);
-      }
+         if (pgmoneta_create_worker_input(NULL, file_path, NULL, 0, workers, &wi))
+         {
+            goto error;
+         }
 
-      algorithm = (char*)pgmoneta_json_get(file, "Checksum-Algorithm");
-      if (pgmoneta_create_file_hash(pgmoneta_get_hash_algorithm(algorithm), file_path, &hash))
+         wi->data = file;
+         file = NULL;
+
+         pgmoneta_workers_add(workers, do_checksum_verify, wi);
+      }
+      else
       {
-         pgmoneta_log_error("Unable to generate hash for file %s with algorithm %s", file_path, algorithm);
-         goto error;
+         ret = checksum_verify_file(file, file_path);
+         pgmoneta_json_destroy(file);
+         file = NULL;
+
+         if (ret)
+         {
+            goto error;
+         }
       }
+   }
 
-      checksum = (char*)pgmoneta_json_get(file, "Checksum");
-      if (!pgmoneta_compare_string(hash, checksum))
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
       {
-         pgmoneta_log_error("File checksum mismatch, path: %s. Getting %s, should be %s", file_path, hash, checksum);
+         goto error;
       }
-      free(hash);
-      pgmoneta_json_destroy(file);
-      file = NULL;
+      pgmoneta_workers_destroy(workers);
+      number_of_workers = 0;
    }
+
+   verify_checksums = NULL;
    pgmoneta_json_reader_close(reader);
    pgmoneta_json_destroy(file);
    return 0;
 
 error:
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+   verify_checksums = NULL;
    pgmoneta_json_reader_close(reader);
    pgmoneta_json_destroy(file);
    return 1;
@@ -145,6 +255,53 @@ pgmoneta_compare_manifests(char* old_manifest, char* new_manifest, struct art**
    *changed_files = NULL;
    *added_files = NULL;
 
+   if (pgmoneta_manifest_is_sorted(old_manifest) && pgmoneta_manifest_is_sorted(new_manifest))
+   {
+      struct manifest_diff diff;
+
+      memset(&diff, 0, sizeof(struct manifest_diff));
+
+      // the results come out in sorted order, so the trees are built in one pass at the end
+      if (pgmoneta_manifest_diff(old_manifest, new_manifest, manifest_diff_art, &diff))
+      {
+         goto sorted_error;
+      }
+
+      deleted = manifest_diff_list_art(&diff.deleted);
+      changed = manifest_diff_list_art(&diff.changed);
+      added = manifest_diff_list_art(&diff.added);
+
+      if (deleted == NULL || changed == NULL || added == NULL)
+      {
+         goto sorted_error;
+      }
+
+      if (diff.changes)
+      {
+         pgmoneta_art_insert(changed, "backup_manifest", (uintptr_t)"backup manifest", ValueString);
+      }
+
+      manifest_diff_list_destroy(&diff.deleted);
+      manifest_diff_list_destroy(&diff.changed);
+      manifest_diff_list_destroy(&diff.added);
+
+      *deleted_files = deleted;
+      *changed_files = changed;
+      *added_files = added;
+
+      return 0;
+
+sorted_error:
+      pgmoneta_art_destroy(deleted);
+      pgmoneta_art_destroy(changed);
+      pgmoneta_art_destroy(added);
+      manifest_diff_list_destroy(&diff.deleted);
+      manifest_diff_list_destroy(&diff.changed);
+      manifest_diff_list_destroy(&diff.added);
+      return 1;
+   }
+
+   // manifests of older backups are not sorted
    pgmoneta_deque_create(false, &que);
 
    pgmoneta_art_create(&deleted);
@@ -163,17 +320,17 @@ pgmoneta_compare_manifests(char* old_manifest, char* new_manifest, struct art**
 
    while (pgmoneta_csv_next_row(r1, &cols, &f1))
    {
-      if (cols != MANIFEST_COLUMN_COUNT)
+      if (!manifest_columns(cols))
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
          free(f1);
          continue;
       }
       // build left chunk into a deque
-      build_deque(que, r1, f1);
+      build_deque(que, r1, f1, cols);
       while (pgmoneta_csv_next_row(r2, &cols, &f2))
       {
-         if (cols != MANIFEST_COLUMN_COUNT)
+         if (!manifest_columns(cols))
          {
             pgmoneta_log_error("Incorrect number of columns in manifest file");
             free(f2);
@@ -181,14 +338,14 @@ pgmoneta_compare_manifests(char* old_manifest, char* new_manifest, struct art**
          }
          // build every right chunk into an ART
          pgmoneta_art_create(&tree);
-         build_tree(tree, r2, f2);
+         build_tree(tree, r2, f2, cols);
          pgmoneta_deque_iterator_create(que, &iter);
          while (pgmoneta_deque_iterator_next(iter))
          {
             checksum = (char*)pgmoneta_art_search(tree, iter->tag);
             if (checksum != NULL)
             {
-               if (!strcmp((char*)pgmoneta_value_data(iter->value), checksum))
+               if (manifest_equal((char*)pgmoneta_value_data(iter->value), checksum))
                {
                   // not changed but not deleted, remove the entry
                   pgmoneta_deque_iterator_remove(iter);
@@ -233,23 +390,23 @@ pgmoneta_compare_manifests(char* old_manifest, char* new_manifest, struct art**
 
    while (pgmoneta_csv_next_row(r2, &cols, &f2))
    {
-      if (cols != MANIFEST_COLUMN_COUNT)
+      if (!manifest_columns(cols))
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
          free(f2);
          continue;
       }
-      build_deque(que, r2, f2);
+      build_deque(que, r2, f2, cols);
       while (pgmoneta_csv_next_row(r1, &cols, &f1))
       {
-         if (cols != MANIFEST_COLUMN_COUNT)
+         if (!manifest_columns(cols))
          {
             pgmoneta_log_error("Incorrect number of columns in manifest file");
             free(f1);
             continue;
          }
          pgmoneta_art_create(&tree);
-         build_tree(tree, r1, f1);
+         build_tree(tree, r1, f1, cols);
          pgmoneta_deque_iterator_create(que, &iter);
          while (pgmoneta_deque_iterator_next(iter))
          {
@@ -307,59 +464,969 @@ error:
 }
 
 static void
-build_deque(struct deque* deque, struct csv_reader* reader, char** f)
+build_deque(struct deque* deque, struct csv_reader* reader, char** f, int cols)
 {
    char** entry = NULL;
    char* path = NULL;
-   char* checksum = NULL;
-   int cols = 0;
+   char value[MISC_LENGTH * 2];
    if (deque == NULL)
    {
       return;
    }
    path = f[MANIFEST_PATH_INDEX];
-   checksum = f[MANIFEST_CHECKSUM_INDEX];
-   pgmoneta_deque_add(deque, path, (uintptr_t)checksum, ValueString);
+   manifest_value(f, cols, value, sizeof(value));
+   pgmoneta_deque_add(deque, path, (uintptr_t)value, ValueString);
    free(f);
    while (deque->size < MANIFEST_CHUNK_SIZE && pgmoneta_csv_next_row(reader, &cols, &entry))
    {
-      if (cols != MANIFEST_COLUMN_COUNT)
+      if (!manifest_columns(cols))
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
          free(entry);
          continue;
       }
       path = entry[MANIFEST_PATH_INDEX];
-      checksum = entry[MANIFEST_CHECKSUM_INDEX];
-      pgmoneta_deque_add(deque, path, (uintptr_t)checksum, ValueString);
+      manifest_value(entry, cols, value, sizeof(value));
+      pgmoneta_deque_add(deque, path, (uintptr_t)value, ValueString);
       free(entry);
       entry = NULL;
    }
 }
 
 static void
-build_tree(struct art* tree, struct csv_reader* reader, char** f)
+build_tree(struct art* tree, struct csv_reader* reader, char** f, int cols)
 {
    char** entry = NULL;
    char* path = NULL;
-   int cols = 0;
+   char value[MISC_LENGTH * 2];
    if (tree == NULL)
    {
       return;
    }
    path = f[MANIFEST_PATH_INDEX];
-   pgmoneta_art_insert(tree, path, (uintptr_t)f[MANIFEST_CHECKSUM_INDEX], ValueString);
+   manifest_value(f, cols, value, sizeof(value));
+   pgmoneta_art_insert(tree, path, (uintptr_t)value, ValueString);
    free(f);
    while (tree->size < MANIFEST_CHUNK_SIZE && pgmoneta_csv_next_row(reader, &cols, &entry))
    {
-      if (cols != MANIFEST_COLUMN_COUNT)
+      if (!manifest_columns(cols))
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
          free(entry);
          continue;
       }
       path = entry[MANIFEST_PATH_INDEX];
-      pgmoneta_art_insert(tree, path, (uintptr_t)entry[MANIFEST_CHECKSUM_INDEX], ValueString);
+      manifest_value(entry, cols, value, sizeof(value));
+      pgmoneta_art_insert(tree, path, (uintptr_t)value, ValueString);
       free(entry);
    }
 }
+
+bool
+pgmoneta_manifest_is_sorted(char* manifest)
+{
+   struct csv_reader* reader = NULL;
+   char** row = NULL;
+   char previous[sizeof(reader->line)];
+   char value[MISC_LENGTH * 2];
+   bool first = true;
+   bool sorted = true;
+   struct manifest_map* map = NULL;
+
+   // the binary copy is only written for a sorted manifest
+   if (!pgmoneta_manifest_map_open(manifest, &map))
+   {
+      pgmoneta_manifest_map_close(map);
+      return true;
+   }
+
+   if (pgmoneta_csv_reader_init(manifest, &reader))
+   {
+      return false;
+   }
+
+   memset(previous, 0, sizeof(previous));
+
+   while (sorted && manifest_next_row(reader, &row, value, sizeof(value)))
+   {
+      if (!first && strcmp(previous, row[MANIFEST_PATH_INDEX]) >= 0)
+      {
+         sorted = false;
+      }
+
+      snprintf(previous, sizeof(previous), "%s", row[MANIFEST_PATH_INDEX]);
+      first = false;
+   }
+
+   free(row);
+   pgmoneta_csv_reader_destroy(reader);
+
+   return sorted;
+}
+
+int
+pgmoneta_manifest_diff(char* old_manifest, char* new_manifest, manifest_diff_cb callback, void* data)
+{
+   struct csv_reader* r1 = NULL;
+   struct csv_reader* r2 = NULL;
+   char** f1 = NULL;
+   char** f2 = NULL;
+   char v1[MISC_LENGTH * 2];
+   char v2[MISC_LENGTH * 2];
+   bool has1;
+   bool has2;
+   int cmp;
+   int ret;
+   struct manifest_map* m1 = NULL;
+   struct manifest_map* m2 = NULL;
+
+   if (!pgmoneta_manifest_map_open(old_manifest, &m1) && !pgmoneta_manifest_map_open(new_manifest, &m2))
+   {
+      ret = manifest_map_diff(m1, m2, callback, data);
+
+      pgmoneta_manifest_map_close(m1);
+      pgmoneta_manifest_map_close(m2);
+
+      return ret;
+   }
+   pgmoneta_manifest_map_close(m1);
+
+   if (pgmoneta_csv_reader_init(old_manifest, &r1))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_csv_reader_init(new_manifest, &r2))
+   {
+      goto error;
+   }
+
+   has1 = manifest_next_row(r1, &f1, v1, sizeof(v1));
+   has2 = manifest_next_row(r2, &f2, v2, sizeof(v2));
+
+   // merge the two sorted lists, each side only holds its current row
+   while (has1 || has2)
+   {
+      if (!has1)
+      {
+         cmp = 1;
+      }
+      else if (!has2)
+      {
+         cmp = -1;
+      }
+      else
+      {
+         cmp = strcmp(f1[MANIFEST_PATH_INDEX], f2[MANIFEST_PATH_INDEX]);
+      }
+
+      if (cmp < 0)
+      {
+         if (callback(MANIFEST_FILE_DELETED, f1[MANIFEST_PATH_INDEX], v1, data))
+         {
+            goto error;
+         }
+         has1 = manifest_next_row(r1, &f1, v1, sizeof(v1));
+      }
+      else if (cmp > 0)
+      {
+         if (callback(MANIFEST_FILE_ADDED, f2[MANIFEST_PATH_INDEX], v2, data))
+         {
+            goto error;
+         }
+         has2 = manifest_next_row(r2, &f2, v2, sizeof(v2));
+      }
+      else
+      {
+         if (!manifest_equal(v1, v2) && callback(MANIFEST_FILE_CHANGED, f1[MANIFEST_PATH_INDEX], v1, data))
+         {
+            goto error;
+         }
+         has1 = manifest_next_row(r1, &f1, v1, sizeof(v1));
+         has2 = manifest_next_row(r2, &f2, v2, sizeof(v2));
+      }
+   }
+
+   free(f1);
+   free(f2);
+   pgmoneta_csv_reader_destroy(r1);
+   pgmoneta_csv_reader_destroy(r2);
+
+   return 0;
+
+error:
+   free(f1);
+   free(f2);
+   pgmoneta_csv_reader_destroy(r1);
+   pgmoneta_csv_reader_destroy(r2);
+
+   return 1;
+}
+
+int
+pgmoneta_manifest_files(char* manifest, bool by_size, struct manifest_listing** files, int* number_of_files)
+{
+   int cols = 0;
+   int n = 0;
+   int capacity = 0;
+   char** row = NULL;
+   struct csv_reader* reader = NULL;
+   struct manifest_listing* f = NULL;
+   struct manifest_listing* tmp = NULL;
+   struct manifest_map* map = NULL;
+
+   *files = NULL;
+   *number_of_files = 0;
+
+   if (manifest != NULL && !pgmoneta_manifest_map_open(manifest, &map))
+   {
+      f = (struct manifest_listing*)calloc(map->number_of_files + 1, sizeof(struct manifest_listing));
+      if (f == NULL)
+      {
+         pgmoneta_manifest_map_close(map);
+         goto error;
+      }
+
+      for (uint32_t i = 0; i < map->number_of_files; i++)
+      {
+         f[n].path = pgmoneta_append(NULL, pgmoneta_manifest_map_path(map, &map->entries[i]));
+         f[n].size = map->entries[i].size;
+
+         if (f[n].path == NULL)
+         {
+            pgmoneta_manifest_map_close(map);
+            goto error;
+         }
+
+         n++;
+      }
+
+      pgmoneta_manifest_map_close(map);
+
+      goto sort;
+   }
+
+   if (manifest == NULL || pgmoneta_csv_reader_init(manifest, &reader))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_csv_next_row(reader, &cols, &row))
+   {
+      if (!manifest_columns(cols))
+      {
+         pgmoneta_log_error("Incorrect number of columns in manifest file");
+         goto error;
+      }
+
+      if (n == capacity)
+      {
+         capacity = capacity == 0 ? 1024 : capacity * 2;
+         tmp = (struct manifest_listing*)realloc(f, capacity * sizeof(struct manifest_listing));
+         if (tmp == NULL)
+         {
+            goto error;
+         }
+         f = tmp;
+      }
+
+      f[n].path = pgmoneta_append(NULL, row[MANIFEST_PATH_INDEX]);
+      f[n].size = cols > MANIFEST_SIZE_INDEX ? strtoll(row[MANIFEST_SIZE_INDEX], NULL, 10) : -1;
+
+      if (f[n].path == NULL)
+      {
+         goto error;
+      }
+
+      n++;
+
+      free(row);
+      row = NULL;
+   }
+
+   pgmoneta_csv_reader_destroy(reader);
+   reader = NULL;
+
+sort:
+
+   // the manifest is sorted by path already
+   if (by_size && n > 0)
+   {
+      qsort(f, n, sizeof(struct manifest_listing), manifest_listing_size_compare);
+   }
+
+   *files = f;
+   *number_of_files = n;
+
+   return 0;
+
+error:
+
+   free(row);
+   pgmoneta_manifest_files_destroy(f, n);
+
+   if (reader != NULL)
+   {
+      pgmoneta_csv_reader_destroy(reader);
+   }
+
+   return 1;
+}
+
+void
+pgmoneta_manifest_files_destroy(struct manifest_listing* files, int number_of_files)
+{
+   if (files == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i].path);
+   }
+   free(files);
+}
+
+int
+pgmoneta_manifest_map_create(char* manifest)
+{
+   int cols = 0;
+   uint32_t n = 0;
+   uint32_t capacity = 0;
+   size_t strings_size = 0;
+   size_t strings_capacity = 0;
+   size_t length;
+   char** row = NULL;
+   char* map_path = NULL;
+   char* tmp_path = NULL;
+   char* strings = NULL;
+   char* previous = NULL;
+   void* tmp = NULL;
+   FILE* file = NULL;
+   struct csv_reader* reader = NULL;
+   struct manifest_map_header header;
+   struct manifest_map_entry* entries = NULL;
+
+   if (manifest == NULL || pgmoneta_csv_reader_init(manifest, &reader))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_csv_next_row(reader, &cols, &row))
+   {
+      if (!manifest_columns(cols))
+      {
+         pgmoneta_log_error("Incorrect number of columns in manifest file");
+         goto error;
+      }
+
+      // an older manifest keeps its order, and is read as it is
+      if (previous != NULL && strcmp(previous, row[MANIFEST_PATH_INDEX]) >= 0)
+      {
+         goto unmapped;
+      }
+
+      if (n == capacity)
+      {
+         capacity = capacity == 0 ? 1024 : capacity * 2;
+         tmp = realloc(entries, capacity * sizeof(struct manifest_map_entry));
+         if (tmp == NULL)
+         {
+            goto error;
+         }
+         entries = (struct manifest_map_entry*)tmp;
+      }
+
+      length = strlen(row[MANIFEST_PATH_INDEX]) + strlen(row[MANIFEST_CHECKSUM_INDEX]) + 2;
+      if (strings_size + length > UINT32_MAX)
+      {
+         goto unmapped;
+      }
+
+      if (strings_size + length > strings_capacity)
+      {
+         strings_capacity = strings_capacity == 0 ? 65536 : strings_capacity * 2;
+         while (strings_size + length > strings_capacity)
+         {
+            strings_capacity *= 2;
+         }
+         tmp = realloc(strings, strings_capacity);
+         if (tmp == NULL)
+         {
+            goto error;
+         }
+         strings = (char*)tmp;
+      }
+
+      entries[n].path = (uint32_t)strings_size;
+      strcpy(strings + strings_size, row[MANIFEST_PATH_INDEX]);
+      strings_size += strlen(row[MANIFEST_PATH_INDEX]) + 1;
+
+      entries[n].checksum = (uint32_t)strings_size;
+      strcpy(strings + strings_size, row[MANIFEST_CHECKSUM_INDEX]);
+      strings_size += strlen(row[MANIFEST_CHECKSUM_INDEX]) + 1;
+
+      entries[n].size = cols > MANIFEST_SIZE_INDEX ? strtoll(row[MANIFEST_SIZE_INDEX], NULL, 10) : -1;
+      n++;
+
+      // the strings move when they grow, so the previous path is found again
+      previous = strings + entries[n - 1].path;
+
+      free(row);
+      row = NULL;
+   }
+
+   memset(&header, 0, sizeof(struct manifest_map_header));
+   header.magic = MANIFEST_MAP_MAGIC;
+   header.version = MANIFEST_MAP_VERSION;
+   header.number_of_files = n;
+   header.strings = (uint32_t)strings_size;
+
+   // written aside and renamed, so a reader maps either the old or the new copy
+   map_path = manifest_map_name(manifest);
+   tmp_path = pgmoneta_format_and_append(NULL, "%s.%d", map_path, (int)getpid());
+
+   file = fopen(tmp_path, "wb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fwrite(&header, sizeof(struct manifest_map_header), 1, file) != 1 ||
+       (n > 0 && fwrite(entries, sizeof(struct manifest_map_entry), n, file) != n) ||
+       (strings_size > 0 && fwrite(strings, 1, strings_size, file) != strings_size))
+   {
+      goto error;
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (rename(tmp_path, map_path))
+   {
+      goto error;
+   }
+
+   goto done;
+
+unmapped:
+
+   // a copy of an earlier version of the manifest must not be mapped instead
+   map_path = manifest_map_name(manifest);
+   remove(map_path);
+
+done:
+
+   free(row);
+   pgmoneta_csv_reader_destroy(reader);
+   free(entries);
+   free(strings);
+   free(map_path);
+   free(tmp_path);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   if (tmp_path != NULL)
+   {
+      remove(tmp_path);
+   }
+
+   free(row);
+   if (reader != NULL)
+   {
+      pgmoneta_csv_reader_destroy(reader);
+   }
+   free(entries);
+   free(strings);
+   free(map_path);
+   free(tmp_path);
+
+   return 1;
+}
+
+int
+pgmoneta_manifest_map_open(char* manifest, struct manifest_map** map)
+{
+   int fd = -1;
+   size_t expected;
+   char* map_path = NULL;
+   void* base = MAP_FAILED;
+   struct stat manifest_st;
+   struct stat map_st;
+   struct manifest_map_header* header = NULL;
+   struct manifest_map* m = NULL;
+
+   *map = NULL;
+
+   if (manifest == NULL || stat(manifest, &manifest_st))
+   {
+      goto error;
+   }
+
+   map_path = manifest_map_name(manifest);
+
+   // a manifest rewritten within the same tick of the clock as its copy is rebuilt too
+   if (stat(map_path, &map_st) ||
+       map_st.st_mtim.tv_sec < manifest_st.st_mtim.tv_sec ||
+       (map_st.st_mtim.tv_sec == manifest_st.st_mtim.tv_sec && map_st.st_mtim.tv_nsec <= manifest_st.st_mtim.tv_nsec))
+   {
+      if (pgmoneta_manifest_map_create(manifest))
+      {
+         goto error;
+      }
+   }
+
+   fd = open(map_path, O_RDONLY | O_CLOEXEC);
+   if (fd == -1 || fstat(fd, &map_st) || (size_t)map_st.st_size < sizeof(struct manifest_map_header))
+   {
+      goto error;
+   }
+
+   base = mmap(NULL, map_st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   if (base == MAP_FAILED)
+   {
+      goto error;
+   }
+
+   close(fd);
+   fd = -1;
+
+   header = (struct manifest_map_header*)base;
+   expected = sizeof(struct manifest_map_header) + (size_t)header->number_of_files * sizeof(struct manifest_map_entry) + header->strings;
+
+   if (header->magic != MANIFEST_MAP_MAGIC || header->version != MANIFEST_MAP_VERSION || expected != (size_t)map_st.st_size)
+   {
+      pgmoneta_log_debug("Manifest: Ignoring %s", map_path);
+      goto error;
+   }
+
+   m = (struct manifest_map*)calloc(1, sizeof(struct manifest_map));
+   if (m == NULL)
+   {
+      goto error;
+   }
+
+   m->base = base;
+   m->length = map_st.st_size;
+   m->number_of_files = header->number_of_files;
+   m->entries = (struct manifest_map_entry*)((char*)base + sizeof(struct manifest_map_header));
+   m->strings = (char*)(m->entries + header->number_of_files);
+
+   // the strings are only trusted when they end inside the mapping
+   if (header->strings > 0 && m->strings[header->strings - 1] != '\0')
+   {
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < m->number_of_files; i++)
+   {
+      if (m->entries[i].path >= header->strings || m->entries[i].checksum >= header->strings)
+      {
+         goto error;
+      }
+   }
+
+   free(map_path);
+
+   *map = m;
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+   if (base != MAP_FAILED)
+   {
+      munmap(base, map_st.st_size);
+   }
+   free(m);
+   free(map_path);
+
+   return 1;
+}
+
+struct manifest_map_entry*
+pgmoneta_manifest_map_find(struct manifest_map* map, char* path)
+{
+   int cmp;
+   uint32_t low = 0;
+   uint32_t high;
+   uint32_t middle;
+
+   if (map == NULL || path == NULL)
+   {
+      return NULL;
+   }
+
+   high = map->number_of_files;
+
+   while (low < high)
+   {
+      middle = low + (high - low) / 2;
+      cmp = strcmp(map->strings + map->entries[middle].path, path);
+
+      if (cmp == 0)
+      {
+         return &map->entries[middle];
+      }
+      else if (cmp < 0)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+
+   return NULL;
+}
+
+char*
+pgmoneta_manifest_map_path(struct manifest_map* map, struct manifest_map_entry* entry)
+{
+   return map->strings + entry->path;
+}
+
+char*
+pgmoneta_manifest_map_checksum(struct manifest_map* map, struct manifest_map_entry* entry)
+{
+   return map->strings + entry->checksum;
+}
+
+void
+pgmoneta_manifest_map_close(struct manifest_map* map)
+{
+   if (map == NULL)
+   {
+      return;
+   }
+
+   munmap(map->base, map->length);
+   free(map);
+}
+
+static int
+manifest_listing_size_compare(const void* a, const void* b)
+{
+   struct manifest_listing* f1 = (struct manifest_listing*)a;
+   struct manifest_listing* f2 = (struct manifest_listing*)b;
+
+   if (f1->size > f2->size)
+   {
+      return -1;
+   }
+   else if (f1->size < f2->size)
+   {
+      return 1;
+   }
+
+   return strcmp(f1->path, f2->path);
+}
+
+static bool
+manifest_next_row(struct csv_reader* reader, char*** row, char* value, size_t size)
+{
+   int cols = 0;
+
+   free(*row);
+   *row = NULL;
+
+   while (pgmoneta_csv_next_row(reader, &cols, row))
+   {
+      if (manifest_columns(cols))
+      {
+         manifest_value(*row, cols, value, size);
+         return true;
+      }
+
+      pgmoneta_log_error("Incorrect number of columns in manifest file");
+      free(*row);
+      *row = NULL;
+   }
+
+   return false;
+}
+
+static int
+manifest_diff_art(int type, char* path, char* checksum, void* data)
+{
+   struct manifest_diff* diff = (struct manifest_diff*)data;
+
+   diff->changes = true;
+
+   switch (type)
+   {
+      case MANIFEST_FILE_DELETED:
+         return manifest_diff_list_add(&diff->deleted, path, checksum);
+      case MANIFEST_FILE_CHANGED:
+         return manifest_diff_list_add(&diff->changed, path, checksum);
+      case MANIFEST_FILE_ADDED:
+         return manifest_diff_list_add(&diff->added, path, checksum);
+      default:
+         break;
+   }
+
+   return 1;
+}
+
+static int
+manifest_diff_list_add(struct manifest_diff_list* list, char* path, char* checksum)
+{
+   char** paths = NULL;
+   uintptr_t* checksums = NULL;
+   uint64_t capacity;
+
+   if (list->size == list->capacity)
+   {
+      capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+
+      paths = realloc(list->paths, capacity * sizeof(char*));
+      if (paths == NULL)
+      {
+         goto error;
+      }
+      list->paths = paths;
+
+      checksums = realloc(list->checksums, capacity * sizeof(uintptr_t));
+      if (checksums == NULL)
+      {
+         goto error;
+      }
+      list->checksums = checksums;
+
+      list->capacity = capacity;
+   }
+
+   list->paths[list->size] = strdup(path);
+   list->checksums[list->size] = (uintptr_t)strdup(checksum);
+
+   if (list->paths[list->size] == NULL || list->checksums[list->size] == 0)
+   {
+      free(list->paths[list->size]);
+      free((char*)list->checksums[list->size]);
+      goto error;
+   }
+
+   list->size++;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static struct art*
+manifest_diff_list_art(struct manifest_diff_list* list)
+{
+   struct art* tree = NULL;
+
+   if (pgmoneta_art_create_sorted(list->paths, list->checksums, ValueString, list->size, &tree))
+   {
+      return NULL;
+   }
+
+   return tree;
+}
+
+static void
+manifest_diff_list_destroy(struct manifest_diff_list* list)
+{
+   for (uint64_t i = 0; i < list->size; i++)
+   {
+      free(list->paths[i]);
+      free((char*)list->checksums[i]);
+   }
+
+   free(list->paths);
+   free(list->checksums);
+
+   memset(list, 0, sizeof(struct manifest_diff_list));
+}
+
+static void
+do_checksum_verify(struct worker_input* wi)
+{
+   if (checksum_verify_file(wi->data, wi->from))
+   {
+      wi->workers->outcome = false;
+   }
+
+   pgmoneta_json_destroy(wi->data);
+   wi->data = NULL;
+   free(wi);
+}
+
+static int
+checksum_verify_file(struct json* file, char* path)
+{
+   size_t file_size = 0;
+   size_t file_size_manifest = 0;
+   char* hash = NULL;
+   char* algorithm = NULL;
+   char* checksum = NULL;
+
+   file_size = pgmoneta_get_file_size(path);
+   file_size_manifest = (int64_t)pgmoneta_json_get(file, "Size");
+   if (file_size != file_size_manifest)
+   {
+      pgmoneta_log_error("File size mismatch: %s, getting %lu, should be %lu", path, file_size, file_size_manifest);
+   }
+
+   algorithm = (char*)pgmoneta_json_get(file, "Checksum-Algorithm");
+   if (algorithm != NULL && verify_checksums != NULL && pgmoneta_get_hash_algorithm(algorithm) == HASH_ALGORITHM_SHA256 &&
+       pgmoneta_art_search(verify_checksums, path) != 0)
+   {
+      // hashed while it was received
+      hash = pgmoneta_append(NULL, (char*)pgmoneta_art_search(verify_checksums, path));
+   }
+   else if (algorithm == NULL || pgmoneta_create_file_hash(pgmoneta_get_hash_algorithm(algorithm), path, &hash))
+   {
+      pgmoneta_log_error("Unable to generate hash for file %s with algorithm %s", path, algorithm != NULL ? algorithm : "none");
+      return 1;
+   }
+
+   checksum = (char*)pgmoneta_json_get(file, "Checksum");
+   if (!pgmoneta_compare_string(hash, checksum))
+   {
+      pgmoneta_log_error("File checksum mismatch, path: %s. Getting %s, should be %s", path, hash, checksum);
+   }
+
+   free(hash);
+   return 0;
+}
+
+static bool
+manifest_columns(int cols)
+{
+   return cols == MANIFEST_COLUMN_COUNT || cols == MANIFEST_MINIMUM_COLUMN_COUNT;
+}
+
+static void
+manifest_value(char** f, int cols, char* value, size_t size)
+{
+   // "<checksum> <size>", the size is missing in older manifests
+   if (cols > MANIFEST_SIZE_INDEX)
+   {
+      snprintf(value, size, "%s %s", f[MANIFEST_CHECKSUM_INDEX], f[MANIFEST_SIZE_INDEX]);
+   }
+   else
+   {
+      snprintf(value, size, "%s", f[MANIFEST_CHECKSUM_INDEX]);
+   }
+}
+
+static bool
+manifest_equal(char* v1, char* v2)
+{
+   char* s1 = strchr(v1, ' ');
+   char* s2 = strchr(v2, ' ');
+   size_t l1 = s1 != NULL ? (size_t)(s1 - v1) : strlen(v1);
+   size_t l2 = s2 != NULL ? (size_t)(s2 - v2) : strlen(v2);
+
+   if (l1 != l2 || strncmp(v1, v2, l1))
+   {
+      return false;
+   }
+
+   // only compare the sizes when both manifests have them
+   if (s1 != NULL && s2 != NULL && strcmp(s1, s2))
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static char*
+manifest_map_name(char* manifest)
+{
+   return pgmoneta_format_and_append(NULL, "%s%s", manifest, MANIFEST_MAP_SUFFIX);
+}
+
+static void
+manifest_map_value(struct manifest_map* map, struct manifest_map_entry* entry, char* value, size_t size)
+{
+   // the same "<checksum> <size>" as a row of the manifest
+   if (entry->size >= 0)
+   {
+      snprintf(value, size, "%s %" PRId64, pgmoneta_manifest_map_checksum(map, entry), entry->size);
+   }
+   else
+   {
+      snprintf(value, size, "%s", pgmoneta_manifest_map_checksum(map, entry));
+   }
+}
+
+static int
+manifest_map_diff(struct manifest_map* m1, struct manifest_map* m2, manifest_diff_cb callback, void* data)
+{
+   int cmp;
+   uint32_t i = 0;
+   uint32_t j = 0;
+   char v1[MISC_LENGTH * 2];
+   char v2[MISC_LENGTH * 2];
+
+   while (i < m1->number_of_files || j < m2->number_of_files)
+   {
+      if (i == m1->number_of_files)
+      {
+         cmp = 1;
+      }
+      else if (j == m2->number_of_files)
+      {
+         cmp = -1;
+      }
+      else
+      {
+         cmp = strcmp(pgmoneta_manifest_map_path(m1, &m1->entries[i]), pgmoneta_manifest_map_path(m2, &m2->entries[j]));
+      }
+
+      if (cmp < 0)
+      {
+         manifest_map_value(m1, &m1->entries[i], v1, sizeof(v1));
+         if (callback(MANIFEST_FILE_DELETED, pgmoneta_manifest_map_path(m1, &m1->entries[i]), v1, data))
+         {
+            return 1;
+         }
+         i++;
+      }
+      else if (cmp > 0)
+      {
+         manifest_map_value(m2, &m2->entries[j], v2, sizeof(v2));
+         if (callback(MANIFEST_FILE_ADDED, pgmoneta_manifest_map_path(m2, &m2->entries[j]), v2, data))
+         {
+            return 1;
+         }
+         j++;
+      }
+      else
+      {
+         manifest_map_value(m1, &m1->entries[i], v1, sizeof(v1));
+         manifest_map_value(m2, &m2->entries[j], v2, sizeof(v2));
+         if (!manifest_equal(v1, v2) && callback(MANIFEST_FILE_CHANGED, pgmoneta_manifest_map_path(m1, &m1->entries[i]), v1, data))
+         {
+            return 1;
+         }
+         i++;
+         j++;
+      }
+   }
+
+   return 0;
+}
@@ -37,11 +37,47 @@
 #ifdef DEBUG
 #include <assert.h>
 #endif
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
-static struct message* message = NULL;
-static void* data = NULL;
+#define MEMORY_POOL_MAGIC 0x706F6F6C
+
+/** @struct memory_header
+ * The header in front of a pool buffer. It takes ALIGNMENT_SIZE bytes so the
+ * buffer itself stays aligned
+ */
+struct memory_header
+{
+   uint32_t magic;             /**< The magic */
+   int32_t size_class;         /**< The size class, or -1 for a buffer larger than the largest class */
+   size_t size;                /**< The usable size */
+   size_t mapped;              /**< The length of the huge page mapping, or 0 for a heap buffer */
+   struct memory_header* next; /**< The next buffer in the thread cache */
+};
+
+/** @struct memory_cache
+ * The buffers a thread keeps for reuse
+ */
+struct memory_cache
+{
+   struct memory_header* free[MEMORY_POOL_CLASSES]; /**< The buffers per size class */
+   int count[MEMORY_POOL_CLASSES];                  /**< The number of buffers per size class */
+};
+
+static _Thread_local struct message* message = NULL;
+static _Thread_local void* data = NULL;
+static _Thread_local struct memory_cache pool_cache;
+
+static int pool_size_class(size_t size);
+static void pool_count(atomic_ullong* counter);
+#ifdef HAVE_LINUX
+static struct memory_header* pool_map(size_t size, size_t* length);
+#endif
+static void pool_release(struct memory_header* header);
 
 void
 pgmoneta_memory_init(void)
@@ -69,6 +105,12 @@ pgmoneta_memory_init(void)
 struct message*
 pgmoneta_memory_message(void)
 {
+   // threads that talk to a server set up their message on first use
+   if (message == NULL)
+   {
+      pgmoneta_memory_init();
+   }
+
 #ifdef DEBUG
    assert(message != NULL);
    assert(data != NULL);
@@ -80,10 +122,16 @@ pgmoneta_memory_message(void)
 void
 pgmoneta_memory_free(void)
 {
-#ifdef DEBUG
-   assert(message != NULL);
-   assert(data != NULL);
-#endif
+   if (message == NULL)
+   {
+      pgmoneta_memory_init();
+      return;
+   }
+
+   if (data == NULL)
+   {
+      return;
+   }
 
    memset(message, 0, sizeof(struct message));
    memset(data, 0, DEFAULT_BUFFER_SIZE);
@@ -101,6 +149,147 @@ pgmoneta_memory_destroy(void)
 
    data = NULL;
    message = NULL;
+
+   pgmoneta_memory_pool_clear();
+}
+
+void*
+pgmoneta_memory_pool_alloc(size_t size)
+{
+   int size_class;
+   size_t class_size;
+   size_t mapped = 0;
+   struct memory_header* header = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   size_class = pool_size_class(size);
+
+   if (size_class >= 0 && pool_cache.free[size_class] != NULL)
+   {
+      header = pool_cache.free[size_class];
+      pool_cache.free[size_class] = header->next;
+      pool_cache.count[size_class]--;
+      header->next = NULL;
+
+      if (config != NULL)
+      {
+         pool_count(&config->prometheus.memory_pool_allocations);
+         pool_count(&config->prometheus.memory_pool_cache_hits);
+      }
+
+      return (char*)header + ALIGNMENT_SIZE;
+   }
+
+   if (size_class >= 0)
+   {
+      class_size = (size_t)ALIGNMENT_SIZE << size_class;
+   }
+   else
+   {
+      class_size = pgmoneta_get_aligned_size(size);
+   }
+
+#ifdef HAVE_LINUX
+   if (config != NULL && config->hugepage != HUGEPAGE_OFF && ALIGNMENT_SIZE + class_size >= MEMORY_HUGEPAGE_SIZE)
+   {
+      header = pool_map(ALIGNMENT_SIZE + class_size, &mapped);
+      if (header != NULL)
+      {
+         // the rest of the last huge page is usable as well
+         class_size = mapped - ALIGNMENT_SIZE;
+      }
+   }
+#endif
+
+   if (header == NULL)
+   {
+      header = (struct memory_header*)aligned_alloc((size_t)ALIGNMENT_SIZE, ALIGNMENT_SIZE + class_size);
+      if (header == NULL)
+      {
+         return NULL;
+      }
+   }
+
+   header->magic = MEMORY_POOL_MAGIC;
+   header->size_class = size_class;
+   header->size = class_size;
+   header->mapped = mapped;
+   header->next = NULL;
+
+   if (config != NULL)
+   {
+      pool_count(&config->prometheus.memory_pool_allocations);
+      if (size_class < 0)
+      {
+         pool_count(&config->prometheus.memory_pool_oversized);
+      }
+   }
+
+   return (char*)header + ALIGNMENT_SIZE;
+}
+
+size_t
+pgmoneta_memory_pool_size(void* buffer)
+{
+   struct memory_header* header = NULL;
+
+   if (buffer == NULL)
+   {
+      return 0;
+   }
+
+   header = (struct memory_header*)((char*)buffer - ALIGNMENT_SIZE);
+
+   return header->size;
+}
+
+void
+pgmoneta_memory_pool_free(void* buffer)
+{
+   struct memory_header* header = NULL;
+   int size_class;
+
+   if (buffer == NULL)
+   {
+      return;
+   }
+
+   header = (struct memory_header*)((char*)buffer - ALIGNMENT_SIZE);
+
+#ifdef DEBUG
+   assert(header->magic == MEMORY_POOL_MAGIC);
+#endif
+
+   size_class = header->size_class;
+
+   if (size_class >= 0 && pool_cache.count[size_class] < MEMORY_POOL_DEPTH)
+   {
+      header->next = pool_cache.free[size_class];
+      pool_cache.free[size_class] = header;
+      pool_cache.count[size_class]++;
+      return;
+   }
+
+   pool_release(header);
+}
+
+void
+pgmoneta_memory_pool_clear(void)
+{
+   struct memory_header* header = NULL;
+
+   for (int i = 0; i < MEMORY_POOL_CLASSES; i++)
+   {
+      while (pool_cache.free[i] != NULL)
+      {
+         header = pool_cache.free[i];
+         pool_cache.free[i] = header->next;
+         pool_release(header);
+      }
+      pool_cache.count[i] = 0;
+   }
 }
 
 void*
@@ -151,10 +340,40 @@ pgmoneta_memory_stream_buffer_init(struct stream_buffer** buffer)
       return;
    }
 
-   b->size = DEFAULT_BUFFER_SIZE;
    b->start = b->end = b->cursor = 0;
-   b->buffer = aligned_alloc((size_t)ALIGNMENT_SIZE, DEFAULT_BUFFER_SIZE);
+   b->buffer = pgmoneta_memory_pool_alloc(STREAM_BUFFER_SIZE);
+
+   if (b->buffer == NULL)
+   {
+      free(b);
+      *buffer = NULL;
+      return;
+   }
+
+   b->size = STREAM_BUFFER_SIZE;
    *buffer = b;
+
+   pgmoneta_memory_account(b->size);
+}
+
+void
+pgmoneta_memory_stream_buffer_compact(struct stream_buffer* buffer)
+{
+   int offset = buffer->start;
+
+   if (offset == 0)
+   {
+      return;
+   }
+
+   if (buffer->end > offset)
+   {
+      memmove(buffer->buffer, buffer->buffer + offset, buffer->end - offset);
+   }
+
+   buffer->start = 0;
+   buffer->end -= offset;
+   buffer->cursor -= offset;
 }
 
 int
@@ -163,32 +382,41 @@ pgmoneta_memory_stream_buffer_enlarge(struct stream_buffer* buffer, int bytes_ne
    size_t new_size = 0;
    void* new_buffer = NULL;
 
-   if (buffer->size + bytes_needed < buffer->size + DEFAULT_BUFFER_SIZE)
+   // double the buffer so a large message is received with a logarithmic number of copies
+   if (bytes_needed < buffer->size)
    {
-      new_size = pgmoneta_get_aligned_size(buffer->size + DEFAULT_BUFFER_SIZE);
+      new_size = pgmoneta_get_aligned_size((size_t)buffer->size * 2);
    }
    else
    {
-      new_size = pgmoneta_get_aligned_size(buffer->size + bytes_needed);
+      new_size = pgmoneta_get_aligned_size((size_t)buffer->size + bytes_needed);
    }
 
-   if (buffer->size > new_size)
+   if (new_size > INT_MAX)
    {
-      return 0;
+      return 1;
    }
 
-   new_buffer = aligned_alloc((size_t)ALIGNMENT_SIZE, new_size);
+   new_buffer = pgmoneta_memory_pool_alloc(new_size);
 
    if (new_buffer == NULL)
    {
       return 1;
    }
 
-   memset(new_buffer, 0, new_size);
-   memcpy(new_buffer, buffer->buffer, buffer->size);
+   // use the whole size class
+   new_size = pgmoneta_memory_pool_size(new_buffer);
+
+   // only the unconsumed data is kept, so the buffer is compacted as well
+   memcpy(new_buffer, buffer->buffer + buffer->start, buffer->end - buffer->start);
+
+   pgmoneta_memory_pool_free(buffer->buffer);
 
-   free(buffer->buffer);
+   pgmoneta_memory_account(new_size - buffer->size);
 
+   buffer->end -= buffer->start;
+   buffer->cursor -= buffer->start;
+   buffer->start = 0;
    buffer->size = new_size;
    buffer->buffer = new_buffer;
 
@@ -204,8 +432,149 @@ pgmoneta_memory_stream_buffer_free(struct stream_buffer* buffer)
    }
    if (buffer->buffer != NULL)
    {
-      free(buffer->buffer);
+      pgmoneta_memory_pool_free(buffer->buffer);
+      pgmoneta_memory_release(buffer->size);
       buffer->buffer = NULL;
    }
    free(buffer);
 }
+
+int
+pgmoneta_memory_acquire(size_t unit, int wanted)
+{
+   int units;
+   unsigned long long used;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config == NULL || wanted <= 0)
+   {
+      return wanted > 0 ? wanted : 0;
+   }
+
+   used = atomic_load(&config->memory_used);
+
+   do
+   {
+      units = wanted;
+
+      if (config->memory_budget > 0 && unit > 0)
+      {
+         if (used >= config->memory_budget)
+         {
+            units = 0;
+         }
+         else
+         {
+            units = (int)MIN((unsigned long long)wanted, (config->memory_budget - used) / unit);
+         }
+      }
+
+      if (units == 0)
+      {
+         return 0;
+      }
+   }
+   while (!atomic_compare_exchange_weak(&config->memory_used, &used, used + (unsigned long long)units * unit));
+
+   return units;
+}
+
+void
+pgmoneta_memory_account(size_t size)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config != NULL)
+   {
+      atomic_fetch_add(&config->memory_used, size);
+   }
+}
+
+void
+pgmoneta_memory_release(size_t size)
+{
+   unsigned long long used;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config == NULL)
+   {
+      return;
+   }
+
+   used = atomic_load(&config->memory_used);
+
+   // the memory in use doesn't wrap around when the releases and the reservations are out of step
+   while (!atomic_compare_exchange_weak(&config->memory_used, &used, used > size ? used - size : 0))
+   {
+   }
+}
+
+static int
+pool_size_class(size_t size)
+{
+   int size_class = 0;
+
+   while (size_class < MEMORY_POOL_CLASSES && ((size_t)ALIGNMENT_SIZE << size_class) < size)
+   {
+      size_class++;
+   }
+
+   return size_class < MEMORY_POOL_CLASSES ? size_class : -1;
+}
+
+static void
+pool_count(atomic_ullong* counter)
+{
+   atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+#ifdef HAVE_LINUX
+static struct memory_header*
+pool_map(size_t size, size_t* length)
+{
+   size_t l;
+   void* m = NULL;
+
+   *length = 0;
+
+   l = (size + MEMORY_HUGEPAGE_SIZE - 1) & ~((size_t)MEMORY_HUGEPAGE_SIZE - 1);
+
+   // the reserved huge pages first, then transparent huge pages
+   m = mmap(NULL, l, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+   if (m == MAP_FAILED)
+   {
+      m = mmap(NULL, l, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (m == MAP_FAILED)
+      {
+         errno = 0;
+         return NULL;
+      }
+
+      madvise(m, l, MADV_HUGEPAGE);
+      errno = 0;
+   }
+
+   *length = l;
+
+   return (struct memory_header*)m;
+}
+#endif
+
+static void
+pool_release(struct memory_header* header)
+{
+   if (header->mapped > 0)
+   {
+      munmap(header, header->mapped);
+   }
+   else
+   {
+      free(header);
+   }
+}
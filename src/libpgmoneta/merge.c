@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <blockmap.h>
+#include <info.h>
+#include <logging.h>
+#include <management.h>
+#include <merge.h>
+#include <network.h>
+#include <prometheus.h>
+#include <restore.h>
+#include <sha256.h>
+#include <storage.h>
+#include <utils.h>
+#include <workflow.h>
+
+/* system */
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+static int swap_directory(char* current, char* saved, char* replacement);
+static void revert_directory(char* current, char* saved);
+static int run_merge_workflow(int server, char* label);
+
+void
+pgmoneta_merge_backup(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   bool active = false;
+   bool locked = false;
+   char* identifier = NULL;
+   char* label = NULL;
+   char* elapsed = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double total_seconds = 0;
+   struct backup* backup = NULL;
+   struct json* req = NULL;
+   struct json* response = NULL;
+   struct configuration* config;
+
+   pgmoneta_start_logging();
+
+   config = (struct configuration*)shmem;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   /* A merge is background work, so let backups and restores go first */
+   if (setpriority(PRIO_PROCESS, 0, MERGE_NICE))
+   {
+      pgmoneta_log_debug("Merge: Unable to lower the priority (%s)", strerror(errno));
+      errno = 0;
+   }
+
+   req = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
+   identifier = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_BACKUP);
+
+   if (identifier == NULL || pgmoneta_get_backup_server(server, identifier, &backup) || backup == NULL)
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_MERGE_NOBACKUP, compression, encryption, payload);
+      pgmoneta_log_warn("Merge: No identifier for %s/%s", config->servers[server].name, identifier);
+      goto error;
+   }
+
+   if (backup->type != TYPE_INCREMENTAL)
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_MERGE_FULL, compression, encryption, payload);
+      pgmoneta_log_warn("Merge: %s/%s is already a full backup", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   free(backup);
+   backup = NULL;
+
+   /* Holding the delete flag keeps retention and delete away from the chain */
+   if (atomic_load(&config->states[server].backup) ||
+       !atomic_compare_exchange_strong(&config->states[server].delete, &active, true))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_MERGE_ACTIVE, compression, encryption, payload);
+      pgmoneta_log_info("Merge: Active backup or delete for server %s", config->servers[server].name);
+      goto error;
+   }
+
+   locked = true;
+
+   if (pgmoneta_merge(server, identifier, &label))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_MERGE_ERROR, compression, encryption, payload);
+      pgmoneta_log_error("Merge: Unable to merge %s/%s", config->servers[server].name, identifier);
+      goto error;
+   }
+
+   atomic_store(&config->states[server].delete, false);
+   locked = false;
+
+   if (pgmoneta_get_backup_server(server, label, &backup))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_MERGE_ERROR, compression, encryption, payload);
+      goto error;
+   }
+
+   if (pgmoneta_management_create_response(payload, server, &response))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+      goto error;
+   }
+
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)backup->label, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUP_SIZE, (uintptr_t)backup->backup_size, ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_RESTORE_SIZE, (uintptr_t)backup->restore_size, ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)backup->compression, ValueInt32);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_ENCRYPTION, (uintptr_t)backup->encryption, ValueInt32);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_INCREMENTAL, (uintptr_t)false, ValueBool);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_MERGE_NETWORK, compression, encryption, payload);
+      pgmoneta_log_error("Merge: Error sending response for %s", config->servers[server].name);
+      goto error;
+   }
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+   pgmoneta_log_info("Merge: %s/%s (Elapsed: %s)", config->servers[server].name, backup->label, elapsed);
+
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   free(backup);
+   free(label);
+   free(elapsed);
+
+   exit(0);
+
+error:
+
+   if (locked)
+   {
+      atomic_store(&config->states[server].delete, false);
+   }
+
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   free(backup);
+   free(label);
+   free(elapsed);
+
+   exit(1);
+}
+
+int
+pgmoneta_merge(int server, char* identifier, char** label)
+{
+   char* server_base = NULL;
+   char* root = NULL;
+   char* backup_base = NULL;
+   char* path = NULL;
+   char current[MAX_PATH];
+   char saved[MAX_PATH];
+   char replacement[MAX_PATH];
+   char link[MAX_PATH];
+   bool swapped_data = false;
+   bool swapped_manifest = false;
+   int swapped_tablespaces = 0;
+   unsigned long size = 0;
+   struct backup* backup = NULL;
+   struct info_batch* info = NULL;
+   struct art* nodes = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *label = NULL;
+
+   if (pgmoneta_art_create(&nodes))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_workflow_nodes(server, identifier, nodes, &backup))
+   {
+      goto error;
+   }
+
+   if (backup->type != TYPE_INCREMENTAL)
+   {
+      pgmoneta_log_warn("Merge: %s/%s is not an incremental backup", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   if (pgmoneta_storage_recall(server, backup))
+   {
+      goto error;
+   }
+
+   /*
+    * The chain is combined next to the backup directory, so that the result
+    * can be moved into place with a rename and the backup directory only
+    * ever holds a single data directory
+    */
+   server_base = pgmoneta_get_server(server);
+   root = pgmoneta_append(root, server_base);
+   root = pgmoneta_append(root, "merge/");
+
+   if (pgmoneta_exists(root))
+   {
+      pgmoneta_delete_directory(root);
+   }
+
+   if (pgmoneta_mkdir(root))
+   {
+      pgmoneta_log_error("Merge: Could not create %s", root);
+      goto error;
+   }
+
+   if (pgmoneta_art_insert(nodes, NODE_POSITION, (uintptr_t)"", ValueString))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_art_insert(nodes, NODE_TARGET_ROOT, (uintptr_t)root, ValueString))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("Merge: Combining %s/%s in %s", config->servers[server].name, backup->label, root);
+
+   if (pgmoneta_restore_backup(nodes))
+   {
+      pgmoneta_log_error("Merge: Unable to combine %s/%s", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   backup_base = pgmoneta_get_server_backup_identifier(server, backup->label);
+
+   snprintf(current, sizeof(current), "%sdata", backup_base);
+   snprintf(saved, sizeof(saved), "%sdata", root);
+   snprintf(replacement, sizeof(replacement), "%s%s-%s", root, config->servers[server].name, backup->label);
+
+   if (swap_directory(current, saved, replacement))
+   {
+      goto error;
+   }
+   swapped_data = true;
+
+   for (int i = 0; i < backup->number_of_tablespaces; i++)
+   {
+      snprintf(current, sizeof(current), "%stblspc_%s", backup_base, backup->tablespaces[i]);
+      snprintf(saved, sizeof(saved), "%stblspc_%s", root, backup->tablespaces[i]);
+      snprintf(replacement, sizeof(replacement), "%s%s-%s-%s", root, config->servers[server].name,
+               backup->label, backup->tablespaces[i]);
+
+      if (swap_directory(current, saved, replacement))
+      {
+         goto error;
+      }
+      swapped_tablespaces++;
+
+      /* The combined directory links to the staging area, so point it back at the backup */
+      snprintf(link, sizeof(link), "%sdata/pg_tblspc/%s", backup_base, backup->tablespaces_oids[i]);
+      snprintf(current, sizeof(current), "%stblspc_%s/", backup_base, backup->tablespaces[i]);
+
+      unlink(link);
+      if (pgmoneta_symlink_file(link, current))
+      {
+         pgmoneta_log_error("Merge: Could not link %s", link);
+         goto error;
+      }
+   }
+
+   snprintf(current, sizeof(current), "%sbackup.manifest", backup_base);
+   snprintf(saved, sizeof(saved), "%sbackup.manifest", root);
+
+   if (pgmoneta_exists(current))
+   {
+      if (rename(current, saved))
+      {
+         pgmoneta_log_error("Merge: Could not move %s (%s)", current, strerror(errno));
+         errno = 0;
+         goto error;
+      }
+      swapped_manifest = true;
+   }
+
+   /* The block map and checksum index describe the incremental layout */
+   path = pgmoneta_append(path, backup_base);
+   path = pgmoneta_append(path, BLOCKMAP_INDEX);
+   if (pgmoneta_exists(path))
+   {
+      pgmoneta_delete_file(path, NULL);
+   }
+   free(path);
+   path = NULL;
+
+   path = pgmoneta_append(path, backup_base);
+   path = pgmoneta_append(path, SHA256_INDEX);
+   if (pgmoneta_exists(path))
+   {
+      pgmoneta_delete_file(path, NULL);
+   }
+   free(path);
+   path = NULL;
+
+   path = pgmoneta_append(path, backup_base);
+   path = pgmoneta_append(path, "data");
+   size = pgmoneta_directory_size(path);
+   free(path);
+   path = NULL;
+
+   pgmoneta_update_info_bool(backup_base, INFO_DEDUPLICATION, false);
+   pgmoneta_update_info_bool(backup_base, INFO_PAGE_FILTER, false);
+
+   if (run_merge_workflow(server, backup->label))
+   {
+      goto error;
+   }
+
+   /* The backup becomes a full backup in one step */
+   if (pgmoneta_info_begin(backup_base, &info))
+   {
+      goto error;
+   }
+
+   pgmoneta_info_set_unsigned_long(info, INFO_TYPE, TYPE_FULL);
+   pgmoneta_info_set_string(info, INFO_PARENT, "");
+   pgmoneta_info_set_unsigned_long(info, INFO_RESTORE, size);
+   pgmoneta_info_set_unsigned_long(info, INFO_COMPRESSION, config->compression_type);
+   pgmoneta_info_set_unsigned_long(info, INFO_ENCRYPTION, config->encryption);
+
+   size = pgmoneta_directory_size(backup_base);
+   pgmoneta_info_set_unsigned_long(info, INFO_BACKUP, size);
+
+   if (pgmoneta_info_commit(info))
+   {
+      goto error;
+   }
+
+   pgmoneta_delete_directory(root);
+
+   *label = pgmoneta_append(*label, backup->label);
+
+   pgmoneta_prometheus_refresh(server);
+
+   pgmoneta_art_destroy(nodes);
+
+   free(backup);
+   free(backup_base);
+   free(root);
+   free(server_base);
+
+   return 0;
+
+error:
+
+   if (backup_base != NULL)
+   {
+      if (swapped_manifest)
+      {
+         snprintf(current, sizeof(current), "%sbackup.manifest", backup_base);
+         snprintf(saved, sizeof(saved), "%sbackup.manifest", root);
+         rename(saved, current);
+      }
+
+      for (int i = 0; i < swapped_tablespaces; i++)
+      {
+         snprintf(current, sizeof(current), "%stblspc_%s", backup_base, backup->tablespaces[i]);
+         snprintf(saved, sizeof(saved), "%stblspc_%s", root, backup->tablespaces[i]);
+         revert_directory(current, saved);
+      }
+
+      if (swapped_data)
+      {
+         snprintf(current, sizeof(current), "%sdata", backup_base);
+         snprintf(saved, sizeof(saved), "%sdata", root);
+         revert_directory(current, saved);
+      }
+   }
+
+   if (root != NULL && pgmoneta_exists(root))
+   {
+      pgmoneta_delete_directory(root);
+   }
+
+   pgmoneta_art_destroy(nodes);
+
+   free(path);
+   free(backup);
+   free(backup_base);
+   free(root);
+   free(server_base);
+
+   return 1;
+}
+
+static int
+swap_directory(char* current, char* saved, char* replacement)
+{
+   if (!pgmoneta_exists(replacement))
+   {
+      pgmoneta_log_error("Merge: %s does not exist", replacement);
+      goto error;
+   }
+
+   if (rename(current, saved))
+   {
+      pgmoneta_log_error("Merge: Could not move %s (%s)", current, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   if (rename(replacement, current))
+   {
+      pgmoneta_log_error("Merge: Could not move %s (%s)", replacement, strerror(errno));
+      errno = 0;
+      rename(saved, current);
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+revert_directory(char* current, char* saved)
+{
+   if (pgmoneta_exists(current))
+   {
+      pgmoneta_delete_directory(current);
+   }
+
+   if (rename(saved, current))
+   {
+      pgmoneta_log_error("Merge: Could not restore %s (%s)", current, strerror(errno));
+      errno = 0;
+   }
+}
+
+static int
+run_merge_workflow(int server, char* label)
+{
+   struct workflow* workflow = NULL;
+   struct workflow* current = NULL;
+   struct backup* backup = NULL;
+   struct art* nodes = NULL;
+
+   if (pgmoneta_art_create(&nodes))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_workflow_nodes(server, label, nodes, &backup))
+   {
+      goto error;
+   }
+
+   workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_MERGE, server, backup);
+
+   current = workflow;
+   while (current != NULL)
+   {
+      if (current->setup(current->name(), nodes))
+      {
+         goto error;
+      }
+      current = current->next;
+   }
+
+   current = workflow;
+   while (current != NULL)
+   {
+      if (pgmoneta_workflow_execute(current, nodes))
+      {
+         goto error;
+      }
+      current = current->next;
+   }
+
+   current = workflow;
+   while (current != NULL)
+   {
+      if (current->teardown(current->name(), nodes))
+      {
+         goto error;
+      }
+      current = current->next;
+   }
+
+   pgmoneta_workflow_destroy(workflow);
+   pgmoneta_art_destroy(nodes);
+   free(backup);
+
+   return 0;
+
+error:
+
+   pgmoneta_workflow_destroy(workflow);
+   pgmoneta_art_destroy(nodes);
+   free(backup);
+
+   return 1;
+}
@@ -35,8 +35,14 @@
 #include <memory.h>
 #include <message.h>
 #include <network.h>
+#include <probes.h>
+#include <protocol.h>
 #include <security.h>
+#include <sha256.h>
+#include <trace.h>
 #include <utils.h>
+#include <workflow.h>
+#include <zstandard_compression.h>
 
 #include <assert.h>
 #include <errno.h>
@@ -47,6 +53,29 @@
 #include <openssl/ssl.h>
 #include <sys/time.h>
 #include <stdio.h>
+#ifdef HAVE_LINUX
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#ifdef HAVE_LINUX
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+#define SPLICE_TAR_BLOCK 512
+
+/** @struct splice_stream
+ * Defines a tar archive that is moved from the socket to its files with splice
+ */
+struct splice_stream
+{
+   int server;                   /**< The server index */
+   int socket;                   /**< The socket */
+   struct stream_buffer* buffer; /**< The bytes that were already read from the socket */
+   int pipe[2];                  /**< The pipe that the payload moves through */
+   size_t pipe_size;             /**< The size of the pipe */
+   size_t left;                  /**< The bytes left of the current CopyData message */
+   bool done;                    /**< Is the CopyDone message received */
+};
+#endif
 
 static struct message* allocate_message(size_t size);
 
@@ -62,9 +91,20 @@ static int get_column_name(struct message* msg, int index, char** name);
 
 static bool is_server_side_compression(void);
 
-static unsigned char* decode_base64(const char* base64_data, int* decoded_len);
 static char** get_paths(const char* data, int* count);
 static void extract_file_name(const char* path, char* file_name, char* file_path);
+static int receive_checksums(char* basedir, struct deque* hashes, struct art** checksums);
+
+#ifdef HAVE_LINUX
+static int splice_archive(int server, int socket, struct stream_buffer* buffer, char* directory, struct tar_totals* totals);
+static int splice_wait(int socket);
+static int splice_read(struct splice_stream* s, void* data, size_t length);
+static int splice_message(struct splice_stream* s);
+static int splice_data(struct splice_stream* s, void* data, size_t length);
+static int splice_skip(struct splice_stream* s, size_t length);
+static int splice_file(struct splice_stream* s, int fd, size_t length);
+static uint64_t splice_tar_number(char* field, size_t length);
+#endif
 
 int
 pgmoneta_read_block_message(SSL* ssl, int socket, struct message** msg)
@@ -132,7 +172,7 @@ pgmoneta_free_message(struct message* msg)
    {
       if (msg->data)
       {
-         free(msg->data);
+         pgmoneta_memory_pool_free(msg->data);
          msg->data = NULL;
       }
 
@@ -800,6 +840,9 @@ pgmoneta_create_base_backup_message(int server_version, bool incremental, char*
    char* options = NULL;
    struct message* m = NULL;
    size_t size;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    memset(&cmd[0], 0, sizeof(cmd));
    // other options are
@@ -836,7 +879,9 @@ pgmoneta_create_base_backup_message(int server_version, bool incremental, char*
          options = pgmoneta_append(options, "COMPRESSION 'zstd', ");
          options = pgmoneta_append(options, "COMPRESSION_DETAIL 'level=");
          options = pgmoneta_append_int(options, compression_level);
-         options = pgmoneta_append(options, ",workers=4', ");
+         options = pgmoneta_append(options, ",workers=");
+         options = pgmoneta_append_int(options, config->workers > 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS);
+         options = pgmoneta_append(options, "', ");
       }
       else if (compression == COMPRESSION_SERVER_LZ4)
       {
@@ -1350,7 +1395,7 @@ allocate_message(size_t size)
       goto error;
    }
 
-   m->data = aligned_alloc((size_t)ALIGNMENT_SIZE, pgmoneta_get_aligned_size(size));
+   m->data = pgmoneta_memory_pool_alloc(size);
 
    if (m->data == NULL)
    {
@@ -1494,6 +1539,8 @@ read_message(int socket, bool block, int timeout, struct message** msg)
 
       if (likely(numbytes > 0))
       {
+         PGMONETA_PROBE2(network__read, socket, numbytes);
+
          m->kind = (signed char)(*((char*)m->data));
          m->length = numbytes;
          *msg = m;
@@ -1651,6 +1698,8 @@ ssl_read_message(SSL* ssl, int timeout, struct message** msg)
 
       if (likely(numbytes > 0))
       {
+         PGMONETA_PROBE2(network__read, SSL_get_fd(ssl), numbytes);
+
          m->kind = (signed char)(*((char*)m->data));
          m->length = numbytes;
          *msg = m;
@@ -1816,10 +1865,24 @@ pgmoneta_read_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer)
    int numbytes = 0;
    bool keep_read = false;
    int err;
+   size_t end;
+   uint64_t trace_start;
+   char detail[MISC_LENGTH];
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
+   trace_start = pgmoneta_trace_now();
+
+   /*
+    * consumed messages are only moved out of the way when the free tail
+    * gets small, so draining a large read doesn't copy the rest each time
+    */
+   if (buffer->start > 0 && buffer->size - buffer->end < buffer->size / 2)
+   {
+      pgmoneta_memory_stream_buffer_compact(buffer);
+   }
+
    /*
     * if buffer is still too full,
     * try enlarging it to be at least big enough for one TCP packet (I'm using 1500B here)
@@ -1837,6 +1900,7 @@ pgmoneta_read_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer)
       pgmoneta_log_error("Not enough space to read new copy-out data");
       goto error;
    }
+   end = buffer->end;
    do
    {
       if (ssl != NULL)
@@ -1850,7 +1914,29 @@ pgmoneta_read_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer)
 
       if (likely(numbytes > 0))
       {
+         PGMONETA_PROBE2(network__read, socket, numbytes);
+
          buffer->end += numbytes;
+
+         /* drain the records OpenSSL already holds, so one call returns several messages */
+         while (ssl != NULL && buffer->end < buffer->size && SSL_pending(ssl) > 0)
+         {
+            numbytes = SSL_read(ssl, buffer->buffer + buffer->end, buffer->size - buffer->end);
+            if (numbytes <= 0)
+            {
+               ERR_clear_error();
+               break;
+            }
+            buffer->end += numbytes;
+         }
+
+         // only the reads that waited on the server are traced, so a fast stream doesn't fill the trace
+         if (trace_start > 0 && pgmoneta_trace_now() - trace_start >= TRACE_SLOW_READ)
+         {
+            snprintf(&detail[0], sizeof(detail), "%zu bytes", buffer->end - end);
+            pgmoneta_trace_event(TRACE_NETWORK, "Read", &detail[0], trace_start);
+         }
+
          return MESSAGE_STATUS_OK;
       }
       else if (numbytes == 0)
@@ -1993,8 +2079,7 @@ pgmoneta_consume_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer,
             goto error;
          }
       }
-      if (m->kind != 'D' && m->kind != 'H' && m->kind != 'W' && m->kind != 'T' &&
-          m->kind != 'c' && m->kind != 'f' && m->kind != 'E' && m->kind != 'd' && m->kind != 'C')
+      if (!pgmoneta_protocol_copy_kind(m->kind))
       {
          // skip this message
          keep_read = true;
@@ -2005,7 +2090,7 @@ pgmoneta_consume_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer,
 
       if (m->kind != 'D' && m->kind != 'T' && m->kind != 'E')
       {
-         m->data = (void*) malloc(length - 4 + 1);
+         m->data = pgmoneta_memory_pool_alloc(length - 4 + 1);
          m->length = length - 4;
          memset(m->data, 0, m->length + 1);
          memcpy(m->data, buffer->buffer + (buffer->cursor + 4), m->length);
@@ -2016,7 +2101,7 @@ pgmoneta_consume_copy_stream(SSL* ssl, int socket, struct stream_buffer* buffer,
           * if it's a DataRow, RowDescription or ErrorResponse message
           * This is to accommodate our existing message parsing APIs for these types of messages
           */
-         m->data = (void*) malloc(length + 1);
+         m->data = pgmoneta_memory_pool_alloc(length + 1);
          m->length = length + 1;
          memcpy(m->data, buffer->buffer + buffer->cursor - 1, m->length);
       }
@@ -2104,8 +2189,7 @@ pgmoneta_consume_copy_stream_start(SSL* ssl, int socket, struct stream_buffer* b
             goto error;
          }
       }
-      if (message->kind != 'D' && message->kind != 'H' && message->kind != 'W' && message->kind != 'T' &&
-          message->kind != 'c' && message->kind != 'f' && message->kind != 'E' && message->kind != 'd' && message->kind != 'C')
+      if (!pgmoneta_protocol_copy_kind(message->kind))
       {
          // skip this message
          keep_read = true;
@@ -2141,24 +2225,44 @@ error:
    return status;
 }
 
+bool
+pgmoneta_copy_stream_has_message(struct stream_buffer* buffer)
+{
+   int cursor = buffer->cursor;
+   signed char kind;
+   int length;
+
+   while (cursor + 1 + 4 < buffer->end)
+   {
+      kind = buffer->buffer[cursor];
+      length = pgmoneta_read_int32(buffer->buffer + cursor + 1);
+
+      if (cursor + 1 + length >= buffer->end)
+      {
+         return false;
+      }
+
+      if (kind == 'D' || kind == 'H' || kind == 'W' || kind == 'T' ||
+          kind == 'c' || kind == 'f' || kind == 'E' || kind == 'd' || kind == 'C')
+      {
+         return true;
+      }
+
+      // pgmoneta_consume_copy_stream_start skips the unknown ones
+      cursor += (length + 1);
+   }
+
+   return false;
+}
+
 void
 pgmoneta_consume_copy_stream_end(struct stream_buffer* buffer, struct message* message)
 {
    int length = pgmoneta_read_int32(buffer->buffer + buffer->cursor + 1);
    buffer->cursor += (1 + length);
    buffer->start = buffer->cursor;
-   // left shift unconsumed data to reuse space
-   if (buffer->start < buffer->end)
-   {
-      if (buffer->start > 0)
-      {
-         memmove(buffer->buffer, buffer->buffer + buffer->start, buffer->end - buffer->start);
-         buffer->end -= buffer->start;
-         buffer->cursor -= buffer->start;
-         buffer->start = 0;
-      }
-   }
-   else
+   // the space of consumed messages is reclaimed by the next read
+   if (buffer->start >= buffer->end)
    {
       buffer->start = buffer->end = buffer->cursor = 0;
    }
@@ -2270,18 +2374,35 @@ error:
 }
 
 int
-pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket)
+pgmoneta_receive_archive_files(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket, struct page_checksums* pages, struct tar_totals* totals)
 {
    char directory[MAX_PATH];
    char link_path[MAX_PATH];
    char null_buffer[2 * 512]; // 2 tar block size of terminator null bytes
-   FILE* file = NULL;
+   struct tar_stream* stream = NULL;
    struct query_response* response = NULL;
    struct message* msg = (struct message*)malloc(sizeof (struct message));
    struct tuple* tup = NULL;
+   struct deque* hashes = NULL;
+   struct art* checksums = NULL;
+   bool splice = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    memset(msg, 0, sizeof (struct message));
 
+   // TLS, the bandwidth limits and the page checksums need the bytes in user space
+   splice = config->backup_splice && ssl == NULL && bucket == NULL && network_bucket == NULL && pages == NULL;
+#ifndef HAVE_LINUX
+   splice = false;
+#endif
+
+   if (pgmoneta_deque_create(true, &hashes))
+   {
+      goto error;
+   }
+
    // Receive the second result set
    if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
    {
@@ -2333,10 +2454,10 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
          }
       }
       pgmoneta_mkdir(directory);
-      file = fopen(file_path, "wb");
-      if (file == NULL)
+      // the archive is extracted while it is received
+      if (!splice && pgmoneta_tar_stream_create(directory, COMPRESSION_NONE, hashes, pages, tup->data[1] == NULL ? totals : NULL, &stream))
       {
-         pgmoneta_log_error("Could not create archive tar file");
+         pgmoneta_log_error("Could not create archive tar stream");
          goto error;
       }
       // get the copy out response
@@ -2347,68 +2468,72 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
          {
             pgmoneta_log_copyfail_message(msg);
             pgmoneta_log_error_response_message(msg);
-            fflush(file);
-            fclose(file);
             goto error;
          }
          pgmoneta_consume_copy_stream_end(buffer, msg);
       }
-      while (msg->kind != 'c')
+      if (splice)
       {
-         pgmoneta_consume_copy_stream_start(ssl, socket, buffer, msg, network_bucket);
-         if (msg->kind == 'E' || msg->kind == 'f')
+#ifdef HAVE_LINUX
+         // only the headers are read, the files never leave the kernel
+         if (splice_archive(server, socket, buffer, directory, tup->data[1] == NULL ? totals : NULL))
          {
-            pgmoneta_log_copyfail_message(msg);
-            pgmoneta_log_error_response_message(msg);
-            fflush(file);
-            fclose(file);
+            pgmoneta_log_error("could not extract %s", file_path);
             goto error;
          }
-
-         if (msg->kind == 'd' && msg->length > 0)
+#endif
+      }
+      else
+      {
+         while (msg->kind != 'c')
          {
+            pgmoneta_consume_copy_stream_start(ssl, socket, buffer, msg, network_bucket);
+            if (msg->kind == 'E' || msg->kind == 'f')
+            {
+               pgmoneta_log_copyfail_message(msg);
+               pgmoneta_log_error_response_message(msg);
+               goto error;
+            }
 
-            if (bucket)
+            if (msg->kind == 'd' && msg->length > 0)
             {
-               while (1)
+
+               if (bucket)
                {
-                  if (!pgmoneta_token_bucket_consume(bucket, msg->length))
-                  {
-                     break;
-                  }
-                  else
+                  while (1)
                   {
-                     SLEEP(500000000L)
+                     if (!pgmoneta_token_bucket_consume(bucket, msg->length))
+                     {
+                        break;
+                     }
+                     else
+                     {
+                        SLEEP(500000000L)
+                     }
                   }
                }
-            }
 
-            // copy data
-            if (fwrite(msg->data, msg->length, 1, file) != 1)
-            {
-               pgmoneta_log_error("could not write to file %s", file_path);
-               fflush(file);
-               fclose(file);
-               goto error;
+               // copy data
+               if (pgmoneta_tar_stream_write(stream, msg->data, msg->length))
+               {
+                  pgmoneta_log_error("could not extract %s", file_path);
+                  goto error;
+               }
+
+               pgmoneta_workflow_progress(server, msg->length, 0);
             }
+            pgmoneta_consume_copy_stream_end(buffer, msg);
          }
-         pgmoneta_consume_copy_stream_end(buffer, msg);
-      }
-      //append two blocks of null bytes to the end of the tar file
-      memset(null_buffer, 0, 2 * 512);
-      if (fwrite(null_buffer, 2 * 512, 1, file) != 1)
-      {
-         pgmoneta_log_error("could not write to file %s", file_path);
-         fflush(file);
-         fclose(file);
-         goto error;
+         //append two blocks of null bytes to the end of the tar file
+         memset(null_buffer, 0, 2 * 512);
+         if (pgmoneta_tar_stream_write(stream, null_buffer, 2 * 512) || pgmoneta_tar_stream_finish(stream))
+         {
+            pgmoneta_log_error("could not extract %s", file_path);
+            goto error;
+         }
+         pgmoneta_tar_stream_destroy(stream);
+         stream = NULL;
       }
-      fflush(file);
-      fclose(file);
-
-      // extract the file
-      pgmoneta_extract_tar_file(file_path, directory);
-      remove(file_path);
       pgmoneta_free_message(msg);
 
       msg = NULL;
@@ -2454,12 +2579,19 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
       snprintf(directory, sizeof(directory), "%s/data", basedir);
    }
 
-   if (pgmoneta_manifest_checksum_verify(directory))
+   if (receive_checksums(basedir, hashes, &checksums))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_manifest_checksum_verify(directory, server, checksums))
    {
       pgmoneta_log_error("Manifest verification failed");
       goto error;
    }
 
+   pgmoneta_art_destroy(checksums);
+   pgmoneta_deque_destroy(hashes);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 0;
@@ -2470,13 +2602,16 @@ error:
    {
       pgmoneta_disconnect(socket);
    }
+   pgmoneta_tar_stream_destroy(stream);
+   pgmoneta_art_destroy(checksums);
+   pgmoneta_deque_destroy(hashes);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 1;
 }
 
 int
-pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket)
+pgmoneta_receive_archive_stream(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket, struct page_checksums* pages, struct tar_totals* totals)
 {
    struct query_response* response = NULL;
    struct message* msg = (struct message*)malloc(sizeof (struct message));
@@ -2496,6 +2631,12 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
    memset(null_buffer, 0, 2 * 512);
    char type;
    FILE* file = NULL;
+   struct tar_stream* stream = NULL;
+   struct deque* hashes = NULL;
+   struct art* checksums = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    if (msg == NULL)
    {
@@ -2504,6 +2645,11 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
 
    memset(msg, 0, sizeof(struct message));
 
+   if (pgmoneta_deque_create(true, &hashes))
+   {
+      goto error;
+   }
+
    // Receive the second result set
    if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
    {
@@ -2538,21 +2684,20 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
             case 'n':
             {
                // append two blocks of null buffer and extract the tar file
-               if (file != NULL)
+               if (stream != NULL)
                {
-                  if ((!is_server_side_compression()) && fwrite(null_buffer, 2 * 512, 1, file) != 1)
+                  if ((!is_server_side_compression()) && pgmoneta_tar_stream_write(stream, null_buffer, 2 * 512))
                   {
-                     pgmoneta_log_error("could not write to file %s", file_path);
-                     fflush(file);
-                     fclose(file);
-                     file = NULL;
+                     pgmoneta_log_error("could not extract %s", file_path);
                      goto error;
                   }
-                  fflush(file);
-                  fclose(file);
-                  file = NULL;
-                  pgmoneta_extract_tar_file(file_path, directory);
-                  remove(file_path);
+                  if (pgmoneta_tar_stream_finish(stream))
+                  {
+                     pgmoneta_log_error("could not extract %s", file_path);
+                     goto error;
+                  }
+                  pgmoneta_tar_stream_destroy(stream);
+                  stream = NULL;
                }
                // new tablespace or main directory tar file
                char* archive_name = pgmoneta_read_string(msg->data + 1);
@@ -2609,10 +2754,10 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
                   }
                }
                pgmoneta_mkdir(directory);
-               file = fopen(file_path, "wb");
-               if (file == NULL)
+               // the archive is extracted while it is received
+               if (pgmoneta_tar_stream_create(directory, config->compression_type, hashes, pages, tup->data[1] == NULL ? totals : NULL, &stream))
                {
-                  pgmoneta_log_error("Could not create archive tar file");
+                  pgmoneta_log_error("Could not create archive tar stream");
                   goto error;
                }
                break;
@@ -2620,21 +2765,20 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
             case 'm':
             {
                // start of manifest, finish off previous data archive receiving
-               if (file != NULL)
+               if (stream != NULL)
                {
-                  if ((!is_server_side_compression()) && fwrite(null_buffer, 2 * 512, 1, file) != 1)
+                  if ((!is_server_side_compression()) && pgmoneta_tar_stream_write(stream, null_buffer, 2 * 512))
                   {
-                     pgmoneta_log_error("could not write to file %s", file_path);
-                     fflush(file);
-                     fclose(file);
-                     file = NULL;
+                     pgmoneta_log_error("could not extract %s", file_path);
                      goto error;
                   }
-                  fflush(file);
-                  fclose(file);
-                  file = NULL;
-                  pgmoneta_extract_tar_file(file_path, directory);
-                  remove(file_path);
+                  if (pgmoneta_tar_stream_finish(stream))
+                  {
+                     pgmoneta_log_error("could not extract %s", file_path);
+                     goto error;
+                  }
+                  pgmoneta_tar_stream_destroy(stream);
+                  stream = NULL;
                }
                if (pgmoneta_ends_with(basedir, "/"))
                {
@@ -2672,9 +2816,19 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
                   }
                }
 
-               if (fwrite(msg->data + 1, msg->length - 1, 1, file) != 1)
+               if (stream != NULL)
+               {
+                  if (pgmoneta_tar_stream_write(stream, msg->data + 1, msg->length - 1))
+                  {
+                     pgmoneta_log_error("could not extract %s", file_path);
+                     goto error;
+                  }
+
+                  pgmoneta_workflow_progress(server, msg->length - 1, 0);
+               }
+               else if (file == NULL || fwrite(msg->data + 1, msg->length - 1, 1, file) != 1)
                {
-                  pgmoneta_log_error("could not write to file %s", file_path);
+                  pgmoneta_log_error("could not write to file %s", tmp_manifest_file_path);
                   goto error;
                }
                break;
@@ -2695,6 +2849,19 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
       pgmoneta_consume_copy_stream_end(buffer, msg);
    }
 
+   if (stream != NULL)
+   {
+      // the archive ended without a manifest
+      if (((!is_server_side_compression()) && pgmoneta_tar_stream_write(stream, null_buffer, 2 * 512)) ||
+          pgmoneta_tar_stream_finish(stream))
+      {
+         pgmoneta_log_error("could not extract %s", file_path);
+         goto error;
+      }
+      pgmoneta_tar_stream_destroy(stream);
+      stream = NULL;
+   }
+
    if (file != NULL)
    {
       if (rename(tmp_manifest_file_path, manifest_file_path) != 0)
@@ -2740,12 +2907,19 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
    {
       snprintf(dir, sizeof(dir), "%s/data", basedir);
    }
-   if (pgmoneta_manifest_checksum_verify(dir))
+   if (receive_checksums(basedir, hashes, &checksums))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_manifest_checksum_verify(dir, server, checksums))
    {
       pgmoneta_log_error("Manifest verification failed");
       goto error;
    }
 
+   pgmoneta_art_destroy(checksums);
+   pgmoneta_deque_destroy(hashes);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 0;
@@ -2761,6 +2935,9 @@ error:
       fflush(file);
       fclose(file);
    }
+   pgmoneta_tar_stream_destroy(stream);
+   pgmoneta_art_destroy(checksums);
+   pgmoneta_deque_destroy(hashes);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 1;
@@ -2870,19 +3047,20 @@ error:
 }
 
 int
-pgmoneta_receive_extra_files(SSL* ssl, int socket, char* username, char* source_dir, char* target_dir, char** info_extra)
+pgmoneta_receive_extra_files(SSL** ssl, int* sockets, int number_of_connections, char* username, char* source_dir, char* target_dir, char** info_extra)
 {
    int count = 0;
    char** paths = NULL;
+   struct ext_fetch* files = NULL;
    struct query_response* qr = NULL;
 
-   pgmoneta_ext_privilege(ssl, socket, &qr);
+   pgmoneta_ext_privilege(ssl[0], sockets[0], &qr);
    if (qr != NULL && qr->tuples != NULL && qr->tuples->data != NULL && qr->tuples->data[0] != NULL && qr->tuples->data[0][0] == 't')
    {
       pgmoneta_free_query_response(qr);
       qr = NULL;
 
-      pgmoneta_ext_get_files(ssl, socket, source_dir, &qr);
+      pgmoneta_ext_get_files(ssl[0], sockets[0], source_dir, &qr);
       if (qr != NULL)
       {
          paths = get_paths(qr->tuples->data[0], &count);
@@ -2903,86 +3081,58 @@ pgmoneta_receive_extra_files(SSL* ssl, int socket, char* username, char* source_
             (*info_extra)[0] = '\0';
          }
 
+         files = (struct ext_fetch*)calloc(count > 0 ? count : 1, sizeof(struct ext_fetch));
+         if (files == NULL)
+         {
+            goto error;
+         }
+
          for (int j = 0; j < count; j++)
          {
             char* dest_dir;
-            char* dest_path;
             char file_name[MAX_PATH];
             char file_path[MAX_PATH];
 
             extract_file_name(paths[j], file_name, file_path);
 
-            if (file_path[0] != '\0')
-            {
-               dest_dir = (char*)malloc((strlen(target_dir) + strlen(file_path) + 1) * sizeof(char));
-               snprintf(dest_dir, strlen(target_dir) + strlen(file_path) + 1, "%s%s", target_dir, file_path);
-            }
-            else
-            {
-               dest_dir = (char*)malloc((strlen(target_dir) + 1) * sizeof(char));
-               memset(dest_dir, 0, strlen(target_dir) + 1);
-               memcpy(dest_dir, target_dir, strlen(target_dir));
-            }
+            dest_dir = pgmoneta_append(NULL, target_dir);
+            dest_dir = pgmoneta_append(dest_dir, file_path);
 
             pgmoneta_mkdir(dest_dir);
 
-            dest_path = (char*)malloc((strlen(dest_dir) + strlen(file_name) + 1) * sizeof(char));
-            snprintf(dest_path, strlen(dest_dir) + strlen(file_name) + 1, "%s%s", dest_dir, file_name);
+            files[j].path = paths[j];
+            files[j].dest = pgmoneta_append(dest_dir, file_name);
+         }
 
-            pgmoneta_ext_get_file(ssl, socket, paths[j], &qr);
-            if (qr != NULL && qr->tuples != NULL)
-            {
-               struct tuple* current_tuple = qr->tuples;
-               while (current_tuple != NULL)
-               {
-                  if (current_tuple->data != NULL && current_tuple->data[0] != NULL)
-                  {
-                     int decoded_len;
-                     unsigned char* decoded_data;
+         if (pgmoneta_ext_fetch_files(ssl, sockets, number_of_connections, files, count))
+         {
+            pgmoneta_log_warn("Retrieving extra files: Could not fetch the files of \"%s\"", source_dir);
+            goto error;
+         }
 
-                     decoded_data = decode_base64(current_tuple->data[0], &decoded_len);
-                     if (decoded_data != NULL)
-                     {
-                        FILE* file = fopen(dest_path, "wb");
-                        if (file != NULL)
-                        {
-                           fwrite(decoded_data, 1, decoded_len, file);
-                           fclose(file);
-                        }
-                        else
-                        {
-                           pgmoneta_log_error("Retrieving extra files: Could not open file \"%s\" for writing", dest_path);
-                           free(dest_dir);
-                           free(dest_path);
-                           goto error;
-                        }
-                        free(decoded_data);
-                     }
-                  }
-                  current_tuple = current_tuple->next;
-               }
-               if (strlen(*info_extra) == 0)
-               {
-                  *info_extra = pgmoneta_append(*info_extra, paths[j]);
-               }
-               else
-               {
-                  *info_extra = pgmoneta_append(*info_extra, ", ");
-                  *info_extra = pgmoneta_append(*info_extra, paths[j]);
-               }
+         for (int j = 0; j < count; j++)
+         {
+            if (files[j].missing)
+            {
+               pgmoneta_log_warn("Retrieving extra files: \"%s\" was removed", paths[j]);
+            }
+            else if (strlen(*info_extra) == 0)
+            {
+               *info_extra = pgmoneta_append(*info_extra, paths[j]);
             }
             else
             {
-               pgmoneta_log_warn("Retrieving extra files: Query failed");
-               goto error;
+               *info_extra = pgmoneta_append(*info_extra, ", ");
+               *info_extra = pgmoneta_append(*info_extra, paths[j]);
             }
+         }
 
-            pgmoneta_free_query_response(qr);
-            free(dest_dir);
-            free(dest_path);
+         for (int j = 0; j < count; j++)
+         {
+            free(files[j].dest);
             free(paths[j]);
-            qr = NULL;
          }
+         free(files);
          free(paths);
       }
       else
@@ -3009,10 +3159,15 @@ error:
    {
       for (int i = 0; i < count; i++)
       {
+         if (files != NULL)
+         {
+            free(files[i].dest);
+         }
          free(paths[i]);
       }
       free(paths);
    }
+   free(files);
    pgmoneta_free_query_response(qr);
 
    return 1;
@@ -3121,42 +3276,6 @@ extract_file_name(const char* path, char* file_name, char* file_path)
    }
 }
 
-static unsigned char*
-decode_base64(const char* base64_data, int* decoded_len)
-{
-   size_t base64_len;
-   size_t max_decoded_len;
-   unsigned char* decoded_data;
-   int actual_decoded_len;
-
-   base64_len = strlen(base64_data);
-   max_decoded_len = (base64_len / 4) * 3;
-   decoded_data = (unsigned char*)malloc(max_decoded_len);
-
-   // Perform base64 decoding using OpenSSL
-   actual_decoded_len = EVP_DecodeBlock(decoded_data, (const unsigned char*)base64_data, base64_len);
-
-   // Handle padding
-   if (base64_data[base64_len - 1] == '=')
-   {
-      actual_decoded_len--;
-   }
-   if (base64_data[base64_len - 2] == '=')
-   {
-      actual_decoded_len--;
-   }
-
-   if (actual_decoded_len < 0)
-   {
-      pgmoneta_log_error("error decode: Base64 decoding failed");
-      free(decoded_data);
-      return NULL;
-   }
-
-   *decoded_len = actual_decoded_len;
-   return decoded_data;
-}
-
 int
 pgmoneta_send_file(SSL* ssl, int socket, char* username, char* source_path, char* target_path)
 {
@@ -3232,3 +3351,559 @@ error:
 
    return 1;
 }
+
+static int
+receive_checksums(char* basedir, struct deque* hashes, struct art** checksums)
+{
+   struct deque_iterator* iter = NULL;
+   struct art* c = NULL;
+
+   *checksums = NULL;
+
+   // the index lets the later steps skip reading the files again
+   if (pgmoneta_sha256_index_write(basedir, hashes))
+   {
+      pgmoneta_log_warn("Could not write the checksum index of %s", basedir);
+   }
+
+   if (pgmoneta_art_create(&c))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_iterator_create(hashes, &iter))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_deque_iterator_next(iter))
+   {
+      pgmoneta_art_insert(c, iter->tag, iter->value->data, ValueString);
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+
+   *checksums = c;
+
+   return 0;
+
+error:
+   pgmoneta_art_destroy(c);
+
+   return 1;
+}
+
+#ifdef HAVE_LINUX
+static int
+splice_archive(int server, int socket, struct stream_buffer* buffer, char* directory, struct tar_totals* totals)
+{
+   char header[SPLICE_TAR_BLOCK];
+   char name[MAX_PATH];
+   char link_name[MAX_PATH];
+   char path[MAX_PATH];
+   uint64_t size;
+   uint64_t disk;
+   uint64_t sum;
+   mode_t mode;
+   int n;
+   int pipe_size;
+   int fd = -1;
+   struct splice_stream s;
+
+   memset(&s, 0, sizeof(struct splice_stream));
+   s.server = server;
+   s.socket = socket;
+   s.buffer = buffer;
+   s.pipe[0] = -1;
+   s.pipe[1] = -1;
+
+   if (pipe2(s.pipe, O_CLOEXEC))
+   {
+      pgmoneta_log_error("Could not create a pipe: %s", strerror(errno));
+      goto error;
+   }
+
+   // a larger pipe moves more of a file per call, the default size is used when the limit is lower
+   fcntl(s.pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+   pipe_size = fcntl(s.pipe[1], F_GETPIPE_SZ);
+   s.pipe_size = pipe_size > 0 ? (size_t)pipe_size : 65536;
+   errno = 0;
+
+   while (true)
+   {
+      if (splice_message(&s))
+      {
+         goto error;
+      }
+
+      // the archive ends with the stream, the terminating blocks are not sent
+      if (s.done)
+      {
+         break;
+      }
+
+      if (splice_data(&s, header, sizeof(header)))
+      {
+         goto error;
+      }
+
+      if (header[0] == '\0')
+      {
+         continue;
+      }
+
+      sum = 0;
+      for (int i = 0; i < SPLICE_TAR_BLOCK; i++)
+      {
+         sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)header[i];
+      }
+
+      if (sum != splice_tar_number(header + 148, 8))
+      {
+         pgmoneta_log_error("Invalid tar header in %s", directory);
+         goto error;
+      }
+
+      memset(name, 0, sizeof(name));
+      memset(link_name, 0, sizeof(link_name));
+      memset(path, 0, sizeof(path));
+
+      if (!memcmp(header + 257, "ustar", 5) && header[345] != '\0')
+      {
+         snprintf(name, sizeof(name), "%.155s/%.100s", header + 345, header);
+      }
+      else
+      {
+         snprintf(name, sizeof(name), "%.100s", header);
+      }
+      snprintf(link_name, sizeof(link_name), "%.100s", header + 157);
+
+      n = snprintf(path, sizeof(path), "%s%s%s", directory, pgmoneta_ends_with(directory, "/") ? "" : "/", name);
+      if (n < 0 || (size_t)n >= sizeof(path))
+      {
+         pgmoneta_log_error("The path of %s in %s is too long", name, directory);
+         goto error;
+      }
+
+      size = splice_tar_number(header + 124, 12);
+      mode = (mode_t)(splice_tar_number(header + 100, 8) & 07777);
+
+      switch (header[156])
+      {
+         case '0':
+         case '\0':
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+            if (fd < 0)
+            {
+               pgmoneta_log_error("Could not create %s: %s", path, strerror(errno));
+               goto error;
+            }
+
+            if (splice_file(&s, fd, size) || pgmoneta_durability_file(fd))
+            {
+               goto error;
+            }
+
+            close(fd);
+            fd = -1;
+
+            if (totals != NULL)
+            {
+               disk = size;
+               if (totals->block_size > 0 && disk % totals->block_size != 0)
+               {
+                  disk += totals->block_size - disk % totals->block_size;
+               }
+
+               totals->bytes += size;
+               totals->disk += disk;
+               totals->files++;
+               totals->biggest = MAX(totals->biggest, disk);
+            }
+            break;
+         case '5':
+            if (pgmoneta_mkdir(path))
+            {
+               pgmoneta_log_error("Could not create %s: %s", path, strerror(errno));
+               goto error;
+            }
+            break;
+         case '2':
+            unlink(path);
+            if (symlink(link_name, path))
+            {
+               pgmoneta_log_error("Could not create %s: %s", path, strerror(errno));
+               goto error;
+            }
+
+            if (totals != NULL)
+            {
+               totals->disk += totals->block_size;
+            }
+            break;
+         default:
+            pgmoneta_log_error("Unsupported tar entry %c for %s", header[156], name);
+            goto error;
+      }
+
+      if (splice_skip(&s, (SPLICE_TAR_BLOCK - size % SPLICE_TAR_BLOCK) % SPLICE_TAR_BLOCK))
+      {
+         goto error;
+      }
+   }
+
+   close(s.pipe[0]);
+   close(s.pipe[1]);
+
+   return 0;
+
+error:
+   if (fd != -1)
+   {
+      close(fd);
+   }
+   if (s.pipe[0] != -1)
+   {
+      close(s.pipe[0]);
+   }
+   if (s.pipe[1] != -1)
+   {
+      close(s.pipe[1]);
+   }
+
+   return 1;
+}
+
+static int
+splice_wait(int socket)
+{
+   int ret;
+   struct pollfd pfd;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pfd.fd = socket;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+
+   while (config->running)
+   {
+      ret = poll(&pfd, 1, 1000);
+
+      if (ret > 0)
+      {
+         return 0;
+      }
+      else if (ret < 0 && errno != EINTR)
+      {
+         pgmoneta_log_error("Could not wait for the backup: %s", strerror(errno));
+         return 1;
+      }
+
+      errno = 0;
+   }
+
+   return 1;
+}
+
+static int
+splice_read(struct splice_stream* s, void* data, size_t length)
+{
+   char* p = (char*)data;
+   ssize_t n;
+
+   while (length > 0)
+   {
+      if (s->buffer->cursor < s->buffer->end)
+      {
+         // the bytes that came with the CopyOutResponse are used first
+         n = MIN(length, (size_t)(s->buffer->end - s->buffer->cursor));
+         memcpy(p, s->buffer->buffer + s->buffer->cursor, n);
+         s->buffer->cursor += n;
+         s->buffer->start = s->buffer->cursor;
+      }
+      else
+      {
+         n = read(s->socket, p, length);
+
+         if (n == 0)
+         {
+            pgmoneta_log_error("The connection was closed during the backup");
+            return 1;
+         }
+         else if (n < 0)
+         {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+               errno = 0;
+               if (splice_wait(s->socket))
+               {
+                  return 1;
+               }
+               continue;
+            }
+
+            pgmoneta_log_error("Could not read the backup: %s", strerror(errno));
+            return 1;
+         }
+      }
+
+      p += n;
+      length -= n;
+   }
+
+   return 0;
+}
+
+static int
+splice_message(struct splice_stream* s)
+{
+   char header[5];
+   int length;
+   char* body = NULL;
+   struct message msg;
+
+   while (s->left == 0 && !s->done)
+   {
+      if (splice_read(s, header, sizeof(header)))
+      {
+         goto error;
+      }
+
+      length = pgmoneta_read_int32(&header[1]) - 4;
+      if (length < 0)
+      {
+         pgmoneta_log_error("Invalid message length %d", length);
+         goto error;
+      }
+
+      if (header[0] == 'd')
+      {
+         s->left = length;
+         continue;
+      }
+
+      // the other messages are small, they keep their header like in the copy stream
+      body = (char*)calloc(1, sizeof(header) + length + 1);
+      if (body == NULL)
+      {
+         goto error;
+      }
+
+      memcpy(body, header, sizeof(header));
+      if (splice_read(s, body + sizeof(header), length))
+      {
+         goto error;
+      }
+
+      if (header[0] == 'E')
+      {
+         msg.kind = 'E';
+         msg.length = sizeof(header) + length;
+         msg.data = body;
+         pgmoneta_log_error_response_message(&msg);
+         goto error;
+      }
+      else if (header[0] == 'f')
+      {
+         pgmoneta_log_error("COPY-failure: %s", body + sizeof(header));
+         goto error;
+      }
+      else if (header[0] == 'c')
+      {
+         s->done = true;
+      }
+
+      free(body);
+      body = NULL;
+   }
+
+   return 0;
+
+error:
+   free(body);
+
+   return 1;
+}
+
+static int
+splice_data(struct splice_stream* s, void* data, size_t length)
+{
+   char* p = (char*)data;
+   size_t n;
+
+   while (length > 0)
+   {
+      if (splice_message(s))
+      {
+         return 1;
+      }
+
+      if (s->done)
+      {
+         pgmoneta_log_error("The backup ended inside of a tar entry");
+         return 1;
+      }
+
+      n = MIN(length, s->left);
+      if (splice_read(s, p, n))
+      {
+         return 1;
+      }
+
+      s->left -= n;
+      p += n;
+      length -= n;
+   }
+
+   return 0;
+}
+
+static int
+splice_skip(struct splice_stream* s, size_t length)
+{
+   char block[SPLICE_TAR_BLOCK];
+   size_t n;
+
+   while (length > 0)
+   {
+      n = MIN(length, sizeof(block));
+      if (splice_data(s, block, n))
+      {
+         return 1;
+      }
+
+      length -= n;
+   }
+
+   return 0;
+}
+
+static int
+splice_file(struct splice_stream* s, int fd, size_t length)
+{
+   size_t n;
+   size_t out;
+   ssize_t moved;
+
+   while (length > 0)
+   {
+      if (splice_message(s))
+      {
+         return 1;
+      }
+
+      if (s->done)
+      {
+         pgmoneta_log_error("The backup ended inside of a tar entry");
+         return 1;
+      }
+
+      n = MIN(length, s->left);
+
+      if (s->buffer->cursor < s->buffer->end)
+      {
+         n = MIN(n, (size_t)(s->buffer->end - s->buffer->cursor));
+         out = 0;
+         while (out < n)
+         {
+            moved = write(fd, s->buffer->buffer + s->buffer->cursor + out, n - out);
+            if (moved < 0 && errno == EINTR)
+            {
+               continue;
+            }
+            if (moved <= 0)
+            {
+               pgmoneta_log_error("Could not write the backup: %s", strerror(errno));
+               return 1;
+            }
+            out += moved;
+         }
+         s->buffer->cursor += n;
+         s->buffer->start = s->buffer->cursor;
+      }
+      else
+      {
+         moved = splice(s->socket, NULL, s->pipe[1], NULL, MIN(n, s->pipe_size), SPLICE_F_MOVE | SPLICE_F_MORE);
+
+         if (moved == 0)
+         {
+            pgmoneta_log_error("The connection was closed during the backup");
+            return 1;
+         }
+         else if (moved < 0)
+         {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+               errno = 0;
+               if (splice_wait(s->socket))
+               {
+                  return 1;
+               }
+               continue;
+            }
+
+            pgmoneta_log_error("Could not read the backup: %s", strerror(errno));
+            return 1;
+         }
+
+         n = (size_t)moved;
+         out = 0;
+         while (out < n)
+         {
+            moved = splice(s->pipe[0], NULL, fd, NULL, n - out, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (moved < 0 && errno == EINTR)
+            {
+               continue;
+            }
+            if (moved <= 0)
+            {
+               pgmoneta_log_error("Could not write the backup: %s", strerror(errno));
+               return 1;
+            }
+            out += moved;
+         }
+      }
+
+      s->left -= n;
+      length -= n;
+
+      pgmoneta_workflow_progress(s->server, n, 0);
+   }
+
+   return 0;
+}
+
+static uint64_t
+splice_tar_number(char* field, size_t length)
+{
+   uint64_t value = 0;
+   size_t i = 0;
+
+   // large sizes are stored as base-256 with the high bit set
+   if ((unsigned char)field[0] & 0x80)
+   {
+      value = (unsigned char)field[0] & 0x7f;
+      for (i = 1; i < length; i++)
+      {
+         value = (value << 8) | (unsigned char)field[i];
+      }
+
+      return value;
+   }
+
+   while (i < length && (field[i] == ' ' || field[i] == '\0'))
+   {
+      i++;
+   }
+
+   while (i < length && field[i] >= '0' && field[i] <= '7')
+   {
+      value = (value << 3) | (uint64_t)(field[i] - '0');
+      i++;
+   }
+
+   return value;
+}
+#endif
@@ -36,6 +36,7 @@
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <netdb.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +53,7 @@
 #include <netinet/tcp.h>
 
 static int bind_host(const char* hostname, int port, int** fds, int* length);
+static int connect_timeout(int fd, struct sockaddr* addr, socklen_t length, int timeout);
 
 /**
  *
@@ -233,7 +235,7 @@ pgmoneta_connect(const char* hostname, int port, int* fd)
    struct addrinfo* servinfo = NULL;
    struct addrinfo* p = NULL;
    int yes = 1;
-   size_t buffer_size = DEFAULT_BUFFER_SIZE;
+   int buffer_size = DEFAULT_BUFFER_SIZE;
    socklen_t optlen = sizeof(int);
    int rv;
    char sport[6];
@@ -242,6 +244,11 @@ pgmoneta_connect(const char* hostname, int port, int* fd)
 
    config = (struct configuration*)shmem;
 
+   if (config != NULL && config->socket_buffer_size > 0)
+   {
+      buffer_size = config->socket_buffer_size;
+   }
+
    memset(&sport, 0, sizeof(sport));
    sprintf(&sport[0], "%d", port);
 
@@ -318,7 +325,7 @@ pgmoneta_connect(const char* hostname, int port, int* fd)
             }
          }
 
-         if (connect(*fd, p->ai_addr, p->ai_addrlen) == -1)
+         if (connect_timeout(*fd, p->ai_addr, p->ai_addrlen, config != NULL ? config->authentication_timeout : 0) == -1)
          {
             error = errno;
             pgmoneta_disconnect(*fd);
@@ -454,6 +461,66 @@ pgmoneta_get_address(struct sockaddr* sa, char* address, size_t length)
    }
 }
 
+static int
+connect_timeout(int fd, struct sockaddr* addr, socklen_t length, int timeout)
+{
+   int ret;
+   int error = 0;
+   socklen_t error_length = sizeof(int);
+   struct pollfd pfd;
+
+   if (timeout <= 0)
+   {
+      return connect(fd, addr, length);
+   }
+
+   // an unreachable host fails after the timeout instead of the TCP retries of the system
+   pgmoneta_socket_nonblocking(fd, true);
+
+   ret = connect(fd, addr, length);
+   if (ret == -1 && errno == EINPROGRESS)
+   {
+      pfd.fd = fd;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+
+      do
+      {
+         ret = poll(&pfd, 1, timeout * 1000);
+      }
+      while (ret == -1 && errno == EINTR);
+
+      if (ret == 0)
+      {
+         errno = ETIMEDOUT;
+         ret = -1;
+      }
+      else if (ret > 0)
+      {
+         if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1)
+         {
+            ret = -1;
+         }
+         else if (error != 0)
+         {
+            errno = error;
+            ret = -1;
+         }
+         else
+         {
+            ret = 0;
+         }
+      }
+   }
+
+   if (ret == 0)
+   {
+      pgmoneta_socket_nonblocking(fd, false);
+   }
+
+   return ret;
+}
+
 int
 pgmoneta_socket_nonblocking(int fd, bool value)
 {
@@ -536,7 +603,15 @@ int
 pgmoneta_socket_buffers(int fd)
 {
    socklen_t optlen = sizeof(int);
-   size_t buffer_size = DEFAULT_BUFFER_SIZE;
+   int buffer_size = DEFAULT_BUFFER_SIZE;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config != NULL && config->socket_buffer_size > 0)
+   {
+      buffer_size = config->socket_buffer_size;
+   }
 
    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, optlen) == -1)
    {
@@ -0,0 +1,917 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <page.h>
+#include <utils.h>
+#include <workers.h>
+
+/* system */
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define PAGE_CHECKSUM_OFFSET 8
+#define PAGE_LOWER_OFFSET    12
+#define PAGE_UPPER_OFFSET    14
+#define PAGE_HEADER_DATA     24
+
+#define PAGE_N_SUMS     32
+#define PAGE_FNV_PRIME  16777619
+
+#define PAGE_CHECKSUM_COMP(checksum, value)          \
+        do                                           \
+        {                                            \
+           uint32_t t = (checksum) ^ (value);        \
+           (checksum) = t * PAGE_FNV_PRIME ^ (t >> 17); \
+        }                                            \
+        while (0)
+
+/* The initial values of the sums of PostgreSQL's page checksum */
+static const uint32_t page_checksum_offsets[PAGE_N_SUMS] = {
+   0x5B1F36E9, 0xB8525960, 0x02AB50AA, 0x1DE66D2A,
+   0x79FF467A, 0x9BB9F8A3, 0x217E7CD2, 0x83E13D2C,
+   0xF8D4474F, 0xE39EB970, 0x42C6AE16, 0x993216FA,
+   0x7B093B5D, 0x98DAFF3C, 0xF718902A, 0x0B1C9CDB,
+   0xE58F764B, 0x187636BC, 0x5D7B3BB1, 0xE73DE7DE,
+   0x92BEC979, 0xCCA6C0B2, 0x304A0979, 0x85AA43D4,
+   0x783125BB, 0x6CA8EAA2, 0xE407EAC6, 0x4B5CFC3E,
+   0x9FBF8C76, 0x15CA20BE, 0xF2CA9FFF, 0x3BE6D1E1
+};
+
+static atomic_ullong page_bytes;
+static atomic_ullong page_packed;
+
+static bool page_is_relation(char* name);
+static void page_verify_block(struct page_verify* verify, const unsigned char* page);
+static int page_pack_directory(char* directory, size_t block_size, struct workers* workers);
+static int page_unpack_directory(char* directory, struct workers* workers);
+static void do_page_pack_file(struct worker_input* wi);
+static void do_page_unpack_file(struct worker_input* wi);
+
+int
+pgmoneta_page_pack(int server, char* directory, struct workers* workers)
+{
+   size_t block_size;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   block_size = config->servers[server].block_size;
+   if (block_size < PAGE_HEADER_DATA || block_size > UINT16_MAX + 1)
+   {
+      pgmoneta_log_error("Page: Invalid block size %zu for %s", block_size, config->servers[server].name);
+      goto error;
+   }
+
+   atomic_init(&page_bytes, 0);
+   atomic_init(&page_packed, 0);
+
+   if (page_pack_directory(directory, block_size, workers))
+   {
+      goto error;
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+   }
+
+   pgmoneta_log_debug("Page: %llu bytes in relation files packed to %llu bytes",
+                      (unsigned long long)atomic_load(&page_bytes), (unsigned long long)atomic_load(&page_packed));
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_page_unpack(char* directory, struct workers* workers)
+{
+   if (page_unpack_directory(directory, workers))
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+uint16_t
+pgmoneta_page_checksum(const unsigned char* page, size_t block_size, uint32_t block)
+{
+   uint32_t sums[PAGE_N_SUMS];
+   uint32_t row[PAGE_N_SUMS];
+   uint32_t result = 0;
+   size_t rows = block_size / sizeof(row);
+
+   memcpy(sums, page_checksum_offsets, sizeof(sums));
+
+   for (size_t i = 0; i < rows; i++)
+   {
+      memcpy(row, page + i * sizeof(row), sizeof(row));
+
+      // the checksum is computed with the checksum field set to zero
+      if (i == 0)
+      {
+         memset((unsigned char*)row + PAGE_CHECKSUM_OFFSET, 0, sizeof(uint16_t));
+      }
+
+      for (int j = 0; j < PAGE_N_SUMS; j++)
+      {
+         PAGE_CHECKSUM_COMP(sums[j], row[j]);
+      }
+   }
+
+   for (int i = 0; i < 2; i++)
+   {
+      for (int j = 0; j < PAGE_N_SUMS; j++)
+      {
+         PAGE_CHECKSUM_COMP(sums[j], 0);
+      }
+   }
+
+   for (int j = 0; j < PAGE_N_SUMS; j++)
+   {
+      result ^= sums[j];
+   }
+
+   result ^= block;
+
+   return (uint16_t)((result % 65535) + 1);
+}
+
+bool
+pgmoneta_page_verify_start(struct page_checksums* checksums, char* path, struct page_verify* verify)
+{
+   char* name = NULL;
+   char* parent = NULL;
+   char* segment = NULL;
+   size_t length;
+   uint64_t first = 0;
+
+   memset(verify, 0, sizeof(struct page_verify));
+
+   if (checksums == NULL || checksums->block_size < PAGE_HEADER_DATA ||
+       checksums->block_size % (sizeof(uint32_t) * PAGE_N_SUMS) != 0)
+   {
+      return false;
+   }
+
+   name = strrchr(path, '/');
+   if (name == NULL || name - path < 2 || !page_is_relation(name + 1))
+   {
+      return false;
+   }
+   name++;
+
+   // the relation files are in global, or in the directory of a database
+   parent = name - 1;
+   while (parent > path && *(parent - 1) != '/')
+   {
+      parent--;
+   }
+   length = (size_t)(name - 1 - parent);
+
+   if (!(length == 6 && !strncmp(parent, "global", 6)))
+   {
+      if (length == 0)
+      {
+         return false;
+      }
+
+      for (size_t i = 0; i < length; i++)
+      {
+         if (!isdigit((unsigned char)parent[i]))
+         {
+            return false;
+         }
+      }
+   }
+
+   segment = strchr(name, '.');
+   if (segment != NULL)
+   {
+      first = strtoull(segment + 1, NULL, 10) * checksums->relseg_size;
+      if (first > UINT32_MAX)
+      {
+         return false;
+      }
+   }
+
+   verify->page = (unsigned char*)malloc(checksums->block_size);
+   if (verify->page == NULL)
+   {
+      return false;
+   }
+
+   verify->checksums = checksums;
+   verify->block = (uint32_t)first;
+   snprintf(verify->path, sizeof(verify->path), "%s", path);
+
+   return true;
+}
+
+void
+pgmoneta_page_verify_update(struct page_verify* verify, const void* data, size_t size)
+{
+   size_t n;
+   size_t block_size;
+   const unsigned char* d = (const unsigned char*)data;
+
+   if (verify->checksums == NULL)
+   {
+      return;
+   }
+
+   block_size = verify->checksums->block_size;
+
+   while (size > 0)
+   {
+      if (verify->length == 0 && size >= block_size)
+      {
+         // whole blocks are verified where they are
+         page_verify_block(verify, d);
+         d += block_size;
+         size -= block_size;
+      }
+      else
+      {
+         n = MIN(block_size - verify->length, size);
+
+         memcpy(verify->page + verify->length, d, n);
+         verify->length += n;
+         d += n;
+         size -= n;
+
+         if (verify->length == block_size)
+         {
+            page_verify_block(verify, verify->page);
+            verify->length = 0;
+         }
+      }
+   }
+}
+
+void
+pgmoneta_page_verify_finish(struct page_verify* verify)
+{
+   // a partial block at the end is a relation that was extended during the backup
+   free(verify->page);
+   verify->page = NULL;
+   verify->checksums = NULL;
+}
+
+bool
+pgmoneta_page_is_packed(char* path)
+{
+   char magic[PAGE_MAGIC_SIZE];
+   FILE* file = NULL;
+   bool result = false;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      return false;
+   }
+
+   if (fread(magic, 1, PAGE_MAGIC_SIZE, file) == PAGE_MAGIC_SIZE &&
+       !memcmp(magic, PAGE_MAGIC, PAGE_MAGIC_SIZE))
+   {
+      result = true;
+   }
+
+   fclose(file);
+
+   return result;
+}
+
+static bool
+page_is_relation(char* name)
+{
+   char* p = name;
+
+   /* <relfilenode>[_fsm|_vm|_init][.<segment>] */
+   if (!isdigit((unsigned char)*p))
+   {
+      return false;
+   }
+
+   while (isdigit((unsigned char)*p))
+   {
+      p++;
+   }
+
+   if (!strncmp(p, "_fsm", 4))
+   {
+      p += 4;
+   }
+   else if (!strncmp(p, "_vm", 3))
+   {
+      p += 3;
+   }
+   else if (!strncmp(p, "_init", 5))
+   {
+      p += 5;
+   }
+
+   if (*p == '.')
+   {
+      p++;
+
+      if (!isdigit((unsigned char)*p))
+      {
+         return false;
+      }
+
+      while (isdigit((unsigned char)*p))
+      {
+         p++;
+      }
+   }
+
+   return *p == '\0';
+}
+
+static void
+page_verify_block(struct page_verify* verify, const unsigned char* page)
+{
+   uint16_t upper;
+   uint16_t checksum;
+   uint16_t expected;
+   uint32_t xlogid;
+   uint32_t xrecoff;
+   uint64_t lsn;
+   struct page_checksums* checksums = verify->checksums;
+
+   memcpy(&upper, page + PAGE_UPPER_OFFSET, sizeof(uint16_t));
+   memcpy(&xlogid, page, sizeof(uint32_t));
+   memcpy(&xrecoff, page + sizeof(uint32_t), sizeof(uint32_t));
+   lsn = ((uint64_t)xlogid << 32) | xrecoff;
+
+   // new pages have no checksum, and the pages changed during the backup are fixed by the WAL
+   if (upper != 0 && (checksums->lsn == 0 || lsn < checksums->lsn))
+   {
+      memcpy(&checksum, page + PAGE_CHECKSUM_OFFSET, sizeof(uint16_t));
+      expected = pgmoneta_page_checksum(page, checksums->block_size, verify->block);
+
+      atomic_fetch_add(&checksums->blocks, 1);
+
+      if (checksum != expected)
+      {
+         atomic_fetch_add(&checksums->failures, 1);
+         pgmoneta_log_warn("Page: Checksum failure in %s block %u (%u, expected %u)",
+                           verify->path, verify->block, checksum, expected);
+      }
+   }
+
+   verify->block++;
+}
+
+static int
+page_pack_directory(char* directory, size_t block_size, struct workers* workers)
+{
+   DIR* dir = NULL;
+   char* entry_path = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct worker_input* wi = NULL;
+
+   dir = opendir(directory);
+   if (dir == NULL)
+   {
+      pgmoneta_log_error("Page: Could not open %s", directory);
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      entry_path = pgmoneta_append(entry_path, directory);
+      if (!pgmoneta_ends_with(entry_path, "/"))
+      {
+         entry_path = pgmoneta_append(entry_path, "/");
+      }
+      entry_path = pgmoneta_append(entry_path, entry->d_name);
+
+      if (!lstat(entry_path, &st))
+      {
+         if (S_ISDIR(st.st_mode))
+         {
+            if (page_pack_directory(entry_path, block_size, workers))
+            {
+               goto error;
+            }
+         }
+         else if (S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size % block_size == 0 &&
+                  page_is_relation(entry->d_name))
+         {
+            if (pgmoneta_create_worker_input(NULL, entry_path, NULL, (int)block_size, workers, &wi))
+            {
+               goto error;
+            }
+
+            if (workers != NULL)
+            {
+               if (workers->outcome)
+               {
+                  pgmoneta_workers_add(workers, do_page_pack_file, wi);
+               }
+               else
+               {
+                  free(wi);
+               }
+            }
+            else
+            {
+               do_page_pack_file(wi);
+            }
+         }
+      }
+
+      free(entry_path);
+      entry_path = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(entry_path);
+
+   return 1;
+}
+
+static void
+do_page_pack_file(struct worker_input* wi)
+{
+   char tmp[MAX_PATH];
+   unsigned char header[PAGE_HEADER_SIZE];
+   unsigned char hole[4];
+   unsigned char* page = NULL;
+   unsigned char kind;
+   size_t block_size = (size_t)wi->level;
+   uint64_t size = 0;
+   uint64_t packed = PAGE_HEADER_SIZE;
+   uint16_t lower;
+   uint16_t upper;
+   size_t n;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   memset(&tmp[0], 0, sizeof(tmp));
+
+   page = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, block_size);
+   if (page == NULL)
+   {
+      goto error;
+   }
+
+   in = fopen(wi->from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("Page: Could not open %s", wi->from);
+      goto error;
+   }
+
+   snprintf(tmp, sizeof(tmp), "%s.page", wi->from);
+
+   out = fopen(tmp, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("Page: Could not create %s", tmp);
+      goto error;
+   }
+
+   memset(header, 0, sizeof(header));
+   if (fwrite(header, 1, PAGE_HEADER_SIZE, out) != PAGE_HEADER_SIZE)
+   {
+      goto error;
+   }
+
+   while ((n = fread(page, 1, block_size, in)) > 0)
+   {
+      if (n != block_size)
+      {
+         pgmoneta_log_error("Page: Partial page in %s", wi->from);
+         goto error;
+      }
+
+      size += block_size;
+
+      memcpy(&lower, page + PAGE_LOWER_OFFSET, sizeof(uint16_t));
+      memcpy(&upper, page + PAGE_UPPER_OFFSET, sizeof(uint16_t));
+
+      if (pgmoneta_is_zero(page, block_size))
+      {
+         kind = PAGE_ZERO;
+      }
+      else if (lower >= PAGE_HEADER_DATA && lower < upper && upper <= block_size &&
+               pgmoneta_is_zero(page + lower, upper - lower))
+      {
+         kind = PAGE_HOLE;
+      }
+      else
+      {
+         kind = PAGE_RAW;
+      }
+
+      if (fputc(kind, out) == EOF)
+      {
+         goto error;
+      }
+      packed++;
+
+      if (kind == PAGE_HOLE)
+      {
+         pgmoneta_write_uint16(hole, lower);
+         pgmoneta_write_uint16(hole + 2, upper);
+
+         if (fwrite(hole, 1, sizeof(hole), out) != sizeof(hole) ||
+             fwrite(page, 1, lower, out) != lower ||
+             fwrite(page + upper, 1, block_size - upper, out) != block_size - upper)
+         {
+            goto error;
+         }
+         packed += sizeof(hole) + lower + block_size - upper;
+      }
+      else if (kind == PAGE_RAW)
+      {
+         if (fwrite(page, 1, block_size, out) != block_size)
+         {
+            goto error;
+         }
+         packed += block_size;
+      }
+   }
+
+   if (ferror(in))
+   {
+      pgmoneta_log_error("Page: Could not read %s", wi->from);
+      goto error;
+   }
+
+   fclose(in);
+   in = NULL;
+
+   atomic_fetch_add(&page_bytes, size);
+
+   if (packed >= size)
+   {
+      /* Nothing to gain, the file is kept as is */
+      fclose(out);
+      out = NULL;
+      unlink(tmp);
+
+      atomic_fetch_add(&page_packed, size);
+      free(wi);
+
+      return;
+   }
+
+   memcpy(header, PAGE_MAGIC, PAGE_MAGIC_SIZE);
+   pgmoneta_write_uint64(header + PAGE_MAGIC_SIZE, size);
+   pgmoneta_write_uint32(header + PAGE_MAGIC_SIZE + 8, (uint32_t)block_size);
+
+   if (fseek(out, 0, SEEK_SET) || fwrite(header, 1, PAGE_HEADER_SIZE, out) != PAGE_HEADER_SIZE)
+   {
+      pgmoneta_log_error("Page: Could not write %s", tmp);
+      goto error;
+   }
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (rename(tmp, wi->from))
+   {
+      pgmoneta_log_error("Page: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   atomic_fetch_add(&page_packed, packed);
+
+   free(wi);
+
+   return;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (strlen(tmp) > 0)
+   {
+      unlink(tmp);
+   }
+
+   if (wi->workers != NULL)
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+page_unpack_directory(char* directory, struct workers* workers)
+{
+   DIR* dir = NULL;
+   char* entry_path = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct worker_input* wi = NULL;
+
+   dir = opendir(directory);
+   if (dir == NULL)
+   {
+      pgmoneta_log_error("Page: Could not open %s", directory);
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      entry_path = pgmoneta_append(entry_path, directory);
+      if (!pgmoneta_ends_with(entry_path, "/"))
+      {
+         entry_path = pgmoneta_append(entry_path, "/");
+      }
+      entry_path = pgmoneta_append(entry_path, entry->d_name);
+
+      if (!lstat(entry_path, &st))
+      {
+         if (S_ISDIR(st.st_mode))
+         {
+            if (page_unpack_directory(entry_path, workers))
+            {
+               goto error;
+            }
+         }
+         else if (S_ISREG(st.st_mode) && st.st_size >= PAGE_HEADER_SIZE &&
+                  page_is_relation(entry->d_name) && pgmoneta_page_is_packed(entry_path))
+         {
+            if (pgmoneta_create_worker_input(NULL, entry_path, NULL, 0, workers, &wi))
+            {
+               goto error;
+            }
+
+            if (workers != NULL)
+            {
+               if (workers->outcome)
+               {
+                  pgmoneta_workers_add(workers, do_page_unpack_file, wi);
+               }
+               else
+               {
+                  free(wi);
+               }
+            }
+            else
+            {
+               do_page_unpack_file(wi);
+            }
+         }
+      }
+
+      free(entry_path);
+      entry_path = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(entry_path);
+
+   return 1;
+}
+
+static void
+do_page_unpack_file(struct worker_input* wi)
+{
+   char tmp[MAX_PATH];
+   unsigned char header[PAGE_HEADER_SIZE];
+   unsigned char hole[4];
+   unsigned char* page = NULL;
+   int kind;
+   uint64_t size;
+   uint64_t written = 0;
+   uint32_t block_size;
+   uint16_t lower;
+   uint16_t upper;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   memset(&tmp[0], 0, sizeof(tmp));
+
+   in = fopen(wi->from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("Page: Could not open %s", wi->from);
+      goto error;
+   }
+
+   if (fread(header, 1, PAGE_HEADER_SIZE, in) != PAGE_HEADER_SIZE ||
+       memcmp(header, PAGE_MAGIC, PAGE_MAGIC_SIZE))
+   {
+      pgmoneta_log_error("Page: Invalid packed file %s", wi->from);
+      goto error;
+   }
+
+   size = pgmoneta_read_uint64(header + PAGE_MAGIC_SIZE);
+   block_size = pgmoneta_read_uint32(header + PAGE_MAGIC_SIZE + 8);
+
+   if (block_size < PAGE_HEADER_DATA || block_size > UINT16_MAX + 1 || size % block_size != 0)
+   {
+      pgmoneta_log_error("Page: Invalid packed file %s", wi->from);
+      goto error;
+   }
+
+   page = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_OUT, block_size);
+   if (page == NULL)
+   {
+      goto error;
+   }
+
+   snprintf(tmp, sizeof(tmp), "%s.page", wi->from);
+
+   out = fopen(tmp, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("Page: Could not create %s", tmp);
+      goto error;
+   }
+
+   while (written < size)
+   {
+      kind = fgetc(in);
+
+      if (kind == PAGE_ZERO)
+      {
+         memset(page, 0, block_size);
+      }
+      else if (kind == PAGE_HOLE)
+      {
+         if (fread(hole, 1, sizeof(hole), in) != sizeof(hole))
+         {
+            goto truncated;
+         }
+
+         lower = pgmoneta_read_uint16(hole);
+         upper = pgmoneta_read_uint16(hole + 2);
+
+         if (lower > upper || upper > block_size)
+         {
+            pgmoneta_log_error("Page: Invalid hole in %s", wi->from);
+            goto error;
+         }
+
+         memset(page + lower, 0, upper - lower);
+
+         if (fread(page, 1, lower, in) != lower ||
+             fread(page + upper, 1, block_size - upper, in) != block_size - upper)
+         {
+            goto truncated;
+         }
+      }
+      else if (kind == PAGE_RAW)
+      {
+         if (fread(page, 1, block_size, in) != block_size)
+         {
+            goto truncated;
+         }
+      }
+      else
+      {
+         goto truncated;
+      }
+
+      if (fwrite(page, 1, block_size, out) != block_size)
+      {
+         pgmoneta_log_error("Page: Could not write %s", tmp);
+         goto error;
+      }
+
+      written += block_size;
+   }
+
+   fclose(in);
+   in = NULL;
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (rename(tmp, wi->from))
+   {
+      pgmoneta_log_error("Page: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   free(wi);
+
+   return;
+
+truncated:
+
+   pgmoneta_log_error("Page: Truncated packed file %s", wi->from);
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (strlen(tmp) > 0)
+   {
+      unlink(tmp);
+   }
+
+   if (wi->workers != NULL)
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
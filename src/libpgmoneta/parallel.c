@@ -0,0 +1,1409 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <extension.h>
+#include <logging.h>
+#include <memory.h>
+#include <message.h>
+#include <network.h>
+#include <parallel.h>
+#include <security.h>
+#include <tablespace.h>
+#include <utils.h>
+#include <walk.h>
+#include <workers.h>
+
+/* system */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* The directories whose contents are left out, like BASE_BACKUP does */
+#define PARALLEL_EXCLUDED_DIRECTORIES \
+        "'pg_wal', 'pg_dynshmem', 'pg_notify', 'pg_replslot', 'pg_serial', 'pg_snapshots', 'pg_stat_tmp', 'pg_subtrans'"
+
+static char* excluded_files[] = {
+   "postmaster.pid",
+   "postmaster.opts",
+   "pg_internal.init",
+   "backup_label",
+   "backup_label.old",
+   "tablespace_map",
+   "backup_manifest",
+   "postgresql.auto.conf.tmp",
+   "current_logfiles.tmp",
+   NULL
+};
+
+/** @struct parallel_file
+ * Defines a file of the server that is copied
+ */
+struct parallel_file
+{
+   char* path;                 /**< The path relative to the data directory of the server */
+   char* target;               /**< The path in the backup */
+   size_t size;                /**< The number of bytes copied */
+   char modified[MISC_LENGTH]; /**< The last modification time */
+   char* checksum;             /**< The checksum */
+   bool missing;               /**< Was the file removed during the backup */
+   bool done;                  /**< Was the file copied by an earlier attempt */
+};
+
+/** @struct parallel_state
+ * Defines the files shared by the connections
+ */
+struct parallel_state
+{
+   struct parallel_file* files; /**< The files, largest first */
+   int number_of_files;         /**< The number of files */
+   atomic_int next;             /**< The next file to copy */
+   atomic_bool failed;          /**< Has a copy failed */
+   int hash;                    /**< The hash algorithm of the manifest */
+   struct token_bucket* bucket;         /**< The backup rate limit bucket */
+   struct token_bucket* network_bucket; /**< The network rate limit bucket */
+   FILE* progress;                      /**< The progress journal */
+   pthread_mutex_t progress_lock;       /**< The lock of the progress journal */
+};
+
+/** @struct parallel_cleanup
+ * Defines the files to keep when a backup is resumed
+ */
+struct parallel_cleanup
+{
+   char** targets;          /**< The paths in the backup, sorted */
+   int number_of_targets;   /**< The number of paths */
+};
+
+/** @struct parallel_connection
+ * Defines a connection that copies files
+ */
+struct parallel_connection
+{
+   SSL* ssl;                     /**< The SSL structure */
+   int socket;                   /**< The socket */
+   struct parallel_state* state; /**< The shared state */
+};
+
+static int query(SSL* ssl, int socket, char* qs, struct query_response** response);
+static char* join_path(char* base, char* path);
+static char* target_path(char* backup_base, struct tablespace* tablespaces, char* path);
+static bool excluded(char* path);
+static int list_files(SSL* ssl, int socket, char* backup_base, struct tablespace* tablespaces, struct parallel_state* state);
+static int copy_file(SSL* ssl, int socket, struct parallel_state* state, struct parallel_file* file);
+static void copy_files(struct worker_input* wi);
+static int copy_wal(SSL* ssl, int socket, int server, char* data, uint32_t timeline, char* startpos, char* endpos, struct parallel_state* state);
+static int progress_resume(char* backup_base, struct parallel_state* state);
+static int progress_open(char* backup_base, char* listed, struct parallel_state* state);
+static void progress_add(struct parallel_state* state, struct parallel_file* file);
+static int progress_read(char* path, char* listed, size_t size, int* hash, int* number_of_entries, struct parallel_file** entries);
+static int progress_cleanup(struct walk_entry* entry, void* arg);
+static int string_compare(const void* a, const void* b);
+static int write_manifest(char* data, struct parallel_state* state, struct parallel_file* label, uint32_t timeline, char* startpos, char* endpos);
+static char* segment_name(uint32_t timeline, uint64_t segno, uint64_t wal_size);
+static uint64_t parse_lsn(char* lsn);
+static int file_size_compare(const void* a, const void* b);
+static int file_path_compare(const void* a, const void* b);
+static void free_files(struct parallel_state* state);
+
+int
+pgmoneta_parallel_backup(int server, char* label, char* backup_base, struct tablespace* tablespaces, int hash,
+                         struct token_bucket* bucket, struct token_bucket* network_bucket,
+                         char* startpos, uint32_t* start_timeline, char* endpos, uint32_t* end_timeline)
+{
+   int usr = -1;
+   int number_of_connections;
+   uint32_t timeline = 0;
+   char* qs = NULL;
+   char* data = NULL;
+   char* line = NULL;
+   char* progress = NULL;
+   char listed[MISC_LENGTH];
+   SSL* ssl = NULL;
+   int socket = -1;
+   FILE* file = NULL;
+   struct parallel_file backup_label = {0};
+   struct parallel_state state;
+   struct parallel_connection* connections = NULL;
+   struct query_response* response = NULL;
+   struct tuple* tup = NULL;
+   struct tablespace* tblspc = NULL;
+   struct workers* workers = NULL;
+   struct worker_input* wi = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&state, 0, sizeof(struct parallel_state));
+   atomic_init(&state.next, 0);
+   atomic_init(&state.failed, false);
+   state.hash = hash;
+   state.bucket = bucket;
+   state.network_bucket = network_bucket;
+   pthread_mutex_init(&state.progress_lock, NULL);
+
+   number_of_connections = config->backup_connections;
+
+   for (int i = 0; usr == -1 && i < config->number_of_users; i++)
+   {
+      if (!strcmp(config->servers[server].username, config->users[i].username))
+      {
+         usr = i;
+      }
+   }
+
+   if (usr == -1)
+   {
+      goto error;
+   }
+
+   // the backup lasts as long as the session that started it
+   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket) != AUTH_SUCCESS)
+   {
+      pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
+      goto error;
+   }
+
+   connections = (struct parallel_connection*)calloc(number_of_connections, sizeof(struct parallel_connection));
+   if (connections == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      connections[i].socket = -1;
+      connections[i].state = &state;
+   }
+
+   // authentication isn't thread safe, so the connections are opened up front
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false,
+                                       &connections[i].ssl, &connections[i].socket) != AUTH_SUCCESS)
+      {
+         pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
+         goto error;
+      }
+   }
+
+   if (query(ssl, socket, "SELECT oid, spcname FROM pg_tablespace;", &response))
+   {
+      goto error;
+   }
+
+   tup = response->tuples;
+   while (tup != NULL)
+   {
+      tblspc = tablespaces;
+      while (tblspc != NULL)
+      {
+         if (tup->data[0] != NULL && tup->data[1] != NULL && !strcmp(tblspc->name, tup->data[1]))
+         {
+            tblspc->oid = atoi(tup->data[0]);
+         }
+         tblspc = tblspc->next;
+      }
+      tup = tup->next;
+   }
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   if (config->servers[server].version >= 15)
+   {
+      qs = pgmoneta_format_and_append(NULL, "SELECT pg_backup_start('pgmoneta_%s', true);", label);
+   }
+   else
+   {
+      qs = pgmoneta_format_and_append(NULL, "SELECT pg_start_backup('pgmoneta_%s', true, false);", label);
+   }
+
+   if (query(ssl, socket, qs, &response) || response->tuples == NULL || response->tuples->data[0] == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not start the backup of %s", config->servers[server].name);
+      goto error;
+   }
+   memset(startpos, 0, 20);
+   snprintf(startpos, 20, "%s", response->tuples->data[0]);
+   pgmoneta_free_query_response(response);
+   response = NULL;
+   free(qs);
+   qs = NULL;
+
+   // a file modified in the second of the listing can't be told apart from its copy
+   if (query(ssl, socket, "SELECT to_char(now() AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS');", &response) ||
+       response->tuples == NULL || response->tuples->data[0] == NULL)
+   {
+      goto error;
+   }
+   memset(listed, 0, sizeof(listed));
+   snprintf(listed, sizeof(listed), "%s", response->tuples->data[0]);
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   if (list_files(ssl, socket, backup_base, tablespaces, &state))
+   {
+      pgmoneta_log_error("Parallel backup: Could not list the files of %s", config->servers[server].name);
+      goto error;
+   }
+
+   if (progress_resume(backup_base, &state) || progress_open(backup_base, listed, &state))
+   {
+      pgmoneta_log_error("Parallel backup: Could not create the progress journal for %s", config->servers[server].name);
+      goto error;
+   }
+
+   pgmoneta_log_debug("Parallel backup: %s/%s has %d files for %d connections", config->servers[server].name, label,
+                      state.number_of_files, number_of_connections);
+
+   if (pgmoneta_workers_initialize(number_of_connections, &workers))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      if (pgmoneta_create_worker_input(NULL, "", "", 0, workers, &wi))
+      {
+         goto error;
+      }
+
+      wi->argument = &connections[i];
+
+      if (pgmoneta_workers_add(workers, copy_files, wi))
+      {
+         free(wi);
+         goto error;
+      }
+      wi = NULL;
+   }
+
+   pgmoneta_workers_wait(workers);
+   if (!workers->outcome || atomic_load(&state.failed))
+   {
+      goto error;
+   }
+   pgmoneta_workers_destroy(workers);
+   workers = NULL;
+
+   if (config->servers[server].version >= 15)
+   {
+      qs = pgmoneta_append(qs, "SELECT lsn, labelfile FROM pg_backup_stop(false);");
+   }
+   else
+   {
+      qs = pgmoneta_append(qs, "SELECT lsn, labelfile FROM pg_stop_backup(false, false);");
+   }
+
+   if (query(ssl, socket, qs, &response) || response->tuples == NULL ||
+       response->tuples->data[0] == NULL || response->tuples->data[1] == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not stop the backup of %s", config->servers[server].name);
+      goto error;
+   }
+   memset(endpos, 0, 20);
+   snprintf(endpos, 20, "%s", response->tuples->data[0]);
+
+   line = strstr(response->tuples->data[1], "START TIMELINE: ");
+   if (line != NULL)
+   {
+      timeline = (uint32_t)strtoul(line + strlen("START TIMELINE: "), NULL, 10);
+   }
+
+   data = join_path(backup_base, "data");
+
+   backup_label.path = strdup("backup_label");
+   backup_label.target = join_path(data, "backup_label");
+
+   file = fopen(backup_label.target, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not create %s", backup_label.target);
+      goto error;
+   }
+   backup_label.size = strlen(response->tuples->data[1]);
+   if (fwrite(response->tuples->data[1], 1, backup_label.size, file) != backup_label.size)
+   {
+      goto error;
+   }
+   fclose(file);
+   file = NULL;
+
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   if (timeline == 0)
+   {
+      goto error;
+   }
+
+   if (copy_wal(connections[0].ssl, connections[0].socket, server, data, timeline, startpos, endpos, &state))
+   {
+      pgmoneta_log_error("Parallel backup: Could not copy the WAL of %s", config->servers[server].name);
+      goto error;
+   }
+
+   if (pgmoneta_create_file_hash(hash, backup_label.target, &backup_label.checksum))
+   {
+      goto error;
+   }
+
+   if (write_manifest(data, &state, &backup_label, timeline, startpos, endpos))
+   {
+      goto error;
+   }
+
+   tblspc = tablespaces;
+   while (tblspc != NULL)
+   {
+      if (tblspc->oid != 0)
+      {
+         char* link_path = NULL;
+         char* directory = NULL;
+         char* name = NULL;
+
+         name = pgmoneta_format_and_append(NULL, "pg_tblspc/%u", tblspc->oid);
+         link_path = join_path(data, name);
+         free(name);
+         name = pgmoneta_format_and_append(NULL, "tblspc_%s/", tblspc->name);
+         directory = join_path(backup_base, name);
+
+         pgmoneta_symlink_file(link_path, directory);
+
+         free(link_path);
+         free(directory);
+         free(name);
+      }
+      tblspc = tblspc->next;
+   }
+
+   // the backup is complete, so there is nothing left to resume
+   fclose(state.progress);
+   state.progress = NULL;
+   progress = join_path(backup_base, PARALLEL_PROGRESS);
+   remove(progress);
+
+   *start_timeline = timeline;
+   *end_timeline = timeline;
+
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      pgmoneta_close_ssl(connections[i].ssl);
+      pgmoneta_disconnect(connections[i].socket);
+   }
+   free(connections);
+   pgmoneta_close_ssl(ssl);
+   pgmoneta_disconnect(socket);
+   free_files(&state);
+   free(backup_label.path);
+   free(backup_label.target);
+   free(backup_label.checksum);
+   free(data);
+   free(progress);
+   free(qs);
+   pthread_mutex_destroy(&state.progress_lock);
+
+   return 0;
+
+error:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   // the journal stays, so the next backup continues from the copied files
+   if (state.progress != NULL)
+   {
+      fclose(state.progress);
+   }
+
+   if (connections != NULL)
+   {
+      for (int i = 0; i < number_of_connections; i++)
+      {
+         pgmoneta_close_ssl(connections[i].ssl);
+         if (connections[i].socket != -1)
+         {
+            pgmoneta_disconnect(connections[i].socket);
+         }
+      }
+      free(connections);
+   }
+
+   // closing the session ends the backup on the server
+   pgmoneta_close_ssl(ssl);
+   if (socket != -1)
+   {
+      pgmoneta_disconnect(socket);
+   }
+   pgmoneta_free_query_response(response);
+   free_files(&state);
+   free(backup_label.path);
+   free(backup_label.target);
+   free(backup_label.checksum);
+   free(data);
+   free(progress);
+   free(qs);
+   pthread_mutex_destroy(&state.progress_lock);
+
+   return 1;
+}
+
+bool
+pgmoneta_parallel_resumable(char* backup_base)
+{
+   bool resumable;
+   char* journal = NULL;
+
+   journal = join_path(backup_base, PARALLEL_PROGRESS);
+   resumable = pgmoneta_exists(journal);
+   free(journal);
+
+   return resumable;
+}
+
+int
+pgmoneta_parallel_resume_label(int server, char** label)
+{
+   int number_of_directories = 0;
+   char** dirs = NULL;
+   char* server_backup = NULL;
+   char* backup_base = NULL;
+
+   *label = NULL;
+
+   server_backup = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_directories(server_backup, &number_of_directories, &dirs))
+   {
+      goto error;
+   }
+
+   // the labels are timestamps, so the newest one is kept
+   for (int i = 0; i < number_of_directories; i++)
+   {
+      backup_base = join_path(server_backup, dirs[i]);
+
+      if (pgmoneta_parallel_resumable(backup_base) && (*label == NULL || strcmp(dirs[i], *label) > 0))
+      {
+         free(*label);
+         *label = strdup(dirs[i]);
+      }
+
+      free(backup_base);
+      backup_base = NULL;
+   }
+
+   for (int i = 0; i < number_of_directories; i++)
+   {
+      free(dirs[i]);
+   }
+   free(dirs);
+   free(server_backup);
+
+   return 0;
+
+error:
+
+   free(server_backup);
+
+   return 1;
+}
+
+static int
+query(SSL* ssl, int socket, char* qs, struct query_response** response)
+{
+   struct message* msg = NULL;
+
+   *response = NULL;
+
+   if (pgmoneta_create_query_message(qs, &msg) != MESSAGE_STATUS_OK || msg == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_query_execute(ssl, socket, msg, response) || *response == NULL)
+   {
+      goto error;
+   }
+
+   pgmoneta_free_message(msg);
+
+   return 0;
+
+error:
+
+   pgmoneta_free_message(msg);
+   pgmoneta_free_query_response(*response);
+   *response = NULL;
+
+   return 1;
+}
+
+static char*
+join_path(char* base, char* path)
+{
+   if (pgmoneta_ends_with(base, "/"))
+   {
+      return pgmoneta_format_and_append(NULL, "%s%s", base, path);
+   }
+
+   return pgmoneta_format_and_append(NULL, "%s/%s", base, path);
+}
+
+static char*
+target_path(char* backup_base, struct tablespace* tablespaces, char* path)
+{
+   char* target = NULL;
+   char* relative = NULL;
+   char* end = NULL;
+   unsigned int oid;
+   struct tablespace* tblspc = NULL;
+
+   // the files of a tablespace go to its own directory, which pg_tblspc links to
+   if (pgmoneta_starts_with(path, "pg_tblspc/"))
+   {
+      oid = (unsigned int)strtoul(path + strlen("pg_tblspc/"), &end, 10);
+
+      tblspc = tablespaces;
+      while (tblspc != NULL && (oid == 0 || tblspc->oid != oid))
+      {
+         tblspc = tblspc->next;
+      }
+
+      if (tblspc != NULL && (*end == '\0' || *end == '/'))
+      {
+         relative = pgmoneta_format_and_append(NULL, "tblspc_%s%s", tblspc->name, end);
+         target = join_path(backup_base, relative);
+         free(relative);
+
+         return target;
+      }
+   }
+
+   relative = pgmoneta_format_and_append(NULL, "data/%s", path);
+   target = join_path(backup_base, relative);
+   free(relative);
+
+   return target;
+}
+
+static bool
+excluded(char* path)
+{
+   char* name = strrchr(path, '/');
+
+   name = name != NULL ? name + 1 : path;
+
+   if (strstr(path, "pgsql_tmp") != NULL)
+   {
+      char* component = path;
+
+      while (component != NULL)
+      {
+         if (pgmoneta_starts_with(component, "pgsql_tmp"))
+         {
+            return true;
+         }
+
+         component = strchr(component, '/');
+         if (component != NULL)
+         {
+            component++;
+         }
+      }
+   }
+
+   for (int i = 0; excluded_files[i] != NULL; i++)
+   {
+      if (!strcmp(name, excluded_files[i]))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static int
+list_files(SSL* ssl, int socket, char* backup_base, struct tablespace* tablespaces, struct parallel_state* state)
+{
+   int number_of_files = 0;
+   char* target = NULL;
+   struct query_response* response = NULL;
+   struct tuple* tup = NULL;
+
+   // pg_stat_file() follows the links in pg_tblspc, so the tablespaces are listed too
+   if (query(ssl, socket,
+             "WITH RECURSIVE files(path, isdir, size, modified) AS ("
+             " SELECT f, s.isdir, s.size, s.modification"
+             " FROM pg_ls_dir('.', true, false) AS f, LATERAL pg_stat_file(f, true) AS s"
+             " UNION ALL"
+             " SELECT d.path || '/' || f, s.isdir, s.size, s.modification"
+             " FROM files d, LATERAL pg_ls_dir(d.path, true, false) AS f, LATERAL pg_stat_file(d.path || '/' || f, true) AS s"
+             " WHERE d.isdir AND d.path NOT IN (" PARALLEL_EXCLUDED_DIRECTORIES "))"
+             " SELECT path, isdir, size, to_char(modified AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS')"
+             " FROM files WHERE isdir IS NOT NULL;",
+             &response))
+   {
+      goto error;
+   }
+
+   tup = response->tuples;
+   while (tup != NULL)
+   {
+      if (tup->data[0] != NULL && tup->data[1] != NULL && tup->data[1][0] == 'f')
+      {
+         number_of_files++;
+      }
+      tup = tup->next;
+   }
+
+   state->files = (struct parallel_file*)calloc(number_of_files > 0 ? number_of_files : 1, sizeof(struct parallel_file));
+   if (state->files == NULL)
+   {
+      goto error;
+   }
+
+   tup = response->tuples;
+   while (tup != NULL)
+   {
+      if (tup->data[0] == NULL || tup->data[1] == NULL || excluded(tup->data[0]))
+      {
+         tup = tup->next;
+         continue;
+      }
+
+      target = target_path(backup_base, tablespaces, tup->data[0]);
+
+      if (tup->data[1][0] == 't')
+      {
+         if (pgmoneta_mkdir(target))
+         {
+            pgmoneta_log_error("Parallel backup: Could not create %s", target);
+            goto error;
+         }
+         free(target);
+      }
+      else
+      {
+         struct parallel_file* file = &state->files[state->number_of_files++];
+
+         file->path = strdup(tup->data[0]);
+         file->target = target;
+         file->size = tup->data[2] != NULL ? strtoull(tup->data[2], NULL, 10) : 0;
+         if (tup->data[3] != NULL)
+         {
+            snprintf(file->modified, sizeof(file->modified), "%s", tup->data[3]);
+         }
+      }
+      target = NULL;
+
+      tup = tup->next;
+   }
+
+   // BASE_BACKUP sends pg_wal with an empty archive_status
+   target = target_path(backup_base, tablespaces, "pg_wal/archive_status");
+   if (pgmoneta_mkdir(target))
+   {
+      goto error;
+   }
+   free(target);
+   target = NULL;
+
+   // the largest files go first so the connections finish together
+   qsort(state->files, state->number_of_files, sizeof(struct parallel_file), file_size_compare);
+
+   pgmoneta_free_query_response(response);
+
+   return 0;
+
+error:
+
+   free(target);
+   pgmoneta_free_query_response(response);
+
+   return 1;
+}
+
+static int
+copy_file(SSL* ssl, int socket, struct parallel_state* state, struct parallel_file* file)
+{
+   struct ext_fetch fetch;
+
+   memset(&fetch, 0, sizeof(struct ext_fetch));
+   fetch.path = file->path;
+   fetch.dest = file->target;
+
+   if (pgmoneta_ext_fetch_file(ssl, socket, &fetch, state->bucket, state->network_bucket))
+   {
+      pgmoneta_log_error("Parallel backup: Could not read %s", file->path);
+      goto error;
+   }
+
+   // a file that is removed during the backup is left out, like BASE_BACKUP does
+   file->missing = fetch.missing;
+
+   if (!file->missing)
+   {
+      file->size = fetch.size;
+
+      if (state->hash != HASH_ALGORITHM_DEFAULT && pgmoneta_create_file_hash(state->hash, file->target, &file->checksum))
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+copy_files(struct worker_input* wi)
+{
+   int i;
+   struct parallel_connection* connection = (struct parallel_connection*)wi->argument;
+   struct parallel_state* state = connection->state;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   while (config->running && !atomic_load(&state->failed))
+   {
+      i = atomic_fetch_add(&state->next, 1);
+      if (i >= state->number_of_files)
+      {
+         break;
+      }
+
+      if (state->files[i].done)
+      {
+         continue;
+      }
+
+      if (copy_file(connection->ssl, connection->socket, state, &state->files[i]))
+      {
+         atomic_store(&state->failed, true);
+         wi->workers->outcome = false;
+      }
+      else if (!state->files[i].missing)
+      {
+         progress_add(state, &state->files[i]);
+      }
+   }
+
+   if (!config->running)
+   {
+      atomic_store(&state->failed, true);
+      wi->workers->outcome = false;
+   }
+
+   pgmoneta_memory_destroy();
+
+   free(wi);
+}
+
+static int
+copy_wal(SSL* ssl, int socket, int server, char* data, uint32_t timeline, char* startpos, char* endpos, struct parallel_state* state)
+{
+   uint64_t wal_size;
+   uint64_t start_lsn;
+   uint64_t end_lsn;
+   uint64_t start_segno;
+   uint64_t end_segno;
+   char* name = NULL;
+   struct parallel_file segment = {0};
+   struct parallel_state wal_state;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // the segments aren't in the manifest, so they aren't hashed
+   memset(&wal_state, 0, sizeof(struct parallel_state));
+   wal_state.hash = HASH_ALGORITHM_DEFAULT;
+   wal_state.bucket = state->bucket;
+   wal_state.network_bucket = state->network_bucket;
+
+   wal_size = config->servers[server].wal_size;
+   if (wal_size == 0)
+   {
+      goto error;
+   }
+
+   start_lsn = parse_lsn(startpos);
+   end_lsn = parse_lsn(endpos);
+
+   if (start_lsn == 0 || end_lsn <= start_lsn)
+   {
+      goto error;
+   }
+
+   // the segment that holds the end position, which is the previous one at a boundary
+   start_segno = start_lsn / wal_size;
+   end_segno = (end_lsn - 1) / wal_size;
+
+   for (uint64_t segno = start_segno; segno <= end_segno; segno++)
+   {
+      name = segment_name(timeline, segno, wal_size);
+      segment.path = pgmoneta_format_and_append(NULL, "pg_wal/%s", name);
+      segment.target = join_path(data, segment.path);
+      segment.missing = false;
+
+      if (copy_file(ssl, socket, &wal_state, &segment) || segment.missing)
+      {
+         pgmoneta_log_error("Parallel backup: Could not copy %s", segment.path);
+         goto error;
+      }
+
+      free(segment.checksum);
+      free(segment.path);
+      free(segment.target);
+      free(name);
+      segment.checksum = NULL;
+      segment.path = NULL;
+      segment.target = NULL;
+      name = NULL;
+   }
+
+   return 0;
+
+error:
+
+   free(segment.checksum);
+   free(segment.path);
+   free(segment.target);
+   free(name);
+
+   return 1;
+}
+
+static int
+progress_resume(char* backup_base, struct parallel_state* state)
+{
+   int hash = HASH_ALGORITHM_DEFAULT;
+   int number_of_entries = 0;
+   int number_of_done = 0;
+   char previous[MAX_PATH * 2];
+   char* journal = NULL;
+   struct parallel_file* entries = NULL;
+   struct parallel_file** sorted = NULL;
+   struct parallel_file* key = NULL;
+   struct parallel_file** found = NULL;
+   struct parallel_cleanup cleanup;
+   struct stat st;
+
+   memset(&cleanup, 0, sizeof(struct parallel_cleanup));
+
+   journal = join_path(backup_base, PARALLEL_PROGRESS);
+
+   if (!pgmoneta_exists(journal))
+   {
+      free(journal);
+      return 0;
+   }
+
+   memset(previous, 0, sizeof(previous));
+   if (progress_read(journal, previous, sizeof(previous), &hash, &number_of_entries, &entries) || hash != state->hash)
+   {
+      pgmoneta_log_warn("Parallel backup: Ignoring the progress journal in %s", backup_base);
+      number_of_entries = 0;
+   }
+
+   sorted = (struct parallel_file**)calloc(number_of_entries + 1, sizeof(struct parallel_file*));
+   cleanup.targets = (char**)calloc(state->number_of_files + 1, sizeof(char*));
+   if (sorted == NULL || cleanup.targets == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_entries; i++)
+   {
+      sorted[i] = &entries[i];
+   }
+   qsort(sorted, number_of_entries, sizeof(struct parallel_file*), file_path_compare);
+
+   for (int i = 0; i < state->number_of_files; i++)
+   {
+      struct parallel_file* file = &state->files[i];
+
+      cleanup.targets[cleanup.number_of_targets++] = file->target;
+
+      key = file;
+      found = (struct parallel_file**)bsearch(&key, sorted, number_of_entries, sizeof(struct parallel_file*), file_path_compare);
+
+      // only a file that is unchanged since before the earlier listing is kept
+      if (found == NULL || (*found)->size != file->size || strcmp((*found)->modified, file->modified) ||
+          strcmp(file->modified, previous) >= 0 || stat(file->target, &st) || (size_t)st.st_size != file->size)
+      {
+         continue;
+      }
+
+      if (state->hash != HASH_ALGORITHM_DEFAULT)
+      {
+         if ((*found)->checksum == NULL)
+         {
+            continue;
+         }
+         file->checksum = strdup((*found)->checksum);
+      }
+
+      file->done = true;
+      number_of_done++;
+   }
+
+   // the files that are gone from the server, or were copied halfway, are left out
+   qsort(cleanup.targets, cleanup.number_of_targets, sizeof(char*), string_compare);
+   if (pgmoneta_walk(backup_base, 0, 1, progress_cleanup, &cleanup))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_info("Parallel backup: Resuming %s with %d of %d files copied", backup_base, number_of_done, state->number_of_files);
+
+   for (int i = 0; i < number_of_entries; i++)
+   {
+      free(entries[i].path);
+      free(entries[i].checksum);
+   }
+   free(entries);
+   free(sorted);
+   free(cleanup.targets);
+   free(journal);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_entries; i++)
+   {
+      free(entries[i].path);
+      free(entries[i].checksum);
+   }
+   free(entries);
+   free(sorted);
+   free(cleanup.targets);
+   free(journal);
+
+   return 1;
+}
+
+static int
+progress_open(char* backup_base, char* listed, struct parallel_state* state)
+{
+   char* journal = NULL;
+
+   journal = join_path(backup_base, PARALLEL_PROGRESS);
+
+   state->progress = fopen(journal, "w");
+   if (state->progress == NULL)
+   {
+      goto error;
+   }
+
+   fprintf(state->progress, "%s\t%d\n", listed, state->hash);
+
+   for (int i = 0; i < state->number_of_files; i++)
+   {
+      if (state->files[i].done)
+      {
+         progress_add(state, &state->files[i]);
+      }
+   }
+
+   if (fflush(state->progress))
+   {
+      goto error;
+   }
+
+   free(journal);
+
+   return 0;
+
+error:
+
+   free(journal);
+
+   return 1;
+}
+
+static void
+progress_add(struct parallel_state* state, struct parallel_file* file)
+{
+   if (state->progress == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&state->progress_lock);
+   fprintf(state->progress, "%zu\t%s\t%s\t%s\n", file->size, file->modified,
+           file->checksum != NULL ? file->checksum : "-", file->path);
+   fflush(state->progress);
+   pthread_mutex_unlock(&state->progress_lock);
+}
+
+static int
+progress_read(char* path, char* listed, size_t size, int* hash, int* number_of_entries, struct parallel_file** entries)
+{
+   int n = 0;
+   int capacity = 0;
+   char* fields[4];
+   char* p = NULL;
+   char line[MAX_PATH * 2];
+   FILE* file = NULL;
+   struct parallel_file* e = NULL;
+   struct parallel_file* tmp = NULL;
+
+   *number_of_entries = 0;
+   *entries = NULL;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fgets(line, sizeof(line), file) == NULL)
+   {
+      goto error;
+   }
+
+   p = strchr(line, '\t');
+   if (p == NULL)
+   {
+      goto error;
+   }
+   *p = '\0';
+   snprintf(listed, size, "%s", line);
+   *hash = atoi(p + 1);
+
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      // a line without its end was cut by the failure
+      if (!pgmoneta_ends_with(line, "\n"))
+      {
+         break;
+      }
+      line[strlen(line) - 1] = '\0';
+
+      fields[0] = line;
+      for (int i = 1; i < 4; i++)
+      {
+         fields[i] = fields[i - 1] != NULL ? strchr(fields[i - 1], '\t') : NULL;
+         if (fields[i] != NULL)
+         {
+            *fields[i]++ = '\0';
+         }
+      }
+
+      if (fields[3] == NULL)
+      {
+         continue;
+      }
+
+      if (n == capacity)
+      {
+         capacity = capacity == 0 ? 1024 : capacity * 2;
+         tmp = (struct parallel_file*)realloc(e, capacity * sizeof(struct parallel_file));
+         if (tmp == NULL)
+         {
+            goto error;
+         }
+         e = tmp;
+      }
+
+      memset(&e[n], 0, sizeof(struct parallel_file));
+      e[n].size = strtoull(fields[0], NULL, 10);
+      snprintf(e[n].modified, sizeof(e[n].modified), "%s", fields[1]);
+      e[n].checksum = strcmp(fields[2], "-") ? strdup(fields[2]) : NULL;
+      e[n].path = strdup(fields[3]);
+      n++;
+   }
+
+   fclose(file);
+
+   *number_of_entries = n;
+   *entries = e;
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   for (int i = 0; i < n; i++)
+   {
+      free(e[i].path);
+      free(e[i].checksum);
+   }
+   free(e);
+
+   return 1;
+}
+
+static int
+progress_cleanup(struct walk_entry* entry, void* arg)
+{
+   char* path = entry->path;
+   struct parallel_cleanup* cleanup = (struct parallel_cleanup*)arg;
+
+   // backup.info and the journal are next to the data
+   if (entry->type != WALK_FILE || entry->depth == 0)
+   {
+      return WALK_CONTINUE;
+   }
+
+   if (bsearch(&path, cleanup->targets, cleanup->number_of_targets, sizeof(char*), string_compare) == NULL)
+   {
+      unlinkat(entry->dirfd, entry->name, 0);
+   }
+
+   return WALK_CONTINUE;
+}
+
+static int
+write_manifest(char* data, struct parallel_state* state, struct parallel_file* label, uint32_t timeline, char* startpos, char* endpos)
+{
+   int number_of_files = 0;
+   char* algorithm = NULL;
+   char* manifest = NULL;
+   char* checksum = NULL;
+   char* manifest_path = NULL;
+   FILE* file = NULL;
+   struct parallel_file** files = NULL;
+
+   switch (state->hash)
+   {
+      case HASH_ALGORITHM_SHA224:
+         algorithm = "SHA224";
+         break;
+      case HASH_ALGORITHM_SHA256:
+         algorithm = "SHA256";
+         break;
+      case HASH_ALGORITHM_SHA384:
+         algorithm = "SHA384";
+         break;
+      case HASH_ALGORITHM_SHA512:
+         algorithm = "SHA512";
+         break;
+      case HASH_ALGORITHM_CRC32C:
+         algorithm = "CRC32C";
+         break;
+      default:
+         break;
+   }
+
+   files = (struct parallel_file**)calloc(state->number_of_files + 1, sizeof(struct parallel_file*));
+   if (files == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < state->number_of_files; i++)
+   {
+      if (!state->files[i].missing)
+      {
+         files[number_of_files++] = &state->files[i];
+      }
+   }
+   files[number_of_files++] = label;
+
+   qsort(files, number_of_files, sizeof(struct parallel_file*), file_path_compare);
+
+   // the same layout as the manifest of BASE_BACKUP, since the checksum covers the bytes
+   manifest = pgmoneta_append(manifest, "{ \"PostgreSQL-Backup-Manifest-Version\": 1,\n\"Files\": [");
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      char modified[MISC_LENGTH];
+
+      memset(modified, 0, sizeof(modified));
+
+      if (strlen(files[i]->modified) > 0)
+      {
+         snprintf(modified, sizeof(modified), "%s", files[i]->modified);
+      }
+      else
+      {
+         time_t t = time(NULL);
+         strftime(modified, sizeof(modified), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+      }
+
+      manifest = pgmoneta_format_and_append(manifest, "%s{ \"Path\": \"%s\", \"Size\": %zu, \"Last-Modified\": \"%s GMT\"",
+                                            i == 0 ? "\n" : ",\n", files[i]->path, files[i]->size, modified);
+
+      if (algorithm != NULL && files[i]->checksum != NULL)
+      {
+         manifest = pgmoneta_format_and_append(manifest, ", \"Checksum-Algorithm\": \"%s\", \"Checksum\": \"%s\"",
+                                               algorithm, files[i]->checksum);
+      }
+
+      manifest = pgmoneta_append(manifest, " }");
+   }
+
+   manifest = pgmoneta_format_and_append(manifest, "\n],\n\"WAL-Ranges\": [\n{ \"Timeline\": %u, \"Start-LSN\": \"%s\", \"End-LSN\": \"%s\" }\n],\n",
+                                         timeline, startpos, endpos);
+
+   if (pgmoneta_generate_string_sha256_hash(manifest, &checksum))
+   {
+      goto error;
+   }
+
+   manifest = pgmoneta_format_and_append(manifest, "\"Manifest-Checksum\": \"%s\"}\n", checksum);
+
+   manifest_path = join_path(data, "backup_manifest");
+
+   file = fopen(manifest_path, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not create %s", manifest_path);
+      goto error;
+   }
+
+   if (fwrite(manifest, 1, strlen(manifest), file) != strlen(manifest))
+   {
+      goto error;
+   }
+
+   fclose(file);
+
+   free(files);
+   free(manifest);
+   free(checksum);
+   free(manifest_path);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   free(files);
+   free(manifest);
+   free(checksum);
+   free(manifest_path);
+
+   return 1;
+}
+
+static char*
+segment_name(uint32_t timeline, uint64_t segno, uint64_t wal_size)
+{
+   uint64_t segments_per_id = 0x100000000ULL / wal_size;
+
+   return pgmoneta_format_and_append(NULL, "%08X%08X%08X", timeline,
+                                     (uint32_t)(segno / segments_per_id),
+                                     (uint32_t)(segno % segments_per_id));
+}
+
+static uint64_t
+parse_lsn(char* lsn)
+{
+   uint32_t high = 0;
+   uint32_t low = 0;
+
+   if (sscanf(lsn, "%X/%X", &high, &low) != 2)
+   {
+      return 0;
+   }
+
+   return ((uint64_t)high << 32) | low;
+}
+
+static int
+file_size_compare(const void* a, const void* b)
+{
+   const struct parallel_file* fa = (const struct parallel_file*)a;
+   const struct parallel_file* fb = (const struct parallel_file*)b;
+
+   if (fa->size > fb->size)
+   {
+      return -1;
+   }
+   else if (fa->size < fb->size)
+   {
+      return 1;
+   }
+
+   return strcmp(fa->path, fb->path);
+}
+
+static int
+file_path_compare(const void* a, const void* b)
+{
+   const struct parallel_file* fa = *(const struct parallel_file**)a;
+   const struct parallel_file* fb = *(const struct parallel_file**)b;
+
+   return strcmp(fa->path, fb->path);
+}
+
+static int
+string_compare(const void* a, const void* b)
+{
+   return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void
+free_files(struct parallel_state* state)
+{
+   if (state->files == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < state->number_of_files; i++)
+   {
+      free(state->files[i].path);
+      free(state->files[i].target);
+      free(state->files[i].checksum);
+   }
+
+   free(state->files);
+   state->files = NULL;
+   state->number_of_files = 0;
+}
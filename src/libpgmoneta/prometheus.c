@@ -28,6 +28,7 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <gzip_compression.h>
 #include <info.h>
 #include <logging.h>
 #include <memory.h>
@@ -35,15 +36,22 @@
 #include <network.h>
 #include <prometheus.h>
 #include <shmem.h>
+#include <string_builder.h>
 #include <utils.h>
 #include <wal.h>
 
 /* system */
+#include <ctype.h>
+#include <errno.h>
 #include <ev.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
 #define CHUNK_SIZE 32768
@@ -53,15 +61,101 @@
 #define PAGE_METRICS 2
 #define BAD_REQUEST  3
 
+#define PROMETHEUS_MAX_CLIENTS 64
+#define PROMETHEUS_KEEP_ALIVE  120
+
+#define CONTENT_TYPE_TEXT        "text/plain; version=0.0.4; charset=utf-8"
+#define CONTENT_TYPE_OPENMETRICS "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/**
+ * The upper bounds of the buckets of the backup durations in seconds
+ */
+static const double backup_elapsed_buckets[PROMETHEUS_BACKUP_ELAPSED_BUCKETS] = {60, 300, 900, 1800, 3600, 7200, 14400, 28800};
+
+/**
+ * The upper bounds of the buckets of the workflow node durations in seconds
+ */
+static const double node_elapsed_buckets[PROMETHEUS_NODE_BUCKETS] = {1, 10, 60, 300, 900, 1800, 3600, 7200};
+
+/**
+ * The upper bounds of the buckets of the workflow node throughputs in MB/s
+ */
+static const double node_throughput_buckets[PROMETHEUS_NODE_BUCKETS] = {1, 10, 50, 100, 250, 500, 1000, 2500};
+
+/**
+ * The upper bounds of the buckets of the WAL latencies in seconds
+ */
+static const double latency_buckets[PROMETHEUS_LATENCY_BUCKETS] = {0.0001, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1};
+
+#define SECTION_BACKUP 0
+#define SECTION_SIZE   1
+#define SECTIONS       2
+
+/**
+ * The backups of a server, they are read once for a scrape
+ */
+struct prometheus_backups
+{
+   int number_of_backups;   /**< The number of backups */
+   struct backup** backups; /**< The backups */
+};
+
+/** @struct prometheus_request
+ * Defines a request to the metrics server
+ */
+struct prometheus_request
+{
+   int page;         /**< The page */
+   bool keep_alive;  /**< Is the connection kept open */
+   bool gzip;        /**< Does the client accept gzip */
+   bool openmetrics; /**< Does the client accept OpenMetrics */
+};
+
+/** @struct prometheus_fragment
+ * Defines the metrics of the backups of a server. They are built again when the
+ * backups of the server changed, or the configuration was reloaded
+ */
+struct prometheus_fragment
+{
+   unsigned long long version; /**< The version of the backups */
+   unsigned long generation;   /**< The generation of the configuration */
+   char* data[SECTIONS];       /**< The metrics per section */
+};
+
+static struct prometheus_fragment fragments[NUMBER_OF_SERVERS];
+
+static int metrics_pipe[2] = {-1, -1};
+static pthread_t metrics_thread;
+static volatile bool metrics_running = false;
+
+static void* server_run(void* arg);
+static bool poll_pending(int fd);
+static void close_client(int client_fd);
+static void serve_request(int client_fd, bool* keep_alive);
+static void resolve_request(struct message* msg, struct prometheus_request* request);
+static bool header_contains(char* headers, char* name, char* token);
+
 static int resolve_page(struct message* msg);
 static int unknown_page(int client_fd);
 static int home_page(int client_fd);
-static int metrics_page(int client_fd);
+static int metrics_page(int client_fd, struct prometheus_request* request);
 static int bad_request(int client_fd);
-
-static void general_information(int client_fd);
-static void backup_information(int client_fd);
-static void size_information(int client_fd);
+static int send_response(int client_fd, char* content_type, char* body, size_t length, bool gzip, bool keep_alive);
+static char* openmetrics(char* text);
+
+static void backups_refresh(int server);
+static void general_information(struct string_builder* data);
+static void backup_information(struct string_builder* data, int first, int last, struct prometheus_backups* snapshot);
+static void size_information(struct string_builder* data, int first, int last, struct prometheus_backups* snapshot);
+static void state_information(struct string_builder* data);
+static void fragment_information(struct string_builder* data);
+static void fragment_build(int server, unsigned long long version, unsigned long generation);
+static char* fragment_merge(char** sections, int number_of_sections);
+static void workflow_information(struct string_builder* data);
+static struct prometheus_node* workflow_node(int server, char* name);
+static void latency_histogram(struct string_builder* data, char* metric, char* help, int type);
+static void histogram_observe(struct prometheus_histogram* h, double seconds);
+static void worker_histogram(struct string_builder* data, char* metric, char* help, struct prometheus_histogram* h);
 
 static int send_chunk(int client_fd, char* data);
 
@@ -72,59 +166,77 @@ static bool metrics_cache_finalize(void);
 static size_t metrics_cache_size_to_alloc(void);
 static void metrics_cache_invalidate(void);
 
-void
-pgmoneta_prometheus(int client_fd)
+int
+pgmoneta_prometheus_start(void)
 {
-   int status;
-   int page;
-   struct message* msg = NULL;
-   struct configuration* config;
-
-   pgmoneta_start_logging();
-   pgmoneta_memory_init();
-
-   config = (struct configuration*)shmem;
+   if (metrics_running)
+   {
+      return 0;
+   }
 
-   status = pgmoneta_read_timeout_message(NULL, client_fd, config->authentication_timeout, &msg);
-   if (status != MESSAGE_STATUS_OK)
+   if (pipe(metrics_pipe) != 0)
    {
+      pgmoneta_log_error("Prometheus: Could not create pipe: %s", strerror(errno));
+      errno = 0;
       goto error;
    }
 
-   page = resolve_page(msg);
+   metrics_running = true;
 
-   if (page == PAGE_HOME)
-   {
-      home_page(client_fd);
-   }
-   else if (page == PAGE_METRICS)
+   if (pthread_create(&metrics_thread, NULL, server_run, NULL) != 0)
    {
-      metrics_page(client_fd);
+      pgmoneta_log_error("Prometheus: Could not create the metrics server thread");
+      metrics_running = false;
+      goto error;
    }
-   else if (page == PAGE_UNKNOWN)
+
+   return 0;
+
+error:
+
+   if (metrics_pipe[0] != -1)
    {
-      unknown_page(client_fd);
+      close(metrics_pipe[0]);
+      close(metrics_pipe[1]);
+      metrics_pipe[0] = -1;
+      metrics_pipe[1] = -1;
    }
-   else
+
+   return 1;
+}
+
+void
+pgmoneta_prometheus_serve(int client_fd)
+{
+   if (!metrics_running || write(metrics_pipe[1], &client_fd, sizeof(int)) != sizeof(int))
    {
-      bad_request(client_fd);
+      pgmoneta_disconnect(client_fd);
    }
+}
 
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_memory_destroy();
-   pgmoneta_stop_logging();
+void
+pgmoneta_prometheus_stop(void)
+{
+   int stop = -1;
 
-   exit(0);
+   if (!metrics_running)
+   {
+      return;
+   }
 
-error:
+   metrics_running = false;
 
-   pgmoneta_disconnect(client_fd);
+   if (write(metrics_pipe[1], &stop, sizeof(int)) != sizeof(int))
+   {
+      pgmoneta_log_debug("Prometheus: Could not wake up the metrics server");
+   }
 
-   pgmoneta_memory_destroy();
-   pgmoneta_stop_logging();
+   pthread_join(metrics_thread, NULL);
 
-   exit(1);
+   close(metrics_pipe[0]);
+   close(metrics_pipe[1]);
+   metrics_pipe[0] = -1;
+   metrics_pipe[1] = -1;
 }
 
 void
@@ -147,6 +259,62 @@ retry_cache_locking:
       atomic_store(&config->prometheus.logging_warn, 0);
       atomic_store(&config->prometheus.logging_error, 0);
       atomic_store(&config->prometheus.logging_fatal, 0);
+      atomic_store(&config->prometheus.memory_pool_allocations, 0);
+      atomic_store(&config->prometheus.memory_pool_cache_hits, 0);
+      atomic_store(&config->prometheus.memory_pool_oversized, 0);
+      atomic_store(&config->prometheus.worker_busy, 0);
+      atomic_store(&config->prometheus.worker_idle, 0);
+      for (int i = 0; i < PROMETHEUS_LATENCY_BUCKETS; i++)
+      {
+         atomic_store(&config->prometheus.worker_task.bucket[i], 0);
+         atomic_store(&config->prometheus.worker_queue_wait.bucket[i], 0);
+      }
+      atomic_store(&config->prometheus.worker_task.count, 0);
+      atomic_store(&config->prometheus.worker_task.sum, 0);
+      atomic_store(&config->prometheus.worker_queue_wait.count, 0);
+      atomic_store(&config->prometheus.worker_queue_wait.sum, 0);
+
+      for (int i = 0; i < config->number_of_servers; i++)
+      {
+         atomic_store(&config->servers[i].metrics.wal_segments, 0);
+         atomic_store(&config->servers[i].metrics.trash_files, 0);
+         for (int j = 0; j < PROMETHEUS_BACKUP_ELAPSED_BUCKETS; j++)
+         {
+            atomic_store(&config->servers[i].metrics.backup_elapsed_bucket[j], 0);
+         }
+         atomic_store(&config->servers[i].metrics.backup_elapsed_count, 0);
+         atomic_store(&config->servers[i].metrics.backup_elapsed_sum, 0);
+
+         for (int j = 0; j < PROMETHEUS_NODES; j++)
+         {
+            struct prometheus_node* node = &config->servers[i].metrics.nodes[j];
+
+            for (int k = 0; k < PROMETHEUS_NODE_BUCKETS; k++)
+            {
+               atomic_store(&node->elapsed_bucket[k], 0);
+               atomic_store(&node->throughput_bucket[k], 0);
+            }
+            atomic_store(&node->count, 0);
+            atomic_store(&node->elapsed_sum, 0);
+            atomic_store(&node->throughput_sum, 0);
+            atomic_store(&node->bytes_in, 0);
+            atomic_store(&node->bytes_out, 0);
+            atomic_store(&node->files, 0);
+         }
+
+         atomic_store(&config->servers[i].metrics.wal_received, 0);
+         for (int j = 0; j < PROMETHEUS_WAL_LATENCIES; j++)
+         {
+            struct prometheus_histogram* h = &config->servers[i].metrics.wal_latency[j];
+
+            for (int k = 0; k < PROMETHEUS_LATENCY_BUCKETS; k++)
+            {
+               atomic_store(&h->bucket[k], 0);
+            }
+            atomic_store(&h->count, 0);
+            atomic_store(&h->sum, 0);
+         }
+      }
 
       atomic_store(&cache->lock, STATE_FREE);
    }
@@ -183,112 +351,612 @@ pgmoneta_prometheus_logging(int type)
    }
 }
 
-static int
-resolve_page(struct message* msg)
+void
+pgmoneta_prometheus_refresh(int server)
 {
-   char* from = NULL;
-   int index;
+   char* d = NULL;
+   unsigned long long size = 0;
+   struct configuration* config;
 
-   if (msg->length < 3 || strncmp((char*)msg->data, "GET", 3) != 0)
+   config = (struct configuration*)shmem;
+
+   backups_refresh(server);
+
+   d = pgmoneta_get_server_backup(server);
+   atomic_store(&config->servers[server].metrics.backup_total_size, pgmoneta_directory_size(d));
+   free(d);
+
+   d = pgmoneta_get_server_wal(server);
+   size = pgmoneta_directory_size(d);
+   free(d);
+
+   d = pgmoneta_get_server_wal_shipping_wal(server);
+   if (d != NULL)
    {
-      pgmoneta_log_debug("Promethus: Not a GET request");
-      return BAD_REQUEST;
+      size += pgmoneta_directory_size(d);
    }
+   free(d);
 
-   index = 4;
-   from = (char*)msg->data + index;
+   atomic_store(&config->servers[server].metrics.wal_total_size, size);
 
-   while (pgmoneta_read_byte(msg->data + index) != ' ')
+   d = pgmoneta_get_server(server);
+   size = pgmoneta_directory_size(d);
+   free(d);
+
+   d = pgmoneta_get_server_wal_shipping(server);
+   if (d != NULL)
    {
-      index++;
+      size += pgmoneta_directory_size(d);
    }
+   free(d);
 
-   pgmoneta_write_byte(msg->data + index, '\0');
+   atomic_store(&config->servers[server].metrics.total_size, size);
 
-   if (strcmp(from, "/") == 0 || strcmp(from, "/index.html") == 0)
+   atomic_fetch_add(&config->servers[server].metrics.backups_version, 1);
+}
+
+void
+pgmoneta_prometheus_backup_added(int server, uint64_t size)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   backups_refresh(server);
+
+   // the directories only grew by the new backup, so they aren't walked again
+   atomic_fetch_add(&config->servers[server].metrics.backup_total_size, size);
+   atomic_fetch_add(&config->servers[server].metrics.total_size, size);
+
+   atomic_fetch_add(&config->servers[server].metrics.backups_version, 1);
+}
+
+void
+pgmoneta_prometheus_backup_elapsed(int server, double seconds)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < PROMETHEUS_BACKUP_ELAPSED_BUCKETS; i++)
    {
-      return PAGE_HOME;
+      if (seconds <= backup_elapsed_buckets[i])
+      {
+         atomic_fetch_add(&config->servers[server].metrics.backup_elapsed_bucket[i], 1);
+         break;
+      }
    }
-   else if (strcmp(from, "/metrics") == 0)
+
+   atomic_fetch_add(&config->servers[server].metrics.backup_elapsed_count, 1);
+   atomic_fetch_add(&config->servers[server].metrics.backup_elapsed_sum, (unsigned long long)seconds);
+}
+
+void
+pgmoneta_prometheus_wal_segment(int server, size_t size)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   atomic_fetch_add(&config->servers[server].metrics.wal_segments, 1);
+   atomic_fetch_add(&config->servers[server].metrics.wal_total_size, size);
+   atomic_fetch_add(&config->servers[server].metrics.total_size, size);
+}
+
+void
+pgmoneta_prometheus_wal_received(int server, size_t bytes)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   atomic_fetch_add(&config->servers[server].metrics.wal_received, bytes);
+}
+
+void
+pgmoneta_prometheus_wal_rate(int server, uint64_t rate)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   atomic_store(&config->servers[server].metrics.wal_receive_rate, rate);
+}
+
+void
+pgmoneta_prometheus_wal_primary(int server, uint64_t primary, uint64_t received)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   atomic_store(&config->servers[server].metrics.wal_primary_lsn, primary);
+   atomic_store(&config->servers[server].metrics.wal_behind, primary > received ? primary - received : 0);
+}
+
+void
+pgmoneta_prometheus_wal_latency(int server, int type, double seconds)
+{
+   struct prometheus_histogram* h = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (type < 0 || type >= PROMETHEUS_WAL_LATENCIES)
    {
-      return PAGE_METRICS;
+      return;
    }
 
-   return PAGE_UNKNOWN;
+   h = &config->servers[server].metrics.wal_latency[type];
+
+   histogram_observe(h, seconds);
 }
 
-static int
-unknown_page(int client_fd)
+void
+pgmoneta_prometheus_worker_alive(int delta)
 {
-   char* data = NULL;
-   time_t now;
-   char time_buf[32];
-   int status;
-   struct message msg;
+   struct configuration* config;
 
-   memset(&msg, 0, sizeof(struct message));
-   memset(&data, 0, sizeof(data));
+   config = (struct configuration*)shmem;
 
-   now = time(NULL);
+   atomic_fetch_add(&config->prometheus.worker_alive, delta);
+}
 
-   memset(&time_buf, 0, sizeof(time_buf));
-   ctime_r(&now, &time_buf[0]);
-   time_buf[strlen(time_buf) - 1] = 0;
+void
+pgmoneta_prometheus_worker_task(double queue_wait, double seconds)
+{
+   struct configuration* config;
 
-   data = pgmoneta_append(data, "HTTP/1.1 403 Forbidden\r\n");
-   data = pgmoneta_append(data, "Date: ");
-   data = pgmoneta_append(data, &time_buf[0]);
-   data = pgmoneta_append(data, "\r\n");
+   config = (struct configuration*)shmem;
 
-   msg.kind = 0;
-   msg.length = strlen(data);
-   msg.data = data;
+   histogram_observe(&config->prometheus.worker_queue_wait, queue_wait);
+   histogram_observe(&config->prometheus.worker_task, seconds);
+   atomic_fetch_add(&config->prometheus.worker_busy, (unsigned long long)(seconds * 1000000));
+}
 
-   status = pgmoneta_write_message(NULL, client_fd, &msg);
+void
+pgmoneta_prometheus_worker_active(int delta)
+{
+   struct configuration* config;
 
-   free(data);
+   config = (struct configuration*)shmem;
 
-   return status;
+   atomic_fetch_add(&config->prometheus.worker_active, delta);
 }
 
-static int
-home_page(int client_fd)
+void
+pgmoneta_prometheus_worker_idle(double seconds)
 {
-   char* data = NULL;
-   time_t now;
-   char time_buf[32];
-   int status;
-   struct message msg;
+   struct configuration* config;
 
-   memset(&msg, 0, sizeof(struct message));
-   memset(&data, 0, sizeof(data));
+   config = (struct configuration*)shmem;
 
-   now = time(NULL);
+   atomic_fetch_add(&config->prometheus.worker_idle, (unsigned long long)(seconds * 1000000));
+}
 
-   memset(&time_buf, 0, sizeof(time_buf));
-   ctime_r(&now, &time_buf[0]);
-   time_buf[strlen(time_buf) - 1] = 0;
+void
+pgmoneta_prometheus_workflow_node(int server, char* name, double seconds, uint64_t bytes_in, uint64_t bytes_out, uint64_t files)
+{
+   double throughput = 0.0;
+   uint64_t bytes;
+   struct prometheus_node* node = NULL;
 
-   data = pgmoneta_append(data, "HTTP/1.1 200 OK\r\n");
-   data = pgmoneta_append(data, "Content-Type: text/html; charset=utf-8\r\n");
-   data = pgmoneta_append(data, "Date: ");
-   data = pgmoneta_append(data, &time_buf[0]);
-   data = pgmoneta_append(data, "\r\n");
-   data = pgmoneta_append(data, "Transfer-Encoding: chunked\r\n");
-   data = pgmoneta_append(data, "\r\n");
+   node = workflow_node(server, name);
+   if (node == NULL)
+   {
+      pgmoneta_log_debug("Prometheus: No slot for workflow node %s", name);
+      return;
+   }
 
-   msg.kind = 0;
-   msg.length = strlen(data);
-   msg.data = data;
+   bytes = bytes_in > bytes_out ? bytes_in : bytes_out;
+   if (seconds > 0.0)
+   {
+      throughput = (bytes / seconds) / 1e6;
+   }
 
-   status = pgmoneta_write_message(NULL, client_fd, &msg);
-   if (status != MESSAGE_STATUS_OK)
+   for (int i = 0; i < PROMETHEUS_NODE_BUCKETS; i++)
    {
-      goto done;
+      if (seconds <= node_elapsed_buckets[i])
+      {
+         atomic_fetch_add(&node->elapsed_bucket[i], 1);
+         break;
+      }
    }
 
-   free(data);
-   data = NULL;
+   for (int i = 0; i < PROMETHEUS_NODE_BUCKETS; i++)
+   {
+      if (throughput <= node_throughput_buckets[i])
+      {
+         atomic_fetch_add(&node->throughput_bucket[i], 1);
+         break;
+      }
+   }
+
+   atomic_fetch_add(&node->count, 1);
+   atomic_fetch_add(&node->elapsed_sum, (unsigned long long)(seconds * 1000));
+   atomic_fetch_add(&node->throughput_sum, (unsigned long long)(throughput * 1000));
+   atomic_fetch_add(&node->bytes_in, bytes_in);
+   atomic_fetch_add(&node->bytes_out, bytes_out);
+   atomic_fetch_add(&node->files, files);
+}
+
+static void*
+server_run(void* arg)
+{
+   int n;
+   int number_of_clients = 0;
+   int clients[PROMETHEUS_MAX_CLIENTS];
+   time_t last_used[PROMETHEUS_MAX_CLIENTS];
+   struct pollfd fds[PROMETHEUS_MAX_CLIENTS + 1];
+   bool keep_alive;
+   time_t now;
+   sigset_t mask;
+
+   (void)arg;
+
+   // the signals are handled by the main loop
+   sigfillset(&mask);
+   pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+   pgmoneta_cpu_affinity(-1);
+
+   pgmoneta_memory_init();
+
+   while (metrics_running)
+   {
+      fds[0].fd = metrics_pipe[0];
+      fds[0].events = POLLIN;
+      fds[0].revents = 0;
+
+      for (int i = 0; i < number_of_clients; i++)
+      {
+         fds[i + 1].fd = clients[i];
+         fds[i + 1].events = POLLIN;
+         fds[i + 1].revents = 0;
+      }
+
+      n = poll(fds, number_of_clients + 1, 1000);
+      if (n < 0)
+      {
+         if (errno != EINTR)
+         {
+            pgmoneta_log_error("Prometheus: poll: %s", strerror(errno));
+         }
+         errno = 0;
+         continue;
+      }
+
+      now = time(NULL);
+
+      for (int i = 0; i < number_of_clients; i++)
+      {
+         if (fds[i + 1].revents != 0)
+         {
+            keep_alive = false;
+
+            if (fds[i + 1].revents & POLLIN)
+            {
+               serve_request(clients[i], &keep_alive);
+            }
+
+            if (keep_alive)
+            {
+               last_used[i] = now;
+            }
+            else
+            {
+               close_client(clients[i]);
+               clients[i] = -1;
+            }
+         }
+         else if (now - last_used[i] > PROMETHEUS_KEEP_ALIVE)
+         {
+            close_client(clients[i]);
+            clients[i] = -1;
+         }
+      }
+
+      n = 0;
+      for (int i = 0; i < number_of_clients; i++)
+      {
+         if (clients[i] != -1)
+         {
+            clients[n] = clients[i];
+            last_used[n] = last_used[i];
+            n++;
+         }
+      }
+      number_of_clients = n;
+
+      if (fds[0].revents & POLLIN)
+      {
+         int client_fd;
+
+         while (read(metrics_pipe[0], &client_fd, sizeof(int)) == sizeof(int))
+         {
+            if (client_fd == -1)
+            {
+               break;
+            }
+
+            // make room by dropping the connection that was idle the longest
+            if (number_of_clients == PROMETHEUS_MAX_CLIENTS)
+            {
+               int oldest = 0;
+
+               for (int i = 1; i < number_of_clients; i++)
+               {
+                  if (last_used[i] < last_used[oldest])
+                  {
+                     oldest = i;
+                  }
+               }
+
+               close_client(clients[oldest]);
+               clients[oldest] = clients[number_of_clients - 1];
+               last_used[oldest] = last_used[number_of_clients - 1];
+               number_of_clients--;
+            }
+
+            clients[number_of_clients] = client_fd;
+            last_used[number_of_clients] = now;
+            number_of_clients++;
+
+            if (!poll_pending(metrics_pipe[0]))
+            {
+               break;
+            }
+         }
+      }
+   }
+
+   for (int i = 0; i < number_of_clients; i++)
+   {
+      close_client(clients[i]);
+   }
+
+   pgmoneta_memory_destroy();
+
+   return NULL;
+}
+
+static bool
+poll_pending(int fd)
+{
+   struct pollfd pfd;
+
+   pfd.fd = fd;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+
+   return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+static void
+close_client(int client_fd)
+{
+   // forked children hold a copy of the descriptor, so end the connection for all of them
+   shutdown(client_fd, SHUT_RDWR);
+   pgmoneta_disconnect(client_fd);
+}
+
+static void
+serve_request(int client_fd, bool* keep_alive)
+{
+   int status;
+   struct message* msg = NULL;
+   struct prometheus_request request;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *keep_alive = false;
+
+   status = pgmoneta_read_timeout_message(NULL, client_fd, config->authentication_timeout, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      return;
+   }
+
+   resolve_request(msg, &request);
+
+   if (request.page == PAGE_HOME)
+   {
+      status = home_page(client_fd);
+   }
+   else if (request.page == PAGE_METRICS)
+   {
+      status = metrics_page(client_fd, &request);
+   }
+   else if (request.page == PAGE_UNKNOWN)
+   {
+      status = unknown_page(client_fd);
+   }
+   else
+   {
+      status = bad_request(client_fd);
+      request.keep_alive = false;
+   }
+
+   *keep_alive = request.keep_alive && status == MESSAGE_STATUS_OK;
+}
+
+static void
+resolve_request(struct message* msg, struct prometheus_request* request)
+{
+   char* headers = NULL;
+
+   memset(request, 0, sizeof(struct prometheus_request));
+
+   headers = (char*)malloc(msg->length + 1);
+   if (headers != NULL)
+   {
+      memcpy(headers, msg->data, msg->length);
+      headers[msg->length] = '\0';
+
+      for (char* c = headers; *c != '\0'; c++)
+      {
+         *c = tolower((unsigned char)*c);
+      }
+
+      // HTTP/1.1 keeps the connection by default, HTTP/1.0 has to ask for it
+      if (strstr(headers, "http/1.0\r\n") != NULL)
+      {
+         request->keep_alive = header_contains(headers, "connection", "keep-alive");
+      }
+      else
+      {
+         request->keep_alive = !header_contains(headers, "connection", "close");
+      }
+
+      request->gzip = header_contains(headers, "accept-encoding", "gzip");
+      request->openmetrics = header_contains(headers, "accept", "application/openmetrics-text");
+
+      free(headers);
+   }
+
+   request->page = resolve_page(msg);
+}
+
+static bool
+header_contains(char* headers, char* name, char* token)
+{
+   char key[64];
+   char* line = NULL;
+   char* end = NULL;
+   bool found = false;
+
+   snprintf(key, sizeof(key), "\r\n%s:", name);
+
+   line = strstr(headers, key);
+   if (line != NULL)
+   {
+      line += strlen(key);
+      end = strstr(line, "\r\n");
+      if (end != NULL)
+      {
+         *end = '\0';
+      }
+
+      found = strstr(line, token) != NULL;
+
+      if (end != NULL)
+      {
+         *end = '\r';
+      }
+   }
+
+   return found;
+}
+
+static int
+resolve_page(struct message* msg)
+{
+   char* from = NULL;
+   int index;
+
+   if (msg->length < 3 || strncmp((char*)msg->data, "GET", 3) != 0)
+   {
+      pgmoneta_log_debug("Promethus: Not a GET request");
+      return BAD_REQUEST;
+   }
+
+   index = 4;
+   from = (char*)msg->data + index;
+
+   while (pgmoneta_read_byte(msg->data + index) != ' ')
+   {
+      index++;
+   }
+
+   pgmoneta_write_byte(msg->data + index, '\0');
+
+   if (strcmp(from, "/") == 0 || strcmp(from, "/index.html") == 0)
+   {
+      return PAGE_HOME;
+   }
+   else if (strcmp(from, "/metrics") == 0)
+   {
+      return PAGE_METRICS;
+   }
+
+   return PAGE_UNKNOWN;
+}
+
+static int
+unknown_page(int client_fd)
+{
+   char* data = NULL;
+   time_t now;
+   char time_buf[32];
+   int status;
+   struct message msg;
+
+   memset(&msg, 0, sizeof(struct message));
+   memset(&data, 0, sizeof(data));
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   data = pgmoneta_append(data, "HTTP/1.1 403 Forbidden\r\n");
+   data = pgmoneta_append(data, "Date: ");
+   data = pgmoneta_append(data, &time_buf[0]);
+   data = pgmoneta_append(data, "\r\n");
+   data = pgmoneta_append(data, "Content-Length: 0\r\n");
+   data = pgmoneta_append(data, "\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = pgmoneta_write_message(NULL, client_fd, &msg);
+
+   free(data);
+
+   return status;
+}
+
+static int
+home_page(int client_fd)
+{
+   char* data = NULL;
+   time_t now;
+   char time_buf[32];
+   int status;
+   struct message msg;
+
+   memset(&msg, 0, sizeof(struct message));
+   memset(&data, 0, sizeof(data));
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   data = pgmoneta_append(data, "HTTP/1.1 200 OK\r\n");
+   data = pgmoneta_append(data, "Content-Type: text/html; charset=utf-8\r\n");
+   data = pgmoneta_append(data, "Date: ");
+   data = pgmoneta_append(data, &time_buf[0]);
+   data = pgmoneta_append(data, "\r\n");
+   data = pgmoneta_append(data, "Transfer-Encoding: chunked\r\n");
+   data = pgmoneta_append(data, "\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = pgmoneta_write_message(NULL, client_fd, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      goto done;
+   }
+
+   free(data);
+   data = NULL;
 
    data = pgmoneta_append(data, "<html>\n");
    data = pgmoneta_append(data, "<head>\n");
@@ -323,6 +991,39 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "  <h2>pgmoneta_logging_fatal</h2>\n");
    data = pgmoneta_append(data, "  The number of FATAL logging statements\n");
    data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_memory_pool_allocations</h2>\n");
+   data = pgmoneta_append(data, "  The number of buffers handed out by the memory pool\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_memory_pool_cache_hits</h2>\n");
+   data = pgmoneta_append(data, "  The number of buffers reused from a thread cache\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_memory_pool_oversized</h2>\n");
+   data = pgmoneta_append(data, "  The number of buffers larger than the largest size class\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_memory_used_bytes</h2>\n");
+   data = pgmoneta_append(data, "  The memory of memory_budget in use\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_memory_budget_bytes</h2>\n");
+   data = pgmoneta_append(data, "  The memory budget, 0 for no limit\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_worker_alive</h2>\n");
+   data = pgmoneta_append(data, "  The number of alive workers\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_worker_active</h2>\n");
+   data = pgmoneta_append(data, "  The number of workers running a task\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_worker_busy_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The time the workers spent running tasks\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_worker_idle_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The time the workers spent waiting for tasks\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_worker_task_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The run time of the worker tasks\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_worker_queue_wait_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The time the worker tasks waited in a queue\n");
+   data = pgmoneta_append(data, "  <p>\n");
    data = pgmoneta_append(data, "  <h2>pgmoneta_retention_days</h2>\n");
    data = pgmoneta_append(data, "  The retention of pgmoneta in days\n");
    data = pgmoneta_append(data, "  <h2>pgmoneta_retention_weeks</h2>\n");
@@ -1041,14 +1742,303 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "      <tr>\n");
-   data = pgmoneta_append(data, "        <td>label</td>\n");
-   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
+   data = pgmoneta_append(data, "        <td>label</td>\n");
+   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_checksum_failures</h2>\n");
+   data = pgmoneta_append(data, "  The number of pages that failed the checksum verification in a backup\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>label</td>\n");
+   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_compression_ratio</h2>\n");
+   data = pgmoneta_append(data, "  The ratio of backup size to restore size for each backup\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>label</td>\n");
+   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_retain</h2>\n");
+   data = pgmoneta_append(data, "  Retain a backup for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>label</td>\n");
+   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_total_size</h2>\n");
+   data = pgmoneta_append(data, "  The total size of the backups for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_total_size</h2>\n");
+   data = pgmoneta_append(data, "  The total size of the WAL for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_total_size</h2>\n");
+   data = pgmoneta_append(data, "  The total size for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_active_backup</h2>\n");
+   data = pgmoneta_append(data, "  Is there an active backup for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_active_restore</h2>\n");
+   data = pgmoneta_append(data, "  Is there an active restore for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_active_archiving</h2>\n");
+   data = pgmoneta_append(data, "  Is there an active archiving for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_current_wal_file</h2>\n");
+   data = pgmoneta_append(data, "  The current streaming WAL filename of a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>file</td>\n");
+   data = pgmoneta_append(data, "        <td>The current WAL filename for this server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_current_wal_lsn</h2>\n");
+   data = pgmoneta_append(data, "  The current WAL log sequence number\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>lsn</td>\n");
+   data = pgmoneta_append(data, "        <td>The current WAL log sequence number</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_lag</h2>\n");
+   data = pgmoneta_append(data, "  The number of bytes a WAL target is behind the WAL stream\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>target</td>\n");
+   data = pgmoneta_append(data, "        <td>The WAL target, wal_shipping, ssh or archive</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_archive_failed</h2>\n");
+   data = pgmoneta_append(data, "  The number of WAL segments that could not be archived to the storage engine\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_segments</h2>\n");
+   data = pgmoneta_append(data, "  The number of WAL segments received for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_trash_backups</h2>\n");
+   data = pgmoneta_append(data, "  The number of deleted backups waiting in the trash of a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_trash_files</h2>\n");
+   data = pgmoneta_append(data, "  The number of files unlinked from the trash of a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_elapsed_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The duration of the backups for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>le</td>\n");
+   data = pgmoneta_append(data, "        <td>The upper bound of the bucket in seconds</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_received_bytes</h2>\n");
+   data = pgmoneta_append(data, "  The number of WAL bytes received for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_receive_rate</h2>\n");
+   data = pgmoneta_append(data, "  The WAL bytes received per second for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_primary_lsn</h2>\n");
+   data = pgmoneta_append(data, "  The WAL end position reported by the primary for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_behind_bytes</h2>\n");
+   data = pgmoneta_append(data, "  The number of WAL bytes the WAL stream is behind the primary for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_write_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The latency of the WAL writes for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>le</td>\n");
+   data = pgmoneta_append(data, "        <td>The upper bound of the bucket in seconds</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "    </tbody>\n");
+   data = pgmoneta_append(data, "  </table>\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_flush_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The latency of the WAL flushes to disk for a server\n");
+   data = pgmoneta_append(data, "  <table border=\"1\">\n");
+   data = pgmoneta_append(data, "    <tbody>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>name</td>\n");
+   data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>le</td>\n");
+   data = pgmoneta_append(data, "        <td>The upper bound of the bucket in seconds</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_compression_ratio</h2>\n");
-   data = pgmoneta_append(data, "  The ratio of backup size to restore size for each backup\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_close_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The latency of closing a WAL segment for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
@@ -1056,29 +2046,25 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "      <tr>\n");
-   data = pgmoneta_append(data, "        <td>label</td>\n");
-   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
+   data = pgmoneta_append(data, "        <td>le</td>\n");
+   data = pgmoneta_append(data, "        <td>The upper bound of the bucket in seconds</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_retain</h2>\n");
-   data = pgmoneta_append(data, "  Retain a backup for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_active</h2>\n");
+   data = pgmoneta_append(data, "  The number of running workflows for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
    data = pgmoneta_append(data, "        <td>name</td>\n");
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
-   data = pgmoneta_append(data, "      <tr>\n");
-   data = pgmoneta_append(data, "        <td>label</td>\n");
-   data = pgmoneta_append(data, "        <td>The backup label</td>\n");
-   data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_backup_total_size</h2>\n");
-   data = pgmoneta_append(data, "  The total size of the backups for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_bytes</h2>\n");
+   data = pgmoneta_append(data, "  The bytes processed by the running workflows for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
@@ -1088,8 +2074,8 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_wal_total_size</h2>\n");
-   data = pgmoneta_append(data, "  The total size of the WAL for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_files</h2>\n");
+   data = pgmoneta_append(data, "  The files processed by the running workflows for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
@@ -1099,8 +2085,8 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_total_size</h2>\n");
-   data = pgmoneta_append(data, "  The total size for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_nodes</h2>\n");
+   data = pgmoneta_append(data, "  The workflow nodes done by the running workflows for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
@@ -1110,41 +2096,61 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_active_backup</h2>\n");
-   data = pgmoneta_append(data, "  Is there an active backup for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_node_elapsed_seconds</h2>\n");
+   data = pgmoneta_append(data, "  The duration of a workflow node for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
    data = pgmoneta_append(data, "        <td>name</td>\n");
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>node</td>\n");
+   data = pgmoneta_append(data, "        <td>The name of the workflow node</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>le</td>\n");
+   data = pgmoneta_append(data, "        <td>The upper bound of the bucket in seconds</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_active_restore</h2>\n");
-   data = pgmoneta_append(data, "  Is there an active restore for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_node_throughput_mbs</h2>\n");
+   data = pgmoneta_append(data, "  The throughput of a workflow node in MB/s for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
    data = pgmoneta_append(data, "        <td>name</td>\n");
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>node</td>\n");
+   data = pgmoneta_append(data, "        <td>The name of the workflow node</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>le</td>\n");
+   data = pgmoneta_append(data, "        <td>The upper bound of the bucket in MB/s</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_active_archiving</h2>\n");
-   data = pgmoneta_append(data, "  Is there an active archiving for a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_node_bytes_in</h2>\n");
+   data = pgmoneta_append(data, "  The bytes of the directory before a workflow node for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
    data = pgmoneta_append(data, "        <td>name</td>\n");
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
+   data = pgmoneta_append(data, "      <tr>\n");
+   data = pgmoneta_append(data, "        <td>node</td>\n");
+   data = pgmoneta_append(data, "        <td>The name of the workflow node</td>\n");
+   data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_current_wal_file</h2>\n");
-   data = pgmoneta_append(data, "  The current streaming WAL filename of a server\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_node_bytes_out</h2>\n");
+   data = pgmoneta_append(data, "  The bytes of the directory after a workflow node for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
@@ -1152,14 +2158,14 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "      <tr>\n");
-   data = pgmoneta_append(data, "        <td>file</td>\n");
-   data = pgmoneta_append(data, "        <td>The current WAL filename for this server</td>\n");
+   data = pgmoneta_append(data, "        <td>node</td>\n");
+   data = pgmoneta_append(data, "        <td>The name of the workflow node</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
    data = pgmoneta_append(data, "  <p>\n");
-   data = pgmoneta_append(data, "  <h2>pgmoneta_current_wal_lsn</h2>\n");
-   data = pgmoneta_append(data, "  The current WAL log sequence number\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_workflow_node_files</h2>\n");
+   data = pgmoneta_append(data, "  The files of the directory after a workflow node for a server\n");
    data = pgmoneta_append(data, "  <table border=\"1\">\n");
    data = pgmoneta_append(data, "    <tbody>\n");
    data = pgmoneta_append(data, "      <tr>\n");
@@ -1167,8 +2173,8 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "        <td>The identifier for the server</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "      <tr>\n");
-   data = pgmoneta_append(data, "        <td>lsn</td>\n");
-   data = pgmoneta_append(data, "        <td>The current WAL log sequence number</td>\n");
+   data = pgmoneta_append(data, "        <td>node</td>\n");
+   data = pgmoneta_append(data, "        <td>The name of the workflow node</td>\n");
    data = pgmoneta_append(data, "      </tr>\n");
    data = pgmoneta_append(data, "    </tbody>\n");
    data = pgmoneta_append(data, "  </table>\n");
@@ -1200,20 +2206,19 @@ done:
 }
 
 static int
-metrics_page(int client_fd)
+metrics_page(int client_fd, struct prometheus_request* request)
 {
-   char* data = NULL;
-   time_t now;
-   char time_buf[32];
+   char* body = NULL;
+   char* text = NULL;
+   struct string_builder sb;
+   unsigned char* compressed = NULL;
+   size_t compressed_size = 0;
    int status;
-   struct message msg;
    struct prometheus_cache* cache;
    signed char cache_is_free;
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
-   memset(&msg, 0, sizeof(struct message));
-
 retry_cache_locking:
    cache_is_free = STATE_FREE;
    if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
@@ -1221,62 +2226,32 @@ retry_cache_locking:
       // can serve the message out of cache?
       if (is_metrics_cache_configured() && is_metrics_cache_valid())
       {
-         // serve the message directly out of the cache
          pgmoneta_log_debug("Serving metrics out of cache (%d/%d bytes valid until %lld)",
                             strlen(cache->data),
                             cache->size,
                             cache->valid_until);
 
-         msg.kind = 0;
-         msg.length = strlen(cache->data);
-         msg.data = cache->data;
+         body = pgmoneta_append(body, cache->data);
       }
       else
       {
-         // build the message without the cache
+         // build the metrics without the cache, the backups of a server are only read when they changed
          metrics_cache_invalidate();
 
-         now = time(NULL);
-
-         memset(&time_buf, 0, sizeof(time_buf));
-         ctime_r(&now, &time_buf[0]);
-         time_buf[strlen(time_buf) - 1] = 0;
+         pgmoneta_string_builder_init(&sb);
 
-         data = pgmoneta_append(data, "HTTP/1.1 200 OK\r\n");
-         data = pgmoneta_append(data, "Content-Type: text/plain; version=0.0.1; charset=utf-8\r\n");
-         data = pgmoneta_append(data, "Date: ");
-         data = pgmoneta_append(data, &time_buf[0]);
-         data = pgmoneta_append(data, "\r\n");
-         data = pgmoneta_append(data, "Transfer-Encoding: chunked\r\n");
-         data = pgmoneta_append(data, "\r\n");
-         metrics_cache_append(data);
+         general_information(&sb);
+         fragment_information(&sb);
+         state_information(&sb);
+         workflow_information(&sb);
 
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
+         body = pgmoneta_string_builder_detach(&sb);
 
-         status = pgmoneta_write_message(NULL, client_fd, &msg);
-         if (status != MESSAGE_STATUS_OK)
+         if (body != NULL)
          {
-            goto error;
+            metrics_cache_append(body);
+            metrics_cache_finalize();
          }
-
-         free(data);
-         data = NULL;
-
-         general_information(client_fd);
-         backup_information(client_fd);
-         size_information(client_fd);
-
-         /* Footer */
-         data = pgmoneta_append(data, "0\r\n\r\n");
-         metrics_cache_append(data);
-
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
-
-         metrics_cache_finalize();
       }
 
       // free the cache
@@ -1288,21 +2263,216 @@ retry_cache_locking:
       SLEEP_AND_GOTO(1000000L, retry_cache_locking)
    }
 
-   status = pgmoneta_write_message(NULL, client_fd, &msg);
-   if (status != MESSAGE_STATUS_OK)
+   if (body == NULL)
    {
       goto error;
    }
 
-   free(data);
+   if (request->openmetrics)
+   {
+      text = openmetrics(body);
+      if (text == NULL)
+      {
+         goto error;
+      }
+      free(body);
+      body = text;
+   }
 
-   return 0;
+   if (request->gzip && pgmoneta_gzip_string(body, &compressed, &compressed_size) == 0)
+   {
+      status = send_response(client_fd, request->openmetrics ? CONTENT_TYPE_OPENMETRICS : CONTENT_TYPE_TEXT,
+                             (char*)compressed, compressed_size, true, request->keep_alive);
+   }
+   else
+   {
+      status = send_response(client_fd, request->openmetrics ? CONTENT_TYPE_OPENMETRICS : CONTENT_TYPE_TEXT,
+                             body, strlen(body), false, request->keep_alive);
+   }
+
+   free(compressed);
+   free(body);
+
+   return status;
 
 error:
 
+   free(compressed);
+   free(body);
+
+   return MESSAGE_STATUS_ERROR;
+}
+
+static int
+send_response(int client_fd, char* content_type, char* body, size_t length, bool gzip, bool keep_alive)
+{
+   char* data = NULL;
+   char number[32];
+   time_t now;
+   char time_buf[32];
+   int status;
+   struct message msg;
+
+   memset(&msg, 0, sizeof(struct message));
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   snprintf(number, sizeof(number), "%zu", length);
+
+   data = pgmoneta_append(data, "HTTP/1.1 200 OK\r\n");
+   data = pgmoneta_append(data, "Content-Type: ");
+   data = pgmoneta_append(data, content_type);
+   data = pgmoneta_append(data, "\r\n");
+   data = pgmoneta_append(data, "Date: ");
+   data = pgmoneta_append(data, &time_buf[0]);
+   data = pgmoneta_append(data, "\r\n");
+   if (gzip)
+   {
+      data = pgmoneta_append(data, "Content-Encoding: gzip\r\n");
+   }
+   data = pgmoneta_append(data, "Vary: Accept, Accept-Encoding\r\n");
+   data = pgmoneta_append(data, "Content-Length: ");
+   data = pgmoneta_append(data, number);
+   data = pgmoneta_append(data, "\r\n");
+   data = pgmoneta_append(data, keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+   data = pgmoneta_append(data, "\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = pgmoneta_write_message(NULL, client_fd, &msg);
+   if (status != MESSAGE_STATUS_OK)
+   {
+      goto done;
+   }
+
+   msg.kind = 0;
+   msg.length = length;
+   msg.data = body;
+
+   status = pgmoneta_write_message(NULL, client_fd, &msg);
+
+done:
+
    free(data);
 
-   return 1;
+   return status;
+}
+
+static char*
+openmetrics(char* text)
+{
+   char* result = NULL;
+   char* out = NULL;
+   char* line = NULL;
+   char* next = NULL;
+   char* name = NULL;
+   char* name_end = NULL;
+   size_t line_length;
+   size_t name_length;
+   size_t lines = 1;
+   bool counter = false;
+
+   for (char* c = text; *c != '\0'; c++)
+   {
+      if (*c == '\n')
+      {
+         lines++;
+      }
+   }
+
+   // a line grows by at most the _total suffix or the space of a comment
+   result = (char*)malloc(strlen(text) + 7 * lines + 8);
+   if (result == NULL)
+   {
+      return NULL;
+   }
+   out = result;
+
+   for (line = text; *line != '\0'; line = next)
+   {
+      next = strchr(line, '\n');
+      line_length = next != NULL ? (size_t)(next - line) : strlen(line);
+      next = next != NULL ? next + 1 : line + line_length;
+
+      if (line_length == 0)
+      {
+         // OpenMetrics has no empty lines
+         continue;
+      }
+
+      if (!strncmp(line, "#HELP ", 6) || !strncmp(line, "#TYPE ", 6))
+      {
+         name = line + 6;
+         name_end = memchr(name, ' ', line_length - 6);
+         name_length = name_end != NULL ? (size_t)(name_end - name) : line_length - 6;
+
+         if (line[1] == 'T')
+         {
+            counter = name_end != NULL && !strncmp(name_end, " counter\n", 9);
+         }
+         else
+         {
+            // the TYPE line follows the HELP line
+            char* type_end = strchr(next, '\n');
+
+            counter = !strncmp(next, "#TYPE ", 6) && type_end != NULL && type_end - next > 8 && !strncmp(type_end - 8, " counter", 8);
+         }
+
+         memcpy(out, line[1] == 'H' ? "# HELP " : "# TYPE ", 7);
+         out += 7;
+
+         // a counter family is named without the _total suffix of its samples
+         if (counter && name_length > 6 && !strncmp(name + name_length - 6, "_total", 6))
+         {
+            memcpy(out, name, name_length - 6);
+            out += name_length - 6;
+         }
+         else
+         {
+            memcpy(out, name, name_length);
+            out += name_length;
+         }
+
+         memcpy(out, name + name_length, line_length - 6 - name_length);
+         out += line_length - 6 - name_length;
+      }
+      else if (counter)
+      {
+         name_end = strpbrk(line, "{ ");
+         if (name_end != NULL && name_end < line + line_length &&
+             (name_end - line < 6 || strncmp(name_end - 6, "_total", 6)))
+         {
+            memcpy(out, line, name_end - line);
+            out += name_end - line;
+            memcpy(out, "_total", 6);
+            out += 6;
+            memcpy(out, name_end, line_length - (name_end - line));
+            out += line_length - (name_end - line);
+         }
+         else
+         {
+            memcpy(out, line, line_length);
+            out += line_length;
+         }
+      }
+      else
+      {
+         memcpy(out, line, line_length);
+         out += line_length;
+      }
+
+      *out++ = '\n';
+   }
+
+   memcpy(out, "# EOF\n", 7);
+
+   return result;
 }
 
 static int
@@ -1327,6 +2497,8 @@ bad_request(int client_fd)
    data = pgmoneta_append(data, "Date: ");
    data = pgmoneta_append(data, &time_buf[0]);
    data = pgmoneta_append(data, "\r\n");
+   data = pgmoneta_append(data, "Content-Length: 0\r\n");
+   data = pgmoneta_append(data, "\r\n");
 
    msg.kind = 0;
    msg.length = strlen(data);
@@ -1340,12 +2512,11 @@ bad_request(int client_fd)
 }
 
 static void
-general_information(int client_fd)
+general_information(struct string_builder* data)
 {
    char* d;
    unsigned long size;
    int retention;
-   char* data = NULL;
    time_t t;
    char time_str[128];
    struct tm* time_info;
@@ -1353,133 +2524,180 @@ general_information(int client_fd)
 
    config = (struct configuration*)shmem;
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_state The state of pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_state gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_state ");
-   data = pgmoneta_append(data, "1");
-   data = pgmoneta_append(data, "\n\n");
-   data = pgmoneta_append(data, "#HELP pgmoneta_version The version of pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_version gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_version{version=\"");
-   data = pgmoneta_append(data, VERSION);
-   data = pgmoneta_append(data, "\"} 1");
-   data = pgmoneta_append(data, "\n\n");
-   data = pgmoneta_append(data, "#HELP pgmoneta_logging_info The number of INFO logging statements\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_logging_info gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_logging_info ");
-   data = pgmoneta_append_ulong(data, atomic_load(&config->prometheus.logging_info));
-   data = pgmoneta_append(data, "\n\n");
-   data = pgmoneta_append(data, "#HELP pgmoneta_logging_warn The number of WARN logging statements\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_logging_warn gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_logging_warn ");
-   data = pgmoneta_append_ulong(data, atomic_load(&config->prometheus.logging_warn));
-   data = pgmoneta_append(data, "\n\n");
-   data = pgmoneta_append(data, "#HELP pgmoneta_logging_error The number of ERROR logging statements\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_logging_error gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_logging_error ");
-   data = pgmoneta_append_ulong(data, atomic_load(&config->prometheus.logging_error));
-   data = pgmoneta_append(data, "\n\n");
-   data = pgmoneta_append(data, "#HELP pgmoneta_logging_fatal The number of FATAL logging statements\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_logging_fatal gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_logging_fatal ");
-   data = pgmoneta_append_ulong(data, atomic_load(&config->prometheus.logging_fatal));
-   data = pgmoneta_append(data, "\n\n");
-   data = pgmoneta_append(data, "#HELP pgmoneta_retention_days The retention days of pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_retention_days gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_retention_days ");
-   data = pgmoneta_append_int(data, config->retention_days <= 0 ? 0 : config->retention_days);
-   data = pgmoneta_append(data, "\n\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_retention_weeks The retention weeks of pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_retention_weeks gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_retention_weeks ");
-   data = pgmoneta_append_int(data, config->retention_weeks <= 0 ? 0 : config->retention_weeks);
-   data = pgmoneta_append(data, "\n\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_retention_months The retention months of pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_retention_months gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_retention_months ");
-   data = pgmoneta_append_int(data, config->retention_months <= 0 ? 0 : config->retention_months);
-   data = pgmoneta_append(data, "\n\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_retention_years The retention years of pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_retention_years gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_retention_years ");
-   data = pgmoneta_append_int(data, config->retention_years <= 0 ? 0 : config->retention_years);
-   data = pgmoneta_append(data, "\n\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_retention_server The retention of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_retention_server gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_state The state of pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_state gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_state ");
+   pgmoneta_string_builder_append(data, "1");
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_version The version of pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_version gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_version{version=\"");
+   pgmoneta_string_builder_append(data, VERSION);
+   pgmoneta_string_builder_append(data, "\"} 1");
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_logging_info The number of INFO logging statements\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_logging_info gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_logging_info ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.logging_info));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_logging_warn The number of WARN logging statements\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_logging_warn gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_logging_warn ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.logging_warn));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_logging_error The number of ERROR logging statements\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_logging_error gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_logging_error ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.logging_error));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_logging_fatal The number of FATAL logging statements\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_logging_fatal gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_logging_fatal ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.logging_fatal));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_memory_pool_allocations The number of buffers handed out by the memory pool\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_memory_pool_allocations counter\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_memory_pool_allocations ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.memory_pool_allocations));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_memory_pool_cache_hits The number of buffers reused from a thread cache\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_memory_pool_cache_hits counter\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_memory_pool_cache_hits ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.memory_pool_cache_hits));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_memory_pool_oversized The number of buffers larger than the largest size class\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_memory_pool_oversized counter\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_memory_pool_oversized ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->prometheus.memory_pool_oversized));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_memory_used_bytes The memory of memory_budget in use\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_memory_used_bytes gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_memory_used_bytes ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&config->memory_used));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_memory_budget_bytes The memory budget, 0 for no limit\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_memory_budget_bytes gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_memory_budget_bytes ");
+   pgmoneta_string_builder_append_ulong(data, config->memory_budget);
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_worker_alive The number of alive workers\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_worker_alive gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_worker_alive ");
+   pgmoneta_string_builder_append_int(data, atomic_load(&config->prometheus.worker_alive));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_worker_active The number of workers running a task\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_worker_active gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_worker_active ");
+   pgmoneta_string_builder_append_int(data, atomic_load(&config->prometheus.worker_active));
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_worker_busy_seconds The time the workers spent running tasks\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_worker_busy_seconds counter\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_worker_busy_seconds ");
+   pgmoneta_string_builder_append_double_precision(data, atomic_load(&config->prometheus.worker_busy) / 1000000.0, 6);
+   pgmoneta_string_builder_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_worker_idle_seconds The time the workers spent waiting for tasks\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_worker_idle_seconds counter\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_worker_idle_seconds ");
+   pgmoneta_string_builder_append_double_precision(data, atomic_load(&config->prometheus.worker_idle) / 1000000.0, 6);
+   pgmoneta_string_builder_append(data, "\n\n");
+   worker_histogram(data, "pgmoneta_worker_task_seconds", "The run time of the worker tasks", &config->prometheus.worker_task);
+   worker_histogram(data, "pgmoneta_worker_queue_wait_seconds", "The time the worker tasks waited in a queue", &config->prometheus.worker_queue_wait);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_retention_days The retention days of pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_retention_days gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_retention_days ");
+   pgmoneta_string_builder_append_int(data, config->retention_days <= 0 ? 0 : config->retention_days);
+   pgmoneta_string_builder_append(data, "\n\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_retention_weeks The retention weeks of pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_retention_weeks gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_retention_weeks ");
+   pgmoneta_string_builder_append_int(data, config->retention_weeks <= 0 ? 0 : config->retention_weeks);
+   pgmoneta_string_builder_append(data, "\n\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_retention_months The retention months of pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_retention_months gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_retention_months ");
+   pgmoneta_string_builder_append_int(data, config->retention_months <= 0 ? 0 : config->retention_months);
+   pgmoneta_string_builder_append(data, "\n\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_retention_years The retention years of pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_retention_years gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_retention_years ");
+   pgmoneta_string_builder_append_int(data, config->retention_years <= 0 ? 0 : config->retention_years);
+   pgmoneta_string_builder_append(data, "\n\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_retention_server The retention of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_retention_server gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_retention_server{");
-
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"");
-      data = pgmoneta_append(data, ", ");
-      data = pgmoneta_append(data, "parameter= \"days\"");
-      data = pgmoneta_append(data, "} ");
+      pgmoneta_string_builder_append(data, "pgmoneta_retention_server{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"");
+      pgmoneta_string_builder_append(data, ", ");
+      pgmoneta_string_builder_append(data, "parameter= \"days\"");
+      pgmoneta_string_builder_append(data, "} ");
       retention = config->servers[i].retention_days;
       if (retention <= 0)
       {
          retention = config->retention_days;
       }
-      data = pgmoneta_append_int(data, retention <= 0 ? 0 : retention);
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append_int(data, retention <= 0 ? 0 : retention);
+      pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "pgmoneta_retention_server{");
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"");
-      data = pgmoneta_append(data, ", ");
-      data = pgmoneta_append(data, "parameter= \"weeks\"");
-      data = pgmoneta_append(data, "} ");
+      pgmoneta_string_builder_append(data, "pgmoneta_retention_server{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"");
+      pgmoneta_string_builder_append(data, ", ");
+      pgmoneta_string_builder_append(data, "parameter= \"weeks\"");
+      pgmoneta_string_builder_append(data, "} ");
       retention = config->servers[i].retention_weeks;
       if (retention <= 0)
       {
          retention = config->retention_weeks;
       }
-      data = pgmoneta_append_int(data, retention <= 0 ? 0 : retention);
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append_int(data, retention <= 0 ? 0 : retention);
+      pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "pgmoneta_retention_server{");
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"");
-      data = pgmoneta_append(data, ", ");
-      data = pgmoneta_append(data, "parameter= \"months\"");
-      data = pgmoneta_append(data, "} ");
+      pgmoneta_string_builder_append(data, "pgmoneta_retention_server{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"");
+      pgmoneta_string_builder_append(data, ", ");
+      pgmoneta_string_builder_append(data, "parameter= \"months\"");
+      pgmoneta_string_builder_append(data, "} ");
       retention = config->servers[i].retention_months;
       if (retention <= 0)
       {
          retention = config->retention_months;
       }
-      data = pgmoneta_append_int(data, retention <= 0 ? 0 : retention);
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append_int(data, retention <= 0 ? 0 : retention);
+      pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "pgmoneta_retention_server{");
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"");
-      data = pgmoneta_append(data, ", ");
-      data = pgmoneta_append(data, "parameter= \"years\"");
-      data = pgmoneta_append(data, "} ");
+      pgmoneta_string_builder_append(data, "pgmoneta_retention_server{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"");
+      pgmoneta_string_builder_append(data, ", ");
+      pgmoneta_string_builder_append(data, "parameter= \"years\"");
+      pgmoneta_string_builder_append(data, "} ");
       retention = config->servers[i].retention_years;
       if (retention <= 0)
       {
          retention = config->retention_years;
       }
-      data = pgmoneta_append_int(data, retention <= 0 ? 0 : retention);
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append_int(data, retention <= 0 ? 0 : retention);
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_compression The compression used\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_compression gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_compression ");
-   data = pgmoneta_append_int(data, config->compression_type);
-   data = pgmoneta_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_compression The compression used\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_compression gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_compression ");
+   pgmoneta_string_builder_append_int(data, config->compression_type);
+   pgmoneta_string_builder_append(data, "\n\n");
 
    d = NULL;
 
@@ -1488,11 +2706,11 @@ general_information(int client_fd)
 
    size = pgmoneta_directory_size(d);
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_used_space The disk space used for pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_used_space gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_used_space ");
-   data = pgmoneta_append_ulong(data, size);
-   data = pgmoneta_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_used_space The disk space used for pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_used_space gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_used_space ");
+   pgmoneta_string_builder_append_ulong(data, size);
+   pgmoneta_string_builder_append(data, "\n\n");
 
    free(d);
 
@@ -1503,11 +2721,11 @@ general_information(int client_fd)
 
    size = pgmoneta_free_space(d);
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_free_space The free disk space for pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_free_space gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_free_space ");
-   data = pgmoneta_append_ulong(data, size);
-   data = pgmoneta_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_free_space The free disk space for pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_free_space gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_free_space ");
+   pgmoneta_string_builder_append_ulong(data, size);
+   pgmoneta_string_builder_append(data, "\n\n");
 
    free(d);
 
@@ -1518,395 +2736,395 @@ general_information(int client_fd)
 
    size = pgmoneta_total_space(d);
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_total_space The total disk space for pgmoneta\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_total_space gauge\n");
-   data = pgmoneta_append(data, "pgmoneta_total_space ");
-   data = pgmoneta_append_ulong(data, size);
-   data = pgmoneta_append(data, "\n\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_total_space The total disk space for pgmoneta\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_total_space gauge\n");
+   pgmoneta_string_builder_append(data, "pgmoneta_total_space ");
+   pgmoneta_string_builder_append_ulong(data, size);
+   pgmoneta_string_builder_append(data, "\n\n");
 
    free(d);
 
    d = NULL;
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_wal_shipping The disk space used for WAL shipping for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_wal_shipping gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_shipping The disk space used for WAL shipping for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_shipping gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_wal_shipping{");
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_shipping{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_wal_shipping_wal(i);
 
       if (d != NULL)
       {
          size = pgmoneta_directory_size(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_wal_shipping_used_space The disk space used for WAL shipping of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_wal_shipping_used_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_shipping_used_space The disk space used for WAL shipping of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_shipping_used_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_wal_shipping_used_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_shipping_used_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_wal_shipping(i);
       if (d != NULL)
       {
          size = pgmoneta_directory_size(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_wal_shipping_free_space The free disk space for WAL shipping of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_wal_shipping_free_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_shipping_free_space The free disk space for WAL shipping of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_shipping_free_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_wal_shipping_free_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_shipping_free_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_wal_shipping(i);
 
       if (d != NULL)
       {
          size = pgmoneta_free_space(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_wal_shipping_total_space The total disk space for WAL shipping of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_wal_shipping_total_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_shipping_total_space The total disk space for WAL shipping of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_shipping_total_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_wal_shipping_total_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_shipping_total_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_wal_shipping(i);
 
       if (d != NULL)
       {
          size = pgmoneta_total_space(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
    free(d);
 
    d = NULL;
 
    /* workspace */
-   data = pgmoneta_append(data, "#HELP pgmoneta_workspace The disk space used for workspace for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_workspace gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workspace The disk space used for workspace for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workspace gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_workspace{");
+      pgmoneta_string_builder_append(data, "pgmoneta_workspace{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_workspace(i);
 
       if (d != NULL)
       {
          size = pgmoneta_directory_size(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_workspace_free_space The free disk space for workspace of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_workspace_free_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workspace_free_space The free disk space for workspace of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workspace_free_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_workspace_free_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_workspace_free_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_workspace(i);
 
       if (d != NULL)
       {
          size = pgmoneta_free_space(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_workspace_total_space The total disk space for workspace of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_workspace_total_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workspace_total_space The total disk space for workspace of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workspace_total_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_workspace_total_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_workspace_total_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_workspace(i);
 
       if (d != NULL)
       {
          size = pgmoneta_total_space(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
    /* hot_standby */
-   data = pgmoneta_append(data, "#HELP pgmoneta_hot_standby The disk space used for hot standby for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_hot_standby gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_hot_standby The disk space used for hot standby for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_hot_standby gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_hot_standby{");
+      pgmoneta_string_builder_append(data, "pgmoneta_hot_standby{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_hot_standby(i);
 
       if (d != NULL)
       {
          size = pgmoneta_directory_size(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_hot_standby_free_space The free disk space for hot standby of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_hot_standby_free_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_hot_standby_free_space The free disk space for hot standby of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_hot_standby_free_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_hot_standby_free_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_hot_standby_free_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_hot_standby(i);
 
       if (d != NULL)
       {
          size = pgmoneta_free_space(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_hot_standby_total_space The total disk space for hot standby of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_hot_standby_total_space gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_hot_standby_total_space The total disk space for hot standby of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_hot_standby_total_space gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_hot_standby_total_space{");
+      pgmoneta_string_builder_append(data, "pgmoneta_hot_standby_total_space{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       d = pgmoneta_get_server_hot_standby(i);
 
       if (d != NULL)
       {
          size = pgmoneta_total_space(d);
-         data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append_ulong(data, size);
       }
       else
       {
-         data = pgmoneta_append_ulong(data, 0);
+         pgmoneta_string_builder_append_ulong(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       free(d);
       d = NULL;
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_timeline The current timeline a server is on\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_timeline counter\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_timeline The current timeline a server is on\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_timeline counter\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_timeline{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_timeline{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_int(data, config->servers[i].cur_timeline);
+      pgmoneta_string_builder_append_int(data, config->servers[i].cur_timeline);
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_parent_tli The parent timeline of a timeline on a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_parent_tli gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_parent_tli The parent timeline of a timeline on a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_parent_tli gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
       struct timeline_history* history = NULL;
       struct timeline_history* curh = NULL;
       int tli = 2;
 
-      data = pgmoneta_append(data, "pgmoneta_server_parent_tli{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_parent_tli{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\", ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
 
-      data = pgmoneta_append(data, "tli=\"");
-      data = pgmoneta_append_int(data, 1);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "tli=\"");
+      pgmoneta_string_builder_append_int(data, 1);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_int(data, 0);
+      pgmoneta_string_builder_append_int(data, 0);
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       pgmoneta_get_timeline_history(i, config->servers[i].cur_timeline, &history);
       curh = history;
       while (curh != NULL)
       {
-         data = pgmoneta_append(data, "pgmoneta_server_parent_tli{");
+         pgmoneta_string_builder_append(data, "pgmoneta_server_parent_tli{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\", ");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\", ");
 
-         data = pgmoneta_append(data, "tli=\"");
-         data = pgmoneta_append_int(data, tli);
-         data = pgmoneta_append(data, "\"} ");
+         pgmoneta_string_builder_append(data, "tli=\"");
+         pgmoneta_string_builder_append_int(data, tli);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-         data = pgmoneta_append_int(data, curh->parent_tli);
+         pgmoneta_string_builder_append_int(data, curh->parent_tli);
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
 
          curh = curh->next;
          tli++;
       }
       pgmoneta_free_timeline_history(history);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_timeline_switchpos The WAL switch position of a timeline on a server (showed in hex as a parameter)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_timeline_switchpos gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_timeline_switchpos The WAL switch position of a timeline on a server (showed in hex as a parameter)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_timeline_switchpos gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
       struct timeline_history* history = NULL;
       struct timeline_history* curh = NULL;
       int tli = 2;
 
-      data = pgmoneta_append(data, "pgmoneta_server_timeline_switchpos{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_timeline_switchpos{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\", ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
 
-      data = pgmoneta_append(data, "tli=\"1\", ");
+      pgmoneta_string_builder_append(data, "tli=\"1\", ");
 
-      data = pgmoneta_append(data, "walpos=\"0/0\"} ");
+      pgmoneta_string_builder_append(data, "walpos=\"0/0\"} ");
 
-      data = pgmoneta_append(data, "1");
+      pgmoneta_string_builder_append(data, "1");
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
       pgmoneta_get_timeline_history(i, config->servers[i].cur_timeline, &history);
       curh = history;
@@ -1916,478 +3134,588 @@ general_information(int client_fd)
          memset(xlogpos, 0, MISC_LENGTH);
          snprintf(xlogpos, MISC_LENGTH, "%X/%X", curh->switchpos_hi, curh->switchpos_lo);
 
-         data = pgmoneta_append(data, "pgmoneta_server_timeline_switchpos{");
+         pgmoneta_string_builder_append(data, "pgmoneta_server_timeline_switchpos{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\", ");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\", ");
 
-         data = pgmoneta_append(data, "tli=\"");
-         data = pgmoneta_append_int(data, tli);
-         data = pgmoneta_append(data, "\", ");
+         pgmoneta_string_builder_append(data, "tli=\"");
+         pgmoneta_string_builder_append_int(data, tli);
+         pgmoneta_string_builder_append(data, "\", ");
 
-         data = pgmoneta_append(data, "walpos=\"");
-         data = pgmoneta_append(data, xlogpos);
-         data = pgmoneta_append(data, "\"} ");
+         pgmoneta_string_builder_append(data, "walpos=\"");
+         pgmoneta_string_builder_append(data, xlogpos);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-         data = pgmoneta_append_int(data, 1);
+         pgmoneta_string_builder_append_int(data, 1);
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
 
          curh = curh->next;
          tli++;
       }
       pgmoneta_free_timeline_history(history);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_workers The numbeer of workers for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_workers gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_workers The numbeer of workers for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_workers gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
       int workers = config->servers[i].workers != -1 ? config->servers[i].workers : config->workers;
 
-      data = pgmoneta_append(data, "pgmoneta_server_workers{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_workers{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_int(data, workers);
+      pgmoneta_string_builder_append_int(data, workers);
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_valid Is the server in a valid state\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_valid gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_valid Is the server in a valid state\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_valid gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_valid{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_valid{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_bool(data, config->servers[i].valid);
+      pgmoneta_string_builder_append_bool(data, config->servers[i].valid);
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_wal_streaming The WAL streaming status of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_wal_streaming gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_streaming The WAL streaming status of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_streaming gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_wal_streaming{");
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_streaming{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_bool(data, config->servers[i].wal_streaming);
+      pgmoneta_string_builder_append_bool(data, config->servers[i].wal_streaming);
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_operation_count The count of client operations of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_operation_count gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_operation_count The count of client operations of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_operation_count gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_operation_count{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_operation_count{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_ulong(data, atomic_load(&config->servers[i].operation_count));
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->states[i].operation_count));
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_failed_operation_count The count of failed client operations of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_failed_operation_count gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_failed_operation_count The count of failed client operations of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_failed_operation_count gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_failed_operation_count{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_failed_operation_count{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_ulong(data, atomic_load(&config->servers[i].failed_operation_count));
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->states[i].failed_operation_count));
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_last_operation_time The time of the latest client operation of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_last_operation_time gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_last_operation_time The time of the latest client operation of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_last_operation_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_last_operation_time{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_last_operation_time{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      if (atomic_load(&config->servers[i].operation_count) > 0)
+      if (atomic_load(&config->states[i].operation_count) > 0)
       {
          memset(&time_str[0], 0, sizeof(time_str));
-         t = (time_t)atomic_load(&config->servers[i].last_operation_time);
+         t = (time_t)atomic_load(&config->states[i].last_operation_time);
          time_info = localtime(&t);
          strftime(&time_str[0], sizeof(time_str), "%Y%m%d%H%M%S", time_info);
 
-         data = pgmoneta_append(data, time_str);
+         pgmoneta_string_builder_append(data, time_str);
       }
       else
       {
-         data = pgmoneta_append_int(data, 0);
+         pgmoneta_string_builder_append_int(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_last_failed_operation_time The time of the latest failed client operation of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_last_failed_operation_time gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_last_failed_operation_time The time of the latest failed client operation of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_last_failed_operation_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_last_failed_operation_time{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_last_failed_operation_time{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      if (atomic_load(&config->servers[i].failed_operation_count) > 0)
+      if (atomic_load(&config->states[i].failed_operation_count) > 0)
       {
          memset(&time_str[0], 0, sizeof(time_str));
-         t = (time_t)atomic_load(&config->servers[i].last_failed_operation_time);
+         t = (time_t)atomic_load(&config->states[i].last_failed_operation_time);
          time_info = localtime(&t);
          strftime(&time_str[0], sizeof(time_str), "%Y%m%d%H%M%S", time_info);
 
-         data = pgmoneta_append(data, time_str);
+         pgmoneta_string_builder_append(data, time_str);
       }
       else
       {
-         data = pgmoneta_append_int(data, 0);
+         pgmoneta_string_builder_append_int(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_checksums Are checksums enabled\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_checksums gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_checksums Are checksums enabled\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_checksums gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_checksums{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_checksums{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       if (config->servers[i].checksums)
       {
-         data = pgmoneta_append_int(data, 1);
+         pgmoneta_string_builder_append_int(data, 1);
       }
       else
       {
-         data = pgmoneta_append_int(data, 0);
+         pgmoneta_string_builder_append_int(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_server_summarize_wal Is summarize_wal enabled\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_server_summarize_wal gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_server_summarize_wal Is summarize_wal enabled\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_server_summarize_wal gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_server_summarize_wal{");
+      pgmoneta_string_builder_append(data, "pgmoneta_server_summarize_wal{");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
       if (config->servers[i].summarize_wal)
       {
-         data = pgmoneta_append_int(data, 1);
+         pgmoneta_string_builder_append_int(data, 1);
       }
       else
       {
-         data = pgmoneta_append_int(data, 0);
+         pgmoneta_string_builder_append_int(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_extension The version of pgmoneta extension\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_extension gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_extension The version of pgmoneta extension\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_extension gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_extension{");
-
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"");
-      data = pgmoneta_append(data, ", ");
-      data = pgmoneta_append(data, "version=\"");
-      data = pgmoneta_append(data, config->servers[i].ext_version);
-      data = pgmoneta_append(data, "\"");
-      data = pgmoneta_append(data, "} ");
+      pgmoneta_string_builder_append(data, "pgmoneta_extension{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"");
+      pgmoneta_string_builder_append(data, ", ");
+      pgmoneta_string_builder_append(data, "version=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].ext_version);
+      pgmoneta_string_builder_append(data, "\"");
+      pgmoneta_string_builder_append(data, "} ");
       if (config->servers[i].ext_valid)
       {
-         data = pgmoneta_append_int(data, 1);
+         pgmoneta_string_builder_append_int(data, 1);
       }
       else
       {
-         data = pgmoneta_append_int(data, 0);
+         pgmoneta_string_builder_append_int(data, 0);
       }
 
-      data = pgmoneta_append(data, "\n");
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      pgmoneta_string_builder_append(data, "\n");
    }
+   pgmoneta_string_builder_append(data, "\n");
 }
 
 static void
-backup_information(int client_fd)
+backup_information(struct string_builder* data, int first, int last, struct prometheus_backups* snapshot)
 {
-   char* d;
    int number_of_backups;
    struct backup** backups;
-   bool valid;
-   int valid_count;
-   char* data = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_oldest The oldest backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_oldest gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_oldest The oldest backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_oldest gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_oldest{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_oldest));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_newest The newest backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_newest gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_newest{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_newest));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_count The number of valid backups for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_count gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_count{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_count));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup Is the backup valid for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
+
+      if (number_of_backups > 0)
+      {
+         for (int j = 0; j < number_of_backups; j++)
+         {
+            if (backups[j] != NULL)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               pgmoneta_string_builder_append_int(data, backups[j]->valid);
+
+               pgmoneta_string_builder_append(data, "\n");
+            }
+         }
+      }
+      else
+      {
+         pgmoneta_string_builder_append(data, "pgmoneta_backup{");
+
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
+
+         pgmoneta_string_builder_append(data, "\n");
+      }
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_version The version of postgresql for a backup\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_version gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
+
+      if (number_of_backups > 0)
+      {
+         for (int j = 0; j < number_of_backups; j++)
+         {
+            if (backups[j]->valid == VALID_TRUE)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_version{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\", major=\"");
+               pgmoneta_string_builder_append_int(data, backups[j]->major_version);
+               pgmoneta_string_builder_append(data, "\", minor=\"");
+               pgmoneta_string_builder_append_int(data, backups[j]->minor_version);
+               pgmoneta_string_builder_append(data, "\"} 1");
+
+               pgmoneta_string_builder_append(data, "\n");
+            }
+         }
+      }
+      else
+      {
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_version{");
+
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
+
+         pgmoneta_string_builder_append(data, "\n");
+      }
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_total_elapsed_time The backup in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_total_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
+
+      if (number_of_backups > 0)
+      {
+         for (int j = 0; j < number_of_backups; j++)
+         {
+            if (backups[j]->valid == VALID_TRUE)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_total_elapsed_time{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->total_elapsed_time, 4);
+
+               pgmoneta_string_builder_append(data, "\n");
+            }
+         }
+      }
+      else
+      {
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_total_elapsed_time{");
+
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
+
+         pgmoneta_string_builder_append(data, "\n");
+      }
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-      number_of_backups = 0;
-      backups = NULL;
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_basebackup_elapsed_time The duration for basebackup in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_basebackup_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      if (number_of_backups > 0)
+      {
+         for (int j = 0; j < number_of_backups; j++)
+         {
+            if (backups[j]->valid == VALID_TRUE)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_basebackup_elapsed_time{");
 
-      data = pgmoneta_append(data, "pgmoneta_backup_oldest{");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->basebackup_elapsed_time, 4);
 
-      valid = false;
-      for (int j = 0; !valid && j < number_of_backups; j++)
-      {
-         if (backups[j]->valid == VALID_TRUE)
-         {
-            data = pgmoneta_append(data, backups[j]->label);
-            valid = true;
+               pgmoneta_string_builder_append(data, "\n");
+            }
          }
       }
-
-      if (!valid)
+      else
       {
-         data = pgmoneta_append(data, "0");
-      }
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_basebackup_elapsed_time{");
 
-      data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_newest The newest backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_newest gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_manifest_elapsed_time The duration for manifest in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_manifest_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      if (number_of_backups > 0)
+      {
+         for (int j = 0; j < number_of_backups; j++)
+         {
+            if (backups[j]->valid == VALID_TRUE)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_manifest_elapsed_time{");
 
-      data = pgmoneta_append(data, "pgmoneta_backup_newest{");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->manifest_elapsed_time, 4);
 
-      valid = false;
-      for (int j = number_of_backups - 1; !valid && j >= 0; j--)
-      {
-         if (backups[j]->valid == VALID_TRUE)
-         {
-            data = pgmoneta_append(data, backups[j]->label);
-            valid = true;
+               pgmoneta_string_builder_append(data, "\n");
+            }
          }
       }
-
-      if (!valid)
+      else
       {
-         data = pgmoneta_append(data, "0");
-      }
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_manifest_elapsed_time{");
 
-      data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_count The number of valid backups for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_count gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_zstd_elapsed_time The duration for zstd compression in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_zstd_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
-
-      data = pgmoneta_append(data, "pgmoneta_backup_count{");
-
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
-      valid_count = 0;
-      for (int j = 0; j < number_of_backups; j++)
+      if (number_of_backups > 0)
       {
-         if (backups[j]->valid == VALID_TRUE)
+         for (int j = 0; j < number_of_backups; j++)
          {
-            valid_count++;
-         }
-      }
+            if (backups[j]->valid == VALID_TRUE)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_zstd_elapsed_time{");
 
-      data = pgmoneta_append_int(data, valid_count);
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->compression_zstd_elapsed_time, 4);
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+               pgmoneta_string_builder_append(data, "\n");
+            }
+         }
       }
-      free(backups);
+      else
+      {
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_zstd_elapsed_time{");
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+         pgmoneta_string_builder_append(data, "\n");
+      }
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup Is the backup valid for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_gzip_elapsed_time The duration for gzip compression in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_gzip_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
          for (int j = 0; j < number_of_backups; j++)
          {
-            if (backups[j] != NULL)
+            if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_gzip_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_int(data, backups[j]->valid);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->compression_gzip_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_gzip_elapsed_time{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_version The version of postgresql for a backup\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_version gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_bzip2_elapsed_time The duration for bzip2 compression in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_bzip2_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2395,61 +3723,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_version{");
-
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\", major=\"");
-               data = pgmoneta_append_int(data, backups[j]->major_version);
-               data = pgmoneta_append(data, "\", minor=\"");
-               data = pgmoneta_append_int(data, backups[j]->minor_version);
-               data = pgmoneta_append(data, "\"} 1");
-
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_bzip2_elapsed_time{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->compression_bzip2_elapsed_time, 4);
+
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_version{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_bzip2_elapsed_time{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_total_elapsed_time The backup in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_total_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_lz4_elapsed_time The duration for lz4 compression in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_lz4_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2457,51 +3763,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_total_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_lz4_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->total_elapsed_time, 4);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->compression_lz4_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_total_elapsed_time{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_lz4_elapsed_time{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_basebackup_elapsed_time The duration for basebackup in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_basebackup_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_encryption_elapsed_time The duration for encryption in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_encryption_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2509,51 +3803,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_basebackup_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_encryption_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->basebackup_elapsed_time, 4);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->encryption_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_basebackup_elapsed_time{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_encryption_elapsed_time{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_manifest_elapsed_time The duration for manifest in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_manifest_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_linking_elapsed_time The duration for linking in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_linking_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2561,51 +3843,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_manifest_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_linking_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->manifest_elapsed_time, 4);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->linking_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_manifest_elapsed_time{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_linking_elapsed_time{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_zstd_elapsed_time The duration for zstd compression in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_zstd_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_remote_ssh_elapsed_time The duration for remote ssh in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_remote_ssh_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2613,51 +3883,40 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_zstd_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_ssh_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->compression_zstd_elapsed_time, 4);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->remote_ssh_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_zstd_elapsed_time{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_ssh_elapsed_time{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_gzip_elapsed_time The duration for gzip compression in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_gzip_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      d = pgmoneta_get_server_backup(i);
+   pgmoneta_string_builder_append(data, "\n");
 
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_remote_s3_elapsed_time The duration for remote_s3 in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_remote_s3_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2665,51 +3924,40 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_gzip_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_s3_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->compression_gzip_elapsed_time, 4);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->remote_s3_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_gzip_elapsed_time{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_s3_elapsed_time{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_bzip2_elapsed_time The duration for bzip2 compression in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_bzip2_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      d = pgmoneta_get_server_backup(i);
 
-      number_of_backups = 0;
-      backups = NULL;
+   pgmoneta_string_builder_append(data, "\n");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_remote_azure_elapsed_time The duration for remote_azure in seconds for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_remote_azure_elapsed_time gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2717,51 +3965,40 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_bzip2_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_azure_elapsed_time{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->compression_bzip2_elapsed_time, 4);
+               pgmoneta_string_builder_append_double_precision(data, backups[j]->remote_azure_elapsed_time, 4);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_bzip2_elapsed_time{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_azure_elapsed_time{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_lz4_elapsed_time The duration for lz4 compression in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_lz4_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      d = pgmoneta_get_server_backup(i);
 
-      number_of_backups = 0;
-      backups = NULL;
+   pgmoneta_string_builder_append(data, "\n");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_start_timeline The starting timeline of a backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_start_timeline gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2769,51 +4006,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_lz4_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_start_timeline{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->compression_lz4_elapsed_time, 4);
+               pgmoneta_string_builder_append_int(data, backups[j]->start_timeline);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_lz4_elapsed_time{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_start_timeline{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_encryption_elapsed_time The duration for encryption in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_encryption_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_end_timeline The ending timeline of a backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_end_timeline gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2821,51 +4046,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_encryption_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_end_timeline{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->encryption_elapsed_time, 4);
+               pgmoneta_string_builder_append_int(data, backups[j]->end_timeline);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_encryption_elapsed_time{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_end_timeline{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_linking_elapsed_time The duration for linking in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_linking_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_start_walpos The starting WAL position of a backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_start_walpos gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2873,51 +4086,46 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_linking_elapsed_time{");
+               char walpos[MISC_LENGTH];
+               memset(walpos, 0, MISC_LENGTH);
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_start_walpos{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\", ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->linking_elapsed_time, 4);
+               snprintf(walpos, MISC_LENGTH, "%X/%X", backups[j]->start_lsn_hi32, backups[j]->start_lsn_lo32);
+               pgmoneta_string_builder_append(data, "walpos=\"");
+               pgmoneta_string_builder_append(data, walpos);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               pgmoneta_string_builder_append_int(data, 1);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_linking_elapsed_time{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_start_walpos{");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\", ");
+         pgmoneta_string_builder_append(data, "walpos=\"0/0\"} 0");
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
+      }   }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_remote_ssh_elapsed_time The duration for remote ssh in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_ssh_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_checkpoint_walpos The checkpoint WAL position of a backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_checkpoint_walpos gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2925,52 +4133,47 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_remote_ssh_elapsed_time{");
+               char walpos[MISC_LENGTH];
+               memset(walpos, 0, MISC_LENGTH);
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_checkpoint_walpos{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\", ");
+
+               snprintf(walpos, MISC_LENGTH, "%X/%X", backups[j]->checkpoint_lsn_hi32, backups[j]->checkpoint_lsn_lo32);
+               pgmoneta_string_builder_append(data, "walpos=\"");
+               pgmoneta_string_builder_append(data, walpos);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->remote_ssh_elapsed_time, 4);
+               pgmoneta_string_builder_append_int(data, 1);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_remote_ssh_elapsed_time{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_checkpoint_walpos{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\", ");
+         pgmoneta_string_builder_append(data, "walpos=\"0/0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_remote_s3_elapsed_time The duration for remote_s3 in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_s3_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_end_walpos The ending WAL position of a backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_end_walpos gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -2978,52 +4181,89 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_remote_s3_elapsed_time{");
+               char walpos[MISC_LENGTH];
+               memset(walpos, 0, MISC_LENGTH);
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_end_walpos{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\", ");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               snprintf(walpos, MISC_LENGTH, "%X/%X", backups[j]->end_lsn_hi32, backups[j]->end_lsn_lo32);
+               pgmoneta_string_builder_append(data, "walpos=\"");
+               pgmoneta_string_builder_append(data, walpos);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->remote_s3_elapsed_time, 4);
+               pgmoneta_string_builder_append_int(data, 1);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_remote_s3_elapsed_time{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_end_walpos{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\", ");
+         pgmoneta_string_builder_append(data, "walpos=\"0/0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
+   }
+   pgmoneta_string_builder_append(data, "\n");
+}
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+static void
+size_information(struct string_builder* data, int first, int last, struct prometheus_backups* snapshot)
+{
+   int number_of_backups;
+   struct backup** backups;
+   struct configuration* config;
 
-      free(d);
-   }
+   config = (struct configuration*)shmem;
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_restore_newest_size The size of the newest restore for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_restore_newest_size gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_restore_newest_size{");
 
-   data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_remote_azure_elapsed_time The duration for remote_azure in seconds for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_azure_elapsed_time gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.restore_newest_size));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_newest_size The size of the newest backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_newest_size gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_newest_size{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      number_of_backups = 0;
-      backups = NULL;
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_newest_size));
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_restore_size The size of a restore for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_restore_size gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3031,52 +4271,86 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_remote_azure_elapsed_time{");
+               pgmoneta_string_builder_append(data, "pgmoneta_restore_size{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_double_precision(data, backups[j]->remote_azure_elapsed_time, 4);
+               pgmoneta_string_builder_append_ulong(data, backups[j]->restore_size);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_remote_azure_elapsed_time{");
+         pgmoneta_string_builder_append(data, "pgmoneta_restore_size{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-      for (int j = 0; j < number_of_backups; j++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_restore_size_increment The size increment of a restore for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_restore_size_increment gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
+
+      if (number_of_backups > 0)
       {
-         free(backups[j]);
-      }
-      free(backups);
+         for (int j = 0; j < number_of_backups; j++)
+         {
+            if (backups[j] != NULL)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_restore_size_increment{");
 
-      free(d);
-   }
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               if (j == 0)
+               {
+                  pgmoneta_string_builder_append_int(data, backups[0]->restore_size);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, backups[j]->restore_size - backups[j - 1]->restore_size);
+               }
 
-   data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
+            }
+         }
+      }
+      else
+      {
+         pgmoneta_string_builder_append(data, "pgmoneta_restore_size_increment{");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_start_timeline The starting timeline of a backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_start_timeline gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      d = pgmoneta_get_server_backup(i);
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      number_of_backups = 0;
-      backups = NULL;
+         pgmoneta_string_builder_append(data, "\n");
+      }
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_size The size of a backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_size gauge\n");
+   for (int i = first; i < last; i++)
+   {
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3084,51 +4358,39 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_start_timeline{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_size{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_int(data, backups[j]->start_timeline);
+               pgmoneta_string_builder_append_ulong(data, backups[j]->backup_size);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_start_timeline{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_size{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_end_timeline The ending timeline of a backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_end_timeline gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_checksum_failures The number of pages that failed the checksum verification in a backup\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_checksum_failures gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3136,416 +4398,316 @@ backup_information(int client_fd)
          {
             if (backups[j]->valid == VALID_TRUE)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_end_timeline{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_checksum_failures{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_int(data, backups[j]->end_timeline);
+               pgmoneta_string_builder_append_ulong(data, backups[j]->checksum_failures);
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_end_timeline{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_checksum_failures{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_start_walpos The starting WAL position of a backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_start_walpos gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_ratio The ratio of backup size to restore size for each backup\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_ratio gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
          for (int j = 0; j < number_of_backups; j++)
          {
-            if (backups[j]->valid == VALID_TRUE)
+            if (backups[j] != NULL)
             {
-               char walpos[MISC_LENGTH];
-               memset(walpos, 0, MISC_LENGTH);
-               data = pgmoneta_append(data, "pgmoneta_backup_start_walpos{");
-
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\", ");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_ratio{");
 
-               snprintf(walpos, MISC_LENGTH, "%X/%X", backups[j]->start_lsn_hi32, backups[j]->start_lsn_lo32);
-               data = pgmoneta_append(data, "walpos=\"");
-               data = pgmoneta_append(data, walpos);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append_int(data, 1);
+               if (backups[j]->restore_size)
+               {
+                  pgmoneta_string_builder_append_double(data, 1.0 * backups[j]->backup_size / backups[j]->restore_size);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
 
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_start_walpos{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_ratio{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\", ");
-         data = pgmoneta_append(data, "walpos=\"0/0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
-      }
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_checkpoint_walpos The checkpoint WAL position of a backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_checkpoint_walpos gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_throughput The throughput of the backup for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_throughput gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
          for (int j = 0; j < number_of_backups; j++)
          {
-            if (backups[j]->valid == VALID_TRUE)
+            if (backups[j] != NULL)
             {
-               char walpos[MISC_LENGTH];
-               memset(walpos, 0, MISC_LENGTH);
-               data = pgmoneta_append(data, "pgmoneta_backup_checkpoint_walpos{");
-
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\", ");
-
-               snprintf(walpos, MISC_LENGTH, "%X/%X", backups[j]->checkpoint_lsn_hi32, backups[j]->checkpoint_lsn_lo32);
-               data = pgmoneta_append(data, "walpos=\"");
-               data = pgmoneta_append(data, walpos);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_throughput{");
 
-               data = pgmoneta_append_int(data, 1);
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append(data, "\n");
+               if (backups[j]->total_elapsed_time)
+               {
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->total_elapsed_time) / (1e6), 4);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_checkpoint_walpos{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\", ");
-         data = pgmoneta_append(data, "walpos=\"0/0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_throughput{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_end_walpos The ending WAL position of a backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_end_walpos gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_basebackup_mbs The throughput of the basebackup for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_basebackup_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
          for (int j = 0; j < number_of_backups; j++)
          {
-            if (backups[j]->valid == VALID_TRUE)
+            if (backups[j] != NULL)
             {
-               char walpos[MISC_LENGTH];
-               memset(walpos, 0, MISC_LENGTH);
-               data = pgmoneta_append(data, "pgmoneta_backup_end_walpos{");
-
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\", ");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_basebackup_mbs{");
 
-               snprintf(walpos, MISC_LENGTH, "%X/%X", backups[j]->end_lsn_hi32, backups[j]->end_lsn_lo32);
-               data = pgmoneta_append(data, "walpos=\"");
-               data = pgmoneta_append(data, walpos);
-               data = pgmoneta_append(data, "\"} ");
-
-               data = pgmoneta_append_int(data, 1);
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append(data, "\n");
+               if (backups[j]->basebackup_elapsed_time)
+               {
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->basebackup_elapsed_time) / (1e6), 4);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_end_walpos{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_basebackup_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\", ");
-         data = pgmoneta_append(data, "walpos=\"0/0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
-}
-
-static void
-size_information(int client_fd)
-{
-   char* d;
-   int number_of_backups;
-   struct backup** backups;
-   unsigned long size;
-   bool valid;
-   char* data = NULL;
-   struct configuration* config;
+   pgmoneta_string_builder_append(data, "\n");
 
-   config = (struct configuration*)shmem;
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_restore_newest_size The size of the newest restore for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_restore_newest_size gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_manifest_mbs The throughput of the manifest for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_manifest_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
-
-      data = pgmoneta_append(data, "pgmoneta_restore_newest_size{");
-
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
-
-      valid = false;
-      for (int j = number_of_backups - 1; !valid && j >= 0; j--)
+      if (number_of_backups > 0)
       {
-         if (backups[j]->valid == VALID_TRUE)
+         for (int j = 0; j < number_of_backups; j++)
          {
-            data = pgmoneta_append_ulong(data, backups[j]->restore_size);
-            valid = true;
+            if (backups[j] != NULL)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_manifest_mbs{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               if (backups[j]->manifest_elapsed_time)
+               {
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->manifest_elapsed_time) / (1e6), 4);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
+               pgmoneta_string_builder_append(data, "\n");
+            }
          }
       }
-
-      if (!valid)
+      else
       {
-         data = pgmoneta_append(data, "0");
-      }
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_manifest_mbs{");
 
-      data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_newest_size The size of the newest backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_newest_size gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_zstd_mbs The throughput of the zstd compression for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_zstd_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
-
-      data = pgmoneta_append(data, "pgmoneta_backup_newest_size{");
-
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
-
-      valid = false;
-      for (int j = number_of_backups - 1; !valid && j >= 0; j--)
+      if (number_of_backups > 0)
       {
-         if (backups[j]->valid == VALID_TRUE)
+         for (int j = 0; j < number_of_backups; j++)
          {
-            data = pgmoneta_append_ulong(data, backups[j]->backup_size);
-            valid = true;
+            if (backups[j] != NULL)
+            {
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_zstd_mbs{");
+
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
+
+               if (backups[j]->compression_zstd_elapsed_time)
+               {
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_zstd_elapsed_time) / (1e6), 4);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
+               pgmoneta_string_builder_append(data, "\n");
+            }
          }
       }
-
-      if (!valid)
+      else
       {
-         data = pgmoneta_append(data, "0");
-      }
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_zstd_mbs{");
 
-      data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_restore_size The size of a restore for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_restore_size gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_gzip_mbs The throughput of the gzip compression for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_gzip_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
          for (int j = 0; j < number_of_backups; j++)
          {
-            if (backups[j]->valid == VALID_TRUE)
+            if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_restore_size{");
-
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_gzip_mbs{");
 
-               data = pgmoneta_append_ulong(data, backups[j]->restore_size);
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append(data, "\n");
+               if (backups[j]->compression_gzip_elapsed_time)
+               {
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_gzip_elapsed_time) / (1e6), 4);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_restore_size{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_gzip_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_restore_size_increment The size increment of a restore for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_restore_size_increment gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_bzip2_mbs The throughput of the bzip2 compression for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_bzip2_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3553,126 +4715,91 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_restore_size_increment{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_bzip2_mbs{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (j == 0)
+               if (backups[j]->compression_bzip2_elapsed_time)
                {
-                  data = pgmoneta_append_int(data, backups[0]->restore_size);
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_bzip2_elapsed_time) / (1e6), 4);
                }
                else
                {
-                  data = pgmoneta_append_int(data, backups[j]->restore_size - backups[j - 1]->restore_size);
+                  pgmoneta_string_builder_append_int(data, 0);
                }
-
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_restore_size_increment{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_bzip2_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_size The size of a backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_size gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_compression_lz4_mbs The throughput of the lz4 compression for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_compression_lz4_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
          for (int j = 0; j < number_of_backups; j++)
          {
-            if (backups[j]->valid == VALID_TRUE)
+            if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_size{");
-
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_lz4_mbs{");
 
-               data = pgmoneta_append_ulong(data, backups[j]->backup_size);
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append(data, "\n");
+               if (backups[j]->compression_lz4_elapsed_time)
+               {
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_lz4_elapsed_time) / (1e6), 4);
+               }
+               else
+               {
+                  pgmoneta_string_builder_append_int(data, 0);
+               }
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_size{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_compression_lz4_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_ratio The ratio of backup size to restore size for each backup\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_ratio gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_encryption_mbs The throughput of the encryption for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_encryption_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3680,66 +4807,45 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_ratio{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_encryption_mbs{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->restore_size)
+               if (backups[j]->encryption_elapsed_time)
                {
-                  data = pgmoneta_append_double(data, 1.0 * backups[j]->backup_size / backups[j]->restore_size);
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->encryption_elapsed_time) / (1e6), 4);
                }
                else
                {
-                  data = pgmoneta_append_int(data, 0);
+                  pgmoneta_string_builder_append_int(data, 0);
                }
-
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_ratio{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_encryption_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_throughput The throughput of the backup for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_throughput gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_linking_mbs The throughput of the linking for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_linking_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3747,65 +4853,45 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_throughput{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_linking_mbs{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->total_elapsed_time)
+               if (backups[j]->linking_elapsed_time)
                {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->total_elapsed_time) / (1e6), 4);
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->linking_elapsed_time) / (1e6), 4);
                }
                else
                {
-                  data = pgmoneta_append_int(data, 0);
+                  pgmoneta_string_builder_append_int(data, 0);
                }
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_throughput{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_linking_mbs{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_basebackup_mbs The throughput of the basebackup for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_basebackup_mbs gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_remote_ssh_mbs The throughput of the remote_ssh for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_remote_ssh_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3813,65 +4899,45 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_basebackup_mbs{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_ssh_mbs{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->basebackup_elapsed_time)
+               if (backups[j]->remote_ssh_elapsed_time)
                {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->basebackup_elapsed_time) / (1e6), 4);
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->remote_ssh_elapsed_time) / (1e6), 4);
                }
                else
                {
-                  data = pgmoneta_append_int(data, 0);
+                  pgmoneta_string_builder_append_int(data, 0);
                }
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_basebackup_mbs{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_ssh_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_manifest_mbs The throughput of the manifest for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_manifest_mbs gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_remote_s3_mbs The throughput of the remote_s3 for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_remote_s3_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3879,65 +4945,45 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_manifest_mbs{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_s3_mbs{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->manifest_elapsed_time)
+               if (backups[j]->remote_s3_elapsed_time)
                {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->manifest_elapsed_time) / (1e6), 4);
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->remote_s3_elapsed_time) / (1e6), 4);
                }
                else
                {
-                  data = pgmoneta_append_int(data, 0);
+                  pgmoneta_string_builder_append_int(data, 0);
                }
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_manifest_mbs{");
-
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_s3_mbs{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
-   }
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_zstd_mbs The throughput of the zstd compression for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_zstd_mbs gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_remote_azure_mbs The throughput of the remote_azure for a server (MB/s)\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_remote_azure_mbs gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -3945,65 +4991,45 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_zstd_mbs{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_azure_mbs{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->compression_zstd_elapsed_time)
+               if (backups[j]->remote_azure_elapsed_time)
                {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_zstd_elapsed_time) / (1e6), 4);
+                  pgmoneta_string_builder_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->remote_azure_elapsed_time) / (1e6), 4);
                }
                else
                {
-                  data = pgmoneta_append_int(data, 0);
+                  pgmoneta_string_builder_append_int(data, 0);
                }
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_zstd_mbs{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_remote_azure_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
-
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
+         pgmoneta_string_builder_append(data, "\n");
       }
-      free(backups);
-
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
-
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_gzip_mbs The throughput of the gzip compression for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_gzip_mbs gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_retain Retain backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_retain gauge\n");
+   for (int i = first; i < last; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = snapshot[i].number_of_backups;
+      backups = snapshot[i].backups;
 
       if (number_of_backups > 0)
       {
@@ -4011,781 +5037,1060 @@ size_information(int client_fd)
          {
             if (backups[j] != NULL)
             {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_gzip_mbs{");
+               pgmoneta_string_builder_append(data, "pgmoneta_backup_retain{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+               pgmoneta_string_builder_append(data, "name=\"");
+               pgmoneta_string_builder_append(data, config->servers[i].name);
+               pgmoneta_string_builder_append(data, "\",label=\"");
+               pgmoneta_string_builder_append(data, backups[j]->label);
+               pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->compression_gzip_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_gzip_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
+               pgmoneta_string_builder_append_bool(data, backups[j]->keep);
+
+               pgmoneta_string_builder_append(data, "\n");
             }
          }
       }
       else
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_gzip_mbs{");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_retain{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",label=\"0\"} 0");
 
-         data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
       }
+   }
+   pgmoneta_string_builder_append(data, "\n");
+}
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+static void
+state_information(struct string_builder* data)
+{
+   struct configuration* config;
+   char* lsn = NULL;
 
-      free(d);
+   config = (struct configuration*)shmem;
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_total_size The total size of the backups for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_total_size gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_total_size{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_total_size));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_total_size The total size of the WAL for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_total_size gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_total_size{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.wal_total_size));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_bzip2_mbs The throughput of the bzip2 compression for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_bzip2_mbs gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_total_size The total size for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_total_size gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      pgmoneta_string_builder_append(data, "pgmoneta_total_size{");
 
-      number_of_backups = 0;
-      backups = NULL;
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.total_size));
 
-      if (number_of_backups > 0)
-      {
-         for (int j = 0; j < number_of_backups; j++)
-         {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_bzip2_mbs{");
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_active_backup Is there an active backup for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_active_backup gauge\n");
 
-               if (backups[j]->compression_bzip2_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_bzip2_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
-         }
-      }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_bzip2_mbs{");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_active_backup{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+      pgmoneta_string_builder_append_bool(data, atomic_load(&config->states[i].backup));
 
-         data = pgmoneta_append(data, "\n");
-      }
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_active_backup Is there an active restore for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_active_restore gauge\n");
 
-      free(d);
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_active_restore{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_bool(data, atomic_load(&config->states[i].restore));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_active_archiving Is there an active archiving for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_active_archiving gauge\n");
+
+   for (int i = 0; i < config->number_of_servers; i++)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      pgmoneta_string_builder_append(data, "pgmoneta_active_backup{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_bool(data, atomic_load(&config->states[i].archiving));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_compression_lz4_mbs The throughput of the lz4 compression for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_lz4_mbs gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_current_wal_file The current streaming WAL filename of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_current_wal_file gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      pgmoneta_string_builder_append(data, "pgmoneta_current_wal_file{");
 
-      number_of_backups = 0;
-      backups = NULL;
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      pgmoneta_string_builder_append(data, "file=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].current_wal_filename);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      if (number_of_backups > 0)
-      {
-         for (int j = 0; j < number_of_backups; j++)
-         {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_compression_lz4_mbs{");
+      pgmoneta_string_builder_append_bool(data, config->servers[i].wal_streaming);
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-               if (backups[j]->compression_lz4_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->compression_lz4_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
-         }
-      }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_compression_lz4_mbs{");
+   // Append the WAL LSN of every server
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_current_wal_lsn The current WAL log sequence number\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_current_wal_lsn gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_current_wal_lsn{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
 
-         data = pgmoneta_append(data, "\n");
-      }
+      pgmoneta_string_builder_append(data, "lsn=\"");
+      lsn = pgmoneta_lsn_to_string(atomic_load_explicit(&config->states[i].wal_lsn, memory_order_relaxed));
+      pgmoneta_string_builder_append(data, lsn);
+      free(lsn);
+      lsn = NULL;
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+      pgmoneta_string_builder_append_bool(data, config->servers[i].wal_streaming);
 
-      free(d);
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_lag The number of bytes a WAL target is behind the WAL stream\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_lag gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_lag{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
+
+      pgmoneta_string_builder_append(data, "target=\"wal_shipping\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->states[i].wal_shipping_lag));
+
+      pgmoneta_string_builder_append(data, "\n");
+
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_lag{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
+
+      pgmoneta_string_builder_append(data, "target=\"ssh\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->states[i].wal_ssh_lag));
+
+      pgmoneta_string_builder_append(data, "\n");
+
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_lag{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\", ");
+
+      pgmoneta_string_builder_append(data, "target=\"archive\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->states[i].wal_archive_lag));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_encryption_mbs The throughput of the encryption for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_encryption_mbs gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_archive_failed The number of WAL segments that could not be archived to the storage engine\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_archive_failed counter\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_archive_failed{");
 
-      number_of_backups = 0;
-      backups = NULL;
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->states[i].wal_archive_failed));
 
-      if (number_of_backups > 0)
-      {
-         for (int j = 0; j < number_of_backups; j++)
-         {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_encryption_mbs{");
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_segments The number of WAL segments received for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_segments counter\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_segments{");
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-               if (backups[j]->encryption_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->encryption_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
-         }
-      }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_encryption_mbs{");
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.wal_segments));
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-         data = pgmoneta_append(data, "\n");
-      }
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_trash_backups The number of deleted backups waiting in the trash of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_trash_backups gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_trash_backups{");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      free(d);
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.trash_backups));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_trash_files The number of files unlinked from the trash of a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_trash_files counter\n");
+   for (int i = 0; i < config->number_of_servers; i++)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      pgmoneta_string_builder_append(data, "pgmoneta_trash_files{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.trash_files));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_linking_mbs The throughput of the linking for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_linking_mbs gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_received_bytes The number of WAL bytes received for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_received_bytes counter\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_received_bytes{");
 
-      number_of_backups = 0;
-      backups = NULL;
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.wal_received));
 
-      if (number_of_backups > 0)
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_receive_rate The WAL bytes received per second for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_receive_rate gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_receive_rate{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.wal_receive_rate));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_primary_lsn The WAL end position reported by the primary for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_primary_lsn gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_primary_lsn{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.wal_primary_lsn));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_wal_behind_bytes The number of WAL bytes the WAL stream is behind the primary for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_wal_behind_bytes gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_wal_behind_bytes{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.wal_behind));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   latency_histogram(data, "pgmoneta_wal_write_seconds", "The latency of the WAL writes for a server", PROMETHEUS_WAL_WRITE);
+   latency_histogram(data, "pgmoneta_wal_flush_seconds", "The latency of the WAL flushes to disk for a server", PROMETHEUS_WAL_FLUSH);
+   latency_histogram(data, "pgmoneta_wal_close_seconds", "The latency of closing a WAL segment for a server", PROMETHEUS_WAL_CLOSE);
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_backup_elapsed_seconds The duration of the backups for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_backup_elapsed_seconds histogram\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      unsigned long cumulative = 0;
+
+      for (int j = 0; j < PROMETHEUS_BACKUP_ELAPSED_BUCKETS; j++)
       {
-         for (int j = 0; j < number_of_backups; j++)
-         {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_linking_mbs{");
+         cumulative += atomic_load(&config->servers[i].metrics.backup_elapsed_bucket[j]);
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+         pgmoneta_string_builder_append(data, "pgmoneta_backup_elapsed_seconds_bucket{");
 
-               if (backups[j]->linking_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->linking_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
-         }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",le=\"");
+         pgmoneta_string_builder_append_ulong(data, (unsigned long)backup_elapsed_buckets[j]);
+         pgmoneta_string_builder_append(data, "\"} ");
+
+         pgmoneta_string_builder_append_ulong(data, cumulative);
+
+         pgmoneta_string_builder_append(data, "\n");
       }
-      else
+
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_elapsed_seconds_bucket{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\",le=\"+Inf\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_elapsed_count));
+
+      pgmoneta_string_builder_append(data, "\n");
+
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_elapsed_seconds_sum{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_elapsed_sum));
+
+      pgmoneta_string_builder_append(data, "\n");
+
+      pgmoneta_string_builder_append(data, "pgmoneta_backup_elapsed_seconds_count{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].metrics.backup_elapsed_count));
+
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+}
+
+static void
+fragment_information(struct string_builder* data)
+{
+   unsigned long long version;
+   unsigned long generation;
+   char* merged = NULL;
+   char* sections[NUMBER_OF_SERVERS];
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   generation = atomic_load(&config->reload_generation);
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      version = atomic_load(&config->servers[i].metrics.backups_version);
+
+      if (fragments[i].data[SECTION_BACKUP] == NULL || fragments[i].data[SECTION_SIZE] == NULL ||
+          fragments[i].version != version || fragments[i].generation != generation)
       {
-         data = pgmoneta_append(data, "pgmoneta_backup_linking_mbs{");
+         fragment_build(i, version, generation);
+      }
+   }
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+   for (int s = 0; s < SECTIONS; s++)
+   {
+      for (int i = 0; i < config->number_of_servers; i++)
+      {
+         sections[i] = fragments[i].data[s];
+      }
 
-         data = pgmoneta_append(data, "\n");
+      merged = fragment_merge(sections, config->number_of_servers);
+      if (merged != NULL)
+      {
+         pgmoneta_string_builder_append(data, merged);
+         free(merged);
       }
+   }
+}
+
+static void
+fragment_build(int server, unsigned long long version, unsigned long generation)
+{
+   char* d = NULL;
+   struct string_builder sb;
+   struct prometheus_backups snapshot[NUMBER_OF_SERVERS];
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&snapshot, 0, sizeof(snapshot));
+
+   d = pgmoneta_get_server_backup(server);
+   pgmoneta_get_backups(d, &snapshot[server].number_of_backups, &snapshot[server].backups);
+   free(d);
 
-      for (int j = 0; j < number_of_backups; j++)
+   for (int s = 0; s < SECTIONS; s++)
+   {
+      free(fragments[server].data[s]);
+      fragments[server].data[s] = NULL;
+   }
+
+   pgmoneta_string_builder_init(&sb);
+
+   backup_information(&sb, server, server + 1, &snapshot[0]);
+   fragments[server].data[SECTION_BACKUP] = pgmoneta_string_builder_detach(&sb);
+
+   size_information(&sb, server, server + 1, &snapshot[0]);
+   fragments[server].data[SECTION_SIZE] = pgmoneta_string_builder_detach(&sb);
+
+   fragments[server].version = version;
+   fragments[server].generation = generation;
+
+   for (int j = 0; j < snapshot[server].number_of_backups; j++)
+   {
+      free(snapshot[server].backups[j]);
+   }
+   free(snapshot[server].backups);
+
+   pgmoneta_log_debug("Prometheus: Built the backup metrics of %s (version %llu)", config->servers[server].name, version);
+}
+
+/**
+ * Merge the sections of the servers. A section holds the same metric families
+ * in the same order for every server, and a family has to be contiguous, so the
+ * samples of all servers are put below a single HELP and TYPE
+ * @param sections The sections
+ * @param number_of_sections The number of sections
+ * @return The merged section, or NULL
+ */
+static char*
+fragment_merge(char** sections, int number_of_sections)
+{
+   size_t size = 1;
+   size_t header;
+   size_t length;
+   char* result = NULL;
+   char* out = NULL;
+   char* end = NULL;
+   char* cursors[NUMBER_OF_SERVERS];
+
+   for (int i = 0; i < number_of_sections; i++)
+   {
+      if (sections[i] == NULL)
       {
-         free(backups[j]);
+         return NULL;
       }
-      free(backups);
-
-      free(d);
+      cursors[i] = sections[i];
+      size += strlen(sections[i]);
    }
-   data = pgmoneta_append(data, "\n");
 
-   if (data != NULL)
+   result = (char*)malloc(size);
+   if (result == NULL)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      return NULL;
    }
+   out = result;
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_remote_ssh_mbs The throughput of the remote_ssh for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_ssh_mbs gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   while (number_of_sections > 0 && pgmoneta_starts_with(cursors[0], "#HELP "))
    {
-      d = pgmoneta_get_server_backup(i);
+      // the HELP and TYPE lines of the family
+      end = strchr(cursors[0], '\n');
+      end = end != NULL ? strchr(end + 1, '\n') : NULL;
+      if (end == NULL)
+      {
+         goto error;
+      }
+      header = end + 1 - cursors[0];
 
-      number_of_backups = 0;
-      backups = NULL;
+      for (int i = 0; i < number_of_sections; i++)
+      {
+         if (strncmp(cursors[i], cursors[0], header))
+         {
+            goto error;
+         }
+      }
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      memcpy(out, cursors[0], header);
+      out += header;
 
-      if (number_of_backups > 0)
+      for (int i = 0; i < number_of_sections; i++)
       {
-         for (int j = 0; j < number_of_backups; j++)
+         cursors[i] += header;
+
+         // the samples run up to the empty line that ends the family
+         if (*cursors[i] == '\n')
          {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_remote_ssh_mbs{");
+            length = 0;
+         }
+         else
+         {
+            end = strstr(cursors[i], "\n\n");
+            length = end != NULL ? (size_t)(end + 1 - cursors[i]) : strlen(cursors[i]);
+         }
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+         memcpy(out, cursors[i], length);
+         out += length;
 
-               if (backups[j]->remote_ssh_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->remote_ssh_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
+         cursors[i] += length;
+         while (*cursors[i] == '\n')
+         {
+            cursors[i]++;
          }
       }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_remote_ssh_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+      *out++ = '\n';
+   }
 
-         data = pgmoneta_append(data, "\n");
-      }
+   *out = '\0';
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+   return result;
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+error:
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
-   }
+   pgmoneta_log_debug("Prometheus: The backup metrics of the servers differ");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_remote_s3_mbs The throughput of the remote_s3 for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_s3_mbs gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      d = pgmoneta_get_server_backup(i);
+   free(result);
 
-      number_of_backups = 0;
-      backups = NULL;
+   return NULL;
+}
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+static void
+workflow_information(struct string_builder* data)
+{
+   struct configuration* config;
 
-      if (number_of_backups > 0)
-      {
-         for (int j = 0; j < number_of_backups; j++)
-         {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_remote_s3_mbs{");
+   config = (struct configuration*)shmem;
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_active The number of running workflows for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_active gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_workflow_active{");
 
-               if (backups[j]->remote_s3_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->remote_s3_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
-         }
-      }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_remote_s3_mbs{");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].progress.active));
 
-         data = pgmoneta_append(data, "\n");
-      }
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_bytes The bytes processed by the running workflows for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_bytes gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_string_builder_append(data, "pgmoneta_workflow_bytes{");
 
-      free(d);
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].progress.bytes));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_files The files processed by the running workflows for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_files gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      pgmoneta_string_builder_append(data, "pgmoneta_workflow_files{");
+
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
+
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].progress.files));
+
+      pgmoneta_string_builder_append(data, "\n");
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_remote_azure_mbs The throughput of the remote_azure for a server (MB/s)\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_azure_mbs gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_nodes The workflow nodes done by the running workflows for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_nodes gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
+      pgmoneta_string_builder_append(data, "pgmoneta_workflow_nodes{");
 
-      number_of_backups = 0;
-      backups = NULL;
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&config->servers[i].progress.nodes));
 
-      if (number_of_backups > 0)
+      pgmoneta_string_builder_append(data, "\n");
+   }
+   pgmoneta_string_builder_append(data, "\n");
+
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_node_elapsed_seconds The duration of a workflow node for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_node_elapsed_seconds histogram\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      for (int j = 0; j < PROMETHEUS_NODES; j++)
       {
-         for (int j = 0; j < number_of_backups; j++)
+         struct prometheus_node* node = &config->servers[i].metrics.nodes[j];
+         unsigned long cumulative = 0;
+
+         if (atomic_load(&node->state) != PROMETHEUS_NODE_READY)
          {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_remote_azure_mbs{");
+            continue;
+         }
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+         for (int k = 0; k < PROMETHEUS_NODE_BUCKETS; k++)
+         {
+            cumulative += atomic_load(&node->elapsed_bucket[k]);
 
-               if (backups[j]->remote_azure_elapsed_time)
-               {
-                  data = pgmoneta_append_double_precision(data, (1.0 * backups[j]->backup_size / backups[j]->remote_azure_elapsed_time) / (1e6), 4);
-               }
-               else
-               {
-                  data = pgmoneta_append_int(data, 0);
-               }
-               data = pgmoneta_append(data, "\n");
-            }
+            pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_elapsed_seconds_bucket{");
+
+            pgmoneta_string_builder_append(data, "name=\"");
+            pgmoneta_string_builder_append(data, config->servers[i].name);
+            pgmoneta_string_builder_append(data, "\",node=\"");
+            pgmoneta_string_builder_append(data, node->name);
+            pgmoneta_string_builder_append(data, "\",le=\"");
+            pgmoneta_string_builder_append_ulong(data, (unsigned long)node_elapsed_buckets[k]);
+            pgmoneta_string_builder_append(data, "\"} ");
+
+            pgmoneta_string_builder_append_ulong(data, cumulative);
+
+            pgmoneta_string_builder_append(data, "\n");
          }
-      }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_remote_azure_mbs{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_elapsed_seconds_bucket{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\",le=\"+Inf\"} ");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->count));
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_elapsed_seconds_sum{");
+
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
+
+         pgmoneta_string_builder_append_double_precision(data, atomic_load(&node->elapsed_sum) / 1000.0, 3);
+
+         pgmoneta_string_builder_append(data, "\n");
+
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_elapsed_seconds_count{");
+
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
+
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->count));
+
+         pgmoneta_string_builder_append(data, "\n");
+      }
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_retain Retain backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_retain gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_node_throughput_mbs The throughput of a workflow node in MB/s for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_node_throughput_mbs histogram\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
+      for (int j = 0; j < PROMETHEUS_NODES; j++)
+      {
+         struct prometheus_node* node = &config->servers[i].metrics.nodes[j];
+         unsigned long cumulative = 0;
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+         if (atomic_load(&node->state) != PROMETHEUS_NODE_READY)
+         {
+            continue;
+         }
 
-      if (number_of_backups > 0)
-      {
-         for (int j = 0; j < number_of_backups; j++)
+         for (int k = 0; k < PROMETHEUS_NODE_BUCKETS; k++)
          {
-            if (backups[j] != NULL)
-            {
-               data = pgmoneta_append(data, "pgmoneta_backup_retain{");
+            cumulative += atomic_load(&node->throughput_bucket[k]);
 
-               data = pgmoneta_append(data, "name=\"");
-               data = pgmoneta_append(data, config->servers[i].name);
-               data = pgmoneta_append(data, "\",label=\"");
-               data = pgmoneta_append(data, backups[j]->label);
-               data = pgmoneta_append(data, "\"} ");
+            pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_throughput_mbs_bucket{");
 
-               data = pgmoneta_append_bool(data, backups[j]->keep);
+            pgmoneta_string_builder_append(data, "name=\"");
+            pgmoneta_string_builder_append(data, config->servers[i].name);
+            pgmoneta_string_builder_append(data, "\",node=\"");
+            pgmoneta_string_builder_append(data, node->name);
+            pgmoneta_string_builder_append(data, "\",le=\"");
+            pgmoneta_string_builder_append_ulong(data, (unsigned long)node_throughput_buckets[k]);
+            pgmoneta_string_builder_append(data, "\"} ");
 
-               data = pgmoneta_append(data, "\n");
-            }
+            pgmoneta_string_builder_append_ulong(data, cumulative);
+
+            pgmoneta_string_builder_append(data, "\n");
          }
-      }
-      else
-      {
-         data = pgmoneta_append(data, "pgmoneta_backup_retain{");
 
-         data = pgmoneta_append(data, "name=\"");
-         data = pgmoneta_append(data, config->servers[i].name);
-         data = pgmoneta_append(data, "\",label=\"0\"} 0");
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_throughput_mbs_bucket{");
 
-         data = pgmoneta_append(data, "\n");
-      }
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\",le=\"+Inf\"} ");
 
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->count));
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
-   }
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_throughput_mbs_sum{");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_backup_total_size The total size of the backups for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_backup_total_size gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      d = pgmoneta_get_server_backup(i);
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-      size = pgmoneta_directory_size(d);
+         pgmoneta_string_builder_append_double_precision(data, atomic_load(&node->throughput_sum) / 1000.0, 3);
 
-      data = pgmoneta_append(data, "pgmoneta_backup_total_size{");
+         pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_throughput_mbs_count{");
 
-      data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->count));
 
-      free(d);
+         pgmoneta_string_builder_append(data, "\n");
+      }
    }
-   data = pgmoneta_append(data, "\n");
+   pgmoneta_string_builder_append(data, "\n");
 
-   if (data != NULL)
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_node_bytes_in The bytes of the directory before a workflow node for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_node_bytes_in counter\n");
+   for (int i = 0; i < config->number_of_servers; i++)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      for (int j = 0; j < PROMETHEUS_NODES; j++)
+      {
+         struct prometheus_node* node = &config->servers[i].metrics.nodes[j];
+
+         if (atomic_load(&node->state) != PROMETHEUS_NODE_READY)
+         {
+            continue;
+         }
+
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_bytes_in{");
+
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
+
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->bytes_in));
+
+         pgmoneta_string_builder_append(data, "\n");
+      }
    }
+   pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_wal_total_size The total size of the WAL for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_wal_total_size gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_node_bytes_out The bytes of the directory after a workflow node for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_node_bytes_out counter\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_wal(i);
+      for (int j = 0; j < PROMETHEUS_NODES; j++)
+      {
+         struct prometheus_node* node = &config->servers[i].metrics.nodes[j];
 
-      size = pgmoneta_directory_size(d);
+         if (atomic_load(&node->state) != PROMETHEUS_NODE_READY)
+         {
+            continue;
+         }
 
-      free(d);
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_bytes_out{");
 
-      d = pgmoneta_get_server_wal_shipping_wal(i);
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-      if (d != NULL)
-      {
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->bytes_out));
 
-         size += pgmoneta_directory_size(d);
+         pgmoneta_string_builder_append(data, "\n");
       }
+   }
+   pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "pgmoneta_wal_total_size{");
+   pgmoneta_string_builder_append(data, "#HELP pgmoneta_workflow_node_files The files of the directory after a workflow node for a server\n");
+   pgmoneta_string_builder_append(data, "#TYPE pgmoneta_workflow_node_files counter\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      for (int j = 0; j < PROMETHEUS_NODES; j++)
+      {
+         struct prometheus_node* node = &config->servers[i].metrics.nodes[j];
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+         if (atomic_load(&node->state) != PROMETHEUS_NODE_READY)
+         {
+            continue;
+         }
 
-      data = pgmoneta_append_ulong(data, size);
+         pgmoneta_string_builder_append(data, "pgmoneta_workflow_node_files{");
 
-      data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",node=\"");
+         pgmoneta_string_builder_append(data, node->name);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+         pgmoneta_string_builder_append_ulong(data, atomic_load(&node->files));
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+         pgmoneta_string_builder_append(data, "\n");
+      }
    }
+   pgmoneta_string_builder_append(data, "\n");
+}
+
+static void
+latency_histogram(struct string_builder* data, char* metric, char* help, int type)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_total_size The total size for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_total_size gauge\n");
+   pgmoneta_string_builder_append(data, "#HELP ");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, " ");
+   pgmoneta_string_builder_append(data, help);
+   pgmoneta_string_builder_append(data, "\n");
+   pgmoneta_string_builder_append(data, "#TYPE ");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, " histogram\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server(i);
+      struct prometheus_histogram* h = &config->servers[i].metrics.wal_latency[type];
+      unsigned long cumulative = 0;
 
-      size = pgmoneta_directory_size(d);
+      for (int j = 0; j < PROMETHEUS_LATENCY_BUCKETS; j++)
+      {
+         cumulative += atomic_load(&h->bucket[j]);
 
-      free(d);
+         pgmoneta_string_builder_append(data, metric);
+         pgmoneta_string_builder_append(data, "_bucket{");
 
-      d = pgmoneta_get_server_wal_shipping(i);
+         pgmoneta_string_builder_append(data, "name=\"");
+         pgmoneta_string_builder_append(data, config->servers[i].name);
+         pgmoneta_string_builder_append(data, "\",le=\"");
+         pgmoneta_string_builder_append_double_precision(data, latency_buckets[j], 4);
+         pgmoneta_string_builder_append(data, "\"} ");
 
-      if (d != NULL)
-      {
-         size += pgmoneta_directory_size(d);
-      }
+         pgmoneta_string_builder_append_ulong(data, cumulative);
 
-      data = pgmoneta_append(data, "pgmoneta_total_size{");
+         pgmoneta_string_builder_append(data, "\n");
+      }
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, metric);
+      pgmoneta_string_builder_append(data, "_bucket{");
 
-      data = pgmoneta_append_ulong(data, size);
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\",le=\"+Inf\"} ");
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&h->count));
 
-      free(d);
-   }
-   data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_active_backup Is there an active backup for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_active_backup gauge\n");
+      pgmoneta_string_builder_append(data, metric);
+      pgmoneta_string_builder_append(data, "_sum{");
 
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      data = pgmoneta_append(data, "pgmoneta_active_backup{");
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_bool(data, atomic_load(&config->servers[i].backup));
+      pgmoneta_string_builder_append_double_precision(data, atomic_load(&h->sum) / 1000000.0, 6);
 
-      data = pgmoneta_append(data, "\n");
-   }
-   data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_active_backup Is there an active restore for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_active_restore gauge\n");
+      pgmoneta_string_builder_append(data, metric);
+      pgmoneta_string_builder_append(data, "_count{");
 
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      data = pgmoneta_append(data, "pgmoneta_active_restore{");
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      pgmoneta_string_builder_append(data, "name=\"");
+      pgmoneta_string_builder_append(data, config->servers[i].name);
+      pgmoneta_string_builder_append(data, "\"} ");
 
-      data = pgmoneta_append_bool(data, atomic_load(&config->servers[i].restore));
+      pgmoneta_string_builder_append_ulong(data, atomic_load(&h->count));
 
-      data = pgmoneta_append(data, "\n");
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
-
-   data = pgmoneta_append(data, "#HELP pgmoneta_active_archiving Is there an active archiving for a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_active_archiving gauge\n");
+   pgmoneta_string_builder_append(data, "\n");
+}
 
-   for (int i = 0; i < config->number_of_servers; i++)
+static void
+histogram_observe(struct prometheus_histogram* h, double seconds)
+{
+   for (int i = 0; i < PROMETHEUS_LATENCY_BUCKETS; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_active_backup{");
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\"} ");
+      if (seconds <= latency_buckets[i])
+      {
+         atomic_fetch_add(&h->bucket[i], 1);
+         break;
+      }
+   }
 
-      data = pgmoneta_append_bool(data, atomic_load(&config->servers[i].archiving));
+   atomic_fetch_add(&h->count, 1);
+   atomic_fetch_add(&h->sum, (unsigned long long)(seconds * 1000000));
+}
 
-      data = pgmoneta_append(data, "\n");
+static void
+worker_histogram(struct string_builder* data, char* metric, char* help, struct prometheus_histogram* h)
+{
+   unsigned long cumulative = 0;
+
+   pgmoneta_string_builder_append(data, "#HELP ");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, " ");
+   pgmoneta_string_builder_append(data, help);
+   pgmoneta_string_builder_append(data, "\n");
+   pgmoneta_string_builder_append(data, "#TYPE ");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, " histogram\n");
+
+   for (int i = 0; i < PROMETHEUS_LATENCY_BUCKETS; i++)
+   {
+      cumulative += atomic_load(&h->bucket[i]);
+
+      pgmoneta_string_builder_append(data, metric);
+      pgmoneta_string_builder_append(data, "_bucket{le=\"");
+      pgmoneta_string_builder_append_double_precision(data, latency_buckets[i], 4);
+      pgmoneta_string_builder_append(data, "\"} ");
+      pgmoneta_string_builder_append_ulong(data, cumulative);
+      pgmoneta_string_builder_append(data, "\n");
    }
-   data = pgmoneta_append(data, "\n");
 
-   data = pgmoneta_append(data, "#HELP pgmoneta_current_wal_file The current streaming WAL filename of a server\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_current_wal_file gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
-   {
-      data = pgmoneta_append(data, "pgmoneta_current_wal_file{");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, "_bucket{le=\"+Inf\"} ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&h->count));
+   pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\", ");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, "_sum ");
+   pgmoneta_string_builder_append_double_precision(data, atomic_load(&h->sum) / 1000000.0, 6);
+   pgmoneta_string_builder_append(data, "\n");
 
-      data = pgmoneta_append(data, "file=\"");
-      data = pgmoneta_append(data, config->servers[i].current_wal_filename);
-      data = pgmoneta_append(data, "\"} ");
+   pgmoneta_string_builder_append(data, metric);
+   pgmoneta_string_builder_append(data, "_count ");
+   pgmoneta_string_builder_append_ulong(data, atomic_load(&h->count));
+   pgmoneta_string_builder_append(data, "\n\n");
+}
 
-      data = pgmoneta_append_bool(data, config->servers[i].wal_streaming);
+static struct prometheus_node*
+workflow_node(int server, char* name)
+{
+   signed char state;
+   struct prometheus_node* node = NULL;
+   struct configuration* config;
 
-      data = pgmoneta_append(data, "\n");
-   }
-   data = pgmoneta_append(data, "\n");
+   config = (struct configuration*)shmem;
 
-   // Append the WAL LSN of every server
-   data = pgmoneta_append(data, "#HELP pgmoneta_current_wal_lsn The current WAL log sequence number\n");
-   data = pgmoneta_append(data, "#TYPE pgmoneta_current_wal_lsn gauge\n");
-   for (int i = 0; i < config->number_of_servers; i++)
+   for (int i = 0; i < PROMETHEUS_NODES; i++)
    {
-      data = pgmoneta_append(data, "pgmoneta_current_wal_lsn{");
-
-      data = pgmoneta_append(data, "name=\"");
-      data = pgmoneta_append(data, config->servers[i].name);
-      data = pgmoneta_append(data, "\", ");
+      node = &config->servers[server].metrics.nodes[i];
 
-      data = pgmoneta_append(data, "lsn=\"");
-      if (!strcmp(config->servers[i].current_wal_lsn, ""))
+      state = STATE_FREE;
+      if (atomic_compare_exchange_strong(&node->state, &state, STATE_IN_USE))
       {
-         data = pgmoneta_append(data, "0/0");
+         memset(node->name, 0, sizeof(node->name));
+         snprintf(node->name, sizeof(node->name), "%s", name);
+         atomic_store(&node->state, PROMETHEUS_NODE_READY);
+
+         return node;
       }
-      else
+
+      while (atomic_load(&node->state) == STATE_IN_USE)
       {
-         data = pgmoneta_append(data, config->servers[i].current_wal_lsn);
+         SLEEP(1000000L);
       }
-      data = pgmoneta_append(data, "\"} ");
-
-      data = pgmoneta_append_bool(data, config->servers[i].wal_streaming);
 
-      data = pgmoneta_append(data, "\n");
+      if (!strncmp(node->name, name, sizeof(node->name) - 1))
+      {
+         return node;
+      }
    }
-   data = pgmoneta_append(data, "\n");
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
-   }
+   return NULL;
 }
 
 static int
@@ -5045,3 +6350,52 @@ metrics_cache_finalize(void)
    cache->valid_until = now + config->metrics_cache_max_age;
    return cache->valid_until > now;
 }
+
+static void
+backups_refresh(int server)
+{
+   char* d = NULL;
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
+   unsigned int count = 0;
+   unsigned long long oldest = 0;
+   unsigned long long newest = 0;
+   unsigned long long newest_size = 0;
+   unsigned long long restore_newest_size = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_get_server_backup(server);
+
+   if (!pgmoneta_get_backups(d, &number_of_backups, &backups))
+   {
+      for (int i = 0; i < number_of_backups; i++)
+      {
+         if (backups[i]->valid == VALID_TRUE)
+         {
+            if (count == 0)
+            {
+               oldest = strtoull(backups[i]->label, NULL, 10);
+            }
+            newest = strtoull(backups[i]->label, NULL, 10);
+            newest_size = backups[i]->backup_size;
+            restore_newest_size = backups[i]->restore_size;
+            count++;
+         }
+      }
+   }
+
+   atomic_store(&config->servers[server].metrics.backup_oldest, oldest);
+   atomic_store(&config->servers[server].metrics.backup_newest, newest);
+   atomic_store(&config->servers[server].metrics.backup_count, count);
+   atomic_store(&config->servers[server].metrics.backup_newest_size, newest_size);
+   atomic_store(&config->servers[server].metrics.restore_newest_size, restore_newest_size);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+   free(d);
+}
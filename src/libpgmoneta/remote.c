@@ -42,6 +42,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
 void
@@ -53,6 +55,7 @@ pgmoneta_remote_management(int client_fd, char* address)
    uint8_t compression;
    uint8_t encryption;
    SSL* client_ssl = NULL;
+   struct timeval timeout;
    struct json* payload = NULL;
    struct configuration* config;
 
@@ -68,32 +71,45 @@ pgmoneta_remote_management(int client_fd, char* address)
    auth_status = pgmoneta_remote_management_auth(client_fd, address, &client_ssl);
    if (auth_status == AUTH_SUCCESS)
    {
-      if (pgmoneta_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, &server_fd))
+      if (config->blocking_timeout > 0)
       {
-         goto done;
+         timeout.tv_sec = config->blocking_timeout;
+         timeout.tv_usec = 0;
+         setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
       }
 
-      if (pgmoneta_management_read_json(client_ssl, client_fd, &compression, &encryption, &payload))
+      /* Serve the requests of the client, so a batch only authenticates once */
+      while (!pgmoneta_management_read_json(client_ssl, client_fd, &compression, &encryption, &payload))
       {
-         goto done;
-      }
-
-      if (pgmoneta_management_write_json(NULL, server_fd, compression, encryption, payload))
-      {
-         goto done;
-      }
-
-      pgmoneta_json_destroy(payload);
-      payload = NULL;
-
-      if (pgmoneta_management_read_json(NULL, server_fd, &compression, &encryption, &payload))
-      {
-         goto done;
-      }
-
-      if (pgmoneta_management_write_json(client_ssl, client_fd, compression, encryption, payload))
-      {
-         goto done;
+         if (pgmoneta_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, &server_fd))
+         {
+            goto done;
+         }
+
+         if (pgmoneta_management_write_json(NULL, server_fd, compression, encryption, payload))
+         {
+            goto done;
+         }
+
+         pgmoneta_json_destroy(payload);
+         payload = NULL;
+
+         if (pgmoneta_management_read_json(NULL, server_fd, &compression, &encryption, &payload))
+         {
+            goto done;
+         }
+
+         if (pgmoneta_management_write_json(client_ssl, client_fd, compression, encryption, payload))
+         {
+            goto done;
+         }
+
+         pgmoneta_json_destroy(payload);
+         payload = NULL;
+
+         /* pgmoneta closes the management socket after each command */
+         pgmoneta_disconnect(server_fd);
+         server_fd = -1;
       }
    }
    else
@@ -29,35 +29,47 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <blockmap.h>
+#include <catalog.h>
 #include <deque.h>
 #include <info.h>
 #include <logging.h>
 #include <management.h>
+#include <manifest.h>
 #include <network.h>
 #include <restore.h>
+#include <scheduler.h>
 #include <security.h>
+#include <storage.h>
 #include <string.h>
 #include <utils.h>
 #include <value.h>
+#include <walk.h>
+#include <workers.h>
 #include <workflow.h>
+#include <zstandard_compression.h>
 
 /* system */
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #define RESTORE_OK            0
 #define RESTORE_MISSING_LABEL 1
 #define RESTORE_NO_DISK_SPACE 2
-#define INCREMENTAL_MAGIC 0xd3ae1f0d
-#define INCREMENTAL_PREFIX_LENGTH (sizeof(INCREMENTAL_PREFIX) - 1)
+#define RESTORE_REMOTE_ERROR  3
 #define MANIFEST_FILES "Files"
 #define MAX_PATH_INCREMENTAL (MAX_PATH * 2)
 
+#define RECONSTRUCT_RUN_SIZE (1024 * 1024)
+
 /**
  * An rfile stores the metadata we need to use a file on disk for reconstruction.
  * For full backup file in the chain, only file name and file pointer are initialized.
@@ -70,18 +82,63 @@
  * while truncation_block_length only reflects length until the checkpoint before backup starts.
  * relative_block_numbers are the relative BlockNumber of each block in the file. Relative here means relative to
  * the starting BlockNumber of this file.
+ * A full file that is only present as a seekable zstd file is read through its seek table,
+ * so only the frames holding the needed blocks are decompressed.
  */
 struct rfile
 {
    char* filepath;
    FILE* fp;
+   struct zstd_seekable* seekable;
    size_t header_length;
    uint32_t num_blocks;
    uint32_t* relative_block_numbers;
    uint32_t truncation_block_length;
 };
 
-static char* restore_last_files_names[] = {"/global/pg_control", "/postgresql.conf", "/pg_hba.conf"};
+/* Restored in this order after the rest of the data directory, with pg_control as the final file */
+static char* restore_last_files_names[] = {"/postgresql.conf", "/pg_hba.conf", "/global/pg_control"};
+
+/** @struct combine
+ * Defines the state shared by the files of a combine, which are reconstructed in parallel
+ */
+struct combine
+{
+   int server;                      /**< The server */
+   int algorithm;                   /**< The manifest hash algorithm */
+   struct deque* prior_backup_dirs; /**< The prior backup directories, from newest to oldest */
+   struct json* files;              /**< The file array inside the manifest */
+   char* label;                     /**< The label of the backup being combined */
+   struct art* blockmap;            /**< The block map index of the backup, or NULL */
+   struct art* directories;         /**< The restored directory of each backup in the chain */
+   struct restore_filter* filter;   /**< The filter of a selective restore, or NULL */
+   pthread_mutex_t lock;            /**< The lock protecting the file array */
+};
+
+static struct combine combine_state = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/** @struct restore_clone
+ * Defines the copy of a restored directory to the other targets
+ */
+struct restore_clone
+{
+   char* root;               /**< The restored directory */
+   char* name;               /**< The name of the directory in each target */
+   char** targets;           /**< The target directories, the first one holds the restore */
+   int number_of_targets;    /**< The number of target directories */
+   struct workers* workers;  /**< The workers */
+};
+
+/** @struct block_source
+ * Defines an incremental file a block map points to
+ */
+struct block_source
+{
+   char* label;                  /**< The label of the backup */
+   struct rfile* rf;             /**< The incremental file */
+   uint32_t* positions;          /**< The position of each block in the file, UINT32_MAX if absent */
+   uint32_t number_of_positions; /**< The number of positions */
+};
 
 static void clear_manifest_incremental_entries(struct json* manifest);
 static int get_file_manifest(char* path, char* manifest_path, int algorithm, struct json** file);
@@ -99,6 +156,7 @@ static int get_file_manifest(char* path, char* manifest_path, int algorithm, str
  * @param algorithm The manifest hash algorithm used for the backup
  * @param prior_backup_dirs The root directory of prior incremental/full backups, from newest to oldest
  * @param files The file array inside manifest of the backup
+ * @param workers The workers, or NULL to combine the files serially
  * @return 0 on success, 1 if otherwise
  */
 static int combine_backups_recursive(uint32_t tsoid,
@@ -108,7 +166,23 @@ static int combine_backups_recursive(uint32_t tsoid,
                                      char* relative_dir,
                                      int algorithm,
                                      struct deque* prior_backup_dirs,
-                                     struct json* files);
+                                     struct json* files,
+                                     struct workers* workers);
+
+/**
+ * Combine a single file into the output directory, either by reconstructing
+ * an incremental file or by copying a full file
+ * @param input_file_path The absolute path to the input file
+ * @param output_file_path The absolute path to the output file
+ * @param relative_dir The directory containing the file relative to the root dir, ending with a slash
+ * @param incremental Is the input file an incremental file
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+combine_file(char* input_file_path, char* output_file_path, char* relative_dir, bool incremental);
+
+static void
+do_combine_file(struct worker_input* wi);
 
 /**
  * Reconstruct an incremental backup file from itself and its prior incremental/full backup files to a full backup file
@@ -140,6 +214,38 @@ reconstruct_backup_file(int server,
 static uint32_t
 find_reconstructed_block_length(struct rfile* s);
 
+/**
+ * Find the source of each block from the block map index instead of walking the chain.
+ * Only the backups that actually hold blocks of the file are opened
+ * @param server The server
+ * @param map The block map of the file
+ * @param latest_source The rfile of the incremental file
+ * @param relative_dir The directory containing the file relative to the root dir, ending with a slash
+ * @param bare_file_name The name of the file without "INCREMENTAL." prefix
+ * @param block_length The number of blocks of the reconstructed file
+ * @param full_copy_possible Whether the latest incremental file has no blocks
+ * @param source_map The source of each block
+ * @param offset_map The offset of each block in its source
+ * @param sources The opened rfiles
+ * @param copy_source The full file the reconstructed file can be directly copied from, if any
+ * @return 0 on success, 1 if the chain has to be walked instead
+ */
+static int
+resolve_blockmap(int server,
+                 struct blockmap* map,
+                 struct rfile* latest_source,
+                 char* relative_dir,
+                 char* bare_file_name,
+                 uint32_t block_length,
+                 bool full_copy_possible,
+                 struct rfile** source_map,
+                 off_t* offset_map,
+                 struct deque* sources,
+                 struct rfile** copy_source);
+
+static char*
+backup_directory_label(char* directory);
+
 static int
 rfile_create(char* file_path, struct rfile** rfile);
 
@@ -156,7 +262,24 @@ static bool
 is_full_file(struct rfile* rf);
 
 static int
-read_block(struct rfile* rf, off_t offset, uint32_t blocksz, uint8_t* buffer);
+read_blocks(struct rfile* rf, off_t offset, size_t length, uint8_t* buffer);
+
+/**
+ * Copy a run of consecutive blocks from a source into the reconstructed file.
+ * Uncompressed sources are copied inside the kernel when possible
+ * @param rf The source
+ * @param offset The offset of the run in the source
+ * @param length The length of the run
+ * @param fd The descriptor of the reconstructed file
+ * @param output_offset The offset of the run in the reconstructed file
+ * @param buffer A buffer of at least length bytes
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+copy_run(struct rfile* rf, off_t offset, size_t length, int fd, off_t output_offset, uint8_t* buffer);
+
+static int
+write_fully(int fd, uint8_t* buffer, size_t length, off_t offset);
 
 static int
 write_reconstructed_file(char* output_file_path,
@@ -171,6 +294,24 @@ write_backup_label(char* from_dir, char* to_dir);
 static uint32_t
 parse_oid(char* name);
 
+static bool
+filter_contains(uint32_t* oids, int number_of_oids, uint32_t oid);
+
+static int
+filter_sparse_file(char* to, off_t size);
+
+static int
+restore_plan(int server, char* identifier, char* position, char** label);
+
+static int
+restore_targets(char* directory, int* number_of_targets, char*** targets);
+
+static int
+restore_clone(int server, struct backup* backup, char** targets, int number_of_targets);
+
+static int
+restore_clone_entry(struct walk_entry* entry, void* arg);
+
 int
 pgmoneta_get_restore_last_files_names(char*** output)
 {
@@ -212,6 +353,180 @@ pgmoneta_is_restore_last_name(char* file_name)
    return false;
 }
 
+int
+pgmoneta_restore_filter_create(int server, char* label, struct backup* backup, char* position, struct restore_filter** filter)
+{
+   char tokens[512];
+   char* ptr = NULL;
+   char* manifest = NULL;
+   struct manifest_listing* files = NULL;
+   int number_of_files = 0;
+   struct restore_filter* f = NULL;
+
+   *filter = NULL;
+
+   if (position == NULL || (strstr(position, "database=") == NULL && strstr(position, "tablespace=") == NULL))
+   {
+      return 0;
+   }
+
+   f = (struct restore_filter*)calloc(1, sizeof(struct restore_filter));
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   memset(&tokens[0], 0, sizeof(tokens));
+   snprintf(&tokens[0], sizeof(tokens), "%s", position);
+
+   ptr = strtok(&tokens[0], ",");
+
+   while (ptr != NULL)
+   {
+      if (pgmoneta_starts_with(ptr, "database="))
+      {
+         uint32_t oid = (uint32_t)strtoul(ptr + strlen("database="), NULL, 10);
+
+         if (oid == 0 || f->number_of_databases >= MAX_NUMBER_OF_TABLESPACES)
+         {
+            pgmoneta_log_error("Restore: Invalid database %s", ptr + strlen("database="));
+            goto error;
+         }
+
+         f->databases[f->number_of_databases++] = oid;
+      }
+      else if (pgmoneta_starts_with(ptr, "tablespace="))
+      {
+         int idx = -1;
+
+         for (uint64_t i = 0; backup != NULL && idx == -1 && i < backup->number_of_tablespaces; i++)
+         {
+            if (!strcmp(ptr + strlen("tablespace="), backup->tablespaces[i]))
+            {
+               idx = (int)i;
+            }
+         }
+
+         if (idx == -1 || f->number_of_tablespaces >= MAX_NUMBER_OF_TABLESPACES)
+         {
+            pgmoneta_log_error("Restore: Unknown tablespace %s", ptr + strlen("tablespace="));
+            goto error;
+         }
+
+         f->tablespaces[f->number_of_tablespaces++] = parse_oid(backup->tablespaces_oids[idx]);
+      }
+
+      ptr = strtok(NULL, ",");
+   }
+
+   // the backup files may be compressed, so the sizes of the original files come from the manifest
+   if (pgmoneta_art_create(&f->sizes))
+   {
+      goto error;
+   }
+
+   manifest = pgmoneta_get_server_backup_identifier(server, label);
+   manifest = pgmoneta_append(manifest, "backup.manifest");
+
+   if (pgmoneta_manifest_files(manifest, false, &files, &number_of_files))
+   {
+      pgmoneta_log_warn("Restore: Could not read %s, the relation files will be restored", manifest);
+      number_of_files = 0;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if (files[i].size >= 0)
+      {
+         pgmoneta_art_insert(f->sizes, files[i].path, (uintptr_t)files[i].size, ValueInt64);
+      }
+   }
+
+   pgmoneta_manifest_files_destroy(files, number_of_files);
+   free(manifest);
+
+   pgmoneta_log_debug("Restore: %d databases and %d tablespaces selected", f->number_of_databases, f->number_of_tablespaces);
+
+   *filter = f;
+
+   return 0;
+
+error:
+
+   free(manifest);
+   pgmoneta_restore_filter_destroy(f);
+
+   return 1;
+}
+
+bool
+pgmoneta_restore_filter_excluded(struct restore_filter* filter, char* path)
+{
+   uint32_t tsoid = 0;
+   uint32_t dboid = 0;
+   char* name = NULL;
+
+   if (filter == NULL || path == NULL)
+   {
+      return false;
+   }
+
+   // only the relation files are left out, so PG_VERSION and pg_filenode.map keep the databases valid
+   name = strrchr(path, '/');
+   name = name != NULL ? name + 1 : path;
+
+   if (*name < '0' || *name > '9')
+   {
+      return false;
+   }
+
+   if (sscanf(path, "base/%u/", &dboid) == 1)
+   {
+      tsoid = 0;
+   }
+   else if (sscanf(path, "pg_tblspc/%u/%*[^/]/%u/", &tsoid, &dboid) != 2)
+   {
+      return false;
+   }
+
+   if (tsoid != 0 && filter->number_of_tablespaces > 0 &&
+       !filter_contains(filter->tablespaces, filter->number_of_tablespaces, tsoid))
+   {
+      return true;
+   }
+
+   if (dboid >= RESTORE_FIRST_USER_OID && filter->number_of_databases > 0 &&
+       !filter_contains(filter->databases, filter->number_of_databases, dboid))
+   {
+      return true;
+   }
+
+   return false;
+}
+
+int
+pgmoneta_restore_filter_file(struct restore_filter* filter, char* path, char* to)
+{
+   if (!pgmoneta_restore_filter_excluded(filter, path) || !pgmoneta_art_contains_key(filter->sizes, path))
+   {
+      return 1;
+   }
+
+   return filter_sparse_file(to, (off_t)pgmoneta_art_search(filter->sizes, path));
+}
+
+void
+pgmoneta_restore_filter_destroy(struct restore_filter* filter)
+{
+   if (filter == NULL)
+   {
+      return;
+   }
+
+   pgmoneta_art_destroy(filter->sizes);
+   free(filter);
+}
+
 void
 pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
 {
@@ -219,7 +534,10 @@ pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
    char* identifier = NULL;
    char* position = NULL;
    char* directory = NULL;
+   char* label = NULL;
    char* elapsed = NULL;
+   int number_of_targets = 0;
+   char** targets = NULL;
    struct timespec start_t;
    struct timespec end_t;
    double total_seconds = 0;
@@ -231,29 +549,72 @@ pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
    struct configuration* config;
 
    pgmoneta_start_logging();
+   pgmoneta_scheduler_priority(SCHEDULER_PRIORITY_RESTORE);
 
    config = (struct configuration*)shmem;
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
 
    atomic_fetch_add(&config->active_restores, 1);
-   atomic_fetch_add(&config->servers[server].restore, 1);
+   atomic_fetch_add(&config->states[server].restore, 1);
 
    req = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
    identifier = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_BACKUP);
    position = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_POSITION);
    directory = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_DIRECTORY);
 
-   if (pgmoneta_art_create(&nodes))
+   // a list of directories gets one restore, which is decoded once into the first of them
+   if (restore_targets(directory, &number_of_targets, &targets))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_RESTORE_ERROR, compression, encryption, payload);
+      goto error;
+   }
+   directory = targets[0];
+
+   if (pgmoneta_art_create_concurrent(&nodes))
+   {
+      goto error;
+   }
+
+   if (restore_plan(server, identifier, position, &label))
    {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_RESTORE_NOBACKUP, compression, encryption, payload);
       goto error;
    }
 
+   if (label != NULL)
+   {
+      identifier = label;
+   }
+
+   if (!pgmoneta_sftp_restore_target(directory) &&
+       (config->storage_engine & (STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
+   {
+      char* d = pgmoneta_get_server_backup_identifier(server, identifier);
+
+      /* The local copy is gone, pull the backup metadata back from the object store */
+      if (d != NULL && !pgmoneta_exists(d))
+      {
+         pgmoneta_storage_fetch_backup(server, identifier);
+      }
+
+      free(d);
+   }
+
    if (pgmoneta_workflow_nodes(server, identifier, nodes, &backup))
    {
       goto error;
    }
 
+   // only a full backup can be restored straight from the object store
+   if (backup->type != TYPE_FULL || backup->deduplication || backup->page_filter)
+   {
+      if (pgmoneta_storage_recall(server, backup))
+      {
+         goto error;
+      }
+   }
+
    if (pgmoneta_art_insert(nodes, NODE_POSITION, (uintptr_t)position, ValueString))
    {
       goto error;
@@ -264,7 +625,21 @@ pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
       goto error;
    }
 
-   ret = pgmoneta_restore_backup(nodes);
+   if (pgmoneta_sftp_restore_target(directory))
+   {
+      /* The files go straight to the remote host, so there is no local disk space to check */
+      ret = pgmoneta_sftp_restore(server, backup, position, directory) ? RESTORE_REMOTE_ERROR : RESTORE_OK;
+   }
+   else
+   {
+      ret = pgmoneta_restore_backup(nodes);
+
+      if (ret == RESTORE_OK && number_of_targets > 1 && restore_clone(server, backup, targets, number_of_targets))
+      {
+         ret = RESTORE_REMOTE_ERROR;
+      }
+   }
+
    if (ret == RESTORE_OK)
    {
       if (pgmoneta_management_create_response(payload, server, &response))
@@ -306,6 +681,13 @@ pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
       pgmoneta_log_warn("Restore: No identifier for %s/%s", config->servers[server].name, identifier);
       goto error;
    }
+   else if (ret == RESTORE_REMOTE_ERROR)
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_RESTORE_ERROR,
+                                         compression, encryption, payload);
+      pgmoneta_log_error("Restore: Could not restore %s/%s to %s", config->servers[server].name, identifier, directory);
+      goto error;
+   }
    else
    {
       pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_RESTORE_NODISK,
@@ -317,12 +699,18 @@ pgmoneta_restore(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
 
    pgmoneta_disconnect(client_fd);
 
-   atomic_fetch_sub(&config->servers[server].restore, 1);
+   atomic_fetch_sub(&config->states[server].restore, 1);
    atomic_fetch_sub(&config->active_restores, 1);
 
    pgmoneta_stop_logging();
 
+   for (int i = 0; i < number_of_targets; i++)
+   {
+      free(targets[i]);
+   }
+   free(targets);
    free(backup);
+   free(label);
    free(elapsed);
    free(output);
 
@@ -334,12 +722,18 @@ error:
 
    pgmoneta_disconnect(client_fd);
 
-   atomic_fetch_sub(&config->servers[server].restore, 1);
+   atomic_fetch_sub(&config->states[server].restore, 1);
    atomic_fetch_sub(&config->active_restores, 1);
 
    pgmoneta_stop_logging();
 
+   for (int i = 0; i < number_of_targets; i++)
+   {
+      free(targets[i]);
+   }
+   free(targets);
    free(backup);
+   free(label);
    free(elapsed);
    free(output);
 
@@ -365,6 +759,11 @@ pgmoneta_restore_backup(struct art* nodes)
 
    config = (struct configuration*)shmem;
 
+   pgmoneta_durability(config->restore_durability);
+
+   /* Files and directories are created as 0600 and 0700, so no permission pass is needed afterwards */
+   umask(S_IRWXG | S_IRWXO);
+
    memset(directory_incremental, 0, MAX_PATH);
    memset(directory_combine, 0, MAX_PATH);
 
@@ -472,15 +871,10 @@ pgmoneta_restore_backup(struct art* nodes)
       current = current->next;
    }
 
-   current = workflow;
-   while (current != NULL)
+   if (pgmoneta_workflow_run(workflow, nodes))
    {
-      if (current->execute(current->name(), nodes))
-      {
-         ret = RESTORE_MISSING_LABEL;
-         goto error;
-      }
-      current = current->next;
+      ret = RESTORE_MISSING_LABEL;
+      goto error;
    }
 
    current = workflow;
@@ -503,6 +897,13 @@ pgmoneta_restore_backup(struct art* nodes)
       }
    }
 
+   // the target root node was replaced for incremental restores, so sync through the combined directory
+   if (pgmoneta_sync_filesystem(strlen(directory_combine) > 0 ? directory_combine : directory))
+   {
+      ret = RESTORE_MISSING_LABEL;
+      goto error;
+   }
+
    free(manifest_path);
 
    pgmoneta_workflow_destroy(workflow);
@@ -541,7 +942,7 @@ error:
 }
 
 int
-pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs, struct backup* bck, struct json* manifest)
+pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs, struct backup* bck, struct json* manifest, struct restore_filter* filter)
 {
    uint32_t tsoid = 0;
    char relative_tablespace_path[MAX_PATH];
@@ -550,6 +951,9 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
    char otblspc_dir[MAX_PATH];
    char manifest_path[MAX_PATH];
    struct json* files = NULL;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct deque_iterator* dir_iter = NULL;
    struct configuration* config;
 
    if (manifest == NULL || prior_backup_dirs == NULL || base == NULL || input_dir == NULL || output_dir == NULL)
@@ -578,8 +982,45 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
       goto error;
    }
 
+   combine_state.server = server;
+   combine_state.algorithm = bck->hash_algorithm;
+   combine_state.prior_backup_dirs = prior_backup_dirs;
+   combine_state.files = files;
+   combine_state.label = bck->label;
+   combine_state.filter = filter;
+
+   // the block map points at backups by label
+   pgmoneta_art_create(&combine_state.directories);
+   pgmoneta_art_insert(combine_state.directories, bck->label, (uintptr_t)input_dir, ValueString);
+   pgmoneta_deque_iterator_create(prior_backup_dirs, &dir_iter);
+   while (pgmoneta_deque_iterator_next(dir_iter))
+   {
+      char* dir = (char*)pgmoneta_value_data(dir_iter->value);
+      char* label = backup_directory_label(dir);
+
+      if (label != NULL)
+      {
+         pgmoneta_art_insert(combine_state.directories, label, (uintptr_t)dir, ValueString);
+      }
+      free(label);
+   }
+   pgmoneta_deque_iterator_destroy(dir_iter);
+   dir_iter = NULL;
+
+   if (pgmoneta_blockmap_read(server, bck->label, &combine_state.blockmap))
+   {
+      combine_state.blockmap = NULL;
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+      pgmoneta_workers_plan(workers);
+   }
+
    // round 1 for base data directory
-   if (combine_backups_recursive(0, server, input_dir, output_dir, NULL, bck->hash_algorithm, prior_backup_dirs, files))
+   if (combine_backups_recursive(0, server, input_dir, output_dir, NULL, bck->hash_algorithm, prior_backup_dirs, files, workers))
    {
       goto error;
    }
@@ -612,10 +1053,21 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
          pgmoneta_log_error("Combine backups: unable to create symlink %s->%s", otblspc_dir, relative_tablespace_path);
       }
 
-      if (combine_backups_recursive(tsoid, server, itblspc_dir, full_tablespace_path, NULL, bck->hash_algorithm, prior_backup_dirs, files))
+      if (combine_backups_recursive(tsoid, server, itblspc_dir, full_tablespace_path, NULL, bck->hash_algorithm, prior_backup_dirs, files, workers))
+      {
+         goto error;
+      }
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
       {
          goto error;
       }
+      pgmoneta_workers_destroy(workers);
+      number_of_workers = 0;
    }
 
    if (write_backup_label(input_dir, output_dir))
@@ -629,8 +1081,29 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
       goto error;
    }
 
+   combine_state.prior_backup_dirs = NULL;
+   combine_state.files = NULL;
+   combine_state.label = NULL;
+   combine_state.filter = NULL;
+   pgmoneta_art_destroy(combine_state.blockmap);
+   combine_state.blockmap = NULL;
+   pgmoneta_art_destroy(combine_state.directories);
+   combine_state.directories = NULL;
    return 0;
 error:
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+   combine_state.prior_backup_dirs = NULL;
+   combine_state.files = NULL;
+   combine_state.label = NULL;
+   combine_state.filter = NULL;
+   pgmoneta_art_destroy(combine_state.blockmap);
+   combine_state.blockmap = NULL;
+   pgmoneta_art_destroy(combine_state.directories);
+   combine_state.directories = NULL;
    return 1;
 }
 
@@ -642,7 +1115,8 @@ combine_backups_recursive(uint32_t tsoid,
                           char* relative_dir,
                           int algorithm,
                           struct deque* prior_backup_dirs,
-                          struct json* files)
+                          struct json* files,
+                          struct workers* workers)
 {
    bool is_pg_tblspc = false;
    bool is_incremental_dir = false;
@@ -655,7 +1129,7 @@ combine_backups_recursive(uint32_t tsoid,
    char relative_prefix[MAX_PATH];
    DIR* dir = NULL;
    struct dirent* entry;
-   struct json* file = NULL;
+   struct worker_input* wi = NULL;
 
    memset(ifulldir, 0, MAX_PATH);
    memset(ofulldir, 0, MAX_PATH);
@@ -717,7 +1191,7 @@ combine_backups_recursive(uint32_t tsoid,
    {
       char ifullpath[MAX_PATH_INCREMENTAL];
       char ofullpath[MAX_PATH_INCREMENTAL];
-      char manifest_path[MAX_PATH_INCREMENTAL];
+      bool incremental = false;
 
       if (pgmoneta_compare_string(entry->d_name, ".") || pgmoneta_compare_string(entry->d_name, ".."))
       {
@@ -726,7 +1200,6 @@ combine_backups_recursive(uint32_t tsoid,
 
       memset(ifullpath, 0, MAX_PATH_INCREMENTAL);
       memset(ofullpath, 0, MAX_PATH_INCREMENTAL);
-      memset(manifest_path, 0, MAX_PATH_INCREMENTAL);
 
       snprintf(ifullpath, MAX_PATH_INCREMENTAL, "%s/%s", ifulldir, entry->d_name);
 
@@ -751,7 +1224,7 @@ combine_backups_recursive(uint32_t tsoid,
          {
             snprintf(new_relative_dir, MAX_PATH, "%s/%s", relative_dir, entry->d_name);
          }
-         combine_backups_recursive(tsoid, server, input_dir, output_dir, new_relative_dir, algorithm, prior_backup_dirs, files);
+         combine_backups_recursive(tsoid, server, input_dir, output_dir, new_relative_dir, algorithm, prior_backup_dirs, files, workers);
          continue;
       }
 
@@ -779,32 +1252,26 @@ combine_backups_recursive(uint32_t tsoid,
       {
          // finally found an incremental file
          snprintf(ofullpath, MAX_PATH_INCREMENTAL, "%s/%s", ofulldir, entry->d_name + INCREMENTAL_PREFIX_LENGTH);
-         snprintf(manifest_path, MAX_PATH_INCREMENTAL, "%s%s", relative_prefix, entry->d_name + INCREMENTAL_PREFIX_LENGTH);
-         if (reconstruct_backup_file(server,
-                                     ifullpath,
-                                     ofullpath,
-                                     relative_prefix,
-                                     entry->d_name + INCREMENTAL_PREFIX_LENGTH,
-                                     prior_backup_dirs))
-         {
-            pgmoneta_log_error("unable to reconstruct file %s", ifullpath);
-            goto error;
-         }
-         // Update file entry in manifest
-         if (get_file_manifest(ofullpath, manifest_path, algorithm, &file))
-         {
-            pgmoneta_log_error("Unable to get manifest for file %s", ofullpath);
-         }
-         else
-         {
-            pgmoneta_json_append(files, (uintptr_t)file, ValueJSON);
-         }
+         incremental = true;
       }
       else
       {
          // copy the full file from input dir to output dir
          snprintf(ofullpath, MAX_PATH_INCREMENTAL, "%s/%s", ofulldir, entry->d_name);
-         pgmoneta_copy_file(ifullpath, ofullpath, NULL);
+      }
+
+      if (workers != NULL)
+      {
+         if (pgmoneta_create_worker_input(relative_prefix, ifullpath, ofullpath, incremental ? 1 : 0, workers, &wi))
+         {
+            goto error;
+         }
+         pgmoneta_workers_add(workers, do_combine_file, wi);
+         wi = NULL;
+      }
+      else if (combine_file(ifullpath, ofullpath, relative_prefix, incremental))
+      {
+         goto error;
       }
    }
 
@@ -822,19 +1289,102 @@ error:
 }
 
 static int
-reconstruct_backup_file(int server,
-                        char* input_file_path,
-                        char* output_file_path,
-                        char* relative_dir,
-                        char* bare_file_name,
-                        struct deque* prior_backup_dirs)
+combine_file(char* input_file_path, char* output_file_path, char* relative_dir, bool incremental)
 {
-   struct deque* sources = NULL; // bookkeeping of each incr/full backup rfile, so that we can free them conveniently
-   struct deque_iterator* bck_iter = NULL; // the iterator for backup directories
-   struct rfile* latest_source = NULL; // the metadata of current incr backup file
-   struct rfile** source_map = NULL; // source to find each block
-   off_t* offset_map = NULL; // offsets to find each block in corresponding file
-   uint32_t block_length = 0; // total number of blocks in the reconstructed file
+   char* bare_file_name = NULL;
+   char manifest_path[MAX_PATH_INCREMENTAL];
+   struct json* file = NULL;
+   struct rfile* rf = NULL;
+   struct stat st;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   bare_file_name = strrchr(output_file_path, '/') + 1;
+
+   memset(manifest_path, 0, MAX_PATH_INCREMENTAL);
+   snprintf(manifest_path, MAX_PATH_INCREMENTAL, "%s%s", relative_dir, bare_file_name);
+
+   // the relation files left out by a selective restore are neither copied nor reconstructed
+   if (pgmoneta_restore_filter_excluded(combine_state.filter, manifest_path))
+   {
+      if (!incremental && !stat(input_file_path, &st))
+      {
+         return filter_sparse_file(output_file_path, st.st_size);
+      }
+      else if (incremental && !incremental_rfile_initialize(combine_state.server, input_file_path, &rf))
+      {
+         off_t size = (off_t)find_reconstructed_block_length(rf) * config->servers[combine_state.server].block_size;
+
+         rfile_destroy(rf);
+
+         return filter_sparse_file(output_file_path, size);
+      }
+   }
+
+   if (!incremental)
+   {
+      if (pgmoneta_copy_file(input_file_path, output_file_path, NULL))
+      {
+         pgmoneta_log_error("combine backup: unable to copy file %s", input_file_path);
+         goto error;
+      }
+      return 0;
+   }
+
+   if (reconstruct_backup_file(combine_state.server,
+                               input_file_path,
+                               output_file_path,
+                               relative_dir,
+                               bare_file_name,
+                               combine_state.prior_backup_dirs))
+   {
+      pgmoneta_log_error("unable to reconstruct file %s", input_file_path);
+      goto error;
+   }
+
+   // Update file entry in manifest
+   if (get_file_manifest(output_file_path, manifest_path, combine_state.algorithm, &file))
+   {
+      pgmoneta_log_error("Unable to get manifest for file %s", output_file_path);
+   }
+   else
+   {
+      pthread_mutex_lock(&combine_state.lock);
+      pgmoneta_json_append(combine_state.files, (uintptr_t)file, ValueJSON);
+      pthread_mutex_unlock(&combine_state.lock);
+   }
+
+   return 0;
+error:
+   return 1;
+}
+
+static void
+do_combine_file(struct worker_input* wi)
+{
+   if (combine_file(wi->from, wi->to, wi->directory, wi->level == 1))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+reconstruct_backup_file(int server,
+                        char* input_file_path,
+                        char* output_file_path,
+                        char* relative_dir,
+                        char* bare_file_name,
+                        struct deque* prior_backup_dirs)
+{
+   struct deque* sources = NULL; // bookkeeping of each incr/full backup rfile, so that we can free them conveniently
+   struct deque_iterator* bck_iter = NULL; // the iterator for backup directories
+   struct rfile* latest_source = NULL; // the metadata of current incr backup file
+   struct rfile** source_map = NULL; // source to find each block
+   off_t* offset_map = NULL; // offsets to find each block in corresponding file
+   uint32_t block_length = 0; // total number of blocks in the reconstructed file
    bool full_copy_possible = true; // whether we could just copy over directly instead of block by block
    uint32_t b = 0; // temp variable for block numbers
    struct configuration* config;
@@ -843,6 +1393,8 @@ reconstruct_backup_file(int server,
    uint32_t nblocks = 0;
    size_t file_size = 0;
    struct rfile* copy_source = NULL;
+   struct blockmap* map = NULL;
+   bool resolved = false;
    struct value_config rfile_config = {.destroy_data = rfile_destroy_cb, .to_string = NULL};
 
    config = (struct configuration*)shmem;
@@ -898,71 +1450,109 @@ reconstruct_backup_file(int server,
    // There could be blocks that cannot be sourced. This is probably because the block gets truncated
    // during the backup process before it gets backed up. In this case just zero fill the block later,
    // the WAL replay will fix the inconsistency since it's getting truncated in the first place.
-   pgmoneta_deque_iterator_create(prior_backup_dirs, &bck_iter);
-   while (pgmoneta_deque_iterator_next(bck_iter))
+   if (combine_state.blockmap != NULL)
    {
-      struct rfile* rf = NULL;
-      char* dir = (char*)pgmoneta_value_data(bck_iter->value);
-      // try finding the full file
       memset(path, 0, MAX_PATH);
-      // relative directory always ends with '/'
-      snprintf(path, MAX_PATH, "%s/%s%s", dir, relative_dir, bare_file_name);
-      if (rfile_create(path, &rf))
+      snprintf(path, MAX_PATH, "%s%s", relative_dir, bare_file_name);
+      if (!pgmoneta_blockmap_get(combine_state.blockmap, path, &map) && map != NULL)
       {
-         memset(path, 0, MAX_PATH);
-         snprintf(path, MAX_PATH, "%s/%s/INCREMENTAL.%s", dir, relative_dir, bare_file_name);
-         if (incremental_rfile_initialize(server, path, &rf))
+         if (!resolve_blockmap(server, map, latest_source, relative_dir, bare_file_name, block_length,
+                               full_copy_possible, source_map, offset_map, sources, &copy_source))
          {
-            goto error;
+            resolved = true;
+         }
+         else
+         {
+            pgmoneta_log_debug("reconstruct: block map of %s is incomplete, walking the chain", input_file_path);
+            for (b = 0; b < block_length; b++)
+            {
+               if (source_map[b] != latest_source)
+               {
+                  source_map[b] = NULL;
+                  offset_map[b] = 0;
+               }
+            }
+            copy_source = NULL;
          }
       }
-      pgmoneta_deque_add_with_config(sources, NULL, (uintptr_t)rf, &rfile_config);
+   }
 
-      // If it's a full file, all blocks not sourced yet can be sourced from it.
-      // And then we are done, no need to go further back.
-      if (is_full_file(rf))
+   if (!resolved)
+   {
+      pgmoneta_deque_iterator_create(prior_backup_dirs, &bck_iter);
+      while (pgmoneta_deque_iterator_next(bck_iter))
       {
-         // would be nice if we could check if stat fails
-         file_size = pgmoneta_get_file_size(rf->filepath);
-         nblocks = file_size / blocksz;
-
-         // no need to check for blocks beyond truncation_block_length
-         // since those blocks should have been truncated away anyway,
-         // we just need to zero fill them later.
-         for (b = 0; b < latest_source->truncation_block_length; b++)
+         struct rfile* rf = NULL;
+         char* dir = (char*)pgmoneta_value_data(bck_iter->value);
+         // try finding the full file
+         memset(path, 0, MAX_PATH);
+         // relative directory always ends with '/'
+         snprintf(path, MAX_PATH, "%s/%s%s", dir, relative_dir, bare_file_name);
+         if (rfile_create(path, &rf))
          {
-            if (source_map[b] == NULL && b < nblocks)
+            memset(path, 0, MAX_PATH);
+            snprintf(path, MAX_PATH, "%s/%s/INCREMENTAL.%s", dir, relative_dir, bare_file_name);
+            if (incremental_rfile_initialize(server, path, &rf))
             {
-               source_map[b] = rf;
-               offset_map[b] = b * blocksz;
+               goto error;
             }
          }
+         pgmoneta_deque_add_with_config(sources, NULL, (uintptr_t)rf, &rfile_config);
 
-         // full_copy_possible only remains true when there are no modified blocks in later incremental files,
-         // which means the file has probably never been modified since last full backup.
-         // But it still could've gotten truncated, so check the file size.
-         if (full_copy_possible && file_size == block_length * blocksz)
+         // If it's a full file, all blocks not sourced yet can be sourced from it.
+         // And then we are done, no need to go further back.
+         if (is_full_file(rf))
          {
-            copy_source = rf;
-         }
+            // would be nice if we could check if stat fails
+            if (rf->seekable != NULL)
+            {
+               file_size = pgmoneta_zstandardd_seekable_size(rf->seekable);
+            }
+            else
+            {
+               file_size = pgmoneta_get_file_size(rf->filepath);
+            }
+            nblocks = file_size / blocksz;
 
-         break;
-      }
-      // as for an incremental file, source blocks we don't have yet from it
-      for (int i = 0; i < rf->num_blocks; i++)
-      {
-         b = rf->relative_block_numbers[i];
-         // only the latest source may contain blocks exceeding the latest truncation block length
-         // as for the rest...
-         if (b >= latest_source->truncation_block_length || source_map[b] != NULL)
+            // no need to check for blocks beyond truncation_block_length
+            // since those blocks should have been truncated away anyway,
+            // we just need to zero fill them later.
+            for (b = 0; b < latest_source->truncation_block_length; b++)
+            {
+               if (source_map[b] == NULL && b < nblocks)
+               {
+                  source_map[b] = rf;
+                  offset_map[b] = b * blocksz;
+               }
+            }
+
+            // full_copy_possible only remains true when there are no modified blocks in later incremental files,
+            // which means the file has probably never been modified since last full backup.
+            // But it still could've gotten truncated, so check the file size.
+            if (full_copy_possible && file_size == block_length * blocksz && rf->seekable == NULL)
+            {
+               copy_source = rf;
+            }
+
+            break;
+         }
+         // as for an incremental file, source blocks we don't have yet from it
+         for (int i = 0; i < rf->num_blocks; i++)
          {
-            continue;
+            b = rf->relative_block_numbers[i];
+            // only the latest source may contain blocks exceeding the latest truncation block length
+            // as for the rest...
+            if (b >= latest_source->truncation_block_length || source_map[b] != NULL)
+            {
+               continue;
+            }
+            source_map[b] = rf;
+            offset_map[b] = rf->header_length + (i * blocksz);
+            full_copy_possible = false;
          }
-         source_map[b] = rf;
-         offset_map[b] = rf->header_length + (i * blocksz);
-         full_copy_possible = false;
       }
    }
+
    // let's skip manifest for now
    if (copy_source != NULL)
    {
@@ -980,12 +1570,14 @@ reconstruct_backup_file(int server,
          goto error;
       }
    }
+   pgmoneta_blockmap_destroy(map);
    pgmoneta_deque_destroy(sources);
    pgmoneta_deque_iterator_destroy(bck_iter);
    free(source_map);
    free(offset_map);
    return 0;
 error:
+   pgmoneta_blockmap_destroy(map);
    pgmoneta_deque_destroy(sources);
    pgmoneta_deque_iterator_destroy(bck_iter);
    free(source_map);
@@ -993,6 +1585,218 @@ error:
    return 1;
 }
 
+static int
+resolve_blockmap(int server,
+                 struct blockmap* map,
+                 struct rfile* latest_source,
+                 char* relative_dir,
+                 char* bare_file_name,
+                 uint32_t block_length,
+                 bool full_copy_possible,
+                 struct rfile** source_map,
+                 off_t* offset_map,
+                 struct deque* sources,
+                 struct rfile** copy_source)
+{
+   struct configuration* config;
+   size_t blocksz = 0;
+   char path[MAX_PATH];
+   char* dir = NULL;
+   char* label = NULL;
+   struct rfile* full = NULL;
+   size_t file_size = 0;
+   uint32_t nblocks = 0;
+   struct block_source* chain = NULL;
+   struct block_source* current = NULL;
+   int chain_length = 0;
+   int number_of_sources = 0;
+   uint32_t position = 0;
+   struct value_config rfile_config = {.destroy_data = rfile_destroy_cb, .to_string = NULL};
+
+   config = (struct configuration*)shmem;
+
+   blocksz = config->servers[server].block_size;
+
+   *copy_source = NULL;
+
+   chain_length = pgmoneta_deque_size(combine_state.prior_backup_dirs) + 1;
+   chain = (struct block_source*)calloc(chain_length, sizeof(struct block_source));
+   if (chain == NULL)
+   {
+      goto error;
+   }
+
+   // the full file is where walking the chain would have stopped
+   dir = (char*)pgmoneta_art_search(combine_state.directories, map->full);
+   if (dir == NULL)
+   {
+      goto error;
+   }
+   memset(path, 0, MAX_PATH);
+   snprintf(path, MAX_PATH, "%s/%s%s", dir, relative_dir, bare_file_name);
+   if (rfile_create(path, &full))
+   {
+      goto error;
+   }
+   pgmoneta_deque_add_with_config(sources, NULL, (uintptr_t)full, &rfile_config);
+
+   if (full->seekable != NULL)
+   {
+      file_size = pgmoneta_zstandardd_seekable_size(full->seekable);
+   }
+   else
+   {
+      file_size = pgmoneta_get_file_size(full->filepath);
+   }
+   nblocks = file_size / blocksz;
+
+   for (uint32_t b = 0; b < latest_source->truncation_block_length && b < block_length; b++)
+   {
+      if (source_map[b] != NULL)
+      {
+         continue;
+      }
+
+      label = pgmoneta_blockmap_source(map, b);
+      if (label == map->full)
+      {
+         if (b < nblocks)
+         {
+            source_map[b] = full;
+            offset_map[b] = b * blocksz;
+         }
+         continue;
+      }
+
+      // the blocks of the latest backup itself are already sourced
+      if (!strcmp(label, combine_state.label))
+      {
+         goto error;
+      }
+
+      if (current == NULL || strcmp(current->label, label))
+      {
+         current = NULL;
+         for (int i = 0; i < number_of_sources; i++)
+         {
+            if (!strcmp(chain[i].label, label))
+            {
+               current = &chain[i];
+               break;
+            }
+         }
+      }
+
+      if (current == NULL)
+      {
+         struct rfile* rf = NULL;
+
+         if (number_of_sources == chain_length)
+         {
+            goto error;
+         }
+
+         dir = (char*)pgmoneta_art_search(combine_state.directories, label);
+         if (dir == NULL)
+         {
+            goto error;
+         }
+         memset(path, 0, MAX_PATH);
+         snprintf(path, MAX_PATH, "%s/%sINCREMENTAL.%s", dir, relative_dir, bare_file_name);
+         if (incremental_rfile_initialize(server, path, &rf))
+         {
+            goto error;
+         }
+         pgmoneta_deque_add_with_config(sources, NULL, (uintptr_t)rf, &rfile_config);
+
+         current = &chain[number_of_sources++];
+         current->label = label;
+         current->rf = rf;
+         for (uint32_t i = 0; i < rf->num_blocks; i++)
+         {
+            if (rf->relative_block_numbers[i] + 1 > current->number_of_positions)
+            {
+               current->number_of_positions = rf->relative_block_numbers[i] + 1;
+            }
+         }
+         if (current->number_of_positions > 0)
+         {
+            current->positions = (uint32_t*)malloc(sizeof(uint32_t) * current->number_of_positions);
+            if (current->positions == NULL)
+            {
+               goto error;
+            }
+            memset(current->positions, 0xff, sizeof(uint32_t) * current->number_of_positions);
+            for (uint32_t i = 0; i < rf->num_blocks; i++)
+            {
+               current->positions[rf->relative_block_numbers[i]] = i;
+            }
+         }
+      }
+
+      position = b < current->number_of_positions ? current->positions[b] : UINT32_MAX;
+      if (position == UINT32_MAX)
+      {
+         goto error;
+      }
+
+      source_map[b] = current->rf;
+      offset_map[b] = current->rf->header_length + ((off_t)position * blocksz);
+      full_copy_possible = false;
+   }
+
+   if (full_copy_possible && file_size == block_length * blocksz && full->seekable == NULL)
+   {
+      *copy_source = full;
+   }
+
+   for (int i = 0; i < number_of_sources; i++)
+   {
+      free(chain[i].positions);
+   }
+   free(chain);
+
+   return 0;
+error:
+   for (int i = 0; chain != NULL && i < number_of_sources; i++)
+   {
+      free(chain[i].positions);
+   }
+   free(chain);
+   return 1;
+}
+
+static char*
+backup_directory_label(char* directory)
+{
+   char* d = NULL;
+   char* name = NULL;
+   char* label = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_append(NULL, directory);
+   while (strlen(d) > 1 && d[strlen(d) - 1] == '/')
+   {
+      d[strlen(d) - 1] = '\0';
+   }
+
+   name = strrchr(d, '/');
+   name = name != NULL ? name + 1 : d;
+
+   // restored backups are named <server>-<label>
+   if (pgmoneta_starts_with(name, config->servers[combine_state.server].name) &&
+       name[strlen(config->servers[combine_state.server].name)] == '-')
+   {
+      label = pgmoneta_append(NULL, name + strlen(config->servers[combine_state.server].name) + 1);
+   }
+
+   free(d);
+
+   return label;
+}
+
 static uint32_t
 find_reconstructed_block_length(struct rfile* s)
 {
@@ -1018,16 +1822,24 @@ rfile_create(char* file_path, struct rfile** rfile)
 {
    struct rfile* rf = NULL;
    FILE* fp = NULL;
+   struct zstd_seekable* seekable = NULL;
+   char zstd_path[MAX_PATH];
+
    fp = fopen(file_path, "r");
 
    if (fp == NULL)
    {
-      goto error;
+      snprintf(zstd_path, sizeof(zstd_path), "%s.zstd", file_path);
+      if (!pgmoneta_exists(zstd_path) || pgmoneta_zstandardd_seekable_open(zstd_path, &seekable))
+      {
+         goto error;
+      }
    }
    rf = (struct rfile*) malloc(sizeof(struct rfile));
    memset(rf, 0, sizeof(struct rfile));
    rf->filepath = pgmoneta_append(NULL, file_path);
    rf->fp = fp;
+   rf->seekable = seekable;
    *rfile = rf;
    return 0;
 
@@ -1047,6 +1859,7 @@ rfile_destroy(struct rfile* rf)
    {
       fclose(rf->fp);
    }
+   pgmoneta_zstandardd_seekable_close(rf->seekable);
    free(rf->filepath);
    free(rf->relative_block_numbers);
    free(rf);
@@ -1160,22 +1973,106 @@ is_full_file(struct rfile* rf)
 }
 
 static int
-read_block(struct rfile* rf, off_t offset, uint32_t blocksz, uint8_t* buffer)
+read_blocks(struct rfile* rf, off_t offset, size_t length, uint8_t* buffer)
 {
-   int nread = 0;
-   if (fseek(rf->fp, offset, SEEK_SET))
+   ssize_t nread = 0;
+   size_t total = 0;
+
+   if (rf->seekable != NULL)
    {
-      pgmoneta_log_error("unable to locate file pointer to offset %llu in file %s", offset, rf->filepath);
-      goto error;
+      if (pgmoneta_zstandardd_seekable_read(rf->seekable, offset, length, buffer))
+      {
+         pgmoneta_log_error("unable to read blocks at offset %llu from file %s", offset, rf->filepath);
+         goto error;
+      }
+      return 0;
+   }
+
+   while (total < length)
+   {
+      nread = pread(fileno(rf->fp), buffer + total, length - total, offset + total);
+      if (nread < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (nread <= 0)
+      {
+         pgmoneta_log_error("unable to read blocks at offset %llu from file %s", offset, rf->filepath);
+         goto error;
+      }
+      total += nread;
    }
 
-   nread = fread(buffer, 1, blocksz, rf->fp);
-   if (nread != blocksz)
+   return 0;
+error:
+   return 1;
+}
+
+static int
+copy_run(struct rfile* rf, off_t offset, size_t length, int fd, off_t output_offset, uint8_t* buffer)
+{
+#ifdef HAVE_LINUX
+   loff_t in = offset;
+   loff_t out = output_offset;
+   ssize_t copied = 0;
+
+   if (rf->seekable == NULL)
+   {
+      // only fall back to user space when the file system can't do it for us
+      while (length > 0)
+      {
+         copied = copy_file_range(fileno(rf->fp), &in, fd, &out, length, 0);
+         if (copied < 0 && errno == EINTR)
+         {
+            continue;
+         }
+         if (copied <= 0)
+         {
+            break;
+         }
+         length -= copied;
+      }
+
+      if (length == 0)
+      {
+         return 0;
+      }
+
+      offset = in;
+      output_offset = out;
+   }
+#endif
+
+   if (read_blocks(rf, offset, length, buffer))
    {
-      pgmoneta_log_error("unable to read block at offset %llu from file %s", offset, rf->filepath);
       goto error;
    }
 
+   return write_fully(fd, buffer, length, output_offset);
+error:
+   return 1;
+}
+
+static int
+write_fully(int fd, uint8_t* buffer, size_t length, off_t offset)
+{
+   ssize_t written = 0;
+   size_t total = 0;
+
+   while (total < length)
+   {
+      written = pwrite(fd, buffer + total, length - total, offset + total);
+      if (written < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (written <= 0)
+      {
+         goto error;
+      }
+      total += written;
+   }
+
    return 0;
 error:
    return 1;
@@ -1188,55 +2085,95 @@ write_reconstructed_file(char* output_file_path,
                          off_t* offset_map,
                          uint32_t blocksz)
 {
-   FILE* wfp = NULL;
-   uint8_t buffer[blocksz];
+   int fd = -1;
+   uint8_t* buffer = NULL;
    struct rfile* s = NULL;
+   uint32_t max_run = 0;
+   uint32_t run = 0;
+   size_t length = 0;
+   uint32_t i = 0;
+   bool zero = false;
+
+   max_run = RECONSTRUCT_RUN_SIZE / blocksz;
+   if (max_run == 0)
+   {
+      max_run = 1;
+   }
+
+   buffer = malloc((size_t)max_run * blocksz);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
 
-   wfp = fopen(output_file_path, "wb+");
-   if (wfp == NULL)
+   fd = open(output_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (fd < 0)
    {
       pgmoneta_log_error("reconstruct: unable to open file for reconstruction at %s", output_file_path);
       goto error;
    }
-   for (int i = 0; i < block_length; i++)
+
+   // Blocks sourced from the same file at consecutive offsets are written as one run,
+   // and so are the blocks that have to be zero filled
+   while (i < block_length)
    {
-      memset(buffer, 0, blocksz);
       s = source_map[i];
+      run = 1;
+      while (i + run < block_length && run < max_run && source_map[i + run] == s &&
+             (s == NULL || offset_map[i + run] == offset_map[i] + (off_t)run * blocksz))
+      {
+         run++;
+      }
+      length = (size_t)run * blocksz;
+
       if (s == NULL)
       {
-         // zero fill the block since source doesn't exist
-         memset(buffer, 0, blocksz);
-         if (fwrite(buffer, 1, blocksz, wfp) != blocksz)
+         // zero fill the blocks since source doesn't exist
+         if (!zero)
+         {
+            memset(buffer, 0, (size_t)max_run * blocksz);
+         }
+         if (write_fully(fd, buffer, length, (off_t)i * blocksz))
          {
             pgmoneta_log_error("reconstruct: fail to write to file %s", output_file_path);
             goto error;
          }
+         zero = true;
       }
       else
       {
-         // we might be able to use copy_file_range to have faster copy,
-         // but for now let's stay in user space
-         if (read_block(s, offset_map[i], blocksz, buffer))
-         {
-            goto error;
-         }
-         if (fwrite(buffer, 1, blocksz, wfp) != blocksz)
+         if (copy_run(s, offset_map[i], length, fd, (off_t)i * blocksz, buffer))
          {
             pgmoneta_log_error("reconstruct: fail to write to file %s", output_file_path);
             goto error;
          }
+         zero = false;
       }
+
+      i += run;
    }
-   if (wfp != NULL)
+
+   if (pgmoneta_durability_file(fd))
+   {
+      pgmoneta_log_error("reconstruct: fail to sync file %s", output_file_path);
+      goto error;
+   }
+
+   if (close(fd))
    {
-      fclose(wfp);
+      fd = -1;
+      pgmoneta_log_error("reconstruct: fail to write to file %s", output_file_path);
+      goto error;
    }
+
+   free(buffer);
    return 0;
 error:
-   if (wfp != NULL)
+   if (fd >= 0)
    {
-      fclose(wfp);
+      close(fd);
    }
+   free(buffer);
    return 1;
 }
 
@@ -1415,3 +2352,380 @@ error:
    pgmoneta_json_destroy(f);
    return 1;
 }
+
+static bool
+filter_contains(uint32_t* oids, int number_of_oids, uint32_t oid)
+{
+   for (int i = 0; i < number_of_oids; i++)
+   {
+      if (oids[i] == oid)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static int
+filter_sparse_file(char* to, off_t size)
+{
+   int fd = -1;
+
+   fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+   if (fd == -1)
+   {
+      pgmoneta_log_error("Restore: Could not create %s (%s)", to, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   // the blocks are never written, so only the size of the file takes space
+   if (ftruncate(fd, size) == -1)
+   {
+      pgmoneta_log_error("Restore: Could not extend %s (%s)", to, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   close(fd);
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+static int
+restore_plan(int server, char* identifier, char* position, char** label)
+{
+   char* d = NULL;
+   int index = -1;
+   int* chain = NULL;
+   int length = 0;
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *label = NULL;
+
+   d = pgmoneta_get_server_backup(server);
+
+   if (identifier == NULL || pgmoneta_get_backups(d, &number_of_backups, &backups))
+   {
+      goto done;
+   }
+
+   // the newest backup that can reach the recovery target is restored
+   if (!strcmp(identifier, "newest") || !strcmp(identifier, "latest"))
+   {
+      if (pgmoneta_catalog_target(number_of_backups, backups, position, &index))
+      {
+         pgmoneta_log_warn("Restore: No backup for %s ended before %s", config->servers[server].name, position);
+      }
+   }
+
+   if (index == -1)
+   {
+      index = pgmoneta_catalog_search(number_of_backups, backups, identifier);
+   }
+
+   // the backup is not known locally, so the workflow looks it up
+   if (index == -1)
+   {
+      goto done;
+   }
+
+   if (pgmoneta_catalog_chain(number_of_backups, backups, index, &chain, &length))
+   {
+      pgmoneta_log_error("Restore: The chain of %s/%s is missing a backup", config->servers[server].name, backups[index]->label);
+      goto error;
+   }
+
+   for (int i = length - 1; i > 0; i--)
+   {
+      pgmoneta_log_debug("Restore: %s/%s is combined", config->servers[server].name, backups[chain[i]]->label);
+   }
+
+   pgmoneta_log_debug("Restore: %s/%s from WAL %s", config->servers[server].name, backups[index]->label, backups[index]->wal);
+
+   *label = pgmoneta_append(NULL, backups[index]->label);
+
+done:
+
+   free(chain);
+   free(d);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   return 0;
+
+error:
+
+   free(chain);
+   free(d);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   return 1;
+}
+
+static int
+restore_targets(char* directory, int* number_of_targets, char*** targets)
+{
+   int n = 0;
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   char** t = NULL;
+
+   *number_of_targets = 0;
+   *targets = NULL;
+
+   if (directory == NULL)
+   {
+      goto error;
+   }
+
+   t = (char**)calloc(strlen(directory) + 1, sizeof(char*));
+   copy = strdup(directory);
+   if (t == NULL || copy == NULL)
+   {
+      goto error;
+   }
+
+   token = strtok_r(copy, ",", &saveptr);
+   while (token != NULL)
+   {
+      // the copies are made locally, so a remote target can only be restored alone
+      if (strchr(directory, ',') != NULL && pgmoneta_sftp_restore_target(token))
+      {
+         pgmoneta_log_error("Restore: %s can't be one of several targets", token);
+         goto error;
+      }
+
+      if (strlen(token) > 0)
+      {
+         t[n++] = strdup(token);
+      }
+      token = strtok_r(NULL, ",", &saveptr);
+   }
+
+   if (n == 0)
+   {
+      goto error;
+   }
+
+   free(copy);
+
+   *number_of_targets = n;
+   *targets = t;
+
+   return 0;
+
+error:
+
+   if (t != NULL)
+   {
+      for (int i = 0; i < n; i++)
+      {
+         free(t[i]);
+      }
+   }
+   free(t);
+   free(copy);
+
+   return 1;
+}
+
+static int
+restore_clone(int server, struct backup* backup, char** targets, int number_of_targets)
+{
+   int number_of_workers = 0;
+   char* name = NULL;
+   char* from = NULL;
+   char* to = NULL;
+   struct restore_clone clone;
+   struct workers* workers = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 1; i < number_of_targets; i++)
+   {
+      if (pgmoneta_free_space(targets[i]) < backup->restore_size)
+      {
+         pgmoneta_log_error("Restore: Not enough disk space for %s/%s in %s", config->servers[server].name, backup->label, targets[i]);
+         goto error;
+      }
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   // the data directory, and then the directory of each tablespace
+   for (int t = -1; t < (int)backup->number_of_tablespaces; t++)
+   {
+      if (t == -1)
+      {
+         name = pgmoneta_format_and_append(NULL, "%s-%s", config->servers[server].name, backup->label);
+      }
+      else
+      {
+         name = pgmoneta_format_and_append(NULL, "%s-%s-%s", config->servers[server].name, backup->label, backup->tablespaces[t]);
+      }
+
+      from = pgmoneta_format_and_append(NULL, "%s/%s", targets[0], name);
+
+      // a tablespace left out by the filter was not restored
+      if (pgmoneta_exists(from))
+      {
+         for (int i = 1; i < number_of_targets; i++)
+         {
+            to = pgmoneta_format_and_append(NULL, "%s/%s", targets[i], name);
+            pgmoneta_delete_directory(to);
+            if (pgmoneta_mkdir(to))
+            {
+               pgmoneta_log_error("Restore: Could not create %s", to);
+               goto error;
+            }
+            free(to);
+            to = NULL;
+         }
+
+         memset(&clone, 0, sizeof(struct restore_clone));
+         clone.root = from;
+         clone.name = name;
+         clone.targets = targets;
+         clone.number_of_targets = number_of_targets;
+         clone.workers = workers;
+
+         if (pgmoneta_walk(from, 0, 1, restore_clone_entry, &clone))
+         {
+            goto error;
+         }
+      }
+
+      free(name);
+      name = NULL;
+      free(from);
+      from = NULL;
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
+   for (int i = 1; i < number_of_targets; i++)
+   {
+      if (pgmoneta_sync_filesystem(targets[i]))
+      {
+         goto error;
+      }
+      pgmoneta_log_debug("Restore: %s/%s copied to %s", config->servers[server].name, backup->label, targets[i]);
+   }
+
+   return 0;
+
+error:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   free(name);
+   free(from);
+   free(to);
+
+   return 1;
+}
+
+static int
+restore_clone_entry(struct walk_entry* entry, void* arg)
+{
+   int ret = WALK_CONTINUE;
+   char* relative = NULL;
+   char* to = NULL;
+   char link[MAX_PATH];
+   ssize_t size;
+   struct restore_clone* clone = (struct restore_clone*)arg;
+
+   // the paths of the walk start with the root, which has no trailing slash
+   relative = entry->path + strlen(clone->root) + 1;
+
+   memset(&link[0], 0, sizeof(link));
+   if (entry->type == WALK_LINK)
+   {
+      size = readlinkat(entry->dirfd, entry->name, &link[0], sizeof(link) - 1);
+      if (size == -1)
+      {
+         return WALK_STOP;
+      }
+   }
+
+   for (int i = 1; ret == WALK_CONTINUE && i < clone->number_of_targets; i++)
+   {
+      to = pgmoneta_format_and_append(NULL, "%s/%s/%s", clone->targets[i], clone->name, relative);
+
+      if (entry->type == WALK_DIRECTORY)
+      {
+         if (pgmoneta_mkdir(to))
+         {
+            ret = WALK_STOP;
+         }
+      }
+      else if (entry->type == WALK_LINK)
+      {
+         // the tablespace links are relative, so they point into the same target
+         if (symlink(&link[0], to))
+         {
+            ret = WALK_STOP;
+         }
+      }
+      else if (entry->type == WALK_FILE)
+      {
+         if (pgmoneta_copy_file(entry->path, to, clone->workers))
+         {
+            ret = WALK_STOP;
+         }
+      }
+
+      if (ret == WALK_STOP)
+      {
+         pgmoneta_log_error("Restore: Could not create %s", to);
+      }
+
+      free(to);
+      to = NULL;
+   }
+
+   return ret;
+}
@@ -28,10 +28,30 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <catalog.h>
+#include <cluster.h>
 #include <workflow.h>
 #include <logging.h>
+#include <management.h>
+#include <network.h>
 #include <retention.h>
+#include <trash.h>
 #include <utils.h>
+#include <walinventory.h>
+
+/* system */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void retention_values(int server, int* retention_days, int* retention_weeks, int* retention_months, int* retention_years);
+static int retention_parent(int number_of_backups, struct backup** backups, char* label);
+static time_t retention_until(int number_of_backups, struct backup** backups, int retention_days);
+static int retention_wal_files(char* base, char* oldest, int* number_of_files, char*** files);
+static int retention_wal_inventory(int server, char* oldest, int* number_of_files, char*** files, uint64_t* size);
+static void mark_retention(int server, int retention_days, int retention_weeks, int retention_months,
+                           int retention_years, int number_of_backups, struct backup** backups, bool** retention_flags);
 
 void
 pgmoneta_retention(char** argv)
@@ -52,6 +72,11 @@ pgmoneta_retention(char** argv)
    {
       for (int i = 0; i < config->number_of_servers; i++)
       {
+         if (!pgmoneta_cluster_owns(i))
+         {
+            continue;
+         }
+
          workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_RETENTION, i, NULL);
 
          if (pgmoneta_art_create(&nodes))
@@ -72,7 +97,7 @@ pgmoneta_retention(char** argv)
          current = workflow;
          while (current != NULL)
          {
-            if (current->execute(current->name(), nodes))
+            if (pgmoneta_workflow_execute(current, nodes))
             {
                goto error;
             }
@@ -94,6 +119,9 @@ pgmoneta_retention(char** argv)
 
          nodes = NULL;
          workflow = NULL;
+
+         // also picks up what an interrupted reclaim left behind
+         pgmoneta_trash_reclaim_background(i);
       }
    }
 
@@ -110,3 +138,738 @@ error:
 
    exit(1);
 }
+
+int
+pgmoneta_retention_plan(int server, struct retention_plan** plan)
+{
+   char* d = NULL;
+   int retention_days = -1;
+   int retention_weeks = -1;
+   int retention_months = -1;
+   int retention_years = -1;
+   int oldest = -1;
+   int number_of_backup_wal = 0;
+   char** backup_wal = NULL;
+   int* parents = NULL;
+   int* children = NULL;
+   bool* keep = NULL;
+   struct retention_plan* p = NULL;
+
+   *plan = NULL;
+
+   p = (struct retention_plan*)calloc(1, sizeof(struct retention_plan));
+   if (p == NULL)
+   {
+      goto error;
+   }
+
+   retention_values(server, &retention_days, &retention_weeks, &retention_months, &retention_years);
+
+   d = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_backups(d, &p->number_of_backups, &p->backups))
+   {
+      goto error;
+   }
+
+   free(d);
+   d = NULL;
+
+   p->until = retention_until(p->number_of_backups, p->backups, retention_days);
+
+   if (p->number_of_backups > 0)
+   {
+      p->deletes = (bool*)calloc(p->number_of_backups, sizeof(bool));
+      parents = (int*)calloc(p->number_of_backups, sizeof(int));
+      children = (int*)calloc(p->number_of_backups, sizeof(int));
+
+      if (p->deletes == NULL || parents == NULL || children == NULL)
+      {
+         goto error;
+      }
+
+      mark_retention(server, retention_days, retention_weeks, retention_months,
+                     retention_years, p->number_of_backups, p->backups, &keep);
+
+      if (keep == NULL)
+      {
+         goto error;
+      }
+
+      for (int i = 0; i < p->number_of_backups; i++)
+      {
+         parents[i] = retention_parent(p->number_of_backups, p->backups, p->backups[i]->parent_label);
+         if (parents[i] >= 0)
+         {
+            children[parents[i]]++;
+         }
+      }
+
+      // the children are newer than their parent, so the parent is planned after all of them
+      for (int i = p->number_of_backups - 1; i >= 0; i--)
+      {
+         if (!keep[i] && !p->backups[i]->keep && children[i] == 0)
+         {
+            p->deletes[i] = true;
+            p->number_of_deletes++;
+            p->backup_size += p->backups[i]->backup_size;
+
+            if (parents[i] >= 0)
+            {
+               children[parents[i]]--;
+            }
+         }
+      }
+
+      for (int i = 0; oldest == -1 && i < p->number_of_backups; i++)
+      {
+         if (!p->deletes[i])
+         {
+            oldest = (!p->backups[i]->keep && p->backups[i]->valid == VALID_TRUE) ? i : -2;
+         }
+      }
+   }
+
+   // like pgmoneta_delete_wal the WAL goes when no backup is left, or up to the oldest one when it is valid
+   if (p->number_of_backups == p->number_of_deletes)
+   {
+      p->all_wal = true;
+   }
+   else if (oldest >= 0)
+   {
+      d = pgmoneta_get_server_backup_identifier_data_wal(server, p->backups[oldest]->label);
+
+      pgmoneta_get_wal_files(d, &number_of_backup_wal, &backup_wal);
+
+      if (number_of_backup_wal > 0)
+      {
+         p->oldest_wal = pgmoneta_append(NULL, backup_wal[0]);
+      }
+
+      free(d);
+      d = NULL;
+   }
+
+   if (p->all_wal || p->oldest_wal != NULL)
+   {
+      retention_wal_inventory(server, p->oldest_wal, &p->number_of_wal, &p->wal, &p->wal_size);
+   }
+
+   for (int i = 0; i < number_of_backup_wal; i++)
+   {
+      free(backup_wal[i]);
+   }
+   free(backup_wal);
+   free(parents);
+   free(children);
+   free(keep);
+
+   *plan = p;
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_backup_wal; i++)
+   {
+      free(backup_wal[i]);
+   }
+   free(backup_wal);
+   free(parents);
+   free(children);
+   free(keep);
+   free(d);
+
+   pgmoneta_retention_plan_destroy(p);
+
+   return 1;
+}
+
+int
+pgmoneta_retention_wal(int server, struct retention_plan* plan)
+{
+   int failed = 0;
+   char* d = NULL;
+   char* wal_shipping = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   struct walinventory_stamp stamp;
+
+   if (plan == NULL || (!plan->all_wal && plan->oldest_wal == NULL))
+   {
+      return 0;
+   }
+
+   d = pgmoneta_get_server_wal(server);
+
+   pgmoneta_walinventory_begin(server, &stamp);
+
+   if (pgmoneta_trash_files(server, d, plan->number_of_wal, plan->wal))
+   {
+      pgmoneta_log_warn("Retention: Could not delete all the WAL segments of %s", d);
+      failed = 1;
+   }
+
+   pgmoneta_walinventory_update(server, &stamp, 0, NULL, failed ? 0 : plan->number_of_wal, plan->wal);
+
+   wal_shipping = pgmoneta_get_server_wal_shipping_wal(server);
+   if (wal_shipping != NULL && !retention_wal_files(wal_shipping, plan->oldest_wal, &number_of_files, &files))
+   {
+      if (pgmoneta_trash_files(server, wal_shipping, number_of_files, files))
+      {
+         pgmoneta_log_warn("Retention: Could not delete all the WAL segments of %s", wal_shipping);
+         failed = 1;
+      }
+   }
+
+   pgmoneta_log_debug("Retention: %d WAL segments (%s)", plan->number_of_wal, plan->oldest_wal != NULL ? plan->oldest_wal : "All");
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(wal_shipping);
+   free(d);
+
+   return failed;
+}
+
+void
+pgmoneta_retention_plan_destroy(struct retention_plan* plan)
+{
+   if (plan == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < plan->number_of_backups; i++)
+   {
+      free(plan->backups[i]);
+   }
+   free(plan->backups);
+
+   for (int i = 0; i < plan->number_of_wal; i++)
+   {
+      free(plan->wal[i]);
+   }
+   free(plan->wal);
+
+   free(plan->deletes);
+   free(plan->oldest_wal);
+   free(plan);
+}
+
+void
+pgmoneta_retention_request(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   char* elapsed = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double total_seconds = 0;
+   struct retention_plan* plan = NULL;
+   struct json* response = NULL;
+   struct json* backups = NULL;
+   struct configuration* config;
+
+   pgmoneta_start_logging();
+
+   config = (struct configuration*)shmem;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   if (pgmoneta_retention_plan(server, &plan))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_RETENTION_ERROR, compression, encryption, payload);
+      pgmoneta_log_error("Retention: Could not plan %s", config->servers[server].name);
+      goto error;
+   }
+
+   if (pgmoneta_management_create_response(payload, server, &response) || pgmoneta_json_create(&backups))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+      goto error;
+   }
+
+   for (int i = plan->number_of_backups - 1; i >= 0; i--)
+   {
+      struct json* bck = NULL;
+
+      if (!plan->deletes[i])
+      {
+         continue;
+      }
+
+      if (pgmoneta_json_create(&bck))
+      {
+         pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+         goto error;
+      }
+
+      pgmoneta_json_put(bck, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)plan->backups[i]->label, ValueString);
+      pgmoneta_json_put(bck, MANAGEMENT_ARGUMENT_BACKUP_SIZE, (uintptr_t)plan->backups[i]->backup_size, ValueUInt64);
+      pgmoneta_json_put(bck, MANAGEMENT_ARGUMENT_INCREMENTAL, (uintptr_t)(plan->backups[i]->type == TYPE_INCREMENTAL), ValueBool);
+
+      pgmoneta_json_append(backups, (uintptr_t)bck, ValueJSON);
+   }
+
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_NUMBER_OF_BACKUPS, (uintptr_t)plan->number_of_deletes, ValueUInt32);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUP_SIZE, (uintptr_t)plan->backup_size, ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_NUMBER_OF_WAL, (uintptr_t)plan->number_of_wal, ValueUInt32);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_WAL_SIZE, (uintptr_t)plan->wal_size, ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_RECLAIMED, (uintptr_t)(plan->backup_size + plan->wal_size), ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUPS, (uintptr_t)backups, ValueJSON);
+   backups = NULL;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_RETENTION_NETWORK, compression, encryption, payload);
+      pgmoneta_log_error("Retention: Error sending response for %s", config->servers[server].name);
+      goto error;
+   }
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+   pgmoneta_log_info("Retention: %s (Backups: %d, WAL: %d, Elapsed: %s)", config->servers[server].name,
+                     plan->number_of_deletes, plan->number_of_wal, elapsed);
+
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   pgmoneta_retention_plan_destroy(plan);
+   free(elapsed);
+
+   exit(0);
+
+error:
+
+   pgmoneta_json_destroy(backups);
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   pgmoneta_retention_plan_destroy(plan);
+   free(elapsed);
+
+   exit(1);
+}
+
+static void
+retention_values(int server, int* retention_days, int* retention_weeks, int* retention_months, int* retention_years)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *retention_days = config->servers[server].retention_days;
+   if (*retention_days <= 0)
+   {
+      *retention_days = config->retention_days;
+   }
+   *retention_weeks = config->servers[server].retention_weeks;
+   if (*retention_weeks <= 0)
+   {
+      *retention_weeks = config->retention_weeks;
+   }
+   *retention_months = config->servers[server].retention_months;
+   if (*retention_months <= 0)
+   {
+      *retention_months = config->retention_months;
+   }
+   *retention_years = config->servers[server].retention_years;
+   if (*retention_years <= 0)
+   {
+      *retention_years = config->retention_years;
+   }
+}
+
+static int
+retention_parent(int number_of_backups, struct backup** backups, char* label)
+{
+   int low = 0;
+   int high = number_of_backups - 1;
+   int middle;
+   int cmp;
+
+   if (label == NULL || strlen(label) == 0)
+   {
+      return -1;
+   }
+
+   // the backups are sorted by label, and the parent of a backup may not be valid
+   while (low <= high)
+   {
+      middle = low + (high - low) / 2;
+      cmp = strcmp(backups[middle]->label, label);
+
+      if (cmp == 0)
+      {
+         return middle;
+      }
+      else if (cmp < 0)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle - 1;
+      }
+   }
+
+   return -1;
+}
+
+static time_t
+retention_until(int number_of_backups, struct backup** backups, int retention_days)
+{
+   time_t now;
+   time_t t;
+   time_t until;
+   char check_date[128];
+   struct tm tm;
+
+   now = time(NULL);
+
+   // the weeks, the months and the years move with the date
+   memset(&tm, 0, sizeof(struct tm));
+   localtime_r(&now, &tm);
+   tm.tm_hour = 0;
+   tm.tm_min = 0;
+   tm.tm_sec = 0;
+   tm.tm_mday++;
+   tm.tm_isdst = -1;
+   until = mktime(&tm);
+
+   // and the days with the oldest backup that is within them
+   t = now - ((time_t)retention_days * 24 * 60 * 60);
+   memset(&check_date[0], 0, sizeof(check_date));
+   strftime(&check_date[0], sizeof(check_date), "%Y%m%d%H%M%S", localtime(&t));
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      if (strcmp(backups[i]->label, &check_date[0]) >= 0)
+      {
+         memset(&tm, 0, sizeof(struct tm));
+         if (strptime(backups[i]->label, "%Y%m%d%H%M%S", &tm) != NULL)
+         {
+            tm.tm_isdst = -1;
+            t = mktime(&tm) + ((time_t)retention_days * 24 * 60 * 60);
+            until = MIN(until, t);
+         }
+         break;
+      }
+   }
+
+   return until;
+}
+
+static int
+retention_wal_files(char* base, char* oldest, int* number_of_files, char*** files)
+{
+   int number_of_wal_files = 0;
+   char** wal_files = NULL;
+   int n = 0;
+
+   *number_of_files = 0;
+   *files = NULL;
+
+   if (pgmoneta_get_wal_files(base, &number_of_wal_files, &wal_files))
+   {
+      pgmoneta_log_warn("Unable to get WAL segments under %s", base);
+      goto error;
+   }
+
+   // the segments are sorted, so the ones to delete come first
+   while (n < number_of_wal_files && (oldest == NULL || strcmp(wal_files[n], oldest) < 0))
+   {
+      n++;
+   }
+
+   for (int i = n; i < number_of_wal_files; i++)
+   {
+      free(wal_files[i]);
+      wal_files[i] = NULL;
+   }
+
+   if (n == 0)
+   {
+      free(wal_files);
+      wal_files = NULL;
+   }
+
+   *number_of_files = n;
+   *files = wal_files;
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_wal_files; i++)
+   {
+      free(wal_files[i]);
+   }
+   free(wal_files);
+
+   return 1;
+}
+
+static int
+retention_wal_inventory(int server, char* oldest, int* number_of_files, char*** files, uint64_t* size)
+{
+   int start = 0;
+   int end = 0;
+   int last;
+   int n = 0;
+   char** array = NULL;
+   struct walinventory* inventory = NULL;
+
+   *number_of_files = 0;
+   *files = NULL;
+   *size = 0;
+
+   if (pgmoneta_walinventory_load(server, &inventory))
+   {
+      pgmoneta_log_warn("Retention: Unable to get the WAL inventory of %s", ((struct configuration*)shmem)->servers[server].name);
+      goto error;
+   }
+
+   pgmoneta_walinventory_range(inventory, NULL, oldest, &start, &end);
+
+   if (end > 0)
+   {
+      array = (char**)calloc(end, sizeof(char*));
+      if (array == NULL)
+      {
+         goto error;
+      }
+   }
+
+   // a pack is only deleted when all of its segments are older
+   for (int i = start; i < end; i = last)
+   {
+      last = i + 1;
+      while (last < inventory->number_of_segments && !strcmp(inventory->segments[last].file, inventory->segments[i].file))
+      {
+         last++;
+      }
+
+      if (last > end)
+      {
+         break;
+      }
+
+      array[n] = pgmoneta_append(NULL, inventory->segments[i].file);
+      n++;
+
+      for (int j = i; j < last; j++)
+      {
+         *size += inventory->segments[j].size;
+      }
+   }
+
+   if (n == 0)
+   {
+      free(array);
+      array = NULL;
+   }
+
+   *number_of_files = n;
+   *files = array;
+
+   pgmoneta_walinventory_destroy(inventory);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < n; i++)
+   {
+      free(array[i]);
+   }
+   free(array);
+
+   pgmoneta_walinventory_destroy(inventory);
+
+   return 1;
+}
+
+static void
+mark_retention(int server, int retention_days, int retention_weeks, int retention_months,
+               int retention_years, int number_of_backups, struct backup** backups, bool** retention_keep)
+{
+   bool* keep = NULL;
+   time_t t;
+   char check_date[128];
+   struct tm* time_info;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   keep = (bool*) malloc(sizeof (bool*) * number_of_backups);
+
+   if (keep == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      keep[i] = false;
+   }
+   t = time(NULL);
+   memset(&check_date[0], 0, sizeof(check_date));
+   // retention for nearest days, always happen, so no need to check
+   time_t tmp_time = t;
+   tmp_time = tmp_time - (retention_days * 24 * 60 * 60);
+   time_info = localtime(&tmp_time);
+   strftime(&check_date[0], sizeof(check_date), "%Y%m%d%H%M%S", time_info);
+   // this is the same logic as previous implementation
+   // construct the timestamp 7 days before
+   // and mark retain for backups later than that
+   for (int j = number_of_backups - 1; j >= 0; j--)
+   {
+      if (strcmp(backups[j]->label, &check_date[0]) >= 0)
+      {
+         pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
+         keep[j] = true;
+      }
+      else
+      {
+         pgmoneta_log_debug("Marked for deletion: %s/%s", config->servers[server].name, backups[j]->label);
+      }
+   }
+   if (retention_weeks != -1)
+   {
+      // reset tmp time
+      tmp_time = t;
+      // use global variable k to traverse backups from latest to oldest
+      int k = number_of_backups - 1;
+      for (int j = 0; j < retention_weeks; j++)
+      {
+         // push the time a week back
+         tmp_time = tmp_time - (j * 7 * 24 * 60 * 60);
+         time_info = localtime(&tmp_time);
+         // tm_wday starts with Sunday, wind tmp_time to the nearest Monday
+         tmp_time = tmp_time - ((time_info->tm_wday + 6) % 7) * 24 * 60 * 60;
+         time_info = localtime(&tmp_time);
+         // scan will resume from where it left off in the previous loop
+         // and try to find the first backup whose date with the new Monday
+         while (k >= 0)
+         {
+            // find the latest label on that Monday
+            // check backups from latest to earliest,
+            // mark retain for the first backup whose date matches with that Monday
+            struct tm backup_time_info = {0};
+            // construct tm struct from the timestamp label
+            strptime(backups[k]->label, "%Y%m%d%H%M%S", &backup_time_info);
+            if (time_info->tm_year == backup_time_info.tm_year &&
+                time_info->tm_yday == backup_time_info.tm_yday)
+            {
+               pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
+               keep[k--] = true;
+               break;
+            }
+            else if ((time_info->tm_year == backup_time_info.tm_year &&
+                      time_info->tm_yday > backup_time_info.tm_yday) ||
+                     time_info->tm_year > backup_time_info.tm_year)
+            {
+               // stop if one week's Monday doesn't backup and k goes too far back
+               break;
+            }
+            k--;
+         }
+      }
+   }
+   if (retention_months != -1)
+   {
+      // use global variable k to traverse backups from latest to oldest
+      int k = number_of_backups - 1;
+      // get the time info for the current time
+      time_info = localtime(&t);
+      int cur_year = time_info->tm_year;
+      int cur_month = time_info->tm_mon;
+
+      for (int j = 0; j < retention_months; j++)
+      {
+         // first we look at the first day on this month,
+         // then push the time one month back at a time
+         if (j > 0)
+         {
+            cur_month--;
+         }
+         // if we cross years, change month to December of the previous year
+         if (cur_month < 0)
+         {
+            cur_month = 11;
+            cur_year--;
+         }
+         // scan through backups from latest to earliest,
+         // scan will resume from where it left off in the previous loop
+         // and try to find the first backup whose month and year matches with cur_month and cur_year
+         while (k >= 0)
+         {
+            struct tm backup_time_info = {0};
+            strptime(backups[k]->label, "%Y%m%d%H%M%S", &backup_time_info);
+            // find the latest backup on the first day of that month
+            if (cur_month == backup_time_info.tm_mon &&
+                cur_year == backup_time_info.tm_year &&
+                backup_time_info.tm_mday == 1)
+            {
+               pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
+               keep[k--] = true;
+               break;
+            }
+            else if ((cur_year == backup_time_info.tm_year &&
+                      cur_month > backup_time_info.tm_mon) ||
+                     cur_year > backup_time_info.tm_year)
+            {
+               // stop when k goes too far back
+               break;
+            }
+            k--;
+         }
+      }
+   }
+   if (retention_years != -1)
+   {
+      int k = number_of_backups - 1;
+      time_info = localtime(&t);
+      int cur_year = time_info->tm_year;
+
+      for (int j = 0; j < retention_years; j++)
+      {
+         // go to previous year
+         if (j > 0)
+         {
+            cur_year--;
+         }
+
+         while (k >= 0)
+         {
+            struct tm backup_time_info = {0};
+            strptime(backups[k]->label, "%Y%m%d%H%M%S", &backup_time_info);
+            // find the latest backup on the first day of that year
+            if (cur_year == backup_time_info.tm_year && backup_time_info.tm_yday == 0)
+            {
+               pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
+               keep[k--] = true;
+               break;
+            }
+            else if (cur_year > backup_time_info.tm_year)
+            {
+               // in case one year doesn't have backups and the pointer k goes too far back
+               break;
+            }
+            k--;
+         }
+      }
+   }
+   *retention_keep = keep;
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <scheduler.h>
+
+/* system */
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX
+#include <sys/sysinfo.h>
+#endif
+
+#define SCHEDULER_WAIT 10000000L
+
+static int scheduler_capacity(int resource);
+static bool scheduler_alive(pid_t pid);
+static bool scheduler_preempted(int resource, int priority);
+static int scheduler_take(int resource, int capacity, int wanted, pid_t pid);
+static int scheduler_wait(int resource, int priority, pid_t pid);
+static int scheduler_held(int resource);
+
+static int scheduler_priority = SCHEDULER_PRIORITY_BACKUP;
+static pid_t scheduler_pid = 0;
+static atomic_int scheduler_holdings[SCHEDULER_RESOURCES];
+
+void
+pgmoneta_scheduler_priority(int priority)
+{
+   scheduler_priority = priority;
+}
+
+int
+pgmoneta_scheduler_acquire(int resource, int wanted, int* granted)
+{
+   int capacity;
+   int got = 0;
+   int waiter = -1;
+   bool nested;
+   bool waited = false;
+   pid_t pid;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *granted = 0;
+
+   capacity = scheduler_capacity(resource);
+   if (capacity == 0)
+   {
+      *granted = wanted;
+      return 0;
+   }
+
+   wanted = MAX(MIN(wanted, capacity), 1);
+   pid = getpid();
+   nested = scheduler_held(resource) > 0;
+
+   if (!nested)
+   {
+      waiter = scheduler_wait(resource, scheduler_priority, pid);
+   }
+
+   while (got == 0)
+   {
+      if (nested || !scheduler_preempted(resource, scheduler_priority))
+      {
+         got = scheduler_take(resource, capacity, wanted, pid);
+      }
+
+      if (got > 0 || nested || !config->running)
+      {
+         break;
+      }
+
+      if (!waited)
+      {
+         pgmoneta_log_debug("Scheduler: Waiting for resource %d", resource);
+         waited = true;
+      }
+
+      SLEEP(SCHEDULER_WAIT);
+   }
+
+   if (waiter != -1)
+   {
+      atomic_store(&config->scheduler.waiters[resource][waiter], 0);
+   }
+
+   atomic_fetch_add(&scheduler_holdings[resource], got);
+
+   *granted = got;
+
+   return 0;
+}
+
+int
+pgmoneta_scheduler_take(int resource, int wanted)
+{
+   int capacity;
+   int got;
+
+   capacity = scheduler_capacity(resource);
+   if (capacity == 0 || wanted <= 0)
+   {
+      return MAX(wanted, 0);
+   }
+
+   // resets the holdings of a forked child
+   scheduler_held(resource);
+
+   if (scheduler_preempted(resource, scheduler_priority))
+   {
+      return 0;
+   }
+
+   got = scheduler_take(resource, capacity, MIN(wanted, capacity), getpid());
+
+   atomic_fetch_add(&scheduler_holdings[resource], got);
+
+   return got;
+}
+
+void
+pgmoneta_scheduler_release(int resource, int granted)
+{
+   int expected;
+   pid_t pid;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (granted <= 0 || scheduler_held(resource) <= 0)
+   {
+      return;
+   }
+
+   pid = getpid();
+
+   for (int i = 0; granted > 0 && i < SCHEDULER_MAX_SLOTS; i++)
+   {
+      expected = pid;
+      if (atomic_compare_exchange_strong(&config->scheduler.slots[resource][i], &expected, 0))
+      {
+         atomic_fetch_sub(&scheduler_holdings[resource], 1);
+         granted--;
+      }
+   }
+}
+
+static int
+scheduler_capacity(int resource)
+{
+   int capacity = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   switch (resource)
+   {
+      case SCHEDULER_WORKERS:
+         capacity = config->scheduler_workers;
+         if (capacity == 0)
+         {
+#ifdef HAVE_LINUX
+            capacity = get_nprocs();
+#else
+            capacity = 16;
+#endif
+         }
+         break;
+      case SCHEDULER_DISK:
+         capacity = config->scheduler_disk;
+         break;
+      case SCHEDULER_NETWORK:
+         capacity = config->scheduler_network;
+         break;
+      default:
+         break;
+   }
+
+   return MIN(capacity, SCHEDULER_MAX_SLOTS);
+}
+
+static bool
+scheduler_alive(pid_t pid)
+{
+   if (kill(pid, 0) == -1 && errno == ESRCH)
+   {
+      errno = 0;
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+scheduler_preempted(int resource, int priority)
+{
+   long long entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < SCHEDULER_MAX_WAITERS; i++)
+   {
+      entry = atomic_load(&config->scheduler.waiters[resource][i]);
+
+      if (entry != 0 && (int)(entry & 0xFF) < priority)
+      {
+         if (scheduler_alive((pid_t)(entry >> 8)))
+         {
+            return true;
+         }
+
+         // a process that died while it waited
+         atomic_compare_exchange_strong(&config->scheduler.waiters[resource][i], &entry, 0);
+      }
+   }
+
+   return false;
+}
+
+static int
+scheduler_take(int resource, int capacity, int wanted, pid_t pid)
+{
+   int got = 0;
+   int expected;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; got < wanted && i < capacity; i++)
+   {
+      expected = 0;
+      if (atomic_compare_exchange_strong(&config->scheduler.slots[resource][i], &expected, pid))
+      {
+         got++;
+      }
+   }
+
+   if (got == 0)
+   {
+      // the slots of a process that died are free again
+      for (int i = 0; got < wanted && i < capacity; i++)
+      {
+         expected = atomic_load(&config->scheduler.slots[resource][i]);
+         if (expected != 0 && !scheduler_alive((pid_t)expected) &&
+             atomic_compare_exchange_strong(&config->scheduler.slots[resource][i], &expected, pid))
+         {
+            got++;
+         }
+      }
+   }
+
+   return got;
+}
+
+static int
+scheduler_wait(int resource, int priority, pid_t pid)
+{
+   long long expected;
+   long long entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   entry = ((long long)pid << 8) | priority;
+
+   for (int i = 0; i < SCHEDULER_MAX_WAITERS; i++)
+   {
+      expected = 0;
+      if (atomic_compare_exchange_strong(&config->scheduler.waiters[resource][i], &expected, entry))
+      {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+static int
+scheduler_held(int resource)
+{
+   pid_t pid = getpid();
+
+   // a forked child doesn't hold the slots of its parent
+   if (scheduler_pid != pid)
+   {
+      for (int i = 0; i < SCHEDULER_RESOURCES; i++)
+      {
+         atomic_store(&scheduler_holdings[i], 0);
+      }
+      scheduler_pid = pid;
+   }
+
+   return atomic_load(&scheduler_holdings[resource]);
+}
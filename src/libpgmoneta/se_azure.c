@@ -29,6 +29,7 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <deque.h>
 #include <dirent.h>
 #include <http.h>
 #include <info.h>
@@ -36,33 +37,98 @@
 #include <security.h>
 #include <stdio.h>
 #include <storage.h>
+#include <trace.h>
 #include <utils.h>
+#include <value.h>
+#include <workers.h>
 #include <workflow.h>
 
 /* system */
 #include <assert.h>
+#include <openssl/evp.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define AZURE_VERSION         "2021-08-06"
+#define AZURE_MAX_BLOCKS      50000
+#define AZURE_BLOCK_ID_LENGTH 12
+#define AZURE_BATCH_SIZE      256
+#define AZURE_BATCH_BOUNDARY  "batch_pgmoneta"
+#define AZURE_MD5_BUFFER_SIZE (1024 * 1024)
+
+/** @struct azure_blob
+ * Defines a file that is uploaded as blocks. The worker that uploads
+ * the last block commits the block list
+ */
+struct azure_blob
+{
+   char local_path[MAX_PATH];    /**< The local path */
+   char azure_path[MAX_PATH];    /**< The path in the container */
+   size_t size;                  /**< The size of the file */
+   size_t block_size;            /**< The size of the blocks */
+   int number_of_blocks;         /**< The number of blocks */
+   atomic_int remaining;         /**< The number of blocks left to upload */
+   atomic_bool failed;           /**< Has a block failed */
+   struct azure_blob* next;      /**< The next blob */
+};
+
+/** @struct azure_body
+ * Defines the part of a file or buffer sent as a request body
+ */
+struct azure_body
+{
+   FILE* file;                   /**< The file */
+   size_t remaining;             /**< The number of bytes left to send */
+};
+
 static char* azure_storage_name(void);
 static int azure_storage_setup(char* name, struct art*);
 static int azure_storage_execute(char* name, struct art*);
 static int azure_storage_teardown(char* name, struct art*);
 
-static int azure_upload_files(char* local_root, char* azure_root, char* relative_path);
-static int azure_send_upload_request(char* local_root, char* azure_root, char* relative_path);
+static int azure_upload_files(char* local_root, char* azure_root, char* relative_path, struct workers* workers, struct azure_blob** blobs);
+static int azure_queue_file(char* local_path, char* azure_path, struct workers* workers, struct azure_blob** blobs);
+static void do_azure_put_blob(struct worker_input* wi);
+static void do_azure_put_block(struct worker_input* wi);
+static int azure_put_blob(char* local_path, char* azure_path);
+static int azure_put_block(struct azure_blob* blob, int block);
+static int azure_put_block_list(struct azure_blob* blob);
+static int azure_send_request(char* method, char* azure_path, char* query, char* resource, char* range, bool block_blob, FILE* file, size_t length, char* content_md5, FILE* out, long expected);
+static char* azure_content_md5(FILE* file, size_t length);
+static char* azure_block_id(int block);
+static size_t azure_read(char* buffer, size_t size, size_t nitems, void* userdata);
+static CURL* azure_handle(void);
+static void azure_handle_destroy(void* handle);
+static void azure_destroy_blobs(struct azure_blob* blobs);
+
+static int azure_backend_put(struct storage_backend* backend, char* local_path, char* remote_path);
+static int azure_backend_get(struct storage_backend* backend, char* remote_path, char* local_path);
+static int azure_backend_list(struct storage_backend* backend, char* remote_path, struct deque** names);
+static int azure_backend_remove(struct storage_backend* backend, char* remote_path);
+static int azure_backend_remove_directory(struct storage_backend* backend, char* remote_path);
+static int azure_delete_batch(struct deque* names);
+static char* azure_authorization(char* string_to_sign);
+static int azure_backend_stream(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out);
+static char* azure_xml_value(char* xml, char* tag);
 
 static char* azure_get_host(void);
 static char* azure_get_basepath(int server, char* identifier);
+static char* azure_get_path(char* remote_path);
 
-static CURL* curl = NULL;
+// the decoded shared key, it only changes with the configuration
+static pthread_mutex_t signing_lock = PTHREAD_MUTEX_INITIALIZER;
+static char signing_source[MISC_LENGTH];
+static char* signing_key = NULL;
+static size_t signing_key_length = 0;
 
 struct workflow*
 pgmoneta_storage_create_azure(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    wf->name = &azure_storage_name;
    wf->setup = &azure_storage_setup;
@@ -73,6 +139,32 @@ pgmoneta_storage_create_azure(void)
    return wf;
 }
 
+struct storage_backend*
+pgmoneta_storage_backend_azure(void)
+{
+   struct storage_backend* backend = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   backend = (struct storage_backend*)calloc(1, sizeof(struct storage_backend));
+   if (backend == NULL)
+   {
+      return NULL;
+   }
+
+   snprintf(&backend->name[0], sizeof(backend->name), "%s", "Azure");
+   backend->put = &azure_backend_put;
+   backend->get = &azure_backend_get;
+   backend->list = &azure_backend_list;
+   backend->remove = &azure_backend_remove;
+   backend->remove_directory = &azure_backend_remove_directory;
+   backend->stream = &azure_backend_stream;
+   backend->range_size = (size_t)config->azure_block_size;
+
+   return backend;
+}
+
 static char*
 azure_storage_name(void)
 {
@@ -88,12 +180,6 @@ azure_storage_setup(char* name, struct art* nodes)
 
    config = (struct configuration*)shmem;
 
-   curl = curl_easy_init();
-   if (curl == NULL)
-   {
-      goto error;
-   }
-
 #ifdef DEBUG
    char* a = pgmoneta_art_to_string(nodes, FORMAT_TEXT, NULL, 0);
    pgmoneta_log_debug("(Tree)\n%s", a);
@@ -109,9 +195,6 @@ azure_storage_setup(char* name, struct art* nodes)
    pgmoneta_log_debug("Azure storage engine (setup): %s/%s", config->servers[server].name, label);
 
    return 0;
-
-error:
-   return 1;
 }
 
 static int
@@ -124,6 +207,9 @@ azure_storage_execute(char* name, struct art* nodes)
    double remote_azure_elapsed_time;
    char* local_root = NULL;
    char* azure_root = NULL;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct azure_blob* blobs = NULL;
    struct configuration* config;
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
@@ -148,11 +234,36 @@ azure_storage_execute(char* name, struct art* nodes)
    local_root = pgmoneta_get_server_backup_identifier(server, label);
    azure_root = azure_get_basepath(server, label);
 
-   if (azure_upload_files(local_root, azure_root, ""))
+   // each worker keeps its own connection, so the files and blocks
+   // of the backup are sent over as many streams as there are workers
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      if (pgmoneta_workers_initialize(number_of_workers, &workers))
+      {
+         goto error;
+      }
+   }
+
+   if (azure_upload_files(local_root, azure_root, "", workers, &blobs))
    {
       goto error;
    }
 
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_AZURE, NULL, NULL);
+
+   azure_destroy_blobs(blobs);
+
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
    remote_azure_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
 
@@ -165,6 +276,15 @@ azure_storage_execute(char* name, struct art* nodes)
 
 error:
 
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_AZURE, NULL, NULL);
+
+   azure_destroy_blobs(blobs);
+
    free(local_root);
    free(azure_root);
 
@@ -196,9 +316,11 @@ azure_storage_teardown(char* name, struct art* nodes)
 
    root = pgmoneta_get_server_backup_identifier_data(server, label);
 
-   pgmoneta_delete_directory(root);
-
-   curl_easy_cleanup(curl);
+   // the data stays on local storage until retention tiers the backup
+   if (pgmoneta_storage_retention_local(server) == 0)
+   {
+      pgmoneta_delete_directory(root);
+   }
 
    pgmoneta_log_debug("Azure storage engine (teardown): %s/%s", config->servers[server].name, label);
 
@@ -208,11 +330,13 @@ azure_storage_teardown(char* name, struct art* nodes)
 }
 
 static int
-azure_upload_files(char* local_root, char* azure_root, char* relative_path)
+azure_upload_files(char* local_root, char* azure_root, char* relative_path, struct workers* workers, struct azure_blob** blobs)
 {
    char* local_path = NULL;
    char* relative_file;
    char* new_file;
+   char* file_path = NULL;
+   char* azure_path = NULL;
    bool copied_files = false;
    DIR* dir;
    struct dirent* entry;
@@ -238,7 +362,10 @@ azure_upload_files(char* local_root, char* azure_root, char* relative_path)
 
          snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
 
-         azure_upload_files(local_root, azure_root, relative_dir);
+         if (azure_upload_files(local_root, azure_root, relative_dir, workers, blobs))
+         {
+            goto error;
+         }
       }
       else
       {
@@ -250,13 +377,25 @@ azure_upload_files(char* local_root, char* azure_root, char* relative_path)
          relative_file = pgmoneta_append(relative_file, "/");
          relative_file = pgmoneta_append(relative_file, entry->d_name);
 
-         if (azure_send_upload_request(local_root, azure_root, relative_file))
+         file_path = pgmoneta_append(NULL, local_root);
+         file_path = pgmoneta_append(file_path, relative_file);
+
+         azure_path = pgmoneta_append(NULL, azure_root);
+         azure_path = pgmoneta_append(azure_path, relative_file);
+
+         if (azure_queue_file(file_path, azure_path, workers, blobs))
          {
             free(relative_file);
+            free(file_path);
+            free(azure_path);
             goto error;
          }
 
          free(relative_file);
+         free(file_path);
+         free(azure_path);
+         file_path = NULL;
+         azure_path = NULL;
       }
    }
 
@@ -274,18 +413,27 @@ azure_upload_files(char* local_root, char* azure_root, char* relative_path)
       new_file = pgmoneta_append(new_file, local_root);
       new_file = pgmoneta_append(new_file, relative_file);
 
+      azure_path = pgmoneta_append(NULL, azure_root);
+      azure_path = pgmoneta_append(azure_path, relative_file);
+
       FILE* file = fopen(new_file, "w");
 
       pgmoneta_permission(new_file, 6, 4, 4);
 
-      azure_send_upload_request(local_root, azure_root, relative_file);
+      // sent right away, the marker is removed before the workers would run
+      azure_put_blob(new_file, azure_path);
 
-      fclose(file);
+      if (file != NULL)
+      {
+         fclose(file);
+      }
 
       remove(new_file);
 
       free(new_file);
       free(relative_file);
+      free(azure_path);
+      azure_path = NULL;
    }
 
    closedir(dir);
@@ -296,7 +444,10 @@ azure_upload_files(char* local_root, char* azure_root, char* relative_path)
 
 error:
 
-   closedir(dir);
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
 
    free(local_path);
 
@@ -304,229 +455,1401 @@ error:
 }
 
 static int
-azure_send_upload_request(char* local_root, char* azure_root, char* relative_path)
+azure_queue_file(char* local_path, char* azure_path, struct workers* workers, struct azure_blob** blobs)
 {
-   char utc_date[UTC_TIME_LENGTH];
-   char* string_to_sign = NULL;
-   char* signing_key = NULL;
-   char* signature = NULL;
-   char* base64_signature = NULL;
-   size_t base64_signature_length;
-   char* local_path = NULL;
-   char* azure_path = NULL;
-   char* azure_host = NULL;
-   char* azure_url = NULL;
-   char* auth_value = NULL;
-   unsigned char* signature_hmac = NULL;
-   unsigned char* signature_hex = NULL;
-   int hmac_length = 0;
-   size_t signing_key_length = 0;
-   FILE* file = NULL;
-   struct stat file_info;
-   CURLcode res = -1;
-   struct curl_slist* chunk = NULL;
+   size_t size = 0;
+   struct azure_blob* blob = NULL;
+   struct worker_input* wi = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   local_path = pgmoneta_append(local_path, local_root);
-   local_path = pgmoneta_append(local_path, relative_path);
+   size = pgmoneta_get_file_size(local_path);
 
-   azure_path = pgmoneta_append(azure_path, azure_root);
-   azure_path = pgmoneta_append(azure_path, relative_path);
+   if (size <= (size_t)config->azure_block_size)
+   {
+      if (pgmoneta_create_worker_input(NULL, local_path, azure_path, 0, workers, &wi))
+      {
+         goto error;
+      }
 
-   memset(&utc_date[0], 0, sizeof(utc_date));
+      if (workers != NULL)
+      {
+         if (workers->outcome)
+         {
+            pgmoneta_workers_add(workers, do_azure_put_blob, (struct worker_input*)wi);
+         }
+      }
+      else
+      {
+         if (azure_put_blob(local_path, azure_path))
+         {
+            free(wi);
+            goto error;
+         }
+         free(wi);
+      }
 
-   if (pgmoneta_get_timestamp_UTC_format(utc_date))
-   {
-      goto error;
+      return 0;
    }
 
-   file = fopen(local_path, "rb");
-   if (file == NULL)
+   blob = (struct azure_blob*)calloc(1, sizeof(struct azure_blob));
+   if (blob == NULL)
    {
       goto error;
    }
 
-   if (fstat(fileno(file), &file_info) != 0)
-   {
-      goto error;
-   }
+   snprintf(blob->local_path, sizeof(blob->local_path), "%s", local_path);
+   snprintf(blob->azure_path, sizeof(blob->azure_path), "%s", azure_path);
+   blob->size = size;
 
-   // Construct string to sign.
-   if (file_info.st_size == 0)
+   // a block blob has at most 50000 blocks, so very large files get larger blocks
+   blob->block_size = (size_t)config->azure_block_size;
+   if (blob->size / blob->block_size >= AZURE_MAX_BLOCKS)
    {
-      string_to_sign = pgmoneta_append(string_to_sign, "PUT\n\n\n\n\n\n\n\n\n\n\n\nx-ms-blob-type:BlockBlob\nx-ms-date:");
+      blob->block_size = blob->size / AZURE_MAX_BLOCKS + 1;
    }
-   else
+
+   blob->number_of_blocks = (int)((blob->size + blob->block_size - 1) / blob->block_size);
+   atomic_init(&blob->remaining, blob->number_of_blocks);
+   atomic_init(&blob->failed, false);
+
+   blob->next = *blobs;
+   *blobs = blob;
+
+   for (int i = 0; i < blob->number_of_blocks; i++)
    {
-      string_to_sign = pgmoneta_append(string_to_sign, "PUT\n\n\n");
-      string_to_sign = pgmoneta_append(string_to_sign, (char*)file_info.st_size);
-      string_to_sign = pgmoneta_append(string_to_sign, "\n\n\n\n\n\n\n\n\nx-ms-blob-type:BlockBlob\nx-ms-date:");
-   }
+      if (workers != NULL)
+      {
+         if (pgmoneta_create_worker_input(NULL, local_path, azure_path, 0, workers, &wi))
+         {
+            goto error;
+         }
 
-   string_to_sign = pgmoneta_append(string_to_sign, utc_date);
-   string_to_sign = pgmoneta_append(string_to_sign, "\nx-ms-version:2021-08-06\n/");
-   string_to_sign = pgmoneta_append(string_to_sign, config->azure_storage_account);
-   string_to_sign = pgmoneta_append(string_to_sign, "/");
-   string_to_sign = pgmoneta_append(string_to_sign, config->azure_container);
-   string_to_sign = pgmoneta_append(string_to_sign, "/");
-   string_to_sign = pgmoneta_append(string_to_sign, azure_path);
+         wi->argument = blob;
+         wi->offset = (off_t)(i * blob->block_size);
+         wi->length = i < blob->number_of_blocks - 1 ? blob->block_size : blob->size - (size_t)wi->offset;
 
-   // Decode the Azure storage account shared key.
-   pgmoneta_base64_decode(config->azure_shared_key, strlen(config->azure_shared_key), (void**)&signing_key, &signing_key_length);
+         if (workers->outcome)
+         {
+            pgmoneta_workers_add(workers, do_azure_put_block, (struct worker_input*)wi);
+         }
+      }
+      else if (azure_put_block(blob, i))
+      {
+         goto error;
+      }
+   }
 
-   // Construct the signature.
-   if (pgmoneta_generate_string_hmac_sha256_hash(signing_key, signing_key_length, string_to_sign, strlen(string_to_sign), &signature_hmac, &hmac_length))
+   if (workers == NULL && azure_put_block_list(blob))
    {
       goto error;
    }
 
-   // Encode the signature.
-   pgmoneta_base64_encode((char*) signature_hmac, hmac_length, &base64_signature, &base64_signature_length);
+   return 0;
 
-   // Construct the authorization header.
-   auth_value = pgmoneta_append(auth_value, "SharedKey ");
-   auth_value = pgmoneta_append(auth_value, config->azure_storage_account);
-   auth_value = pgmoneta_append(auth_value, ":");
-   auth_value = pgmoneta_append(auth_value, base64_signature);
+error:
 
-   chunk = pgmoneta_http_add_header(chunk, "Authorization", auth_value);
+   pgmoneta_log_error("Azure: Unable to upload %s", local_path);
 
-   chunk = pgmoneta_http_add_header(chunk, "x-ms-blob-type", "BlockBlob");
+   return 1;
+}
 
-   chunk = pgmoneta_http_add_header(chunk, "x-ms-date", utc_date);
+static void
+do_azure_put_blob(struct worker_input* wi)
+{
+   if (azure_put_blob(wi->from, wi->to))
+   {
+      pgmoneta_log_error("Azure: Unable to upload %s", wi->from);
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
 
-   chunk = pgmoneta_http_add_header(chunk, "x-ms-version", "2021-08-06");
+static void
+do_azure_put_block(struct worker_input* wi)
+{
+   struct azure_blob* blob = (struct azure_blob*)wi->argument;
 
-   if (pgmoneta_http_set_header_option(curl, chunk))
+   if (atomic_load(&blob->failed) || azure_put_block(blob, (int)(wi->offset / blob->block_size)))
    {
-      goto error;
+      atomic_store(&blob->failed, true);
    }
 
-   azure_host = azure_get_host();
+   // the last block of the file commits the blob
+   if (atomic_fetch_sub(&blob->remaining, 1) == 1)
+   {
+      if (atomic_load(&blob->failed) || azure_put_block_list(blob))
+      {
+         pgmoneta_log_error("Azure: Unable to upload %s", blob->local_path);
+         wi->workers->outcome = false;
+      }
+   }
 
-   azure_url = pgmoneta_append(azure_url, "https://");
-   azure_url = pgmoneta_append(azure_url, azure_host);
-   azure_url = pgmoneta_append(azure_url, "/");
-   azure_url = pgmoneta_append(azure_url, azure_path);
+   free(wi);
+}
 
-   pgmoneta_http_set_request_option(curl, HTTP_PUT);
+static int
+azure_put_blob(char* local_path, char* azure_path)
+{
+   FILE* file = NULL;
+   size_t size = 0;
+   char* md5 = NULL;
+   uint64_t trace_start;
 
-   pgmoneta_http_set_url_option(curl, azure_url);
+   trace_start = pgmoneta_trace_now();
 
-   curl_easy_setopt(curl, CURLOPT_READDATA, (void*) file);
+   file = fopen(local_path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
 
-   curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)file_info.st_size);
+   size = pgmoneta_get_file_size(local_path);
 
-   res = curl_easy_perform(curl);
-   if (res != CURLE_OK)
+   md5 = azure_content_md5(file, size);
+   if (md5 == NULL)
    {
-      fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
       goto error;
    }
 
-   free(local_path);
-   free(azure_path);
-   free(azure_url);
-   free(azure_host);
-   free(signature);
-   free(base64_signature);
-   free(signature_hmac);
-   free(signature_hex);
-   free(string_to_sign);
-   free(auth_value);
+   if (azure_send_request("PUT", azure_path, NULL, NULL, NULL, true, file, size, md5, NULL, 201))
+   {
+      goto error;
+   }
 
-   curl_slist_free_all(chunk);
+   pgmoneta_trace_event(TRACE_STORAGE, "Azure blob", azure_path, trace_start);
 
    fclose(file);
+
+   free(md5);
+
    return 0;
 
 error:
 
-   if (local_path != NULL)
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(md5);
+
+   return 1;
+}
+
+static int
+azure_put_block(struct azure_blob* blob, int block)
+{
+   off_t offset = 0;
+   size_t length = 0;
+   char* id = NULL;
+   char* escaped = NULL;
+   char* query = NULL;
+   char* resource = NULL;
+   char* md5 = NULL;
+   char detail[MAX_PATH];
+   uint64_t trace_start;
+   FILE* file = NULL;
+
+   trace_start = pgmoneta_trace_now();
+
+   offset = (off_t)(block * blob->block_size);
+   length = block < blob->number_of_blocks - 1 ? blob->block_size : blob->size - (size_t)offset;
+
+   id = azure_block_id(block);
+   if (id == NULL)
    {
-      free(local_path);
+      goto error;
    }
 
-   if (azure_path != NULL)
+   escaped = curl_easy_escape(azure_handle(), id, 0);
+   if (escaped == NULL)
    {
-      free(azure_path);
+      goto error;
+   }
+
+   query = pgmoneta_append(query, "comp=block&blockid=");
+   query = pgmoneta_append(query, escaped);
+
+   resource = pgmoneta_append(resource, "\nblockid:");
+   resource = pgmoneta_append(resource, id);
+   resource = pgmoneta_append(resource, "\ncomp:block");
+
+   file = fopen(blob->local_path, "rb");
+   if (file == NULL)
+   {
+      goto error;
    }
 
-   if (azure_url != NULL)
+   if (offset > 0 && fseeko(file, offset, SEEK_SET))
    {
-      free(azure_url);
+      goto error;
    }
 
-   if (azure_host != NULL)
+   md5 = azure_content_md5(file, length);
+   if (md5 == NULL)
    {
-      free(azure_host);
+      goto error;
    }
 
-   if (signature != NULL)
+   if (azure_send_request("PUT", blob->azure_path, query, resource, NULL, false, file, length, md5, NULL, 201))
    {
-      free(signature);
+      goto error;
    }
 
-   if (base64_signature != NULL)
+   if (trace_start > 0)
    {
-      free(base64_signature);
+      snprintf(&detail[0], sizeof(detail), "%.*s (block %d)", (int)sizeof(detail) - 32, blob->azure_path, block);
+      pgmoneta_trace_event(TRACE_STORAGE, "Azure block", &detail[0], trace_start);
    }
 
-   if (signature_hmac != NULL)
+   fclose(file);
+
+   curl_free(escaped);
+   free(id);
+   free(query);
+   free(resource);
+   free(md5);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
    {
-      free(signature_hmac);
+      fclose(file);
    }
 
-   if (signature_hex != NULL)
+   if (escaped != NULL)
    {
-      free(signature_hex);
+      curl_free(escaped);
    }
+   free(id);
+   free(query);
+   free(resource);
+   free(md5);
+
+   return 1;
+}
+
+static int
+azure_put_block_list(struct azure_blob* blob)
+{
+   char* id = NULL;
+   char* body = NULL;
+   FILE* file = NULL;
 
-   if (string_to_sign != NULL)
+   body = pgmoneta_append(body, "<?xml version=\"1.0\" encoding=\"utf-8\"?><BlockList>");
+   for (int i = 0; i < blob->number_of_blocks; i++)
    {
-      free(string_to_sign);
+      id = azure_block_id(i);
+      if (id == NULL)
+      {
+         goto error;
+      }
+
+      body = pgmoneta_append(body, "<Latest>");
+      body = pgmoneta_append(body, id);
+      body = pgmoneta_append(body, "</Latest>");
+
+      free(id);
+      id = NULL;
    }
+   body = pgmoneta_append(body, "</BlockList>");
 
-   if (auth_value != NULL)
+   file = fmemopen(body, strlen(body), "r");
+   if (file == NULL)
    {
-      free(auth_value);
+      goto error;
    }
 
-   if (chunk != NULL)
+   if (azure_send_request("PUT", blob->azure_path, "comp=blocklist", "\ncomp:blocklist", NULL, false, file, strlen(body), NULL, NULL, 201))
    {
-      curl_slist_free_all(chunk);
+      goto error;
    }
 
+   fclose(file);
+
+   free(body);
+
+   return 0;
+
+error:
+
    if (file != NULL)
    {
       fclose(file);
    }
 
+   free(id);
+   free(body);
+
    return 1;
 }
 
-static char*
-azure_get_host()
+static int
+azure_send_request(char* method, char* azure_path, char* query, char* resource, char* range, bool block_blob, FILE* file, size_t length, char* content_md5, FILE* out, long expected)
 {
-   char* host = NULL;
+   char utc_date[UTC_TIME_LENGTH];
+   char content_length[MISC_LENGTH];
+   char* string_to_sign = NULL;
+   char* azure_host = NULL;
+   char* azure_url = NULL;
+   char* auth_value = NULL;
+   long code = 0;
+   CURL* handle = NULL;
+   CURLcode res = -1;
+   struct azure_body body;
+   struct curl_slist* chunk = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   host = pgmoneta_append(host, config->azure_storage_account);
-   host = pgmoneta_append(host, ".blob.core.windows.net/");
-   host = pgmoneta_append(host, config->azure_container);
+   handle = azure_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
 
-   return host;
-}
+   // the handle keeps its connection open for the next request of this thread
+   pgmoneta_http_handle_reset(handle);
 
-static char*
-azure_get_basepath(int server, char* identifier)
-{
-   char* d = NULL;
-   struct configuration* config;
+   memset(&utc_date[0], 0, sizeof(utc_date));
+
+   if (pgmoneta_get_timestamp_UTC_format(utc_date))
+   {
+      goto error;
+   }
+
+   // Construct string to sign, the content length is empty for an empty body
+   memset(&content_length[0], 0, sizeof(content_length));
+   if (length > 0)
+   {
+      snprintf(content_length, sizeof(content_length), "%zu", length);
+   }
+
+   string_to_sign = pgmoneta_append(string_to_sign, method);
+   string_to_sign = pgmoneta_append(string_to_sign, "\n\n\n");
+   string_to_sign = pgmoneta_append(string_to_sign, content_length);
+   string_to_sign = pgmoneta_append(string_to_sign, "\n");
+   if (content_md5 != NULL)
+   {
+      string_to_sign = pgmoneta_append(string_to_sign, content_md5);
+   }
+   string_to_sign = pgmoneta_append(string_to_sign, "\n\n\n\n\n\n\n\n");
+   if (block_blob)
+   {
+      string_to_sign = pgmoneta_append(string_to_sign, "x-ms-blob-type:BlockBlob\n");
+   }
+   string_to_sign = pgmoneta_append(string_to_sign, "x-ms-date:");
+   string_to_sign = pgmoneta_append(string_to_sign, utc_date);
+   if (range != NULL)
+   {
+      string_to_sign = pgmoneta_append(string_to_sign, "\nx-ms-range:");
+      string_to_sign = pgmoneta_append(string_to_sign, range);
+   }
+   string_to_sign = pgmoneta_append(string_to_sign, "\nx-ms-version:");
+   string_to_sign = pgmoneta_append(string_to_sign, AZURE_VERSION);
+   string_to_sign = pgmoneta_append(string_to_sign, "\n/");
+   string_to_sign = pgmoneta_append(string_to_sign, config->azure_storage_account);
+   string_to_sign = pgmoneta_append(string_to_sign, "/");
+   string_to_sign = pgmoneta_append(string_to_sign, config->azure_container);
+   // a request on the container itself has no blob name
+   if (strlen(azure_path) > 0)
+   {
+      string_to_sign = pgmoneta_append(string_to_sign, "/");
+      string_to_sign = pgmoneta_append(string_to_sign, azure_path);
+   }
+   if (resource != NULL)
+   {
+      string_to_sign = pgmoneta_append(string_to_sign, resource);
+   }
+
+   auth_value = azure_authorization(string_to_sign);
+   if (auth_value == NULL)
+   {
+      goto error;
+   }
+
+   chunk = pgmoneta_http_add_header(chunk, "Authorization", auth_value);
+
+   if (content_md5 != NULL)
+   {
+      // the service rejects the body when it doesn't match
+      chunk = pgmoneta_http_add_header(chunk, "Content-MD5", content_md5);
+   }
+
+   if (block_blob)
+   {
+      chunk = pgmoneta_http_add_header(chunk, "x-ms-blob-type", "BlockBlob");
+   }
+
+   chunk = pgmoneta_http_add_header(chunk, "x-ms-date", utc_date);
+
+   if (range != NULL)
+   {
+      chunk = pgmoneta_http_add_header(chunk, "x-ms-range", range);
+   }
+
+   chunk = pgmoneta_http_add_header(chunk, "x-ms-version", AZURE_VERSION);
+
+   if (pgmoneta_http_set_header_option(handle, chunk))
+   {
+      goto error;
+   }
+
+   azure_host = azure_get_host();
+
+   azure_url = pgmoneta_append(azure_url, "https://");
+   azure_url = pgmoneta_append(azure_url, azure_host);
+   if (strlen(azure_path) > 0)
+   {
+      azure_url = pgmoneta_append(azure_url, "/");
+      azure_url = pgmoneta_append(azure_url, azure_path);
+   }
+   if (query != NULL)
+   {
+      azure_url = pgmoneta_append(azure_url, "?");
+      azure_url = pgmoneta_append(azure_url, query);
+   }
+
+   pgmoneta_http_set_url_option(handle, azure_url);
+
+   if (!strcmp(method, "PUT"))
+   {
+      pgmoneta_http_set_request_option(handle, HTTP_PUT);
+
+      body.file = file;
+      body.remaining = length;
+
+      curl_easy_setopt(handle, CURLOPT_READFUNCTION, azure_read);
+
+      curl_easy_setopt(handle, CURLOPT_READDATA, (void*)&body);
+
+      curl_easy_setopt(handle, CURLOPT_INFILESIZE_LARGE, (curl_off_t)length);
+   }
+   else if (!strcmp(method, "GET"))
+   {
+      pgmoneta_http_set_request_option(handle, HTTP_GET);
+   }
+   else
+   {
+      curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, method);
+   }
+
+   if (out != NULL)
+   {
+      curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)out);
+   }
+
+   if (file != NULL)
+   {
+      // the read callback can't send the body again
+      res = curl_easy_perform(handle);
+      if (res == CURLE_OK)
+      {
+         curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+      }
+   }
+   else
+   {
+      res = pgmoneta_http_perform(handle, out, &code);
+   }
+
+   if (res != CURLE_OK)
+   {
+      pgmoneta_log_error("Azure: %s %s failed: %s", method, azure_path, curl_easy_strerror(res));
+      goto error;
+   }
+
+   if (code != expected)
+   {
+      pgmoneta_log_error("Azure: %s %s failed with HTTP %ld", method, azure_path, code);
+      goto error;
+   }
+
+   free(azure_url);
+   free(azure_host);
+   free(string_to_sign);
+   free(auth_value);
+
+   curl_slist_free_all(chunk);
+
+   return 0;
+
+error:
+
+   free(azure_url);
+   free(azure_host);
+   free(string_to_sign);
+   free(auth_value);
+
+   if (chunk != NULL)
+   {
+      curl_slist_free_all(chunk);
+   }
+
+   return 1;
+}
+
+static char*
+azure_content_md5(FILE* file, size_t length)
+{
+   off_t start = 0;
+   size_t n = 0;
+   char* buffer = NULL;
+   char* md5 = NULL;
+   size_t md5_length = 0;
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int digest_length = 0;
+   EVP_MD_CTX* ctx = NULL;
+
+   start = ftello(file);
+   if (start < 0)
+   {
+      goto error;
+   }
+
+   buffer = (char*)malloc(AZURE_MD5_BUFFER_SIZE);
+   ctx = EVP_MD_CTX_new();
+   if (buffer == NULL || ctx == NULL || !EVP_DigestInit_ex(ctx, EVP_md5(), NULL))
+   {
+      goto error;
+   }
+
+   while (length > 0)
+   {
+      n = fread(buffer, 1, length < AZURE_MD5_BUFFER_SIZE ? length : AZURE_MD5_BUFFER_SIZE, file);
+      if (n == 0 || !EVP_DigestUpdate(ctx, buffer, n))
+      {
+         goto error;
+      }
+
+      length -= n;
+   }
+
+   if (!EVP_DigestFinal_ex(ctx, &digest[0], &digest_length))
+   {
+      goto error;
+   }
+
+   // the body is sent from where it was read
+   if (fseeko(file, start, SEEK_SET))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_base64_encode(&digest[0], digest_length, &md5, &md5_length))
+   {
+      goto error;
+   }
+
+   EVP_MD_CTX_free(ctx);
+   free(buffer);
+
+   return md5;
+
+error:
+
+   if (ctx != NULL)
+   {
+      EVP_MD_CTX_free(ctx);
+   }
+   free(buffer);
+   free(md5);
+
+   return NULL;
+}
+
+static char*
+azure_authorization(char* string_to_sign)
+{
+   unsigned char* signature_hmac = NULL;
+   int hmac_length = 0;
+   char* base64_signature = NULL;
+   size_t base64_signature_length;
+   char* auth_value = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pthread_mutex_lock(&signing_lock);
+
+   // Decode the Azure storage account shared key, once for as long as it is the same.
+   if (signing_key == NULL || strcmp(signing_source, config->azure_shared_key))
+   {
+      free(signing_key);
+      signing_key = NULL;
+      signing_key_length = 0;
+
+      if (pgmoneta_base64_decode(config->azure_shared_key, strlen(config->azure_shared_key), (void**)&signing_key, &signing_key_length))
+      {
+         pthread_mutex_unlock(&signing_lock);
+         goto error;
+      }
+
+      snprintf(&signing_source[0], sizeof(signing_source), "%s", config->azure_shared_key);
+   }
+
+   // Construct the signature.
+   if (pgmoneta_generate_string_hmac_sha256_hash(signing_key, signing_key_length, string_to_sign, strlen(string_to_sign), &signature_hmac, &hmac_length))
+   {
+      pthread_mutex_unlock(&signing_lock);
+      goto error;
+   }
+
+   pthread_mutex_unlock(&signing_lock);
+
+   // Encode the signature.
+   pgmoneta_base64_encode((char*) signature_hmac, hmac_length, &base64_signature, &base64_signature_length);
+
+   // Construct the authorization header.
+   auth_value = pgmoneta_append(auth_value, "SharedKey ");
+   auth_value = pgmoneta_append(auth_value, config->azure_storage_account);
+   auth_value = pgmoneta_append(auth_value, ":");
+   auth_value = pgmoneta_append(auth_value, base64_signature);
+
+   free(signature_hmac);
+   free(base64_signature);
+
+   return auth_value;
+
+error:
+
+   free(signature_hmac);
+   free(base64_signature);
+
+   return NULL;
+}
+
+static char*
+azure_block_id(int block)
+{
+   char raw[AZURE_BLOCK_ID_LENGTH + 1];
+   char* id = NULL;
+   size_t id_length = 0;
+
+   // all the ids of a blob must have the same length
+   memset(&raw[0], 0, sizeof(raw));
+   snprintf(raw, sizeof(raw), "%0*d", AZURE_BLOCK_ID_LENGTH, block);
+
+   if (pgmoneta_base64_encode(raw, AZURE_BLOCK_ID_LENGTH, &id, &id_length))
+   {
+      return NULL;
+   }
+
+   return id;
+}
+
+static size_t
+azure_read(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+   size_t n = 0;
+   struct azure_body* body = (struct azure_body*)userdata;
+
+   n = size * nitems;
+   if (n > body->remaining)
+   {
+      n = body->remaining;
+   }
+
+   if (n == 0)
+   {
+      return 0;
+   }
+
+   n = fread(buffer, 1, n, body->file);
+   if (n == 0)
+   {
+      return CURL_READFUNC_ABORT;
+   }
+
+   body->remaining -= n;
+
+   return n;
+}
+
+static CURL*
+azure_handle(void)
+{
+   CURL* handle = NULL;
+
+   handle = (CURL*)pgmoneta_worker_context(WORKER_CONTEXT_AZURE);
+
+   if (handle == NULL)
+   {
+      handle = pgmoneta_http_handle_create();
+      if (handle != NULL)
+      {
+         pgmoneta_worker_context_set(WORKER_CONTEXT_AZURE, handle, &azure_handle_destroy);
+      }
+   }
+
+   return handle;
+}
+
+static void
+azure_handle_destroy(void* handle)
+{
+   curl_easy_cleanup((CURL*)handle);
+}
+
+static void
+azure_destroy_blobs(struct azure_blob* blobs)
+{
+   struct azure_blob* next = NULL;
+
+   while (blobs != NULL)
+   {
+      next = blobs->next;
+      free(blobs);
+      blobs = next;
+   }
+}
+
+static int
+azure_backend_put(struct storage_backend* backend, char* local_path, char* remote_path)
+{
+   int ret;
+   char* azure_path = NULL;
+
+   azure_path = azure_get_path(remote_path);
+
+   // the handle of the calling thread is kept for its next request
+   ret = azure_put_blob(local_path, azure_path);
+
+   free(azure_path);
+
+   return ret;
+}
+
+static int
+azure_backend_get(struct storage_backend* backend, char* remote_path, char* local_path)
+{
+   FILE* file = NULL;
+
+   file = fopen(local_path, "wb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (azure_backend_stream(backend, remote_path, 0, 0, file))
+   {
+      goto error;
+   }
+
+   if (fclose(file) != 0)
+   {
+      file = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static int
+azure_backend_stream(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out)
+{
+   int ret;
+   char range[MISC_LENGTH];
+   char* azure_path = NULL;
+
+   azure_path = azure_get_path(remote_path);
+
+   memset(&range[0], 0, sizeof(range));
+   if (length > 0)
+   {
+      snprintf(range, sizeof(range), "bytes=%jd-%jd", (intmax_t)offset, (intmax_t)(offset + length - 1));
+   }
+
+   ret = azure_send_request("GET", azure_path, NULL, NULL, length > 0 ? range : NULL, false, NULL, 0, NULL, out, length > 0 ? 206 : 200);
+
+   free(azure_path);
+
+   return ret;
+}
+
+static int
+azure_backend_list(struct storage_backend* backend, char* remote_path, struct deque** names)
+{
+   char* prefix = NULL;
+   char* escaped = NULL;
+   char* escaped_marker = NULL;
+   char* query = NULL;
+   char* resource = NULL;
+   char* response = NULL;
+   size_t response_size = 0;
+   char* marker = NULL;
+   char* name = NULL;
+   char* cursor = NULL;
+   FILE* out = NULL;
+   CURL* handle = NULL;
+   struct deque* n = NULL;
+
+   handle = azure_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_create(false, &n))
+   {
+      goto error;
+   }
+
+   prefix = azure_get_path(remote_path);
+   if (!pgmoneta_ends_with(prefix, "/"))
+   {
+      prefix = pgmoneta_append(prefix, "/");
+   }
+
+   escaped = curl_easy_escape(handle, prefix, 0);
+   if (escaped == NULL)
+   {
+      goto error;
+   }
+
+   do
+   {
+      query = pgmoneta_append(query, "restype=container&comp=list&delimiter=%2F&prefix=");
+      query = pgmoneta_append(query, escaped);
+
+      // the canonical resource lists the parameters sorted and not escaped
+      resource = pgmoneta_append(resource, "\ncomp:list\ndelimiter:/");
+
+      if (marker != NULL)
+      {
+         escaped_marker = curl_easy_escape(handle, marker, 0);
+         if (escaped_marker == NULL)
+         {
+            goto error;
+         }
+         query = pgmoneta_append(query, "&marker=");
+         query = pgmoneta_append(query, escaped_marker);
+         curl_free(escaped_marker);
+         escaped_marker = NULL;
+
+         resource = pgmoneta_append(resource, "\nmarker:");
+         resource = pgmoneta_append(resource, marker);
+      }
+
+      resource = pgmoneta_append(resource, "\nprefix:");
+      resource = pgmoneta_append(resource, prefix);
+      resource = pgmoneta_append(resource, "\nrestype:container");
+
+      out = open_memstream(&response, &response_size);
+      if (out == NULL)
+      {
+         goto error;
+      }
+
+      if (azure_send_request("GET", "", query, resource, NULL, false, NULL, 0, NULL, out, 200))
+      {
+         goto error;
+      }
+
+      fclose(out);
+      out = NULL;
+
+      // the blob prefixes of the subdirectories are not files
+      cursor = response;
+      while (cursor != NULL && (cursor = strstr(cursor, "<Blob>")) != NULL)
+      {
+         cursor += strlen("<Blob>");
+         name = azure_xml_value(cursor, "Name");
+         if (name != NULL && strlen(name) > strlen(prefix))
+         {
+            pgmoneta_deque_add(n, NULL, (uintptr_t)(name + strlen(prefix)), ValueString);
+         }
+         free(name);
+      }
+
+      free(marker);
+      marker = azure_xml_value(response, "NextMarker");
+
+      free(response);
+      free(query);
+      free(resource);
+      response = NULL;
+      query = NULL;
+      resource = NULL;
+   }
+   while (marker != NULL);
+
+   *names = n;
+
+   curl_free(escaped);
+   free(prefix);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (escaped != NULL)
+   {
+      curl_free(escaped);
+   }
+
+   pgmoneta_deque_destroy(n);
+
+   free(marker);
+   free(response);
+   free(query);
+   free(resource);
+   free(prefix);
+
+   return 1;
+}
+
+static int
+azure_backend_remove(struct storage_backend* backend, char* remote_path)
+{
+   int ret;
+   char* azure_path = NULL;
+
+   azure_path = azure_get_path(remote_path);
+
+   ret = azure_send_request("DELETE", azure_path, NULL, NULL, NULL, false, NULL, 0, NULL, NULL, 202);
+
+   free(azure_path);
+
+   return ret;
+}
+
+static int
+azure_backend_remove_directory(struct storage_backend* backend, char* remote_path)
+{
+   char* prefix = NULL;
+   char* escaped = NULL;
+   char* escaped_marker = NULL;
+   char* query = NULL;
+   char* resource = NULL;
+   char* response = NULL;
+   size_t response_size = 0;
+   char* marker = NULL;
+   char* name = NULL;
+   char* cursor = NULL;
+   FILE* out = NULL;
+   CURL* handle = NULL;
+   struct deque* names = NULL;
+
+   handle = azure_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   prefix = azure_get_path(remote_path);
+   if (!pgmoneta_ends_with(prefix, "/"))
+   {
+      prefix = pgmoneta_append(prefix, "/");
+   }
+
+   escaped = curl_easy_escape(handle, prefix, 0);
+   if (escaped == NULL)
+   {
+      goto error;
+   }
+
+   // without a delimiter the listing has the blobs of all the subdirectories
+   do
+   {
+      query = pgmoneta_append(query, "restype=container&comp=list&prefix=");
+      query = pgmoneta_append(query, escaped);
+
+      resource = pgmoneta_append(resource, "\ncomp:list");
+
+      if (marker != NULL)
+      {
+         escaped_marker = curl_easy_escape(handle, marker, 0);
+         if (escaped_marker == NULL)
+         {
+            goto error;
+         }
+         query = pgmoneta_append(query, "&marker=");
+         query = pgmoneta_append(query, escaped_marker);
+         curl_free(escaped_marker);
+         escaped_marker = NULL;
+
+         resource = pgmoneta_append(resource, "\nmarker:");
+         resource = pgmoneta_append(resource, marker);
+      }
+
+      resource = pgmoneta_append(resource, "\nprefix:");
+      resource = pgmoneta_append(resource, prefix);
+      resource = pgmoneta_append(resource, "\nrestype:container");
+
+      out = open_memstream(&response, &response_size);
+      if (out == NULL)
+      {
+         goto error;
+      }
+
+      if (azure_send_request("GET", "", query, resource, NULL, false, NULL, 0, NULL, out, 200))
+      {
+         goto error;
+      }
+
+      fclose(out);
+      out = NULL;
+
+      cursor = response;
+      while (cursor != NULL && (cursor = strstr(cursor, "<Blob>")) != NULL)
+      {
+         cursor += strlen("<Blob>");
+         name = azure_xml_value(cursor, "Name");
+         if (name != NULL)
+         {
+            if (names == NULL && pgmoneta_deque_create(false, &names))
+            {
+               free(name);
+               goto error;
+            }
+
+            pgmoneta_deque_add(names, NULL, (uintptr_t)name, ValueString);
+
+            if (pgmoneta_deque_size(names) >= AZURE_BATCH_SIZE)
+            {
+               if (azure_delete_batch(names))
+               {
+                  free(name);
+                  goto error;
+               }
+               pgmoneta_deque_destroy(names);
+               names = NULL;
+            }
+         }
+         free(name);
+      }
+
+      free(marker);
+      marker = azure_xml_value(response, "NextMarker");
+
+      free(response);
+      free(query);
+      free(resource);
+      response = NULL;
+      query = NULL;
+      resource = NULL;
+   }
+   while (marker != NULL);
+
+   if (names != NULL && azure_delete_batch(names))
+   {
+      goto error;
+   }
+
+   pgmoneta_deque_destroy(names);
+   curl_free(escaped);
+   free(prefix);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (escaped != NULL)
+   {
+      curl_free(escaped);
+   }
+
+   pgmoneta_deque_destroy(names);
+
+   free(marker);
+   free(response);
+   free(query);
+   free(resource);
+   free(prefix);
+
+   return 1;
+}
+
+static int
+azure_delete_batch(struct deque* names)
+{
+   char utc_date[UTC_TIME_LENGTH];
+   char number[MISC_LENGTH];
+   char* string_to_sign = NULL;
+   char* auth_value = NULL;
+   char* body = NULL;
+   char* azure_host = NULL;
+   char* azure_url = NULL;
+   char* response = NULL;
+   size_t response_size = 0;
+   char* cursor = NULL;
+   int id = 0;
+   long code = 0;
+   FILE* out = NULL;
+   CURL* handle = NULL;
+   CURLcode res;
+   struct curl_slist* chunk = NULL;
+   struct deque_iterator* iter = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   handle = azure_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   pgmoneta_http_handle_reset(handle);
+
+   memset(&utc_date[0], 0, sizeof(utc_date));
+
+   if (pgmoneta_get_timestamp_UTC_format(utc_date))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_iterator_create(names, &iter))
+   {
+      goto error;
+   }
+
+   // every subrequest is signed on its own
+   while (pgmoneta_deque_iterator_next(iter))
+   {
+      char* name = (char*)pgmoneta_value_data(iter->value);
+
+      string_to_sign = pgmoneta_append(string_to_sign, "DELETE\n\n\n\n\n\n\n\n\n\n\n\nx-ms-date:");
+      string_to_sign = pgmoneta_append(string_to_sign, utc_date);
+      string_to_sign = pgmoneta_append(string_to_sign, "\n/");
+      string_to_sign = pgmoneta_append(string_to_sign, config->azure_storage_account);
+      string_to_sign = pgmoneta_append(string_to_sign, "/");
+      string_to_sign = pgmoneta_append(string_to_sign, config->azure_container);
+      string_to_sign = pgmoneta_append(string_to_sign, "/");
+      string_to_sign = pgmoneta_append(string_to_sign, name);
+
+      auth_value = azure_authorization(string_to_sign);
+      if (auth_value == NULL)
+      {
+         goto error;
+      }
+
+      memset(&number[0], 0, sizeof(number));
+      snprintf(number, sizeof(number), "%d", id++);
+
+      body = pgmoneta_append(body, "--" AZURE_BATCH_BOUNDARY "\r\n");
+      body = pgmoneta_append(body, "Content-Type: application/http\r\n");
+      body = pgmoneta_append(body, "Content-Transfer-Encoding: binary\r\n");
+      body = pgmoneta_append(body, "Content-ID: ");
+      body = pgmoneta_append(body, number);
+      body = pgmoneta_append(body, "\r\n\r\nDELETE /");
+      body = pgmoneta_append(body, config->azure_container);
+      body = pgmoneta_append(body, "/");
+      body = pgmoneta_append(body, name);
+      body = pgmoneta_append(body, " HTTP/1.1\r\nx-ms-date: ");
+      body = pgmoneta_append(body, utc_date);
+      body = pgmoneta_append(body, "\r\nAuthorization: ");
+      body = pgmoneta_append(body, auth_value);
+      body = pgmoneta_append(body, "\r\nContent-Length: 0\r\n\r\n");
+
+      free(string_to_sign);
+      free(auth_value);
+      string_to_sign = NULL;
+      auth_value = NULL;
+   }
+
+   body = pgmoneta_append(body, "--" AZURE_BATCH_BOUNDARY "--\r\n");
+
+   memset(&number[0], 0, sizeof(number));
+   snprintf(number, sizeof(number), "%zu", strlen(body));
+
+   string_to_sign = pgmoneta_append(string_to_sign, "POST\n\n\n");
+   string_to_sign = pgmoneta_append(string_to_sign, number);
+   string_to_sign = pgmoneta_append(string_to_sign, "\n\nmultipart/mixed; boundary=" AZURE_BATCH_BOUNDARY "\n\n\n\n\n\n\nx-ms-date:");
+   string_to_sign = pgmoneta_append(string_to_sign, utc_date);
+   string_to_sign = pgmoneta_append(string_to_sign, "\nx-ms-version:");
+   string_to_sign = pgmoneta_append(string_to_sign, AZURE_VERSION);
+   string_to_sign = pgmoneta_append(string_to_sign, "\n/");
+   string_to_sign = pgmoneta_append(string_to_sign, config->azure_storage_account);
+   string_to_sign = pgmoneta_append(string_to_sign, "/");
+   string_to_sign = pgmoneta_append(string_to_sign, config->azure_container);
+   string_to_sign = pgmoneta_append(string_to_sign, "\ncomp:batch\nrestype:container");
+
+   auth_value = azure_authorization(string_to_sign);
+   if (auth_value == NULL)
+   {
+      goto error;
+   }
+
+   chunk = pgmoneta_http_add_header(chunk, "Authorization", auth_value);
+   chunk = pgmoneta_http_add_header(chunk, "Content-Type", "multipart/mixed; boundary=" AZURE_BATCH_BOUNDARY);
+   chunk = pgmoneta_http_add_header(chunk, "x-ms-date", utc_date);
+   chunk = pgmoneta_http_add_header(chunk, "x-ms-version", AZURE_VERSION);
+
+   if (pgmoneta_http_set_header_option(handle, chunk))
+   {
+      goto error;
+   }
+
+   azure_host = azure_get_host();
+
+   azure_url = pgmoneta_append(azure_url, "https://");
+   azure_url = pgmoneta_append(azure_url, azure_host);
+   azure_url = pgmoneta_append(azure_url, "?restype=container&comp=batch");
+
+   pgmoneta_http_set_url_option(handle, azure_url);
+
+   out = open_memstream(&response, &response_size);
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   curl_easy_setopt(handle, CURLOPT_POST, 1L);
+   curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body);
+   curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)strlen(body));
+   curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)out);
+
+   res = pgmoneta_http_perform(handle, out, &code);
+
+   fclose(out);
+   out = NULL;
+
+   if (res != CURLE_OK)
+   {
+      pgmoneta_log_error("Azure: Batch delete failed: %s", curl_easy_strerror(res));
+      goto error;
+   }
+
+   if (code != 202)
+   {
+      pgmoneta_log_error("Azure: Batch delete failed with HTTP %ld", code);
+      goto error;
+   }
+
+   // a blob that is gone already is fine
+   cursor = response;
+   while (cursor != NULL && (cursor = strstr(cursor, "HTTP/1.1 ")) != NULL)
+   {
+      cursor += strlen("HTTP/1.1 ");
+      code = strtol(cursor, NULL, 10);
+      if (code != 202 && code != 404)
+      {
+         pgmoneta_log_error("Azure: Batch delete of a blob failed with HTTP %ld", code);
+         goto error;
+      }
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+   curl_slist_free_all(chunk);
+   free(string_to_sign);
+   free(auth_value);
+   free(body);
+   free(azure_host);
+   free(azure_url);
+   free(response);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+
+   if (chunk != NULL)
+   {
+      curl_slist_free_all(chunk);
+   }
+   free(string_to_sign);
+   free(auth_value);
+   free(body);
+   free(azure_host);
+   free(azure_url);
+   free(response);
+
+   return 1;
+}
+
+static char*
+azure_xml_value(char* xml, char* tag)
+{
+   char open[MISC_LENGTH];
+   char close[MISC_LENGTH];
+   char* start = NULL;
+   char* end = NULL;
+   char* value = NULL;
+
+   if (xml == NULL)
+   {
+      return NULL;
+   }
+
+   snprintf(open, sizeof(open), "<%s>", tag);
+   snprintf(close, sizeof(close), "</%s>", tag);
+
+   start = strstr(xml, open);
+   if (start == NULL)
+   {
+      return NULL;
+   }
+   start += strlen(open);
+
+   end = strstr(start, close);
+   if (end == NULL || end == start)
+   {
+      return NULL;
+   }
+
+   value = (char*)calloc(1, end - start + 1);
+   if (value == NULL)
+   {
+      return NULL;
+   }
+
+   memcpy(value, start, end - start);
+
+   return value;
+}
+
+static char*
+azure_get_host()
+{
+   char* host = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   host = pgmoneta_append(host, config->azure_storage_account);
+   host = pgmoneta_append(host, ".blob.core.windows.net/");
+   host = pgmoneta_append(host, config->azure_container);
+
+   return host;
+}
+
+static char*
+azure_get_basepath(int server, char* identifier)
+{
+   char* d = NULL;
+   struct configuration* config;
 
    config = (struct configuration*)shmem;
 
@@ -541,3 +1864,21 @@ azure_get_basepath(int server, char* identifier)
 
    return d;
 }
+
+static char*
+azure_get_path(char* remote_path)
+{
+   char* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_append(d, config->azure_base_dir);
+   if (!pgmoneta_ends_with(config->azure_base_dir, "/"))
+   {
+      d = pgmoneta_append(d, "/");
+   }
+   d = pgmoneta_append(d, remote_path);
+
+   return d;
+}
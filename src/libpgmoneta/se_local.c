@@ -47,7 +47,7 @@ pgmoneta_storage_create_local(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -33,36 +33,153 @@
 #include <info.h>
 #include <logging.h>
 #include <security.h>
+#include <sha256.h>
 #include <storage.h>
+#include <string_builder.h>
+#include <trace.h>
 #include <utils.h>
+#include <workers.h>
 #include <workflow.h>
 
 /* system */
 #include <assert.h>
 #include <dirent.h>
+#include <openssl/evp.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+
+#define S3_UNSIGNED_PAYLOAD "UNSIGNED-PAYLOAD"
+#define S3_EMPTY_PAYLOAD    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+#define S3_STREAMING_PAYLOAD "STREAMING-AWS4-HMAC-SHA256-PAYLOAD-TRAILER"
+#define S3_MAX_PARTS        10000
+#define S3_CHUNK_SIZE       (64 * 1024)
+
+#define S3_REQUEST_PUT      0
+#define S3_REQUEST_CREATE   1
+#define S3_REQUEST_PART     2
+#define S3_REQUEST_COMPLETE 3
+#define S3_REQUEST_ABORT    4
+
+#define S3_STATE_PENDING    0
+#define S3_STATE_SENDING    1
+#define S3_STATE_CREATING   2
+#define S3_STATE_PARTS      3
+#define S3_STATE_COMPLETING 4
+#define S3_STATE_DONE       5
+
+/** @struct s3_upload
+ * Defines a file that is uploaded with a single PUT or as a multipart upload
+ */
+struct s3_upload
+{
+   char relative_path[MAX_PATH]; /**< The path relative to the backup */
+   char local_path[MAX_PATH];    /**< The local path */
+   char s3_path[MAX_PATH];       /**< The S3 key */
+   size_t size;                  /**< The size of the file */
+   size_t part_size;             /**< The size of the parts */
+   int state;                    /**< The state of the upload */
+   char* upload_id;              /**< The id of the multipart upload */
+   int number_of_parts;          /**< The number of parts */
+   int next_part;                /**< The next part to send, starting at 1 */
+   int completed_parts;          /**< The number of uploaded parts */
+   char** etags;                 /**< The ETags of the uploaded parts */
+   char** checksums;             /**< The CRC32C checksums of the uploaded parts */
+   struct s3_upload* next;       /**< The next upload */
+};
+
+/** @struct s3_request
+ * Defines a request slot. The easy handle of a slot is reused for all its requests,
+ * which keeps the connections of the multi handle open across files
+ */
+struct s3_request
+{
+   CURL* handle;                 /**< The easy handle */
+   bool busy;                    /**< Is a request in flight */
+   int type;                     /**< The request type */
+   struct s3_upload* upload;     /**< The upload */
+   int part;                     /**< The part number, starting at 1 */
+   FILE* file;                   /**< The file being sent */
+   size_t remaining;             /**< The number of bytes left to send */
+   char* url;                    /**< The URL */
+   char* body;                   /**< The request body */
+   struct curl_slist* headers;   /**< The request headers */
+   char* response;               /**< The response body */
+   size_t response_size;         /**< The size of the response body */
+   char etag[MISC_LENGTH];       /**< The ETag of the response */
+   bool chunked;                 /**< Is the body sent as signed chunks */
+   char date[LONG_TIME_LENGHT];  /**< The date of the signature */
+   char signature[65];           /**< The signature of the previous chunk */
+   unsigned char* key;           /**< The signing key */
+   int key_length;               /**< The length of the signing key */
+   char* chunk;                  /**< The encoded chunk */
+   size_t chunk_length;          /**< The length of the encoded chunk */
+   size_t chunk_offset;          /**< The bytes of the encoded chunk already sent */
+   bool last;                    /**< Is the final chunk encoded */
+   uint32_t crc;                 /**< The CRC32C of the data sent */
+   char checksum[MISC_LENGTH];   /**< The base64 CRC32C of the data, once sent */
+   uint64_t traced;              /**< The start of the request in the trace */
+};
 
 static char* s3_storage_name(void);
 static int s3_storage_setup(char*, struct art*);
 static int s3_storage_execute(char*, struct art*);
 static int s3_storage_teardown(char*, struct art*);
 
-static int s3_upload_files(char* local_root, char* s3_root, char* relative_path);
-static int s3_send_upload_request(char* local_root, char* s3_root, char* relative_path);
+static int s3_upload_files(char* local_root, char* s3_root);
+static int s3_collect_files(char* local_root, char* s3_root, char* relative_path, struct s3_upload** head, struct s3_upload** tail);
+static struct s3_upload* s3_next_upload(struct s3_upload** cursor, int* type, int* part);
+static int s3_start_request(struct s3_request* request, struct s3_upload* upload, int type, int part);
+static int s3_finish_request(struct s3_request* request, CURLcode result);
+static void s3_reset_request(struct s3_request* request);
+static void s3_abort_uploads(struct s3_upload* uploads);
+static void s3_destroy_uploads(struct s3_upload* uploads);
+static int s3_sign(char* method, char* s3_path, char* query, char* payload, bool storage_class, size_t decoded_length, char* date, char* signature, struct curl_slist** headers);
+static int s3_signing_key(char* short_date, unsigned char** key, int* length);
+static char* s3_complete_body(struct s3_upload* upload);
+static char* s3_xml_value(char* xml, char* tag);
+static size_t s3_read(char* buffer, size_t size, size_t nitems, void* userdata);
+static int s3_next_chunk(struct s3_request* request);
+static int s3_chunk_sign(struct s3_request* request, char* algorithm, char* hashes);
+static size_t s3_chunked_length(size_t length);
+static size_t s3_write(char* buffer, size_t size, size_t nitems, void* userdata);
+static size_t s3_header(char* buffer, size_t size, size_t nitems, void* userdata);
+
+static int s3_backend_put(struct storage_backend* backend, char* local_path, char* remote_path);
+static int s3_backend_get(struct storage_backend* backend, char* remote_path, char* local_path);
+static int s3_backend_list(struct storage_backend* backend, char* remote_path, struct deque** names);
+static int s3_backend_remove(struct storage_backend* backend, char* remote_path);
+static int s3_backend_remove_directory(struct storage_backend* backend, char* remote_path);
+static int s3_delete_objects(char* body);
+static int s3_backend_stream(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out);
+static int s3_send_request(char* method, char* s3_path, char* query, char* range, FILE* out, long expected);
+static CURL* s3_handle(void);
 
 static char* s3_get_host(void);
 static char* s3_get_basepath(int server, char* identifier);
+static char* s3_get_path(char* remote_path);
+static void s3_handle_destroy(void* handle);
 
-static CURL* curl = NULL;
+static CURLM* multi = NULL;
+static struct s3_request* requests = NULL;
+static int number_of_requests = 0;
+static struct art* s3_checksums = NULL;
+
+// the signing key only changes with the day, the region and the secret
+static pthread_mutex_t signing_lock = PTHREAD_MUTEX_INITIALIZER;
+static char signing_date[SHORT_TIME_LENGHT];
+static char* signing_scope = NULL;
+static unsigned char* signing_key = NULL;
+static int signing_key_length = 0;
 
 struct workflow*
 pgmoneta_storage_create_s3(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    wf->name = &s3_storage_name;
    wf->setup = &s3_storage_setup;
@@ -73,6 +190,32 @@ pgmoneta_storage_create_s3(void)
    return wf;
 }
 
+struct storage_backend*
+pgmoneta_storage_backend_s3(void)
+{
+   struct storage_backend* backend = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   backend = (struct storage_backend*)calloc(1, sizeof(struct storage_backend));
+   if (backend == NULL)
+   {
+      return NULL;
+   }
+
+   snprintf(&backend->name[0], sizeof(backend->name), "%s", "S3");
+   backend->put = &s3_backend_put;
+   backend->get = &s3_backend_get;
+   backend->list = &s3_backend_list;
+   backend->remove = &s3_backend_remove;
+   backend->remove_directory = &s3_backend_remove_directory;
+   backend->stream = &s3_backend_stream;
+   backend->range_size = (size_t)config->s3_part_size;
+
+   return backend;
+}
+
 static char*
 s3_storage_name(void)
 {
@@ -103,12 +246,31 @@ s3_storage_setup(char* name, struct art* nodes)
 
    pgmoneta_log_debug("S3 storage engine (setup): %s/%s", config->servers[server].name, label);
 
-   curl = curl_easy_init();
-   if (curl == NULL)
+   multi = curl_multi_init();
+   if (multi == NULL)
    {
       goto error;
    }
 
+   number_of_requests = config->s3_concurrency > 0 ? config->s3_concurrency : 1;
+
+   curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)number_of_requests);
+
+   requests = (struct s3_request*)calloc(number_of_requests, sizeof(struct s3_request));
+   if (requests == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_requests; i++)
+   {
+      requests[i].handle = pgmoneta_http_handle_create();
+      if (requests[i].handle == NULL)
+      {
+         goto error;
+      }
+   }
+
    return 0;
 
 error:
@@ -149,11 +311,20 @@ s3_storage_execute(char* name, struct art* nodes)
    local_root = pgmoneta_get_server_backup_identifier(server, label);
    s3_root = s3_get_basepath(server, label);
 
-   if (s3_upload_files(local_root, s3_root, ""))
+   // the payload hash of unchanged files is taken from the checksum index
+   if (!config->s3_unsigned_payload)
+   {
+      pgmoneta_sha256_index_read(local_root, &s3_checksums);
+   }
+
+   if (s3_upload_files(local_root, s3_root))
    {
       goto error;
    }
 
+   pgmoneta_art_destroy(s3_checksums);
+   s3_checksums = NULL;
+
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
    remote_s3_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
 
@@ -166,6 +337,9 @@ s3_storage_execute(char* name, struct art* nodes)
 
 error:
 
+   pgmoneta_art_destroy(s3_checksums);
+   s3_checksums = NULL;
+
    free(local_root);
    free(s3_root);
 
@@ -199,9 +373,29 @@ s3_storage_teardown(char* name, struct art* nodes)
 
    root = pgmoneta_get_server_backup_identifier_data(server, label);
 
-   pgmoneta_delete_directory(root);
+   // the data stays on local storage until retention tiers the backup
+   if (pgmoneta_storage_retention_local(server) == 0)
+   {
+      pgmoneta_delete_directory(root);
+   }
+
+   for (int i = 0; requests != NULL && i < number_of_requests; i++)
+   {
+      s3_reset_request(&requests[i]);
+      if (requests[i].handle != NULL)
+      {
+         curl_easy_cleanup(requests[i].handle);
+      }
+   }
+   free(requests);
+   requests = NULL;
+   number_of_requests = 0;
 
-   curl_easy_cleanup(curl);
+   if (multi != NULL)
+   {
+      curl_multi_cleanup(multi);
+      multi = NULL;
+   }
 
    free(root);
 
@@ -209,12 +403,118 @@ s3_storage_teardown(char* name, struct art* nodes)
 }
 
 static int
-s3_upload_files(char* local_root, char* s3_root, char* relative_path)
+s3_upload_files(char* local_root, char* s3_root)
+{
+   int running = 0;
+   int still_running = 0;
+   int queued = 0;
+   int type = 0;
+   int part = 0;
+   bool failed = false;
+   struct s3_upload* head = NULL;
+   struct s3_upload* tail = NULL;
+   struct s3_upload* cursor = NULL;
+   struct s3_upload* upload = NULL;
+   struct s3_request* request = NULL;
+   CURLMsg* msg = NULL;
+
+   if (s3_collect_files(local_root, s3_root, "", &head, &tail))
+   {
+      goto error;
+   }
+
+   cursor = head;
+
+   // parts of large files and small files share the slots, so a few big
+   // relation segments don't serialize the upload
+   for (;;)
+   {
+      while (!failed && running < number_of_requests && (upload = s3_next_upload(&cursor, &type, &part)) != NULL)
+      {
+         request = NULL;
+         for (int i = 0; i < number_of_requests; i++)
+         {
+            if (!requests[i].busy)
+            {
+               request = &requests[i];
+               break;
+            }
+         }
+
+         if (s3_start_request(request, upload, type, part) ||
+             curl_multi_add_handle(multi, request->handle) != CURLM_OK)
+         {
+            s3_reset_request(request);
+            failed = true;
+            break;
+         }
+
+         running++;
+      }
+
+      if (running == 0)
+      {
+         break;
+      }
+
+      if (curl_multi_perform(multi, &still_running) != CURLM_OK)
+      {
+         failed = true;
+      }
+
+      while ((msg = curl_multi_info_read(multi, &queued)) != NULL)
+      {
+         if (msg->msg != CURLMSG_DONE)
+         {
+            continue;
+         }
+
+         request = NULL;
+         curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&request);
+         curl_multi_remove_handle(multi, msg->easy_handle);
+         running--;
+
+         if (request == NULL || s3_finish_request(request, msg->data.result))
+         {
+            failed = true;
+         }
+
+         s3_reset_request(request);
+      }
+
+      if (running > 0)
+      {
+         curl_multi_poll(multi, NULL, 0, 1000, NULL);
+      }
+   }
+
+   if (failed)
+   {
+      goto error;
+   }
+
+   s3_destroy_uploads(head);
+
+   return 0;
+
+error:
+
+   s3_abort_uploads(head);
+   s3_destroy_uploads(head);
+
+   return 1;
+}
+
+static int
+s3_collect_files(char* local_root, char* s3_root, char* relative_path, struct s3_upload** head, struct s3_upload** tail)
 {
    char* local_path = NULL;
-   char* relative_file;
-   DIR* dir;
+   DIR* dir = NULL;
    struct dirent* entry;
+   struct s3_upload* upload = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    local_path = pgmoneta_append(local_path, local_root);
    local_path = pgmoneta_append(local_path, relative_path);
@@ -237,23 +537,47 @@ s3_upload_files(char* local_root, char* s3_root, char* relative_path)
 
          snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
 
-         s3_upload_files(local_root, s3_root, relative_dir);
+         if (s3_collect_files(local_root, s3_root, relative_dir, head, tail))
+         {
+            goto error;
+         }
       }
       else
       {
-         relative_file = NULL;
+         upload = (struct s3_upload*)calloc(1, sizeof(struct s3_upload));
+         if (upload == NULL)
+         {
+            goto error;
+         }
+
+         snprintf(upload->relative_path, sizeof(upload->relative_path), "%s/%s", relative_path, entry->d_name);
+         snprintf(upload->local_path, sizeof(upload->local_path), "%s%s", local_root, upload->relative_path);
+         snprintf(upload->s3_path, sizeof(upload->s3_path), "%s%s", s3_root, upload->relative_path);
 
-         relative_file = pgmoneta_append(relative_file, relative_path);
-         relative_file = pgmoneta_append(relative_file, "/");
-         relative_file = pgmoneta_append(relative_file, entry->d_name);
+         upload->size = pgmoneta_get_file_size(upload->local_path);
+         upload->state = S3_STATE_PENDING;
 
-         if (s3_send_upload_request(local_root, s3_root, relative_file))
+         // S3 allows at most 10000 parts, so very large files get larger parts
+         upload->part_size = (size_t)config->s3_part_size;
+         if (upload->size / upload->part_size >= S3_MAX_PARTS)
          {
-            free(relative_file);
-            goto error;
+            upload->part_size = upload->size / S3_MAX_PARTS + 1;
+         }
+
+         if (upload->size > upload->part_size)
+         {
+            upload->number_of_parts = (int)((upload->size + upload->part_size - 1) / upload->part_size);
          }
 
-         free(relative_file);
+         if (*tail == NULL)
+         {
+            *head = upload;
+         }
+         else
+         {
+            (*tail)->next = upload;
+         }
+         *tail = upload;
       }
    }
 
@@ -265,289 +589,1819 @@ s3_upload_files(char* local_root, char* s3_root, char* relative_path)
 
 error:
 
-   closedir(dir);
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
 
    free(local_path);
 
    return 1;
 }
 
+static struct s3_upload*
+s3_next_upload(struct s3_upload** cursor, int* type, int* part)
+{
+   while (*cursor != NULL && (*cursor)->state == S3_STATE_DONE)
+   {
+      *cursor = (*cursor)->next;
+   }
+
+   for (struct s3_upload* u = *cursor; u != NULL; u = u->next)
+   {
+      if (u->state == S3_STATE_PENDING)
+      {
+         *type = u->number_of_parts > 0 ? S3_REQUEST_CREATE : S3_REQUEST_PUT;
+         *part = 0;
+         return u;
+      }
+      else if (u->state == S3_STATE_PARTS)
+      {
+         if (u->next_part <= u->number_of_parts)
+         {
+            *type = S3_REQUEST_PART;
+            *part = u->next_part;
+            return u;
+         }
+         else if (u->completed_parts == u->number_of_parts)
+         {
+            *type = S3_REQUEST_COMPLETE;
+            *part = 0;
+            return u;
+         }
+      }
+   }
+
+   return NULL;
+}
+
 static int
-s3_send_upload_request(char* local_root, char* s3_root, char* relative_path)
+s3_start_request(struct s3_request* request, struct s3_upload* upload, int type, int part)
 {
-   char short_date[SHORT_TIME_LENGHT];
-   char long_date[LONG_TIME_LENGHT];
-   char* canonical_request = NULL;
-   char* auth_value = NULL;
-   char* string_to_sign = NULL;
    char* s3_host = NULL;
-   char* s3_url = NULL;
-   char* file_sha256 = NULL;
-   char* canonical_request_sha256 = NULL;
-   char* key = NULL;
-   char* local_path = NULL;
-   char* s3_path = NULL;
-   unsigned char* date_key_hmac = NULL;
-   unsigned char* date_region_key_hmac = NULL;
-   unsigned char* date_region_service_key_hmac = NULL;
-   unsigned char* signing_key_hmac = NULL;
-   unsigned char* signature_hmac = NULL;
-   unsigned char* signature_hex = NULL;
-   int hmac_length = 0;
-   FILE* file = NULL;
-   struct stat file_info;
-   CURLcode res = -1;
-   struct curl_slist* chunk = NULL;
+   char* payload = NULL;
+   char* query = NULL;
+   char* id = NULL;
+   char number[MISC_LENGTH];
+   char* method = NULL;
+   off_t offset = 0;
+   size_t length = 0;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   local_path = pgmoneta_append(local_path, local_root);
-   local_path = pgmoneta_append(local_path, relative_path);
-
-   s3_path = pgmoneta_append(s3_path, s3_root);
-   s3_path = pgmoneta_append(s3_path, relative_path);
-
-   memset(&short_date[0], 0, sizeof(short_date));
-   memset(&long_date[0], 0, sizeof(long_date));
-
-   if (pgmoneta_get_timestamp_ISO8601_format(short_date, long_date))
+   if (request == NULL)
    {
       goto error;
    }
 
-   pgmoneta_create_sha256_file(local_path, &file_sha256);
-
-   s3_host = s3_get_host();
-
-   // Construct canonical request.
-   canonical_request = pgmoneta_append(canonical_request, "PUT\n/");
-   canonical_request = pgmoneta_append(canonical_request, s3_path);
-   canonical_request = pgmoneta_append(canonical_request, "\n\nhost:");
-   canonical_request = pgmoneta_append(canonical_request, s3_host);
-   canonical_request = pgmoneta_append(canonical_request, "\nx-amz-content-sha256:");
-   canonical_request = pgmoneta_append(canonical_request, file_sha256);
-   canonical_request = pgmoneta_append(canonical_request, "\nx-amz-date:");
-   canonical_request = pgmoneta_append(canonical_request, long_date);
-   canonical_request = pgmoneta_append(canonical_request, "\nx-amz-storage-class:REDUCED_REDUNDANCY\n\nhost;x-amz-content-sha256;x-amz-date;x-amz-storage-class\n");
-   canonical_request = pgmoneta_append(canonical_request, file_sha256);
-
-   pgmoneta_generate_string_sha256_hash(canonical_request, &canonical_request_sha256);
-
-   // Construct string to sign.
-   string_to_sign = pgmoneta_append(string_to_sign, "AWS4-HMAC-SHA256\n");
-   string_to_sign = pgmoneta_append(string_to_sign, long_date);
-   string_to_sign = pgmoneta_append(string_to_sign, "\n");
-   string_to_sign = pgmoneta_append(string_to_sign, short_date);
-   string_to_sign = pgmoneta_append(string_to_sign, "/");
-   string_to_sign = pgmoneta_append(string_to_sign, config->s3_aws_region);
-   string_to_sign = pgmoneta_append(string_to_sign, "/s3/aws4_request\n");
-   string_to_sign = pgmoneta_append(string_to_sign, canonical_request_sha256);
+   request->busy = true;
+   request->type = type;
+   request->upload = upload;
+   request->part = part;
+   request->traced = pgmoneta_trace_now();
 
-   key = pgmoneta_append(key, "AWS4");
-   key = pgmoneta_append(key, config->s3_secret_access_key);
+   pgmoneta_http_handle_reset(request->handle);
 
-   if (pgmoneta_generate_string_hmac_sha256_hash(key, strlen(key), short_date, SHORT_TIME_LENGHT - 1, &date_key_hmac, &hmac_length))
+   if (upload->upload_id != NULL)
    {
-      goto error;
+      id = curl_easy_escape(request->handle, upload->upload_id, 0);
+      if (id == NULL)
+      {
+         goto error;
+      }
    }
 
-   if (pgmoneta_generate_string_hmac_sha256_hash((char*)date_key_hmac, hmac_length, config->s3_aws_region, strlen(config->s3_aws_region), &date_region_key_hmac, &hmac_length))
+   switch (type)
    {
-      goto error;
+      case S3_REQUEST_PUT:
+         method = "PUT";
+         length = upload->size;
+         break;
+      case S3_REQUEST_CREATE:
+         method = "POST";
+         query = pgmoneta_append(query, "uploads=");
+         request->body = pgmoneta_append(request->body, "");
+         break;
+      case S3_REQUEST_PART:
+         method = "PUT";
+         offset = (off_t)((part - 1) * upload->part_size);
+         length = part < upload->number_of_parts ? upload->part_size : upload->size - (size_t)offset;
+         memset(number, 0, sizeof(number));
+         snprintf(number, sizeof(number), "%d", part);
+         query = pgmoneta_append(query, "partNumber=");
+         query = pgmoneta_append(query, number);
+         query = pgmoneta_append(query, "&uploadId=");
+         query = pgmoneta_append(query, id);
+         break;
+      case S3_REQUEST_COMPLETE:
+         method = "POST";
+         query = pgmoneta_append(query, "uploadId=");
+         query = pgmoneta_append(query, id);
+         request->body = s3_complete_body(upload);
+         if (request->body == NULL)
+         {
+            goto error;
+         }
+         break;
+      default:
+         goto error;
    }
 
-   if (pgmoneta_generate_string_hmac_sha256_hash((char*)date_region_key_hmac, hmac_length, "s3", strlen("s3"), &date_region_service_key_hmac, &hmac_length))
+   if (request->body != NULL)
    {
-      goto error;
+      pgmoneta_generate_string_sha256_hash(request->body, &payload);
+   }
+   else if (config->s3_unsigned_payload)
+   {
+      payload = pgmoneta_append(payload, S3_UNSIGNED_PAYLOAD);
+   }
+   else if (type == S3_REQUEST_CREATE || length == 0)
+   {
+      payload = pgmoneta_append(payload, S3_EMPTY_PAYLOAD);
+   }
+   else
+   {
+      if (type == S3_REQUEST_PUT)
+      {
+         payload = pgmoneta_sha256_index_lookup(s3_checksums, upload->relative_path, upload->local_path);
+      }
+
+      if (payload == NULL)
+      {
+         // no checksum from the receive, so the data is signed chunk by chunk while it is sent
+         payload = pgmoneta_append(payload, S3_STREAMING_PAYLOAD);
+         request->chunked = true;
+      }
    }
 
-   if (pgmoneta_generate_string_hmac_sha256_hash((char*)date_region_service_key_hmac, hmac_length, "aws4_request", strlen("aws4_request"), &signing_key_hmac, &hmac_length))
+   if (payload == NULL)
    {
       goto error;
    }
 
-   if (pgmoneta_generate_string_hmac_sha256_hash((char*)signing_key_hmac, hmac_length, string_to_sign, strlen(string_to_sign), &signature_hmac, &hmac_length))
+   if (s3_sign(method, upload->s3_path, query, payload, type == S3_REQUEST_PUT || type == S3_REQUEST_CREATE,
+               request->chunked ? length : 0, request->date, request->signature, &request->headers))
    {
       goto error;
    }
 
-   pgmoneta_convert_base32_to_hex(signature_hmac, hmac_length, &signature_hex);
-
-   auth_value = pgmoneta_append(auth_value, "AWS4-HMAC-SHA256 Credential=");
-   auth_value = pgmoneta_append(auth_value, config->s3_access_key_id);
-   auth_value = pgmoneta_append(auth_value, "/");
-   auth_value = pgmoneta_append(auth_value, short_date);
-   auth_value = pgmoneta_append(auth_value, "/");
-   auth_value = pgmoneta_append(auth_value, config->s3_aws_region);
-   auth_value = pgmoneta_append(auth_value, "/s3/aws4_request,SignedHeaders=host;x-amz-content-sha256;x-amz-date;x-amz-storage-class,Signature=");
-   auth_value = pgmoneta_append(auth_value, (char*)signature_hex);
-
-   chunk = pgmoneta_http_add_header(chunk, "Authorization", auth_value);
-
-   chunk = pgmoneta_http_add_header(chunk, "Host", s3_host);
+   if (request->chunked)
+   {
+      char short_date[SHORT_TIME_LENGHT];
 
-   chunk = pgmoneta_http_add_header(chunk, "x-amz-content-sha256", file_sha256);
+      memset(&short_date[0], 0, sizeof(short_date));
+      memcpy(&short_date[0], &request->date[0], SHORT_TIME_LENGHT - 1);
 
-   chunk = pgmoneta_http_add_header(chunk, "x-amz-date", long_date);
+      if (s3_signing_key(short_date, &request->key, &request->key_length))
+      {
+         goto error;
+      }
+   }
 
-   chunk = pgmoneta_http_add_header(chunk, "x-amz-storage-class", "REDUCED_REDUNDANCY");
+   if (type == S3_REQUEST_CREATE && !config->s3_unsigned_payload)
+   {
+      // the parts are sent as signed chunks, which carry their CRC32C
+      request->headers = pgmoneta_http_add_header(request->headers, "x-amz-checksum-algorithm", "CRC32C");
+   }
 
-   if (pgmoneta_http_set_header_option(curl, chunk))
+   if (pgmoneta_http_set_header_option(request->handle, request->headers))
    {
       goto error;
    }
 
-   s3_url = pgmoneta_append(s3_url, "https://");
-   s3_url = pgmoneta_append(s3_url, s3_host);
-   s3_url = pgmoneta_append(s3_url, "/");
-   s3_url = pgmoneta_append(s3_url, s3_path);
+   s3_host = s3_get_host();
 
-   file = fopen(local_path, "rb");
-   if (file == NULL)
+   request->url = pgmoneta_append(request->url, "https://");
+   request->url = pgmoneta_append(request->url, s3_host);
+   request->url = pgmoneta_append(request->url, "/");
+   request->url = pgmoneta_append(request->url, upload->s3_path);
+   if (query != NULL)
    {
-      goto error;
+      request->url = pgmoneta_append(request->url, "?");
+      request->url = pgmoneta_append(request->url, query);
    }
 
-   if (fstat(fileno(file), &file_info) != 0)
+   pgmoneta_http_set_url_option(request->handle, request->url);
+
+   if (request->body != NULL)
    {
-      goto error;
+      curl_easy_setopt(request->handle, CURLOPT_POST, 1L);
+      curl_easy_setopt(request->handle, CURLOPT_POSTFIELDS, request->body);
+      curl_easy_setopt(request->handle, CURLOPT_POSTFIELDSIZE, (long)strlen(request->body));
    }
+   else
+   {
+      request->file = fopen(upload->local_path, "rb");
+      if (request->file == NULL)
+      {
+         goto error;
+      }
 
-   pgmoneta_http_set_request_option(curl, HTTP_PUT);
+      if (offset > 0 && fseeko(request->file, offset, SEEK_SET))
+      {
+         goto error;
+      }
 
-   pgmoneta_http_set_url_option(curl, s3_url);
+      request->remaining = length;
 
-   curl_easy_setopt(curl, CURLOPT_READDATA, (void*) file);
+      pgmoneta_http_set_request_option(request->handle, HTTP_PUT);
 
-   curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)file_info.st_size);
+      curl_easy_setopt(request->handle, CURLOPT_READFUNCTION, s3_read);
+      curl_easy_setopt(request->handle, CURLOPT_READDATA, (void*)request);
+      curl_easy_setopt(request->handle, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(request->chunked ? s3_chunked_length(length) : length));
+   }
 
-   curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+   curl_easy_setopt(request->handle, CURLOPT_WRITEFUNCTION, s3_write);
+   curl_easy_setopt(request->handle, CURLOPT_WRITEDATA, (void*)request);
+   curl_easy_setopt(request->handle, CURLOPT_HEADERFUNCTION, s3_header);
+   curl_easy_setopt(request->handle, CURLOPT_HEADERDATA, (void*)request);
+   curl_easy_setopt(request->handle, CURLOPT_PRIVATE, (void*)request);
 
-   res = curl_easy_perform(curl);
-   if (res != CURLE_OK)
+   switch (type)
    {
-      fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-      goto error;
+      case S3_REQUEST_PUT:
+         upload->state = S3_STATE_SENDING;
+         break;
+      case S3_REQUEST_CREATE:
+         upload->state = S3_STATE_CREATING;
+         break;
+      case S3_REQUEST_PART:
+         upload->next_part++;
+         break;
+      case S3_REQUEST_COMPLETE:
+         upload->state = S3_STATE_COMPLETING;
+         break;
+      default:
+         break;
    }
 
-   free(s3_url);
+   if (id != NULL)
+   {
+      curl_free(id);
+   }
    free(s3_host);
-   free(file_sha256);
-   free(signature_hex);
-   free(signature_hmac);
-   free(signing_key_hmac);
-   free(date_region_service_key_hmac);
-   free(date_region_key_hmac);
-   free(date_key_hmac);
-   free(key);
-   free(local_path);
-   free(s3_path);
-   free(canonical_request_sha256);
-   free(canonical_request);
-   free(string_to_sign);
-   free(auth_value);
+   free(payload);
+   free(query);
 
-   curl_slist_free_all(chunk);
-
-   fclose(file);
    return 0;
 
 error:
 
-   if (s3_url != NULL)
-   {
-      free(s3_url);
-   }
+   pgmoneta_log_error("S3: Unable to send %s", upload->relative_path);
 
-   if (s3_host != NULL)
+   if (id != NULL)
    {
-      free(s3_host);
+      curl_free(id);
    }
+   free(s3_host);
+   free(payload);
+   free(query);
 
-   if (signature_hex != NULL)
-   {
-      free(signature_hex);
-   }
+   return 1;
+}
 
-   if (signature_hmac != NULL)
-   {
-      free(signature_hmac);
-   }
+static int
+s3_finish_request(struct s3_request* request, CURLcode result)
+{
+   long code = 0;
+   char detail[MAX_PATH];
+   char* names[] = {"S3 put", "S3 create", "S3 part", "S3 complete", "S3 abort"};
+   struct s3_upload* upload = request->upload;
 
-   if (signing_key_hmac != NULL)
+   if (request->traced > 0)
    {
-      free(signing_key_hmac);
+      if (request->type == S3_REQUEST_PART)
+      {
+         snprintf(&detail[0], sizeof(detail), "%.*s (part %d)", (int)sizeof(detail) - 32, upload->relative_path, request->part);
+      }
+      else
+      {
+         snprintf(&detail[0], sizeof(detail), "%s", upload->relative_path);
+      }
+      pgmoneta_trace_event(TRACE_STORAGE, names[request->type], &detail[0], request->traced);
    }
 
-   if (date_region_service_key_hmac != NULL)
+   if (result != CURLE_OK)
    {
-      free(date_region_service_key_hmac);
+      pgmoneta_log_error("S3: %s failed: %s", upload->relative_path, curl_easy_strerror(result));
+      goto error;
    }
 
-   if (date_region_key_hmac != NULL)
+   curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &code);
+   if (code != 200)
    {
-      free(date_region_key_hmac);
+      pgmoneta_log_error("S3: %s failed with HTTP %ld", upload->relative_path, code);
+      goto error;
    }
 
-   if (date_key_hmac != NULL)
+   switch (request->type)
    {
-      free(date_region_key_hmac);
+      case S3_REQUEST_PUT:
+         upload->state = S3_STATE_DONE;
+         break;
+      case S3_REQUEST_CREATE:
+         upload->upload_id = s3_xml_value(request->response, "UploadId");
+         upload->etags = (char**)calloc(upload->number_of_parts, sizeof(char*));
+         upload->checksums = (char**)calloc(upload->number_of_parts, sizeof(char*));
+         if (upload->upload_id == NULL || upload->etags == NULL || upload->checksums == NULL)
+         {
+            pgmoneta_log_error("S3: No multipart upload for %s", upload->relative_path);
+            goto error;
+         }
+         upload->next_part = 1;
+         upload->state = S3_STATE_PARTS;
+         break;
+      case S3_REQUEST_PART:
+         if (strlen(request->etag) == 0)
+         {
+            pgmoneta_log_error("S3: No ETag for part %d of %s", request->part, upload->relative_path);
+            goto error;
+         }
+         upload->etags[request->part - 1] = pgmoneta_append(NULL, request->etag);
+         if (strlen(request->checksum) > 0)
+         {
+            upload->checksums[request->part - 1] = pgmoneta_append(NULL, request->checksum);
+         }
+         upload->completed_parts++;
+         break;
+      case S3_REQUEST_COMPLETE:
+         // a completion can fail after the 200 status has been sent
+         if (request->response != NULL && strstr(request->response, "<Error>") != NULL)
+         {
+            pgmoneta_log_error("S3: Unable to complete %s", upload->relative_path);
+            goto error;
+         }
+         upload->state = S3_STATE_DONE;
+         break;
+      default:
+         break;
    }
 
-   if (key != NULL)
-   {
-      free(key);
-   }
+   return 0;
 
-   if (local_path != NULL)
-   {
-      free(local_path);
-   }
+error:
 
-   if (s3_path != NULL)
-   {
-      free(s3_path);
-   }
+   return 1;
+}
 
-   if (canonical_request_sha256 != NULL)
+static void
+s3_reset_request(struct s3_request* request)
+{
+   if (request == NULL)
    {
-      free(canonical_request_sha256);
+      return;
    }
 
-   if (file_sha256 != NULL)
+   if (request->file != NULL)
    {
-      free(file_sha256);
+      fclose(request->file);
    }
 
-   if (canonical_request != NULL)
+   if (request->headers != NULL)
    {
-      free(canonical_request);
+      curl_slist_free_all(request->headers);
    }
 
-   if (string_to_sign != NULL)
+   free(request->url);
+   free(request->body);
+   free(request->response);
+   free(request->key);
+   free(request->chunk);
+
+   request->busy = false;
+   request->type = 0;
+   request->upload = NULL;
+   request->part = 0;
+   request->file = NULL;
+   request->remaining = 0;
+   request->url = NULL;
+   request->body = NULL;
+   request->headers = NULL;
+   request->response = NULL;
+   request->response_size = 0;
+   memset(request->etag, 0, sizeof(request->etag));
+   request->chunked = false;
+   memset(request->date, 0, sizeof(request->date));
+   memset(request->signature, 0, sizeof(request->signature));
+   request->key = NULL;
+   request->key_length = 0;
+   request->chunk = NULL;
+   request->chunk_length = 0;
+   request->chunk_offset = 0;
+   request->last = false;
+   request->crc = 0;
+   memset(request->checksum, 0, sizeof(request->checksum));
+}
+
+static void
+s3_abort_uploads(struct s3_upload* uploads)
+{
+   char* s3_host = NULL;
+   char* query = NULL;
+   char* id = NULL;
+   char* payload = NULL;
+   struct s3_request* request = NULL;
+
+   if (requests == NULL)
+   {
+      return;
+   }
+
+   // the slots are idle once the multi loop is done
+   request = &requests[0];
+
+   for (struct s3_upload* u = uploads; u != NULL; u = u->next)
+   {
+      if (u->upload_id == NULL || u->state == S3_STATE_DONE)
+      {
+         continue;
+      }
+
+      s3_reset_request(request);
+      pgmoneta_http_handle_reset(request->handle);
+
+      id = curl_easy_escape(request->handle, u->upload_id, 0);
+      query = pgmoneta_append(query, "uploadId=");
+      query = pgmoneta_append(query, id);
+
+      pgmoneta_generate_string_sha256_hash("", &payload);
+
+      if (payload != NULL && !s3_sign("DELETE", u->s3_path, query, payload, false, 0, NULL, NULL, &request->headers))
+      {
+         s3_host = s3_get_host();
+
+         request->url = pgmoneta_append(request->url, "https://");
+         request->url = pgmoneta_append(request->url, s3_host);
+         request->url = pgmoneta_append(request->url, "/");
+         request->url = pgmoneta_append(request->url, u->s3_path);
+         request->url = pgmoneta_append(request->url, "?");
+         request->url = pgmoneta_append(request->url, query);
+
+         pgmoneta_http_set_header_option(request->handle, request->headers);
+         pgmoneta_http_set_url_option(request->handle, request->url);
+         curl_easy_setopt(request->handle, CURLOPT_CUSTOMREQUEST, "DELETE");
+         curl_easy_setopt(request->handle, CURLOPT_WRITEFUNCTION, s3_write);
+         curl_easy_setopt(request->handle, CURLOPT_WRITEDATA, (void*)request);
+
+         if (curl_easy_perform(request->handle) != CURLE_OK)
+         {
+            pgmoneta_log_warn("S3: Unable to abort the upload of %s", u->relative_path);
+         }
+      }
+
+      if (id != NULL)
+      {
+         curl_free(id);
+      }
+      free(s3_host);
+      free(query);
+      free(payload);
+
+      id = NULL;
+      s3_host = NULL;
+      query = NULL;
+      payload = NULL;
+   }
+
+   s3_reset_request(request);
+}
+
+static void
+s3_destroy_uploads(struct s3_upload* uploads)
+{
+   struct s3_upload* next = NULL;
+
+   while (uploads != NULL)
+   {
+      next = uploads->next;
+
+      for (int i = 0; uploads->etags != NULL && i < uploads->number_of_parts; i++)
+      {
+         free(uploads->etags[i]);
+      }
+      free(uploads->etags);
+      for (int i = 0; uploads->checksums != NULL && i < uploads->number_of_parts; i++)
+      {
+         free(uploads->checksums[i]);
+      }
+      free(uploads->checksums);
+      free(uploads->upload_id);
+      free(uploads);
+
+      uploads = next;
+   }
+}
+
+static int
+s3_backend_put(struct storage_backend* backend, char* local_path, char* remote_path)
+{
+   CURLcode res;
+   char* s3_path = NULL;
+   CURL* handle = NULL;
+   struct s3_upload upload;
+   struct s3_request request;
+
+   memset(&upload, 0, sizeof(struct s3_upload));
+   memset(&request, 0, sizeof(struct s3_request));
+
+   handle = s3_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   s3_path = s3_get_path(remote_path);
+
+   snprintf(&upload.relative_path[0], sizeof(upload.relative_path), "%s", remote_path);
+   snprintf(&upload.local_path[0], sizeof(upload.local_path), "%s", local_path);
+   snprintf(&upload.s3_path[0], sizeof(upload.s3_path), "%s", s3_path);
+   upload.size = pgmoneta_get_file_size(local_path);
+
+   free(s3_path);
+
+   request.handle = handle;
+
+   if (s3_start_request(&request, &upload, S3_REQUEST_PUT, 0))
+   {
+      goto error;
+   }
+
+   res = curl_easy_perform(handle);
+
+   if (s3_finish_request(&request, res))
+   {
+      goto error;
+   }
+
+   s3_reset_request(&request);
+
+   return 0;
+
+error:
+
+   s3_reset_request(&request);
+
+   return 1;
+}
+
+static int
+s3_backend_get(struct storage_backend* backend, char* remote_path, char* local_path)
+{
+   FILE* file = NULL;
+
+   file = fopen(local_path, "wb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (s3_backend_stream(backend, remote_path, 0, 0, file))
+   {
+      goto error;
+   }
+
+   if (fclose(file) != 0)
+   {
+      file = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static int
+s3_backend_stream(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out)
+{
+   int ret;
+   char range[MISC_LENGTH];
+   char* s3_path = NULL;
+
+   s3_path = s3_get_path(remote_path);
+
+   memset(&range[0], 0, sizeof(range));
+   if (length > 0)
+   {
+      snprintf(range, sizeof(range), "bytes=%jd-%jd", (intmax_t)offset, (intmax_t)(offset + length - 1));
+   }
+
+   ret = s3_send_request("GET", s3_path, NULL, length > 0 ? range : NULL, out, length > 0 ? 206 : 200);
+
+   free(s3_path);
+
+   return ret;
+}
+
+static int
+s3_backend_list(struct storage_backend* backend, char* remote_path, struct deque** names)
+{
+   char* prefix = NULL;
+   char* escaped = NULL;
+   char* escaped_token = NULL;
+   char* query = NULL;
+   char* response = NULL;
+   size_t response_size = 0;
+   char* token = NULL;
+   char* key = NULL;
+   char* cursor = NULL;
+   char* truncated = NULL;
+   FILE* out = NULL;
+   CURL* handle = NULL;
+   struct deque* n = NULL;
+
+   handle = s3_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_create(false, &n))
+   {
+      goto error;
+   }
+
+   prefix = s3_get_path(remote_path);
+   if (!pgmoneta_ends_with(prefix, "/"))
+   {
+      prefix = pgmoneta_append(prefix, "/");
+   }
+
+   escaped = curl_easy_escape(handle, prefix, 0);
+   if (escaped == NULL)
+   {
+      goto error;
+   }
+
+   // the query parameters are in the sorted order of the canonical request
+   do
+   {
+      if (token != NULL)
+      {
+         escaped_token = curl_easy_escape(handle, token, 0);
+         if (escaped_token == NULL)
+         {
+            goto error;
+         }
+         query = pgmoneta_append(query, "continuation-token=");
+         query = pgmoneta_append(query, escaped_token);
+         query = pgmoneta_append(query, "&");
+         curl_free(escaped_token);
+         escaped_token = NULL;
+      }
+      query = pgmoneta_append(query, "delimiter=%2F&list-type=2&prefix=");
+      query = pgmoneta_append(query, escaped);
+
+      out = open_memstream(&response, &response_size);
+      if (out == NULL)
+      {
+         goto error;
+      }
+
+      if (s3_send_request("GET", "", query, NULL, out, 200))
+      {
+         goto error;
+      }
+
+      fclose(out);
+      out = NULL;
+
+      cursor = response;
+      while ((key = s3_xml_value(cursor, "Key")) != NULL)
+      {
+         if (strlen(key) > strlen(prefix))
+         {
+            pgmoneta_deque_add(n, NULL, (uintptr_t)(key + strlen(prefix)), ValueString);
+         }
+         cursor = strstr(cursor, "</Key>") + strlen("</Key>");
+         free(key);
+      }
+
+      free(token);
+      token = NULL;
+
+      truncated = s3_xml_value(response, "IsTruncated");
+      if (truncated != NULL && !strcmp(truncated, "true"))
+      {
+         token = s3_xml_value(response, "NextContinuationToken");
+      }
+
+      free(truncated);
+      free(response);
+      free(query);
+      truncated = NULL;
+      response = NULL;
+      query = NULL;
+   }
+   while (token != NULL);
+
+   *names = n;
+
+   curl_free(escaped);
+   free(prefix);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (escaped != NULL)
+   {
+      curl_free(escaped);
+   }
+
+   pgmoneta_deque_destroy(n);
+
+   free(token);
+   free(response);
+   free(query);
+   free(prefix);
+
+   return 1;
+}
+
+static int
+s3_backend_remove(struct storage_backend* backend, char* remote_path)
+{
+   int ret;
+   char* s3_path = NULL;
+
+   s3_path = s3_get_path(remote_path);
+
+   ret = s3_send_request("DELETE", s3_path, NULL, NULL, NULL, 204);
+
+   free(s3_path);
+
+   return ret;
+}
+
+static int
+s3_backend_remove_directory(struct storage_backend* backend, char* remote_path)
+{
+   char* prefix = NULL;
+   char* escaped = NULL;
+   char* escaped_token = NULL;
+   char* query = NULL;
+   char* response = NULL;
+   size_t response_size = 0;
+   char* token = NULL;
+   char* key = NULL;
+   char* cursor = NULL;
+   char* truncated = NULL;
+   char* body = NULL;
+   int keys = 0;
+   FILE* out = NULL;
+   CURL* handle = NULL;
+
+   handle = s3_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   prefix = s3_get_path(remote_path);
+   if (!pgmoneta_ends_with(prefix, "/"))
+   {
+      prefix = pgmoneta_append(prefix, "/");
+   }
+
+   escaped = curl_easy_escape(handle, prefix, 0);
+   if (escaped == NULL)
+   {
+      goto error;
+   }
+
+   // a page of the listing has at most 1000 keys, which is what a DeleteObjects request takes
+   do
+   {
+      if (token != NULL)
+      {
+         escaped_token = curl_easy_escape(handle, token, 0);
+         if (escaped_token == NULL)
+         {
+            goto error;
+         }
+         query = pgmoneta_append(query, "continuation-token=");
+         query = pgmoneta_append(query, escaped_token);
+         query = pgmoneta_append(query, "&");
+         curl_free(escaped_token);
+         escaped_token = NULL;
+      }
+      query = pgmoneta_append(query, "list-type=2&prefix=");
+      query = pgmoneta_append(query, escaped);
+
+      out = open_memstream(&response, &response_size);
+      if (out == NULL)
+      {
+         goto error;
+      }
+
+      if (s3_send_request("GET", "", query, NULL, out, 200))
+      {
+         goto error;
+      }
+
+      fclose(out);
+      out = NULL;
+
+      keys = 0;
+      body = pgmoneta_append(body, "<Delete><Quiet>true</Quiet>");
+
+      cursor = response;
+      while ((key = s3_xml_value(cursor, "Key")) != NULL)
+      {
+         body = pgmoneta_append(body, "<Object><Key>");
+         body = pgmoneta_append(body, key);
+         body = pgmoneta_append(body, "</Key></Object>");
+         keys++;
+
+         cursor = strstr(cursor, "</Key>") + strlen("</Key>");
+         free(key);
+      }
+
+      body = pgmoneta_append(body, "</Delete>");
+
+      if (keys > 0 && s3_delete_objects(body))
+      {
+         goto error;
+      }
+
+      free(token);
+      token = NULL;
+
+      truncated = s3_xml_value(response, "IsTruncated");
+      if (truncated != NULL && !strcmp(truncated, "true"))
+      {
+         token = s3_xml_value(response, "NextContinuationToken");
+      }
+
+      free(truncated);
+      free(response);
+      free(query);
+      free(body);
+      truncated = NULL;
+      response = NULL;
+      query = NULL;
+      body = NULL;
+   }
+   while (token != NULL);
+
+   curl_free(escaped);
+   free(prefix);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (escaped != NULL)
+   {
+      curl_free(escaped);
+   }
+
+   free(token);
+   free(response);
+   free(query);
+   free(body);
+   free(prefix);
+
+   return 1;
+}
+
+static int
+s3_delete_objects(char* body)
+{
+   char* s3_host = NULL;
+   char* url = NULL;
+   char* payload = NULL;
+   char* md5 = NULL;
+   size_t md5_length = 0;
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int digest_length = 0;
+   char* response = NULL;
+   size_t response_size = 0;
+   long code = 0;
+   FILE* out = NULL;
+   CURL* handle = NULL;
+   CURLcode res;
+   struct curl_slist* headers = NULL;
+
+   handle = s3_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   pgmoneta_http_handle_reset(handle);
+
+   pgmoneta_generate_string_sha256_hash(body, &payload);
+   if (payload == NULL)
+   {
+      goto error;
+   }
+
+   // DeleteObjects requires the MD5 of its body
+   if (!EVP_Digest(body, strlen(body), digest, &digest_length, EVP_md5(), NULL) ||
+       pgmoneta_base64_encode(digest, digest_length, &md5, &md5_length))
+   {
+      goto error;
+   }
+
+   if (s3_sign("POST", "", "delete=", payload, false, 0, NULL, NULL, &headers))
+   {
+      goto error;
+   }
+
+   headers = pgmoneta_http_add_header(headers, "Content-MD5", md5);
+   headers = pgmoneta_http_add_header(headers, "Content-Type", "application/xml");
+
+   if (pgmoneta_http_set_header_option(handle, headers))
+   {
+      goto error;
+   }
+
+   s3_host = s3_get_host();
+
+   url = pgmoneta_append(url, "https://");
+   url = pgmoneta_append(url, s3_host);
+   url = pgmoneta_append(url, "/?delete");
+
+   pgmoneta_http_set_url_option(handle, url);
+
+   out = open_memstream(&response, &response_size);
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   curl_easy_setopt(handle, CURLOPT_POST, 1L);
+   curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body);
+   curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)strlen(body));
+   curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)out);
+
+   res = pgmoneta_http_perform(handle, out, &code);
+
+   fclose(out);
+   out = NULL;
+
+   if (res != CURLE_OK)
+   {
+      pgmoneta_log_error("S3: DeleteObjects failed: %s", curl_easy_strerror(res));
+      goto error;
+   }
+
+   // in quiet mode only the keys that could not be deleted are reported
+   if (code != 200 || (response != NULL && strstr(response, "<Error>") != NULL))
+   {
+      pgmoneta_log_error("S3: DeleteObjects failed with HTTP %ld", code);
+      goto error;
+   }
+
+   curl_slist_free_all(headers);
+   free(s3_host);
+   free(url);
+   free(payload);
+   free(md5);
+   free(response);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (headers != NULL)
+   {
+      curl_slist_free_all(headers);
+   }
+   free(s3_host);
+   free(url);
+   free(payload);
+   free(md5);
+   free(response);
+
+   return 1;
+}
+
+static int
+s3_send_request(char* method, char* s3_path, char* query, char* range, FILE* out, long expected)
+{
+   char* s3_host = NULL;
+   char* url = NULL;
+   long code = 0;
+   CURL* handle = NULL;
+   CURLcode res;
+   struct curl_slist* headers = NULL;
+
+   handle = s3_handle();
+   if (handle == NULL)
+   {
+      goto error;
+   }
+
+   // the handle keeps its connection open for the next request of this thread
+   pgmoneta_http_handle_reset(handle);
+
+   if (s3_sign(method, s3_path, query, S3_EMPTY_PAYLOAD, false, 0, NULL, NULL, &headers))
+   {
+      goto error;
+   }
+
+   if (range != NULL)
+   {
+      headers = pgmoneta_http_add_header(headers, "Range", range);
+   }
+
+   if (pgmoneta_http_set_header_option(handle, headers))
+   {
+      goto error;
+   }
+
+   s3_host = s3_get_host();
+
+   url = pgmoneta_append(url, "https://");
+   url = pgmoneta_append(url, s3_host);
+   url = pgmoneta_append(url, "/");
+   url = pgmoneta_append(url, s3_path);
+   if (query != NULL)
+   {
+      url = pgmoneta_append(url, "?");
+      url = pgmoneta_append(url, query);
+   }
+
+   pgmoneta_http_set_url_option(handle, url);
+
+   if (!strcmp(method, "GET"))
+   {
+      pgmoneta_http_set_request_option(handle, HTTP_GET);
+   }
+   else
+   {
+      curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, method);
+   }
+
+   if (out != NULL)
+   {
+      curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)out);
+   }
+
+   res = pgmoneta_http_perform(handle, out, &code);
+   if (res != CURLE_OK)
+   {
+      pgmoneta_log_error("S3: %s %s failed: %s", method, s3_path, curl_easy_strerror(res));
+      goto error;
+   }
+
+   if (code != expected)
+   {
+      pgmoneta_log_error("S3: %s %s failed with HTTP %ld", method, s3_path, code);
+      goto error;
+   }
+
+   curl_slist_free_all(headers);
+   free(s3_host);
+   free(url);
+
+   return 0;
+
+error:
+
+   if (headers != NULL)
+   {
+      curl_slist_free_all(headers);
+   }
+   free(s3_host);
+   free(url);
+
+   return 1;
+}
+
+static CURL*
+s3_handle(void)
+{
+   CURL* handle = NULL;
+
+   handle = (CURL*)pgmoneta_worker_context(WORKER_CONTEXT_S3);
+
+   if (handle == NULL)
+   {
+      handle = pgmoneta_http_handle_create();
+      if (handle != NULL)
+      {
+         pgmoneta_worker_context_set(WORKER_CONTEXT_S3, handle, &s3_handle_destroy);
+      }
+   }
+
+   return handle;
+}
+
+static int
+s3_sign(char* method, char* s3_path, char* query, char* payload, bool storage_class, size_t decoded_length, char* date, char* signature, struct curl_slist** headers)
+{
+   char short_date[SHORT_TIME_LENGHT];
+   char long_date[LONG_TIME_LENGHT];
+   char length[MISC_LENGTH];
+   char* signed_headers = NULL;
+   struct string_builder sb;
+   char* s3_host = NULL;
+   char* canonical_request_sha256 = NULL;
+   unsigned char* signing_key_hmac = NULL;
+   unsigned char* signature_hmac = NULL;
+   unsigned char* signature_hex = NULL;
+   int hmac_length = 0;
+   struct curl_slist* chunk = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_string_builder_init(&sb);
+
+   memset(&short_date[0], 0, sizeof(short_date));
+   memset(&long_date[0], 0, sizeof(long_date));
+
+   if (pgmoneta_get_timestamp_ISO8601_format(short_date, long_date))
+   {
+      goto error;
+   }
+
+   s3_host = s3_get_host();
+
+   memset(&length[0], 0, sizeof(length));
+   snprintf(&length[0], sizeof(length), "%zu", decoded_length);
+
+   signed_headers = pgmoneta_append(signed_headers, "host;x-amz-content-sha256;x-amz-date");
+   if (decoded_length > 0)
+   {
+      signed_headers = pgmoneta_append(signed_headers, ";x-amz-decoded-content-length");
+   }
+   if (storage_class)
+   {
+      signed_headers = pgmoneta_append(signed_headers, ";x-amz-storage-class");
+   }
+   if (decoded_length > 0)
+   {
+      signed_headers = pgmoneta_append(signed_headers, ";x-amz-trailer");
+   }
+
+   // Construct canonical request.
+   pgmoneta_string_builder_append(&sb, method);
+   pgmoneta_string_builder_append(&sb, "\n/");
+   pgmoneta_string_builder_append(&sb, s3_path);
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append(&sb, query != NULL ? query : "");
+   pgmoneta_string_builder_append(&sb, "\nhost:");
+   pgmoneta_string_builder_append(&sb, s3_host);
+   pgmoneta_string_builder_append(&sb, "\nx-amz-content-sha256:");
+   pgmoneta_string_builder_append(&sb, payload);
+   pgmoneta_string_builder_append(&sb, "\nx-amz-date:");
+   pgmoneta_string_builder_append(&sb, long_date);
+   pgmoneta_string_builder_append(&sb, "\n");
+   if (decoded_length > 0)
+   {
+      pgmoneta_string_builder_append(&sb, "x-amz-decoded-content-length:");
+      pgmoneta_string_builder_append(&sb, &length[0]);
+      pgmoneta_string_builder_append(&sb, "\n");
+   }
+   if (storage_class)
+   {
+      pgmoneta_string_builder_append(&sb, "x-amz-storage-class:REDUCED_REDUNDANCY\n");
+   }
+   if (decoded_length > 0)
+   {
+      pgmoneta_string_builder_append(&sb, "x-amz-trailer:x-amz-checksum-crc32c\n");
+   }
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append(&sb, signed_headers);
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append(&sb, payload);
+
+   pgmoneta_generate_string_sha256_hash(sb.data, &canonical_request_sha256);
+
+   pgmoneta_string_builder_reset(&sb);
+
+   // Construct string to sign.
+   pgmoneta_string_builder_append(&sb, "AWS4-HMAC-SHA256\n");
+   pgmoneta_string_builder_append(&sb, long_date);
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append(&sb, short_date);
+   pgmoneta_string_builder_append(&sb, "/");
+   pgmoneta_string_builder_append(&sb, config->s3_aws_region);
+   pgmoneta_string_builder_append(&sb, "/s3/aws4_request\n");
+   pgmoneta_string_builder_append(&sb, canonical_request_sha256);
+
+   if (s3_signing_key(short_date, &signing_key_hmac, &hmac_length))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_generate_string_hmac_sha256_hash((char*)signing_key_hmac, hmac_length, sb.data, sb.length, &signature_hmac, &hmac_length))
+   {
+      goto error;
+   }
+
+   pgmoneta_convert_base32_to_hex(signature_hmac, hmac_length, &signature_hex);
+
+   pgmoneta_string_builder_reset(&sb);
+
+   pgmoneta_string_builder_append(&sb, "AWS4-HMAC-SHA256 Credential=");
+   pgmoneta_string_builder_append(&sb, config->s3_access_key_id);
+   pgmoneta_string_builder_append(&sb, "/");
+   pgmoneta_string_builder_append(&sb, short_date);
+   pgmoneta_string_builder_append(&sb, "/");
+   pgmoneta_string_builder_append(&sb, config->s3_aws_region);
+   pgmoneta_string_builder_append(&sb, "/s3/aws4_request,SignedHeaders=");
+   pgmoneta_string_builder_append(&sb, signed_headers);
+   pgmoneta_string_builder_append(&sb, ",Signature=");
+   pgmoneta_string_builder_append(&sb, (char*)signature_hex);
+
+   chunk = pgmoneta_http_add_header(chunk, "Authorization", sb.data);
+
+   chunk = pgmoneta_http_add_header(chunk, "Host", s3_host);
+
+   chunk = pgmoneta_http_add_header(chunk, "x-amz-content-sha256", payload);
+
+   chunk = pgmoneta_http_add_header(chunk, "x-amz-date", long_date);
+
+   if (decoded_length > 0)
+   {
+      chunk = pgmoneta_http_add_header(chunk, "Content-Encoding", "aws-chunked");
+      chunk = pgmoneta_http_add_header(chunk, "x-amz-decoded-content-length", &length[0]);
+   }
+
+   if (storage_class)
+   {
+      chunk = pgmoneta_http_add_header(chunk, "x-amz-storage-class", "REDUCED_REDUNDANCY");
+   }
+
+   if (decoded_length > 0)
+   {
+      chunk = pgmoneta_http_add_header(chunk, "x-amz-trailer", "x-amz-checksum-crc32c");
+   }
+
+   if (date != NULL)
+   {
+      memcpy(date, &long_date[0], sizeof(long_date));
+   }
+
+   if (signature != NULL)
+   {
+      snprintf(signature, 65, "%s", (char*)signature_hex);
+   }
+
+   *headers = chunk;
+
+   free(s3_host);
+   free(signed_headers);
+   free(signature_hex);
+   free(signature_hmac);
+   free(signing_key_hmac);
+   free(canonical_request_sha256);
+   pgmoneta_string_builder_destroy(&sb);
+
+   return 0;
+
+error:
+
+   free(s3_host);
+   free(signed_headers);
+   free(signature_hex);
+   free(signature_hmac);
+   free(signing_key_hmac);
+   free(canonical_request_sha256);
+   pgmoneta_string_builder_destroy(&sb);
+
+   return 1;
+}
+
+static int
+s3_signing_key(char* short_date, unsigned char** key, int* length)
+{
+   char* scope = NULL;
+   char* secret = NULL;
+   unsigned char* date_key_hmac = NULL;
+   unsigned char* date_region_key_hmac = NULL;
+   unsigned char* date_region_service_key_hmac = NULL;
+   unsigned char* signing_key_hmac = NULL;
+   unsigned char* copy = NULL;
+   int hmac_length = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *key = NULL;
+   *length = 0;
+
+   scope = pgmoneta_append(scope, config->s3_aws_region);
+   scope = pgmoneta_append(scope, "/");
+   scope = pgmoneta_append(scope, config->s3_secret_access_key);
+
+   pthread_mutex_lock(&signing_lock);
+
+   if (signing_key == NULL || strcmp(signing_date, short_date) || signing_scope == NULL || strcmp(signing_scope, scope))
    {
-      free(string_to_sign);
+      secret = pgmoneta_append(secret, "AWS4");
+      secret = pgmoneta_append(secret, config->s3_secret_access_key);
+
+      if (pgmoneta_generate_string_hmac_sha256_hash(secret, strlen(secret), short_date, SHORT_TIME_LENGHT - 1, &date_key_hmac, &hmac_length))
+      {
+         goto error;
+      }
+
+      if (pgmoneta_generate_string_hmac_sha256_hash((char*)date_key_hmac, hmac_length, config->s3_aws_region, strlen(config->s3_aws_region), &date_region_key_hmac, &hmac_length))
+      {
+         goto error;
+      }
+
+      if (pgmoneta_generate_string_hmac_sha256_hash((char*)date_region_key_hmac, hmac_length, "s3", strlen("s3"), &date_region_service_key_hmac, &hmac_length))
+      {
+         goto error;
+      }
+
+      if (pgmoneta_generate_string_hmac_sha256_hash((char*)date_region_service_key_hmac, hmac_length, "aws4_request", strlen("aws4_request"), &signing_key_hmac, &hmac_length))
+      {
+         goto error;
+      }
+
+      free(signing_key);
+      free(signing_scope);
+
+      signing_key = signing_key_hmac;
+      signing_key_length = hmac_length;
+      signing_scope = scope;
+      memcpy(&signing_date[0], short_date, sizeof(signing_date));
+
+      signing_key_hmac = NULL;
+      scope = NULL;
    }
 
-   if (auth_value != NULL)
+   copy = (unsigned char*)malloc(signing_key_length);
+   if (copy == NULL)
    {
-      free(auth_value);
+      goto error;
    }
 
-   if (chunk != NULL)
+   memcpy(copy, signing_key, signing_key_length);
+
+   *key = copy;
+   *length = signing_key_length;
+
+   pthread_mutex_unlock(&signing_lock);
+
+   free(date_region_service_key_hmac);
+   free(date_region_key_hmac);
+   free(date_key_hmac);
+   free(secret);
+   free(scope);
+
+   return 0;
+
+error:
+
+   pthread_mutex_unlock(&signing_lock);
+
+   free(signing_key_hmac);
+   free(date_region_service_key_hmac);
+   free(date_region_key_hmac);
+   free(date_key_hmac);
+   free(secret);
+   free(scope);
+
+   return 1;
+}
+
+static char*
+s3_complete_body(struct s3_upload* upload)
+{
+   char number[MISC_LENGTH];
+   char* body = NULL;
+
+   body = pgmoneta_append(body, "<CompleteMultipartUpload>");
+   for (int i = 0; i < upload->number_of_parts; i++)
    {
-      curl_slist_free_all(chunk);
+      if (upload->etags[i] == NULL)
+      {
+         free(body);
+         return NULL;
+      }
+
+      memset(number, 0, sizeof(number));
+      snprintf(number, sizeof(number), "%d", i + 1);
+
+      body = pgmoneta_append(body, "<Part><PartNumber>");
+      body = pgmoneta_append(body, number);
+      body = pgmoneta_append(body, "</PartNumber><ETag>");
+      body = pgmoneta_append(body, upload->etags[i]);
+      body = pgmoneta_append(body, "</ETag>");
+      if (upload->checksums != NULL && upload->checksums[i] != NULL)
+      {
+         body = pgmoneta_append(body, "<ChecksumCRC32C>");
+         body = pgmoneta_append(body, upload->checksums[i]);
+         body = pgmoneta_append(body, "</ChecksumCRC32C>");
+      }
+      body = pgmoneta_append(body, "</Part>");
    }
+   body = pgmoneta_append(body, "</CompleteMultipartUpload>");
 
-   if (file != NULL)
+   return body;
+}
+
+static char*
+s3_xml_value(char* xml, char* tag)
+{
+   char open[MISC_LENGTH];
+   char close[MISC_LENGTH];
+   char* start = NULL;
+   char* end = NULL;
+   char* value = NULL;
+
+   if (xml == NULL)
    {
-      fclose(file);
+      return NULL;
+   }
+
+   snprintf(open, sizeof(open), "<%s>", tag);
+   snprintf(close, sizeof(close), "</%s>", tag);
+
+   start = strstr(xml, open);
+   if (start == NULL)
+   {
+      return NULL;
+   }
+   start += strlen(open);
+
+   end = strstr(start, close);
+   if (end == NULL || end == start)
+   {
+      return NULL;
+   }
+
+   value = (char*)calloc(1, end - start + 1);
+   if (value == NULL)
+   {
+      return NULL;
+   }
+
+   memcpy(value, start, end - start);
+
+   return value;
+}
+
+static size_t
+s3_read(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+   size_t n = 0;
+   struct s3_request* request = (struct s3_request*)userdata;
+
+   if (request->chunked)
+   {
+      if (request->chunk_offset == request->chunk_length)
+      {
+         if (request->last)
+         {
+            return 0;
+         }
+
+         if (s3_next_chunk(request))
+         {
+            return CURL_READFUNC_ABORT;
+         }
+      }
+
+      n = size * nitems;
+      if (n > request->chunk_length - request->chunk_offset)
+      {
+         n = request->chunk_length - request->chunk_offset;
+      }
+
+      memcpy(buffer, request->chunk + request->chunk_offset, n);
+      request->chunk_offset += n;
+
+      return n;
+   }
+
+   n = size * nitems;
+   if (n > request->remaining)
+   {
+      n = request->remaining;
+   }
+
+   if (n == 0)
+   {
+      return 0;
+   }
+
+   n = fread(buffer, 1, n, request->file);
+   if (n == 0)
+   {
+      return CURL_READFUNC_ABORT;
+   }
+
+   request->remaining -= n;
+
+   return n;
+}
+
+static int
+s3_next_chunk(struct s3_request* request)
+{
+   size_t length = 0;
+   size_t header_length = 0;
+   unsigned char* data = NULL;
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int digest_length = 0;
+   unsigned char* digest_hex = NULL;
+   unsigned char crc[4];
+   char* crc_base64 = NULL;
+   size_t crc_length = 0;
+   char header[MISC_LENGTH];
+   char* trailer = NULL;
+   char* chunk_signature = NULL;
+
+   length = request->remaining;
+   if (length > S3_CHUNK_SIZE)
+   {
+      length = S3_CHUNK_SIZE;
+   }
+
+   data = (unsigned char*)malloc(length + 1);
+   if (data == NULL)
+   {
+      goto error;
+   }
+
+   if (length > 0 && fread(data, 1, length, request->file) != length)
+   {
+      goto error;
+   }
+
+   request->remaining -= length;
+   request->last = length == 0;
+
+   if (length > 0)
+   {
+      pgmoneta_create_crc32c_buffer(data, length, &request->crc);
    }
 
+   if (!EVP_Digest(data, length, &digest[0], &digest_length, EVP_sha256(), NULL))
+   {
+      goto error;
+   }
+
+   pgmoneta_convert_base32_to_hex(&digest[0], digest_length, &digest_hex);
+   if (digest_hex == NULL)
+   {
+      goto error;
+   }
+
+   chunk_signature = pgmoneta_append(chunk_signature, S3_EMPTY_PAYLOAD);
+   chunk_signature = pgmoneta_append(chunk_signature, "\n");
+   chunk_signature = pgmoneta_append(chunk_signature, (char*)digest_hex);
+
+   if (s3_chunk_sign(request, "AWS4-HMAC-SHA256-PAYLOAD", chunk_signature))
+   {
+      goto error;
+   }
+
+   memset(&header[0], 0, sizeof(header));
+   header_length = snprintf(&header[0], sizeof(header), "%zx;chunk-signature=%s\r\n", length, request->signature);
+
+   if (request->last)
+   {
+      // the CRC32C of the data follows the final chunk as a signed trailer
+      crc[0] = (unsigned char)(request->crc >> 24);
+      crc[1] = (unsigned char)(request->crc >> 16);
+      crc[2] = (unsigned char)(request->crc >> 8);
+      crc[3] = (unsigned char)request->crc;
+
+      if (pgmoneta_base64_encode(&crc[0], sizeof(crc), &crc_base64, &crc_length))
+      {
+         goto error;
+      }
+
+      memset(request->checksum, 0, sizeof(request->checksum));
+      snprintf(request->checksum, sizeof(request->checksum), "%s", crc_base64);
+
+      trailer = pgmoneta_append(trailer, "x-amz-checksum-crc32c:");
+      trailer = pgmoneta_append(trailer, request->checksum);
+      trailer = pgmoneta_append(trailer, "\n");
+
+      free(digest_hex);
+      digest_hex = NULL;
+
+      pgmoneta_generate_string_sha256_hash(trailer, (char**)&digest_hex);
+      if (digest_hex == NULL || s3_chunk_sign(request, "AWS4-HMAC-SHA256-TRAILER", (char*)digest_hex))
+      {
+         goto error;
+      }
+
+      free(trailer);
+      trailer = NULL;
+
+      trailer = pgmoneta_append(trailer, &header[0]);
+      trailer = pgmoneta_append(trailer, "x-amz-checksum-crc32c:");
+      trailer = pgmoneta_append(trailer, request->checksum);
+      trailer = pgmoneta_append(trailer, "\r\nx-amz-trailer-signature:");
+      trailer = pgmoneta_append(trailer, request->signature);
+      trailer = pgmoneta_append(trailer, "\r\n\r\n");
+
+      free(request->chunk);
+      request->chunk = trailer;
+      request->chunk_length = strlen(trailer);
+      trailer = NULL;
+   }
+   else
+   {
+      free(request->chunk);
+      request->chunk = (char*)malloc(header_length + length + 2);
+      if (request->chunk == NULL)
+      {
+         goto error;
+      }
+
+      memcpy(request->chunk, &header[0], header_length);
+      memcpy(request->chunk + header_length, data, length);
+      memcpy(request->chunk + header_length + length, "\r\n", 2);
+
+      request->chunk_length = header_length + length + 2;
+   }
+
+   request->chunk_offset = 0;
+
+   free(data);
+   free(digest_hex);
+   free(crc_base64);
+   free(trailer);
+   free(chunk_signature);
+
+   return 0;
+
+error:
+
+   request->chunk_length = 0;
+   request->chunk_offset = 0;
+
+   free(data);
+   free(digest_hex);
+   free(crc_base64);
+   free(trailer);
+   free(chunk_signature);
+
+   return 1;
+}
+
+static int
+s3_chunk_sign(struct s3_request* request, char* algorithm, char* hashes)
+{
+   unsigned char* signature_hmac = NULL;
+   unsigned char* signature_hex = NULL;
+   int hmac_length = 0;
+   struct string_builder sb;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_string_builder_init(&sb);
+
+   // Each chunk is signed with the signature of the previous one, starting at the request signature
+   pgmoneta_string_builder_append(&sb, algorithm);
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append(&sb, request->date);
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append_length(&sb, request->date, SHORT_TIME_LENGHT - 1);
+   pgmoneta_string_builder_append(&sb, "/");
+   pgmoneta_string_builder_append(&sb, config->s3_aws_region);
+   pgmoneta_string_builder_append(&sb, "/s3/aws4_request\n");
+   pgmoneta_string_builder_append(&sb, request->signature);
+   pgmoneta_string_builder_append(&sb, "\n");
+   pgmoneta_string_builder_append(&sb, hashes);
+
+   if (pgmoneta_generate_string_hmac_sha256_hash((char*)request->key, request->key_length, sb.data, sb.length, &signature_hmac, &hmac_length))
+   {
+      goto error;
+   }
+
+   pgmoneta_convert_base32_to_hex(signature_hmac, hmac_length, &signature_hex);
+   if (signature_hex == NULL)
+   {
+      goto error;
+   }
+
+   snprintf(request->signature, sizeof(request->signature), "%s", (char*)signature_hex);
+
+   free(signature_hmac);
+   free(signature_hex);
+   pgmoneta_string_builder_destroy(&sb);
+
+   return 0;
+
+error:
+
+   free(signature_hmac);
+   free(signature_hex);
+   pgmoneta_string_builder_destroy(&sb);
+
    return 1;
 }
 
+static size_t
+s3_chunked_length(size_t length)
+{
+   char size[MISC_LENGTH];
+   size_t n = 0;
+   size_t total = 0;
+
+   while (length > 0)
+   {
+      n = length > S3_CHUNK_SIZE ? S3_CHUNK_SIZE : length;
+
+      // <hex size>;chunk-signature=<64 hex>\r\n<data>\r\n
+      total += snprintf(&size[0], sizeof(size), "%zx", n) + strlen(";chunk-signature=") + 64 + 2 + n + 2;
+
+      length -= n;
+   }
+
+   // 0;chunk-signature=<64 hex>\r\nx-amz-checksum-crc32c:<8 base64>\r\nx-amz-trailer-signature:<64 hex>\r\n\r\n
+   total += strlen("0;chunk-signature=") + 64 + 2;
+   total += strlen("x-amz-checksum-crc32c:") + 8 + 2;
+   total += strlen("x-amz-trailer-signature:") + 64 + 2 + 2;
+
+   return total;
+}
+
+static size_t
+s3_write(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+   size_t n = size * nitems;
+   char* response = NULL;
+   struct s3_request* request = (struct s3_request*)userdata;
+
+   response = (char*)realloc(request->response, request->response_size + n + 1);
+   if (response == NULL)
+   {
+      return 0;
+   }
+
+   memcpy(response + request->response_size, buffer, n);
+   request->response = response;
+   request->response_size += n;
+   request->response[request->response_size] = '\0';
+
+   return n;
+}
+
+static size_t
+s3_header(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+   size_t n = size * nitems;
+   size_t length = 0;
+   char* value = NULL;
+   struct s3_request* request = (struct s3_request*)userdata;
+
+   if (n > strlen("ETag:") && !strncasecmp(buffer, "ETag:", strlen("ETag:")))
+   {
+      value = buffer + strlen("ETag:");
+      length = n - strlen("ETag:");
+
+      while (length > 0 && (*value == ' ' || *value == '\t'))
+      {
+         value++;
+         length--;
+      }
+
+      while (length > 0 && (value[length - 1] == '\r' || value[length - 1] == '\n' || value[length - 1] == ' '))
+      {
+         length--;
+      }
+
+      if (length < sizeof(request->etag))
+      {
+         memset(request->etag, 0, sizeof(request->etag));
+         memcpy(request->etag, value, length);
+      }
+   }
+
+   return n;
+}
+
 static char*
 s3_get_host(void)
 {
@@ -583,3 +2437,27 @@ s3_get_basepath(int server, char* identifier)
 
    return d;
 }
+
+static char*
+s3_get_path(char* remote_path)
+{
+   char* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_append(d, config->s3_base_dir);
+   if (!pgmoneta_ends_with(config->s3_base_dir, "/"))
+   {
+      d = pgmoneta_append(d, "/");
+   }
+   d = pgmoneta_append(d, remote_path);
+
+   return d;
+}
+
+static void
+s3_handle_destroy(void* handle)
+{
+   curl_easy_cleanup((CURL*)handle);
+}
@@ -32,11 +32,17 @@
 #include <pgmoneta.h>
 #include <art.h>
 #include <info.h>
+#include <io.h>
 #include <logging.h>
+#include <manifest.h>
+#include <restore.h>
 #include <string.h>
+#include <streamer.h>
 #include <utils.h>
 #include <security.h>
 #include <storage.h>
+#include <trace.h>
+#include <workers.h>
 #include <workflow.h>
 
 /* system */
@@ -46,6 +52,39 @@
 #include <fcntl.h>
 #include <libssh/libssh.h>
 #include <libssh/sftp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SFTP_RESTORE_PREFIX "ssh://"
+
+#define SFTP_WINDOW 16
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+#define HAVE_SFTP_AIO
+#endif
+
+/** @struct sftp_target
+ * Defines the remote host of a backup or a restore
+ */
+struct sftp_target
+{
+   char username[MISC_LENGTH]; /**< The user name */
+   char hostname[MISC_LENGTH]; /**< The host name */
+   int port;                   /**< The port, 0 for the default */
+   char path[MAX_PATH];        /**< The directory */
+};
+
+/** @struct sftp_context
+ * Defines the SSH session of a thread
+ */
+struct sftp_context
+{
+   ssh_session session; /**< The SSH session */
+   sftp_session sftp;   /**< The SFTP session */
+   size_t max_write;    /**< The largest write the server accepts */
+};
 
 static char* ssh_storage_name(void);
 static int ssh_storage_setup(char*, struct art*);
@@ -62,28 +101,79 @@ static char* get_remote_server_wal(int server);
 static int read_latest_backup_sha256(char* path);
 
 static int sftp_make_directory(char* local_dir, char* remote_dir);
-static int sftp_copy_directory(char* local_root, char* remote_root, char* relative_path);
+static int sftp_copy_directory(char* local_root, char* remote_root, char* relative_path, struct workers* workers);
+static int sftp_copy_queue(char* local_root, char* remote_root, char* relative_path, struct workers* workers);
+static void do_sftp_copy_file(struct worker_input* wi);
 static int sftp_copy_file(char* local_root, char* remote_root, char* relative_path);
+static int sftp_write_file(struct sftp_context* context, sftp_file dfile, FILE* sfile);
+static int sftp_publish_file(char* local_root, char* remote_root, char* relative_path);
+static bool sftp_journal_contains(char* relative_path);
+static void sftp_journal_add(char* relative_path);
+static int sftp_reconnect(void);
+static bool sftp_manifest_unchanged(char* relative_path);
+static int sftp_link_unchanged(char* local_root, char* remote_root);
 static int sftp_wal_prepare(sftp_file* file, int segsize);
 static bool sftp_exists(char* path);
 static int sftp_get_file_size(char* file_path, size_t* file_size);
 static int sftp_permission(char* path, int user, int group, int all);
 
+static int ssh_open(char* username, char* hostname, int port, ssh_session* result_session, sftp_session* result_sftp);
+
+static int ssh_backend_put(struct storage_backend* backend, char* local_path, char* remote_path);
+static int ssh_backend_get(struct storage_backend* backend, char* remote_path, char* local_path);
+static int ssh_backend_list(struct storage_backend* backend, char* remote_path, struct deque** names);
+static int ssh_backend_remove(struct storage_backend* backend, char* remote_path);
+static int ssh_backend_remove_directory(struct storage_backend* backend, char* remote_path);
+static int ssh_backend_stream(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out);
+static char* ssh_backend_path(char* remote_path);
+
+static int sftp_parse_target(char* target, struct sftp_target* t);
+static void sftp_context_destroy(void* context);
+static struct sftp_context* sftp_thread_context(void);
+static ssize_t sftp_stream_write(void* cookie, const char* buffer, size_t size);
+static int sftp_stream_close(void* cookie);
+static FILE* sftp_stream_open(struct sftp_context* context, char* path, mode_t mode);
+static int sftp_stream_copy(char* from, FILE* out);
+static char* sftp_restore_name(char* name, bool decode, bool wal);
+static int sftp_restore_file(char* from, char* to, bool decode);
+static void do_sftp_restore_file(struct worker_input* wi);
+static void do_sftp_restore_wal(struct worker_input* wi);
+static int sftp_restore_queue(char* from, char* to, bool wal, struct workers* workers);
+static int sftp_make_directories(sftp_session s, char* path, mode_t mode);
+static int sftp_make_one_directory(sftp_session s, char* path, mode_t mode);
+static int sftp_restore_directory(struct sftp_context* context, char* from, char* to, char* relative, bool last, struct workers* workers);
+static int sftp_restore_tablespaces(struct sftp_context* context, int server, struct backup* backup, char* from, char* root, struct workers* workers);
+static void sftp_restore_position(char* position, bool* primary, bool* copy_wal);
+static int sftp_restore_wal(struct sftp_context* context, int server, struct backup* backup, char* root, struct workers* workers);
+static int sftp_restore_recovery_info(struct sftp_context* context, int server, struct backup* backup, char* position, bool primary, char* from, char* root);
+
 static ssh_session session = NULL;
 static sftp_session sftp = NULL;
 
 static struct art* tree_map = NULL;
 
+static struct art* journal = NULL;
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool resuming = false;
+
+static struct art* manifest_changed = NULL;
+static struct art* manifest_added = NULL;
+static char* link_list = NULL;
+static int link_count = 0;
+
 static bool is_error = false;
 
 static char* latest_remote_root = NULL;
 
+static struct sftp_target remote_target;
+static bool restore_decode = false;
+
 struct workflow*
 pgmoneta_storage_create_ssh(int workflow_type)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -111,6 +201,37 @@ pgmoneta_storage_create_ssh(int workflow_type)
    return wf;
 }
 
+struct storage_backend*
+pgmoneta_storage_backend_ssh(void)
+{
+   struct storage_backend* backend = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   backend = (struct storage_backend*)calloc(1, sizeof(struct storage_backend));
+   if (backend == NULL)
+   {
+      return NULL;
+   }
+
+   snprintf(&backend->name[0], sizeof(backend->name), "%s", "SSH");
+   backend->put = &ssh_backend_put;
+   backend->get = &ssh_backend_get;
+   backend->list = &ssh_backend_list;
+   backend->remove = &ssh_backend_remove;
+   backend->remove_directory = &ssh_backend_remove_directory;
+   backend->stream = &ssh_backend_stream;
+   backend->range_size = 0;
+
+   // the threads of a transfer open their sessions to the configured host
+   memset(&remote_target, 0, sizeof(struct sftp_target));
+   snprintf(&remote_target.username[0], sizeof(remote_target.username), "%s", config->ssh_username);
+   snprintf(&remote_target.hostname[0], sizeof(remote_target.hostname), "%s", config->ssh_hostname);
+
+   return backend;
+}
+
 static char*
 ssh_storage_name(void)
 {
@@ -122,19 +243,6 @@ ssh_storage_setup(char* name, struct art* nodes)
 {
    int server = -1;
    char* label = NULL;
-   ssh_key srv_pubkey = NULL;
-   ssh_key client_pubkey = NULL;
-   ssh_key client_privkey = NULL;
-   char* pubkey_path = NULL;
-   char* privkey_path = NULL;
-   char* pubkey_full_path = NULL;
-   char* privkey_full_path = NULL;
-   char* homedir = NULL;
-   char* hexa = NULL;
-   unsigned char* srv_pubkey_hash = NULL;
-   size_t hash_length;
-   int rc;
-   enum ssh_known_hosts_e state;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -154,38 +262,83 @@ ssh_storage_setup(char* name, struct art* nodes)
 
    pgmoneta_log_debug("SSH storage engine (setup): %s/%s", config->servers[server].name, label);
 
+   // the workers open their own sessions to the same host
+   memset(&remote_target, 0, sizeof(struct sftp_target));
+   snprintf(&remote_target.username[0], sizeof(remote_target.username), "%s", config->ssh_username);
+   snprintf(&remote_target.hostname[0], sizeof(remote_target.hostname), "%s", config->ssh_hostname);
+
+   if (ssh_open(config->ssh_username, config->ssh_hostname, 0, &session, &sftp))
+   {
+      is_error = true;
+      return 1;
+   }
+
+   is_error = false;
+
+   return 0;
+}
+
+static int
+ssh_open(char* username, char* hostname, int port, ssh_session* result_session, sftp_session* result_sftp)
+{
+   ssh_session connection = NULL;
+   sftp_session channel = NULL;
+   ssh_key srv_pubkey = NULL;
+   ssh_key client_pubkey = NULL;
+   ssh_key client_privkey = NULL;
+   char* pubkey_path = NULL;
+   char* privkey_path = NULL;
+   char* pubkey_full_path = NULL;
+   char* privkey_full_path = NULL;
+   char* homedir = NULL;
+   unsigned char* srv_pubkey_hash = NULL;
+   size_t hash_length;
+   int rc;
+   enum ssh_known_hosts_e state;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
    homedir = getenv("HOME");
    pubkey_path = "/.ssh/id_rsa.pub";
    privkey_path = "/.ssh/id_rsa";
 
-   session = ssh_new();
+   *result_session = NULL;
+   *result_sftp = NULL;
 
-   if (session == NULL)
+   connection = ssh_new();
+
+   if (connection == NULL)
    {
       goto error;
    }
 
-   ssh_options_set(session, SSH_OPTIONS_USER, config->ssh_username);
-   ssh_options_set(session, SSH_OPTIONS_HOST, config->ssh_hostname);
+   ssh_options_set(connection, SSH_OPTIONS_USER, username);
+   ssh_options_set(connection, SSH_OPTIONS_HOST, hostname);
+
+   if (port > 0)
+   {
+      ssh_options_set(connection, SSH_OPTIONS_PORT, &port);
+   }
 
    if (strlen(config->ssh_ciphers) == 0)
    {
-      ssh_options_set(session, SSH_OPTIONS_CIPHERS_C_S, "aes256-ctr,aes192-ctr,aes128-ctr");
+      ssh_options_set(connection, SSH_OPTIONS_CIPHERS_C_S, "aes256-ctr,aes192-ctr,aes128-ctr");
    }
    else
    {
-      ssh_options_set(session, SSH_OPTIONS_CIPHERS_C_S, config->ssh_ciphers);
+      ssh_options_set(connection, SSH_OPTIONS_CIPHERS_C_S, config->ssh_ciphers);
    }
 
-   rc = ssh_connect(session);
+   rc = ssh_connect(connection);
    if (rc != SSH_OK)
    {
-      pgmoneta_log_error("Remote Backup: Error connecting to %s: %s",
-                         config->ssh_hostname, ssh_get_error(session));
+      pgmoneta_log_error("SSH: Error connecting to %s: %s",
+                         hostname, ssh_get_error(connection));
       goto error;
    }
 
-   rc = ssh_get_server_publickey(session, &srv_pubkey);
+   rc = ssh_get_server_publickey(connection, &srv_pubkey);
    if (rc < 0)
    {
       goto error;
@@ -198,7 +351,7 @@ ssh_storage_setup(char* name, struct art* nodes)
       goto error;
    }
 
-   state = ssh_session_is_known_server(session);
+   state = ssh_session_is_known_server(connection);
    switch (state)
    {
       case SSH_KNOWN_HOSTS_OK:
@@ -213,7 +366,7 @@ ssh_storage_setup(char* name, struct art* nodes)
          pgmoneta_log_error("could not find known host file: %s", strerror(errno));
          goto error;
       case SSH_KNOWN_HOSTS_UNKNOWN:
-         rc = ssh_session_update_known_hosts(session);
+         rc = ssh_session_update_known_hosts(connection);
          if (rc < 0)
          {
             pgmoneta_log_error("could not update known_hosts file: %s", strerror(errno));
@@ -246,31 +399,31 @@ ssh_storage_setup(char* name, struct art* nodes)
       goto error;
    }
 
-   rc = ssh_userauth_publickey(session, NULL, client_privkey);
+   rc = ssh_userauth_publickey(connection, NULL, client_privkey);
    if (rc != SSH_AUTH_SUCCESS)
    {
       pgmoneta_log_error("could not authenticate with public/private key: %s", strerror(errno));
       goto error;
    }
 
-   sftp = sftp_new(session);
+   channel = sftp_new(connection);
 
-   if (sftp == NULL)
+   if (channel == NULL)
    {
-      pgmoneta_log_error("Error: %s", ssh_get_error(session));
+      pgmoneta_log_error("Error: %s", ssh_get_error(connection));
       goto error;
    }
 
-   rc = sftp_init(sftp);
+   rc = sftp_init(channel);
    if (rc != SSH_OK)
    {
-      pgmoneta_log_error("Error: %s", sftp_get_error(sftp));
+      pgmoneta_log_error("Error: %s", sftp_get_error(channel));
       goto error;
    }
 
-   is_error = false;
+   *result_session = connection;
+   *result_sftp = channel;
 
-   ssh_string_free_char(hexa);
    ssh_clean_pubkey_hash(&srv_pubkey_hash);
    ssh_key_free(srv_pubkey);
    ssh_key_free(client_pubkey);
@@ -283,9 +436,6 @@ ssh_storage_setup(char* name, struct art* nodes)
 
 error:
 
-   is_error = true;
-
-   ssh_string_free_char(hexa);
    ssh_clean_pubkey_hash(&srv_pubkey_hash);
    ssh_key_free(srv_pubkey);
    ssh_key_free(client_pubkey);
@@ -294,13 +444,21 @@ error:
    free(pubkey_full_path);
    free(privkey_full_path);
 
-   sftp_free(sftp);
+   if (channel != NULL)
+   {
+      sftp_free(channel);
+   }
+
+   if (connection != NULL)
+   {
+      ssh_disconnect(connection);
+      ssh_free(connection);
+   }
 
-   ssh_disconnect(session);
-   ssh_free(session);
    return 1;
 }
 
+
 static int
 ssh_storage_backup_execute(char* name, struct art* nodes)
 {
@@ -313,9 +471,18 @@ ssh_storage_backup_execute(char* name, struct art* nodes)
    char* local_root = NULL;
    char* remote_root = NULL;
    char* latest_backup_sha256 = NULL;
+   char* old_manifest = NULL;
+   char* new_manifest = NULL;
+   char* manifest = NULL;
+   char* info_local_root = NULL;
+   char* info_remote_root = NULL;
+   struct art* manifest_deleted = NULL;
    int next_newest = -1;
    int number_of_backups = 0;
+   int number_of_workers = 0;
+   int ret = 0;
    struct backup** backups = NULL;
+   struct workers* workers = NULL;
    struct configuration* config;
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
@@ -365,11 +532,13 @@ ssh_storage_backup_execute(char* name, struct art* nodes)
       }
    }
 
-   if (pgmoneta_art_create(&tree_map))
+   if (pgmoneta_art_create(&tree_map) || pgmoneta_art_create(&journal))
    {
       goto error;
    }
 
+   resuming = false;
+
    if (next_newest != -1)
    {
       latest_remote_root = get_remote_server_backup_identifier(server, backups[next_newest]->label);
@@ -381,18 +550,106 @@ ssh_storage_backup_execute(char* name, struct art* nodes)
       {
          goto error;
       }
+
+      if (config->ssh_manifest_diff)
+      {
+         old_manifest = pgmoneta_get_server_backup_identifier(server, backups[next_newest]->label);
+         old_manifest = pgmoneta_append(old_manifest, "backup.manifest");
+
+         new_manifest = pgmoneta_append(new_manifest, local_root);
+         new_manifest = pgmoneta_append(new_manifest, "backup.manifest");
+
+         if (pgmoneta_compare_manifests(old_manifest, new_manifest, &manifest_deleted, &manifest_changed, &manifest_added))
+         {
+            pgmoneta_log_warn("SSH: Could not compare %s with %s, comparing the files", new_manifest, old_manifest);
+            pgmoneta_art_destroy(manifest_changed);
+            pgmoneta_art_destroy(manifest_added);
+            manifest_changed = NULL;
+            manifest_added = NULL;
+         }
+
+         pgmoneta_art_destroy(manifest_deleted);
+         manifest_deleted = NULL;
+      }
    }
 
-   sftp_copy_file(local_root, remote_root, "/backup.info");
+   // backup.info goes last, so a pgmoneta on the remote host only sees complete backups
    sftp_copy_file(local_root, remote_root, "/backup.sha256");
 
+   manifest = pgmoneta_append(manifest, local_root);
+   manifest = pgmoneta_append(manifest, "/backup.manifest");
+   if (pgmoneta_exists(manifest) && sftp_copy_file(local_root, remote_root, "/backup.manifest"))
+   {
+      goto error;
+   }
+
+   info_local_root = pgmoneta_append(info_local_root, local_root);
+   info_remote_root = pgmoneta_append(info_remote_root, remote_root);
+
    local_root = pgmoneta_append(local_root, "/data");
    remote_root = pgmoneta_append(remote_root, "/data");
 
-   if (sftp_copy_directory(local_root, remote_root, "") != 0)
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+
+   // a dropped connection resumes the transfer, the journal holds the
+   // files that are done and the others continue at their remote size
+   for (int attempt = 0;; attempt++)
    {
-      pgmoneta_log_error("failed to transfer the backup directory from the local host to the remote server: %s", strerror(errno));
-      goto error;
+      workers = NULL;
+      if (number_of_workers > 0 && pgmoneta_workers_initialize(number_of_workers, &workers))
+      {
+         goto error;
+      }
+
+      free(link_list);
+      link_list = NULL;
+      link_count = 0;
+
+      ret = sftp_copy_directory(local_root, remote_root, "", workers);
+
+      if (workers != NULL)
+      {
+         pgmoneta_workers_wait(workers);
+         if (!workers->outcome)
+         {
+            ret = 1;
+         }
+         pgmoneta_workers_destroy(workers);
+         workers = NULL;
+      }
+
+      if (ret == 0)
+      {
+         ret = sftp_link_unchanged(local_root, remote_root);
+      }
+
+      if (ret == 0)
+      {
+         ret = sftp_publish_file(info_local_root, info_remote_root, "/backup.info");
+      }
+
+      pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
+
+      if (ret == 0)
+      {
+         break;
+      }
+
+      if (attempt >= config->ssh_retries)
+      {
+         pgmoneta_log_error("failed to transfer the backup directory from the local host to the remote server: %s", strerror(errno));
+         goto error;
+      }
+
+      pgmoneta_log_warn("SSH: Resuming the transfer of %s/%s (%d of %d)", config->servers[server].name, label,
+                        attempt + 1, config->ssh_retries);
+
+      resuming = true;
+
+      if (sftp_reconnect())
+      {
+         goto error;
+      }
    }
 
    is_error = false;
@@ -408,6 +665,19 @@ ssh_storage_backup_execute(char* name, struct art* nodes)
       free(latest_backup_sha256);
    }
 
+   pgmoneta_art_destroy(journal);
+   journal = NULL;
+   pgmoneta_art_destroy(manifest_changed);
+   pgmoneta_art_destroy(manifest_added);
+   manifest_changed = NULL;
+   manifest_added = NULL;
+
+   free(old_manifest);
+   free(new_manifest);
+   free(manifest);
+   free(info_local_root);
+   free(info_remote_root);
+
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
    remote_ssh_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
 
@@ -423,6 +693,24 @@ error:
 
    is_error = true;
 
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
+
+   pgmoneta_art_destroy(journal);
+   journal = NULL;
+   pgmoneta_art_destroy(manifest_changed);
+   pgmoneta_art_destroy(manifest_added);
+   manifest_changed = NULL;
+   manifest_added = NULL;
+   free(link_list);
+   link_list = NULL;
+   link_count = 0;
+
+   free(old_manifest);
+   free(new_manifest);
+   free(manifest);
+   free(info_local_root);
+   free(info_remote_root);
+
    for (int i = 0; i < number_of_backups; i++)
    {
       free(backups[i]);
@@ -571,222 +859,189 @@ ssh_storage_wal_shipping_teardown(char* name, struct art* nodes)
 }
 
 static int
-sftp_make_directory(char* local_dir, char* remote_dir)
+ssh_backend_put(struct storage_backend* backend, char* local_path, char* remote_path)
 {
-   int rc;
-   char* p;
-   mode_t mode = 0;
-
-   mode = pgmoneta_get_permission(local_dir);
+   char* d = NULL;
+   char* parent = NULL;
+   char* slash = NULL;
+   FILE* sfile = NULL;
+   sftp_file dfile = NULL;
+   struct sftp_context* context = NULL;
 
-   for (p = remote_dir + 1; *p; p++)
+   context = sftp_thread_context();
+   if (context == NULL)
    {
-      if (*p == '/')
-      {
-         *p = '\0';
-
-         rc = sftp_mkdir(sftp, remote_dir, mode);
-         if (rc != SSH_OK)
-         {
-            if (sftp_get_error(sftp) != SSH_FX_FILE_ALREADY_EXISTS)
-            {
-               pgmoneta_log_error("could not create the directory: %s in the remote server: %s", remote_dir, strerror(errno));
-               goto error;
-            }
-         }
-
-         *p = '/';
-      }
+      goto error;
    }
 
-   rc = sftp_mkdir(sftp, remote_dir, mode);
-   if (rc != SSH_OK)
+   d = ssh_backend_path(remote_path);
+
+   parent = pgmoneta_append(parent, d);
+   slash = strrchr(parent, '/');
+   if (slash != NULL && slash != parent)
    {
-      if (sftp_get_error(sftp) != SSH_FX_FILE_ALREADY_EXISTS)
+      *slash = '\0';
+      if (sftp_make_directories(context->sftp, parent, 0700))
       {
-         pgmoneta_log_error("could not create the directory: %s in the remote server: %s", remote_dir, strerror(errno));
          goto error;
       }
    }
 
-   return 0;
-
-error:
-   return 1;
-}
+   sfile = fopen(local_path, "rb");
+   if (sfile == NULL)
+   {
+      goto error;
+   }
 
-static int
-sftp_copy_directory(char* local_root, char* remote_root, char* relative_path)
-{
-   char* from = NULL;
-   char* to = NULL;
-   char* relative_file;
-   int rc;
-   DIR* dir;
-   struct dirent* entry;
-   mode_t mode = 0;
+   dfile = sftp_open(context->sftp, d, O_WRONLY | O_CREAT | O_TRUNC, pgmoneta_get_permission(local_path));
+   if (dfile == NULL)
+   {
+      goto error;
+   }
 
-   from = pgmoneta_append(from, local_root);
-   from = pgmoneta_append(from, relative_path);
+   if (sftp_write_file(context, dfile, sfile))
+   {
+      goto error;
+   }
 
-   to = pgmoneta_append(to, remote_root);
-   to = pgmoneta_append(to, relative_path);
+   fclose(sfile);
+   sfile = NULL;
 
-   if (!(dir = opendir(from)))
+   if (sftp_close(dfile) != SSH_OK)
    {
+      dfile = NULL;
       goto error;
    }
 
-   mode = pgmoneta_get_permission(from);
+   free(d);
+   free(parent);
 
-   rc = sftp_mkdir(sftp, to, mode);
-   if (rc != SSH_OK)
+   return 0;
+
+error:
+
+   if (sfile != NULL)
    {
-      if (sftp_get_error(sftp) != SSH_FX_FILE_ALREADY_EXISTS)
-      {
-         goto error;
-      }
+      fclose(sfile);
    }
 
-   while ((entry = readdir(dir)) != NULL)
+   if (dfile != NULL)
    {
-      if (entry->d_type == DT_DIR)
-      {
-         char relative_dir[1024];
-
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
+      sftp_close(dfile);
+   }
 
-         snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
+   // the session may be gone, the next operation on this thread opens a new one
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
 
-         sftp_copy_directory(local_root, remote_root, relative_dir);
-      }
-      else
-      {
-         relative_file = NULL;
+   free(d);
+   free(parent);
 
-         relative_file = pgmoneta_append(relative_file, relative_path);
-         relative_file = pgmoneta_append(relative_file, "/");
-         relative_file = pgmoneta_append(relative_file, entry->d_name);
+   return 1;
+}
 
-         if (sftp_copy_file(local_root, remote_root, relative_file))
-         {
-            free(relative_file);
-            goto error;
-         }
+static int
+ssh_backend_get(struct storage_backend* backend, char* remote_path, char* local_path)
+{
+   FILE* dfile = NULL;
 
-         free(relative_file);
-      }
+   dfile = fopen(local_path, "wb");
+   if (dfile == NULL)
+   {
+      goto error;
    }
 
-   closedir(dir);
+   if (ssh_backend_stream(backend, remote_path, 0, 0, dfile))
+   {
+      goto error;
+   }
 
-   free(from);
-   free(to);
+   if (fclose(dfile) != 0)
+   {
+      dfile = NULL;
+      goto error;
+   }
 
    return 0;
 
 error:
 
-   closedir(dir);
-
-   free(from);
-   free(to);
+   if (dfile != NULL)
+   {
+      fclose(dfile);
+   }
 
    return 1;
 }
 
 static int
-sftp_copy_file(char* local_root, char* remote_root, char* relative_path)
+ssh_backend_stream(struct storage_backend* backend, char* remote_path, off_t offset, size_t length, FILE* out)
 {
    char* s = NULL;
-   char* d = NULL;
-   char* sha256 = NULL;
-   char* latest_sha256 = NULL;
-   char* latest_backup_path = NULL;
-   char buffer[16384];
-   FILE* sfile = NULL;
-   sftp_file dfile = NULL;
-   unsigned long read_bytes = 0;
-   mode_t mode = 0;
-   bool is_link = false;
-
-   s = pgmoneta_append(s, local_root);
-   s = pgmoneta_append(s, relative_path);
+   char* buffer = NULL;
+   size_t want = 0;
+   size_t left = length;
+   ssize_t n = 0;
+   sftp_file sfile = NULL;
+   struct sftp_context* context = NULL;
 
-   d = pgmoneta_append(d, remote_root);
-   d = pgmoneta_append(d, relative_path);
+   context = sftp_thread_context();
+   if (context == NULL)
+   {
+      goto error;
+   }
 
-   pgmoneta_create_sha256_file(s, &sha256);
+   s = ssh_backend_path(remote_path);
 
-   if (latest_remote_root != NULL)
+   sfile = sftp_open(context->sftp, s, O_RDONLY, 0);
+   if (sfile == NULL)
    {
-      latest_backup_path = pgmoneta_append(latest_backup_path, latest_remote_root);
-      latest_backup_path = pgmoneta_append(latest_backup_path, relative_path);
-
-      if ((latest_sha256 = (char*)pgmoneta_art_search(tree_map, relative_path)) != NULL)
-      {
-         if (!strcmp(latest_sha256, sha256))
-         {
-            is_link = true;
-         }
-      }
+      goto error;
    }
 
-   if (is_link)
+   if (offset > 0 && sftp_seek64(sfile, (uint64_t)offset) < 0)
    {
-      if (sftp_symlink(sftp, latest_backup_path, d) < 0)
-      {
-         pgmoneta_log_error("Failed to link remotely: %s", ssh_get_error(session));
-         goto error;
-      }
+      goto error;
    }
-   else
-   {
-      mode = pgmoneta_get_permission(s);
 
-      sfile = fopen(s, "rb");
+   buffer = (char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, IO_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
 
-      if (sfile == NULL)
+   do
+   {
+      want = IO_BUFFER_SIZE;
+      if (length > 0 && left < want)
       {
-         goto error;
+         want = left;
       }
 
-      dfile = sftp_open(sftp, d, O_WRONLY | O_CREAT | O_TRUNC, mode);
-
-      if (dfile == NULL)
+      if (want == 0)
       {
-         goto error;
+         break;
       }
 
-      memset(buffer, 0, sizeof(buffer));
-
-      while ((read_bytes = fread(buffer, 1, sizeof(buffer), sfile)) > 0)
+      n = sftp_read(sfile, buffer, want);
+      if (n > 0)
       {
-         sftp_write(dfile, buffer, read_bytes);
+         if (fwrite(buffer, 1, (size_t)n, out) != (size_t)n)
+         {
+            goto error;
+         }
+         left -= length > 0 ? (size_t)n : 0;
       }
    }
+   while (n > 0);
 
-   if (sfile != NULL)
+   if (n < 0)
    {
-      fclose(sfile);
+      goto error;
    }
 
-   if (dfile != NULL)
-   {
-      sftp_close(dfile);
-   }
+   sftp_close(sfile);
 
    free(s);
-   free(d);
-   free(sha256);
-
-   if (latest_backup_path != NULL)
-   {
-      free(latest_backup_path);
-   }
 
    return 0;
 
@@ -794,342 +1049,2365 @@ error:
 
    if (sfile != NULL)
    {
-      fclose(sfile);
+      sftp_close(sfile);
    }
 
-   if (dfile != NULL)
-   {
-      sftp_close(dfile);
-   }
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
 
    free(s);
-   free(d);
-   free(sha256);
-
-   if (latest_backup_path != NULL)
-   {
-      free(latest_backup_path);
-   }
 
    return 1;
 }
 
 static int
-sftp_wal_prepare(sftp_file* file, int segsize)
+ssh_backend_list(struct storage_backend* backend, char* remote_path, struct deque** names)
 {
-   char buffer[8192] = {0};
-   size_t written = 0;
-
-   if (file == NULL || *file == NULL)
-   {
-      return 1;
-   }
+   char* d = NULL;
+   sftp_dir dir = NULL;
+   sftp_attributes attributes = NULL;
+   struct deque* n = NULL;
+   struct sftp_context* context = NULL;
 
-   while (written < (size_t)segsize)
+   context = sftp_thread_context();
+   if (context == NULL)
    {
-      written += sftp_write(*file, buffer, sizeof(buffer));
+      goto error;
    }
 
-   if (sftp_seek(*file, 0) < 0)
+   if (pgmoneta_deque_create(false, &n))
    {
-      pgmoneta_log_error("WAL error: %s", ssh_get_error(session));
-      return 1;
+      goto error;
    }
-   return 0;
-}
 
-static int
-read_latest_backup_sha256(char* path)
-{
-   char buffer[4096];
-   FILE* file = NULL;
+   d = ssh_backend_path(remote_path);
 
-   file = fopen(path, "r");
-   if (file == NULL)
+   dir = sftp_opendir(context->sftp, d);
+   if (dir == NULL)
    {
       goto error;
    }
 
-   fclose(file);
-
-   file = fopen(path, "r");
-
-   memset(&buffer[0], 0, sizeof(buffer));
-
-   while ((fgets(&buffer[0], sizeof(buffer), file)) != NULL)
+   while ((attributes = sftp_readdir(context->sftp, dir)) != NULL)
    {
-      char* ptr = NULL;
-      char* file_path = NULL;
-      char* hash = NULL;
-
-      ptr = strtok(&buffer[0], ":");
-
-      if (ptr == NULL)
+      if (attributes->type == SSH_FILEXFER_TYPE_REGULAR)
       {
-         goto error;
+         pgmoneta_deque_add(n, NULL, (uintptr_t)attributes->name, ValueString);
       }
-      file_path = pgmoneta_append(NULL, ptr);
-
-      ptr = strtok(NULL, ":");
-
-      hash = (char*)malloc(strlen(ptr));
+      sftp_attributes_free(attributes);
+   }
 
-      if (hash == NULL)
-      {
-         goto error;
-      }
+   if (!sftp_dir_eof(dir))
+   {
+      goto error;
+   }
 
-      memset(hash, 0, strlen(ptr));
-      memcpy(hash, ptr, strlen(ptr) - 1);
+   sftp_closedir(dir);
 
-      pgmoneta_art_insert(tree_map, file_path, (uintptr_t)hash, ValueString);
-      free(file_path);
-   }
+   *names = n;
 
-   fclose(file);
+   free(d);
 
    return 0;
 
 error:
 
-   if (file != NULL)
+   if (dir != NULL)
    {
-      fclose(file);
+      sftp_closedir(dir);
    }
 
+   pgmoneta_deque_destroy(n);
+
+   free(d);
+
    return 1;
 }
 
-static char*
-get_remote_server_basepath(int server)
+static int
+ssh_backend_remove(struct storage_backend* backend, char* remote_path)
 {
    char* d = NULL;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
+   struct sftp_context* context = NULL;
 
-   d = pgmoneta_append(d, config->ssh_base_dir);
-   if (!pgmoneta_ends_with(config->ssh_base_dir, "/"))
+   context = sftp_thread_context();
+   if (context == NULL)
    {
-      d = pgmoneta_append(d, "/");
+      goto error;
    }
-   d = pgmoneta_append(d, config->servers[server].name);
-   d = pgmoneta_append(d, "/");
 
-   return d;
-}
+   d = ssh_backend_path(remote_path);
 
-static char*
-get_remote_server_backup(int server)
-{
-   char* d = NULL;
+   if (sftp_unlink(context->sftp, d) != SSH_OK && sftp_get_error(context->sftp) != SSH_FX_NO_SUCH_FILE)
+   {
+      goto error;
+   }
 
-   d = get_remote_server_basepath(server);
-   d = pgmoneta_append(d, "backup/");
+   free(d);
 
-   return d;
-}
+   return 0;
 
-static char*
-get_remote_server_backup_identifier(int server, char* identifier)
-{
-   char* d = NULL;
+error:
 
-   d = get_remote_server_backup(server);
-   d = pgmoneta_append(d, identifier);
+   free(d);
 
-   return d;
+   return 1;
 }
 
-static char*
-get_remote_server_wal(int server)
+static int
+ssh_backend_remove_directory(struct storage_backend* backend, char* remote_path)
 {
    char* d = NULL;
+   char* command = NULL;
+   char buffer[1024];
+   int status = -1;
+   ssh_channel channel = NULL;
+   struct sftp_context* context = NULL;
 
-   d = get_remote_server_basepath(server);
-   d = pgmoneta_append(d, "wal/");
-
-   return d;
-}
-
-int
-pgmoneta_sftp_wal_open(int server, char* filename, int segsize, sftp_file* file)
-{
+   context = sftp_thread_context();
+   if (context == NULL)
+   {
+      goto error;
+   }
 
-   char* root = NULL;
-   char* path = NULL;
+   d = ssh_backend_path(remote_path);
 
-   root = get_remote_server_wal(server);
+   // a single command instead of an SFTP request per file
+   command = pgmoneta_append(command, "rm -rf -- '");
+   command = pgmoneta_append(command, d);
+   command = pgmoneta_append(command, "'");
 
-   if (root == NULL || strlen(root) == 0 || !sftp_exists(root))
+   channel = ssh_channel_new(context->session);
+   if (channel == NULL)
    {
       goto error;
    }
 
-   path = pgmoneta_append(path, root);
-   if (!pgmoneta_ends_with(path, "/"))
+   if (ssh_channel_open_session(channel) != SSH_OK ||
+       ssh_channel_request_exec(channel, command) != SSH_OK)
    {
-      path = pgmoneta_append(path, "/");
+      goto error;
    }
 
-   path = pgmoneta_append(path, filename);
-   path = pgmoneta_append(path, ".partial");
-
-   if (sftp_exists(path))
+   while (ssh_channel_read(channel, buffer, sizeof(buffer), 0) > 0)
    {
-      // file alreay exists, check if it's padded already
-      size_t size = 0;
-      sftp_get_file_size(path, &size);
-      if (size == (size_t)segsize)
-      {
-         *file = sftp_open(sftp, path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
-         if (*file == NULL)
-         {
-            pgmoneta_log_error("WAL error: %s", ssh_get_error(session));
-            goto error;
-         }
-         sftp_permission(path, 6, 0, 0);
-
-         free(path);
-         return 0;
-      }
-      if (size != 0)
-      {
-         // corrupted file
-         pgmoneta_log_error("WAL file corrupted: %s", path);
-         goto error;
-      }
    }
 
-   *file = sftp_open(sftp, path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+   ssh_channel_send_eof(channel);
+   status = ssh_channel_get_exit_status(channel);
 
-   if (*file == NULL)
+   if (status != 0)
    {
-      pgmoneta_log_error("WAL error: %s", ssh_get_error(session));
+      pgmoneta_log_error("SSH: %s failed with %d", command, status);
       goto error;
    }
 
-   if (sftp_wal_prepare(file, segsize))
-   {
-      goto error;
-   }
+   ssh_channel_close(channel);
+   ssh_channel_free(channel);
+
+   free(command);
+   free(d);
 
-   free(path);
    return 0;
 
 error:
-   if (*file != NULL)
+
+   if (channel != NULL)
    {
-      sftp_close(*file);
+      ssh_channel_close(channel);
+      ssh_channel_free(channel);
    }
-   free(path);
+
+   free(command);
+   free(d);
+
    return 1;
 }
 
-int
-pgmoneta_sftp_wal_close(int server, char* filename, bool partial, sftp_file* file)
+static char*
+ssh_backend_path(char* remote_path)
 {
+   char* d = NULL;
+   struct configuration* config;
 
-   char* root = NULL;
-   char tmp_file_path[MAX_PATH] = {0};
-   char file_path[MAX_PATH] = {0};
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_append(d, config->ssh_base_dir);
+   if (!pgmoneta_ends_with(config->ssh_base_dir, "/"))
+   {
+      d = pgmoneta_append(d, "/");
+   }
+   d = pgmoneta_append(d, remote_path);
+
+   return d;
+}
+
+static int
+sftp_make_directory(char* local_dir, char* remote_dir)
+{
+   int rc;
+   char* p;
+   mode_t mode = 0;
+
+   mode = pgmoneta_get_permission(local_dir);
+
+   for (p = remote_dir + 1; *p; p++)
+   {
+      if (*p == '/')
+      {
+         *p = '\0';
+
+         rc = sftp_mkdir(sftp, remote_dir, mode);
+         if (rc != SSH_OK)
+         {
+            if (sftp_get_error(sftp) != SSH_FX_FILE_ALREADY_EXISTS)
+            {
+               pgmoneta_log_error("could not create the directory: %s in the remote server: %s", remote_dir, strerror(errno));
+               goto error;
+            }
+         }
+
+         *p = '/';
+      }
+   }
+
+   rc = sftp_mkdir(sftp, remote_dir, mode);
+   if (rc != SSH_OK)
+   {
+      if (sftp_get_error(sftp) != SSH_FX_FILE_ALREADY_EXISTS)
+      {
+         pgmoneta_log_error("could not create the directory: %s in the remote server: %s", remote_dir, strerror(errno));
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+   return 1;
+}
+
+static int
+sftp_copy_directory(char* local_root, char* remote_root, char* relative_path, struct workers* workers)
+{
+   char* from = NULL;
+   char* to = NULL;
+   char* relative_file;
+   int rc;
+   DIR* dir;
+   struct dirent* entry;
+   mode_t mode = 0;
+
+   from = pgmoneta_append(from, local_root);
+   from = pgmoneta_append(from, relative_path);
+
+   to = pgmoneta_append(to, remote_root);
+   to = pgmoneta_append(to, relative_path);
+
+   if (!(dir = opendir(from)))
+   {
+      goto error;
+   }
+
+   mode = pgmoneta_get_permission(from);
+
+   // the directories are made before their files are queued
+   rc = sftp_mkdir(sftp, to, mode);
+   if (rc != SSH_OK)
+   {
+      if (sftp_get_error(sftp) != SSH_FX_FILE_ALREADY_EXISTS)
+      {
+         goto error;
+      }
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         char relative_dir[1024];
+
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         {
+            continue;
+         }
+
+         snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
+
+         if (sftp_copy_directory(local_root, remote_root, relative_dir, workers))
+         {
+            goto error;
+         }
+      }
+      else
+      {
+         relative_file = NULL;
+
+         relative_file = pgmoneta_append(relative_file, relative_path);
+         relative_file = pgmoneta_append(relative_file, "/");
+         relative_file = pgmoneta_append(relative_file, entry->d_name);
+
+         if (sftp_copy_queue(local_root, remote_root, relative_file, workers))
+         {
+            free(relative_file);
+            goto error;
+         }
+
+         free(relative_file);
+      }
+   }
+
+   closedir(dir);
+
+   free(from);
+   free(to);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(from);
+   free(to);
+
+   return 1;
+}
+
+static int
+sftp_copy_queue(char* local_root, char* remote_root, char* relative_path, struct workers* workers)
+{
+   struct worker_input* wi = NULL;
+   int ret = 0;
+
+   if (sftp_journal_contains(relative_path))
+   {
+      return 0;
+   }
+
+   // unchanged files are linked on the remote host once the others are sent
+   if (sftp_manifest_unchanged(relative_path))
+   {
+      link_list = pgmoneta_append(link_list, relative_path);
+      link_list = pgmoneta_append(link_list, "\n");
+      link_count++;
+      return 0;
+   }
+
+   if (pgmoneta_create_worker_input(relative_path, local_root, remote_root, 0, workers, &wi))
+   {
+      return 1;
+   }
+
+   if (workers != NULL)
+   {
+      if (workers->outcome)
+      {
+         pgmoneta_workers_add(workers, &do_sftp_copy_file, wi);
+      }
+      else
+      {
+         free(wi);
+      }
+
+      return 0;
+   }
+
+   ret = sftp_copy_file(wi->from, wi->to, wi->directory);
+
+   free(wi);
+
+   return ret;
+}
+
+static void
+do_sftp_copy_file(struct worker_input* wi)
+{
+   if (sftp_copy_file(wi->from, wi->to, wi->directory))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+sftp_copy_file(char* local_root, char* remote_root, char* relative_path)
+{
+   char* s = NULL;
+   char* d = NULL;
+   char* sha256 = NULL;
+   char* latest_sha256 = NULL;
+   char* latest_backup_path = NULL;
+   FILE* sfile = NULL;
+   sftp_file dfile = NULL;
+   sftp_attributes attributes = NULL;
+   uint64_t offset = 0;
+   uint64_t trace_start;
+   mode_t mode = 0;
+   bool is_link = false;
+   struct sftp_context* context = NULL;
+
+   trace_start = pgmoneta_trace_now();
+
+   s = pgmoneta_append(s, local_root);
+   s = pgmoneta_append(s, relative_path);
+
+   d = pgmoneta_append(d, remote_root);
+   d = pgmoneta_append(d, relative_path);
+
+   context = sftp_thread_context();
+   if (context == NULL)
+   {
+      goto error;
+   }
+
+   pgmoneta_create_sha256_file(s, &sha256);
+
+   if (latest_remote_root != NULL)
+   {
+      latest_backup_path = pgmoneta_append(latest_backup_path, latest_remote_root);
+      latest_backup_path = pgmoneta_append(latest_backup_path, relative_path);
+
+      if ((latest_sha256 = (char*)pgmoneta_art_search(tree_map, relative_path)) != NULL)
+      {
+         if (sha256 != NULL && !strcmp(latest_sha256, sha256))
+         {
+            is_link = true;
+         }
+      }
+   }
+
+   if (is_link)
+   {
+      if (sftp_symlink(context->sftp, latest_backup_path, d) < 0)
+      {
+         // the link may be left from the interrupted transfer
+         if (!resuming || sftp_get_error(context->sftp) != SSH_FX_FILE_ALREADY_EXISTS)
+         {
+            pgmoneta_log_error("Failed to link remotely: %s", ssh_get_error(context->session));
+            goto error;
+         }
+      }
+   }
+   else
+   {
+      mode = pgmoneta_get_permission(s);
+
+      sfile = fopen(s, "rb");
+
+      if (sfile == NULL)
+      {
+         goto error;
+      }
+
+      if (resuming && (attributes = sftp_stat(context->sftp, d)) != NULL)
+      {
+         if (attributes->size <= (uint64_t)pgmoneta_get_file_size(s))
+         {
+            offset = attributes->size;
+         }
+         sftp_attributes_free(attributes);
+         attributes = NULL;
+      }
+
+      dfile = sftp_open(context->sftp, d, O_WRONLY | O_CREAT | (offset > 0 ? 0 : O_TRUNC), mode);
+
+      if (dfile == NULL)
+      {
+         goto error;
+      }
+
+      if (offset > 0)
+      {
+         if (sftp_seek64(dfile, offset) < 0 || fseeko(sfile, (off_t)offset, SEEK_SET))
+         {
+            goto error;
+         }
+
+         pgmoneta_log_debug("SSH: Resuming %s at %" PRIu64, relative_path, offset);
+      }
+
+      if (sftp_write_file(context, dfile, sfile))
+      {
+         goto error;
+      }
+   }
+
+   if (sfile != NULL)
+   {
+      fclose(sfile);
+      sfile = NULL;
+   }
+
+   if (dfile != NULL)
+   {
+      if (sftp_close(dfile) != SSH_OK)
+      {
+         dfile = NULL;
+         goto error;
+      }
+      dfile = NULL;
+   }
+
+   sftp_journal_add(relative_path);
+
+   pgmoneta_trace_event(TRACE_STORAGE, is_link ? "SFTP link" : "SFTP copy", relative_path, trace_start);
+
+   free(s);
+   free(d);
+   free(sha256);
+
+   if (latest_backup_path != NULL)
+   {
+      free(latest_backup_path);
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("SSH: Could not copy %s", relative_path);
+
+   if (sfile != NULL)
+   {
+      fclose(sfile);
+   }
+
+   if (dfile != NULL)
+   {
+      sftp_close(dfile);
+   }
+
+   // the session may be gone, the next copy on this thread opens a new one
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
+
+   free(s);
+   free(d);
+   free(sha256);
+
+   if (latest_backup_path != NULL)
+   {
+      free(latest_backup_path);
+   }
+
+   return 1;
+}
+
+static int
+sftp_publish_file(char* local_root, char* remote_root, char* relative_path)
+{
+   char* s = NULL;
+   char* d = NULL;
+   char* partial = NULL;
+   FILE* sfile = NULL;
+   sftp_file dfile = NULL;
+   struct sftp_context* context = NULL;
+
+   s = pgmoneta_append(s, local_root);
+   s = pgmoneta_append(s, relative_path);
+
+   d = pgmoneta_append(d, remote_root);
+   d = pgmoneta_append(d, relative_path);
+
+   partial = pgmoneta_append(partial, d);
+   partial = pgmoneta_append(partial, ".partial");
+
+   context = sftp_thread_context();
+   if (context == NULL)
+   {
+      goto error;
+   }
+
+   sfile = fopen(s, "rb");
+   if (sfile == NULL)
+   {
+      goto error;
+   }
+
+   dfile = sftp_open(context->sftp, partial, O_WRONLY | O_CREAT | O_TRUNC, pgmoneta_get_permission(s));
+   if (dfile == NULL)
+   {
+      goto error;
+   }
+
+   if (sftp_write_file(context, dfile, sfile))
+   {
+      goto error;
+   }
+
+   fclose(sfile);
+   sfile = NULL;
+
+   if (sftp_close(dfile) != SSH_OK)
+   {
+      dfile = NULL;
+      goto error;
+   }
+   dfile = NULL;
+
+   // SFTP v3 doesn't rename over an existing file
+   if (sftp_unlink(context->sftp, d) != SSH_OK && sftp_get_error(context->sftp) != SSH_FX_NO_SUCH_FILE)
+   {
+      goto error;
+   }
+
+   if (sftp_rename(context->sftp, partial, d) != SSH_OK)
+   {
+      goto error;
+   }
+
+   free(s);
+   free(d);
+   free(partial);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("SSH: Could not publish %s", relative_path);
+
+   if (sfile != NULL)
+   {
+      fclose(sfile);
+   }
+
+   if (dfile != NULL)
+   {
+      sftp_close(dfile);
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
+
+   free(s);
+   free(d);
+   free(partial);
+
+   return 1;
+}
+
+static int
+sftp_write_file(struct sftp_context* context, sftp_file dfile, FILE* sfile)
+{
+   size_t chunk = IO_BUFFER_SIZE;
+   size_t n = 0;
+   char* buffer = NULL;
+#ifdef HAVE_SFTP_AIO
+   sftp_aio aio[SFTP_WINDOW];
+   int first = 0;
+   int in_flight = 0;
+#else
+   ssize_t written = 0;
+#endif
+
+   if (context->max_write > 0 && context->max_write < chunk)
+   {
+      chunk = context->max_write;
+   }
+
+   buffer = (char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, chunk);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+#ifdef HAVE_SFTP_AIO
+   // keep a window of writes in flight instead of waiting for each one
+   while ((n = fread(buffer, 1, chunk, sfile)) > 0)
+   {
+      if (in_flight == SFTP_WINDOW)
+      {
+         if (sftp_aio_wait_write(&aio[first]) < 0)
+         {
+            in_flight--;
+            first = (first + 1) % SFTP_WINDOW;
+            goto error;
+         }
+         in_flight--;
+         first = (first + 1) % SFTP_WINDOW;
+      }
+
+      if (sftp_aio_begin_write(dfile, buffer, n, &aio[(first + in_flight) % SFTP_WINDOW]) < 0)
+      {
+         goto error;
+      }
+      in_flight++;
+   }
+
+   while (in_flight > 0)
+   {
+      if (sftp_aio_wait_write(&aio[first]) < 0)
+      {
+         in_flight--;
+         first = (first + 1) % SFTP_WINDOW;
+         goto error;
+      }
+      in_flight--;
+      first = (first + 1) % SFTP_WINDOW;
+   }
+#else
+   while ((n = fread(buffer, 1, chunk, sfile)) > 0)
+   {
+      for (size_t offset = 0; offset < n; offset += written)
+      {
+         written = sftp_write(dfile, buffer + offset, n - offset);
+         if (written <= 0)
+         {
+            goto error;
+         }
+      }
+   }
+#endif
+
+   if (ferror(sfile))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+#ifdef HAVE_SFTP_AIO
+   while (in_flight > 0)
+   {
+      sftp_aio_free(aio[first]);
+      in_flight--;
+      first = (first + 1) % SFTP_WINDOW;
+   }
+#endif
+
+   pgmoneta_log_error("SSH: Write failed: %s", ssh_get_error(context->session));
+
+   return 1;
+}
+
+static bool
+sftp_journal_contains(char* relative_path)
+{
+   bool done = false;
+
+   if (journal == NULL)
+   {
+      return false;
+   }
+
+   pthread_mutex_lock(&journal_lock);
+   done = pgmoneta_art_contains_key(journal, relative_path);
+   pthread_mutex_unlock(&journal_lock);
+
+   return done;
+}
+
+static void
+sftp_journal_add(char* relative_path)
+{
+   if (journal == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&journal_lock);
+   pgmoneta_art_insert(journal, relative_path, (uintptr_t)true, ValueBool);
+   pthread_mutex_unlock(&journal_lock);
+}
+
+static bool
+sftp_manifest_unchanged(char* relative_path)
+{
+   char* name = NULL;
+   char* suffix = NULL;
+   bool unchanged = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (manifest_changed == NULL || manifest_added == NULL)
+   {
+      return false;
+   }
+
+   // the manifest has the names of the files before compression and encryption
+   name = pgmoneta_append(NULL, relative_path + 1);
+   suffix = pgmoneta_streamer_suffix(config->compression_type, config->encryption);
+   if (suffix != NULL && pgmoneta_ends_with(name, suffix))
+   {
+      name[strlen(name) - strlen(suffix)] = '\0';
+   }
+
+   unchanged = !pgmoneta_is_incremental_path(name) &&
+               !pgmoneta_art_contains_key(manifest_added, name) &&
+               !pgmoneta_art_contains_key(manifest_changed, name);
+
+   free(suffix);
+   free(name);
+
+   return unchanged;
+}
+
+static int
+sftp_link_unchanged(char* local_root, char* remote_root)
+{
+   char* list_path = NULL;
+   char* latest_root = NULL;
+   char* command = NULL;
+   char* output = NULL;
+   char* line = NULL;
+   char* next = NULL;
+   char buffer[4096];
+   int n = 0;
+   int status = -1;
+   int sent = 0;
+   bool fallback = true;
+   size_t length = 0;
+   ssize_t written = 0;
+   sftp_file file = NULL;
+   ssh_channel channel = NULL;
+
+   if (link_list == NULL || latest_remote_root == NULL)
+   {
+      return 0;
+   }
+
+   // the list is sent as a file, so the command is short and its output can't block the input
+   list_path = pgmoneta_append(list_path, remote_root);
+   list_path = pgmoneta_append(list_path, ".links");
+
+   latest_root = pgmoneta_append(latest_root, latest_remote_root);
+   latest_root = pgmoneta_append(latest_root, "/data");
+
+   length = strlen(link_list);
+
+   file = sftp_open(sftp, list_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (file == NULL)
+   {
+      goto send;
+   }
+
+   for (size_t offset = 0; offset < length; offset += written)
+   {
+      written = sftp_write(file, link_list + offset, length - offset);
+      if (written <= 0)
+      {
+         sftp_close(file);
+         goto send;
+      }
+   }
+
+   if (sftp_close(file) != SSH_OK)
+   {
+      goto send;
+   }
+
+   // a file that can't be linked is printed, and sent instead
+   command = pgmoneta_append(command, "cd '");
+   command = pgmoneta_append(command, latest_root);
+   command = pgmoneta_append(command, "' && while IFS= read -r f; do ln -f -- \".$f\" '");
+   command = pgmoneta_append(command, remote_root);
+   command = pgmoneta_append(command, "'\"$f\" 2>/dev/null || printf '%s\\n' \"$f\"; done < '");
+   command = pgmoneta_append(command, list_path);
+   command = pgmoneta_append(command, "'; rm -f '");
+   command = pgmoneta_append(command, list_path);
+   command = pgmoneta_append(command, "'");
+
+   channel = ssh_channel_new(session);
+   if (channel == NULL)
+   {
+      goto send;
+   }
+
+   if (ssh_channel_open_session(channel) != SSH_OK ||
+       ssh_channel_request_exec(channel, command) != SSH_OK)
+   {
+      goto send;
+   }
+
+   while ((n = ssh_channel_read(channel, buffer, sizeof(buffer) - 1, 0)) > 0)
+   {
+      buffer[n] = '\0';
+      output = pgmoneta_append(output, buffer);
+   }
+
+   ssh_channel_send_eof(channel);
+   status = ssh_channel_get_exit_status(channel);
+
+   if (n < 0 || status != 0)
+   {
+      goto send;
+   }
+
+   fallback = false;
+
+   free(link_list);
+   link_list = output;
+   output = NULL;
+
+send:
+
+   if (channel != NULL)
+   {
+      ssh_channel_close(channel);
+      ssh_channel_free(channel);
+      channel = NULL;
+   }
+
+   if (fallback)
+   {
+      pgmoneta_log_warn("SSH: Could not link on %s, sending the unchanged files", remote_target.hostname);
+   }
+
+   line = link_list;
+   while (line != NULL && *line != '\0')
+   {
+      next = strchr(line, '\n');
+      if (next != NULL)
+      {
+         *next = '\0';
+      }
+
+      if (strlen(line) > 0)
+      {
+         if (sftp_copy_file(local_root, remote_root, line))
+         {
+            goto error;
+         }
+         sent++;
+      }
+
+      line = next != NULL ? next + 1 : NULL;
+   }
+
+   pgmoneta_log_debug("SSH: Linked %d unchanged files on %s", link_count - sent, remote_target.hostname);
+
+   free(link_list);
+   link_list = NULL;
+   link_count = 0;
+
+   free(output);
+   free(command);
+   free(latest_root);
+   free(list_path);
+
+   return 0;
+
+error:
+
+   free(output);
+   free(command);
+   free(latest_root);
+   free(list_path);
+
+   return 1;
+}
+
+static int
+sftp_reconnect(void)
+{
+   sftp_free(sftp);
+   ssh_free(session);
+   sftp = NULL;
+   session = NULL;
+
+   if (ssh_open(remote_target.username, remote_target.hostname, remote_target.port, &session, &sftp))
+   {
+      pgmoneta_log_error("SSH: Could not reconnect to %s", remote_target.hostname);
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+sftp_wal_prepare(sftp_file* file, int segsize)
+{
+   char buffer[8192] = {0};
+   size_t written = 0;
+
+   if (file == NULL || *file == NULL)
+   {
+      return 1;
+   }
+
+   while (written < (size_t)segsize)
+   {
+      written += sftp_write(*file, buffer, sizeof(buffer));
+   }
+
+   if (sftp_seek(*file, 0) < 0)
+   {
+      pgmoneta_log_error("WAL error: %s", ssh_get_error(session));
+      return 1;
+   }
+   return 0;
+}
+
+static int
+read_latest_backup_sha256(char* path)
+{
+   char buffer[4096];
+   FILE* file = NULL;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   fclose(file);
+
+   file = fopen(path, "r");
+
+   memset(&buffer[0], 0, sizeof(buffer));
+
+   while ((fgets(&buffer[0], sizeof(buffer), file)) != NULL)
+   {
+      char* ptr = NULL;
+      char* file_path = NULL;
+      char* hash = NULL;
+
+      ptr = strtok(&buffer[0], ":");
+
+      if (ptr == NULL)
+      {
+         goto error;
+      }
+      file_path = pgmoneta_append(NULL, ptr);
+
+      ptr = strtok(NULL, ":");
+
+      hash = (char*)malloc(strlen(ptr));
+
+      if (hash == NULL)
+      {
+         goto error;
+      }
+
+      memset(hash, 0, strlen(ptr));
+      memcpy(hash, ptr, strlen(ptr) - 1);
+
+      pgmoneta_art_insert(tree_map, file_path, (uintptr_t)hash, ValueString);
+      free(file_path);
+   }
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static char*
+get_remote_server_basepath(int server)
+{
+   char* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   d = pgmoneta_append(d, config->ssh_base_dir);
+   if (!pgmoneta_ends_with(config->ssh_base_dir, "/"))
+   {
+      d = pgmoneta_append(d, "/");
+   }
+   d = pgmoneta_append(d, config->servers[server].name);
+   d = pgmoneta_append(d, "/");
+
+   return d;
+}
+
+static char*
+get_remote_server_backup(int server)
+{
+   char* d = NULL;
+
+   d = get_remote_server_basepath(server);
+   d = pgmoneta_append(d, "backup/");
+
+   return d;
+}
+
+static char*
+get_remote_server_backup_identifier(int server, char* identifier)
+{
+   char* d = NULL;
+
+   d = get_remote_server_backup(server);
+   d = pgmoneta_append(d, identifier);
+
+   return d;
+}
+
+static char*
+get_remote_server_wal(int server)
+{
+   char* d = NULL;
+
+   d = get_remote_server_basepath(server);
+   d = pgmoneta_append(d, "wal/");
+
+   return d;
+}
+
+int
+pgmoneta_sftp_wal_open(int server, char* filename, int segsize, sftp_file* file)
+{
+
+   char* root = NULL;
+   char* path = NULL;
+
+   root = get_remote_server_wal(server);
+
+   if (root == NULL || strlen(root) == 0 || !sftp_exists(root))
+   {
+      goto error;
+   }
+
+   path = pgmoneta_append(path, root);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+
+   path = pgmoneta_append(path, filename);
+   path = pgmoneta_append(path, ".partial");
+
+   if (sftp_exists(path))
+   {
+      // file alreay exists, check if it's padded already
+      size_t size = 0;
+      sftp_get_file_size(path, &size);
+      if (size == (size_t)segsize)
+      {
+         *file = sftp_open(sftp, path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+         if (*file == NULL)
+         {
+            pgmoneta_log_error("WAL error: %s", ssh_get_error(session));
+            goto error;
+         }
+         sftp_permission(path, 6, 0, 0);
+
+         free(path);
+         return 0;
+      }
+      if (size != 0)
+      {
+         // corrupted file
+         pgmoneta_log_error("WAL file corrupted: %s", path);
+         goto error;
+      }
+   }
+
+   *file = sftp_open(sftp, path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+
+   if (*file == NULL)
+   {
+      pgmoneta_log_error("WAL error: %s", ssh_get_error(session));
+      goto error;
+   }
+
+   if (sftp_wal_prepare(file, segsize))
+   {
+      goto error;
+   }
+
+   free(path);
+   return 0;
+
+error:
+   if (*file != NULL)
+   {
+      sftp_close(*file);
+   }
+   free(path);
+   return 1;
+}
+
+int
+pgmoneta_sftp_wal_close(int server, char* filename, bool partial, sftp_file* file)
+{
+
+   char* root = NULL;
+   char tmp_file_path[MAX_PATH] = {0};
+   char file_path[MAX_PATH] = {0};
+
+   root = get_remote_server_wal(server);
+
+   if (file == NULL || *file == NULL || root == NULL || filename == NULL || strlen(root) == 0 || strlen(filename) == 0)
+   {
+      return 1;
+   }
+
+   if (partial)
+   {
+      pgmoneta_log_warn("Not renaming %s.partial, this segment is incomplete", filename);
+      sftp_close(*file);
+      return 0;
+   }
+
+   if (pgmoneta_ends_with(root, "/"))
+   {
+      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s%s.partial", root, filename);
+      snprintf(file_path, sizeof(file_path), "%s%s", root, filename);
+   }
+   else
+   {
+      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s/%s.partial", root, filename);
+      snprintf(file_path, sizeof(file_path), "%s/%s", root, filename);
+   }
+   if (sftp_rename(sftp, tmp_file_path, file_path) != 0)
+   {
+      pgmoneta_log_error("could not rename file %s to %s", tmp_file_path, file_path);
+      goto error;
+   }
+
+   sftp_close(*file);
+
+   return 0;
+
+error:
+   sftp_close(*file);
+   return 1;
+}
+
+bool
+pgmoneta_sftp_restore_target(char* target)
+{
+   return target != NULL && pgmoneta_starts_with(target, SFTP_RESTORE_PREFIX);
+}
+
+int
+pgmoneta_sftp_restore(int server, struct backup* backup, char* position, char* target)
+{
+   char* from = NULL;
+   char* root = NULL;
+   bool primary = true;
+   bool copy_wal = false;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct sftp_context* context = NULL;
+   sftp_attributes attributes = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (backup->type != TYPE_FULL)
+   {
+      pgmoneta_log_error("SSH: %s/%s is an incremental backup, merge it before restoring it to a remote host",
+                         config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   if (sftp_parse_target(target, &remote_target))
+   {
+      goto error;
+   }
+
+   restore_decode = backup->compression != COMPRESSION_NONE || backup->encryption != ENCRYPTION_NONE;
+
+   context = sftp_thread_context();
+   if (context == NULL)
+   {
+      goto error;
+   }
+
+   from = pgmoneta_get_server_backup_identifier_data(server, backup->label);
+
+   root = pgmoneta_append(root, remote_target.path);
+   if (!pgmoneta_ends_with(root, "/"))
+   {
+      root = pgmoneta_append(root, "/");
+   }
+   root = pgmoneta_append(root, config->servers[server].name);
+   root = pgmoneta_append(root, "-");
+   root = pgmoneta_append(root, backup->label);
+
+   if ((attributes = sftp_stat(context->sftp, root)) != NULL)
+   {
+      pgmoneta_log_error("SSH: %s already exists on %s", root, remote_target.hostname);
+      sftp_attributes_free(attributes);
+      goto error;
+   }
+
+   if (sftp_make_directories(context->sftp, remote_target.path, 0700))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("SSH: Restoring %s/%s to %s:%s", config->servers[server].name, backup->label,
+                      remote_target.hostname, root);
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (sftp_restore_directory(context, from, root, "", false, workers))
+   {
+      goto error;
+   }
+
+   if (sftp_restore_tablespaces(context, server, backup, from, root, workers))
+   {
+      goto error;
+   }
+
+   if (position != NULL && strlen(position) > 0)
+   {
+      sftp_restore_position(position, &primary, &copy_wal);
+
+      if (copy_wal && sftp_restore_wal(context, server, backup, root, workers))
+      {
+         goto error;
+      }
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+      number_of_workers = 0;
+   }
+
+   /* The files that make the directory usable are sent once all the others are there */
+   if (sftp_restore_directory(context, from, root, "", true, NULL))
+   {
+      goto error;
+   }
+
+   if (position != NULL && strlen(position) > 0)
+   {
+      if (sftp_restore_recovery_info(context, server, backup, position, primary, from, root))
+      {
+         goto error;
+      }
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
+
+   free(from);
+   free(root);
+
+   return 0;
+
+error:
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, NULL, NULL);
+
+   free(from);
+   free(root);
+
+   return 1;
+}
+static bool
+sftp_exists(char* path)
+{
+   if (sftp_stat(sftp, path) != NULL)
+   {
+      return true;
+   }
+   return false;
+}
+
+static int
+sftp_get_file_size(char* file_path, size_t* file_size)
+{
+   sftp_file file = NULL;
+   sftp_attributes attributes = NULL;
+
+   if ((file = sftp_open(sftp, file_path, O_RDONLY, 0)) == NULL)
+   {
+      pgmoneta_log_error("Failed to open file: %s : %s", file_path, ssh_get_error(session));
+      goto error;
+   }
+
+   if ((attributes = sftp_fstat(file)) == NULL)
+   {
+      pgmoneta_log_error("Error retrieving file attributes: %s : %s", file_path, ssh_get_error(session));
+      goto error;
+   }
+
+   *file_size = attributes->size;
+
+   sftp_attributes_free(attributes);
+   sftp_close(file);
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      sftp_close(file);
+   }
+   if (attributes != NULL)
+   {
+      sftp_attributes_free(attributes);
+   }
+   return 1;
+}
+
+static int
+sftp_permission(char* path, int user, int group, int all)
+{
+   int ret;
+   mode_t mode;
+   pgmoneta_get_permission_mode(user, group, all, &mode);
+   ret = sftp_chmod(sftp, path, mode);
+   if (ret != 0)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+sftp_parse_target(char* target, struct sftp_target* t)
+{
+   char* host = NULL;
+   char* path = NULL;
+   char* at = NULL;
+   char* colon = NULL;
+   char* end = NULL;
+   size_t length = 0;
+   long port = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(t, 0, sizeof(struct sftp_target));
+
+   if (!pgmoneta_sftp_restore_target(target))
+   {
+      goto error;
+   }
+
+   host = target + strlen(SFTP_RESTORE_PREFIX);
+   path = strchr(host, '/');
+
+   if (path == NULL || path == host || strlen(path) >= sizeof(t->path))
+   {
+      goto error;
+   }
+
+   at = memchr(host, '@', path - host);
+   if (at != NULL)
+   {
+      length = at - host;
+      if (length == 0 || length >= sizeof(t->username))
+      {
+         goto error;
+      }
+      memcpy(t->username, host, length);
+      host = at + 1;
+   }
+   else
+   {
+      memcpy(t->username, config->ssh_username, strlen(config->ssh_username));
+   }
+
+   colon = memchr(host, ':', path - host);
+   if (colon != NULL)
+   {
+      port = strtol(colon + 1, &end, 10);
+      if (end != path || port <= 0 || port > 65535)
+      {
+         goto error;
+      }
+      t->port = (int)port;
+      length = colon - host;
+   }
+   else
+   {
+      length = path - host;
+   }
+
+   if (length == 0 || length >= sizeof(t->hostname))
+   {
+      goto error;
+   }
+
+   memcpy(t->hostname, host, length);
+   memcpy(t->path, path, strlen(path));
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("SSH: Invalid restore target %s, expected ssh://[user@]host[:port]/path", target);
+
+   return 1;
+}
+
+static void
+sftp_context_destroy(void* context)
+{
+   struct sftp_context* c = (struct sftp_context*)context;
+
+   if (c == NULL)
+   {
+      return;
+   }
+
+   if (c->sftp != NULL)
+   {
+      sftp_free(c->sftp);
+   }
+
+   if (c->session != NULL)
+   {
+      ssh_disconnect(c->session);
+      ssh_free(c->session);
+   }
+
+   free(c);
+}
+
+static struct sftp_context*
+sftp_thread_context(void)
+{
+   struct sftp_context* context = NULL;
+
+   context = (struct sftp_context*)pgmoneta_worker_context(WORKER_CONTEXT_SFTP);
+
+   if (context == NULL)
+   {
+      context = (struct sftp_context*)calloc(1, sizeof(struct sftp_context));
+      if (context == NULL)
+      {
+         return NULL;
+      }
+
+      if (ssh_open(remote_target.username, remote_target.hostname, remote_target.port,
+                   &context->session, &context->sftp))
+      {
+         free(context);
+         return NULL;
+      }
+
+#ifdef HAVE_SFTP_AIO
+      sftp_limits_t limits = sftp_limits(context->sftp);
+      if (limits != NULL)
+      {
+         context->max_write = (size_t)limits->max_write_length;
+         sftp_limits_free(limits);
+      }
+#endif
+
+      pgmoneta_worker_context_set(WORKER_CONTEXT_SFTP, context, &sftp_context_destroy);
+   }
+
+   return context;
+}
+
+static ssize_t
+sftp_stream_write(void* cookie, const char* buffer, size_t size)
+{
+   size_t written = 0;
+   ssize_t n = 0;
+
+   while (written < size)
+   {
+      n = sftp_write((sftp_file)cookie, buffer + written, size - written);
+      if (n <= 0)
+      {
+         return 0;
+      }
+      written += n;
+   }
+
+   return written;
+}
+
+static int
+sftp_stream_close(void* cookie)
+{
+   return sftp_close((sftp_file)cookie) == SSH_OK ? 0 : EOF;
+}
+
+static FILE*
+sftp_stream_open(struct sftp_context* context, char* path, mode_t mode)
+{
+   sftp_file file = NULL;
+   FILE* stream = NULL;
+   cookie_io_functions_t functions = {
+      .read = NULL,
+      .write = &sftp_stream_write,
+      .seek = NULL,
+      .close = &sftp_stream_close
+   };
+
+   file = sftp_open(context->sftp, path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+   if (file == NULL)
+   {
+      pgmoneta_log_error("SSH: Could not create %s: %s", path, ssh_get_error(context->session));
+      return NULL;
+   }
+
+   stream = fopencookie(file, "w", functions);
+   if (stream == NULL)
+   {
+      sftp_close(file);
+      return NULL;
+   }
+
+   /* Fewer and larger SFTP writes keep the channel busy */
+   setvbuf(stream, NULL, _IOFBF, IO_BUFFER_SIZE);
+
+   return stream;
+}
+
+static int
+sftp_stream_copy(char* from, FILE* out)
+{
+   size_t n = 0;
+   unsigned char* buffer = NULL;
+   struct io_reader* in = NULL;
+
+   buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, IO_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_io_reader_open(from, 0, 0, &in))
+   {
+      goto error;
+   }
+
+   while ((n = pgmoneta_io_reader_read(in, buffer, IO_BUFFER_SIZE)) > 0)
+   {
+      if (fwrite(buffer, 1, n, out) != n)
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_io_reader_error(in))
+   {
+      goto error;
+   }
+
+   pgmoneta_io_reader_close(in);
+
+   return 0;
+
+error:
+
+   pgmoneta_io_reader_close(in);
+
+   return 1;
+}
+
+static char*
+sftp_restore_name(char* name, bool decode, bool wal)
+{
+   char* result = NULL;
+
+   result = pgmoneta_append(result, name);
+   if (result == NULL)
+   {
+      return NULL;
+   }
+
+   if (decode && pgmoneta_ends_with(result, ".aes"))
+   {
+      result[strlen(result) - strlen(".aes")] = '\0';
+   }
+
+   if (decode && pgmoneta_is_compressed_archive(result))
+   {
+      *strrchr(result, '.') = '\0';
+   }
+
+   if (wal && pgmoneta_ends_with(result, ".partial"))
+   {
+      result[strlen(result) - strlen(".partial")] = '\0';
+   }
+
+   return result;
+}
+
+static int
+sftp_restore_file(char* from, char* to, bool decode)
+{
+   struct sftp_context* context = NULL;
+   FILE* out = NULL;
+   int ret = 0;
+
+   context = sftp_thread_context();
+   if (context == NULL)
+   {
+      goto error;
+   }
+
+   out = sftp_stream_open(context, to, pgmoneta_get_permission(from));
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   if (decode && (pgmoneta_is_compressed_archive(from) || pgmoneta_is_encrypted_archive(from)))
+   {
+      ret = pgmoneta_destreamer_stream(from, out);
+   }
+   else
+   {
+      ret = sftp_stream_copy(from, out);
+   }
+
+   if (ret)
+   {
+      goto error;
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("SSH: Could not restore %s to %s", from, to);
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   return 1;
+}
+
+static void
+do_sftp_restore_file(struct worker_input* wi)
+{
+   if (sftp_restore_file(wi->from, wi->to, restore_decode))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static void
+do_sftp_restore_wal(struct worker_input* wi)
+{
+   if (sftp_restore_file(wi->from, wi->to, true))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+sftp_restore_queue(char* from, char* to, bool wal, struct workers* workers)
+{
+   struct worker_input* wi = NULL;
+   int ret = 0;
+
+   if (pgmoneta_create_worker_input(NULL, from, to, 0, workers, &wi))
+   {
+      return 1;
+   }
+
+   if (workers != NULL)
+   {
+      if (workers->outcome)
+      {
+         pgmoneta_workers_add(workers, wal ? &do_sftp_restore_wal : &do_sftp_restore_file, wi);
+      }
+      else
+      {
+         free(wi);
+      }
+
+      return 0;
+   }
+
+   ret = sftp_restore_file(wi->from, wi->to, wal || restore_decode);
+
+   free(wi);
+
+   return ret;
+}
+
+static int
+sftp_make_directories(sftp_session s, char* path, mode_t mode)
+{
+   char* directory = NULL;
+   char* p = NULL;
+   int ret = 0;
+
+   directory = pgmoneta_append(directory, path);
+   if (directory == NULL)
+   {
+      return 1;
+   }
+
+   for (p = directory + 1; ret == 0 && *p; p++)
+   {
+      if (*p == '/')
+      {
+         *p = '\0';
+         ret = sftp_make_one_directory(s, directory, mode);
+         *p = '/';
+      }
+   }
+
+   if (ret == 0 && !pgmoneta_ends_with(directory, "/"))
+   {
+      ret = sftp_make_one_directory(s, directory, mode);
+   }
+
+   free(directory);
+
+   return ret;
+}
+
+static int
+sftp_make_one_directory(sftp_session s, char* path, mode_t mode)
+{
+   if (sftp_mkdir(s, path, mode) != SSH_OK && sftp_get_error(s) != SSH_FX_FILE_ALREADY_EXISTS)
+   {
+      pgmoneta_log_error("SSH: Could not create the directory %s", path);
+      return 1;
+   }
 
-   root = get_remote_server_wal(server);
+   return 0;
+}
 
-   if (file == NULL || *file == NULL || root == NULL || filename == NULL || strlen(root) == 0 || strlen(filename) == 0)
+static int
+sftp_restore_directory(struct sftp_context* context, char* from, char* to, char* relative, bool last, struct workers* workers)
+{
+   DIR* d = NULL;
+   struct dirent* entry;
+   struct stat statbuf;
+   char* from_buffer = NULL;
+   char* to_buffer = NULL;
+   char* relative_buffer = NULL;
+   char* name = NULL;
+
+   if (!last && sftp_make_one_directory(context->sftp, to, pgmoneta_get_permission(from)))
    {
-      return 1;
+      goto error;
    }
 
-   if (partial)
+   d = opendir(from);
+   if (d == NULL)
    {
-      pgmoneta_log_warn("Not renaming %s.partial, this segment is incomplete", filename);
-      sftp_close(*file);
-      return 0;
+      pgmoneta_log_error("SSH: Could not open the %s directory", from);
+      goto error;
    }
 
-   if (pgmoneta_ends_with(root, "/"))
+   while ((entry = readdir(d)))
    {
-      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s%s.partial", root, filename);
-      snprintf(file_path, sizeof(file_path), "%s%s", root, filename);
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      from_buffer = pgmoneta_append(from_buffer, from);
+      if (!pgmoneta_ends_with(from_buffer, "/"))
+      {
+         from_buffer = pgmoneta_append(from_buffer, "/");
+      }
+      from_buffer = pgmoneta_append(from_buffer, entry->d_name);
+
+      if (lstat(from_buffer, &statbuf))
+      {
+         goto error;
+      }
+
+      if (S_ISDIR(statbuf.st_mode))
+      {
+         name = pgmoneta_append(name, entry->d_name);
+      }
+      else if (S_ISREG(statbuf.st_mode))
+      {
+         name = sftp_restore_name(entry->d_name, restore_decode, false);
+      }
+
+      /* Tablespace links are created with their tablespace */
+      if (name != NULL)
+      {
+         to_buffer = pgmoneta_append(to_buffer, to);
+         to_buffer = pgmoneta_append(to_buffer, "/");
+         to_buffer = pgmoneta_append(to_buffer, name);
+
+         relative_buffer = pgmoneta_append(relative_buffer, relative);
+         relative_buffer = pgmoneta_append(relative_buffer, "/");
+         relative_buffer = pgmoneta_append(relative_buffer, name);
+
+         if (S_ISDIR(statbuf.st_mode))
+         {
+            if (sftp_restore_directory(context, from_buffer, to_buffer, relative_buffer, last, workers))
+            {
+               goto error;
+            }
+         }
+         else if (pgmoneta_is_restore_last_name(relative_buffer) == last)
+         {
+            if (sftp_restore_queue(from_buffer, to_buffer, false, workers))
+            {
+               goto error;
+            }
+         }
+      }
+
+      free(from_buffer);
+      free(to_buffer);
+      free(relative_buffer);
+      free(name);
+
+      from_buffer = NULL;
+      to_buffer = NULL;
+      relative_buffer = NULL;
+      name = NULL;
    }
-   else
+
+   closedir(d);
+
+   return 0;
+
+error:
+
+   if (d != NULL)
    {
-      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s/%s.partial", root, filename);
-      snprintf(file_path, sizeof(file_path), "%s/%s", root, filename);
+      closedir(d);
    }
-   if (sftp_rename(sftp, tmp_file_path, file_path) != 0)
+
+   free(from_buffer);
+   free(to_buffer);
+   free(relative_buffer);
+   free(name);
+
+   return 1;
+}
+
+static int
+sftp_restore_tablespaces(struct sftp_context* context, int server, struct backup* backup, char* from, char* root, struct workers* workers)
+{
+   char* from_tblspc = NULL;
+   char* link = NULL;
+   char* to_oid = NULL;
+   char* to_directory = NULL;
+   char* relative_directory = NULL;
+   char path[MAX_PATH];
+   char tmp_tblspc_name[MISC_LENGTH];
+   char* tblspc_name = NULL;
+   ssize_t size;
+   int idx = -1;
+   DIR* d = NULL;
+   struct dirent* entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (backup->number_of_tablespaces == 0)
    {
-      pgmoneta_log_error("could not rename file %s to %s", tmp_file_path, file_path);
+      return 0;
+   }
+
+   from_tblspc = pgmoneta_append(from_tblspc, from);
+   if (!pgmoneta_ends_with(from_tblspc, "/"))
+   {
+      from_tblspc = pgmoneta_append(from_tblspc, "/");
+   }
+   from_tblspc = pgmoneta_append(from_tblspc, "pg_tblspc/");
+
+   d = opendir(from_tblspc);
+   if (d == NULL)
+   {
+      pgmoneta_log_error("SSH: Could not open the %s directory", from_tblspc);
       goto error;
    }
 
-   sftp_close(*file);
+   while ((entry = readdir(d)))
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      link = pgmoneta_append(link, from_tblspc);
+      link = pgmoneta_append(link, entry->d_name);
+
+      memset(&path[0], 0, sizeof(path));
+      size = readlink(link, &path[0], sizeof(path) - 1);
+      if (size == -1)
+      {
+         goto error;
+      }
+
+      if (pgmoneta_ends_with(&path[0], "/"))
+      {
+         memset(&tmp_tblspc_name[0], 0, sizeof(tmp_tblspc_name));
+         memcpy(&tmp_tblspc_name[0], &path[0], strlen(&path[0]) - 1);
+
+         tblspc_name = strrchr(&tmp_tblspc_name[0], '/') + 1;
+      }
+      else
+      {
+         tblspc_name = strrchr(&path[0], '/') + 1;
+      }
+
+      idx = -1;
+      for (uint64_t i = 0; idx == -1 && i < backup->number_of_tablespaces; i++)
+      {
+         if (!strcmp(tblspc_name, backup->tablespaces[i]))
+         {
+            idx = i;
+         }
+      }
+
+      if (idx >= 0)
+      {
+         to_oid = pgmoneta_append(to_oid, root);
+         to_oid = pgmoneta_append(to_oid, "/pg_tblspc/");
+         to_oid = pgmoneta_append(to_oid, entry->d_name);
+
+         to_directory = pgmoneta_append(to_directory, remote_target.path);
+         if (!pgmoneta_ends_with(to_directory, "/"))
+         {
+            to_directory = pgmoneta_append(to_directory, "/");
+         }
+         to_directory = pgmoneta_append(to_directory, config->servers[server].name);
+         to_directory = pgmoneta_append(to_directory, "-");
+         to_directory = pgmoneta_append(to_directory, backup->label);
+         to_directory = pgmoneta_append(to_directory, "-");
+         to_directory = pgmoneta_append(to_directory, tblspc_name);
+
+         relative_directory = pgmoneta_append(relative_directory, "../../");
+         relative_directory = pgmoneta_append(relative_directory, config->servers[server].name);
+         relative_directory = pgmoneta_append(relative_directory, "-");
+         relative_directory = pgmoneta_append(relative_directory, backup->label);
+         relative_directory = pgmoneta_append(relative_directory, "-");
+         relative_directory = pgmoneta_append(relative_directory, tblspc_name);
+         relative_directory = pgmoneta_append(relative_directory, "/");
+
+         pgmoneta_log_trace("SSH: Tablespace %s -> %s", entry->d_name, to_directory);
+
+         if (sftp_symlink(context->sftp, relative_directory, to_oid) < 0)
+         {
+            pgmoneta_log_error("SSH: Could not link %s: %s", to_oid, ssh_get_error(context->session));
+            goto error;
+         }
+
+         if (sftp_restore_directory(context, &path[0], to_directory, "", false, workers))
+         {
+            goto error;
+         }
+
+         free(to_oid);
+         free(to_directory);
+         free(relative_directory);
+
+         to_oid = NULL;
+         to_directory = NULL;
+         relative_directory = NULL;
+      }
+
+      free(link);
+      link = NULL;
+   }
+
+   closedir(d);
+
+   free(from_tblspc);
 
    return 0;
 
 error:
-   sftp_close(*file);
+
+   if (d != NULL)
+   {
+      closedir(d);
+   }
+
+   free(from_tblspc);
+   free(link);
+   free(to_oid);
+   free(to_directory);
+   free(relative_directory);
+
    return 1;
 }
-static bool
-sftp_exists(char* path)
+
+static void
+sftp_restore_position(char* position, bool* primary, bool* copy_wal)
 {
-   if (sftp_stat(sftp, path) != NULL)
+   char tokens[512];
+   char* ptr = NULL;
+
+   *primary = true;
+   *copy_wal = false;
+
+   memset(&tokens[0], 0, sizeof(tokens));
+   memcpy(&tokens[0], position, MIN(strlen(position), sizeof(tokens) - 1));
+
+   ptr = strtok(&tokens[0], ",");
+
+   while (ptr != NULL)
    {
-      return true;
+      char key[256];
+      char* equal = NULL;
+
+      memset(&key[0], 0, sizeof(key));
+
+      equal = strchr(ptr, '=');
+
+      if (equal == NULL)
+      {
+         memcpy(&key[0], ptr, MIN(strlen(ptr), sizeof(key) - 1));
+      }
+      else
+      {
+         memcpy(&key[0], ptr, MIN(strlen(ptr) - strlen(equal), sizeof(key) - 1));
+      }
+
+      if (!strcmp(&key[0], "current") ||
+          !strcmp(&key[0], "immediate") ||
+          !strcmp(&key[0], "name") ||
+          !strcmp(&key[0], "xid") ||
+          !strcmp(&key[0], "lsn") ||
+          !strcmp(&key[0], "time"))
+      {
+         *copy_wal = true;
+      }
+      else if (!strcmp(&key[0], "primary"))
+      {
+         *primary = true;
+      }
+      else if (!strcmp(&key[0], "replica"))
+      {
+         *primary = false;
+      }
+
+      ptr = strtok(NULL, ",");
    }
-   return false;
 }
 
 static int
-sftp_get_file_size(char* file_path, size_t* file_size)
+sftp_restore_wal(struct sftp_context* context, int server, struct backup* backup, char* root, struct workers* workers)
 {
-   sftp_file file = NULL;
-   sftp_attributes attributes = NULL;
+   int number_of_wal_files = 0;
+   char** wal_files = NULL;
+   char* waldir = NULL;
+   char* waltarget = NULL;
+   char* name = NULL;
+   char* ff = NULL;
+   char* tf = NULL;
+   int ret = 0;
 
-   if ((file = sftp_open(sftp, file_path, O_RDONLY, 0)) == NULL)
+   waldir = pgmoneta_get_server_wal(server);
+
+   waltarget = pgmoneta_append(waltarget, root);
+   waltarget = pgmoneta_append(waltarget, "/pg_wal");
+
+   if (sftp_make_one_directory(context->sftp, waltarget, 0700))
    {
-      pgmoneta_log_error("Failed to open file: %s : %s", file_path, ssh_get_error(session));
+      ret = 1;
+   }
+
+   pgmoneta_get_files(waldir, &number_of_wal_files, &wal_files);
+
+   for (int i = 0; ret == 0 && i < number_of_wal_files; i++)
+   {
+      if (strcmp(wal_files[i], &backup->wal[0]) >= 0)
+      {
+         name = sftp_restore_name(wal_files[i], true, true);
+
+         ff = pgmoneta_append(ff, waldir);
+         if (!pgmoneta_ends_with(ff, "/"))
+         {
+            ff = pgmoneta_append(ff, "/");
+         }
+         ff = pgmoneta_append(ff, wal_files[i]);
+
+         tf = pgmoneta_append(tf, waltarget);
+         tf = pgmoneta_append(tf, "/");
+         tf = pgmoneta_append(tf, name);
+
+         ret = sftp_restore_queue(ff, tf, true, workers);
+
+         free(name);
+         free(ff);
+         free(tf);
+
+         name = NULL;
+         ff = NULL;
+         tf = NULL;
+      }
+   }
+
+   for (int i = 0; i < number_of_wal_files; i++)
+   {
+      free(wal_files[i]);
+   }
+   free(wal_files);
+
+   free(waldir);
+   free(waltarget);
+
+   return ret;
+}
+
+static int
+sftp_restore_recovery_info(struct sftp_context* context, int server, struct backup* backup, char* position, bool primary, char* from, char* root)
+{
+   char* conf = NULL;
+   char* suffix = NULL;
+   char* f = NULL;
+   char* t = NULL;
+   char* signal = NULL;
+   FILE* ffile = NULL;
+   FILE* tfile = NULL;
+   int ret = 0;
+
+   conf = primary ? "postgresql.auto.conf" : "postgresql.conf";
+
+   f = pgmoneta_append(f, from);
+   if (!pgmoneta_ends_with(f, "/"))
+   {
+      f = pgmoneta_append(f, "/");
+   }
+   f = pgmoneta_append(f, conf);
+
+   if (!pgmoneta_exists(f))
+   {
+      suffix = pgmoneta_streamer_suffix(backup->compression, backup->encryption);
+      f = pgmoneta_append(f, suffix);
+   }
+
+   if (!pgmoneta_exists(f))
+   {
+      pgmoneta_log_error("%s does not exists", f);
       goto error;
    }
 
-   if ((attributes = sftp_fstat(file)) == NULL)
+   t = pgmoneta_append(t, root);
+   t = pgmoneta_append(t, "/");
+   t = pgmoneta_append(t, conf);
+
+   /* The configuration is decoded locally, rewritten and sent once */
+   ffile = tmpfile();
+   if (ffile == NULL)
    {
-      pgmoneta_log_error("Error retrieving file attributes: %s : %s", file_path, ssh_get_error(session));
       goto error;
    }
 
-   *file_size = attributes->size;
+   if (restore_decode && (pgmoneta_is_compressed_archive(f) || pgmoneta_is_encrypted_archive(f)))
+   {
+      ret = pgmoneta_destreamer_stream(f, ffile);
+   }
+   else
+   {
+      ret = sftp_stream_copy(f, ffile);
+   }
 
-   sftp_attributes_free(attributes);
-   sftp_close(file);
+   if (ret || fflush(ffile) != 0)
+   {
+      goto error;
+   }
 
-   return 0;
+   rewind(ffile);
 
-error:
-   if (file != NULL)
+   tfile = sftp_stream_open(context, t, pgmoneta_get_permission(f));
+   if (tfile == NULL)
    {
-      sftp_close(file);
+      goto error;
    }
-   if (attributes != NULL)
+
+   if (primary)
    {
-      sftp_attributes_free(attributes);
+      ret = pgmoneta_restore_primary_conf(ffile, tfile);
+   }
+   else
+   {
+      ret = pgmoneta_restore_recovery_conf(server, position, ffile, tfile);
    }
-   return 1;
-}
 
-static int
-sftp_permission(char* path, int user, int group, int all)
-{
-   int ret;
-   mode_t mode;
-   pgmoneta_get_permission_mode(user, group, all, &mode);
-   ret = sftp_chmod(sftp, path, mode);
-   if (ret != 0)
+   if (ret)
    {
-      return 1;
+      goto error;
+   }
+
+   if (fclose(tfile) != 0)
+   {
+      tfile = NULL;
+      goto error;
+   }
+   tfile = NULL;
+
+   signal = pgmoneta_append(signal, root);
+   signal = pgmoneta_append(signal, "/standby.signal");
+
+   if (primary)
+   {
+      if (sftp_unlink(context->sftp, signal) != SSH_OK)
+      {
+         pgmoneta_log_debug("%s doesn't exists", signal);
+      }
+   }
+   else
+   {
+      tfile = sftp_stream_open(context, signal, S_IRUSR | S_IWUSR);
+      if (tfile == NULL || fclose(tfile) != 0)
+      {
+         tfile = NULL;
+         goto error;
+      }
+      tfile = NULL;
    }
 
+   fclose(ffile);
+
+   free(suffix);
+   free(f);
+   free(t);
+   free(signal);
+
    return 0;
+
+error:
+
+   if (ffile != NULL)
+   {
+      fclose(ffile);
+   }
+
+   if (tfile != NULL)
+   {
+      fclose(tfile);
+   }
+
+   free(suffix);
+   free(f);
+   free(t);
+   free(signal);
+
+   return 1;
 }
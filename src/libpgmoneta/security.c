@@ -28,13 +28,16 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <io.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
 #include <prometheus.h>
 #include <security.h>
+#include <sha256.h>
 #include <utils.h>
+#include <workers.h>
 
 /* system */
 #include <stdatomic.h>
@@ -45,16 +48,19 @@
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/md5.h>
+#include <openssl/pem.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/ssl.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #ifdef HAVE_CRC32C
@@ -75,6 +81,20 @@ _mm_crc32_u8(uint32_t crc, uint8_t value)
 #else
 #include <immintrin.h>
 #endif
+
+#include <pthread.h>
+
+/* The buffer is split in three streams, so three crc32 instructions are in flight at once */
+#define CRC32C_LONG  8192
+#define CRC32C_SHORT 256
+#define CRC32C_POLY  0x82f63b78
+
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_init(void);
+static uint32_t crc32c_hardware(uint32_t crc, unsigned char* buffer, size_t size);
 #endif
 
 #define SECURITY_INVALID  -2
@@ -85,12 +105,17 @@ _mm_crc32_u8(uint32_t crc, uint8_t value)
 #define SECURITY_SCRAM256 10
 #define SECURITY_ALL      99
 
+#define CRC32C_BUFFER_SIZE (1024 * 1024)
+
 #define NUMBER_OF_SECURITY_MESSAGES    5
 #define SECURITY_BUFFER_SIZE        1024
 
 static signed char has_security;
 static ssize_t security_lengths[NUMBER_OF_SECURITY_MESSAGES];
 static char security_messages[NUMBER_OF_SECURITY_MESSAGES][SECURITY_BUFFER_SIZE];
+static char management_session[MISC_LENGTH];
+static char source_host[MISC_LENGTH];
+static int source_port;
 
 static int get_auth_type(struct message* msg, int* auth_type);
 static int get_salt(void* data, char** salt);
@@ -114,6 +139,9 @@ static int client_proof(char* password, char* salt, int salt_length, int iterati
                         char* client_final_message_wo_proof, size_t client_final_message_wo_proof_length,
                         unsigned char** result, int* result_length);
 static int  salted_password(char* password, char* salt, int salt_length, int iterations, unsigned char** result, int* result_length);
+static int  scram_key_hash(char* password, char* salt, int salt_length, int iterations, unsigned char* hash);
+static bool scram_key_get(unsigned char* hash, unsigned char* key);
+static void scram_key_put(unsigned char* hash, unsigned char* key);
 static int  salted_password_key(unsigned char* salted_password, int salted_password_length, char* key,
                                 unsigned char** result, int* result_length);
 static int  stored_key(unsigned char* client_key, int client_key_length, unsigned char** result, int* result_length);
@@ -128,6 +156,9 @@ static int  server_signature(char* password, char* salt, int salt_length, int it
 static int  create_ssl_ctx(bool client, SSL_CTX** ctx);
 static int  create_ssl_client(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl);
 static int  create_ssl_server(SSL_CTX* ctx, int socket, SSL** ssl);
+static int  management_ssl_ctx(SSL_CTX* ctx);
+static void management_session_load(int socket, SSL* ssl);
+static int  management_session_save(SSL* ssl, SSL_SESSION* session);
 
 static int create_hash_file(char* filename, const char* algorithm, char** hash);
 
@@ -173,6 +204,12 @@ pgmoneta_remote_management_auth(int client_fd, char* address, SSL** client_ssl)
             goto error;
          }
 
+         if (management_ssl_ctx(ctx))
+         {
+            SSL_CTX_free(ctx);
+            goto error;
+         }
+
          if (create_ssl_server(ctx, client_fd, &c_ssl))
          {
             goto error;
@@ -313,6 +350,38 @@ error:
    return AUTH_ERROR;
 }
 
+int
+pgmoneta_remote_management_init(void)
+{
+   char* salt = NULL;
+   int salt_length = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (generate_salt(&salt, &salt_length))
+   {
+      goto error;
+   }
+
+   memcpy(&config->management_salt[0], salt, MANAGEMENT_SALT_LENGTH);
+
+   if (RAND_bytes(&config->management_tickets[0], MANAGEMENT_TICKET_KEYS_LENGTH) != 1)
+   {
+      goto error;
+   }
+
+   free(salt);
+
+   return 0;
+
+error:
+
+   free(salt);
+
+   return 1;
+}
+
 int
 pgmoneta_remote_management_scram_sha256(char* username, char* password, int server_fd, SSL** s_ssl)
 {
@@ -414,6 +483,8 @@ pgmoneta_remote_management_scram_sha256(char* username, char* password, int serv
 
                   *s_ssl = ssl;
 
+                  management_session_load(server_fd, ssl);
+
                   do
                   {
                      status = SSL_connect(ssl);
@@ -910,7 +981,17 @@ retry:
 
    get_scram_attribute('r', (char*)msg->data + 26, msg->length - 26, &client_nounce);
    generate_nounce(&server_nounce);
-   generate_salt(&salt, &salt_length);
+
+   /* The salt is fixed for the lifetime of the server, so the salted password is cached */
+   salt_length = MANAGEMENT_SALT_LENGTH;
+   salt = malloc(salt_length);
+
+   if (salt == NULL)
+   {
+      goto error;
+   }
+
+   memcpy(salt, &config->management_salt[0], salt_length);
    pgmoneta_base64_encode(salt, salt_length, &base64_salt, &base64_salt_length);
 
    server_first_message = malloc(89);
@@ -1061,9 +1142,24 @@ error:
    return AUTH_ERROR;
 }
 
+void
+pgmoneta_server_source(char* host, int port)
+{
+   memset(&source_host[0], 0, sizeof(source_host));
+   source_port = 0;
+
+   if (host != NULL && strlen(host) > 0)
+   {
+      snprintf(&source_host[0], sizeof(source_host), "%s", host);
+      source_port = port;
+   }
+}
+
 int
 pgmoneta_server_authenticate(int server, char* database, char* username, char* password, bool replication, SSL** ssl, int* fd)
 {
+   char* host = NULL;
+   int port;
    int server_fd;
    int auth_type;
    int ret;
@@ -1087,17 +1183,27 @@ pgmoneta_server_authenticate(int server, char* database, char* username, char* p
       memset(&security_messages[i], 0, SECURITY_BUFFER_SIZE);
    }
 
-   if (config->servers[server].host[0] == '/')
+   host = config->servers[server].host;
+   port = config->servers[server].port;
+
+   // the connections of this process can be sent to a standby of the server
+   if (strlen(source_host) > 0)
+   {
+      host = &source_host[0];
+      port = source_port;
+   }
+
+   if (host[0] == '/')
    {
       char pgsql[MISC_LENGTH];
 
       memset(&pgsql, 0, sizeof(pgsql));
-      snprintf(&pgsql[0], sizeof(pgsql), ".s.PGSQL.%d", config->servers[server].port);
-      ret = pgmoneta_connect_unix_socket(config->servers[server].host, &pgsql[0], &server_fd);
+      snprintf(&pgsql[0], sizeof(pgsql), ".s.PGSQL.%d", port);
+      ret = pgmoneta_connect_unix_socket(host, &pgsql[0], &server_fd);
    }
    else
    {
-      ret = pgmoneta_connect(config->servers[server].host, config->servers[server].port, &server_fd);
+      ret = pgmoneta_connect(host, port, &server_fd);
    }
 
    if (ret != 0)
@@ -1180,6 +1286,15 @@ pgmoneta_server_authenticate(int server, char* database, char* username, char* p
          }
       }
       while (connect != 1);
+
+#ifdef BIO_get_ktls_recv
+      if (config->ktls)
+      {
+         pgmoneta_log_debug("%s: kTLS send %s, receive %s", config->servers[server].name,
+                            BIO_get_ktls_send(SSL_get_wbio(c_ssl)) ? "on" : "off",
+                            BIO_get_ktls_recv(SSL_get_rbio(c_ssl)) ? "on" : "off");
+      }
+#endif
    }
 
    ret = pgmoneta_create_startup_message(username, database, replication, &startup_msg);
@@ -2175,8 +2290,28 @@ salted_password(char* password, char* salt, int salt_length, int iterations, uns
    unsigned char Ui[size];
    unsigned char Ui_prev[size];
    unsigned int Ui_length;
+   unsigned char hash[SCRAM_KEY_LENGTH];
+   bool cacheable = false;
    unsigned char* r = NULL;
-   HMAC_CTX* ctx = HMAC_CTX_new();
+   HMAC_CTX* ctx = NULL;
+
+   // the iterations are only run the first time for a role
+   cacheable = !scram_key_hash(password, salt, salt_length, iterations, &hash[0]);
+   if (cacheable)
+   {
+      r = malloc(size);
+      if (r != NULL && scram_key_get(&hash[0], r))
+      {
+         *result = r;
+         *result_length = size;
+
+         return 0;
+      }
+      free(r);
+      r = NULL;
+   }
+
+   ctx = HMAC_CTX_new();
 
    if (ctx == NULL)
    {
@@ -2248,6 +2383,11 @@ salted_password(char* password, char* salt, int salt_length, int iterations, uns
       memcpy(&Ui_prev[0], &Ui[0], size);
    }
 
+   if (cacheable)
+   {
+      scram_key_put(&hash[0], r);
+   }
+
    *result = r;
    *result_length = size;
 
@@ -2268,6 +2408,109 @@ error:
    return 1;
 }
 
+static int
+scram_key_hash(char* password, char* salt, int salt_length, int iterations, unsigned char* hash)
+{
+   unsigned int length = 0;
+   EVP_MD_CTX* ctx = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config == NULL)
+   {
+      return 1;
+   }
+
+   ctx = EVP_MD_CTX_new();
+   if (ctx == NULL)
+   {
+      goto error;
+   }
+
+   if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1 ||
+       EVP_DigestUpdate(ctx, password, strlen(password) + 1) != 1 ||
+       EVP_DigestUpdate(ctx, salt, salt_length) != 1 ||
+       EVP_DigestUpdate(ctx, &iterations, sizeof(iterations)) != 1 ||
+       EVP_DigestFinal_ex(ctx, hash, &length) != 1 ||
+       length != SCRAM_KEY_LENGTH)
+   {
+      goto error;
+   }
+
+   EVP_MD_CTX_free(ctx);
+
+   return 0;
+
+error:
+
+   EVP_MD_CTX_free(ctx);
+
+   return 1;
+}
+
+static bool
+scram_key_get(unsigned char* hash, unsigned char* key)
+{
+   bool found = false;
+   signed char isfree;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+retry:
+   isfree = STATE_FREE;
+
+   if (atomic_compare_exchange_strong(&config->scram_lock, &isfree, STATE_IN_USE))
+   {
+      for (int i = 0; !found && i < NUMBER_OF_SERVERS; i++)
+      {
+         if (config->scram_keys[i].valid && !memcmp(config->scram_keys[i].hash, hash, SCRAM_KEY_LENGTH))
+         {
+            memcpy(key, config->scram_keys[i].key, SCRAM_KEY_LENGTH);
+            found = true;
+         }
+      }
+
+      atomic_store(&config->scram_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry)
+   }
+
+   return found;
+}
+
+static void
+scram_key_put(unsigned char* hash, unsigned char* key)
+{
+   signed char isfree;
+   struct scram_key* k = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+retry:
+   isfree = STATE_FREE;
+
+   if (atomic_compare_exchange_strong(&config->scram_lock, &isfree, STATE_IN_USE))
+   {
+      k = &config->scram_keys[config->scram_next];
+      config->scram_next = (config->scram_next + 1) % NUMBER_OF_SERVERS;
+
+      memcpy(k->hash, hash, SCRAM_KEY_LENGTH);
+      memcpy(k->key, key, SCRAM_KEY_LENGTH);
+      k->valid = true;
+
+      atomic_store(&config->scram_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry)
+   }
+}
+
 static int
 salted_password_key(unsigned char* salted_password, int salted_password_length, char* key, unsigned char** result, int* result_length)
 {
@@ -2520,6 +2763,10 @@ static int
 create_ssl_ctx(bool client, SSL_CTX** ctx)
 {
    SSL_CTX* c = NULL;
+   bool ktls = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    if (client)
    {
@@ -2544,6 +2791,26 @@ create_ssl_ctx(bool client, SSL_CTX** ctx)
    SSL_CTX_set_options(c, SSL_OP_NO_TICKET);
    SSL_CTX_set_session_cache_mode(c, SSL_SESS_CACHE_OFF);
 
+   if (client)
+   {
+      if (config != NULL && config->ktls)
+      {
+#ifdef SSL_OP_ENABLE_KTLS
+         SSL_CTX_set_options(c, SSL_OP_ENABLE_KTLS);
+         ktls = true;
+#else
+         pgmoneta_log_warn("ktls: Not supported by OpenSSL");
+#endif
+      }
+
+      /* kTLS can't take over a connection with buffered records, so read ahead only without it */
+      if (!ktls)
+      {
+         SSL_CTX_set_read_ahead(c, 1);
+         SSL_CTX_set_default_read_buffer_len(c, SSL3_RT_MAX_PLAIN_LENGTH * 4);
+      }
+   }
+
    *ctx = c;
 
    return 0;
@@ -2754,7 +3021,7 @@ create_hash_file(char* filename, const char* algorithm, char** hash)
    const EVP_MD* md;
    unsigned char md_value[EVP_MAX_MD_SIZE];
    unsigned int md_len;
-   FILE* file = NULL;
+   struct io_reader* reader = NULL;
    char read_buf[16384];
    unsigned long read_bytes = 0;
    char* hash_buf;
@@ -2801,27 +3068,41 @@ create_hash_file(char* filename, const char* algorithm, char** hash)
       return 1;
    }
 
-   file = fopen(filename, "rb");
-   if (file == NULL)
+   if (pgmoneta_io_reader_open(filename, 0, 0, &reader))
    {
+      free(hash_buf);
+      EVP_MD_CTX_free(md_ctx);
       return 1;
    }
 
    memset(read_buf, 0, sizeof(read_buf));
 
-   while ((read_bytes = fread(read_buf, 1, sizeof(read_buf), file)) > 0)
+   while ((read_bytes = pgmoneta_io_reader_read(reader, read_buf, sizeof(read_buf))) > 0)
    {
       if (!EVP_DigestUpdate(md_ctx, read_buf, read_bytes))
       {
          pgmoneta_log_error("Message digest update failed");
+         pgmoneta_io_reader_close(reader);
+         free(hash_buf);
          EVP_MD_CTX_free(md_ctx);
          return 1;
       }
    }
 
+   if (pgmoneta_io_reader_error(reader))
+   {
+      pgmoneta_log_error("Could not read %s", filename);
+      pgmoneta_io_reader_close(reader);
+      free(hash_buf);
+      EVP_MD_CTX_free(md_ctx);
+      return 1;
+   }
+
    if (!EVP_DigestFinal_ex(md_ctx, md_value, &md_len))
    {
       pgmoneta_log_error("Message digest finalization failed");
+      pgmoneta_io_reader_close(reader);
+      free(hash_buf);
       EVP_MD_CTX_free(md_ctx);
       return 1;
    }
@@ -2836,7 +3117,7 @@ create_hash_file(char* filename, const char* algorithm, char** hash)
    hash_buf[hash_len - 1] = 0;
    *hash = hash_buf;
 
-   fclose(file);
+   pgmoneta_io_reader_close(reader);
 
    return 0;
 }
@@ -2850,7 +3131,7 @@ pgmoneta_create_sha224_file(char* filename, char** sha224)
 int
 pgmoneta_create_sha256_file(char* filename, char** sha256)
 {
-   return create_hash_file(filename, "SHA256", sha256);
+   return pgmoneta_sha256_file(filename, sha256);
 }
 
 int
@@ -2963,22 +3244,7 @@ pgmoneta_create_crc32c_buffer(void* buffer, size_t size, uint32_t* crc)
 
    #ifdef HAVE_CRC32C
 
-   uint64_t crc_long = (uint64_t) ~(*crc);
-
-   for (int i = 0; i < size / 8; i++)
-   {
-      crc_long = _mm_crc32_u64(crc_long, *((uint64_t*)buffer));
-      buffer += 8;
-   }
-   for (int i = 0; i < (size % 8); i++)
-   {
-      crc_long = (uint64_t)_mm_crc32_u8((uint32_t)crc_long, *((unsigned char*)buffer));
-      buffer++;
-   }
-
-   crc_long = ~crc_long;
-
-   *crc = (uint32_t)crc_long;
+   *crc = crc32c_hardware(*crc, (unsigned char*)buffer, size);
    return 0;
 
    #else
@@ -3067,7 +3333,7 @@ int
 pgmoneta_create_crc32c_file(char* path, char** crc)
 {
    FILE* file = NULL;
-   char read_buf[16384];
+   char* read_buf = NULL;
    unsigned long read_bytes = 0;
    char* crc_string;
    uint32_t crc_buf = 0;
@@ -3079,9 +3345,14 @@ pgmoneta_create_crc32c_file(char* path, char** crc)
       goto error;
    }
 
-   memset(read_buf, 0, sizeof(read_buf));
+   // large reads keep the crc32 instructions busy instead of waiting on fread
+   read_buf = (char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, CRC32C_BUFFER_SIZE);
+   if (read_buf == NULL)
+   {
+      goto error;
+   }
 
-   while ((read_bytes = fread(read_buf, 1, sizeof(read_buf), file)) > 0)
+   while ((read_bytes = fread(read_buf, 1, CRC32C_BUFFER_SIZE, file)) > 0)
    {
       pgmoneta_create_crc32c_buffer(read_buf, read_bytes, &crc_buf);
    }
@@ -3123,7 +3394,7 @@ pgmoneta_create_file_hash(int algorithm, char* file_path, char** hash)
    switch (algorithm)
    {
       case HASH_ALGORITHM_CRC32C:
-         pgmoneta_create_crc32c_file(file_path, hash);
+         stat = pgmoneta_create_crc32c_file(file_path, hash);
          break;
       case HASH_ALGORITHM_SHA224:
          stat = pgmoneta_create_sha224_file(file_path, hash);
@@ -3191,3 +3462,305 @@ pgmoneta_get_hash_algorithm(char* algorithm)
 
    return HASH_ALGORITHM_SHA256;
 }
+
+#ifdef HAVE_CRC32C
+static uint32_t
+gf2_matrix_times(uint32_t* mat, uint32_t vec)
+{
+   uint32_t sum = 0;
+
+   while (vec)
+   {
+      if (vec & 1)
+      {
+         sum ^= *mat;
+      }
+      vec >>= 1;
+      mat++;
+   }
+
+   return sum;
+}
+
+static void
+gf2_matrix_square(uint32_t* square, uint32_t* mat)
+{
+   for (int n = 0; n < 32; n++)
+   {
+      square[n] = gf2_matrix_times(mat, mat[n]);
+   }
+}
+
+static void
+crc32c_zeros_op(uint32_t* even, size_t len)
+{
+   uint32_t odd[32];
+   uint32_t row = 1;
+
+   // The operator for one zero bit
+   odd[0] = CRC32C_POLY;
+   for (int n = 1; n < 32; n++)
+   {
+      odd[n] = row;
+      row <<= 1;
+   }
+
+   // Two and four zero bits
+   gf2_matrix_square(even, odd);
+   gf2_matrix_square(odd, even);
+
+   // Each square doubles the zero bits, starting from one byte
+   do
+   {
+      gf2_matrix_square(even, odd);
+      len >>= 1;
+      if (len == 0)
+      {
+         return;
+      }
+      gf2_matrix_square(odd, even);
+      len >>= 1;
+   }
+   while (len);
+
+   for (int n = 0; n < 32; n++)
+   {
+      even[n] = odd[n];
+   }
+}
+
+static void
+crc32c_zeros(uint32_t zeros[][256], size_t len)
+{
+   uint32_t op[32];
+
+   crc32c_zeros_op(op, len);
+
+   for (uint32_t n = 0; n < 256; n++)
+   {
+      zeros[0][n] = gf2_matrix_times(op, n);
+      zeros[1][n] = gf2_matrix_times(op, n << 8);
+      zeros[2][n] = gf2_matrix_times(op, n << 16);
+      zeros[3][n] = gf2_matrix_times(op, n << 24);
+   }
+}
+
+static void
+crc32c_init(void)
+{
+   crc32c_zeros(crc32c_long, CRC32C_LONG);
+   crc32c_zeros(crc32c_short, CRC32C_SHORT);
+}
+
+static inline uint32_t
+crc32c_shift(uint32_t zeros[][256], uint32_t crc)
+{
+   return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+          zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+static uint32_t
+crc32c_hardware(uint32_t crc, unsigned char* buffer, size_t size)
+{
+   uint64_t crc0;
+   uint64_t crc1;
+   uint64_t crc2;
+   unsigned char* end;
+   uint64_t value;
+
+   pthread_once(&crc32c_once, crc32c_init);
+
+   crc0 = (uint64_t)(uint32_t) ~crc;
+
+   while (size > 0 && ((uintptr_t)buffer & 7) != 0)
+   {
+      crc0 = _mm_crc32_u8((uint32_t)crc0, *buffer);
+      buffer++;
+      size--;
+   }
+
+   // Three streams, which are combined by shifting the earlier ones over the later ones
+   while (size >= CRC32C_LONG * 3)
+   {
+      crc1 = 0;
+      crc2 = 0;
+      end = buffer + CRC32C_LONG;
+      do
+      {
+         crc0 = _mm_crc32_u64(crc0, *(uint64_t*)buffer);
+         crc1 = _mm_crc32_u64(crc1, *(uint64_t*)(buffer + CRC32C_LONG));
+         crc2 = _mm_crc32_u64(crc2, *(uint64_t*)(buffer + CRC32C_LONG * 2));
+         buffer += 8;
+      }
+      while (buffer < end);
+      crc0 = crc32c_shift(crc32c_long, (uint32_t)crc0) ^ crc1;
+      crc0 = crc32c_shift(crc32c_long, (uint32_t)crc0) ^ crc2;
+      buffer += CRC32C_LONG * 2;
+      size -= CRC32C_LONG * 3;
+   }
+
+   while (size >= CRC32C_SHORT * 3)
+   {
+      crc1 = 0;
+      crc2 = 0;
+      end = buffer + CRC32C_SHORT;
+      do
+      {
+         crc0 = _mm_crc32_u64(crc0, *(uint64_t*)buffer);
+         crc1 = _mm_crc32_u64(crc1, *(uint64_t*)(buffer + CRC32C_SHORT));
+         crc2 = _mm_crc32_u64(crc2, *(uint64_t*)(buffer + CRC32C_SHORT * 2));
+         buffer += 8;
+      }
+      while (buffer < end);
+      crc0 = crc32c_shift(crc32c_short, (uint32_t)crc0) ^ crc1;
+      crc0 = crc32c_shift(crc32c_short, (uint32_t)crc0) ^ crc2;
+      buffer += CRC32C_SHORT * 2;
+      size -= CRC32C_SHORT * 3;
+   }
+
+   while (size >= 8)
+   {
+      memcpy(&value, buffer, 8);
+      crc0 = _mm_crc32_u64(crc0, value);
+      buffer += 8;
+      size -= 8;
+   }
+
+   while (size > 0)
+   {
+      crc0 = _mm_crc32_u8((uint32_t)crc0, *buffer);
+      buffer++;
+      size--;
+   }
+
+   return (uint32_t) ~crc0;
+}
+#endif
+
+static int
+management_ssl_ctx(SSL_CTX* ctx)
+{
+   long length;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   /* The ticket keys are shared, so any process can resume the session of a management client */
+   length = SSL_CTX_get_tlsext_ticket_keys(ctx, NULL, 0);
+   if (length <= 0 || length > MANAGEMENT_TICKET_KEYS_LENGTH)
+   {
+      return 0;
+   }
+
+   if (SSL_CTX_set_tlsext_ticket_keys(ctx, &config->management_tickets[0], length) != 1)
+   {
+      goto error;
+   }
+
+   if (SSL_CTX_set_session_id_context(ctx, (unsigned char*)"pgmoneta", strlen("pgmoneta")) != 1)
+   {
+      goto error;
+   }
+
+   SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+management_session_load(int socket, SSL* ssl)
+{
+   struct sockaddr_storage addr;
+   socklen_t addr_length = sizeof(addr);
+   char host[INET6_ADDRSTRLEN];
+   int port;
+   FILE* file = NULL;
+   SSL_SESSION* session = NULL;
+
+   memset(&management_session, 0, sizeof(management_session));
+   memset(&host, 0, sizeof(host));
+
+   if (getpeername(socket, (struct sockaddr*)&addr, &addr_length) == -1)
+   {
+      return;
+   }
+
+   if (addr.ss_family == AF_INET)
+   {
+      inet_ntop(AF_INET, &((struct sockaddr_in*)&addr)->sin_addr, &host[0], sizeof(host));
+      port = ntohs(((struct sockaddr_in*)&addr)->sin_port);
+   }
+   else if (addr.ss_family == AF_INET6)
+   {
+      inet_ntop(AF_INET6, &((struct sockaddr_in6*)&addr)->sin6_addr, &host[0], sizeof(host));
+      port = ntohs(((struct sockaddr_in6*)&addr)->sin6_port);
+   }
+   else
+   {
+      return;
+   }
+
+   snprintf(&management_session[0], sizeof(management_session), "%s/.pgmoneta/%s_%d.session",
+            pgmoneta_get_home_directory(), &host[0], port);
+
+   SSL_clear_options(ssl, SSL_OP_NO_TICKET);
+   SSL_CTX_set_session_cache_mode(SSL_get_SSL_CTX(ssl), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+   SSL_CTX_sess_set_new_cb(SSL_get_SSL_CTX(ssl), management_session_save);
+
+   file = fopen(&management_session[0], "r");
+   if (file == NULL)
+   {
+      return;
+   }
+
+   session = PEM_read_SSL_SESSION(file, NULL, NULL, NULL);
+   if (session != NULL)
+   {
+      SSL_set_session(ssl, session);
+      SSL_SESSION_free(session);
+   }
+
+   fclose(file);
+}
+
+static int
+management_session_save(SSL* ssl, SSL_SESSION* session)
+{
+   int fd;
+   FILE* file = NULL;
+
+   if (strlen(management_session) == 0)
+   {
+      return 0;
+   }
+
+   /* The session holds the secret of the connection, so only the user may read it */
+   fd = open(&management_session[0], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+   if (fd == -1)
+   {
+      return 0;
+   }
+
+   if (fchmod(fd, S_IRUSR | S_IWUSR) == -1)
+   {
+      close(fd);
+      return 0;
+   }
+
+   file = fdopen(fd, "w");
+   if (file == NULL)
+   {
+      close(fd);
+      return 0;
+   }
+
+   PEM_write_SSL_SESSION(file, session);
+
+   fclose(file);
+
+   return 0;
+}
@@ -52,6 +52,9 @@ static int get_segment_size(SSL* ssl, int socket, int server, size_t* segsz);
 static int get_block_size(SSL* ssl, int socket, int server, size_t* blocksz);
 static int get_summarize_wal(SSL* ssl, int socket, int server, bool* sw);
 
+static int query_source(int server, int usr, char* host, int port, char* sql, struct query_response** response);
+static uint64_t parse_lsn(char* lsn);
+
 static bool is_valid_response(struct query_response* response);
 
 void
@@ -257,6 +260,206 @@ pgmoneta_server_valid(int srv)
    return true;
 }
 
+int
+pgmoneta_server_backup_source(int srv, char* host, size_t length, int* port)
+{
+   int usr;
+   int standby_port;
+   uint64_t primary_lsn;
+   uint64_t replay_lsn;
+   uint64_t lag;
+   uint64_t best = UINT64_MAX;
+   char system_identifier[MISC_LENGTH];
+   char standbys[MAX_PATH];
+   char* token = NULL;
+   char* saveptr = NULL;
+   char* standby = NULL;
+   char* colon = NULL;
+   struct query_response* response = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(host, 0, length);
+   *port = config->servers[srv].port;
+
+   if (strlen(config->servers[srv].backup_standbys) == 0)
+   {
+      return 0;
+   }
+
+   usr = -1;
+   for (int i = 0; usr == -1 && i < config->number_of_users; i++)
+   {
+      if (!strcmp(config->servers[srv].username, config->users[i].username))
+      {
+         usr = i;
+      }
+   }
+
+   if (usr == -1)
+   {
+      goto error;
+   }
+
+   if (query_source(srv, usr, NULL, 0, "SELECT pg_current_wal_lsn(), system_identifier FROM pg_control_system();", &response))
+   {
+      pgmoneta_log_error("Backup: Unable to get the WAL position of %s", config->servers[srv].name);
+      goto error;
+   }
+
+   primary_lsn = parse_lsn(response->tuples->data[0]);
+   memset(&system_identifier[0], 0, sizeof(system_identifier));
+   snprintf(&system_identifier[0], sizeof(system_identifier), "%s", response->tuples->data[1] != NULL ? response->tuples->data[1] : "");
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   memset(&standbys[0], 0, sizeof(standbys));
+   memcpy(&standbys[0], config->servers[srv].backup_standbys, sizeof(standbys) - 1);
+
+   token = strtok_r(&standbys[0], ",", &saveptr);
+   while (token != NULL)
+   {
+      standby = pgmoneta_remove_whitespace(token);
+      standby_port = config->servers[srv].port;
+
+      // a unix socket directory has no port in it
+      colon = strrchr(standby, ':');
+      if (colon != NULL && standby[0] != '/')
+      {
+         *colon = '\0';
+         standby_port = pgmoneta_atoi(colon + 1);
+      }
+
+      if (strlen(standby) == 0 || standby_port <= 0)
+      {
+         pgmoneta_log_warn("Backup: Invalid standby '%s' for %s", token, config->servers[srv].name);
+      }
+      else if (query_source(srv, usr, standby, standby_port,
+                            "SELECT pg_is_in_recovery(), pg_last_wal_replay_lsn(), system_identifier FROM pg_control_system();",
+                            &response))
+      {
+         pgmoneta_log_warn("Backup: Standby %s:%d of %s is not available", standby, standby_port, config->servers[srv].name);
+      }
+      else if (strcmp(response->tuples->data[0], "t") || response->tuples->data[1] == NULL)
+      {
+         pgmoneta_log_warn("Backup: %s:%d is not a standby of %s", standby, standby_port, config->servers[srv].name);
+      }
+      else if (response->tuples->data[2] == NULL || strcmp(response->tuples->data[2], system_identifier))
+      {
+         pgmoneta_log_warn("Backup: %s:%d is a standby of another system than %s", standby, standby_port, config->servers[srv].name);
+      }
+      else
+      {
+         replay_lsn = parse_lsn(response->tuples->data[1]);
+         lag = primary_lsn > replay_lsn ? primary_lsn - replay_lsn : 0;
+
+         pgmoneta_log_debug("Backup: %s:%d of %s has a replay lag of %llu bytes", standby, standby_port, config->servers[srv].name,
+                            (unsigned long long)lag);
+
+         if (lag < best)
+         {
+            best = lag;
+            snprintf(host, length, "%s", standby);
+            *port = standby_port;
+         }
+      }
+
+      pgmoneta_free_query_response(response);
+      response = NULL;
+      free(standby);
+      standby = NULL;
+
+      token = strtok_r(NULL, ",", &saveptr);
+   }
+
+   if (strlen(host) == 0)
+   {
+      pgmoneta_log_warn("Backup: No standby of %s is available, using the primary", config->servers[srv].name);
+      *port = config->servers[srv].port;
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_free_query_response(response);
+   free(standby);
+
+   return 1;
+}
+
+static int
+query_source(int server, int usr, char* host, int port, char* sql, struct query_response** response)
+{
+   int auth;
+   SSL* ssl = NULL;
+   int socket = -1;
+   struct message* query_msg = NULL;
+   struct query_response* r = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *response = NULL;
+
+   pgmoneta_server_source(host, port);
+   auth = pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket);
+   pgmoneta_server_source(NULL, 0);
+
+   if (auth != AUTH_SUCCESS)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_create_query_message(sql, &query_msg) != MESSAGE_STATUS_OK)
+   {
+      goto error;
+   }
+
+   pgmoneta_query_execute(ssl, socket, query_msg, &r);
+
+   if (!is_valid_response(r))
+   {
+      goto error;
+   }
+
+   pgmoneta_write_terminate(ssl, socket);
+   pgmoneta_close_ssl(ssl);
+   pgmoneta_disconnect(socket);
+   pgmoneta_free_message(query_msg);
+
+   *response = r;
+
+   return 0;
+
+error:
+
+   pgmoneta_free_query_response(r);
+   pgmoneta_free_message(query_msg);
+   pgmoneta_close_ssl(ssl);
+   if (socket != -1)
+   {
+      pgmoneta_disconnect(socket);
+   }
+
+   return 1;
+}
+
+static uint64_t
+parse_lsn(char* lsn)
+{
+   uint32_t high = 0;
+   uint32_t low = 0;
+
+   if (lsn == NULL || sscanf(lsn, "%X/%X", &high, &low) != 2)
+   {
+      return 0;
+   }
+
+   return ((uint64_t)high << 32) | low;
+}
+
 static int
 get_wal_size(SSL* ssl, int socket, int server, int* ws)
 {
@@ -0,0 +1,804 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <csv.h>
+#include <deque.h>
+#include <io.h>
+#include <logging.h>
+#include <sha256.h>
+#include <utils.h>
+#include <workers.h>
+
+/* system */
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_HAVE_AVX2
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint32_t sha256_initial[8] = {
+   0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#ifdef SHA256_HAVE_AVX2
+static const uint32_t sha256_k[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void sha256_avx2_block(uint32_t state[8][SHA256_LANES], const unsigned char* blocks[SHA256_LANES]);
+static void sha256_avx2_buffers(unsigned char** data, size_t* sizes, int count, unsigned char digests[][SHA256_LENGTH]);
+#endif
+
+static int sha256_lanes(struct sha256_job* jobs, int* lanes, unsigned char** data, size_t* sizes, int count);
+static int sha256_evp_buffer(unsigned char* data, size_t size, unsigned char* digest);
+static EVP_MD_CTX* sha256_context(void);
+static void sha256_free_context(void* context);
+static char* sha256_index_path(char* backup_base);
+
+bool
+pgmoneta_sha256_multi_buffer(void)
+{
+#ifdef SHA256_HAVE_AVX2
+   static int supported = -1;
+   unsigned int eax = 0;
+   unsigned int ebx = 0;
+   unsigned int ecx = 0;
+   unsigned int edx = 0;
+
+   if (supported == -1)
+   {
+      __builtin_cpu_init();
+      supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+
+      // a single stream on the SHA extensions is faster than eight AVX2 lanes
+      if (supported == 1 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA))
+      {
+         supported = 0;
+      }
+   }
+
+   return supported == 1;
+#else
+   return false;
+#endif
+}
+
+int
+pgmoneta_sha256_buffers(unsigned char** data, size_t* sizes, int number_of_buffers, unsigned char digests[][SHA256_LENGTH])
+{
+   int i = 0;
+
+#ifdef SHA256_HAVE_AVX2
+   if (pgmoneta_sha256_multi_buffer())
+   {
+      // a lone buffer would leave seven lanes idle
+      for (; i + 1 < number_of_buffers; i += SHA256_LANES)
+      {
+         int count = number_of_buffers - i < SHA256_LANES ? number_of_buffers - i : SHA256_LANES;
+
+         sha256_avx2_buffers(&data[i], &sizes[i], count, &digests[i]);
+      }
+   }
+#endif
+
+   for (; i < number_of_buffers; i++)
+   {
+      if (sha256_evp_buffer(data[i], sizes[i], digests[i]))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_sha256_file(char* path, char** sha256)
+{
+   return pgmoneta_sha256_file_range(path, 0, 0, sha256);
+}
+
+int
+pgmoneta_sha256_file_range(char* path, off_t offset, size_t size, char** sha256)
+{
+   EVP_MD_CTX* ctx = NULL;
+   struct io_reader* reader = NULL;
+   unsigned char* buffer = NULL;
+   unsigned char digest[SHA256_LENGTH];
+   unsigned int length = 0;
+   size_t read_bytes = 0;
+
+   *sha256 = NULL;
+
+   ctx = sha256_context();
+   if (ctx == NULL)
+   {
+      goto error;
+   }
+
+   buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, SHA256_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_io_reader_open(path, offset, size, &reader))
+   {
+      goto error;
+   }
+
+   // OpenSSL picks the SHA extensions of the CPU for the compression function
+   if (!EVP_DigestInit_ex(ctx, EVP_sha256(), NULL))
+   {
+      pgmoneta_log_error("Message digest initialization failed");
+      goto error;
+   }
+
+   while ((read_bytes = pgmoneta_io_reader_read(reader, buffer, SHA256_BUFFER_SIZE)) > 0)
+   {
+      if (!EVP_DigestUpdate(ctx, buffer, read_bytes))
+      {
+         pgmoneta_log_error("Message digest update failed");
+         goto error;
+      }
+   }
+
+   if (pgmoneta_io_reader_error(reader))
+   {
+      goto error;
+   }
+
+   if (!EVP_DigestFinal_ex(ctx, digest, &length))
+   {
+      pgmoneta_log_error("Message digest finalization failed");
+      goto error;
+   }
+
+   pgmoneta_io_reader_close(reader);
+
+   pgmoneta_sha256_hex(digest, sha256);
+
+   return *sha256 == NULL ? 1 : 0;
+
+error:
+
+   pgmoneta_io_reader_close(reader);
+
+   return 1;
+}
+
+int
+pgmoneta_sha256_files(struct sha256_job* jobs, int number_of_jobs)
+{
+   int lanes[SHA256_LANES];
+   unsigned char* data[SHA256_LANES];
+   size_t sizes[SHA256_LANES];
+   unsigned char* buffer = NULL;
+   int count = 0;
+   int result = 0;
+   struct stat st;
+
+   for (int i = 0; i < number_of_jobs; i++)
+   {
+      jobs[i].sha256 = NULL;
+
+      if (stat(jobs[i].path, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > SHA256_SMALL_FILE)
+      {
+         if (pgmoneta_sha256_file(jobs[i].path, &jobs[i].sha256))
+         {
+            result = 1;
+         }
+      }
+   }
+
+   for (int i = 0; i < number_of_jobs; i++)
+   {
+      FILE* file = NULL;
+      size_t size = 0;
+
+      if (jobs[i].sha256 != NULL)
+      {
+         continue;
+      }
+
+      if (count == 0)
+      {
+         // fetched per batch as the large file path shares the buffer
+         buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, SHA256_BUFFER_SIZE);
+         if (buffer == NULL)
+         {
+            return 1;
+         }
+      }
+
+      data[count] = buffer + count * (SHA256_SMALL_FILE + 1);
+
+      file = fopen(jobs[i].path, "rb");
+      if (file == NULL)
+      {
+         result = 1;
+         continue;
+      }
+
+      size = fread(data[count], 1, SHA256_SMALL_FILE + 1, file);
+      if (ferror(file))
+      {
+         fclose(file);
+         result = 1;
+         continue;
+      }
+      fclose(file);
+
+      if (size > SHA256_SMALL_FILE)
+      {
+         // the file grew since it was examined, the lanes are hashed before the buffer is reused
+         if (sha256_lanes(jobs, lanes, data, sizes, count))
+         {
+            return 1;
+         }
+         count = 0;
+
+         if (pgmoneta_sha256_file(jobs[i].path, &jobs[i].sha256))
+         {
+            result = 1;
+         }
+         continue;
+      }
+
+      sizes[count] = size;
+      lanes[count] = i;
+      count++;
+
+      if (count == SHA256_LANES)
+      {
+         if (sha256_lanes(jobs, lanes, data, sizes, count))
+         {
+            return 1;
+         }
+         count = 0;
+      }
+   }
+
+   if (sha256_lanes(jobs, lanes, data, sizes, count))
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < number_of_jobs; i++)
+   {
+      if (jobs[i].sha256 == NULL)
+      {
+         result = 1;
+      }
+   }
+
+   return result;
+}
+
+int
+pgmoneta_sha256_index_write(char* backup_base, struct deque* hashes)
+{
+   char* index_path = NULL;
+   char* tmp_path = NULL;
+   struct csv_writer* writer = NULL;
+   struct deque_iterator* iter = NULL;
+   size_t base_length = 0;
+
+   index_path = sha256_index_path(backup_base);
+   tmp_path = pgmoneta_append(tmp_path, index_path);
+   tmp_path = pgmoneta_append(tmp_path, ".tmp");
+
+   if (pgmoneta_csv_writer_init(tmp_path, &writer))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_iterator_create(hashes, &iter))
+   {
+      goto error;
+   }
+
+   base_length = strlen(backup_base);
+
+   while (pgmoneta_deque_iterator_next(iter))
+   {
+      struct stat st;
+      char size[MISC_LENGTH];
+      char mtime[MISC_LENGTH];
+      char* relative = iter->tag;
+      char* cols[4];
+
+      if (strncmp(relative, backup_base, base_length) || stat(iter->tag, &st))
+      {
+         continue;
+      }
+
+      relative += base_length;
+      while (*relative == '/')
+      {
+         relative++;
+      }
+
+      memset(size, 0, sizeof(size));
+      memset(mtime, 0, sizeof(mtime));
+      snprintf(size, sizeof(size), "%lld", (long long)st.st_size);
+      snprintf(mtime, sizeof(mtime), "%lld.%09ld", (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+
+      cols[0] = relative;
+      cols[1] = (char*)iter->value->data;
+      cols[2] = size;
+      cols[3] = mtime;
+
+      pgmoneta_csv_write(writer, 4, cols);
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+   iter = NULL;
+
+   pgmoneta_csv_writer_destroy(writer);
+   writer = NULL;
+
+   if (rename(tmp_path, index_path))
+   {
+      goto error;
+   }
+
+   free(index_path);
+   free(tmp_path);
+
+   return 0;
+
+error:
+   pgmoneta_deque_iterator_destroy(iter);
+   pgmoneta_csv_writer_destroy(writer);
+   if (tmp_path != NULL)
+   {
+      remove(tmp_path);
+   }
+
+   free(index_path);
+   free(tmp_path);
+
+   return 1;
+}
+
+int
+pgmoneta_sha256_index_read(char* backup_base, struct art** index)
+{
+   char* index_path = NULL;
+   struct csv_reader* reader = NULL;
+   struct art* a = NULL;
+   char** cols = NULL;
+   int number_of_columns = 0;
+
+   *index = NULL;
+
+   index_path = sha256_index_path(backup_base);
+
+   if (!pgmoneta_exists(index_path))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_csv_reader_init(index_path, &reader))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_art_create(&a))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_csv_next_row(reader, &number_of_columns, &cols))
+   {
+      if (number_of_columns == 4)
+      {
+         char value[MISC_LENGTH * 2];
+
+         memset(value, 0, sizeof(value));
+         snprintf(value, sizeof(value), "%s %s %s", cols[1], cols[2], cols[3]);
+
+         pgmoneta_art_insert(a, cols[0], (uintptr_t)value, ValueString);
+      }
+
+      free(cols);
+      cols = NULL;
+   }
+
+   pgmoneta_csv_reader_destroy(reader);
+   free(index_path);
+
+   *index = a;
+
+   return 0;
+
+error:
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_art_destroy(a);
+   free(index_path);
+
+   return 1;
+}
+
+char*
+pgmoneta_sha256_index_lookup(struct art* index, char* relative, char* path)
+{
+   char* value = NULL;
+   char sha256[SHA256_HEX_LENGTH];
+   long long size = 0;
+   long long seconds = 0;
+   long nanoseconds = 0;
+   struct stat st;
+
+   if (index == NULL || relative == NULL)
+   {
+      return NULL;
+   }
+
+   while (*relative == '/')
+   {
+      relative++;
+   }
+
+   value = (char*)pgmoneta_art_search(index, relative);
+   if (value == NULL)
+   {
+      return NULL;
+   }
+
+   memset(sha256, 0, sizeof(sha256));
+   if (sscanf(value, "%64s %lld %lld.%ld", sha256, &size, &seconds, &nanoseconds) != 4)
+   {
+      return NULL;
+   }
+
+   // compressed, encrypted or rewritten files no longer match their entry
+   if (stat(path, &st) || st.st_size != size ||
+       st.st_mtim.tv_sec != seconds || st.st_mtim.tv_nsec != nanoseconds)
+   {
+      return NULL;
+   }
+
+   return pgmoneta_append(NULL, sha256);
+}
+
+static char*
+sha256_index_path(char* backup_base)
+{
+   char* path = NULL;
+
+   path = pgmoneta_append(path, backup_base);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   path = pgmoneta_append(path, SHA256_INDEX);
+
+   return path;
+}
+
+static int
+sha256_lanes(struct sha256_job* jobs, int* lanes, unsigned char** data, size_t* sizes, int count)
+{
+   unsigned char digests[SHA256_LANES][SHA256_LENGTH];
+
+   if (count == 0)
+   {
+      return 0;
+   }
+
+   if (pgmoneta_sha256_buffers(data, sizes, count, digests))
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < count; i++)
+   {
+      pgmoneta_sha256_hex(digests[i], &jobs[lanes[i]].sha256);
+   }
+
+   return 0;
+}
+
+#ifdef SHA256_HAVE_AVX2
+
+#define ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define BSIG0(x) _mm256_xor_si256(_mm256_xor_si256(ROTR(x, 2), ROTR(x, 13)), ROTR(x, 22))
+#define BSIG1(x) _mm256_xor_si256(_mm256_xor_si256(ROTR(x, 6), ROTR(x, 11)), ROTR(x, 25))
+#define SSIG0(x) _mm256_xor_si256(_mm256_xor_si256(ROTR(x, 7), ROTR(x, 18)), _mm256_srli_epi32(x, 3))
+#define SSIG1(x) _mm256_xor_si256(_mm256_xor_si256(ROTR(x, 17), ROTR(x, 19)), _mm256_srli_epi32(x, 10))
+
+__attribute__((target("avx2")))
+static void
+sha256_avx2_block(uint32_t state[8][SHA256_LANES], const unsigned char* blocks[SHA256_LANES])
+{
+   __m256i w[64];
+   __m256i s[8];
+   __m256i a, b, c, d, e, f, g, h;
+
+   // load eight words of each lane and transpose them into one word of all lanes
+   for (int half = 0; half < 2; half++)
+   {
+      __m256i r[8];
+      __m256i u[8];
+      const __m256i swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                           12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+      for (int l = 0; l < SHA256_LANES; l++)
+      {
+         r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(blocks[l] + 32 * half)), swap);
+      }
+
+      u[0] = _mm256_unpacklo_epi32(r[0], r[1]);
+      u[1] = _mm256_unpackhi_epi32(r[0], r[1]);
+      u[2] = _mm256_unpacklo_epi32(r[2], r[3]);
+      u[3] = _mm256_unpackhi_epi32(r[2], r[3]);
+      u[4] = _mm256_unpacklo_epi32(r[4], r[5]);
+      u[5] = _mm256_unpackhi_epi32(r[4], r[5]);
+      u[6] = _mm256_unpacklo_epi32(r[6], r[7]);
+      u[7] = _mm256_unpackhi_epi32(r[6], r[7]);
+
+      r[0] = _mm256_unpacklo_epi64(u[0], u[2]);
+      r[1] = _mm256_unpackhi_epi64(u[0], u[2]);
+      r[2] = _mm256_unpacklo_epi64(u[1], u[3]);
+      r[3] = _mm256_unpackhi_epi64(u[1], u[3]);
+      r[4] = _mm256_unpacklo_epi64(u[4], u[6]);
+      r[5] = _mm256_unpackhi_epi64(u[4], u[6]);
+      r[6] = _mm256_unpacklo_epi64(u[5], u[7]);
+      r[7] = _mm256_unpackhi_epi64(u[5], u[7]);
+
+      for (int i = 0; i < 4; i++)
+      {
+         w[8 * half + i] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20);
+         w[8 * half + i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31);
+      }
+   }
+
+   for (int t = 16; t < 64; t++)
+   {
+      w[t] = _mm256_add_epi32(_mm256_add_epi32(SSIG1(w[t - 2]), w[t - 7]),
+                              _mm256_add_epi32(SSIG0(w[t - 15]), w[t - 16]));
+   }
+
+   for (int i = 0; i < 8; i++)
+   {
+      s[i] = _mm256_loadu_si256((const __m256i*)state[i]);
+   }
+
+   a = s[0];
+   b = s[1];
+   c = s[2];
+   d = s[3];
+   e = s[4];
+   f = s[5];
+   g = s[6];
+   h = s[7];
+
+   for (int t = 0; t < 64; t++)
+   {
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+      __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, BSIG1(e)), _mm256_add_epi32(ch, w[t])),
+                                    _mm256_set1_epi32((int)sha256_k[t]));
+      __m256i t2 = _mm256_add_epi32(BSIG0(a), maj);
+
+      h = g;
+      g = f;
+      f = e;
+      e = _mm256_add_epi32(d, t1);
+      d = c;
+      c = b;
+      b = a;
+      a = _mm256_add_epi32(t1, t2);
+   }
+
+   s[0] = _mm256_add_epi32(s[0], a);
+   s[1] = _mm256_add_epi32(s[1], b);
+   s[2] = _mm256_add_epi32(s[2], c);
+   s[3] = _mm256_add_epi32(s[3], d);
+   s[4] = _mm256_add_epi32(s[4], e);
+   s[5] = _mm256_add_epi32(s[5], f);
+   s[6] = _mm256_add_epi32(s[6], g);
+   s[7] = _mm256_add_epi32(s[7], h);
+
+   for (int i = 0; i < 8; i++)
+   {
+      _mm256_storeu_si256((__m256i*)state[i], s[i]);
+   }
+}
+
+static void
+sha256_avx2_buffers(unsigned char** data, size_t* sizes, int count, unsigned char digests[][SHA256_LENGTH])
+{
+   static const unsigned char zero[SHA256_BLOCK] = {0};
+   uint32_t state[8][SHA256_LANES];
+   unsigned char tails[SHA256_LANES][2 * SHA256_BLOCK];
+   size_t full[SHA256_LANES];
+   size_t blocks[SHA256_LANES];
+   size_t maximum = 0;
+   const unsigned char* lane[SHA256_LANES];
+
+   memset(tails, 0, sizeof(tails));
+
+   for (int l = 0; l < SHA256_LANES; l++)
+   {
+      for (int i = 0; i < 8; i++)
+      {
+         state[i][l] = sha256_initial[i];
+      }
+
+      full[l] = 0;
+      blocks[l] = 0;
+
+      if (l < count)
+      {
+         size_t rest = sizes[l] % SHA256_BLOCK;
+         size_t tail = rest + 9 <= SHA256_BLOCK ? 1 : 2;
+         uint64_t bits = (uint64_t)sizes[l] * 8;
+
+         full[l] = sizes[l] / SHA256_BLOCK;
+         blocks[l] = full[l] + tail;
+
+         memcpy(tails[l], data[l] + full[l] * SHA256_BLOCK, rest);
+         tails[l][rest] = 0x80;
+         for (int i = 0; i < 8; i++)
+         {
+            tails[l][tail * SHA256_BLOCK - 1 - i] = (unsigned char)(bits >> (8 * i));
+         }
+
+         if (blocks[l] > maximum)
+         {
+            maximum = blocks[l];
+         }
+      }
+   }
+
+   for (size_t n = 0; n < maximum; n++)
+   {
+      for (int l = 0; l < SHA256_LANES; l++)
+      {
+         if (n < full[l])
+         {
+            lane[l] = data[l] + n * SHA256_BLOCK;
+         }
+         else if (n < blocks[l])
+         {
+            lane[l] = tails[l] + (n - full[l]) * SHA256_BLOCK;
+         }
+         else
+         {
+            lane[l] = zero;
+         }
+      }
+
+      sha256_avx2_block(state, lane);
+
+      // a finished lane keeps running on padding, so take its digest now
+      for (int l = 0; l < count; l++)
+      {
+         if (n + 1 == blocks[l])
+         {
+            for (int i = 0; i < 8; i++)
+            {
+               digests[l][4 * i] = (unsigned char)(state[i][l] >> 24);
+               digests[l][4 * i + 1] = (unsigned char)(state[i][l] >> 16);
+               digests[l][4 * i + 2] = (unsigned char)(state[i][l] >> 8);
+               digests[l][4 * i + 3] = (unsigned char)state[i][l];
+            }
+         }
+      }
+   }
+}
+
+#endif
+
+static int
+sha256_evp_buffer(unsigned char* data, size_t size, unsigned char* digest)
+{
+   EVP_MD_CTX* ctx = NULL;
+   unsigned int length = 0;
+
+   ctx = sha256_context();
+   if (ctx == NULL)
+   {
+      return 1;
+   }
+
+   if (!EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) ||
+       !EVP_DigestUpdate(ctx, data, size) ||
+       !EVP_DigestFinal_ex(ctx, digest, &length))
+   {
+      pgmoneta_log_error("Message digest failed");
+      return 1;
+   }
+
+   return 0;
+}
+
+static EVP_MD_CTX*
+sha256_context(void)
+{
+   EVP_MD_CTX* ctx = NULL;
+
+   ctx = (EVP_MD_CTX*)pgmoneta_worker_context(WORKER_CONTEXT_SHA256);
+   if (ctx == NULL)
+   {
+      ctx = EVP_MD_CTX_new();
+      if (ctx != NULL)
+      {
+         pgmoneta_worker_context_set(WORKER_CONTEXT_SHA256, ctx, sha256_free_context);
+      }
+   }
+
+   return ctx;
+}
+
+static void
+sha256_free_context(void* context)
+{
+   EVP_MD_CTX_free((EVP_MD_CTX*)context);
+}
+
+void
+pgmoneta_sha256_hex(unsigned char* digest, char** sha256)
+{
+   char* hex = NULL;
+
+   *sha256 = NULL;
+
+   hex = (char*)malloc(SHA256_HEX_LENGTH);
+   if (hex == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < SHA256_LENGTH; i++)
+   {
+      sprintf(&hex[i * 2], "%02x", digest[i]);
+   }
+   hex[SHA256_HEX_LENGTH - 1] = '\0';
+
+   *sha256 = hex;
+}
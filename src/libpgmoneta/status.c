@@ -34,8 +34,14 @@
 #include <network.h>
 #include <status.h>
 #include <utils.h>
+#include <walinventory.h>
 
-void
+/* system */
+#include <time.h>
+
+static int status_progress(int server, struct json** progress);
+
+int
 pgmoneta_status(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint8_t encryption, struct json* payload)
 {
    char* d = NULL;
@@ -43,7 +49,7 @@ pgmoneta_status(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint
    int32_t retention_weeks;
    int32_t retention_months;
    int32_t retention_years;
-   uint64_t used_size;
+   uint64_t used_size = 0;
    uint64_t free_size;
    uint64_t total_size;
    uint64_t workspace_size;
@@ -72,17 +78,6 @@ pgmoneta_status(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint
       goto error;
    }
 
-   d = NULL;
-   d = pgmoneta_append(d, config->base_dir);
-   d = pgmoneta_append(d, "/");
-
-   used_size = pgmoneta_directory_size(d);
-
-   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_USED_SPACE, (uintptr_t)used_size, ValueUInt64);
-
-   free(d);
-   d = NULL;
-
    free_size = pgmoneta_free_space(config->base_dir);
    total_size = pgmoneta_total_space(config->base_dir);
 
@@ -138,15 +133,11 @@ pgmoneta_status(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint
       free(d);
       d = NULL;
 
-      d = pgmoneta_get_server(i);
-
-      server_size = pgmoneta_directory_size(d);
+      server_size = pgmoneta_server_size(i, number_of_backups, backups);
+      used_size += server_size;
 
       pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_SERVER_SIZE, (uintptr_t)server_size, ValueUInt64);
 
-      free(d);
-      d = NULL;
-
       d = pgmoneta_get_server_workspace(i);
       workspace_size = pgmoneta_free_space(d);
       free(d);
@@ -191,6 +182,7 @@ pgmoneta_status(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint
       d = NULL;
    }
 
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_USED_SPACE, (uintptr_t)used_size, ValueUInt64);
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVERS, (uintptr_t)servers, ValueJSON);
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
@@ -207,13 +199,11 @@ pgmoneta_status(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint
 
    pgmoneta_log_info("Status (Elapsed: %s)", elapsed);
 
-   pgmoneta_json_destroy(payload);
-
-   pgmoneta_disconnect(client_fd);
+   free(elapsed);
 
-   pgmoneta_stop_logging();
+   pgmoneta_json_destroy(payload);
 
-   exit(0);
+   return 0;
 
 error:
 
@@ -227,14 +217,10 @@ error:
 
    pgmoneta_json_destroy(payload);
 
-   pgmoneta_disconnect(client_fd);
-
-   pgmoneta_stop_logging();
-
-   exit(1);
+   return 1;
 }
 
-void
+int
 pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compression, uint8_t encryption, struct json* payload)
 {
    char* d = NULL;
@@ -242,7 +228,7 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
    int32_t retention_weeks;
    int32_t retention_months;
    int32_t retention_years;
-   uint64_t used_size;
+   uint64_t used_size = 0;
    uint64_t free_size;
    uint64_t total_size;
    uint64_t workspace_size;
@@ -258,9 +244,13 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
    uint64_t delta;
    int32_t number_of_backups = 0;
    struct backup** backups = NULL;
+   int number_of_wal_files = 0;
+   char** wal_files = NULL;
    struct json* response = NULL;
    struct json* servers = NULL;
    struct json* bcks = NULL;
+   struct json* pool = NULL;
+   struct json* progress = NULL;
    struct configuration* config;
 
    pgmoneta_start_logging();
@@ -274,17 +264,6 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
       goto error;
    }
 
-   d = NULL;
-   d = pgmoneta_append(d, config->base_dir);
-   d = pgmoneta_append(d, "/");
-
-   used_size = pgmoneta_directory_size(d);
-
-   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_USED_SPACE, (uintptr_t)used_size, ValueUInt64);
-
-   free(d);
-   d = NULL;
-
    free_size = pgmoneta_free_space(config->base_dir);
    total_size = pgmoneta_total_space(config->base_dir);
 
@@ -295,15 +274,21 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_WORKERS, (uintptr_t)config->workers, ValueInt32);
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_NUMBER_OF_SERVERS, (uintptr_t)config->number_of_servers, ValueInt32);
 
+   pgmoneta_json_create(&pool);
+   pgmoneta_json_put(pool, MANAGEMENT_ARGUMENT_ALIVE, (uintptr_t)atomic_load(&config->prometheus.worker_alive), ValueInt32);
+   pgmoneta_json_put(pool, MANAGEMENT_ARGUMENT_ACTIVE, (uintptr_t)atomic_load(&config->prometheus.worker_active), ValueInt32);
+   pgmoneta_json_put(pool, MANAGEMENT_ARGUMENT_TASKS, (uintptr_t)atomic_load(&config->prometheus.worker_task.count), ValueUInt64);
+   pgmoneta_json_put(pool, MANAGEMENT_ARGUMENT_BUSY, pgmoneta_value_from_double(atomic_load(&config->prometheus.worker_busy) / 1000000.0), ValueDouble);
+   pgmoneta_json_put(pool, MANAGEMENT_ARGUMENT_IDLE, pgmoneta_value_from_double(atomic_load(&config->prometheus.worker_idle) / 1000000.0), ValueDouble);
+   pgmoneta_json_put(pool, MANAGEMENT_ARGUMENT_QUEUE_WAIT, pgmoneta_value_from_double(atomic_load(&config->prometheus.worker_queue_wait.sum) / 1000000.0), ValueDouble);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_WORKER_POOL, (uintptr_t)pool, ValueJSON);
+
    pgmoneta_json_create(&servers);
 
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      char* wal_dir = NULL;
       struct json* js = NULL;
 
-      wal_dir = pgmoneta_get_server_wal(i);
-
       pgmoneta_json_create(&js);
 
       retention_days = config->servers[i].retention_days;
@@ -335,15 +320,6 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
       pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_RETENTION_MONTHS, (uintptr_t)retention_months, ValueInt32);
       pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_RETENTION_YEARS, (uintptr_t)retention_years, ValueInt32);
 
-      d = pgmoneta_get_server(i);
-
-      server_size = pgmoneta_directory_size(d);
-
-      pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_SERVER_SIZE, (uintptr_t)server_size, ValueUInt64);
-
-      free(d);
-      d = NULL;
-
       d = pgmoneta_get_server_workspace(i);
       workspace_size = pgmoneta_free_space(d);
       free(d);
@@ -368,6 +344,17 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
 
       pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_CHECKSUMS, (uintptr_t)config->servers[i].checksums, ValueBool);
 
+      if (atomic_load(&config->servers[i].progress.active) > 0)
+      {
+         if (status_progress(i, &progress))
+         {
+            goto error;
+         }
+
+         pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_PROGRESS, (uintptr_t)progress, ValueJSON);
+         progress = NULL;
+      }
+
       free(d);
       d = NULL;
 
@@ -377,6 +364,13 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
 
       pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_NUMBER_OF_BACKUPS, (uintptr_t)number_of_backups, ValueInt32);
 
+      server_size = pgmoneta_server_size(i, number_of_backups, backups);
+      used_size += server_size;
+
+      pgmoneta_json_put(js, MANAGEMENT_ARGUMENT_SERVER_SIZE, (uintptr_t)server_size, ValueUInt64);
+
+      pgmoneta_walinventory_segments(i, &number_of_wal_files, &wal_files);
+
       if (pgmoneta_json_create(&bcks))
       {
          goto error;
@@ -403,7 +397,7 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
             pgmoneta_json_put(bck, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)backups[j]->compression, ValueInt32);
             pgmoneta_json_put(bck, MANAGEMENT_ARGUMENT_ENCRYPTION, (uintptr_t)backups[j]->encryption, ValueInt32);
 
-            wal = pgmoneta_number_of_wal_files(wal_dir, &backups[j]->wal[0], NULL);
+            wal = pgmoneta_number_of_wal_files_in(number_of_wal_files, wal_files, &backups[j]->wal[0], NULL);
             wal *= config->servers[i].wal_size;
 
             pgmoneta_json_put(bck, MANAGEMENT_ARGUMENT_WAL, (uintptr_t)wal, ValueUInt64);
@@ -411,7 +405,7 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
             delta = 0;
             if (j > 0)
             {
-               delta = pgmoneta_number_of_wal_files(wal_dir, &backups[j - 1]->wal[0], &backups[j]->wal[0]);
+               delta = pgmoneta_number_of_wal_files_in(number_of_wal_files, wal_files, &backups[j - 1]->wal[0], &backups[j]->wal[0]);
                delta *= config->servers[i].wal_size;
             }
 
@@ -439,13 +433,20 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
       free(backups);
       backups = NULL;
 
-      free(wal_dir);
-      wal_dir = NULL;
+      for (int j = 0; j < number_of_wal_files; j++)
+      {
+         free(wal_files[j]);
+      }
+      free(wal_files);
+      wal_files = NULL;
+      number_of_wal_files = 0;
+
 
       free(d);
       d = NULL;
    }
 
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_USED_SPACE, (uintptr_t)used_size, ValueUInt64);
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVERS, (uintptr_t)servers, ValueJSON);
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
@@ -462,13 +463,11 @@ pgmoneta_status_details(SSL* ssl, int client_fd, bool offline, uint8_t compressi
 
    pgmoneta_log_info("Status details (Elapsed: %s)", elapsed);
 
-   pgmoneta_json_destroy(payload);
-
-   pgmoneta_disconnect(client_fd);
+   free(elapsed);
 
-   pgmoneta_stop_logging();
+   pgmoneta_json_destroy(payload);
 
-   exit(0);
+   return 0;
 
 error:
 
@@ -478,6 +477,12 @@ error:
    }
    free(backups);
 
+   for (int i = 0; i < number_of_wal_files; i++)
+   {
+      free(wal_files[i]);
+   }
+   free(wal_files);
+
    for (int i = 0; i < number_of_directories; i++)
    {
       free(array[i]);
@@ -488,9 +493,39 @@ error:
 
    pgmoneta_json_destroy(payload);
 
-   pgmoneta_disconnect(client_fd);
+   return 1;
+}
+
+static int
+status_progress(int server, struct json** progress)
+{
+   time_t elapsed;
+   uint64_t bytes;
+   struct json* j = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *progress = NULL;
+
+   if (pgmoneta_json_create(&j))
+   {
+      return 1;
+   }
+
+   elapsed = time(NULL) - (time_t)atomic_load(&config->servers[server].progress.start);
+   bytes = atomic_load(&config->servers[server].progress.bytes);
+
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_ACTIVE, (uintptr_t)atomic_load(&config->servers[server].progress.active), ValueInt32);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_NODE, (uintptr_t)config->servers[server].progress.node, ValueString);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_NODES, (uintptr_t)atomic_load(&config->servers[server].progress.nodes), ValueInt32);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_NUMBER_OF_NODES, (uintptr_t)atomic_load(&config->servers[server].progress.number_of_nodes), ValueInt32);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_BYTES, (uintptr_t)bytes, ValueUInt64);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_FILES, (uintptr_t)atomic_load(&config->servers[server].progress.files), ValueUInt64);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_ELAPSED, (uintptr_t)(int64_t)elapsed, ValueInt64);
+   pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_THROUGHPUT, (uintptr_t)(elapsed > 0 ? bytes / (uint64_t)elapsed : bytes), ValueUInt64);
 
-   pgmoneta_stop_logging();
+   *progress = j;
 
-   exit(1);
+   return 0;
 }
@@ -0,0 +1,1260 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <csv.h>
+#include <deque.h>
+#include <info.h>
+#include <io.h>
+#include <logging.h>
+#include <manifest.h>
+#include <restore.h>
+#include <storage.h>
+#include <streamer.h>
+#include <utils.h>
+#include <value.h>
+#include <workers.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STORAGE_PUT    0
+#define STORAGE_GET    1
+#define STORAGE_REMOVE 2
+#define STORAGE_DECODE 3
+#define STORAGE_RANGE  4
+
+static int storage_queue(struct storage_transfer* transfer, int operation, char* from, char* to, off_t offset, size_t length);
+static int storage_run(struct storage_transfer* transfer, int operation, char* from, char* to, off_t offset, size_t length);
+static void do_storage_operation(struct worker_input* wi);
+static int storage_decode(struct storage_backend* backend, struct backup* backup, char* remote_path, char* local_path);
+static int storage_range(struct storage_backend* backend, char* remote_path, char* local_path, off_t offset, size_t length);
+static int storage_restore_file(struct storage_transfer* transfer, struct backup* backup, char* remote_root, char* to, char* path, size_t size);
+static ssize_t storage_stream_write(void* cookie, const char* buffer, size_t size);
+static bool storage_restore_last(char** names, char* path);
+static int storage_recall_backup(int server, struct backup* backup);
+static int storage_recall_file(struct storage_transfer* transfer, char* remote_root, char* local_root, char* path, char* suffix);
+static bool storage_has_backup(struct storage_backend* backend, int server, char* label);
+static int storage_remove_backup(int server, char* label);
+
+int
+pgmoneta_storage_backend_create(struct storage_backend** backend)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *backend = NULL;
+
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   {
+      *backend = pgmoneta_storage_backend_ssh();
+   }
+   else if (config->storage_engine & STORAGE_ENGINE_S3)
+   {
+      *backend = pgmoneta_storage_backend_s3();
+   }
+   else if (config->storage_engine & STORAGE_ENGINE_AZURE)
+   {
+      *backend = pgmoneta_storage_backend_azure();
+   }
+   else
+   {
+      return 0;
+   }
+
+   if (*backend == NULL)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+void
+pgmoneta_storage_backend_destroy(struct storage_backend* backend)
+{
+   free(backend);
+}
+
+int
+pgmoneta_storage_transfer_create(int server, struct storage_backend* backend, struct storage_transfer** transfer)
+{
+   int number_of_workers = 0;
+   struct storage_transfer* t = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *transfer = NULL;
+
+   if (backend == NULL)
+   {
+      goto error;
+   }
+
+   t = (struct storage_transfer*)calloc(1, sizeof(struct storage_transfer));
+   if (t == NULL)
+   {
+      goto error;
+   }
+
+   t->backend = backend;
+   atomic_init(&t->bytes, 0);
+   atomic_init(&t->failed, 0);
+
+   // every thread of the transfer keeps its own connection to the remote side
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      if (pgmoneta_workers_initialize(number_of_workers, &t->workers))
+      {
+         goto error;
+      }
+   }
+
+   // the limit is shared by all the threads, so it holds for the transfer as a whole,
+   // and the transfers of all servers share total_max_rate
+   if (config->storage_max_rate > 0 || pgmoneta_token_bucket_limited(&config->network_bucket))
+   {
+      t->bucket = (struct token_bucket*)calloc(1, sizeof(struct token_bucket));
+      if (t->bucket == NULL || (config->storage_max_rate > 0 && pgmoneta_token_bucket_init(t->bucket, config->storage_max_rate)))
+      {
+         goto error;
+      }
+      t->bucket->parent = &config->network_bucket;
+   }
+
+   *transfer = t;
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Storage: Could not create a transfer for %s", backend != NULL ? backend->name : "");
+
+   if (t != NULL)
+   {
+      pgmoneta_workers_destroy(t->workers);
+      pgmoneta_token_bucket_destroy(t->bucket);
+      free(t);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_storage_put(struct storage_transfer* transfer, char* local_path, char* remote_path)
+{
+   return storage_queue(transfer, STORAGE_PUT, local_path, remote_path, 0, 0);
+}
+
+int
+pgmoneta_storage_get(struct storage_transfer* transfer, char* remote_path, char* local_path)
+{
+   return storage_queue(transfer, STORAGE_GET, remote_path, local_path, 0, 0);
+}
+
+int
+pgmoneta_storage_remove(struct storage_transfer* transfer, char* remote_path)
+{
+   return storage_queue(transfer, STORAGE_REMOVE, remote_path, NULL, 0, 0);
+}
+
+int
+pgmoneta_storage_put_directory(struct storage_transfer* transfer, char* local_root, char* remote_root)
+{
+   char* local_path = NULL;
+   char* remote_path = NULL;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   dir = opendir(local_root);
+   if (dir == NULL)
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      local_path = pgmoneta_append(local_path, local_root);
+      if (!pgmoneta_ends_with(local_root, "/"))
+      {
+         local_path = pgmoneta_append(local_path, "/");
+      }
+      local_path = pgmoneta_append(local_path, entry->d_name);
+
+      remote_path = pgmoneta_append(remote_path, remote_root);
+      if (!pgmoneta_ends_with(remote_root, "/"))
+      {
+         remote_path = pgmoneta_append(remote_path, "/");
+      }
+      remote_path = pgmoneta_append(remote_path, entry->d_name);
+
+      if (pgmoneta_is_directory(local_path))
+      {
+         if (pgmoneta_storage_put_directory(transfer, local_path, remote_path))
+         {
+            goto error;
+         }
+      }
+      else if (pgmoneta_is_file(local_path))
+      {
+         if (pgmoneta_storage_put(transfer, local_path, remote_path))
+         {
+            goto error;
+         }
+      }
+
+      free(local_path);
+      free(remote_path);
+      local_path = NULL;
+      remote_path = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(local_path);
+   free(remote_path);
+
+   return 1;
+}
+
+int
+pgmoneta_storage_list(struct storage_backend* backend, char* remote_path, struct deque** names)
+{
+   *names = NULL;
+
+   if (backend == NULL || backend->list(backend, remote_path, names))
+   {
+      pgmoneta_log_error("Storage: Could not list %s", remote_path);
+      pgmoneta_deque_destroy(*names);
+      *names = NULL;
+      return 1;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_storage_fetch_backup(int server, char* label)
+{
+   char* local_root = NULL;
+   char* local_path = NULL;
+   char* remote_path = NULL;
+   char* files[] = {"backup.info", "backup.manifest"};
+   struct storage_backend* backend = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (pgmoneta_storage_backend_create(&backend) || backend == NULL)
+   {
+      goto error;
+   }
+
+   local_root = pgmoneta_get_server_backup_identifier(server, label);
+
+   if (pgmoneta_mkdir(local_root))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < 2; i++)
+   {
+      local_path = pgmoneta_append(local_path, local_root);
+      local_path = pgmoneta_append(local_path, files[i]);
+
+      remote_path = pgmoneta_append(remote_path, config->servers[server].name);
+      remote_path = pgmoneta_append(remote_path, "/backup/");
+      remote_path = pgmoneta_append(remote_path, label);
+      remote_path = pgmoneta_append(remote_path, "/");
+      remote_path = pgmoneta_append(remote_path, files[i]);
+
+      if (backend->get(backend, remote_path, local_path))
+      {
+         goto error;
+      }
+
+      free(local_path);
+      free(remote_path);
+      local_path = NULL;
+      remote_path = NULL;
+   }
+
+   pgmoneta_log_info("%s: Fetched %s/%s", backend->name, config->servers[server].name, label);
+
+   pgmoneta_storage_backend_destroy(backend);
+   free(local_root);
+
+   return 0;
+
+error:
+
+   if (local_root != NULL)
+   {
+      pgmoneta_delete_directory(local_root);
+   }
+
+   pgmoneta_storage_backend_destroy(backend);
+   free(local_root);
+   free(local_path);
+   free(remote_path);
+
+   return 1;
+}
+
+int
+pgmoneta_storage_restore(int server, struct backup* backup, char* to)
+{
+   int cols = 0;
+   char** row = NULL;
+   char* manifest = NULL;
+   char* remote_root = NULL;
+   char** last = NULL;
+   struct csv_reader* reader = NULL;
+   struct storage_backend* backend = NULL;
+   struct storage_transfer* transfer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (backup->type != TYPE_FULL || backup->number_of_tablespaces > 0 || backup->deduplication || backup->page_filter)
+   {
+      pgmoneta_log_error("Storage: %s/%s can only be restored from its local copy", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   if (pgmoneta_storage_backend_create(&backend) || backend == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_storage_transfer_create(server, backend, &transfer))
+   {
+      goto error;
+   }
+
+   transfer->backup = backup;
+
+   if (pgmoneta_get_restore_last_files_names(&last))
+   {
+      goto error;
+   }
+
+   manifest = pgmoneta_get_server_backup_identifier(server, backup->label);
+   manifest = pgmoneta_append(manifest, "backup.manifest");
+
+   remote_root = pgmoneta_append(remote_root, config->servers[server].name);
+   remote_root = pgmoneta_append(remote_root, "/backup/");
+   remote_root = pgmoneta_append(remote_root, backup->label);
+   remote_root = pgmoneta_append(remote_root, "/data/");
+
+   pgmoneta_log_debug("%s: Restoring %s/%s to %s", backend->name, config->servers[server].name, backup->label, to);
+
+   if (pgmoneta_csv_reader_init(manifest, &reader))
+   {
+      goto error;
+   }
+
+   // the files that make the directory usable come once all the others are there
+   for (int pass = 0; pass < 2; pass++)
+   {
+      if (pass == 1 && pgmoneta_csv_reader_reset(reader))
+      {
+         goto error;
+      }
+
+      while (pgmoneta_csv_next_row(reader, &cols, &row))
+      {
+         if (cols == MANIFEST_COLUMN_COUNT && storage_restore_last(last, row[MANIFEST_PATH_INDEX]) == (pass == 1))
+         {
+            if (storage_restore_file(transfer, backup, remote_root, to, row[MANIFEST_PATH_INDEX],
+                                     strtoull(row[MANIFEST_SIZE_INDEX], NULL, 10)))
+            {
+               goto error;
+            }
+         }
+
+         free(row);
+         row = NULL;
+      }
+
+      if (pgmoneta_storage_transfer_wait(transfer))
+      {
+         goto error;
+      }
+   }
+
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_storage_transfer_destroy(transfer);
+   pgmoneta_storage_backend_destroy(backend);
+
+   for (int i = 0; last[i] != NULL; i++)
+   {
+      free(last[i]);
+   }
+   free(last);
+   free(manifest);
+   free(remote_root);
+
+   return 0;
+
+error:
+
+   free(row);
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_storage_transfer_destroy(transfer);
+   pgmoneta_storage_backend_destroy(backend);
+
+   for (int i = 0; last != NULL && last[i] != NULL; i++)
+   {
+      free(last[i]);
+   }
+   free(last);
+   free(manifest);
+   free(remote_root);
+
+   return 1;
+}
+
+int
+pgmoneta_storage_retention_local(int server)
+{
+   int days;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   days = config->servers[server].retention_local;
+   if (days < 0)
+   {
+      days = config->retention_local;
+   }
+
+   return days > 0 ? days : 0;
+}
+
+int
+pgmoneta_storage_tier(int server, struct backup* backup)
+{
+   char* root = NULL;
+   char* data = NULL;
+   char* remote_root = NULL;
+   struct storage_backend* backend = NULL;
+   struct storage_transfer* transfer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   data = pgmoneta_get_server_backup_identifier_data(server, backup->label);
+
+   if (!pgmoneta_exists(data))
+   {
+      free(data);
+      return 0;
+   }
+
+   if (backup->number_of_tablespaces > 0)
+   {
+      // the remote copy can't be recalled with its tablespaces
+      pgmoneta_log_debug("Storage: %s/%s stays local", config->servers[server].name, backup->label);
+      free(data);
+      return 0;
+   }
+
+   if (pgmoneta_storage_backend_create(&backend) || backend == NULL)
+   {
+      goto error;
+   }
+
+   if (!storage_has_backup(backend, server, backup->label))
+   {
+      root = pgmoneta_get_server_backup_identifier(server, backup->label);
+
+      remote_root = pgmoneta_append(remote_root, config->servers[server].name);
+      remote_root = pgmoneta_append(remote_root, "/backup/");
+      remote_root = pgmoneta_append(remote_root, backup->label);
+
+      if (pgmoneta_storage_transfer_create(server, backend, &transfer))
+      {
+         goto error;
+      }
+
+      if (pgmoneta_storage_put_directory(transfer, root, remote_root))
+      {
+         goto error;
+      }
+
+      if (pgmoneta_storage_transfer_wait(transfer))
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_delete_directory(data))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_info("%s: Tiered %s/%s", backend->name, config->servers[server].name, backup->label);
+
+   pgmoneta_storage_transfer_destroy(transfer);
+   pgmoneta_storage_backend_destroy(backend);
+   free(root);
+   free(data);
+   free(remote_root);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Storage: Could not tier %s/%s", config->servers[server].name, backup->label);
+
+   pgmoneta_storage_transfer_destroy(transfer);
+   pgmoneta_storage_backend_destroy(backend);
+   free(root);
+   free(data);
+   free(remote_root);
+
+   return 1;
+}
+
+int
+pgmoneta_storage_recall(int server, struct backup* backup)
+{
+   struct backup* current = NULL;
+   struct backup* parent = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!(config->storage_engine & (STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
+   {
+      return 0;
+   }
+
+   if (storage_recall_backup(server, backup))
+   {
+      return 1;
+   }
+
+   // an incremental backup is only usable with the data of its parents
+   current = backup;
+   while (current->type == TYPE_INCREMENTAL)
+   {
+      if (pgmoneta_get_backup_parent(server, current, &parent) || parent == NULL)
+      {
+         goto error;
+      }
+
+      if (current != backup)
+      {
+         free(current);
+      }
+      current = parent;
+      parent = NULL;
+
+      if (storage_recall_backup(server, current))
+      {
+         goto error;
+      }
+   }
+
+   if (current != backup)
+   {
+      free(current);
+   }
+
+   return 0;
+
+error:
+
+   if (current != backup)
+   {
+      free(current);
+   }
+
+   return 1;
+}
+
+void
+pgmoneta_storage_remove_backup(int server, char* label)
+{
+   pid_t pid;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!config->retention_remote ||
+       !(config->storage_engine & (STORAGE_ENGINE_SSH | STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
+   {
+      return;
+   }
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgmoneta_log_warn("Storage: No fork for %s/%s", config->servers[server].name, label);
+      errno = 0;
+   }
+   else if (pid == 0)
+   {
+      int ret;
+
+      ret = storage_remove_backup(server, label);
+
+      pgmoneta_stop_logging();
+
+      exit(ret);
+   }
+}
+
+int
+pgmoneta_storage_transfer_wait(struct storage_transfer* transfer)
+{
+   if (transfer == NULL)
+   {
+      return 1;
+   }
+
+   if (transfer->workers != NULL)
+   {
+      pgmoneta_workers_wait(transfer->workers);
+   }
+
+   return atomic_load(&transfer->failed) > 0 ? 1 : 0;
+}
+
+void
+pgmoneta_storage_transfer_destroy(struct storage_transfer* transfer)
+{
+   if (transfer == NULL)
+   {
+      return;
+   }
+
+   if (transfer->workers != NULL)
+   {
+      pgmoneta_workers_wait(transfer->workers);
+      pgmoneta_workers_destroy(transfer->workers);
+   }
+
+   pgmoneta_token_bucket_destroy(transfer->bucket);
+
+   free(transfer);
+}
+
+static int
+storage_restore_file(struct storage_transfer* transfer, struct backup* backup, char* remote_root, char* to, char* path, size_t size)
+{
+   char* suffix = NULL;
+   char* local_path = NULL;
+   char* remote_path = NULL;
+   char* directory = NULL;
+   char* slash = NULL;
+   size_t range_size = transfer->backend->range_size;
+   bool decode = false;
+   FILE* file = NULL;
+
+   decode = backup->compression != COMPRESSION_NONE || backup->encryption != ENCRYPTION_NONE;
+
+   local_path = pgmoneta_append(local_path, to);
+   if (!pgmoneta_ends_with(to, "/"))
+   {
+      local_path = pgmoneta_append(local_path, "/");
+   }
+   local_path = pgmoneta_append(local_path, path);
+
+   directory = pgmoneta_append(directory, local_path);
+   slash = strrchr(directory, '/');
+   if (slash != NULL)
+   {
+      *slash = '\0';
+      if (pgmoneta_mkdir(directory))
+      {
+         goto error;
+      }
+   }
+
+   suffix = pgmoneta_streamer_suffix(backup->compression, backup->encryption);
+
+   remote_path = pgmoneta_append(remote_path, remote_root);
+   remote_path = pgmoneta_append(remote_path, path);
+   remote_path = pgmoneta_append(remote_path, suffix);
+
+   if (decode || range_size == 0 || size <= range_size)
+   {
+      if (storage_queue(transfer, decode ? STORAGE_DECODE : STORAGE_RANGE, remote_path, local_path, 0, size))
+      {
+         goto error;
+      }
+   }
+   else
+   {
+      // a plain file is written at the offsets of its ranges, which are downloaded in parallel
+      file = fopen(local_path, "wb");
+      if (file == NULL || ftruncate(fileno(file), (off_t)size))
+      {
+         goto error;
+      }
+      fclose(file);
+      file = NULL;
+
+      for (size_t offset = 0; offset < size; offset += range_size)
+      {
+         if (storage_queue(transfer, STORAGE_RANGE, remote_path, local_path, (off_t)offset, MIN(range_size, size - offset)))
+         {
+            goto error;
+         }
+      }
+   }
+
+   free(suffix);
+   free(local_path);
+   free(remote_path);
+   free(directory);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Storage: Could not restore %s", path);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(suffix);
+   free(local_path);
+   free(remote_path);
+   free(directory);
+
+   return 1;
+}
+
+static bool
+storage_restore_last(char** names, char* path)
+{
+   for (int i = 0; names[i] != NULL; i++)
+   {
+      // the names start at the root of the data directory
+      if (!strcmp(names[i] + 1, path))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static int
+storage_recall_backup(int server, struct backup* backup)
+{
+   int cols = 0;
+   char** row = NULL;
+   char* data = NULL;
+   char* suffix = NULL;
+   char* manifest = NULL;
+   char* remote_root = NULL;
+   struct csv_reader* reader = NULL;
+   struct storage_backend* backend = NULL;
+   struct storage_transfer* transfer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   data = pgmoneta_get_server_backup_identifier_data(server, backup->label);
+
+   if (pgmoneta_exists(data))
+   {
+      free(data);
+      return 0;
+   }
+
+   if (pgmoneta_storage_backend_create(&backend) || backend == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_storage_transfer_create(server, backend, &transfer))
+   {
+      goto error;
+   }
+
+   manifest = pgmoneta_get_server_backup_identifier(server, backup->label);
+   manifest = pgmoneta_append(manifest, "backup.manifest");
+
+   remote_root = pgmoneta_append(remote_root, config->servers[server].name);
+   remote_root = pgmoneta_append(remote_root, "/backup/");
+   remote_root = pgmoneta_append(remote_root, backup->label);
+   remote_root = pgmoneta_append(remote_root, "/data/");
+
+   suffix = pgmoneta_streamer_suffix(backup->compression, backup->encryption);
+
+   pgmoneta_log_debug("%s: Recalling %s/%s", backend->name, config->servers[server].name, backup->label);
+
+   if (pgmoneta_csv_reader_init(manifest, &reader))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_csv_next_row(reader, &cols, &row))
+   {
+      if (cols == MANIFEST_COLUMN_COUNT)
+      {
+         if (storage_recall_file(transfer, remote_root, data, row[MANIFEST_PATH_INDEX], suffix))
+         {
+            goto error;
+         }
+      }
+
+      free(row);
+      row = NULL;
+   }
+
+   if (pgmoneta_storage_transfer_wait(transfer))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_info("%s: Recalled %s/%s", backend->name, config->servers[server].name, backup->label);
+
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_storage_transfer_destroy(transfer);
+   pgmoneta_storage_backend_destroy(backend);
+   free(data);
+   free(suffix);
+   free(manifest);
+   free(remote_root);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Storage: Could not recall %s/%s", config->servers[server].name, backup->label);
+
+   free(row);
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_storage_transfer_destroy(transfer);
+   pgmoneta_storage_backend_destroy(backend);
+
+   // a partial copy would be taken for the backup
+   pgmoneta_delete_directory(data);
+
+   free(data);
+   free(suffix);
+   free(manifest);
+   free(remote_root);
+
+   return 1;
+}
+
+static int
+storage_recall_file(struct storage_transfer* transfer, char* remote_root, char* local_root, char* path, char* suffix)
+{
+   char* local_path = NULL;
+   char* remote_path = NULL;
+   char* slash = NULL;
+
+   local_path = pgmoneta_append(local_path, local_root);
+   local_path = pgmoneta_append(local_path, path);
+
+   slash = strrchr(local_path, '/');
+   *slash = '\0';
+   if (pgmoneta_mkdir(local_path))
+   {
+      goto error;
+   }
+   *slash = '/';
+
+   local_path = pgmoneta_append(local_path, suffix);
+
+   remote_path = pgmoneta_append(remote_path, remote_root);
+   remote_path = pgmoneta_append(remote_path, path);
+   remote_path = pgmoneta_append(remote_path, suffix);
+
+   if (pgmoneta_storage_get(transfer, remote_path, local_path))
+   {
+      goto error;
+   }
+
+   free(local_path);
+   free(remote_path);
+
+   return 0;
+
+error:
+
+   free(local_path);
+   free(remote_path);
+
+   return 1;
+}
+
+static bool
+storage_has_backup(struct storage_backend* backend, int server, char* label)
+{
+   bool found = false;
+   char* remote_root = NULL;
+   struct deque* names = NULL;
+   struct deque_iterator* iter = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   remote_root = pgmoneta_append(remote_root, config->servers[server].name);
+   remote_root = pgmoneta_append(remote_root, "/backup/");
+   remote_root = pgmoneta_append(remote_root, label);
+   remote_root = pgmoneta_append(remote_root, "/");
+
+   // the manifest means the upload of the backup has been done
+   if (!backend->list(backend, remote_root, &names) && !pgmoneta_deque_iterator_create(names, &iter))
+   {
+      while (!found && pgmoneta_deque_iterator_next(iter))
+      {
+         found = !strcmp((char*)pgmoneta_value_data(iter->value), "backup.manifest");
+      }
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+   pgmoneta_deque_destroy(names);
+   free(remote_root);
+
+   return found;
+}
+
+static int
+storage_remove_backup(int server, char* label)
+{
+   char* remote_root = NULL;
+   struct storage_backend* backend = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (pgmoneta_storage_backend_create(&backend) || backend == NULL)
+   {
+      goto error;
+   }
+
+   remote_root = pgmoneta_append(remote_root, config->servers[server].name);
+   remote_root = pgmoneta_append(remote_root, "/backup/");
+   remote_root = pgmoneta_append(remote_root, label);
+
+   if (backend->remove_directory(backend, remote_root))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_info("%s: Deleted %s/%s", backend->name, config->servers[server].name, label);
+
+   pgmoneta_storage_backend_destroy(backend);
+   free(remote_root);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Storage: Could not delete the remote copy of %s/%s", config->servers[server].name, label);
+
+   pgmoneta_storage_backend_destroy(backend);
+   free(remote_root);
+
+   return 1;
+}
+
+static int
+storage_decode(struct storage_backend* backend, struct backup* backup, char* remote_path, char* local_path)
+{
+   FILE* file = NULL;
+   FILE* out = NULL;
+   struct destreamer* destreamer = NULL;
+   cookie_io_functions_t functions = {
+      .read = NULL,
+      .write = &storage_stream_write,
+      .seek = NULL,
+      .close = NULL
+   };
+
+   file = fopen(local_path, "wb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_destreamer_create(backup->compression, backup->encryption, file, &destreamer))
+   {
+      goto error;
+   }
+
+   // the response body goes through the destreamer while it arrives
+   out = fopencookie(destreamer, "w", functions);
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   setvbuf(out, NULL, _IOFBF, IO_BUFFER_SIZE);
+
+   if (backend->stream(backend, remote_path, 0, 0, out))
+   {
+      goto error;
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (pgmoneta_destreamer_finish(destreamer))
+   {
+      goto error;
+   }
+
+   pgmoneta_destreamer_destroy(destreamer);
+   destreamer = NULL;
+
+   if (fclose(file) != 0)
+   {
+      file = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   pgmoneta_destreamer_destroy(destreamer);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static int
+storage_range(struct storage_backend* backend, char* remote_path, char* local_path, off_t offset, size_t length)
+{
+   FILE* file = NULL;
+
+   // the file of a split download exists already, with the size of the whole file
+   file = fopen(local_path, "r+b");
+   if (file == NULL && (file = fopen(local_path, "wb")) == NULL)
+   {
+      goto error;
+   }
+
+   if (offset > 0 && fseeko(file, offset, SEEK_SET))
+   {
+      goto error;
+   }
+
+   if (backend->stream(backend, remote_path, offset, length, file))
+   {
+      goto error;
+   }
+
+   if (fclose(file) != 0)
+   {
+      file = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static ssize_t
+storage_stream_write(void* cookie, const char* buffer, size_t size)
+{
+   if (pgmoneta_destreamer_write((struct destreamer*)cookie, (void*)buffer, size))
+   {
+      return 0;
+   }
+
+   return size;
+}
+
+static int
+storage_queue(struct storage_transfer* transfer, int operation, char* from, char* to, off_t offset, size_t length)
+{
+   struct worker_input* wi = NULL;
+
+   if (transfer == NULL)
+   {
+      goto error;
+   }
+
+   if (transfer->workers == NULL)
+   {
+      return storage_run(transfer, operation, from, to, offset, length);
+   }
+
+   if (pgmoneta_create_worker_input(NULL, from, to != NULL ? to : "", operation, transfer->workers, &wi))
+   {
+      goto error;
+   }
+
+   wi->argument = transfer;
+   wi->offset = offset;
+   wi->length = length;
+
+   if (pgmoneta_workers_add(transfer->workers, do_storage_operation, wi))
+   {
+      free(wi);
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+storage_run(struct storage_transfer* transfer, int operation, char* from, char* to, off_t offset, size_t length)
+{
+   int ret = 1;
+   size_t size = 0;
+   struct storage_backend* backend = transfer->backend;
+
+   if (operation == STORAGE_PUT)
+   {
+      size = pgmoneta_get_file_size(from);
+   }
+   else if (operation == STORAGE_DECODE || operation == STORAGE_RANGE)
+   {
+      size = length;
+   }
+
+   // an upload takes its tokens before it starts, a download once its size is known
+   if (transfer->bucket != NULL && size > 0)
+   {
+      while (pgmoneta_token_bucket_consume(transfer->bucket, size))
+      {
+         SLEEP(500000000L);
+      }
+   }
+
+   switch (operation)
+   {
+      case STORAGE_PUT:
+         ret = backend->put(backend, from, to);
+         break;
+      case STORAGE_GET:
+         ret = backend->get(backend, from, to);
+         if (ret == 0)
+         {
+            size = pgmoneta_get_file_size(to);
+            if (transfer->bucket != NULL && size > 0)
+            {
+               while (pgmoneta_token_bucket_consume(transfer->bucket, size))
+               {
+                  SLEEP(500000000L);
+               }
+            }
+         }
+         break;
+      case STORAGE_REMOVE:
+         ret = backend->remove(backend, from);
+         break;
+      case STORAGE_DECODE:
+         ret = storage_decode(backend, transfer->backup, from, to);
+         break;
+      case STORAGE_RANGE:
+         ret = storage_range(backend, from, to, offset, length);
+         break;
+      default:
+         break;
+   }
+
+   if (ret)
+   {
+      pgmoneta_log_error("%s: Could not transfer %s", backend->name, from);
+      atomic_fetch_add(&transfer->failed, 1);
+      return 1;
+   }
+
+   atomic_fetch_add(&transfer->bytes, size);
+
+   return 0;
+}
+
+static void
+do_storage_operation(struct worker_input* wi)
+{
+   struct storage_transfer* transfer = (struct storage_transfer*)wi->argument;
+
+   if (storage_run(transfer, wi->level, wi->from, wi->to, wi->offset, wi->length))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
@@ -0,0 +1,1564 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <aes.h>
+#include <io.h>
+#include <logging.h>
+#include <lz4_compression.h>
+#include <memory.h>
+#include <probes.h>
+#include <streamer.h>
+#include <utils.h>
+#include <zstandard_compression.h>
+
+/* system */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <bzlib.h>
+#include <lz4.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <openssl/evp.h>
+
+static int stream_compress(struct streamer* streamer, void* data, size_t size, bool finish);
+static int stream_compress_zstd(struct streamer* streamer, void* data, size_t size, bool finish);
+static int stream_compress_lz4(struct streamer* streamer, void* data, size_t size, bool finish);
+static int stream_compress_lz4_block(struct streamer* streamer);
+static int stream_compress_gzip(struct streamer* streamer, void* data, size_t size, bool finish);
+static int stream_compress_bzip2(struct streamer* streamer, void* data, size_t size, bool finish);
+static int stream_encrypt(struct streamer* streamer, void* data, size_t size, bool finish);
+static int stream_output(struct streamer* streamer, void* data, size_t size);
+static int stream_aead_output(void* data, void* buffer, size_t size);
+
+static int destream_decrypt(struct destreamer* destreamer, void* data, size_t size, bool finish);
+static int destream_decompress(struct destreamer* destreamer, void* data, size_t size);
+static int destream_decompress_finish(struct destreamer* destreamer);
+static int destream_zstd(struct destreamer* destreamer, void* data, size_t size);
+static int destream_lz4(struct destreamer* destreamer, void* data, size_t size);
+static int destream_gzip(struct destreamer* destreamer, void* data, size_t size);
+static int destream_bzip2(struct destreamer* destreamer, void* data, size_t size);
+static int destream_output(struct destreamer* destreamer, void* data, size_t size);
+static int destream_sparse_output(struct destreamer* destreamer, unsigned char* data, size_t size);
+static int destream_aead_output(void* data, void* buffer, size_t size);
+static int destream_file(char* from, FILE* out, size_t limit);
+
+int
+pgmoneta_streamer_create(int compression, int level, int encryption, FILE* file, struct streamer** streamer)
+{
+   struct streamer* s = NULL;
+
+   *streamer = NULL;
+
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   s = (struct streamer*)calloc(1, sizeof(struct streamer));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   s->compression = compression;
+   s->encryption = encryption;
+   s->file = file;
+
+   switch (compression)
+   {
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         if (level < 1)
+         {
+            level = 1;
+         }
+         else if (level > 19)
+         {
+            level = 19;
+         }
+
+         s->zstd = ZSTD_createCCtx();
+         if (s->zstd == NULL)
+         {
+            goto error;
+         }
+
+         s->zstd_threads = pgmoneta_zstandard_threads(0, NULL);
+
+         ZSTD_CCtx_setParameter(s->zstd, ZSTD_c_compressionLevel, level);
+         ZSTD_CCtx_setParameter(s->zstd, ZSTD_c_checksumFlag, 1);
+         ZSTD_CCtx_setParameter(s->zstd, ZSTD_c_nbWorkers, s->zstd_threads);
+
+         s->buffer_size = ZSTD_CStreamOutSize();
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         s->lz4 = LZ4_createStream();
+         if (s->lz4 == NULL)
+         {
+            goto error;
+         }
+
+         s->buffer_size = LZ4_COMPRESSBOUND(BLOCK_BYTES);
+         break;
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         if (level < 1)
+         {
+            level = 1;
+         }
+         else if (level > 9)
+         {
+            level = 9;
+         }
+
+         s->gzip = (z_stream*)calloc(1, sizeof(z_stream));
+         if (s->gzip == NULL)
+         {
+            goto error;
+         }
+
+         if (deflateInit2(s->gzip, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+         {
+            free(s->gzip);
+            s->gzip = NULL;
+            goto error;
+         }
+
+         s->buffer_size = 65536;
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         if (level < 1)
+         {
+            level = 1;
+         }
+         else if (level > 9)
+         {
+            level = 9;
+         }
+
+         s->bzip2 = (bz_stream*)calloc(1, sizeof(bz_stream));
+         if (s->bzip2 == NULL)
+         {
+            goto error;
+         }
+
+         if (BZ2_bzCompressInit(s->bzip2, level, 0, 0) != BZ_OK)
+         {
+            free(s->bzip2);
+            s->bzip2 = NULL;
+            goto error;
+         }
+
+         s->buffer_size = 65536;
+         break;
+      case COMPRESSION_NONE:
+         break;
+      default:
+         pgmoneta_log_error("Streamer: Unknown compression type %d", compression);
+         goto error;
+   }
+
+   if (s->buffer_size > 0)
+   {
+      s->buffer = (unsigned char*)malloc(s->buffer_size);
+      if (s->buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_aead_mode(encryption))
+   {
+      if (pgmoneta_aead_create(encryption, stream_aead_output, s, &s->aead))
+      {
+         goto error;
+      }
+   }
+   else if (encryption != ENCRYPTION_NONE)
+   {
+      if (pgmoneta_cipher_context_create(encryption, 1, &s->cipher))
+      {
+         goto error;
+      }
+
+      s->cipher_buffer_size = 65536 + EVP_MAX_BLOCK_LENGTH;
+      s->cipher_buffer = (unsigned char*)malloc(s->cipher_buffer_size);
+      if (s->cipher_buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   *streamer = s;
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Streamer: Could not create streamer");
+
+   pgmoneta_streamer_destroy(s);
+
+   return 1;
+}
+
+int
+pgmoneta_streamer_write(struct streamer* streamer, void* data, size_t size)
+{
+   if (streamer == NULL)
+   {
+      return 1;
+   }
+
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   streamer->bytes_in += size;
+
+   return stream_compress(streamer, data, size, false);
+}
+
+int
+pgmoneta_streamer_finish(struct streamer* streamer)
+{
+   if (streamer == NULL)
+   {
+      return 1;
+   }
+
+   if (stream_compress(streamer, NULL, 0, true))
+   {
+      return 1;
+   }
+
+   if (fflush(streamer->file) != 0)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_streamer_digest(struct streamer* streamer)
+{
+   if (streamer == NULL || streamer->bytes_out > 0)
+   {
+      return 1;
+   }
+
+   streamer->digest = EVP_MD_CTX_new();
+   if (streamer->digest == NULL)
+   {
+      return 1;
+   }
+
+   if (EVP_DigestInit_ex(streamer->digest, EVP_sha256(), NULL) != 1)
+   {
+      EVP_MD_CTX_free(streamer->digest);
+      streamer->digest = NULL;
+      return 1;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_streamer_sha256(struct streamer* streamer, char** sha256)
+{
+   unsigned int length = 0;
+   unsigned char hash[EVP_MAX_MD_SIZE];
+   char* s = NULL;
+
+   *sha256 = NULL;
+
+   if (streamer == NULL || streamer->digest == NULL)
+   {
+      return 1;
+   }
+
+   if (EVP_DigestFinal_ex(streamer->digest, hash, &length) != 1)
+   {
+      return 1;
+   }
+
+   s = (char*)malloc(length * 2 + 1);
+   if (s == NULL)
+   {
+      return 1;
+   }
+
+   for (unsigned int i = 0; i < length; i++)
+   {
+      sprintf(&s[i * 2], "%02x", hash[i]);
+   }
+   s[length * 2] = '\0';
+
+   *sha256 = s;
+
+   return 0;
+}
+
+void
+pgmoneta_streamer_destroy(struct streamer* streamer)
+{
+   if (streamer == NULL)
+   {
+      return;
+   }
+
+   if (streamer->zstd != NULL)
+   {
+      ZSTD_freeCCtx(streamer->zstd);
+   }
+   pgmoneta_zstandard_threads_release(streamer->zstd_threads);
+
+   if (streamer->lz4 != NULL)
+   {
+      LZ4_freeStream(streamer->lz4);
+   }
+
+   if (streamer->gzip != NULL)
+   {
+      deflateEnd(streamer->gzip);
+      free(streamer->gzip);
+   }
+
+   if (streamer->bzip2 != NULL)
+   {
+      BZ2_bzCompressEnd(streamer->bzip2);
+      free(streamer->bzip2);
+   }
+
+   if (streamer->cipher != NULL)
+   {
+      EVP_CIPHER_CTX_free(streamer->cipher);
+   }
+
+   pgmoneta_aead_destroy(streamer->aead);
+
+   if (streamer->digest != NULL)
+   {
+      EVP_MD_CTX_free(streamer->digest);
+   }
+
+   free(streamer->buffer);
+   free(streamer->cipher_buffer);
+   free(streamer);
+}
+
+char*
+pgmoneta_streamer_suffix(int compression, int encryption)
+{
+   char* suffix = NULL;
+
+   suffix = pgmoneta_append(suffix, "");
+
+   switch (compression)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         suffix = pgmoneta_append(suffix, ".gz");
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         suffix = pgmoneta_append(suffix, ".zstd");
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         suffix = pgmoneta_append(suffix, ".lz4");
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         suffix = pgmoneta_append(suffix, ".bz2");
+         break;
+      default:
+         break;
+   }
+
+   if (encryption != ENCRYPTION_NONE)
+   {
+      suffix = pgmoneta_append(suffix, ".aes");
+   }
+
+   return suffix;
+}
+
+int
+pgmoneta_destreamer_create(int compression, int encryption, FILE* file, struct destreamer** destreamer)
+{
+   struct stat st;
+   struct destreamer* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *destreamer = NULL;
+
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   d = (struct destreamer*)calloc(1, sizeof(struct destreamer));
+   if (d == NULL)
+   {
+      goto error;
+   }
+
+   d->compression = compression;
+   d->encryption = encryption;
+   d->file = file;
+
+   /* Holes need a regular file, a memory stream or a pipe is written densely */
+   d->sparse = config->sparse_files && fileno(file) >= 0 && !fstat(fileno(file), &st) && S_ISREG(st.st_mode);
+
+   switch (compression)
+   {
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         d->zstd = ZSTD_createDCtx();
+         if (d->zstd == NULL)
+         {
+            goto error;
+         }
+
+         d->buffer_size = ZSTD_DStreamOutSize();
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         d->lz4 = LZ4_createStreamDecode();
+         if (d->lz4 == NULL)
+         {
+            goto error;
+         }
+
+         LZ4_setStreamDecode(d->lz4, NULL, 0);
+
+         d->buffer_size = LZ4_COMPRESSBOUND(BLOCK_BYTES);
+         break;
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         d->gzip = (z_stream*)calloc(1, sizeof(z_stream));
+         if (d->gzip == NULL)
+         {
+            goto error;
+         }
+
+         if (inflateInit2(d->gzip, MAX_WBITS + 16) != Z_OK)
+         {
+            free(d->gzip);
+            d->gzip = NULL;
+            goto error;
+         }
+
+         d->buffer_size = 65536;
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         d->bzip2 = (bz_stream*)calloc(1, sizeof(bz_stream));
+         if (d->bzip2 == NULL)
+         {
+            goto error;
+         }
+
+         if (BZ2_bzDecompressInit(d->bzip2, 0, 0) != BZ_OK)
+         {
+            free(d->bzip2);
+            d->bzip2 = NULL;
+            goto error;
+         }
+
+         d->buffer_size = 65536;
+         break;
+      case COMPRESSION_NONE:
+         break;
+      default:
+         pgmoneta_log_error("Destreamer: Unknown compression type %d", compression);
+         goto error;
+   }
+
+   if (d->buffer_size > 0)
+   {
+      d->buffer = (unsigned char*)malloc(d->buffer_size);
+      if (d->buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_aead_mode(encryption))
+   {
+      if (pgmoneta_aead_open_create(destream_aead_output, d, &d->aead))
+      {
+         goto error;
+      }
+   }
+   else if (encryption != ENCRYPTION_NONE)
+   {
+      if (pgmoneta_cipher_context_create(encryption, 0, &d->cipher))
+      {
+         goto error;
+      }
+
+      d->cipher_buffer_size = 65536 + EVP_MAX_BLOCK_LENGTH;
+      d->cipher_buffer = (unsigned char*)malloc(d->cipher_buffer_size);
+      if (d->cipher_buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   *destreamer = d;
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Destreamer: Could not create destreamer");
+
+   pgmoneta_destreamer_destroy(d);
+
+   return 1;
+}
+
+int
+pgmoneta_destreamer_write(struct destreamer* destreamer, void* data, size_t size)
+{
+   if (destreamer == NULL)
+   {
+      return 1;
+   }
+
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   destreamer->bytes_in += size;
+
+   return destream_decrypt(destreamer, data, size, false);
+}
+
+int
+pgmoneta_destreamer_finish(struct destreamer* destreamer)
+{
+   if (destreamer == NULL)
+   {
+      return 1;
+   }
+
+   if (destream_decrypt(destreamer, NULL, 0, true))
+   {
+      return 1;
+   }
+
+   if (destream_decompress_finish(destreamer))
+   {
+      return 1;
+   }
+
+   if (fflush(destreamer->file) != 0)
+   {
+      return 1;
+   }
+
+   /* A file that ends in a hole gets its size from the truncate */
+   if (destreamer->hole && ftruncate(fileno(destreamer->file), ftello(destreamer->file)))
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+void
+pgmoneta_destreamer_destroy(struct destreamer* destreamer)
+{
+   if (destreamer == NULL)
+   {
+      return;
+   }
+
+   if (destreamer->zstd != NULL)
+   {
+      ZSTD_freeDCtx(destreamer->zstd);
+   }
+
+   if (destreamer->lz4 != NULL)
+   {
+      LZ4_freeStreamDecode(destreamer->lz4);
+   }
+
+   if (destreamer->gzip != NULL)
+   {
+      inflateEnd(destreamer->gzip);
+      free(destreamer->gzip);
+   }
+
+   if (destreamer->bzip2 != NULL)
+   {
+      BZ2_bzDecompressEnd(destreamer->bzip2);
+      free(destreamer->bzip2);
+   }
+
+   if (destreamer->cipher != NULL)
+   {
+      EVP_CIPHER_CTX_free(destreamer->cipher);
+   }
+
+   pgmoneta_aead_destroy(destreamer->aead);
+
+   free(destreamer->buffer);
+   free(destreamer->cipher_buffer);
+   free(destreamer);
+}
+
+int
+pgmoneta_destreamer_file(char* from, char* to)
+{
+   FILE* out = NULL;
+
+   out = fopen(to, "wb");
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_destreamer_stream(from, out))
+   {
+      goto error;
+   }
+
+   if (fflush(out) != 0 || pgmoneta_durability_file(fileno(out)))
+   {
+      goto error;
+   }
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (pgmoneta_exists(to))
+   {
+      pgmoneta_delete_file(to, NULL);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_destreamer_stream(char* from, FILE* out)
+{
+   return destream_file(from, out, 0);
+}
+
+int
+pgmoneta_destreamer_head(char* from, size_t size, FILE* out)
+{
+   return destream_file(from, out, size);
+}
+
+static int
+destream_file(char* from, FILE* out, size_t limit)
+{
+   int compression = COMPRESSION_NONE;
+   int encryption = ENCRYPTION_NONE;
+   size_t n;
+   char* name = NULL;
+   unsigned char* buffer = NULL;
+   struct io_reader* in = NULL;
+   struct destreamer* destreamer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   name = pgmoneta_append(name, from);
+   if (name == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_ends_with(name, ".aes"))
+   {
+      // authenticated files name their mode in the header, the others use the configured cipher
+      encryption = pgmoneta_aead_file(from) ? ENCRYPTION_AES_256_GCM : config->encryption;
+      name[strlen(name) - strlen(".aes")] = '\0';
+
+      if (encryption == ENCRYPTION_NONE)
+      {
+         pgmoneta_log_error("Destreamer: No encryption configured for %s", from);
+         goto error;
+      }
+   }
+
+   if (pgmoneta_ends_with(name, ".zstd"))
+   {
+      compression = COMPRESSION_CLIENT_ZSTD;
+   }
+   else if (pgmoneta_ends_with(name, ".lz4"))
+   {
+      compression = COMPRESSION_CLIENT_LZ4;
+   }
+   else if (pgmoneta_ends_with(name, ".gz"))
+   {
+      compression = COMPRESSION_CLIENT_GZIP;
+   }
+   else if (pgmoneta_ends_with(name, ".bz2"))
+   {
+      compression = COMPRESSION_CLIENT_BZIP2;
+   }
+
+   buffer = (unsigned char*)pgmoneta_worker_buffer(WORKER_BUFFER_IN, IO_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_io_reader_open(from, 0, 0, &in))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_destreamer_create(compression, encryption, out, &destreamer))
+   {
+      goto error;
+   }
+
+   // with a limit only the start of the file is decoded, so the rest is never read
+   while ((limit == 0 || destreamer->bytes_out < limit) &&
+          (n = pgmoneta_io_reader_read(in, buffer, IO_BUFFER_SIZE)) > 0)
+   {
+      if (pgmoneta_destreamer_write(destreamer, buffer, n))
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_io_reader_error(in))
+   {
+      goto error;
+   }
+
+   if ((limit == 0 || destreamer->bytes_out < limit) && pgmoneta_destreamer_finish(destreamer))
+   {
+      goto error;
+   }
+
+   pgmoneta_destreamer_destroy(destreamer);
+   pgmoneta_io_reader_close(in);
+
+   free(name);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Destreamer: Could not decode %s", from);
+
+   pgmoneta_destreamer_destroy(destreamer);
+   pgmoneta_io_reader_close(in);
+
+   free(name);
+
+   return 1;
+}
+
+static int
+stream_compress(struct streamer* streamer, void* data, size_t size, bool finish)
+{
+   PGMONETA_PROBE2(compress__block, size, finish);
+
+   if (streamer->zstd != NULL)
+   {
+      return stream_compress_zstd(streamer, data, size, finish);
+   }
+   else if (streamer->lz4 != NULL)
+   {
+      return stream_compress_lz4(streamer, data, size, finish);
+   }
+   else if (streamer->gzip != NULL)
+   {
+      return stream_compress_gzip(streamer, data, size, finish);
+   }
+   else if (streamer->bzip2 != NULL)
+   {
+      return stream_compress_bzip2(streamer, data, size, finish);
+   }
+
+   return stream_encrypt(streamer, data, size, finish);
+}
+
+static int
+stream_compress_zstd(struct streamer* streamer, void* data, size_t size, bool finish)
+{
+   size_t remaining;
+   ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+   ZSTD_inBuffer input = {data, size, 0};
+
+   do
+   {
+      ZSTD_outBuffer output = {streamer->buffer, streamer->buffer_size, 0};
+
+      remaining = ZSTD_compressStream2(streamer->zstd, &output, &input, mode);
+      if (ZSTD_isError(remaining))
+      {
+         pgmoneta_log_error("Streamer: ZSTD %s", ZSTD_getErrorName(remaining));
+         return 1;
+      }
+
+      if (output.pos > 0 && stream_encrypt(streamer, streamer->buffer, output.pos, false))
+      {
+         return 1;
+      }
+   }
+   while (finish ? remaining != 0 : input.pos != input.size);
+
+   if (finish)
+   {
+      return stream_encrypt(streamer, NULL, 0, true);
+   }
+
+   return 0;
+}
+
+static int
+stream_compress_lz4(struct streamer* streamer, void* data, size_t size, bool finish)
+{
+   size_t offset = 0;
+   size_t chunk;
+
+   while (offset < size)
+   {
+      chunk = MIN(size - offset, (size_t)BLOCK_BYTES - streamer->lz4_length);
+
+      memcpy(streamer->lz4_buffer[streamer->lz4_index] + streamer->lz4_length, (char*)data + offset, chunk);
+      streamer->lz4_length += chunk;
+      offset += chunk;
+
+      if (streamer->lz4_length == BLOCK_BYTES)
+      {
+         if (stream_compress_lz4_block(streamer))
+         {
+            return 1;
+         }
+      }
+   }
+
+   if (finish)
+   {
+      if (streamer->lz4_length > 0 && stream_compress_lz4_block(streamer))
+      {
+         return 1;
+      }
+
+      return stream_encrypt(streamer, NULL, 0, true);
+   }
+
+   return 0;
+}
+
+static int
+stream_compress_lz4_block(struct streamer* streamer)
+{
+   int compressed;
+
+   compressed = LZ4_compress_fast_continue(streamer->lz4, streamer->lz4_buffer[streamer->lz4_index],
+                                           (char*)streamer->buffer, (int)streamer->lz4_length,
+                                           (int)streamer->buffer_size, 1);
+   if (compressed <= 0)
+   {
+      pgmoneta_log_error("Streamer: LZ4 compression failed");
+      return 1;
+   }
+
+   if (stream_encrypt(streamer, &compressed, sizeof(compressed), false))
+   {
+      return 1;
+   }
+
+   if (stream_encrypt(streamer, streamer->buffer, (size_t)compressed, false))
+   {
+      return 1;
+   }
+
+   streamer->lz4_index = (streamer->lz4_index + 1) % 2;
+   streamer->lz4_length = 0;
+
+   return 0;
+}
+
+static int
+stream_compress_gzip(struct streamer* streamer, void* data, size_t size, bool finish)
+{
+   int ret;
+   size_t have;
+
+   streamer->gzip->next_in = (Bytef*)data;
+   streamer->gzip->avail_in = (uInt)size;
+
+   do
+   {
+      streamer->gzip->next_out = streamer->buffer;
+      streamer->gzip->avail_out = (uInt)streamer->buffer_size;
+
+      ret = deflate(streamer->gzip, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR)
+      {
+         pgmoneta_log_error("Streamer: GZip compression failed");
+         return 1;
+      }
+
+      have = streamer->buffer_size - streamer->gzip->avail_out;
+      if (have > 0 && stream_encrypt(streamer, streamer->buffer, have, false))
+      {
+         return 1;
+      }
+   }
+   while (streamer->gzip->avail_out == 0 || (finish && ret != Z_STREAM_END));
+
+   if (finish)
+   {
+      return stream_encrypt(streamer, NULL, 0, true);
+   }
+
+   return 0;
+}
+
+static int
+stream_compress_bzip2(struct streamer* streamer, void* data, size_t size, bool finish)
+{
+   int ret;
+   size_t have;
+
+   streamer->bzip2->next_in = (char*)data;
+   streamer->bzip2->avail_in = (unsigned int)size;
+
+   do
+   {
+      streamer->bzip2->next_out = (char*)streamer->buffer;
+      streamer->bzip2->avail_out = (unsigned int)streamer->buffer_size;
+
+      ret = BZ2_bzCompress(streamer->bzip2, finish ? BZ_FINISH : BZ_RUN);
+      if (ret != BZ_RUN_OK && ret != BZ_FINISH_OK && ret != BZ_STREAM_END)
+      {
+         pgmoneta_log_error("Streamer: BZip2 compression failed %d", ret);
+         return 1;
+      }
+
+      have = streamer->buffer_size - streamer->bzip2->avail_out;
+      if (have > 0 && stream_encrypt(streamer, streamer->buffer, have, false))
+      {
+         return 1;
+      }
+   }
+   while (streamer->bzip2->avail_in > 0 || (finish && ret != BZ_STREAM_END));
+
+   if (finish)
+   {
+      return stream_encrypt(streamer, NULL, 0, true);
+   }
+
+   return 0;
+}
+
+static int
+stream_encrypt(struct streamer* streamer, void* data, size_t size, bool finish)
+{
+   int outl = 0;
+   size_t offset = 0;
+   size_t chunk;
+
+   if (streamer->aead != NULL)
+   {
+      if (size > 0 && pgmoneta_aead_update(streamer->aead, data, size))
+      {
+         pgmoneta_log_error("Streamer: AEAD encryption failed");
+         return 1;
+      }
+
+      return finish ? pgmoneta_aead_finish(streamer->aead) : 0;
+   }
+
+   if (streamer->cipher == NULL)
+   {
+      return stream_output(streamer, data, size);
+   }
+
+   while (offset < size)
+   {
+      chunk = MIN(size - offset, streamer->cipher_buffer_size - EVP_MAX_BLOCK_LENGTH);
+
+      if (EVP_CipherUpdate(streamer->cipher, streamer->cipher_buffer, &outl,
+                           (unsigned char*)data + offset, (int)chunk) == 0)
+      {
+         pgmoneta_log_error("Streamer: EVP_CipherUpdate failed");
+         return 1;
+      }
+
+      if (stream_output(streamer, streamer->cipher_buffer, (size_t)outl))
+      {
+         return 1;
+      }
+
+      offset += chunk;
+   }
+
+   if (finish)
+   {
+      if (EVP_CipherFinal_ex(streamer->cipher, streamer->cipher_buffer, &outl) == 0)
+      {
+         pgmoneta_log_error("Streamer: EVP_CipherFinal_ex failed");
+         return 1;
+      }
+
+      if (stream_output(streamer, streamer->cipher_buffer, (size_t)outl))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static int
+stream_output(struct streamer* streamer, void* data, size_t size)
+{
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (fwrite(data, 1, size, streamer->file) != size)
+   {
+      pgmoneta_log_error("Streamer: Could not write %zu bytes", size);
+      return 1;
+   }
+
+   if (streamer->digest != NULL && EVP_DigestUpdate(streamer->digest, data, size) != 1)
+   {
+      return 1;
+   }
+
+   streamer->bytes_out += size;
+
+   return 0;
+}
+
+static int
+stream_aead_output(void* data, void* buffer, size_t size)
+{
+   return stream_output((struct streamer*)data, buffer, size);
+}
+
+static int
+destream_decrypt(struct destreamer* destreamer, void* data, size_t size, bool finish)
+{
+   int outl = 0;
+   size_t offset = 0;
+   size_t chunk;
+
+   if (destreamer->aead != NULL)
+   {
+      if (size > 0 && pgmoneta_aead_open_update(destreamer->aead, data, size))
+      {
+         return 1;
+      }
+
+      return finish ? pgmoneta_aead_open_finish(destreamer->aead) : 0;
+   }
+
+   if (destreamer->cipher == NULL)
+   {
+      return destream_decompress(destreamer, data, size);
+   }
+
+   while (offset < size)
+   {
+      chunk = MIN(size - offset, destreamer->cipher_buffer_size - EVP_MAX_BLOCK_LENGTH);
+
+      if (EVP_CipherUpdate(destreamer->cipher, destreamer->cipher_buffer, &outl,
+                           (unsigned char*)data + offset, (int)chunk) == 0)
+      {
+         pgmoneta_log_error("Destreamer: EVP_CipherUpdate failed");
+         return 1;
+      }
+
+      if (destream_decompress(destreamer, destreamer->cipher_buffer, (size_t)outl))
+      {
+         return 1;
+      }
+
+      offset += chunk;
+   }
+
+   if (finish)
+   {
+      if (EVP_CipherFinal_ex(destreamer->cipher, destreamer->cipher_buffer, &outl) == 0)
+      {
+         pgmoneta_log_error("Destreamer: EVP_CipherFinal_ex failed");
+         return 1;
+      }
+
+      if (destream_decompress(destreamer, destreamer->cipher_buffer, (size_t)outl))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static int
+destream_decompress(struct destreamer* destreamer, void* data, size_t size)
+{
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (destreamer->zstd != NULL)
+   {
+      return destream_zstd(destreamer, data, size);
+   }
+   else if (destreamer->lz4 != NULL)
+   {
+      return destream_lz4(destreamer, data, size);
+   }
+   else if (destreamer->gzip != NULL)
+   {
+      return destream_gzip(destreamer, data, size);
+   }
+   else if (destreamer->bzip2 != NULL)
+   {
+      return destream_bzip2(destreamer, data, size);
+   }
+
+   return destream_output(destreamer, data, size);
+}
+
+static int
+destream_decompress_finish(struct destreamer* destreamer)
+{
+   size_t ret;
+
+   if (destreamer->zstd != NULL)
+   {
+      ZSTD_inBuffer input = {NULL, 0, 0};
+
+      // flush what is left in the context once the input buffer was full
+      if (destreamer->zstd_started && destreamer->zstd_remaining != 0)
+      {
+         do
+         {
+            ZSTD_outBuffer output = {destreamer->buffer, destreamer->buffer_size, 0};
+
+            ret = ZSTD_decompressStream(destreamer->zstd, &output, &input);
+            if (ZSTD_isError(ret))
+            {
+               pgmoneta_log_error("Destreamer: ZSTD %s", ZSTD_getErrorName(ret));
+               return 1;
+            }
+
+            destreamer->zstd_remaining = ret;
+
+            if (destream_output(destreamer, destreamer->buffer, output.pos))
+            {
+               return 1;
+            }
+
+            if (output.pos == 0)
+            {
+               break;
+            }
+         }
+         while (ret != 0);
+      }
+
+      if (!destreamer->zstd_started || destreamer->zstd_remaining != 0)
+      {
+         pgmoneta_log_error("Destreamer: Truncated ZSTD data");
+         return 1;
+      }
+   }
+   else if (destreamer->lz4 != NULL)
+   {
+      if (destreamer->lz4_block != 0 || destreamer->lz4_length != 0)
+      {
+         pgmoneta_log_error("Destreamer: Truncated LZ4 data");
+         return 1;
+      }
+   }
+   else if (destreamer->gzip != NULL)
+   {
+      if (!destreamer->gzip_end)
+      {
+         pgmoneta_log_error("Destreamer: Truncated GZip data");
+         return 1;
+      }
+   }
+   else if (destreamer->bzip2 != NULL)
+   {
+      if (!destreamer->bzip2_end)
+      {
+         pgmoneta_log_error("Destreamer: Truncated BZip2 data");
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static int
+destream_zstd(struct destreamer* destreamer, void* data, size_t size)
+{
+   size_t ret;
+   ZSTD_inBuffer input = {data, size, 0};
+
+   if (!destreamer->zstd_started)
+   {
+      // the frame header names the dictionary the data was compressed with
+      uint32_t id = ZSTD_getDictID_fromFrame(data, size);
+      ZSTD_DDict* ddict = NULL;
+
+      if (id != 0)
+      {
+         ddict = pgmoneta_zstandard_dictionary_get(id);
+         if (ddict == NULL)
+         {
+            pgmoneta_log_error("Destreamer: No ZSTD dictionary %u", id);
+            return 1;
+         }
+      }
+
+      ZSTD_DCtx_refDDict(destreamer->zstd, ddict);
+      destreamer->zstd_started = true;
+   }
+
+   while (input.pos < input.size)
+   {
+      ZSTD_outBuffer output = {destreamer->buffer, destreamer->buffer_size, 0};
+
+      ret = ZSTD_decompressStream(destreamer->zstd, &output, &input);
+      if (ZSTD_isError(ret))
+      {
+         pgmoneta_log_error("Destreamer: ZSTD %s", ZSTD_getErrorName(ret));
+         return 1;
+      }
+
+      destreamer->zstd_remaining = ret;
+
+      if (destream_output(destreamer, destreamer->buffer, output.pos))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static int
+destream_lz4(struct destreamer* destreamer, void* data, size_t size)
+{
+   int decompressed;
+   size_t offset = 0;
+   size_t chunk;
+
+   // the block index that follows the end of the blocks is not needed
+   if (destreamer->lz4_block < 0)
+   {
+      return 0;
+   }
+
+   while (offset < size)
+   {
+      // every block is preceded by its compressed size
+      if (destreamer->lz4_block == 0)
+      {
+         chunk = MIN(size - offset, sizeof(int) - destreamer->lz4_length);
+         memcpy(destreamer->buffer + destreamer->lz4_length, (char*)data + offset, chunk);
+
+         destreamer->lz4_length += chunk;
+         offset += chunk;
+
+         if (destreamer->lz4_length == sizeof(int))
+         {
+            memcpy(&destreamer->lz4_block, destreamer->buffer, sizeof(int));
+            destreamer->lz4_length = 0;
+
+            if (destreamer->lz4_block == 0)
+            {
+               destreamer->lz4_block = -1;
+               return 0;
+            }
+
+            if (destreamer->lz4_block <= 0 || (size_t)destreamer->lz4_block > destreamer->buffer_size)
+            {
+               pgmoneta_log_error("Destreamer: Invalid LZ4 block size %d", destreamer->lz4_block);
+               return 1;
+            }
+         }
+
+         continue;
+      }
+
+      chunk = MIN(size - offset, (size_t)destreamer->lz4_block - destreamer->lz4_length);
+      memcpy(destreamer->buffer + destreamer->lz4_length, (char*)data + offset, chunk);
+
+      destreamer->lz4_length += chunk;
+      offset += chunk;
+
+      if (destreamer->lz4_length == (size_t)destreamer->lz4_block)
+      {
+         decompressed = LZ4_decompress_safe_continue(destreamer->lz4, (char*)destreamer->buffer,
+                                                     destreamer->lz4_buffer[destreamer->lz4_index],
+                                                     destreamer->lz4_block, BLOCK_BYTES);
+         if (decompressed <= 0)
+         {
+            pgmoneta_log_error("Destreamer: LZ4 decompression failed");
+            return 1;
+         }
+
+         if (destream_output(destreamer, destreamer->lz4_buffer[destreamer->lz4_index], (size_t)decompressed))
+         {
+            return 1;
+         }
+
+         destreamer->lz4_index = (destreamer->lz4_index + 1) % 2;
+         destreamer->lz4_block = 0;
+         destreamer->lz4_length = 0;
+      }
+   }
+
+   return 0;
+}
+
+static int
+destream_gzip(struct destreamer* destreamer, void* data, size_t size)
+{
+   int ret;
+
+   destreamer->gzip->next_in = (Bytef*)data;
+   destreamer->gzip->avail_in = (uInt)size;
+
+   do
+   {
+      // a file can hold several gzip members, each one starts a new stream
+      if (destreamer->gzip_end)
+      {
+         if (destreamer->gzip->avail_in == 0)
+         {
+            break;
+         }
+
+         inflateReset(destreamer->gzip);
+         destreamer->gzip_end = false;
+      }
+
+      destreamer->gzip->next_out = destreamer->buffer;
+      destreamer->gzip->avail_out = (uInt)destreamer->buffer_size;
+
+      ret = inflate(destreamer->gzip, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+      {
+         destreamer->gzip_end = true;
+      }
+      else if (ret == Z_BUF_ERROR)
+      {
+         break;
+      }
+      else if (ret != Z_OK)
+      {
+         pgmoneta_log_error("Destreamer: GZip decompression failed %d", ret);
+         return 1;
+      }
+
+      if (destream_output(destreamer, destreamer->buffer, destreamer->buffer_size - destreamer->gzip->avail_out))
+      {
+         return 1;
+      }
+   }
+   while (destreamer->gzip->avail_in > 0 || destreamer->gzip->avail_out == 0);
+
+   return 0;
+}
+
+static int
+destream_bzip2(struct destreamer* destreamer, void* data, size_t size)
+{
+   int ret;
+   char* next_in = NULL;
+   unsigned int avail_in = 0;
+
+   destreamer->bzip2->next_in = (char*)data;
+   destreamer->bzip2->avail_in = (unsigned int)size;
+
+   do
+   {
+      // concatenated streams are decompressed one after the other
+      if (destreamer->bzip2_end)
+      {
+         if (destreamer->bzip2->avail_in == 0)
+         {
+            break;
+         }
+
+         next_in = destreamer->bzip2->next_in;
+         avail_in = destreamer->bzip2->avail_in;
+
+         BZ2_bzDecompressEnd(destreamer->bzip2);
+         memset(destreamer->bzip2, 0, sizeof(bz_stream));
+
+         if (BZ2_bzDecompressInit(destreamer->bzip2, 0, 0) != BZ_OK)
+         {
+            return 1;
+         }
+
+         destreamer->bzip2->next_in = next_in;
+         destreamer->bzip2->avail_in = avail_in;
+         destreamer->bzip2_end = false;
+      }
+
+      destreamer->bzip2->next_out = (char*)destreamer->buffer;
+      destreamer->bzip2->avail_out = (unsigned int)destreamer->buffer_size;
+
+      ret = BZ2_bzDecompress(destreamer->bzip2);
+      if (ret == BZ_STREAM_END)
+      {
+         destreamer->bzip2_end = true;
+      }
+      else if (ret != BZ_OK)
+      {
+         pgmoneta_log_error("Destreamer: BZip2 decompression failed %d", ret);
+         return 1;
+      }
+
+      if (destream_output(destreamer, destreamer->buffer, destreamer->buffer_size - destreamer->bzip2->avail_out))
+      {
+         return 1;
+      }
+   }
+   while (destreamer->bzip2->avail_in > 0 || destreamer->bzip2->avail_out == 0);
+
+   return 0;
+}
+
+static int
+destream_output(struct destreamer* destreamer, void* data, size_t size)
+{
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (destreamer->sparse)
+   {
+      if (destream_sparse_output(destreamer, (unsigned char*)data, size))
+      {
+         pgmoneta_log_error("Destreamer: Could not write %zu bytes", size);
+         return 1;
+      }
+   }
+   else if (fwrite(data, 1, size, destreamer->file) != size)
+   {
+      pgmoneta_log_error("Destreamer: Could not write %zu bytes", size);
+      return 1;
+   }
+
+   destreamer->bytes_out += size;
+
+   return 0;
+}
+
+static int
+destream_sparse_output(struct destreamer* destreamer, unsigned char* data, size_t size)
+{
+   size_t start = 0;
+   size_t position = 0;
+   size_t block;
+
+   /* The zero blocks that are aligned in the output are skipped with a seek */
+   while (position < size)
+   {
+      block = MIN(SPARSE_BLOCK_SIZE - (destreamer->bytes_out + position) % SPARSE_BLOCK_SIZE, size - position);
+
+      if (block == SPARSE_BLOCK_SIZE && pgmoneta_is_zero(data + position, block))
+      {
+         if (position > start && fwrite(data + start, 1, position - start, destreamer->file) != position - start)
+         {
+            return 1;
+         }
+
+         if (fseeko(destreamer->file, block, SEEK_CUR))
+         {
+            return 1;
+         }
+
+         destreamer->hole = true;
+         start = position + block;
+      }
+
+      position += block;
+   }
+
+   if (size > start)
+   {
+      if (fwrite(data + start, 1, size - start, destreamer->file) != size - start)
+      {
+         return 1;
+      }
+
+      destreamer->hole = false;
+   }
+
+   return 0;
+}
+
+static int
+destream_aead_output(void* data, void* buffer, size_t size)
+{
+   return destream_decompress((struct destreamer*)data, buffer, size);
+}
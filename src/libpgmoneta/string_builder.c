@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pgmoneta.h>
+#include <string_builder.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int string_builder_reserve(struct string_builder* sb, size_t length);
+
+void
+pgmoneta_string_builder_init(struct string_builder* sb)
+{
+   sb->data = &sb->inline_data[0];
+   sb->length = 0;
+   sb->capacity = STRING_BUILDER_INLINE_SIZE;
+   sb->data[0] = '\0';
+}
+
+int
+pgmoneta_string_builder_append(struct string_builder* sb, char* s)
+{
+   if (s == NULL)
+   {
+      return 0;
+   }
+
+   return pgmoneta_string_builder_append_length(sb, s, strlen(s));
+}
+
+int
+pgmoneta_string_builder_append_length(struct string_builder* sb, char* s, size_t length)
+{
+   if (string_builder_reserve(sb, length))
+   {
+      return 1;
+   }
+
+   memcpy(sb->data + sb->length, s, length);
+   sb->length += length;
+   sb->data[sb->length] = '\0';
+
+   return 0;
+}
+
+int
+pgmoneta_string_builder_append_char(struct string_builder* sb, char c)
+{
+   return pgmoneta_string_builder_append_length(sb, &c, 1);
+}
+
+int
+pgmoneta_string_builder_append_int(struct string_builder* sb, int i)
+{
+   char number[12];
+   int length;
+
+   length = snprintf(&number[0], sizeof(number), "%d", i);
+
+   return pgmoneta_string_builder_append_length(sb, &number[0], length);
+}
+
+int
+pgmoneta_string_builder_append_ulong(struct string_builder* sb, unsigned long l)
+{
+   char number[21];
+   int length;
+
+   length = snprintf(&number[0], sizeof(number), "%lu", l);
+
+   return pgmoneta_string_builder_append_length(sb, &number[0], length);
+}
+
+int
+pgmoneta_string_builder_append_double(struct string_builder* sb, double d)
+{
+   char number[21];
+
+   memset(&number[0], 0, sizeof(number));
+   snprintf(&number[0], 20, "%lf", d);
+
+   return pgmoneta_string_builder_append(sb, &number[0]);
+}
+
+int
+pgmoneta_string_builder_append_double_precision(struct string_builder* sb, double d, int precision)
+{
+   char number[21];
+
+   memset(&number[0], 0, sizeof(number));
+   snprintf(&number[0], 20, "%.*f", precision, d);
+
+   return pgmoneta_string_builder_append(sb, &number[0]);
+}
+
+int
+pgmoneta_string_builder_append_bool(struct string_builder* sb, bool b)
+{
+   return pgmoneta_string_builder_append_char(sb, b ? '1' : '0');
+}
+
+void
+pgmoneta_string_builder_reset(struct string_builder* sb)
+{
+   sb->length = 0;
+   sb->data[0] = '\0';
+}
+
+char*
+pgmoneta_string_builder_detach(struct string_builder* sb)
+{
+   char* result = NULL;
+
+   if (sb->length == 0)
+   {
+      pgmoneta_string_builder_destroy(sb);
+      return NULL;
+   }
+
+   if (sb->data == &sb->inline_data[0])
+   {
+      result = (char*)malloc(sb->length + 1);
+      if (result != NULL)
+      {
+         memcpy(result, sb->data, sb->length + 1);
+      }
+   }
+   else
+   {
+      // give the spare capacity back
+      result = (char*)realloc(sb->data, sb->length + 1);
+      if (result == NULL)
+      {
+         result = sb->data;
+      }
+   }
+
+   pgmoneta_string_builder_init(sb);
+
+   return result;
+}
+
+void
+pgmoneta_string_builder_destroy(struct string_builder* sb)
+{
+   if (sb->data != &sb->inline_data[0])
+   {
+      free(sb->data);
+   }
+
+   pgmoneta_string_builder_init(sb);
+}
+
+static int
+string_builder_reserve(struct string_builder* sb, size_t length)
+{
+   size_t capacity;
+   char* n = NULL;
+
+   if (sb->length + length + 1 <= sb->capacity)
+   {
+      return 0;
+   }
+
+   capacity = sb->capacity;
+   while (capacity < sb->length + length + 1)
+   {
+      capacity *= 2;
+   }
+
+   if (sb->data == &sb->inline_data[0])
+   {
+      n = (char*)malloc(capacity);
+      if (n == NULL)
+      {
+         return 1;
+      }
+      memcpy(n, sb->data, sb->length + 1);
+   }
+   else
+   {
+      n = (char*)realloc(sb->data, capacity);
+      if (n == NULL)
+      {
+         return 1;
+      }
+   }
+
+   sb->data = n;
+   sb->capacity = capacity;
+
+   return 0;
+}
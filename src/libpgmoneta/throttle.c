@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <memory.h>
+#include <message.h>
+#include <network.h>
+#include <security.h>
+#include <throttle.h>
+#include <utils.h>
+
+/* system */
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static void throttle(int server);
+static int probe(SSL* ssl, int socket, bool* busy);
+
+bool
+pgmoneta_throttle_enabled(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return config->backup_throttle_lag > 0 ||
+          config->backup_throttle_active > 0 ||
+          config->backup_throttle_io > 0;
+}
+
+pid_t
+pgmoneta_throttle_start(int server)
+{
+   pid_t pid;
+
+   if (!pgmoneta_throttle_enabled())
+   {
+      return 0;
+   }
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgmoneta_log_warn("Throttle: No fork for %s", ((struct configuration*)shmem)->servers[server].name);
+      return 0;
+   }
+   else if (pid == 0)
+   {
+      throttle(server);
+      exit(0);
+   }
+
+   return pid;
+}
+
+void
+pgmoneta_throttle_stop(int server, pid_t pid)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (pid <= 0)
+   {
+      return;
+   }
+
+   /* The throttle only holds a query connection, so it doesn't need to clean up */
+   kill(pid, SIGKILL);
+   waitpid(pid, NULL, 0);
+
+   pgmoneta_token_bucket_rate(&config->servers[server].network_bucket, pgmoneta_get_network_max_rate(server));
+}
+
+static void
+throttle(int server)
+{
+   int usr = -1;
+   int socket = -1;
+   bool busy = false;
+   long rate;
+   long ceiling;
+   long measured;
+   unsigned long long consumed;
+   unsigned long long previous;
+   SSL* ssl = NULL;
+   struct token_bucket* bucket;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   bucket = &config->servers[server].network_bucket;
+   ceiling = pgmoneta_get_network_max_rate(server);
+
+   for (int i = 0; usr == -1 && i < config->number_of_users; i++)
+   {
+      if (!strcmp(config->servers[server].username, config->users[i].username))
+      {
+         usr = i;
+      }
+   }
+
+   if (usr == -1)
+   {
+      goto done;
+   }
+
+   pgmoneta_memory_init();
+
+   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket) != AUTH_SUCCESS)
+   {
+      pgmoneta_log_warn("Throttle: Could not connect to %s", config->servers[server].name);
+      goto done;
+   }
+
+   previous = atomic_load(&bucket->consumed);
+
+   while (atomic_load(&config->states[server].backup))
+   {
+      sleep(THROTTLE_INTERVAL);
+
+      if (probe(ssl, socket, &busy))
+      {
+         pgmoneta_log_warn("Throttle: Could not probe %s", config->servers[server].name);
+         break;
+      }
+
+      consumed = atomic_load(&bucket->consumed);
+      measured = (long)((consumed - previous) / THROTTLE_INTERVAL);
+      previous = consumed;
+
+      rate = bucket->max_rate;
+
+      if (busy)
+      {
+         /* Halve the rate, starting from the measured rate when unlimited */
+         rate = (rate > 0 ? rate : measured) / 2;
+         if (rate < THROTTLE_MIN_RATE)
+         {
+            rate = THROTTLE_MIN_RATE;
+         }
+      }
+      else if (rate > 0)
+      {
+         if (ceiling == 0 && measured < rate - rate / 4)
+         {
+            /* The limit no longer holds the backup back */
+            rate = 0;
+         }
+         else
+         {
+            rate += rate / 4;
+            if (ceiling > 0 && rate >= ceiling)
+            {
+               rate = ceiling;
+            }
+         }
+      }
+
+      if (rate != bucket->max_rate)
+      {
+         pgmoneta_log_debug("Throttle: %s at %ld bytes/s (measured %ld bytes/s, %s)",
+                            config->servers[server].name, rate, measured, busy ? "busy" : "idle");
+         pgmoneta_token_bucket_rate(bucket, rate);
+      }
+   }
+
+done:
+
+   if (ssl != NULL)
+   {
+      pgmoneta_close_ssl(ssl);
+   }
+   if (socket != -1)
+   {
+      pgmoneta_disconnect(socket);
+   }
+
+   pgmoneta_memory_destroy();
+}
+
+static int
+probe(SSL* ssl, int socket, bool* busy)
+{
+   long active;
+   long io;
+   long long lag;
+   char* value = NULL;
+   struct message* query_msg = NULL;
+   struct query_response* response = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *busy = false;
+
+   /* The backup and the WAL receivers show up as walsenders, not as client backends */
+   if (pgmoneta_create_query_message("SELECT "
+                                     "(SELECT count(*) FROM pg_stat_activity WHERE backend_type = 'client backend' AND state = 'active' AND pid <> pg_backend_pid()), "
+                                     "(SELECT count(*) FROM pg_stat_activity WHERE backend_type = 'client backend' AND wait_event_type = 'IO'), "
+                                     "(SELECT CASE WHEN pg_is_in_recovery() THEN 0 ELSE "
+                                     "COALESCE(max(pg_wal_lsn_diff(pg_current_wal_lsn(), replay_lsn)), 0)::bigint END "
+                                     "FROM pg_stat_replication WHERE state <> 'backup');",
+                                     &query_msg) != MESSAGE_STATUS_OK)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_query_execute(ssl, socket, query_msg, &response) || response == NULL || response->tuples == NULL)
+   {
+      goto error;
+   }
+
+   value = pgmoneta_query_response_get_data(response, 0);
+   active = value != NULL ? strtol(value, NULL, 10) : 0;
+   value = pgmoneta_query_response_get_data(response, 1);
+   io = value != NULL ? strtol(value, NULL, 10) : 0;
+   value = pgmoneta_query_response_get_data(response, 2);
+   lag = value != NULL ? strtoll(value, NULL, 10) : 0;
+
+   if ((config->backup_throttle_active > 0 && active >= config->backup_throttle_active) ||
+       (config->backup_throttle_io > 0 && io >= config->backup_throttle_io) ||
+       (config->backup_throttle_lag > 0 && lag >= config->backup_throttle_lag))
+   {
+      *busy = true;
+   }
+
+   pgmoneta_free_query_response(response);
+   pgmoneta_free_message(query_msg);
+
+   return 0;
+
+error:
+
+   pgmoneta_free_query_response(response);
+   pgmoneta_free_message(query_msg);
+
+   return 1;
+}
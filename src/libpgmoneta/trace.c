@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <trace.h>
+#include <utils.h>
+
+/* system */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @struct trace_event
+ * Defines an event of a trace
+ */
+struct trace_event
+{
+   char category[16];        /**< The category */
+   char name[64];            /**< The name */
+   char detail[MISC_LENGTH]; /**< The detail */
+   uint64_t start;           /**< The start in microseconds */
+   uint64_t duration;        /**< The duration in microseconds */
+   int thread;               /**< The thread */
+};
+
+static void trace_string(FILE* file, char* s);
+
+static atomic_bool trace_enabled = false;
+static atomic_uint_fast64_t trace_next = 0;
+static atomic_int trace_threads = 0;
+static _Thread_local int trace_thread = 0;
+static int trace_depth = 0;
+static size_t trace_size = 0;
+static struct trace_event* trace_events = NULL;
+static struct timespec trace_origin;
+
+void
+pgmoneta_trace_start(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (trace_depth++ > 0)
+   {
+      return;
+   }
+
+   if (config->trace_sample <= 0 || random() % 100 >= config->trace_sample)
+   {
+      return;
+   }
+
+   // the events are kept for the next workflow of the process, since a worker could still add one
+   if (trace_events == NULL || trace_size != (size_t)config->trace_events)
+   {
+      free(trace_events);
+      trace_size = 0;
+
+      trace_events = (struct trace_event*)calloc(config->trace_events, sizeof(struct trace_event));
+      if (trace_events == NULL)
+      {
+         pgmoneta_log_warn("Trace: Unable to allocate %d events", config->trace_events);
+         return;
+      }
+      trace_size = config->trace_events;
+   }
+
+   atomic_store(&trace_next, 0);
+   clock_gettime(CLOCK_MONOTONIC_RAW, &trace_origin);
+   atomic_store(&trace_enabled, true);
+}
+
+bool
+pgmoneta_trace_enabled(void)
+{
+   return atomic_load(&trace_enabled);
+}
+
+uint64_t
+pgmoneta_trace_now(void)
+{
+   struct timespec now;
+
+   if (!atomic_load(&trace_enabled))
+   {
+      return 0;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+   // 0 means not traced, so the times start at 1
+   return (uint64_t)(now.tv_sec - trace_origin.tv_sec) * 1000000 +
+          (now.tv_nsec - trace_origin.tv_nsec) / 1000 + 1;
+}
+
+void
+pgmoneta_trace_event(char* category, char* name, char* detail, uint64_t start)
+{
+   uint64_t end;
+   struct trace_event* event = NULL;
+
+   if (start == 0 || !atomic_load(&trace_enabled))
+   {
+      return;
+   }
+
+   end = pgmoneta_trace_now();
+
+   if (trace_thread == 0)
+   {
+      trace_thread = atomic_fetch_add(&trace_threads, 1) + 1;
+   }
+
+   event = &trace_events[atomic_fetch_add(&trace_next, 1) % trace_size];
+
+   memset(event, 0, sizeof(struct trace_event));
+   snprintf(&event->category[0], sizeof(event->category), "%s", category);
+   snprintf(&event->name[0], sizeof(event->name), "%s", name);
+   // a long path keeps its end, which names the file
+   if (detail != NULL && strlen(detail) >= sizeof(event->detail))
+   {
+      snprintf(&event->detail[0], sizeof(event->detail), "...%s", detail + strlen(detail) - (sizeof(event->detail) - 4));
+   }
+   else if (detail != NULL)
+   {
+      snprintf(&event->detail[0], sizeof(event->detail), "%s", detail);
+   }
+   event->start = start - 1;
+   event->duration = end > start ? end - start : 0;
+   event->thread = trace_thread;
+}
+
+int
+pgmoneta_trace_finish(int server, char* label)
+{
+   uint64_t next;
+   uint64_t first;
+   bool comma = false;
+   char timestamp[128];
+   char* d = NULL;
+   char* path = NULL;
+   FILE* file = NULL;
+   time_t t;
+   struct tm* time_info;
+   struct trace_event* event = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (trace_depth > 0)
+   {
+      trace_depth--;
+   }
+
+   if (trace_depth > 0 || !atomic_load(&trace_enabled))
+   {
+      return 0;
+   }
+
+   atomic_store(&trace_enabled, false);
+
+   next = atomic_load(&trace_next);
+   first = next > trace_size ? next - trace_size : 0;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "trace/");
+
+   if (pgmoneta_mkdir(d))
+   {
+      goto error;
+   }
+
+   t = time(NULL);
+   time_info = localtime(&t);
+   memset(&timestamp[0], 0, sizeof(timestamp));
+   strftime(&timestamp[0], sizeof(timestamp), "%Y%m%d%H%M%S", time_info);
+
+   path = pgmoneta_format_and_append(NULL, "%s%s-%d.json", d, timestamp, (int)getpid());
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   fprintf(file, "{\"traceEvents\":[\n");
+   fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", (int)getpid());
+   trace_string(file, config->servers[server].name);
+   fprintf(file, "}}");
+   comma = true;
+
+   // the ring holds the newest events, oldest first
+   for (uint64_t i = first; i < next; i++)
+   {
+      event = &trace_events[i % trace_size];
+
+      fprintf(file, "%s\n{\"name\":", comma ? "," : "");
+      trace_string(file, event->name);
+      fprintf(file, ",\"cat\":");
+      trace_string(file, event->category);
+      fprintf(file, ",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d",
+              (unsigned long long)event->start, (unsigned long long)event->duration,
+              (int)getpid(), event->thread);
+      if (strlen(event->detail) > 0)
+      {
+         fprintf(file, ",\"args\":{\"detail\":");
+         trace_string(file, event->detail);
+         fprintf(file, "}");
+      }
+      fprintf(file, "}");
+   }
+
+   fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"server\":");
+   trace_string(file, config->servers[server].name);
+   fprintf(file, ",\"label\":");
+   trace_string(file, label != NULL ? label : "");
+   fprintf(file, ",\"dropped\":%llu}}\n", (unsigned long long)first);
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   pgmoneta_log_info("Trace: %s (Events: %llu Dropped: %llu)", path,
+                     (unsigned long long)(next - first), (unsigned long long)first);
+
+   free(d);
+   free(path);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_warn("Trace: Unable to write the trace for %s", config->servers[server].name);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(d);
+   free(path);
+
+   return 1;
+}
+
+static void
+trace_string(FILE* file, char* s)
+{
+   fputc('"', file);
+
+   for (char* c = s; c != NULL && *c != '\0'; c++)
+   {
+      if (*c == '"' || *c == '\\')
+      {
+         fputc('\\', file);
+         fputc(*c, file);
+      }
+      else if ((unsigned char)*c < 0x20)
+      {
+         fprintf(file, "\\u%04x", (unsigned char)*c);
+      }
+      else
+      {
+         fputc(*c, file);
+      }
+   }
+
+   fputc('"', file);
+}
@@ -0,0 +1,644 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <deque.h>
+#include <logging.h>
+#include <trash.h>
+#include <utils.h>
+#include <value.h>
+#include <volume.h>
+#include <workers.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define TRASH_DIRECTORY "trash/"
+#define TRASH_BATCH     256
+
+/** @struct trash_batch
+ * Defines the files of one directory that a worker unlinks
+ */
+struct trash_batch
+{
+   int server;                  /**< The server */
+   char directory[MAX_PATH];    /**< The directory */
+   int number_of_files;         /**< The number of files */
+   char* files[TRASH_BATCH];    /**< The names of the files */
+   struct token_bucket* bucket; /**< The rate limit, or NULL */
+};
+
+static char* trash_directory(int server);
+static int trash_empty(int server);
+static bool trash_claim(int server);
+static int trash_walk(int server, char* path, struct deque* directories, struct workers* workers, struct token_bucket* bucket);
+static int trash_submit(struct trash_batch* batch, struct workers* workers);
+static void trash_unlink(struct trash_batch* batch);
+static void do_trash_batch(struct worker_input* wi);
+
+int
+pgmoneta_trash_move(int server, char* directory)
+{
+   char* trash = NULL;
+   char* name = NULL;
+   char* to = NULL;
+   char* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   trash = trash_directory(server);
+   if (pgmoneta_mkdir(trash))
+   {
+      goto error;
+   }
+
+   d = pgmoneta_append(d, directory);
+   if (pgmoneta_ends_with(d, "/"))
+   {
+      d[strlen(d) - 1] = '\0';
+   }
+
+   name = strrchr(d, '/');
+   name = name != NULL ? name + 1 : d;
+
+   to = pgmoneta_append(to, trash);
+   to = pgmoneta_append(to, name);
+
+   if (pgmoneta_exists(to))
+   {
+      to = pgmoneta_append(to, ".");
+      to = pgmoneta_append_int(to, (int)getpid());
+   }
+
+   // the trash is on the same file system, so the backup is gone at once
+   if (rename(d, to))
+   {
+      pgmoneta_log_debug("Trash: Could not move %s (%s)", d, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   atomic_fetch_add(&config->servers[server].metrics.trash_backups, 1);
+
+   pgmoneta_log_debug("Trash: %s", to);
+
+   free(trash);
+   free(d);
+   free(to);
+
+   return 0;
+
+error:
+
+   free(trash);
+   free(d);
+   free(to);
+
+   return 1;
+}
+
+int
+pgmoneta_trash_files(int server, char* directory, int number_of_files, char** files)
+{
+   char* trash = NULL;
+   char* to = NULL;
+   char from_path[MAX_PATH];
+   char to_path[MAX_PATH];
+   int failed = 0;
+
+   if (number_of_files <= 0)
+   {
+      return 0;
+   }
+
+   trash = trash_directory(server);
+
+   to = pgmoneta_append(to, trash);
+   to = pgmoneta_append(to, "files.");
+   to = pgmoneta_append_int(to, (int)getpid());
+   to = pgmoneta_append(to, ".");
+   to = pgmoneta_append_int(to, (int)time(NULL));
+
+   if (pgmoneta_mkdir(to))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      memset(from_path, 0, sizeof(from_path));
+      memset(to_path, 0, sizeof(to_path));
+
+      if (pgmoneta_ends_with(directory, "/"))
+      {
+         snprintf(from_path, sizeof(from_path), "%s%s", directory, files[i]);
+      }
+      else
+      {
+         snprintf(from_path, sizeof(from_path), "%s/%s", directory, files[i]);
+      }
+      snprintf(to_path, sizeof(to_path), "%s/%s", to, files[i]);
+
+      if (rename(from_path, to_path))
+      {
+         // a directory on another file system, like the one of WAL shipping, can't be renamed into the trash
+         if (errno != EXDEV || pgmoneta_delete_file(from_path, NULL))
+         {
+            pgmoneta_log_debug("Trash: Could not move %s (%s)", from_path, strerror(errno));
+            failed++;
+         }
+         errno = 0;
+      }
+   }
+
+   pgmoneta_log_debug("Trash: %d files of %s", number_of_files - failed, directory);
+
+   free(trash);
+   free(to);
+
+   return failed > 0 ? 1 : 0;
+
+error:
+
+   free(trash);
+   free(to);
+
+   return 1;
+}
+
+int
+pgmoneta_trash_reclaim(int server)
+{
+   char* trash = NULL;
+   char* path = NULL;
+   char* target = NULL;
+   char* d = NULL;
+   int number_of_workers = 0;
+   int number_of_backups = 0;
+   struct workers* workers = NULL;
+   struct token_bucket* bucket = NULL;
+   struct deque* directories = NULL;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!trash_claim(server))
+   {
+      return 0;
+   }
+
+   trash = trash_directory(server);
+
+   if (config->delete_max_rate > 0)
+   {
+      bucket = (struct token_bucket*)malloc(sizeof(struct token_bucket));
+      if (bucket == NULL || pgmoneta_token_bucket_init(bucket, config->delete_max_rate))
+      {
+         goto error;
+      }
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   while (true)
+   {
+      if (!(dir = opendir(trash)))
+      {
+         break;
+      }
+
+      number_of_backups = 0;
+      while ((entry = readdir(dir)) != NULL)
+      {
+         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+         {
+            continue;
+         }
+
+         path = pgmoneta_append(path, trash);
+         path = pgmoneta_append(path, entry->d_name);
+
+         if (pgmoneta_deque_create(false, &directories))
+         {
+            goto error;
+         }
+
+         pgmoneta_log_debug("Trash: Reclaiming %s", path);
+
+         // a backup on a backup volume is reclaimed there, and its link last
+         target = pgmoneta_volume_target(path);
+
+         if (trash_walk(server, target != NULL ? target : path, directories, workers, bucket))
+         {
+            goto error;
+         }
+
+         if (workers != NULL)
+         {
+            pgmoneta_workers_wait(workers);
+         }
+
+         // the directories are empty now, and the deepest come last
+         while ((d = (char*)pgmoneta_deque_poll_last(directories, NULL)) != NULL)
+         {
+            if (rmdir(d))
+            {
+               pgmoneta_log_warn("Trash: Could not remove %s (%s)", d, strerror(errno));
+               errno = 0;
+            }
+            free(d);
+         }
+
+         if (target != NULL)
+         {
+            unlink(path);
+            free(target);
+            target = NULL;
+         }
+
+         pgmoneta_deque_destroy(directories);
+         directories = NULL;
+
+         if (atomic_load(&config->servers[server].metrics.trash_backups) > 0)
+         {
+            atomic_fetch_sub(&config->servers[server].metrics.trash_backups, 1);
+         }
+
+         number_of_backups++;
+
+         free(path);
+         path = NULL;
+      }
+
+      closedir(dir);
+      dir = NULL;
+
+      if (number_of_backups == 0)
+      {
+         atomic_store(&config->servers[server].metrics.trash_backups, 0);
+         atomic_store(&config->states[server].trash, 0);
+
+         // a backup moved to the trash after the last pass is reclaimed too
+         if (trash_empty(server) || !trash_claim(server))
+         {
+            break;
+         }
+      }
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   free(bucket);
+   free(trash);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   pgmoneta_deque_destroy(directories);
+
+   free(bucket);
+   free(path);
+   free(target);
+   free(trash);
+
+   atomic_store(&config->states[server].trash, 0);
+
+   return 1;
+}
+
+void
+pgmoneta_trash_reclaim_background(int server)
+{
+   pid_t pid;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pid = atomic_load(&config->states[server].trash);
+   if ((pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH)) || trash_empty(server))
+   {
+      errno = 0;
+      return;
+   }
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgmoneta_log_warn("Trash: No fork for %s", config->servers[server].name);
+      errno = 0;
+   }
+   else if (pid == 0)
+   {
+      int ret;
+
+      ret = pgmoneta_trash_reclaim(server);
+
+      pgmoneta_stop_logging();
+
+      exit(ret);
+   }
+}
+
+static char*
+trash_directory(int server)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, TRASH_DIRECTORY);
+
+   return d;
+}
+
+static int
+trash_empty(int server)
+{
+   int empty = 1;
+   char* trash = NULL;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   trash = trash_directory(server);
+
+   if ((dir = opendir(trash)) != NULL)
+   {
+      while (empty && (entry = readdir(dir)) != NULL)
+      {
+         if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+         {
+            empty = 0;
+         }
+      }
+      closedir(dir);
+   }
+
+   free(trash);
+
+   return empty;
+}
+
+static bool
+trash_claim(int server)
+{
+   int expected = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (atomic_compare_exchange_strong(&config->states[server].trash, &expected, (int)getpid()))
+   {
+      return true;
+   }
+
+   // the reclaim of a process that died
+   if (kill(expected, 0) == -1 && errno == ESRCH)
+   {
+      errno = 0;
+      return atomic_compare_exchange_strong(&config->states[server].trash, &expected, (int)getpid());
+   }
+
+   return false;
+}
+
+static int
+trash_walk(int server, char* path, struct deque* directories, struct workers* workers, struct token_bucket* bucket)
+{
+   char* p = NULL;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat statbuf;
+   struct trash_batch* batch = NULL;
+   bool is_directory;
+
+   if (pgmoneta_deque_add(directories, NULL, (uintptr_t)path, ValueString))
+   {
+      goto error;
+   }
+
+   if (!(dir = opendir(path)))
+   {
+      // a file at the top of the trash
+      if (errno == ENOTDIR)
+      {
+         errno = 0;
+         free((char*)pgmoneta_deque_poll_last(directories, NULL));
+         unlink(path);
+         return 0;
+      }
+
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      is_directory = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN)
+      {
+         p = pgmoneta_append(p, path);
+         p = pgmoneta_append(p, "/");
+         p = pgmoneta_append(p, entry->d_name);
+
+         is_directory = !lstat(p, &statbuf) && S_ISDIR(statbuf.st_mode);
+
+         free(p);
+         p = NULL;
+      }
+
+      if (is_directory)
+      {
+         p = pgmoneta_append(p, path);
+         p = pgmoneta_append(p, "/");
+         p = pgmoneta_append(p, entry->d_name);
+
+         if (trash_walk(server, p, directories, workers, bucket))
+         {
+            goto error;
+         }
+
+         free(p);
+         p = NULL;
+      }
+      else
+      {
+         if (batch == NULL)
+         {
+            batch = (struct trash_batch*)calloc(1, sizeof(struct trash_batch));
+            if (batch == NULL)
+            {
+               goto error;
+            }
+
+            batch->server = server;
+            batch->bucket = bucket;
+            snprintf(batch->directory, sizeof(batch->directory), "%s", path);
+         }
+
+         batch->files[batch->number_of_files++] = strdup(entry->d_name);
+
+         if (batch->number_of_files == TRASH_BATCH)
+         {
+            trash_submit(batch, workers);
+            batch = NULL;
+         }
+      }
+   }
+
+   if (batch != NULL)
+   {
+      trash_submit(batch, workers);
+      batch = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   if (batch != NULL)
+   {
+      trash_unlink(batch);
+   }
+
+   free(p);
+
+   return 1;
+}
+
+static int
+trash_submit(struct trash_batch* batch, struct workers* workers)
+{
+   struct worker_input* wi = NULL;
+
+   if (workers != NULL && workers->outcome &&
+       !pgmoneta_create_worker_input(NULL, "", "", 0, workers, &wi))
+   {
+      wi->argument = batch;
+      pgmoneta_workers_add(workers, do_trash_batch, wi);
+   }
+   else
+   {
+      trash_unlink(batch);
+   }
+
+   return 0;
+}
+
+static void
+trash_unlink(struct trash_batch* batch)
+{
+   int fd;
+   unsigned long unlinked = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   fd = open(batch->directory, O_RDONLY | O_DIRECTORY);
+
+   for (int i = 0; i < batch->number_of_files; i++)
+   {
+      if (batch->bucket != NULL)
+      {
+         while (pgmoneta_token_bucket_consume(batch->bucket, 1))
+         {
+            SLEEP(10000000L);
+         }
+      }
+
+      if (fd != -1 && !unlinkat(fd, batch->files[i], 0))
+      {
+         unlinked++;
+      }
+
+      free(batch->files[i]);
+   }
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   errno = 0;
+
+   atomic_fetch_add(&config->servers[batch->server].metrics.trash_files, unlinked);
+
+   free(batch);
+}
+
+static void
+do_trash_batch(struct worker_input* wi)
+{
+   trash_unlink((struct trash_batch*)wi->argument);
+
+   free(wi);
+}
@@ -29,9 +29,16 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <info.h>
+#include <io.h>
 #include <logging.h>
+#include <memory.h>
+#include <network.h>
 #include <restore.h>
+#include <streamer.h>
 #include <utils.h>
+#include <volume.h>
+#include <walk.h>
+#include <walpack.h>
 #include <workers.h>
 
 /* system */
@@ -57,6 +64,13 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef HAVE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
 
 #ifndef EVBACKEND_LINUXAIO
 #define EVBACKEND_LINUXAIO 0x00000040U
@@ -66,7 +80,10 @@
 #define EVBACKEND_IOURING  0x00000080U
 #endif
 
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
 extern char** environ;
+static int durability = DURABILITY_SYNCFS;
 #ifdef HAVE_LINUX
 static bool env_changed = false;
 static int max_process_title_size = 0;
@@ -78,14 +95,36 @@ static bool is_wal_file(char* file);
 
 static char* get_server_basepath(int server);
 
-static int copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct workers* workers);
+static int copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct restore_filter* filter, struct workers* workers);
 static int copy_tablespaces_hotstandby(char* from, char* to, char* tblspc_mappings, struct backup* backup, struct workers* workers);
 
 static int get_permissions(char* from, int* permissions);
 
 static void do_copy_file(struct worker_input* wi);
+static void do_decode_file(struct worker_input* wi);
+static int copy_directory(char* from, char* to, char* relative, char** restore_last_files_names, bool decode, struct restore_filter* filter, struct workers* workers);
+static bool is_restore_last_file(char** restore_last_files_names, char* from, bool decode);
+static int restore_file(char* from, char* to, bool decode, struct workers* workers);
+static int filter_file(struct restore_filter* filter, char* relative, char* to, bool decode);
+static int copy_data(int fd_from, int fd_to, off_t size);
+static int copy_sparse(int fd_from, int fd_to, off_t size);
 static void do_delete_file(struct worker_input* wi);
 
+/**
+ * The names of one type in a directory
+ */
+struct walk_names
+{
+   int type;              /**< The type of the entries */
+   int number_of_names;   /**< The number of names */
+   int capacity;          /**< The capacity of the names */
+   char** names;          /**< The names */
+};
+
+static int directory_size_entry(struct walk_entry* entry, void* arg);
+static int names_entry(struct walk_entry* entry, void* arg);
+static int permission_entry(struct walk_entry* entry, void* arg);
+
 int32_t
 pgmoneta_get_request(struct message* msg)
 {
@@ -228,7 +267,7 @@ pgmoneta_extract_message(char type, struct message* msg, struct message** extrac
          m_length = pgmoneta_read_int32(msg->data + offset + 1);
 
          result = (struct message*)malloc(sizeof(struct message));
-         result->data = aligned_alloc((size_t)ALIGNMENT_SIZE, pgmoneta_get_aligned_size(1 + m_length));
+         result->data = pgmoneta_memory_pool_alloc(1 + m_length);
 
          memcpy(result->data, msg->data + offset, 1 + m_length);
 
@@ -315,7 +354,7 @@ pgmoneta_extract_message_offset(size_t offset, void* data, struct message** extr
    m_length = pgmoneta_read_int32(data + offset + 1);
 
    result = (struct message*)malloc(sizeof(struct message));
-   m_data = aligned_alloc((size_t)ALIGNMENT_SIZE, pgmoneta_get_aligned_size(1 + m_length));
+   m_data = pgmoneta_memory_pool_alloc(1 + m_length);
 
    memcpy(m_data, data + offset, 1 + m_length);
 
@@ -348,7 +387,7 @@ pgmoneta_extract_message_from_data(char type, void* data, size_t data_size, stru
          m_length = pgmoneta_read_int32(data + offset + 1);
 
          result = (struct message*)malloc(sizeof(struct message));
-         m_data = aligned_alloc((size_t)ALIGNMENT_SIZE, pgmoneta_get_aligned_size(1 + m_length));
+         m_data = pgmoneta_memory_pool_alloc(1 + m_length);
 
          memcpy(m_data, data + offset, 1 + m_length);
 
@@ -379,238 +418,6 @@ pgmoneta_extract_message_from_data(char type, void* data, size_t data_size, stru
    return 1;
 }
 
-signed char
-pgmoneta_read_byte(void* data)
-{
-   return (signed char) *((char*)data);
-}
-
-uint8_t
-pgmoneta_read_uint8(void* data)
-{
-   return (uint8_t) *((char*)data);
-}
-
-int16_t
-pgmoneta_read_int16(void* data)
-{
-   unsigned char bytes[] = {*((unsigned char*)data),
-                            *((unsigned char*)(data + 1))};
-
-   int16_t res = (int16_t)((bytes[0] << 8)) |
-                 ((bytes[1]));
-
-   return res;
-}
-
-uint16_t
-pgmoneta_read_uint16(void* data)
-{
-   unsigned char bytes[] = {*((unsigned char*)data),
-                            *((unsigned char*)(data + 1))};
-
-   uint16_t res = (uint16_t)((bytes[0] << 8)) |
-                  ((bytes[1]));
-
-   return res;
-}
-
-int32_t
-pgmoneta_read_int32(void* data)
-{
-   unsigned char bytes[] = {*((unsigned char*)data),
-                            *((unsigned char*)(data + 1)),
-                            *((unsigned char*)(data + 2)),
-                            *((unsigned char*)(data + 3))};
-
-   int32_t res = (int32_t)(((uint32_t)bytes[0] << 24)) |
-                 (((uint32_t)bytes[1] << 16)) |
-                 (((uint32_t)bytes[2] << 8)) |
-                 (((uint32_t)bytes[3]));
-
-   return res;
-}
-
-uint32_t
-pgmoneta_read_uint32(void* data)
-{
-   unsigned char bytes[] = {*((unsigned char*)data),
-                            *((unsigned char*)(data + 1)),
-                            *((unsigned char*)(data + 2)),
-                            *((unsigned char*)(data + 3))};
-
-   uint32_t res = (uint32_t)(((uint32_t)bytes[0] << 24)) |
-                  (((uint32_t)bytes[1] << 16)) |
-                  (((uint32_t)bytes[2] << 8)) |
-                  (((uint32_t)bytes[3]));
-
-   return res;
-}
-
-int64_t
-pgmoneta_read_int64(void* data)
-{
-   unsigned char bytes[] = {*((unsigned char*)data),
-                            *((unsigned char*)(data + 1)),
-                            *((unsigned char*)(data + 2)),
-                            *((unsigned char*)(data + 3)),
-                            *((unsigned char*)(data + 4)),
-                            *((unsigned char*)(data + 5)),
-                            *((unsigned char*)(data + 6)),
-                            *((unsigned char*)(data + 7))};
-
-   int64_t res = (int64_t)(((uint64_t)bytes[0] << 56)) |
-                 (((uint64_t)bytes[1] << 48)) |
-                 (((uint64_t)bytes[2] << 40)) |
-                 (((uint64_t)bytes[3] << 32)) |
-                 (((uint64_t)bytes[4] << 24)) |
-                 (((uint64_t)bytes[5] << 16)) |
-                 (((uint64_t)bytes[6] << 8)) |
-                 (((uint64_t)bytes[7]));
-
-   return res;
-}
-
-uint64_t
-pgmoneta_read_uint64(void* data)
-{
-   unsigned char bytes[] = {*((unsigned char*)data),
-                            *((unsigned char*)(data + 1)),
-                            *((unsigned char*)(data + 2)),
-                            *((unsigned char*)(data + 3)),
-                            *((unsigned char*)(data + 4)),
-                            *((unsigned char*)(data + 5)),
-                            *((unsigned char*)(data + 6)),
-                            *((unsigned char*)(data + 7))};
-
-   uint64_t res = (uint64_t)(((uint64_t)bytes[0] << 56)) |
-                  (((uint64_t)bytes[1] << 48)) |
-                  (((uint64_t)bytes[2] << 40)) |
-                  (((uint64_t)bytes[3] << 32)) |
-                  (((uint64_t)bytes[4] << 24)) |
-                  (((uint64_t)bytes[5] << 16)) |
-                  (((uint64_t)bytes[6] << 8)) |
-                  (((uint64_t)bytes[7]));
-
-   return res;
-}
-
-bool
-pgmoneta_read_bool(void* data)
-{
-   return (bool) *((bool*)data);
-}
-
-void
-pgmoneta_write_byte(void* data, signed char b)
-{
-   *((char*)(data)) = b;
-}
-
-void
-pgmoneta_write_uint8(void* data, uint8_t b)
-{
-   *((uint8_t*)(data)) = b;
-}
-
-void
-pgmoneta_write_int16(void* data, int16_t i)
-{
-   char* ptr = (char*)&i;
-
-   *((char*)(data + 1)) = *ptr;
-   ptr++;
-   *((char*)(data)) = *ptr;
-}
-
-void
-pgmoneta_write_uint16(void* data, uint16_t i)
-{
-   char* ptr = (char*)&i;
-
-   *((char*)(data + 1)) = *ptr;
-   ptr++;
-   *((char*)(data)) = *ptr;
-}
-
-void
-pgmoneta_write_int32(void* data, int32_t i)
-{
-   char* ptr = (char*)&i;
-
-   *((char*)(data + 3)) = *ptr;
-   ptr++;
-   *((char*)(data + 2)) = *ptr;
-   ptr++;
-   *((char*)(data + 1)) = *ptr;
-   ptr++;
-   *((char*)(data)) = *ptr;
-}
-
-void
-pgmoneta_write_uint32(void* data, uint32_t i)
-{
-   uint8_t* ptr = (uint8_t*)&i;
-
-   *((uint8_t*)(data + 3)) = *ptr;
-   ptr++;
-   *((uint8_t*)(data + 2)) = *ptr;
-   ptr++;
-   *((uint8_t*)(data + 1)) = *ptr;
-   ptr++;
-   *((uint8_t*)(data)) = *ptr;
-}
-
-void
-pgmoneta_write_int64(void* data, int64_t i)
-{
-   char* ptr = (char*)&i;
-
-   *((char*)(data + 7)) = *ptr;
-   ptr++;
-   *((char*)(data + 6)) = *ptr;
-   ptr++;
-   *((char*)(data + 5)) = *ptr;
-   ptr++;
-   *((char*)(data + 4)) = *ptr;
-   ptr++;
-   *((char*)(data + 3)) = *ptr;
-   ptr++;
-   *((char*)(data + 2)) = *ptr;
-   ptr++;
-   *((char*)(data + 1)) = *ptr;
-   ptr++;
-   *((char*)(data)) = *ptr;
-}
-
-void
-pgmoneta_write_uint64(void* data, uint64_t i)
-{
-   char* ptr = (char*)&i;
-
-   *((char*)(data + 7)) = *ptr;
-   ptr++;
-   *((char*)(data + 6)) = *ptr;
-   ptr++;
-   *((char*)(data + 5)) = *ptr;
-   ptr++;
-   *((char*)(data + 4)) = *ptr;
-   ptr++;
-   *((char*)(data + 3)) = *ptr;
-   ptr++;
-   *((char*)(data + 2)) = *ptr;
-   ptr++;
-   *((char*)(data + 1)) = *ptr;
-   ptr++;
-   *((char*)(data)) = *ptr;
-}
-
-void
-pgmoneta_write_bool(void* data, bool b)
-{
-   *((bool*)(data)) = b;
-}
-
 char*
 pgmoneta_read_string(void* data)
 {
@@ -1072,6 +879,119 @@ pgmoneta_set_proc_title(int argc, char** argv, char* s1, char* s2)
 #endif
 }
 
+int
+pgmoneta_cpu_list(char* list, int* cpus, int size)
+{
+   int number = 0;
+   long first;
+   long last;
+   char* p = list;
+   char* end = NULL;
+
+   if (list == NULL)
+   {
+      return 0;
+   }
+
+   while (*p != '\0')
+   {
+      while (*p == ' ' || *p == ',')
+      {
+         p++;
+      }
+
+      if (*p == '\0')
+      {
+         break;
+      }
+
+      first = strtol(p, &end, 10);
+      if (end == p || first < 0)
+      {
+         goto error;
+      }
+      p = end;
+      last = first;
+
+      if (*p == '-')
+      {
+         p++;
+         last = strtol(p, &end, 10);
+         if (end == p || last < first)
+         {
+            goto error;
+         }
+         p = end;
+      }
+
+      if (*p != '\0' && *p != ',' && *p != ' ')
+      {
+         goto error;
+      }
+
+      for (long cpu = first; cpu <= last && number < size; cpu++)
+      {
+         cpus[number++] = (int)cpu;
+      }
+   }
+
+   return number;
+
+error:
+
+   return -1;
+}
+
+int
+pgmoneta_cpu_affinity(int index)
+{
+#ifdef HAVE_LINUX
+   int number;
+   int cpus[CPU_SETSIZE];
+   cpu_set_t set;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config == NULL || strlen(config->cpu_affinity) == 0)
+   {
+      return 0;
+   }
+
+   number = pgmoneta_cpu_list(config->cpu_affinity, &cpus[0], CPU_SETSIZE);
+   if (number <= 0)
+   {
+      goto error;
+   }
+
+   CPU_ZERO(&set);
+
+   for (int i = 0; i < number; i++)
+   {
+      if ((index < 0 || i == index % number) && cpus[i] < CPU_SETSIZE)
+      {
+         CPU_SET(cpus[i], &set);
+      }
+   }
+
+   if (CPU_COUNT(&set) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) != 0)
+   {
+      pgmoneta_log_debug("Unable to set the CPU affinity to %s", config->cpu_affinity);
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+#else
+   (void)index;
+
+   return 0;
+#endif
+}
+
 unsigned int
 pgmoneta_version_as_number(unsigned int major, unsigned int minor, unsigned int patch)
 {
@@ -1355,185 +1275,215 @@ unsigned long
 pgmoneta_directory_size(char* directory)
 {
    unsigned long total_size = 0;
-   DIR* dir;
-   struct dirent* entry;
-   char* p;
-   struct stat st;
+
+   pgmoneta_walk(directory, WALK_STAT, 1, directory_size_entry, &total_size);
+
+   return total_size;
+}
+
+static int
+directory_size_entry(struct walk_entry* entry, void* arg)
+{
+   unsigned long* total_size = (unsigned long*)arg;
    unsigned long l;
 
-   if (!(dir = opendir(directory)))
+   if (entry->type == WALK_FILE && entry->st->st_blksize > 0)
    {
-      return total_size;
-   }
+      l = entry->st->st_size / entry->st->st_blksize;
 
-   while ((entry = readdir(dir)) != NULL)
-   {
-      if (entry->d_type == DT_DIR)
+      if (entry->st->st_size % entry->st->st_blksize != 0)
       {
-         char path[1024];
-
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
+         l += 1;
+      }
 
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+      *total_size += (l * entry->st->st_blksize);
+   }
+   else if (entry->type == WALK_LINK)
+   {
+      *total_size += entry->st->st_blksize;
+   }
 
-         total_size += pgmoneta_directory_size(path);
-      }
-      else if (entry->d_type == DT_REG)
-      {
-         p = NULL;
+   return WALK_CONTINUE;
+}
 
-         p = pgmoneta_append(p, directory);
-         p = pgmoneta_append(p, "/");
-         p = pgmoneta_append(p, entry->d_name);
+unsigned long
+pgmoneta_server_wal_size(int server)
+{
+   char* d = NULL;
+   long long mtime;
+   unsigned long size;
+   struct stat st;
+   struct configuration* config;
 
-         memset(&st, 0, sizeof(struct stat));
+   config = (struct configuration*)shmem;
 
-         stat(p, &st);
+   d = pgmoneta_get_server_wal(server);
 
-         l = st.st_size / st.st_blksize;
+   if (stat(d, &st))
+   {
+      free(d);
+      return 0;
+   }
 
-         if (st.st_size % st.st_blksize != 0)
-         {
-            l += 1;
-         }
+   /* Segments are added, compressed and deleted by renames and unlinks, which all change the directory */
+   mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
 
-         total_size += (l * st.st_blksize);
+   if (atomic_load(&config->states[server].wal_directory_mtime) == mtime)
+   {
+      free(d);
+      return atomic_load(&config->states[server].wal_directory_size);
+   }
 
-         free(p);
-      }
-      else if (entry->d_type == DT_LNK)
-      {
-         p = NULL;
+   size = pgmoneta_directory_size(d);
 
-         p = pgmoneta_append(p, directory);
-         p = pgmoneta_append(p, "/");
-         p = pgmoneta_append(p, entry->d_name);
+   atomic_store(&config->states[server].wal_directory_size, size);
+   atomic_store(&config->states[server].wal_directory_mtime, mtime);
 
-         memset(&st, 0, sizeof(struct stat));
+   free(d);
 
-         stat(p, &st);
+   return size;
+}
 
-         total_size += st.st_blksize;
+unsigned long
+pgmoneta_server_size(int server, int number_of_backups, struct backup** backups)
+{
+   unsigned long size = 0;
 
-         free(p);
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      if (backups[i] != NULL)
+      {
+         size += backups[i]->backup_size;
       }
    }
 
-   closedir(dir);
+   size += pgmoneta_server_wal_size(server);
 
-   return total_size;
+   return size;
 }
 
 int
 pgmoneta_get_directories(char* base, int* number_of_directories, char*** dirs)
 {
-   char* d = NULL;
-   char** array = NULL;
-   int nod = 0;
-   int n = 0;
-   DIR* dir = NULL;
-   struct dirent* entry = NULL;
+   struct walk_names names;
 
    *number_of_directories = 0;
    *dirs = NULL;
 
-   nod = 0;
+   memset(&names, 0, sizeof(struct walk_names));
+   names.type = WALK_DIRECTORY;
 
    if (base == NULL || !strcmp(base, ""))
    {
       goto error;
    }
 
-   if (!(dir = opendir(base)))
+   if (pgmoneta_walk(base, WALK_FLAT, 1, names_entry, &names))
    {
       goto error;
    }
 
-   while ((entry = readdir(dir)) != NULL)
-   {
-      if (entry->d_type == DT_DIR)
-      {
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
+   pgmoneta_sort(names.number_of_names, names.names);
 
-         nod++;
-      }
-   }
-
-   closedir(dir);
-   dir = NULL;
+   *number_of_directories = names.number_of_names;
+   *dirs = names.names;
 
-   dir = opendir(base);
+   return 0;
 
-   array = (char**)malloc(sizeof(char*) * nod);
-   n = 0;
+error:
 
-   while ((entry = readdir(dir)) != NULL)
+   for (int i = 0; i < names.number_of_names; i++)
    {
-      if (entry->d_type == DT_DIR)
-      {
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
-
-         array[n] = (char*)malloc(strlen(entry->d_name) + 1);
-         memset(array[n], 0, strlen(entry->d_name) + 1);
-         memcpy(array[n], entry->d_name, strlen(entry->d_name));
-         n++;
-      }
+      free(names.names[i]);
    }
+   free(names.names);
 
-   closedir(dir);
-   dir = NULL;
-
-   pgmoneta_sort(nod, array);
+   return 1;
+}
 
-   free(d);
-   d = NULL;
+static int
+names_entry(struct walk_entry* entry, void* arg)
+{
+   struct walk_names* names = (struct walk_names*)arg;
+   char** n = NULL;
+   struct stat st;
 
-   *number_of_directories = nod;
-   *dirs = array;
+   // the backups on backup volumes are links to directories
+   if (entry->type == WALK_LINK && names->type == WALK_DIRECTORY)
+   {
+      if (stat(entry->path, &st) || !S_ISDIR(st.st_mode))
+      {
+         return WALK_CONTINUE;
+      }
+   }
+   else if (entry->type != names->type)
+   {
+      return WALK_CONTINUE;
+   }
 
-   return 0;
+   if (names->number_of_names == names->capacity)
+   {
+      names->capacity = names->capacity > 0 ? 2 * names->capacity : 64;
 
-error:
+      n = (char**)realloc(names->names, names->capacity * sizeof(char*));
+      if (n == NULL)
+      {
+         return WALK_STOP;
+      }
 
-   if (dir != NULL)
-   {
-      closedir(dir);
+      names->names = n;
    }
 
-   for (int i = 0; i < nod; i++)
+   names->names[names->number_of_names] = strdup(entry->name);
+   if (names->names[names->number_of_names] == NULL)
    {
-      free(array[i]);
+      return WALK_STOP;
    }
-   free(array);
-
-   free(d);
 
-   *number_of_directories = 0;
-   *dirs = NULL;
+   names->number_of_names++;
 
-   return 1;
+   return WALK_CONTINUE;
 }
 
 int
 pgmoneta_delete_directory(char* path)
 {
-   DIR* d = opendir(path);
+   DIR* d = NULL;
    size_t path_len = strlen(path);
    int r = -1;
    int r2 = -1;
    char* buf;
+   char* target = NULL;
    size_t len;
    struct dirent* entry;
 
+   // a backup on a backup volume goes together with its link
+   target = pgmoneta_volume_target(path);
+   if (target != NULL)
+   {
+      r = pgmoneta_delete_directory(target);
+      free(target);
+
+      if (!r)
+      {
+         buf = strdup(path);
+         if (buf == NULL)
+         {
+            return -1;
+         }
+         while (strlen(buf) > 1 && buf[strlen(buf) - 1] == '/')
+         {
+            buf[strlen(buf) - 1] = '\0';
+         }
+         r = unlink(buf);
+         free(buf);
+      }
+
+      return r;
+   }
+
+   d = opendir(path);
+
    if (d)
    {
       r = 0;
@@ -1581,102 +1531,38 @@ pgmoneta_delete_directory(char* path)
 int
 pgmoneta_get_files(char* base, int* number_of_files, char*** files)
 {
-   char* d = NULL;
-   char** array = NULL;
-   int nof = 0;
-   int n;
-   DIR* dir = NULL;
-   struct dirent* entry;
+   struct walk_names names;
 
    *number_of_files = 0;
    *files = NULL;
 
-   nof = 0;
+   memset(&names, 0, sizeof(struct walk_names));
+   names.type = WALK_FILE;
 
    if (base == NULL)
    {
       goto error;
    }
 
-   if (!(dir = opendir(base)))
-   {
-      goto error;
-   }
-
-   while ((entry = readdir(dir)) != NULL)
-   {
-      if (entry->d_type == DT_REG)
-      {
-         nof++;
-      }
-   }
-
-   closedir(dir);
-   dir = NULL;
-
-   dir = opendir(base);
-
-   if (dir == NULL)
-   {
-      goto error;
-   }
-
-   array = (char**)malloc(sizeof(char*) * nof);
-
-   if (array == NULL)
+   if (pgmoneta_walk(base, WALK_FLAT, 1, names_entry, &names))
    {
       goto error;
    }
 
-   n = 0;
-
-   while ((entry = readdir(dir)) != NULL)
-   {
-      if (entry->d_type == DT_REG)
-      {
-         array[n] = (char*)malloc(strlen(entry->d_name) + 1);
-
-         if (array[n] == NULL)
-         {
-            goto error;
-         }
-
-         memset(array[n], 0, strlen(entry->d_name) + 1);
-         memcpy(array[n], entry->d_name, strlen(entry->d_name));
-         n++;
-      }
-   }
-
-   closedir(dir);
-   dir = NULL;
-
-   pgmoneta_sort(nof, array);
-
-   free(d);
-   d = NULL;
+   pgmoneta_sort(names.number_of_names, names.names);
 
-   *number_of_files = nof;
-   *files = array;
+   *number_of_files = names.number_of_names;
+   *files = names.names;
 
    return 0;
 
 error:
 
-   if (dir != NULL)
-   {
-      closedir(dir);
-   }
-
-   for (int i = 0; i < nof; i++)
+   for (int i = 0; i < names.number_of_names; i++)
    {
-      free(array[i]);
+      free(names.names[i]);
    }
-   free(array);
-
-   free(d);
-
-   *number_of_files = 0;
-   *files = NULL;
+   free(names.names);
 
    return 1;
 }
@@ -1823,7 +1709,7 @@ do_delete_file(struct worker_input* fi)
 }
 
 int
-pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct workers* workers)
+pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct restore_filter* filter, struct workers* workers)
 {
    DIR* d = opendir(from);
    char* from_buffer = NULL;
@@ -1831,6 +1717,10 @@ pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server,
    struct dirent* entry;
    struct stat statbuf;
    char** restore_last_files_names = NULL;
+   bool decode = false;
+
+   // compressed and encrypted files are decoded while they are copied
+   decode = backup != NULL && (backup->compression != COMPRESSION_NONE || backup->encryption != ENCRYPTION_NONE);
 
    if (pgmoneta_get_restore_last_files_names(&restore_last_files_names))
    {
@@ -1886,31 +1776,20 @@ pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server,
             {
                if (!strcmp(entry->d_name, "pg_tblspc"))
                {
-                  copy_tablespaces_restore(from, to, base, server, id, backup, workers);
+                  copy_tablespaces_restore(from, to, base, server, id, backup, filter, workers);
                }
                else
                {
-                  pgmoneta_copy_directory(from_buffer, to_buffer, restore_last_files_names, workers);
+                  copy_directory(from_buffer, to_buffer, entry->d_name, restore_last_files_names, decode, filter, workers);
                }
             }
+            else if (is_restore_last_file(restore_last_files_names, from_buffer, decode))
+            {
+               pgmoneta_log_trace("Restore: %s is restored last", from_buffer);
+            }
             else
             {
-               bool file_is_excluded = false;
-               if (restore_last_files_names != NULL)
-               {
-                  for (int i = 0; restore_last_files_names[i] != NULL; i++)
-                  {
-                     file_is_excluded = !strcmp(from_buffer, restore_last_files_names[i]);
-                  }
-                  if (!file_is_excluded)
-                  {
-                     pgmoneta_copy_file(from_buffer, to_buffer, workers);
-                  }
-               }
-               else
-               {
-                  pgmoneta_copy_file(from_buffer, to_buffer, workers);
-               }
+               restore_file(from_buffer, to_buffer, decode, workers);
             }
          }
 
@@ -2019,15 +1898,18 @@ error:
 }
 
 static int
-copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct workers* workers)
+copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* id, struct backup* backup, struct restore_filter* filter, struct workers* workers)
 {
    char* from_tblspc = NULL;
    char* to_tblspc = NULL;
    int idx = -1;
    DIR* d = NULL;
    ssize_t size;
+   bool decode = false;
    struct dirent* entry;
 
+   decode = backup != NULL && (backup->compression != COMPRESSION_NONE || backup->encryption != ENCRYPTION_NONE);
+
    from_tblspc = pgmoneta_append(from_tblspc, from);
    if (!pgmoneta_ends_with(from_tblspc, "/"))
    {
@@ -2101,6 +1983,7 @@ copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* i
             char* to_oid = NULL;
             char* to_directory = NULL;
             char* relative_directory = NULL;
+            char relative_tablespace[MAX_PATH];
 
             pgmoneta_log_trace("Tablespace %s -> %s was found in the backup", entry->d_name, &path[0]);
 
@@ -2128,7 +2011,10 @@ copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* i
             pgmoneta_mkdir(to_directory);
             pgmoneta_symlink_at_file(to_oid, relative_directory);
 
-            pgmoneta_copy_directory(&path[0], to_directory, NULL, workers);
+            memset(&relative_tablespace[0], 0, sizeof(relative_tablespace));
+            snprintf(&relative_tablespace[0], sizeof(relative_tablespace), "pg_tblspc/%s", entry->d_name);
+
+            copy_directory(&path[0], to_directory, &relative_tablespace[0], NULL, decode, filter, workers);
 
             free(to_oid);
             free(to_directory);
@@ -2291,76 +2177,7 @@ error:
 int
 pgmoneta_copy_directory(char* from, char* to, char** restore_last_files_names, struct workers* workers)
 {
-   DIR* d = opendir(from);
-   char* from_buffer;
-   char* to_buffer;
-   struct dirent* entry;
-   struct stat statbuf;
-
-   pgmoneta_mkdir(to);
-
-   if (d)
-   {
-      while ((entry = readdir(d)))
-      {
-         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
-         {
-            continue;
-         }
-
-         from_buffer = NULL;
-         to_buffer = NULL;
-
-         from_buffer = pgmoneta_append(from_buffer, from);
-         from_buffer = pgmoneta_append(from_buffer, "/");
-         from_buffer = pgmoneta_append(from_buffer, entry->d_name);
-
-         to_buffer = pgmoneta_append(to_buffer, to);
-         to_buffer = pgmoneta_append(to_buffer, "/");
-         to_buffer = pgmoneta_append(to_buffer, entry->d_name);
-
-         if (!stat(from_buffer, &statbuf))
-         {
-            if (S_ISDIR(statbuf.st_mode))
-            {
-               pgmoneta_copy_directory(from_buffer, to_buffer, restore_last_files_names, workers);
-            }
-            else
-            {
-               bool file_is_excluded = false;
-               if (restore_last_files_names != NULL)
-               {
-                  for (int i = 0; restore_last_files_names[i] != NULL; i++)
-                  {
-                     file_is_excluded = !strcmp(from_buffer, restore_last_files_names[i]);
-                  }
-                  if (!file_is_excluded)
-                  {
-                     pgmoneta_copy_file(from_buffer, to_buffer, workers);
-                  }
-               }
-               else
-               {
-                  pgmoneta_copy_file(from_buffer, to_buffer, workers);
-               }
-            }
-         }
-
-         free(from_buffer);
-         free(to_buffer);
-      }
-      closedir(d);
-   }
-   else
-   {
-      goto error;
-   }
-
-   return 0;
-
-error:
-
-   return 1;
+   return copy_directory(from, to, NULL, restore_last_files_names, false, NULL, workers);
 }
 
 void
@@ -2454,97 +2271,645 @@ error:
    return 1;
 }
 
-static void
-do_copy_file(struct worker_input* fi)
+int
+pgmoneta_decode_file(char* from, char* to, struct workers* workers)
 {
-   int fd_from = -1;
-   int fd_to = -1;
-   char buffer[8192];
-   ssize_t nread = -1;
-   int permissions = -1;
+   struct worker_input* fi = NULL;
 
-   fd_from = open(fi->from, O_RDONLY);
+   if (pgmoneta_create_worker_input(NULL, from, to, 0, workers, &fi))
+   {
+      goto error;
+   }
 
-   if (fd_from < 0)
+   if (workers != NULL)
    {
-      pgmoneta_log_error("File doesn't exists: %s", fi->from);
+      if (workers->outcome)
+      {
+         pgmoneta_workers_add(workers, do_decode_file, fi);
+      }
+      else
+      {
+         free(fi);
+      }
+   }
+   else
+   {
+      if (pgmoneta_destreamer_file(fi->from, fi->to))
+      {
+         free(fi);
+         goto error;
+      }
+
+      free(fi);
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_sync_filesystem(char* path)
+{
+   int fd = -1;
+
+   fd = open(path, O_RDONLY);
+
+   if (fd < 0)
+   {
+      pgmoneta_log_error("Unable to open %s for sync (%s)", path, strerror(errno));
+      errno = 0;
       goto error;
    }
 
-   if (get_permissions(fi->from, &permissions))
+#ifdef HAVE_LINUX
+   if (syncfs(fd))
    {
-      pgmoneta_log_error("Unable to get file permissions: %s", fi->from);
+      pgmoneta_log_error("Unable to sync %s (%s)", path, strerror(errno));
+      errno = 0;
       goto error;
    }
+#else
+   sync();
+#endif
 
-   fd_to = open(fi->to, O_WRONLY | O_CREAT | O_TRUNC, permissions);
+   close(fd);
 
-   if (fd_to < 0)
+   return 0;
+
+error:
+
+   if (fd >= 0)
    {
-      pgmoneta_log_error("Unable to create file: %s", fi->to);
-      goto error;
+      close(fd);
    }
 
-   while ((nread = read(fd_from, buffer, sizeof(buffer))) > 0)
+   return 1;
+}
+
+void
+pgmoneta_durability(int mode)
+{
+   durability = mode;
+}
+
+int
+pgmoneta_durability_file(int fd)
+{
+   if (durability == DURABILITY_FSYNC)
+   {
+      if (fsync(fd))
+      {
+         pgmoneta_log_error("Unable to sync a file (%s)", strerror(errno));
+         errno = 0;
+         return 1;
+      }
+   }
+   else if (durability == DURABILITY_WRITE_BEHIND)
    {
-      char* out = &buffer[0];
-      ssize_t nwritten;
+#ifdef HAVE_LINUX
+      // only a hint, the sync at the end of the workflow waits for the data
+      sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+      errno = 0;
+#endif
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_durability_path(char* path)
+{
+   int fd = -1;
+   int ret;
+
+   if (durability == DURABILITY_SYNCFS)
+   {
+      return 0;
+   }
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+   {
+      pgmoneta_log_error("Unable to open %s for sync (%s)", path, strerror(errno));
+      errno = 0;
+      return 1;
+   }
+
+   ret = pgmoneta_durability_file(fd);
+
+   close(fd);
+
+   return ret;
+}
+
+static void
+do_copy_file(struct worker_input* fi)
+{
+   int fd_from = -1;
+   int fd_to = -1;
+   int permissions = -1;
+   struct stat st;
+
+   fd_from = open(fi->from, O_RDONLY);
+
+   if (fd_from < 0)
+   {
+      pgmoneta_log_error("File doesn't exists: %s", fi->from);
+      goto error;
+   }
+
+   if (get_permissions(fi->from, &permissions))
+   {
+      pgmoneta_log_error("Unable to get file permissions: %s", fi->from);
+      goto error;
+   }
+
+   fd_to = open(fi->to, O_WRONLY | O_CREAT | O_TRUNC, permissions);
+
+   if (fd_to < 0)
+   {
+      pgmoneta_log_error("Unable to create file: %s", fi->to);
+      goto error;
+   }
+
+   if (fstat(fd_from, &st))
+   {
+      goto error;
+   }
+
+   if (copy_data(fd_from, fd_to, st.st_size))
+   {
+      goto error;
+   }
+
+   /* Unless the durability is per file the data is made durable by pgmoneta_sync_filesystem() once the workflow is done */
+   if (pgmoneta_durability_file(fd_to))
+   {
+      goto error;
+   }
+
+   pgmoneta_io_drop(fd_from, false);
+   pgmoneta_io_drop(fd_to, true);
+
+   if (close(fd_to) < 0)
+   {
+      fd_to = -1;
+      goto error;
+   }
+   close(fd_from);
+
+#ifdef DEBUG
+   pgmoneta_log_trace("FILETRACKER | Copy | %s | %s |", fi->from, fi->to);
+#endif
+
+   free(fi);
+
+   return;
+
+error:
+
+#ifdef DEBUG
+   pgmoneta_log_trace("FILETRACKER | Fail | %s | %s | %s |", fi->from, fi->to, strerror(errno));
+#endif
+
+   if (fd_from >= 0)
+   {
+      close(fd_from);
+   }
+   if (fd_to >= 0)
+   {
+      close(fd_to);
+   }
+
+   errno = 0;
+
+   free(fi);
+}
+
+static void
+do_decode_file(struct worker_input* fi)
+{
+   if (pgmoneta_destreamer_file(fi->from, fi->to))
+   {
+      fi->workers->outcome = false;
+   }
+
+#ifdef DEBUG
+   pgmoneta_log_trace("FILETRACKER | Decode | %s | %s |", fi->from, fi->to);
+#endif
+
+   free(fi);
+}
+
+static int
+copy_directory(char* from, char* to, char* relative, char** restore_last_files_names, bool decode, struct restore_filter* filter, struct workers* workers)
+{
+   DIR* d = opendir(from);
+   char* from_buffer;
+   char* to_buffer;
+   char* relative_buffer;
+   struct dirent* entry;
+   struct stat statbuf;
+
+   pgmoneta_mkdir(to);
+
+   if (d)
+   {
+      while ((entry = readdir(d)))
+      {
+         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+         {
+            continue;
+         }
+
+         from_buffer = NULL;
+         to_buffer = NULL;
+         relative_buffer = NULL;
+
+         from_buffer = pgmoneta_append(from_buffer, from);
+         from_buffer = pgmoneta_append(from_buffer, "/");
+         from_buffer = pgmoneta_append(from_buffer, entry->d_name);
+
+         // the path relative to the data directory is only needed by a selective restore
+         if (filter != NULL && relative != NULL)
+         {
+            relative_buffer = pgmoneta_append(relative_buffer, relative);
+            relative_buffer = pgmoneta_append(relative_buffer, "/");
+            relative_buffer = pgmoneta_append(relative_buffer, entry->d_name);
+         }
+
+         to_buffer = pgmoneta_append(to_buffer, to);
+         to_buffer = pgmoneta_append(to_buffer, "/");
+         to_buffer = pgmoneta_append(to_buffer, entry->d_name);
+
+         if (!stat(from_buffer, &statbuf))
+         {
+            if (S_ISDIR(statbuf.st_mode))
+            {
+               copy_directory(from_buffer, to_buffer, relative_buffer, restore_last_files_names, decode, filter, workers);
+            }
+            else if (relative_buffer != NULL && !filter_file(filter, relative_buffer, to_buffer, decode))
+            {
+               pgmoneta_log_trace("Restore: %s left out", relative_buffer);
+            }
+            else if (is_restore_last_file(restore_last_files_names, from_buffer, decode))
+            {
+               pgmoneta_log_trace("Restore: %s is restored last", from_buffer);
+            }
+            else
+            {
+               restore_file(from_buffer, to_buffer, decode, workers);
+            }
+         }
+
+         free(from_buffer);
+         free(to_buffer);
+         free(relative_buffer);
+      }
+      closedir(d);
+   }
+   else
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static bool
+is_restore_last_file(char** restore_last_files_names, char* from, bool decode)
+{
+   char* name = NULL;
+   bool last = false;
+
+   if (restore_last_files_names == NULL)
+   {
+      return false;
+   }
+
+   name = pgmoneta_append(name, from);
+   if (name == NULL)
+   {
+      return false;
+   }
+
+   // the names are matched against the decoded file, as that is what the last files step writes
+   if (decode)
+   {
+      if (pgmoneta_ends_with(name, ".aes"))
+      {
+         name[strlen(name) - strlen(".aes")] = '\0';
+      }
+
+      if (pgmoneta_is_compressed_archive(name))
+      {
+         *strrchr(name, '.') = '\0';
+      }
+   }
+
+   for (int i = 0; !last && restore_last_files_names[i] != NULL; i++)
+   {
+      last = !strcmp(name, restore_last_files_names[i]);
+   }
+
+   free(name);
+
+   return last;
+}
+
+static int
+filter_file(struct restore_filter* filter, char* relative, char* to, bool decode)
+{
+   char* path = NULL;
+   char* target = NULL;
+   int ret = 1;
+
+   path = pgmoneta_append(path, relative);
+   target = pgmoneta_append(target, to);
+
+   if (path != NULL && target != NULL)
+   {
+      // the file is left out under the name it would be restored with
+      if (decode && pgmoneta_ends_with(path, ".aes"))
+      {
+         path[strlen(path) - strlen(".aes")] = '\0';
+         target[strlen(target) - strlen(".aes")] = '\0';
+      }
+
+      if (decode && pgmoneta_is_compressed_archive(path))
+      {
+         *strrchr(path, '.') = '\0';
+         *strrchr(target, '.') = '\0';
+      }
+
+      ret = pgmoneta_restore_filter_file(filter, path, target);
+   }
+
+   free(path);
+   free(target);
+
+   return ret;
+}
+
+static int
+restore_file(char* from, char* to, bool decode, struct workers* workers)
+{
+   char* target = NULL;
+   int ret;
+
+   if (!decode || (!pgmoneta_is_compressed_archive(from) && !pgmoneta_is_encrypted_archive(from)))
+   {
+      return pgmoneta_copy_file(from, to, workers);
+   }
+
+   target = pgmoneta_append(target, to);
+   if (target == NULL)
+   {
+      return 1;
+   }
+
+   if (pgmoneta_ends_with(target, ".aes"))
+   {
+      target[strlen(target) - strlen(".aes")] = '\0';
+   }
+
+   if (pgmoneta_is_compressed_archive(target))
+   {
+      *strrchr(target, '.') = '\0';
+   }
+
+   ret = pgmoneta_decode_file(from, target, workers);
+
+   free(target);
+
+   return ret;
+}
+
+static int
+copy_data(int fd_from, int fd_to, off_t size)
+{
+   off_t copied = 0;
+   ssize_t n = 0;
+   ssize_t nread = 0;
+   char* buffer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+#ifdef HAVE_LINUX
+   /* Share the extents when the file system supports it, then let the kernel move the data */
+#ifdef FICLONE
+   if (size > 0 && ioctl(fd_to, FICLONE, fd_from) == 0)
+   {
+      return 0;
+   }
+#endif
+#endif
+
+   if (size > 0 && config->sparse_files)
+   {
+      return copy_sparse(fd_from, fd_to, size);
+   }
+
+#ifdef HAVE_LINUX
+   if (size > 0 && pgmoneta_io_uring_available())
+   {
+      return pgmoneta_io_copy(fd_from, fd_to, size);
+   }
+
+   while (copied < size)
+   {
+      n = copy_file_range(fd_from, NULL, fd_to, NULL, size - copied, 0);
+      if (n < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (n <= 0)
+      {
+         break;
+      }
+      copied += n;
+   }
+
+   while (copied < size)
+   {
+      n = sendfile(fd_to, fd_from, NULL, size - copied);
+      if (n < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      if (n <= 0)
+      {
+         break;
+      }
+      copied += n;
+   }
+
+   errno = 0;
+
+   if (copied >= size)
+   {
+      return 0;
+   }
+#endif
+
+   buffer = (char*)malloc(COPY_BUFFER_SIZE);
+
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   while ((nread = read(fd_from, buffer, COPY_BUFFER_SIZE)) > 0)
+   {
+      char* out = buffer;
+
+      do
+      {
+         n = write(fd_to, out, nread);
+
+         if (n >= 0)
+         {
+            nread -= n;
+            out += n;
+         }
+         else if (errno != EINTR)
+         {
+            goto error;
+         }
+      }
+      while (nread > 0);
+   }
+
+   if (nread < 0)
+   {
+      goto error;
+   }
+
+   free(buffer);
+
+   return 0;
+
+error:
+
+   free(buffer);
+
+   return 1;
+}
+
+static int
+copy_sparse(int fd_from, int fd_to, off_t size)
+{
+   off_t data = 0;
+   off_t hole = size;
+   off_t offset;
+   size_t length;
+   size_t start;
+   size_t position;
+   ssize_t n;
+   char* buffer = NULL;
+
+   buffer = (char*)malloc(COPY_BUFFER_SIZE);
+
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   /* Only the data extents of the source are read, and the zero blocks in them are skipped as well */
+   while (data < size)
+   {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+      data = lseek(fd_from, data, SEEK_DATA);
+      if (data < 0)
+      {
+         if (errno == ENXIO)
+         {
+            break;
+         }
+
+         data = 0;
+         hole = size;
+      }
+      else
+      {
+         hole = lseek(fd_from, data, SEEK_HOLE);
+         if (hole < 0 || hole > size)
+         {
+            hole = size;
+         }
+      }
+#endif
 
-      do
+      for (offset = data; offset < hole; offset += length)
       {
-         nwritten = write(fd_to, out, nread);
+         length = MIN(COPY_BUFFER_SIZE, (size_t)(hole - offset));
 
-         if (nwritten >= 0)
+         n = pread(fd_from, buffer, length, offset);
+         if (n < 0 && errno == EINTR)
          {
-            nread -= nwritten;
-            out += nwritten;
+            length = 0;
+            continue;
          }
-         else if (errno != EINTR)
+         if (n <= 0)
+         {
+            goto error;
+         }
+         length = n;
+
+         start = 0;
+         position = 0;
+         while (position < length)
+         {
+            size_t block = MIN(SPARSE_BLOCK_SIZE - (offset + position) % SPARSE_BLOCK_SIZE, length - position);
+
+            if (block == SPARSE_BLOCK_SIZE && pgmoneta_is_zero(buffer + position, block))
+            {
+               if (position > start && pwrite(fd_to, buffer + start, position - start, offset + start) != (ssize_t)(position - start))
+               {
+                  goto error;
+               }
+               start = position + block;
+            }
+
+            position += block;
+         }
+
+         if (length > start && pwrite(fd_to, buffer + start, length - start, offset + start) != (ssize_t)(length - start))
          {
             goto error;
          }
       }
-      while (nread > 0);
+
+      data = hole;
    }
 
-   if (nread == 0)
+   /* A file that ends in a hole gets its size from the truncate */
+   if (ftruncate(fd_to, size))
    {
-      fsync(fd_to);
-
-      if (close(fd_to) < 0)
-      {
-         fd_to = -1;
-         goto error;
-      }
-      close(fd_from);
+      goto error;
    }
 
-#ifdef DEBUG
-   pgmoneta_log_trace("FILETRACKER | Copy | %s | %s |", fi->from, fi->to);
-#endif
+   errno = 0;
 
-   free(fi);
+   free(buffer);
 
-   return;
+   return 0;
 
 error:
 
-#ifdef DEBUG
-   pgmoneta_log_trace("FILETRACKER | Fail | %s | %s | %s |", fi->from, fi->to, strerror(errno));
-#endif
-
-   if (fd_from >= 0)
-   {
-      close(fd_from);
-   }
-   if (fd_to >= 0)
-   {
-      close(fd_to);
-   }
-
    errno = 0;
 
-   free(fi);
+   free(buffer);
+
+   return 1;
 }
 
 int
@@ -2678,6 +3043,19 @@ pgmoneta_is_file(char* file)
    return false;
 }
 
+bool
+pgmoneta_is_zero(void* data, size_t size)
+{
+   unsigned char* d = (unsigned char*)data;
+
+   if (size == 0)
+   {
+      return true;
+   }
+
+   return d[0] == 0 && !memcmp(d, d + 1, size - 1);
+}
+
 bool
 pgmoneta_compare_files(char* f1, char* f2)
 {
@@ -2932,58 +3310,85 @@ error:
 }
 
 int
-pgmoneta_copy_wal_files(char* from, char* to, char* start, struct workers* workers)
+pgmoneta_copy_wal_files(char* from, char* to, char* start, char* end, struct workers* workers)
 {
    int number_of_wal_files = 0;
    char** wal_files = NULL;
    char* basename = NULL;
    char* ff = NULL;
    char* tf = NULL;
+   int low = 0;
+   int high = 0;
 
    pgmoneta_get_files(from, &number_of_wal_files, &wal_files);
 
-   for (int i = 0; i < number_of_wal_files; i++)
+   // the names are sorted, so the first segment is found without comparing the ones before it
+   high = number_of_wal_files;
+   while (low < high)
    {
-      pgmoneta_basename_file(wal_files[i], &basename);
+      int middle = low + (high - low) / 2;
 
-      if (strcmp(wal_files[i], start) >= 0)
+      if (strcmp(wal_files[middle], start) < 0)
       {
-         if (pgmoneta_ends_with(wal_files[i], ".partial"))
-         {
-            ff = pgmoneta_append(ff, from);
-            if (!pgmoneta_ends_with(ff, "/"))
-            {
-               ff = pgmoneta_append(ff, "/");
-            }
-            ff = pgmoneta_append(ff, wal_files[i]);
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
 
-            tf = pgmoneta_append(tf, to);
-            if (!pgmoneta_ends_with(tf, "/"))
-            {
-               tf = pgmoneta_append(tf, "/");
-            }
-            tf = pgmoneta_append(tf, basename);
-         }
-         else
-         {
-            ff = pgmoneta_append(ff, from);
-            if (!pgmoneta_ends_with(ff, "/"))
-            {
-               ff = pgmoneta_append(ff, "/");
-            }
-            ff = pgmoneta_append(ff, wal_files[i]);
+   for (int i = low; i < number_of_wal_files; i++)
+   {
+      ff = pgmoneta_append(ff, from);
+      if (!pgmoneta_ends_with(ff, "/"))
+      {
+         ff = pgmoneta_append(ff, "/");
+      }
+      ff = pgmoneta_append(ff, wal_files[i]);
 
-            tf = pgmoneta_append(tf, to);
-            if (!pgmoneta_ends_with(tf, "/"))
-            {
-               tf = pgmoneta_append(tf, "/");
-            }
-            tf = pgmoneta_append(tf, wal_files[i]);
+      // a pack is named after its last segment, so it can hold segments up to the end even when its name is past it
+      if (pgmoneta_is_walpack(wal_files[i]))
+      {
+         pgmoneta_walpack_extract_range(ff, to, start, end);
+
+         free(ff);
+         ff = NULL;
+
+         if (end != NULL && strncmp(wal_files[i], end, 24) > 0)
+         {
+            break;
          }
 
-         pgmoneta_copy_file(ff, tf, workers);
+         continue;
+      }
+
+      if (end != NULL && strncmp(wal_files[i], end, 24) > 0)
+      {
+         free(ff);
+         ff = NULL;
+         break;
+      }
+
+      tf = pgmoneta_append(tf, to);
+      if (!pgmoneta_ends_with(tf, "/"))
+      {
+         tf = pgmoneta_append(tf, "/");
+      }
+
+      if (pgmoneta_ends_with(wal_files[i], ".partial"))
+      {
+         pgmoneta_basename_file(wal_files[i], &basename);
+         tf = pgmoneta_append(tf, basename);
+      }
+      else
+      {
+         tf = pgmoneta_append(tf, wal_files[i]);
       }
 
+      // compressed and encrypted segments are decoded by the workers while they are copied
+      restore_file(ff, tf, true, workers);
+
       free(basename);
       free(ff);
       free(tf);
@@ -3013,6 +3418,7 @@ pgmoneta_number_of_wal_files(char* directory, char* from, char* to)
    result = 0;
 
    pgmoneta_get_files(directory, &number_of_wal_files, &wal_files);
+   pgmoneta_walpack_expand(directory, &number_of_wal_files, &wal_files);
 
    for (int i = 0; i < number_of_wal_files; i++)
    {
@@ -3039,6 +3445,54 @@ pgmoneta_number_of_wal_files(char* directory, char* from, char* to)
    return result;
 }
 
+int
+pgmoneta_number_of_wal_files_in(int number_of_files, char** files, char* from, char* to)
+{
+   int lo;
+   int hi;
+   int mid;
+   int start;
+   int end;
+
+   lo = 0;
+   hi = number_of_files;
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (strcmp(files[mid], from) < 0)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   start = lo;
+
+   if (to == NULL)
+   {
+      return number_of_files - start;
+   }
+
+   hi = number_of_files;
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (strcmp(files[mid], to) < 0)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   end = lo;
+
+   return end - start;
+}
+
 unsigned long
 pgmoneta_free_space(char* path)
 {
@@ -3522,6 +3976,17 @@ pgmoneta_get_server_wal(int server)
    return d;
 }
 
+char*
+pgmoneta_get_server_wal_index(int server)
+{
+   char* d = NULL;
+
+   d = get_server_basepath(server);
+   d = pgmoneta_append(d, "walindex/");
+
+   return d;
+}
+
 char*
 pgmoneta_get_server_wal_shipping(int server)
 {
@@ -3691,64 +4156,42 @@ pgmoneta_get_server_backup_identifier_data_wal(int server, char* identifier)
 int
 pgmoneta_permission_recursive(char* d)
 {
-   DIR* dir = opendir(d);
-   char* f = NULL;
-   struct dirent* entry;
-   struct stat statbuf;
+   pgmoneta_walk(d, 0, 1, permission_entry, NULL);
 
-   if (dir)
-   {
-      while ((entry = readdir(dir)))
-      {
-         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
-         {
-            continue;
-         }
+   return 0;
+}
 
-         f = pgmoneta_append(f, d);
-         if (!pgmoneta_ends_with(f, "/"))
-         {
-            f = pgmoneta_append(f, "/");
-         }
-         f = pgmoneta_append(f, entry->d_name);
+static int
+permission_entry(struct walk_entry* entry, void* arg)
+{
+   struct stat st;
 
-         if (f == NULL)
+   if (entry->type == WALK_DIRECTORY)
+   {
+      pgmoneta_permission(entry->path, 7, 0, 0);
+   }
+   else if (entry->type == WALK_LINK)
+   {
+      // a link is followed, as chmod follows it
+      if (!fstatat(entry->dirfd, entry->name, &st, 0))
+      {
+         if (S_ISDIR(st.st_mode))
          {
-            goto error;
+            pgmoneta_permission(entry->path, 7, 0, 0);
+            pgmoneta_permission_recursive(entry->path);
          }
-
-         if (!stat(f, &statbuf))
+         else
          {
-            if (S_ISDIR(statbuf.st_mode))
-            {
-               pgmoneta_permission(f, 7, 0, 0);
-               pgmoneta_permission_recursive(f);
-            }
-            else
-            {
-               pgmoneta_permission(f, 6, 0, 0);
-            }
+            pgmoneta_permission(entry->path, 6, 0, 0);
          }
-
-         free(f);
-         f = NULL;
       }
-
-      closedir(dir);
    }
-
-   return 0;
-
-error:
-
-   free(f);
-
-   if (dir != NULL)
+   else
    {
-      closedir(dir);
+      pgmoneta_permission(entry->path, 6, 0, 0);
    }
 
-   return 1;
+   return WALK_CONTINUE;
 }
 
 int
@@ -4199,12 +4642,88 @@ pgmoneta_token_bucket_init(struct token_bucket* tb, long max_rate)
       tb->max_rate = max_rate;
       tb->every = DEFAULT_EVERY;
       atomic_init(&tb->last_time, (unsigned long)time(NULL));
+      tb->parent = NULL;
       return 0;
    }
 
    return 1;
 }
 
+void
+pgmoneta_token_bucket_init_shared(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&config->network_bucket, 0, sizeof(struct token_bucket));
+   if (!pgmoneta_token_bucket_init(&config->network_bucket, config->total_max_rate) &&
+       (unsigned long)config->max_rate_burst > config->network_bucket.burst)
+   {
+      config->network_bucket.burst = config->max_rate_burst;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      memset(&config->servers[i].network_bucket, 0, sizeof(struct token_bucket));
+      if (!pgmoneta_token_bucket_init(&config->servers[i].network_bucket, pgmoneta_get_network_max_rate(i)) &&
+          (unsigned long)config->max_rate_burst > config->servers[i].network_bucket.burst)
+      {
+         config->servers[i].network_bucket.burst = config->max_rate_burst;
+      }
+      config->servers[i].network_bucket.parent = &config->network_bucket;
+   }
+}
+
+void
+pgmoneta_token_bucket_rate(struct token_bucket* tb, long max_rate)
+{
+   unsigned long burst;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (tb == NULL)
+   {
+      return;
+   }
+
+   if (max_rate <= 0)
+   {
+      tb->max_rate = 0;
+      return;
+   }
+
+   burst = MAX((unsigned long)max_rate, (unsigned long)DEFAULT_BURST);
+   if ((unsigned long)config->max_rate_burst > burst)
+   {
+      burst = config->max_rate_burst;
+   }
+
+   tb->burst = burst;
+   tb->every = DEFAULT_EVERY;
+   if (tb->max_rate <= 0)
+   {
+      atomic_store(&tb->cur_tokens, burst);
+      atomic_store(&tb->last_time, (unsigned long)time(NULL));
+   }
+   tb->max_rate = max_rate;
+}
+
+bool
+pgmoneta_token_bucket_limited(struct token_bucket* tb)
+{
+   for (; tb != NULL; tb = tb->parent)
+   {
+      if (tb->max_rate > 0)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 void
 pgmoneta_token_bucket_destroy(struct token_bucket* tb)
 {
@@ -4270,21 +4789,39 @@ pgmoneta_token_bucket_add(struct token_bucket* tb)
 int
 pgmoneta_token_bucket_consume(struct token_bucket* tb, unsigned long tokens)
 {
-   if (tokens < tb->burst)
+   unsigned long burst = 0;
+
+   // the smallest burst of the hierarchy is the most that can be taken at once
+   for (struct token_bucket* b = tb; b != NULL; b = b->parent)
+   {
+      atomic_fetch_add(&b->consumed, tokens);
+
+      if (b->max_rate > 0 && (burst == 0 || b->burst < burst))
+      {
+         burst = b->burst;
+      }
+   }
+
+   if (burst == 0)
+   {
+      return 0;
+   }
+
+   if (tokens < burst)
    {
       return pgmoneta_token_bucket_once(tb, tokens);
    }
    else
    {
       unsigned long accum = 0;
-      unsigned long cur_tokens;
+      unsigned long chunk;
       while (accum < tokens)
       {
-
-         cur_tokens = atomic_load(&tb->cur_tokens);
-         if (!pgmoneta_token_bucket_once(tb, cur_tokens))
+         // small chunks, so a bucket shared with other workflows still gets drained
+         chunk = MIN(tokens - accum, (unsigned long)DEFAULT_BURST);
+         if (!pgmoneta_token_bucket_once(tb, chunk))
          {
-            accum += cur_tokens;
+            accum += chunk;
          }
          else
          {
@@ -4292,7 +4829,6 @@ pgmoneta_token_bucket_consume(struct token_bucket* tb, unsigned long tokens)
          }
       }
       return 0;
-
    }
 }
 
@@ -4301,6 +4837,16 @@ pgmoneta_token_bucket_once(struct token_bucket* tb, unsigned long tokens)
 {
    unsigned long expected;
 
+   if (tb == NULL)
+   {
+      return 0;
+   }
+
+   if (tb->max_rate <= 0)
+   {
+      return pgmoneta_token_bucket_once(tb->parent, tokens);
+   }
+
    if (!pgmoneta_token_bucket_add(tb))
    {
       expected = atomic_load(&tb->cur_tokens);
@@ -4309,6 +4855,11 @@ pgmoneta_token_bucket_once(struct token_bucket* tb, unsigned long tokens)
       {
          if (atomic_compare_exchange_weak(&tb->cur_tokens, &expected, expected - tokens))
          {
+            if (pgmoneta_token_bucket_once(tb->parent, tokens))
+            {
+               atomic_fetch_add(&tb->cur_tokens, tokens);
+               return 1;
+            }
             return 0;
          }
       }
@@ -4321,22 +4872,33 @@ char*
 pgmoneta_format_and_append(char* buf, const char* format, ...)
 {
    va_list args;
-   va_start(args, format);
+   char small[256];
+   char* formatted_str = small;
 
-   // Determine the required buffer size
-   int size_needed = vsnprintf(NULL, 0, format, args) + 1;
+   // Most strings fit on the stack, so they are formatted in a single pass
+   va_start(args, format);
+   int size_needed = vsnprintf(small, sizeof(small), format, args) + 1;
    va_end(args);
 
-   // Allocate buffer to hold the formatted string
-   char* formatted_str = malloc(size_needed);
+   if (size_needed > (int)sizeof(small))
+   {
+      formatted_str = malloc(size_needed);
+      if (formatted_str == NULL)
+      {
+         return buf;
+      }
 
-   va_start(args, format);
-   vsnprintf(formatted_str, size_needed, format, args);
-   va_end(args);
+      va_start(args, format);
+      vsnprintf(formatted_str, size_needed, format, args);
+      va_end(args);
+   }
 
    buf = pgmoneta_append(buf, formatted_str);
 
-   free(formatted_str);
+   if (formatted_str != small)
+   {
+      free(formatted_str);
+   }
 
    return buf;
 
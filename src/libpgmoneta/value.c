@@ -71,6 +71,17 @@ pgmoneta_value_create(enum value_type type, uintptr_t data, struct value** value
    {
       goto error;
    }
+   pgmoneta_value_init(type, data, val);
+   *value = val;
+   return 0;
+
+error:
+   return 1;
+}
+
+int
+pgmoneta_value_init(enum value_type type, uintptr_t data, struct value* val)
+{
    val->data = 0;
    val->type = type;
    switch (type)
@@ -172,11 +183,7 @@ pgmoneta_value_create(enum value_type type, uintptr_t data, struct value** value
          val->destroy_data = noop_destroy_cb;
          break;
    }
-   *value = val;
    return 0;
-
-error:
-   return 1;
 }
 
 int
@@ -186,15 +193,22 @@ pgmoneta_value_create_with_config(uintptr_t data, struct value_config* config, s
    {
       return 1;
    }
+   return pgmoneta_value_init_with_config(data, config, *value);
+}
+
+int
+pgmoneta_value_init_with_config(uintptr_t data, struct value_config* config, struct value* value)
+{
+   pgmoneta_value_init(ValueRef, data, value);
    if (config != NULL)
    {
       if (config->destroy_data != NULL)
       {
-         (*value)->destroy_data = config->destroy_data;
+         value->destroy_data = config->destroy_data;
       }
       if (config->to_string != NULL)
       {
-         (*value)->to_string = config->to_string;
+         value->to_string = config->to_string;
       }
    }
    return 0;
@@ -212,6 +226,17 @@ pgmoneta_value_destroy(struct value* value)
    return 0;
 }
 
+void
+pgmoneta_value_release(struct value* value)
+{
+   if (value == NULL)
+   {
+      return;
+   }
+   value->destroy_data(value->data);
+   value->data = 0;
+}
+
 uintptr_t
 pgmoneta_value_data(struct value* value)
 {
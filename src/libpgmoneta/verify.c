@@ -35,6 +35,8 @@
 #include <logging.h>
 #include <management.h>
 #include <network.h>
+#include <scheduler.h>
+#include <storage.h>
 #include <string.h>
 #include <utils.h>
 #include <verify.h>
@@ -71,6 +73,7 @@ pgmoneta_verify(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_
    struct configuration* config;
 
    pgmoneta_start_logging();
+   pgmoneta_scheduler_priority(SCHEDULER_PRIORITY_VERIFY);
 
    config = (struct configuration*)shmem;
 
@@ -106,6 +109,11 @@ pgmoneta_verify(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_
       goto error;
    }
 
+   if (pgmoneta_storage_recall(server, backup))
+   {
+      goto error;
+   }
+
    workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_VERIFY, server, backup);
 
    current = workflow;
@@ -121,7 +129,7 @@ pgmoneta_verify(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_
    current = workflow;
    while (current != NULL)
    {
-      if (current->execute(current->name(), nodes))
+      if (pgmoneta_workflow_execute(current, nodes))
       {
          goto error;
       }
@@ -207,8 +215,15 @@ pgmoneta_verify(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)label, ValueString);
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
    pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_FILES, (uintptr_t)filesj, ValueJSON);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SAMPLE, (uintptr_t)config->verify_sample, ValueInt32);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_VERIFIED, pgmoneta_art_search(nodes, NODE_VERIFIED), ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_VERIFIED_SIZE, pgmoneta_art_search(nodes, NODE_VERIFIED_SIZE), ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_THROUGHPUT, pgmoneta_art_search(nodes, NODE_THROUGHPUT), ValueUInt64);
 
-   pgmoneta_delete_directory((char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE));
+   if (pgmoneta_art_contains_key(nodes, NODE_TARGET_BASE))
+   {
+      pgmoneta_delete_directory((char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE));
+   }
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
 
@@ -243,7 +258,10 @@ pgmoneta_verify(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_
 
 error:
 
-   pgmoneta_delete_directory((char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE));
+   if (pgmoneta_art_contains_key(nodes, NODE_TARGET_BASE))
+   {
+      pgmoneta_delete_directory((char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE));
+   }
 
    pgmoneta_deque_iterator_destroy(fiter);
    pgmoneta_deque_iterator_destroy(aiter);
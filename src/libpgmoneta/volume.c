@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <utils.h>
+#include <volume.h>
+
+/* system */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+static int volume_select(void);
+
+int
+pgmoneta_volume_create(int server, char* label)
+{
+   int volume;
+   char* root = NULL;
+   char* link = NULL;
+   char* parent = NULL;
+   char* target = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   root = pgmoneta_get_server_backup_identifier(server, label);
+
+   if (config->number_of_backup_volumes == 0)
+   {
+      goto local;
+   }
+
+   volume = volume_select();
+   if (volume == -1)
+   {
+      goto local;
+   }
+
+   target = pgmoneta_append(target, config->backup_volumes[volume]);
+   if (!pgmoneta_ends_with(target, "/"))
+   {
+      target = pgmoneta_append(target, "/");
+   }
+   target = pgmoneta_append(target, config->servers[server].name);
+   target = pgmoneta_append(target, "/backup/");
+   target = pgmoneta_append(target, label);
+
+   parent = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_mkdir(target) || pgmoneta_mkdir(parent))
+   {
+      pgmoneta_log_warn("Volume: Could not create %s", target);
+      goto local;
+   }
+
+   // the link has no trailing slash
+   link = pgmoneta_append(link, root);
+   link[strlen(link) - 1] = '\0';
+
+   if (symlink(target, link))
+   {
+      pgmoneta_log_warn("Volume: Could not link %s to %s (%s)", link, target, strerror(errno));
+      errno = 0;
+      rmdir(target);
+      goto local;
+   }
+
+   pgmoneta_log_debug("Volume: %s/%s on %s", config->servers[server].name, label, config->backup_volumes[volume]);
+
+   free(root);
+   free(link);
+   free(parent);
+   free(target);
+
+   return 0;
+
+local:
+
+   if (pgmoneta_mkdir(root))
+   {
+      goto error;
+   }
+
+   free(root);
+   free(link);
+   free(parent);
+   free(target);
+
+   return 0;
+
+error:
+
+   free(root);
+   free(link);
+   free(parent);
+   free(target);
+
+   return 1;
+}
+
+char*
+pgmoneta_volume_target(char* path)
+{
+   char link[PATH_MAX];
+   char* target = NULL;
+   struct stat st;
+
+   if (path == NULL || strlen(path) == 0 || strlen(path) >= sizeof(link))
+   {
+      return NULL;
+   }
+
+   memset(&link[0], 0, sizeof(link));
+   memcpy(&link[0], path, strlen(path));
+   while (strlen(link) > 1 && link[strlen(link) - 1] == '/')
+   {
+      link[strlen(link) - 1] = '\0';
+   }
+
+   if (lstat(&link[0], &st) || !S_ISLNK(st.st_mode))
+   {
+      return NULL;
+   }
+
+   target = realpath(&link[0], NULL);
+
+   return target;
+}
+
+static int
+volume_select(void)
+{
+   int volume = -1;
+   unsigned long long best = 0;
+   unsigned long long available;
+   struct statvfs st;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < config->number_of_backup_volumes; i++)
+   {
+      if (statvfs(config->backup_volumes[i], &st))
+      {
+         pgmoneta_log_warn("Volume: %s is not available (%s)", config->backup_volumes[i], strerror(errno));
+         errno = 0;
+         continue;
+      }
+
+      available = (unsigned long long)st.f_bavail * st.f_frsize;
+
+      if (volume == -1 || available > best)
+      {
+         volume = i;
+         best = available;
+      }
+   }
+
+   return volume;
+}
@@ -29,1174 +29,3491 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <fanout.h>
 #include <logging.h>
 #include <management.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
+#include <probes.h>
 #include <prometheus.h>
+#include <protocol.h>
+#include <scheduler.h>
 #include <security.h>
 #include <server.h>
 #include <storage.h>
+#include <streamer.h>
 #include <utils.h>
 #include <value.h>
 #include <wal.h>
+#include <walarchive.h>
+#include <walfile.h>
+#include <walindex.h>
+#include <walinventory.h>
+#include <workers.h>
 #include <workflow.h>
+#include <zstandard_compression.h>
 
 /* system */
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <ev.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <openssl/ssl.h>
 #include <libssh/libssh.h>
 #include <libssh/sftp.h>
+#include <zstd.h>
 
+#define WAL_FEEDBACK_INTERVAL (10 * 1000000)
+#define WAL_FEEDBACK_BYTES    (1024 * 1024)
+#define WAL_RATE_INTERVAL     1000000
+
+#define WAL_PREALLOC_DIRECTORY "prealloc/"
+
+#define WAL_STATE_FILE    "wal.state"
+#define WAL_STATE_MAGIC   "PGMWALST"
+#define WAL_STATE_VERSION 1
+
+#define WAL_RECEIVER_OK              0
+#define WAL_RECEIVER_END_OF_TIMELINE 1
+#define WAL_RECEIVER_ERROR           2
+
+/**
+ * The parsed history file of a timeline, kept while the file is unchanged
+ */
+struct wal_history_cache
+{
+   uint32_t tli;                      /**< The timeline, 0 if none */
+   struct timespec mtime;             /**< The modification time of the history file */
+   off_t size;                        /**< The size of the history file */
+   struct timeline_history* history;  /**< The history */
+};
+
+static pthread_mutex_t wal_history_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct wal_history_cache wal_history[NUMBER_OF_SERVERS];
+
+/**
+ * The data of a WAL fan-out sink
+ */
+struct wal_sink
+{
+   int srv;              /**< The server index */
+   char* root;           /**< The root directory */
+   char path[MAX_PATH];  /**< The root directory owned by the sink */
+   FILE* file;           /**< The WAL shipping file */
+   sftp_file sftp;       /**< The remote file */
+};
+
+/**
+ * The streaming state of a server, written when a segment is opened or closed
+ * so a restart doesn't read the WAL directory
+ */
+struct wal_state
+{
+   char magic[8];              /**< The magic number */
+   uint32_t version;           /**< The version of the format */
+   uint32_t segsize;           /**< The WAL segment size */
+   uint64_t flushed;           /**< The position synced to disk */
+   char segment[MISC_LENGTH];  /**< The newest segment */
+   uint8_t partial;            /**< Is the newest segment partial */
+   uint8_t padding[7];         /**< The padding */
+};
+
+/**
+ * The standby status feedback of the WAL receiver
+ */
+struct wal_feedback
+{
+   int64_t received;  /**< The received position */
+   int64_t flushed;   /**< The position synced to disk */
+   int64_t reported;  /**< The received position of the last report */
+   int64_t last;      /**< The time of the last report in microseconds */
+};
+
+/**
+ * The WAL receiver of a server
+ */
+struct wal_receiver
+{
+   struct ev_io io;                   /**< The libev watcher, must be first */
+   int srv;                           /**< The server index */
+   SSL* ssl;                          /**< The SSL structure */
+   int socket;                        /**< The socket */
+   char* d;                           /**< The WAL directory */
+   char* wal_shipping;                /**< The WAL shipping directory */
+   char* pool;                        /**< The preallocated segment directory */
+   uint32_t timeline;                 /**< The timeline */
+   uint32_t high32;                   /**< The high 32 bits of the start position */
+   uint32_t low32;                    /**< The low 32 bits of the start position */
+   size_t segsize;                    /**< The WAL segment size */
+   size_t xlogptr;                    /**< The current position */
+   size_t curr_xlogoff;               /**< The offset within the current segment */
+   size_t bytes_left;                 /**< The bytes left for the next segment */
+   size_t resume;                     /**< The offset to resume the partial segment at, 0 if none */
+   char* remain_buffer;               /**< The data left for the next segment */
+   size_t remain_buffer_alloc_size;   /**< The size of the remain buffer */
+   char* filename;                    /**< The current segment */
+   FILE* wal_file;                    /**< The current segment file */
+   struct streamer* streamer;         /**< The inline compression and encryption */
+   bool stream_compression;           /**< Compress and encrypt while streaming */
+   unsigned long generation;          /**< The configuration generation of the settings in use */
+   struct wal_feedback feedback;      /**< The standby status feedback */
+   int64_t rate_start;                /**< The start of the receive rate interval in microseconds */
+   uint64_t rate_bytes;               /**< The bytes received in the receive rate interval */
+   struct fanout* fanout;             /**< The WAL fan-out */
+   struct wal_archive* archive;       /**< The WAL archive of the storage engine */
+   struct stream_buffer* buffer;      /**< The stream buffer */
+   struct message* msg;               /**< The message buffer */
+   struct workflow* head;             /**< The storage workflow */
+   struct art* nodes;                 /**< The workflow nodes */
+   bool active;                       /**< Is the receiver streaming */
+};
+
+static int wal_receiver_create(int srv, struct wal_receiver** receiver);
+static int wal_receiver_setup(struct wal_receiver* receiver);
+static int wal_receiver_start(struct wal_receiver* receiver);
+static int wal_receiver_process(struct wal_receiver* receiver, struct message* msg);
+static int wal_receiver_flush(struct wal_receiver* receiver);
+static void wal_receiver_reconfigure(struct wal_receiver* receiver);
+static int wal_receiver_end_of_timeline(struct wal_receiver* receiver);
+static void wal_receiver_destroy(struct wal_receiver* receiver, bool failed);
+static void wal_multiplex_cb(struct ev_loop* loop, struct ev_io* watcher, int revents);
+static void wal_multiplex_timer_cb(struct ev_loop* loop, struct ev_timer* watcher, int revents);
 static char* wal_file_name(uint32_t timeline, size_t segno, int segsize);
 static int wal_fetch_history(char* basedir, int timeline, SSL* ssl, int socket);
-static FILE* wal_open(char* root, char* filename, int segsize);
+static int wal_read_history(char* path, char* filename, struct timeline_history** history);
+static struct timeline_history* wal_copy_history(struct timeline_history* history);
+static FILE* wal_open(char* root, char* pool, char* filename, int segsize);
+static char* wal_prealloc_directory(char* root);
+static bool wal_is_pending(char* name);
+static void wal_compress_segment(struct worker_input* wi);
+static bool wal_prealloc_take(char* pool, char* path, int segsize);
 static int wal_close(char* root, char* filename, bool partial, FILE* file);
+static FILE* wal_stream_open(int srv, char* root, char* filename, struct streamer** streamer);
+static int wal_stream_close(int srv, char* root, char* filename, bool partial, FILE* file, struct streamer* streamer);
+static void wal_segment_metrics(int srv, char* root, char* filename);
+static void wal_segment_index(int srv, char* root, char* filename);
+static void wal_segment_notify(int srv);
+static size_t wal_write(int srv, FILE* file, struct streamer* streamer, void* data, size_t size);
 static int wal_prepare(FILE* file, int segsize);
 static int wal_send_status_report(SSL* ssl, int socket, int64_t received, int64_t flushed, int64_t applied);
+static void wal_feedback_init(struct wal_feedback* feedback, int64_t position);
+static int wal_feedback(int srv, SSL* ssl, int socket, struct wal_feedback* feedback, FILE* file, bool force);
+static void wal_received(struct wal_receiver* receiver, size_t bytes);
+static double wal_elapsed(struct timespec start_t);
+static int wal_sync(FILE* file);
 static int wal_xlog_offset(size_t xlogptr, int segsize);
 static int wal_convert_xlogpos(char* xlogpos, int segsize, uint32_t* high32, uint32_t* low32);
 static int wal_find_streaming_start(char* basedir, int segsize, uint32_t* timeline, uint32_t* high32, uint32_t* low32);
+static void wal_streaming_position(char* segment, bool partial, int segsize, uint32_t* timeline, uint32_t* high32, uint32_t* low32);
+static void wal_state_write(struct wal_receiver* receiver, bool partial);
+static int wal_state_read(struct wal_receiver* receiver);
+static int wal_state_probe(struct wal_receiver* receiver, char* segment, bool* partial);
+static void wal_resume(struct wal_receiver* receiver);
+static size_t wal_resume_offset(char* path, uint64_t start, size_t segsize);
+static bool wal_resume_page(char* data, uint16_t magic, uint64_t start, size_t blcksz, size_t page);
+static int wal_resume_copy(char* data, size_t segsize, size_t blcksz, uint16_t magic, uint64_t start, size_t* pos, char* to, size_t size);
 static int wal_read_replication_slot(SSL* ssl, int socket, char* slot, char* name, int segsize, uint32_t* high32, uint32_t* low32, uint32_t* timeline);
 static int wal_shipping_setup(int srv, char** wal_shipping);
+static int wal_fanout_setup(int srv, char* wal_shipping, struct fanout** fanout);
+static int wal_shipping_open(struct fanout_sink* sink, char* filename, int segsize);
+static int wal_shipping_write(struct fanout_sink* sink, void* data, size_t size);
+static int wal_shipping_close(struct fanout_sink* sink, char* filename, bool partial);
+static int wal_hot_standby_open(struct fanout_sink* sink, char* filename, int segsize);
+static int wal_ssh_open(struct fanout_sink* sink, char* filename, int segsize);
+static int wal_ssh_write(struct fanout_sink* sink, void* data, size_t size);
+static int wal_ssh_close(struct fanout_sink* sink, char* filename, bool partial);
 static void update_wal_lsn(int srv, size_t xlogptr);
 
 void
 pgmoneta_wal(int srv, char** argv)
 {
-   int usr;
-   int auth;
-   SSL* ssl = NULL;
-   int socket = -1;
-   uint32_t high32 = 0;
-   uint32_t low32 = 0;
-   char* d = NULL;
-   char* wal_shipping = NULL;
-   uint32_t timeline = 0;
-   uint32_t cur_timeline = 0;
-   int hdrlen = 1 + 8 + 8 + 8;
-   size_t bytes_left = 0;
-   char* xlogpos = NULL;
-   char* remain_buffer = NULL;
-   size_t remain_buffer_alloc_size = 0;
-   char cmd[MISC_LENGTH];
-   size_t xlogpos_size = 0;
-   size_t xlogptr = 0;
-   size_t segno;
-   size_t xlogoff;
-   size_t curr_xlogoff = 0;
-   size_t segsize;
-   int read_replication = 1;
-   char* filename = NULL;
-   signed char type;
    int ret;
-   FILE* wal_file = NULL;
-   FILE* wal_shipping_file = NULL;
-   sftp_file sftp_wal_file = NULL;
-   struct message* identify_system_msg = NULL;
-   struct query_response* identify_system_response = NULL;
-   struct query_response* end_of_timeline_response = NULL;
-   struct message* start_replication_msg = NULL;
-   struct message* msg = (struct message*)malloc(sizeof (struct message));;
+   int status;
+   struct wal_receiver* receiver = NULL;
    struct configuration* config;
-   struct stream_buffer* buffer = NULL;
-   struct workflow* head = NULL;
-   struct workflow* current = NULL;
-   struct art* nodes = NULL;
 
    config = (struct configuration*) shmem;
 
    pgmoneta_start_logging();
+   pgmoneta_scheduler_priority(SCHEDULER_PRIORITY_WAL);
+   pgmoneta_cpu_affinity(-1);
    pgmoneta_memory_init();
 
    pgmoneta_set_proc_title(1, argv, "wal", config->servers[srv].name);
 
-   if (msg == NULL)
+   if (wal_receiver_create(srv, &receiver))
    {
       goto error;
    }
 
-   memset(msg, 0, sizeof(struct message));
-
-   if (config->servers[srv].wal_streaming)
+   while (config->running)
    {
-      goto error;
-   }
+      if (wal_receiver_start(receiver))
+      {
+         goto error;
+      }
 
-   usr = -1;
-   for (int i = 0; usr == -1 && i < config->number_of_users; i++)
-   {
-      if (!strcmp(config->servers[srv].username, config->users[i].username))
+      // start streaming current timeline's WAL segments
+      status = WAL_RECEIVER_OK;
+      while (config->running && !atomic_load(&config->states[srv].wal_restart) && status == WAL_RECEIVER_OK)
       {
-         usr = i;
+         ret = pgmoneta_consume_copy_stream_start(receiver->ssl, receiver->socket, receiver->buffer, receiver->msg, NULL);
+         if (ret == 0)
+         {
+            status = WAL_RECEIVER_END_OF_TIMELINE;
+            break;
+         }
+         if (ret != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
+         status = wal_receiver_process(receiver, receiver->msg);
+         if (status == WAL_RECEIVER_ERROR)
+         {
+            goto error;
+         }
+
+         pgmoneta_consume_copy_stream_end(receiver->buffer, receiver->msg);
+
+         // the messages that arrived together are synced together
+         if (!pgmoneta_copy_stream_has_message(receiver->buffer) && wal_receiver_flush(receiver))
+         {
+            goto error;
+         }
       }
-   }
 
-   if (usr == -1)
-   {
-      pgmoneta_log_trace("Invalid user for %s", config->servers[srv].name);
-      goto error;
-   }
-   pgmoneta_server_info(srv);
+      if (!config->running)
+      {
+         break;
+      }
 
-   if (config->servers[srv].checksums)
-   {
-      pgmoneta_log_debug("Server %s has checksums enabled", config->servers[srv].name);
-   }
-   else
-   {
-      pgmoneta_log_warn("Server %s has checksums disabled. Use initdb -k or pg_checksums to enable", config->servers[srv].name);
+      if (atomic_load(&config->states[srv].wal_restart))
+      {
+         // the stream is started again with the reloaded connection settings
+         pgmoneta_log_info("WAL: Restarting the streaming for %s", config->servers[srv].name);
+         break;
+      }
+
+      if (wal_receiver_end_of_timeline(receiver))
+      {
+         goto error;
+      }
    }
 
-   segsize = config->servers[srv].wal_size;
-   d = pgmoneta_get_server_wal(srv);
-   pgmoneta_mkdir(d);
+   wal_receiver_destroy(receiver, false);
+   free(receiver);
 
-   if (pgmoneta_art_create(&nodes))
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+
+   exit(0);
+
+error:
+   wal_receiver_destroy(receiver, true);
+   free(receiver);
+
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+
+   exit(1);
+}
+
+void
+pgmoneta_wal_multiplex(int* servers, int number_of_servers, char** argv)
+{
+   int active = 0;
+   struct ev_loop* loop = NULL;
+   struct ev_timer timer;
+   struct wal_receiver** receivers = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   pgmoneta_start_logging();
+   pgmoneta_scheduler_priority(SCHEDULER_PRIORITY_WAL);
+   pgmoneta_cpu_affinity(-1);
+   pgmoneta_memory_init();
+
+   pgmoneta_set_proc_title(1, argv, "wal", "multiplex");
+
+   receivers = (struct wal_receiver**)calloc(number_of_servers + 1, sizeof(struct wal_receiver*));
+   if (receivers == NULL)
    {
       goto error;
    }
 
-   if (pgmoneta_art_insert(nodes, NODE_SERVER, (uintptr_t)srv, ValueInt32))
+   loop = ev_loop_new(pgmoneta_libev(config->libev));
+   if (loop == NULL)
    {
+      pgmoneta_log_error("WAL: Could not create the event loop");
       goto error;
    }
 
-   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   // the connections are set up one by one, and only the streaming is multiplexed
+   for (int i = 0; config->running && i < number_of_servers; i++)
    {
-      head = pgmoneta_storage_create_ssh(WORKFLOW_TYPE_WAL_SHIPPING);
-      current = head;
+      if (wal_receiver_create(servers[i], &receivers[active]) || wal_receiver_start(receivers[active]))
+      {
+         wal_receiver_destroy(receivers[active], true);
+         free(receivers[active]);
+         receivers[active] = NULL;
+         continue;
+      }
+
+      pgmoneta_log_debug("WAL: Multiplexing %s", config->servers[servers[i]].name);
+
+      ev_io_init((struct ev_io*)receivers[active], wal_multiplex_cb, receivers[active]->socket, EV_READ);
+      ev_io_start(loop, (struct ev_io*)receivers[active]);
+
+      active++;
    }
 
-   current = head;
-   while (current != NULL)
+   if (active > 0)
    {
-      if (current->setup(current->name(), nodes))
-      {
-         goto error;
-      }
-      current = current->next;
+      timer.data = receivers;
+      ev_timer_init(&timer, wal_multiplex_timer_cb, 1.0, 1.0);
+      ev_timer_start(loop, &timer);
+
+      ev_run(loop, 0);
+
+      ev_timer_stop(loop, &timer);
    }
 
-   current = head;
-   while (current != NULL)
+   for (int i = 0; i < active; i++)
    {
-      if (current->execute(current->name(), nodes))
+      if (receivers[i]->active)
       {
-         goto error;
+         ev_io_stop(loop, (struct ev_io*)receivers[i]);
+         wal_receiver_destroy(receivers[i], false);
       }
-      current = current->next;
+      free(receivers[i]);
    }
 
-   // Setup WAL shipping directory
-   if (wal_shipping_setup(srv, &wal_shipping))
+   ev_loop_destroy(loop);
+   free(receivers);
+
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+
+   exit(0);
+
+error:
+   if (loop != NULL)
    {
-      pgmoneta_log_warn("Unable to create WAL shipping directory");
+      ev_loop_destroy(loop);
    }
+   free(receivers);
 
-   auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket);
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
 
-   if (auth != AUTH_SUCCESS)
+   exit(1);
+}
+
+int
+pgmoneta_wal_replay(int srv, int socket, uint32_t timeline, uint64_t start, struct wal_replay* replay)
+{
+   int ret;
+   int bucket;
+   int status = WAL_RECEIVER_OK;
+   bool data;
+   double latency;
+   struct timespec first_t;
+   struct timespec start_t;
+   struct wal_receiver* r = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   memset(replay, 0, sizeof(struct wal_replay));
+   memset(&first_t, 0, sizeof(struct timespec));
+
+   if (config->servers[srv].wal_streaming)
    {
-      pgmoneta_log_error("Authentication failed for user %s on %s", config->users[usr].username, config->servers[srv].name);
-      goto error;
+      pgmoneta_disconnect(socket);
+      return 1;
    }
 
-   pgmoneta_memory_stream_buffer_init(&buffer);
-
-   config->servers[srv].wal_streaming = true;
-   pgmoneta_create_identify_system_message(&identify_system_msg);
-   if (pgmoneta_query_execute(ssl, socket, identify_system_msg, &identify_system_response))
+   r = (struct wal_receiver*)calloc(1, sizeof(struct wal_receiver));
+   if (r == NULL)
    {
-      pgmoneta_log_error("Error occurred when executing IDENTIFY_SYSTEM");
-      goto error;
+      pgmoneta_disconnect(socket);
+      return 1;
    }
 
-   if (identify_system_response == NULL || identify_system_response->number_of_columns < 4)
+   r->srv = srv;
+   r->socket = socket;
+   r->generation = atomic_load(&config->reload_generation);
+   r->stream_compression = config->wal_stream_compression && !config->wal_synchronous &&
+                           (pgmoneta_get_wal_compression(srv) != COMPRESSION_NONE || config->encryption != ENCRYPTION_NONE);
+
+   r->msg = (struct message*)malloc(sizeof (struct message));
+   if (r->msg == NULL)
    {
       goto error;
    }
 
-   cur_timeline = pgmoneta_atoi(pgmoneta_query_response_get_data(identify_system_response, 1));
-   if (cur_timeline < 1)
+   memset(r->msg, 0, sizeof(struct message));
+
+   if (wal_receiver_setup(r))
    {
-      pgmoneta_log_error("identify system: timeline should at least be 1, getting %d", timeline);
       goto error;
    }
-   config->servers[srv].cur_timeline = cur_timeline;
 
-   wal_find_streaming_start(d, segsize, &timeline, &high32, &low32);
-   if (timeline == 0)
+   pgmoneta_memory_stream_buffer_init(&r->buffer);
+
+   config->servers[srv].wal_streaming = true;
+   r->active = true;
+
+   // the stream is already started, so the position is taken as given
+   r->timeline = timeline;
+   r->high32 = (uint32_t)(start >> 32);
+   r->low32 = (uint32_t)start;
+
+   atomic_store_explicit(&config->states[srv].wal_lsn, start, memory_order_relaxed);
+   wal_feedback_init(&r->feedback, (int64_t)start);
+
+   while (config->running && status == WAL_RECEIVER_OK)
    {
-      read_replication = (config->servers[srv].version >= 15) ? 1 : 0;
+      ret = pgmoneta_consume_copy_stream_start(r->ssl, r->socket, r->buffer, r->msg, NULL);
+      if (ret == 0)
+      {
+         break;
+      }
+      if (ret != MESSAGE_STATUS_OK)
+      {
+         goto error;
+      }
 
-      // query the replication slot to get the starting LSN and timeline ID
-      if (read_replication)
+      data = r->msg->kind == 'd' && r->msg->length >= PROTOCOL_XLOGDATA_SIZE && *((char*)r->msg->data) == 'w';
+
+      clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+      if (replay->messages == 0 && data)
       {
-         if (wal_read_replication_slot(ssl, socket, config->servers[srv].wal_slot, config->servers[srv].name, segsize, &high32, &low32, &timeline))
-         {
-            read_replication = 0;   // Fallback if not PostgreSQL 15+
-         }
+         first_t = start_t;
       }
 
-      // use current xlogpos as last resort
-      if (!read_replication)
+      status = wal_receiver_process(r, r->msg);
+      if (status == WAL_RECEIVER_ERROR)
       {
-         timeline = cur_timeline;
-         xlogpos_size = strlen(pgmoneta_query_response_get_data(identify_system_response, 2)) + 1;
-         xlogpos = (char*)malloc(xlogpos_size);
+         goto error;
+      }
 
-         if (xlogpos == NULL)
-         {
-            goto error;
-         }
-         memset(xlogpos, 0, xlogpos_size);
-         memcpy(xlogpos, pgmoneta_query_response_get_data(identify_system_response, 2), xlogpos_size);
-         if (wal_convert_xlogpos(xlogpos, segsize, &high32, &low32))
+      if (data)
+      {
+         latency = wal_elapsed(start_t);
+
+         replay->messages++;
+         replay->bytes += r->msg->length - PROTOCOL_XLOGDATA_SIZE;
+         replay->latency_total += latency;
+         replay->latency_max = MAX(replay->latency_max, latency);
+
+         bucket = 0;
+         while (bucket < WAL_REPLAY_BUCKETS - 1 && latency * 1000000.0 >= (double)(1ULL << bucket))
          {
-            goto error;
+            bucket++;
          }
-         free(xlogpos);
-         xlogpos = NULL;
+         replay->latency[bucket]++;
       }
-   }
 
-   pgmoneta_free_query_response(identify_system_response);
-   identify_system_response = NULL;
+      pgmoneta_consume_copy_stream_end(r->buffer, r->msg);
 
-   while (config->running)
-   {
-      if (wal_fetch_history(d, timeline, ssl, socket))
+      if (!pgmoneta_copy_stream_has_message(r->buffer) && wal_receiver_flush(r))
       {
-         pgmoneta_log_error("Error occurred when fetching .history file");
          goto error;
       }
+   }
 
-      snprintf(cmd, sizeof(cmd), "%X/%X", high32, low32);
+   if (replay->messages > 0)
+   {
+      replay->elapsed = wal_elapsed(first_t);
+   }
 
-      pgmoneta_create_start_replication_message(cmd, timeline, config->servers[srv].wal_slot, &start_replication_msg);
+   wal_receiver_destroy(r, false);
+   free(r);
 
-      ret = pgmoneta_write_message(ssl, socket, start_replication_msg);
+   return 0;
 
-      if (ret != MESSAGE_STATUS_OK)
-      {
-         pgmoneta_log_error("Error during START_REPLICATION for server %s", config->servers[srv].name);
-         goto error;
-      }
+error:
+   if (replay->messages > 0)
+   {
+      replay->elapsed = wal_elapsed(first_t);
+   }
+
+   wal_receiver_destroy(r, true);
+   free(r);
+
+   return 1;
+}
 
-      // assign xlogpos at the beginning of the streaming to LSN
-      memset(config->servers[srv].current_wal_lsn, 0, MISC_LENGTH);
-      snprintf(config->servers[srv].current_wal_lsn, MISC_LENGTH, "%s", cmd);
+static void
+wal_multiplex_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
+{
+   int ret;
+   int status = WAL_RECEIVER_OK;
+   struct wal_receiver* receiver = (struct wal_receiver*)watcher;
+   struct configuration* config;
 
-      type = 0;
+   config = (struct configuration*)shmem;
 
-      // wait for the CopyBothResponse message
+   if (EV_ERROR & revents)
+   {
+      goto error;
+   }
 
-      while (config->running && (msg == NULL || type != 'W'))
+   // the socket is readable, so a single read will not wait for the server
+   do
+   {
+      if (pgmoneta_read_copy_stream(receiver->ssl, receiver->socket, receiver->buffer) != MESSAGE_STATUS_OK)
       {
-         ret = pgmoneta_consume_copy_stream_start(ssl, socket, buffer, msg, NULL);
-         if (ret != 1)
-         {
-            pgmoneta_log_error("Error occurred when starting stream replication");
-            goto error;
-         }
-         type = msg->kind;
-         if (type == 'E')
-         {
-            pgmoneta_log_error("Error occurred when starting stream replication");
-            pgmoneta_log_error_response_message(msg);
-            goto error;
-         }
-         pgmoneta_consume_copy_stream_end(buffer, msg);
+         goto error;
       }
+   }
+   while (receiver->ssl != NULL && SSL_pending(receiver->ssl) > 0);
 
-      type = 0;
+   while (config->running && status == WAL_RECEIVER_OK && pgmoneta_copy_stream_has_message(receiver->buffer))
+   {
+      ret = pgmoneta_consume_copy_stream_start(receiver->ssl, receiver->socket, receiver->buffer, receiver->msg, NULL);
+      if (ret != MESSAGE_STATUS_OK)
+      {
+         goto error;
+      }
 
-      // start streaming current timeline's WAL segments
-      while (config->running)
+      status = wal_receiver_process(receiver, receiver->msg);
+      if (status == WAL_RECEIVER_ERROR)
       {
-         ret = pgmoneta_consume_copy_stream_start(ssl, socket, buffer, msg, NULL);
-         if (ret == 0)
-         {
-            break;
-         }
-         if (ret != MESSAGE_STATUS_OK)
-         {
-            goto error;
-         }
-
-         if (msg == NULL)
-         {
-            pgmoneta_log_error("wal: received NULL message");
-            goto error;
-         }
+         goto error;
+      }
 
-         if (msg->kind == 'E' || msg->kind == 'f')
-         {
-            pgmoneta_log_copyfail_message(msg);
-            pgmoneta_log_error_response_message(msg);
-            goto error;
-         }
-         if (msg->kind == 'd')
-         {
-            type = *((char*)msg->data);
-            switch (type)
-            {
-               case 'w':
-               {
-                  // wal data
-                  if (msg->length < hdrlen)
-                  {
-                     pgmoneta_log_error("Incomplete CopyData payload");
-                     goto error;
-                  }
-                  xlogptr = pgmoneta_read_int64(msg->data + 1);
-                  xlogoff = wal_xlog_offset(xlogptr, segsize);
+      pgmoneta_consume_copy_stream_end(receiver->buffer, receiver->msg);
+   }
 
-                  if (wal_file == NULL)
-                  {
-                     if (xlogoff != 0 && bytes_left != xlogoff)
-                     {
-                        pgmoneta_log_error("Received WAL record of offset %d with no file open", xlogoff);
-                        goto error;
-                     }
-                     else
-                     {
-                        // new wal file
-                        segno = xlogptr / segsize;
-                        curr_xlogoff = 0;
-                        filename = wal_file_name(timeline, segno, segsize);
-                        if ((wal_file = wal_open(d, filename, segsize)) == NULL)
-                        {
-                           pgmoneta_log_error("Could not create or open WAL segment file at %s", d);
-                           goto error;
-                        }
-                        memset(config->servers[srv].current_wal_filename, 0, MISC_LENGTH);
-                        snprintf(config->servers[srv].current_wal_filename, MISC_LENGTH, "%s.partial", filename);
-                        if ((wal_shipping_file = wal_open(wal_shipping, filename, segsize)) == NULL)
-                        {
-                           if (wal_shipping != NULL)
-                           {
-                              pgmoneta_log_warn("Could not create or open WAL segment file at %s", wal_shipping);
-                           }
-                        }
-                        if (config->storage_engine & STORAGE_ENGINE_SSH)
-                        {
-                           if (pgmoneta_sftp_wal_open(srv, filename, segsize, &sftp_wal_file) == 1)
-                           {
-                              pgmoneta_log_error("Could not create or open WAL segment file on remote ssh storage engine");
-                              goto error;
-                           }
-                        }
-
-                        if (bytes_left > 0)
-                        {
-                           curr_xlogoff += bytes_left;
-                           fwrite(remain_buffer, 1, bytes_left, wal_file);
-                           if (sftp_wal_file != NULL)
-                           {
-                              sftp_write(sftp_wal_file, remain_buffer, bytes_left);
-                           }
-                           if (wal_shipping_file != NULL)
-                           {
-                              fwrite(remain_buffer, 1, bytes_left, wal_shipping_file);
-                           }
-                           bytes_left = 0;
-                        }
-                     }
-                  }
-                  else if (curr_xlogoff != xlogoff)
-                  {
-                     pgmoneta_log_error("Received WAL record offset %08x, expected %08x", xlogoff, curr_xlogoff);
-                     goto error;
-                  }
-                  bytes_left = msg->length - hdrlen;
-                  size_t bytes_written = 0;
-                  // write to the wal file
-                  while (bytes_left > 0)
-                  {
-                     size_t bytes_to_write = 0;
-                     if (xlogoff + bytes_left > segsize)
-                     {
-                        // do not write across the segment boundary
-                        bytes_to_write = segsize - xlogoff;
-                     }
-                     else
-                     {
-                        bytes_to_write = bytes_left;
-                     }
-                     if (bytes_to_write != fwrite(msg->data + hdrlen + bytes_written, 1, bytes_to_write, wal_file))
-                     {
-                        pgmoneta_log_error("Could not write %d bytes to WAL file %s", bytes_to_write, filename);
-                        goto error;
-                     }
-                     if (sftp_wal_file != NULL)
-                     {
-                        sftp_write(sftp_wal_file, msg->data + hdrlen + bytes_written, bytes_to_write);
-                     }
-
-                     if (wal_shipping_file != NULL)
-                     {
-                        fwrite(msg->data + hdrlen + bytes_written, 1, bytes_to_write, wal_shipping_file);
-                     }
-
-                     bytes_written += bytes_to_write;
-                     bytes_left -= bytes_to_write;
-                     xlogptr += bytes_written;
-                     xlogoff += bytes_written;
-                     curr_xlogoff += bytes_written;
-
-                     if (wal_xlog_offset(xlogptr, segsize) == 0)
-                     {
-                        // the end of WAL segment
-                        fflush(wal_file);
-                        wal_close(d, filename, false, wal_file);
-                        if (sftp_wal_file != NULL)
-                        {
-                           pgmoneta_sftp_wal_close(srv, filename, false, &sftp_wal_file);
-                           sftp_wal_file = NULL;
-                        }
-
-                        wal_file = NULL;
-                        if (wal_shipping_file != NULL)
-                        {
-                           fflush(wal_shipping_file);
-                           wal_close(wal_shipping, filename, false, wal_shipping_file);
-                           wal_shipping_file = NULL;
-                        }
-                        free(filename);
-                        filename = NULL;
-
-                        xlogoff = 0;
-                        curr_xlogoff = 0;
-
-                        if (bytes_left > 0)
-                        {
-                           /* Save the rest of the data for the next WAL segment */
-                           if (remain_buffer == NULL)
-                           {
-                              remain_buffer = malloc(bytes_left);
-                              remain_buffer_alloc_size = bytes_left;
-                           }
-                           else if (bytes_left > remain_buffer_alloc_size)
-                           {
-                              remain_buffer = realloc(remain_buffer, bytes_left);
-                              remain_buffer_alloc_size = bytes_left;
-                           }
-                           memset(remain_buffer, 0, remain_buffer_alloc_size);
-                           memcpy(remain_buffer, msg->data + bytes_written, bytes_left);
-                        }
-                        break;
-                     }
-                  }
-                  // update LSN after a message data is written to the segment
-                  update_wal_lsn(srv, xlogptr);
+   // the messages of one read are synced together
+   if (status == WAL_RECEIVER_OK && wal_receiver_flush(receiver))
+   {
+      goto error;
+   }
 
-                  wal_send_status_report(ssl, socket, xlogptr, xlogptr, 0);
-                  break;
-               }
-               case 'k':
-               {
-                  // keep alive request
-                  wal_send_status_report(ssl, socket, xlogptr, xlogptr, 0);
-                  break;
-               }
-               default:
-                  // shouldn't be here
-                  pgmoneta_log_error("Unrecognized CopyData type %c", type);
-                  goto error;
-            }
-         }
-         else if (msg->kind == 'c')
-         {
-            // handle CopyDone
-            pgmoneta_send_copy_done_message(ssl, socket);
-            if (wal_file != NULL)
-            {
-               // Next file would be at a new timeline, so we treat the current wal file completed
-               wal_close(d, filename, false, wal_file);
-               wal_file = NULL;
-               wal_close(wal_shipping, filename, false, wal_shipping_file);
-               wal_shipping_file = NULL;
-               if (sftp_wal_file != NULL)
-               {
-                  pgmoneta_sftp_wal_close(srv, filename, false, &sftp_wal_file);
-                  sftp_wal_file = NULL;
-               }
-            }
-            pgmoneta_consume_copy_stream_end(buffer, msg);
-            break;
-         }
-         pgmoneta_consume_copy_stream_end(buffer, msg);
-      }
-      // there should be a DataRow message followed by a CommandComplete messages,
-      // receive them and parse the next timeline and xlogpos from it
-      if (!config->running)
-      {
-         break;
-      }
-      pgmoneta_consume_data_row_messages(ssl, socket, buffer, &end_of_timeline_response);
-      if (end_of_timeline_response == NULL || end_of_timeline_response->number_of_columns < 2)
+   if (status == WAL_RECEIVER_END_OF_TIMELINE)
+   {
+      // the switch to the next timeline is a short exchange, so it is done in place
+      if (wal_receiver_end_of_timeline(receiver) || wal_receiver_start(receiver))
       {
          goto error;
       }
-      timeline = pgmoneta_atoi(pgmoneta_query_response_get_data(end_of_timeline_response, 0));
-      xlogpos = pgmoneta_query_response_get_data(end_of_timeline_response, 1);
-      if (wal_convert_xlogpos(xlogpos, segsize, &high32, &low32))
+   }
+
+   if (!config->running)
+   {
+      ev_break(loop, EVBREAK_ALL);
+   }
+
+   return;
+
+error:
+   pgmoneta_log_error("WAL: Stopping the multiplexed stream for %s", config->servers[receiver->srv].name);
+
+   ev_io_stop(loop, watcher);
+   wal_receiver_destroy(receiver, true);
+}
+
+static void
+wal_multiplex_timer_cb(struct ev_loop* loop, struct ev_timer* watcher, int revents)
+{
+   bool active = false;
+   struct wal_receiver** receivers = (struct wal_receiver**)watcher->data;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; receivers[i] != NULL; i++)
+   {
+      if (receivers[i]->active && atomic_load(&config->states[receivers[i]->srv].wal_restart))
       {
-         goto error;
+         // the stream is started again with the reloaded connection settings
+         pgmoneta_log_info("WAL: Restarting the multiplexed streaming for %s", config->servers[receivers[i]->srv].name);
+
+         ev_io_stop(loop, (struct ev_io*)receivers[i]);
+         wal_receiver_destroy(receivers[i], false);
       }
-      xlogpos = NULL;
-      // receive the last command complete message
-      msg->kind = '\0';
-      while (config->running && msg->kind != 'C')
+
+      if (receivers[i]->active)
       {
-         pgmoneta_consume_copy_stream_start(ssl, socket, buffer, msg, NULL);
-         pgmoneta_consume_copy_stream_end(buffer, msg);
+         active = true;
+
+         // the receive rate drops to zero for connections that are idle
+         wal_received(receivers[i], 0);
+
+         // keep the feedback going for connections that are idle
+         wal_feedback(receivers[i]->srv, receivers[i]->ssl, receivers[i]->socket, &receivers[i]->feedback,
+                      receivers[i]->streamer == NULL ? receivers[i]->wal_file : NULL, false);
       }
+   }
+
+   if (!config->running || !active)
+   {
+      ev_break(loop, EVBREAK_ALL);
+   }
+}
+
+static int
+wal_receiver_create(int srv, struct wal_receiver** receiver)
+{
+   int usr;
+   int auth;
+   uint32_t cur_timeline = 0;
+   int read_replication = 1;
+   char* xlogpos = NULL;
+   size_t xlogpos_size = 0;
+   struct wal_receiver* r = NULL;
+   struct message* identify_system_msg = NULL;
+   struct query_response* identify_system_response = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   *receiver = NULL;
 
-      pgmoneta_free_query_response(end_of_timeline_response);
-      end_of_timeline_response = NULL;
-      pgmoneta_free_message(start_replication_msg);
-      start_replication_msg = NULL;
+   if (config->servers[srv].wal_streaming)
+   {
+      return 1;
    }
 
-   config->servers[srv].wal_streaming = false;
-   pgmoneta_close_ssl(ssl);
-   if (socket != -1)
+   atomic_store(&config->states[srv].wal_restart, false);
+
+   r = (struct wal_receiver*)calloc(1, sizeof(struct wal_receiver));
+   if (r == NULL)
    {
-      pgmoneta_disconnect(socket);
+      return 1;
    }
-   if (wal_file != NULL)
+
+   *receiver = r;
+
+   r->srv = srv;
+   r->socket = -1;
+   r->generation = atomic_load(&config->reload_generation);
+   r->stream_compression = config->wal_stream_compression && !config->wal_synchronous &&
+                           (pgmoneta_get_wal_compression(srv) != COMPRESSION_NONE || config->encryption != ENCRYPTION_NONE);
+
+   r->msg = (struct message*)malloc(sizeof (struct message));
+   if (r->msg == NULL)
+   {
+      goto error;
+   }
+
+   memset(r->msg, 0, sizeof(struct message));
+
+   usr = -1;
+   for (int i = 0; usr == -1 && i < config->number_of_users; i++)
    {
-      bool partial = (wal_xlog_offset(xlogptr, segsize) != 0);
-      wal_close(d, filename, partial, wal_file);
-      wal_close(wal_shipping, filename, partial, wal_shipping_file);
-      if (sftp_wal_file != NULL)
+      if (!strcmp(config->servers[srv].username, config->users[i].username))
       {
-         pgmoneta_sftp_wal_close(srv, filename, partial, &sftp_wal_file);
-         sftp_wal_file = NULL;
+         usr = i;
       }
    }
 
-   current = head;
-   while (current != NULL)
+   if (usr == -1)
    {
-      current->teardown(current->name(), nodes);
+      pgmoneta_log_trace("Invalid user for %s", config->servers[srv].name);
+      goto error;
+   }
+   pgmoneta_server_info(srv);
 
-      current = current->next;
+   if (config->servers[srv].checksums)
+   {
+      pgmoneta_log_debug("Server %s has checksums enabled", config->servers[srv].name);
+   }
+   else
+   {
+      pgmoneta_log_warn("Server %s has checksums disabled. Use initdb -k or pg_checksums to enable", config->servers[srv].name);
    }
 
-   pgmoneta_memory_destroy();
-   pgmoneta_stop_logging();
+   if (wal_receiver_setup(r))
+   {
+      goto error;
+   }
 
-   pgmoneta_free_message(identify_system_msg);
-   pgmoneta_free_message(start_replication_msg);
-   if (msg != NULL)
+   auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, true, &r->ssl, &r->socket);
+
+   if (auth != AUTH_SUCCESS)
+   {
+      pgmoneta_log_error("Authentication failed for user %s on %s", config->users[usr].username, config->servers[srv].name);
+      goto error;
+   }
+
+   pgmoneta_memory_stream_buffer_init(&r->buffer);
+
+   config->servers[srv].wal_streaming = true;
+   r->active = true;
+
+   pgmoneta_create_identify_system_message(&identify_system_msg);
+   if (pgmoneta_query_execute(r->ssl, r->socket, identify_system_msg, &identify_system_response))
+   {
+      pgmoneta_log_error("Error occurred when executing IDENTIFY_SYSTEM");
+      goto error;
+   }
+
+   if (identify_system_response == NULL || identify_system_response->number_of_columns < 4)
+   {
+      goto error;
+   }
+
+   cur_timeline = pgmoneta_atoi(pgmoneta_query_response_get_data(identify_system_response, 1));
+   if (cur_timeline < 1)
+   {
+      pgmoneta_log_error("identify system: timeline should at least be 1, getting %d", r->timeline);
+      goto error;
+   }
+   config->servers[srv].cur_timeline = cur_timeline;
+
+   // the persisted state only needs its tail checked, the directory is read when it doesn't match
+   if (wal_state_read(r))
+   {
+      wal_find_streaming_start(r->d, r->segsize, &r->timeline, &r->high32, &r->low32);
+   }
+   if (r->timeline != 0)
+   {
+      wal_resume(r);
+   }
+   else
    {
-      msg->data = NULL;
+      read_replication = (config->servers[srv].version >= 15) ? 1 : 0;
+
+      // query the replication slot to get the starting LSN and timeline ID
+      if (read_replication)
+      {
+         if (wal_read_replication_slot(r->ssl, r->socket, config->servers[srv].wal_slot, config->servers[srv].name, r->segsize, &r->high32, &r->low32, &r->timeline))
+         {
+            read_replication = 0;   // Fallback if not PostgreSQL 15+
+         }
+      }
+
+      // use current xlogpos as last resort
+      if (!read_replication)
+      {
+         r->timeline = cur_timeline;
+         xlogpos_size = strlen(pgmoneta_query_response_get_data(identify_system_response, 2)) + 1;
+         xlogpos = (char*)malloc(xlogpos_size);
+
+         if (xlogpos == NULL)
+         {
+            goto error;
+         }
+         memset(xlogpos, 0, xlogpos_size);
+         memcpy(xlogpos, pgmoneta_query_response_get_data(identify_system_response, 2), xlogpos_size);
+         if (wal_convert_xlogpos(xlogpos, r->segsize, &r->high32, &r->low32))
+         {
+            goto error;
+         }
+         free(xlogpos);
+         xlogpos = NULL;
+      }
    }
-   pgmoneta_free_message(msg);
+
+   pgmoneta_free_message(identify_system_msg);
    pgmoneta_free_query_response(identify_system_response);
-   pgmoneta_free_query_response(end_of_timeline_response);
-   pgmoneta_memory_stream_buffer_free(buffer);
 
-   pgmoneta_art_destroy(nodes);
+   return 0;
 
-   free(remain_buffer);
-   free(d);
-   free(wal_shipping);
-   free(filename);
+error:
+   pgmoneta_free_message(identify_system_msg);
+   pgmoneta_free_query_response(identify_system_response);
    free(xlogpos);
-   exit(0);
 
-error:
-   config->servers[srv].wal_streaming = false;
-   pgmoneta_close_ssl(ssl);
-   if (socket != -1)
+   return 1;
+}
+
+static int
+wal_receiver_setup(struct wal_receiver* r)
+{
+   struct workflow* current = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   r->segsize = config->servers[r->srv].wal_size;
+   r->d = pgmoneta_get_server_wal(r->srv);
+   pgmoneta_mkdir(r->d);
+
+   if (config->wal_prealloc > 0)
    {
-      pgmoneta_disconnect(socket);
+      r->pool = wal_prealloc_directory(r->d);
    }
 
-   if (wal_file != NULL)
+   if (pgmoneta_art_create(&r->nodes))
    {
-      wal_close(d, filename, true, wal_file);
-      wal_close(wal_shipping, filename, true, wal_shipping_file);
+      return 1;
    }
-   if (sftp_wal_file != NULL)
+
+   if (pgmoneta_art_insert(r->nodes, NODE_SERVER, (uintptr_t)r->srv, ValueInt32))
    {
-      pgmoneta_sftp_wal_close(srv, filename, true, &sftp_wal_file);
-      sftp_wal_file = NULL;
+      return 1;
    }
-   pgmoneta_free_message(identify_system_msg);
-   pgmoneta_free_message(start_replication_msg);
-   if (msg != NULL)
+
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
    {
-      msg->data = NULL;
+      r->head = pgmoneta_storage_create_ssh(WORKFLOW_TYPE_WAL_SHIPPING);
    }
-   pgmoneta_free_message(msg);
-   pgmoneta_free_query_response(identify_system_response);
-   pgmoneta_free_query_response(end_of_timeline_response);
-   pgmoneta_memory_stream_buffer_free(buffer);
 
-   current = head;
+   current = r->head;
    while (current != NULL)
    {
-      current->teardown(current->name(), nodes);
+      if (current->setup(current->name(), r->nodes))
+      {
+         return 1;
+      }
+      current = current->next;
+   }
 
+   current = r->head;
+   while (current != NULL)
+   {
+      if (current->execute(current->name(), r->nodes))
+      {
+         return 1;
+      }
       current = current->next;
    }
-
-   pgmoneta_memory_destroy();
-   pgmoneta_stop_logging();
-
-   pgmoneta_art_destroy(nodes);
-
-   free(remain_buffer);
-   free(d);
-   free(wal_shipping);
-   free(filename);
-   free(xlogpos);
-   exit(1);
+
+   // Setup WAL shipping directory
+   if (wal_shipping_setup(r->srv, &r->wal_shipping))
+   {
+      pgmoneta_log_warn("Unable to create WAL shipping directory");
+   }
+
+   if (wal_fanout_setup(r->srv, r->wal_shipping, &r->fanout))
+   {
+      return 1;
+   }
+
+   if (pgmoneta_wal_archive_create(r->srv, r->d, &r->archive))
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+wal_receiver_start(struct wal_receiver* r)
+{
+   int ret;
+   signed char type;
+   char cmd[MISC_LENGTH];
+   struct message* start_replication_msg = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   if (wal_fetch_history(r->d, r->timeline, r->ssl, r->socket))
+   {
+      pgmoneta_log_error("Error occurred when fetching .history file");
+      goto error;
+   }
+
+   snprintf(cmd, sizeof(cmd), "%X/%X", r->high32, r->low32);
+
+   pgmoneta_create_start_replication_message(cmd, r->timeline, config->servers[r->srv].wal_slot, &start_replication_msg);
+
+   ret = pgmoneta_write_message(r->ssl, r->socket, start_replication_msg);
+
+   if (ret != MESSAGE_STATUS_OK)
+   {
+      pgmoneta_log_error("Error during START_REPLICATION for server %s", config->servers[r->srv].name);
+      goto error;
+   }
+
+   // assign xlogpos at the beginning of the streaming to LSN
+   atomic_store_explicit(&config->states[r->srv].wal_lsn, ((uint64_t)r->high32 << 32) | r->low32, memory_order_relaxed);
+
+   // everything before the start position is already on disk
+   wal_feedback_init(&r->feedback, ((int64_t)r->high32 << 32) | r->low32);
+
+   type = 0;
+
+   // wait for the CopyBothResponse message
+   while (config->running && type != 'W')
+   {
+      ret = pgmoneta_consume_copy_stream_start(r->ssl, r->socket, r->buffer, r->msg, NULL);
+      if (ret != 1)
+      {
+         pgmoneta_log_error("Error occurred when starting stream replication");
+         goto error;
+      }
+      type = r->msg->kind;
+      if (type == 'E')
+      {
+         pgmoneta_log_error("Error occurred when starting stream replication");
+         pgmoneta_log_error_response_message(r->msg);
+         goto error;
+      }
+      pgmoneta_consume_copy_stream_end(r->buffer, r->msg);
+   }
+
+   pgmoneta_free_message(start_replication_msg);
+
+   return 0;
+
+error:
+   pgmoneta_free_message(start_replication_msg);
+
+   return 1;
+}
+
+static int
+wal_receiver_process(struct wal_receiver* r, struct message* msg)
+{
+   int hdrlen = PROTOCOL_XLOGDATA_SIZE;
+   signed char type;
+   bool resume;
+   size_t segno;
+   size_t xlogoff;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   if (msg == NULL)
+   {
+      pgmoneta_log_error("wal: received NULL message");
+      return WAL_RECEIVER_ERROR;
+   }
+
+   if (msg->kind == 'E' || msg->kind == 'f')
+   {
+      pgmoneta_log_copyfail_message(msg);
+      pgmoneta_log_error_response_message(msg);
+      return WAL_RECEIVER_ERROR;
+   }
+
+   if (msg->kind == 'c')
+   {
+      // handle CopyDone
+      pgmoneta_send_copy_done_message(r->ssl, r->socket);
+      if (r->wal_file != NULL)
+      {
+         // Next file would be at a new timeline, so we treat the current wal file completed
+         if (!wal_stream_close(r->srv, r->d, r->filename, false, r->wal_file, r->streamer))
+         {
+            wal_state_write(r, false);
+            pgmoneta_wal_archive_add(r->archive, r->filename);
+         }
+         r->streamer = NULL;
+         r->wal_file = NULL;
+         pgmoneta_fanout_close(r->fanout, r->filename, false);
+         free(r->filename);
+         r->filename = NULL;
+      }
+      return WAL_RECEIVER_END_OF_TIMELINE;
+   }
+
+   if (msg->kind != 'd')
+   {
+      return WAL_RECEIVER_OK;
+   }
+
+   type = *((char*)msg->data);
+   switch (type)
+   {
+      case 'w':
+      {
+         struct protocol_xlogdata xlogdata;
+
+         // wal data
+         if (msg->length < hdrlen || !pgmoneta_protocol_xlogdata(msg->data, (size_t)msg->length, &xlogdata))
+         {
+            pgmoneta_log_error("Incomplete CopyData payload");
+            return WAL_RECEIVER_ERROR;
+         }
+         r->xlogptr = xlogdata.start;
+         xlogoff = wal_xlog_offset(r->xlogptr, r->segsize);
+
+         wal_received(r, msg->length - hdrlen);
+         pgmoneta_prometheus_wal_primary(r->srv, xlogdata.end, r->xlogptr + msg->length - hdrlen);
+
+         if (r->wal_file == NULL)
+         {
+            // the stream starts in the middle of the partial segment that is already on disk
+            resume = r->resume > 0 && xlogoff == r->resume;
+            r->resume = 0;
+
+            if (xlogoff != 0 && r->bytes_left != xlogoff && !resume)
+            {
+               pgmoneta_log_error("Received WAL record of offset %d with no file open", xlogoff);
+               return WAL_RECEIVER_ERROR;
+            }
+            else
+            {
+               // new wal file, which is where a reloaded configuration takes effect
+               if (atomic_load(&config->reload_generation) != r->generation && !resume)
+               {
+                  wal_receiver_reconfigure(r);
+               }
+
+               segno = r->xlogptr / r->segsize;
+               r->curr_xlogoff = resume ? xlogoff : 0;
+               free(r->filename);
+               r->filename = wal_file_name(r->timeline, segno, r->segsize);
+               if (r->stream_compression)
+               {
+                  r->wal_file = wal_stream_open(r->srv, r->d, r->filename, &r->streamer);
+               }
+               else
+               {
+                  r->wal_file = wal_open(r->d, r->pool, r->filename, r->segsize);
+               }
+               if (r->wal_file == NULL)
+               {
+                  pgmoneta_log_error("Could not create or open WAL segment file at %s", r->d);
+                  return WAL_RECEIVER_ERROR;
+               }
+               if (resume && fseek(r->wal_file, (long)xlogoff, SEEK_SET))
+               {
+                  pgmoneta_log_error("Could not resume WAL segment %s: %s", r->filename, strerror(errno));
+                  return WAL_RECEIVER_ERROR;
+               }
+               memset(config->servers[r->srv].current_wal_filename, 0, MISC_LENGTH);
+               if (r->streamer != NULL)
+               {
+                  char* suffix = pgmoneta_streamer_suffix(r->streamer->compression, r->streamer->encryption);
+                  snprintf(config->servers[r->srv].current_wal_filename, MISC_LENGTH, "%s%s.partial", r->filename, suffix);
+                  free(suffix);
+               }
+               else
+               {
+                  snprintf(config->servers[r->srv].current_wal_filename, MISC_LENGTH, "%s.partial", r->filename);
+               }
+               if (pgmoneta_fanout_open(r->fanout, r->filename, r->segsize))
+               {
+                  return WAL_RECEIVER_ERROR;
+               }
+               wal_state_write(r, true);
+
+               if (r->bytes_left > 0)
+               {
+                  r->curr_xlogoff += r->bytes_left;
+                  if (r->bytes_left != wal_write(r->srv, r->wal_file, r->streamer, r->remain_buffer, r->bytes_left))
+                  {
+                     pgmoneta_log_error("Could not write %d bytes to WAL file %s", r->bytes_left, r->filename);
+                     return WAL_RECEIVER_ERROR;
+                  }
+                  if (pgmoneta_fanout_write(r->fanout, r->remain_buffer, r->bytes_left))
+                  {
+                     return WAL_RECEIVER_ERROR;
+                  }
+                  r->bytes_left = 0;
+               }
+            }
+         }
+         else if (r->curr_xlogoff != xlogoff)
+         {
+            pgmoneta_log_error("Received WAL record offset %08x, expected %08x", xlogoff, r->curr_xlogoff);
+            return WAL_RECEIVER_ERROR;
+         }
+         r->bytes_left = msg->length - hdrlen;
+         size_t bytes_written = 0;
+         // write to the wal file
+         while (r->bytes_left > 0)
+         {
+            size_t bytes_to_write = 0;
+            if (xlogoff + r->bytes_left > r->segsize)
+            {
+               // do not write across the segment boundary
+               bytes_to_write = r->segsize - xlogoff;
+            }
+            else
+            {
+               bytes_to_write = r->bytes_left;
+            }
+            if (bytes_to_write != wal_write(r->srv, r->wal_file, r->streamer, msg->data + hdrlen + bytes_written, bytes_to_write))
+            {
+               pgmoneta_log_error("Could not write %d bytes to WAL file %s", bytes_to_write, r->filename);
+               return WAL_RECEIVER_ERROR;
+            }
+            if (pgmoneta_fanout_write(r->fanout, msg->data + hdrlen + bytes_written, bytes_to_write))
+            {
+               return WAL_RECEIVER_ERROR;
+            }
+
+            bytes_written += bytes_to_write;
+            r->bytes_left -= bytes_to_write;
+            r->xlogptr += bytes_written;
+            xlogoff += bytes_written;
+            r->curr_xlogoff += bytes_written;
+
+            if (wal_xlog_offset(r->xlogptr, r->segsize) == 0)
+            {
+               // the end of WAL segment
+               fflush(r->wal_file);
+               if (!wal_stream_close(r->srv, r->d, r->filename, false, r->wal_file, r->streamer))
+               {
+                  r->feedback.flushed = r->xlogptr;
+                  wal_state_write(r, false);
+                  pgmoneta_wal_archive_add(r->archive, r->filename);
+               }
+               r->streamer = NULL;
+               r->wal_file = NULL;
+
+               if (pgmoneta_fanout_close(r->fanout, r->filename, false))
+               {
+                  return WAL_RECEIVER_ERROR;
+               }
+               free(r->filename);
+               r->filename = NULL;
+
+               xlogoff = 0;
+               r->curr_xlogoff = 0;
+
+               if (r->bytes_left > 0)
+               {
+                  /* Save the rest of the data for the next WAL segment */
+                  if (r->remain_buffer == NULL)
+                  {
+                     r->remain_buffer = malloc(r->bytes_left);
+                     r->remain_buffer_alloc_size = r->bytes_left;
+                  }
+                  else if (r->bytes_left > r->remain_buffer_alloc_size)
+                  {
+                     r->remain_buffer = realloc(r->remain_buffer, r->bytes_left);
+                     r->remain_buffer_alloc_size = r->bytes_left;
+                  }
+                  memset(r->remain_buffer, 0, r->remain_buffer_alloc_size);
+                  memcpy(r->remain_buffer, msg->data + bytes_written, r->bytes_left);
+               }
+               break;
+            }
+         }
+         // update LSN after a message data is written to the segment
+         update_wal_lsn(r->srv, r->xlogptr);
+
+         // report a completed segment right away, otherwise coalesce the feedback
+         r->feedback.received = r->xlogptr;
+         wal_feedback(r->srv, r->ssl, r->socket, &r->feedback, r->streamer == NULL ? r->wal_file : NULL, r->feedback.flushed == r->feedback.received);
+         break;
+      }
+      case 'k':
+      {
+         // keep alive request, the last byte tells if the server requests a reply
+         struct protocol_keepalive keepalive;
+         bool reply = false;
+
+         if (msg->length > 0 && pgmoneta_protocol_keepalive(msg->data, (size_t)msg->length, &keepalive))
+         {
+            reply = keepalive.reply;
+            pgmoneta_prometheus_wal_primary(r->srv, keepalive.end, r->xlogptr);
+         }
+
+         wal_feedback(r->srv, r->ssl, r->socket, &r->feedback, r->streamer == NULL ? r->wal_file : NULL, reply);
+         break;
+      }
+      default:
+         // shouldn't be here
+         pgmoneta_log_error("Unrecognized CopyData type %c", type);
+         return WAL_RECEIVER_ERROR;
+   }
+
+   return WAL_RECEIVER_OK;
+}
+
+static int
+wal_receiver_flush(struct wal_receiver* r)
+{
+   struct timespec start_t;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   if (!config->wal_synchronous || r->wal_file == NULL || r->streamer != NULL ||
+       r->feedback.flushed >= r->feedback.received)
+   {
+      return 0;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   if (wal_sync(r->wal_file))
+   {
+      return 1;
+   }
+
+   pgmoneta_prometheus_wal_latency(r->srv, PROMETHEUS_WAL_FLUSH, wal_elapsed(start_t));
+
+   // the primary waits for this report to commit
+   r->feedback.flushed = r->feedback.received;
+
+   return wal_feedback(r->srv, r->ssl, r->socket, &r->feedback, NULL, true);
+}
+
+static void
+wal_receiver_reconfigure(struct wal_receiver* r)
+{
+   char* wal_shipping = NULL;
+   struct fanout* fanout = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   r->generation = atomic_load(&config->reload_generation);
+   r->stream_compression = config->wal_stream_compression && !config->wal_synchronous &&
+                           (pgmoneta_get_wal_compression(r->srv) != COMPRESSION_NONE || config->encryption != ENCRYPTION_NONE);
+
+   // the fan-out is idle between segments, so it is replaced without touching the replication connection
+   if (wal_shipping_setup(r->srv, &wal_shipping))
+   {
+      pgmoneta_log_warn("Unable to create WAL shipping directory");
+   }
+
+   if (wal_fanout_setup(r->srv, wal_shipping, &fanout))
+   {
+      pgmoneta_log_warn("WAL: Keeping the WAL shipping settings of %s", config->servers[r->srv].name);
+      free(wal_shipping);
+      return;
+   }
+
+   pgmoneta_fanout_destroy(r->fanout);
+   free(r->wal_shipping);
+
+   r->fanout = fanout;
+   r->wal_shipping = wal_shipping;
+
+   pgmoneta_log_debug("WAL: Reconfigured %s", config->servers[r->srv].name);
+}
+
+static int
+wal_receiver_end_of_timeline(struct wal_receiver* r)
+{
+   char* xlogpos = NULL;
+   struct query_response* end_of_timeline_response = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   // there should be a DataRow message followed by a CommandComplete messages,
+   // receive them and parse the next timeline and xlogpos from it
+   pgmoneta_consume_data_row_messages(r->ssl, r->socket, r->buffer, &end_of_timeline_response);
+   if (end_of_timeline_response == NULL || end_of_timeline_response->number_of_columns < 2)
+   {
+      goto error;
+   }
+   r->timeline = pgmoneta_atoi(pgmoneta_query_response_get_data(end_of_timeline_response, 0));
+   xlogpos = pgmoneta_query_response_get_data(end_of_timeline_response, 1);
+   if (wal_convert_xlogpos(xlogpos, r->segsize, &r->high32, &r->low32))
+   {
+      goto error;
+   }
+   // receive the last command complete message
+   r->msg->kind = '\0';
+   while (config->running && r->msg->kind != 'C')
+   {
+      pgmoneta_consume_copy_stream_start(r->ssl, r->socket, r->buffer, r->msg, NULL);
+      pgmoneta_consume_copy_stream_end(r->buffer, r->msg);
+   }
+
+   pgmoneta_free_query_response(end_of_timeline_response);
+
+   return 0;
+
+error:
+   pgmoneta_free_query_response(end_of_timeline_response);
+
+   return 1;
+}
+
+static void
+wal_receiver_destroy(struct wal_receiver* r, bool failed)
+{
+   bool partial;
+   struct workflow* current = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*) shmem;
+
+   if (r == NULL)
+   {
+      return;
+   }
+
+   if (r->active)
+   {
+      config->servers[r->srv].wal_streaming = false;
+   }
+   r->active = false;
+
+   pgmoneta_close_ssl(r->ssl);
+   r->ssl = NULL;
+   if (r->socket != -1)
+   {
+      pgmoneta_disconnect(r->socket);
+      r->socket = -1;
+   }
+
+   partial = failed || wal_xlog_offset(r->xlogptr, r->segsize) != 0;
+
+   if (r->wal_file != NULL)
+   {
+      wal_stream_close(r->srv, r->d, r->filename, partial, r->wal_file, r->streamer);
+      r->streamer = NULL;
+      r->wal_file = NULL;
+   }
+   if (r->filename != NULL)
+   {
+      pgmoneta_fanout_close(r->fanout, r->filename, partial);
+   }
+   pgmoneta_fanout_destroy(r->fanout);
+   r->fanout = NULL;
+   pgmoneta_wal_archive_destroy(r->archive);
+   r->archive = NULL;
+
+   current = r->head;
+   while (current != NULL)
+   {
+      current->teardown(current->name(), r->nodes);
+
+      current = current->next;
+   }
+
+   if (r->msg != NULL)
+   {
+      r->msg->data = NULL;
+   }
+   pgmoneta_free_message(r->msg);
+   r->msg = NULL;
+   pgmoneta_memory_stream_buffer_free(r->buffer);
+   r->buffer = NULL;
+
+   pgmoneta_art_destroy(r->nodes);
+   r->nodes = NULL;
+
+   free(r->remain_buffer);
+   r->remain_buffer = NULL;
+   free(r->d);
+   r->d = NULL;
+   free(r->pool);
+   r->pool = NULL;
+   free(r->wal_shipping);
+   r->wal_shipping = NULL;
+   free(r->filename);
+   r->filename = NULL;
+}
+
+static int
+wal_read_replication_slot(SSL* ssl, int socket, char* slot, char* name, int segsize, uint32_t* high32, uint32_t* low32, uint32_t* timeline)
+{
+   struct message* read_slot_msg = NULL;
+   struct query_response* read_slot_response = NULL;
+   char* lsn = NULL;
+   int status = 0;
+   uint32_t tli = 0;
+
+   *high32 = 0;
+   *low32 = 0;
+   *timeline = 0;
+
+   pgmoneta_create_read_replication_slot_message(slot, &read_slot_msg);
+   status = pgmoneta_query_execute(ssl, socket, read_slot_msg, &read_slot_response);
+
+   if (status != 0)
+   {
+      pgmoneta_log_debug("Error occurred when executing READ_REPLICATION_SLOT for slot %s on server %s", slot, name);
+      goto error;
+   }
+
+   if (read_slot_response == NULL || read_slot_response->number_of_columns < 3)
+   {
+      pgmoneta_log_debug("Invalid response from READ_REPLICATION_SLOT for slot %s on server %s", slot, name);
+      goto error;
+   }
+
+   tli = pgmoneta_atoi(pgmoneta_query_response_get_data(read_slot_response, 2));
+   if (tli < 1)
+   {
+      pgmoneta_log_debug("wal_read_replication_slot: timeline is %d, expecting 1 for server %s", tli, name);
+      goto error;
+   }
+
+   lsn = pgmoneta_query_response_get_data(read_slot_response, 1);
+   if (wal_convert_xlogpos(lsn, segsize, high32, low32))
+   {
+      pgmoneta_log_debug("wal_read_replication_slot: failed to convert LSN from replication slot %s on server %s", slot, name);
+      goto error;
+   }
+
+   *timeline = tli;
+
+   pgmoneta_free_query_response(read_slot_response);
+   pgmoneta_free_message(read_slot_msg);
+
+   return 0;
+
+error:
+   pgmoneta_free_query_response(read_slot_response);
+   pgmoneta_free_message(read_slot_msg);
+   return 1;
+}
+
+static void
+update_wal_lsn(int srv, size_t xlogptr)
+{
+   struct configuration* config = (struct configuration*) shmem;
+
+   atomic_store_explicit(&config->states[srv].wal_lsn, (uint64_t)xlogptr, memory_order_relaxed);
+}
+
+int
+pgmoneta_get_timeline_history(int srv, uint32_t tli, struct timeline_history** history)
+{
+   struct timeline_history* h = NULL;
+   char filename[MISC_LENGTH];
+   char* path = NULL;
+   bool cached = false;
+   struct stat st;
+
+   if (tli == 1)
+   {
+      return 0;
+   }
+
+   snprintf(filename, sizeof(filename), "%08X.history", tli);
+   path = pgmoneta_get_server_wal(srv);
+   path = pgmoneta_append(path, filename);
+
+   memset(&st, 0, sizeof(struct stat));
+   if (stat(path, &st))
+   {
+      errno = 0;
+   }
+
+   /* The metrics ask for the same history on each scrape. A forked process may
+      inherit the lock while it is held, so the cache is skipped when it is busy */
+   if (srv >= 0 && srv < NUMBER_OF_SERVERS && !pthread_mutex_trylock(&wal_history_lock))
+   {
+      struct wal_history_cache* c = &wal_history[srv];
+
+      if (c->tli == tli && c->history != NULL && c->size == st.st_size &&
+          c->mtime.tv_sec == st.st_mtim.tv_sec && c->mtime.tv_nsec == st.st_mtim.tv_nsec)
+      {
+         h = wal_copy_history(c->history);
+         cached = h != NULL;
+      }
+
+      pthread_mutex_unlock(&wal_history_lock);
+   }
+
+   if (!cached)
+   {
+      if (wal_read_history(path, filename, &h))
+      {
+         goto error;
+      }
+
+      if (srv >= 0 && srv < NUMBER_OF_SERVERS && !pthread_mutex_trylock(&wal_history_lock))
+      {
+         struct wal_history_cache* c = &wal_history[srv];
+
+         pgmoneta_free_timeline_history(c->history);
+
+         c->tli = tli;
+         c->mtime = st.st_mtim;
+         c->size = st.st_size;
+         c->history = wal_copy_history(h);
+
+         pthread_mutex_unlock(&wal_history_lock);
+      }
+   }
+
+   *history = h;
+
+   free(path);
+
+   return 0;
+
+error:
+
+   free(path);
+
+   return 1;
+}
+
+void
+pgmoneta_free_timeline_history(struct timeline_history* history)
+{
+   struct timeline_history* h = history;
+   while (h != NULL)
+   {
+      struct timeline_history* next = h->next;
+      free(h);
+      h = next;
+   }
+}
+
+int
+pgmoneta_wal_prealloc(int srv)
+{
+   char* d = NULL;
+   char* pool = NULL;
+   char* path = NULL;
+   char* tmp = NULL;
+   char number[MISC_LENGTH];
+   FILE* file = NULL;
+   int segsize;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   segsize = config->servers[srv].wal_size;
+
+   if (config->wal_prealloc <= 0 || segsize <= 0)
+   {
+      return 0;
+   }
+
+   d = pgmoneta_get_server_wal(srv);
+   pool = wal_prealloc_directory(d);
+
+   if (pgmoneta_mkdir(pool))
+   {
+      goto error;
+   }
+
+   for (int i = 0; config->running && i < config->wal_prealloc; i++)
+   {
+      memset(&number[0], 0, sizeof(number));
+      snprintf(&number[0], sizeof(number), "%d", i);
+
+      path = pgmoneta_append(path, pool);
+      path = pgmoneta_append(path, &number[0]);
+
+      if (!pgmoneta_exists(path))
+      {
+         // fill a temporary file, so the receiver never picks up an incomplete segment
+         tmp = pgmoneta_append(tmp, path);
+         tmp = pgmoneta_append(tmp, ".tmp");
+
+         file = fopen(tmp, "wb");
+         if (file == NULL)
+         {
+            pgmoneta_log_error("WAL error: %s", strerror(errno));
+            errno = 0;
+            goto error;
+         }
+
+         if (wal_prepare(file, segsize) || wal_sync(file))
+         {
+            goto error;
+         }
+
+         fclose(file);
+         file = NULL;
+
+         if (rename(tmp, path) != 0)
+         {
+            pgmoneta_log_error("could not rename file %s to %s", tmp, path);
+            goto error;
+         }
+
+         pgmoneta_log_trace("Pre-allocated WAL segment %s", path);
+
+         free(tmp);
+         tmp = NULL;
+      }
+
+      free(path);
+      path = NULL;
+   }
+
+   free(d);
+   free(pool);
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   if (tmp != NULL)
+   {
+      pgmoneta_delete_file(tmp, NULL);
+   }
+
+   free(d);
+   free(pool);
+   free(path);
+   free(tmp);
+
+   return 1;
+}
+
+int
+pgmoneta_wal_recycle(char* directory, char* path)
+{
+   char* pool = NULL;
+   char* to = NULL;
+   char* name = NULL;
+   char number[MISC_LENGTH];
+   int ret = 1;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->wal_prealloc <= 0 || directory == NULL || path == NULL)
+   {
+      return 1;
+   }
+
+   // only complete raw segments are recycled
+   name = strrchr(path, '/');
+   name = name != NULL ? name + 1 : path;
+   if (strlen(name) != 24 || strspn(name, "0123456789ABCDEF") != 24)
+   {
+      return 1;
+   }
+
+   pool = wal_prealloc_directory(directory);
+   if (pgmoneta_mkdir(pool))
+   {
+      free(pool);
+      return 1;
+   }
+
+   for (int i = 0; ret && i < config->wal_prealloc; i++)
+   {
+      memset(&number[0], 0, sizeof(number));
+      snprintf(&number[0], sizeof(number), "%d", i);
+
+      to = pgmoneta_append(to, pool);
+      to = pgmoneta_append(to, &number[0]);
+
+      if (!pgmoneta_exists(to) && rename(path, to) == 0)
+      {
+         pgmoneta_log_trace("Recycled WAL segment %s", path);
+         ret = 0;
+      }
+
+      free(to);
+      to = NULL;
+   }
+
+   free(pool);
+
+   return ret;
+}
+
+int
+pgmoneta_wal_compress_pending(int srv, char* directory)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   char** pending = NULL;
+   int number_of_pending = 0;
+   int number_of_workers = 0;
+   char* suffix = NULL;
+   char* from = NULL;
+   char* to = NULL;
+   bool* done = NULL;
+   int number_of_compressed = 0;
+   char** compressed = NULL;
+   char** raw = NULL;
+   struct workers* workers = NULL;
+   struct worker_input* wi = NULL;
+   struct walinventory_stamp stamp;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_walinventory_begin(srv, &stamp);
+
+   // the names sort oldest first
+   if (pgmoneta_get_wal_files(directory, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   pending = (char**)calloc(MAX(number_of_files, 1), sizeof(char*));
+   if (pending == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if (wal_is_pending(files[i]))
+      {
+         pending[number_of_pending++] = files[i];
+      }
+   }
+
+   if (number_of_pending == 0)
+   {
+      goto done;
+   }
+
+   done = (bool*)calloc(number_of_pending, sizeof(bool));
+   compressed = (char**)calloc(number_of_pending, sizeof(char*));
+   raw = (char**)calloc(number_of_pending, sizeof(char*));
+   if (done == NULL || compressed == NULL || raw == NULL)
+   {
+      goto error;
+   }
+
+   suffix = pgmoneta_streamer_suffix(pgmoneta_get_wal_compression(srv), config->encryption);
+
+   if (suffix == NULL || strlen(suffix) == 0)
+   {
+      goto done;
+   }
+
+   number_of_workers = MIN(pgmoneta_get_number_of_workers(srv), number_of_pending);
+   if (number_of_workers > 1)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   for (int i = 0; i < number_of_pending; i++)
+   {
+      from = pgmoneta_append(NULL, directory);
+      if (!pgmoneta_ends_with(from, "/"))
+      {
+         from = pgmoneta_append(from, "/");
+      }
+      from = pgmoneta_append(from, pending[i]);
+
+      to = pgmoneta_append(NULL, from);
+      to = pgmoneta_append(to, suffix);
+
+      if (!pgmoneta_create_worker_input(NULL, from, to, srv, workers, &wi))
+      {
+         wi->argument = &done[i];
+
+         if (workers != NULL)
+         {
+            if (pgmoneta_workers_add(workers, wal_compress_segment, wi))
+            {
+               free(wi);
+            }
+         }
+         else
+         {
+            wal_compress_segment(wi);
+         }
+      }
+
+      wi = NULL;
+
+      free(from);
+      free(to);
+      from = NULL;
+      to = NULL;
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
+   // the raw segments are removed here, so the pool of recycled segments has a single writer
+   for (int i = 0; i < number_of_pending; i++)
+   {
+      if (!done[i])
+      {
+         pgmoneta_log_error("WAL: Could not compress %s in %s", pending[i], directory);
+         continue;
+      }
+
+      from = pgmoneta_append(NULL, directory);
+      if (!pgmoneta_ends_with(from, "/"))
+      {
+         from = pgmoneta_append(from, "/");
+      }
+      from = pgmoneta_append(from, pending[i]);
+
+      if (pgmoneta_wal_recycle(directory, from))
+      {
+         pgmoneta_delete_file(from, NULL);
+      }
+
+      compressed[number_of_compressed] = pgmoneta_append(NULL, pending[i]);
+      compressed[number_of_compressed] = pgmoneta_append(compressed[number_of_compressed], suffix);
+      raw[number_of_compressed] = pending[i];
+      number_of_compressed++;
+
+      free(from);
+      from = NULL;
+   }
+
+   pgmoneta_walinventory_update(srv, &stamp, number_of_compressed, compressed, number_of_compressed, raw);
+
+done:
+
+   for (int i = 0; i < number_of_compressed; i++)
+   {
+      free(compressed[i]);
+   }
+   free(compressed);
+   free(raw);
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(pending);
+   free(done);
+   free(suffix);
+
+   return 0;
+
+error:
+
+   free(compressed);
+   free(raw);
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(pending);
+   free(done);
+   free(suffix);
+
+   return 1;
+}
+
+int
+pgmoneta_get_wal_compression(int srv)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->servers[srv].wal_compression_type != -1)
+   {
+      return config->servers[srv].wal_compression_type;
+   }
+
+   if (config->wal_compression_type != -1)
+   {
+      return config->wal_compression_type;
+   }
+
+   return config->compression_type;
+}
+
+int
+pgmoneta_get_wal_compression_level(int srv)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->servers[srv].wal_compression_level != -1)
+   {
+      return config->servers[srv].wal_compression_level;
+   }
+
+   if (config->wal_compression_level != -1)
+   {
+      return config->wal_compression_level;
+   }
+
+   return config->compression_level;
+}
+
+static int
+wal_read_history(char* path, char* filename, struct timeline_history** history)
+{
+   struct timeline_history* h = NULL;
+   struct timeline_history* curh = NULL;
+   struct timeline_history* nexth = NULL;
+   char buffer[MAX_PATH];
+   int numfields = 0;
+   FILE* file = NULL;
+
+   *history = NULL;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Unable to open history file: %s", strerror(errno));
+      goto error;
+   }
+   memset(buffer, 0, sizeof(buffer));
+   while (fgets(buffer, sizeof(buffer), file) != NULL)
+   {
+      char* ptr = buffer;
+      // ignore empty spaces
+      while (*ptr != '\0' && isspace(*ptr))
+      {
+         ptr++;
+      }
+      // ignore empty lines and comments
+      if (*ptr == '\0' || *ptr == '#')
+      {
+         continue;
+      }
+      nexth = (struct timeline_history*) malloc(sizeof(struct timeline_history));
+
+      if (nexth == NULL)
+      {
+         goto error;
+      }
+
+      memset(nexth, 0, sizeof(struct timeline_history));
+      if (h == NULL)
+      {
+         curh = nexth;
+         h = curh;
+      }
+      else
+      {
+         curh->next = nexth;
+         curh = curh->next;
+      }
+      numfields = sscanf(ptr, "%u\t%X/%X", &curh->parent_tli, &curh->switchpos_hi, &curh->switchpos_lo);
+      if (numfields != 3)
+      {
+         pgmoneta_log_error("error parsing history file %s", filename);
+         goto error;
+      }
+      memset(buffer, 0, sizeof(buffer));
+   }
+
+   *history = h;
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   pgmoneta_free_timeline_history(h);
+   return 1;
+}
+
+static struct timeline_history*
+wal_copy_history(struct timeline_history* history)
+{
+   struct timeline_history* h = NULL;
+   struct timeline_history* tail = NULL;
+   struct timeline_history* next = NULL;
+
+   for (struct timeline_history* cur = history; cur != NULL; cur = cur->next)
+   {
+      next = (struct timeline_history*)malloc(sizeof(struct timeline_history));
+      if (next == NULL)
+      {
+         pgmoneta_free_timeline_history(h);
+         return NULL;
+      }
+
+      memcpy(next, cur, sizeof(struct timeline_history));
+      next->next = NULL;
+
+      if (tail == NULL)
+      {
+         h = next;
+      }
+      else
+      {
+         tail->next = next;
+      }
+      tail = next;
+   }
+
+   return h;
+}
+
+static bool
+wal_is_pending(char* name)
+{
+   // only complete raw segments, partial segments are compressed when they are complete
+   return strlen(name) == 24 && strspn(name, "0123456789ABCDEF") == 24;
+}
+
+static void
+wal_compress_segment(struct worker_input* wi)
+{
+   int srv = wi->level;
+   size_t size = 0;
+   void* buffer = NULL;
+   FILE* in = NULL;
+   FILE* out = NULL;
+   struct streamer* streamer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   buffer = pgmoneta_worker_buffer(WORKER_BUFFER_IN, 65536);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   in = fopen(wi->from, "rb");
+   out = fopen(wi->to, "wb");
+   if (in == NULL || out == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_streamer_create(pgmoneta_get_wal_compression(srv), pgmoneta_get_wal_compression_level(srv),
+                                config->encryption, out, &streamer))
+   {
+      goto error;
+   }
+
+   // the segments are the unit of parallelism, so a segment is compressed by a single thread
+   if (wi->workers != NULL && streamer->zstd != NULL)
+   {
+      ZSTD_CCtx_setParameter(streamer->zstd, ZSTD_c_nbWorkers, 0);
+      pgmoneta_zstandard_threads_release(streamer->zstd_threads);
+      streamer->zstd_threads = 0;
+   }
+
+   while ((size = fread(buffer, 1, 65536, in)) > 0)
+   {
+      if (pgmoneta_streamer_write(streamer, buffer, size))
+      {
+         goto error;
+      }
+   }
+
+   if (ferror(in) || pgmoneta_streamer_finish(streamer))
+   {
+      goto error;
+   }
+
+   pgmoneta_streamer_destroy(streamer);
+   streamer = NULL;
+
+   fclose(in);
+   in = NULL;
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   pgmoneta_permission(wi->to, 6, 0, 0);
+
+   *((bool*)wi->argument) = true;
+
+   free(wi);
+
+   return;
+
+error:
+
+   pgmoneta_streamer_destroy(streamer);
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (pgmoneta_exists(wi->to))
+   {
+      pgmoneta_delete_file(wi->to, NULL);
+   }
+
+   if (wi->workers != NULL)
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static char*
+wal_prealloc_directory(char* root)
+{
+   char* pool = NULL;
+
+   pool = pgmoneta_append(pool, root);
+   if (!pgmoneta_ends_with(pool, "/"))
+   {
+      pool = pgmoneta_append(pool, "/");
+   }
+   pool = pgmoneta_append(pool, WAL_PREALLOC_DIRECTORY);
+
+   return pool;
+}
+
+static bool
+wal_prealloc_take(char* pool, char* path, int segsize)
+{
+   char* from = NULL;
+   char number[MISC_LENGTH];
+   bool taken = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; !taken && i < config->wal_prealloc; i++)
+   {
+      memset(&number[0], 0, sizeof(number));
+      snprintf(&number[0], sizeof(number), "%d", i);
+
+      from = pgmoneta_append(from, pool);
+      from = pgmoneta_append(from, &number[0]);
+
+      if (pgmoneta_exists(from))
+      {
+         if (pgmoneta_get_file_size(from) != (size_t)segsize)
+         {
+            pgmoneta_delete_file(from, NULL);
+         }
+         else if (rename(from, path) == 0)
+         {
+            taken = true;
+         }
+      }
+
+      free(from);
+      from = NULL;
+   }
+
+   return taken;
+}
+
+static char*
+wal_file_name(uint32_t timeline, size_t segno, int segsize)
+{
+   char hex[128];
+   char* f = NULL;
+
+   memset(&hex[0], 0, sizeof(hex));
+   int segments_per_id = 0x100000000ULL / segsize;
+   int seg_id = segno / segments_per_id;
+   int seg_offset = segno % segments_per_id;
+
+   snprintf(&hex[0], sizeof(hex), "%08X%08X%08X", timeline, seg_id, seg_offset);
+   f = pgmoneta_append(f, hex);
+   return f;
+}
+
+static int
+wal_fetch_history(char* basedir, int timeline, SSL* ssl, int socket)
+{
+   struct message* timeline_history_msg = NULL;
+   struct query_response* timeline_history_response = NULL;
+   FILE* history_file = NULL;
+   char* history_content = NULL;
+   char path[MAX_PATH];
+
+   if (basedir == NULL || strlen(basedir) == 0 || !pgmoneta_exists(basedir))
+   {
+      pgmoneta_log_error("base directory for history file does not exist");
+      goto error;
+   }
+
+   memset(path, 0, sizeof(path));
+   snprintf(path, sizeof(path), "%s%s%08X.history", basedir, pgmoneta_ends_with(basedir, "/") ? "" : "/", timeline);
+
+   // do nothing if the corresponding .history already exists, or current timeline is 1
+   if (timeline == 1 || pgmoneta_exists(path))
+   {
+      return 0;
+   }
+
+   pgmoneta_create_timeline_history_message(timeline, &timeline_history_msg);
+   if (pgmoneta_query_execute(ssl, socket, timeline_history_msg, &timeline_history_response))
+   {
+      pgmoneta_log_error("Error occurred when executing TIMELINE_HISTORY %d", timeline);
+      goto error;
+   }
+
+   history_content = pgmoneta_query_response_get_data(timeline_history_response, 1);
+
+   history_file = fopen(path, "wb");
+   if (history_file == NULL)
+   {
+      goto error;
+   }
+   fwrite(history_content, 1, strlen(history_content) + 1, history_file);
+   fflush(history_file);
+
+   pgmoneta_free_message(timeline_history_msg);
+   pgmoneta_free_query_response(timeline_history_response);
+   if (history_file != NULL)
+   {
+      fclose(history_file);
+   }
+   return 0;
+
+error:
+   pgmoneta_free_message(timeline_history_msg);
+   pgmoneta_free_query_response(timeline_history_response);
+   if (history_file != NULL)
+   {
+      fclose(history_file);
+   }
+   return 1;
+}
+
+static FILE*
+wal_open(char* root, char* pool, char* filename, int segsize)
+{
+   if (root == NULL || strlen(root) == 0 || !pgmoneta_exists(root))
+   {
+      return NULL;
+   }
+   char* path = NULL;
+   FILE* file = NULL;
+   path = pgmoneta_append(path, root);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+
+   path = pgmoneta_append(path, filename);
+   path = pgmoneta_append(path, ".partial");
+
+   if (pgmoneta_exists(path))
+   {
+      // file alreay exists, check if it's padded already
+      size_t size = pgmoneta_get_file_size(path);
+      if (size == (size_t)segsize)
+      {
+         file = fopen(path, "r+b");
+         if (file == NULL)
+         {
+            pgmoneta_log_error("WAL error: %s", strerror(errno));
+            errno = 0;
+            goto error;
+         }
+         pgmoneta_permission(path, 6, 0, 0);
+         PGMONETA_PROBE1(file__open, filename);
+
+         free(path);
+         return file;
+      }
+      if (size != 0)
+      {
+         // corrupted file
+         pgmoneta_log_error("WAL file corrupted: %s", path);
+         goto error;
+      }
+   }
+
+   // a ready segment from the pool only costs a rename
+   if (pool != NULL && wal_prealloc_take(pool, path, segsize))
+   {
+      file = fopen(path, "r+b");
+      if (file == NULL)
+      {
+         pgmoneta_log_error("WAL error: %s", strerror(errno));
+         errno = 0;
+         goto error;
+      }
+      pgmoneta_permission(path, 6, 0, 0);
+      PGMONETA_PROBE1(file__open, filename);
+
+      free(path);
+      return file;
+   }
+
+   file = fopen(path, "wb");
+
+   if (file == NULL)
+   {
+      pgmoneta_log_error("WAL error: %s", strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   if (wal_prepare(file, segsize))
+   {
+      goto error;
+   }
+
+   pgmoneta_permission(path, 6, 0, 0);
+   PGMONETA_PROBE1(file__open, filename);
+
+   free(path);
+   return file;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   free(path);
+   return NULL;
+}
+
+static int
+wal_close(char* root, char* filename, bool partial, FILE* file)
+{
+   if (file == NULL || root == NULL || filename == NULL || strlen(root) == 0 || strlen(filename) == 0)
+   {
+      return 1;
+   }
+   char tmp_file_path[MAX_PATH] = {0};
+   char file_path[MAX_PATH] = {0};
+
+   PGMONETA_PROBE1(file__close, filename);
+
+   if (partial)
+   {
+      pgmoneta_log_info("Not renaming %s.partial, this segment is incomplete", filename);
+      fclose(file);
+      return 0;
+   }
+
+   if (pgmoneta_ends_with(root, "/"))
+   {
+      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s%s.partial", root, filename);
+      snprintf(file_path, sizeof(file_path), "%s%s", root, filename);
+   }
+   else
+   {
+      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s/%s.partial", root, filename);
+      snprintf(file_path, sizeof(file_path), "%s/%s", root, filename);
+   }
+   if (wal_sync(file))
+   {
+      pgmoneta_log_error("could not sync file %s", tmp_file_path);
+      goto error;
+   }
+
+   if (rename(tmp_file_path, file_path) != 0)
+   {
+      pgmoneta_log_error("could not rename file %s to %s", tmp_file_path, file_path);
+      goto error;
+   }
+
+   fclose(file);
+
+   return 0;
+
+error:
+   fclose(file);
+   return 1;
+}
+
+static FILE*
+wal_stream_open(int srv, char* root, char* filename, struct streamer** streamer)
+{
+   char* suffix = NULL;
+   char* path = NULL;
+   char* raw = NULL;
+   FILE* file = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *streamer = NULL;
+
+   if (root == NULL || strlen(root) == 0 || !pgmoneta_exists(root))
+   {
+      return NULL;
+   }
+
+   suffix = pgmoneta_streamer_suffix(pgmoneta_get_wal_compression(srv), config->encryption);
+
+   path = pgmoneta_append(path, root);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   raw = pgmoneta_append(raw, path);
+
+   path = pgmoneta_append(path, filename);
+   path = pgmoneta_append(path, suffix);
+   path = pgmoneta_append(path, ".partial");
+
+   raw = pgmoneta_append(raw, filename);
+   raw = pgmoneta_append(raw, ".partial");
+
+   // the segment is streamed from its start, so an earlier raw partial file is stale
+   if (pgmoneta_exists(raw))
+   {
+      pgmoneta_delete_file(raw, NULL);
+   }
+
+   file = fopen(path, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("WAL error: %s", strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   if (pgmoneta_streamer_create(pgmoneta_get_wal_compression(srv), pgmoneta_get_wal_compression_level(srv), config->encryption, file, streamer))
+   {
+      goto error;
+   }
+
+   pgmoneta_permission(path, 6, 0, 0);
+
+   free(suffix);
+   free(raw);
+   free(path);
+   return file;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   free(suffix);
+   free(raw);
+   free(path);
+   return NULL;
+}
+
+static int
+wal_stream_close(int srv, char* root, char* filename, bool partial, FILE* file, struct streamer* streamer)
+{
+   char* suffix = NULL;
+   char* name = NULL;
+   int ret;
+   struct timespec start_t;
+   struct walinventory_stamp stamp;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   pgmoneta_walinventory_begin(srv, &stamp);
+
+   if (streamer == NULL)
+   {
+      ret = wal_close(root, filename, partial, file);
+      if (!ret && !partial)
+      {
+         pgmoneta_prometheus_wal_latency(srv, PROMETHEUS_WAL_CLOSE, wal_elapsed(start_t));
+         wal_segment_metrics(srv, root, filename);
+         wal_segment_index(srv, root, filename);
+         pgmoneta_walinventory_update(srv, &stamp, 1, &filename, 0, NULL);
+         wal_segment_notify(srv);
+      }
+      return ret;
+   }
+
+   // the compressed stream is finished even for an incomplete segment, so the partial file remains readable
+   if (pgmoneta_streamer_finish(streamer))
+   {
+      pgmoneta_log_error("Could not finish WAL segment %s", filename);
+   }
+
+   // the suffix follows the settings the segment was opened with, which a reload may have changed
+   suffix = pgmoneta_streamer_suffix(streamer->compression, streamer->encryption);
+   pgmoneta_streamer_destroy(streamer);
+
+   if (filename == NULL)
+   {
+      free(suffix);
+      if (file != NULL)
+      {
+         fclose(file);
+      }
+      return 1;
+   }
+
+   name = pgmoneta_append(name, filename);
+   name = pgmoneta_append(name, suffix);
+
+   ret = wal_close(root, name, partial, file);
+   if (!ret && !partial)
+   {
+      pgmoneta_prometheus_wal_latency(srv, PROMETHEUS_WAL_CLOSE, wal_elapsed(start_t));
+      wal_segment_metrics(srv, root, name);
+      wal_segment_index(srv, root, name);
+      pgmoneta_walinventory_update(srv, &stamp, 1, &name, 0, NULL);
+      wal_segment_notify(srv);
+   }
+
+   free(suffix);
+   free(name);
+
+   return ret;
+}
+
+static void
+wal_segment_metrics(int srv, char* root, char* filename)
+{
+   char path[MAX_PATH];
+
+   memset(&path[0], 0, sizeof(path));
+   snprintf(&path[0], sizeof(path), "%s%s%s", root, pgmoneta_ends_with(root, "/") ? "" : "/", filename);
+
+   pgmoneta_prometheus_wal_segment(srv, pgmoneta_get_file_size(&path[0]));
+}
+
+static void
+wal_segment_index(int srv, char* root, char* filename)
+{
+   char path[MAX_PATH];
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!config->wal_index)
+   {
+      return;
+   }
+
+   memset(&path[0], 0, sizeof(path));
+   snprintf(&path[0], sizeof(path), "%s%s%s", root, pgmoneta_ends_with(root, "/") ? "" : "/", filename);
+
+   if (pgmoneta_walindex_create(srv, &path[0]))
+   {
+      pgmoneta_log_warn("Could not index WAL segment %s", filename);
+   }
+}
+
+static void
+wal_segment_notify(int srv)
+{
+   pid_t pid;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // the main process picks the segment up for the post-processing, instead of waiting for its periodic run
+   atomic_store(&config->states[srv].wal_pending, true);
+
+   pid = (pid_t)atomic_load(&config->wal_notify);
+   if (pid > 0 && kill(pid, SIGUSR1))
+   {
+      pgmoneta_log_debug("Could not notify the main process of a closed WAL segment: %s", strerror(errno));
+   }
+}
+
+static size_t
+wal_write(int srv, FILE* file, struct streamer* streamer, void* data, size_t size)
+{
+   size_t written;
+   struct timespec start_t;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   if (streamer != NULL)
+   {
+      if (pgmoneta_streamer_write(streamer, data, size))
+      {
+         return 0;
+      }
+
+      written = size;
+   }
+   else
+   {
+      written = fwrite(data, 1, size, file);
+   }
+
+   pgmoneta_prometheus_wal_latency(srv, PROMETHEUS_WAL_WRITE, wal_elapsed(start_t));
+
+   return written;
+}
+
+static void
+wal_received(struct wal_receiver* r, size_t bytes)
+{
+   int64_t now;
+
+   pgmoneta_prometheus_wal_received(r->srv, bytes);
+
+   now = pgmoneta_get_current_timestamp();
+   r->rate_bytes += bytes;
+
+   if (r->rate_start == 0)
+   {
+      r->rate_start = now;
+   }
+   else if (now - r->rate_start >= WAL_RATE_INTERVAL)
+   {
+      pgmoneta_prometheus_wal_rate(r->srv, (uint64_t)(r->rate_bytes * 1000000.0 / (now - r->rate_start)));
+      r->rate_start = now;
+      r->rate_bytes = 0;
+   }
+}
+
+static double
+wal_elapsed(struct timespec start_t)
+{
+   struct timespec end_t;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   return pgmoneta_compute_duration(start_t, end_t);
+}
+
+static int
+wal_prepare(FILE* file, int segsize)
+{
+   char buffer[8192] = {0};
+   size_t written = 0;
+
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+#if defined(HAVE_LINUX)
+   // allocate the blocks up front, and fall back to zero-filling when the file system cannot
+   if (posix_fallocate(fileno(file), 0, segsize) == 0)
+   {
+      written = segsize;
+   }
+#endif
+
+   while (written < (size_t)segsize)
+   {
+      written += fwrite(buffer, 1, sizeof(buffer), file);
+   }
+
+   fflush(file);
+   if (fseek(file, 0, SEEK_SET) != 0)
+   {
+      pgmoneta_log_error("WAL error: %s", strerror(errno));
+      errno = 0;
+      return 1;
+   }
+   return 0;
+}
+
+static int
+wal_send_status_report(SSL* ssl, int socket, int64_t received, int64_t flushed, int64_t applied)
+{
+   struct message* status_report_msg = NULL;
+   pgmoneta_create_standby_status_update_message(received, flushed, applied, &status_report_msg);
+
+   if (pgmoneta_write_message(ssl, socket, status_report_msg) != MESSAGE_STATUS_OK)
+   {
+      goto error;
+   }
+   pgmoneta_free_message(status_report_msg);
+   return 0;
+
+error:
+   pgmoneta_free_message(status_report_msg);
+   return 1;
+}
+
+static void
+wal_feedback_init(struct wal_feedback* feedback, int64_t position)
+{
+   feedback->received = position;
+   feedback->flushed = position;
+   feedback->reported = position;
+   feedback->last = pgmoneta_get_current_timestamp();
+}
+
+static int
+wal_feedback(int srv, SSL* ssl, int socket, struct wal_feedback* feedback, FILE* file, bool force)
+{
+   int64_t now;
+   bool interval;
+   struct timespec start_t;
+
+   now = pgmoneta_get_current_timestamp();
+   interval = now - feedback->last >= WAL_FEEDBACK_INTERVAL;
+
+   if (!force && !interval && feedback->received - feedback->reported < WAL_FEEDBACK_BYTES)
+   {
+      return 0;
+   }
+
+   // only sync the open segment on the interval, a byte triggered report just advances the received position
+   if (interval && file != NULL && feedback->flushed < feedback->received)
+   {
+      clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+      if (!wal_sync(file))
+      {
+         pgmoneta_prometheus_wal_latency(srv, PROMETHEUS_WAL_FLUSH, wal_elapsed(start_t));
+         feedback->flushed = feedback->received;
+      }
+   }
+
+   if (wal_send_status_report(ssl, socket, feedback->received, feedback->flushed, 0))
+   {
+      return 1;
+   }
+
+   feedback->reported = feedback->received;
+   feedback->last = now;
+
+   return 0;
+}
+
+static int
+wal_sync(FILE* file)
+{
+   if (fflush(file) != 0)
+   {
+      return 1;
+   }
+
+   if (fsync(fileno(file)) != 0)
+   {
+      pgmoneta_log_error("WAL error: %s", strerror(errno));
+      errno = 0;
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+wal_xlog_offset(size_t xlogptr, int segsize)
+{
+   // this function assumes that segsize is a power of 2
+   return xlogptr & (segsize - 1);
+}
+
+static int
+wal_convert_xlogpos(char* xlogpos, int segsize, uint32_t* high32, uint32_t* low32)
+{
+   char* ptr = NULL;
+   int num = 0;
+   if (xlogpos == NULL || !pgmoneta_contains(xlogpos, "/"))
+   {
+      pgmoneta_log_error("WAL unable to convert xlogpos");
+      return 1;
+   }
+   ptr = strtok(xlogpos, "/");
+   sscanf(ptr, "%x", &num);
+   *high32 = num;
+
+   ptr = strtok(NULL, "/");
+   sscanf(ptr, "%x", &num);
+   // discard in-segment offset
+   *low32 = num & (~(segsize - 1));
+   return 0;
+}
+
+// this function assumes basedir only contains wal segments and .history files
+static int
+wal_find_streaming_start(char* basedir, int segsize, uint32_t* timeline, uint32_t* high32, uint32_t* low32)
+{
+   char* segname = NULL;
+   char* pos = NULL;
+   DIR* dir;
+   struct dirent* entry;
+   bool high_is_partial = false;
+   bool is_partial = false;
+
+   dir = opendir(basedir);
+
+   if (dir == NULL)
+   {
+      pgmoneta_log_error("Could not open wal base directory %s", basedir);
+      goto error;
+   }
+
+   // read the wal directory, get the latest wal segment
+   while ((entry = readdir(dir)) != NULL)
+   {
+      // we only care about files
+      if (entry->d_type != DT_REG)
+      {
+         continue;
+      }
+      // ignore history files here
+      if (pgmoneta_ends_with(entry->d_name, ".history"))
+      {
+         continue;
+      }
+      // find the latest wal segments
+      // By latest we mean it has a larger xlogpos. If the xlogpos is the same(unlikely),
+      // the one that's not partial is more up-to-date
+      is_partial = pgmoneta_ends_with(entry->d_name, ".partial");
+      if (segname == NULL || strcmp(entry->d_name, segname) > 0 || (strcmp(entry->d_name, segname) == 0 && !is_partial))
+      {
+         segname = entry->d_name;
+         high_is_partial = is_partial;
+      }
+   }
+   if (segname == NULL)
+   {
+      *timeline = 0;
+      *high32 = 0;
+      *low32 = 0;
+      closedir(dir);
+      return 0;
+   }
+
+   // remove the suffix
+   pos = strtok(segname, ".");
+   wal_streaming_position(pos, high_is_partial, segsize, timeline, high32, low32);
+
+   closedir(dir);
+   return 0;
+
+error:
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+   return 1;
+}
+
+static void
+wal_streaming_position(char* segment, bool partial, int segsize, uint32_t* timeline, uint32_t* high32, uint32_t* low32)
+{
+   sscanf(segment, "%08X%08X%08X", timeline, high32, low32);
+
+   // high32 is the segment id, low32 is the number of segments
+   int segments_per_id = 0x100000000ULL / segsize;
+   // if the latest wal segment is partial, we start with this one
+   // otherwise we start with the next one
+   if (!partial)
+   {
+      // handle possible overflow
+      if (*low32 == (uint32_t)segments_per_id)
+      {
+         *low32 = 0;
+         *high32 = *high32 + 1;
+      }
+      else
+      {
+         *low32 = *low32 + 1;
+      }
+   }
+   *low32 *= segsize;
+}
+
+static void
+wal_state_write(struct wal_receiver* r, bool partial)
+{
+   struct wal_state state;
+   char* path = NULL;
+   char* tmp = NULL;
+   FILE* file = NULL;
+
+   memset(&state, 0, sizeof(struct wal_state));
+   memcpy(state.magic, WAL_STATE_MAGIC, sizeof(state.magic));
+   state.version = WAL_STATE_VERSION;
+   state.segsize = (uint32_t)r->segsize;
+   state.flushed = r->feedback.flushed;
+   snprintf(state.segment, sizeof(state.segment), "%s", r->filename);
+   state.partial = partial ? 1 : 0;
+
+   path = pgmoneta_get_server(r->srv);
+   path = pgmoneta_append(path, WAL_STATE_FILE);
+   tmp = pgmoneta_append(tmp, path);
+   tmp = pgmoneta_append(tmp, ".tmp");
+
+   file = fopen(tmp, "w");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fwrite(&state, sizeof(struct wal_state), 1, file) != 1 || fflush(file) || fsync(fileno(file)))
+   {
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (rename(tmp, path))
+   {
+      goto error;
+   }
+
+   free(path);
+   free(tmp);
+   return;
+
+error:
+   // the state is an optimization, the WAL directory is read instead
+   pgmoneta_log_debug("Could not write the WAL state %s: %s", path, strerror(errno));
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   if (tmp != NULL)
+   {
+      unlink(tmp);
+   }
+   free(path);
+   free(tmp);
 }
 
 static int
-wal_read_replication_slot(SSL* ssl, int socket, char* slot, char* name, int segsize, uint32_t* high32, uint32_t* low32, uint32_t* timeline)
+wal_state_read(struct wal_receiver* r)
 {
-   struct message* read_slot_msg = NULL;
-   struct query_response* read_slot_response = NULL;
-   char* lsn = NULL;
-   int status = 0;
-   uint32_t tli = 0;
+   struct configuration* config;
+   struct wal_state state;
+   uint32_t timeline = 0;
+   uint32_t high32 = 0;
+   uint32_t low32 = 0;
+   uint64_t segno = 0;
+   bool partial = false;
+   bool next_partial = false;
+   char* path = NULL;
+   char* next = NULL;
+   FILE* file = NULL;
 
-   *high32 = 0;
-   *low32 = 0;
-   *timeline = 0;
+   config = (struct configuration*)shmem;
 
-   pgmoneta_create_read_replication_slot_message(slot, &read_slot_msg);
-   status = pgmoneta_query_execute(ssl, socket, read_slot_msg, &read_slot_response);
+   path = pgmoneta_get_server(r->srv);
+   path = pgmoneta_append(path, WAL_STATE_FILE);
 
-   if (status != 0)
+   file = fopen(path, "r");
+   if (file == NULL)
    {
-      pgmoneta_log_debug("Error occurred when executing READ_REPLICATION_SLOT for slot %s on server %s", slot, name);
       goto error;
    }
 
-   if (read_slot_response == NULL || read_slot_response->number_of_columns < 3)
+   if (fread(&state, sizeof(struct wal_state), 1, file) != 1 ||
+       memcmp(state.magic, WAL_STATE_MAGIC, sizeof(state.magic)) ||
+       state.version != WAL_STATE_VERSION ||
+       state.segsize != r->segsize)
    {
-      pgmoneta_log_debug("Invalid response from READ_REPLICATION_SLOT for slot %s on server %s", slot, name);
+      pgmoneta_log_debug("Invalid WAL state %s", path);
       goto error;
    }
+   state.segment[sizeof(state.segment) - 1] = '\0';
 
-   tli = pgmoneta_atoi(pgmoneta_query_response_get_data(read_slot_response, 2));
-   if (tli < 1)
+   if (sscanf(state.segment, "%08X%08X%08X", &timeline, &high32, &low32) != 3)
    {
-      pgmoneta_log_debug("wal_read_replication_slot: timeline is %d, expecting 1 for server %s", tli, name);
+      pgmoneta_log_debug("Invalid WAL state segment %s", state.segment);
       goto error;
    }
 
-   lsn = pgmoneta_query_response_get_data(read_slot_response, 1);
-   if (wal_convert_xlogpos(lsn, segsize, high32, low32))
+   // the recorded segment must be the tail of the directory
+   if (wal_state_probe(r, state.segment, &partial))
    {
-      pgmoneta_log_debug("wal_read_replication_slot: failed to convert LSN from replication slot %s on server %s", slot, name);
+      pgmoneta_log_debug("WAL state segment %s not found", state.segment);
       goto error;
    }
 
-   *timeline = tli;
+   segno = (uint64_t)high32 * (0x100000000ULL / r->segsize) + low32;
+   next = wal_file_name(timeline, segno + 1, r->segsize);
+   if (!wal_state_probe(r, next, &next_partial))
+   {
+      pgmoneta_log_debug("WAL state segment %s is behind %s", state.segment, next);
+      goto error;
+   }
 
-   pgmoneta_free_query_response(read_slot_response);
-   pgmoneta_free_message(read_slot_msg);
+   wal_streaming_position(state.segment, partial, r->segsize, &r->timeline, &r->high32, &r->low32);
 
+   pgmoneta_log_debug("WAL state %s: %s%s flushed %X/%X", config->servers[r->srv].name, state.segment,
+                      partial ? ".partial" : "", (uint32_t)(state.flushed >> 32), (uint32_t)state.flushed);
+
+   fclose(file);
+   free(path);
+   free(next);
    return 0;
 
 error:
-   pgmoneta_free_query_response(read_slot_response);
-   pgmoneta_free_message(read_slot_msg);
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   free(path);
+   free(next);
    return 1;
 }
 
-static void
-update_wal_lsn(int srv, size_t xlogptr)
-{
-   struct configuration* config = (struct configuration*) shmem;
-   uint32_t low32 = xlogptr & 0xffffffff;
-   uint32_t high32 = xlogptr >> 32 & 0xffffffff;
-   memset(config->servers[srv].current_wal_lsn, 0, MISC_LENGTH);
-   snprintf(config->servers[srv].current_wal_lsn, MISC_LENGTH, "%X/%X", high32, low32);
-}
-
-int
-pgmoneta_get_timeline_history(int srv, uint32_t tli, struct timeline_history** history)
+static int
+wal_state_probe(struct wal_receiver* r, char* segment, bool* partial)
 {
-   struct timeline_history* h = NULL;
-   struct timeline_history* curh = NULL;
-   struct timeline_history* nexth = NULL;
-   char filename[MISC_LENGTH];
+   struct configuration* config;
+   char* suffix = NULL;
+   char* names[2] = {NULL, NULL};
    char* path = NULL;
-   char buffer[MAX_PATH];
-   int numfields = 0;
-   FILE* file = NULL;
+   int found = 1;
 
-   if (tli == 1)
-   {
-      return 0;
-   }
+   config = (struct configuration*)shmem;
 
-   snprintf(filename, sizeof(filename), "%08X.history", tli);
-   path = pgmoneta_get_server_wal(srv);
-   path = pgmoneta_append(path, filename);
-   file = fopen(path, "r");
-   if (file == NULL)
-   {
-      pgmoneta_log_error("Unable to open history file: %s", strerror(errno));
-      goto error;
-   }
-   memset(buffer, 0, sizeof(buffer));
-   while (fgets(buffer, sizeof(buffer), file) != NULL)
+   *partial = false;
+
+   suffix = pgmoneta_streamer_suffix(pgmoneta_get_wal_compression(r->srv), config->encryption);
+
+   names[0] = pgmoneta_append(names[0], segment);
+   names[1] = pgmoneta_append(names[1], segment);
+   names[1] = pgmoneta_append(names[1], suffix);
+
+   // a complete segment wins over a partial one of the same name
+   for (int i = 0; i < 2 && found; i++)
    {
-      char* ptr = buffer;
-      // ignore empty spaces
-      while (*ptr != '\0' && isspace(*ptr))
-      {
-         ptr++;
-      }
-      // ignore empty lines and comments
-      if (*ptr == '\0' || *ptr == '#')
+      path = pgmoneta_append(path, r->d);
+      if (!pgmoneta_ends_with(path, "/"))
       {
-         continue;
+         path = pgmoneta_append(path, "/");
       }
-      nexth = (struct timeline_history*) malloc(sizeof(struct timeline_history));
+      path = pgmoneta_append(path, names[i]);
 
-      if (nexth == NULL)
+      if (pgmoneta_exists(path))
       {
-         goto error;
+         found = 0;
       }
 
-      memset(nexth, 0, sizeof(struct timeline_history));
-      if (h == NULL)
-      {
-         curh = nexth;
-         h = curh;
-      }
-      else
+      free(path);
+      path = NULL;
+   }
+
+   for (int i = 0; i < 2 && found; i++)
+   {
+      path = pgmoneta_append(path, r->d);
+      if (!pgmoneta_ends_with(path, "/"))
       {
-         curh->next = nexth;
-         curh = curh->next;
+         path = pgmoneta_append(path, "/");
       }
-      numfields = sscanf(ptr, "%u\t%X/%X", &curh->parent_tli, &curh->switchpos_hi, &curh->switchpos_lo);
-      if (numfields != 3)
+      path = pgmoneta_append(path, names[i]);
+      path = pgmoneta_append(path, ".partial");
+
+      if (pgmoneta_exists(path))
       {
-         pgmoneta_log_error("error parsing history file %s", filename);
-         goto error;
+         *partial = true;
+         found = 0;
       }
-      memset(buffer, 0, sizeof(buffer));
+
+      free(path);
+      path = NULL;
    }
 
-   *history = h;
+   free(names[0]);
+   free(names[1]);
+   free(suffix);
 
-   free(path);
-   if (file != NULL)
+   return found;
+}
+
+static void
+wal_resume(struct wal_receiver* r)
+{
+   uint64_t start;
+   char* filename = NULL;
+   char* path = NULL;
+
+   // a compressed segment can not be appended to, and the sinks need the segment from its start
+   if (r->stream_compression || (r->fanout != NULL && r->fanout->number_of_sinks > 0))
    {
-      fclose(file);
+      return;
    }
-   return 0;
 
-error:
-   free(path);
-   if (file != NULL)
+   start = ((uint64_t)r->high32 << 32) | r->low32;
+   filename = wal_file_name(r->timeline, start / r->segsize, r->segsize);
+
+   path = pgmoneta_append(path, r->d);
+   if (!pgmoneta_ends_with(path, "/"))
    {
-      fclose(file);
+      path = pgmoneta_append(path, "/");
    }
-   pgmoneta_free_timeline_history(h);
-   return 1;
-}
+   path = pgmoneta_append(path, filename);
+   path = pgmoneta_append(path, ".partial");
 
-void
-pgmoneta_free_timeline_history(struct timeline_history* history)
-{
-   struct timeline_history* h = history;
-   while (h != NULL)
+   if (pgmoneta_exists(path))
    {
-      struct timeline_history* next = h->next;
-      free(h);
-      h = next;
-   }
-}
+      r->resume = wal_resume_offset(path, start, r->segsize);
 
-static char*
-wal_file_name(uint32_t timeline, size_t segno, int segsize)
-{
-   char hex[128];
-   char* f = NULL;
+      if (r->resume > 0)
+      {
+         start += r->resume;
+         r->high32 = (uint32_t)(start >> 32);
+         r->low32 = (uint32_t)start;
 
-   memset(&hex[0], 0, sizeof(hex));
-   int segments_per_id = 0x100000000ULL / segsize;
-   int seg_id = segno / segments_per_id;
-   int seg_offset = segno % segments_per_id;
+         pgmoneta_log_info("Resuming WAL segment %s at %X/%X", filename, r->high32, r->low32);
+      }
+   }
 
-   snprintf(&hex[0], sizeof(hex), "%08X%08X%08X", timeline, seg_id, seg_offset);
-   f = pgmoneta_append(f, hex);
-   return f;
+   free(filename);
+   free(path);
 }
 
-static int
-wal_fetch_history(char* basedir, int timeline, SSL* ssl, int socket)
+static size_t
+wal_resume_offset(char* path, uint64_t start, size_t segsize)
 {
-   struct message* timeline_history_msg = NULL;
-   struct query_response* timeline_history_response = NULL;
-   FILE* history_file = NULL;
-   char* history_content = NULL;
-   char path[MAX_PATH];
-
-   if (basedir == NULL || strlen(basedir) == 0 || !pgmoneta_exists(basedir))
-   {
-      pgmoneta_log_error("base directory for history file does not exist");
-      goto error;
-   }
+   int fd = -1;
+   char* data = MAP_FAILED;
+   char* record = NULL;
+   size_t pos = 0;
+   size_t valid = 0;
+   size_t blcksz;
+   size_t length;
+   uint16_t magic;
+   uint32_t crc;
+   struct stat st;
+   struct xlog_long_page_header_data header;
+   struct xlog_record hdr;
 
-   memset(path, 0, sizeof(path));
-   if (pgmoneta_ends_with(basedir, "/"))
+   fd = open(path, O_RDONLY);
+   if (fd == -1 || fstat(fd, &st) == -1 || (size_t)st.st_size != segsize)
    {
-      snprintf(path, sizeof(path), "%s%08x.history", basedir, timeline);
+      goto done;
    }
 
-   // do nothing if the corresponding .history already exists, or current timeline is 1
-   if (timeline == 1 || pgmoneta_exists(path))
+   data = mmap(NULL, segsize, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (data == MAP_FAILED)
    {
-      return 0;
+      goto done;
    }
 
-   pgmoneta_create_timeline_history_message(timeline, &timeline_history_msg);
-   if (pgmoneta_query_execute(ssl, socket, timeline_history_msg, &timeline_history_response))
-   {
-      pgmoneta_log_error("Error occurred when executing TIMELINE_HISTORY %d", timeline);
-      goto error;
-   }
+   memcpy(&header, data, sizeof(struct xlog_long_page_header_data));
 
-   history_content = pgmoneta_query_response_get_data(timeline_history_response, 1);
+   magic = header.std.xlp_magic;
+   blcksz = header.xlp_xlog_blcksz;
 
-   history_file = fopen(path, "wb");
-   if (history_file == NULL)
+   if (magic == 0 || !(header.std.xlp_info & XLP_LONG_HEADER) || header.std.xlp_pageaddr != start ||
+       header.xlp_seg_size != segsize || blcksz < 1024 || blcksz > 65536 ||
+       (blcksz & (blcksz - 1)) != 0 || segsize % blcksz != 0)
    {
-      goto error;
+      goto done;
    }
-   fwrite(history_content, 1, strlen(history_content) + 1, history_file);
-   fflush(history_file);
 
-   pgmoneta_free_message(timeline_history_msg);
-   pgmoneta_free_query_response(timeline_history_response);
-   if (history_file != NULL)
+   // the end of a record that started in the previous segment can only be skipped
+   if (header.std.xlp_info & XLP_FIRST_IS_CONTRECORD)
    {
-      fclose(history_file);
+      if (wal_resume_copy(data, segsize, blcksz, magic, start, &pos, NULL, header.std.xlp_rem_len))
+      {
+         goto done;
+      }
+      pos = MAXALIGN(pos);
    }
-   return 0;
 
-error:
-   pgmoneta_free_message(timeline_history_msg);
-   pgmoneta_free_query_response(timeline_history_response);
-   if (history_file != NULL)
+   // the records are checked against their CRC, and the first one that fails ends the valid part
+   while (pos < segsize)
    {
-      fclose(history_file);
-   }
-   return 1;
-}
+      if (wal_resume_copy(data, segsize, blcksz, magic, start, &pos, (char*)&hdr, SIZE_OF_XLOG_RECORD))
+      {
+         break;
+      }
 
-static FILE*
-wal_open(char* root, char* filename, int segsize)
-{
-   if (root == NULL || strlen(root) == 0 || !pgmoneta_exists(root))
-   {
-      return NULL;
-   }
-   char* path = NULL;
-   FILE* file = NULL;
-   path = pgmoneta_append(path, root);
-   if (!pgmoneta_ends_with(path, "/"))
-   {
-      path = pgmoneta_append(path, "/");
-   }
+      if (hdr.xl_tot_len < SIZE_OF_XLOG_RECORD || hdr.xl_tot_len - SIZE_OF_XLOG_RECORD > segsize)
+      {
+         break;
+      }
 
-   path = pgmoneta_append(path, filename);
-   path = pgmoneta_append(path, ".partial");
+      length = hdr.xl_tot_len - SIZE_OF_XLOG_RECORD;
 
-   if (pgmoneta_exists(path))
-   {
-      // file alreay exists, check if it's padded already
-      size_t size = pgmoneta_get_file_size(path);
-      if (size == (size_t)segsize)
+      free(record);
+      record = (char*)malloc(length + 1);
+      if (record == NULL)
       {
-         file = fopen(path, "r+b");
-         if (file == NULL)
-         {
-            pgmoneta_log_error("WAL error: %s", strerror(errno));
-            errno = 0;
-            goto error;
-         }
-         pgmoneta_permission(path, 6, 0, 0);
+         break;
+      }
 
-         free(path);
-         return file;
+      // a record that goes on in the next segment is streamed again
+      if (wal_resume_copy(data, segsize, blcksz, magic, start, &pos, record, length))
+      {
+         break;
       }
-      if (size != 0)
+
+      crc = 0;
+      pgmoneta_create_crc32c_buffer(record, length, &crc);
+      pgmoneta_create_crc32c_buffer(&hdr, offsetof(struct xlog_record, xl_crc), &crc);
+      if (crc != hdr.xl_crc)
       {
-         // corrupted file
-         pgmoneta_log_error("WAL file corrupted: %s", path);
-         goto error;
+         break;
       }
-   }
 
-   file = fopen(path, "wb");
+      pos = MAXALIGN(pos);
+      valid = pos;
+   }
 
-   if (file == NULL)
+done:
+   if (data != MAP_FAILED)
    {
-      pgmoneta_log_error("WAL error: %s", strerror(errno));
-      errno = 0;
-      goto error;
+      munmap(data, segsize);
    }
-
-   if (wal_prepare(file, segsize))
+   if (fd != -1)
    {
-      goto error;
+      close(fd);
    }
+   free(record);
 
-   pgmoneta_permission(path, 6, 0, 0);
+   // a complete segment that was not renamed is streamed again
+   return valid < segsize ? valid : 0;
+}
 
-   free(path);
-   return file;
+static bool
+wal_resume_page(char* data, uint16_t magic, uint64_t start, size_t blcksz, size_t page)
+{
+   struct xlog_page_header_data header;
 
-error:
-   if (file != NULL)
-   {
-      fclose(file);
-   }
-   free(path);
-   return NULL;
+   memcpy(&header, data + page * blcksz, sizeof(struct xlog_page_header_data));
+
+   return header.xlp_magic == magic && header.xlp_pageaddr == start + page * blcksz;
 }
 
 static int
-wal_close(char* root, char* filename, bool partial, FILE* file)
+wal_resume_copy(char* data, size_t segsize, size_t blcksz, uint16_t magic, uint64_t start, size_t* pos, char* to, size_t size)
 {
-   if (file == NULL || root == NULL || filename == NULL || strlen(root) == 0 || strlen(filename) == 0)
+   size_t chunk;
+
+   while (size > 0)
    {
-      return 1;
+      if (*pos % blcksz == 0)
+      {
+         if (*pos >= segsize || !wal_resume_page(data, magic, start, blcksz, *pos / blcksz))
+         {
+            return 1;
+         }
+         *pos += *pos == 0 ? SIZE_OF_XLOG_LONG_PHD : SIZE_OF_XLOG_SHORT_PHD;
+      }
+
+      chunk = blcksz - *pos % blcksz;
+      if (chunk > size)
+      {
+         chunk = size;
+      }
+
+      if (to != NULL)
+      {
+         memcpy(to, data + *pos, chunk);
+         to += chunk;
+      }
+
+      *pos += chunk;
+      size -= chunk;
    }
-   char tmp_file_path[MAX_PATH] = {0};
-   char file_path[MAX_PATH] = {0};
 
-   if (partial)
+   return 0;
+}
+
+static int
+wal_shipping_setup(int srv, char** wal_shipping)
+{
+   char* ws = NULL;
+   ws = pgmoneta_get_server_wal_shipping_wal(srv);
+   if (ws != NULL)
    {
-      pgmoneta_log_info("Not renaming %s.partial, this segment is incomplete", filename);
-      fclose(file);
+      if (pgmoneta_mkdir(ws))
+      {
+         *wal_shipping = NULL;
+         return 1;
+      }
+      *wal_shipping = ws;
       return 0;
    }
+   *wal_shipping = NULL;
+   return 0;
+}
 
-   if (pgmoneta_ends_with(root, "/"))
-   {
-      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s%s.partial", root, filename);
-      snprintf(file_path, sizeof(file_path), "%s%s", root, filename);
-   }
-   else
+static int
+wal_fanout_setup(int srv, char* wal_shipping, struct fanout** fanout)
+{
+   int n;
+   struct fanout* f = NULL;
+   struct fanout_sink* sink = NULL;
+   struct wal_sink* ws = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *fanout = NULL;
+
+   if (pgmoneta_fanout_create(config->wal_fanout_size > 0 ? (size_t)config->wal_fanout_size : 0, &f))
    {
-      snprintf(tmp_file_path, sizeof(tmp_file_path), "%s/%s.partial", root, filename);
-      snprintf(file_path, sizeof(file_path), "%s/%s", root, filename);
+      goto error;
    }
-   if (rename(tmp_file_path, file_path) != 0)
+
+   for (int i = 0; i < 3; i++)
    {
-      pgmoneta_log_error("could not rename file %s to %s", tmp_file_path, file_path);
-      goto error;
+      if ((i == 0 && wal_shipping == NULL) ||
+          (i == 1 && !(config->storage_engine & STORAGE_ENGINE_SSH)) ||
+          (i == 2 && (!config->servers[srv].hot_standby_wal || strlen(config->servers[srv].hot_standby) == 0)))
+      {
+         continue;
+      }
+
+      sink = (struct fanout_sink*)calloc(1, sizeof(struct fanout_sink));
+      ws = (struct wal_sink*)calloc(1, sizeof(struct wal_sink));
+
+      if (sink == NULL || ws == NULL)
+      {
+         goto error;
+      }
+
+      ws->srv = srv;
+      ws->root = wal_shipping;
+
+      sink->data = ws;
+      if (i == 0)
+      {
+         snprintf(&sink->name[0], sizeof(sink->name), "%s", "wal_shipping");
+         sink->open = &wal_shipping_open;
+         sink->write = &wal_shipping_write;
+         sink->close = &wal_shipping_close;
+         sink->lag = &config->states[srv].wal_shipping_lag;
+      }
+      else if (i == 1)
+      {
+         snprintf(&sink->name[0], sizeof(sink->name), "%s", "ssh");
+         sink->open = &wal_ssh_open;
+         sink->write = &wal_ssh_write;
+         sink->close = &wal_ssh_close;
+         sink->lag = &config->states[srv].wal_ssh_lag;
+      }
+      else
+      {
+         // the pg_wal directory of the hot standby, which a standby in it replays from
+         n = snprintf(&ws->path[0], sizeof(ws->path), "%s%s%s/pg_wal/",
+                      config->servers[srv].hot_standby,
+                      pgmoneta_ends_with(config->servers[srv].hot_standby, "/") ? "" : "/",
+                      config->servers[srv].name);
+
+         if (n < 0 || (size_t)n >= sizeof(ws->path))
+         {
+            pgmoneta_log_error("The hot standby directory of %s is too long, not feeding it WAL", config->servers[srv].name);
+            free(sink);
+            free(ws);
+            sink = NULL;
+            ws = NULL;
+            continue;
+         }
+
+         ws->root = &ws->path[0];
+
+         snprintf(&sink->name[0], sizeof(sink->name), "%s", "hot_standby");
+         sink->open = &wal_hot_standby_open;
+         sink->write = &wal_shipping_write;
+         sink->close = &wal_shipping_close;
+      }
+
+      if (pgmoneta_fanout_add(f, sink))
+      {
+         goto error;
+      }
+
+      sink = NULL;
+      ws = NULL;
    }
 
-   fclose(file);
+   *fanout = f;
 
    return 0;
 
 error:
-   fclose(file);
+   free(sink);
+   free(ws);
+   pgmoneta_fanout_destroy(f);
+
    return 1;
 }
 
 static int
-wal_prepare(FILE* file, int segsize)
+wal_shipping_open(struct fanout_sink* sink, char* filename, int segsize)
 {
-   char buffer[8192] = {0};
-   size_t written = 0;
-
-   if (file == NULL)
-   {
-      return 1;
-   }
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
 
-   while (written < (size_t)segsize)
+   // WAL shipping is best effort, so a failure doesn't stop the streaming
+   if ((ws->file = wal_open(ws->root, NULL, filename, segsize)) == NULL)
    {
-      written += fwrite(buffer, 1, sizeof(buffer), file);
+      pgmoneta_log_warn("Could not create or open WAL segment file at %s", ws->root);
    }
 
-   fflush(file);
-   if (fseek(file, 0, SEEK_SET) != 0)
-   {
-      pgmoneta_log_error("WAL error: %s", strerror(errno));
-      errno = 0;
-      return 1;
-   }
    return 0;
 }
 
 static int
-wal_send_status_report(SSL* ssl, int socket, int64_t received, int64_t flushed, int64_t applied)
+wal_shipping_write(struct fanout_sink* sink, void* data, size_t size)
 {
-   struct message* status_report_msg = NULL;
-   pgmoneta_create_standby_status_update_message(received, flushed, applied, &status_report_msg);
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
 
-   if (pgmoneta_write_message(ssl, socket, status_report_msg) != MESSAGE_STATUS_OK)
+   if (ws->file != NULL)
    {
-      goto error;
+      fwrite(data, 1, size, ws->file);
    }
-   pgmoneta_free_message(status_report_msg);
-   return 0;
 
-error:
-   pgmoneta_free_message(status_report_msg);
-   return 1;
+   return 0;
 }
 
 static int
-wal_xlog_offset(size_t xlogptr, int segsize)
+wal_shipping_close(struct fanout_sink* sink, char* filename, bool partial)
 {
-   // this function assumes that segsize is a power of 2
-   return xlogptr & (segsize - 1);
-}
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
 
-static int
-wal_convert_xlogpos(char* xlogpos, int segsize, uint32_t* high32, uint32_t* low32)
-{
-   char* ptr = NULL;
-   int num = 0;
-   if (xlogpos == NULL || !pgmoneta_contains(xlogpos, "/"))
+   if (ws->file != NULL)
    {
-      pgmoneta_log_error("WAL unable to convert xlogpos");
-      return 1;
+      fflush(ws->file);
+      wal_close(ws->root, filename, partial, ws->file);
+      ws->file = NULL;
    }
-   ptr = strtok(xlogpos, "/");
-   sscanf(ptr, "%x", &num);
-   *high32 = num;
 
-   ptr = strtok(NULL, "/");
-   sscanf(ptr, "%x", &num);
-   // discard in-segment offset
-   *low32 = num & (~(segsize - 1));
    return 0;
 }
 
-// this function assumes basedir only contains wal segments and .history files
 static int
-wal_find_streaming_start(char* basedir, int segsize, uint32_t* timeline, uint32_t* high32, uint32_t* low32)
+wal_hot_standby_open(struct fanout_sink* sink, char* filename, int segsize)
 {
-   char* segname = NULL;
-   char* pos = NULL;
-   DIR* dir;
-   struct dirent* entry;
-   bool high_is_partial = false;
-   bool is_partial = false;
-
-   dir = opendir(basedir);
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
 
-   if (dir == NULL)
+   // there is no hot standby until the first backup creates it
+   if (!pgmoneta_exists(ws->root))
    {
-      pgmoneta_log_error("Could not open wal base directory %s", basedir);
-      goto error;
+      ws->file = NULL;
+      return 0;
    }
 
-   // read the wal directory, get the latest wal segment
-   while ((entry = readdir(dir)) != NULL)
-   {
-      // we only care about files
-      if (entry->d_type != DT_REG)
-      {
-         continue;
-      }
-      // ignore history files here
-      if (pgmoneta_ends_with(entry->d_name, ".history"))
-      {
-         continue;
-      }
-      // find the latest wal segments
-      // By latest we mean it has a larger xlogpos. If the xlogpos is the same(unlikely),
-      // the one that's not partial is more up-to-date
-      is_partial = pgmoneta_ends_with(entry->d_name, ".partial");
-      if (segname == NULL || strcmp(entry->d_name, segname) > 0 || (strcmp(entry->d_name, segname) == 0 && !is_partial))
-      {
-         segname = entry->d_name;
-         high_is_partial = is_partial;
-      }
-   }
-   if (segname == NULL)
+   if ((ws->file = wal_open(ws->root, NULL, filename, segsize)) == NULL)
    {
-      *timeline = 0;
-      *high32 = 0;
-      *low32 = 0;
-      closedir(dir);
-      return 0;
+      pgmoneta_log_warn("Could not create or open WAL segment file at %s", ws->root);
    }
 
-   // remove the suffix
-   pos = strtok(segname, ".");
-   sscanf(pos, "%08X%08X%08X", timeline, high32, low32);
+   return 0;
+}
 
-   // high32 is the segment id, low32 is the number of segments
-   int segments_per_id = 0x100000000ULL / segsize;
-   // if the latest wal segment is partial, we start with this one
-   // otherwise we start with the next one
-   if (!high_is_partial)
+static int
+wal_ssh_open(struct fanout_sink* sink, char* filename, int segsize)
+{
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
+
+   if (pgmoneta_sftp_wal_open(ws->srv, filename, segsize, &ws->sftp) == 1)
    {
-      // handle possible overflow
-      if (*low32 == (uint32_t)segments_per_id)
-      {
-         *low32 = 0;
-         *high32 = *high32 + 1;
-      }
-      else
-      {
-         *low32 = *low32 + 1;
-      }
+      pgmoneta_log_error("Could not create or open WAL segment file on remote ssh storage engine");
+      ws->sftp = NULL;
+      return 1;
    }
-   *low32 *= segsize;
 
-   closedir(dir);
    return 0;
+}
 
-error:
-   if (dir != NULL)
+static int
+wal_ssh_write(struct fanout_sink* sink, void* data, size_t size)
+{
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
+
+   if (ws->sftp != NULL)
    {
-      closedir(dir);
+      sftp_write(ws->sftp, data, size);
    }
-   return 1;
+
+   return 0;
 }
 
 static int
-wal_shipping_setup(int srv, char** wal_shipping)
+wal_ssh_close(struct fanout_sink* sink, char* filename, bool partial)
 {
-   char* ws = NULL;
-   ws = pgmoneta_get_server_wal_shipping_wal(srv);
-   if (ws != NULL)
+   struct wal_sink* ws = (struct wal_sink*)sink->data;
+
+   if (ws->sftp != NULL)
    {
-      if (pgmoneta_mkdir(ws))
-      {
-         *wal_shipping = NULL;
-         return 1;
-      }
-      *wal_shipping = ws;
-      return 0;
+      pgmoneta_sftp_wal_close(ws->srv, filename, partial, &ws->sftp);
+      ws->sftp = NULL;
    }
-   *wal_shipping = NULL;
+
    return 0;
 }
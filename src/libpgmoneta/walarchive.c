@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <storage.h>
+#include <streamer.h>
+#include <utils.h>
+#include <wal.h>
+#include <walarchive.h>
+#include <workers.h>
+
+/* system */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WAL_ARCHIVE_MAX_DELAY 60
+
+static struct wal_segment* wal_archive_take(struct wal_archive* archive, time_t* wait);
+static char* wal_archive_path(struct wal_archive* archive, char* filename, char** name);
+static void* wal_archive_run(void* arg);
+
+int
+pgmoneta_wal_archive_create(int srv, char* directory, struct wal_archive** archive)
+{
+   struct wal_archive* a = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *archive = NULL;
+
+   if (!(config->storage_engine & (STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
+   {
+      return 0;
+   }
+
+   a = (struct wal_archive*)calloc(1, sizeof(struct wal_archive));
+   if (a == NULL)
+   {
+      goto error;
+   }
+
+   a->srv = srv;
+   a->directory = pgmoneta_append(NULL, directory);
+
+   if (pgmoneta_storage_backend_create(&a->backend) || a->backend == NULL)
+   {
+      free(a->directory);
+      free(a);
+      goto error;
+   }
+
+   pthread_mutex_init(&a->lock, NULL);
+   pthread_cond_init(&a->pending, NULL);
+
+   atomic_store(&config->states[srv].wal_archive_lag, 0);
+
+   if (pthread_create(&a->thread, NULL, wal_archive_run, a) != 0)
+   {
+      pgmoneta_log_error("WAL archive: Could not start for %s", config->servers[srv].name);
+      pthread_cond_destroy(&a->pending);
+      pthread_mutex_destroy(&a->lock);
+      pgmoneta_storage_backend_destroy(a->backend);
+      free(a->directory);
+      free(a);
+      goto error;
+   }
+
+   *archive = a;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_wal_archive_add(struct wal_archive* archive, char* filename)
+{
+   char* path = NULL;
+   struct wal_segment* segment = NULL;
+   struct wal_segment* dropped = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (archive == NULL)
+   {
+      return 0;
+   }
+
+   segment = (struct wal_segment*)calloc(1, sizeof(struct wal_segment));
+   if (segment == NULL)
+   {
+      goto error;
+   }
+
+   snprintf(&segment->filename[0], sizeof(segment->filename), "%s", filename);
+
+   path = wal_archive_path(archive, filename, NULL);
+   if (path != NULL)
+   {
+      segment->size = pgmoneta_get_file_size(path);
+   }
+
+   pthread_mutex_lock(&archive->lock);
+
+   // the stream is never held back by the remote side, so the backlog is bounded
+   if (archive->number_of_segments >= config->wal_archive_queue)
+   {
+      dropped = archive->head;
+      archive->head = dropped->next;
+      if (archive->head == NULL)
+      {
+         archive->tail = NULL;
+      }
+      archive->number_of_segments--;
+   }
+
+   if (archive->tail == NULL)
+   {
+      archive->head = segment;
+   }
+   else
+   {
+      archive->tail->next = segment;
+   }
+   archive->tail = segment;
+   archive->number_of_segments++;
+
+   pthread_cond_signal(&archive->pending);
+   pthread_mutex_unlock(&archive->lock);
+
+   atomic_fetch_add(&config->states[archive->srv].wal_archive_lag, segment->size);
+
+   if (dropped != NULL)
+   {
+      pgmoneta_log_error("WAL archive: Queue is full, %s is not archived", dropped->filename);
+      atomic_fetch_sub(&config->states[archive->srv].wal_archive_lag, dropped->size);
+      atomic_fetch_add(&config->states[archive->srv].wal_archive_failed, 1);
+      free(dropped);
+   }
+
+   free(path);
+
+   return 0;
+
+error:
+
+   free(path);
+
+   return 1;
+}
+
+void
+pgmoneta_wal_archive_destroy(struct wal_archive* archive)
+{
+   struct wal_segment* segment = NULL;
+   struct wal_segment* next = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (archive == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&archive->lock);
+   archive->done = true;
+   pthread_cond_broadcast(&archive->pending);
+   pthread_mutex_unlock(&archive->lock);
+
+   pthread_join(archive->thread, NULL);
+
+   if (archive->number_of_segments > 0)
+   {
+      pgmoneta_log_warn("WAL archive: %d segments of %s are not archived", archive->number_of_segments,
+                        config->servers[archive->srv].name);
+   }
+
+   segment = archive->head;
+   while (segment != NULL)
+   {
+      next = segment->next;
+      free(segment);
+      segment = next;
+   }
+
+   atomic_store(&config->states[archive->srv].wal_archive_lag, 0);
+
+   pthread_cond_destroy(&archive->pending);
+   pthread_mutex_destroy(&archive->lock);
+
+   pgmoneta_storage_backend_destroy(archive->backend);
+
+   free(archive->directory);
+   free(archive);
+}
+
+static struct wal_segment*
+wal_archive_take(struct wal_archive* archive, time_t* wait)
+{
+   time_t now;
+   struct wal_segment* previous = NULL;
+   struct wal_segment* segment = NULL;
+
+   now = time(NULL);
+   *wait = 0;
+
+   // segments waiting for a retry don't hold back the ones behind them
+   segment = archive->head;
+   while (segment != NULL)
+   {
+      if (segment->retry <= now)
+      {
+         if (previous == NULL)
+         {
+            archive->head = segment->next;
+         }
+         else
+         {
+            previous->next = segment->next;
+         }
+         if (archive->tail == segment)
+         {
+            archive->tail = previous;
+         }
+         archive->number_of_segments--;
+         segment->next = NULL;
+
+         return segment;
+      }
+
+      if (*wait == 0 || segment->retry < *wait)
+      {
+         *wait = segment->retry;
+      }
+
+      previous = segment;
+      segment = segment->next;
+   }
+
+   return NULL;
+}
+
+static char*
+wal_archive_path(struct wal_archive* archive, char* filename, char** name)
+{
+   char* suffix = NULL;
+   char* path = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // a raw segment may have been compressed and encrypted since it was queued
+   for (int i = 0; i < 2; i++)
+   {
+      path = pgmoneta_append(NULL, archive->directory);
+      if (!pgmoneta_ends_with(path, "/"))
+      {
+         path = pgmoneta_append(path, "/");
+      }
+      path = pgmoneta_append(path, filename);
+
+      if (i == 1)
+      {
+         suffix = pgmoneta_streamer_suffix(pgmoneta_get_wal_compression(archive->srv), config->encryption);
+         path = pgmoneta_append(path, suffix);
+      }
+
+      if (pgmoneta_exists(path))
+      {
+         if (name != NULL)
+         {
+            *name = pgmoneta_append(NULL, filename);
+            *name = pgmoneta_append(*name, suffix);
+         }
+
+         free(suffix);
+
+         return path;
+      }
+
+      free(path);
+      path = NULL;
+   }
+
+   free(suffix);
+
+   return NULL;
+}
+
+static void*
+wal_archive_run(void* arg)
+{
+   int ret;
+   time_t wait;
+   char* path = NULL;
+   char* name = NULL;
+   char* remote = NULL;
+   struct timespec until;
+   struct wal_segment* segment = NULL;
+   struct wal_archive* archive = (struct wal_archive*)arg;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pthread_mutex_lock(&archive->lock);
+
+   while (!archive->done)
+   {
+      segment = wal_archive_take(archive, &wait);
+
+      if (segment == NULL)
+      {
+         if (wait == 0)
+         {
+            pthread_cond_wait(&archive->pending, &archive->lock);
+         }
+         else
+         {
+            until.tv_sec = wait;
+            until.tv_nsec = 0;
+            pthread_cond_timedwait(&archive->pending, &archive->lock, &until);
+         }
+         continue;
+      }
+
+      pthread_mutex_unlock(&archive->lock);
+
+      path = wal_archive_path(archive, segment->filename, &name);
+      if (path == NULL)
+      {
+         // retention or a restart has removed the segment already
+         pgmoneta_log_warn("WAL archive: %s no longer exists", segment->filename);
+         ret = 0;
+      }
+      else
+      {
+         remote = pgmoneta_append(remote, config->servers[archive->srv].name);
+         remote = pgmoneta_append(remote, "/wal/");
+         remote = pgmoneta_append(remote, name);
+
+         ret = archive->backend->put(archive->backend, path, remote);
+      }
+
+      if (ret == 0)
+      {
+         pgmoneta_log_debug("WAL archive: %s archived", segment->filename);
+      }
+
+      free(path);
+      free(name);
+      free(remote);
+      path = NULL;
+      name = NULL;
+      remote = NULL;
+
+      pthread_mutex_lock(&archive->lock);
+
+      if (ret != 0 && ++segment->attempts <= config->wal_archive_retries)
+      {
+         segment->retry = time(NULL) + MIN(1 << MIN(segment->attempts, 6), WAL_ARCHIVE_MAX_DELAY);
+
+         pgmoneta_log_warn("WAL archive: Upload of %s failed, attempt %d of %d", segment->filename,
+                           segment->attempts, config->wal_archive_retries);
+
+         if (archive->tail == NULL)
+         {
+            archive->head = segment;
+         }
+         else
+         {
+            archive->tail->next = segment;
+         }
+         archive->tail = segment;
+         archive->number_of_segments++;
+         continue;
+      }
+
+      if (ret != 0)
+      {
+         pgmoneta_log_error("WAL archive: %s is not archived", segment->filename);
+         atomic_fetch_add(&config->states[archive->srv].wal_archive_failed, 1);
+      }
+
+      atomic_fetch_sub(&config->states[archive->srv].wal_archive_lag, segment->size);
+
+      free(segment);
+      segment = NULL;
+   }
+
+   pthread_mutex_unlock(&archive->lock);
+
+   pgmoneta_worker_cache_clear();
+
+   return NULL;
+}
@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <management.h>
+#include <network.h>
+#include <utils.h>
+#include <walfetch.h>
+#include <walpack.h>
+#include <workers.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WALFETCH_DIRECTORY "prefetch/"
+#define WALFETCH_TEMPORARY ".tmp"
+
+static char* walfetch_cache(int server);
+static char* walfetch_find(char* wal, char* name);
+static int walfetch_decode(char* from, char* name, char* to, struct workers* workers);
+static int walfetch_move(char* from, char* to);
+static bool walfetch_is_segment(char* name);
+static void walfetch_prune(char* cache, char* name);
+static void walfetch_prefetch(int server, char* cache, char* wal, char* name);
+
+void
+pgmoneta_wal_fetch(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   bool prefetched = false;
+   char* name = NULL;
+   char* destination = NULL;
+   char* cache = NULL;
+   char* cached = NULL;
+   char* wal = NULL;
+   char* from = NULL;
+   char* elapsed = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double total_seconds;
+   struct json* req = NULL;
+   struct json* response = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   req = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
+   name = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_FILENAME);
+   destination = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_DESTINATION_FILE);
+
+   if (name == NULL || destination == NULL || strlen(name) == 0 ||
+       strchr(name, '/') != NULL || strstr(name, "..") != NULL || destination[0] != '/')
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_BAD_PAYLOAD, compression, encryption, payload);
+      pgmoneta_log_error("WAL fetch: Invalid request for %s", config->servers[server].name);
+
+      goto error;
+   }
+
+   cache = walfetch_cache(server);
+   wal = pgmoneta_get_server_wal(server);
+
+   if (cache != NULL)
+   {
+      cached = pgmoneta_append(cached, cache);
+      cached = pgmoneta_append(cached, name);
+
+      if (pgmoneta_exists(cached) && !walfetch_move(cached, destination))
+      {
+         prefetched = true;
+      }
+   }
+
+   if (!prefetched)
+   {
+      from = walfetch_find(wal, name);
+
+      if (from == NULL)
+      {
+         /* PostgreSQL asks for history files that don't exist, so this isn't an error */
+         pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_WAL_FETCH_NOFILE, compression, encryption, payload);
+         pgmoneta_log_debug("WAL fetch: No file %s for %s", name, config->servers[server].name);
+
+         goto error;
+      }
+
+      if (walfetch_decode(from, name, destination, NULL))
+      {
+         pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_WAL_FETCH_ERROR, compression, encryption, payload);
+         pgmoneta_log_error("WAL fetch: Unable to restore %s to %s", from, destination);
+
+         goto error;
+      }
+   }
+
+   if (pgmoneta_management_create_response(payload, server, &response))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+
+      goto error;
+   }
+
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_FILENAME, (uintptr_t)name, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_DESTINATION_FILE, (uintptr_t)destination, ValueString);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_WAL_FETCH_NETWORK, compression, encryption, payload);
+      pgmoneta_log_error("WAL fetch: Error sending response for %s", config->servers[server].name);
+
+      goto error;
+   }
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+
+   pgmoneta_log_debug("WAL fetch: %s/%s from %s (Elapsed: %s)", config->servers[server].name, name,
+                      prefetched ? "prefetch" : "archive", elapsed);
+
+   /* The recovery doesn't wait for the prefetch of the segments after this one */
+   pgmoneta_disconnect(client_fd);
+   client_fd = -1;
+
+   if (cache != NULL && config->wal_prefetch > 0 && walfetch_is_segment(name))
+   {
+      walfetch_prefetch(server, cache, wal, name);
+   }
+
+   pgmoneta_json_destroy(payload);
+
+   free(cache);
+   free(cached);
+   free(wal);
+   free(from);
+   free(elapsed);
+
+   pgmoneta_stop_logging();
+
+   exit(0);
+
+error:
+
+   pgmoneta_json_destroy(payload);
+
+   free(cache);
+   free(cached);
+   free(wal);
+   free(from);
+   free(elapsed);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   exit(1);
+}
+
+static char*
+walfetch_cache(int server)
+{
+   char* cache = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   cache = pgmoneta_get_server_workspace(server);
+
+   if (cache == NULL)
+   {
+      return NULL;
+   }
+
+   cache = pgmoneta_append(cache, WALFETCH_DIRECTORY);
+   cache = pgmoneta_append(cache, config->servers[server].name);
+   cache = pgmoneta_append(cache, "/");
+
+   if (pgmoneta_mkdir(cache))
+   {
+      pgmoneta_log_warn("WAL fetch: Unable to create %s", cache);
+      free(cache);
+      return NULL;
+   }
+
+   return cache;
+}
+
+static char*
+walfetch_find(char* wal, char* name)
+{
+   char* path = NULL;
+   char* compressions[] = {"", ".zstd", ".lz4", ".bz2", ".gz"};
+   char* encryptions[] = {"", ".aes"};
+
+   for (int i = 0; i < (int)(sizeof(compressions) / sizeof(compressions[0])); i++)
+   {
+      for (int j = 0; j < (int)(sizeof(encryptions) / sizeof(encryptions[0])); j++)
+      {
+         path = pgmoneta_append(path, wal);
+         path = pgmoneta_append(path, name);
+         path = pgmoneta_append(path, compressions[i]);
+         path = pgmoneta_append(path, encryptions[j]);
+
+         if (pgmoneta_is_file(path))
+         {
+            return path;
+         }
+
+         free(path);
+         path = NULL;
+      }
+   }
+
+   return pgmoneta_walpack_find(wal, name);
+}
+
+static int
+walfetch_decode(char* from, char* name, char* to, struct workers* workers)
+{
+   if (pgmoneta_is_walpack(from))
+   {
+      return pgmoneta_walpack_extract(from, name, to);
+   }
+
+   if (pgmoneta_is_compressed_archive(from) || pgmoneta_is_encrypted_archive(from))
+   {
+      return pgmoneta_decode_file(from, to, workers);
+   }
+
+   if (pgmoneta_copy_file(from, to, workers))
+   {
+      return 1;
+   }
+
+   if (workers == NULL && !pgmoneta_exists(to))
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+walfetch_move(char* from, char* to)
+{
+   if (rename(from, to) == 0)
+   {
+      return 0;
+   }
+
+   if (errno != EXDEV)
+   {
+      return 1;
+   }
+
+   if (pgmoneta_copy_file(from, to, NULL) || !pgmoneta_exists(to))
+   {
+      return 1;
+   }
+
+   unlink(from);
+
+   return 0;
+}
+
+static bool
+walfetch_is_segment(char* name)
+{
+   if (strlen(name) != 24)
+   {
+      return false;
+   }
+
+   for (int i = 0; i < 24; i++)
+   {
+      if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'A' && name[i] <= 'F')))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void
+walfetch_prune(char* cache, char* name)
+{
+   char path[MAX_PATH];
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+
+   dir = opendir(cache);
+
+   if (dir == NULL)
+   {
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_name[0] == '.')
+      {
+         continue;
+      }
+
+      /* The recovery never goes back, so segments up to the requested one are done */
+      if (strncmp(entry->d_name, name, 24) <= 0)
+      {
+         memset(&path[0], 0, sizeof(path));
+         snprintf(&path[0], sizeof(path), "%s%s", cache, entry->d_name);
+         unlink(&path[0]);
+      }
+   }
+
+   closedir(dir);
+}
+
+static void
+walfetch_prefetch(int server, char* cache, char* wal, char* name)
+{
+   int fd = -1;
+   int number_of_workers = 0;
+   int number_of_files = 0;
+   uint32_t timeline = 0;
+   uint32_t log = 0;
+   uint32_t seg = 0;
+   uint64_t segments_per_id = 0;
+   uint64_t segno = 0;
+   uint64_t wal_size = 0;
+   char next[MISC_LENGTH];
+   char** files = NULL;
+   char* from = NULL;
+   char* cached = NULL;
+   char* tmp = NULL;
+   struct workers* workers = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   wal_size = config->servers[server].wal_size;
+
+   walfetch_prune(cache, name);
+
+   if (wal_size == 0 || sscanf(name, "%08X%08X%08X", &timeline, &log, &seg) != 3)
+   {
+      return;
+   }
+
+   segments_per_id = 0x100000000ULL / wal_size;
+   segno = (uint64_t)log * segments_per_id + seg;
+
+   files = (char**)calloc(config->wal_prefetch, sizeof(char*));
+
+   if (files == NULL)
+   {
+      return;
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   for (int i = 1; i <= config->wal_prefetch; i++)
+   {
+      memset(&next[0], 0, sizeof(next));
+      snprintf(&next[0], sizeof(next), "%08X%08X%08X", timeline,
+               (uint32_t)((segno + i) / segments_per_id), (uint32_t)((segno + i) % segments_per_id));
+
+      cached = pgmoneta_append(NULL, cache);
+      cached = pgmoneta_append(cached, &next[0]);
+
+      if (pgmoneta_exists(cached))
+      {
+         free(cached);
+         cached = NULL;
+         continue;
+      }
+
+      from = walfetch_find(wal, &next[0]);
+
+      if (from == NULL)
+      {
+         /* Not archived yet */
+         free(cached);
+         cached = NULL;
+         break;
+      }
+
+      tmp = pgmoneta_append(NULL, cached);
+      tmp = pgmoneta_append(tmp, WALFETCH_TEMPORARY);
+
+      /* Another fetch is already working on the segment */
+      fd = open(tmp, O_CREAT | O_EXCL | O_WRONLY, 0600);
+      if (fd == -1)
+      {
+         free(from);
+         free(cached);
+         free(tmp);
+         from = NULL;
+         cached = NULL;
+         tmp = NULL;
+         continue;
+      }
+      close(fd);
+
+      if (walfetch_decode(from, &next[0], tmp, workers))
+      {
+         unlink(tmp);
+         free(tmp);
+      }
+      else
+      {
+         files[number_of_files++] = tmp;
+      }
+
+      free(from);
+      free(cached);
+      from = NULL;
+      cached = NULL;
+      tmp = NULL;
+   }
+
+   pgmoneta_workers_wait(workers);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      cached = pgmoneta_append(NULL, files[i]);
+      cached[strlen(cached) - strlen(WALFETCH_TEMPORARY)] = '\0';
+
+      if ((workers != NULL && !workers->outcome) || rename(files[i], cached))
+      {
+         unlink(files[i]);
+      }
+      else
+      {
+         pgmoneta_log_debug("WAL fetch: Prefetched %s", cached);
+      }
+
+      free(cached);
+      free(files[i]);
+   }
+
+   pgmoneta_workers_destroy(workers);
+
+   free(files);
+}
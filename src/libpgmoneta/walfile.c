@@ -26,25 +26,55 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <aes.h>
-#include <compression.h>
+#include <arena.h>
+#include <csv.h>
 #include <deque.h>
 #include <json.h>
 #include <logging.h>
+#include <streamer.h>
 #include <utils.h>
 #include <walfile.h>
 #include <walfile/wal_reader.h>
+#include <workers.h>
 
+#include <fcntl.h>
 #include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @struct walfile_segment
+ * A WAL segment decoded for pgmoneta_describe_walfile
+ */
+struct walfile_segment
+{
+   char path[MAX_PATH];         /**< The path of the segment */
+   struct wal_filter* filter;   /**< The filter */
+   struct walfile* wf;          /**< The decoded segment */
+   struct arena* arena;         /**< The arena of the records, shared with the segments of other windows */
+   struct wal_stats* stats;     /**< The statistics of the segment, or NULL */
+   bool failed;                 /**< Did the decoding fail */
+};
+
+static bool is_wal_segment(char* file);
+static int map_walfile(char* path, char** data, size_t* size, bool* mapped);
+static int read_walfile(int server, char* path, struct wal_filter* filter, struct arena* arena, struct walfile** wf);
+static void destroy_walfile(struct walfile* wf, bool keep_arena);
+static int list_segments(char* path, struct wal_filter* filter, int* number_of_files, char*** files, struct walfile_segment** segments, int* number_of_segments);
+static void decode_segment(struct walfile_segment* segment);
+static void do_decode_segment(struct worker_input* wi);
+static void stats_segment(struct walfile_segment* segment);
+static void do_stats_segment(struct worker_input* wi);
 
 int
 pgmoneta_read_walfile(int server, char* path, struct walfile** wf)
 {
    struct walfile* new_wf = NULL;
 
-   new_wf = malloc(sizeof(struct walfile));
+   new_wf = calloc(1, sizeof(struct walfile));
    if (new_wf == NULL)
    {
       goto error;
@@ -55,6 +85,11 @@ pgmoneta_read_walfile(int server, char* path, struct walfile** wf)
       goto error;
    }
 
+   if (pgmoneta_arena_create(ARENA_DEFAULT_SIZE, false, &new_wf->arena))
+   {
+      goto error;
+   }
+
    if (pgmoneta_wal_parse_wal_file(path, server, new_wf))
    {
       goto error;
@@ -68,6 +103,144 @@ error:
    return 1;
 }
 
+int
+pgmoneta_read_walfile_filter(int server, char* path, struct wal_filter* filter, struct walfile** wf)
+{
+   return read_walfile(server, path, filter, NULL, wf);
+}
+
+int
+pgmoneta_read_walfile_buffer(int server, char* name, char* data, size_t size, struct walfile** wf)
+{
+   struct walfile* new_wf = NULL;
+
+   *wf = NULL;
+
+   new_wf = calloc(1, sizeof(struct walfile));
+   if (new_wf == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_create(false, &new_wf->records) || pgmoneta_deque_create(false, &new_wf->page_headers) ||
+       pgmoneta_arena_create(ARENA_DEFAULT_SIZE, false, &new_wf->arena))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_wal_parse_wal_buffer(data, size, name, server, NULL, new_wf))
+   {
+      goto error;
+   }
+
+   *wf = new_wf;
+
+   return 0;
+
+error:
+
+   if (new_wf != NULL && new_wf->records != NULL && new_wf->page_headers != NULL)
+   {
+      destroy_walfile(new_wf, false);
+   }
+   else if (new_wf != NULL)
+   {
+      pgmoneta_deque_destroy(new_wf->records);
+      pgmoneta_deque_destroy(new_wf->page_headers);
+      free(new_wf);
+   }
+
+   return 1;
+}
+
+static int
+read_walfile(int server, char* path, struct wal_filter* filter, struct arena* arena, struct walfile** wf)
+{
+   struct walfile* new_wf = NULL;
+   char* data = NULL;
+   size_t size = 0;
+   bool mapped = false;
+   char* name = NULL;
+
+   *wf = NULL;
+
+   new_wf = calloc(1, sizeof(struct walfile));
+   if (new_wf == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_create(false, &new_wf->records) || pgmoneta_deque_create(false, &new_wf->page_headers))
+   {
+      goto error;
+   }
+
+   if (arena != NULL)
+   {
+      new_wf->arena = arena;
+   }
+   else if (pgmoneta_arena_create(ARENA_DEFAULT_SIZE, false, &new_wf->arena))
+   {
+      goto error;
+   }
+
+   name = pgmoneta_walfile_segment_name(path);
+   if (name == NULL)
+   {
+      goto error;
+   }
+
+   if (map_walfile(path, &data, &size, &mapped))
+   {
+      pgmoneta_log_error("Failed to open WAL file at %s", path);
+      goto error;
+   }
+
+   if (pgmoneta_wal_parse_wal_buffer(data, size, name, server, filter, new_wf))
+   {
+      goto error;
+   }
+
+   if (mapped)
+   {
+      munmap(data, size);
+   }
+   else
+   {
+      free(data);
+   }
+   free(name);
+
+   *wf = new_wf;
+
+   return 0;
+
+error:
+
+   if (mapped)
+   {
+      munmap(data, size);
+   }
+   else
+   {
+      free(data);
+   }
+   free(name);
+
+   if (new_wf != NULL && new_wf->records != NULL && new_wf->page_headers != NULL)
+   {
+      destroy_walfile(new_wf, arena != NULL);
+   }
+   else if (new_wf != NULL)
+   {
+      pgmoneta_deque_destroy(new_wf->records);
+      pgmoneta_deque_destroy(new_wf->page_headers);
+      free(new_wf);
+   }
+
+   return 1;
+}
+
 int
 pgmoneta_write_walfile(struct walfile* wf, int server, char* path)
 {
@@ -157,6 +330,12 @@ error:
 
 void
 pgmoneta_destroy_walfile(struct walfile* wf)
+{
+   destroy_walfile(wf, false);
+}
+
+static void
+destroy_walfile(struct walfile* wf, bool keep_arena)
 {
    struct deque_iterator* record_iterator = NULL;
    struct deque_iterator* page_header_iterator = NULL;
@@ -171,7 +350,8 @@ pgmoneta_destroy_walfile(struct walfile* wf)
       return;
    }
 
-   while (pgmoneta_deque_iterator_next(record_iterator))
+   // The records of an arena are released with it
+   while (wf->arena == NULL && pgmoneta_deque_iterator_next(record_iterator))
    {
       struct decoded_xlog_record* record = (struct decoded_xlog_record*) record_iterator->value->data;
       if (record->partial)
@@ -199,7 +379,7 @@ pgmoneta_destroy_walfile(struct walfile* wf)
    pgmoneta_deque_iterator_destroy(record_iterator);
    pgmoneta_deque_destroy(wf->records);
 
-   while (pgmoneta_deque_iterator_next(page_header_iterator))
+   while (wf->arena == NULL && pgmoneta_deque_iterator_next(page_header_iterator))
    {
       struct xlog_page_header_data* page_header = (struct xlog_page_header_data*) page_header_iterator->value->data;
       free(page_header);
@@ -207,101 +387,324 @@ pgmoneta_destroy_walfile(struct walfile* wf)
    pgmoneta_deque_iterator_destroy(page_header_iterator);
    pgmoneta_deque_destroy(wf->page_headers);
 
+   if (!keep_arena)
+   {
+      pgmoneta_arena_destroy(wf->arena);
+   }
+
    free(wf->long_phd);
    free(wf);
 }
 
 int
-pgmoneta_describe_walfile(char* path, enum value_type type, char* output, bool quiet, bool color,
+pgmoneta_describe_walfile(char* path, enum value_type type, bool csv, char* output, bool quiet, bool color,
                           struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids,
-                          uint32_t limit)
+                          uint32_t limit, int workers)
 {
    FILE* out = NULL;
-   char* tmp_wal = NULL;
-   struct walfile* wf = NULL;
+   struct csv_writer* writer = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   int number_of_segments = 0;
+   struct walfile_segment* segments = NULL;
+   struct wal_filter filter;
+   struct workers* w = NULL;
+   struct worker_input* wi = NULL;
    struct deque_iterator* record_iterator = NULL;
    struct decoded_xlog_record* record = NULL;
-   char* decompressed_file_name = NULL;
-   char* decrypted_file_name = NULL;
-   char* wal_path = NULL;
-   bool copy = true;
+   struct arena** arenas = NULL;
+   int window = 0;
+
+   memset(&filter, 0, sizeof(struct wal_filter));
+   filter.rms = rms;
+   filter.start_lsn = start_lsn;
+   filter.end_lsn = end_lsn;
+   filter.xids = xids;
 
-   if (!pgmoneta_is_file(path))
+   if (list_segments(path, &filter, &number_of_files, &files, &segments, &number_of_segments))
    {
-      pgmoneta_log_fatal("WAL file at %s does not exist", path);
       goto error;
    }
 
-   wal_path = pgmoneta_append(wal_path, path);
-
-   // Based on the file extension, if it's an encrypted file, decrypt it in /tmp
-   if (pgmoneta_is_encrypted_archive(wal_path))
+   if (workers > 1 && number_of_segments > 1)
    {
-      tmp_wal = pgmoneta_format_and_append(tmp_wal, "/tmp/%s", basename(wal_path));
+      if (pgmoneta_workers_initialize(MIN(workers, number_of_segments), &w))
+      {
+         pgmoneta_log_warn("Failed to start workers, decoding sequentially");
+         w = NULL;
+      }
+   }
 
-      // Temporarily copying the encrypted WAL file, because the decrypt
-      // functions delete the source file
-      pgmoneta_copy_file(wal_path, tmp_wal, NULL);
-      copy = false;
+   // Decoded segments are held in memory until displayed, so only one window is in flight
+   window = w != NULL ? MIN(workers, number_of_segments) : 1;
 
-      pgmoneta_basename_file(basename(wal_path), &decrypted_file_name);
+   // Each slot of the window keeps its arena, so the memory of a segment is reused by the next one
+   arenas = (struct arena**)calloc(window, sizeof(struct arena*));
+   if (arenas == NULL)
+   {
+      goto error;
+   }
 
-      free(wal_path);
-      wal_path = NULL;
+   for (int i = 0; i < window; i++)
+   {
+      if (pgmoneta_arena_create(ARENA_DEFAULT_SIZE, false, &arenas[i]))
+      {
+         goto error;
+      }
+   }
 
-      wal_path = pgmoneta_format_and_append(wal_path, "/tmp/%s", decrypted_file_name);
-      free(decrypted_file_name);
+   if (output == NULL)
+   {
+      out = stdout;
+   }
+   else
+   {
+      out = fopen(output, "w");
+      color = false;
 
-      if (pgmoneta_decrypt_file(tmp_wal, wal_path))
+      if (out == NULL)
       {
-         pgmoneta_log_fatal("Failed to decrypt WAL file at %s", path);
+         pgmoneta_log_fatal("Failed to open %s", output);
          goto error;
       }
    }
 
-   // Based on the file extension, if it's a compressed file, decompress it
-   // in /tmp
-   if (pgmoneta_is_compressed_archive(wal_path))
+   if (csv && !quiet)
+   {
+      if (pgmoneta_csv_writer_create(out, &writer) || pgmoneta_wal_record_csv_header(writer))
+      {
+         goto error;
+      }
+   }
+   else if (type == ValueJSON && !quiet)
    {
-      free(tmp_wal);
-      tmp_wal = NULL;
+      fprintf(out, "{ \"WAL\": [\n");
+   }
 
-      tmp_wal = pgmoneta_format_and_append(tmp_wal, "/tmp/%s", basename(wal_path));
+   for (int start = 0; start < number_of_segments; start += window)
+   {
+      int end = MIN(start + window, number_of_segments);
 
-      if (copy)
+      for (int i = start; i < end; i++)
       {
-         // Temporarily copying the compressed WAL file, because the decompress
-         // functions delete the source file
-         pgmoneta_copy_file(wal_path, tmp_wal, NULL);
+         segments[i].arena = arenas[i - start];
+
+         if (w != NULL && !pgmoneta_create_worker_input(NULL, segments[i].path, NULL, 0, w, &wi))
+         {
+            wi->argument = &segments[i];
+            pgmoneta_workers_add(w, do_decode_segment, wi);
+            wi = NULL;
+         }
+         else
+         {
+            decode_segment(&segments[i]);
+         }
       }
 
-      pgmoneta_basename_file(basename(wal_path), &decompressed_file_name);
+      pgmoneta_workers_wait(w);
 
-      free(wal_path);
-      wal_path = NULL;
+      for (int i = start; i < end; i++)
+      {
+         if (segments[i].failed)
+         {
+            pgmoneta_log_fatal("Failed to read WAL file at %s", segments[i].path);
+            goto error;
+         }
+
+         if (pgmoneta_deque_iterator_create(segments[i].wf->records, &record_iterator))
+         {
+            pgmoneta_log_fatal("Failed to create deque iterator");
+            goto error;
+         }
+
+         while (pgmoneta_deque_iterator_next(record_iterator))
+         {
+            record = (struct decoded_xlog_record*) record_iterator->value->data;
+            if (writer != NULL)
+            {
+               if (pgmoneta_wal_record_csv(record, segments[i].wf->long_phd->std.xlp_magic, writer,
+                                           rms, start_lsn, end_lsn, xids, limit))
+               {
+                  pgmoneta_log_fatal("Failed to write the CSV output");
+                  goto error;
+               }
+            }
+            else if (!csv)
+            {
+               pgmoneta_wal_record_display(record, segments[i].wf->long_phd->std.xlp_magic, type, out, quiet, color,
+                                           rms, start_lsn, end_lsn, xids, limit);
+            }
+         }
+
+         pgmoneta_deque_iterator_destroy(record_iterator);
+         record_iterator = NULL;
+
+         destroy_walfile(segments[i].wf, true);
+         segments[i].wf = NULL;
+         pgmoneta_arena_reset(segments[i].arena);
+      }
+   }
+
+   if (writer != NULL)
+   {
+      pgmoneta_csv_writer_destroy(writer);
+      writer = NULL;
+   }
+   else if (type == ValueJSON && !quiet && !csv)
+   {
+      fprintf(out, "\n]}");
+   }
+
+   if (output != NULL)
+   {
+      fflush(out);
+      fclose(out);
+   }
 
-      wal_path = pgmoneta_format_and_append(wal_path, "/tmp/%s", decompressed_file_name);
-      free(decompressed_file_name);
+   pgmoneta_workers_destroy(w);
 
-      if (pgmoneta_decompress(tmp_wal, wal_path))
+   for (int i = 0; i < window; i++)
+   {
+      pgmoneta_arena_destroy(arenas[i]);
+   }
+   free(arenas);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(segments);
+
+   return 0;
+
+error:
+
+   pgmoneta_csv_writer_destroy(writer);
+
+   if (output != NULL)
+   {
+      if (out != NULL)
       {
-         pgmoneta_log_fatal("Failed to decompress WAL file at %s", path);
-         goto error;
+         fflush(out);
+         fclose(out);
+      }
+   }
+
+   pgmoneta_deque_iterator_destroy(record_iterator);
+
+   if (w != NULL)
+   {
+      pgmoneta_workers_wait(w);
+      pgmoneta_workers_destroy(w);
+   }
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      destroy_walfile(segments[i].wf, true);
+   }
+
+   if (arenas != NULL)
+   {
+      for (int i = 0; i < window; i++)
+      {
+         pgmoneta_arena_destroy(arenas[i]);
       }
+      free(arenas);
    }
 
-   if (pgmoneta_read_walfile(-1, wal_path, &wf))
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(segments);
+
+   return 1;
+}
+
+int
+pgmoneta_describe_walfile_stats(char* path, enum value_type type, char* output,
+                                struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids,
+                                uint32_t limit, int workers)
+{
+   FILE* out = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   int number_of_segments = 0;
+   struct walfile_segment* segments = NULL;
+   struct wal_filter filter;
+   struct wal_stats* stats = NULL;
+   struct workers* w = NULL;
+   struct worker_input* wi = NULL;
+
+   memset(&filter, 0, sizeof(struct wal_filter));
+   filter.rms = rms;
+   filter.start_lsn = start_lsn;
+   filter.end_lsn = end_lsn;
+   filter.xids = xids;
+
+   if (list_segments(path, &filter, &number_of_files, &files, &segments, &number_of_segments))
    {
-      pgmoneta_log_fatal("Failed to read WAL file at %s", path);
       goto error;
    }
 
-   if (pgmoneta_deque_iterator_create(wf->records, &record_iterator))
+   if (pgmoneta_wal_stats_create(&stats))
    {
-      pgmoneta_log_fatal("Failed to create deque iterator");
       goto error;
    }
 
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      if (pgmoneta_wal_stats_create(&segments[i].stats))
+      {
+         goto error;
+      }
+   }
+
+   if (workers > 1 && number_of_segments > 1)
+   {
+      if (pgmoneta_workers_initialize(MIN(workers, number_of_segments), &w))
+      {
+         pgmoneta_log_warn("Failed to start workers, decoding sequentially");
+         w = NULL;
+      }
+   }
+
+   // A segment is counted and released by its worker, so all the segments can be in flight
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      if (w != NULL && !pgmoneta_create_worker_input(NULL, segments[i].path, NULL, 0, w, &wi))
+      {
+         wi->argument = &segments[i];
+         pgmoneta_workers_add(w, do_stats_segment, wi);
+         wi = NULL;
+      }
+      else
+      {
+         stats_segment(&segments[i]);
+      }
+   }
+
+   pgmoneta_workers_wait(w);
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      if (segments[i].failed)
+      {
+         pgmoneta_log_fatal("Failed to read WAL file at %s", segments[i].path);
+         goto error;
+      }
+
+      if (pgmoneta_wal_stats_merge(stats, segments[i].stats))
+      {
+         goto error;
+      }
+
+      pgmoneta_wal_stats_destroy(segments[i].stats);
+      segments[i].stats = NULL;
+   }
+
    if (output == NULL)
    {
       out = stdout;
@@ -309,67 +712,300 @@ pgmoneta_describe_walfile(char* path, enum value_type type, char* output, bool q
    else
    {
       out = fopen(output, "w");
-      color = false;
+      if (out == NULL)
+      {
+         pgmoneta_log_fatal("Failed to open %s", output);
+         goto error;
+      }
    }
 
-   if (type == ValueJSON)
+   pgmoneta_wal_stats_display(stats, type, out, limit);
+
+   if (output != NULL)
    {
-      if (!quiet)
+      fflush(out);
+      fclose(out);
+   }
+
+   pgmoneta_workers_destroy(w);
+
+   pgmoneta_wal_stats_destroy(stats);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(segments);
+
+   return 0;
+
+error:
+
+   if (w != NULL)
+   {
+      pgmoneta_workers_wait(w);
+      pgmoneta_workers_destroy(w);
+   }
+
+   pgmoneta_wal_stats_destroy(stats);
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      pgmoneta_wal_stats_destroy(segments[i].stats);
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(segments);
+
+   return 1;
+}
+
+char*
+pgmoneta_walfile_segment_name(char* file)
+{
+   char* name = NULL;
+   char* n = NULL;
+
+   name = pgmoneta_append(NULL, basename(file));
+
+   while (name != NULL && (pgmoneta_is_encrypted_archive(name) || pgmoneta_is_compressed_archive(name)))
+   {
+      if (pgmoneta_basename_file(name, &n))
       {
-         fprintf(out, "{ \"WAL\": [\n");
+         free(name);
+         return NULL;
       }
 
-      while (pgmoneta_deque_iterator_next(record_iterator))
+      free(name);
+      name = n;
+   }
+
+   return name;
+}
+
+static bool
+is_wal_segment(char* file)
+{
+   char* name = NULL;
+   bool segment = false;
+
+   name = pgmoneta_walfile_segment_name(file);
+
+   if (name != NULL && strlen(name) == 24 && strspn(name, "0123456789ABCDEF") == 24)
+   {
+      segment = true;
+   }
+
+   free(name);
+
+   return segment;
+}
+
+static int
+map_walfile(char* path, char** data, size_t* size, bool* mapped)
+{
+   FILE* memory = NULL;
+   char* d = NULL;
+   size_t s = 0;
+   int fd = -1;
+   struct stat st;
+   void* m = NULL;
+
+   *data = NULL;
+   *size = 0;
+   *mapped = false;
+
+   if (pgmoneta_is_encrypted_archive(path) || pgmoneta_is_compressed_archive(path))
+   {
+      // Decrypt and decompress into memory instead of going through /tmp
+      memory = open_memstream(&d, &s);
+      if (memory == NULL)
       {
-         record = (struct decoded_xlog_record*) record_iterator->value->data;
-         pgmoneta_wal_record_display(record, wf->long_phd->std.xlp_magic, type, out, quiet, color,
-                                     rms, start_lsn, end_lsn, xids, limit);
+         goto error;
       }
 
-      if (!quiet)
+      if (pgmoneta_destreamer_stream(path, memory))
       {
-         fprintf(out, "\n]}");
+         goto error;
       }
+
+      fclose(memory);
+      memory = NULL;
+
+      if (s == 0)
+      {
+         goto error;
+      }
+
+      *data = d;
+      *size = s;
+
+      return 0;
    }
-   else
+
+   // Plain segments are mapped, so the records are decoded without copying the pages
+   fd = open(path, O_RDONLY);
+   if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0)
+   {
+      goto error;
+   }
+
+   m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (m == MAP_FAILED)
    {
-      while (pgmoneta_deque_iterator_next(record_iterator))
+      goto error;
+   }
+
+   posix_madvise(m, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+   close(fd);
+
+   *data = (char*)m;
+   *size = st.st_size;
+   *mapped = true;
+
+   return 0;
+
+error:
+
+   if (memory != NULL)
+   {
+      fclose(memory);
+   }
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   free(d);
+
+   return 1;
+}
+
+static int
+list_segments(char* path, struct wal_filter* filter, int* number_of_files, char*** files, struct walfile_segment** segments, int* number_of_segments)
+{
+   struct walfile_segment* s = NULL;
+   int n = 0;
+
+   *number_of_files = 0;
+   *files = NULL;
+   *segments = NULL;
+   *number_of_segments = 0;
+
+   if (pgmoneta_is_directory(path))
+   {
+      if (pgmoneta_get_wal_files(path, number_of_files, files))
+      {
+         pgmoneta_log_fatal("Failed to list WAL files in %s", path);
+         goto error;
+      }
+
+      s = (struct walfile_segment*)calloc(MAX(*number_of_files, 1), sizeof(struct walfile_segment));
+      if (s == NULL)
       {
-         record = (struct decoded_xlog_record*) record_iterator->value->data;
-         pgmoneta_wal_record_display(record, wf->long_phd->std.xlp_magic, type, out, quiet, color,
-                                     rms, start_lsn, end_lsn, xids, limit);
+         goto error;
       }
-   }
 
-   if (output != NULL)
+      for (int i = 0; i < *number_of_files; i++)
+      {
+         if (is_wal_segment((*files)[i]))
+         {
+            snprintf(s[n].path, MAX_PATH, "%s%s%s", path,
+                     pgmoneta_ends_with(path, "/") ? "" : "/", (*files)[i]);
+            s[n].filter = filter;
+            n++;
+         }
+      }
+   }
+   else if (pgmoneta_is_file(path))
    {
-      if (out != NULL)
+      s = (struct walfile_segment*)calloc(1, sizeof(struct walfile_segment));
+      if (s == NULL)
       {
-         fflush(out);
-         fclose(out);
+         goto error;
       }
+
+      snprintf(s[0].path, MAX_PATH, "%s", path);
+      s[0].filter = filter;
+      n = 1;
+   }
+   else
+   {
+      pgmoneta_log_fatal("WAL file at %s does not exist", path);
+      goto error;
    }
 
-   free(tmp_wal);
-   free(wal_path);
-   pgmoneta_deque_iterator_destroy(record_iterator);
-   pgmoneta_destroy_walfile(wf);
+   *segments = s;
+   *number_of_segments = n;
+
    return 0;
 
 error:
 
-   if (output != NULL)
+   free(s);
+
+   return 1;
+}
+
+static void
+decode_segment(struct walfile_segment* segment)
+{
+   segment->failed = read_walfile(-1, segment->path, segment->filter, segment->arena, &segment->wf) != 0;
+}
+
+static void
+do_decode_segment(struct worker_input* wi)
+{
+   decode_segment((struct walfile_segment*)wi->argument);
+
+   free(wi);
+}
+
+static void
+stats_segment(struct walfile_segment* segment)
+{
+   struct walfile* wf = NULL;
+   struct deque_iterator* record_iterator = NULL;
+
+   segment->failed = true;
+
+   if (read_walfile(-1, segment->path, segment->filter, NULL, &wf))
    {
-      if (out != NULL)
+      return;
+   }
+
+   if (pgmoneta_deque_iterator_create(wf->records, &record_iterator))
+   {
+      destroy_walfile(wf, false);
+      return;
+   }
+
+   segment->failed = false;
+   while (pgmoneta_deque_iterator_next(record_iterator))
+   {
+      if (pgmoneta_wal_stats_add(segment->stats, (struct decoded_xlog_record*)record_iterator->value->data))
       {
-         fflush(out);
-         fclose(out);
+         segment->failed = true;
+         break;
       }
    }
 
-   free(tmp_wal);
-   free(wal_path);
-   pgmoneta_destroy_walfile(wf);
    pgmoneta_deque_iterator_destroy(record_iterator);
-   return 1;
-}
\ No newline at end of file
+
+   destroy_walfile(wf, false);
+}
+
+static void
+do_stats_segment(struct worker_input* wi)
+{
+   stats_segment((struct walfile_segment*)wi->argument);
+
+   free(wi);
+}
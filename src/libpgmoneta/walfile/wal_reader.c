@@ -26,25 +26,48 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <arena.h>
+#include <csv.h>
 #include <logging.h>
+#include <security.h>
 #include <utils.h>
 #include <walfile.h>
 #include <walfile/rmgr.h>
 #include <walfile/wal_reader.h>
 
 #include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <libgen.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define WAL_CSV_COLUMNS     10
+
+#define WAL_STATS_RELATIONS 1024
+#define WAL_STATS_RM_XACT   1
 
 struct server* server_config;
 
-static int decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn);
+static int decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn, struct arena* arena);
+static void* record_alloc(struct arena* arena, size_t size);
+static int add_partial_record(struct walfile* wal_file);
 static void record_json(struct decoded_xlog_record* record, uint8_t magic_value, struct value** value);
 static bool get_record_block_tag_extended(struct decoded_xlog_record* pRecord, int id, struct rel_file_locator* pLocator, enum fork_number* pNumber, block_number* pInt, buffer* pVoid);
 static char* get_record_block_ref_info(char* buf, struct decoded_xlog_record* record, bool pretty, bool detailed_format, uint32_t* fpi_len, uint8_t magic_value);
 static int magic_value_to_postgres_version(uint16_t magic_value);
 
+static struct wal_stats_relation* stats_relation(struct wal_stats* stats, struct rel_file_locator* rlocator);
+static int stats_grow(struct wal_stats* stats);
+static size_t stats_hash(struct rel_file_locator* rlocator);
+static bool stats_same_relation(struct rel_file_locator* a, struct rel_file_locator* b);
+static void stats_commit_time(struct wal_stats* stats, timestamp_tz time);
+static int stats_compare_relations(const void* a, const void* b);
+
 static bool is_included(char* rm, struct deque* rms,
                         uint64_t s_lsn, uint64_t start_lsn,
                         uint64_t e_lsn, uint64_t end_lsn,
@@ -135,30 +158,26 @@ pgmoneta_wal_array_desc(char* buf, void* array, size_t elem_size, int count)
 }
 
 static void
-read_all_page_headers(FILE* file, struct xlog_long_page_header_data* long_header, struct walfile* wal_file)
+read_all_page_headers(char* data, size_t size, struct xlog_long_page_header_data* long_header, struct walfile* wal_file)
 {
-   int page_number = 1;
-   while (true)
+   struct xlog_page_header_data* page_header = NULL;
+
+   for (size_t offset = long_header->xlp_xlog_blcksz;
+        offset + SIZE_OF_XLOG_SHORT_PHD <= size;
+        offset += long_header->xlp_xlog_blcksz)
    {
-      fseek(file, page_number * long_header->xlp_xlog_blcksz, SEEK_SET);
-      struct xlog_page_header_data* page_header = NULL;
-      page_header = malloc(SIZE_OF_XLOG_SHORT_PHD);
-      size_t bytes_read = fread(page_header, SIZE_OF_XLOG_SHORT_PHD, 1, file);
-      if (feof(file))
-      {
-         free(page_header);
-         goto finish;
-      }
-      if (bytes_read != 1)
+      page_header = record_alloc(wal_file->arena, SIZE_OF_XLOG_SHORT_PHD);
+      if (page_header == NULL)
       {
-         pgmoneta_log_error("Error: Failed to read the complete data");
          goto error;
       }
+
+      memcpy(page_header, data + offset, SIZE_OF_XLOG_SHORT_PHD);
       pgmoneta_deque_add(wal_file->page_headers, NULL, (uintptr_t) page_header, ValueRef);
-      page_number++;
    }
-finish:
+
    return;
+
 error:
    pgmoneta_log_fatal("Error: Could not read all page headers");
    return;
@@ -167,50 +186,157 @@ error:
 int
 pgmoneta_wal_parse_wal_file(char* path, int server, struct walfile* wal_file)
 {
-#define MALLOC(pointer, size) \
-        pointer = malloc(size); \
-        if (pointer == NULL) \
-        { \
-           pgmoneta_log_fatal("Error: Could not allocate memory for %s", #pointer); \
-           goto error; \
-        }
-
-   struct xlog_record* record = NULL;
+   int fd = -1;
+   struct stat st;
+   void* data = MAP_FAILED;
+   FILE* file = NULL;
+   int ret;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1 || fstat(fd, &st) == -1)
+   {
+      pgmoneta_log_fatal("Error: Could not open file %s", path);
+      goto error;
+   }
+
+   if (st.st_size > 0)
+   {
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+
+   if (data == MAP_FAILED)
+   {
+      // Fall back to reading the file when it can't be mapped
+      file = fdopen(fd, "rb");
+      if (file == NULL)
+      {
+         goto error;
+      }
+      fd = -1;
+
+      ret = pgmoneta_wal_parse_wal_stream(file, basename(path), server, NULL, wal_file);
+
+      fclose(file);
+
+      return ret;
+   }
+
+   posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+   ret = pgmoneta_wal_parse_wal_buffer(data, st.st_size, basename(path), server, NULL, wal_file);
+
+   munmap(data, st.st_size);
+   close(fd);
+
+   return ret;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_wal_parse_wal_stream(FILE* file, char* name, int server, struct wal_filter* filter, struct walfile* wal_file)
+{
+   char* data = NULL;
+   size_t size = 0;
+   size_t capacity = DEFAULT_WAL_SEGZ_BYTES;
+   size_t n = 0;
+   int ret;
+
+   data = malloc(capacity);
+   if (data == NULL)
+   {
+      goto error;
+   }
+
+   while ((n = fread(data + size, 1, capacity - size, file)) > 0)
+   {
+      size += n;
+
+      if (size == capacity)
+      {
+         char* d = realloc(data, capacity * 2);
+         if (d == NULL)
+         {
+            goto error;
+         }
+         data = d;
+         capacity *= 2;
+      }
+   }
+
+   if (ferror(file))
+   {
+      pgmoneta_log_error("Error: Failed to read the complete data");
+      goto error;
+   }
+
+   ret = pgmoneta_wal_parse_wal_buffer(data, size, name, server, filter, wal_file);
+
+   free(data);
+
+   return ret;
+
+error:
+
+   free(data);
+
+   return 1;
+}
+
+int
+pgmoneta_wal_parse_wal_buffer(char* data, size_t size, char* name, int server, struct wal_filter* filter, struct walfile* wal_file)
+{
+   struct xlog_record record;
    struct xlog_long_page_header_data* long_header = NULL;
+   struct xlog_page_header_data page_header;
+   char* payload = NULL;
    char* buffer = NULL;
+   uint32_t buffer_size = 0;
+   uint32_t crc;
    struct decoded_xlog_record* decoded = NULL;
-   struct xlog_page_header_data* page_header = NULL;
    struct configuration* config = NULL;
    timeline_id tli = 0;
    xlog_seg_no logSegNo = 0;
    xlog_rec_ptr base;
-   int wal_segz_bytes = DEFAULT_WAL_SEGZ_BYTES;
+   uint32_t block_size;
+   size_t next_record;
+   size_t position;
+   size_t end_of_page;
+   int page_number = 0;
 
    config = (struct configuration*) shmem;
 
-   FILE* file = fopen(path, "rb");
-   if (file == NULL)
+   if (size < SIZE_OF_XLOG_LONG_PHD)
    {
-      pgmoneta_log_fatal("Error: Could not open file %s", path);
+      pgmoneta_log_error("Error: Failed to read the complete data");
       goto error;
    }
 
-   // calculate the size of the file
-   fseek(file, 0, SEEK_END);
-   wal_segz_bytes = ftell(file);
-   fseek(file, 0, SEEK_SET);
+   long_header = malloc(SIZE_OF_XLOG_LONG_PHD);
+   if (long_header == NULL)
+   {
+      pgmoneta_log_fatal("Error: Could not allocate memory for long_header");
+      goto error;
+   }
 
-   MALLOC(long_header, SIZE_OF_XLOG_LONG_PHD);
-   size_t bytes_read = fread(long_header, SIZE_OF_XLOG_LONG_PHD, 1, file);
+   memcpy(long_header, data, SIZE_OF_XLOG_LONG_PHD);
+   wal_file->long_phd = long_header;
+   block_size = long_header->xlp_xlog_blcksz;
 
-   if (bytes_read < 0)
+   if (magic_value_to_postgres_version(long_header->std.xlp_magic) == -1 ||
+       block_size < SIZE_OF_XLOG_LONG_PHD || (block_size & (block_size - 1)) != 0)
    {
-      pgmoneta_log_error("Error: Failed to read the complete data");
+      pgmoneta_log_error("Error: %s is not a WAL segment", name);
       goto error;
    }
 
-   assert(magic_value_to_postgres_version(long_header->std.xlp_magic) != -1);
-
    if (server == -1)
    {
       config->servers[0].version = magic_value_to_postgres_version(long_header->std.xlp_magic);
@@ -224,183 +350,202 @@ pgmoneta_wal_parse_wal_file(char* path, int server, struct walfile* wal_file)
 
    if (long_header->std.xlp_rem_len > 0)
    {
-      decoded = malloc(sizeof(struct decoded_xlog_record));
-      decoded->partial = true;
-      if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
+      if (add_partial_record(wal_file))
       {
          goto error;
       }
    }
 
-   uint32_t next_record = MAXALIGN(
-      ftell(file) +
-      ((long_header->std.xlp_rem_len / long_header->xlp_xlog_blcksz) * SIZE_OF_XLOG_SHORT_PHD) +
-      long_header->std.xlp_rem_len % long_header->xlp_xlog_blcksz
+   next_record = MAXALIGN(
+      SIZE_OF_XLOG_LONG_PHD +
+      ((long_header->std.xlp_rem_len / block_size) * SIZE_OF_XLOG_SHORT_PHD) +
+      long_header->std.xlp_rem_len % block_size
       );
-   int page_number = 0;
-   wal_file->long_phd = long_header;
 
-   read_all_page_headers(file, long_header, wal_file);
-   fseek(file, next_record, SEEK_SET);
+   read_all_page_headers(data, size, long_header, wal_file);
 
-   if (xlog_from_file_name(basename(path), &tli, &logSegNo, wal_segz_bytes))
+   if (xlog_from_file_name(name, &tli, &logSegNo, size))
    {
       pgmoneta_log_fatal("Failed to extract LSN from the filename");
       goto error;
    }
-   XLOG_SEG_NO_OFFEST_TO_REC_PTR(logSegNo, 0, wal_segz_bytes, base);
+   XLOG_SEG_NO_OFFEST_TO_REC_PTR(logSegNo, 0, size, base);
 
    while (true)
    {
       // Check if next record is beyond the current page
-      if (next_record >= (long_header->xlp_xlog_blcksz * (page_number + 1)))
+      if (next_record >= (size_t)block_size * (page_number + 1))
       {
          page_number++;
-         fseek(file, page_number * long_header->xlp_xlog_blcksz, SEEK_SET);
-         MALLOC(page_header, SIZE_OF_XLOG_SHORT_PHD);
-         size_t bytes_read = fread(page_header, SIZE_OF_XLOG_SHORT_PHD, 1, file);
-         if (feof(file))
+         position = (size_t)page_number * block_size;
+         if (position + SIZE_OF_XLOG_SHORT_PHD > size)
          {
-            decoded = calloc(1, sizeof(struct decoded_xlog_record));
-            decoded->partial = true;
-            if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
+            if (add_partial_record(wal_file))
             {
                goto error;
             }
-            free(page_header);
             goto finish;
          }
-         if (bytes_read <= 0)
-         {
-            pgmoneta_log_error("Error: Failed to read the complete data");
-            goto error;
-         }
-         next_record = MAXALIGN(ftell(file) + page_header->xlp_rem_len);
-         free(page_header);
+         memcpy(&page_header, data + position, SIZE_OF_XLOG_SHORT_PHD);
+         next_record = MAXALIGN(position + SIZE_OF_XLOG_SHORT_PHD + page_header.xlp_rem_len);
          continue;
       }
-      fseek(file, next_record, SEEK_SET);
+      position = next_record;
+      end_of_page = (size_t)block_size * (page_number + 1);
 
-      // Check if record crosses the page boundary
-      if (ftell(file) + SIZE_OF_XLOG_RECORD > long_header->xlp_xlog_blcksz * (page_number + 1))
+      // Check if record header crosses the page boundary
+      if (position + SIZE_OF_XLOG_RECORD > end_of_page)
       {
-         char* temp_buffer = NULL;
-         MALLOC(temp_buffer, SIZE_OF_XLOG_RECORD)
-         uint32_t end_of_page = (page_number + 1) * long_header->xlp_xlog_blcksz;
-         size_t bytes_read = fread(temp_buffer, 1, end_of_page - ftell(file), file);
+         size_t first = end_of_page - position;
 
-         fseek(file, SIZE_OF_XLOG_SHORT_PHD, SEEK_CUR);
-         bytes_read += fread(temp_buffer + bytes_read, 1, SIZE_OF_XLOG_RECORD - bytes_read, file);
-
-         if (feof(file) && bytes_read != SIZE_OF_XLOG_RECORD)
+         if (end_of_page + SIZE_OF_XLOG_SHORT_PHD + (SIZE_OF_XLOG_RECORD - first) > size)
          {
-            free(temp_buffer);
-            decoded = calloc(1, sizeof(struct decoded_xlog_record));
-            decoded->partial = true;
-            if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
+            if (add_partial_record(wal_file))
             {
                goto error;
             }
             goto finish;
          }
 
-         assert(bytes_read == SIZE_OF_XLOG_RECORD);
-         record = (struct xlog_record*) temp_buffer;
+         memcpy(&record, data + position, first);
+         memcpy((char*)&record + first, data + end_of_page + SIZE_OF_XLOG_SHORT_PHD, SIZE_OF_XLOG_RECORD - first);
+         position = end_of_page + SIZE_OF_XLOG_SHORT_PHD + (SIZE_OF_XLOG_RECORD - first);
          page_number++;
       }
       else
       {
-         MALLOC(record, SIZE_OF_XLOG_RECORD)
-         size_t bytes_read = fread(record, SIZE_OF_XLOG_RECORD, 1, file);
-         if (bytes_read < 0)
+         if (position + SIZE_OF_XLOG_RECORD > size)
          {
-            pgmoneta_log_error("Error: Failed to read the complete data");
-            goto error;
+            break;
          }
+         memcpy(&record, data + position, SIZE_OF_XLOG_RECORD);
+         position += SIZE_OF_XLOG_RECORD;
       }
 
-      if (record->xl_tot_len == 0)
+      if (record.xl_tot_len == 0)
       {
-         free(record);
          break;
       }
-      uint32_t data_length = record->xl_tot_len - SIZE_OF_XLOG_RECORD;
-      xlog_rec_ptr lsn = ftell(file) + base - SIZE_OF_XLOG_RECORD;
-      next_record = ftell(file) + MAXALIGN(record->xl_tot_len - SIZE_OF_XLOG_RECORD);
-      uint32_t end_of_page = (page_number + 1) * long_header->xlp_xlog_blcksz;
+      uint32_t data_length = record.xl_tot_len - SIZE_OF_XLOG_RECORD;
+      xlog_rec_ptr lsn = position + base - SIZE_OF_XLOG_RECORD;
+      next_record = position + MAXALIGN(record.xl_tot_len - SIZE_OF_XLOG_RECORD);
+      end_of_page = (size_t)block_size * (page_number + 1);
+
+      if (filter != NULL)
+      {
+         // Records are in LSN order, so nothing after this one can match
+         if (filter->end_lsn > 0 && lsn > filter->end_lsn)
+         {
+            goto finish;
+         }
 
-      MALLOC(buffer, data_length)
+         // The header has everything the filters look at, so skip the payload
+         if (!is_included(RmgrTable[record.xl_rmid].name, filter->rms,
+                          record.xl_prev, filter->start_lsn,
+                          lsn, filter->end_lsn,
+                          record.xl_xid, filter->xids))
+         {
+            continue;
+         }
+      }
 
-      // Read record data, possibly across page boundaries
-      if (data_length + ftell(file) >= end_of_page)
+      if (position + data_length <= end_of_page && position + data_length <= size)
       {
-         size_t bytes_read = 0;
-         size_t total_bytes_read = 0;
-         uint32_t remaining_data_length = data_length;
-         bytes_read = fread(buffer, 1, end_of_page - ftell(file), file);
-         total_bytes_read += bytes_read;
-         remaining_data_length -= bytes_read;
-         while (remaining_data_length != 0)
+         // The record is on a single page, so it is decoded where it is
+         payload = data + position;
+      }
+      else
+      {
+         // Reassemble the record data across the page boundaries
+         size_t copied = 0;
+         size_t chunk = MIN((size_t)data_length, end_of_page - position);
+
+         if (data_length > buffer_size)
+         {
+            free(buffer);
+            buffer = malloc(data_length);
+            if (buffer == NULL)
+            {
+               pgmoneta_log_fatal("Error: Could not allocate memory for buffer");
+               goto error;
+            }
+            buffer_size = data_length;
+         }
+
+         if (position + chunk > size)
+         {
+            if (add_partial_record(wal_file))
+            {
+               goto error;
+            }
+            goto finish;
+         }
+
+         memcpy(buffer, data + position, chunk);
+         copied = chunk;
+         position = end_of_page;
+
+         while (copied < data_length)
          {
-            if (feof(file))
+            position += SIZE_OF_XLOG_SHORT_PHD;
+            chunk = MIN((size_t)(data_length - copied), (size_t)(block_size - SIZE_OF_XLOG_SHORT_PHD));
+
+            if (position + chunk > size)
             {
-               free(record);
-               decoded = calloc(1, sizeof(struct decoded_xlog_record));
-               decoded->partial = true;
-               if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
+               if (add_partial_record(wal_file))
                {
                   goto error;
                }
-               free(buffer);
                goto finish;
             }
-            fseek(file, SIZE_OF_XLOG_SHORT_PHD, SEEK_CUR);
-            bytes_read = fread(buffer + total_bytes_read, 1,
-                               MIN(remaining_data_length, long_header->xlp_xlog_blcksz - SIZE_OF_XLOG_SHORT_PHD), file);
-            remaining_data_length -= bytes_read;
-            total_bytes_read += bytes_read;
+
+            memcpy(buffer + copied, data + position, chunk);
+            copied += chunk;
+            position += chunk;
          }
-         assert(total_bytes_read == data_length);
+
+         payload = buffer;
       }
-      else
-      {
-         size_t bytes_read = fread(buffer, 1, data_length, file);
 
-         if (bytes_read != data_length)
-         {
-            pgmoneta_log_error("Error: Actual bytes read do not match the expected length");
-            goto error;
-         }
+      // The CRC covers the record data and then the header up to the CRC itself
+      crc = 0;
+      pgmoneta_create_crc32c_buffer(payload, data_length, &crc);
+      pgmoneta_create_crc32c_buffer(&record, offsetof(struct xlog_record, xl_crc), &crc);
+      if (crc != record.xl_crc)
+      {
+         pgmoneta_log_warn("Invalid CRC for the WAL record at %X/%X in %s",
+                           (uint32_t)(lsn >> 32), (uint32_t)lsn, name);
+         goto finish;
       }
 
-      decoded = calloc(1, sizeof(struct decoded_xlog_record));
+      decoded = record_alloc(wal_file->arena, sizeof(struct decoded_xlog_record));
+      if (decoded == NULL)
+      {
+         goto error;
+      }
 
-      if (decode_xlog_record(buffer, decoded, record, long_header->xlp_xlog_blcksz, long_header->std.xlp_magic, lsn))
+      if (decode_xlog_record(payload, decoded, &record, block_size, long_header->std.xlp_magic, lsn, wal_file->arena))
       {
          goto error;
       }
-      else
+
+      if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
       {
-         if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
-         {
-            goto error;
-         }
+         goto error;
       }
-      free(buffer);
-      free(record);
    }
 finish:
-   fclose(file);
+   free(buffer);
    return 0;
 
 error:
+   free(buffer);
    pgmoneta_log_fatal("Error: Could not parse WAL file");
-   fclose(file);
    return 1;
 }
 
 static int
-decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn)
+decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn, struct arena* arena)
 {
 #define COPY_HEADER_FIELD(_dst, _size)          \
         do {                                        \
@@ -613,13 +758,13 @@ decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlo
       if (blk->has_image)
       {
          /* no need to align image */
-         blk->bkp_image = malloc(blk->bimg_len);
+         blk->bkp_image = record_alloc(arena, blk->bimg_len);
          memcpy(blk->bkp_image, ptr, blk->bimg_len);
          ptr += blk->bimg_len;
       }
       if (blk->has_data)
       {
-         blk->data = malloc(blk->data_len);
+         blk->data = record_alloc(arena, blk->data_len);
          memcpy(blk->data, ptr, blk->data_len);
          ptr += blk->data_len;
       }
@@ -627,7 +772,7 @@ decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlo
 
    if (decoded->main_data_len > 0)
    {
-      decoded->main_data = malloc(decoded->main_data_len);
+      decoded->main_data = record_alloc(arena, decoded->main_data_len);
       if (decoded->main_data == NULL)
       {
          goto
@@ -893,11 +1038,7 @@ pgmoneta_wal_record_display(struct decoded_xlog_record* record, uint16_t magic_v
                             struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids, uint32_t limit)
 {
    static uint32_t current_limit = 0;
-   char* header_str = NULL;
-   char* rm_desc = NULL;
-   char* backup_str = NULL;
-   char* start_lsn_string = NULL;
-   char* end_lsn_string = NULL;
+   char* desc = NULL;
    struct value* record_serialized = NULL;
    char* value_str = NULL;
    uint32_t rec_len = 0;
@@ -954,52 +1095,550 @@ pgmoneta_wal_record_display(struct decoded_xlog_record* record, uint16_t magic_v
             return;
          }
          get_record_length(record, &rec_len, &fpi_len);
-         start_lsn_string = pgmoneta_lsn_to_string(record->header.xl_prev);
-         end_lsn_string = pgmoneta_lsn_to_string(record->lsn);
+
+         // The description and the block references share one buffer, and the header goes straight to the output
+         desc = RmgrTable[record->header.xl_rmid].rm_desc(desc, record);
+         desc = pgmoneta_append_char(desc, ' ');
+         desc = get_record_block_ref_info(desc, record, false, true, &fpi_len, magic_value);
 
          if (color)
          {
-            header_str = pgmoneta_format_and_append(header_str, "%s%s%s | %s%s%s | %s%s%s | %s%d%s | %s%d%s | %s%d%s",
-                                                    COLOR_RED, RmgrTable[record->header.xl_rmid].name, COLOR_RESET,
-                                                    COLOR_MAGENTA, start_lsn_string, COLOR_RESET,
-                                                    COLOR_MAGENTA, end_lsn_string, COLOR_RESET,
-                                                    COLOR_BLUE, rec_len, COLOR_RESET,
-                                                    COLOR_YELLOW, record->header.xl_tot_len, COLOR_RESET,
-                                                    COLOR_CYAN, record->header.xl_xid, COLOR_RESET);
+            fprintf(out, "%s%s%s | %s%X/%X%s | %s%X/%X%s | %s%d%s | %s%d%s | %s%d%s%s | %s%s%s\n",
+                    COLOR_RED, RmgrTable[record->header.xl_rmid].name, COLOR_RESET,
+                    COLOR_MAGENTA, (uint32_t)(record->header.xl_prev >> 32), (uint32_t)record->header.xl_prev, COLOR_RESET,
+                    COLOR_MAGENTA, (uint32_t)(record->lsn >> 32), (uint32_t)record->lsn, COLOR_RESET,
+                    COLOR_BLUE, rec_len, COLOR_RESET,
+                    COLOR_YELLOW, record->header.xl_tot_len, COLOR_RESET,
+                    COLOR_CYAN, record->header.xl_xid, COLOR_RESET, COLOR_WHITE,
+                    COLOR_GREEN, desc, COLOR_RESET);
          }
          else
          {
-            header_str = pgmoneta_format_and_append(header_str, "%s | %s | %s | %d | %d | %d",
-                                                    RmgrTable[record->header.xl_rmid].name,
-                                                    start_lsn_string,
-                                                    end_lsn_string,
-                                                    rec_len,
-                                                    record->header.xl_tot_len,
-                                                    record->header.xl_xid);
+            fprintf(out, "%s | %X/%X | %X/%X | %d | %d | %d | %s\n",
+                    RmgrTable[record->header.xl_rmid].name,
+                    (uint32_t)(record->header.xl_prev >> 32), (uint32_t)record->header.xl_prev,
+                    (uint32_t)(record->lsn >> 32), (uint32_t)record->lsn,
+                    rec_len,
+                    record->header.xl_tot_len,
+                    record->header.xl_xid,
+                    desc);
          }
 
-         rm_desc = RmgrTable[record->header.xl_rmid].rm_desc(rm_desc, record);
-         backup_str = get_record_block_ref_info(backup_str, record, false, true, &fpi_len, magic_value);
+         free(desc);
+      }
+   }
+}
 
-         if (color)
+int
+pgmoneta_wal_record_csv_header(struct csv_writer* writer)
+{
+   char* cols[WAL_CSV_COLUMNS] = {"ResourceManager", "StartLSN", "EndLSN", "RecordLength", "TotalLength",
+                                  "Xid", "Info", "Crc", "Data", "Description"};
+
+   return pgmoneta_csv_write(writer, WAL_CSV_COLUMNS, cols);
+}
+
+int
+pgmoneta_wal_record_csv(struct decoded_xlog_record* record, uint16_t magic_value, struct csv_writer* writer,
+                        struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids, uint32_t limit)
+{
+   static uint32_t current_limit = 0;
+   int ret = 0;
+   uint32_t rec_len = 0;
+   uint32_t fpi_len = 0;
+   char* rm_desc = NULL;
+   char* backup_str = NULL;
+   char numbers[7][MISC_LENGTH];
+   char* cols[WAL_CSV_COLUMNS];
+
+   // a record that goes on in the next segment has no row
+   if (record->partial)
+   {
+      return 0;
+   }
+
+   if (!is_included(RmgrTable[record->header.xl_rmid].name, rms,
+                    record->header.xl_prev, start_lsn,
+                    record->lsn, end_lsn,
+                    record->header.xl_xid, xids))
+   {
+      return 0;
+   }
+
+   current_limit++;
+   if (limit > 0 && current_limit > limit)
+   {
+      return 0;
+   }
+
+   get_record_length(record, &rec_len, &fpi_len);
+
+   rm_desc = RmgrTable[record->header.xl_rmid].rm_desc(rm_desc, record);
+   backup_str = get_record_block_ref_info(backup_str, record, false, true, &fpi_len, magic_value);
+
+   memset(numbers, 0, sizeof(numbers));
+   snprintf(numbers[0], MISC_LENGTH, "%" PRIu64, (uint64_t)record->header.xl_prev);
+   snprintf(numbers[1], MISC_LENGTH, "%" PRIu64, (uint64_t)record->lsn);
+   snprintf(numbers[2], MISC_LENGTH, "%u", rec_len);
+   snprintf(numbers[3], MISC_LENGTH, "%u", record->header.xl_tot_len);
+   snprintf(numbers[4], MISC_LENGTH, "%u", record->header.xl_xid);
+   snprintf(numbers[5], MISC_LENGTH, "%u", record->header.xl_info);
+   snprintf(numbers[6], MISC_LENGTH, "%u", record->header.xl_crc);
+
+   cols[0] = RmgrTable[record->header.xl_rmid].name;
+   cols[1] = numbers[0];
+   cols[2] = numbers[1];
+   cols[3] = numbers[2];
+   cols[4] = numbers[3];
+   cols[5] = numbers[4];
+   cols[6] = numbers[5];
+   cols[7] = numbers[6];
+   cols[8] = rm_desc;
+   cols[9] = backup_str;
+
+   ret = pgmoneta_csv_write(writer, WAL_CSV_COLUMNS, cols);
+
+   free(rm_desc);
+   free(backup_str);
+
+   return ret;
+}
+
+int
+pgmoneta_wal_stats_create(struct wal_stats** stats)
+{
+   struct wal_stats* s = NULL;
+
+   *stats = NULL;
+
+   s = (struct wal_stats*)calloc(1, sizeof(struct wal_stats));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   s->relations_size = WAL_STATS_RELATIONS;
+   s->relations = (struct wal_stats_relation*)calloc(s->relations_size, sizeof(struct wal_stats_relation));
+   if (s->relations == NULL)
+   {
+      goto error;
+   }
+
+   *stats = s;
+
+   return 0;
+
+error:
+
+   free(s);
+
+   return 1;
+}
+
+int
+pgmoneta_wal_stats_add(struct wal_stats* stats, struct decoded_xlog_record* record)
+{
+   uint32_t rec_len = 0;
+   uint32_t fpi_len = 0;
+   uint8_t rmid = 0;
+   uint8_t info = 0;
+   bool seen = false;
+   timestamp_tz xact_time = 0;
+   struct wal_stats_relation* relation = NULL;
+
+   if (record->partial)
+   {
+      return 0;
+   }
+
+   get_record_length(record, &rec_len, &fpi_len);
+
+   rmid = record->header.xl_rmid;
+
+   stats->records++;
+   stats->bytes += record->header.xl_tot_len;
+   stats->fpi_bytes += fpi_len;
+   stats->rm_records[rmid]++;
+   stats->rm_bytes[rmid] += record->header.xl_tot_len;
+   stats->rm_fpi_bytes[rmid] += fpi_len;
+
+   for (int block_id = 0; block_id <= record->max_block_id; block_id++)
+   {
+      if (!XLogRecHasBlockRef(record, block_id))
+      {
+         continue;
+      }
+
+      relation = stats_relation(stats, &record->blocks[block_id].rlocator);
+      if (relation == NULL)
+      {
+         return 1;
+      }
+
+      // a record with several blocks of a relation counts once for it
+      seen = false;
+      for (int i = 0; i < block_id && !seen; i++)
+      {
+         seen = XLogRecHasBlockRef(record, i) &&
+                stats_same_relation(&record->blocks[i].rlocator, &record->blocks[block_id].rlocator);
+      }
+
+      if (!seen)
+      {
+         relation->records++;
+      }
+
+      if (XLogRecHasBlockImage(record, block_id))
+      {
+         stats->fpi++;
+         relation->fpi++;
+      }
+   }
+
+   if (rmid == WAL_STATS_RM_XACT)
+   {
+      info = record->header.xl_info & XLOG_XACT_OPMASK;
+
+      if (info == XLOG_XACT_COMMIT || info == XLOG_XACT_COMMIT_PREPARED)
+      {
+         stats->commits++;
+
+         // the commit records start with the commit time
+         if (record->main_data_len >= sizeof(timestamp_tz))
          {
-            fprintf(out, "%s%s%s | %s%s %s%s\n",
-                    COLOR_RED, header_str, COLOR_WHITE,
-                    COLOR_GREEN, rm_desc,
-                    backup_str, COLOR_RESET);
+            memcpy(&xact_time, record->main_data, sizeof(timestamp_tz));
+            stats_commit_time(stats, xact_time);
          }
-         else
+      }
+      else if (info == XLOG_XACT_ABORT || info == XLOG_XACT_ABORT_PREPARED)
+      {
+         stats->aborts++;
+      }
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_wal_stats_merge(struct wal_stats* stats, struct wal_stats* other)
+{
+   struct wal_stats_relation* relation = NULL;
+
+   stats->records += other->records;
+   stats->bytes += other->bytes;
+   stats->fpi += other->fpi;
+   stats->fpi_bytes += other->fpi_bytes;
+   stats->commits += other->commits;
+   stats->aborts += other->aborts;
+
+   for (int i = 0; i < WAL_STATS_RMGRS; i++)
+   {
+      stats->rm_records[i] += other->rm_records[i];
+      stats->rm_bytes[i] += other->rm_bytes[i];
+      stats->rm_fpi_bytes[i] += other->rm_fpi_bytes[i];
+   }
+
+   if (other->first_commit != 0)
+   {
+      stats_commit_time(stats, other->first_commit);
+      stats_commit_time(stats, other->last_commit);
+   }
+
+   for (size_t i = 0; i < other->relations_size; i++)
+   {
+      if (!other->relations[i].used)
+      {
+         continue;
+      }
+
+      relation = stats_relation(stats, &other->relations[i].rlocator);
+      if (relation == NULL)
+      {
+         return 1;
+      }
+
+      relation->records += other->relations[i].records;
+      relation->fpi += other->relations[i].fpi;
+   }
+
+   return 0;
+}
+
+void
+pgmoneta_wal_stats_display(struct wal_stats* stats, enum value_type type, FILE* out, uint32_t limit)
+{
+   size_t n = 0;
+   double seconds = 0.0;
+   double rate = 0.0;
+   double share = 0.0;
+   char* name = NULL;
+   char* str = NULL;
+   struct wal_stats_relation** relations = NULL;
+   struct json* json = NULL;
+   struct json* rmgrs = NULL;
+   struct json* rels = NULL;
+   struct json* entry = NULL;
+
+   relations = (struct wal_stats_relation**)calloc(MAX(stats->number_of_relations, 1), sizeof(struct wal_stats_relation*));
+   if (relations == NULL)
+   {
+      return;
+   }
+
+   for (size_t i = 0; i < stats->relations_size; i++)
+   {
+      if (stats->relations[i].used)
+      {
+         relations[n++] = &stats->relations[i];
+      }
+   }
+
+   qsort(relations, n, sizeof(struct wal_stats_relation*), stats_compare_relations);
+
+   if (limit > 0 && n > limit)
+   {
+      n = limit;
+   }
+
+   // the commit times are in microseconds
+   seconds = (double)(stats->last_commit - stats->first_commit) / 1000000.0;
+   if (seconds > 0.0)
+   {
+      rate = (double)stats->commits / seconds;
+   }
+
+   if (type == ValueJSON)
+   {
+      if (pgmoneta_json_create(&json) || pgmoneta_json_create(&rmgrs) || pgmoneta_json_create(&rels))
+      {
+         goto done;
+      }
+
+      pgmoneta_json_put(json, "Records", stats->records, ValueUInt64);
+      pgmoneta_json_put(json, "Bytes", stats->bytes, ValueUInt64);
+      pgmoneta_json_put(json, "FullPageImages", stats->fpi, ValueUInt64);
+      pgmoneta_json_put(json, "FullPageImageBytes", stats->fpi_bytes, ValueUInt64);
+      pgmoneta_json_put(json, "Commits", stats->commits, ValueUInt64);
+      pgmoneta_json_put(json, "CommitsPerSecond", pgmoneta_value_from_double(rate), ValueDouble);
+      pgmoneta_json_put(json, "Aborts", stats->aborts, ValueUInt64);
+
+      for (int i = 0; i < WAL_STATS_RMGRS; i++)
+      {
+         if (stats->rm_records[i] == 0)
+         {
+            continue;
+         }
+
+         name = RmgrTable[i].name != NULL ? RmgrTable[i].name : "Unknown";
+
+         if (pgmoneta_json_create(&entry))
+         {
+            goto done;
+         }
+
+         pgmoneta_json_put(entry, "ResourceManager", (uintptr_t)name, ValueString);
+         pgmoneta_json_put(entry, "Records", stats->rm_records[i], ValueUInt64);
+         pgmoneta_json_put(entry, "Bytes", stats->rm_bytes[i], ValueUInt64);
+         pgmoneta_json_put(entry, "FullPageImageBytes", stats->rm_fpi_bytes[i], ValueUInt64);
+         pgmoneta_json_append(rmgrs, (uintptr_t)entry, ValueJSON);
+         entry = NULL;
+      }
+
+      for (size_t i = 0; i < n; i++)
+      {
+         if (pgmoneta_json_create(&entry))
          {
-            fprintf(out, "%s | %s %s\n", header_str, rm_desc, backup_str);
+            goto done;
          }
 
-         free(header_str);
-         free(rm_desc);
-         free(backup_str);
-         free(start_lsn_string);
-         free(end_lsn_string);
+         pgmoneta_json_put(entry, "Tablespace", relations[i]->rlocator.spcOid, ValueUInt32);
+         pgmoneta_json_put(entry, "Database", relations[i]->rlocator.dbOid, ValueUInt32);
+         pgmoneta_json_put(entry, "Relation", relations[i]->rlocator.relNumber, ValueUInt32);
+         pgmoneta_json_put(entry, "Records", relations[i]->records, ValueUInt64);
+         pgmoneta_json_put(entry, "FullPageImages", relations[i]->fpi, ValueUInt64);
+         pgmoneta_json_append(rels, (uintptr_t)entry, ValueJSON);
+         entry = NULL;
+      }
+
+      pgmoneta_json_put(json, "ResourceManagers", (uintptr_t)rmgrs, ValueJSON);
+      rmgrs = NULL;
+      pgmoneta_json_put(json, "Relations", (uintptr_t)rels, ValueJSON);
+      rels = NULL;
+
+      str = pgmoneta_json_to_string(json, FORMAT_JSON, NULL, 0);
+      if (str != NULL)
+      {
+         fprintf(out, "%s\n", str);
       }
    }
+   else
+   {
+      share = stats->bytes > 0 ? 100.0 * (double)stats->fpi_bytes / (double)stats->bytes : 0.0;
+
+      fprintf(out, "Records: %" PRIu64 "\n", stats->records);
+      fprintf(out, "Bytes: %" PRIu64 "\n", stats->bytes);
+      fprintf(out, "Full page images: %" PRIu64 " (%" PRIu64 " bytes, %.2f%%)\n", stats->fpi, stats->fpi_bytes, share);
+      fprintf(out, "Commits: %" PRIu64 " (%.2f/s)\n", stats->commits, rate);
+      fprintf(out, "Aborts: %" PRIu64 "\n", stats->aborts);
+
+      fprintf(out, "\n%-20s %12s %16s %16s %8s\n", "Resource manager", "Records", "Bytes", "FPI bytes", "Bytes %");
+      for (int i = 0; i < WAL_STATS_RMGRS; i++)
+      {
+         if (stats->rm_records[i] == 0)
+         {
+            continue;
+         }
+
+         name = RmgrTable[i].name != NULL ? RmgrTable[i].name : "Unknown";
+         share = stats->bytes > 0 ? 100.0 * (double)stats->rm_bytes[i] / (double)stats->bytes : 0.0;
+
+         fprintf(out, "%-20s %12" PRIu64 " %16" PRIu64 " %16" PRIu64 " %7.2f%%\n",
+                 name, stats->rm_records[i], stats->rm_bytes[i], stats->rm_fpi_bytes[i], share);
+      }
+
+      fprintf(out, "\n%-32s %12s %12s\n", "Relation", "Records", "FPI");
+      for (size_t i = 0; i < n; i++)
+      {
+         char relation[MISC_LENGTH];
+
+         snprintf(&relation[0], sizeof(relation), "%u/%u/%u",
+                  relations[i]->rlocator.spcOid, relations[i]->rlocator.dbOid, relations[i]->rlocator.relNumber);
+
+         fprintf(out, "%-32s %12" PRIu64 " %12" PRIu64 "\n", relation, relations[i]->records, relations[i]->fpi);
+      }
+   }
+
+done:
+
+   pgmoneta_json_destroy(entry);
+   pgmoneta_json_destroy(rmgrs);
+   pgmoneta_json_destroy(rels);
+   pgmoneta_json_destroy(json);
+   free(str);
+   free(relations);
+}
+
+void
+pgmoneta_wal_stats_destroy(struct wal_stats* stats)
+{
+   if (stats == NULL)
+   {
+      return;
+   }
+
+   free(stats->relations);
+   free(stats);
+}
+
+static struct wal_stats_relation*
+stats_relation(struct wal_stats* stats, struct rel_file_locator* rlocator)
+{
+   size_t i = 0;
+
+   // the table is kept at most three quarters full
+   if ((stats->number_of_relations + 1) * 4 > stats->relations_size * 3 && stats_grow(stats))
+   {
+      return NULL;
+   }
+
+   i = stats_hash(rlocator) & (stats->relations_size - 1);
+   while (stats->relations[i].used)
+   {
+      if (stats_same_relation(&stats->relations[i].rlocator, rlocator))
+      {
+         return &stats->relations[i];
+      }
+
+      i = (i + 1) & (stats->relations_size - 1);
+   }
+
+   stats->relations[i].used = true;
+   stats->relations[i].rlocator = *rlocator;
+   stats->number_of_relations++;
+
+   return &stats->relations[i];
+}
+
+static int
+stats_grow(struct wal_stats* stats)
+{
+   size_t size = stats->relations_size * 2;
+   size_t j = 0;
+   struct wal_stats_relation* relations = NULL;
+
+   relations = (struct wal_stats_relation*)calloc(size, sizeof(struct wal_stats_relation));
+   if (relations == NULL)
+   {
+      return 1;
+   }
+
+   for (size_t i = 0; i < stats->relations_size; i++)
+   {
+      if (!stats->relations[i].used)
+      {
+         continue;
+      }
+
+      j = stats_hash(&stats->relations[i].rlocator) & (size - 1);
+      while (relations[j].used)
+      {
+         j = (j + 1) & (size - 1);
+      }
+
+      relations[j] = stats->relations[i];
+   }
+
+   free(stats->relations);
+   stats->relations = relations;
+   stats->relations_size = size;
+
+   return 0;
+}
+
+static size_t
+stats_hash(struct rel_file_locator* rlocator)
+{
+   uint64_t h = 0;
+
+   h = (uint64_t)rlocator->relNumber * 0x9E3779B97F4A7C15ULL;
+   h ^= ((uint64_t)rlocator->dbOid << 32 | rlocator->spcOid) * 0xC2B2AE3D27D4EB4FULL;
+   h ^= h >> 29;
+
+   return (size_t)h;
+}
+
+static bool
+stats_same_relation(struct rel_file_locator* a, struct rel_file_locator* b)
+{
+   return a->relNumber == b->relNumber && a->dbOid == b->dbOid && a->spcOid == b->spcOid;
+}
+
+static void
+stats_commit_time(struct wal_stats* stats, timestamp_tz time)
+{
+   if (stats->first_commit == 0 || time < stats->first_commit)
+   {
+      stats->first_commit = time;
+   }
+
+   if (stats->last_commit == 0 || time > stats->last_commit)
+   {
+      stats->last_commit = time;
+   }
+}
+
+static int
+stats_compare_relations(const void* a, const void* b)
+{
+   struct wal_stats_relation* ra = *(struct wal_stats_relation**)a;
+   struct wal_stats_relation* rb = *(struct wal_stats_relation**)b;
+
+   if (ra->records != rb->records)
+   {
+      return ra->records < rb->records ? 1 : -1;
+   }
+
+   return 0;
 }
 
 static bool
@@ -1308,3 +1947,30 @@ pgmoneta_wal_encode_xlog_record(struct decoded_xlog_record* decoded, uint16_t ma
 
    return buffer;
 }
+
+static void*
+record_alloc(struct arena* arena, size_t size)
+{
+   if (arena != NULL)
+   {
+      return pgmoneta_arena_alloc(arena, size);
+   }
+
+   return calloc(1, size);
+}
+
+static int
+add_partial_record(struct walfile* wal_file)
+{
+   struct decoded_xlog_record* decoded = NULL;
+
+   decoded = record_alloc(wal_file->arena, sizeof(struct decoded_xlog_record));
+   if (decoded == NULL)
+   {
+      return 1;
+   }
+
+   decoded->partial = true;
+
+   return pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef);
+}
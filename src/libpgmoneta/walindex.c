@@ -0,0 +1,1177 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <deque.h>
+#include <logging.h>
+#include <utils.h>
+#include <walfile.h>
+#include <walindex.h>
+#include <walpack.h>
+#include <walfile/rm.h>
+#include <walfile/rm_database.h>
+#include <walfile/rm_storage.h>
+#include <walfile/rm_xact.h>
+#include <walfile/wal_reader.h>
+
+/* system */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WALINDEX_HEADER_SIZE offsetof(struct walindex, relations)
+#define WALINDEX_RM_XACT     1
+#define WALINDEX_RM_SMGR     2
+#define WALINDEX_RM_DBASE    4
+#define WALINDEX_NO_BLOCK    UINT32_MAX
+#define SMGR_TRUNCATE_HEAP   0x0001
+#define WALINDEX_TIME_MARGIN (24LL * 3600LL * 1000000LL)
+#define POSTGRES_EPOCH_USECS (946684800LL * 1000000LL)
+
+/**
+ * A block reference, or a creation or truncation, collected while a segment is indexed
+ */
+struct walindex_block
+{
+   uint32_t spcoid;         /**< The tablespace OID */
+   uint32_t dboid;          /**< The database OID */
+   uint32_t relnumber;      /**< The relation file number */
+   uint32_t fork;           /**< The fork number */
+   uint32_t block;          /**< The block number, WALINDEX_NO_BLOCK for a creation or truncation */
+   uint32_t truncate_block; /**< The block the fork was truncated to */
+   uint32_t flags;          /**< The flags */
+};
+
+static int add_block(struct walindex_block** blocks, size_t* number_of_blocks, size_t* capacity,
+                     struct walindex_block* block);
+static int add_storage_blocks(struct decoded_xlog_record* record, struct walindex_block** blocks,
+                              size_t* number_of_blocks, size_t* capacity);
+static int block_compare(const void* a, const void* b);
+static int summarize_relations(struct walindex_block* blocks, size_t number_of_blocks, struct walindex* index);
+static char* index_path(int server, char* segment);
+static int next_segment(char* segment, uint32_t segment_size, char** next);
+static bool same_timeline(char* a, char* b);
+static int segment_reaches(int server, char* segment, bool has_lsn, uint64_t lsn, int64_t target_time, uint32_t* segment_size);
+static void find_first(int server, char** files, int number_of_files, char* start, bool has_lsn, uint64_t lsn, int64_t target_time,
+                       char** found, uint32_t* found_size);
+
+int
+pgmoneta_walindex_create(int server, char* path)
+{
+   char* segment = NULL;
+   char* d = NULL;
+   char* f = NULL;
+   char* tmp = NULL;
+   FILE* file = NULL;
+   struct walfile* wf = NULL;
+   struct walindex index;
+   struct deque_iterator* record_iterator = NULL;
+   struct decoded_xlog_record* record = NULL;
+   struct walindex_block* blocks = NULL;
+   struct walindex_block block;
+   size_t number_of_blocks = 0;
+   size_t capacity = 0;
+
+   memset(&index, 0, sizeof(struct walindex));
+
+   segment = pgmoneta_walfile_segment_name(path);
+   if (segment == NULL || strlen(segment) != 24)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_read_walfile_filter(server, path, NULL, &wf))
+   {
+      goto error;
+   }
+
+   memcpy(&index.magic[0], WALINDEX_MAGIC, sizeof(index.magic));
+   index.version = WALINDEX_VERSION;
+   sscanf(segment, "%08X", &index.timeline);
+   index.segment_size = wf->long_phd->xlp_seg_size;
+
+   if (pgmoneta_deque_iterator_create(wf->records, &record_iterator))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_deque_iterator_next(record_iterator))
+   {
+      record = (struct decoded_xlog_record*)record_iterator->value->data;
+
+      if (record->partial)
+      {
+         continue;
+      }
+
+      if (index.number_of_records == 0)
+      {
+         index.min_lsn = record->lsn;
+      }
+      index.max_lsn = record->lsn;
+      index.number_of_records++;
+
+      if (record->header.xl_xid != 0)
+      {
+         if (index.min_xid == 0 || record->header.xl_xid < index.min_xid)
+         {
+            index.min_xid = record->header.xl_xid;
+         }
+         index.max_xid = MAX(index.max_xid, record->header.xl_xid);
+      }
+
+      if (record->header.xl_rmid == WALINDEX_RM_XACT)
+      {
+         uint8_t info = record->header.xl_info & XLOG_XACT_OPMASK;
+
+         if ((info == XLOG_XACT_COMMIT || info == XLOG_XACT_COMMIT_PREPARED ||
+              info == XLOG_XACT_ABORT || info == XLOG_XACT_ABORT_PREPARED) &&
+             record->main_data != NULL && record->main_data_len >= sizeof(timestamp_tz))
+         {
+            timestamp_tz xact_time;
+            int64_t t;
+
+            memcpy(&xact_time, record->main_data, sizeof(timestamp_tz));
+            t = (int64_t)xact_time + POSTGRES_EPOCH_USECS;
+
+            if (index.number_of_commits == 0)
+            {
+               index.min_commit_time = t;
+               index.max_commit_time = t;
+            }
+            index.min_commit_time = MIN(index.min_commit_time, t);
+            index.max_commit_time = MAX(index.max_commit_time, t);
+            index.number_of_commits++;
+
+            if (record->header.xl_xid != 0)
+            {
+               if (index.min_commit_xid == 0 || record->header.xl_xid < index.min_commit_xid)
+               {
+                  index.min_commit_xid = record->header.xl_xid;
+               }
+               index.max_commit_xid = MAX(index.max_commit_xid, record->header.xl_xid);
+            }
+         }
+      }
+
+      if ((record->header.xl_rmid == WALINDEX_RM_SMGR || record->header.xl_rmid == WALINDEX_RM_DBASE) &&
+          add_storage_blocks(record, &blocks, &number_of_blocks, &capacity))
+      {
+         goto error;
+      }
+
+      for (int i = 0; i <= record->max_block_id; i++)
+      {
+         if (!record->blocks[i].in_use)
+         {
+            continue;
+         }
+
+         memset(&block, 0, sizeof(struct walindex_block));
+         block.spcoid = record->blocks[i].rlocator.spcOid;
+         block.dboid = record->blocks[i].rlocator.dbOid;
+         block.relnumber = record->blocks[i].rlocator.relNumber;
+         block.fork = (uint32_t)record->blocks[i].forknum;
+         block.block = record->blocks[i].blkno;
+         block.truncate_block = WALINDEX_NO_BLOCK;
+
+         if (add_block(&blocks, &number_of_blocks, &capacity, &block))
+         {
+            goto error;
+         }
+      }
+   }
+
+   pgmoneta_deque_iterator_destroy(record_iterator);
+   record_iterator = NULL;
+
+   if (summarize_relations(blocks, number_of_blocks, &index))
+   {
+      goto error;
+   }
+
+   // The block numbers follow the relation forks in the file
+   number_of_blocks = 0;
+   for (uint32_t i = 0; i < index.number_of_relations; i++)
+   {
+      number_of_blocks += index.relations[i].blocks;
+   }
+
+   d = pgmoneta_get_server_wal_index(server);
+   if (pgmoneta_mkdir(d))
+   {
+      goto error;
+   }
+
+   f = index_path(server, segment);
+   tmp = pgmoneta_append(tmp, f);
+   tmp = pgmoneta_append(tmp, ".tmp");
+
+   file = fopen(tmp, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("WAL index: Could not create %s", tmp);
+      goto error;
+   }
+
+   if (fwrite(&index, WALINDEX_HEADER_SIZE, 1, file) != 1 ||
+       (index.number_of_relations > 0 &&
+        fwrite(index.relations, sizeof(struct walindex_relation), index.number_of_relations, file) != index.number_of_relations) ||
+       (number_of_blocks > 0 &&
+        fwrite(index.block_numbers, sizeof(uint32_t), number_of_blocks, file) != number_of_blocks))
+   {
+      pgmoneta_log_error("WAL index: Could not write %s", tmp);
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (rename(tmp, f))
+   {
+      pgmoneta_log_error("WAL index: Could not rename %s", tmp);
+      goto error;
+   }
+
+   pgmoneta_log_debug("WAL index: %s (%u records, %u commits, %u relations)", segment,
+                      index.number_of_records, index.number_of_commits, index.number_of_relations);
+
+   pgmoneta_destroy_walfile(wf);
+   free(index.relations);
+   free(index.block_numbers);
+   free(blocks);
+   free(segment);
+   free(d);
+   free(f);
+   free(tmp);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+      pgmoneta_delete_file(tmp, NULL);
+   }
+
+   pgmoneta_deque_iterator_destroy(record_iterator);
+   pgmoneta_destroy_walfile(wf);
+   free(index.relations);
+   free(index.block_numbers);
+   free(blocks);
+   free(segment);
+   free(d);
+   free(f);
+   free(tmp);
+
+   return 1;
+}
+
+int
+pgmoneta_walindex_read(int server, char* segment, bool relations, struct walindex** index)
+{
+   char* f = NULL;
+   FILE* file = NULL;
+   struct walindex* wi = NULL;
+
+   *index = NULL;
+
+   f = index_path(server, segment);
+
+   file = fopen(f, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   wi = (struct walindex*)calloc(1, sizeof(struct walindex));
+   if (wi == NULL)
+   {
+      goto error;
+   }
+
+   if (fread(wi, WALINDEX_HEADER_SIZE, 1, file) != 1 ||
+       memcmp(&wi->magic[0], WALINDEX_MAGIC, sizeof(wi->magic)) ||
+       wi->version != WALINDEX_VERSION)
+   {
+      pgmoneta_log_debug("WAL index: Invalid %s", f);
+      goto error;
+   }
+
+   wi->relations = NULL;
+   wi->block_numbers = NULL;
+
+   if (relations && wi->number_of_relations > 0)
+   {
+      size_t number_of_blocks = 0;
+
+      wi->relations = (struct walindex_relation*)calloc(wi->number_of_relations, sizeof(struct walindex_relation));
+      if (wi->relations == NULL)
+      {
+         goto error;
+      }
+
+      if (fread(wi->relations, sizeof(struct walindex_relation), wi->number_of_relations, file) != wi->number_of_relations)
+      {
+         pgmoneta_log_debug("WAL index: Truncated %s", f);
+         goto error;
+      }
+
+      for (uint32_t i = 0; i < wi->number_of_relations; i++)
+      {
+         number_of_blocks += wi->relations[i].blocks;
+      }
+
+      if (number_of_blocks > 0)
+      {
+         wi->block_numbers = (uint32_t*)malloc(number_of_blocks * sizeof(uint32_t));
+         if (wi->block_numbers == NULL)
+         {
+            goto error;
+         }
+
+         if (fread(wi->block_numbers, sizeof(uint32_t), number_of_blocks, file) != number_of_blocks)
+         {
+            pgmoneta_log_debug("WAL index: Truncated %s", f);
+            goto error;
+         }
+      }
+   }
+
+   fclose(file);
+   free(f);
+
+   *index = wi;
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   pgmoneta_walindex_destroy(wi);
+   free(f);
+
+   return 1;
+}
+
+int
+pgmoneta_walindex_find(int server, char* start, char* position, char** end)
+{
+   char tokens[512];
+   char* ptr = NULL;
+   char* d = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   struct walindex* wi = NULL;
+   char* found = NULL;
+   uint32_t found_size = 0;
+   bool has_lsn = false;
+   bool has_time = false;
+   bool has_xid = false;
+   uint64_t lsn = 0;
+   int64_t target_time = 0;
+   uint32_t xid = 0;
+
+   *end = NULL;
+
+   if (start == NULL || strlen(start) < 24 || position == NULL)
+   {
+      goto done;
+   }
+
+   memset(&tokens[0], 0, sizeof(tokens));
+   memcpy(&tokens[0], position, MIN(strlen(position), sizeof(tokens) - 1));
+
+   ptr = strtok(&tokens[0], ",");
+
+   while (ptr != NULL)
+   {
+      char* equal = strchr(ptr, '=');
+
+      if (equal != NULL)
+      {
+         *equal = '\0';
+
+         if (!strcmp(ptr, "lsn"))
+         {
+            uint32_t high = 0;
+            uint32_t low = 0;
+
+            if (sscanf(equal + 1, "%X/%X", &high, &low) == 2)
+            {
+               lsn = ((uint64_t)high << 32) | low;
+               has_lsn = true;
+            }
+         }
+         else if (!strcmp(ptr, "time"))
+         {
+            struct tm tm;
+
+            memset(&tm, 0, sizeof(struct tm));
+
+            if (strptime(equal + 1, "%Y-%m-%d %H:%M:%S", &tm) != NULL)
+            {
+               target_time = (int64_t)timegm(&tm) * 1000000LL + WALINDEX_TIME_MARGIN;
+               has_time = true;
+            }
+         }
+         else if (!strcmp(ptr, "xid"))
+         {
+            xid = (uint32_t)strtoul(equal + 1, NULL, 10);
+            has_xid = xid != 0;
+         }
+      }
+
+      ptr = strtok(NULL, ",");
+   }
+
+   if (!has_lsn && !has_time && !has_xid)
+   {
+      goto done;
+   }
+
+   d = pgmoneta_get_server_wal_index(server);
+
+   if (pgmoneta_get_files(d, &number_of_files, &files))
+   {
+      goto done;
+   }
+
+   if (!has_xid)
+   {
+      // the positions and the commit times grow with the segments, so only log(n) indexes are read
+      find_first(server, files, number_of_files, start, has_lsn, lsn, target_time, &found, &found_size);
+   }
+   else
+   {
+      for (int i = 0; i < number_of_files; i++)
+      {
+         char segment[25];
+         bool match = false;
+
+         if (!pgmoneta_ends_with(files[i], WALINDEX_SUFFIX) || strlen(files[i]) != 24 + strlen(WALINDEX_SUFFIX))
+         {
+            continue;
+         }
+
+         memset(&segment[0], 0, sizeof(segment));
+         memcpy(&segment[0], files[i], 24);
+
+         if (strcmp(&segment[0], start) < 0 || !same_timeline(&segment[0], start))
+         {
+            continue;
+         }
+
+         if (pgmoneta_walindex_read(server, &segment[0], false, &wi))
+         {
+            continue;
+         }
+
+         if (has_lsn && wi->number_of_records > 0 && wi->max_lsn >= lsn)
+         {
+            match = true;
+         }
+         else if (has_time && wi->number_of_commits > 0 && wi->max_commit_time >= target_time)
+         {
+            match = true;
+         }
+         else if (has_xid && wi->number_of_commits > 0 && wi->min_commit_xid <= xid && xid <= wi->max_commit_xid)
+         {
+            // A later segment may commit the same XID range again, so keep the last one
+            free(found);
+            found = pgmoneta_append(NULL, &segment[0]);
+            found_size = wi->segment_size;
+         }
+
+         if (match)
+         {
+            free(found);
+            found = pgmoneta_append(NULL, &segment[0]);
+            found_size = wi->segment_size;
+
+            pgmoneta_walindex_destroy(wi);
+            wi = NULL;
+            break;
+         }
+
+         pgmoneta_walindex_destroy(wi);
+         wi = NULL;
+      }
+   }
+
+   if (found != NULL)
+   {
+      // The target record can continue into the next segment
+      if (next_segment(found, found_size, end))
+      {
+         *end = NULL;
+      }
+   }
+
+done:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(found);
+   free(d);
+
+   return 0;
+}
+
+int
+pgmoneta_walindex_prewarm(int server, char* start, char* end, uint64_t max_blocks, char* path)
+{
+   char* d = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   struct walindex* wi = NULL;
+   struct art* seen = NULL;
+   struct walindex_block* blocks = NULL;
+   size_t number_of_blocks = 0;
+   size_t capacity = 0;
+   FILE* file = NULL;
+
+   if (start == NULL || strlen(start) < 24 || max_blocks == 0)
+   {
+      goto error;
+   }
+
+   d = pgmoneta_get_server_wal_index(server);
+
+   if (pgmoneta_get_files(d, &number_of_files, &files) || pgmoneta_art_create(&seen))
+   {
+      goto error;
+   }
+
+   // The newest segments first, so the cap keeps the blocks touched last
+   for (int i = number_of_files - 1; i >= 0 && number_of_blocks < max_blocks; i--)
+   {
+      char segment[25];
+      uint32_t* block_number = NULL;
+
+      if (!pgmoneta_ends_with(files[i], WALINDEX_SUFFIX) || strlen(files[i]) != 24 + strlen(WALINDEX_SUFFIX))
+      {
+         continue;
+      }
+
+      memset(&segment[0], 0, sizeof(segment));
+      memcpy(&segment[0], files[i], 24);
+
+      if ((end != NULL && strcmp(&segment[0], end) > 0) || !same_timeline(&segment[0], start))
+      {
+         continue;
+      }
+
+      if (pgmoneta_walindex_read(server, &segment[0], true, &wi))
+      {
+         continue;
+      }
+
+      block_number = wi->block_numbers;
+
+      for (uint32_t j = 0; j < wi->number_of_relations && number_of_blocks < max_blocks; j++)
+      {
+         struct walindex_relation* r = &wi->relations[j];
+
+         for (uint32_t k = 0; k < r->blocks && number_of_blocks < max_blocks; k++)
+         {
+            char key[64];
+            struct walindex_block block;
+
+            memset(&key[0], 0, sizeof(key));
+            snprintf(&key[0], sizeof(key), "%u.%u.%u.%u.%u", r->dboid, r->spcoid, r->relnumber, r->fork, block_number[k]);
+
+            if (r->relnumber == 0 || pgmoneta_art_contains_key(seen, &key[0]))
+            {
+               continue;
+            }
+
+            if (pgmoneta_art_insert(seen, &key[0], true, ValueBool))
+            {
+               goto error;
+            }
+
+            memset(&block, 0, sizeof(struct walindex_block));
+            block.spcoid = r->spcoid;
+            block.dboid = r->dboid;
+            block.relnumber = r->relnumber;
+            block.fork = r->fork;
+            block.block = block_number[k];
+
+            if (add_block(&blocks, &number_of_blocks, &capacity, &block))
+            {
+               goto error;
+            }
+         }
+
+         block_number += r->blocks;
+      }
+
+      pgmoneta_walindex_destroy(wi);
+      wi = NULL;
+   }
+
+   if (number_of_blocks == 0)
+   {
+      goto done;
+   }
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("WAL index: Could not create %s", path);
+      goto error;
+   }
+
+   // pg_prewarm sorts the blocks itself, and loads them until shared_buffers is full
+   fprintf(file, "<<%zu>>\n", number_of_blocks);
+   for (size_t i = 0; i < number_of_blocks; i++)
+   {
+      fprintf(file, "%u,%u,%u,%u,%u\n", blocks[i].dboid, blocks[i].spcoid, blocks[i].relnumber,
+              blocks[i].fork, blocks[i].block);
+   }
+
+   if (ferror(file) || fclose(file))
+   {
+      file = NULL;
+      pgmoneta_log_error("WAL index: Could not write %s", path);
+      goto error;
+   }
+   file = NULL;
+
+   pgmoneta_log_debug("WAL index: %zu blocks in %s", number_of_blocks, path);
+
+done:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   pgmoneta_art_destroy(seen);
+   free(blocks);
+   free(d);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   pgmoneta_walindex_destroy(wi);
+   pgmoneta_art_destroy(seen);
+   free(blocks);
+   free(d);
+
+   return 1;
+}
+
+int
+pgmoneta_walindex_prune(int server)
+{
+   char* d = NULL;
+   char* w = NULL;
+   int number_of_indexes = 0;
+   char** indexes = NULL;
+   int number_of_wal = 0;
+   char** wal = NULL;
+   char** segments = NULL;
+   int n = 0;
+
+   d = pgmoneta_get_server_wal_index(server);
+
+   if (!pgmoneta_exists(d))
+   {
+      goto done;
+   }
+
+   w = pgmoneta_get_server_wal(server);
+
+   if (pgmoneta_get_files(d, &number_of_indexes, &indexes) || pgmoneta_get_wal_files(w, &number_of_wal, &wal) ||
+       pgmoneta_walpack_expand(w, &number_of_wal, &wal))
+   {
+      goto error;
+   }
+
+   segments = (char**)calloc(MAX(number_of_wal, 1), sizeof(char*));
+   if (segments == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_wal; i++)
+   {
+      segments[i] = pgmoneta_walfile_segment_name(wal[i]);
+   }
+
+   // Both lists are sorted, and the suffixes don't change the order of the segments
+   for (int i = 0; i < number_of_indexes; i++)
+   {
+      bool archived = false;
+      char path[MAX_PATH];
+
+      while (n < number_of_wal && (segments[n] == NULL || strncmp(segments[n], indexes[i], 24) < 0))
+      {
+         n++;
+      }
+
+      if (n < number_of_wal && !strncmp(segments[n], indexes[i], 24))
+      {
+         archived = true;
+      }
+
+      if (!archived)
+      {
+         memset(&path[0], 0, sizeof(path));
+         snprintf(&path[0], sizeof(path), "%s%s", d, indexes[i]);
+         pgmoneta_delete_file(&path[0], NULL);
+      }
+   }
+
+done:
+
+   for (int i = 0; i < number_of_wal; i++)
+   {
+      free(wal[i]);
+      if (segments != NULL)
+      {
+         free(segments[i]);
+      }
+   }
+   free(wal);
+   free(segments);
+
+   for (int i = 0; i < number_of_indexes; i++)
+   {
+      free(indexes[i]);
+   }
+   free(indexes);
+   free(d);
+   free(w);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_wal; i++)
+   {
+      free(wal[i]);
+      if (segments != NULL)
+      {
+         free(segments[i]);
+      }
+   }
+   free(wal);
+   free(segments);
+
+   for (int i = 0; i < number_of_indexes; i++)
+   {
+      free(indexes[i]);
+   }
+   free(indexes);
+   free(d);
+   free(w);
+
+   return 1;
+}
+
+void
+pgmoneta_walindex_destroy(struct walindex* index)
+{
+   if (index != NULL)
+   {
+      free(index->relations);
+      free(index->block_numbers);
+      free(index);
+   }
+}
+
+static int
+add_block(struct walindex_block** blocks, size_t* number_of_blocks, size_t* capacity,
+          struct walindex_block* block)
+{
+   struct walindex_block* b = NULL;
+
+   if (*number_of_blocks == *capacity)
+   {
+      *capacity = *capacity == 0 ? 1024 : *capacity * 2;
+      b = (struct walindex_block*)realloc(*blocks, *capacity * sizeof(struct walindex_block));
+      if (b == NULL)
+      {
+         return 1;
+      }
+      *blocks = b;
+   }
+
+   memcpy(&(*blocks)[*number_of_blocks], block, sizeof(struct walindex_block));
+   (*number_of_blocks)++;
+
+   return 0;
+}
+
+static int
+add_storage_blocks(struct decoded_xlog_record* record, struct walindex_block** blocks,
+                   size_t* number_of_blocks, size_t* capacity)
+{
+   uint8_t info = record->header.xl_info & ~XLR_INFO_MASK;
+   struct walindex_block block;
+
+   memset(&block, 0, sizeof(struct walindex_block));
+   block.block = WALINDEX_NO_BLOCK;
+   block.truncate_block = WALINDEX_NO_BLOCK;
+
+   if (record->main_data == NULL)
+   {
+      return 0;
+   }
+
+   if (record->header.xl_rmid == WALINDEX_RM_DBASE)
+   {
+      struct xl_dbase_create_wal_log_rec xlrec;
+
+      // Every database record starts with the database, and the drop records of the
+      // versions before 15 share their info with a creation, so treat them all as one.
+      // The tablespace is only right for the creations, so it is only informational
+      if (record->main_data_len < sizeof(oid))
+      {
+         return 0;
+      }
+
+      memset(&xlrec, 0, sizeof(xlrec));
+      memcpy(&xlrec, record->main_data, MIN(record->main_data_len, sizeof(xlrec)));
+
+      block.spcoid = xlrec.tablespace_id;
+      block.dboid = xlrec.db_id;
+      block.flags = WALINDEX_DATABASE_CREATED;
+
+      return add_block(blocks, number_of_blocks, capacity, &block);
+   }
+
+   if (info == XLOG_SMGR_CREATE && record->main_data_len >= sizeof(struct xl_smgr_create))
+   {
+      struct xl_smgr_create xlrec;
+
+      memcpy(&xlrec, record->main_data, sizeof(struct xl_smgr_create));
+
+      block.spcoid = xlrec.rnode.spcNode;
+      block.dboid = xlrec.rnode.dbNode;
+      block.relnumber = xlrec.rnode.relNode;
+      block.fork = (uint32_t)xlrec.forkNum;
+      block.flags = WALINDEX_RELATION_CREATED;
+
+      return add_block(blocks, number_of_blocks, capacity, &block);
+   }
+   else if (info == XLOG_SMGR_TRUNCATE && record->main_data_len >= sizeof(struct xl_smgr_truncate))
+   {
+      struct xl_smgr_truncate xlrec;
+
+      memcpy(&xlrec, record->main_data, sizeof(struct xl_smgr_truncate));
+
+      block.spcoid = xlrec.rnode.spcNode;
+      block.dboid = xlrec.rnode.dbNode;
+      block.relnumber = xlrec.rnode.relNode;
+
+      // The free space and visibility maps are truncated to sizes that aren't in the
+      // record, so all of their blocks count as touched
+      for (uint32_t fork = MAIN_FORKNUM; fork <= VISIBILITYMAP_FORKNUM; fork++)
+      {
+         if (fork == MAIN_FORKNUM && !(xlrec.flags & SMGR_TRUNCATE_HEAP))
+         {
+            continue;
+         }
+
+         block.fork = fork;
+         block.truncate_block = fork == MAIN_FORKNUM ? xlrec.blkno : 0;
+
+         if (add_block(blocks, number_of_blocks, capacity, &block))
+         {
+            return 1;
+         }
+      }
+   }
+
+   return 0;
+}
+
+static int
+block_compare(const void* a, const void* b)
+{
+   const struct walindex_block* x = (const struct walindex_block*)a;
+   const struct walindex_block* y = (const struct walindex_block*)b;
+
+   if (x->spcoid != y->spcoid)
+   {
+      return x->spcoid < y->spcoid ? -1 : 1;
+   }
+   if (x->dboid != y->dboid)
+   {
+      return x->dboid < y->dboid ? -1 : 1;
+   }
+   if (x->relnumber != y->relnumber)
+   {
+      return x->relnumber < y->relnumber ? -1 : 1;
+   }
+   if (x->fork != y->fork)
+   {
+      return x->fork < y->fork ? -1 : 1;
+   }
+   if (x->block != y->block)
+   {
+      return x->block < y->block ? -1 : 1;
+   }
+
+   return 0;
+}
+
+static int
+summarize_relations(struct walindex_block* blocks, size_t number_of_blocks, struct walindex* index)
+{
+   struct walindex_relation* relations = NULL;
+   struct walindex_relation* r = NULL;
+   uint32_t* block_numbers = NULL;
+   uint32_t n = 0;
+   size_t m = 0;
+
+   index->relations = NULL;
+   index->block_numbers = NULL;
+   index->number_of_relations = 0;
+
+   if (number_of_blocks == 0)
+   {
+      return 0;
+   }
+
+   qsort(blocks, number_of_blocks, sizeof(struct walindex_block), block_compare);
+
+   // There can't be more relation forks or distinct blocks than block references
+   relations = (struct walindex_relation*)calloc(number_of_blocks, sizeof(struct walindex_relation));
+   block_numbers = (uint32_t*)malloc(number_of_blocks * sizeof(uint32_t));
+   if (relations == NULL || block_numbers == NULL)
+   {
+      free(relations);
+      free(block_numbers);
+      return 1;
+   }
+
+   for (size_t i = 0; i < number_of_blocks; i++)
+   {
+      struct walindex_block* b = &blocks[i];
+
+      if (r == NULL || r->spcoid != b->spcoid || r->dboid != b->dboid ||
+          r->relnumber != b->relnumber || r->fork != b->fork)
+      {
+         r = &relations[n++];
+         r->spcoid = b->spcoid;
+         r->dboid = b->dboid;
+         r->relnumber = b->relnumber;
+         r->fork = b->fork;
+         r->truncate_block = WALINDEX_NO_BLOCK;
+      }
+
+      r->flags |= b->flags;
+      r->truncate_block = MIN(r->truncate_block, b->truncate_block);
+
+      // Creations and truncations sort after the blocks of their relation fork
+      if (b->block == WALINDEX_NO_BLOCK || (r->blocks > 0 && b->block == block_numbers[m - 1]))
+      {
+         continue;
+      }
+
+      if (r->blocks == 0)
+      {
+         r->min_block = b->block;
+      }
+      r->max_block = b->block;
+      r->blocks++;
+      block_numbers[m++] = b->block;
+   }
+
+   index->relations = relations;
+   index->block_numbers = block_numbers;
+   index->number_of_relations = n;
+
+   return 0;
+}
+
+static char*
+index_path(int server, char* segment)
+{
+   char* f = NULL;
+
+   f = pgmoneta_get_server_wal_index(server);
+   f = pgmoneta_append(f, segment);
+   f = pgmoneta_append(f, WALINDEX_SUFFIX);
+
+   return f;
+}
+
+static int
+next_segment(char* segment, uint32_t segment_size, char** next)
+{
+   uint32_t tli = 0;
+   uint32_t log = 0;
+   uint32_t seg = 0;
+   uint64_t segments_per_id;
+   uint64_t segno;
+
+   *next = NULL;
+
+   if (segment_size == 0 || sscanf(segment, "%08X%08X%08X", &tli, &log, &seg) != 3)
+   {
+      return 1;
+   }
+
+   segments_per_id = 0x100000000ULL / segment_size;
+   segno = (uint64_t)log * segments_per_id + seg + 1;
+
+   *next = pgmoneta_format_and_append(NULL, "%08X%08X%08X", tli,
+                                      (uint32_t)(segno / segments_per_id),
+                                      (uint32_t)(segno % segments_per_id));
+
+   return 0;
+}
+
+static bool
+same_timeline(char* a, char* b)
+{
+   return !strncmp(a, b, 8);
+}
+
+static int
+segment_reaches(int server, char* segment, bool has_lsn, uint64_t lsn, int64_t target_time, uint32_t* segment_size)
+{
+   int ret = -1;
+   struct walindex* wi = NULL;
+
+   if (pgmoneta_walindex_read(server, segment, false, &wi))
+   {
+      return -1;
+   }
+
+   *segment_size = wi->segment_size;
+
+   if (has_lsn && wi->number_of_records > 0)
+   {
+      ret = wi->max_lsn >= lsn ? 1 : 0;
+   }
+   else if (!has_lsn && wi->number_of_commits > 0)
+   {
+      ret = wi->max_commit_time >= target_time ? 1 : 0;
+   }
+
+   pgmoneta_walindex_destroy(wi);
+
+   return ret;
+}
+
+static void
+find_first(int server, char** files, int number_of_files, char* start, bool has_lsn, uint64_t lsn, int64_t target_time,
+           char** found, uint32_t* found_size)
+{
+   int first = 0;
+   int low = 0;
+   int high = 0;
+
+   *found = NULL;
+   *found_size = 0;
+
+   // the indexes of the timeline of the backup, from its first segment
+   while (first < number_of_files &&
+          (strlen(files[first]) != 24 + strlen(WALINDEX_SUFFIX) || !pgmoneta_ends_with(files[first], WALINDEX_SUFFIX) ||
+           strncmp(files[first], start, 24) < 0 || !same_timeline(files[first], start)))
+   {
+      first++;
+   }
+
+   low = first;
+   high = first;
+   while (high < number_of_files && strlen(files[high]) == 24 + strlen(WALINDEX_SUFFIX) &&
+          pgmoneta_ends_with(files[high], WALINDEX_SUFFIX) && same_timeline(files[high], start))
+   {
+      high++;
+   }
+
+   while (low < high)
+   {
+      int middle = low + (high - low) / 2;
+      int probe = middle;
+      int reaches = -1;
+      uint32_t size = 0;
+      char segment[25];
+
+      // a segment without records or commits says nothing, so the next one is asked
+      while (probe < high && reaches == -1)
+      {
+         memset(&segment[0], 0, sizeof(segment));
+         memcpy(&segment[0], files[probe], 24);
+
+         reaches = segment_reaches(server, &segment[0], has_lsn, lsn, target_time, &size);
+         if (reaches == -1)
+         {
+            probe++;
+         }
+      }
+
+      if (reaches == 1)
+      {
+         free(*found);
+         *found = pgmoneta_append(NULL, &segment[0]);
+         *found_size = size;
+         high = probe;
+      }
+      else if (reaches == 0)
+      {
+         low = probe + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+}
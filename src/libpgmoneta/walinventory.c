@@ -0,0 +1,1073 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <utils.h>
+#include <walindex.h>
+#include <walinventory.h>
+#include <walpack.h>
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define WALINVENTORY_MAGIC_SIZE   8
+#define WALINVENTORY_RACY_SECONDS 2
+
+/**
+ * The header of an inventory
+ */
+struct walinventory_header
+{
+   char magic[WALINVENTORY_MAGIC_SIZE]; /**< The magic */
+   uint32_t version;                    /**< The version of the format */
+   uint32_t record_size;                /**< The size of the segment structure */
+   uint32_t number_of_segments;         /**< The number of segments */
+   uint32_t reserved;                   /**< Reserved */
+   int64_t wal_sec;                     /**< The modification time of the WAL directory, seconds */
+   int64_t wal_nsec;                    /**< The modification time of the WAL directory, nanoseconds */
+   int64_t index_sec;                   /**< The modification time of the WAL index directory, seconds */
+   int64_t index_nsec;                  /**< The modification time of the WAL index directory, nanoseconds */
+};
+
+static char* walinventory_path(int server, char* suffix);
+static void walinventory_mtime(char* directory, struct timespec* mtime);
+static bool walinventory_current(struct walinventory_header* header, struct walinventory_stamp* stamp);
+static void walinventory_stamp(struct walinventory_header* header, struct walinventory_stamp* stamp);
+static int walinventory_lock(int server);
+static void walinventory_unlock(int fd);
+static int walinventory_read(int server, struct walinventory_header* header, struct walinventory** inventory);
+static int walinventory_write(int server, struct walinventory_header* header, struct walinventory* inventory);
+static int walinventory_refresh(int server, struct walinventory* old, struct walinventory** inventory);
+static int walinventory_file(char* directory, char* file, struct walinventory* inventory, int* capacity);
+static int walinventory_append(struct walinventory* inventory, int* capacity, struct walinventory_segment* segment);
+static void walinventory_indexed(int server, struct walinventory* inventory);
+static void walinventory_suffix(char* name, int32_t* compression, int32_t* encryption);
+static uint32_t walinventory_timeline(char* name);
+static int walinventory_lower_bound(struct walinventory* inventory, char* name);
+static bool walinventory_contains(int number_of_files, char** files, char* file);
+static int walinventory_compare(const void* a, const void* b);
+
+int
+pgmoneta_walinventory_load(int server, struct walinventory** inventory)
+{
+   int fd = -1;
+   struct walinventory* old = NULL;
+   struct walinventory* inv = NULL;
+   struct walinventory_stamp stamp;
+   struct walinventory_header header;
+
+   *inventory = NULL;
+
+   fd = walinventory_lock(server);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   pgmoneta_walinventory_begin(server, &stamp);
+
+   if (!walinventory_read(server, &header, &old) && walinventory_current(&header, &stamp))
+   {
+      walinventory_unlock(fd);
+
+      *inventory = old;
+
+      return 0;
+   }
+
+   /* The segments that are known are kept, so only the new files are looked at */
+   if (walinventory_refresh(server, old, &inv))
+   {
+      goto error;
+   }
+
+   walinventory_stamp(&header, &stamp);
+
+   if (walinventory_write(server, &header, inv))
+   {
+      pgmoneta_log_debug("WAL inventory: Could not store the inventory of %s", ((struct configuration*)shmem)->servers[server].name);
+   }
+
+   walinventory_unlock(fd);
+
+   pgmoneta_walinventory_destroy(old);
+
+   *inventory = inv;
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      walinventory_unlock(fd);
+   }
+
+   pgmoneta_walinventory_destroy(old);
+   pgmoneta_walinventory_destroy(inv);
+
+   return 1;
+}
+
+int
+pgmoneta_walinventory_files(int server, int* number_of_files, char*** files)
+{
+   int n = 0;
+   char** array = NULL;
+   struct walinventory* inventory = NULL;
+
+   *number_of_files = 0;
+   *files = NULL;
+
+   if (pgmoneta_walinventory_load(server, &inventory))
+   {
+      goto error;
+   }
+
+   if (inventory->number_of_segments == 0)
+   {
+      pgmoneta_walinventory_destroy(inventory);
+      return 0;
+   }
+
+   array = (char**)calloc(inventory->number_of_segments, sizeof(char*));
+   if (array == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < inventory->number_of_segments; i++)
+   {
+      // the segments of a pack are next to each other
+      if (n > 0 && !strcmp(array[n - 1], inventory->segments[i].file))
+      {
+         continue;
+      }
+
+      array[n] = pgmoneta_append(NULL, inventory->segments[i].file);
+      if (array[n] == NULL)
+      {
+         goto error;
+      }
+      n++;
+   }
+
+   pgmoneta_sort(n, array);
+
+   pgmoneta_walinventory_destroy(inventory);
+
+   *number_of_files = n;
+   *files = array;
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < n; i++)
+   {
+      free(array[i]);
+   }
+   free(array);
+
+   pgmoneta_walinventory_destroy(inventory);
+
+   return 1;
+}
+
+int
+pgmoneta_walinventory_segments(int server, int* number_of_segments, char*** segments)
+{
+   char** array = NULL;
+   struct walinventory* inventory = NULL;
+
+   *number_of_segments = 0;
+   *segments = NULL;
+
+   if (pgmoneta_walinventory_load(server, &inventory))
+   {
+      goto error;
+   }
+
+   if (inventory->number_of_segments == 0)
+   {
+      pgmoneta_walinventory_destroy(inventory);
+      return 0;
+   }
+
+   array = (char**)calloc(inventory->number_of_segments, sizeof(char*));
+   if (array == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < inventory->number_of_segments; i++)
+   {
+      array[i] = pgmoneta_append(NULL, inventory->segments[i].name);
+      if (array[i] == NULL)
+      {
+         goto error;
+      }
+   }
+
+   *number_of_segments = inventory->number_of_segments;
+   *segments = array;
+
+   pgmoneta_walinventory_destroy(inventory);
+
+   return 0;
+
+error:
+
+   for (int i = 0; array != NULL && i < inventory->number_of_segments; i++)
+   {
+      free(array[i]);
+   }
+   free(array);
+
+   pgmoneta_walinventory_destroy(inventory);
+
+   return 1;
+}
+
+void
+pgmoneta_walinventory_range(struct walinventory* inventory, char* from, char* to, int* start, int* end)
+{
+   *start = 0;
+   *end = 0;
+
+   if (inventory == NULL)
+   {
+      return;
+   }
+
+   *start = from != NULL ? walinventory_lower_bound(inventory, from) : 0;
+   *end = to != NULL ? walinventory_lower_bound(inventory, to) : inventory->number_of_segments;
+
+   if (*end < *start)
+   {
+      *end = *start;
+   }
+}
+
+uint64_t
+pgmoneta_walinventory_size(struct walinventory* inventory, char* from, char* to)
+{
+   int start;
+   int end;
+   uint64_t size = 0;
+
+   pgmoneta_walinventory_range(inventory, from, to, &start, &end);
+
+   for (int i = start; i < end; i++)
+   {
+      size += inventory->segments[i].size;
+   }
+
+   return size;
+}
+
+void
+pgmoneta_walinventory_begin(int server, struct walinventory_stamp* stamp)
+{
+   char* d = NULL;
+
+   memset(stamp, 0, sizeof(struct walinventory_stamp));
+
+   d = pgmoneta_get_server_wal(server);
+   walinventory_mtime(d, &stamp->wal);
+   free(d);
+
+   d = pgmoneta_get_server_wal_index(server);
+   walinventory_mtime(d, &stamp->index);
+   free(d);
+}
+
+int
+pgmoneta_walinventory_update(int server, struct walinventory_stamp* stamp, int number_of_added, char** added,
+                             int number_of_removed, char** removed)
+{
+   int fd = -1;
+   int n = 0;
+   int index;
+   int capacity = 0;
+   char* d = NULL;
+   char* x = NULL;
+   char** sorted = NULL;
+   char path[MAX_PATH];
+   struct walinventory* inventory = NULL;
+   struct walinventory* files = NULL;
+   struct walinventory_segment* segments = NULL;
+   struct walinventory_stamp now;
+   struct walinventory_header header;
+
+   if (number_of_added == 0 && number_of_removed == 0)
+   {
+      return 0;
+   }
+
+   fd = walinventory_lock(server);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   pgmoneta_walinventory_begin(server, &now);
+
+   /* A missing inventory is built by the next load */
+   if (walinventory_read(server, &header, &inventory))
+   {
+      goto done;
+   }
+
+   /* Another change came in between, so the next load has to look at the directory */
+   if (!walinventory_current(&header, stamp))
+   {
+      memset(&now, 0, sizeof(struct walinventory_stamp));
+      goto store;
+   }
+
+   if (number_of_removed > 0)
+   {
+      sorted = (char**)malloc(number_of_removed * sizeof(char*));
+      if (sorted == NULL)
+      {
+         goto error;
+      }
+      memcpy(sorted, removed, number_of_removed * sizeof(char*));
+      pgmoneta_sort(number_of_removed, sorted);
+
+      for (int j = 0; j < inventory->number_of_segments; j++)
+      {
+         if (!walinventory_contains(number_of_removed, sorted, inventory->segments[j].file))
+         {
+            inventory->segments[n++] = inventory->segments[j];
+         }
+      }
+
+      inventory->number_of_segments = n;
+   }
+
+   if (number_of_added > 0)
+   {
+      files = (struct walinventory*)calloc(1, sizeof(struct walinventory));
+      if (files == NULL)
+      {
+         goto error;
+      }
+
+      d = pgmoneta_get_server_wal(server);
+      x = pgmoneta_get_server_wal_index(server);
+
+      for (int j = 0; j < number_of_added; j++)
+      {
+         if (walinventory_file(d, added[j], files, &capacity))
+         {
+            goto error;
+         }
+      }
+
+      segments = (struct walinventory_segment*)realloc(inventory->segments, (inventory->number_of_segments + files->number_of_segments + 1) * sizeof(struct walinventory_segment));
+      if (segments == NULL)
+      {
+         goto error;
+      }
+      inventory->segments = segments;
+
+      for (int j = 0; j < files->number_of_segments; j++)
+      {
+         memset(&path[0], 0, sizeof(path));
+         snprintf(&path[0], sizeof(path), "%s%.24s%s", x, files->segments[j].name, WALINDEX_SUFFIX);
+         files->segments[j].indexed = pgmoneta_exists(&path[0]);
+
+         index = walinventory_lower_bound(inventory, files->segments[j].name);
+         if (index < inventory->number_of_segments && !strcmp(inventory->segments[index].name, files->segments[j].name))
+         {
+            inventory->segments[index] = files->segments[j];
+            continue;
+         }
+
+         memmove(&inventory->segments[index + 1], &inventory->segments[index],
+                 (inventory->number_of_segments - index) * sizeof(struct walinventory_segment));
+         inventory->segments[index] = files->segments[j];
+         inventory->number_of_segments++;
+      }
+   }
+
+store:
+
+   walinventory_stamp(&header, &now);
+
+   if (walinventory_write(server, &header, inventory))
+   {
+      goto error;
+   }
+
+done:
+
+   walinventory_unlock(fd);
+
+   pgmoneta_walinventory_destroy(inventory);
+   pgmoneta_walinventory_destroy(files);
+   free(sorted);
+   free(d);
+   free(x);
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      walinventory_unlock(fd);
+   }
+
+   pgmoneta_walinventory_destroy(inventory);
+   pgmoneta_walinventory_destroy(files);
+   free(sorted);
+   free(d);
+   free(x);
+
+   return 1;
+}
+
+void
+pgmoneta_walinventory_destroy(struct walinventory* inventory)
+{
+   if (inventory == NULL)
+   {
+      return;
+   }
+
+   free(inventory->segments);
+   free(inventory);
+}
+
+static char*
+walinventory_path(int server, char* suffix)
+{
+   char* path = NULL;
+
+   path = pgmoneta_get_server_wal(server);
+   while (path != NULL && strlen(path) > 1 && pgmoneta_ends_with(path, "/"))
+   {
+      path[strlen(path) - 1] = '\0';
+   }
+   path = pgmoneta_append(path, suffix);
+
+   return path;
+}
+
+static void
+walinventory_mtime(char* directory, struct timespec* mtime)
+{
+   struct stat st;
+
+   memset(mtime, 0, sizeof(struct timespec));
+
+   if (directory == NULL || stat(directory, &st))
+   {
+      errno = 0;
+      return;
+   }
+
+   *mtime = st.st_mtim;
+}
+
+static bool
+walinventory_current(struct walinventory_header* header, struct walinventory_stamp* stamp)
+{
+   if (header->wal_sec == 0 && header->wal_nsec == 0)
+   {
+      return false;
+   }
+
+   return header->wal_sec == (int64_t)stamp->wal.tv_sec && header->wal_nsec == (int64_t)stamp->wal.tv_nsec &&
+          header->index_sec == (int64_t)stamp->index.tv_sec && header->index_nsec == (int64_t)stamp->index.tv_nsec;
+}
+
+static void
+walinventory_stamp(struct walinventory_header* header, struct walinventory_stamp* stamp)
+{
+   struct timespec now;
+
+   memset(header, 0, sizeof(struct walinventory_header));
+   memcpy(&header->magic[0], WALINVENTORY_MAGIC, WALINVENTORY_MAGIC_SIZE);
+   header->version = WALINVENTORY_VERSION;
+   header->record_size = sizeof(struct walinventory_segment);
+
+   /* File times are coarse, so a change right after the directory was read could keep its time.
+      The segments are kept anyway, and the next load refreshes them */
+   clock_gettime(CLOCK_REALTIME, &now);
+   if (now.tv_sec - stamp->wal.tv_sec < WALINVENTORY_RACY_SECONDS ||
+       now.tv_sec - stamp->index.tv_sec < WALINVENTORY_RACY_SECONDS)
+   {
+      return;
+   }
+
+   header->wal_sec = stamp->wal.tv_sec;
+   header->wal_nsec = stamp->wal.tv_nsec;
+   header->index_sec = stamp->index.tv_sec;
+   header->index_nsec = stamp->index.tv_nsec;
+}
+
+static int
+walinventory_lock(int server)
+{
+   char* path = NULL;
+   int fd = -1;
+
+   path = walinventory_path(server, WALINVENTORY_SUFFIX ".lock");
+   if (path == NULL)
+   {
+      return -1;
+   }
+
+   /* The WAL receiver, the retention and the management requests run in different processes */
+   fd = open(path, O_CREAT | O_RDWR, 0600);
+   if (fd == -1 || flock(fd, LOCK_EX))
+   {
+      pgmoneta_log_debug("WAL inventory: Could not lock %s", path);
+      if (fd != -1)
+      {
+         close(fd);
+      }
+      fd = -1;
+      errno = 0;
+   }
+
+   free(path);
+
+   return fd;
+}
+
+static void
+walinventory_unlock(int fd)
+{
+   flock(fd, LOCK_UN);
+   close(fd);
+}
+
+static int
+walinventory_read(int server, struct walinventory_header* header, struct walinventory** inventory)
+{
+   char* path = NULL;
+   FILE* file = NULL;
+   struct stat st;
+   struct walinventory* inv = NULL;
+
+   *inventory = NULL;
+   memset(header, 0, sizeof(struct walinventory_header));
+
+   path = walinventory_path(server, WALINVENTORY_SUFFIX);
+   if (path == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fstat(fileno(file), &st) || fread(header, 1, sizeof(struct walinventory_header), file) != sizeof(struct walinventory_header))
+   {
+      goto error;
+   }
+
+   if (memcmp(&header->magic[0], WALINVENTORY_MAGIC, WALINVENTORY_MAGIC_SIZE) ||
+       header->version != WALINVENTORY_VERSION ||
+       header->record_size != sizeof(struct walinventory_segment) ||
+       (uint64_t)st.st_size != sizeof(struct walinventory_header) + (uint64_t)header->number_of_segments * sizeof(struct walinventory_segment))
+   {
+      goto error;
+   }
+
+   inv = (struct walinventory*)calloc(1, sizeof(struct walinventory));
+   if (inv == NULL)
+   {
+      goto error;
+   }
+
+   if (header->number_of_segments > 0)
+   {
+      inv->segments = (struct walinventory_segment*)malloc(header->number_of_segments * sizeof(struct walinventory_segment));
+      if (inv->segments == NULL ||
+          fread(inv->segments, sizeof(struct walinventory_segment), header->number_of_segments, file) != header->number_of_segments)
+      {
+         goto error;
+      }
+   }
+   inv->number_of_segments = (int)header->number_of_segments;
+
+   fclose(file);
+   free(path);
+
+   *inventory = inv;
+
+   return 0;
+
+error:
+
+   errno = 0;
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   pgmoneta_walinventory_destroy(inv);
+   free(path);
+
+   return 1;
+}
+
+static int
+walinventory_write(int server, struct walinventory_header* header, struct walinventory* inventory)
+{
+   char* path = NULL;
+   char* tmp = NULL;
+   FILE* file = NULL;
+
+   path = walinventory_path(server, WALINVENTORY_SUFFIX);
+   tmp = walinventory_path(server, WALINVENTORY_SUFFIX ".tmp");
+   if (path == NULL || tmp == NULL)
+   {
+      goto error;
+   }
+
+   header->number_of_segments = (uint32_t)inventory->number_of_segments;
+
+   file = fopen(tmp, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_debug("WAL inventory: Could not create %s due to %s", tmp, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   if (fwrite(header, 1, sizeof(struct walinventory_header), file) != sizeof(struct walinventory_header))
+   {
+      goto error;
+   }
+
+   if (inventory->number_of_segments > 0 &&
+       fwrite(inventory->segments, sizeof(struct walinventory_segment), inventory->number_of_segments, file) != (size_t)inventory->number_of_segments)
+   {
+      goto error;
+   }
+
+   if (fflush(file) || fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (rename(tmp, path))
+   {
+      goto error;
+   }
+
+   free(path);
+   free(tmp);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   if (tmp != NULL)
+   {
+      unlink(tmp);
+   }
+
+   errno = 0;
+   free(path);
+   free(tmp);
+
+   return 1;
+}
+
+static int
+walinventory_refresh(int server, struct walinventory* old, struct walinventory** inventory)
+{
+   int c = 0;
+   int capacity = 0;
+   int number_of_files = 0;
+   char** files = NULL;
+   char* d = NULL;
+   struct walinventory* inv = NULL;
+
+   *inventory = NULL;
+
+   d = pgmoneta_get_server_wal(server);
+
+   inv = (struct walinventory*)calloc(1, sizeof(struct walinventory));
+   if (inv == NULL)
+   {
+      goto error;
+   }
+
+   // a server without segments has no directory yet
+   if (pgmoneta_exists(d) && pgmoneta_get_wal_files(d, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      // the files of the inventory follow the order of the directory
+      while (old != NULL && c < old->number_of_segments && strcmp(old->segments[c].file, files[i]) < 0)
+      {
+         c++;
+      }
+
+      if (old != NULL && c < old->number_of_segments && !strcmp(old->segments[c].file, files[i]))
+      {
+         while (c < old->number_of_segments && !strcmp(old->segments[c].file, files[i]))
+         {
+            if (walinventory_append(inv, &capacity, &old->segments[c]))
+            {
+               goto error;
+            }
+            c++;
+         }
+      }
+      else if (walinventory_file(d, files[i], inv, &capacity))
+      {
+         goto error;
+      }
+   }
+
+   if (inv->number_of_segments > 1)
+   {
+      qsort(inv->segments, inv->number_of_segments, sizeof(struct walinventory_segment), walinventory_compare);
+   }
+
+   walinventory_indexed(server, inv);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(d);
+
+   *inventory = inv;
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(d);
+
+   pgmoneta_walinventory_destroy(inv);
+
+   return 1;
+}
+
+static int
+walinventory_file(char* directory, char* file, struct walinventory* inventory, int* capacity)
+{
+   int number_of_members = 0;
+   char** members = NULL;
+   char path[MAX_PATH];
+   struct stat st;
+   struct walinventory_segment segment;
+
+   memset(&path[0], 0, sizeof(path));
+   snprintf(&path[0], sizeof(path), "%s%s%s", directory, pgmoneta_ends_with(directory, "/") ? "" : "/", file);
+
+   memset(&segment, 0, sizeof(struct walinventory_segment));
+   snprintf(&segment.file[0], sizeof(segment.file), "%s", file);
+
+   if (!stat(&path[0], &st))
+   {
+      segment.size = (uint64_t)st.st_size;
+   }
+   errno = 0;
+
+   if (pgmoneta_is_walpack(file) && !pgmoneta_walpack_members(&path[0], &number_of_members, &members) && number_of_members > 0)
+   {
+      uint64_t size = segment.size;
+
+      segment.packed = true;
+      segment.compression = COMPRESSION_CLIENT_ZSTD;
+      segment.encryption = ENCRYPTION_NONE;
+
+      for (int i = 0; i < number_of_members; i++)
+      {
+         snprintf(&segment.name[0], sizeof(segment.name), "%s", members[i]);
+         segment.timeline = walinventory_timeline(members[i]);
+         segment.size = i == number_of_members - 1 ? size : 0;
+
+         if (walinventory_append(inventory, capacity, &segment))
+         {
+            goto error;
+         }
+      }
+   }
+   else
+   {
+      snprintf(&segment.name[0], sizeof(segment.name), "%s", file);
+      segment.timeline = walinventory_timeline(file);
+      walinventory_suffix(file, &segment.compression, &segment.encryption);
+
+      if (walinventory_append(inventory, capacity, &segment))
+      {
+         goto error;
+      }
+   }
+
+   for (int i = 0; i < number_of_members; i++)
+   {
+      free(members[i]);
+   }
+   free(members);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_members; i++)
+   {
+      free(members[i]);
+   }
+   free(members);
+
+   return 1;
+}
+
+static int
+walinventory_append(struct walinventory* inventory, int* capacity, struct walinventory_segment* segment)
+{
+   struct walinventory_segment* segments = NULL;
+
+   if (inventory->number_of_segments >= *capacity)
+   {
+      *capacity = MAX(*capacity * 2, 64);
+      segments = (struct walinventory_segment*)realloc(inventory->segments, *capacity * sizeof(struct walinventory_segment));
+      if (segments == NULL)
+      {
+         return 1;
+      }
+      inventory->segments = segments;
+   }
+
+   inventory->segments[inventory->number_of_segments++] = *segment;
+
+   return 0;
+}
+
+static void
+walinventory_indexed(int server, struct walinventory* inventory)
+{
+   int lo;
+   int hi;
+   int mid;
+   int cmp;
+   int number_of_indexes = 0;
+   char** indexes = NULL;
+   char* d = NULL;
+   char name[MISC_LENGTH];
+
+   d = pgmoneta_get_server_wal_index(server);
+
+   if (pgmoneta_exists(d))
+   {
+      pgmoneta_get_files(d, &number_of_indexes, &indexes);
+   }
+
+   for (int i = 0; i < inventory->number_of_segments; i++)
+   {
+      inventory->segments[i].indexed = false;
+
+      memset(&name[0], 0, sizeof(name));
+      snprintf(&name[0], sizeof(name), "%.24s%s", inventory->segments[i].name, WALINDEX_SUFFIX);
+
+      lo = 0;
+      hi = number_of_indexes;
+      while (!inventory->segments[i].indexed && lo < hi)
+      {
+         mid = lo + (hi - lo) / 2;
+         cmp = strcmp(indexes[mid], &name[0]);
+         if (cmp == 0)
+         {
+            inventory->segments[i].indexed = true;
+         }
+         else if (cmp < 0)
+         {
+            lo = mid + 1;
+         }
+         else
+         {
+            hi = mid;
+         }
+      }
+   }
+
+   for (int i = 0; i < number_of_indexes; i++)
+   {
+      free(indexes[i]);
+   }
+   free(indexes);
+   free(d);
+}
+
+static void
+walinventory_suffix(char* name, int32_t* compression, int32_t* encryption)
+{
+   char* suffix = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *compression = COMPRESSION_NONE;
+   *encryption = ENCRYPTION_NONE;
+
+   if (strlen(name) <= 24)
+   {
+      return;
+   }
+
+   suffix = name + 24;
+
+   if (pgmoneta_ends_with(suffix, ".aes"))
+   {
+      *encryption = config->encryption != ENCRYPTION_NONE ? config->encryption : ENCRYPTION_AES_256_GCM;
+   }
+
+   if (!strncmp(suffix, ".gz", 3))
+   {
+      *compression = COMPRESSION_CLIENT_GZIP;
+   }
+   else if (!strncmp(suffix, ".zstd", 5))
+   {
+      *compression = COMPRESSION_CLIENT_ZSTD;
+   }
+   else if (!strncmp(suffix, ".lz4", 4))
+   {
+      *compression = COMPRESSION_CLIENT_LZ4;
+   }
+   else if (!strncmp(suffix, ".bz2", 4))
+   {
+      *compression = COMPRESSION_CLIENT_BZIP2;
+   }
+}
+
+static uint32_t
+walinventory_timeline(char* name)
+{
+   unsigned int timeline = 0;
+
+   if (strlen(name) < 24 || strspn(name, "0123456789ABCDEF") < 24 || sscanf(name, "%8X", &timeline) != 1)
+   {
+      return 0;
+   }
+
+   return (uint32_t)timeline;
+}
+
+static int
+walinventory_lower_bound(struct walinventory* inventory, char* name)
+{
+   int lo = 0;
+   int hi = inventory->number_of_segments;
+   int mid;
+
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (strcmp(inventory->segments[mid].name, name) < 0)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+
+   return lo;
+}
+
+static bool
+walinventory_contains(int number_of_files, char** files, char* file)
+{
+   int lo = 0;
+   int hi = number_of_files;
+   int mid;
+   int cmp;
+
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      cmp = strcmp(files[mid], file);
+      if (cmp == 0)
+      {
+         return true;
+      }
+      else if (cmp < 0)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+
+   return false;
+}
+
+static int
+walinventory_compare(const void* a, const void* b)
+{
+   return strcmp(((struct walinventory_segment*)a)->name, ((struct walinventory_segment*)b)->name);
+}
@@ -0,0 +1,745 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <manifest.h>
+#include <utils.h>
+#include <walk.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#define WALK_BUFFER_SIZE (32 * 1024)
+
+/**
+ * A directory of a walk
+ */
+struct walk_directory
+{
+   char* relative;                /**< The path below the root, empty for the root */
+   int depth;                     /**< The depth of its entries */
+   struct walk_directory* next;   /**< The next directory */
+};
+
+/**
+ * The state of a walk
+ */
+struct walk
+{
+   int root_fd;                   /**< The descriptor of the root */
+   char root[MAX_PATH];           /**< The root */
+   int flags;                     /**< The flags */
+   int threads;                   /**< The number of threads */
+   walk_callback callback;        /**< The callback */
+   void* arg;                     /**< The argument of the callback */
+   pthread_mutex_t lock;          /**< The lock of the queue */
+   pthread_cond_t has_work;       /**< Signaled when the queue or the pending count changes */
+   pthread_mutex_t callback_lock; /**< The lock of the callback */
+   struct walk_directory* queue;  /**< The directories to read */
+   int pending;                   /**< The number of queued and reading directories */
+   bool failed;                   /**< Has the walk failed */
+};
+
+#if defined(__linux__)
+/**
+ * A record of getdents64
+ */
+struct walk_dirent
+{
+   uint64_t d_ino;           /**< The inode */
+   int64_t d_off;            /**< The offset of the next record */
+   unsigned short d_reclen;  /**< The length of the record */
+   unsigned char d_type;     /**< The type */
+   char d_name[];            /**< The name */
+};
+#endif
+
+static int walk_tree(char* root, int depth, int flags, int threads, walk_callback callback, void* arg);
+static int walk_listed(int root_fd, char* root, struct manifest_listing* file, int flags, walk_callback callback, void* arg,
+                       char* current, size_t current_size, int* dirfd);
+static void* walk_thread(void* arg);
+static int walk_directory(struct walk* walk, struct walk_directory* directory, struct walk_directory** children);
+static int walk_visit(struct walk* walk, int dirfd, char* path, struct walk_directory* directory, char* name, unsigned char d_type, struct walk_directory** children);
+static int walk_type(unsigned char d_type);
+static int walk_mode_type(mode_t mode);
+static struct walk_directory* walk_directory_create(char* relative, char* name, int depth);
+static void walk_directory_free(struct walk_directory* directory);
+
+int
+pgmoneta_walk(char* root, int flags, int threads, walk_callback callback, void* arg)
+{
+   return walk_tree(root, 0, flags, threads, callback, arg);
+}
+
+static int
+walk_tree(char* root, int depth, int flags, int threads, walk_callback callback, void* arg)
+{
+   size_t length;
+   int started = 0;
+   pthread_t* ids = NULL;
+   struct walk_directory* directory = NULL;
+   struct walk walk;
+
+   memset(&walk, 0, sizeof(struct walk));
+   walk.root_fd = -1;
+
+   if (root == NULL || strlen(root) == 0 || strlen(root) >= MAX_PATH || callback == NULL)
+   {
+      goto error;
+   }
+
+   length = strlen(root);
+   memcpy(walk.root, root, length);
+
+   while (length > 1 && walk.root[length - 1] == '/')
+   {
+      walk.root[--length] = '\0';
+   }
+
+   walk.root_fd = open(walk.root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (walk.root_fd == -1)
+   {
+      goto error;
+   }
+
+   directory = walk_directory_create("", NULL, depth);
+   if (directory == NULL)
+   {
+      goto error;
+   }
+
+   walk.flags = flags;
+   walk.threads = (threads > 1 && !(flags & WALK_FLAT)) ? threads : 1;
+   walk.callback = callback;
+   walk.arg = arg;
+   walk.queue = directory;
+   walk.pending = 1;
+
+   pthread_mutex_init(&walk.lock, NULL);
+   pthread_cond_init(&walk.has_work, NULL);
+   pthread_mutex_init(&walk.callback_lock, NULL);
+
+   if (walk.threads > 1)
+   {
+      ids = (pthread_t*)calloc(walk.threads - 1, sizeof(pthread_t));
+
+      // the calling thread takes part, so a thread that can't be started only costs parallelism
+      while (ids != NULL && started < walk.threads - 1)
+      {
+         if (pthread_create(&ids[started], NULL, walk_thread, &walk))
+         {
+            break;
+         }
+         started++;
+      }
+   }
+
+   walk_thread(&walk);
+
+   for (int i = 0; i < started; i++)
+   {
+      pthread_join(ids[i], NULL);
+   }
+   free(ids);
+
+   walk_directory_free(walk.queue);
+
+   pthread_mutex_destroy(&walk.callback_lock);
+   pthread_cond_destroy(&walk.has_work);
+   pthread_mutex_destroy(&walk.lock);
+
+   close(walk.root_fd);
+
+   return walk.failed ? 1 : 0;
+
+error:
+
+   if (walk.root_fd != -1)
+   {
+      close(walk.root_fd);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_walk_manifest(char* root, char* manifest, int flags, int threads, walk_callback callback, void* arg)
+{
+   int root_fd = -1;
+   int dirfd = -1;
+   int number_of_files = 0;
+   size_t length;
+   char directory[MAX_PATH];
+   char current[MAX_PATH];
+   char* wal = NULL;
+   int ret = 0;
+   struct manifest_listing* files = NULL;
+
+   if (manifest == NULL || !pgmoneta_exists(manifest) ||
+       pgmoneta_manifest_files(manifest, threads > 1, &files, &number_of_files))
+   {
+      return pgmoneta_walk(root, flags, threads, callback, arg);
+   }
+
+   if (root == NULL || strlen(root) == 0 || strlen(root) >= MAX_PATH || callback == NULL)
+   {
+      goto error;
+   }
+
+   memset(directory, 0, sizeof(directory));
+   length = strlen(root);
+   memcpy(directory, root, length);
+
+   while (length > 1 && directory[length - 1] == '/')
+   {
+      directory[--length] = '\0';
+   }
+
+   root_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (root_fd == -1)
+   {
+      goto error;
+   }
+
+   memset(current, 0, sizeof(current));
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      // the tablespaces are links, and are processed from the backup
+      if (pgmoneta_starts_with(files[i].path, "pg_tblspc/"))
+      {
+         continue;
+      }
+
+      if (walk_listed(root_fd, directory, &files[i], flags, callback, arg, current, sizeof(current), &dirfd))
+      {
+         goto error;
+      }
+   }
+
+   if (dirfd != -1)
+   {
+      close(dirfd);
+      dirfd = -1;
+   }
+
+   close(root_fd);
+   root_fd = -1;
+
+   pgmoneta_manifest_files_destroy(files, number_of_files);
+   files = NULL;
+
+   wal = pgmoneta_append(wal, directory);
+   wal = pgmoneta_append(wal, "/pg_wal");
+
+   if (pgmoneta_exists(wal))
+   {
+      ret = walk_tree(wal, 1, flags, threads, callback, arg);
+   }
+
+   free(wal);
+
+   return ret;
+
+error:
+
+   if (dirfd != -1)
+   {
+      close(dirfd);
+   }
+
+   if (root_fd != -1)
+   {
+      close(root_fd);
+   }
+
+   pgmoneta_manifest_files_destroy(files, number_of_files);
+
+   return 1;
+}
+
+static int
+walk_listed(int root_fd, char* root, struct manifest_listing* file, int flags, walk_callback callback, void* arg,
+            char* current, size_t current_size, int* dirfd)
+{
+   int n;
+   int depth = 0;
+   char* slash = NULL;
+   char* name = NULL;
+   char directory[MAX_PATH];
+   char path[MAX_PATH];
+   char relative[MAX_PATH];
+   struct stat st;
+   struct walk_entry entry;
+
+   slash = strrchr(file->path, '/');
+
+   memset(relative, 0, sizeof(relative));
+   if (slash != NULL)
+   {
+      if ((size_t)(slash - file->path) >= sizeof(relative))
+      {
+         return 1;
+      }
+      memcpy(relative, file->path, slash - file->path);
+      name = slash + 1;
+   }
+   else
+   {
+      name = file->path;
+   }
+
+   for (char* c = file->path; *c != '\0'; c++)
+   {
+      if (*c == '/')
+      {
+         depth++;
+      }
+   }
+
+   // the files of a directory are next to each other in path order, so its descriptor is kept
+   if (*dirfd == -1 || strcmp(current, relative))
+   {
+      if (*dirfd != -1)
+      {
+         close(*dirfd);
+      }
+
+      snprintf(current, current_size, "%s", relative);
+
+      *dirfd = openat(root_fd, strlen(relative) > 0 ? relative : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (*dirfd == -1)
+      {
+         // the directory is gone, so are its files
+         return 0;
+      }
+   }
+
+   memset(&st, 0, sizeof(struct stat));
+
+   if (flags & WALK_STAT)
+   {
+      if (fstatat(*dirfd, name, &st, AT_SYMLINK_NOFOLLOW))
+      {
+         return 0;
+      }
+   }
+
+   if (strlen(relative) > 0)
+   {
+      n = snprintf(directory, sizeof(directory), "%s/%s", root, relative);
+   }
+   else
+   {
+      n = snprintf(directory, sizeof(directory), "%s", root);
+   }
+
+   if (n < 0 || n >= (int)sizeof(directory) ||
+       snprintf(path, sizeof(path), "%s/%s", directory, name) >= (int)sizeof(path))
+   {
+      pgmoneta_log_error("Walk: Path too long in %s", root);
+      return 1;
+   }
+
+   memset(&entry, 0, sizeof(struct walk_entry));
+   entry.dirfd = *dirfd;
+   entry.name = name;
+   entry.directory = directory;
+   entry.path = path;
+   entry.type = (flags & WALK_STAT) ? walk_mode_type(st.st_mode) : WALK_FILE;
+   entry.depth = depth;
+   entry.st = (flags & WALK_STAT) ? &st : NULL;
+
+   if (callback(&entry, arg) == WALK_STOP)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static void*
+walk_thread(void* arg)
+{
+   struct walk* walk = (struct walk*)arg;
+   struct walk_directory* directory = NULL;
+   struct walk_directory* children = NULL;
+   struct walk_directory* last = NULL;
+   int failed;
+
+   pthread_mutex_lock(&walk->lock);
+
+   while (true)
+   {
+      while (walk->queue == NULL && walk->pending > 0 && !walk->failed)
+      {
+         pthread_cond_wait(&walk->has_work, &walk->lock);
+      }
+
+      if (walk->queue == NULL || walk->failed)
+      {
+         break;
+      }
+
+      directory = walk->queue;
+      walk->queue = directory->next;
+      directory->next = NULL;
+
+      pthread_mutex_unlock(&walk->lock);
+
+      children = NULL;
+      failed = walk_directory(walk, directory, &children);
+
+      walk_directory_free(directory);
+      directory = NULL;
+
+      pthread_mutex_lock(&walk->lock);
+
+      if (failed)
+      {
+         walk->failed = true;
+         walk_directory_free(children);
+      }
+      else if (children != NULL)
+      {
+         // the children go in front, so the walk stays depth first on one thread
+         last = children;
+         walk->pending++;
+
+         while (last->next != NULL)
+         {
+            last = last->next;
+            walk->pending++;
+         }
+
+         last->next = walk->queue;
+         walk->queue = children;
+      }
+
+      walk->pending--;
+
+      pthread_cond_broadcast(&walk->has_work);
+   }
+
+   pthread_mutex_unlock(&walk->lock);
+
+   return NULL;
+}
+
+static int
+walk_directory(struct walk* walk, struct walk_directory* directory, struct walk_directory** children)
+{
+   int fd = -1;
+   int n;
+   char path[MAX_PATH];
+#if defined(__linux__)
+   long size;
+   char* buffer = NULL;
+   struct walk_dirent* d = NULL;
+#else
+   int copy = -1;
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+#endif
+
+   if (strlen(directory->relative) == 0)
+   {
+      n = snprintf(path, sizeof(path), "%s", walk->root);
+   }
+   else
+   {
+      n = snprintf(path, sizeof(path), "%s/%s", walk->root, directory->relative);
+   }
+
+   if (n < 0 || n >= (int)sizeof(path))
+   {
+      pgmoneta_log_error("Walk: Path too long in %s", walk->root);
+      goto error;
+   }
+
+   fd = openat(walk->root_fd, strlen(directory->relative) > 0 ? directory->relative : ".",
+               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd == -1)
+   {
+      pgmoneta_log_debug("Walk: Could not open %s (%s)", path, strerror(errno));
+      goto error;
+   }
+
+#if defined(__linux__)
+   buffer = (char*)malloc(WALK_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   while ((size = syscall(SYS_getdents64, fd, buffer, WALK_BUFFER_SIZE)) > 0)
+   {
+      for (long offset = 0; offset < size; offset += d->d_reclen)
+      {
+         d = (struct walk_dirent*)(buffer + offset);
+
+         if (walk_visit(walk, fd, path, directory, d->d_name, d->d_type, children))
+         {
+            goto error;
+         }
+      }
+   }
+
+   if (size < 0)
+   {
+      pgmoneta_log_debug("Walk: Could not read %s (%s)", path, strerror(errno));
+      goto error;
+   }
+
+   free(buffer);
+#else
+   copy = dup(fd);
+   if (copy == -1 || (dir = fdopendir(copy)) == NULL)
+   {
+      goto error;
+   }
+   copy = -1;
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (walk_visit(walk, fd, path, directory, entry->d_name, entry->d_type, children))
+      {
+         goto error;
+      }
+   }
+
+   closedir(dir);
+#endif
+
+   close(fd);
+
+   return 0;
+
+error:
+
+#if defined(__linux__)
+   free(buffer);
+#else
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+   if (copy != -1)
+   {
+      close(copy);
+   }
+#endif
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+static int
+walk_visit(struct walk* walk, int dirfd, char* path, struct walk_directory* directory, char* name, unsigned char d_type, struct walk_directory** children)
+{
+   int n;
+   int type;
+   int result;
+   char entry_path[MAX_PATH];
+   struct stat st;
+   struct walk_entry entry;
+   struct walk_directory* child = NULL;
+
+   if (!strcmp(name, ".") || !strcmp(name, ".."))
+   {
+      return 0;
+   }
+
+   memset(&st, 0, sizeof(struct stat));
+
+   if (d_type == DT_UNKNOWN || (walk->flags & WALK_STAT))
+   {
+      // the entry is gone since the directory was read
+      if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW))
+      {
+         return 0;
+      }
+
+      type = walk_mode_type(st.st_mode);
+   }
+   else
+   {
+      type = walk_type(d_type);
+   }
+
+   n = snprintf(entry_path, sizeof(entry_path), "%s/%s", path, name);
+   if (n < 0 || n >= (int)sizeof(entry_path))
+   {
+      pgmoneta_log_error("Walk: Path too long in %s", path);
+      return 1;
+   }
+
+   memset(&entry, 0, sizeof(struct walk_entry));
+   entry.dirfd = dirfd;
+   entry.name = name;
+   entry.directory = path;
+   entry.path = entry_path;
+   entry.type = type;
+   entry.depth = directory->depth;
+   entry.st = (walk->flags & WALK_STAT) ? &st : NULL;
+
+   pthread_mutex_lock(&walk->callback_lock);
+   result = walk->callback(&entry, walk->arg);
+   pthread_mutex_unlock(&walk->callback_lock);
+
+   if (result == WALK_STOP)
+   {
+      return 1;
+   }
+
+   if (type == WALK_DIRECTORY && result == WALK_CONTINUE && !(walk->flags & WALK_FLAT))
+   {
+      child = walk_directory_create(directory->relative, name, directory->depth + 1);
+      if (child == NULL)
+      {
+         return 1;
+      }
+
+      child->next = *children;
+      *children = child;
+   }
+
+   return 0;
+}
+
+static int
+walk_type(unsigned char d_type)
+{
+   switch (d_type)
+   {
+      case DT_REG:
+         return WALK_FILE;
+      case DT_DIR:
+         return WALK_DIRECTORY;
+      case DT_LNK:
+         return WALK_LINK;
+      default:
+         return WALK_OTHER;
+   }
+}
+
+static int
+walk_mode_type(mode_t mode)
+{
+   if (S_ISREG(mode))
+   {
+      return WALK_FILE;
+   }
+   else if (S_ISDIR(mode))
+   {
+      return WALK_DIRECTORY;
+   }
+   else if (S_ISLNK(mode))
+   {
+      return WALK_LINK;
+   }
+
+   return WALK_OTHER;
+}
+
+static struct walk_directory*
+walk_directory_create(char* relative, char* name, int depth)
+{
+   size_t length;
+   struct walk_directory* directory = NULL;
+
+   directory = (struct walk_directory*)calloc(1, sizeof(struct walk_directory));
+   if (directory == NULL)
+   {
+      goto error;
+   }
+
+   length = strlen(relative) + (name != NULL ? strlen(name) + 1 : 0) + 1;
+
+   directory->relative = (char*)malloc(length);
+   if (directory->relative == NULL)
+   {
+      goto error;
+   }
+
+   if (name == NULL)
+   {
+      snprintf(directory->relative, length, "%s", relative);
+   }
+   else if (strlen(relative) == 0)
+   {
+      snprintf(directory->relative, length, "%s", name);
+   }
+   else
+   {
+      snprintf(directory->relative, length, "%s/%s", relative, name);
+   }
+
+   directory->depth = depth;
+
+   return directory;
+
+error:
+
+   free(directory);
+
+   return NULL;
+}
+
+static void
+walk_directory_free(struct walk_directory* directory)
+{
+   struct walk_directory* next = NULL;
+
+   while (directory != NULL)
+   {
+      next = directory->next;
+      free(directory->relative);
+      free(directory);
+      directory = next;
+   }
+}
@@ -0,0 +1,1555 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <info.h>
+#include <logging.h>
+#include <streamer.h>
+#include <utils.h>
+#include <wal.h>
+#include <walfile.h>
+#include <walpack.h>
+#include <walfile/wal_reader.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zstd.h>
+
+struct walpack_image
+{
+   struct rel_file_locator rlocator; /**< The relation */
+   int forknum;                      /**< The fork */
+   uint32_t blkno;                   /**< The block */
+   uint64_t lsn;                     /**< The record */
+   int first;                        /**< The first piece */
+   int number_of_pieces;             /**< The number of pieces */
+};
+
+struct walpack_piece
+{
+   uint32_t offset; /**< The offset in the segment */
+   uint32_t length; /**< The length */
+};
+
+static char* walpack_path(char* directory, char* name);
+static int walpack_segment(char* file, uint32_t wal_size, uint32_t* timeline, uint64_t* segno);
+static int walpack_index(FILE* file, uint32_t* number_of_entries, unsigned char** index);
+static int walpack_window_log(uint32_t wal_size);
+static int walpack_write(int server, char* directory, char** files, int number_of_files, bool compact);
+static bool walpack_is_compacted(char* path);
+static int walpack_compact_pack(int server, char* directory, char* name);
+static int walpack_fpi_split(int server, char* name, char* data, size_t size, char** blob, size_t* blob_size);
+static int walpack_fpi_join(char* blob, size_t blob_size, char** segment, size_t* segment_size);
+static int walpack_fpi_pieces(size_t position, size_t skip, size_t length, uint32_t block_size, size_t size,
+                              struct walpack_piece** pieces, int* number_of_pieces, int* capacity);
+static int walpack_image_compare(const void* a, const void* b);
+static int walpack_decode(FILE* file, unsigned char* entry, void* prefix, size_t prefix_size, void** data);
+static int walpack_extract_entry(FILE* file, unsigned char* index, uint32_t number_of_entries, uint32_t i, void** reference, char* to);
+
+int
+pgmoneta_walpack_directory(int server, char* directory)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   int first = -1;
+   int length = 0;
+   uint32_t timeline = 0;
+   uint32_t previous_timeline = 0;
+   uint64_t segno = 0;
+   uint64_t previous_segno = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->wal_pack < 2 || config->servers[server].wal_size == 0)
+   {
+      return 0;
+   }
+
+   if (pgmoneta_get_wal_files(directory, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   /* The names are sorted, so a run of consecutive segments is a run of the list */
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if (pgmoneta_is_walpack(files[i]) || pgmoneta_is_encrypted_archive(files[i]) ||
+          walpack_segment(files[i], config->servers[server].wal_size, &timeline, &segno))
+      {
+         first = -1;
+         length = 0;
+         continue;
+      }
+
+      if (first == -1 || timeline != previous_timeline || segno != previous_segno + 1)
+      {
+         first = i;
+         length = 0;
+      }
+
+      length++;
+      previous_timeline = timeline;
+      previous_segno = segno;
+
+      if (length == config->wal_pack)
+      {
+         if (walpack_write(server, directory, &files[first], length, false))
+         {
+            goto error;
+         }
+
+         first = -1;
+         length = 0;
+      }
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   return 1;
+}
+
+int
+pgmoneta_walpack_compact(int server, char* directory)
+{
+   char* d = NULL;
+   char limit[MISC_LENGTH];
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   char* path = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!config->wal_compaction)
+   {
+      return 0;
+   }
+
+   memset(&limit[0], 0, sizeof(limit));
+
+   d = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_backups(d, &number_of_backups, &backups))
+   {
+      goto error;
+   }
+
+   for (int i = number_of_backups - 1; i >= 0; i--)
+   {
+      if (backups[i] != NULL && backups[i]->valid == VALID_TRUE && backups[i]->type == TYPE_FULL)
+      {
+         memcpy(&limit[0], &backups[i]->wal[0], sizeof(limit));
+         break;
+      }
+   }
+
+   /* Recovery from the newest full backup never reads the WAL before it */
+   if (strlen(&limit[0]) == 0)
+   {
+      goto done;
+   }
+
+   if (pgmoneta_get_wal_files(directory, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if (!pgmoneta_is_walpack(files[i]) || strncmp(files[i], &limit[0], 24) >= 0)
+      {
+         continue;
+      }
+
+      path = walpack_path(directory, files[i]);
+
+      if (!walpack_is_compacted(path) && walpack_compact_pack(server, directory, files[i]))
+      {
+         pgmoneta_log_warn("WAL pack: Could not compact %s", path);
+      }
+
+      free(path);
+      path = NULL;
+   }
+
+done:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(d);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(d);
+
+   return 1;
+}
+
+bool
+pgmoneta_is_walpack(char* name)
+{
+   return pgmoneta_ends_with(name, WALPACK_SUFFIX);
+}
+
+int
+pgmoneta_walpack_members(char* path, int* number_of_members, char*** members)
+{
+   uint32_t number_of_entries = 0;
+   unsigned char* index = NULL;
+   char** m = NULL;
+   FILE* file = NULL;
+
+   *number_of_members = 0;
+   *members = NULL;
+
+   file = fopen(path, "rb");
+   if (file == NULL || walpack_index(file, &number_of_entries, &index))
+   {
+      goto error;
+   }
+
+   m = (char**)calloc(MAX(number_of_entries, 1), sizeof(char*));
+   if (m == NULL)
+   {
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < number_of_entries; i++)
+   {
+      m[i] = pgmoneta_append(NULL, (char*)(index + i * WALPACK_ENTRY_SIZE));
+   }
+
+   *number_of_members = (int)number_of_entries;
+   *members = m;
+
+   free(index);
+   fclose(file);
+
+   return 0;
+
+error:
+
+   free(index);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+char*
+pgmoneta_walpack_find(char* directory, char* name)
+{
+   char* best = NULL;
+   char* path = NULL;
+   int number_of_members = 0;
+   char** members = NULL;
+   bool found = false;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   dir = opendir(directory);
+   if (dir == NULL)
+   {
+      return NULL;
+   }
+
+   /* A pack is named after its last segment, so the segment is in the first pack that ends at or after it */
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!pgmoneta_is_walpack(entry->d_name) || strncmp(entry->d_name, name, 24) < 0)
+      {
+         continue;
+      }
+
+      if (best == NULL || strcmp(entry->d_name, best) < 0)
+      {
+         free(best);
+         best = pgmoneta_append(NULL, entry->d_name);
+      }
+   }
+
+   closedir(dir);
+
+   if (best == NULL)
+   {
+      return NULL;
+   }
+
+   path = walpack_path(directory, best);
+
+   if (!pgmoneta_walpack_members(path, &number_of_members, &members))
+   {
+      for (int i = 0; i < number_of_members; i++)
+      {
+         if (!strcmp(members[i], name))
+         {
+            found = true;
+         }
+         free(members[i]);
+      }
+      free(members);
+   }
+
+   free(best);
+
+   if (!found)
+   {
+      free(path);
+      return NULL;
+   }
+
+   return path;
+}
+
+int
+pgmoneta_walpack_extract(char* path, char* name, char* to)
+{
+   uint32_t number_of_entries = 0;
+   unsigned char* index = NULL;
+   bool found = false;
+   void* reference = NULL;
+   FILE* file = NULL;
+
+   file = fopen(path, "rb");
+   if (file == NULL || walpack_index(file, &number_of_entries, &index))
+   {
+      goto error;
+   }
+
+   for (uint32_t i = 0; !found && i < number_of_entries; i++)
+   {
+      if (!strcmp((char*)(index + i * WALPACK_ENTRY_SIZE), name))
+      {
+         found = true;
+
+         if (walpack_extract_entry(file, index, number_of_entries, i, &reference, to))
+         {
+            goto error;
+         }
+      }
+   }
+
+   if (!found)
+   {
+      goto error;
+   }
+
+   free(reference);
+   free(index);
+   fclose(file);
+
+   return 0;
+
+error:
+
+   free(reference);
+   free(index);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_walpack_extract_range(char* path, char* directory, char* start, char* end)
+{
+   uint32_t number_of_entries = 0;
+   unsigned char* index = NULL;
+   char* name = NULL;
+   char* to = NULL;
+   void* reference = NULL;
+   FILE* file = NULL;
+
+   file = fopen(path, "rb");
+   if (file == NULL || walpack_index(file, &number_of_entries, &index))
+   {
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < number_of_entries; i++)
+   {
+      name = (char*)(index + i * WALPACK_ENTRY_SIZE);
+
+      if (strncmp(name, start, 24) < 0 || (end != NULL && strncmp(name, end, 24) > 0))
+      {
+         continue;
+      }
+
+      to = walpack_path(directory, name);
+
+      if (walpack_extract_entry(file, index, number_of_entries, i, &reference, to))
+      {
+         goto error;
+      }
+
+      free(to);
+      to = NULL;
+   }
+
+   free(reference);
+   free(index);
+   fclose(file);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("WAL pack: Could not extract from %s", path);
+
+   free(to);
+   free(reference);
+   free(index);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_walpack_expand(char* directory, int* number_of_files, char*** files)
+{
+   int n = 0;
+   int capacity = 0;
+   int number_of_members = 0;
+   char** members = NULL;
+   char** expanded = NULL;
+   char** e = NULL;
+   char* path = NULL;
+
+   capacity = MAX(*number_of_files, 1);
+   expanded = (char**)malloc(capacity * sizeof(char*));
+   if (expanded == NULL)
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < *number_of_files; i++)
+   {
+      number_of_members = 0;
+      members = NULL;
+
+      if (pgmoneta_is_walpack((*files)[i]))
+      {
+         path = walpack_path(directory, (*files)[i]);
+         pgmoneta_walpack_members(path, &number_of_members, &members);
+         free(path);
+         path = NULL;
+      }
+
+      if (n + MAX(number_of_members, 1) > capacity)
+      {
+         capacity = MAX(capacity * 2, n + number_of_members);
+         e = (char**)realloc(expanded, capacity * sizeof(char*));
+         if (e == NULL)
+         {
+            goto error;
+         }
+         expanded = e;
+      }
+
+      if (members != NULL)
+      {
+         for (int j = 0; j < number_of_members; j++)
+         {
+            expanded[n++] = members[j];
+         }
+         free(members);
+         members = NULL;
+
+         free((*files)[i]);
+      }
+      else
+      {
+         expanded[n++] = (*files)[i];
+      }
+
+      (*files)[i] = NULL;
+   }
+
+   free(*files);
+
+   *number_of_files = n;
+   *files = expanded;
+
+   return 0;
+
+error:
+
+   for (int j = 0; j < number_of_members; j++)
+   {
+      free(members[j]);
+   }
+   free(members);
+
+   for (int j = 0; j < n; j++)
+   {
+      free(expanded[j]);
+   }
+   free(expanded);
+
+   /* The entries that were moved are gone from the input as well */
+   for (int j = 0; j < *number_of_files; j++)
+   {
+      free((*files)[j]);
+   }
+   free(*files);
+
+   *number_of_files = 0;
+   *files = NULL;
+
+   return 1;
+}
+
+static char*
+walpack_path(char* directory, char* name)
+{
+   char* path = NULL;
+
+   path = pgmoneta_append(path, directory);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   path = pgmoneta_append(path, name);
+
+   return path;
+}
+
+static int
+walpack_segment(char* file, uint32_t wal_size, uint32_t* timeline, uint64_t* segno)
+{
+   char* name = NULL;
+   uint32_t log = 0;
+   uint32_t seg = 0;
+
+   name = pgmoneta_walfile_segment_name(file);
+
+   if (name == NULL || strlen(name) != 24 || strspn(name, "0123456789ABCDEF") != 24 ||
+       sscanf(name, "%08X%08X%08X", timeline, &log, &seg) != 3)
+   {
+      free(name);
+      return 1;
+   }
+
+   *segno = (uint64_t)log * (0x100000000ULL / wal_size) + seg;
+
+   free(name);
+
+   return 0;
+}
+
+static int
+walpack_index(FILE* file, uint32_t* number_of_entries, unsigned char** index)
+{
+   unsigned char header[WALPACK_HEADER_SIZE];
+   unsigned char* i = NULL;
+   bool v1 = false;
+   uint32_t n;
+
+   *number_of_entries = 0;
+   *index = NULL;
+
+   if (fread(header, 1, WALPACK_HEADER_SIZE, file) != WALPACK_HEADER_SIZE)
+   {
+      goto error;
+   }
+
+   if (!memcmp(header, WALPACK_MAGIC_V1, WALPACK_MAGIC_SIZE))
+   {
+      v1 = true;
+   }
+   else if (memcmp(header, WALPACK_MAGIC, WALPACK_MAGIC_SIZE) &&
+            memcmp(header, WALPACK_MAGIC_COMPACT, WALPACK_MAGIC_SIZE))
+   {
+      goto error;
+   }
+
+   n = pgmoneta_read_uint32(header + WALPACK_MAGIC_SIZE);
+
+   i = (unsigned char*)malloc(MAX(n, 1) * WALPACK_ENTRY_SIZE);
+   if (i == NULL)
+   {
+      goto error;
+   }
+
+   for (uint32_t j = 0; j < n; j++)
+   {
+      unsigned char* entry = i + j * WALPACK_ENTRY_SIZE;
+
+      if (fread(entry, v1 ? WALPACK_ENTRY_SIZE_V1 : WALPACK_ENTRY_SIZE, 1, file) != 1)
+      {
+         goto error;
+      }
+
+      /* The segments of the first version were all compressed on their own */
+      if (v1)
+      {
+         pgmoneta_write_uint64(entry + WALPACK_NAME_SIZE + 24, WALPACK_NO_REFERENCE);
+      }
+
+      entry[WALPACK_NAME_SIZE - 1] = '\0';
+   }
+
+   *number_of_entries = n;
+   *index = i;
+
+   return 0;
+
+error:
+
+   free(i);
+
+   return 1;
+}
+
+static int
+walpack_write(int server, char* directory, char** files, int number_of_files, bool compact)
+{
+   char* path = NULL;
+   char* tmp = NULL;
+   char* from = NULL;
+   char* data = NULL;
+   size_t size = 0;
+   char* blob = NULL;
+   size_t blob_size = 0;
+   char* reference = NULL;
+   size_t reference_size = 0;
+   void* compressed = NULL;
+   size_t compressed_size = 0;
+   size_t bound;
+   uint64_t offset;
+   int level;
+   int window_log;
+   ZSTD_bounds bounds;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   unsigned char header[WALPACK_HEADER_SIZE];
+   unsigned char* index = NULL;
+   unsigned char* entry = NULL;
+   char* name = NULL;
+   FILE* memory = NULL;
+   FILE* out = NULL;
+   ZSTD_CCtx* cctx = NULL;
+
+   level = pgmoneta_get_wal_compression_level(server);
+   level = MAX(1, MIN(level, 19));
+
+   cctx = ZSTD_createCCtx();
+   if (cctx == NULL)
+   {
+      goto error;
+   }
+
+   /* The window covers the reference segment and the segment, so the long distance matcher finds the
+      full page images the segment repeats from the reference */
+   window_log = walpack_window_log(config->servers[server].wal_size);
+   bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+   window_log = MAX(bounds.lowerBound, MIN(window_log, bounds.upperBound));
+
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, window_log);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+   index = (unsigned char*)calloc(number_of_files, WALPACK_ENTRY_SIZE);
+   if (index == NULL)
+   {
+      goto error;
+   }
+
+   name = pgmoneta_walfile_segment_name(files[number_of_files - 1]);
+   if (name == NULL)
+   {
+      goto error;
+   }
+
+   path = walpack_path(directory, name);
+   path = pgmoneta_append(path, WALPACK_SUFFIX);
+
+   tmp = pgmoneta_append(NULL, path);
+   tmp = pgmoneta_append(tmp, ".tmp");
+
+   free(name);
+   name = NULL;
+
+   out = fopen(tmp, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("WAL pack: Could not create %s", tmp);
+      goto error;
+   }
+
+   memcpy(header, compact ? WALPACK_MAGIC_COMPACT : WALPACK_MAGIC, WALPACK_MAGIC_SIZE);
+   pgmoneta_write_uint32(header + WALPACK_MAGIC_SIZE, (uint32_t)number_of_files);
+
+   if (fwrite(header, 1, WALPACK_HEADER_SIZE, out) != WALPACK_HEADER_SIZE ||
+       fwrite(index, WALPACK_ENTRY_SIZE, number_of_files, out) != (size_t)number_of_files)
+   {
+      goto error;
+   }
+
+   offset = WALPACK_HEADER_SIZE + (uint64_t)number_of_files * WALPACK_ENTRY_SIZE;
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      from = walpack_path(directory, files[i]);
+
+      memory = open_memstream(&data, &size);
+      if (memory == NULL || pgmoneta_destreamer_stream(from, memory))
+      {
+         goto error;
+      }
+
+      if (fclose(memory))
+      {
+         memory = NULL;
+         goto error;
+      }
+      memory = NULL;
+
+      name = pgmoneta_walfile_segment_name(files[i]);
+      if (name == NULL)
+      {
+         goto error;
+      }
+
+      /* A segment that can't be read as WAL is kept as it is */
+      if (compact && !walpack_fpi_split(server, name, data, size, &blob, &blob_size))
+      {
+         free(data);
+         data = blob;
+         size = blob_size;
+         blob = NULL;
+      }
+
+      bound = ZSTD_compressBound(size);
+      if (bound > compressed_size)
+      {
+         free(compressed);
+         compressed = malloc(bound);
+         if (compressed == NULL)
+         {
+            compressed_size = 0;
+            goto error;
+         }
+         compressed_size = bound;
+      }
+
+      /* The prefix only applies to the next frame */
+      if (reference != NULL)
+      {
+         ZSTD_CCtx_refPrefix(cctx, reference, reference_size);
+      }
+
+      bound = ZSTD_compress2(cctx, compressed, compressed_size, data, size);
+      if (ZSTD_isError(bound))
+      {
+         pgmoneta_log_error("WAL pack: Could not compress %s (%s)", from, ZSTD_getErrorName(bound));
+         goto error;
+      }
+
+      if (fwrite(compressed, 1, bound, out) != bound)
+      {
+         goto error;
+      }
+
+      entry = index + i * WALPACK_ENTRY_SIZE;
+      snprintf((char*)entry, WALPACK_NAME_SIZE, "%s", name);
+      pgmoneta_write_uint64(entry + WALPACK_NAME_SIZE, offset);
+      pgmoneta_write_uint64(entry + WALPACK_NAME_SIZE + 8, bound);
+      pgmoneta_write_uint64(entry + WALPACK_NAME_SIZE + 16, size);
+      pgmoneta_write_uint64(entry + WALPACK_NAME_SIZE + 24, reference != NULL ? 0 : WALPACK_NO_REFERENCE);
+
+      offset += bound;
+
+      if (reference == NULL)
+      {
+         reference = data;
+         reference_size = size;
+      }
+      else
+      {
+         free(data);
+      }
+
+      free(name);
+      free(from);
+      name = NULL;
+      data = NULL;
+      from = NULL;
+      size = 0;
+   }
+
+   if (fseek(out, WALPACK_HEADER_SIZE, SEEK_SET) ||
+       fwrite(index, WALPACK_ENTRY_SIZE, number_of_files, out) != (size_t)number_of_files ||
+       fflush(out) || fsync(fileno(out)))
+   {
+      pgmoneta_log_error("WAL pack: Could not write %s", tmp);
+      goto error;
+   }
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (rename(tmp, path))
+   {
+      pgmoneta_log_error("WAL pack: Could not rename %s: %s", tmp, strerror(errno));
+      goto error;
+   }
+
+   pgmoneta_permission(path, 6, 0, 0);
+
+   /* The segments are only removed once the pack is durable */
+   for (int i = 0; i < number_of_files; i++)
+   {
+      from = walpack_path(directory, files[i]);
+      pgmoneta_delete_file(from, NULL);
+      free(from);
+      from = NULL;
+   }
+
+   pgmoneta_log_debug("WAL pack: %s (%d segments, %" PRIu64 " bytes)", path, number_of_files, offset);
+
+   ZSTD_freeCCtx(cctx);
+   free(reference);
+   free(compressed);
+   free(index);
+   free(path);
+   free(tmp);
+
+   return 0;
+
+error:
+
+   if (memory != NULL)
+   {
+      fclose(memory);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (tmp != NULL)
+   {
+      unlink(tmp);
+   }
+
+   ZSTD_freeCCtx(cctx);
+   free(reference);
+   free(compressed);
+   free(index);
+   free(name);
+   free(data);
+   free(from);
+   free(path);
+   free(tmp);
+
+   return 1;
+}
+
+static int
+walpack_window_log(uint32_t wal_size)
+{
+   int window_log = 10;
+
+   while (window_log < 31 && ((uint64_t)1 << window_log) < 2 * (uint64_t)wal_size)
+   {
+      window_log++;
+   }
+
+   return window_log;
+}
+
+static int
+walpack_decode(FILE* file, unsigned char* entry, void* prefix, size_t prefix_size, void** data)
+{
+   uint64_t offset;
+   uint64_t length;
+   uint64_t size;
+   size_t n;
+   void* compressed = NULL;
+   void* d = NULL;
+   ZSTD_bounds bounds;
+   ZSTD_DCtx* dctx = NULL;
+
+   *data = NULL;
+
+   offset = pgmoneta_read_uint64(entry + WALPACK_NAME_SIZE);
+   length = pgmoneta_read_uint64(entry + WALPACK_NAME_SIZE + 8);
+   size = pgmoneta_read_uint64(entry + WALPACK_NAME_SIZE + 16);
+
+   compressed = malloc(MAX(length, 1));
+   d = malloc(MAX(size, 1));
+   dctx = ZSTD_createDCtx();
+   if (compressed == NULL || d == NULL || dctx == NULL)
+   {
+      goto error;
+   }
+
+   if (fseeko(file, (off_t)offset, SEEK_SET) || fread(compressed, 1, length, file) != length)
+   {
+      pgmoneta_log_error("WAL pack: Truncated segment %s", (char*)entry);
+      goto error;
+   }
+
+   /* The window of a frame with a prefix can be larger than the default limit */
+   bounds = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax);
+   ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, bounds.upperBound);
+
+   if (prefix != NULL)
+   {
+      ZSTD_DCtx_refPrefix(dctx, prefix, prefix_size);
+   }
+
+   n = ZSTD_decompressDCtx(dctx, d, size, compressed, length);
+   if (ZSTD_isError(n) || n != size)
+   {
+      pgmoneta_log_error("WAL pack: Could not decompress segment %s", (char*)entry);
+      goto error;
+   }
+
+   ZSTD_freeDCtx(dctx);
+   free(compressed);
+
+   *data = d;
+
+   return 0;
+
+error:
+
+   ZSTD_freeDCtx(dctx);
+   free(compressed);
+   free(d);
+
+   return 1;
+}
+
+static int
+walpack_extract_entry(FILE* file, unsigned char* index, uint32_t number_of_entries, uint32_t i, void** reference, char* to)
+{
+   unsigned char* entry = NULL;
+   unsigned char* reference_entry = NULL;
+   uint64_t r;
+   size_t size;
+   void* data = NULL;
+   char* segment = NULL;
+   void* prefix = NULL;
+   size_t prefix_size = 0;
+   FILE* out = NULL;
+
+   entry = index + i * WALPACK_ENTRY_SIZE;
+   size = pgmoneta_read_uint64(entry + WALPACK_NAME_SIZE + 16);
+   r = pgmoneta_read_uint64(entry + WALPACK_NAME_SIZE + 24);
+
+   if (r != WALPACK_NO_REFERENCE)
+   {
+      if (r >= number_of_entries || r == i)
+      {
+         goto error;
+      }
+
+      reference_entry = index + r * WALPACK_ENTRY_SIZE;
+
+      /* A reference segment is compressed on its own, and is decompressed once per pack */
+      if (pgmoneta_read_uint64(reference_entry + WALPACK_NAME_SIZE + 24) != WALPACK_NO_REFERENCE)
+      {
+         goto error;
+      }
+
+      if (*reference == NULL && walpack_decode(file, reference_entry, NULL, 0, reference))
+      {
+         goto error;
+      }
+
+      prefix = *reference;
+      prefix_size = pgmoneta_read_uint64(reference_entry + WALPACK_NAME_SIZE + 16);
+   }
+
+   if (walpack_decode(file, entry, prefix, prefix_size, &data))
+   {
+      goto error;
+   }
+
+   segment = data;
+
+   if (size >= WALPACK_MAGIC_SIZE && !memcmp(data, WALPACK_FPI_MAGIC, WALPACK_MAGIC_SIZE) &&
+       walpack_fpi_join(data, size, &segment, &size))
+   {
+      pgmoneta_log_error("WAL pack: Invalid full page images for %s", (char*)entry);
+      goto error;
+   }
+
+   out = fopen(to, "wb");
+   if (out == NULL)
+   {
+      pgmoneta_log_error("WAL pack: Could not create %s", to);
+      goto error;
+   }
+
+   if (fwrite(segment, 1, size, out) != size)
+   {
+      goto error;
+   }
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   free(data);
+
+   return 0;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+      unlink(to);
+   }
+
+   free(data);
+
+   return 1;
+}
+
+static bool
+walpack_is_compacted(char* path)
+{
+   char magic[WALPACK_MAGIC_SIZE];
+   bool compacted = false;
+   FILE* file = NULL;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      return false;
+   }
+
+   if (fread(&magic[0], 1, WALPACK_MAGIC_SIZE, file) == WALPACK_MAGIC_SIZE &&
+       !memcmp(&magic[0], WALPACK_MAGIC_COMPACT, WALPACK_MAGIC_SIZE))
+   {
+      compacted = true;
+   }
+
+   fclose(file);
+
+   return compacted;
+}
+
+static int
+walpack_compact_pack(int server, char* directory, char* name)
+{
+   char* path = NULL;
+   char* work = NULL;
+   char* relative = NULL;
+   int number_of_members = 0;
+   char** members = NULL;
+   char** files = NULL;
+
+   path = walpack_path(directory, name);
+
+   work = walpack_path(directory, name);
+   work = pgmoneta_append(work, ".compact/");
+
+   relative = pgmoneta_append(NULL, name);
+   relative = pgmoneta_append(relative, ".compact/");
+
+   if (pgmoneta_walpack_members(path, &number_of_members, &members) || number_of_members == 0)
+   {
+      goto error;
+   }
+
+   files = (char**)calloc(number_of_members, sizeof(char*));
+   if (files == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_members; i++)
+   {
+      files[i] = pgmoneta_append(NULL, relative);
+      files[i] = pgmoneta_append(files[i], members[i]);
+   }
+
+   /* The pack is rewritten under the same name, and replaces the old one when it is complete */
+   if (pgmoneta_mkdir(work) || pgmoneta_walpack_extract_range(path, work, "", NULL) ||
+       walpack_write(server, directory, files, number_of_members, true))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("WAL pack: Compacted %s", path);
+
+   pgmoneta_delete_directory(work);
+
+   for (int i = 0; i < number_of_members; i++)
+   {
+      free(members[i]);
+      free(files[i]);
+   }
+   free(members);
+   free(files);
+   free(relative);
+   free(work);
+   free(path);
+
+   return 0;
+
+error:
+
+   if (work != NULL && pgmoneta_exists(work))
+   {
+      pgmoneta_delete_directory(work);
+   }
+
+   for (int i = 0; i < number_of_members; i++)
+   {
+      free(members[i]);
+      if (files != NULL)
+      {
+         free(files[i]);
+      }
+   }
+   free(members);
+   free(files);
+   free(relative);
+   free(work);
+   free(path);
+
+   return 1;
+}
+
+static int
+walpack_fpi_split(int server, char* name, char* data, size_t size, char** blob, size_t* blob_size)
+{
+   struct walfile* wf = NULL;
+   struct deque_iterator* iter = NULL;
+   struct decoded_xlog_record* record = NULL;
+   struct walpack_image* images = NULL;
+   struct walpack_image* im = NULL;
+   int number_of_images = 0;
+   int image_capacity = 0;
+   struct walpack_piece* pieces = NULL;
+   int number_of_pieces = 0;
+   int piece_capacity = 0;
+   uint32_t block_size;
+   uint32_t segment_size;
+   size_t position;
+   size_t skip;
+   size_t images_size = 0;
+   size_t header_size;
+   char* b = NULL;
+   char* p = NULL;
+   char* segment = NULL;
+
+   *blob = NULL;
+   *blob_size = 0;
+
+   if (pgmoneta_read_walfile_buffer(server, name, data, size, &wf))
+   {
+      goto error;
+   }
+
+   block_size = wf->long_phd->xlp_xlog_blcksz;
+   segment_size = wf->long_phd->xlp_seg_size;
+
+   if (block_size == 0 || segment_size != size)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_deque_iterator_create(wf->records, &iter))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_deque_iterator_next(iter))
+   {
+      record = (struct decoded_xlog_record*)iter->value->data;
+
+      if (record->partial)
+      {
+         continue;
+      }
+
+      /* The images and the data of the blocks come before the main data at the end of the record */
+      skip = record->header.xl_tot_len - record->main_data_len;
+      for (int i = 0; i <= record->max_block_id; i++)
+      {
+         if (record->blocks[i].in_use)
+         {
+            skip -= record->blocks[i].has_image ? record->blocks[i].bimg_len : 0;
+            skip -= record->blocks[i].has_data ? record->blocks[i].data_len : 0;
+         }
+      }
+
+      if (skip < SIZE_OF_XLOG_RECORD || skip > record->header.xl_tot_len)
+      {
+         continue;
+      }
+
+      position = record->lsn % segment_size;
+
+      for (int i = 0; i <= record->max_block_id; i++)
+      {
+         struct decoded_bkp_block* blk = &record->blocks[i];
+
+         if (!blk->in_use)
+         {
+            continue;
+         }
+
+         if (blk->has_image && blk->bimg_len > 0)
+         {
+            if (number_of_images == image_capacity)
+            {
+               image_capacity = MAX(image_capacity * 2, 1024);
+               im = (struct walpack_image*)realloc(images, image_capacity * sizeof(struct walpack_image));
+               if (im == NULL)
+               {
+                  goto error;
+               }
+               images = im;
+            }
+
+            im = &images[number_of_images];
+            im->rlocator = blk->rlocator;
+            im->forknum = blk->forknum;
+            im->blkno = blk->blkno;
+            im->lsn = record->lsn;
+            im->first = number_of_pieces;
+
+            if (walpack_fpi_pieces(position, skip, blk->bimg_len, block_size, size,
+                                   &pieces, &number_of_pieces, &piece_capacity))
+            {
+               goto error;
+            }
+
+            im->number_of_pieces = number_of_pieces - im->first;
+            images_size += blk->bimg_len;
+            number_of_images++;
+
+            skip += blk->bimg_len;
+         }
+
+         if (blk->has_data)
+         {
+            skip += blk->data_len;
+         }
+      }
+   }
+
+   if (number_of_images == 0)
+   {
+      goto error;
+   }
+
+   qsort(images, number_of_images, sizeof(struct walpack_image), walpack_image_compare);
+
+   /* The magic, the number of pieces and the segment size, then the pieces, the images and the segment */
+   header_size = WALPACK_MAGIC_SIZE + 4 + 8 + (size_t)number_of_pieces * 8;
+   *blob_size = header_size + images_size + size;
+
+   b = (char*)malloc(*blob_size);
+   if (b == NULL)
+   {
+      goto error;
+   }
+
+   memcpy(b, WALPACK_FPI_MAGIC, WALPACK_MAGIC_SIZE);
+   pgmoneta_write_uint32(b + WALPACK_MAGIC_SIZE, (uint32_t)number_of_pieces);
+   pgmoneta_write_uint64(b + WALPACK_MAGIC_SIZE + 4, size);
+
+   segment = b + header_size + images_size;
+   memcpy(segment, data, size);
+
+   p = b + WALPACK_MAGIC_SIZE + 4 + 8;
+   position = header_size;
+
+   for (int i = 0; i < number_of_images; i++)
+   {
+      for (int j = images[i].first; j < images[i].first + images[i].number_of_pieces; j++)
+      {
+         pgmoneta_write_uint32(p, pieces[j].offset);
+         pgmoneta_write_uint32(p + 4, pieces[j].length);
+         p += 8;
+
+         /* The images are taken from the original, so the segment is rebuilt exactly */
+         memcpy(b + position, data + pieces[j].offset, pieces[j].length);
+         memset(segment + pieces[j].offset, 0, pieces[j].length);
+         position += pieces[j].length;
+      }
+   }
+
+   *blob = b;
+
+   pgmoneta_deque_iterator_destroy(iter);
+   pgmoneta_destroy_walfile(wf);
+   free(images);
+   free(pieces);
+
+   return 0;
+
+error:
+
+   *blob_size = 0;
+
+   pgmoneta_deque_iterator_destroy(iter);
+   pgmoneta_destroy_walfile(wf);
+   free(images);
+   free(pieces);
+   free(b);
+
+   return 1;
+}
+
+static int
+walpack_fpi_join(char* blob, size_t blob_size, char** segment, size_t* segment_size)
+{
+   uint32_t number_of_pieces;
+   uint64_t size;
+   uint64_t images_size = 0;
+   uint32_t offset;
+   uint32_t length;
+   size_t header_size;
+   size_t position;
+   char* p = NULL;
+   char* s = NULL;
+
+   if (blob_size < WALPACK_MAGIC_SIZE + 4 + 8)
+   {
+      return 1;
+   }
+
+   number_of_pieces = pgmoneta_read_uint32(blob + WALPACK_MAGIC_SIZE);
+   size = pgmoneta_read_uint64(blob + WALPACK_MAGIC_SIZE + 4);
+   header_size = WALPACK_MAGIC_SIZE + 4 + 8 + (size_t)number_of_pieces * 8;
+
+   if (header_size > blob_size)
+   {
+      return 1;
+   }
+
+   p = blob + WALPACK_MAGIC_SIZE + 4 + 8;
+   for (uint32_t i = 0; i < number_of_pieces; i++)
+   {
+      offset = pgmoneta_read_uint32(p + i * 8);
+      length = pgmoneta_read_uint32(p + i * 8 + 4);
+
+      if ((uint64_t)offset + length > size)
+      {
+         return 1;
+      }
+
+      images_size += length;
+   }
+
+   if (header_size + images_size + size != blob_size)
+   {
+      return 1;
+   }
+
+   s = blob + header_size + images_size;
+   position = header_size;
+
+   for (uint32_t i = 0; i < number_of_pieces; i++)
+   {
+      offset = pgmoneta_read_uint32(p + i * 8);
+      length = pgmoneta_read_uint32(p + i * 8 + 4);
+
+      memcpy(s + offset, blob + position, length);
+      position += length;
+   }
+
+   *segment = s;
+   *segment_size = size;
+
+   return 0;
+}
+
+static int
+walpack_fpi_pieces(size_t position, size_t skip, size_t length, uint32_t block_size, size_t size,
+                   struct walpack_piece** pieces, int* number_of_pieces, int* capacity)
+{
+   size_t chunk;
+   struct walpack_piece* p = NULL;
+
+   /* A record continues after the header of each page it crosses */
+   while (skip > 0)
+   {
+      if (position % block_size == 0)
+      {
+         position += SIZE_OF_XLOG_SHORT_PHD;
+      }
+
+      chunk = MIN(skip, block_size - position % block_size);
+      position += chunk;
+      skip -= chunk;
+   }
+
+   while (length > 0)
+   {
+      if (position % block_size == 0)
+      {
+         position += SIZE_OF_XLOG_SHORT_PHD;
+      }
+
+      chunk = MIN(length, block_size - position % block_size);
+
+      if (position + chunk > size)
+      {
+         return 1;
+      }
+
+      if (*number_of_pieces == *capacity)
+      {
+         *capacity = MAX(*capacity * 2, 1024);
+         p = (struct walpack_piece*)realloc(*pieces, *capacity * sizeof(struct walpack_piece));
+         if (p == NULL)
+         {
+            return 1;
+         }
+         *pieces = p;
+      }
+
+      (*pieces)[*number_of_pieces].offset = (uint32_t)position;
+      (*pieces)[*number_of_pieces].length = (uint32_t)chunk;
+      (*number_of_pieces)++;
+
+      position += chunk;
+      length -= chunk;
+   }
+
+   return 0;
+}
+
+static int
+walpack_image_compare(const void* a, const void* b)
+{
+   const struct walpack_image* x = (const struct walpack_image*)a;
+   const struct walpack_image* y = (const struct walpack_image*)b;
+
+   if (x->rlocator.spcOid != y->rlocator.spcOid)
+   {
+      return x->rlocator.spcOid < y->rlocator.spcOid ? -1 : 1;
+   }
+
+   if (x->rlocator.dbOid != y->rlocator.dbOid)
+   {
+      return x->rlocator.dbOid < y->rlocator.dbOid ? -1 : 1;
+   }
+
+   if (x->rlocator.relNumber != y->rlocator.relNumber)
+   {
+      return x->rlocator.relNumber < y->rlocator.relNumber ? -1 : 1;
+   }
+
+   if (x->forknum != y->forknum)
+   {
+      return x->forknum < y->forknum ? -1 : 1;
+   }
+
+   if (x->blkno != y->blkno)
+   {
+      return x->blkno < y->blkno ? -1 : 1;
+   }
+
+   if (x->lsn != y->lsn)
+   {
+      return x->lsn < y->lsn ? -1 : 1;
+   }
+
+   return 0;
+}
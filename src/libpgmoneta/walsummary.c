@@ -0,0 +1,1195 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <info.h>
+#include <json.h>
+#include <logging.h>
+#include <management.h>
+#include <network.h>
+#include <security.h>
+#include <utils.h>
+#include <value.h>
+#include <walindex.h>
+#include <walsummary.h>
+
+/* system */
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define WALSUMMARY_WAIT       120
+#define WALSUMMARY_THRESHOLD  0.9
+#define DEFAULTTABLESPACE_OID 1663
+#define GLOBALTABLESPACE_OID  1664
+
+static char* forks[] = {"", "_fsm", "_vm", "_init"};
+
+/** @struct walsummary_change
+ * A relation fork of the changes response
+ */
+struct walsummary_change
+{
+   char* path;                           /**< The path relative to the data directory */
+   struct walsummary_relation* relation; /**< The modified blocks */
+};
+
+static int summary_add(struct walsummary* summary, struct walindex* index);
+static char* relation_path(struct walindex_relation* relation);
+static int relation_set(struct walsummary_relation* relation, uint32_t block);
+static void relation_destroy_cb(uintptr_t data);
+static char* segment_name(uint32_t timeline, uint64_t segno, uint64_t wal_size);
+static int newest_index(int server, uint32_t timeline, uint64_t* lsn);
+static int change_compare(const void* a, const void* b);
+static int parent_files(int server, char* parent_label, struct art** files);
+static int incremental_walk(int server, char* data, char* relative_dir, struct walsummary* summary,
+                            struct art* parent, struct art* converted);
+static int incremental_file(int server, char* dir_path, char* relative_dir, char* name, struct walsummary* summary,
+                            struct art* parent, struct art* converted);
+static bool relation_file(char* name, char* relation, size_t size, uint32_t* segno);
+static bool path_fits(int n, size_t size);
+static char* incremental_path(char* relative);
+static int update_manifest(char* data, struct art* converted);
+static void remove_files(char* data, struct art* converted, bool incremental);
+
+int
+pgmoneta_walsummary_create(int server, uint32_t timeline, uint64_t start_lsn, uint64_t end_lsn, struct walsummary** summary)
+{
+   uint64_t wal_size = 0;
+   uint64_t end_segno = 0;
+   char* segment = NULL;
+   struct walindex* index = NULL;
+   struct walsummary* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *summary = NULL;
+
+   wal_size = (uint64_t)config->servers[server].wal_size;
+   if (wal_size == 0 || end_lsn < start_lsn)
+   {
+      goto error;
+   }
+
+   s = (struct walsummary*)calloc(1, sizeof(struct walsummary));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_art_create(&s->relations) || pgmoneta_art_create(&s->databases))
+   {
+      goto error;
+   }
+
+   end_segno = end_lsn / wal_size;
+
+   for (uint64_t segno = start_lsn / wal_size; segno <= end_segno; segno++)
+   {
+      int tries = 0;
+
+      segment = segment_name(timeline, segno, wal_size);
+
+      // The last segment is archived once the server switches away from it
+      while (pgmoneta_walindex_read(server, segment, true, &index))
+      {
+         if (segno != end_segno || tries++ >= WALSUMMARY_WAIT)
+         {
+            pgmoneta_log_debug("WAL summary: No index for %s", segment);
+            goto error;
+         }
+
+         SLEEP(500000000L);
+      }
+
+      if (summary_add(s, index))
+      {
+         goto error;
+      }
+
+      pgmoneta_walindex_destroy(index);
+      index = NULL;
+
+      free(segment);
+      segment = NULL;
+   }
+
+   *summary = s;
+
+   return 0;
+
+error:
+
+   pgmoneta_walindex_destroy(index);
+   pgmoneta_walsummary_destroy(s);
+   free(segment);
+
+   return 1;
+}
+
+bool
+pgmoneta_walsummary_modified(struct walsummary_relation* relation, uint32_t block)
+{
+   if (relation == NULL)
+   {
+      return false;
+   }
+
+   if (relation->created || block >= relation->truncate_block)
+   {
+      return true;
+   }
+
+   if (block >= relation->number_of_bits)
+   {
+      return false;
+   }
+
+   return (relation->bitmap[block / 8] & (1 << (block % 8))) != 0;
+}
+
+int
+pgmoneta_walsummary_incremental(int server, char* label, char* parent_label, uint32_t timeline, char* startpos)
+{
+   uint32_t hi = 0;
+   uint32_t lo = 0;
+   uint64_t start_lsn = 0;
+   uint64_t parent_lsn = 0;
+   char* server_dir = NULL;
+   char* data = NULL;
+   struct backup* parent = NULL;
+   struct walsummary* summary = NULL;
+   struct art* parent_paths = NULL;
+   struct art* converted = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   server_dir = pgmoneta_get_server_backup(server);
+   if (pgmoneta_get_backup(server_dir, parent_label, &parent) || parent == NULL)
+   {
+      goto error;
+   }
+
+   if (parent->start_timeline != timeline)
+   {
+      pgmoneta_log_warn("WAL summary: %s/%s is on timeline %u and %s on timeline %u", config->servers[server].name,
+                        parent_label, parent->start_timeline, label, timeline);
+      goto error;
+   }
+
+   if (startpos == NULL || sscanf(startpos, "%X/%X", &hi, &lo) != 2)
+   {
+      goto error;
+   }
+
+   start_lsn = ((uint64_t)hi << 32) | lo;
+   parent_lsn = ((uint64_t)parent->start_lsn_hi32 << 32) | parent->start_lsn_lo32;
+
+   if (pgmoneta_walsummary_create(server, timeline, parent_lsn, start_lsn, &summary))
+   {
+      pgmoneta_log_warn("WAL summary: The WAL indexes don't cover %s/%s since %s", config->servers[server].name,
+                        label, parent_label);
+      goto error;
+   }
+
+   if (parent_files(server, parent_label, &parent_paths))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_art_create(&converted))
+   {
+      goto error;
+   }
+
+   data = pgmoneta_get_server_backup_identifier_data(server, label);
+
+   // Relations in other tablespaces stay full files
+   if (incremental_walk(server, data, "global", summary, parent_paths, converted) ||
+       incremental_walk(server, data, "base", summary, parent_paths, converted))
+   {
+      goto error;
+   }
+
+   if (update_manifest(data, converted))
+   {
+      goto error;
+   }
+
+   remove_files(data, converted, false);
+
+   pgmoneta_log_debug("WAL summary: %s/%s has %lu incremental files", config->servers[server].name, label,
+                      (unsigned long)converted->size);
+
+   pgmoneta_art_destroy(converted);
+   pgmoneta_art_destroy(parent_paths);
+   pgmoneta_walsummary_destroy(summary);
+   free(parent);
+   free(server_dir);
+   free(data);
+
+   return 0;
+
+error:
+
+   if (converted != NULL && data != NULL)
+   {
+      remove_files(data, converted, true);
+   }
+
+   pgmoneta_art_destroy(converted);
+   pgmoneta_art_destroy(parent_paths);
+   pgmoneta_walsummary_destroy(summary);
+   free(parent);
+   free(server_dir);
+   free(data);
+
+   return 1;
+}
+
+void
+pgmoneta_walsummary_changes(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   char* identifier = NULL;
+   char* limit_value = NULL;
+   char* elapsed = NULL;
+   int limit = WALSUMMARY_CHANGES_LIMIT;
+   uint64_t start_lsn = 0;
+   uint64_t end_lsn = 0;
+   uint64_t total_blocks = 0;
+   uint64_t block_size = 0;
+   uint64_t number_of_changes = 0;
+   struct timespec start_t;
+   struct timespec end_t;
+   double total_seconds = 0;
+   struct backup* backup = NULL;
+   struct walsummary* summary = NULL;
+   struct walsummary_change* changes = NULL;
+   struct art_iterator* iter = NULL;
+   struct json* req = NULL;
+   struct json* response = NULL;
+   struct json* relations = NULL;
+   struct configuration* config;
+
+   pgmoneta_start_logging();
+
+   config = (struct configuration*)shmem;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   req = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
+   identifier = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_BACKUP);
+   limit_value = (char*)pgmoneta_json_get(req, MANAGEMENT_ARGUMENT_LIMIT);
+
+   if (limit_value != NULL && atoi(limit_value) > 0)
+   {
+      limit = atoi(limit_value);
+   }
+
+   if (identifier == NULL || pgmoneta_get_backup_server(server, identifier, &backup) || backup == NULL)
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_CHANGES_NOBACKUP, compression, encryption, payload);
+      pgmoneta_log_warn("Changes: No identifier for %s/%s", config->servers[server].name, identifier);
+      goto error;
+   }
+
+   start_lsn = ((uint64_t)backup->start_lsn_hi32 << 32) | backup->start_lsn_lo32;
+
+   if (newest_index(server, backup->start_timeline, &end_lsn) || end_lsn < start_lsn ||
+       pgmoneta_walsummary_create(server, backup->start_timeline, start_lsn, end_lsn, &summary))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_CHANGES_NOINDEX, compression, encryption, payload);
+      pgmoneta_log_warn("Changes: The WAL indexes don't cover %s/%s", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   changes = (struct walsummary_change*)calloc(MAX(summary->relations->size, 1), sizeof(struct walsummary_change));
+   if (changes == NULL || pgmoneta_art_iterator_create(summary->relations, &iter))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+      goto error;
+   }
+
+   while (pgmoneta_art_iterator_next(iter))
+   {
+      changes[number_of_changes].path = iter->key;
+      changes[number_of_changes].relation = (struct walsummary_relation*)pgmoneta_value_data(iter->value);
+      total_blocks += changes[number_of_changes].relation->blocks;
+      number_of_changes++;
+   }
+
+   qsort(changes, number_of_changes, sizeof(struct walsummary_change), change_compare);
+
+   // The servers table is filled once the server has been seen, so fall back to the default
+   block_size = config->servers[server].block_size > 0 ? config->servers[server].block_size : 8192;
+
+   if (pgmoneta_management_create_response(payload, server, &response) || pgmoneta_json_create(&relations))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+      goto error;
+   }
+
+   for (uint64_t i = 0; i < number_of_changes && i < (uint64_t)limit; i++)
+   {
+      struct json* relation = NULL;
+
+      if (pgmoneta_json_create(&relation))
+      {
+         pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_ALLOCATION, compression, encryption, payload);
+         goto error;
+      }
+
+      pgmoneta_json_put(relation, MANAGEMENT_ARGUMENT_RELATION, (uintptr_t)changes[i].path, ValueString);
+      pgmoneta_json_put(relation, MANAGEMENT_ARGUMENT_BLOCKS, (uintptr_t)changes[i].relation->blocks, ValueUInt32);
+      pgmoneta_json_put(relation, MANAGEMENT_ARGUMENT_CREATED, (uintptr_t)changes[i].relation->created, ValueBool);
+      pgmoneta_json_put(relation, MANAGEMENT_ARGUMENT_TRUNCATED, (uintptr_t)(changes[i].relation->truncate_block != UINT32_MAX), ValueBool);
+
+      pgmoneta_json_append(relations, (uintptr_t)relation, ValueJSON);
+   }
+
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BACKUP, (uintptr_t)backup->label, ValueString);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_NUMBER_OF_RELATIONS, (uintptr_t)number_of_changes, ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_BLOCKS, (uintptr_t)total_blocks, ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_DELTA, (uintptr_t)(total_blocks * block_size), ValueUInt64);
+   pgmoneta_json_put(response, MANAGEMENT_ARGUMENT_RELATIONS, (uintptr_t)relations, ValueJSON);
+   relations = NULL;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   if (pgmoneta_management_response_ok(NULL, client_fd, start_t, end_t, compression, encryption, payload))
+   {
+      pgmoneta_management_response_error(NULL, client_fd, config->servers[server].name, MANAGEMENT_ERROR_CHANGES_NETWORK, compression, encryption, payload);
+      pgmoneta_log_error("Changes: Error sending response for %s", config->servers[server].name);
+      goto error;
+   }
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+   pgmoneta_log_info("Changes: %s/%s (Relations: %lu, Blocks: %lu, Elapsed: %s)", config->servers[server].name,
+                     backup->label, (unsigned long)number_of_changes, (unsigned long)total_blocks, elapsed);
+
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   pgmoneta_art_iterator_destroy(iter);
+   pgmoneta_walsummary_destroy(summary);
+   free(changes);
+   free(backup);
+   free(elapsed);
+
+   exit(0);
+
+error:
+
+   pgmoneta_json_destroy(relations);
+   pgmoneta_json_destroy(payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   pgmoneta_art_iterator_destroy(iter);
+   pgmoneta_walsummary_destroy(summary);
+   free(changes);
+   free(backup);
+   free(elapsed);
+
+   exit(1);
+}
+
+void
+pgmoneta_walsummary_destroy(struct walsummary* summary)
+{
+   if (summary != NULL)
+   {
+      pgmoneta_art_destroy(summary->relations);
+      pgmoneta_art_destroy(summary->databases);
+      free(summary);
+   }
+}
+
+static int
+summary_add(struct walsummary* summary, struct walindex* index)
+{
+   uint32_t* blocks = index->block_numbers;
+   struct value_config relation_config = {.destroy_data = relation_destroy_cb, .to_string = NULL};
+
+   for (uint32_t i = 0; i < index->number_of_relations; i++)
+   {
+      struct walindex_relation* r = &index->relations[i];
+      struct walsummary_relation* sr = NULL;
+      char* path = NULL;
+
+      if (r->flags & WALINDEX_DATABASE_CREATED)
+      {
+         char database[MISC_LENGTH];
+
+         memset(&database[0], 0, sizeof(database));
+         snprintf(&database[0], sizeof(database), "base/%u", r->dboid);
+
+         if (pgmoneta_art_insert(summary->databases, &database[0], (uintptr_t)true, ValueBool))
+         {
+            return 1;
+         }
+      }
+
+      path = relation_path(r);
+
+      if (path != NULL)
+      {
+         sr = (struct walsummary_relation*)pgmoneta_art_search(summary->relations, path);
+
+         if (sr == NULL)
+         {
+            sr = (struct walsummary_relation*)calloc(1, sizeof(struct walsummary_relation));
+            if (sr == NULL)
+            {
+               free(path);
+               return 1;
+            }
+
+            sr->truncate_block = UINT32_MAX;
+
+            if (pgmoneta_art_insert_with_config(summary->relations, path, (uintptr_t)sr, &relation_config))
+            {
+               free(sr);
+               free(path);
+               return 1;
+            }
+         }
+
+         if (r->flags & WALINDEX_RELATION_CREATED)
+         {
+            sr->created = true;
+         }
+         sr->truncate_block = MIN(sr->truncate_block, r->truncate_block);
+
+         for (uint32_t j = 0; j < r->blocks; j++)
+         {
+            if (relation_set(sr, blocks[j]))
+            {
+               free(path);
+               return 1;
+            }
+         }
+      }
+
+      if (r->blocks > 0)
+      {
+         blocks += r->blocks;
+      }
+
+      free(path);
+   }
+
+   return 0;
+}
+
+static char*
+relation_path(struct walindex_relation* relation)
+{
+   if (relation->relnumber == 0 || relation->fork >= sizeof(forks) / sizeof(forks[0]))
+   {
+      return NULL;
+   }
+
+   if (relation->spcoid == GLOBALTABLESPACE_OID)
+   {
+      return pgmoneta_format_and_append(NULL, "global/%u%s", relation->relnumber, forks[relation->fork]);
+   }
+   else if (relation->spcoid == DEFAULTTABLESPACE_OID)
+   {
+      return pgmoneta_format_and_append(NULL, "base/%u/%u%s", relation->dboid, relation->relnumber,
+                                        forks[relation->fork]);
+   }
+
+   return NULL;
+}
+
+static int
+relation_set(struct walsummary_relation* relation, uint32_t block)
+{
+   if (block >= relation->number_of_bits)
+   {
+      uint64_t bits = MAX((uint64_t)block + 1, (uint64_t)relation->number_of_bits * 2);
+      size_t old_size = (relation->number_of_bits + 7) / 8;
+      size_t new_size = 0;
+      uint8_t* bitmap = NULL;
+
+      bits = MIN(bits, (uint64_t)UINT32_MAX);
+      new_size = (bits + 7) / 8;
+
+      bitmap = (uint8_t*)realloc(relation->bitmap, new_size);
+      if (bitmap == NULL)
+      {
+         return 1;
+      }
+
+      memset(bitmap + old_size, 0, new_size - old_size);
+
+      relation->bitmap = bitmap;
+      relation->number_of_bits = (uint32_t)bits;
+   }
+
+   if (!(relation->bitmap[block / 8] & (1 << (block % 8))))
+   {
+      relation->bitmap[block / 8] |= (uint8_t)(1 << (block % 8));
+      relation->blocks++;
+   }
+
+   return 0;
+}
+
+static void
+relation_destroy_cb(uintptr_t data)
+{
+   struct walsummary_relation* relation = (struct walsummary_relation*)data;
+
+   if (relation != NULL)
+   {
+      free(relation->bitmap);
+      free(relation);
+   }
+}
+
+static char*
+segment_name(uint32_t timeline, uint64_t segno, uint64_t wal_size)
+{
+   uint64_t segments_per_id = 0x100000000ULL / wal_size;
+
+   return pgmoneta_format_and_append(NULL, "%08X%08X%08X", timeline,
+                                     (uint32_t)(segno / segments_per_id),
+                                     (uint32_t)(segno % segments_per_id));
+}
+
+static int
+newest_index(int server, uint32_t timeline, uint64_t* lsn)
+{
+   char prefix[9];
+   char* d = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   struct walindex* index = NULL;
+   int ret = 1;
+
+   *lsn = 0;
+
+   memset(&prefix[0], 0, sizeof(prefix));
+   snprintf(&prefix[0], sizeof(prefix), "%08X", timeline);
+
+   d = pgmoneta_get_server_wal_index(server);
+
+   if (pgmoneta_get_files(d, &number_of_files, &files))
+   {
+      goto done;
+   }
+
+   // The names sort by segment, so the newest index of the timeline is the last one
+   for (int i = number_of_files - 1; i >= 0; i--)
+   {
+      if (!strncmp(files[i], &prefix[0], 8) && pgmoneta_ends_with(files[i], WALINDEX_SUFFIX))
+      {
+         char segment[25];
+
+         memset(&segment[0], 0, sizeof(segment));
+         memcpy(&segment[0], files[i], MIN(strlen(files[i]), sizeof(segment) - 1));
+
+         if (!pgmoneta_walindex_read(server, &segment[0], false, &index))
+         {
+            *lsn = index->max_lsn;
+            ret = 0;
+         }
+
+         break;
+      }
+   }
+
+done:
+
+   pgmoneta_walindex_destroy(index);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(d);
+
+   return ret;
+}
+
+static int
+change_compare(const void* a, const void* b)
+{
+   struct walsummary_change* ca = (struct walsummary_change*)a;
+   struct walsummary_change* cb = (struct walsummary_change*)b;
+
+   if (ca->relation->blocks != cb->relation->blocks)
+   {
+      return ca->relation->blocks > cb->relation->blocks ? -1 : 1;
+   }
+
+   return strcmp(ca->path, cb->path);
+}
+
+static int
+parent_files(int server, char* parent_label, struct art** files)
+{
+   char* manifest_path = NULL;
+   char* key_path[1] = {"Files"};
+   struct json_reader* reader = NULL;
+   struct json* file = NULL;
+   struct art* f = NULL;
+
+   *files = NULL;
+
+   manifest_path = pgmoneta_get_server_backup_identifier_data(server, parent_label);
+   manifest_path = pgmoneta_append(manifest_path, "backup_manifest");
+
+   if (pgmoneta_art_create(&f))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_reader_init(manifest_path, &reader))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_locate(reader, key_path, 1))
+   {
+      pgmoneta_log_error("WAL summary: Could not locate the files in %s", manifest_path);
+      goto error;
+   }
+
+   // An incremental file of the parent counts as the relation file itself
+   while (pgmoneta_json_next_array_item(reader, &file))
+   {
+      char relative[MAX_PATH];
+      char* path = (char*)pgmoneta_json_get(file, "Path");
+      char* name = NULL;
+
+      if (path != NULL)
+      {
+         memset(&relative[0], 0, sizeof(relative));
+
+         name = strrchr(path, '/');
+         name = name == NULL ? path : name + 1;
+
+         if (pgmoneta_starts_with(name, INCREMENTAL_PREFIX))
+         {
+            snprintf(&relative[0], sizeof(relative), "%.*s%s", (int)(name - path), path, name + INCREMENTAL_PREFIX_LENGTH);
+         }
+         else
+         {
+            snprintf(&relative[0], sizeof(relative), "%s", path);
+         }
+
+         if (pgmoneta_art_insert(f, &relative[0], (uintptr_t)true, ValueBool))
+         {
+            goto error;
+         }
+      }
+
+      pgmoneta_json_destroy(file);
+      file = NULL;
+   }
+
+   pgmoneta_json_reader_close(reader);
+   free(manifest_path);
+
+   *files = f;
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(file);
+   pgmoneta_json_reader_close(reader);
+   pgmoneta_art_destroy(f);
+   free(manifest_path);
+
+   return 1;
+}
+
+static int
+incremental_walk(int server, char* data, char* relative_dir, struct walsummary* summary,
+                 struct art* parent, struct art* converted)
+{
+   char dir_path[MAX_PATH];
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+
+   memset(&dir_path[0], 0, sizeof(dir_path));
+   snprintf(&dir_path[0], sizeof(dir_path), "%s%s", data, relative_dir);
+
+   if (!(dir = opendir(&dir_path[0])))
+   {
+      pgmoneta_log_error("WAL summary: Could not open directory %s", &dir_path[0]);
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      int n;
+      char path[MAX_PATH];
+      struct stat st;
+
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      memset(&path[0], 0, sizeof(path));
+      n = snprintf(&path[0], sizeof(path), "%s/%s", &dir_path[0], entry->d_name);
+
+      // an entry that can't be named stays a full file
+      if (!path_fits(n, sizeof(path)) || lstat(&path[0], &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         char relative[MAX_PATH];
+
+         memset(&relative[0], 0, sizeof(relative));
+         n = snprintf(&relative[0], sizeof(relative), "%s/%s", relative_dir, entry->d_name);
+
+         if (!path_fits(n, sizeof(relative)))
+         {
+            continue;
+         }
+
+         if (incremental_walk(server, data, &relative[0], summary, parent, converted))
+         {
+            goto error;
+         }
+      }
+      else if (S_ISREG(st.st_mode))
+      {
+         if (incremental_file(server, &dir_path[0], relative_dir, entry->d_name, summary, parent, converted))
+         {
+            goto error;
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return 1;
+}
+
+static int
+incremental_file(int server, char* dir_path, char* relative_dir, char* name, struct walsummary* summary,
+                 struct art* parent, struct art* converted)
+{
+   char relation[MAX_PATH];
+   char relative[MAX_PATH];
+   char key[MAX_PATH];
+   char path[MAX_PATH];
+   char target[MAX_PATH];
+   uint32_t segno = 0;
+   uint32_t magic = INCREMENTAL_MAGIC;
+   uint32_t truncation_block_length = 0;
+   uint32_t number_of_blocks = 0;
+   uint32_t* blocks = NULL;
+   size_t block_size = 0;
+   size_t relseg_size = 0;
+   size_t size = 0;
+   size_t header = 0;
+   char* page = NULL;
+   FILE* in = NULL;
+   FILE* out = NULL;
+   struct walsummary_relation* r = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   block_size = config->servers[server].block_size;
+   relseg_size = config->servers[server].relseg_size;
+
+   memset(&relation[0], 0, sizeof(relation));
+   memset(&relative[0], 0, sizeof(relative));
+   memset(&key[0], 0, sizeof(key));
+   memset(&path[0], 0, sizeof(path));
+   memset(&target[0], 0, sizeof(target));
+
+   if (block_size == 0 || relseg_size == 0 || !relation_file(name, &relation[0], sizeof(relation), &segno))
+   {
+      return 0;
+   }
+
+   if (!path_fits(snprintf(&relative[0], sizeof(relative), "%s/%s", relative_dir, name), sizeof(relative)) ||
+       !path_fits(snprintf(&key[0], sizeof(key), "%s/%s", relative_dir, &relation[0]), sizeof(key)))
+   {
+      return 0;
+   }
+
+   // Files that are new since the parent, or belong to a new database, stay full files
+   if (!pgmoneta_art_contains_key(parent, &relative[0]) || pgmoneta_art_contains_key(summary->databases, relative_dir))
+   {
+      return 0;
+   }
+
+   r = (struct walsummary_relation*)pgmoneta_art_search(summary->relations, &key[0]);
+   if (r != NULL && r->created)
+   {
+      return 0;
+   }
+
+   if (!path_fits(snprintf(&path[0], sizeof(path), "%s/%s", dir_path, name), sizeof(path)) ||
+       !path_fits(snprintf(&target[0], sizeof(target), "%s/%s%s", dir_path, INCREMENTAL_PREFIX, name), sizeof(target)))
+   {
+      return 0;
+   }
+
+   size = pgmoneta_get_file_size(&path[0]);
+   if (size == 0 || size % block_size != 0 || size / block_size > relseg_size)
+   {
+      return 0;
+   }
+
+   truncation_block_length = (uint32_t)(size / block_size);
+
+   blocks = (uint32_t*)malloc(truncation_block_length * sizeof(uint32_t));
+   if (blocks == NULL)
+   {
+      goto error;
+   }
+
+   for (uint32_t b = 0; b < truncation_block_length; b++)
+   {
+      if (pgmoneta_walsummary_modified(r, (uint32_t)((uint64_t)segno * relseg_size + b)))
+      {
+         blocks[number_of_blocks++] = b;
+      }
+   }
+
+   // Same as PostgreSQL, an incremental file doesn't pay off when most blocks changed
+   if (number_of_blocks >= truncation_block_length * WALSUMMARY_THRESHOLD)
+   {
+      free(blocks);
+      return 0;
+   }
+
+   in = fopen(&path[0], "rb");
+   out = fopen(&target[0], "wb");
+   page = (char*)calloc(1, block_size);
+
+   if (in == NULL || out == NULL || page == NULL)
+   {
+      pgmoneta_log_error("WAL summary: Could not create %s", &target[0]);
+      goto error;
+   }
+
+   if (fwrite(&magic, sizeof(uint32_t), 1, out) != 1 ||
+       fwrite(&number_of_blocks, sizeof(uint32_t), 1, out) != 1 ||
+       fwrite(&truncation_block_length, sizeof(uint32_t), 1, out) != 1 ||
+       (number_of_blocks > 0 && fwrite(blocks, sizeof(uint32_t), number_of_blocks, out) != number_of_blocks))
+   {
+      goto error;
+   }
+
+   // The blocks start at a multiple of the block size
+   header = sizeof(uint32_t) * (3 + number_of_blocks);
+   if (number_of_blocks > 0 && header % block_size != 0)
+   {
+      if (fwrite(page, 1, block_size - (header % block_size), out) != block_size - (header % block_size))
+      {
+         goto error;
+      }
+   }
+
+   for (uint32_t i = 0; i < number_of_blocks; i++)
+   {
+      if (fseeko(in, (off_t)blocks[i] * (off_t)block_size, SEEK_SET) ||
+          fread(page, 1, block_size, in) != block_size ||
+          fwrite(page, 1, block_size, out) != block_size)
+      {
+         pgmoneta_log_error("WAL summary: Could not copy block %u of %s", blocks[i], &path[0]);
+         goto error;
+      }
+   }
+
+   fclose(in);
+   in = NULL;
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   if (pgmoneta_art_insert(converted, &relative[0], (uintptr_t)true, ValueBool))
+   {
+      goto error;
+   }
+
+   free(blocks);
+   free(page);
+
+   return 0;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (pgmoneta_exists(&target[0]))
+   {
+      pgmoneta_delete_file(&target[0], NULL);
+   }
+
+   free(blocks);
+   free(page);
+
+   return 1;
+}
+
+static bool
+relation_file(char* name, char* relation, size_t size, uint32_t* segno)
+{
+   char* p = name;
+   char* dot = NULL;
+   bool fork = false;
+
+   *segno = 0;
+
+   if (!isdigit((unsigned char)*p))
+   {
+      return false;
+   }
+
+   while (isdigit((unsigned char)*p))
+   {
+      p++;
+   }
+
+   for (size_t i = 1; !fork && i < sizeof(forks) / sizeof(forks[0]); i++)
+   {
+      if (!strncmp(p, forks[i], strlen(forks[i])))
+      {
+         p += strlen(forks[i]);
+         fork = true;
+      }
+   }
+
+   dot = p;
+
+   if (*p == '.')
+   {
+      p++;
+
+      if (!isdigit((unsigned char)*p))
+      {
+         return false;
+      }
+
+      *segno = (uint32_t)strtoul(p, &p, 10);
+   }
+
+   if (*p != '\0')
+   {
+      return false;
+   }
+
+   snprintf(relation, size, "%.*s", (int)(dot - name), name);
+
+   return true;
+}
+
+static bool
+path_fits(int n, size_t size)
+{
+   return n >= 0 && (size_t)n < size;
+}
+
+static char*
+incremental_path(char* relative)
+{
+   char* name = NULL;
+
+   name = strrchr(relative, '/');
+   name = name == NULL ? relative : name + 1;
+
+   return pgmoneta_format_and_append(NULL, "%.*s%s%s", (int)(name - relative), relative, INCREMENTAL_PREFIX, name);
+}
+
+static int
+update_manifest(char* data, struct art* converted)
+{
+   char* manifest_path = NULL;
+   char* tmp_path = NULL;
+   struct json* manifest = NULL;
+   struct json* files = NULL;
+   struct json_iterator* iter = NULL;
+
+   manifest_path = pgmoneta_append(NULL, data);
+   manifest_path = pgmoneta_append(manifest_path, "backup_manifest");
+   tmp_path = pgmoneta_append(NULL, manifest_path);
+   tmp_path = pgmoneta_append(tmp_path, ".tmp");
+
+   if (pgmoneta_json_read_file(manifest_path, &manifest))
+   {
+      pgmoneta_log_error("WAL summary: Could not read %s", manifest_path);
+      goto error;
+   }
+
+   files = (struct json*)pgmoneta_json_get(manifest, "Files");
+   if (files == NULL || pgmoneta_json_iterator_create(files, &iter))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_json_iterator_next(iter))
+   {
+      struct json* f = (struct json*)pgmoneta_value_data(iter->value);
+      char* path = (char*)pgmoneta_json_get(f, "Path");
+      char* algorithm = NULL;
+      char* relative = NULL;
+      char* full = NULL;
+      char* checksum = NULL;
+
+      if (path == NULL || !pgmoneta_art_contains_key(converted, path))
+      {
+         continue;
+      }
+
+      relative = incremental_path(path);
+      full = pgmoneta_append(NULL, data);
+      full = pgmoneta_append(full, relative);
+
+      algorithm = (char*)pgmoneta_json_get(f, "Checksum-Algorithm");
+      if (algorithm != NULL && strcasecmp(algorithm, "NONE"))
+      {
+         if (pgmoneta_create_file_hash(pgmoneta_get_hash_algorithm(algorithm), full, &checksum))
+         {
+            free(relative);
+            free(full);
+            goto error;
+         }
+
+         pgmoneta_json_put(f, "Checksum", (uintptr_t)checksum, ValueString);
+      }
+
+      pgmoneta_json_put(f, "Size", (uintptr_t)pgmoneta_get_file_size(full), ValueUInt64);
+      pgmoneta_json_put(f, "Path", (uintptr_t)relative, ValueString);
+
+      free(checksum);
+      free(relative);
+      free(full);
+   }
+
+   pgmoneta_json_iterator_destroy(iter);
+   iter = NULL;
+
+   if (pgmoneta_json_write_file(tmp_path, manifest) || rename(tmp_path, manifest_path))
+   {
+      pgmoneta_log_error("WAL summary: Could not write %s", manifest_path);
+      goto error;
+   }
+
+   pgmoneta_json_destroy(manifest);
+   free(manifest_path);
+   free(tmp_path);
+
+   return 0;
+
+error:
+
+   if (pgmoneta_exists(tmp_path))
+   {
+      pgmoneta_delete_file(tmp_path, NULL);
+   }
+
+   pgmoneta_json_iterator_destroy(iter);
+   pgmoneta_json_destroy(manifest);
+   free(manifest_path);
+   free(tmp_path);
+
+   return 1;
+}
+
+static void
+remove_files(char* data, struct art* converted, bool incremental)
+{
+   struct art_iterator* iter = NULL;
+
+   if (pgmoneta_art_iterator_create(converted, &iter))
+   {
+      return;
+   }
+
+   while (pgmoneta_art_iterator_next(iter))
+   {
+      char* relative = NULL;
+      char* path = NULL;
+
+      relative = incremental ? incremental_path(iter->key) : pgmoneta_append(NULL, iter->key);
+
+      path = pgmoneta_append(NULL, data);
+      path = pgmoneta_append(path, relative);
+
+      pgmoneta_delete_file(path, NULL);
+
+      free(relative);
+      free(path);
+   }
+
+   pgmoneta_art_iterator_destroy(iter);
+}
@@ -62,7 +62,7 @@ pgmoneta_create_archive(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -94,6 +94,7 @@ archive_execute(char* name, struct art* nodes)
    char* src = NULL;
    char* dst = NULL;
    char* d_name = NULL;
+   struct backup* backup = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -114,6 +115,7 @@ archive_execute(char* name, struct art* nodes)
    label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
    root = (char*)pgmoneta_art_search(nodes, NODE_TARGET_ROOT);
    base = (char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE);
+   backup = (struct backup*)pgmoneta_art_search(nodes, NODE_BACKUP);
 
    pgmoneta_log_debug("Archive (execute): %s/%s", config->servers[server].name, label);
 
@@ -139,7 +141,14 @@ archive_execute(char* name, struct art* nodes)
       pgmoneta_delete_file(dst, NULL);
    }
 
-   if (pgmoneta_tar_directory(src, dst, d_name))
+   if (backup != NULL && backup->type == TYPE_FULL && !backup->page_filter)
+   {
+      if (pgmoneta_tar_backup(server, backup, dst, d_name))
+      {
+         goto error;
+      }
+   }
+   else if (pgmoneta_tar_directory(src, dst, d_name))
    {
       goto error;
    }
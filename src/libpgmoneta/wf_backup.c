@@ -28,19 +28,25 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <achv.h>
 #include <art.h>
 #include <backup.h>
+#include <blockmap.h>
 #include <info.h>
 #include <logging.h>
 #include <management.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
+#include <page.h>
+#include <parallel.h>
 #include <security.h>
 #include <server.h>
 #include <stdint.h>
 #include <tablespace.h>
+#include <throttle.h>
 #include <utils.h>
+#include <walsummary.h>
 #include <workflow.h>
 
 /* system */
@@ -48,19 +54,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 static char* basebackup_name(void);
 static int basebackup_execute(char*, struct art*);
 
 static int send_upload_manifest(SSL* ssl, int socket);
 static int upload_manifest(SSL* ssl, int socket, char* path);
+static void totals_file(struct tar_totals* totals, char* path, bool add);
 
 struct workflow*
 pgmoneta_create_basebackup(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -105,6 +113,7 @@ basebackup_execute(char* name, struct art* nodes)
    char* tag = NULL;
    char* incremental = NULL;
    char* incremental_label = NULL;
+   bool summarized = false;
    char* manifest_path = NULL;
    char version[10];
    char minor_version[10];
@@ -115,10 +124,19 @@ basebackup_execute(char* name, struct art* nodes)
    uint32_t start_timeline = 0;
    uint32_t end_timeline = 0;
    char old_label_path[MAX_PATH];
+   char source_host[MISC_LENGTH];
+   int source_port = 0;
    int backup_max_rate;
    int network_max_rate;
    int hash;
    uint64_t biggest_file_size;
+   bool parallel = false;
+   uint32_t lsn_hi = 0;
+   uint32_t lsn_lo = 0;
+   struct page_checksums checksums;
+   struct page_checksums* verify = NULL;
+   struct tar_totals totals;
+   struct stat st;
    struct configuration* config;
    struct message* basebackup_msg = NULL;
    struct message* tablespace_msg = NULL;
@@ -126,6 +144,7 @@ basebackup_execute(char* name, struct art* nodes)
    struct query_response* response = NULL;
    struct tablespace* tablespaces = NULL;
    struct tablespace* current_tablespace = NULL;
+   struct info_batch* info = NULL;
    struct tuple* tup = NULL;
    struct token_bucket* bucket = NULL;
    struct token_bucket* network_bucket = NULL;
@@ -158,6 +177,13 @@ basebackup_execute(char* name, struct art* nodes)
       goto error;
    }
 
+   // Without the WAL summarizer the server sends a full backup, which is made
+   // incremental from the WAL indexes once it is received
+   if (incremental != NULL && config->servers[server].version < 17)
+   {
+      summarized = true;
+   }
+
    pgmoneta_memory_init();
 
    backup_max_rate = pgmoneta_get_backup_max_rate(server);
@@ -171,15 +197,17 @@ basebackup_execute(char* name, struct art* nodes)
       }
    }
 
+   // the backup takes its network tokens from the buckets the server and all servers share too
    network_max_rate = pgmoneta_get_network_max_rate(server);
-   if (network_max_rate)
+   if (network_max_rate || pgmoneta_token_bucket_limited(&config->servers[server].network_bucket) || pgmoneta_throttle_enabled())
    {
-      network_bucket = (struct token_bucket*)malloc(sizeof(struct token_bucket));
-      if (pgmoneta_token_bucket_init(network_bucket, network_max_rate))
+      network_bucket = (struct token_bucket*)calloc(1, sizeof(struct token_bucket));
+      if (network_bucket == NULL || (network_max_rate && pgmoneta_token_bucket_init(network_bucket, network_max_rate)))
       {
          pgmoneta_log_error("failed to initialize the network token bucket for backup.\n");
          goto error;
       }
+      network_bucket->parent = &config->servers[server].network_bucket;
    }
    usr = -1;
    // find the corresponding user's index of the given server
@@ -247,131 +275,213 @@ basebackup_execute(char* name, struct art* nodes)
    pgmoneta_close_ssl(ssl);
    pgmoneta_disconnect(socket);
 
-   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket) != AUTH_SUCCESS)
+   ssl = NULL;
+   socket = -1;
+
+   // the data is copied from a standby when there is one, the WAL is still streamed from the primary
+   if (pgmoneta_server_backup_source(server, &source_host[0], sizeof(source_host), &source_port))
    {
-      pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
       goto error;
    }
 
-   pgmoneta_memory_stream_buffer_init(&buffer);
+   if (strlen(source_host) > 0)
+   {
+      pgmoneta_log_info("Backup: %s/%s from standby %s:%d", config->servers[server].name, label, source_host, source_port);
+      pgmoneta_server_source(&source_host[0], source_port);
+   }
 
-   if (incremental != NULL)
+   hash = config->servers[server].manifest;
+   if (hash == HASH_ALGORITHM_DEFAULT)
+   {
+      hash = config->manifest;
+   }
+
+   // a full backup can be copied over several connections instead of one BASE_BACKUP
+   parallel = config->backup_connections > 1 && (incremental == NULL || summarized);
+
+   if (parallel)
+   {
+      backup_base = pgmoneta_get_server_backup_identifier(server, label);
+
+      pgmoneta_mkdir(backup_base);
+      if (pgmoneta_parallel_backup(server, label, backup_base, tablespaces, hash, bucket, network_bucket,
+                                   startpos, &start_timeline, endpos, &end_timeline))
+      {
+         pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
+
+         pgmoneta_create_info(backup_base, label, 0);
+
+         goto error;
+      }
+   }
+   else
    {
-      // send UPLOAD_MANIFEST
-      if (send_upload_manifest(ssl, socket))
+      if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket) != AUTH_SUCCESS)
       {
-         pgmoneta_log_error("Fail to send UPLOAD_MANIFEST to server %s", config->servers[server].name);
+         pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
          goto error;
       }
-      manifest_path = pgmoneta_append(NULL, incremental);
-      manifest_path = pgmoneta_append(manifest_path, "data/backup_manifest");
-      if (upload_manifest(ssl, socket, manifest_path))
+
+      pgmoneta_memory_stream_buffer_init(&buffer);
+
+      if (incremental != NULL && !summarized)
+      {
+         // send UPLOAD_MANIFEST
+         if (send_upload_manifest(ssl, socket))
+         {
+            pgmoneta_log_error("Fail to send UPLOAD_MANIFEST to server %s", config->servers[server].name);
+            goto error;
+         }
+         manifest_path = pgmoneta_append(NULL, incremental);
+         manifest_path = pgmoneta_append(manifest_path, "data/backup_manifest");
+         if (upload_manifest(ssl, socket, manifest_path))
+         {
+            pgmoneta_log_error("Fail to upload manifest to server %s", config->servers[server].name);
+            goto error;
+         }
+         // receive and ignore the result set for UPLOAD_MANIFEST
+         if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
+         {
+            goto error;
+         }
+         pgmoneta_free_query_response(response);
+         response = NULL;
+      }
+
+      tag = pgmoneta_append(tag, "pgmoneta_");
+      tag = pgmoneta_append(tag, label);
+
+      pgmoneta_create_base_backup_message(config->servers[server].version, incremental != NULL && !summarized, tag, true, hash,
+                                          config->compression_type, config->compression_level,
+                                          &basebackup_msg);
+
+      status = pgmoneta_write_message(ssl, socket, basebackup_msg);
+      if (status != MESSAGE_STATUS_OK)
       {
-         pgmoneta_log_error("Fail to upload manifest to server %s", config->servers[server].name);
          goto error;
       }
-      // receive and ignore the result set for UPLOAD_MANIFEST
+
+      // Receive the first result set, which contains the WAL starting point
       if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
       {
          goto error;
       }
+      memset(startpos, 0, sizeof(startpos));
+      memcpy(startpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
+      start_timeline = atoi(response->tuples[0].data[1]);
       pgmoneta_free_query_response(response);
       response = NULL;
-   }
 
-   tag = pgmoneta_append(tag, "pgmoneta_");
-   tag = pgmoneta_append(tag, label);
+      // the pages are verified as they arrive, the ones written after the start are replayed from the WAL
+      if (config->servers[server].checksums && sscanf(startpos, "%X/%X", &lsn_hi, &lsn_lo) == 2)
+      {
+         memset(&checksums, 0, sizeof(struct page_checksums));
+         checksums.block_size = config->servers[server].block_size;
+         checksums.relseg_size = config->servers[server].relseg_size;
+         checksums.lsn = ((uint64_t)lsn_hi << 32) | lsn_lo;
+         verify = &checksums;
+      }
 
-   hash = config->servers[server].manifest;
-   if (hash == HASH_ALGORITHM_DEFAULT)
-   {
-      hash = config->manifest;
-   }
+      // create the root dir
+      backup_base = pgmoneta_get_server_backup_identifier(server, label);
 
-   pgmoneta_create_base_backup_message(config->servers[server].version, incremental != NULL, tag, true, hash,
-                                       config->compression_type, config->compression_level,
-                                       &basebackup_msg);
+      pgmoneta_mkdir(backup_base);
 
-   status = pgmoneta_write_message(ssl, socket, basebackup_msg);
-   if (status != MESSAGE_STATUS_OK)
-   {
-      goto error;
-   }
+      // the files are added up as they are extracted, so the backup isn't walked for its size
+      memset(&totals, 0, sizeof(struct tar_totals));
+      if (!stat(backup_base, &st))
+      {
+         totals.block_size = st.st_blksize;
+      }
 
-   // Receive the first result set, which contains the WAL starting point
-   if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
-   {
-      goto error;
-   }
-   memset(startpos, 0, sizeof(startpos));
-   memcpy(startpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
-   start_timeline = atoi(response->tuples[0].data[1]);
-   pgmoneta_free_query_response(response);
-   response = NULL;
+      if (config->servers[server].version < 15)
+      {
+         if (pgmoneta_receive_archive_files(server, ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket, verify, &totals))
+         {
+            pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
 
-   // create the root dir
-   backup_base = pgmoneta_get_server_backup_identifier(server, label);
+            pgmoneta_create_info(backup_base, label, 0);
 
-   pgmoneta_mkdir(backup_base);
-   if (config->servers[server].version < 15)
-   {
-      if (pgmoneta_receive_archive_files(ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket))
+            goto error;
+         }
+      }
+      else
       {
-         pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
+         if (pgmoneta_receive_archive_stream(server, ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket, verify, &totals))
+         {
+            pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
 
-         pgmoneta_create_info(backup_base, label, 0);
+            pgmoneta_create_info(backup_base, label, 0);
 
-         goto error;
+            goto error;
+         }
       }
-   }
-   else
-   {
-      if (pgmoneta_receive_archive_stream(ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket))
+
+      if (verify != NULL)
       {
-         pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
+         pgmoneta_log_debug("Checksums: %s/%s (Blocks: %llu Failures: %llu)", config->servers[server].name, label,
+                            (unsigned long long)atomic_load(&checksums.blocks),
+                            (unsigned long long)atomic_load(&checksums.failures));
 
-         pgmoneta_create_info(backup_base, label, 0);
+         if (atomic_load(&checksums.failures) > 0)
+         {
+            pgmoneta_log_warn("Backup: %s/%s has %llu page checksum failures", config->servers[server].name, label,
+                              (unsigned long long)atomic_load(&checksums.failures));
+         }
+      }
 
+      // Receive the final result set, which contains the WAL ending point
+      if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
+      {
          goto error;
       }
-   }
-
-   // Receive the final result set, which contains the WAL ending point
-   if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
-   {
-      goto error;
-   }
-   memset(endpos, 0, sizeof(endpos));
-   memcpy(endpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
-   end_timeline = atoi(response->tuples[0].data[1]);
-   pgmoneta_free_query_response(response);
-   response = NULL;
-
-   // remove backup_label.old if it exists
-   memset(old_label_path, 0, MAX_PATH);
-   if (pgmoneta_ends_with(backup_base, "/"))
-   {
-      snprintf(old_label_path, MAX_PATH, "%sdata/%s", backup_base, "backup_label.old");
-   }
-   else
-   {
-      snprintf(old_label_path, MAX_PATH, "%s/data/%s", backup_base, "backup_label.old");
-   }
+      memset(endpos, 0, sizeof(endpos));
+      memcpy(endpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
+      end_timeline = atoi(response->tuples[0].data[1]);
+      pgmoneta_free_query_response(response);
+      response = NULL;
 
-   if (pgmoneta_exists(old_label_path))
-   {
-      if (pgmoneta_exists(old_label_path))
+      // remove backup_label.old if it exists
+      memset(old_label_path, 0, MAX_PATH);
+      if (pgmoneta_ends_with(backup_base, "/"))
       {
-         pgmoneta_delete_file(old_label_path, NULL);
+         snprintf(old_label_path, MAX_PATH, "%sdata/%s", backup_base, "backup_label.old");
       }
       else
       {
-         pgmoneta_log_debug("%s doesn't exists", old_label_path);
+         snprintf(old_label_path, MAX_PATH, "%s/data/%s", backup_base, "backup_label.old");
       }
+
+      if (pgmoneta_exists(old_label_path))
+      {
+         if (pgmoneta_exists(old_label_path))
+         {
+            totals_file(&totals, old_label_path, false);
+            pgmoneta_delete_file(old_label_path, NULL);
+         }
+         else
+         {
+            pgmoneta_log_debug("%s doesn't exists", old_label_path);
+         }
+      }
+
+      // receive and ignore the last result set, it's just a summary
+      pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response);
    }
 
-   // receive and ignore the last result set, it's just a summary
-   pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response);
+   if (strlen(source_host) > 0)
+   {
+      pgmoneta_server_source(NULL, 0);
+
+      // the WAL streamed from the primary only replays a backup taken on its timeline
+      if (start_timeline != end_timeline || start_timeline != config->servers[server].cur_timeline)
+      {
+         pgmoneta_log_error("Backup: %s/%s from standby %s:%d is on timeline %u to %u, but the primary is on timeline %u",
+                            config->servers[server].name, label, source_host, source_port,
+                            start_timeline, end_timeline, config->servers[server].cur_timeline);
+         goto error;
+      }
+   }
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
 
@@ -387,10 +497,32 @@ basebackup_execute(char* name, struct art* nodes)
 
    backup_data = pgmoneta_get_server_backup_identifier_data(server, label);
 
-   size = pgmoneta_directory_size(backup_data);
+   if (parallel)
+   {
+      size = pgmoneta_directory_size(backup_data);
+      biggest_file_size = pgmoneta_biggest_file(backup_data);
+   }
+   else
+   {
+      free(manifest_path);
+      manifest_path = pgmoneta_append(NULL, backup_data);
+      manifest_path = pgmoneta_append(manifest_path, "backup_manifest");
+      totals_file(&totals, manifest_path, true);
+
+      size = totals.disk;
+      biggest_file_size = totals.biggest;
+
+      pgmoneta_workflow_account(totals.bytes, totals.files);
+   }
    pgmoneta_read_wal(backup_data, &wal);
    pgmoneta_read_checkpoint_info(backup_data, &chkptpos);
-   biggest_file_size = pgmoneta_biggest_file(backup_data);
+
+   if (summarized && pgmoneta_walsummary_incremental(server, label, incremental_label, start_timeline, startpos))
+   {
+      pgmoneta_log_warn("Backup: %s/%s is a full backup since it could not be made incremental",
+                        config->servers[server].name, label);
+      incremental = NULL;
+   }
 
    if (pgmoneta_art_insert(nodes, NODE_BACKUP_BASE, (uintptr_t)backup_base, ValueString))
    {
@@ -403,32 +535,42 @@ basebackup_execute(char* name, struct art* nodes)
    }
 
    pgmoneta_create_info(backup_base, label, 1);
-   pgmoneta_update_info_string(backup_base, INFO_WAL, wal);
-   pgmoneta_update_info_unsigned_long(backup_base, INFO_RESTORE, size);
-   pgmoneta_update_info_unsigned_long(backup_base, INFO_BIGGEST_FILE, biggest_file_size);
-   pgmoneta_update_info_string(backup_base, INFO_MAJOR_VERSION, version);
-   pgmoneta_update_info_string(backup_base, INFO_MINOR_VERSION, minor_version);
-   pgmoneta_update_info_bool(backup_base, INFO_KEEP, false);
-   pgmoneta_update_info_string(backup_base, INFO_START_WALPOS, startpos);
-   pgmoneta_update_info_string(backup_base, INFO_END_WALPOS, endpos);
-   pgmoneta_update_info_unsigned_long(backup_base, INFO_START_TIMELINE, start_timeline);
-   pgmoneta_update_info_unsigned_long(backup_base, INFO_END_TIMELINE, end_timeline);
-   pgmoneta_update_info_unsigned_long(backup_base, INFO_HASH_ALGORITHM, hash);
-   pgmoneta_update_info_double(backup_base, INFO_BASEBACKUP_ELAPSED, basebackup_elapsed_time);
+
+   if (pgmoneta_info_begin(backup_base, &info))
+   {
+      goto error;
+   }
+
+   pgmoneta_info_set_string(info, INFO_WAL, wal);
+   pgmoneta_info_set_unsigned_long(info, INFO_RESTORE, size);
+   pgmoneta_info_set_unsigned_long(info, INFO_BIGGEST_FILE, biggest_file_size);
+   pgmoneta_info_set_string(info, INFO_MAJOR_VERSION, version);
+   pgmoneta_info_set_string(info, INFO_MINOR_VERSION, minor_version);
+   pgmoneta_info_set_bool(info, INFO_KEEP, false);
+   pgmoneta_info_set_string(info, INFO_START_WALPOS, startpos);
+   pgmoneta_info_set_string(info, INFO_END_WALPOS, endpos);
+   pgmoneta_info_set_unsigned_long(info, INFO_START_TIMELINE, start_timeline);
+   pgmoneta_info_set_unsigned_long(info, INFO_END_TIMELINE, end_timeline);
+   pgmoneta_info_set_unsigned_long(info, INFO_HASH_ALGORITHM, hash);
+   pgmoneta_info_set_double(info, INFO_BASEBACKUP_ELAPSED, basebackup_elapsed_time);
+   if (verify != NULL)
+   {
+      pgmoneta_info_set_unsigned_long(info, INFO_CHECKSUM_FAILURES, atomic_load(&checksums.failures));
+   }
 
    if (incremental != NULL)
    {
-      pgmoneta_update_info_unsigned_long(backup_base, INFO_TYPE, TYPE_INCREMENTAL);
-      pgmoneta_update_info_string(backup_base, INFO_PARENT, incremental_label);
+      pgmoneta_info_set_unsigned_long(info, INFO_TYPE, TYPE_INCREMENTAL);
+      pgmoneta_info_set_string(info, INFO_PARENT, incremental_label);
    }
    else
    {
-      pgmoneta_update_info_unsigned_long(backup_base, INFO_TYPE, TYPE_FULL);
+      pgmoneta_info_set_unsigned_long(info, INFO_TYPE, TYPE_FULL);
    }
    // in case of parsing error
    if (chkptpos != NULL)
    {
-      pgmoneta_update_info_string(backup_base, INFO_CHKPT_WALPOS, chkptpos);
+      pgmoneta_info_set_string(info, INFO_CHKPT_WALPOS, chkptpos);
    }
 
    current_tablespace = tablespaces;
@@ -440,19 +582,36 @@ basebackup_execute(char* name, struct art* nodes)
       snprintf(&tblname[0], MAX_PATH, "tblspc_%s", current_tablespace->name);
 
       number_of_tablespaces++;
-      pgmoneta_update_info_unsigned_long(backup_base, INFO_TABLESPACES, number_of_tablespaces);
+      pgmoneta_info_set_unsigned_long(info, INFO_TABLESPACES, number_of_tablespaces);
 
       snprintf(key, sizeof(key) - 1, "TABLESPACE%d", number_of_tablespaces);
-      pgmoneta_update_info_string(backup_base, key, tblname);
+      pgmoneta_info_set_string(info, key, tblname);
 
       snprintf(key, sizeof(key) - 1, "TABLESPACE_OID%d", number_of_tablespaces);
-      pgmoneta_update_info_unsigned_long(backup_base, key, current_tablespace->oid);
+      pgmoneta_info_set_unsigned_long(info, key, current_tablespace->oid);
 
       snprintf(key, sizeof(key) - 1, "TABLESPACE_PATH%d", number_of_tablespaces);
-      pgmoneta_update_info_string(backup_base, key, current_tablespace->path);
+      pgmoneta_info_set_string(info, key, current_tablespace->path);
 
       current_tablespace = current_tablespace->next;
    }
+
+   if (pgmoneta_info_commit(info))
+   {
+      info = NULL;
+      goto error;
+   }
+   info = NULL;
+
+   if (incremental != NULL)
+   {
+      // restore falls back to walking the chain without it
+      if (pgmoneta_blockmap_create(server, label, incremental_label))
+      {
+         pgmoneta_log_warn("Unable to create the block map of %s/%s", config->servers[server].name, label);
+      }
+   }
+
    pgmoneta_close_ssl(ssl);
    if (socket != -1)
    {
@@ -477,6 +636,8 @@ basebackup_execute(char* name, struct art* nodes)
 
 error:
 
+   pgmoneta_server_source(NULL, 0);
+
    if (backup_base == NULL)
    {
       backup_base = pgmoneta_get_server_backup_identifier(server, label);
@@ -570,3 +731,35 @@ error:
    }
    return 1;
 }
+
+static void
+totals_file(struct tar_totals* totals, char* path, bool add)
+{
+   struct stat st;
+   uint64_t disk;
+
+   if (stat(path, &st) || !S_ISREG(st.st_mode))
+   {
+      return;
+   }
+
+   disk = st.st_size;
+   if (totals->block_size > 0 && disk % totals->block_size != 0)
+   {
+      disk += totals->block_size - disk % totals->block_size;
+   }
+
+   if (add)
+   {
+      totals->bytes += st.st_size;
+      totals->disk += disk;
+      totals->files++;
+      totals->biggest = MAX(totals->biggest, disk);
+   }
+   else
+   {
+      totals->bytes -= MIN(totals->bytes, (uint64_t)st.st_size);
+      totals->disk -= MIN(totals->disk, disk);
+      totals->files -= MIN(totals->files, 1);
+   }
+}
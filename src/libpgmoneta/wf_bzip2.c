@@ -50,7 +50,7 @@ pgmoneta_create_bzip2(bool compress)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -93,6 +93,7 @@ bzip2_execute_compress(char* name, struct art* nodes)
    char* d = NULL;
    char* backup_base = NULL;
    char* backup_data = NULL;
+   char* manifest = NULL;
    char* tarfile = NULL;
    int hours;
    int minutes;
@@ -128,13 +129,23 @@ bzip2_execute_compress(char* name, struct art* nodes)
       number_of_workers = pgmoneta_get_number_of_workers(server);
       if (number_of_workers > 0)
       {
-         pgmoneta_workers_initialize(number_of_workers, &workers);
+         if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+         {
+            pgmoneta_workers_plan(workers);
+         }
       }
 
       backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
       backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
 
-      pgmoneta_bzip2_data(backup_data, workers);
+      manifest = pgmoneta_append(manifest, backup_base);
+      if (!pgmoneta_ends_with(manifest, "/"))
+      {
+         manifest = pgmoneta_append(manifest, "/");
+      }
+      manifest = pgmoneta_append(manifest, "backup.manifest");
+
+      pgmoneta_bzip2_data(backup_data, manifest, workers);
       pgmoneta_bzip2_tablespaces(backup_base, workers);
 
       if (number_of_workers > 0)
@@ -164,7 +175,23 @@ bzip2_execute_compress(char* name, struct art* nodes)
          }
       }
 
-      ret = pgmoneta_bzip2_file(tarfile, d);
+      number_of_workers = pgmoneta_get_number_of_workers(server);
+      if (number_of_workers > 0)
+      {
+         pgmoneta_workers_initialize(number_of_workers, &workers);
+      }
+
+      ret = pgmoneta_bzip2_file_split(tarfile, d, workers);
+
+      if (number_of_workers > 0)
+      {
+         pgmoneta_workers_wait(workers);
+         if (!workers->outcome)
+         {
+            ret = 1;
+         }
+         pgmoneta_workers_destroy(workers);
+      }
    }
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
@@ -182,6 +209,7 @@ bzip2_execute_compress(char* name, struct art* nodes)
    pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_BZIP2_ELAPSED, compression_bzip2_elapsed_time);
 
    free(d);
+   free(manifest);
 
    return ret;
 }
@@ -29,10 +29,12 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <dedup.h>
 #include <deque.h>
 #include <info.h>
 #include <link.h>
 #include <logging.h>
+#include <trash.h>
 #include <utils.h>
 #include <workers.h>
 #include <workflow.h>
@@ -48,13 +50,14 @@ static int delete_backup_execute(char*, struct art*);
 
 static int delete_full_backup(int server, int index, struct backup* backup, int number_of_backups, struct backup** backups);
 static int delete_incremental_backup(int server, int index, struct backup* backup, int number_of_backups, struct backup** backups);
+static void delete_directory(int server, char* directory);
 
 struct workflow*
 pgmoneta_create_delete_backup(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -88,6 +91,8 @@ delete_backup_execute(char* name, struct art* nodes)
    struct backup** backups = NULL;
    struct backup* backup = NULL;
    struct backup* child = NULL;
+   unsigned char* hashes = NULL;
+   size_t number_of_hashes = 0;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -109,13 +114,13 @@ delete_backup_execute(char* name, struct art* nodes)
 
    active = false;
 
-   if (!atomic_compare_exchange_strong(&config->servers[server].delete, &active, true))
+   if (!atomic_compare_exchange_strong(&config->states[server].delete, &active, true))
    {
       pgmoneta_log_debug("Delete is active for %s (Waiting for %s)", config->servers[server].name, label);
       goto error;
    }
 
-   if (atomic_load(&config->servers[server].backup))
+   if (atomic_load(&config->states[server].backup))
    {
       pgmoneta_log_debug("Backup is active for %s", config->servers[server].name);
       goto error;
@@ -154,11 +159,31 @@ delete_backup_execute(char* name, struct art* nodes)
 
    if (backups[backup_index]->type == TYPE_FULL)
    {
+      if (backups[backup_index]->deduplication)
+      {
+         d = pgmoneta_get_server_backup_identifier(server, label);
+
+         if (pgmoneta_dedup_references(d, &hashes, &number_of_hashes))
+         {
+            pgmoneta_log_error("Delete: No chunk references for %s/%s", config->servers[server].name, label);
+            goto error;
+         }
+
+         free(d);
+         d = NULL;
+      }
+
       if (delete_full_backup(server, backup_index, backups[backup_index], number_of_backups, backups))
       {
          pgmoneta_log_error("Delete: Full backup error for %s/%s", config->servers[server].name, label);
          goto error;
       }
+
+      // the chunks are only released once the backup is gone
+      if (pgmoneta_dedup_release(server, hashes, number_of_hashes))
+      {
+         pgmoneta_log_warn("Delete: Could not release chunks for %s/%s", config->servers[server].name, label);
+      }
    }
    else
    {
@@ -226,8 +251,9 @@ delete_backup_execute(char* name, struct art* nodes)
    free(d);
 
    free(child);
+   free(hashes);
 
-   atomic_store(&config->servers[server].delete, false);
+   atomic_store(&config->states[server].delete, false);
    pgmoneta_log_trace("Delete is ready for %s", config->servers[server].name);
 
    return 0;
@@ -243,8 +269,9 @@ error:
    free(d);
 
    free(child);
+   free(hashes);
 
-   atomic_store(&config->servers[server].delete, false);
+   atomic_store(&config->states[server].delete, false);
    pgmoneta_log_trace("Delete is ready for %s", config->servers[server].name);
 
    return 1;
@@ -321,10 +348,11 @@ delete_full_backup(int server, int index, struct backup* backup, int number_of_b
                goto error;
             }
             pgmoneta_workers_destroy(workers);
+            workers = NULL;
          }
 
-         /* Delete from */
-         pgmoneta_delete_directory(d);
+         /* Delete from, after its files are linked into the next backup */
+         delete_directory(server, d);
          free(d);
          d = NULL;
 
@@ -342,7 +370,7 @@ delete_full_backup(int server, int index, struct backup* backup, int number_of_b
       else if (prev_index != -1)
       {
          /* Latest valid backup */
-         pgmoneta_delete_directory(d);
+         delete_directory(server, d);
       }
       else if (next_index != -1)
       {
@@ -360,10 +388,11 @@ delete_full_backup(int server, int index, struct backup* backup, int number_of_b
                goto error;
             }
             pgmoneta_workers_destroy(workers);
+            workers = NULL;
          }
 
-         /* Delete from */
-         pgmoneta_delete_directory(d);
+         /* Delete from, after its files are linked into the next backup */
+         delete_directory(server, d);
          free(d);
          d = NULL;
 
@@ -381,15 +410,17 @@ delete_full_backup(int server, int index, struct backup* backup, int number_of_b
       else
       {
          /* Only valid backup */
-         pgmoneta_delete_directory(d);
+         delete_directory(server, d);
       }
    }
    else
    {
       /* Just delete */
-      pgmoneta_delete_directory(d);
+      delete_directory(server, d);
    }
 
+   pgmoneta_workers_destroy(workers);
+
    free(d);
    free(from);
    free(to);
@@ -397,10 +428,7 @@ delete_full_backup(int server, int index, struct backup* backup, int number_of_b
    return 0;
 
 error:
-   if (number_of_workers > 0)
-   {
-      pgmoneta_workers_destroy(workers);
-   }
+   pgmoneta_workers_destroy(workers);
 
    free(d);
    free(from);
@@ -449,3 +477,13 @@ error:
 
    return 1;
 }
+
+static void
+delete_directory(int server, char* directory)
+{
+   // the space is reclaimed in the background, unless the trash is on another file system
+   if (pgmoneta_trash_move(server, directory))
+   {
+      pgmoneta_delete_directory(directory);
+   }
+}
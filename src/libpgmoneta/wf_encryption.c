@@ -52,7 +52,7 @@ pgmoneta_encryption(bool encrypt)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -95,6 +95,7 @@ encryption_execute(char* name, struct art* nodes)
    char* enc_file = NULL;
    char* backup_base = NULL;
    char* backup_data = NULL;
+   char* manifest = NULL;
    char* compress_suffix = NULL;
    char* tarfile = NULL;
    int hours;
@@ -131,13 +132,27 @@ encryption_execute(char* name, struct art* nodes)
       number_of_workers = pgmoneta_get_number_of_workers(server);
       if (number_of_workers > 0)
       {
-         pgmoneta_workers_initialize(number_of_workers, &workers);
+         if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+         {
+            pgmoneta_workers_plan(workers);
+         }
       }
 
       backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
       backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
 
-      if (pgmoneta_encrypt_data(backup_data, workers))
+      // the files keep the names of the manifest unless they were compressed
+      if (config->compression_type == COMPRESSION_NONE)
+      {
+         manifest = pgmoneta_append(manifest, backup_base);
+         if (!pgmoneta_ends_with(manifest, "/"))
+         {
+            manifest = pgmoneta_append(manifest, "/");
+         }
+         manifest = pgmoneta_append(manifest, "backup.manifest");
+      }
+
+      if (pgmoneta_encrypt_data(backup_data, manifest, workers))
       {
          goto error;
       }
@@ -218,6 +233,7 @@ encryption_execute(char* name, struct art* nodes)
    pgmoneta_update_info_double(backup_base, INFO_ENCRYPTION_ELAPSED, encryption_elapsed_time);
 
    free(d);
+   free(manifest);
    free(enc_file);
 
    return 0;
@@ -230,6 +246,7 @@ error:
    }
 
    free(d);
+   free(manifest);
    free(enc_file);
 
    return 1;
@@ -49,7 +49,7 @@ pgmoneta_create_extra(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -77,7 +77,8 @@ extra_execute(char* name, struct art* nodes)
    int server = -1;
    char* label = NULL;
    int usr;
-   int socket = -1;
+   int number_of_connections = 0;
+   int* sockets = NULL;
    double seconds;
    int minutes;
    int hours;
@@ -88,7 +89,7 @@ extra_execute(char* name, struct art* nodes)
    char* info_extra = NULL;
    struct timespec start_t;
    struct timespec end_t;
-   SSL* ssl = NULL;
+   SSL** ssl = NULL;
    struct configuration* config;
    struct query_response* qr = NULL;
 
@@ -138,14 +139,31 @@ extra_execute(char* name, struct art* nodes)
       goto error;
    }
 
-   // establish a connection, with replication flag set
-   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket) != AUTH_SUCCESS)
+   // the extra files are fetched over the same number of connections as a parallel backup
+   number_of_connections = config->backup_connections > 1 ? config->backup_connections : 1;
+
+   ssl = (SSL**)calloc(number_of_connections, sizeof(SSL*));
+   sockets = (int*)malloc(number_of_connections * sizeof(int));
+   if (ssl == NULL || sockets == NULL)
    {
-      pgmoneta_log_error("Authentication failed for user %s on %s", config->users[usr].username, config->servers[server].name);
       goto error;
    }
 
-   pgmoneta_ext_is_installed(ssl, socket, &qr);
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      sockets[i] = -1;
+   }
+
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl[i], &sockets[i]) != AUTH_SUCCESS)
+      {
+         pgmoneta_log_error("Authentication failed for user %s on %s", config->users[usr].username, config->servers[server].name);
+         goto error;
+      }
+   }
+
+   pgmoneta_ext_is_installed(ssl[0], sockets[0], &qr);
    if (qr == NULL || qr->tuples == NULL || qr->tuples->data == NULL || qr->tuples->data[0] == NULL || qr->tuples->data[2] == NULL || strcmp(qr->tuples->data[0], "pgmoneta_ext") != 0)
    {
       pgmoneta_log_warn("extra failed: Server %s does not have the pgmoneta_ext extension installed.", config->servers[server].name);
@@ -156,7 +174,7 @@ extra_execute(char* name, struct art* nodes)
 
    for (int i = 0; i < config->servers[server].number_of_extra; i++)
    {
-      if (pgmoneta_receive_extra_files(ssl, socket, config->servers[server].name, config->servers[server].extra[i], root, &info_extra) != 0)
+      if (pgmoneta_receive_extra_files(ssl, sockets, number_of_connections, config->servers[server].name, config->servers[server].extra[i], root, &info_extra) != 0)
       {
          pgmoneta_log_warn("extra failed: Server %s failed to retrieve extra files %s", config->servers[server].name, config->servers[server].extra[i]);
       }
@@ -191,8 +209,13 @@ extra_execute(char* name, struct art* nodes)
    {
       free(info_extra);
    }
-   pgmoneta_close_ssl(ssl);
-   pgmoneta_disconnect(socket);
+   for (int i = 0; i < number_of_connections; i++)
+   {
+      pgmoneta_close_ssl(ssl[i]);
+      pgmoneta_disconnect(sockets[i]);
+   }
+   free(ssl);
+   free(sockets);
    pgmoneta_memory_destroy();
 
    return 0;
@@ -210,14 +233,22 @@ error:
    {
       free(info_extra);
    }
-   if (ssl != NULL)
+   if (ssl != NULL && sockets != NULL)
    {
-      pgmoneta_close_ssl(ssl);
-   }
-   if (socket != -1)
-   {
-      pgmoneta_disconnect(socket);
+      for (int i = 0; i < number_of_connections; i++)
+      {
+         if (ssl[i] != NULL)
+         {
+            pgmoneta_close_ssl(ssl[i]);
+         }
+         if (sockets[i] != -1)
+         {
+            pgmoneta_disconnect(sockets[i]);
+         }
+      }
    }
+   free(ssl);
+   free(sockets);
    pgmoneta_memory_destroy();
 
    return 1;
@@ -50,7 +50,7 @@ pgmoneta_create_gzip(bool compress)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -92,6 +92,7 @@ gzip_execute_compress(char* name, struct art* nodes)
    char* d = NULL;
    char* backup_base = NULL;
    char* backup_data = NULL;
+   char* manifest = NULL;
    char* tarfile = NULL;
    int hours;
    int minutes;
@@ -127,13 +128,23 @@ gzip_execute_compress(char* name, struct art* nodes)
       number_of_workers = pgmoneta_get_number_of_workers(server);
       if (number_of_workers > 0)
       {
-         pgmoneta_workers_initialize(number_of_workers, &workers);
+         if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+         {
+            pgmoneta_workers_plan(workers);
+         }
       }
 
       backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
       backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
 
-      if (pgmoneta_gzip_data(backup_data, workers))
+      manifest = pgmoneta_append(manifest, backup_base);
+      if (!pgmoneta_ends_with(manifest, "/"))
+      {
+         manifest = pgmoneta_append(manifest, "/");
+      }
+      manifest = pgmoneta_append(manifest, "backup.manifest");
+
+      if (pgmoneta_gzip_data(backup_data, manifest, workers))
       {
          goto error;
       }
@@ -182,6 +193,7 @@ gzip_execute_compress(char* name, struct art* nodes)
    pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_GZIP_ELAPSED, compression_gzip_elapsed_time);
 
    free(d);
+   free(manifest);
 
    return 0;
 
@@ -193,6 +205,7 @@ error:
    }
 
    free(d);
+   free(manifest);
 
    return 1;
 }
@@ -30,6 +30,7 @@
 #include <pgmoneta.h>
 #include <art.h>
 #include <hot_standby.h>
+#include <info.h>
 #include <logging.h>
 #include <manifest.h>
 #include <utils.h>
@@ -38,18 +39,25 @@
 
 /* system */
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static char* hot_standby_name(void);
 static int hot_standby_execute(char*, struct art*);
+static int hot_standby_refresh(char* data, char* destination, char* key, size_t block_size, struct workers* workers);
+static int hot_standby_incremental(char* from, char* to, size_t block_size);
+static void do_hot_standby_incremental(struct worker_input* wi);
+static char* hot_standby_path(char* base, char* key, bool incremental);
 
 struct workflow*
 pgmoneta_create_hot_standby(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -90,9 +98,12 @@ hot_standby_execute(char* name, struct art* nodes)
    double seconds;
    char elapsed[128];
    int number_of_workers = 0;
+   bool incremental = false;
+   bool refresh = false;
    char* f = NULL;
-   char* from = NULL;
-   char* to = NULL;
+   char* data = NULL;
+   char* full = NULL;
+   char* partial = NULL;
    struct art* deleted_files = NULL;
    struct art_iterator* deleted_iter = NULL;
    struct art* changed_files = NULL;
@@ -144,6 +155,17 @@ hot_standby_execute(char* name, struct art* nodes)
       destination = pgmoneta_append(destination, root);
       destination = pgmoneta_append(destination, config->servers[server].name);
 
+      incremental = number_of_backups > 0 && backups[number_of_backups - 1]->type == TYPE_INCREMENTAL;
+
+      // an incremental backup only applies on top of the backup the hot standby holds
+      if (incremental && pgmoneta_exists(destination) &&
+          (number_of_backups < 2 || strcmp(backups[number_of_backups - 1]->parent_label, backups[number_of_backups - 2]->label)))
+      {
+         pgmoneta_log_info("Hot standby: %s/%s is not based on the hot standby, it is refreshed by the next full backup",
+                           config->servers[server].name, label);
+         pgmoneta_delete_directory(destination);
+      }
+
       if (pgmoneta_exists(destination) && number_of_backups >= 2)
       {
          source = pgmoneta_append(source, base);
@@ -181,84 +203,65 @@ hot_standby_execute(char* name, struct art* nodes)
          pgmoneta_art_iterator_create(changed_files, &changed_iter);
          pgmoneta_art_iterator_create(added_files, &added_iter);
 
+         data = pgmoneta_append(data, source);
+         data = pgmoneta_append(data, "data/");
+
+         refresh = true;
+
          while (pgmoneta_art_iterator_next(deleted_iter))
          {
-            f = pgmoneta_append(f, destination);
-            if (!pgmoneta_ends_with(f, "/"))
-            {
-               f = pgmoneta_append_char(f, '/');
-            }
-            f = pgmoneta_append(f, deleted_iter->key);
+            // a file that turned into an incremental file, or back, is still there
+            full = hot_standby_path(data, deleted_iter->key, false);
+            partial = hot_standby_path(data, deleted_iter->key, true);
 
-            if (pgmoneta_exists(f))
-            {
-               pgmoneta_delete_file(f, workers);
-            }
-            else
+            if (!pgmoneta_exists(full) && !pgmoneta_exists(partial))
             {
-               pgmoneta_log_debug("%s doesn't exists", f);
+               f = hot_standby_path(destination, deleted_iter->key, false);
+
+               if (pgmoneta_exists(f))
+               {
+                  pgmoneta_delete_file(f, workers);
+               }
+               else
+               {
+                  pgmoneta_log_debug("%s doesn't exists", f);
+               }
+
+               free(f);
+               f = NULL;
             }
 
-            free(f);
-            f = NULL;
+            free(full);
+            full = NULL;
+
+            free(partial);
+            partial = NULL;
          }
 
          while (pgmoneta_art_iterator_next(changed_iter))
          {
-            from = pgmoneta_append(from, source);
-            if (!pgmoneta_ends_with(from, "/"))
-            {
-               from = pgmoneta_append_char(from, '/');
-            }
-            from = pgmoneta_append(from, "data/");
-            from = pgmoneta_append(from, changed_iter->key);
+            pgmoneta_log_trace("hot_standby changed: %s", changed_iter->key);
 
-            to = pgmoneta_append(to, destination);
-            if (!pgmoneta_ends_with(to, "/"))
+            if (hot_standby_refresh(data, destination, changed_iter->key, config->servers[server].block_size, workers))
             {
-               to = pgmoneta_append_char(to, '/');
+               goto error;
             }
-            to = pgmoneta_append(to, changed_iter->key);
-
-            pgmoneta_log_trace("hot_standby changed: %s -> %s", from, to);
-
-            pgmoneta_copy_file(from, to, workers);
-
-            free(from);
-            from = NULL;
-
-            free(to);
-            to = NULL;
          }
 
          while (pgmoneta_art_iterator_next(added_iter))
          {
-            from = pgmoneta_append(from, source);
-            if (!pgmoneta_ends_with(from, "/"))
-            {
-               from = pgmoneta_append_char(from, '/');
-            }
-            from = pgmoneta_append(from, "data/");
-            from = pgmoneta_append(from, added_iter->key);
+            pgmoneta_log_trace("hot_standby new: %s", added_iter->key);
 
-            to = pgmoneta_append(to, destination);
-            if (!pgmoneta_ends_with(to, "/"))
+            if (hot_standby_refresh(data, destination, added_iter->key, config->servers[server].block_size, workers))
             {
-               to = pgmoneta_append_char(to, '/');
+               goto error;
             }
-            to = pgmoneta_append(to, added_iter->key);
-
-            pgmoneta_log_trace("hot_standby new: %s -> %s", from, to);
-
-            pgmoneta_copy_file(from, to, workers);
-
-            free(from);
-            from = NULL;
-
-            free(to);
-            to = NULL;
          }
       }
+      else if (incremental)
+      {
+         pgmoneta_log_debug("Hot standby: %s/%s is created by the next full backup", config->servers[server].name, label);
+      }
       else
       {
          if (pgmoneta_exists(destination))
@@ -289,7 +292,8 @@ hot_standby_execute(char* name, struct art* nodes)
          }
       }
 
-      if (strlen(config->servers[server].hot_standby_overrides) > 0 &&
+      if (pgmoneta_exists(destination) &&
+          strlen(config->servers[server].hot_standby_overrides) > 0 &&
           pgmoneta_exists(config->servers[server].hot_standby_overrides) &&
           pgmoneta_is_directory(config->servers[server].hot_standby_overrides))
       {
@@ -310,6 +314,12 @@ hot_standby_execute(char* name, struct art* nodes)
             goto error;
          }
          pgmoneta_workers_destroy(workers);
+         workers = NULL;
+      }
+
+      if (pgmoneta_exists(destination) && pgmoneta_sync_filesystem(destination))
+      {
+         goto error;
       }
 
       clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
@@ -345,12 +355,26 @@ hot_standby_execute(char* name, struct art* nodes)
    free(root);
    free(base);
    free(source);
+   free(data);
    free(destination);
 
    return 0;
 
 error:
 
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   // a partly refreshed hot standby is not consistent, the next full backup creates it again
+   if (refresh)
+   {
+      pgmoneta_log_error("Hot standby: %s/%s failed to refresh", config->servers[server].name, label);
+      pgmoneta_delete_directory(destination);
+   }
+
    free(old_manifest);
    free(new_manifest);
 
@@ -371,7 +395,214 @@ error:
    free(root);
    free(base);
    free(source);
+   free(data);
+   free(full);
+   free(partial);
    free(destination);
 
    return 1;
 }
+
+static int
+hot_standby_refresh(char* data, char* destination, char* key, size_t block_size, struct workers* workers)
+{
+   char* name = NULL;
+   char* from = NULL;
+   char* to = NULL;
+   struct worker_input* wi = NULL;
+
+   name = strrchr(key, '/');
+   name = name != NULL ? name + 1 : key;
+
+   from = pgmoneta_append(from, data);
+   from = pgmoneta_append(from, key);
+
+   to = hot_standby_path(destination, key, false);
+
+   if (pgmoneta_starts_with(name, INCREMENTAL_PREFIX))
+   {
+      pgmoneta_log_trace("hot_standby incremental: %s -> %s", from, to);
+
+      if (workers != NULL)
+      {
+         if (pgmoneta_create_worker_input(NULL, from, to, (int)block_size, workers, &wi))
+         {
+            goto error;
+         }
+
+         if (workers->outcome)
+         {
+            pgmoneta_workers_add(workers, do_hot_standby_incremental, wi);
+         }
+         else
+         {
+            free(wi);
+         }
+      }
+      else if (hot_standby_incremental(from, to, block_size))
+      {
+         goto error;
+      }
+   }
+   else
+   {
+      pgmoneta_log_trace("hot_standby copy: %s -> %s", from, to);
+
+      pgmoneta_copy_file(from, to, workers);
+   }
+
+   free(from);
+   free(to);
+
+   return 0;
+
+error:
+
+   free(from);
+   free(to);
+
+   return 1;
+}
+
+static int
+hot_standby_incremental(char* from, char* to, size_t block_size)
+{
+   int in = -1;
+   int out = -1;
+   uint32_t header[3];
+   uint32_t* blocks = NULL;
+   uint32_t length = 0;
+   off_t offset = 0;
+   uint8_t* buffer = NULL;
+
+   in = open(from, O_RDONLY);
+   if (in == -1)
+   {
+      pgmoneta_log_error("Hot standby: unable to open %s (%s)", from, strerror(errno));
+      goto error;
+   }
+
+   // magic, number of blocks and truncation block length
+   if (pread(in, &header[0], sizeof(header), 0) != sizeof(header) || header[0] != INCREMENTAL_MAGIC)
+   {
+      pgmoneta_log_error("Hot standby: %s is not an incremental file", from);
+      goto error;
+   }
+
+   if (header[1] > 0)
+   {
+      blocks = (uint32_t*)malloc(sizeof(uint32_t) * header[1]);
+      buffer = (uint8_t*)malloc(block_size);
+
+      if (blocks == NULL || buffer == NULL)
+      {
+         goto error;
+      }
+
+      if (pread(in, blocks, sizeof(uint32_t) * header[1], sizeof(header)) != (ssize_t)(sizeof(uint32_t) * header[1]))
+      {
+         pgmoneta_log_error("Hot standby: incomplete header in %s", from);
+         goto error;
+      }
+
+      // the blocks start at the header rounded up to the block size
+      offset = sizeof(uint32_t) * (3 + header[1]);
+      if (offset % block_size != 0)
+      {
+         offset += block_size - (offset % block_size);
+      }
+   }
+
+   // the blocks that didn't change are taken from the file the hot standby has
+   out = open(to, O_WRONLY);
+   if (out == -1)
+   {
+      pgmoneta_log_error("Hot standby: unable to open %s (%s)", to, strerror(errno));
+      goto error;
+   }
+
+   length = header[2];
+
+   for (uint32_t i = 0; i < header[1]; i++)
+   {
+      if (pread(in, buffer, block_size, offset + (off_t)i * block_size) != (ssize_t)block_size)
+      {
+         pgmoneta_log_error("Hot standby: incomplete block %u in %s", blocks[i], from);
+         goto error;
+      }
+
+      if (pwrite(out, buffer, block_size, (off_t)blocks[i] * block_size) != (ssize_t)block_size)
+      {
+         pgmoneta_log_error("Hot standby: unable to write block %u to %s (%s)", blocks[i], to, strerror(errno));
+         goto error;
+      }
+
+      if (blocks[i] + 1 > length)
+      {
+         length = blocks[i] + 1;
+      }
+   }
+
+   if (ftruncate(out, (off_t)length * block_size))
+   {
+      pgmoneta_log_error("Hot standby: unable to truncate %s (%s)", to, strerror(errno));
+      goto error;
+   }
+
+   close(in);
+   close(out);
+
+   free(blocks);
+   free(buffer);
+
+   return 0;
+
+error:
+
+   errno = 0;
+
+   if (in != -1)
+   {
+      close(in);
+   }
+
+   if (out != -1)
+   {
+      close(out);
+   }
+
+   free(blocks);
+   free(buffer);
+
+   return 1;
+}
+
+static void
+do_hot_standby_incremental(struct worker_input* wi)
+{
+   if (hot_standby_incremental(wi->from, wi->to, (size_t)wi->level))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static char*
+hot_standby_path(char* base, char* key, bool incremental)
+{
+   char* name = NULL;
+   char path[MAX_PATH];
+
+   name = strrchr(key, '/');
+   name = name != NULL ? name + 1 : key;
+
+   memset(&path[0], 0, sizeof(path));
+   snprintf(&path[0], sizeof(path), "%s%s%.*s%s%s",
+            base, pgmoneta_ends_with(base, "/") ? "" : "/",
+            (int)(name - key), key,
+            incremental ? INCREMENTAL_PREFIX : "",
+            pgmoneta_starts_with(name, INCREMENTAL_PREFIX) ? name + INCREMENTAL_PREFIX_LENGTH : name);
+
+   return pgmoneta_append(NULL, &path[0]);
+}
@@ -51,7 +51,7 @@ pgmoneta_create_link(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -89,6 +89,7 @@ link_execute(char* name, struct art* nodes)
    char* from_tablespaces = NULL;
    char* to_tablespaces = NULL;
    char* backup_base = NULL;
+   int current = 0;
    int next_newest = -1;
    int number_of_backups = 0;
    struct backup** backups = NULL;
@@ -126,11 +127,22 @@ link_execute(char* name, struct art* nodes)
 
    pgmoneta_get_backups(server_path, &number_of_backups, &backups);
 
+   /* Link against the newest valid backup older than this one, which might not be the newest */
+   current = number_of_backups - 1;
+   for (int j = 0; j < number_of_backups; j++)
+   {
+      if (!strcmp(backups[j]->label, label))
+      {
+         current = j;
+         break;
+      }
+   }
+
    if (number_of_backups >= 2)
    {
-      for (int j = number_of_backups - 2; j >= 0 && next_newest == -1; j--)
+      for (int j = current - 1; j >= 0 && next_newest == -1; j--)
       {
-         if (backups[j]->valid == VALID_TRUE && backups[j]->major_version == backups[number_of_backups - 1]->major_version)
+         if (backups[j]->valid == VALID_TRUE && backups[j]->major_version == backups[current]->major_version)
          {
             if (next_newest == -1)
             {
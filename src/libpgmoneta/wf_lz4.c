@@ -29,6 +29,7 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <compression.h>
 #include <logging.h>
 #include <utils.h>
 #include <lz4_compression.h>
@@ -48,7 +49,7 @@ pgmoneta_create_lz4(bool compress)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -90,6 +91,7 @@ lz4_execute_compress(char* name, struct art* nodes)
    char* d = NULL;
    char* backup_base = NULL;
    char* backup_data = NULL;
+   char* manifest = NULL;
    char* tarfile = NULL;
    int hours;
    int minutes;
@@ -125,13 +127,28 @@ lz4_execute_compress(char* name, struct art* nodes)
       number_of_workers = pgmoneta_get_number_of_workers(server);
       if (number_of_workers > 0)
       {
-         pgmoneta_workers_initialize(number_of_workers, &workers);
+         if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+         {
+            pgmoneta_workers_plan(workers);
+         }
       }
 
       backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
       backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
 
-      pgmoneta_lz4c_data(backup_data, workers);
+      manifest = pgmoneta_append(manifest, backup_base);
+      if (!pgmoneta_ends_with(manifest, "/"))
+      {
+         manifest = pgmoneta_append(manifest, "/");
+      }
+      manifest = pgmoneta_append(manifest, "backup.manifest");
+
+      if (config->compression_adaptive)
+      {
+         pgmoneta_compression_adaptive_start(server, LZ4_ADAPTIVE_MINIMUM, LZ4_ADAPTIVE_MAXIMUM, LZ4_ADAPTIVE_MAXIMUM);
+      }
+
+      pgmoneta_lz4c_data(backup_data, manifest, workers);
       pgmoneta_lz4c_tablespaces(backup_base, workers);
 
       if (number_of_workers > 0)
@@ -143,6 +160,8 @@ lz4_execute_compress(char* name, struct art* nodes)
          }
          pgmoneta_workers_destroy(workers);
       }
+
+      pgmoneta_compression_adaptive_stop();
    }
    else
    {
@@ -179,17 +198,21 @@ lz4_execute_compress(char* name, struct art* nodes)
    pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_LZ4_ELAPSED, compression_lz4_elapsed_time);
 
    free(d);
+   free(manifest);
 
    return 0;
 
 error:
 
+   pgmoneta_compression_adaptive_stop();
+
    if (number_of_workers > 0)
    {
       pgmoneta_workers_destroy(workers);
    }
 
    free(d);
+   free(manifest);
 
    return 1;
 }
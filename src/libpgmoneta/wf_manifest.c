@@ -47,7 +47,7 @@ pgmoneta_create_manifest(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -63,6 +63,19 @@ pgmoneta_create_manifest(void)
    return wf;
 }
 
+/** @struct manifest_entry
+ * Defines an entry of the converted manifest
+ */
+struct manifest_entry
+{
+   char* path;     /**< The path of the file */
+   char* checksum; /**< The checksum of the file */
+   int64_t size;   /**< The size of the file */
+};
+
+static int
+manifest_entry_compare(const void* a, const void* b);
+
 static char*
 manifest_name(void)
 {
@@ -87,7 +100,12 @@ manifest_execute(char* name, struct art* nodes)
    struct json* entry = NULL;
    struct csv_writer* writer = NULL;
    char file_path[MAX_PATH];
+   char file_size[MISC_LENGTH];
    char* info[MANIFEST_COLUMN_COUNT];
+   struct manifest_entry* entries = NULL;
+   struct manifest_entry* tmp = NULL;
+   size_t number_of_entries = 0;
+   size_t capacity = 0;
    struct configuration* config;
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
@@ -149,18 +167,60 @@ manifest_execute(char* name, struct art* nodes)
 
    // convert original manifest file
    while (pgmoneta_json_next_array_item(reader, &entry))
+   {
+      if (number_of_entries == capacity)
+      {
+         capacity = capacity == 0 ? 1024 : capacity * 2;
+         tmp = (struct manifest_entry*)realloc(entries, capacity * sizeof(struct manifest_entry));
+         if (tmp == NULL)
+         {
+            goto error;
+         }
+         entries = tmp;
+      }
+
+      entries[number_of_entries].path = pgmoneta_append(NULL, (char*)pgmoneta_json_get(entry, "Path"));
+      entries[number_of_entries].checksum = pgmoneta_append(NULL, (char*)pgmoneta_json_get(entry, "Checksum"));
+      entries[number_of_entries].size = (int64_t)pgmoneta_json_get(entry, "Size");
+      number_of_entries++;
+
+      pgmoneta_json_destroy(entry);
+      entry = NULL;
+   }
+
+   // sorted by path so manifests can be compared in a single pass
+   if (number_of_entries > 0)
+   {
+      qsort(entries, number_of_entries, sizeof(struct manifest_entry), manifest_entry_compare);
+   }
+
+   for (size_t i = 0; i < number_of_entries; i++)
    {
       memset(file_path, 0, MAX_PATH);
-      snprintf(file_path, MAX_PATH, "%s", (char*)pgmoneta_json_get(entry, "Path"));
+      snprintf(file_path, MAX_PATH, "%s", entries[i].path != NULL ? entries[i].path : "");
       info[MANIFEST_PATH_INDEX] = file_path;
-      info[MANIFEST_CHECKSUM_INDEX] = (char*)pgmoneta_json_get(entry, "Checksum");
+      info[MANIFEST_CHECKSUM_INDEX] = entries[i].checksum != NULL ? entries[i].checksum : "";
+      memset(file_size, 0, sizeof(file_size));
+      snprintf(file_size, sizeof(file_size), "%" PRId64, entries[i].size);
+      info[MANIFEST_SIZE_INDEX] = file_size;
       pgmoneta_csv_write(writer, MANIFEST_COLUMN_COUNT, info);
-      pgmoneta_json_destroy(entry);
-      entry = NULL;
    }
 
+   for (size_t i = 0; i < number_of_entries; i++)
+   {
+      free(entries[i].path);
+      free(entries[i].checksum);
+   }
+   free(entries);
+
    pgmoneta_json_reader_close(reader);
    pgmoneta_csv_writer_destroy(writer);
+   // the readers map the binary copy instead of parsing the manifest again
+   if (pgmoneta_manifest_map_create(manifest))
+   {
+      pgmoneta_log_warn("Could not create the binary copy of %s", manifest);
+   }
+
    pgmoneta_json_destroy(entry);
    free(backup);
    free(manifest);
@@ -173,6 +233,13 @@ manifest_execute(char* name, struct art* nodes)
    return 0;
 
 error:
+   for (size_t i = 0; i < number_of_entries; i++)
+   {
+      free(entries[i].path);
+      free(entries[i].checksum);
+   }
+   free(entries);
+
    pgmoneta_json_reader_close(reader);
    pgmoneta_csv_writer_destroy(writer);
    pgmoneta_json_destroy(entry);
@@ -182,3 +249,12 @@ error:
 
    return 1;
 }
+
+static int
+manifest_entry_compare(const void* a, const void* b)
+{
+   struct manifest_entry* e1 = (struct manifest_entry*)a;
+   struct manifest_entry* e2 = (struct manifest_entry*)b;
+
+   return strcmp(e1->path != NULL ? e1->path : "", e2->path != NULL ? e2->path : "");
+}
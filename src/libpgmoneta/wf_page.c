@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <info.h>
+#include <logging.h>
+#include <page.h>
+#include <utils.h>
+#include <workers.h>
+#include <workflow.h>
+
+/* system */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* page_name(void);
+static int page_pack_execute(char*, struct art*);
+static int page_unpack_execute(char*, struct art*);
+
+struct workflow*
+pgmoneta_create_page(bool pack)
+{
+   struct workflow* wf = NULL;
+
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
+
+   if (wf == NULL)
+   {
+      return NULL;
+   }
+
+   wf->name = &page_name;
+   wf->setup = &pgmoneta_common_setup;
+
+   if (pack)
+   {
+      wf->execute = &page_pack_execute;
+   }
+   else
+   {
+      wf->execute = &page_unpack_execute;
+   }
+
+   wf->teardown = &pgmoneta_common_teardown;
+   wf->next = NULL;
+
+   return wf;
+}
+
+static char*
+page_name(void)
+{
+   return "Page filter";
+}
+
+static int
+page_pack_execute(char* name, struct art* nodes)
+{
+   int server = -1;
+   char* label = NULL;
+   char* backup_base = NULL;
+   char* backup_data = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double page_elapsed_time;
+   int hours;
+   int minutes;
+   double seconds;
+   char elapsed[128];
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+#ifdef DEBUG
+   char* a = NULL;
+   a = pgmoneta_art_to_string(nodes, FORMAT_TEXT, NULL, 0);
+   pgmoneta_log_debug("(Tree)\n%s", a);
+   assert(nodes != NULL);
+   assert(pgmoneta_art_contains_key(nodes, NODE_SERVER));
+   assert(pgmoneta_art_contains_key(nodes, NODE_LABEL));
+   assert(pgmoneta_art_contains_key(nodes, NODE_BACKUP_BASE));
+   assert(pgmoneta_art_contains_key(nodes, NODE_BACKUP_DATA));
+   free(a);
+#endif
+
+   server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
+   label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
+   backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
+   backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
+
+   pgmoneta_log_debug("Page filter (pack): %s/%s", config->servers[server].name, label);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+      {
+         pgmoneta_workers_plan(workers);
+      }
+   }
+
+   if (pgmoneta_page_pack(server, backup_data, workers))
+   {
+      pgmoneta_log_error("Page filter: Could not pack %s/%s", config->servers[server].name, label);
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
+   pgmoneta_update_info_bool(backup_base, INFO_PAGE_FILTER, true);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+   page_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
+
+   hours = page_elapsed_time / 3600;
+   minutes = ((int)page_elapsed_time % 3600) / 60;
+   seconds = (int)page_elapsed_time % 60 + (page_elapsed_time - ((long)page_elapsed_time));
+
+   memset(&elapsed[0], 0, sizeof(elapsed));
+   sprintf(&elapsed[0], "%02i:%02i:%.4f", hours, minutes, seconds);
+
+   pgmoneta_log_debug("Page filter: %s/%s (Elapsed: %s)", config->servers[server].name, label, &elapsed[0]);
+
+   return 0;
+
+error:
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   return 1;
+}
+
+static int
+page_unpack_execute(char* name, struct art* nodes)
+{
+   int server = -1;
+   char* label = NULL;
+   char* base = NULL;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+#ifdef DEBUG
+   char* a = NULL;
+   a = pgmoneta_art_to_string(nodes, FORMAT_TEXT, NULL, 0);
+   pgmoneta_log_debug("(Tree)\n%s", a);
+   assert(nodes != NULL);
+   assert(pgmoneta_art_contains_key(nodes, NODE_SERVER));
+   assert(pgmoneta_art_contains_key(nodes, NODE_LABEL));
+   free(a);
+#endif
+
+   server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
+   label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
+
+   pgmoneta_log_debug("Page filter (unpack): %s/%s", config->servers[server].name, label);
+
+   base = (char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE);
+   if (base == NULL)
+   {
+      base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (pgmoneta_page_unpack(base, workers))
+   {
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Page filter: Could not rebuild %s/%s", config->servers[server].name, label);
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   return 1;
+}
@@ -37,10 +37,11 @@
 /* system */
 #include <assert.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 static char* permissions_name(void);
 static int permissions_execute_backup(char*, struct art*);
-static int permissions_execute_restore(char*, struct art*);
+static int permissions_process_backup(char*, struct art*, char*);
 static int permissions_execute_archive(char*, struct art*);
 
 struct workflow*
@@ -48,7 +49,7 @@ pgmoneta_create_permissions(int type)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -61,9 +62,7 @@ pgmoneta_create_permissions(int type)
    {
       case PERMISSION_TYPE_BACKUP:
          wf->execute = &permissions_execute_backup;
-         break;
-      case PERMISSION_TYPE_RESTORE:
-         wf->execute = &permissions_execute_restore;
+         wf->process = &permissions_process_backup;
          break;
       case PERMISSION_TYPE_ARCHIVE:
          wf->execute = &permissions_execute_archive;
@@ -118,45 +117,21 @@ permissions_execute_backup(char* name, struct art* nodes)
 }
 
 static int
-permissions_execute_restore(char* name, struct art* nodes)
+permissions_process_backup(char* name, struct art* nodes, char* path)
 {
-   int server = -1;
-   char* label = NULL;
-   char* path = NULL;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
-
-#ifdef DEBUG
-   char* a = NULL;
-   a = pgmoneta_art_to_string(nodes, FORMAT_TEXT, NULL, 0);
-   pgmoneta_log_debug("(Tree)\n%s", a);
-   assert(nodes != NULL);
-   assert(pgmoneta_art_contains_key(nodes, NODE_SERVER));
-   assert(pgmoneta_art_contains_key(nodes, NODE_LABEL));
-   free(a);
-#endif
+   struct stat statbuf;
 
-   server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
-   label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
-   path = pgmoneta_append(path, (char*)pgmoneta_art_search(nodes, NODE_TARGET_ROOT));
-
-   if (!pgmoneta_ends_with(path, "/"))
+   if (stat(path, &statbuf))
    {
-      path = pgmoneta_append(path, "/");
+      return 1;
    }
-   path = pgmoneta_append(path, config->servers[server].name);
-   path = pgmoneta_append(path, "-");
-   path = pgmoneta_append(path, label);
-   path = pgmoneta_append(path, "/");
-
-   pgmoneta_log_debug("Permissions (restore): %s/%s at %s", config->servers[server].name, label, path);
-
-   pgmoneta_permission_recursive(path);
 
-   free(path);
+   if (S_ISDIR(statbuf.st_mode))
+   {
+      return pgmoneta_permission(path, 7, 0, 0);
+   }
 
-   return 0;
+   return pgmoneta_permission(path, 6, 0, 0);
 }
 
 static int
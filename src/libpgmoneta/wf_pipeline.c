@@ -0,0 +1,619 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <deque.h>
+#include <info.h>
+#include <logging.h>
+#include <security.h>
+#include <streamer.h>
+#include <utils.h>
+#include <workers.h>
+#include <workflow.h>
+
+/* system */
+#include <assert.h>
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* pipeline_name(void);
+static int pipeline_execute(char*, struct art*);
+
+static int pipeline_data(char* directory, char* relative_path, struct deque* hashes, struct workers* workers);
+static int pipeline_tablespaces(char* root, struct workers* workers);
+static int pipeline_file(char* from, char* to, char* key, struct deque* hashes);
+static void do_pipeline_file(struct worker_input* wi);
+static int pipeline_process(char* path);
+
+static struct art* pipeline_nodes = NULL;
+static struct workflow** pipeline_stages = NULL;
+static int pipeline_number_of_stages = 0;
+static int pipeline_server = -1;
+
+struct workflow*
+pgmoneta_create_pipeline(void)
+{
+   struct workflow* wf = NULL;
+
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
+
+   if (wf == NULL)
+   {
+      return NULL;
+   }
+
+   wf->name = &pipeline_name;
+   wf->setup = &pgmoneta_common_setup;
+   wf->execute = &pipeline_execute;
+   wf->teardown = &pgmoneta_common_teardown;
+   wf->next = NULL;
+
+   return wf;
+}
+
+static char*
+pipeline_name(void)
+{
+   return "Pipeline";
+}
+
+static int
+pipeline_execute(char* name, struct art* nodes)
+{
+   int server = -1;
+   char* label = NULL;
+   char* tag = NULL;
+   char* sha256 = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
+   double pipeline_elapsed_time;
+   char* backup_base = NULL;
+   char* backup_data = NULL;
+   int hours;
+   int minutes;
+   double seconds;
+   char elapsed[128];
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct deque* hashes = NULL;
+   struct art* files = NULL;
+   struct workflow* workflow = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+#ifdef DEBUG
+   char* a = NULL;
+   a = pgmoneta_art_to_string(nodes, FORMAT_TEXT, NULL, 0);
+   pgmoneta_log_debug("(Tree)\n%s", a);
+   assert(nodes != NULL);
+   assert(pgmoneta_art_contains_key(nodes, NODE_SERVER));
+   assert(pgmoneta_art_contains_key(nodes, NODE_LABEL));
+   free(a);
+#endif
+
+   server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
+   label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
+
+   pgmoneta_log_debug("Pipeline (execute): %s/%s", config->servers[server].name, label);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   // the SHA-256 of the artifacts is only needed for the SSH storage engine
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   {
+      if (pgmoneta_deque_create(true, &hashes))
+      {
+         goto error;
+      }
+   }
+
+   // the later nodes that take one file at a time get the files from here
+   pipeline_nodes = nodes;
+   pipeline_server = server;
+   workflow = (struct workflow*)pgmoneta_art_search(nodes, NODE_WORKFLOW);
+   for (struct workflow* current = workflow; current != NULL; current = current->next)
+   {
+      if (current->streamed)
+      {
+         pipeline_number_of_stages++;
+      }
+   }
+
+   if (pipeline_number_of_stages > 0)
+   {
+      pipeline_stages = (struct workflow**)malloc(pipeline_number_of_stages * sizeof(struct workflow*));
+      if (pipeline_stages == NULL)
+      {
+         goto error;
+      }
+
+      pipeline_number_of_stages = 0;
+      for (struct workflow* current = workflow; current != NULL; current = current->next)
+      {
+         if (current->streamed)
+         {
+            pipeline_stages[pipeline_number_of_stages++] = current;
+         }
+      }
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+      {
+         pgmoneta_workers_plan(workers);
+      }
+   }
+
+   backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
+   backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
+
+   if (pipeline_data(backup_data, "", hashes, workers))
+   {
+      goto error;
+   }
+   if (pipeline_tablespaces(backup_base, workers))
+   {
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
+   free(pipeline_stages);
+   pipeline_stages = NULL;
+   pipeline_number_of_stages = 0;
+   pipeline_nodes = NULL;
+
+   if (hashes != NULL)
+   {
+      if (pgmoneta_art_create(&files))
+      {
+         goto error;
+      }
+
+      while ((sha256 = (char*)pgmoneta_deque_poll(hashes, &tag)) != NULL)
+      {
+         pgmoneta_art_insert(files, tag, (uintptr_t)sha256, ValueString);
+         free(tag);
+         free(sha256);
+         tag = NULL;
+      }
+
+      // handed over to the SHA-256 step
+      if (pgmoneta_art_insert(nodes, NODE_SHA256, (uintptr_t)files, ValueART))
+      {
+         goto error;
+      }
+      files = NULL;
+
+      pgmoneta_deque_destroy(hashes);
+      hashes = NULL;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+   pipeline_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
+
+   hours = pipeline_elapsed_time / 3600;
+   minutes = ((int)pipeline_elapsed_time % 3600) / 60;
+   seconds = (int)pipeline_elapsed_time % 60 + (pipeline_elapsed_time - ((long)pipeline_elapsed_time));
+
+   memset(&elapsed[0], 0, sizeof(elapsed));
+   sprintf(&elapsed[0], "%02i:%02i:%.4f", hours, minutes, seconds);
+
+   pgmoneta_log_debug("Pipeline: %s/%s (Elapsed: %s)", config->servers[server].name, label, &elapsed[0]);
+
+   switch (config->compression_type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_GZIP_ELAPSED, pipeline_elapsed_time);
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_ZSTD_ELAPSED, pipeline_elapsed_time);
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_LZ4_ELAPSED, pipeline_elapsed_time);
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_BZIP2_ELAPSED, pipeline_elapsed_time);
+         break;
+      default:
+         break;
+   }
+
+   if (config->encryption != ENCRYPTION_NONE)
+   {
+      pgmoneta_update_info_double(backup_base, INFO_ENCRYPTION_ELAPSED, pipeline_elapsed_time);
+   }
+
+   return 0;
+
+error:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   free(pipeline_stages);
+   pipeline_stages = NULL;
+   pipeline_number_of_stages = 0;
+   pipeline_nodes = NULL;
+
+   pgmoneta_art_destroy(files);
+   pgmoneta_deque_destroy(hashes);
+
+   return 1;
+}
+
+static int
+pipeline_data(char* directory, char* relative_path, struct deque* hashes, struct workers* workers)
+{
+   char* from = NULL;
+   char* to = NULL;
+   char* key = NULL;
+   char* suffix = NULL;
+   DIR* dir;
+   struct dirent* entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!(dir = opendir(directory)))
+   {
+      return 1;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         char path[1024];
+         char relative_dir[1024];
+
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         {
+            continue;
+         }
+
+         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+         snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
+
+         if (pipeline_process(path))
+         {
+            goto error;
+         }
+
+         if (pipeline_data(path, relative_dir, hashes, workers))
+         {
+            goto error;
+         }
+      }
+      else if (entry->d_type == DT_REG)
+      {
+         from = pgmoneta_append(from, directory);
+         from = pgmoneta_append(from, "/");
+         from = pgmoneta_append(from, entry->d_name);
+
+         if (pgmoneta_ends_with(entry->d_name, "backup_manifest") ||
+             pgmoneta_ends_with(entry->d_name, "backup_label"))
+         {
+            if (pipeline_process(from))
+            {
+               goto error;
+            }
+
+            free(from);
+            from = NULL;
+            continue;
+         }
+
+         // files that are already compressed are only encrypted, like the separate steps do
+         if (!pgmoneta_is_compressed_archive(entry->d_name) && !pgmoneta_is_encrypted_archive(entry->d_name))
+         {
+            suffix = pgmoneta_streamer_suffix(config->compression_type, config->encryption);
+         }
+         else if (config->encryption != ENCRYPTION_NONE &&
+                  !pgmoneta_ends_with(entry->d_name, ".aes") &&
+                  !pgmoneta_ends_with(entry->d_name, ".partial") &&
+                  !pgmoneta_ends_with(entry->d_name, ".history"))
+         {
+            suffix = pgmoneta_streamer_suffix(COMPRESSION_NONE, config->encryption);
+         }
+         else
+         {
+            if (pipeline_process(from))
+            {
+               goto error;
+            }
+
+            free(from);
+            from = NULL;
+            continue;
+         }
+
+         to = pgmoneta_append(to, from);
+         to = pgmoneta_append(to, suffix);
+
+         // the same relative path as in backup.sha256
+         key = pgmoneta_append(key, relative_path);
+         key = pgmoneta_append(key, "/");
+         key = pgmoneta_append(key, entry->d_name);
+         key = pgmoneta_append(key, suffix);
+
+         if (workers != NULL)
+         {
+            struct worker_input* wi = NULL;
+
+            // the directory carries the key of the hash
+            if (!pgmoneta_create_worker_input(key, from, to, 0, workers, &wi))
+            {
+               wi->all = hashes;
+
+               if (workers->outcome)
+               {
+                  pgmoneta_workers_add(workers, do_pipeline_file, wi);
+               }
+               else
+               {
+                  free(wi);
+               }
+            }
+         }
+         else if (pipeline_file(from, to, key, hashes))
+         {
+            goto error;
+         }
+
+         free(from);
+         free(to);
+         free(key);
+         free(suffix);
+
+         from = NULL;
+         to = NULL;
+         key = NULL;
+         suffix = NULL;
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   closedir(dir);
+
+   free(from);
+   free(to);
+   free(key);
+   free(suffix);
+
+   return 1;
+}
+
+static int
+pipeline_tablespaces(char* root, struct workers* workers)
+{
+   DIR* dir;
+   struct dirent* entry;
+
+   if (!(dir = opendir(root)))
+   {
+      return 1;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         char path[1024];
+
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "data") == 0)
+         {
+            continue;
+         }
+
+         snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+
+         // backup.sha256 only covers the data directory
+         if (pipeline_process(path) || pipeline_data(path, "", NULL, workers))
+         {
+            closedir(dir);
+            return 1;
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+}
+
+static int
+pipeline_file(char* from, char* to, char* key, struct deque* hashes)
+{
+   int compression;
+   size_t n;
+   char* sha256 = NULL;
+   char buffer[65536];
+   FILE* in = NULL;
+   FILE* out = NULL;
+   struct streamer* streamer = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   compression = config->compression_type;
+   if (pgmoneta_is_compressed_archive(from) || pgmoneta_is_encrypted_archive(from))
+   {
+      compression = COMPRESSION_NONE;
+   }
+
+   in = fopen(from, "rb");
+   if (in == NULL)
+   {
+      goto error;
+   }
+
+   out = fopen(to, "wb");
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_streamer_create(compression, config->compression_level, config->encryption, out, &streamer))
+   {
+      goto error;
+   }
+
+   if (hashes != NULL && pgmoneta_streamer_digest(streamer))
+   {
+      goto error;
+   }
+
+   while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+   {
+      if (pgmoneta_streamer_write(streamer, buffer, n))
+      {
+         goto error;
+      }
+
+      pgmoneta_workflow_progress(pipeline_server, n, 0);
+   }
+
+   if (ferror(in) || pgmoneta_streamer_finish(streamer))
+   {
+      goto error;
+   }
+
+   if (hashes != NULL)
+   {
+      if (pgmoneta_streamer_sha256(streamer, &sha256))
+      {
+         goto error;
+      }
+
+      pgmoneta_deque_add(hashes, key, (uintptr_t)sha256, ValueString);
+      free(sha256);
+      sha256 = NULL;
+   }
+
+   pgmoneta_streamer_destroy(streamer);
+   streamer = NULL;
+
+   fclose(in);
+   in = NULL;
+
+   if (fclose(out) != 0)
+   {
+      out = NULL;
+      goto error;
+   }
+
+   pgmoneta_delete_file(from, NULL);
+
+   if (pipeline_process(to))
+   {
+      return 1;
+   }
+
+   pgmoneta_workflow_progress(pipeline_server, 0, 1);
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Pipeline: Could not process %s", from);
+
+   pgmoneta_streamer_destroy(streamer);
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   if (pgmoneta_exists(to))
+   {
+      pgmoneta_delete_file(to, NULL);
+   }
+
+   free(sha256);
+
+   return 1;
+}
+
+static void
+do_pipeline_file(struct worker_input* wi)
+{
+   if (pipeline_file(wi->from, wi->to, wi->directory, wi->all))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+pipeline_process(char* path)
+{
+   for (int i = 0; i < pipeline_number_of_stages; i++)
+   {
+      if (pipeline_stages[i]->process(pipeline_stages[i]->name(), pipeline_nodes, path))
+      {
+         pgmoneta_log_error("Pipeline: %s could not process %s", pipeline_stages[i]->name(), path);
+         return 1;
+      }
+   }
+
+   return 0;
+}
@@ -33,8 +33,10 @@
 #include <info.h>
 #include <logging.h>
 #include <restore.h>
+#include <storage.h>
 #include <string.h>
 #include <utils.h>
+#include <walindex.h>
 #include <workers.h>
 #include <workflow.h>
 
@@ -42,6 +44,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 static char* restore_name(void);
@@ -58,17 +61,17 @@ static int recovery_info_execute(char*, struct art*);
 
 static char*restore_excluded_files_name(void);
 static int restore_excluded_files_execute(char*, struct art*);
-static int restore_excluded_files_teardown(char*, struct art*);
 
 static char* get_user_password(char* username);
 static void create_standby_signal(char* basedir);
+static void create_prewarm(int server, struct backup* backup, char* position, char* basedir);
 
 struct workflow*
 pgmoneta_create_restore(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -89,7 +92,7 @@ pgmoneta_create_combine_incremental(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -110,7 +113,7 @@ pgmoneta_create_batch_restore_relay(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -131,7 +134,7 @@ pgmoneta_create_recovery_info(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -152,7 +155,7 @@ pgmoneta_restore_excluded_files(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -162,7 +165,7 @@ pgmoneta_restore_excluded_files(void)
    wf->name = &restore_excluded_files_name;
    wf->setup = &pgmoneta_common_setup;
    wf->execute = &restore_excluded_files_execute;
-   wf->teardown = &restore_excluded_files_teardown;
+   wf->teardown = &pgmoneta_common_teardown;
    wf->next = NULL;
 
    return wf;
@@ -178,6 +181,7 @@ static int
 restore_execute(char* name, struct art* nodes)
 {
    int server = -1;
+   int ret = 0;
    char* position = NULL;
    char* directory = NULL;
    struct backup* backup = NULL;
@@ -187,8 +191,14 @@ restore_execute(char* name, struct art* nodes)
    char* origwal = NULL;
    char* waldir = NULL;
    char* waltarget = NULL;
+   char* walend = NULL;
    int number_of_workers = 0;
    struct workers* workers = NULL;
+   struct restore_filter* filter = NULL;
+   struct timespec start_t;
+   struct timespec data_t;
+   struct timespec wal_t;
+   struct timespec end_t;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -237,13 +247,35 @@ restore_execute(char* name, struct art* nodes)
 
    pgmoneta_delete_directory(to);
 
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
    number_of_workers = pgmoneta_get_number_of_workers(server);
    if (number_of_workers > 0)
    {
       pgmoneta_workers_initialize(number_of_workers, &workers);
    }
 
-   if (pgmoneta_copy_postgresql_restore(from, to, directory, config->servers[server].name, label, backup, workers))
+   if (!pgmoneta_exists(from) && (config->storage_engine & (STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
+   {
+      /* The data directory only lives in the object store, so stream it straight into the target */
+      ret = pgmoneta_storage_restore(server, backup, to);
+   }
+   else
+   {
+      if (pgmoneta_restore_filter_create(server, label, backup, position, &filter))
+      {
+         goto error;
+      }
+
+      ret = pgmoneta_copy_postgresql_restore(from, to, directory, config->servers[server].name, label, backup, filter, workers);
+
+      pgmoneta_restore_filter_destroy(filter);
+      filter = NULL;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &data_t);
+
+   if (ret)
    {
       pgmoneta_log_error("Restore: Could not restore %s/%s", config->servers[server].name, label);
       goto error;
@@ -300,7 +332,8 @@ restore_execute(char* name, struct art* nodes)
             {
                primary = false;
             }
-            else if (!strcmp(&key[0], "inclusive") || !strcmp(&key[0], "timeline") || !strcmp(&key[0], "action"))
+            else if (!strcmp(&key[0], "inclusive") || !strcmp(&key[0], "timeline") || !strcmp(&key[0], "action") ||
+                     !strcmp(&key[0], "database") || !strcmp(&key[0], "tablespace"))
             {
                /* Ok */
             }
@@ -330,7 +363,16 @@ restore_execute(char* name, struct art* nodes)
             waltarget = pgmoneta_append(waltarget, label);
             waltarget = pgmoneta_append(waltarget, "/pg_wal/");
 
-            pgmoneta_copy_wal_files(waldir, waltarget, &backup->wal[0], workers);
+            if (config->wal_index)
+            {
+               pgmoneta_walindex_find(server, &backup->wal[0], position, &walend);
+               if (walend != NULL)
+               {
+                  pgmoneta_log_debug("Restore: WAL up to %s", walend);
+               }
+            }
+
+            pgmoneta_copy_wal_files(waldir, waltarget, &backup->wal[0], walend, workers);
          }
       }
       else
@@ -342,6 +384,11 @@ restore_execute(char* name, struct art* nodes)
       }
    }
 
+   clock_gettime(CLOCK_MONOTONIC_RAW, &wal_t);
+
+   /* The data files and the WAL are decoded and copied by the workers together, and
+    * everything has to be in place before the last files are restored
+    */
    if (number_of_workers > 0)
    {
       pgmoneta_workers_wait(workers);
@@ -352,11 +399,20 @@ restore_execute(char* name, struct art* nodes)
       pgmoneta_workers_destroy(workers);
    }
 
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   pgmoneta_log_debug("Restore: %s/%s data %.4f seconds, WAL %.4f seconds, wait %.4f seconds",
+                      config->servers[server].name, label,
+                      pgmoneta_compute_duration(start_t, data_t),
+                      pgmoneta_compute_duration(data_t, wal_t),
+                      pgmoneta_compute_duration(wal_t, end_t));
+
    free(from);
    free(to);
    free(origwal);
    free(waldir);
    free(waltarget);
+   free(walend);
 
    return 0;
 
@@ -372,6 +428,7 @@ error:
    free(origwal);
    free(waldir);
    free(waltarget);
+   free(walend);
 
    return 1;
 }
@@ -391,8 +448,10 @@ combine_incremental_execute(char* name, struct art* nodes)
    char* input_dir = NULL;
    char output_dir[MAX_PATH];
    char* base = NULL;
+   char* position = NULL;
    struct backup* bck = NULL;
    struct json* manifest = NULL;
+   struct restore_filter* filter = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -451,11 +510,20 @@ combine_incremental_execute(char* name, struct art* nodes)
       }
    }
 
-   if (pgmoneta_combine_backups(server, base, input_dir, output_dir, prior_backups, bck, manifest))
+   position = (char*)pgmoneta_art_search(nodes, NODE_POSITION);
+   if (pgmoneta_restore_filter_create(server, bck->label, bck, position, &filter))
    {
       goto error;
    }
 
+   if (pgmoneta_combine_backups(server, base, input_dir, output_dir, prior_backups, bck, manifest, filter))
+   {
+      goto error;
+   }
+
+   pgmoneta_restore_filter_destroy(filter);
+   filter = NULL;
+
    if (pgmoneta_art_insert(nodes, NODE_TARGET_BASE, (uintptr_t)output_dir, ValueString))
    {
       goto error;
@@ -465,6 +533,7 @@ combine_incremental_execute(char* name, struct art* nodes)
    return 0;
 
 error:
+   pgmoneta_restore_filter_destroy(filter);
    free(input_dir);
    return 1;
 }
@@ -576,16 +645,11 @@ recovery_info_execute(char* name, struct art* nodes)
    char* position = NULL;
    bool primary;
    bool is_recovery_info;
-   char tokens[256];
-   char buffer[256];
-   char line[1024];
    char* f = NULL;
    FILE* ffile = NULL;
    char* t = NULL;
    FILE* tfile = NULL;
    char* path = NULL;
-   bool mode = false;
-   char* ptr = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -652,162 +716,9 @@ recovery_info_execute(char* name, struct art* nodes)
          goto error;
       }
 
-      if (ffile != NULL)
+      if (pgmoneta_restore_recovery_conf(server, position, ffile, tfile))
       {
-         while ((fgets(&buffer[0], sizeof(buffer), ffile)) != NULL)
-         {
-            if (pgmoneta_starts_with(&buffer[0], "standby_mode") ||
-                pgmoneta_starts_with(&buffer[0], "recovery_target") ||
-                pgmoneta_starts_with(&buffer[0], "primary_conninfo") ||
-                pgmoneta_starts_with(&buffer[0], "primary_slot_name"))
-            {
-               memset(&line[0], 0, sizeof(line));
-               snprintf(&line[0], sizeof(line), "#%s", &buffer[0]);
-               fputs(&line[0], tfile);
-            }
-            else
-            {
-               fputs(&buffer[0], tfile);
-            }
-         }
-      }
-
-      if (position != NULL)
-      {
-         memset(&tokens[0], 0, sizeof(tokens));
-         memcpy(&tokens[0], position, strlen(position));
-
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "#\n");
-         fputs(&line[0], tfile);
-
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "# Generated by pgmoneta\n");
-         fputs(&line[0], tfile);
-
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "#\n");
-         fputs(&line[0], tfile);
-
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "primary_conninfo = \'host=%s port=%d user=%s password=%s application_name=%s\'\n",
-                  config->servers[server].host, config->servers[server].port, config->servers[server].username,
-                  get_user_password(config->servers[server].username), config->servers[server].wal_slot);
-         fputs(&line[0], tfile);
-
-         memset(&line[0], 0, sizeof(line));
-         snprintf(&line[0], sizeof(line), "primary_slot_name = \'%s\'\n", config->servers[server].wal_slot);
-         fputs(&line[0], tfile);
-
-         ptr = strtok(&tokens[0], ",");
-
-         while (ptr != NULL)
-         {
-            char key[256];
-            char value[256];
-            char* equal = NULL;
-
-            memset(&key[0], 0, sizeof(key));
-            memset(&value[0], 0, sizeof(value));
-
-            equal = strchr(ptr, '=');
-
-            if (equal == NULL)
-            {
-               memcpy(&key[0], ptr, strlen(ptr));
-            }
-            else
-            {
-               memcpy(&key[0], ptr, strlen(ptr) - strlen(equal));
-               memcpy(&value[0], equal + 1, strlen(equal) - 1);
-            }
-
-            if (!strcmp(&key[0], "current") || !strcmp(&key[0], "immediate"))
-            {
-               if (!mode)
-               {
-                  memset(&line[0], 0, sizeof(line));
-                  snprintf(&line[0], sizeof(line), "recovery_target = \'immediate\'\n");
-                  fputs(&line[0], tfile);
-
-                  mode = true;
-               }
-            }
-            else if (!strcmp(&key[0], "name"))
-            {
-               if (!mode)
-               {
-                  memset(&line[0], 0, sizeof(line));
-                  snprintf(&line[0], sizeof(line), "recovery_target_name = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
-                  fputs(&line[0], tfile);
-
-                  mode = true;
-               }
-            }
-            else if (!strcmp(&key[0], "xid"))
-            {
-               if (!mode)
-               {
-                  memset(&line[0], 0, sizeof(line));
-                  snprintf(&line[0], sizeof(line), "recovery_target_xid = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
-                  fputs(&line[0], tfile);
-
-                  mode = true;
-               }
-            }
-            else if (!strcmp(&key[0], "lsn"))
-            {
-               if (!mode)
-               {
-                  memset(&line[0], 0, sizeof(line));
-                  snprintf(&line[0], sizeof(line), "recovery_target_lsn = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
-                  fputs(&line[0], tfile);
-
-                  mode = true;
-               }
-            }
-            else if (!strcmp(&key[0], "time"))
-            {
-               if (!mode)
-               {
-                  memset(&line[0], 0, sizeof(line));
-                  snprintf(&line[0], sizeof(line), "recovery_target_time = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
-                  fputs(&line[0], tfile);
-
-                  mode = true;
-               }
-            }
-            else if (!strcmp(&key[0], "primary") || !strcmp(&key[0], "replica"))
-            {
-               /* Ok */
-            }
-            else if (!strcmp(&key[0], "inclusive"))
-            {
-               memset(&line[0], 0, sizeof(line));
-               snprintf(&line[0], sizeof(line), "recovery_target_inclusive = %s\n", strlen(value) > 0 ? &value[0] : "on");
-               fputs(&line[0], tfile);
-            }
-            else if (!strcmp(&key[0], "timeline"))
-            {
-               memset(&line[0], 0, sizeof(line));
-               snprintf(&line[0], sizeof(line), "recovery_target_timeline = \'%s\'\n", strlen(value) > 0 ? &value[0] : "latest");
-               fputs(&line[0], tfile);
-            }
-            else if (!strcmp(&key[0], "action"))
-            {
-               memset(&line[0], 0, sizeof(line));
-               snprintf(&line[0], sizeof(line), "recovery_target_action = \'%s\'\n", strlen(value) > 0 ? &value[0] : "pause");
-               fputs(&line[0], tfile);
-            }
-            else
-            {
-               memset(&line[0], 0, sizeof(line));
-               snprintf(&line[0], sizeof(line), "%s = \'%s\'\n", &key[0], strlen(value) > 0 ? &value[0] : "");
-               fputs(&line[0], tfile);
-            }
-
-            ptr = strtok(NULL, ",");
-         }
+         goto error;
       }
 
       if (ffile != NULL)
@@ -853,21 +764,9 @@ recovery_info_execute(char* name, struct art* nodes)
          goto error;
       }
 
-      if (ffile != NULL)
+      if (pgmoneta_restore_primary_conf(ffile, tfile))
       {
-         while ((fgets(&buffer[0], sizeof(buffer), ffile)) != NULL)
-         {
-            if (pgmoneta_starts_with(&buffer[0], "primary_conninfo"))
-            {
-               memset(&line[0], 0, sizeof(line));
-               snprintf(&line[0], sizeof(line), "#%s", &buffer[0]);
-               fputs(&line[0], tfile);
-            }
-            else
-            {
-               fputs(&buffer[0], tfile);
-            }
-         }
+         goto error;
       }
 
       if (ffile != NULL)
@@ -898,6 +797,11 @@ recovery_info_execute(char* name, struct art* nodes)
       }
    }
 
+   if (config->wal_index && config->restore_prewarm > 0)
+   {
+      create_prewarm(server, (struct backup*)pgmoneta_art_search(nodes, NODE_BACKUP), position, base);
+   }
+
 done:
 
    free(f);
@@ -939,9 +843,9 @@ restore_excluded_files_execute(char* name, struct art* nodes)
    char* to = NULL;
    char* suffix = NULL;
    struct backup* backup = NULL;
-   struct workers* workers = NULL;
-   int number_of_workers = 0;
    char** restore_last_files_names = NULL;
+   struct timespec start_t;
+   struct timespec end_t;
    struct configuration* config = (struct configuration*)shmem;
 
 #ifdef DEBUG
@@ -959,6 +863,8 @@ restore_excluded_files_execute(char* name, struct art* nodes)
 
    pgmoneta_log_debug("Excluded (execute): %s/%s", config->servers[server].name, identifier);
 
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
    if (pgmoneta_get_restore_last_files_names(&restore_last_files_names))
    {
       goto error;
@@ -1009,6 +915,12 @@ restore_excluded_files_execute(char* name, struct art* nodes)
       case ENCRYPTION_AES_128_CTR:
          suffix = pgmoneta_append(suffix, ".aes");
          break;
+      case ENCRYPTION_AES_256_GCM:
+         suffix = pgmoneta_append(suffix, ".aes");
+         break;
+      case ENCRYPTION_CHACHA20_POLY1305:
+         suffix = pgmoneta_append(suffix, ".aes");
+         break;
       case ENCRYPTION_NONE:
          break;
       default:
@@ -1018,30 +930,70 @@ restore_excluded_files_execute(char* name, struct art* nodes)
    from = pgmoneta_append(from, (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA));
    to = pgmoneta_append(to, (char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE));
 
-   number_of_workers = pgmoneta_get_number_of_workers(server);
-   if (number_of_workers > 0)
+   if (!pgmoneta_exists(from))
    {
-      pgmoneta_workers_initialize(number_of_workers, &workers);
+      /* Restored from the object store, which already placed these files */
+      for (int i = 0; restore_last_files_names[i] != NULL; i++)
+      {
+         free(restore_last_files_names[i]);
+      }
+      free(restore_last_files_names);
+      free(from);
+      free(to);
+      free(suffix);
+
+      return 0;
    }
 
+   /* The rest of the data directory is complete at this point, so the files are restored
+    * one at a time in order, and pg_control is the final one
+    */
    for (int i = 0; restore_last_files_names[i] != NULL; i++)
    {
       char* from_file = NULL;
       char* to_file = NULL;
+      int ret;
 
       from_file = pgmoneta_append(from_file, from);
       from_file = pgmoneta_append(from_file, restore_last_files_names[i]);
-      from_file = pgmoneta_append(from_file, suffix);
 
       to_file = pgmoneta_append(to_file, to);
       to_file = pgmoneta_append(to_file, restore_last_files_names[i]);
-      to_file = pgmoneta_append(to_file, suffix);
+
+      if (suffix != NULL)
+      {
+         char* encoded = NULL;
+
+         encoded = pgmoneta_append(encoded, from_file);
+         encoded = pgmoneta_append(encoded, suffix);
+
+         if (pgmoneta_exists(encoded))
+         {
+            free(from_file);
+            from_file = encoded;
+         }
+         else
+         {
+            free(encoded);
+         }
+      }
 
       pgmoneta_log_trace("Excluded: %s -> %s", from_file, to_file);
 
-      if (pgmoneta_copy_file(from_file, to_file, workers))
+      if (pgmoneta_ends_with(from_file, restore_last_files_names[i]))
+      {
+         ret = pgmoneta_copy_file(from_file, to_file, NULL);
+      }
+      else
+      {
+         ret = pgmoneta_decode_file(from_file, to_file, NULL);
+      }
+
+      if (ret)
       {
-         pgmoneta_log_error("Restore: Could not copy file %s to %s", from_file, to_file);
+         pgmoneta_log_error("Restore: Could not restore file %s to %s", from_file, to_file);
+         free(from_file);
+         free(to_file);
          goto error;
       }
 
@@ -1052,15 +1004,10 @@ restore_excluded_files_execute(char* name, struct art* nodes)
       to_file = NULL;
    }
 
-   if (number_of_workers > 0)
-   {
-      pgmoneta_workers_wait(workers);
-      if (!workers->outcome)
-      {
-         goto error;
-      }
-      pgmoneta_workers_destroy(workers);
-   }
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   pgmoneta_log_debug("Restore: Last files of %s/%s in %.4f seconds", config->servers[server].name, identifier,
+                      pgmoneta_compute_duration(start_t, end_t));
 
    for (int i = 0; restore_last_files_names[i] != NULL; i++)
    {
@@ -1075,11 +1022,6 @@ restore_excluded_files_execute(char* name, struct art* nodes)
 
 error:
 
-   if (number_of_workers > 0)
-   {
-      pgmoneta_workers_destroy(workers);
-   }
-
    for (int i = 0; restore_last_files_names[i] != NULL; i++)
    {
       free(restore_last_files_names[i]);
@@ -1092,133 +1034,214 @@ error:
    return 1;
 }
 
-static int
-restore_excluded_files_teardown(char* name, struct art* nodes)
+int
+pgmoneta_restore_recovery_conf(int server, char* position, FILE* in, FILE* out)
 {
-   int server = -1;
-   char* identifier = NULL;
-   char** restore_last_files_names = NULL;
-   char* to = NULL;
-   char* suffix = NULL;
-   struct backup* backup = NULL;
+   char tokens[256];
+   char buffer[256];
+   char line[1024];
+   bool mode = false;
+   char* ptr = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-#ifdef DEBUG
-   char* a = NULL;
-   a = pgmoneta_art_to_string(nodes, FORMAT_TEXT, NULL, 0);
-   pgmoneta_log_debug("(Tree)\n%s", a);
-   assert(nodes != NULL);
-   assert(pgmoneta_art_contains_key(nodes, NODE_SERVER));
-   assert(pgmoneta_art_contains_key(nodes, NODE_IDENTIFIER));
-   free(a);
-#endif
+   if (in != NULL)
+   {
+      while ((fgets(&buffer[0], sizeof(buffer), in)) != NULL)
+      {
+         if (pgmoneta_starts_with(&buffer[0], "standby_mode") ||
+             pgmoneta_starts_with(&buffer[0], "recovery_target") ||
+             pgmoneta_starts_with(&buffer[0], "primary_conninfo") ||
+             pgmoneta_starts_with(&buffer[0], "primary_slot_name"))
+         {
+            memset(&line[0], 0, sizeof(line));
+            snprintf(&line[0], sizeof(line), "#%s", &buffer[0]);
+            fputs(&line[0], out);
+         }
+         else
+         {
+            fputs(&buffer[0], out);
+         }
+      }
+   }
 
-   server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
-   identifier = (char*)pgmoneta_art_search(nodes, NODE_IDENTIFIER);
+   if (position != NULL)
+   {
+      memset(&tokens[0], 0, sizeof(tokens));
+      memcpy(&tokens[0], position, strlen(position));
 
-   pgmoneta_log_debug("Excluded (teardown): %s/%s", config->servers[server].name, identifier);
+      memset(&line[0], 0, sizeof(line));
+      snprintf(&line[0], sizeof(line), "#\n");
+      fputs(&line[0], out);
 
-   backup = (struct backup*)pgmoneta_art_search(nodes, NODE_BACKUP);
+      memset(&line[0], 0, sizeof(line));
+      snprintf(&line[0], sizeof(line), "# Generated by pgmoneta\n");
+      fputs(&line[0], out);
 
-   to = pgmoneta_append(to, (char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE));
+      memset(&line[0], 0, sizeof(line));
+      snprintf(&line[0], sizeof(line), "#\n");
+      fputs(&line[0], out);
 
-   switch (backup->compression)
-   {
-      case COMPRESSION_CLIENT_GZIP:
-      case COMPRESSION_SERVER_GZIP:
-         suffix = pgmoneta_append(suffix, ".gz");
-         break;
-      case COMPRESSION_CLIENT_ZSTD:
-      case COMPRESSION_SERVER_ZSTD:
-         suffix = pgmoneta_append(suffix, ".zstd");
-         break;
-      case COMPRESSION_CLIENT_LZ4:
-      case COMPRESSION_SERVER_LZ4:
-         suffix = pgmoneta_append(suffix, ".lz4");
-         break;
-      case COMPRESSION_CLIENT_BZIP2:
-         suffix = pgmoneta_append(suffix, ".bz2");
-         break;
-      case COMPRESSION_NONE:
-         break;
-      default:
-         break;
-   }
+      memset(&line[0], 0, sizeof(line));
+      snprintf(&line[0], sizeof(line), "primary_conninfo = \'host=%s port=%d user=%s password=%s application_name=%s\'\n",
+               config->servers[server].host, config->servers[server].port, config->servers[server].username,
+               get_user_password(config->servers[server].username), config->servers[server].wal_slot);
+      fputs(&line[0], out);
 
-   switch (backup->encryption)
-   {
-      case ENCRYPTION_AES_256_CBC:
-         suffix = pgmoneta_append(suffix, ".aes");
-         break;
-      case ENCRYPTION_AES_192_CBC:
-         suffix = pgmoneta_append(suffix, ".aes");
-         break;
-      case ENCRYPTION_AES_128_CBC:
-         suffix = pgmoneta_append(suffix, ".aes");
-         break;
-      case ENCRYPTION_AES_256_CTR:
-         suffix = pgmoneta_append(suffix, ".aes");
-         break;
-      case ENCRYPTION_AES_192_CTR:
-         suffix = pgmoneta_append(suffix, ".aes");
-         break;
-      case ENCRYPTION_AES_128_CTR:
-         suffix = pgmoneta_append(suffix, ".aes");
-         break;
-      case ENCRYPTION_NONE:
-         break;
-      default:
-         break;
-   }
+      memset(&line[0], 0, sizeof(line));
+      snprintf(&line[0], sizeof(line), "primary_slot_name = \'%s\'\n", config->servers[server].wal_slot);
+      fputs(&line[0], out);
 
-   if (pgmoneta_get_restore_last_files_names(&restore_last_files_names))
-   {
-      goto error;
-   }
+      ptr = strtok(&tokens[0], ",");
 
-   for (int i = 0; restore_last_files_names[i] != NULL; i++)
-   {
-      char* to_file = NULL;
+      while (ptr != NULL)
+      {
+         char key[256];
+         char value[256];
+         char* equal = NULL;
 
-      to_file = pgmoneta_append(to_file, to);
-      to_file = pgmoneta_append(to_file, restore_last_files_names[i]);
-      to_file = pgmoneta_append(to_file, suffix);
+         memset(&key[0], 0, sizeof(key));
+         memset(&value[0], 0, sizeof(value));
 
-      if (pgmoneta_exists(to_file))
-      {
-         pgmoneta_delete_file(to_file, NULL);
-      }
-      else
-      {
-         pgmoneta_log_debug("%s doesn't exists", to_file);
-      }
+         equal = strchr(ptr, '=');
 
-      free(to_file);
-      to_file = NULL;
+         if (equal == NULL)
+         {
+            memcpy(&key[0], ptr, strlen(ptr));
+         }
+         else
+         {
+            memcpy(&key[0], ptr, strlen(ptr) - strlen(equal));
+            memcpy(&value[0], equal + 1, strlen(equal) - 1);
+         }
+
+         if (!strcmp(&key[0], "current") || !strcmp(&key[0], "immediate"))
+         {
+            if (!mode)
+            {
+               memset(&line[0], 0, sizeof(line));
+               snprintf(&line[0], sizeof(line), "recovery_target = \'immediate\'\n");
+               fputs(&line[0], out);
+
+               mode = true;
+            }
+         }
+         else if (!strcmp(&key[0], "name"))
+         {
+            if (!mode)
+            {
+               memset(&line[0], 0, sizeof(line));
+               snprintf(&line[0], sizeof(line), "recovery_target_name = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
+               fputs(&line[0], out);
+
+               mode = true;
+            }
+         }
+         else if (!strcmp(&key[0], "xid"))
+         {
+            if (!mode)
+            {
+               memset(&line[0], 0, sizeof(line));
+               snprintf(&line[0], sizeof(line), "recovery_target_xid = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
+               fputs(&line[0], out);
+
+               mode = true;
+            }
+         }
+         else if (!strcmp(&key[0], "lsn"))
+         {
+            if (!mode)
+            {
+               memset(&line[0], 0, sizeof(line));
+               snprintf(&line[0], sizeof(line), "recovery_target_lsn = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
+               fputs(&line[0], out);
+
+               mode = true;
+            }
+         }
+         else if (!strcmp(&key[0], "time"))
+         {
+            if (!mode)
+            {
+               memset(&line[0], 0, sizeof(line));
+               snprintf(&line[0], sizeof(line), "recovery_target_time = \'%s\'\n", strlen(value) > 0 ? &value[0] : "");
+               fputs(&line[0], out);
+
+               mode = true;
+            }
+         }
+         else if (!strcmp(&key[0], "primary") || !strcmp(&key[0], "replica") ||
+                  !strcmp(&key[0], "database") || !strcmp(&key[0], "tablespace"))
+         {
+            /* Ok */
+         }
+         else if (!strcmp(&key[0], "inclusive"))
+         {
+            memset(&line[0], 0, sizeof(line));
+            snprintf(&line[0], sizeof(line), "recovery_target_inclusive = %s\n", strlen(value) > 0 ? &value[0] : "on");
+            fputs(&line[0], out);
+         }
+         else if (!strcmp(&key[0], "timeline"))
+         {
+            memset(&line[0], 0, sizeof(line));
+            snprintf(&line[0], sizeof(line), "recovery_target_timeline = \'%s\'\n", strlen(value) > 0 ? &value[0] : "latest");
+            fputs(&line[0], out);
+         }
+         else if (!strcmp(&key[0], "action"))
+         {
+            memset(&line[0], 0, sizeof(line));
+            snprintf(&line[0], sizeof(line), "recovery_target_action = \'%s\'\n", strlen(value) > 0 ? &value[0] : "pause");
+            fputs(&line[0], out);
+         }
+         else
+         {
+            memset(&line[0], 0, sizeof(line));
+            snprintf(&line[0], sizeof(line), "%s = \'%s\'\n", &key[0], strlen(value) > 0 ? &value[0] : "");
+            fputs(&line[0], out);
+         }
+
+         ptr = strtok(NULL, ",");
+      }
    }
 
-   for (int i = 0; restore_last_files_names[i] != NULL; i++)
+   if (ferror(out))
    {
-      free(restore_last_files_names[i]);
+      return 1;
    }
-   free(restore_last_files_names);
-   free(to);
-   free(suffix);
 
    return 0;
+}
 
-error:
-   for (int i = 0; restore_last_files_names[i] != NULL; i++)
+int
+pgmoneta_restore_primary_conf(FILE* in, FILE* out)
+{
+   char buffer[256];
+   char line[1024];
+
+   if (in != NULL)
    {
-      free(restore_last_files_names[i]);
+      while ((fgets(&buffer[0], sizeof(buffer), in)) != NULL)
+      {
+         if (pgmoneta_starts_with(&buffer[0], "primary_conninfo"))
+         {
+            memset(&line[0], 0, sizeof(line));
+            snprintf(&line[0], sizeof(line), "#%s", &buffer[0]);
+            fputs(&line[0], out);
+         }
+         else
+         {
+            fputs(&buffer[0], out);
+         }
+      }
    }
-   free(restore_last_files_names);
-   free(to);
-   free(suffix);
 
-   return 1;
+   if (ferror(out))
+   {
+      return 1;
+   }
+
+   return 0;
 }
 
 static char*
@@ -1264,3 +1287,39 @@ create_standby_signal(char* basedir)
 
    free(f);
 }
+
+static void
+create_prewarm(int server, struct backup* backup, char* position, char* basedir)
+{
+   char* walend = NULL;
+   char* path = NULL;
+   size_t block_size;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (backup == NULL)
+   {
+      return;
+   }
+
+   block_size = config->servers[server].block_size > 0 ? config->servers[server].block_size : 8192;
+
+   // Without a recovery target in the indexes the newest WAL gives the blocks the primary uses now
+   pgmoneta_walindex_find(server, &backup->wal[0], position, &walend);
+
+   path = pgmoneta_append(path, basedir);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   path = pgmoneta_append(path, "autoprewarm.blocks");
+
+   if (pgmoneta_walindex_prewarm(server, &backup->wal[0], walend, config->restore_prewarm / block_size, path))
+   {
+      pgmoneta_log_warn("Restore: Could not create %s", path);
+   }
+
+   free(walend);
+   free(path);
+}
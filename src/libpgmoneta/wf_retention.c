@@ -29,12 +29,17 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <catalog.h>
 #include <delete.h>
 #include <deque.h>
 #include <info.h>
 #include <link.h>
 #include <logging.h>
+#include <prometheus.h>
+#include <retention.h>
+#include <storage.h>
 #include <utils.h>
+#include <walindex.h>
 #include <workflow.h>
 
 /* system */
@@ -48,15 +53,14 @@ static char* retention_name(void);
 static int retention_setup(char*, struct art*);
 static int retention_execute(char*, struct art*);
 static int retention_teardown(char*, struct art*);
-static void mark_retention(int server, int retention_days, int retention_weeks, int retention_months,
-                           int retention_years, int number_of_backups, struct backup** backups, bool** retention_flags);
+static void tier_backups(int server);
 
 struct workflow*
 pgmoneta_create_retention(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -105,10 +109,12 @@ static int
 retention_execute(char* name, struct art* nodes)
 {
    char* d;
+   bool complete;
+   bool versioned;
+   int64_t version = 0;
    int number_of_backups = 0;
    struct backup** backups = NULL;
-   struct backup* child = NULL;
-   bool* retention_keep = NULL;
+   struct retention_plan* plan = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -123,75 +129,86 @@ retention_execute(char* name, struct art* nodes)
 
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      int retention_days = -1;
-      int retention_weeks = -1;
-      int retention_months = -1;
-      int retention_years = -1;
-
       pgmoneta_log_debug("Retention (execute): %s", config->servers[i].name);
 
-      retention_days = config->servers[i].retention_days;
-      if (retention_days <= 0)
-      {
-         retention_days = config->retention_days;
-      }
-      retention_weeks = config->servers[i].retention_weeks;
-      if (retention_weeks <= 0)
+      complete = true;
+      plan = NULL;
+
+      d = pgmoneta_get_server_backup(i);
+
+      // nothing changes until a backup does, or the rules move on with the time
+      versioned = !pgmoneta_catalog_version(d, &version);
+      if (versioned && version == atomic_load(&config->states[i].retention_version) &&
+          time(NULL) < atomic_load(&config->states[i].retention_until))
       {
-         retention_weeks = config->retention_weeks;
+         pgmoneta_log_debug("Retention: %s is unchanged", config->servers[i].name);
+
+         tier_backups(i);
+
+         free(d);
+         continue;
       }
-      retention_months = config->servers[i].retention_months;
-      if (retention_months <= 0)
+
+      if (pgmoneta_retention_plan(i, &plan))
       {
-         retention_months = config->retention_months;
+         pgmoneta_log_warn("Retention: Could not plan %s", config->servers[i].name);
+         complete = false;
       }
-      retention_years = config->servers[i].retention_years;
-      if (retention_years <= 0)
+      else
       {
-         retention_years = config->retention_years;
-      }
-
-      number_of_backups = 0;
-      backups = NULL;
+         for (int j = plan->number_of_backups - 1; j >= 0; j--)
+         {
+            if (!plan->deletes[j])
+            {
+               continue;
+            }
 
-      d = pgmoneta_get_server_backup(i);
+            pgmoneta_log_trace("Retention: %s/%s (%s)", config->servers[i].name, plan->backups[j]->label, atomic_load(&config->states[i].delete) ? "Active" : "Inactive");
 
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+            if (atomic_load(&config->states[i].delete))
+            {
+               complete = false;
+               break;
+            }
 
-      if (number_of_backups > 0)
-      {
-         mark_retention(i, retention_days, retention_weeks, retention_months,
-                        retention_years, number_of_backups, backups, &retention_keep);
-         for (int j = 0; j < number_of_backups; j++)
-         {
-            if (!retention_keep[j])
+            pgmoneta_log_info("Retention: %s/%s", config->servers[i].name, plan->backups[j]->label);
+            if (pgmoneta_delete(i, plan->backups[j]->label))
             {
-               pgmoneta_get_backup_child(i, backups[j], &child);
-               // a backup can only be deleted if it has no child
-               if (!backups[j]->keep && child == NULL)
-               {
-                  pgmoneta_log_trace("Retention: %s/%s (%s)", config->servers[i].name, backups[j]->label, atomic_load(&config->servers[i].delete) ? "Active" : "Inactive");
-
-                  if (!atomic_load(&config->servers[i].delete))
-                  {
-                     pgmoneta_log_info("Retention: %s/%s", config->servers[i].name, backups[j]->label);
-                     pgmoneta_delete(i, backups[j]->label);
-                     break;
-                  }
-               }
-               free(child);
-               child = NULL;
+               complete = false;
+               break;
             }
          }
       }
 
-      pgmoneta_delete_wal(i);
+      tier_backups(i);
 
-      for (int j = 0; j < number_of_backups; j++)
+      // the WAL of the plan is the one before the backups that are left when all of the plan is done
+      if (complete)
+      {
+         pgmoneta_retention_wal(i, plan);
+      }
+      else
+      {
+         pgmoneta_delete_wal(i);
+      }
+
+      pgmoneta_walindex_prune(i);
+
+      pgmoneta_prometheus_refresh(i);
+
+      // without backups every new WAL segment goes, so the plan is made each time
+      if (complete && versioned && plan->number_of_deletes == 0 && plan->number_of_backups > 0)
+      {
+         atomic_store(&config->states[i].retention_version, version);
+         atomic_store(&config->states[i].retention_until, (long long)plan->until);
+      }
+      else
       {
-         free(backups[j]);
+         atomic_store(&config->states[i].retention_until, 0);
       }
-      free(backups);
+
+      pgmoneta_retention_plan_destroy(plan);
+      plan = NULL;
 
       if (strlen(config->servers[i].hot_standby) > 0)
       {
@@ -225,11 +242,13 @@ retention_execute(char* name, struct art* nodes)
          }
          free(backups);
 
+         number_of_backups = 0;
+         backups = NULL;
+
          free(srv);
          free(hs);
       }
 
-      free(retention_keep);
       free(d);
    }
 
@@ -260,175 +279,46 @@ retention_teardown(char* name, struct art* nodes)
 }
 
 static void
-mark_retention(int server, int retention_days, int retention_weeks, int retention_months,
-               int retention_years, int number_of_backups, struct backup** backups, bool** retention_keep)
+tier_backups(int server)
 {
-   bool* keep = NULL;
+   int days;
+   char* d = NULL;
    time_t t;
    char check_date[128];
-   struct tm* time_info;
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   keep = (bool*) malloc(sizeof (bool*) * number_of_backups);
+   days = pgmoneta_storage_retention_local(server);
 
-   if (keep == NULL)
+   if (days == 0 || !(config->storage_engine & (STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
    {
       return;
    }
 
-   for (int i = 0; i < number_of_backups; i++)
-   {
-      keep[i] = false;
-   }
-   t = time(NULL);
+   t = time(NULL) - ((time_t)days * 24 * 60 * 60);
    memset(&check_date[0], 0, sizeof(check_date));
-   // retention for nearest days, always happen, so no need to check
-   time_t tmp_time = t;
-   tmp_time = tmp_time - (retention_days * 24 * 60 * 60);
-   time_info = localtime(&tmp_time);
-   strftime(&check_date[0], sizeof(check_date), "%Y%m%d%H%M%S", time_info);
-   // this is the same logic as previous implementation
-   // construct the timestamp 7 days before
-   // and mark retain for backups later than that
-   for (int j = number_of_backups - 1; j >= 0; j--)
-   {
-      if (strcmp(backups[j]->label, &check_date[0]) >= 0)
-      {
-         pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
-         keep[j] = true;
-      }
-      else
-      {
-         pgmoneta_log_debug("Marked for deletion: %s/%s", config->servers[server].name, backups[j]->label);
-      }
-   }
-   if (retention_weeks != -1)
-   {
-      // reset tmp time
-      tmp_time = t;
-      // use global variable k to traverse backups from latest to oldest
-      int k = number_of_backups - 1;
-      for (int j = 0; j < retention_weeks; j++)
-      {
-         // push the time a week back
-         tmp_time = tmp_time - (j * 7 * 24 * 60 * 60);
-         time_info = localtime(&tmp_time);
-         // tm_wday starts with Sunday, wind tmp_time to the nearest Monday
-         tmp_time = tmp_time - ((time_info->tm_wday + 6) % 7) * 24 * 60 * 60;
-         time_info = localtime(&tmp_time);
-         // scan will resume from where it left off in the previous loop
-         // and try to find the first backup whose date with the new Monday
-         while (k >= 0)
-         {
-            // find the latest label on that Monday
-            // check backups from latest to earliest,
-            // mark retain for the first backup whose date matches with that Monday
-            struct tm backup_time_info = {0};
-            // construct tm struct from the timestamp label
-            strptime(backups[k]->label, "%Y%m%d%H%M%S", &backup_time_info);
-            if (time_info->tm_year == backup_time_info.tm_year &&
-                time_info->tm_yday == backup_time_info.tm_yday)
-            {
-               pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
-               keep[k--] = true;
-               break;
-            }
-            else if ((time_info->tm_year == backup_time_info.tm_year &&
-                      time_info->tm_yday > backup_time_info.tm_yday) ||
-                     time_info->tm_year > backup_time_info.tm_year)
-            {
-               // stop if one week's Monday doesn't backup and k goes too far back
-               break;
-            }
-            k--;
-         }
-      }
-   }
-   if (retention_months != -1)
+   strftime(&check_date[0], sizeof(check_date), "%Y%m%d%H%M%S", localtime(&t));
+
+   d = pgmoneta_get_server_backup(server);
+
+   if (!pgmoneta_get_backups(d, &number_of_backups, &backups))
    {
-      // use global variable k to traverse backups from latest to oldest
-      int k = number_of_backups - 1;
-      // get the time info for the current time
-      time_info = localtime(&t);
-      int cur_year = time_info->tm_year;
-      int cur_month = time_info->tm_mon;
-
-      for (int j = 0; j < retention_months; j++)
+      for (int i = 0; i < number_of_backups; i++)
       {
-         // first we look at the first day on this month,
-         // then push the time one month back at a time
-         if (j > 0)
-         {
-            cur_month--;
-         }
-         // if we cross years, change month to December of the previous year
-         if (cur_month < 0)
-         {
-            cur_month = 11;
-            cur_year--;
-         }
-         // scan through backups from latest to earliest,
-         // scan will resume from where it left off in the previous loop
-         // and try to find the first backup whose month and year matches with cur_month and cur_year
-         while (k >= 0)
+         if (backups[i]->valid == VALID_TRUE && strcmp(backups[i]->label, &check_date[0]) < 0)
          {
-            struct tm backup_time_info = {0};
-            strptime(backups[k]->label, "%Y%m%d%H%M%S", &backup_time_info);
-            // find the latest backup on the first day of that month
-            if (cur_month == backup_time_info.tm_mon &&
-                cur_year == backup_time_info.tm_year &&
-                backup_time_info.tm_mday == 1)
-            {
-               pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
-               keep[k--] = true;
-               break;
-            }
-            else if ((cur_year == backup_time_info.tm_year &&
-                      cur_month > backup_time_info.tm_mon) ||
-                     cur_year > backup_time_info.tm_year)
-            {
-               // stop when k goes too far back
-               break;
-            }
-            k--;
+            pgmoneta_storage_tier(server, backups[i]);
          }
       }
    }
-   if (retention_years != -1)
-   {
-      int k = number_of_backups - 1;
-      time_info = localtime(&t);
-      int cur_year = time_info->tm_year;
-
-      for (int j = 0; j < retention_years; j++)
-      {
-         // go to previous year
-         if (j > 0)
-         {
-            cur_year--;
-         }
 
-         while (k >= 0)
-         {
-            struct tm backup_time_info = {0};
-            strptime(backups[k]->label, "%Y%m%d%H%M%S", &backup_time_info);
-            // find the latest backup on the first day of that year
-            if (cur_year == backup_time_info.tm_year && backup_time_info.tm_yday == 0)
-            {
-               pgmoneta_log_trace("Skipped for deletion: %s/%s", config->servers[server].name, backups[j]->label);
-               keep[k--] = true;
-               break;
-            }
-            else if (cur_year > backup_time_info.tm_year)
-            {
-               // in case one year doesn't have backups and the pointer k goes too far back
-               break;
-            }
-            k--;
-         }
-      }
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
    }
-   *retention_keep = keep;
+   free(backups);
+   free(d);
 }
@@ -32,7 +32,9 @@
 #include <deque.h>
 #include <logging.h>
 #include <security.h>
+#include <sha256.h>
 #include <utils.h>
+#include <workers.h>
 #include <workflow.h>
 
 /* system */
@@ -42,16 +44,37 @@
 static char* sha256_name(void);
 static int sha256_execute(char*, struct art*);
 
-static int write_backup_sha256(char* root, char* relative_path);
+#define SHA256_BATCH 64
+
+/** @struct sha256_entry
+ * Defines a line of backup.sha256
+ */
+struct sha256_entry
+{
+   char* relative; /**< The path relative to the data directory */
+   char* sha256;   /**< The hash, NULL until it is calculated */
+};
+
+static int collect_backup_sha256(char* root, char* relative_path);
+static int write_backup_sha256(int server);
+static void do_sha256(struct worker_input* wi);
+static void sha256_clear(void);
 
 static FILE* sha256_file = NULL;
+static struct art* sha256_hashes = NULL;
+static struct art* sha256_index = NULL;
+static struct sha256_entry* sha256_entries = NULL;
+static int sha256_number_of_entries = 0;
+static int sha256_capacity = 0;
+static struct sha256_job* sha256_jobs = NULL;
+static int sha256_number_of_jobs = 0;
 
 struct workflow*
 pgmoneta_create_sha256(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    wf->name = &sha256_name;
    wf->setup = &pgmoneta_common_setup;
@@ -108,7 +131,18 @@ sha256_execute(char* name, struct art* nodes)
 
    d = pgmoneta_get_server_backup_identifier_data(server, label);
 
-   if (write_backup_sha256(d, ""))
+   // the pipeline step may already have hashed the files it wrote
+   sha256_hashes = (struct art*)pgmoneta_art_search(nodes, NODE_SHA256);
+
+   // files that are unchanged since they were received keep the hash from the receive
+   pgmoneta_sha256_index_read(root, &sha256_index);
+
+   if (collect_backup_sha256(d, ""))
+   {
+      goto error;
+   }
+
+   if (write_backup_sha256(server))
    {
       goto error;
    }
@@ -116,6 +150,7 @@ sha256_execute(char* name, struct art* nodes)
    pgmoneta_permission(sha256_path, 6, 0, 0);
 
    fclose(sha256_file);
+   sha256_clear();
 
    free(sha256_path);
    free(root);
@@ -129,6 +164,7 @@ error:
    {
       fclose(sha256_file);
    }
+   sha256_clear();
 
    free(sha256_path);
    free(root);
@@ -138,13 +174,11 @@ error:
 }
 
 static int
-write_backup_sha256(char* root, char* relative_path)
+collect_backup_sha256(char* root, char* relative_path)
 {
    char* dir_path = NULL;
    char* relative_file_path;
    char* absolute_file_path;
-   char* buffer;
-   char* sha256;
    DIR* dir;
    struct dirent* entry;
 
@@ -169,36 +203,75 @@ write_backup_sha256(char* root, char* relative_path)
 
          snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
 
-         write_backup_sha256(root, relative_dir);
+         collect_backup_sha256(root, relative_dir);
       }
       else
       {
          relative_file_path = NULL;
          absolute_file_path = NULL;
-         sha256 = NULL;
-         buffer = NULL;
 
          relative_file_path = pgmoneta_append(relative_file_path, relative_path);
          relative_file_path = pgmoneta_append(relative_file_path, "/");
          relative_file_path = pgmoneta_append(relative_file_path, entry->d_name);
 
+         if (sha256_number_of_entries == sha256_capacity)
+         {
+            int capacity = sha256_capacity == 0 ? 1024 : sha256_capacity * 2;
+            struct sha256_entry* entries = NULL;
+            struct sha256_job* jobs = NULL;
+
+            entries = (struct sha256_entry*)realloc(sha256_entries, capacity * sizeof(struct sha256_entry));
+            if (entries == NULL)
+            {
+               free(relative_file_path);
+               goto error;
+            }
+            sha256_entries = entries;
+
+            jobs = (struct sha256_job*)realloc(sha256_jobs, capacity * sizeof(struct sha256_job));
+            if (jobs == NULL)
+            {
+               free(relative_file_path);
+               goto error;
+            }
+            sha256_jobs = jobs;
+
+            sha256_capacity = capacity;
+         }
+
+         sha256_entries[sha256_number_of_entries].relative = relative_file_path;
+         sha256_entries[sha256_number_of_entries].sha256 = NULL;
+
          absolute_file_path = pgmoneta_append(absolute_file_path, root);
          absolute_file_path = pgmoneta_append(absolute_file_path, "/");
          absolute_file_path = pgmoneta_append(absolute_file_path, relative_file_path);
 
-         pgmoneta_create_sha256_file(absolute_file_path, &sha256);
+         if (sha256_hashes != NULL && pgmoneta_art_search(sha256_hashes, relative_file_path) != 0)
+         {
+            sha256_entries[sha256_number_of_entries].sha256 = pgmoneta_append(NULL, (char*)pgmoneta_art_search(sha256_hashes, relative_file_path));
+         }
+         else if (sha256_index != NULL)
+         {
+            char index_path[MAX_PATH];
 
-         buffer = pgmoneta_append(buffer, relative_file_path);
-         buffer = pgmoneta_append(buffer, ":");
-         buffer = pgmoneta_append(buffer, sha256);
-         buffer = pgmoneta_append(buffer, "\n");
+            memset(index_path, 0, sizeof(index_path));
+            snprintf(index_path, sizeof(index_path), "data%s", relative_file_path);
 
-         fputs(buffer, sha256_file);
+            sha256_entries[sha256_number_of_entries].sha256 = pgmoneta_sha256_index_lookup(sha256_index, index_path, absolute_file_path);
+         }
+
+         if (sha256_entries[sha256_number_of_entries].sha256 != NULL)
+         {
+            free(absolute_file_path);
+         }
+         else
+         {
+            sha256_jobs[sha256_number_of_jobs].path = absolute_file_path;
+            sha256_jobs[sha256_number_of_jobs].sha256 = NULL;
+            sha256_number_of_jobs++;
+         }
 
-         free(buffer);
-         free(sha256);
-         free(relative_file_path);
-         free(absolute_file_path);
+         sha256_number_of_entries++;
       }
    }
 
@@ -219,3 +292,139 @@ error:
 
    return 1;
 }
+
+static int
+write_backup_sha256(int server)
+{
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   char* buffer = NULL;
+   int job = 0;
+
+   if (sha256_number_of_jobs > 0)
+   {
+      number_of_workers = pgmoneta_get_number_of_workers(server);
+   }
+
+   if (number_of_workers > 0)
+   {
+      if (pgmoneta_workers_initialize(number_of_workers, &workers))
+      {
+         goto error;
+      }
+   }
+
+   // batches keep the small files of a directory together so they can share the hash lanes
+   for (int i = 0; i < sha256_number_of_jobs; i += SHA256_BATCH)
+   {
+      struct worker_input* wi = NULL;
+
+      if (pgmoneta_create_worker_input(NULL, NULL, NULL, 0, workers, &wi))
+      {
+         goto error;
+      }
+
+      wi->offset = i;
+      wi->length = MIN(SHA256_BATCH, sha256_number_of_jobs - i);
+
+      if (number_of_workers > 0)
+      {
+         pgmoneta_workers_add(workers, do_sha256, wi);
+      }
+      else
+      {
+         do_sha256(wi);
+      }
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
+   for (int i = 0; i < sha256_number_of_entries; i++)
+   {
+      if (sha256_entries[i].sha256 == NULL)
+      {
+         sha256_entries[i].sha256 = sha256_jobs[job].sha256;
+         sha256_jobs[job].sha256 = NULL;
+         job++;
+      }
+
+      if (sha256_entries[i].sha256 == NULL)
+      {
+         pgmoneta_log_error("SHA256: Unable to hash %s", sha256_entries[i].relative);
+         goto error;
+      }
+
+      buffer = NULL;
+      buffer = pgmoneta_append(buffer, sha256_entries[i].relative);
+      buffer = pgmoneta_append(buffer, ":");
+      buffer = pgmoneta_append(buffer, sha256_entries[i].sha256);
+      buffer = pgmoneta_append(buffer, "\n");
+
+      fputs(buffer, sha256_file);
+
+      free(buffer);
+   }
+
+   return 0;
+
+error:
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
+
+   return 1;
+}
+
+static void
+do_sha256(struct worker_input* wi)
+{
+   if (pgmoneta_sha256_files(&sha256_jobs[wi->offset], (int)wi->length))
+   {
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+
+   free(wi);
+}
+
+static void
+sha256_clear(void)
+{
+   for (int i = 0; i < sha256_number_of_entries; i++)
+   {
+      free(sha256_entries[i].relative);
+      free(sha256_entries[i].sha256);
+   }
+
+   for (int i = 0; i < sha256_number_of_jobs; i++)
+   {
+      free(sha256_jobs[i].path);
+      free(sha256_jobs[i].sha256);
+   }
+
+   free(sha256_entries);
+   free(sha256_jobs);
+
+   pgmoneta_art_destroy(sha256_index);
+   sha256_index = NULL;
+
+   sha256_entries = NULL;
+   sha256_number_of_entries = 0;
+   sha256_capacity = 0;
+   sha256_jobs = NULL;
+   sha256_number_of_jobs = 0;
+   sha256_file = NULL;
+}
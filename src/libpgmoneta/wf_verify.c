@@ -29,11 +29,16 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <catalog.h>
 #include <csv.h>
 #include <deque.h>
+#include <info.h>
+#include <io.h>
 #include <logging.h>
 #include <management.h>
+#include <manifest.h>
 #include <security.h>
+#include <streamer.h>
 #include <utils.h>
 #include <verify.h>
 #include <workers.h>
@@ -42,20 +47,76 @@
 /* system */
 #include <assert.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <openssl/evp.h>
+
+/** @struct verify_parent
+ * Defines a parent backup in the chain of an incremental backup
+ */
+struct verify_parent
+{
+   char* data;         /**< The data directory of the backup */
+   char* suffix;       /**< The suffix of the stored files */
+   struct art* files;  /**< The files of the manifest of the backup */
+};
+
+/** @struct verify_state
+ * Defines the state shared by the verify tasks of a backup
+ */
+struct verify_state
+{
+   int server;                     /**< The server */
+   bool stream;                    /**< Hash the files of the backup instead of a restore */
+   bool fail_fast;                 /**< Stop at the first failure */
+   atomic_bool aborted;            /**< Has a failure stopped the verification */
+   atomic_uint_fast64_t files;     /**< The number of verified files */
+   atomic_uint_fast64_t size;      /**< The number of verified bytes */
+   int number_of_parents;          /**< The number of parent backups of an incremental backup */
+   struct verify_parent* parents;  /**< The parent backups, newest first */
+   atomic_uint_fast64_t chained;   /**< The number of incremental files resolved through the chain */
+};
+
+/** @struct verify_digest
+ * Defines a digest of the data written to its stream
+ */
+struct verify_digest
+{
+   int algorithm;        /**< The hash algorithm */
+   EVP_MD_CTX* context;  /**< The message digest context */
+   uint32_t crc;         /**< The CRC32C checksum */
+   size_t size;          /**< The number of bytes hashed */
+   bool failed;          /**< Has the digest failed */
+   uint8_t* header;      /**< The start of the data is kept here, when it isn't NULL */
+   size_t header_size;   /**< The size of the header buffer */
+   size_t header_length; /**< The number of bytes kept */
+};
+
 static char* verify_name(void);
 static int verify_execute(char*, struct art*);
 
 static void do_verify(struct worker_input* wi);
+static void verify_source(char* data, char* name, char* suffix, char* path, size_t size);
+static int verify_stream_hash(int algorithm, char* from, uint8_t* header, size_t header_size, size_t* header_length, char** hash, size_t* size);
+static int verify_chain_load(int server, char* label, struct verify_state* state);
+static void verify_chain_destroy(struct verify_state* state);
+static int verify_chain(struct verify_state* state, char* path, uint8_t* header, size_t length);
+static int verify_chain_header(int server, uint8_t* header, size_t length, uint32_t* number_of_blocks);
+static int verify_chain_parent(int server, char* from, uint32_t* number_of_blocks);
+static ssize_t verify_digest_write(void* cookie, const char* buffer, size_t size);
+static int verify_digest_close(void* cookie);
 
 struct workflow*
 pgmoneta_create_verify(void)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -83,11 +144,23 @@ verify_execute(char* name, struct art* nodes)
    int server = -1;
    char* label = NULL;
    char* base = NULL;
+   char* directory = NULL;
+   char* suffix = NULL;
    char* info_file = NULL;
    char* manifest_file = NULL;
+   char* elapsed = NULL;
+   char* verified_size = NULL;
+   char* rate = NULL;
    int number_of_columns = 0;
    char** columns = NULL;
    int number_of_workers = 0;
+   uint64_t files = 0;
+   uint64_t size = 0;
+   uint64_t throughput = 0;
+   double total_seconds = 0;
+   struct timespec start_t;
+   struct timespec end_t;
+   struct verify_state state;
    struct backup* backup = NULL;
    struct deque* failed_deque = NULL;
    struct deque* all_deque = NULL;
@@ -107,11 +180,24 @@ verify_execute(char* name, struct art* nodes)
    free(a);
 #endif
 
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
    server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
    label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
 
    pgmoneta_log_debug("Verify (execute): %s/%s", config->servers[server].name, label);
 
+   memset(&state, 0, sizeof(struct verify_state));
+   atomic_init(&state.aborted, false);
+   atomic_init(&state.files, 0);
+   atomic_init(&state.size, 0);
+   atomic_init(&state.chained, 0);
+   state.server = server;
+
+   // without a restore the files are hashed straight from the backup
+   state.stream = !pgmoneta_art_contains_key(nodes, NODE_TARGET_BASE);
+   state.fail_fast = config->verify_fail_fast;
+
    base = pgmoneta_get_server_backup_identifier(server, (char*)pgmoneta_art_search(nodes, NODE_LABEL));
 
    info_file = pgmoneta_append(info_file, base);
@@ -130,14 +216,36 @@ verify_execute(char* name, struct art* nodes)
 
    pgmoneta_get_backup_file(info_file, &backup);
 
-   if (pgmoneta_deque_create(true, &failed_deque))
+   if (backup == NULL)
+   {
+      goto error;
+   }
+
+   if (state.stream)
+   {
+      directory = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
+      suffix = pgmoneta_streamer_suffix(backup->compression, backup->encryption);
+
+      // the manifest describes the incremental files as stored, so the chain is checked next to the hashes
+      if (backup->type == TYPE_INCREMENTAL && verify_chain_load(server, label, &state))
+      {
+         pgmoneta_log_error("Verify: The chain of %s/%s is broken", config->servers[server].name, label);
+         goto error;
+      }
+   }
+   else
+   {
+      directory = (char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE);
+   }
+
+   if (pgmoneta_deque_create_lock_free(0, &failed_deque))
    {
       goto error;
    }
 
    if (!strcasecmp((char*)pgmoneta_art_search(nodes, NODE_FILES), NODE_ALL))
    {
-      if (pgmoneta_deque_create(true, &all_deque))
+      if (pgmoneta_deque_create_lock_free(0, &all_deque))
       {
          goto error;
       }
@@ -146,7 +254,11 @@ verify_execute(char* name, struct art* nodes)
    number_of_workers = pgmoneta_get_number_of_workers(server);
    if (number_of_workers > 0)
    {
-      pgmoneta_workers_initialize(number_of_workers, &workers);
+      if (pgmoneta_workers_initialize(number_of_workers, &workers))
+      {
+         goto error;
+      }
+      pgmoneta_workers_plan(workers);
    }
 
    if (pgmoneta_csv_reader_init(manifest_file, &csv))
@@ -154,12 +266,40 @@ verify_execute(char* name, struct art* nodes)
       goto error;
    }
 
+   srandom((unsigned int)(start_t.tv_nsec ^ getpid()));
+
    while (pgmoneta_csv_next_row(csv, &number_of_columns, &columns))
    {
       struct worker_input* payload = NULL;
       struct json* j = NULL;
+      char path[MAX_PATH];
+
+      if (atomic_load(&state.aborted))
+      {
+         free(columns);
+         columns = NULL;
+         break;
+      }
+
+      // a new random sample every time, so repeated runs cover the whole backup
+      if (config->verify_sample < 100 && random() % 100 >= config->verify_sample)
+      {
+         free(columns);
+         columns = NULL;
+         continue;
+      }
+
+      memset(path, 0, sizeof(path));
+      if (state.stream)
+      {
+         verify_source(directory, columns[0], suffix, path, sizeof(path));
+      }
+      else
+      {
+         snprintf(path, sizeof(path), "%s/%s", directory, columns[0]);
+      }
 
-      if (pgmoneta_create_worker_input(NULL, NULL, NULL, -1, workers, &payload))
+      if (pgmoneta_create_worker_input(NULL, path, NULL, -1, workers, &payload))
       {
          goto error;
       }
@@ -169,7 +309,7 @@ verify_execute(char* name, struct art* nodes)
          goto error;
       }
 
-      pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_DIRECTORY, (uintptr_t)pgmoneta_art_search(nodes, NODE_TARGET_BASE), ValueString);
+      pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_DIRECTORY, (uintptr_t)directory, ValueString);
       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_FILENAME, (uintptr_t)columns[0], ValueString);
       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_ORIGINAL, (uintptr_t)columns[1], ValueString);
       pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_HASH_ALGORITHM, (uintptr_t)backup->hash_algorithm, ValueInt32);
@@ -177,6 +317,7 @@ verify_execute(char* name, struct art* nodes)
       payload->data = j;
       payload->failed = failed_deque;
       payload->all = all_deque;
+      payload->argument = &state;
 
       if (number_of_workers > 0)
       {
@@ -207,16 +348,47 @@ verify_execute(char* name, struct art* nodes)
    pgmoneta_deque_list(failed_deque);
    pgmoneta_deque_list(all_deque);
 
+   files = atomic_load(&state.files);
+   size = atomic_load(&state.size);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+   throughput = total_seconds > 0 ? (uint64_t)(size / total_seconds) : size;
+   verified_size = pgmoneta_translate_file_size(size);
+   rate = pgmoneta_translate_file_size(throughput);
+
+   pgmoneta_log_info("Verify: %s/%s %s %" PRIu64 " files (%s) in %s, %s/s%s",
+                     config->servers[server].name, label,
+                     state.stream ? "streamed" : "restored",
+                     files, verified_size, elapsed, rate,
+                     atomic_load(&state.aborted) ? ", stopped at the first failure" : "");
+
+   if (state.number_of_parents > 0)
+   {
+      pgmoneta_log_info("Verify: %s/%s %" PRIu64 " incremental files resolved through %d parent backups",
+                        config->servers[server].name, label, atomic_load(&state.chained), state.number_of_parents);
+   }
+
    pgmoneta_art_insert(nodes, NODE_FAILED, (uintptr_t)failed_deque, ValueDeque);
    pgmoneta_art_insert(nodes, NODE_ALL, (uintptr_t)all_deque, ValueDeque);
+   pgmoneta_art_insert(nodes, NODE_VERIFIED, (uintptr_t)files, ValueUInt64);
+   pgmoneta_art_insert(nodes, NODE_VERIFIED_SIZE, (uintptr_t)size, ValueUInt64);
+   pgmoneta_art_insert(nodes, NODE_THROUGHPUT, (uintptr_t)throughput, ValueUInt64);
 
    pgmoneta_csv_reader_destroy(csv);
 
+   verify_chain_destroy(&state);
+
    free(backup);
 
    free(base);
+   free(suffix);
    free(info_file);
    free(manifest_file);
+   free(elapsed);
+   free(verified_size);
+   free(rate);
 
    return 0;
 
@@ -235,11 +407,17 @@ error:
 
    pgmoneta_csv_reader_destroy(csv);
 
+   verify_chain_destroy(&state);
+
    free(backup);
 
    free(base);
+   free(suffix);
    free(info_file);
    free(manifest_file);
+   free(elapsed);
+   free(verified_size);
+   free(rate);
 
    return 1;
 }
@@ -247,101 +425,87 @@ error:
 static void
 do_verify(struct worker_input* wi)
 {
-   char* f = NULL;
    char* hash_cal = NULL;
+   char* filename = NULL;
+   char* bare = NULL;
    bool failed = false;
    int ha = 0;
+   size_t size = 0;
+   uint8_t* header = NULL;
+   size_t header_size = 0;
+   size_t header_length = 0;
    struct json* j = NULL;
+   struct verify_state* state = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    j = wi->data;
+   state = (struct verify_state*)wi->argument;
 
-   f = pgmoneta_append(f, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_DIRECTORY));
-   if (!pgmoneta_ends_with(f, "/"))
+   if (atomic_load(&state->aborted))
    {
-      f = pgmoneta_append(f, "/");
+      pgmoneta_json_destroy(j);
+      goto done;
    }
-   f = pgmoneta_append(f, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_FILENAME));
 
-   if (!pgmoneta_exists(f))
+   if (!pgmoneta_exists(wi->from))
    {
       goto error;
    }
 
    ha = (int)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_HASH_ALGORITHM);
-   if (ha == HASH_ALGORITHM_SHA256)
+
+   if (state->stream)
    {
-      if (!pgmoneta_create_sha256_file(f, &hash_cal))
+      filename = (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_FILENAME);
+      bare = strrchr(filename, '/');
+
+      // the header of an incremental file is kept while it is hashed, so the file is only read once
+      if (state->number_of_parents > 0 && bare != NULL && pgmoneta_starts_with(bare + 1, INCREMENTAL_PREFIX))
       {
-         if (strcmp(hash_cal, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_ORIGINAL)))
+         header_size = sizeof(uint32_t) * (3 + config->servers[state->server].relseg_size);
+         header = (uint8_t*)malloc(header_size);
+         if (header == NULL)
          {
-            failed = true;
+            goto error;
          }
       }
-      else
+
+      if (verify_stream_hash(ha, wi->from, header, header_size, &header_length, &hash_cal, &size))
       {
          failed = true;
       }
    }
-   else if (ha == HASH_ALGORITHM_SHA384)
+   else
    {
-      if (!pgmoneta_create_sha384_file(f, &hash_cal))
-      {
-         if (strcmp(hash_cal, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_ORIGINAL)))
-         {
-            failed = true;
-         }
-      }
-      else
+      if (pgmoneta_create_file_hash(ha, wi->from, &hash_cal))
       {
          failed = true;
       }
+      size = pgmoneta_get_file_size(wi->from);
    }
-   else if (ha == HASH_ALGORITHM_SHA512)
+
+   if (!failed && strcmp(hash_cal, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_ORIGINAL)))
    {
-      if (!pgmoneta_create_sha512_file(f, &hash_cal))
-      {
-         if (strcmp(hash_cal, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_ORIGINAL)))
-         {
-            failed = true;
-         }
-      }
-      else
-      {
-         failed = true;
-      }
+      failed = true;
    }
-   else if (ha == HASH_ALGORITHM_SHA224)
+
+   if (!failed && header != NULL)
    {
-      if (!pgmoneta_create_sha224_file(f, &hash_cal))
-      {
-         if (strcmp(hash_cal, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_ORIGINAL)))
-         {
-            failed = true;
-         }
-      }
-      else
+      if (verify_chain(state, filename, header, header_length))
       {
+         pgmoneta_log_error("Verify: %s can't be reconstructed from the parent backups", filename);
          failed = true;
       }
-   }
-   else if (ha == HASH_ALGORITHM_CRC32C)
-   {
-      if (!pgmoneta_create_crc32c_file(f, &hash_cal))
-      {
-         if (strcmp(hash_cal, (char*)pgmoneta_json_get(j, MANAGEMENT_ARGUMENT_ORIGINAL)))
-         {
-            failed = true;
-         }
-      }
       else
       {
-         failed = true;
+         atomic_fetch_add(&state->chained, 1);
       }
    }
-   else
-   {
-      goto error;
-   }
+
+   atomic_fetch_add(&state->files, 1);
+   atomic_fetch_add(&state->size, size);
 
    if (failed)
    {
@@ -351,33 +515,39 @@ do_verify(struct worker_input* wi)
       }
       else
       {
-         failed = true;
          pgmoneta_json_put(j, MANAGEMENT_ARGUMENT_CALCULATED, (uintptr_t)"Unknown", ValueString);
       }
 
-      pgmoneta_deque_add(wi->failed, f, (uintptr_t)j, ValueJSON);
+      pgmoneta_deque_add(wi->failed, wi->from, (uintptr_t)j, ValueJSON);
+
+      if (state->fail_fast)
+      {
+         atomic_store(&state->aborted, true);
+      }
    }
    else if (wi->all != NULL)
    {
-      pgmoneta_deque_add(wi->all, f, (uintptr_t)j, ValueJSON);
+      pgmoneta_deque_add(wi->all, wi->from, (uintptr_t)j, ValueJSON);
    }
    else
    {
       pgmoneta_json_destroy(j);
    }
 
+done:
+
    wi->data = NULL;
    wi->failed = NULL;
    wi->all = NULL;
 
+   free(header);
    free(hash_cal);
-   free(f);
    free(wi);
 
    return;
 
 error:
-   pgmoneta_log_error("Unable to calculate hash for %s", f);
+   pgmoneta_log_error("Unable to calculate hash for %s", wi->from);
 
    pgmoneta_json_destroy(wi->data);
 
@@ -385,7 +555,460 @@ error:
    wi->failed = NULL;
    wi->all = NULL;
 
+   free(header);
    free(hash_cal);
-   free(f);
    free(wi);
 }
+
+static void
+verify_source(char* data, char* name, char* suffix, char* path, size_t size)
+{
+   snprintf(path, size, "%s%s%s%s", data, pgmoneta_ends_with(data, "/") ? "" : "/", name, suffix);
+
+   // files that were stored as is, f.ex. the ones too small to compress
+   if (!pgmoneta_exists(path))
+   {
+      snprintf(path, size, "%s%s%s", data, pgmoneta_ends_with(data, "/") ? "" : "/", name);
+   }
+}
+
+static int
+verify_stream_hash(int algorithm, char* from, uint8_t* header, size_t header_size, size_t* header_length, char** hash, size_t* size)
+{
+   unsigned char md_value[EVP_MAX_MD_SIZE];
+   unsigned int md_len = 0;
+   char* result = NULL;
+   FILE* stream = NULL;
+   const EVP_MD* md = NULL;
+   struct verify_digest digest;
+   cookie_io_functions_t functions = {
+      .read = NULL,
+      .write = &verify_digest_write,
+      .seek = NULL,
+      .close = &verify_digest_close
+   };
+
+   *hash = NULL;
+   *size = 0;
+   *header_length = 0;
+
+   memset(&digest, 0, sizeof(struct verify_digest));
+   digest.algorithm = algorithm;
+   digest.header = header;
+   digest.header_size = header_size;
+
+   switch (algorithm)
+   {
+      case HASH_ALGORITHM_CRC32C:
+         break;
+      case HASH_ALGORITHM_SHA224:
+         md = EVP_sha224();
+         break;
+      case HASH_ALGORITHM_DEFAULT:
+      case HASH_ALGORITHM_SHA256:
+         md = EVP_sha256();
+         break;
+      case HASH_ALGORITHM_SHA384:
+         md = EVP_sha384();
+         break;
+      case HASH_ALGORITHM_SHA512:
+         md = EVP_sha512();
+         break;
+      default:
+         pgmoneta_log_error("Unrecognized hash algorithm: %d", algorithm);
+         goto error;
+   }
+
+   if (md != NULL)
+   {
+      digest.context = EVP_MD_CTX_new();
+      if (digest.context == NULL || !EVP_DigestInit_ex(digest.context, md, NULL))
+      {
+         pgmoneta_log_error("Message digest initialization failed");
+         goto error;
+      }
+   }
+
+   stream = fopencookie(&digest, "w", functions);
+   if (stream == NULL)
+   {
+      goto error;
+   }
+
+   // the decoded data is hashed in large blocks and never reaches the disk
+   setvbuf(stream, NULL, _IOFBF, IO_BUFFER_SIZE);
+
+   if (pgmoneta_destreamer_stream(from, stream))
+   {
+      goto error;
+   }
+
+   if (fclose(stream) != 0)
+   {
+      stream = NULL;
+      goto error;
+   }
+   stream = NULL;
+
+   if (digest.failed)
+   {
+      goto error;
+   }
+
+   if (md != NULL)
+   {
+      if (!EVP_DigestFinal_ex(digest.context, md_value, &md_len))
+      {
+         pgmoneta_log_error("Message digest finalization failed");
+         goto error;
+      }
+
+      result = (char*)malloc(md_len * 2 + 1);
+      if (result == NULL)
+      {
+         goto error;
+      }
+
+      for (unsigned int i = 0; i < md_len; i++)
+      {
+         sprintf(&result[i * 2], "%02x", md_value[i]);
+      }
+      result[md_len * 2] = '\0';
+   }
+   else
+   {
+      result = (char*)malloc(9);
+      if (result == NULL)
+      {
+         goto error;
+      }
+
+      sprintf(result, "%08x", digest.crc);
+   }
+
+   EVP_MD_CTX_free(digest.context);
+
+   *hash = result;
+   *size = digest.size;
+   *header_length = digest.header_length;
+
+   return 0;
+
+error:
+
+   if (stream != NULL)
+   {
+      fclose(stream);
+   }
+
+   EVP_MD_CTX_free(digest.context);
+
+   free(result);
+
+   return 1;
+}
+
+static ssize_t
+verify_digest_write(void* cookie, const char* buffer, size_t size)
+{
+   struct verify_digest* digest = (struct verify_digest*)cookie;
+   size_t n = 0;
+
+   if (digest->header != NULL && digest->header_length < digest->header_size)
+   {
+      n = MIN(size, digest->header_size - digest->header_length);
+      memcpy(digest->header + digest->header_length, buffer, n);
+      digest->header_length += n;
+   }
+
+   if (digest->context != NULL)
+   {
+      if (!EVP_DigestUpdate(digest->context, buffer, size))
+      {
+         digest->failed = true;
+         return 0;
+      }
+   }
+   else
+   {
+      pgmoneta_create_crc32c_buffer((void*)buffer, size, &digest->crc);
+   }
+
+   digest->size += size;
+
+   return size;
+}
+
+static int
+verify_digest_close(void* cookie)
+{
+   return 0;
+}
+
+static int
+verify_chain_load(int server, char* label, struct verify_state* state)
+{
+   char* d = NULL;
+   char* manifest = NULL;
+   int index = -1;
+   int* chain = NULL;
+   int length = 0;
+   int number_of_backups = 0;
+   int number_of_files = 0;
+   struct backup** backups = NULL;
+   struct manifest_listing* files = NULL;
+   struct verify_parent* parent = NULL;
+
+   d = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_backups(d, &number_of_backups, &backups))
+   {
+      goto error;
+   }
+
+   index = pgmoneta_catalog_search(number_of_backups, backups, label);
+   if (index == -1 || strcmp(backups[index]->label, label))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_catalog_chain(number_of_backups, backups, index, &chain, &length))
+   {
+      goto error;
+   }
+
+   state->parents = (struct verify_parent*)calloc(length, sizeof(struct verify_parent));
+   if (state->parents == NULL)
+   {
+      goto error;
+   }
+
+   // only the manifests of the parents are read, the files are looked up in them
+   for (int i = 1; i < length; i++)
+   {
+      parent = &state->parents[state->number_of_parents++];
+
+      parent->data = pgmoneta_get_server_backup_identifier_data(server, backups[chain[i]]->label);
+      parent->suffix = pgmoneta_streamer_suffix(backups[chain[i]]->compression, backups[chain[i]]->encryption);
+
+      if (pgmoneta_art_create(&parent->files))
+      {
+         goto error;
+      }
+
+      manifest = pgmoneta_get_server_backup_identifier(server, backups[chain[i]]->label);
+      manifest = pgmoneta_append(manifest, "backup.manifest");
+
+      if (pgmoneta_manifest_files(manifest, false, &files, &number_of_files))
+      {
+         pgmoneta_log_error("Verify: Could not read %s", manifest);
+         goto error;
+      }
+
+      for (int f = 0; f < number_of_files; f++)
+      {
+         pgmoneta_art_insert(parent->files, files[f].path, (uintptr_t)files[f].size, ValueInt64);
+      }
+
+      pgmoneta_manifest_files_destroy(files, number_of_files);
+      files = NULL;
+      number_of_files = 0;
+
+      free(manifest);
+      manifest = NULL;
+   }
+
+   free(chain);
+   free(d);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   return 0;
+
+error:
+
+   free(manifest);
+   free(chain);
+   free(d);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   return 1;
+}
+
+static void
+verify_chain_destroy(struct verify_state* state)
+{
+   for (int i = 0; i < state->number_of_parents; i++)
+   {
+      free(state->parents[i].data);
+      free(state->parents[i].suffix);
+      pgmoneta_art_destroy(state->parents[i].files);
+   }
+   free(state->parents);
+
+   state->parents = NULL;
+   state->number_of_parents = 0;
+}
+
+static int
+verify_chain(struct verify_state* state, char* path, uint8_t* header, size_t length)
+{
+   char relative[MAX_PATH];
+   char source[MAX_PATH];
+   char* bare = NULL;
+   uint32_t number_of_blocks = 0;
+
+   if (verify_chain_header(state->server, header, length, &number_of_blocks))
+   {
+      pgmoneta_log_error("Verify: Invalid incremental header in %s", path);
+      goto error;
+   }
+
+   // the relation file that the incremental file is reconstructed into
+   bare = strrchr(path, '/');
+   memset(relative, 0, sizeof(relative));
+   snprintf(relative, sizeof(relative), "%.*s%s", (int)(bare + 1 - path), path, bare + 1 + INCREMENTAL_PREFIX_LENGTH);
+
+   // like the reconstruction, walk back until a full copy of the file is found. The blocks
+   // of each incremental file are taken from its header, so no data blocks are read
+   for (int i = 0; i < state->number_of_parents; i++)
+   {
+      struct verify_parent* parent = &state->parents[i];
+
+      if (pgmoneta_art_contains_key(parent->files, relative))
+      {
+         return 0;
+      }
+
+      if (!pgmoneta_art_contains_key(parent->files, path))
+      {
+         pgmoneta_log_error("Verify: Neither %s nor %s is in %s", relative, path, parent->data);
+         goto error;
+      }
+
+      memset(source, 0, sizeof(source));
+      verify_source(parent->data, path, parent->suffix, source, sizeof(source));
+
+      if (verify_chain_parent(state->server, source, &number_of_blocks))
+      {
+         pgmoneta_log_error("Verify: Invalid incremental header in %s", source);
+         goto error;
+      }
+   }
+
+   pgmoneta_log_error("Verify: No full copy of %s in the chain", relative);
+
+error:
+
+   return 1;
+}
+
+static int
+verify_chain_header(int server, uint8_t* header, size_t length, uint32_t* number_of_blocks)
+{
+   uint32_t fields[3];
+   uint32_t block = 0;
+   size_t relsegsz = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   relsegsz = config->servers[server].relseg_size;
+
+   *number_of_blocks = 0;
+
+   if (length < sizeof(fields))
+   {
+      return 1;
+   }
+
+   // magic, number of blocks and truncation block length
+   memcpy(&fields[0], header, sizeof(fields));
+
+   if (fields[0] != INCREMENTAL_MAGIC || fields[1] > relsegsz || fields[2] > relsegsz)
+   {
+      return 1;
+   }
+
+   *number_of_blocks = fields[1];
+
+   if (length < sizeof(fields) + fields[1] * sizeof(uint32_t))
+   {
+      return 1;
+   }
+
+   for (uint32_t i = 0; i < fields[1]; i++)
+   {
+      memcpy(&block, header + sizeof(fields) + i * sizeof(uint32_t), sizeof(uint32_t));
+      if (block >= relsegsz)
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static int
+verify_chain_parent(int server, char* from, uint32_t* number_of_blocks)
+{
+   char* header = NULL;
+   size_t length = 0;
+   size_t needed = sizeof(uint32_t) * 3;
+   FILE* out = NULL;
+   int ret = 1;
+
+   // the block count is in the first fields, so a second pass is only needed for a longer block list
+   for (int pass = 0; pass < 2; pass++)
+   {
+      out = open_memstream(&header, &length);
+      if (out == NULL)
+      {
+         goto error;
+      }
+
+      if (pgmoneta_destreamer_head(from, needed, out))
+      {
+         goto error;
+      }
+
+      fclose(out);
+      out = NULL;
+
+      ret = verify_chain_header(server, (uint8_t*)header, length, number_of_blocks);
+
+      if (ret == 0 || length >= sizeof(uint32_t) * (3 + *number_of_blocks) || *number_of_blocks == 0)
+      {
+         break;
+      }
+
+      needed = sizeof(uint32_t) * (3 + *number_of_blocks);
+
+      free(header);
+      header = NULL;
+      length = 0;
+   }
+
+   free(header);
+
+   return ret;
+
+error:
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+   free(header);
+
+   return 1;
+}
@@ -29,6 +29,8 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <art.h>
+#include <compression.h>
+#include <info.h>
 #include <logging.h>
 #include <utils.h>
 #include <zstandard_compression.h>
@@ -49,7 +51,7 @@ pgmoneta_create_zstd(bool compress)
 {
    struct workflow* wf = NULL;
 
-   wf = (struct workflow*)malloc(sizeof(struct workflow));
+   wf = (struct workflow*)calloc(1, sizeof(struct workflow));
 
    if (wf == NULL)
    {
@@ -91,12 +93,14 @@ zstd_execute_compress(char* name, struct art* nodes)
    char* d = NULL;
    char* backup_base = NULL;
    char* backup_data = NULL;
+   char* manifest = NULL;
    char* tarfile = NULL;
    int hours;
    int minutes;
    double seconds;
    char elapsed[128];
    int number_of_workers = 0;
+   uint32_t dictionary = 0;
    struct workers* workers = NULL;
    struct configuration* config;
 
@@ -126,13 +130,41 @@ zstd_execute_compress(char* name, struct art* nodes)
       number_of_workers = pgmoneta_get_number_of_workers(server);
       if (number_of_workers > 0)
       {
-         pgmoneta_workers_initialize(number_of_workers, &workers);
+         if (pgmoneta_workers_initialize(number_of_workers, &workers) == 0)
+         {
+            pgmoneta_workers_plan(workers);
+         }
       }
 
       backup_base = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_BASE);
       backup_data = (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
 
-      pgmoneta_zstandardc_data(backup_data, workers);
+      manifest = pgmoneta_append(manifest, backup_base);
+      if (!pgmoneta_ends_with(manifest, "/"))
+      {
+         manifest = pgmoneta_append(manifest, "/");
+      }
+      manifest = pgmoneta_append(manifest, "backup.manifest");
+
+      if (config->compression_dictionary)
+      {
+         if (pgmoneta_zstandard_dictionary_train(server, backup_data, &dictionary) ||
+             pgmoneta_zstandard_dictionary_use(server, dictionary))
+         {
+            pgmoneta_log_warn("ZSTD: No dictionary for %s/%s", config->servers[server].name, label);
+            pgmoneta_zstandard_dictionary_use(server, 0);
+            dictionary = 0;
+         }
+
+         pgmoneta_update_info_unsigned_long(backup_base, INFO_DICTIONARY, dictionary);
+      }
+
+      if (config->compression_adaptive)
+      {
+         pgmoneta_compression_adaptive_start(server, 1, 19, MAX(1, MIN(19, config->compression_level)));
+      }
+
+      pgmoneta_zstandardc_data(backup_data, manifest, workers);
       pgmoneta_zstandardc_tablespaces(backup_base, workers);
 
       if (number_of_workers > 0)
@@ -144,6 +176,8 @@ zstd_execute_compress(char* name, struct art* nodes)
          }
          pgmoneta_workers_destroy(workers);
       }
+
+      pgmoneta_compression_adaptive_stop();
    }
    else
    {
@@ -176,17 +210,21 @@ zstd_execute_compress(char* name, struct art* nodes)
    pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_ZSTD_ELAPSED, compression_zstd_elapsed_time);
 
    free(d);
+   free(manifest);
 
    return 0;
 
 error:
 
+   pgmoneta_compression_adaptive_stop();
+
    if (number_of_workers > 0)
    {
       pgmoneta_workers_destroy(workers);
    }
 
    free(d);
+   free(manifest);
 
    return 1;
 }
@@ -27,67 +27,113 @@
  */
 
 #include <pgmoneta.h>
+#include <arena.h>
 #include <logging.h>
+#include <memory.h>
+#include <probes.h>
+#include <prometheus.h>
+#include <scheduler.h>
+#include <trace.h>
+#include <utils.h>
 #include <workers.h>
 
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #ifdef HAVE_LINUX
 #include <sys/sysinfo.h>
 #endif
 
-static volatile int worker_keepalive;
+static _Thread_local struct worker* worker_self = NULL;
+static _Thread_local struct worker_cache thread_cache;
 
-static int worker_init(struct workers* workers, struct worker** worker);
+static int worker_init(struct workers* workers, int index, struct worker** worker);
 static void* worker_do(struct worker* worker);
+static struct task* worker_steal(struct worker* worker);
 static void worker_destroy(struct worker* worker);
 
 static int queue_init(struct queue* queue);
 static void queue_clear(struct queue* queue);
-static void queue_push(struct queue* queue, struct task* task);
-static struct task* queue_pull(struct queue* queue);
+static int queue_grow(struct queue* queue);
+static int queue_push(struct queue* queue, struct task* task);
+static int queue_defer(struct queue* queue, struct task* task);
+static struct task* queue_pop(struct queue* queue);
+static struct task* queue_steal(struct queue* queue);
 static void queue_destroy(struct queue* queue);
 
-static int semaphore_init(struct semaphore* semaphore, int value);
-static void semaphore_reset(struct semaphore* semaphore);
-static void semaphore_post(struct semaphore* semaphore);
-static void semaphore_post_all(struct semaphore* semaphore);
-static void semaphore_wait(struct semaphore* semaphore);
+static struct worker_cache* cache_get(void);
+
+static int plan_compare(const void* a, const void* b);
+static void plan_schedule(struct workers* workers);
+
+static char* worker_intern(struct workers* workers, char* directory);
+
+static int device_index(struct workers* workers, dev_t device);
+static bool device_acquire(struct workers* workers, struct task* task);
+static void device_release(struct workers* workers, struct task* task);
+
+static void worker_scale(struct workers* workers, double wall, double cpu, size_t size);
 
 int
 pgmoneta_workers_initialize(int num, struct workers** workers)
 {
+   int slots = 0;
+   int units = 0;
    struct workers* w = NULL;
+   struct configuration* config;
 
-   *workers = NULL;
+   config = (struct configuration*)shmem;
 
-   worker_keepalive = 1;
+   *workers = NULL;
 
    if (num < 1)
    {
       goto error;
    }
 
-   w = (struct workers*)malloc(sizeof(struct workers));
-   if (w == NULL)
+   // the workers of all running workflows share the CPUs
+   if (pgmoneta_scheduler_acquire(SCHEDULER_WORKERS, num, &slots))
    {
-      pgmoneta_log_error("Could not allocate memory for worker pool");
       goto error;
    }
+   num = MAX(MIN(num, slots), 1);
 
-   w->number_of_alive = 0;
-   w->number_of_working = 0;
-   w->outcome = true;
+   // with memory_budget used up there is still a single worker
+   units = pgmoneta_memory_acquire(WORKER_MEMORY, num);
+   if (units == 0)
+   {
+      pgmoneta_memory_account(WORKER_MEMORY);
+      units = 1;
+   }
+   num = units;
 
-   if (queue_init(&w->queue))
+   w = (struct workers*)calloc(1, sizeof(struct workers));
+   if (w == NULL)
    {
-      pgmoneta_log_error("Could not allocate memory for queue");
+      pgmoneta_log_error("Could not allocate memory for worker pool");
       goto error;
    }
 
-   w->worker = (struct worker**)malloc(num * sizeof(struct worker*));
+   w->slots = slots;
+   w->memory = (size_t)units * WORKER_MEMORY;
+   w->device_limit = config != NULL ? config->workers_per_device : 0;
+
+   w->keepalive = true;
+   w->number_of_alive = 0;
+   w->number_of_working = 0;
+   w->outcome = true;
+   atomic_init(&w->number_of_tasks, 0);
+   atomic_init(&w->number_of_pending, 0);
+   atomic_init(&w->number_of_sleeping, 0);
+   atomic_init(&w->next, 0);
+   atomic_init(&w->active, num);
+   w->autoscale = config != NULL && config->workers_autoscale && num > 1;
+   w->scale_direction = -1;
+
+   w->worker = (struct worker**)calloc(num, sizeof(struct worker*));
    if (w->worker == NULL)
    {
       pgmoneta_log_error("Could not allocate memory for workers");
@@ -96,26 +142,53 @@ pgmoneta_workers_initialize(int num, struct workers** workers)
 
    pthread_mutex_init(&(w->worker_lock), NULL);
    pthread_cond_init(&w->worker_all_idle, NULL);
+   pthread_cond_init(&w->has_tasks, NULL);
+   pthread_mutex_init(&w->intern_lock, NULL);
+   pthread_mutex_init(&w->device_lock, NULL);
+   pthread_cond_init(&w->scaled, NULL);
+   pthread_mutex_init(&w->scale_lock, NULL);
+
+   // without an arena the directories are copied into the inputs
+   if (pgmoneta_arena_create(0, true, &w->arena))
+   {
+      w->arena = NULL;
+   }
 
    for (int n = 0; n < num; n++)
    {
-      worker_init(w, &w->worker[n]);
+      if (worker_init(w, n, &w->worker[n]))
+      {
+         break;
+      }
+      w->number_of_workers++;
+   }
+
+   if (w->number_of_workers == 0)
+   {
+      goto error;
    }
 
-   while (w->number_of_alive != num)
+   while (w->number_of_alive != w->number_of_workers)
    {
       SLEEP(10);
    }
 
+   atomic_store(&w->active, w->number_of_workers);
+   clock_gettime(CLOCK_MONOTONIC_RAW, &w->scale_start);
+
    *workers = w;
 
    return 0;
 
 error:
 
+   pgmoneta_scheduler_release(SCHEDULER_WORKERS, slots);
+   pgmoneta_memory_release((size_t)units * WORKER_MEMORY);
+
    if (w != NULL)
    {
-      queue_destroy(&w->queue);
+      pgmoneta_arena_destroy(w->arena);
+      free(w->worker);
       free(w);
    }
 
@@ -126,6 +199,7 @@ int
 pgmoneta_workers_add(struct workers* workers, void (*function)(struct worker_input*), struct worker_input* wi)
 {
    struct task* t = NULL;
+   struct worker* target = NULL;
 
    if (workers != NULL)
    {
@@ -138,8 +212,81 @@ pgmoneta_workers_add(struct workers* workers, void (*function)(struct worker_inp
 
       t->function = function;
       t->wi = wi;
+      t->size = 0;
+      t->device = -1;
+      clock_gettime(CLOCK_MONOTONIC_RAW, &t->queued);
+
+      if (wi != NULL)
+      {
+         struct stat st;
+
+         if (((workers->planning && wi->length == 0) || workers->device_limit > 0 || workers->autoscale) &&
+             strlen(wi->from) > 0 && stat(wi->from, &st) == 0)
+         {
+            t->size = st.st_size;
+
+            if (workers->device_limit > 0)
+            {
+               t->device = device_index(workers, st.st_dev);
+            }
+         }
+
+         if (wi->length > 0)
+         {
+            t->size = wi->length;
+         }
+      }
+
+      // keep the work of a worker local to it, spread the rest
+      if (worker_self != NULL && worker_self->workers == workers)
+      {
+         target = worker_self;
+      }
+      else if (workers->planning)
+      {
+         if (workers->plan_size == workers->plan_capacity)
+         {
+            int capacity = workers->plan_capacity > 0 ? 2 * workers->plan_capacity : 256;
+            struct task** plan = (struct task**)realloc(workers->plan, capacity * sizeof(struct task*));
+
+            if (plan == NULL)
+            {
+               free(t);
+               goto error;
+            }
+
+            workers->plan = plan;
+            workers->plan_capacity = capacity;
+         }
+
+         atomic_fetch_add(&workers->number_of_pending, 1);
+         workers->plan[workers->plan_size++] = t;
+
+         return 0;
+      }
+      else
+      {
+         target = workers->worker[atomic_fetch_add(&workers->next, 1) % workers->number_of_workers];
+      }
+
+      atomic_fetch_add(&workers->number_of_pending, 1);
+      atomic_fetch_add(&workers->number_of_tasks, 1);
+
+      if (queue_push(&target->queue, t))
+      {
+         atomic_fetch_sub(&workers->number_of_tasks, 1);
+         atomic_fetch_sub(&workers->number_of_pending, 1);
+         free(t);
+         goto error;
+      }
 
-      queue_push(&workers->queue, t);
+      // only take the pool lock when somebody is waiting for work
+      if (atomic_load(&workers->number_of_sleeping) > 0)
+      {
+         pthread_mutex_lock(&workers->worker_lock);
+         pthread_cond_signal(&workers->has_tasks);
+         pthread_mutex_unlock(&workers->worker_lock);
+      }
 
       return 0;
    }
@@ -149,14 +296,28 @@ error:
    return 1;
 }
 
+void
+pgmoneta_workers_plan(struct workers* workers)
+{
+   if (workers != NULL)
+   {
+      workers->planning = true;
+   }
+}
+
 void
 pgmoneta_workers_wait(struct workers* workers)
 {
    if (workers != NULL)
    {
+      if (workers->planning)
+      {
+         plan_schedule(workers);
+      }
+
       pthread_mutex_lock(&workers->worker_lock);
 
-      while (workers->queue.number_of_tasks || workers->number_of_working)
+      while (atomic_load(&workers->number_of_pending) > 0)
       {
          pthread_cond_wait(&workers->worker_all_idle, &workers->worker_lock);
       }
@@ -168,37 +329,51 @@ pgmoneta_workers_wait(struct workers* workers)
 void
 pgmoneta_workers_destroy(struct workers* workers)
 {
-   volatile int worker_total;
-   double timeout = 1.0;
-   time_t start;
-   time_t end;
-   double tpassed = 0.0;
-
    if (workers != NULL)
    {
-      worker_total = workers->number_of_alive;
-      worker_keepalive = 0;
+      pthread_mutex_lock(&workers->worker_lock);
+      workers->keepalive = false;
+      pthread_cond_broadcast(&workers->has_tasks);
+      pthread_cond_broadcast(&workers->scaled);
+      pthread_mutex_unlock(&workers->worker_lock);
 
-      time (&start);
-      while (tpassed < timeout && workers->number_of_alive)
+      while (workers->number_of_alive)
       {
-         semaphore_post_all(workers->queue.has_tasks);
-         time(&end);
-         tpassed = difftime(end, start);
+         pthread_mutex_lock(&workers->worker_lock);
+         pthread_cond_broadcast(&workers->has_tasks);
+         pthread_cond_broadcast(&workers->scaled);
+         pthread_mutex_unlock(&workers->worker_lock);
+         SLEEP(1000000L);
       }
 
-      while (workers->number_of_alive)
+      for (int n = 0; n < workers->number_of_workers; n++)
       {
-         semaphore_post_all(workers->queue.has_tasks);
-         SLEEP(1000000000L);
-      }
+         struct worker* w = workers->worker[n];
 
-      queue_destroy(&workers->queue);
+         pgmoneta_log_debug("Worker %d: %d tasks, busy %.3fs, idle %.3fs, queue wait %.3fs",
+                            w->index, w->tasks, w->busy, w->idle, w->queue_wait);
+         worker_destroy(w);
+      }
 
-      for (int n = 0; n < worker_total; n++)
+      for (int i = 0; i < workers->plan_size; i++)
       {
-         worker_destroy(workers->worker[n]);
+         free(workers->plan[i]->wi);
+         free(workers->plan[i]);
       }
+      free(workers->plan);
+
+      pthread_cond_destroy(&workers->has_tasks);
+      pthread_cond_destroy(&workers->worker_all_idle);
+      pthread_mutex_destroy(&workers->worker_lock);
+      pthread_mutex_destroy(&workers->intern_lock);
+      pthread_mutex_destroy(&workers->device_lock);
+      pthread_cond_destroy(&workers->scaled);
+      pthread_mutex_destroy(&workers->scale_lock);
+
+      pgmoneta_arena_destroy(workers->arena);
+
+      pgmoneta_scheduler_release(SCHEDULER_WORKERS, workers->slots);
+      pgmoneta_memory_release(workers->memory);
 
       free(workers->worker);
       free(workers);
@@ -235,32 +410,66 @@ int
 pgmoneta_create_worker_input(char* directory, char* from, char* to, int level,
                              struct workers* workers, struct worker_input** wi)
 {
+   size_t directory_length;
+   size_t from_length;
+   size_t to_length;
+   char* interned = NULL;
+   char* p = NULL;
    struct worker_input* w = NULL;
 
    *wi = NULL;
 
-   w = (struct worker_input*)malloc(sizeof(struct worker_input));
+   directory_length = directory != NULL ? strlen(directory) : 0;
+   from_length = from != NULL ? strlen(from) : 0;
+   to_length = to != NULL ? strlen(to) : 0;
+
+   if (directory_length >= MAX_PATH || from_length >= MAX_PATH || to_length >= MAX_PATH)
+   {
+      pgmoneta_log_error("Path too long for a worker: %s", from != NULL ? from : "");
+      goto error;
+   }
+
+   // the files of a directory are submitted together, so they share one copy of it
+   if (workers != NULL && workers->arena != NULL)
+   {
+      interned = worker_intern(workers, directory != NULL ? directory : "");
+   }
+
+   w = (struct worker_input*)calloc(1, sizeof(struct worker_input) + from_length + to_length + 2 +
+                                    (interned == NULL ? directory_length + 1 : 0));
 
    if (w == NULL)
    {
       goto error;
    }
 
-   memset(w, 0, sizeof(struct worker_input));
+   p = (char*)(w + 1);
 
-   if (directory != NULL && strlen(directory) > 0)
+   w->from = p;
+   if (from_length > 0)
    {
-      memcpy(w->directory, directory, strlen(directory));
+      memcpy(w->from, from, from_length);
    }
+   p += from_length + 1;
 
-   if (from != NULL && strlen(from) > 0)
+   w->to = p;
+   if (to_length > 0)
    {
-      memcpy(w->from, from, strlen(from));
+      memcpy(w->to, to, to_length);
    }
+   p += to_length + 1;
 
-   if (to != NULL && strlen(to) > 0)
+   if (interned != NULL)
+   {
+      w->directory = interned;
+   }
+   else
    {
-      memcpy(w->to, to, strlen(to));
+      w->directory = p;
+      if (directory_length > 0)
+      {
+         memcpy(w->directory, directory, directory_length);
+      }
    }
 
    w->level = level;
@@ -278,8 +487,87 @@ error:
    return 1;
 }
 
+void*
+pgmoneta_worker_context(int type)
+{
+   if (type < 0 || type >= WORKER_CONTEXTS)
+   {
+      return NULL;
+   }
+
+   return cache_get()->contexts[type];
+}
+
+void
+pgmoneta_worker_context_set(int type, void* context, void (*destroy)(void* context))
+{
+   struct worker_cache* cache = cache_get();
+
+   if (type < 0 || type >= WORKER_CONTEXTS)
+   {
+      return;
+   }
+
+   if (cache->contexts[type] != NULL && cache->contexts[type] != context && cache->destroy[type] != NULL)
+   {
+      cache->destroy[type](cache->contexts[type]);
+   }
+
+   cache->contexts[type] = context;
+   cache->destroy[type] = destroy;
+}
+
+void*
+pgmoneta_worker_buffer(int type, size_t size)
+{
+   void* buffer = NULL;
+   struct worker_cache* cache = cache_get();
+
+   if (type < 0 || type >= WORKER_BUFFERS)
+   {
+      return NULL;
+   }
+
+   if (cache->buffers[type] == NULL || cache->buffer_sizes[type] < size)
+   {
+      buffer = realloc(cache->buffers[type], size);
+      if (buffer == NULL)
+      {
+         return NULL;
+      }
+
+      cache->buffers[type] = buffer;
+      cache->buffer_sizes[type] = size;
+   }
+
+   return cache->buffers[type];
+}
+
+void
+pgmoneta_worker_cache_clear(void)
+{
+   struct worker_cache* cache = cache_get();
+
+   for (int i = 0; i < WORKER_CONTEXTS; i++)
+   {
+      if (cache->contexts[i] != NULL && cache->destroy[i] != NULL)
+      {
+         cache->destroy[i](cache->contexts[i]);
+      }
+   }
+
+   for (int i = 0; i < WORKER_BUFFERS; i++)
+   {
+      free(cache->buffers[i]);
+   }
+
+   memset(cache, 0, sizeof(struct worker_cache));
+
+   pgmoneta_memory_pool_clear();
+}
+
 static int
-worker_init(struct workers* workers, struct worker** worker)
+worker_init(struct workers* workers, int index, struct worker** worker)
 {
    struct worker* w = NULL;
 
@@ -292,9 +580,25 @@ worker_init(struct workers* workers, struct worker** worker)
       goto error;
    }
 
+   w->index = index;
    w->workers = workers;
+   w->tasks = 0;
+   w->busy = 0.0;
+   w->idle = 0.0;
+   w->queue_wait = 0.0;
+   memset(&w->cache, 0, sizeof(struct worker_cache));
+
+   if (queue_init(&w->queue))
+   {
+      pgmoneta_log_error("Could not allocate memory for queue");
+      goto error;
+   }
 
-   pthread_create(&w->pthread, NULL, (void* (*)(void*)) worker_do, w);
+   if (pthread_create(&w->pthread, NULL, (void* (*)(void*)) worker_do, w) != 0)
+   {
+      queue_destroy(&w->queue);
+      goto error;
+   }
    pthread_detach(w->pthread);
 
    *worker = w;
@@ -303,6 +607,8 @@ worker_init(struct workers* workers, struct worker** worker)
 
 error:
 
+   free(w);
+
    return 1;
 }
 
@@ -310,42 +616,162 @@ static void*
 worker_do(struct worker* worker)
 {
    void (*func_ref)(struct worker_input*);
+   double queue_wait;
+   double seconds;
+   uint64_t trace_start;
+   char trace_detail[MISC_LENGTH];
+   size_t size;
+   struct timespec start_t;
+   struct timespec end_t;
+   struct timespec cpu_start;
+   struct timespec cpu_end;
+   bool deferred = false;
    struct task* t;
    struct workers* workers = worker->workers;
 
+   worker_self = worker;
+
+   // the buffers of the worker are allocated by the worker, so they are local to its CPU
+   pgmoneta_cpu_affinity(worker->index);
+
    pthread_mutex_lock(&workers->worker_lock);
    workers->number_of_alive += 1;
    pthread_mutex_unlock(&workers->worker_lock);
 
-   while (worker_keepalive)
+   pgmoneta_prometheus_worker_alive(1);
+
+   while (workers->keepalive)
    {
-      semaphore_wait(workers->queue.has_tasks);
+      t = NULL;
 
-      if (worker_keepalive)
+      // a worker above the running count waits until the workers are scaled up again
+      if (workers->autoscale && worker->index >= atomic_load(&workers->active))
       {
+         pthread_mutex_lock(&workers->worker_lock);
+         while (workers->keepalive && worker->index >= atomic_load(&workers->active))
+         {
+            pthread_cond_wait(&workers->scaled, &workers->worker_lock);
+         }
+         pthread_mutex_unlock(&workers->worker_lock);
+         continue;
+      }
+
+      // after a deferral look at the other queues first, so the deferred task isn't taken again
+      if (!deferred)
+      {
+         t = queue_pop(&worker->queue);
+      }
+      if (t == NULL)
+      {
+         t = worker_steal(worker);
+      }
+      if (t == NULL && deferred)
+      {
+         t = queue_pop(&worker->queue);
+      }
+
+      deferred = false;
+
+      if (t != NULL && !device_acquire(workers, t))
+      {
+         // the device of the task is busy, so the task waits behind the others
+         if (queue_defer(&worker->queue, t) == 0)
+         {
+            deferred = true;
+            SLEEP(1000000L);
+            continue;
+         }
+      }
+
+      if (t != NULL)
+      {
+         atomic_fetch_sub(&workers->number_of_tasks, 1);
+
          pthread_mutex_lock(&workers->worker_lock);
          workers->number_of_working++;
          pthread_mutex_unlock(&workers->worker_lock);
 
-         t = queue_pull(&workers->queue);
-         if (t)
+         pgmoneta_prometheus_worker_active(1);
+         PGMONETA_PROBE1(worker__task__start, worker->index);
+
+         clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+         queue_wait = pgmoneta_compute_duration(t->queued, start_t);
+
+         // the task frees its input, so the file is taken for the trace first
+         trace_start = pgmoneta_trace_now();
+         if (trace_start > 0)
          {
-            func_ref = t->function;
-            func_ref(t->wi);
+            memset(&trace_detail[0], 0, sizeof(trace_detail));
+            snprintf(&trace_detail[0], sizeof(trace_detail), "%s (waited %.3f ms)",
+                     t->wi != NULL && t->wi->from != NULL ? t->wi->from : "", queue_wait * 1000);
+         }
 
-            free(t);
+         if (workers->autoscale)
+         {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
          }
 
+         func_ref = t->function;
+         func_ref(t->wi);
+
+         pgmoneta_trace_event(TRACE_WORKER, "Task", &trace_detail[0], trace_start);
+
+         device_release(workers, t);
+
+         size = t->size;
+         free(t);
+
+         clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+         seconds = pgmoneta_compute_duration(start_t, end_t);
+
+         if (workers->autoscale)
+         {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+            worker_scale(workers, seconds, pgmoneta_compute_duration(cpu_start, cpu_end), size);
+         }
+
+         PGMONETA_PROBE2(worker__task__done, worker->index, (unsigned long)(seconds * 1000000));
+         pgmoneta_prometheus_worker_active(-1);
+         pgmoneta_prometheus_worker_task(queue_wait, seconds);
+
+         worker->tasks++;
+         worker->busy += seconds;
+         worker->queue_wait += queue_wait;
+
          pthread_mutex_lock(&workers->worker_lock);
          workers->number_of_working--;
-         if (!workers->number_of_working)
+         if (atomic_fetch_sub(&workers->number_of_pending, 1) == 1)
+         {
+            pthread_cond_broadcast(&workers->worker_all_idle);
+         }
+         pthread_mutex_unlock(&workers->worker_lock);
+      }
+      else
+      {
+         clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+         // announce the sleep before looking at the task count, so a new task wakes us up
+         pthread_mutex_lock(&workers->worker_lock);
+         atomic_fetch_add(&workers->number_of_sleeping, 1);
+         while (workers->keepalive && atomic_load(&workers->number_of_tasks) == 0)
          {
-            pthread_cond_signal(&workers->worker_all_idle);
+            pthread_cond_wait(&workers->has_tasks, &workers->worker_lock);
          }
+         atomic_fetch_sub(&workers->number_of_sleeping, 1);
          pthread_mutex_unlock(&workers->worker_lock);
 
+         clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+         seconds = pgmoneta_compute_duration(start_t, end_t);
+
+         pgmoneta_prometheus_worker_idle(seconds);
+         worker->idle += seconds;
       }
    }
+
+   pgmoneta_worker_cache_clear();
+
+   pgmoneta_prometheus_worker_alive(-1);
+
    pthread_mutex_lock(&workers->worker_lock);
    workers->number_of_alive--;
    pthread_mutex_unlock(&workers->worker_lock);
@@ -353,9 +779,115 @@ worker_do(struct worker* worker)
    return NULL;
 }
 
+static void
+worker_scale(struct workers* workers, double wall, double cpu, size_t size)
+{
+   int active;
+   int target;
+   int queued;
+   double elapsed;
+   double rate;
+   double ratio;
+   struct timespec now;
+
+   pthread_mutex_lock(&workers->scale_lock);
+
+   workers->scale_wall += wall;
+   workers->scale_cpu += cpu;
+   workers->scale_bytes += size;
+   workers->scale_tasks++;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+   elapsed = pgmoneta_compute_duration(workers->scale_start, now);
+   active = atomic_load(&workers->active);
+
+   // a measurement has a task from each running worker
+   if (elapsed < WORKER_SCALE_INTERVAL || workers->scale_tasks < active)
+   {
+      pthread_mutex_unlock(&workers->scale_lock);
+      return;
+   }
+
+   rate = workers->scale_bytes > 0 ? (double)workers->scale_bytes / elapsed : workers->scale_tasks / elapsed;
+   ratio = workers->scale_wall > 0.0 ? workers->scale_cpu / workers->scale_wall : 0.0;
+   queued = atomic_load(&workers->number_of_tasks);
+   target = active;
+
+   if (queued < active)
+   {
+      // the queue is draining, so the number of workers doesn't limit the throughput
+   }
+   else if (workers->scale_rate == 0.0 || rate > workers->scale_rate * (1.0 + WORKER_SCALE_CHANGE))
+   {
+      target = active + workers->scale_direction;
+   }
+   else if (rate < workers->scale_rate * (1.0 - WORKER_SCALE_CHANGE))
+   {
+      workers->scale_direction = -workers->scale_direction;
+      target = active + workers->scale_direction;
+   }
+   else if (ratio < WORKER_SCALE_IO)
+   {
+      // the tasks wait on I/O, so fewer workers keep the same throughput
+      workers->scale_direction = -1;
+      target = active - 1;
+   }
+   else
+   {
+      // the tasks use the CPU, so more workers can add to the throughput
+      workers->scale_direction = 1;
+      target = active + 1;
+   }
+
+   target = MAX(MIN(target, workers->number_of_workers), 1);
+
+   pgmoneta_log_trace("Workers: %d/%d running, %d queued, CPU %.0f%%, %.0f/s",
+                      active, workers->number_of_workers, queued, ratio * 100, rate);
+
+   workers->scale_start = now;
+   workers->scale_wall = 0.0;
+   workers->scale_cpu = 0.0;
+   workers->scale_bytes = 0;
+   workers->scale_tasks = 0;
+   workers->scale_rate = rate;
+
+   if (target != active)
+   {
+      pgmoneta_log_debug("Workers: %d running (was %d)", target, active);
+
+      pthread_mutex_lock(&workers->worker_lock);
+      atomic_store(&workers->active, target);
+      if (target > active)
+      {
+         pthread_cond_broadcast(&workers->scaled);
+      }
+      pthread_mutex_unlock(&workers->worker_lock);
+   }
+
+   pthread_mutex_unlock(&workers->scale_lock);
+}
+
+static struct task*
+worker_steal(struct worker* worker)
+{
+   struct task* t = NULL;
+   struct workers* workers = worker->workers;
+
+   for (int i = 1; t == NULL && i < workers->number_of_workers; i++)
+   {
+      t = queue_steal(&workers->worker[(worker->index + i) % workers->number_of_workers]->queue);
+   }
+
+   return t;
+}
+
 static void
 worker_destroy(struct worker* w)
 {
+   if (w != NULL)
+   {
+      queue_destroy(&w->queue);
+   }
    free(w);
 }
 
@@ -363,94 +895,144 @@ static int
 queue_init(struct queue* queue)
 {
    queue->number_of_tasks = 0;
-   queue->front = NULL;
-   queue->rear = NULL;
+   queue->front = 0;
+   queue->capacity = 64;
 
-   queue->has_tasks = (struct semaphore*)malloc(sizeof(struct semaphore));
-   if (queue->has_tasks == NULL)
+   queue->tasks = (struct task**)malloc(queue->capacity * sizeof(struct task*));
+   if (queue->tasks == NULL)
    {
       return 1;
    }
 
    pthread_mutex_init(&(queue->rwmutex), NULL);
-   if (semaphore_init(queue->has_tasks, 0))
-   {
-      goto error;
-   }
 
    return 0;
-
-error:
-
-   return 1;
 }
 
 static void
 queue_clear(struct queue* queue)
 {
-   while (queue->number_of_tasks)
+   struct task* t = NULL;
+
+   while ((t = queue_pop(queue)) != NULL)
    {
-      free(queue_pull(queue));
+      free(t->wi);
+      free(t);
    }
 
-   queue->front = NULL;
-   queue->rear = NULL;
-   semaphore_reset(queue->has_tasks);
+   queue->front = 0;
    queue->number_of_tasks = 0;
+}
 
+static int
+queue_grow(struct queue* queue)
+{
+   struct task** tasks = NULL;
+
+   if (queue->number_of_tasks < queue->capacity)
+   {
+      return 0;
+   }
+
+   tasks = (struct task**)malloc(2 * queue->capacity * sizeof(struct task*));
+   if (tasks == NULL)
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < queue->number_of_tasks; i++)
+   {
+      tasks[i] = queue->tasks[(queue->front + i) % queue->capacity];
+   }
+
+   free(queue->tasks);
+   queue->tasks = tasks;
+   queue->front = 0;
+   queue->capacity *= 2;
+
+   return 0;
 }
 
-static void
+static int
 queue_push(struct queue* queue, struct task* task)
 {
-
    pthread_mutex_lock(&queue->rwmutex);
-   task->previous = NULL;
 
-   switch (queue->number_of_tasks)
+   if (queue_grow(queue))
    {
-      case 0:
-         queue->front = task;
-         queue->rear = task;
-         break;
+      pthread_mutex_unlock(&queue->rwmutex);
+      return 1;
+   }
+
+   queue->tasks[(queue->front + queue->number_of_tasks) % queue->capacity] = task;
+   queue->number_of_tasks++;
+
+   pthread_mutex_unlock(&queue->rwmutex);
+
+   return 0;
+}
 
-      default:
-         queue->rear->previous = task;
-         queue->rear = task;
+static int
+queue_defer(struct queue* queue, struct task* task)
+{
+   pthread_mutex_lock(&queue->rwmutex);
 
+   if (queue_grow(queue))
+   {
+      pthread_mutex_unlock(&queue->rwmutex);
+      return 1;
    }
+
+   // the owner takes the newest task, so the oldest end is the last one it gets to
+   queue->front = (queue->front + queue->capacity - 1) % queue->capacity;
+   queue->tasks[queue->front] = task;
    queue->number_of_tasks++;
 
-   semaphore_post(queue->has_tasks);
    pthread_mutex_unlock(&queue->rwmutex);
+
+   return 0;
 }
 
 static struct task*
-queue_pull(struct queue* queue)
+queue_pop(struct queue* queue)
 {
    struct task* task = NULL;
 
    pthread_mutex_lock(&queue->rwmutex);
-   task = queue->front;
 
-   switch (queue->number_of_tasks)
+   // the newest task is the most likely to still be in the cache
+   if (queue->number_of_tasks > 0)
    {
-      case 0:
-         break;
+      queue->number_of_tasks--;
+      task = queue->tasks[(queue->front + queue->number_of_tasks) % queue->capacity];
+   }
 
-      case 1:
-         queue->front = NULL;
-         queue->rear = NULL;
-         queue->number_of_tasks = 0;
-         break;
+   pthread_mutex_unlock(&queue->rwmutex);
+
+   return task;
+}
+
+static struct task*
+queue_steal(struct queue* queue)
+{
+   struct task* task = NULL;
+
+   if (queue->number_of_tasks == 0)
+   {
+      return NULL;
+   }
+
+   pthread_mutex_lock(&queue->rwmutex);
 
-      default:
-         queue->front = task->previous;
-         queue->number_of_tasks--;
-         semaphore_post(queue->has_tasks);
+   if (queue->number_of_tasks > 0)
+   {
+      task = queue->tasks[queue->front];
+      queue->front = (queue->front + 1) % queue->capacity;
+      queue->number_of_tasks--;
    }
 
    pthread_mutex_unlock(&queue->rwmutex);
+
    return task;
 }
 
@@ -458,63 +1040,160 @@ static void
 queue_destroy(struct queue* queue)
 {
    queue_clear(queue);
-   free(queue->has_tasks);
+   free(queue->tasks);
+   pthread_mutex_destroy(&queue->rwmutex);
 }
 
-static int
-semaphore_init(struct semaphore* semaphore, int value)
+static struct worker_cache*
+cache_get(void)
 {
-   if (value < 0 || value > 1 || semaphore == NULL)
+   if (worker_self != NULL)
    {
-      pgmoneta_log_error("Invalid semaphore value: %d", value);
-      goto error;
+      return &worker_self->cache;
    }
 
-   pthread_mutex_init(&(semaphore->mutex), NULL);
-   pthread_cond_init(&(semaphore->cond), NULL);
-   semaphore->value = value;
+   return &thread_cache;
+}
 
-   return 0;
+static int
+plan_compare(const void* a, const void* b)
+{
+   struct task* ta = *(struct task**)a;
+   struct task* tb = *(struct task**)b;
 
-error:
+   if (ta->size > tb->size)
+   {
+      return -1;
+   }
+   else if (ta->size < tb->size)
+   {
+      return 1;
+   }
 
-   return 1;
+   return 0;
 }
 
 static void
-semaphore_reset(struct semaphore* semaphore)
+plan_schedule(struct workers* workers)
 {
-   pthread_mutex_destroy(&(semaphore->mutex));
-   pthread_cond_destroy(&(semaphore->cond));
-   semaphore_init(semaphore, 0);
+   int n = workers->number_of_workers;
+
+   workers->planning = false;
+
+   // largest first, so a big file does not end up as the last task
+   qsort(workers->plan, workers->plan_size, sizeof(struct task*), plan_compare);
+
+   // the owner takes the newest task of its deque, so push the smallest first
+   for (int i = workers->plan_size - 1; i >= 0; i--)
+   {
+      clock_gettime(CLOCK_MONOTONIC_RAW, &workers->plan[i]->queued);
+      atomic_fetch_add(&workers->number_of_tasks, 1);
+      if (queue_push(&workers->worker[i % n]->queue, workers->plan[i]))
+      {
+         atomic_fetch_sub(&workers->number_of_tasks, 1);
+         atomic_fetch_sub(&workers->number_of_pending, 1);
+         workers->outcome = false;
+         free(workers->plan[i]->wi);
+         free(workers->plan[i]);
+      }
+   }
+
+   free(workers->plan);
+   workers->plan = NULL;
+   workers->plan_size = 0;
+   workers->plan_capacity = 0;
+
+   pthread_mutex_lock(&workers->worker_lock);
+   pthread_cond_broadcast(&workers->has_tasks);
+   pthread_mutex_unlock(&workers->worker_lock);
 }
 
-static void
-semaphore_post(struct semaphore* semaphore)
+static char*
+worker_intern(struct workers* workers, char* directory)
 {
-   pthread_mutex_lock(&semaphore->mutex);
-   semaphore->value = 1;
-   pthread_cond_signal(&semaphore->cond);
-   pthread_mutex_unlock(&semaphore->mutex);
+   char* interned = NULL;
+
+   pthread_mutex_lock(&workers->intern_lock);
+
+   if (workers->interned != NULL && !strcmp(workers->interned, directory))
+   {
+      interned = workers->interned;
+   }
+   else
+   {
+      interned = (char*)pgmoneta_arena_alloc(workers->arena, strlen(directory) + 1);
+      if (interned != NULL)
+      {
+         memcpy(interned, directory, strlen(directory));
+         workers->interned = interned;
+      }
+   }
+
+   pthread_mutex_unlock(&workers->intern_lock);
+
+   return interned;
 }
 
-static void
-semaphore_post_all(struct semaphore* semaphore)
+static int
+device_index(struct workers* workers, dev_t device)
 {
-   pthread_mutex_lock(&semaphore->mutex);
-   semaphore->value = 1;
-   pthread_cond_broadcast(&semaphore->cond);
-   pthread_mutex_unlock(&semaphore->mutex);
+   int index = -1;
+
+   pthread_mutex_lock(&workers->device_lock);
+
+   for (int i = 0; index == -1 && i < workers->number_of_devices; i++)
+   {
+      if (workers->devices[i].device == device)
+      {
+         index = i;
+      }
+   }
+
+   // the tasks on a device beyond the table are not limited
+   if (index == -1 && workers->number_of_devices < WORKER_DEVICES)
+   {
+      index = workers->number_of_devices;
+      workers->devices[index].device = device;
+      atomic_init(&workers->devices[index].running, 0);
+      workers->number_of_devices++;
+   }
+
+   pthread_mutex_unlock(&workers->device_lock);
+
+   return index;
+}
+
+static bool
+device_acquire(struct workers* workers, struct task* task)
+{
+   int running;
+   atomic_int* counter;
+
+   if (task->device == -1)
+   {
+      return true;
+   }
+
+   counter = &workers->devices[task->device].running;
+   running = atomic_load(counter);
+
+   do
+   {
+      if (running >= workers->device_limit)
+      {
+         return false;
+      }
+   }
+   while (!atomic_compare_exchange_weak(counter, &running, running + 1));
+
+   return true;
 }
 
 static void
-semaphore_wait(struct semaphore* semaphore)
+device_release(struct workers* workers, struct task* task)
 {
-   pthread_mutex_lock(&semaphore->mutex);
-   while (semaphore->value != 1)
+   if (task->device != -1)
    {
-      pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+      atomic_fetch_sub(&workers->devices[task->device].running, 1);
    }
-   semaphore->value = 0;
-   pthread_mutex_unlock(&semaphore->mutex);
 }
@@ -32,7 +32,12 @@
 #include <hot_standby.h>
 #include <info.h>
 #include <logging.h>
+#include <memory.h>
+#include <probes.h>
+#include <prometheus.h>
+#include <scheduler.h>
 #include <storage.h>
+#include <trace.h>
 #include <workflow.h>
 #include <workflow_funcs.h>
 #include <utils.h>
@@ -40,8 +45,44 @@
 
 /* system */
 #include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define WORKFLOW_STATE_WAITING 0
+#define WORKFLOW_STATE_RUNNING 1
+#define WORKFLOW_STATE_DONE    2
+
+/** @struct workflow_run
+ * Defines the execution of the nodes of a workflow
+ */
+struct workflow_run
+{
+   pthread_mutex_t lock;          /**< The lock */
+   pthread_cond_t finished;       /**< Signaled when a node has finished */
+   struct art* nodes;             /**< The nodes */
+   struct workflow** workflows;   /**< The workflow nodes in list order */
+   int* states;                   /**< The state of each workflow node */
+   int number_of_workflows;       /**< The number of workflow nodes */
+   bool failed;                   /**< Has a node failed */
+};
+
+/** @struct workflow_task
+ * Defines a workflow node running on its own thread
+ */
+struct workflow_task
+{
+   struct workflow_run* run; /**< The execution */
+   int index;                /**< The index of the node */
+};
+
+static _Thread_local struct workflow* workflow_current = NULL;
 
 static struct workflow* wf_backup(struct backup* backup);
 static struct workflow* wf_incremental_backup(void);
@@ -51,41 +92,462 @@ static struct workflow* wf_verify(struct backup* backup);
 static struct workflow* wf_archive(struct backup* backup);
 static struct workflow* wf_delete_backup(struct backup* backup);
 static struct workflow* wf_retention(struct backup* backup);
+static struct workflow* wf_merge(void);
+
+static void workflow_storage(struct workflow** current, struct workflow* permissions);
+static void workflow_stream(struct workflow* workflow);
+
+static bool workflow_ready(struct workflow_run* run, int index);
+static int workflow_start(struct workflow_run* run, int index);
+static void* workflow_task(void* arg);
+
+static void workflow_progress_start(int server, int number_of_nodes);
+static void workflow_progress_node(int server, char* name);
+static void workflow_progress_finish(int server);
+
+static char* workflow_metrics_directory(struct art* nodes);
+static void workflow_directory_metrics(char* directory, uint64_t* bytes, uint64_t* files);
 
 struct workflow*
 pgmoneta_workflow_create(int workflow_type, int server, struct backup* backup)
 {
+   struct workflow* workflow = NULL;
+   struct workflow* current = NULL;
+
    switch (workflow_type)
    {
       case WORKFLOW_TYPE_BACKUP:
-         return wf_backup(backup);
+         workflow = wf_backup(backup);
          break;
       case WORKFLOW_TYPE_RESTORE:
-         return wf_restore(backup);
+         workflow = wf_restore(backup);
          break;
       case WORKFLOW_TYPE_RESTORE_INCREMENTAL:
-         return wf_restore_incremental(server, backup);
+         workflow = wf_restore_incremental(server, backup);
          break;
       case WORKFLOW_TYPE_VERIFY:
-         return wf_verify(backup);
+         workflow = wf_verify(backup);
          break;
       case WORKFLOW_TYPE_ARCHIVE:
-         return wf_archive(backup);
+         workflow = wf_archive(backup);
          break;
       case WORKFLOW_TYPE_DELETE_BACKUP:
-         return wf_delete_backup(backup);
+         workflow = wf_delete_backup(backup);
          break;
       case WORKFLOW_TYPE_RETENTION:
-         return wf_retention(backup);
+         workflow = wf_retention(backup);
          break;
       case WORKFLOW_TYPE_INCREMENTAL_BACKUP:
-         return wf_incremental_backup();
+         workflow = wf_incremental_backup();
+         break;
+      case WORKFLOW_TYPE_MERGE:
+         workflow = wf_merge();
          break;
       default:
          break;
    }
 
-   return NULL;
+   current = workflow;
+   while (current != NULL)
+   {
+      memset(&current->metrics, 0, sizeof(struct workflow_metrics));
+      current = current->next;
+   }
+
+   return workflow;
+}
+
+int
+pgmoneta_workflow_execute(struct workflow* workflow, struct art* nodes)
+{
+   int ret;
+   int server = -1;
+   int resource = -1;
+   int granted = 0;
+   char* directory = NULL;
+   uint64_t bytes = 0;
+   uint64_t files = 0;
+   uint64_t trace_start = 0;
+   struct timespec start_t;
+   struct timespec end_t;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (pgmoneta_art_contains_key(nodes, NODE_SERVER))
+   {
+      server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
+   }
+
+   if (workflow->streamed)
+   {
+      pgmoneta_log_debug("%s: Done per file", workflow->name());
+      if (server != -1)
+      {
+         atomic_fetch_add(&config->servers[server].progress.nodes, 1);
+      }
+      return 0;
+   }
+
+   directory = workflow_metrics_directory(nodes);
+   if (directory != NULL)
+   {
+      workflow_directory_metrics(directory, &bytes, &files);
+   }
+   workflow->metrics.bytes_in = bytes;
+
+   // disk and network heavy nodes take a token shared with the workflows of the other servers
+   if (workflow->resource == WORKFLOW_RESOURCE_DISK)
+   {
+      resource = SCHEDULER_DISK;
+   }
+   else if (workflow->resource == WORKFLOW_RESOURCE_NETWORK || workflow->resource == WORKFLOW_RESOURCE_UPLOAD ||
+            workflow->resource == WORKFLOW_RESOURCE_UPLOAD_MULTI)
+   {
+      resource = SCHEDULER_NETWORK;
+   }
+
+   if (resource != -1 && pgmoneta_scheduler_acquire(resource, 1, &granted))
+   {
+      return 1;
+   }
+
+   workflow_progress_node(server, workflow->name());
+
+   workflow->metrics.accounted = false;
+   workflow_current = workflow;
+
+   PGMONETA_PROBE1(workflow__node__start, workflow->name());
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+   trace_start = pgmoneta_trace_now();
+
+   ret = workflow->execute(workflow->name(), nodes);
+
+   pgmoneta_trace_event(TRACE_NODE, workflow->name(), ret ? "failed" : NULL, trace_start);
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+   PGMONETA_PROBE2(workflow__node__done, workflow->name(), ret);
+
+   workflow_current = NULL;
+
+   if (resource != -1)
+   {
+      pgmoneta_scheduler_release(resource, granted);
+   }
+
+   workflow->metrics.elapsed = pgmoneta_compute_duration(start_t, end_t);
+
+   if (!workflow->metrics.accounted)
+   {
+      bytes = 0;
+      files = 0;
+
+      directory = workflow_metrics_directory(nodes);
+      if (directory != NULL)
+      {
+         workflow_directory_metrics(directory, &bytes, &files);
+      }
+      workflow->metrics.bytes_out = bytes;
+      workflow->metrics.files = files;
+   }
+
+   if (ret == 0 && server != -1)
+   {
+      atomic_fetch_add(&config->servers[server].progress.nodes, 1);
+
+      pgmoneta_prometheus_workflow_node(server, workflow->name(), workflow->metrics.elapsed,
+                                        workflow->metrics.bytes_in, workflow->metrics.bytes_out,
+                                        workflow->metrics.files);
+   }
+
+   pgmoneta_log_debug("%s: %.4f seconds, %" PRIu64 " bytes in, %" PRIu64 " bytes out, %" PRIu64 " files",
+                      workflow->name(), workflow->metrics.elapsed, workflow->metrics.bytes_in,
+                      workflow->metrics.bytes_out, workflow->metrics.files);
+
+   return ret;
+}
+
+int
+pgmoneta_workflow_run(struct workflow* workflow, struct art* nodes)
+{
+   int ret;
+   int ready;
+   int running = 0;
+   int done = 0;
+   int server = -1;
+   char* label = NULL;
+   uint64_t trace_start = 0;
+   struct workflow* current = NULL;
+   struct workflow_run run;
+
+   memset(&run, 0, sizeof(struct workflow_run));
+   run.nodes = nodes;
+
+   // a streaming node looks up the per-file functions of the nodes after it
+   if (pgmoneta_art_insert(nodes, NODE_WORKFLOW, (uintptr_t)workflow, ValueRef))
+   {
+      return 1;
+   }
+
+   for (current = workflow; current != NULL; current = current->next)
+   {
+      run.number_of_workflows++;
+   }
+
+   run.workflows = (struct workflow**)calloc(run.number_of_workflows + 1, sizeof(struct workflow*));
+   run.states = (int*)calloc(run.number_of_workflows + 1, sizeof(int));
+   if (run.workflows == NULL || run.states == NULL)
+   {
+      free(run.workflows);
+      free(run.states);
+      return 1;
+   }
+
+   current = workflow;
+   for (int i = 0; i < run.number_of_workflows; i++)
+   {
+      run.workflows[i] = current;
+      current = current->next;
+   }
+
+   if (pgmoneta_art_contains_key(nodes, NODE_SERVER))
+   {
+      server = (int)pgmoneta_art_search(nodes, NODE_SERVER);
+      workflow_progress_start(server, run.number_of_workflows);
+
+      if (pgmoneta_art_contains_key(nodes, NODE_LABEL))
+      {
+         label = (char*)pgmoneta_art_search(nodes, NODE_LABEL);
+      }
+
+      pgmoneta_trace_start();
+      trace_start = pgmoneta_trace_now();
+   }
+
+   pthread_mutex_init(&run.lock, NULL);
+   pthread_cond_init(&run.finished, NULL);
+
+   pthread_mutex_lock(&run.lock);
+
+   while (done < run.number_of_workflows && !run.failed)
+   {
+      ready = -1;
+
+      for (int i = 0; i < run.number_of_workflows && !run.failed; i++)
+      {
+         if (!workflow_ready(&run, i))
+         {
+            continue;
+         }
+
+         // held back, since a node that can't overlap with anything runs on this thread
+         if (running == 0 && ready == -1)
+         {
+            ready = i;
+            run.states[i] = WORKFLOW_STATE_RUNNING;
+            continue;
+         }
+
+         if (workflow_start(&run, i))
+         {
+            run.failed = true;
+         }
+         running++;
+      }
+
+      if (ready != -1 && run.failed)
+      {
+         run.states[ready] = WORKFLOW_STATE_WAITING;
+         ready = -1;
+      }
+      else if (ready != -1 && running > 0)
+      {
+         if (workflow_start(&run, ready))
+         {
+            run.failed = true;
+         }
+         running++;
+         ready = -1;
+      }
+
+      if (run.failed)
+      {
+         break;
+      }
+
+      if (ready != -1)
+      {
+         pthread_mutex_unlock(&run.lock);
+
+         ret = pgmoneta_workflow_execute(run.workflows[ready], nodes);
+
+         pthread_mutex_lock(&run.lock);
+
+         run.states[ready] = WORKFLOW_STATE_DONE;
+         done++;
+
+         if (ret)
+         {
+            pgmoneta_log_error("Workflow node %s failed", run.workflows[ready]->name());
+            run.failed = true;
+         }
+
+         continue;
+      }
+
+      if (running == 0)
+      {
+         pgmoneta_log_error("Workflow nodes wait for each other");
+         run.failed = true;
+         break;
+      }
+
+      pthread_cond_wait(&run.finished, &run.lock);
+
+      running = 0;
+      done = 0;
+      for (int i = 0; i < run.number_of_workflows; i++)
+      {
+         if (run.states[i] == WORKFLOW_STATE_RUNNING)
+         {
+            running++;
+         }
+         else if (run.states[i] == WORKFLOW_STATE_DONE)
+         {
+            done++;
+         }
+      }
+   }
+
+   // the nodes that are still running use the nodes tree
+   while (true)
+   {
+      running = 0;
+      for (int i = 0; i < run.number_of_workflows; i++)
+      {
+         if (run.states[i] == WORKFLOW_STATE_RUNNING)
+         {
+            running++;
+         }
+      }
+
+      if (running == 0)
+      {
+         break;
+      }
+
+      pthread_cond_wait(&run.finished, &run.lock);
+   }
+
+   pthread_mutex_unlock(&run.lock);
+
+   pthread_cond_destroy(&run.finished);
+   pthread_mutex_destroy(&run.lock);
+
+   free(run.workflows);
+   free(run.states);
+
+   if (server != -1)
+   {
+      workflow_progress_finish(server);
+
+      pgmoneta_trace_event(TRACE_WORKFLOW, run.number_of_workflows > 0 ? workflow->name() : "Workflow", label, trace_start);
+      pgmoneta_trace_finish(server, label);
+   }
+
+   return run.failed ? 1 : 0;
+}
+
+int
+pgmoneta_workflow_depends(struct workflow* workflow, struct workflow* dependency)
+{
+   if (workflow == NULL || dependency == NULL || workflow->number_of_dependencies >= WORKFLOW_MAX_DEPENDENCIES)
+   {
+      return 1;
+   }
+
+   workflow->dependencies[workflow->number_of_dependencies++] = dependency;
+
+   return 0;
+}
+
+void
+pgmoneta_workflow_progress(int server, uint64_t bytes, uint64_t files)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (server < 0 || server >= config->number_of_servers)
+   {
+      return;
+   }
+
+   if (bytes > 0)
+   {
+      atomic_fetch_add(&config->servers[server].progress.bytes, bytes);
+   }
+
+   if (files > 0)
+   {
+      atomic_fetch_add(&config->servers[server].progress.files, files);
+   }
+}
+
+void
+pgmoneta_workflow_account(uint64_t bytes, uint64_t files)
+{
+   if (workflow_current == NULL)
+   {
+      return;
+   }
+
+   workflow_current->metrics.bytes_out = bytes;
+   workflow_current->metrics.files = files;
+   workflow_current->metrics.accounted = true;
+}
+
+int
+pgmoneta_workflow_store_metrics(struct workflow* workflow, struct info_batch* info)
+{
+   char key[MISC_LENGTH + 32];
+   char prefix[MISC_LENGTH];
+   char* n = NULL;
+   size_t length;
+   struct workflow* current = NULL;
+
+   current = workflow;
+   while (current != NULL)
+   {
+      memset(prefix, 0, sizeof(prefix));
+
+      n = current->name();
+      length = strlen(n);
+      if (length > sizeof(prefix) - 1)
+      {
+         length = sizeof(prefix) - 1;
+      }
+
+      for (size_t i = 0; i < length; i++)
+      {
+         prefix[i] = isalnum((unsigned char)n[i]) ? toupper((unsigned char)n[i]) : '_';
+      }
+
+      snprintf(key, sizeof(key), "NODE_%s_ELAPSED", prefix);
+      pgmoneta_info_set_double(info, key, current->metrics.elapsed);
+
+      snprintf(key, sizeof(key), "NODE_%s_BYTES_IN", prefix);
+      pgmoneta_info_set_unsigned_long(info, key, current->metrics.bytes_in);
+
+      snprintf(key, sizeof(key), "NODE_%s_BYTES_OUT", prefix);
+      pgmoneta_info_set_unsigned_long(info, key, current->metrics.bytes_out);
+
+      snprintf(key, sizeof(key), "NODE_%s_FILES", prefix);
+      pgmoneta_info_set_unsigned_long(info, key, current->metrics.files);
+
+      current = current->next;
+   }
+
+   return 0;
 }
 
 int
@@ -302,26 +764,60 @@ wf_backup(struct backup* backup)
 {
    struct workflow* head = NULL;
    struct workflow* current = NULL;
+   struct workflow* manifest = NULL;
+   struct workflow* extra = NULL;
+   struct workflow* permissions = NULL;
+   struct workflow* pipeline = NULL;
    struct configuration* config = NULL;
 
    config = (struct configuration*)shmem;
 
    head = pgmoneta_create_basebackup();
+   head->resource = WORKFLOW_RESOURCE_NETWORK;
    current = head;
 
-   current->next = pgmoneta_create_manifest();
+   manifest = pgmoneta_create_manifest();
+   current->next = manifest;
    current = current->next;
 
-   current->next = pgmoneta_create_extra();
+   // the extra files are fetched while the data directory is processed
+   extra = pgmoneta_create_extra();
+   extra->resource = WORKFLOW_RESOURCE_NETWORK;
+   pgmoneta_workflow_depends(extra, head);
+   current->next = extra;
    current = current->next;
 
    current->next = pgmoneta_storage_create_local();
+   current->next->resource = WORKFLOW_RESOURCE_DISK;
+   pgmoneta_workflow_depends(current->next, manifest);
    current = current->next;
 
    current->next = pgmoneta_create_hot_standby();
+   current->next->resource = WORKFLOW_RESOURCE_DISK;
    current = current->next;
 
-   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+   if (config->page_filter && !config->backup_pipeline)
+   {
+      current->next = pgmoneta_create_page(true);
+      current->next->resource = WORKFLOW_RESOURCE_DISK;
+      current = current->next;
+   }
+
+   if (config->deduplication && !config->backup_pipeline && config->encryption == ENCRYPTION_NONE &&
+       config->storage_engine == STORAGE_ENGINE_LOCAL)
+   {
+      current->next = pgmoneta_create_dedup(true);
+      current->next->resource = WORKFLOW_RESOURCE_DISK;
+      current = current->next;
+   }
+
+   if (config->backup_pipeline && (config->compression_type != COMPRESSION_NONE || config->encryption != ENCRYPTION_NONE))
+   {
+      pipeline = pgmoneta_create_pipeline();
+      current->next = pipeline;
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
    {
       current->next = pgmoneta_create_gzip(true);
       current = current->next;
@@ -342,7 +838,7 @@ wf_backup(struct backup* backup)
       current = current->next;
    }
 
-   if (config->encryption != ENCRYPTION_NONE)
+   if (config->encryption != ENCRYPTION_NONE && !config->backup_pipeline)
    {
       current->next = pgmoneta_encryption(true);
       current = current->next;
@@ -352,35 +848,27 @@ wf_backup(struct backup* backup)
    if (config->link)
    {
       current->next = pgmoneta_create_link();
+      current->next->resource = WORKFLOW_RESOURCE_DISK;
       current = current->next;
    }
 #else
    current->next = pgmoneta_create_link();
+   current->next->resource = WORKFLOW_RESOURCE_DISK;
    current = current->next;
 #endif
 
-   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
+   permissions = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
+   permissions->resource = WORKFLOW_RESOURCE_DISK;
+   pgmoneta_workflow_depends(permissions, current);
+   pgmoneta_workflow_depends(permissions, extra);
+   current->next = permissions;
    current = current->next;
 
-   if (config->storage_engine & STORAGE_ENGINE_SSH)
-   {
-      current->next = pgmoneta_create_sha256();
-      current = current->next;
-
-      current->next = pgmoneta_storage_create_ssh(WORKFLOW_TYPE_BACKUP);
-      current = current->next;
-   }
-
-   if (config->storage_engine & STORAGE_ENGINE_S3)
-   {
-      current->next = pgmoneta_storage_create_s3();
-      current = current->next;
-   }
+   workflow_storage(&current, permissions);
 
-   if (config->storage_engine & STORAGE_ENGINE_AZURE)
+   if (pipeline != NULL)
    {
-      current->next = pgmoneta_storage_create_azure();
-      current = current->next;
+      workflow_stream(pipeline);
    }
 
 #ifdef DEBUG
@@ -404,43 +892,26 @@ wf_restore(struct backup* backup)
    struct workflow* head = NULL;
    struct workflow* current = NULL;
 
+   /* The restore decrypts and decompresses the files while it copies them */
    head = pgmoneta_create_restore();
    current = head;
 
-   if (backup->encryption != ENCRYPTION_NONE)
+   if (backup->deduplication)
    {
-      current->next = pgmoneta_encryption(false);
+      current->next = pgmoneta_create_dedup(false);
       current = current->next;
    }
 
-   if (backup->compression == COMPRESSION_CLIENT_GZIP || backup->compression == COMPRESSION_SERVER_GZIP)
-   {
-      current->next = pgmoneta_create_gzip(false);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_ZSTD || backup->compression == COMPRESSION_SERVER_ZSTD)
-   {
-      current->next = pgmoneta_create_zstd(false);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_LZ4 || backup->compression == COMPRESSION_SERVER_LZ4)
+   if (backup->page_filter)
    {
-      current->next = pgmoneta_create_lz4(false);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_BZIP2)
-   {
-      current->next = pgmoneta_create_bzip2(false);
+      current->next = pgmoneta_create_page(false);
       current = current->next;
    }
 
-   current->next = pgmoneta_create_recovery_info();
-   current = current->next;
-
    current->next = pgmoneta_restore_excluded_files();
    current = current->next;
 
-   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_RESTORE);
+   current->next = pgmoneta_create_recovery_info();
    current = current->next;
 
    current->next = pgmoneta_create_cleanup(CLEANUP_TYPE_RESTORE);
@@ -509,13 +980,10 @@ wf_restore_incremental(int server, struct backup* backup)
    current->next = pgmoneta_create_combine_incremental();
    current = current->next;
 
-   current->next = pgmoneta_create_recovery_info();
-   current = current->next;
-
    current->next = pgmoneta_restore_excluded_files();
    current = current->next;
 
-   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_RESTORE);
+   current->next = pgmoneta_create_recovery_info();
    current = current->next;
 
    current->next = pgmoneta_create_cleanup(CLEANUP_TYPE_RESTORE);
@@ -544,25 +1012,35 @@ wf_incremental_backup(void)
 {
    struct workflow* head = NULL;
    struct workflow* current = NULL;
+   struct workflow* manifest = NULL;
+   struct workflow* extra = NULL;
+   struct workflow* permissions = NULL;
    struct configuration* config = NULL;
 
    config = (struct configuration*)shmem;
 
    head = pgmoneta_create_basebackup();
+   head->resource = WORKFLOW_RESOURCE_NETWORK;
    current = head;
 
-   current->next = pgmoneta_create_manifest();
+   manifest = pgmoneta_create_manifest();
+   current->next = manifest;
    current = current->next;
 
-   current->next = pgmoneta_create_extra();
+   extra = pgmoneta_create_extra();
+   extra->resource = WORKFLOW_RESOURCE_NETWORK;
+   pgmoneta_workflow_depends(extra, head);
+   current->next = extra;
    current = current->next;
 
    current->next = pgmoneta_storage_create_local();
+   current->next->resource = WORKFLOW_RESOURCE_DISK;
+   pgmoneta_workflow_depends(current->next, manifest);
    current = current->next;
 
-   // TODO: use a new pgmoneta_create_hot_standby_incremental instead since we need to combine backup first
-   // current->next = pgmoneta_create_hot_standby();
-   // current = current->next;
+   current->next = pgmoneta_create_hot_standby();
+   current->next->resource = WORKFLOW_RESOURCE_DISK;
+   current = current->next;
 
    if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
    {
@@ -592,31 +1070,17 @@ wf_incremental_backup(void)
    }
 
    current->next = pgmoneta_create_link();
+   current->next->resource = WORKFLOW_RESOURCE_DISK;
    current = current->next;
 
-   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
+   permissions = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
+   permissions->resource = WORKFLOW_RESOURCE_DISK;
+   pgmoneta_workflow_depends(permissions, current);
+   pgmoneta_workflow_depends(permissions, extra);
+   current->next = permissions;
    current = current->next;
 
-   if (config->storage_engine & STORAGE_ENGINE_SSH)
-   {
-      current->next = pgmoneta_create_sha256();
-      current = current->next;
-
-      current->next = pgmoneta_storage_create_ssh(WORKFLOW_TYPE_BACKUP);
-      current = current->next;
-   }
-
-   if (config->storage_engine & STORAGE_ENGINE_S3)
-   {
-      current->next = pgmoneta_storage_create_s3();
-      current = current->next;
-   }
-
-   if (config->storage_engine & STORAGE_ENGINE_AZURE)
-   {
-      current->next = pgmoneta_storage_create_azure();
-      current = current->next;
-   }
+   workflow_storage(&current, permissions);
 
 #ifdef DEBUG
    current = head;
@@ -638,45 +1102,37 @@ wf_verify(struct backup* backup)
 {
    struct workflow* head = NULL;
    struct workflow* current = NULL;
+   struct configuration* config;
 
-   head = pgmoneta_create_restore();
-   current = head;
-
-   if (backup->encryption != ENCRYPTION_NONE)
-   {
-      current->next = pgmoneta_encryption(false);
-      current = current->next;
-   }
+   config = (struct configuration*)shmem;
 
-   if (backup->compression == COMPRESSION_CLIENT_GZIP || backup->compression == COMPRESSION_SERVER_GZIP)
-   {
-      current->next = pgmoneta_create_gzip(false);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_ZSTD || backup->compression == COMPRESSION_SERVER_ZSTD)
-   {
-      current->next = pgmoneta_create_zstd(false);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_LZ4 || backup->compression == COMPRESSION_SERVER_LZ4)
+   /* A streamed verification hashes the files of the backup without a restore. An incremental
+    * backup is always streamed, since its files are checked against the chain in memory
+    */
+   if ((config->verify_mode == VERIFY_MODE_STREAM || backup->type == TYPE_INCREMENTAL) &&
+       !backup->deduplication && !backup->page_filter)
    {
-      current->next = pgmoneta_create_lz4(false);
-      current = current->next;
+      head = pgmoneta_create_verify();
+      current = head;
    }
-   else if (backup->compression == COMPRESSION_CLIENT_BZIP2)
+   else
    {
-      current->next = pgmoneta_create_bzip2(false);
-      current = current->next;
-   }
+      /* The restore decrypts and decompresses the files while it copies them */
+      head = pgmoneta_create_restore();
+      current = head;
 
-   current->next = pgmoneta_restore_excluded_files();
-   current = current->next;
+      if (backup->page_filter)
+      {
+         current->next = pgmoneta_create_page(false);
+         current = current->next;
+      }
 
-   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_RESTORE);
-   current = current->next;
+      current->next = pgmoneta_restore_excluded_files();
+      current = current->next;
 
-   current->next = pgmoneta_create_verify();
-   current = current->next;
+      current->next = pgmoneta_create_verify();
+      current = current->next;
+   }
 
 #ifdef DEBUG
    current = head;
@@ -702,33 +1158,37 @@ wf_archive(struct backup* backup)
    head = pgmoneta_create_archive();
    current = head;
 
-   if (backup->compression == COMPRESSION_CLIENT_GZIP || backup->compression == COMPRESSION_SERVER_GZIP)
-   {
-      current->next = pgmoneta_create_gzip(true);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_ZSTD || backup->compression == COMPRESSION_SERVER_ZSTD)
-   {
-      current->next = pgmoneta_create_zstd(true);
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_LZ4 || backup->compression == COMPRESSION_SERVER_LZ4)
+   /* A full backup is compressed and encrypted while the archive is written */
+   if (backup->type != TYPE_FULL)
    {
-      current->next = pgmoneta_create_lz4(true);
+      if (backup->compression == COMPRESSION_CLIENT_GZIP || backup->compression == COMPRESSION_SERVER_GZIP)
+      {
+         current->next = pgmoneta_create_gzip(true);
+         current = current->next;
+      }
+      else if (backup->compression == COMPRESSION_CLIENT_ZSTD || backup->compression == COMPRESSION_SERVER_ZSTD)
+      {
+         current->next = pgmoneta_create_zstd(true);
+         current = current->next;
+      }
+      else if (backup->compression == COMPRESSION_CLIENT_LZ4 || backup->compression == COMPRESSION_SERVER_LZ4)
+      {
+         current->next = pgmoneta_create_lz4(true);
 
-      current = current->next;
-   }
-   else if (backup->compression == COMPRESSION_CLIENT_BZIP2)
-   {
-      current->next = pgmoneta_create_bzip2(true);
+         current = current->next;
+      }
+      else if (backup->compression == COMPRESSION_CLIENT_BZIP2)
+      {
+         current->next = pgmoneta_create_bzip2(true);
 
-      current = current->next;
-   }
+         current = current->next;
+      }
 
-   if (backup->encryption != ENCRYPTION_NONE)
-   {
-      current->next = pgmoneta_encryption(true);
-      current = current->next;
+      if (backup->encryption != ENCRYPTION_NONE)
+      {
+         current->next = pgmoneta_encryption(true);
+         current = current->next;
+      }
    }
 
    current->next = pgmoneta_create_permissions(PERMISSION_TYPE_ARCHIVE);
@@ -794,3 +1254,353 @@ wf_delete_backup(struct backup* backup)
 
    return head;
 }
+
+static struct workflow*
+wf_merge(void)
+{
+   struct workflow* head = NULL;
+   struct workflow* current = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   head = pgmoneta_create_manifest();
+   current = head;
+
+   if (config->page_filter)
+   {
+      current->next = pgmoneta_create_page(true);
+      current = current->next;
+   }
+
+   if (config->deduplication && config->encryption == ENCRYPTION_NONE &&
+       config->storage_engine == STORAGE_ENGINE_LOCAL)
+   {
+      current->next = pgmoneta_create_dedup(true);
+      current = current->next;
+   }
+
+   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+   {
+      current->next = pgmoneta_create_gzip(true);
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+   {
+      current->next = pgmoneta_create_zstd(true);
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+   {
+      current->next = pgmoneta_create_lz4(true);
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+   {
+      current->next = pgmoneta_create_bzip2(true);
+      current = current->next;
+   }
+
+   if (config->encryption != ENCRYPTION_NONE)
+   {
+      current->next = pgmoneta_encryption(true);
+      current = current->next;
+   }
+
+#ifdef DEBUG
+   if (config->link)
+   {
+      current->next = pgmoneta_create_link();
+      current = current->next;
+   }
+#else
+   current->next = pgmoneta_create_link();
+   current = current->next;
+#endif
+
+   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
+   current = current->next;
+
+#ifdef DEBUG
+   current = head;
+   while (current != NULL)
+   {
+      assert(current->name != NULL);
+      assert(current->setup != NULL);
+      assert(current->execute != NULL);
+      assert(current->teardown != NULL);
+      current = current->next;
+   }
+#endif
+
+   return head;
+}
+
+static void
+workflow_storage(struct workflow** current, struct workflow* permissions)
+{
+   struct workflow* c = *current;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   {
+      c->next = pgmoneta_create_sha256();
+      c = c->next;
+
+      c->next = pgmoneta_storage_create_ssh(WORKFLOW_TYPE_BACKUP);
+      c->next->resource = WORKFLOW_RESOURCE_UPLOAD;
+      c = c->next;
+   }
+
+   /*
+    * the uploads only need the finished backup, not each other. S3 drives its
+    * requests from the node's own thread, so it overlaps the uploads that run
+    * a worker pool, and those take turns
+    */
+   if (config->storage_engine & STORAGE_ENGINE_S3)
+   {
+      c->next = pgmoneta_storage_create_s3();
+      c->next->resource = WORKFLOW_RESOURCE_UPLOAD_MULTI;
+      pgmoneta_workflow_depends(c->next, permissions);
+      c = c->next;
+   }
+
+   if (config->storage_engine & STORAGE_ENGINE_AZURE)
+   {
+      c->next = pgmoneta_storage_create_azure();
+      c->next->resource = WORKFLOW_RESOURCE_UPLOAD;
+      pgmoneta_workflow_depends(c->next, permissions);
+      c = c->next;
+   }
+
+   *current = c;
+}
+
+static void
+workflow_stream(struct workflow* workflow)
+{
+   // the nodes after a streaming node get each file while it is still in the page cache
+   for (struct workflow* current = workflow->next; current != NULL; current = current->next)
+   {
+      if (current->process != NULL)
+      {
+         current->streamed = true;
+      }
+   }
+}
+
+static bool
+workflow_ready(struct workflow_run* run, int index)
+{
+   struct workflow* wf = run->workflows[index];
+
+   if (run->states[index] != WORKFLOW_STATE_WAITING)
+   {
+      return false;
+   }
+
+   if (wf->number_of_dependencies == 0)
+   {
+      if (index > 0 && run->states[index - 1] != WORKFLOW_STATE_DONE)
+      {
+         return false;
+      }
+   }
+   else
+   {
+      for (int i = 0; i < wf->number_of_dependencies; i++)
+      {
+         for (int j = 0; j < run->number_of_workflows; j++)
+         {
+            if (run->workflows[j] == wf->dependencies[i] && run->states[j] != WORKFLOW_STATE_DONE)
+            {
+               return false;
+            }
+         }
+      }
+   }
+
+   // one node per resource class at a time, the uploads through curl_multi have their own class
+   for (int i = 0; i < run->number_of_workflows; i++)
+   {
+      if (run->states[i] == WORKFLOW_STATE_RUNNING && run->workflows[i]->resource == wf->resource)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static int
+workflow_start(struct workflow_run* run, int index)
+{
+   pthread_t thread;
+   struct workflow_task* task = NULL;
+
+   run->states[index] = WORKFLOW_STATE_RUNNING;
+
+   task = (struct workflow_task*)malloc(sizeof(struct workflow_task));
+   if (task == NULL)
+   {
+      goto error;
+   }
+
+   task->run = run;
+   task->index = index;
+
+   if (pthread_create(&thread, NULL, workflow_task, task) != 0)
+   {
+      pgmoneta_log_error("Could not start the %s workflow node", run->workflows[index]->name());
+      goto error;
+   }
+   pthread_detach(thread);
+
+   return 0;
+
+error:
+
+   // never started, so it counts as done for the wait at the end
+   run->states[index] = WORKFLOW_STATE_DONE;
+   free(task);
+
+   return 1;
+}
+
+static void*
+workflow_task(void* arg)
+{
+   int ret;
+   struct workflow_task* task = (struct workflow_task*)arg;
+   struct workflow_run* run = task->run;
+   struct workflow* wf = run->workflows[task->index];
+
+   ret = pgmoneta_workflow_execute(wf, run->nodes);
+   if (ret)
+   {
+      pgmoneta_log_error("Workflow node %s failed", wf->name());
+   }
+
+   pgmoneta_memory_destroy();
+
+   pthread_mutex_lock(&run->lock);
+   run->states[task->index] = WORKFLOW_STATE_DONE;
+   if (ret)
+   {
+      run->failed = true;
+   }
+   pthread_cond_signal(&run->finished);
+   pthread_mutex_unlock(&run->lock);
+
+   free(task);
+
+   return NULL;
+}
+
+static char*
+workflow_metrics_directory(struct art* nodes)
+{
+   if (pgmoneta_art_contains_key(nodes, NODE_TARGET_BASE))
+   {
+      return (char*)pgmoneta_art_search(nodes, NODE_TARGET_BASE);
+   }
+
+   if (pgmoneta_art_contains_key(nodes, NODE_BACKUP_DATA))
+   {
+      return (char*)pgmoneta_art_search(nodes, NODE_BACKUP_DATA);
+   }
+
+   return NULL;
+}
+
+static void
+workflow_directory_metrics(char* directory, uint64_t* bytes, uint64_t* files)
+{
+   char path[MAX_PATH];
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+   struct stat st;
+
+   dir = opendir(directory);
+   if (dir == NULL)
+   {
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+      if (lstat(path, &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         workflow_directory_metrics(path, bytes, files);
+      }
+      else if (S_ISREG(st.st_mode))
+      {
+         *bytes += st.st_size;
+         *files += 1;
+      }
+   }
+
+   closedir(dir);
+}
+
+static void
+workflow_progress_start(int server, int number_of_nodes)
+{
+   struct progress* progress;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   progress = &config->servers[server].progress;
+
+   // the counters cover all the workflows that run at the same time
+   if (atomic_fetch_add(&progress->active, 1) == 0)
+   {
+      atomic_store(&progress->start, (long long)time(NULL));
+      atomic_store(&progress->bytes, 0);
+      atomic_store(&progress->files, 0);
+      atomic_store(&progress->nodes, 0);
+      atomic_store(&progress->number_of_nodes, 0);
+      memset(&progress->node[0], 0, sizeof(progress->node));
+   }
+
+   atomic_fetch_add(&progress->number_of_nodes, number_of_nodes);
+}
+
+static void
+workflow_progress_node(int server, char* name)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (server == -1 || name == NULL)
+   {
+      return;
+   }
+
+   snprintf(&config->servers[server].progress.node[0], MISC_LENGTH, "%s", name);
+}
+
+static void
+workflow_progress_finish(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   atomic_fetch_sub(&config->servers[server].progress.active, 1);
+}
@@ -28,173 +28,230 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <compression.h>
+#include <io.h>
 #include <logging.h>
 #include <management.h>
+#include <memory.h>
+#include <scheduler.h>
 #include <utils.h>
+#include <wal.h>
+#include <walk.h>
 #include <workers.h>
 #include <zstandard_compression.h>
 
 /* system */
 #include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <string.h>
+#include <zdict.h>
 #include <zstd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define ZSTD_DEFAULT_NUMBER_OF_WORKERS 4
+#define ZSTD_SEEKABLE_SKIPPABLE_MAGIC 0x184D2A5E
+#define ZSTD_SEEKABLE_MAGIC           0x8F92EAB1
+#define ZSTD_SEEKABLE_ENTRY_SIZE      8
+#define ZSTD_SEEKABLE_FOOTER_SIZE     9
 
-static int zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin, size_t zout_size, void* zout);
+#define ZSTD_SPLIT_SIZE (64 * 1024 * 1024)
+
+#define ZSTD_DICTIONARY_SIZE         (112 * 1024)
+#define ZSTD_DICTIONARY_SAMPLE_SIZE  (128 * 1024)
+#define ZSTD_DICTIONARY_SAMPLES_SIZE (16 * 1024 * 1024)
+#define ZSTD_DICTIONARY_MIN_SAMPLES  16
+#define ZSTD_DICTIONARY_CACHE        8
+
+/** @struct zstd_data
+ * Defines a compression pass over a directory tree
+ */
+struct zstd_data
+{
+   int level;                /**< The compression level */
+   struct workers* workers;  /**< The workers, or NULL */
+};
+
+/** @struct zstd_split
+ * Defines the parts of a seekable file that are decompressed in parallel
+ */
+struct zstd_split
+{
+   struct worker_split split;      /**< The split */
+   uint32_t number_of_frames;      /**< The number of frames */
+   uint64_t* compressed_offsets;   /**< The compressed offset of each frame, plus the end */
+   uint64_t* decompressed_offsets; /**< The decompressed offset of each frame, plus the end */
+   uint32_t* first_frames;         /**< The first frame of each part, plus the end */
+};
+
+static ZSTD_CDict* compression_dictionary = NULL;
+static uint32_t compression_dictionary_id = 0;
+
+static pthread_mutex_t decompression_dictionaries_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t decompression_dictionary_ids[ZSTD_DICTIONARY_CACHE];
+static ZSTD_DDict* decompression_dictionaries[ZSTD_DICTIONARY_CACHE];
+static int number_of_decompression_dictionaries = 0;
+
+static int zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin, size_t zout_size, void* zout, size_t frame_size);
+static int zstd_write_seek_table(FILE* fout, uint32_t* entries, uint32_t number_of_frames);
+static void zstd_write_le32(uint8_t* data, uint32_t value);
+static uint32_t zstd_read_le32(uint8_t* data);
+static int zstd_seekable_frame(struct zstd_seekable* seekable, uint32_t frame);
+static void zstd_reference_dictionary(ZSTD_CCtx* cctx, char* from, bool always);
+static ZSTD_DDict* zstd_ddict(uint32_t id);
+static char* zstd_dictionary_path(int server, uint32_t id);
+static int zstd_dictionary_read(char* path, void** data, size_t* size);
+static int zstd_dictionary_samples(char* directory, char** samples, size_t* samples_size, size_t** sizes, unsigned* number_of_samples);
 static int zstd_decompress(char* from, char* to, ZSTD_DCtx* dctx, size_t zin_size, void* zin, size_t zout_size, void* zout);
+static int zstd_split_read(char* from, struct zstd_split** split);
+static int zstd_split_decompress(char* directory, char* from, char* to, struct zstd_split* split, struct workers* workers);
+static int zstd_decompress_frames(char* from, char* to, struct zstd_split* split, uint32_t first, uint32_t last);
+static void zstd_split_free(struct zstd_split* split);
+static ZSTD_CCtx* zstd_cctx(void);
+static ZSTD_DCtx* zstd_dctx(void);
+static void zstd_free_cctx(void* cctx);
+static int zstd_data_entry(struct walk_entry* entry, void* arg);
+static void zstd_free_dctx(void* dctx);
+
+static void do_zstd_compress(struct worker_input* wi);
+static void do_zstd_decompress(struct worker_input* wi);
+static void do_zstd_decompress_part(struct worker_input* wi);
 
 void
-pgmoneta_zstandardc_data(char* directory, struct workers* workers)
+pgmoneta_zstandardc_data(char* directory, char* manifest, struct workers* workers)
 {
-   size_t zin_size = -1;
-   void* zin = NULL;
-   size_t zout_size = -1;
-   void* zout = NULL;
-   ZSTD_CCtx* cctx = NULL;
-   char* from = NULL;
-   char* to = NULL;
-   DIR* dir;
-   struct dirent* entry;
-   int level;
-   int ws;
+   struct zstd_data data;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   if (!(dir = opendir(directory)))
-   {
-      return;
-   }
+   memset(&data, 0, sizeof(struct zstd_data));
 
-   level = config->compression_level;
-   if (level < 1)
+   data.level = config->compression_level;
+   if (data.level < 1)
    {
-      level = 1;
+      data.level = 1;
    }
-   else if (level > 19)
+   else if (data.level > 19)
    {
-      level = 19;
+      data.level = 19;
    }
 
-   ws = config->workers != 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS;
+   data.workers = workers;
 
-   zin_size = ZSTD_CStreamInSize();
-   zin = malloc(zin_size);
-   zout_size = ZSTD_CStreamOutSize();
-   zout = malloc(zout_size);
+   // the files are spread over the workers, and a file only gets Zstandard workers of its own
+   // from the slots the pools leave free
+   pgmoneta_walk_manifest(directory, manifest, 0, workers != NULL ? workers->number_of_workers : 1, zstd_data_entry, &data);
+}
 
-   cctx = ZSTD_createCCtx();
-   if (cctx == NULL)
-   {
-      goto error;
-   }
+int
+pgmoneta_zstandard_threads(size_t size, struct workers* workers)
+{
+   int wanted;
+   int threads;
+   int units;
+   struct configuration* config;
 
-   ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
-   ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
-   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, ws);
+   config = (struct configuration*)shmem;
 
-   while ((entry = readdir(dir)) != NULL)
+   wanted = config->workers != 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS;
+
+   // a small input is a single job, which a Zstandard worker only moves to another thread
+   if (size > 0)
    {
-      if (pgmoneta_ends_with(entry->d_name, "backup_manifest"))
-      {
-         continue;
-      }
+      wanted = (int)MIN((size_t)wanted, size / ZSTD_THREAD_SIZE);
+   }
 
-      if (entry->d_type == DT_DIR)
-      {
-         char path[1024];
+   // the queued files keep the workers of the pool busy
+   if (workers != NULL && atomic_load(&workers->number_of_pending) > workers->number_of_workers)
+   {
+      wanted = 0;
+   }
 
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
+   if (wanted <= 0)
+   {
+      return 0;
+   }
 
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+   threads = pgmoneta_scheduler_take(SCHEDULER_WORKERS, wanted);
 
-         pgmoneta_zstandardc_data(path, workers);
-      }
-      else if (entry->d_type == DT_REG)
-      {
-         if (pgmoneta_ends_with(entry->d_name, "backup_label"))
-         {
-            continue;
-         }
-         if (!pgmoneta_is_compressed_archive(entry->d_name) &&
-             !pgmoneta_is_encrypted_archive(entry->d_name))
-         {
-            from = NULL;
+   units = pgmoneta_memory_acquire(ZSTD_WORKER_MEMORY, threads);
+   if (units < threads)
+   {
+      pgmoneta_scheduler_release(SCHEDULER_WORKERS, threads - units);
+   }
 
-            from = pgmoneta_append(from, directory);
-            from = pgmoneta_append(from, "/");
-            from = pgmoneta_append(from, entry->d_name);
+   return units;
+}
 
-            to = NULL;
+void
+pgmoneta_zstandard_threads_release(int threads)
+{
+   if (threads > 0)
+   {
+      pgmoneta_scheduler_release(SCHEDULER_WORKERS, threads);
+      pgmoneta_memory_release((size_t)threads * ZSTD_WORKER_MEMORY);
+   }
+}
 
-            to = pgmoneta_append(to, directory);
-            to = pgmoneta_append(to, "/");
-            to = pgmoneta_append(to, entry->d_name);
-            to = pgmoneta_append(to, ".zstd");
+static int
+zstd_data_entry(struct walk_entry* entry, void* arg)
+{
+   char* to = NULL;
+   struct worker_input* wi = NULL;
+   struct zstd_data* data = (struct zstd_data*)arg;
 
-            if (pgmoneta_exists(from))
-            {
-               if (zstd_compress(from, to, cctx, zin_size, zin, zout_size, zout))
-               {
-                  pgmoneta_log_error("ZSTD: Could not compress %s/%s", directory, entry->d_name);
-                  break;
-               }
+   if (pgmoneta_ends_with(entry->name, "backup_manifest"))
+   {
+      return WALK_SKIP;
+   }
 
-               if (pgmoneta_exists(from))
-               {
-                  pgmoneta_delete_file(from, NULL);
-               }
-               else
-               {
-                  pgmoneta_log_debug("%s doesn't exists", from);
-               }
+   if (entry->type != WALK_FILE || pgmoneta_ends_with(entry->name, "backup_label") ||
+       pgmoneta_is_compressed_archive(entry->name) || pgmoneta_is_encrypted_archive(entry->name))
+   {
+      return WALK_CONTINUE;
+   }
 
-               memset(zin, 0, zin_size);
-               memset(zout, 0, zout_size);
-            }
+   if (pgmoneta_compression_incompressible(entry->path))
+   {
+      return WALK_CONTINUE;
+   }
 
-            free(from);
-            free(to);
+   to = pgmoneta_append(to, entry->path);
+   to = pgmoneta_append(to, ".zstd");
 
-            from = NULL;
-            to = NULL;
+   if (!pgmoneta_create_worker_input(entry->directory, entry->path, to, data->level, data->workers, &wi))
+   {
+      if (data->workers != NULL)
+      {
+         if (data->workers->outcome)
+         {
+            pgmoneta_workers_add(data->workers, do_zstd_compress, wi);
          }
       }
+      else
+      {
+         do_zstd_compress(wi);
+      }
+   }
+   else
+   {
+      goto error;
    }
 
-   closedir(dir);
-
-   ZSTD_freeCCtx(cctx);
-
-   free(zin);
-   free(zout);
-
-   free(from);
    free(to);
 
-   return;
+   return WALK_CONTINUE;
 
 error:
 
-   if (cctx != NULL)
-   {
-      ZSTD_freeCCtx(cctx);
-   }
-
-   free(zin);
-   free(zout);
-
-   free(from);
    free(to);
+
+   return WALK_STOP;
 }
 
 void
@@ -221,7 +278,7 @@ pgmoneta_zstandardc_tablespaces(char* root, struct workers* workers)
 
          snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
 
-         pgmoneta_zstandardc_data(path, workers);
+         pgmoneta_zstandardc_data(path, NULL, workers);
       }
    }
 
@@ -229,7 +286,7 @@ pgmoneta_zstandardc_tablespaces(char* root, struct workers* workers)
 }
 
 void
-pgmoneta_zstandardc_wal(char* directory)
+pgmoneta_zstandardc_wal(int server, char* directory)
 {
    size_t zin_size = -1;
    void* zin = NULL;
@@ -241,7 +298,7 @@ pgmoneta_zstandardc_wal(char* directory)
    DIR* dir;
    struct dirent* entry;
    int level;
-   int workers;
+   int threads = 0;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -251,7 +308,7 @@ pgmoneta_zstandardc_wal(char* directory)
       return;
    }
 
-   level = config->compression_level;
+   level = pgmoneta_get_wal_compression_level(server);
    if (level < 1)
    {
       level = 1;
@@ -261,22 +318,22 @@ pgmoneta_zstandardc_wal(char* directory)
       level = 19;
    }
 
-   workers = config->workers != 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS;
-
    zin_size = ZSTD_CStreamInSize();
-   zin = malloc(zin_size);
+   zin = pgmoneta_worker_buffer(WORKER_BUFFER_IN, zin_size);
    zout_size = ZSTD_CStreamOutSize();
-   zout = malloc(zout_size);
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, zout_size);
 
-   cctx = ZSTD_createCCtx();
+   cctx = zstd_cctx();
    if (cctx == NULL)
    {
       goto error;
    }
 
+   threads = pgmoneta_zstandard_threads((size_t)config->servers[server].wal_size, NULL);
+
    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
-   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
 
    while ((entry = readdir(dir)) != NULL)
    {
@@ -305,7 +362,9 @@ pgmoneta_zstandardc_wal(char* directory)
 
          if (pgmoneta_exists(from))
          {
-            if (zstd_compress(from, to, cctx, zin_size, zin, zout_size, zout))
+            zstd_reference_dictionary(cctx, from, true);
+
+            if (zstd_compress(from, to, cctx, zin_size, zin, zout_size, zout, 0))
             {
                pgmoneta_log_error("ZSTD: Could not compress %s/%s", directory, entry->d_name);
                break;
@@ -313,7 +372,10 @@ pgmoneta_zstandardc_wal(char* directory)
 
             if (pgmoneta_exists(from))
             {
-               pgmoneta_delete_file(from, NULL);
+               if (pgmoneta_wal_recycle(directory, from))
+               {
+                  pgmoneta_delete_file(from, NULL);
+               }
             }
             else
             {
@@ -335,28 +397,19 @@ pgmoneta_zstandardc_wal(char* directory)
 
    closedir(dir);
 
-   ZSTD_freeCCtx(cctx);
-
-   free(zin);
-   free(zout);
-
    free(from);
    free(to);
 
+   pgmoneta_zstandard_threads_release(threads);
+
    return;
 
 error:
 
-   if (cctx != NULL)
-   {
-      ZSTD_freeCCtx(cctx);
-   }
-
-   free(zin);
-   free(zout);
-
    free(from);
    free(to);
+
+   pgmoneta_zstandard_threads_release(threads);
 }
 
 void
@@ -458,11 +511,11 @@ pgmoneta_zstandardd_file(char* from, char* to)
    if (pgmoneta_ends_with(from, ".zstd"))
    {
       zin_size = ZSTD_DStreamInSize();
-      zin = malloc(zin_size);
+      zin = pgmoneta_worker_buffer(WORKER_BUFFER_IN, zin_size);
       zout_size = ZSTD_DStreamOutSize();
-      zout = malloc(zout_size);
+      zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, zout_size);
 
-      dctx = ZSTD_createDCtx();
+      dctx = zstd_dctx();
       if (dctx == NULL)
       {
          goto error;
@@ -488,38 +541,22 @@ pgmoneta_zstandardd_file(char* from, char* to)
       goto error;
    }
 
-   ZSTD_freeDCtx(dctx);
-
-   free(zin);
-   free(zout);
-
    return 0;
 
 error:
 
-   if (dctx != NULL)
-   {
-      ZSTD_freeDCtx(dctx);
-   }
-
-   free(zin);
-   free(zout);
-
    return 1;
 }
 
 void
 pgmoneta_zstandardd_directory(char* directory, struct workers* workers)
 {
-   ZSTD_DCtx* dctx = NULL;
-   size_t zin_size = -1;
-   void* zin = NULL;
-   size_t zout_size = -1;
-   void* zout = NULL;
    char* from = NULL;
    char* to = NULL;
    char* name = NULL;
    DIR* dir;
+   struct zstd_split* split = NULL;
+   struct worker_input* wi = NULL;
    struct dirent* entry;
 
    if (!(dir = opendir(directory)))
@@ -527,28 +564,6 @@ pgmoneta_zstandardd_directory(char* directory, struct workers* workers)
       return;
    }
 
-   zin_size = ZSTD_DStreamInSize();
-   zin = malloc(zin_size);
-
-   if (zin == NULL)
-   {
-      goto error;
-   }
-
-   zout_size = ZSTD_DStreamOutSize();
-   zout = malloc(zout_size);
-
-   if (zout == NULL)
-   {
-      goto error;
-   }
-
-   dctx = ZSTD_createDCtx();
-   if (dctx == NULL)
-   {
-      goto error;
-   }
-
    while ((entry = readdir(dir)) != NULL)
    {
       if (entry->d_type == DT_DIR || entry->d_type == DT_LNK)
@@ -596,24 +611,39 @@ pgmoneta_zstandardd_directory(char* directory, struct workers* workers)
             }
             to = pgmoneta_append(to, name);
 
-            if (zstd_decompress(from, to, dctx, zin_size, zin, zout_size, zout))
+            // the frames of a seekable file are decompressed as parts in parallel
+            if (workers != NULL && !zstd_split_read(from, &split))
             {
-               pgmoneta_log_error("ZSTD: Could not decompress %s/%s", directory, entry->d_name);
-               break;
+               if (zstd_split_decompress(directory, from, to, split, workers))
+               {
+                  pgmoneta_log_error("ZSTD: Could not decompress %s/%s", directory, entry->d_name);
+                  workers->outcome = false;
+               }
+               split = NULL;
             }
-
-            if (pgmoneta_exists(from))
+            else if (!pgmoneta_create_worker_input(directory, from, to, 0, workers, &wi))
             {
-               pgmoneta_delete_file(from, NULL);
+               if (workers != NULL)
+               {
+                  if (workers->outcome)
+                  {
+                     pgmoneta_workers_add(workers, do_zstd_decompress, wi);
+                  }
+                  else
+                  {
+                     free(wi);
+                  }
+               }
+               else
+               {
+                  do_zstd_decompress(wi);
+               }
             }
             else
             {
-               pgmoneta_log_debug("%s doesn't exists", from);
+               goto error;
             }
 
-            memset(zin, 0, zin_size);
-            memset(zout, 0, zout_size);
-
             free(name);
             free(from);
             free(to);
@@ -627,30 +657,137 @@ pgmoneta_zstandardd_directory(char* directory, struct workers* workers)
 
    closedir(dir);
 
-   ZSTD_freeDCtx(dctx);
+   free(from);
+   free(to);
+   free(name);
+
+   return;
+
+error:
 
-   free(zin);
-   free(zout);
+   closedir(dir);
 
+   free(name);
    free(from);
    free(to);
-   free(name);
+}
+
+static void
+do_zstd_compress(struct worker_input* wi)
+{
+   int threads = 0;
+   size_t size;
+   size_t zin_size;
+   void* zin = NULL;
+   size_t zout_size;
+   void* zout = NULL;
+   ZSTD_CCtx* cctx = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!pgmoneta_exists(wi->from))
+   {
+      pgmoneta_log_debug("%s doesn't exists", wi->from);
+      goto done;
+   }
+
+   zin_size = ZSTD_CStreamInSize();
+   zin = pgmoneta_worker_buffer(WORKER_BUFFER_IN, zin_size);
+   zout_size = ZSTD_CStreamOutSize();
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, zout_size);
+
+   cctx = zstd_cctx();
+   if (zin == NULL || zout == NULL || cctx == NULL)
+   {
+      goto error;
+   }
+
+   size = pgmoneta_get_file_size(wi->from);
+   threads = pgmoneta_zstandard_threads(size, wi->workers);
+
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, pgmoneta_compression_adaptive_level(wi->level));
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
+   zstd_reference_dictionary(cctx, wi->from, false);
+
+   if (zstd_compress(wi->from, wi->to, cctx, zin_size, zin, zout_size, zout, (size_t)config->seekable_frame_size))
+   {
+      goto error;
+   }
+
+   pgmoneta_zstandard_threads_release(threads);
+
+   pgmoneta_compression_adaptive_update(size);
+
+   pgmoneta_delete_file(wi->from, NULL);
+
+done:
+
+   free(wi);
 
    return;
 
 error:
 
-   if (dctx != NULL)
+   pgmoneta_zstandard_threads_release(threads);
+
+   pgmoneta_log_error("ZSTD: Could not compress %s", wi->from);
+   if (wi->workers != NULL)
    {
-      ZSTD_freeDCtx(dctx);
+      wi->workers->outcome = false;
    }
 
-   free(zin);
-   free(zout);
+   free(wi);
+}
 
-   free(name);
-   free(from);
-   free(to);
+static void
+do_zstd_decompress(struct worker_input* wi)
+{
+   if (pgmoneta_zstandardd_file(wi->from, wi->to))
+   {
+      pgmoneta_log_error("ZSTD: Could not decompress %s", wi->from);
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+
+   free(wi);
+}
+
+static void
+do_zstd_decompress_part(struct worker_input* wi)
+{
+   struct zstd_split* split = (struct zstd_split*)wi->argument;
+   int part = wi->level;
+
+   if (zstd_decompress_frames(wi->from, wi->to, split, split->first_frames[part], split->first_frames[part + 1]))
+   {
+      pgmoneta_log_error("ZSTD: Could not decompress %s at %lld", wi->from, (long long)wi->offset);
+      atomic_store(&split->split.failed, true);
+   }
+
+   // the last part to finish removes the compressed file, or the partial result
+   if (atomic_fetch_sub(&split->split.remaining, 1) == 1)
+   {
+      if (atomic_load(&split->split.failed))
+      {
+         pgmoneta_log_error("ZSTD: Could not decompress %s", wi->from);
+         pgmoneta_delete_file(wi->to, NULL);
+         if (wi->workers != NULL)
+         {
+            wi->workers->outcome = false;
+         }
+      }
+      else
+      {
+         pgmoneta_delete_file(wi->from, NULL);
+      }
+      zstd_split_free(split);
+   }
+
+   free(wi);
 }
 
 void
@@ -746,7 +883,7 @@ pgmoneta_zstandardc_file(char* from, char* to)
    void* zout = NULL;
    ZSTD_CCtx* cctx = NULL;
    int level;
-   int workers;
+   int threads = 0;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -761,24 +898,24 @@ pgmoneta_zstandardc_file(char* from, char* to)
       level = 19;
    }
 
-   workers = config->workers != 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS;
-
    zin_size = ZSTD_CStreamInSize();
-   zin = malloc(zin_size);
+   zin = pgmoneta_worker_buffer(WORKER_BUFFER_IN, zin_size);
    zout_size = ZSTD_CStreamOutSize();
-   zout = malloc(zout_size);
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, zout_size);
 
-   cctx = ZSTD_createCCtx();
+   cctx = zstd_cctx();
    if (cctx == NULL)
    {
       goto error;
    }
 
+   threads = pgmoneta_zstandard_threads(pgmoneta_get_file_size(from), NULL);
+
    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
-   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
 
-   if (zstd_compress(from, to, cctx, zin_size, zin, zout_size, zout))
+   if (zstd_compress(from, to, cctx, zin_size, zin, zout_size, zout, (size_t)config->seekable_frame_size))
    {
       goto error;
    }
@@ -794,26 +931,436 @@ pgmoneta_zstandardc_file(char* from, char* to)
       }
    }
 
-   ZSTD_freeCCtx(cctx);
+   pgmoneta_zstandard_threads_release(threads);
+
+   return 0;
+
+error:
+
+   pgmoneta_zstandard_threads_release(threads);
+
+   return 1;
+}
+
+int
+pgmoneta_zstandardd_seekable_open(char* from, struct zstd_seekable** seekable)
+{
+   struct zstd_seekable* s = NULL;
+   uint8_t footer[ZSTD_SEEKABLE_FOOTER_SIZE];
+   uint8_t header[8];
+   uint8_t entry[ZSTD_SEEKABLE_ENTRY_SIZE];
+   uint32_t number_of_frames;
+   off_t file_size;
+   off_t table_size;
+
+   *seekable = NULL;
+
+   s = (struct zstd_seekable*)malloc(sizeof(struct zstd_seekable));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   memset(s, 0, sizeof(struct zstd_seekable));
+   s->frame = -1;
+   snprintf(s->path, sizeof(s->path), "%s", from);
+
+   s->file = fopen(from, "rb");
+   if (s->file == NULL)
+   {
+      goto error;
+   }
+
+   if (fseeko(s->file, 0, SEEK_END) != 0)
+   {
+      goto error;
+   }
+
+   file_size = ftello(s->file);
+   if (file_size < (off_t)(sizeof(header) + ZSTD_SEEKABLE_FOOTER_SIZE))
+   {
+      goto error;
+   }
+
+   if (fseeko(s->file, file_size - ZSTD_SEEKABLE_FOOTER_SIZE, SEEK_SET) != 0 ||
+       fread(footer, 1, sizeof(footer), s->file) != sizeof(footer))
+   {
+      goto error;
+   }
+
+   // only seek tables without frame checksums are written
+   if (zstd_read_le32(&footer[5]) != ZSTD_SEEKABLE_MAGIC || (footer[4] & 0x80) != 0)
+   {
+      goto error;
+   }
+
+   number_of_frames = zstd_read_le32(&footer[0]);
+   table_size = (off_t)number_of_frames * ZSTD_SEEKABLE_ENTRY_SIZE + ZSTD_SEEKABLE_FOOTER_SIZE;
+
+   if (file_size < table_size + (off_t)sizeof(header))
+   {
+      goto error;
+   }
+
+   if (fseeko(s->file, file_size - table_size - sizeof(header), SEEK_SET) != 0 ||
+       fread(header, 1, sizeof(header), s->file) != sizeof(header))
+   {
+      goto error;
+   }
+
+   if (zstd_read_le32(&header[0]) != ZSTD_SEEKABLE_SKIPPABLE_MAGIC || zstd_read_le32(&header[4]) != (uint32_t)table_size)
+   {
+      goto error;
+   }
+
+   s->number_of_frames = number_of_frames;
+   s->compressed_offsets = (uint64_t*)malloc((number_of_frames + 1) * sizeof(uint64_t));
+   s->decompressed_offsets = (uint64_t*)malloc((number_of_frames + 1) * sizeof(uint64_t));
+
+   if (s->compressed_offsets == NULL || s->decompressed_offsets == NULL)
+   {
+      goto error;
+   }
+
+   s->compressed_offsets[0] = 0;
+   s->decompressed_offsets[0] = 0;
+
+   for (uint32_t i = 0; i < number_of_frames; i++)
+   {
+      if (fread(entry, 1, sizeof(entry), s->file) != sizeof(entry))
+      {
+         goto error;
+      }
+
+      s->compressed_offsets[i + 1] = s->compressed_offsets[i] + zstd_read_le32(&entry[0]);
+      s->decompressed_offsets[i + 1] = s->decompressed_offsets[i] + zstd_read_le32(&entry[4]);
+   }
+
+   if (s->compressed_offsets[number_of_frames] != (uint64_t)(file_size - table_size - sizeof(header)))
+   {
+      goto error;
+   }
+
+   s->dctx = ZSTD_createDCtx();
+   if (s->dctx == NULL)
+   {
+      goto error;
+   }
 
-   free(zin);
-   free(zout);
+   *seekable = s;
 
    return 0;
 
 error:
 
-   if (cctx != NULL)
+   pgmoneta_zstandardd_seekable_close(s);
+
+   return 1;
+}
+
+size_t
+pgmoneta_zstandardd_seekable_size(struct zstd_seekable* seekable)
+{
+   if (seekable == NULL)
+   {
+      return 0;
+   }
+
+   return (size_t)seekable->decompressed_offsets[seekable->number_of_frames];
+}
+
+int
+pgmoneta_zstandardd_seekable_read(struct zstd_seekable* seekable, off_t offset, size_t length, void* buffer)
+{
+   uint32_t low;
+   uint32_t high;
+   uint32_t frame;
+   size_t position;
+   size_t n;
+   size_t done = 0;
+
+   if (seekable == NULL || offset < 0 || (uint64_t)offset + length > pgmoneta_zstandardd_seekable_size(seekable))
+   {
+      return 1;
+   }
+
+   while (done < length)
+   {
+      position = (size_t)offset + done;
+
+      // find the frame holding the position
+      low = 0;
+      high = seekable->number_of_frames;
+      while (high - low > 1)
+      {
+         uint32_t middle = low + (high - low) / 2;
+
+         if (seekable->decompressed_offsets[middle] <= position)
+         {
+            low = middle;
+         }
+         else
+         {
+            high = middle;
+         }
+      }
+      frame = low;
+
+      if (zstd_seekable_frame(seekable, frame))
+      {
+         return 1;
+      }
+
+      n = MIN(length - done, (size_t)(seekable->decompressed_offsets[frame + 1] - position));
+      memcpy((char*)buffer + done, seekable->decompressed + (position - seekable->decompressed_offsets[frame]), n);
+      done += n;
+   }
+
+   return 0;
+}
+
+void
+pgmoneta_zstandardd_seekable_close(struct zstd_seekable* seekable)
+{
+   if (seekable == NULL)
+   {
+      return;
+   }
+
+   if (seekable->file != NULL)
+   {
+      fclose(seekable->file);
+   }
+
+   if (seekable->dctx != NULL)
+   {
+      ZSTD_freeDCtx(seekable->dctx);
+   }
+
+   free(seekable->compressed_offsets);
+   free(seekable->decompressed_offsets);
+   free(seekable->compressed);
+   free(seekable->decompressed);
+   free(seekable);
+}
+
+int
+pgmoneta_zstandard_dictionary_train(int server, char* directory, uint32_t* id)
+{
+   char* samples = NULL;
+   size_t samples_size = 0;
+   size_t* sizes = NULL;
+   unsigned number_of_samples = 0;
+   void* dictionary = NULL;
+   size_t dictionary_size;
+   char* path = NULL;
+   char* d = NULL;
+   FILE* file = NULL;
+
+   *id = 0;
+
+   if (zstd_dictionary_samples(directory, &samples, &samples_size, &sizes, &number_of_samples))
+   {
+      goto error;
+   }
+
+   if (number_of_samples < ZSTD_DICTIONARY_MIN_SAMPLES)
+   {
+      pgmoneta_log_debug("ZSTD: Only %u dictionary samples in %s", number_of_samples, directory);
+      goto done;
+   }
+
+   dictionary = malloc(ZSTD_DICTIONARY_SIZE);
+   if (dictionary == NULL)
    {
-      ZSTD_freeCCtx(cctx);
+      goto error;
+   }
+
+   dictionary_size = ZDICT_trainFromBuffer(dictionary, ZSTD_DICTIONARY_SIZE, samples, sizes, number_of_samples);
+   if (ZDICT_isError(dictionary_size))
+   {
+      // too little or too uniform data is not worth a dictionary
+      pgmoneta_log_debug("ZSTD: Could not train a dictionary from %s: %s", directory, ZDICT_getErrorName(dictionary_size));
+      goto done;
+   }
+
+   *id = ZDICT_getDictID(dictionary, dictionary_size);
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "dictionary/");
+
+   if (pgmoneta_mkdir(d))
+   {
+      goto error;
+   }
+
+   path = zstd_dictionary_path(server, *id);
+
+   if (!pgmoneta_exists(path))
+   {
+      file = fopen(path, "wb");
+      if (file == NULL)
+      {
+         goto error;
+      }
+
+      if (fwrite(dictionary, 1, dictionary_size, file) != dictionary_size)
+      {
+         goto error;
+      }
+
+      fclose(file);
+      file = NULL;
+   }
+
+   // the WAL of the server follows the dictionary of the latest backup
+   free(path);
+   path = pgmoneta_append(NULL, d);
+   path = pgmoneta_append(path, "latest");
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   fprintf(file, "%u\n", *id);
+   fclose(file);
+   file = NULL;
+
+   pgmoneta_log_debug("ZSTD: Dictionary %u from %u samples", *id, number_of_samples);
+
+done:
+
+   free(samples);
+   free(sizes);
+   free(dictionary);
+   free(path);
+   free(d);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   *id = 0;
+
+   free(samples);
+   free(sizes);
+   free(dictionary);
+   free(path);
+   free(d);
+
+   return 1;
+}
+
+uint32_t
+pgmoneta_zstandard_dictionary_latest(int server)
+{
+   char* path = NULL;
+   FILE* file = NULL;
+   unsigned int id = 0;
+
+   path = pgmoneta_get_server(server);
+   path = pgmoneta_append(path, "dictionary/latest");
+
+   file = fopen(path, "r");
+   if (file != NULL)
+   {
+      if (fscanf(file, "%u", &id) != 1)
+      {
+         id = 0;
+      }
+      fclose(file);
+   }
+
+   free(path);
+
+   return (uint32_t)id;
+}
+
+int
+pgmoneta_zstandard_dictionary_use(int server, uint32_t id)
+{
+   char* path = NULL;
+   void* data = NULL;
+   size_t size = 0;
+   int level;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (id == compression_dictionary_id)
+   {
+      return 0;
    }
 
-   free(zin);
-   free(zout);
+   if (compression_dictionary != NULL)
+   {
+      ZSTD_freeCDict(compression_dictionary);
+      compression_dictionary = NULL;
+      compression_dictionary_id = 0;
+   }
+
+   if (id == 0)
+   {
+      return 0;
+   }
+
+   level = config->compression_level;
+   if (level < 1)
+   {
+      level = 1;
+   }
+   else if (level > 19)
+   {
+      level = 19;
+   }
+
+   path = zstd_dictionary_path(server, id);
+
+   if (zstd_dictionary_read(path, &data, &size))
+   {
+      pgmoneta_log_error("ZSTD: Could not read dictionary %s", path);
+      goto error;
+   }
+
+   compression_dictionary = ZSTD_createCDict(data, size, level);
+   if (compression_dictionary == NULL)
+   {
+      goto error;
+   }
+
+   compression_dictionary_id = id;
+
+   free(data);
+   free(path);
+
+   return 0;
+
+error:
+
+   free(data);
+   free(path);
 
    return 1;
 }
 
+ZSTD_DDict*
+pgmoneta_zstandard_dictionary_get(uint32_t id)
+{
+   if (id == 0)
+   {
+      return NULL;
+   }
+
+   return zstd_ddict(id);
+}
+
 int
 pgmoneta_zstdc_string(char* s, unsigned char** buffer, size_t* buffer_size)
 {
@@ -884,15 +1431,18 @@ pgmoneta_zstdd_string(unsigned char* compressed_buffer, size_t compressed_size,
 }
 
 static int
-zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin, size_t zout_size, void* zout)
+zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin, size_t zout_size, void* zout, size_t frame_size)
 {
-   FILE* fin = NULL;
+   struct io_reader* fin = NULL;
    FILE* fout = NULL;
    size_t toRead;
+   size_t frame_in = 0;
+   size_t frame_out = 0;
+   uint32_t* entries = NULL;
+   uint32_t number_of_frames = 0;
+   uint32_t capacity = 0;
 
-   fin = fopen(from, "rb");
-
-   if (fin == NULL)
+   if (pgmoneta_io_reader_open(from, 0, 0, &fin))
    {
       goto error;
    }
@@ -904,61 +1454,155 @@ zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin,
       goto error;
    }
 
-   toRead = zin_size;
    for (;;)
    {
-      size_t read = fread(zin, sizeof(char), toRead, fin);
+      toRead = zin_size;
+      if (frame_size > 0)
+      {
+         toRead = MIN(toRead, frame_size - frame_in);
+      }
+
+      size_t read = pgmoneta_io_reader_read(fin, zin, toRead);
       int lastChunk = (read < toRead);
-      ZSTD_EndDirective mode = lastChunk ? ZSTD_e_end : ZSTD_e_continue;
+      int endFrame = lastChunk || (frame_size > 0 && frame_in + read == frame_size);
+      ZSTD_EndDirective mode = endFrame ? ZSTD_e_end : ZSTD_e_continue;
       ZSTD_inBuffer input = {zin, read, 0};
       int finished;
+
+      // the previous frame ended with the file, so there is nothing left to write
+      if (read == 0 && frame_in == 0 && number_of_frames > 0)
+      {
+         break;
+      }
+
       do
       {
          ZSTD_outBuffer output = {zout, zout_size, 0};
          size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+         if (ZSTD_isError(remaining))
+         {
+            goto error;
+         }
          fwrite(zout, sizeof(char), output.pos, fout);
-         finished = lastChunk ? (remaining == 0) : (input.pos == input.size);
+         frame_out += output.pos;
+         finished = endFrame ? (remaining == 0) : (input.pos == input.size);
       }
       while (!finished);
 
+      frame_in += read;
+
+      if (frame_size > 0 && endFrame)
+      {
+         if (number_of_frames == capacity)
+         {
+            uint32_t* e = NULL;
+
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            e = (uint32_t*)realloc(entries, capacity * 2 * sizeof(uint32_t));
+            if (e == NULL)
+            {
+               goto error;
+            }
+            entries = e;
+         }
+
+         entries[number_of_frames * 2] = (uint32_t)frame_out;
+         entries[number_of_frames * 2 + 1] = (uint32_t)frame_in;
+         number_of_frames++;
+
+         frame_in = 0;
+         frame_out = 0;
+      }
+
       if (lastChunk)
       {
          break;
       }
    }
 
-   fclose(fout);
-   fclose(fin);
-
-   return 0;
+   if (pgmoneta_io_reader_error(fin))
+   {
+      goto error;
+   }
+
+   if (frame_size > 0 && zstd_write_seek_table(fout, entries, number_of_frames))
+   {
+      goto error;
+   }
+
+   free(entries);
+
+   fflush(fout);
+   pgmoneta_io_drop(fileno(fout), true);
+   fclose(fout);
+   pgmoneta_io_reader_close(fin);
+
+   return 0;
 
 error:
 
+   free(entries);
+
    if (fout != NULL)
    {
       fclose(fout);
    }
 
-   if (fin != NULL)
+   pgmoneta_io_reader_close(fin);
+
+   return 1;
+}
+
+static int
+zstd_write_seek_table(FILE* fout, uint32_t* entries, uint32_t number_of_frames)
+{
+   uint8_t header[8];
+   uint8_t footer[ZSTD_SEEKABLE_FOOTER_SIZE];
+   uint8_t entry[ZSTD_SEEKABLE_ENTRY_SIZE];
+
+   // the seek table is a skippable frame, so plain zstd readers pass over it
+   zstd_write_le32(&header[0], ZSTD_SEEKABLE_SKIPPABLE_MAGIC);
+   zstd_write_le32(&header[4], number_of_frames * ZSTD_SEEKABLE_ENTRY_SIZE + ZSTD_SEEKABLE_FOOTER_SIZE);
+
+   if (fwrite(header, 1, sizeof(header), fout) != sizeof(header))
    {
-      fclose(fin);
+      return 1;
    }
 
-   return 1;
+   for (uint32_t i = 0; i < number_of_frames; i++)
+   {
+      zstd_write_le32(&entry[0], entries[i * 2]);
+      zstd_write_le32(&entry[4], entries[i * 2 + 1]);
+
+      if (fwrite(entry, 1, sizeof(entry), fout) != sizeof(entry))
+      {
+         return 1;
+      }
+   }
+
+   zstd_write_le32(&footer[0], number_of_frames);
+   footer[4] = 0;
+   zstd_write_le32(&footer[5], ZSTD_SEEKABLE_MAGIC);
+
+   if (fwrite(footer, 1, sizeof(footer), fout) != sizeof(footer))
+   {
+      return 1;
+   }
+
+   return 0;
 }
 
 static int
 zstd_decompress(char* from, char* to, ZSTD_DCtx* dctx, size_t zin_size, void* zin, size_t zout_size, void* zout)
 {
-   FILE* fin = NULL;
+   struct io_reader* fin = NULL;
    FILE* fout = NULL;
    size_t toRead;
    size_t read;
    size_t lastRet = 0;
+   bool first = true;
 
-   fin = fopen(from, "rb");
-
-   if (fin == NULL)
+   if (pgmoneta_io_reader_open(from, 0, 0, &fin))
    {
       goto error;
    }
@@ -971,34 +1615,59 @@ zstd_decompress(char* from, char* to, ZSTD_DCtx* dctx, size_t zin_size, void* zi
    }
 
    toRead = zin_size;
-   while ((read = fread(zin, sizeof(char), toRead, fin)))
+   while ((read = pgmoneta_io_reader_read(fin, zin, toRead)))
    {
       ZSTD_inBuffer input = {zin, read, 0};
+
+      if (first)
+      {
+         // the frame header names the dictionary the file was compressed with
+         uint32_t id = ZSTD_getDictID_fromFrame(zin, read);
+         ZSTD_DDict* ddict = NULL;
+
+         if (id != 0)
+         {
+            ddict = zstd_ddict(id);
+            if (ddict == NULL)
+            {
+               pgmoneta_log_error("ZSTD: No dictionary %u for %s", id, from);
+               goto error;
+            }
+         }
+
+         ZSTD_DCtx_refDDict(dctx, ddict);
+         first = false;
+      }
+
       while (input.pos < input.size)
       {
          ZSTD_outBuffer output = {zout, zout_size, 0};
          size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+         if (ZSTD_isError(ret))
+         {
+            pgmoneta_log_error("ZSTD: Could not decompress %s: %s", from, ZSTD_getErrorName(ret));
+            goto error;
+         }
          fwrite(zout, sizeof(char), output.pos, fout);
          lastRet = ret;
       }
    }
 
-   if (lastRet != 0)
+   if (lastRet != 0 || pgmoneta_io_reader_error(fin))
    {
       goto error;
    }
 
-   fclose(fin);
+   pgmoneta_io_reader_close(fin);
+   fflush(fout);
+   pgmoneta_io_drop(fileno(fout), true);
    fclose(fout);
 
    return 0;
 
 error:
 
-   if (fin != NULL)
-   {
-      fclose(fin);
-   }
+   pgmoneta_io_reader_close(fin);
 
    if (fout != NULL)
    {
@@ -1007,3 +1676,593 @@ error:
 
    return 1;
 }
+
+static int
+zstd_split_read(char* from, struct zstd_split** split)
+{
+   struct zstd_seekable* seekable = NULL;
+   struct zstd_split* sp = NULL;
+   uint32_t parts = 0;
+   uint64_t start = 0;
+
+   *split = NULL;
+
+   if (pgmoneta_zstandardd_seekable_open(from, &seekable))
+   {
+      goto error;
+   }
+
+   sp = (struct zstd_split*)malloc(sizeof(struct zstd_split));
+   if (sp == NULL)
+   {
+      goto error;
+   }
+
+   memset(sp, 0, sizeof(struct zstd_split));
+
+   // the offsets are taken over from the seek table
+   sp->number_of_frames = seekable->number_of_frames;
+   sp->compressed_offsets = seekable->compressed_offsets;
+   sp->decompressed_offsets = seekable->decompressed_offsets;
+   seekable->compressed_offsets = NULL;
+   seekable->decompressed_offsets = NULL;
+
+   pgmoneta_zstandardd_seekable_close(seekable);
+   seekable = NULL;
+
+   sp->first_frames = (uint32_t*)malloc((sp->number_of_frames + 1) * sizeof(uint32_t));
+   if (sp->first_frames == NULL)
+   {
+      goto error;
+   }
+
+   // the frames are grouped into parts of at least ZSTD_SPLIT_SIZE
+   for (uint32_t i = 0; i < sp->number_of_frames; i++)
+   {
+      if (i == 0 || sp->decompressed_offsets[i] - start >= ZSTD_SPLIT_SIZE)
+      {
+         sp->first_frames[parts++] = i;
+         start = sp->decompressed_offsets[i];
+      }
+   }
+   sp->first_frames[parts] = sp->number_of_frames;
+
+   if (parts < 2)
+   {
+      goto error;
+   }
+
+   sp->split.number_of_parts = (int)parts;
+   atomic_init(&sp->split.remaining, sp->split.number_of_parts);
+   atomic_init(&sp->split.failed, false);
+
+   *split = sp;
+
+   return 0;
+
+error:
+
+   pgmoneta_zstandardd_seekable_close(seekable);
+   zstd_split_free(sp);
+
+   return 1;
+}
+
+static int
+zstd_split_decompress(char* directory, char* from, char* to, struct zstd_split* split, struct workers* workers)
+{
+   int fd = -1;
+   int parts = split->split.number_of_parts;
+   struct worker_input* wi = NULL;
+
+   // the parts write into the file at their offsets
+   fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1 || ftruncate(fd, (off_t)split->decompressed_offsets[split->number_of_frames]))
+   {
+      goto error;
+   }
+   close(fd);
+   fd = -1;
+
+   for (int i = 0; i < parts; i++)
+   {
+      if (pgmoneta_create_worker_input(directory, from, to, i, workers, &wi))
+      {
+         // the parts that are not queued count as failed
+         atomic_store(&split->split.failed, true);
+         if (atomic_fetch_sub(&split->split.remaining, parts - i) == parts - i)
+         {
+            goto error;
+         }
+         return 1;
+      }
+
+      wi->offset = (off_t)split->compressed_offsets[split->first_frames[i]];
+      wi->length = (size_t)(split->compressed_offsets[split->first_frames[i + 1]] - split->compressed_offsets[split->first_frames[i]]);
+      wi->split = &split->split;
+      wi->argument = split;
+
+      pgmoneta_workers_add(workers, do_zstd_decompress_part, wi);
+   }
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   if (pgmoneta_exists(to))
+   {
+      pgmoneta_delete_file(to, NULL);
+   }
+
+   zstd_split_free(split);
+
+   return 1;
+}
+
+static int
+zstd_decompress_frames(char* from, char* to, struct zstd_split* split, uint32_t first, uint32_t last)
+{
+   int fd_in = -1;
+   int fd_out = -1;
+   size_t compressed_size = 0;
+   size_t decompressed_size = 0;
+   size_t ret;
+   uint32_t id;
+   unsigned char* zin = NULL;
+   unsigned char* zout = NULL;
+   ZSTD_DCtx* dctx = NULL;
+
+   for (uint32_t i = first; i < last; i++)
+   {
+      compressed_size = MAX(compressed_size, (size_t)(split->compressed_offsets[i + 1] - split->compressed_offsets[i]));
+      decompressed_size = MAX(decompressed_size, (size_t)(split->decompressed_offsets[i + 1] - split->decompressed_offsets[i]));
+   }
+
+   zin = pgmoneta_worker_buffer(WORKER_BUFFER_IN, compressed_size);
+   zout = pgmoneta_worker_buffer(WORKER_BUFFER_OUT, decompressed_size);
+   dctx = zstd_dctx();
+
+   if (zin == NULL || zout == NULL || dctx == NULL)
+   {
+      goto error;
+   }
+
+   fd_in = open(from, O_RDONLY);
+   fd_out = open(to, O_WRONLY);
+
+   if (fd_in == -1 || fd_out == -1)
+   {
+      goto error;
+   }
+
+   for (uint32_t i = first; i < last; i++)
+   {
+      compressed_size = split->compressed_offsets[i + 1] - split->compressed_offsets[i];
+      decompressed_size = split->decompressed_offsets[i + 1] - split->decompressed_offsets[i];
+
+      if (pread(fd_in, zin, compressed_size, (off_t)split->compressed_offsets[i]) != (ssize_t)compressed_size)
+      {
+         goto error;
+      }
+
+      id = ZSTD_getDictID_fromFrame(zin, compressed_size);
+      ZSTD_DCtx_refDDict(dctx, id != 0 ? zstd_ddict(id) : NULL);
+
+      ret = ZSTD_decompressDCtx(dctx, zout, decompressed_size, zin, compressed_size);
+      if (ZSTD_isError(ret) || ret != decompressed_size)
+      {
+         pgmoneta_log_error("ZSTD: Could not decompress frame %u of %s", i, from);
+         goto error;
+      }
+
+      if (pwrite(fd_out, zout, decompressed_size, (off_t)split->decompressed_offsets[i]) != (ssize_t)decompressed_size)
+      {
+         goto error;
+      }
+   }
+
+   close(fd_in);
+
+   if (close(fd_out) != 0)
+   {
+      return 1;
+   }
+
+   return 0;
+
+error:
+
+   if (fd_in != -1)
+   {
+      close(fd_in);
+   }
+
+   if (fd_out != -1)
+   {
+      close(fd_out);
+   }
+
+   return 1;
+}
+
+static void
+zstd_split_free(struct zstd_split* split)
+{
+   if (split == NULL)
+   {
+      return;
+   }
+
+   free(split->compressed_offsets);
+   free(split->decompressed_offsets);
+   free(split->first_frames);
+   free(split);
+}
+
+static ZSTD_CCtx*
+zstd_cctx(void)
+{
+   ZSTD_CCtx* cctx = NULL;
+
+   cctx = (ZSTD_CCtx*)pgmoneta_worker_context(WORKER_CONTEXT_ZSTD_COMPRESS);
+   if (cctx != NULL)
+   {
+      ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+      return cctx;
+   }
+
+   cctx = ZSTD_createCCtx();
+   if (cctx != NULL)
+   {
+      pgmoneta_worker_context_set(WORKER_CONTEXT_ZSTD_COMPRESS, cctx, zstd_free_cctx);
+   }
+
+   return cctx;
+}
+
+static ZSTD_DCtx*
+zstd_dctx(void)
+{
+   ZSTD_DCtx* dctx = NULL;
+
+   dctx = (ZSTD_DCtx*)pgmoneta_worker_context(WORKER_CONTEXT_ZSTD_DECOMPRESS);
+   if (dctx != NULL)
+   {
+      ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+      return dctx;
+   }
+
+   dctx = ZSTD_createDCtx();
+   if (dctx != NULL)
+   {
+      pgmoneta_worker_context_set(WORKER_CONTEXT_ZSTD_DECOMPRESS, dctx, zstd_free_dctx);
+   }
+
+   return dctx;
+}
+
+static void
+zstd_free_cctx(void* cctx)
+{
+   ZSTD_freeCCtx((ZSTD_CCtx*)cctx);
+}
+
+static void
+zstd_free_dctx(void* dctx)
+{
+   ZSTD_freeDCtx((ZSTD_DCtx*)dctx);
+}
+
+static void
+zstd_write_le32(uint8_t* data, uint32_t value)
+{
+   data[0] = (uint8_t)(value & 0xFF);
+   data[1] = (uint8_t)((value >> 8) & 0xFF);
+   data[2] = (uint8_t)((value >> 16) & 0xFF);
+   data[3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+static uint32_t
+zstd_read_le32(uint8_t* data)
+{
+   return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static int
+zstd_seekable_frame(struct zstd_seekable* seekable, uint32_t frame)
+{
+   size_t compressed_size;
+   size_t decompressed_size;
+   size_t ret;
+   uint32_t id;
+
+   if (seekable->frame == (int64_t)frame)
+   {
+      return 0;
+   }
+
+   compressed_size = seekable->compressed_offsets[frame + 1] - seekable->compressed_offsets[frame];
+   decompressed_size = seekable->decompressed_offsets[frame + 1] - seekable->decompressed_offsets[frame];
+
+   if (compressed_size > seekable->compressed_capacity)
+   {
+      void* b = realloc(seekable->compressed, compressed_size);
+      if (b == NULL)
+      {
+         return 1;
+      }
+      seekable->compressed = b;
+      seekable->compressed_capacity = compressed_size;
+   }
+
+   if (decompressed_size > seekable->decompressed_capacity)
+   {
+      void* b = realloc(seekable->decompressed, decompressed_size);
+      if (b == NULL)
+      {
+         return 1;
+      }
+      seekable->decompressed = b;
+      seekable->decompressed_capacity = decompressed_size;
+   }
+
+   if (fseeko(seekable->file, (off_t)seekable->compressed_offsets[frame], SEEK_SET) != 0)
+   {
+      return 1;
+   }
+
+   if (fread(seekable->compressed, 1, compressed_size, seekable->file) != compressed_size)
+   {
+      return 1;
+   }
+
+   id = ZSTD_getDictID_fromFrame(seekable->compressed, compressed_size);
+   ZSTD_DCtx_refDDict(seekable->dctx, id != 0 ? zstd_ddict(id) : NULL);
+
+   ret = ZSTD_decompressDCtx(seekable->dctx, seekable->decompressed, decompressed_size,
+                             seekable->compressed, compressed_size);
+   if (ZSTD_isError(ret) || ret != decompressed_size)
+   {
+      pgmoneta_log_error("ZSTD: Could not decompress frame %u of %s", frame, seekable->path);
+      seekable->frame = -1;
+      return 1;
+   }
+
+   seekable->frame = frame;
+
+   return 0;
+}
+
+static void
+zstd_reference_dictionary(ZSTD_CCtx* cctx, char* from, bool always)
+{
+   ZSTD_CDict* cdict = NULL;
+
+   // a dictionary only pays off for small inputs
+   if (compression_dictionary != NULL && (always || pgmoneta_get_file_size(from) <= ZSTD_DICTIONARY_SAMPLE_SIZE))
+   {
+      cdict = compression_dictionary;
+   }
+
+   ZSTD_CCtx_refCDict(cctx, cdict);
+}
+
+static ZSTD_DDict*
+zstd_ddict(uint32_t id)
+{
+   ZSTD_DDict* ddict = NULL;
+   char* path = NULL;
+   void* data = NULL;
+   size_t size = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pthread_mutex_lock(&decompression_dictionaries_lock);
+
+   for (int i = 0; ddict == NULL && i < number_of_decompression_dictionaries; i++)
+   {
+      if (decompression_dictionary_ids[i] == id)
+      {
+         ddict = decompression_dictionaries[i];
+      }
+   }
+
+   // the identifier is unique enough to look in the dictionaries of every server
+   for (int i = 0; ddict == NULL && i < config->number_of_servers; i++)
+   {
+      path = zstd_dictionary_path(i, id);
+
+      if (pgmoneta_exists(path) && !zstd_dictionary_read(path, &data, &size))
+      {
+         ddict = ZSTD_createDDict(data, size);
+         free(data);
+         data = NULL;
+
+         if (ddict != NULL)
+         {
+            if (number_of_decompression_dictionaries == ZSTD_DICTIONARY_CACHE)
+            {
+               number_of_decompression_dictionaries--;
+               ZSTD_freeDDict(decompression_dictionaries[number_of_decompression_dictionaries]);
+            }
+
+            memmove(&decompression_dictionary_ids[1], &decompression_dictionary_ids[0],
+                    number_of_decompression_dictionaries * sizeof(uint32_t));
+            memmove(&decompression_dictionaries[1], &decompression_dictionaries[0],
+                    number_of_decompression_dictionaries * sizeof(ZSTD_DDict*));
+
+            decompression_dictionary_ids[0] = id;
+            decompression_dictionaries[0] = ddict;
+            number_of_decompression_dictionaries++;
+         }
+      }
+
+      free(path);
+      path = NULL;
+   }
+
+   pthread_mutex_unlock(&decompression_dictionaries_lock);
+
+   return ddict;
+}
+
+static char*
+zstd_dictionary_path(int server, uint32_t id)
+{
+   char name[MISC_LENGTH];
+   char* path = NULL;
+
+   snprintf(name, sizeof(name), "dictionary/%u.dict", id);
+
+   path = pgmoneta_get_server(server);
+   path = pgmoneta_append(path, name);
+
+   return path;
+}
+
+static int
+zstd_dictionary_read(char* path, void** data, size_t* size)
+{
+   FILE* file = NULL;
+   void* d = NULL;
+   size_t s;
+
+   *data = NULL;
+   *size = 0;
+
+   s = pgmoneta_get_file_size(path);
+   if (s == 0)
+   {
+      goto error;
+   }
+
+   d = malloc(s);
+   if (d == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fread(d, 1, s, file) != s)
+   {
+      goto error;
+   }
+
+   fclose(file);
+
+   *data = d;
+   *size = s;
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(d);
+
+   return 1;
+}
+
+static int
+zstd_dictionary_samples(char* directory, char** samples, size_t* samples_size, size_t** sizes, unsigned* number_of_samples)
+{
+   DIR* dir = NULL;
+   struct dirent* entry;
+   char path[MAX_PATH];
+   size_t size;
+   FILE* file = NULL;
+
+   if (!(dir = opendir(directory)))
+   {
+      return 0;
+   }
+
+   while ((entry = readdir(dir)) != NULL && *samples_size < ZSTD_DICTIONARY_SAMPLES_SIZE)
+   {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+      if (entry->d_type == DT_DIR)
+      {
+         if (zstd_dictionary_samples(path, samples, samples_size, sizes, number_of_samples))
+         {
+            goto error;
+         }
+      }
+      else if (entry->d_type == DT_REG &&
+               !pgmoneta_is_compressed_archive(entry->d_name) &&
+               !pgmoneta_is_encrypted_archive(entry->d_name))
+      {
+         size = pgmoneta_get_file_size(path);
+
+         if (size == 0 || size > ZSTD_DICTIONARY_SAMPLE_SIZE || *samples_size + size > ZSTD_DICTIONARY_SAMPLES_SIZE)
+         {
+            continue;
+         }
+
+         if (*number_of_samples % 256 == 0)
+         {
+            size_t* s = realloc(*sizes, (*number_of_samples + 256) * sizeof(size_t));
+            if (s == NULL)
+            {
+               goto error;
+            }
+            *sizes = s;
+         }
+
+         if (*samples == NULL)
+         {
+            *samples = malloc(ZSTD_DICTIONARY_SAMPLES_SIZE);
+            if (*samples == NULL)
+            {
+               goto error;
+            }
+         }
+
+         file = fopen(path, "rb");
+         if (file == NULL)
+         {
+            continue;
+         }
+
+         if (fread(*samples + *samples_size, 1, size, file) == size)
+         {
+            (*sizes)[*number_of_samples] = size;
+            (*number_of_samples)++;
+            *samples_size += size;
+         }
+
+         fclose(file);
+         file = NULL;
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   closedir(dir);
+
+   return 1;
+}
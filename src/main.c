@@ -32,7 +32,9 @@
 #include <aes.h>
 #include <backup.h>
 #include <bzip2_compression.h>
+#include <cluster.h>
 #include <configuration.h>
+#include <cron.h>
 #include <delete.h>
 #include <gzip_compression.h>
 #include <info.h>
@@ -41,6 +43,7 @@
 #include <lz4_compression.h>
 #include <management.h>
 #include <memory.h>
+#include <merge.h>
 #include <message.h>
 #include <network.h>
 #include <prometheus.h>
@@ -54,6 +57,9 @@
 #include <utils.h>
 #include <verify.h>
 #include <wal.h>
+#include <walfetch.h>
+#include <walpack.h>
+#include <walsummary.h>
 #include <zstandard_compression.h>
 
 /* system */
@@ -62,7 +68,9 @@
 #include <ev.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -74,6 +82,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include <openssl/crypto.h>
 #ifdef HAVE_LINUX
@@ -84,19 +93,32 @@
 #define OFFLINE 1000
 
 static void accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents);
+static void management_session(int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
+static int management_session_run(int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
+static int management_pool_start(void);
+static void management_pool_stop(void);
+static bool management_pool_serve(int32_t id, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
+static void* management_pool_run(void* arg);
 static void accept_metrics_cb(struct ev_loop* loop, struct ev_io* watcher, int revents);
 static void accept_management_cb(struct ev_loop* loop, struct ev_io* watcher, int revents);
 static void shutdown_cb(struct ev_loop* loop, ev_signal* w, int revents);
 static void reload_cb(struct ev_loop* loop, ev_signal* w, int revents);
 static void coredump_cb(struct ev_loop* loop, ev_signal* w, int revents);
 static void wal_cb(struct ev_loop* loop, ev_periodic* w, int revents);
+static void wal_notify_cb(struct ev_loop* loop, ev_signal* w, int revents);
+static void wal_process(int srv);
 static void retention_cb(struct ev_loop* loop, ev_periodic* w, int revents);
 static void valid_cb(struct ev_loop* loop, ev_periodic* w, int revents);
 static void wal_streaming_cb(struct ev_loop* loop, ev_periodic* w, int revents);
+static void backup_schedule_cb(struct ev_loop* loop, ev_periodic* w, int revents);
+static void cluster_cb(struct ev_loop* loop, ev_periodic* w, int revents);
 static bool accept_fatal(int error);
 static bool reload_configuration(void);
 static void init_receivewals(void);
+static bool wal_multiplexed(void);
+static bool start_wal_multiplex(int* servers, int number_of_servers);
 static int init_replication_slots(void);
+static int init_replication_slot(int srv);
 static int verify_replication_slot(char* slot_name, int srv, SSL* ssl, int socket);
 static int  create_pidfile(void);
 static void remove_pidfile(void);
@@ -109,6 +131,17 @@ struct accept_io
    char** argv;
 };
 
+/**
+ * A management request handed to the management workers
+ */
+struct management_task
+{
+   int client_fd;        /**< The client descriptor */
+   uint8_t compression;  /**< The compression of the request */
+   uint8_t encryption;   /**< The encryption of the request */
+   struct json* payload; /**< The request */
+};
+
 static volatile int keep_running = 1;
 static volatile int stop = 0;
 static char** argv_ptr;
@@ -122,6 +155,10 @@ static struct accept_io io_management[MAX_FDS];
 static int* management_fds = NULL;
 static int management_fds_length = -1;
 static bool offline = false;
+static int management_pipe[2] = {-1, -1};
+static pthread_t management_threads[MAX_MANAGEMENT_WORKERS];
+static int management_threads_length = 0;
+static atomic_int management_idle = 0;
 
 static void
 start_mgt(void)
@@ -243,9 +280,12 @@ main(int argc, char** argv)
    pid_t pid, sid;
    struct signal_info signal_watcher[5];
    struct ev_periodic wal;
+   struct signal_info wal_notify;
    struct ev_periodic retention;
    struct ev_periodic valid;
    struct ev_periodic wal_streaming;
+   struct ev_periodic backup_schedule;
+   struct ev_periodic cluster;
    size_t shmem_size;
    size_t prometheus_cache_shmem_size = 0;
    struct configuration* config = NULL;
@@ -470,6 +510,24 @@ main(int argc, char** argv)
 
    config = (struct configuration*)shmem;
 
+   // the hugepage setting is known now, so the configuration moves to huge pages before it is shared
+   if (config->hugepage != HUGEPAGE_OFF)
+   {
+      void* hugepage_shmem = NULL;
+
+      if (!pgmoneta_create_shared_memory(shmem_size, config->hugepage, &hugepage_shmem))
+      {
+         memcpy(hugepage_shmem, shmem, shmem_size);
+         pgmoneta_destroy_shared_memory(shmem, shmem_size);
+         shmem = hugepage_shmem;
+         config = (struct configuration*)shmem;
+      }
+      else
+      {
+         pgmoneta_log_warn("Unable to use huge pages for the configuration");
+      }
+   }
+
    if (!offline && daemon)
    {
       if (config->log_type == PGMONETA_LOGGING_TYPE_CONSOLE)
@@ -527,6 +585,14 @@ main(int argc, char** argv)
       errx(1, "Error in creating and initializing prometheus cache shared memory");
    }
 
+   /* The metrics of the servers are kept up to date from here on */
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_prometheus_refresh(i);
+   }
+
+   pgmoneta_token_bucket_init_shared();
+
    /* Bind Unix Domain Socket */
    if (pgmoneta_bind_unix_socket(config->unix_socket_dir, MAIN_UDS, &unix_management_socket))
    {
@@ -570,9 +636,23 @@ main(int argc, char** argv)
       goto error;
    }
 
+   if (pgmoneta_remote_management_init())
+   {
+      pgmoneta_log_fatal("Could not initialize remote management");
+#ifdef HAVE_LINUX
+      sd_notify(0, "STATUS=Could not initialize remote management");
+#endif
+      goto error;
+   }
+
    start_mgt();
    mgt_started = true;
 
+   if (management_pool_start())
+   {
+      pgmoneta_log_warn("Could not start the management workers, the commands are served by processes of their own");
+   }
+
    if (config->metrics > 0)
    {
       /* Bind metrics socket */
@@ -596,6 +676,14 @@ main(int argc, char** argv)
 
       start_metrics();
       metrics_started = true;
+
+      if (pgmoneta_prometheus_start())
+      {
+#ifdef HAVE_LINUX
+         sd_notify(0, "STATUS=Could not start the metrics server");
+#endif
+         goto error;
+      }
    }
 
    if (config->management > 0)
@@ -629,6 +717,18 @@ main(int argc, char** argv)
       goto error;
    }
 
+   if (!offline && pgmoneta_cluster_enabled())
+   {
+      /* Claim the servers of this node before streaming */
+      if (pgmoneta_cluster_join())
+      {
+         goto error;
+      }
+
+      ev_periodic_init (&cluster, cluster_cb, 0., MAX(config->cluster_lease / 3, 1), 0);
+      ev_periodic_start (main_loop, &cluster);
+   }
+
    if (!offline)
    {
       /* Start to retrieve WAL */
@@ -641,6 +741,11 @@ main(int argc, char** argv)
       /* Start to verify WAL streaming */
       ev_periodic_init (&wal_streaming, wal_streaming_cb, 0., 60, 0);
       ev_periodic_start (main_loop, &wal_streaming);
+
+      /* Start the scheduled backups */
+      srandom((unsigned int)(time(NULL) ^ getpid()));
+      ev_periodic_init (&backup_schedule, backup_schedule_cb, 0., CRON_INTERVAL, 0);
+      ev_periodic_start (main_loop, &backup_schedule);
    }
 
    if (!offline)
@@ -651,6 +756,12 @@ main(int argc, char** argv)
       {
          ev_periodic_init(&wal, wal_cb, 0., 60, 0);
          ev_periodic_start(main_loop, &wal);
+
+         /* The WAL receivers signal each closed segment, the periodic run catches the rest */
+         ev_signal_init((struct ev_signal*)&wal_notify, wal_notify_cb, SIGUSR1);
+         wal_notify.slot = -1;
+         ev_signal_start(main_loop, (struct ev_signal*)&wal_notify);
+         atomic_store(&config->wal_notify, (int)getpid());
       }
    }
 
@@ -702,15 +813,25 @@ main(int argc, char** argv)
    sd_notify(0, "STOPPING=1");
 #endif
 
+   pgmoneta_cluster_leave();
+
    shutdown_management();
    shutdown_metrics();
+   pgmoneta_prometheus_stop();
    shutdown_mgt();
+   management_pool_stop();
 
    for (int i = 0; i < 5; i++)
    {
       ev_signal_stop(main_loop, (struct ev_signal*)&signal_watcher[i]);
    }
 
+   if (atomic_exchange(&config->wal_notify, 0) != 0)
+   {
+      ev_signal_stop(main_loop, (struct ev_signal*)&wal_notify);
+      signal(SIGUSR1, SIG_IGN);
+   }
+
    ev_loop_destroy(main_loop);
 
    free(metrics_fds);
@@ -740,11 +861,13 @@ error:
    if (mgt_started)
    {
       shutdown_mgt();
+      management_pool_stop();
    }
 
    if (metrics_started)
    {
       shutdown_metrics();
+      pgmoneta_prometheus_stop();
    }
 
    if (management_started)
@@ -845,20 +968,21 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
 
    request = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
 
+   if (management_pool_serve(id, client_fd, compression, encryption, payload))
+   {
+      free(str);
+      pgmoneta_json_destroy(payload);
+
+      return;
+   }
+
    if (id == MANAGEMENT_BACKUP)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
       if (!offline)
       {
-         srv = -1;
-         for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-         {
-            if (!strcmp(config->servers[i].name, server))
-            {
-               srv = i;
-            }
-         }
+         srv = pgmoneta_server_index(server);
 
          if (srv != -1)
          {
@@ -900,14 +1024,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -927,7 +1044,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
             pgmoneta_json_clone(payload, &pyl);
 
             pgmoneta_set_proc_title(1, ai->argv, "list-backup", config->servers[srv].name);
-            pgmoneta_list_backup(client_fd, srv, compression, encryption, pyl);
+            management_session(client_fd, compression, encryption, pyl);
          }
       }
       else
@@ -941,14 +1058,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -983,14 +1093,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1024,14 +1127,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1065,14 +1161,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1230,7 +1319,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
          pgmoneta_json_clone(payload, &pyl);
 
          pgmoneta_set_proc_title(1, ai->argv, "status", NULL);
-         pgmoneta_status(NULL, client_fd, offline, compression, encryption, pyl);
+         management_session(client_fd, compression, encryption, pyl);
       }
    }
    else if (id == MANAGEMENT_STATUS_DETAILS)
@@ -1251,21 +1340,14 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
          pgmoneta_json_clone(payload, &pyl);
 
          pgmoneta_set_proc_title(1, ai->argv, "details", NULL);
-         pgmoneta_status_details(NULL, client_fd, offline, compression, encryption, pyl);
+         management_session(client_fd, compression, encryption, pyl);
       }
    }
    else if (id == MANAGEMENT_RETAIN)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1295,18 +1377,147 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
          goto error;
       }
    }
-   else if (id == MANAGEMENT_EXPUNGE)
+   else if (id == MANAGEMENT_MERGE)
+   {
+      server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
+
+      srv = pgmoneta_server_index(server);
+
+      if (srv != -1)
+      {
+         pid = fork();
+         if (pid == -1)
+         {
+            pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_MERGE_NOFORK, compression, encryption, payload);
+            pgmoneta_log_error("Merge: No fork %s (%d)", server, MANAGEMENT_ERROR_MERGE_NOFORK);
+            goto error;
+         }
+         else if (pid == 0)
+         {
+            struct json* pyl = NULL;
+
+            shutdown_ports();
+
+            pgmoneta_json_clone(payload, &pyl);
+
+            pgmoneta_set_proc_title(1, ai->argv, "merge", config->servers[srv].name);
+            pgmoneta_merge_backup(NULL, client_fd, srv, compression, encryption, pyl);
+         }
+      }
+      else
+      {
+         pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_MERGE_NOSERVER, compression, encryption, payload);
+         pgmoneta_log_error("Merge: No server %s (%d)", server, MANAGEMENT_ERROR_MERGE_NOSERVER);
+         goto error;
+      }
+   }
+   else if (id == MANAGEMENT_WAL_FETCH)
+   {
+      server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
+
+      srv = pgmoneta_server_index(server);
+
+      if (srv != -1)
+      {
+         pid = fork();
+         if (pid == -1)
+         {
+            pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_WAL_FETCH_NOFORK, compression, encryption, payload);
+            pgmoneta_log_error("WAL fetch: No fork %s (%d)", server, MANAGEMENT_ERROR_WAL_FETCH_NOFORK);
+            goto error;
+         }
+         else if (pid == 0)
+         {
+            struct json* pyl = NULL;
+
+            shutdown_ports();
+
+            pgmoneta_json_clone(payload, &pyl);
+
+            pgmoneta_set_proc_title(1, ai->argv, "wal-fetch", config->servers[srv].name);
+            pgmoneta_wal_fetch(NULL, client_fd, srv, compression, encryption, pyl);
+         }
+      }
+      else
+      {
+         pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_WAL_FETCH_NOSERVER, compression, encryption, payload);
+         pgmoneta_log_error("WAL fetch: No server %s (%d)", server, MANAGEMENT_ERROR_WAL_FETCH_NOSERVER);
+         goto error;
+      }
+   }
+   else if (id == MANAGEMENT_CHANGES)
+   {
+      server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
+
+      srv = pgmoneta_server_index(server);
+
+      if (srv != -1)
+      {
+         pid = fork();
+         if (pid == -1)
+         {
+            pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_CHANGES_NOFORK, compression, encryption, payload);
+            pgmoneta_log_error("Changes: No fork %s (%d)", server, MANAGEMENT_ERROR_CHANGES_NOFORK);
+            goto error;
+         }
+         else if (pid == 0)
+         {
+            struct json* pyl = NULL;
+
+            shutdown_ports();
+
+            pgmoneta_json_clone(payload, &pyl);
+
+            pgmoneta_set_proc_title(1, ai->argv, "changes", config->servers[srv].name);
+            pgmoneta_walsummary_changes(NULL, client_fd, srv, compression, encryption, pyl);
+         }
+      }
+      else
+      {
+         pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_CHANGES_NOSERVER, compression, encryption, payload);
+         pgmoneta_log_error("Changes: No server %s (%d)", server, MANAGEMENT_ERROR_CHANGES_NOSERVER);
+         goto error;
+      }
+   }
+   else if (id == MANAGEMENT_RETENTION)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
+      srv = pgmoneta_server_index(server);
+
+      if (srv != -1)
       {
-         if (!strcmp(config->servers[i].name, server))
+         pid = fork();
+         if (pid == -1)
+         {
+            pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_RETENTION_NOFORK, compression, encryption, payload);
+            pgmoneta_log_error("Retention: No fork %s (%d)", server, MANAGEMENT_ERROR_RETENTION_NOFORK);
+            goto error;
+         }
+         else if (pid == 0)
          {
-            srv = i;
+            struct json* pyl = NULL;
+
+            shutdown_ports();
+
+            pgmoneta_json_clone(payload, &pyl);
+
+            pgmoneta_set_proc_title(1, ai->argv, "retention", config->servers[srv].name);
+            pgmoneta_retention_request(NULL, client_fd, srv, compression, encryption, pyl);
          }
       }
+      else
+      {
+         pgmoneta_management_response_error(NULL, client_fd, server, MANAGEMENT_ERROR_RETENTION_NOSERVER, compression, encryption, payload);
+         pgmoneta_log_error("Retention: No server %s (%d)", server, MANAGEMENT_ERROR_RETENTION_NOSERVER);
+         goto error;
+      }
+   }
+   else if (id == MANAGEMENT_EXPUNGE)
+   {
+      server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
+
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1470,14 +1681,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1497,7 +1701,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
             pgmoneta_json_clone(payload, &pyl);
 
             pgmoneta_set_proc_title(1, ai->argv, "info", config->servers[srv].name);
-            pgmoneta_info_request(NULL, client_fd, srv, compression, encryption, pyl);
+            management_session(client_fd, compression, encryption, pyl);
          }
       }
       else
@@ -1511,14 +1715,7 @@ accept_mgt_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    {
       server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-      srv = -1;
-      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
-      {
-         if (!strcmp(config->servers[i].name, server))
-         {
-            srv = i;
-         }
-      }
+      srv = pgmoneta_server_index(server);
 
       if (srv != -1)
       {
@@ -1571,72 +1768,337 @@ error:
 }
 
 static void
-accept_metrics_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
+management_session(int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
-   struct sockaddr_in6 client_addr;
-   socklen_t client_addr_length;
-   int client_fd;
+   int exit_code;
+
+   exit_code = management_session_run(client_fd, compression, encryption, payload);
+
+   pgmoneta_disconnect(client_fd);
+
+   pgmoneta_stop_logging();
+
+   exit(exit_code);
+}
+
+static int
+management_session_run(int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   char b;
+   char* server = NULL;
+   int srv;
+   int32_t id;
+   int exit_code = 0;
+   struct timeval timeout;
+   struct json* header = NULL;
+   struct json* request = NULL;
    struct configuration* config;
 
-   if (EV_ERROR & revents)
+   config = (struct configuration*)shmem;
+
+   if (config->blocking_timeout > 0)
    {
-      pgmoneta_log_debug("accept_metrics_cb: invalid event: %s", strerror(errno));
-      errno = 0;
-      return;
+      timeout.tv_sec = config->blocking_timeout;
+      timeout.tv_usec = 0;
+      setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
    }
 
-   config = (struct configuration*)shmem;
-
-   client_addr_length = sizeof(client_addr);
-   client_fd = accept(watcher->fd, (struct sockaddr*)&client_addr, &client_addr_length);
-   if (client_fd == -1)
+   while (payload != NULL)
    {
-      if (accept_fatal(errno) && keep_running)
-      {
-         pgmoneta_log_warn("Restarting listening port due to: %s (%d)", strerror(errno), watcher->fd);
+      header = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_HEADER);
+      id = (int32_t)pgmoneta_json_get(header, MANAGEMENT_ARGUMENT_COMMAND);
+      request = (struct json*)pgmoneta_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
 
-         shutdown_metrics();
+      if (id == MANAGEMENT_STATUS)
+      {
+         exit_code = pgmoneta_status(NULL, client_fd, offline, compression, encryption, payload);
+      }
+      else if (id == MANAGEMENT_STATUS_DETAILS)
+      {
+         exit_code = pgmoneta_status_details(NULL, client_fd, offline, compression, encryption, payload);
+      }
+      else if (id == MANAGEMENT_LIST_BACKUP || id == MANAGEMENT_INFO)
+      {
+         server = (char*)pgmoneta_json_get(request, MANAGEMENT_ARGUMENT_SERVER);
 
-         free(metrics_fds);
-         metrics_fds = NULL;
-         metrics_fds_length = 0;
+         srv = pgmoneta_server_index(server);
 
-         if (pgmoneta_bind(config->host, config->metrics, &metrics_fds, &metrics_fds_length))
+         if (srv == -1)
          {
-            pgmoneta_log_fatal("Could not bind to %s:%d", config->host, config->metrics);
-            exit(1);
+            pgmoneta_management_response_error(NULL, client_fd, server,
+                                               id == MANAGEMENT_LIST_BACKUP ? MANAGEMENT_ERROR_LIST_BACKUP_NOSERVER : MANAGEMENT_ERROR_INFO_NOSERVER,
+                                               compression, encryption, payload);
+            pgmoneta_log_error("Management: No server %s", server);
+            pgmoneta_json_destroy(payload);
+            exit_code = 1;
          }
-
-         if (metrics_fds_length > MAX_FDS)
+         else if (id == MANAGEMENT_LIST_BACKUP)
          {
-            pgmoneta_log_fatal("Too many descriptors %d", metrics_fds_length);
-            exit(1);
+            exit_code = pgmoneta_list_backup(client_fd, srv, compression, encryption, payload);
          }
-
-         start_metrics();
-
-         for (int i = 0; i < metrics_fds_length; i++)
+         else
          {
-            pgmoneta_log_debug("Metrics: %d", *(metrics_fds + i));
+            exit_code = pgmoneta_info_request(NULL, client_fd, srv, compression, encryption, payload);
          }
       }
       else
       {
-         pgmoneta_log_debug("accept: %s (%d)", strerror(errno), watcher->fd);
+         /* The other commands need the main process */
+         pgmoneta_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_UNKNOWN_COMMAND, compression, encryption, payload);
+         pgmoneta_log_warn("Management: Command %d can't be pipelined", id);
+         pgmoneta_json_destroy(payload);
+         exit_code = 1;
       }
-      errno = 0;
-      return;
-   }
 
-   if (!fork())
-   {
-      ev_loop_fork(loop);
-      shutdown_ports();
-      /* We are leaving the socket descriptor valid such that the client won't reuse it */
-      pgmoneta_prometheus(client_fd);
+      payload = NULL;
+
+      /* Only read a request when there is one, so a closed connection isn't an error */
+      if (recv(client_fd, &b, 1, MSG_PEEK) != 1 ||
+          pgmoneta_management_read_json(NULL, client_fd, &compression, &encryption, &payload))
+      {
+         payload = NULL;
+      }
    }
 
-   pgmoneta_disconnect(client_fd);
+   return exit_code;
+}
+
+static int
+management_pool_start(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->management_workers <= 0 || management_threads_length > 0)
+   {
+      return 0;
+   }
+
+   if (pipe(management_pipe) != 0)
+   {
+      pgmoneta_log_error("Management: Could not create pipe: %s", strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   for (int i = 0; i < MIN(config->management_workers, MAX_MANAGEMENT_WORKERS); i++)
+   {
+      if (pthread_create(&management_threads[i], NULL, management_pool_run, NULL) != 0)
+      {
+         pgmoneta_log_error("Management: Could not create a management worker");
+         break;
+      }
+
+      management_threads_length++;
+      atomic_fetch_add(&management_idle, 1);
+   }
+
+   if (management_threads_length == 0)
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("Management: %d workers", management_threads_length);
+
+   return 0;
+
+error:
+
+   if (management_pipe[0] != -1)
+   {
+      close(management_pipe[0]);
+      close(management_pipe[1]);
+      management_pipe[0] = -1;
+      management_pipe[1] = -1;
+   }
+
+   return 1;
+}
+
+static void
+management_pool_stop(void)
+{
+   struct management_task* stop = NULL;
+
+   if (management_threads_length == 0)
+   {
+      return;
+   }
+
+   for (int i = 0; i < management_threads_length; i++)
+   {
+      if (write(management_pipe[1], &stop, sizeof(struct management_task*)) != sizeof(struct management_task*))
+      {
+         pgmoneta_log_debug("Management: Could not stop a management worker");
+      }
+   }
+
+   for (int i = 0; i < management_threads_length; i++)
+   {
+      pthread_join(management_threads[i], NULL);
+   }
+
+   management_threads_length = 0;
+   atomic_store(&management_idle, 0);
+
+   close(management_pipe[0]);
+   close(management_pipe[1]);
+   management_pipe[0] = -1;
+   management_pipe[1] = -1;
+}
+
+static bool
+management_pool_serve(int32_t id, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   int idle;
+   struct management_task* task = NULL;
+
+   /* Only the commands that read the state run in the main process, the others need a process of their own */
+   if (id != MANAGEMENT_STATUS && id != MANAGEMENT_STATUS_DETAILS && id != MANAGEMENT_LIST_BACKUP && id != MANAGEMENT_INFO)
+   {
+      return false;
+   }
+
+   idle = atomic_load(&management_idle);
+   do
+   {
+      if (idle <= 0)
+      {
+         return false;
+      }
+   }
+   while (!atomic_compare_exchange_weak(&management_idle, &idle, idle - 1));
+
+   task = (struct management_task*)calloc(1, sizeof(struct management_task));
+   if (task == NULL)
+   {
+      goto error;
+   }
+
+   task->client_fd = client_fd;
+   task->compression = compression;
+   task->encryption = encryption;
+
+   if (pgmoneta_json_clone(payload, &task->payload))
+   {
+      goto error;
+   }
+
+   if (write(management_pipe[1], &task, sizeof(struct management_task*)) != sizeof(struct management_task*))
+   {
+      goto error;
+   }
+
+   return true;
+
+error:
+
+   if (task != NULL)
+   {
+      pgmoneta_json_destroy(task->payload);
+   }
+   free(task);
+
+   atomic_fetch_add(&management_idle, 1);
+
+   return false;
+}
+
+static void*
+management_pool_run(void* arg)
+{
+   struct management_task* task = NULL;
+   sigset_t mask;
+
+   (void)arg;
+
+   // the signals are handled by the main loop
+   sigfillset(&mask);
+   pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+   pgmoneta_memory_init();
+
+   while (read(management_pipe[0], &task, sizeof(struct management_task*)) == sizeof(struct management_task*))
+   {
+      if (task == NULL)
+      {
+         break;
+      }
+
+      management_session_run(task->client_fd, task->compression, task->encryption, task->payload);
+
+      pgmoneta_disconnect(task->client_fd);
+      free(task);
+      task = NULL;
+
+      atomic_fetch_add(&management_idle, 1);
+   }
+
+   pgmoneta_memory_destroy();
+
+   return NULL;
+}
+
+static void
+accept_metrics_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
+{
+   struct sockaddr_in6 client_addr;
+   socklen_t client_addr_length;
+   int client_fd;
+   struct configuration* config;
+
+   if (EV_ERROR & revents)
+   {
+      pgmoneta_log_debug("accept_metrics_cb: invalid event: %s", strerror(errno));
+      errno = 0;
+      return;
+   }
+
+   config = (struct configuration*)shmem;
+
+   client_addr_length = sizeof(client_addr);
+   client_fd = accept(watcher->fd, (struct sockaddr*)&client_addr, &client_addr_length);
+   if (client_fd == -1)
+   {
+      if (accept_fatal(errno) && keep_running)
+      {
+         pgmoneta_log_warn("Restarting listening port due to: %s (%d)", strerror(errno), watcher->fd);
+
+         shutdown_metrics();
+
+         free(metrics_fds);
+         metrics_fds = NULL;
+         metrics_fds_length = 0;
+
+         if (pgmoneta_bind(config->host, config->metrics, &metrics_fds, &metrics_fds_length))
+         {
+            pgmoneta_log_fatal("Could not bind to %s:%d", config->host, config->metrics);
+            exit(1);
+         }
+
+         if (metrics_fds_length > MAX_FDS)
+         {
+            pgmoneta_log_fatal("Too many descriptors %d", metrics_fds_length);
+            exit(1);
+         }
+
+         start_metrics();
+
+         for (int i = 0; i < metrics_fds_length; i++)
+         {
+            pgmoneta_log_debug("Metrics: %d", *(metrics_fds + i));
+         }
+      }
+      else
+      {
+         pgmoneta_log_debug("accept: %s (%d)", strerror(errno), watcher->fd);
+      }
+      errno = 0;
+      return;
+   }
+
+   pgmoneta_prometheus_serve(client_fd);
 }
 
 static void
@@ -1759,49 +2221,99 @@ wal_cb(struct ev_loop* loop, ev_periodic* w, int revents)
 
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      /* Compression is always in a fork() */
-      if (!fork())
+      wal_process(i);
+   }
+}
+
+static void
+wal_notify_cb(struct ev_loop* loop, ev_signal* w, int revents)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (EV_ERROR & revents)
+   {
+      pgmoneta_log_trace("wal_notify_cb: got invalid event: %s", strerror(errno));
+      return;
+   }
+
+   /* A running post-processing picks up the new segments itself */
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (atomic_load(&config->states[i].wal_pending) && !atomic_load(&config->states[i].wal))
       {
-         bool active = false;
-         char* d = NULL;
+         wal_process(i);
+      }
+   }
+}
 
-         pgmoneta_set_proc_title(1, argv_ptr, "wal", config->servers[i].name);
+static void
+wal_process(int srv)
+{
+   bool active = false;
+   int compression;
+   char* d = NULL;
+   struct configuration* config;
 
-         shutdown_ports();
+   config = (struct configuration*)shmem;
+
+   /* Compression is always in a fork() */
+   if (!fork())
+   {
+      pgmoneta_set_proc_title(1, argv_ptr, "wal", config->servers[srv].name);
+
+      shutdown_ports();
+
+      while (atomic_compare_exchange_strong(&config->states[srv].wal, &active, true))
+      {
+         atomic_store(&config->states[srv].wal_pending, false);
+
+         d = pgmoneta_get_server_wal(srv);
+         compression = pgmoneta_get_wal_compression(srv);
 
-         if (atomic_compare_exchange_strong(&config->servers[i].wal, &active, true))
+         if ((compression == COMPRESSION_CLIENT_ZSTD || compression == COMPRESSION_SERVER_ZSTD) && config->compression_dictionary)
          {
-            d = pgmoneta_get_server_wal(i);
+            pgmoneta_zstandard_dictionary_use(srv, pgmoneta_zstandard_dictionary_latest(srv));
+            pgmoneta_zstandardc_wal(srv, d);
+         }
+         else
+         {
+            pgmoneta_wal_compress_pending(srv, d);
+         }
 
-            if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
-            {
-               pgmoneta_gzip_wal(d);
-            }
-            else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
-            {
-               pgmoneta_zstandardc_wal(d);
-            }
-            else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
-            {
-               pgmoneta_lz4c_wal(d);
-            }
-            else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
-            {
-               pgmoneta_bzip2_wal(d);
-            }
+         /* Also encrypts the segments that an earlier run compressed but did not encrypt */
+         if (config->encryption != ENCRYPTION_NONE)
+         {
+            pgmoneta_encrypt_wal(srv, d);
+         }
+         else if (config->wal_pack > 0)
+         {
+            pgmoneta_walpack_directory(srv, d);
 
-            if (config->encryption != ENCRYPTION_NONE)
+            if (config->wal_compaction)
             {
-               pgmoneta_encrypt_wal(d);
+               pgmoneta_walpack_compact(srv, d);
             }
+         }
 
-            free(d);
+         pgmoneta_wal_prealloc(srv);
 
-            atomic_store(&config->servers[i].wal, false);
+         free(d);
+         d = NULL;
+
+         atomic_store(&config->states[srv].wal, false);
+
+         /* Segments closed during the run are processed right away */
+         if (!atomic_load(&config->states[srv].wal_pending))
+         {
+            break;
          }
 
-         exit(0);
+         active = false;
       }
+
+      exit(0);
    }
 }
 
@@ -1838,31 +2350,121 @@ valid_cb(struct ev_loop* loop, ev_periodic* w, int revents)
 
    if (!fork())
    {
+      pid_t pid;
+      int number_of_probes = 0;
+
+      shutdown_ports();
+
       pgmoneta_start_logging();
-      pgmoneta_memory_init();
 
+      /* Each server is probed by a process of its own, so the unreachable servers time out together */
       for (int i = 0; i < config->number_of_servers; i++)
       {
          pgmoneta_log_trace("Valid - Server %d Valid %d WAL %d", i, config->servers[i].valid, config->servers[i].wal_streaming);
 
          if (keep_running && !config->servers[i].valid)
          {
-            pgmoneta_server_info(i);
+            pid = fork();
+
+            if (pid == 0)
+            {
+               pgmoneta_memory_init();
+               pgmoneta_server_info(i);
+               pgmoneta_memory_destroy();
+
+               exit(0);
+            }
+            else if (pid > 0)
+            {
+               number_of_probes++;
+            }
          }
       }
 
-      pgmoneta_memory_destroy();
+      while (number_of_probes > 0 && wait(NULL) > 0)
+      {
+         number_of_probes--;
+      }
+
       pgmoneta_stop_logging();
 
       exit(0);
    }
 }
 
+static void
+backup_schedule_cb(struct ev_loop* loop, ev_periodic* w, int revents)
+{
+   pid_t pid;
+   int number_of_servers = 0;
+   int servers[NUMBER_OF_SERVERS];
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (EV_ERROR & revents)
+   {
+      pgmoneta_log_trace("backup_schedule_cb: got invalid event: %s", strerror(errno));
+      errno = 0;
+      return;
+   }
+
+   if (!keep_running || pgmoneta_cron_backups(time(NULL), &servers[0], &number_of_servers))
+   {
+      return;
+   }
+
+   for (int i = 0; i < number_of_servers; i++)
+   {
+      int srv = servers[i];
+
+      pgmoneta_log_info("Backup: Scheduled backup of %s", config->servers[srv].name);
+
+      pid = fork();
+      if (pid == -1)
+      {
+         pgmoneta_log_error("Backup: No fork for the scheduled backup of %s", config->servers[srv].name);
+      }
+      else if (pid == 0)
+      {
+         struct json* payload = NULL;
+
+         shutdown_ports();
+
+         if (pgmoneta_cron_backup_payload(srv, &payload))
+         {
+            exit(1);
+         }
+
+         pgmoneta_set_proc_title(1, argv_ptr, "backup", config->servers[srv].name);
+         pgmoneta_backup(-1, srv, 0, 0, payload);
+      }
+   }
+}
+
+static void
+cluster_cb(struct ev_loop* loop, ev_periodic* w, int revents)
+{
+   if (EV_ERROR & revents)
+   {
+      pgmoneta_log_trace("cluster_cb: got invalid event: %s", strerror(errno));
+      errno = 0;
+      return;
+   }
+
+   if (keep_running)
+   {
+      pgmoneta_cluster_balance();
+   }
+}
+
 static void
 wal_streaming_cb(struct ev_loop* loop, ev_periodic* w, int revents)
 {
    bool start = false;
    int follow;
+   int number_of_starts = 0;
+   int starts[NUMBER_OF_SERVERS];
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -1879,7 +2481,7 @@ wal_streaming_cb(struct ev_loop* loop, ev_periodic* w, int revents)
                          i, config->servers[i].valid, config->servers[i].wal_streaming,
                          config->servers[i].checksums, config->servers[i].summarize_wal);
 
-      if (keep_running && !config->servers[i].wal_streaming)
+      if (keep_running && !config->servers[i].wal_streaming && pgmoneta_cluster_owns(i))
       {
          start = false;
 
@@ -1906,16 +2508,19 @@ wal_streaming_cb(struct ev_loop* loop, ev_periodic* w, int revents)
          }
          else
          {
-            for (int j = 0; !start && j < config->number_of_servers; j++)
+            follow = pgmoneta_server_index(config->servers[i].follow);
+
+            if (follow != -1 && !config->servers[follow].wal_streaming)
             {
-               if (!strcmp(config->servers[i].follow, config->servers[j].name) && !config->servers[j].wal_streaming)
-               {
-                  start = true;
-               }
+               start = true;
             }
          }
 
-         if (start)
+         if (start && wal_multiplexed())
+         {
+            starts[number_of_starts++] = i;
+         }
+         else if (start)
          {
             pid_t pid;
 
@@ -1933,6 +2538,11 @@ wal_streaming_cb(struct ev_loop* loop, ev_periodic* w, int revents)
          }
       }
    }
+
+   if (number_of_starts > 0)
+   {
+      start_wal_multiplex(&starts[0], number_of_starts);
+   }
 }
 
 static bool
@@ -1973,6 +2583,16 @@ reload_configuration(void)
 
    pgmoneta_reload_configuration(&restart);
 
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      pgmoneta_prometheus_refresh(i);
+
+      // the retention settings may have changed
+      atomic_store(&config->states[i].retention_until, 0);
+   }
+
+   pgmoneta_token_bucket_init_shared();
+
    if (old_metrics != config->metrics)
    {
       shutdown_metrics();
@@ -1998,6 +2618,12 @@ reload_configuration(void)
 
          start_metrics();
 
+         if (pgmoneta_prometheus_start())
+         {
+            pgmoneta_log_fatal("Could not start the metrics server");
+            exit(1);
+         }
+
          for (int i = 0; i < metrics_fds_length; i++)
          {
             pgmoneta_log_debug("Metrics: %d", *(metrics_fds + i));
@@ -2044,13 +2670,53 @@ static void
 init_receivewals(void)
 {
    int active = 0;
+   int number_of_receivers;
+   int number_of_servers = 0;
+   int servers[NUMBER_OF_SERVERS];
+   int group[NUMBER_OF_SERVERS];
+   int number_of_group;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
+   if (wal_multiplexed())
+   {
+      for (int i = 0; i < config->number_of_servers; i++)
+      {
+         if (strlen(config->servers[i].follow) == 0 && pgmoneta_cluster_owns(i))
+         {
+            servers[number_of_servers++] = i;
+         }
+      }
+
+      number_of_receivers = MIN(config->wal_receivers, number_of_servers);
+
+      // spread the servers round-robin over the receiver processes
+      for (int r = 0; r < number_of_receivers; r++)
+      {
+         number_of_group = 0;
+         for (int i = r; i < number_of_servers; i += number_of_receivers)
+         {
+            group[number_of_group++] = servers[i];
+         }
+
+         if (start_wal_multiplex(&group[0], number_of_group))
+         {
+            active++;
+         }
+      }
+
+      if (active == 0 && !pgmoneta_cluster_enabled())
+      {
+         pgmoneta_log_error("No active WAL streaming");
+      }
+
+      return;
+   }
+
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      if (strlen(config->servers[i].follow) == 0)
+      if (strlen(config->servers[i].follow) == 0 && pgmoneta_cluster_owns(i))
       {
          pid_t pid;
 
@@ -2072,14 +2738,92 @@ init_receivewals(void)
       }
    }
 
-   if (active == 0)
+   if (active == 0 && !pgmoneta_cluster_enabled())
    {
       pgmoneta_log_error("No active WAL streaming");
    }
 }
 
+static bool
+wal_multiplexed(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // the SSH storage engine keeps a single session per process
+   return config->wal_receivers > 0 && !(config->storage_engine & STORAGE_ENGINE_SSH);
+}
+
+static bool
+start_wal_multiplex(int* servers, int number_of_servers)
+{
+   pid_t pid;
+
+   pid = fork();
+   if (pid == -1)
+   {
+      /* No process */
+      pgmoneta_log_error("WAL - Cannot create process");
+      return false;
+   }
+   else if (pid == 0)
+   {
+      shutdown_ports();
+      pgmoneta_wal_multiplex(servers, number_of_servers, argv_ptr);
+   }
+
+   return true;
+}
+
 static int
 init_replication_slots(void)
+{
+   int ret = 0;
+   int status;
+   pid_t pids[NUMBER_OF_SERVERS];
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   /* The servers are checked at the same time, so an unreachable server only costs its own timeout */
+   for (int srv = 0; srv < config->number_of_servers; srv++)
+   {
+      pids[srv] = fork();
+
+      if (pids[srv] == -1)
+      {
+         pgmoneta_log_error("Cannot create process for server %s", config->servers[srv].name);
+         ret = 1;
+      }
+      else if (pids[srv] == 0)
+      {
+         shutdown_ports();
+
+         pgmoneta_memory_init();
+         status = init_replication_slot(srv);
+         pgmoneta_memory_destroy();
+
+         exit(status);
+      }
+   }
+
+   for (int srv = 0; srv < config->number_of_servers; srv++)
+   {
+      if (pids[srv] > 0)
+      {
+         if (waitpid(pids[srv], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+         {
+            ret = 1;
+         }
+      }
+   }
+
+   return ret;
+}
+
+static int
+init_replication_slot(int srv)
 {
    int usr;
    int auth = AUTH_ERROR;
@@ -2094,140 +2838,133 @@ init_replication_slots(void)
 
    config = (struct configuration*)shmem;
 
-   pgmoneta_memory_init();
+   usr = -1;
 
-   for (int srv = 0; srv < config->number_of_servers; srv++)
+   for (int i = 0; usr == -1 && i < config->number_of_users; i++)
    {
-      usr = -1;
-
-      for (int i = 0; usr == -1 && i < config->number_of_users; i++)
+      if (!strcmp(config->servers[srv].username, config->users[i].username))
       {
-         if (!strcmp(config->servers[srv].username, config->users[i].username))
-         {
-            usr = i;
-         }
+         usr = i;
       }
+   }
 
-      if (usr != -1)
+   if (usr != -1)
+   {
+      create_slot = config->servers[srv].create_slot == CREATE_SLOT_YES ||
+                    (config->create_slot == CREATE_SLOT_YES && config->servers[srv].create_slot != CREATE_SLOT_NO);
+      socket = 0;
+      auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket);
+
+      if (auth == AUTH_SUCCESS)
       {
-         create_slot = config->servers[srv].create_slot == CREATE_SLOT_YES ||
-                       (config->create_slot == CREATE_SLOT_YES && config->servers[srv].create_slot != CREATE_SLOT_NO);
-         socket = 0;
-         auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket);
+         pgmoneta_server_info(srv);
 
-         if (auth == AUTH_SUCCESS)
+         if (!pgmoneta_server_valid(srv))
          {
-            pgmoneta_server_info(srv);
+            pgmoneta_log_fatal("Could not get version for server %s", config->servers[srv].name);
+            ret = 1;
+            goto server_done;
+         }
 
-            if (!pgmoneta_server_valid(srv))
-            {
-               pgmoneta_log_fatal("Could not get version for server %s", config->servers[srv].name);
-               ret = 1;
-               goto server_done;
-            }
+         if (config->servers[srv].version < POSTGRESQL_MIN_VERSION)
+         {
+            pgmoneta_log_fatal("PostgreSQL %d or higher is required for server %s", POSTGRESQL_MIN_VERSION, config->servers[srv].name);
+            ret = 1;
+            goto server_done;
+         }
 
-            if (config->servers[srv].version < POSTGRESQL_MIN_VERSION)
-            {
-               pgmoneta_log_fatal("PostgreSQL %d or higher is required for server %s", POSTGRESQL_MIN_VERSION, config->servers[srv].name);
-               ret = 1;
-               goto server_done;
-            }
+         if (config->servers[srv].version < 15 && (config->compression_type == COMPRESSION_SERVER_GZIP ||
+                                                   config->compression_type == COMPRESSION_SERVER_ZSTD ||
+                                                   config->compression_type == COMPRESSION_SERVER_LZ4))
+         {
+            pgmoneta_log_fatal("PostgreSQL 15 or higher is required for server %s for server side compression", config->servers[srv].name);
+            ret = 1;
+            goto server_done;
+         }
 
-            if (config->servers[srv].version < 15 && (config->compression_type == COMPRESSION_SERVER_GZIP ||
-                                                      config->compression_type == COMPRESSION_SERVER_ZSTD ||
-                                                      config->compression_type == COMPRESSION_SERVER_LZ4))
-            {
-               pgmoneta_log_fatal("PostgreSQL 15 or higher is required for server %s for server side compression", config->servers[srv].name);
-               ret = 1;
-               goto server_done;
-            }
+         if (config->servers[srv].version >= 17 && !config->servers[srv].summarize_wal)
+         {
+            pgmoneta_log_fatal("PostgreSQL %d or higher requires summarize_wal for server %s",
+                               config->servers[srv].version, config->servers[srv].name);
+            ret = 1;
+            goto server_done;
+         }
 
-            if (config->servers[srv].version >= 17 && !config->servers[srv].summarize_wal)
+         /* Verify replication slot */
+         slot_status = verify_replication_slot(config->servers[srv].wal_slot, srv, ssl, socket);
+         if (slot_status == VALID_SLOT)
+         {
+            /* Ok */
+         }
+         else if (!create_slot)
+         {
+            if (slot_status == SLOT_NOT_FOUND)
             {
-               pgmoneta_log_fatal("PostgreSQL %d or higher requires summarize_wal for server %s",
-                                  config->servers[srv].version, config->servers[srv].name);
+               pgmoneta_log_fatal("Replication slot '%s' is not found for server %s", config->servers[srv].wal_slot, config->servers[srv].name);
                ret = 1;
-               goto server_done;
-            }
-
-            /* Verify replication slot */
-            slot_status = verify_replication_slot(config->servers[srv].wal_slot, srv, ssl, socket);
-            if (slot_status == VALID_SLOT)
-            {
-               /* Ok */
             }
-            else if (!create_slot)
+            else if (slot_status == INCORRECT_SLOT_TYPE)
             {
-               if (slot_status == SLOT_NOT_FOUND)
-               {
-                  pgmoneta_log_fatal("Replication slot '%s' is not found for server %s", config->servers[srv].wal_slot, config->servers[srv].name);
-                  ret = 1;
-               }
-               else if (slot_status == INCORRECT_SLOT_TYPE)
-               {
-                  pgmoneta_log_fatal("Replication slot '%s' should be physical", config->servers[srv].wal_slot);
-                  ret = 1;
-               }
+               pgmoneta_log_fatal("Replication slot '%s' should be physical", config->servers[srv].wal_slot);
+               ret = 1;
             }
          }
-         else
-         {
-            pgmoneta_log_error("Authentication failed for user %s on %s", config->users[usr].username, config->servers[srv].name);
-            ret = 1;
-         }
+      }
+      else
+      {
+         pgmoneta_log_error("Authentication failed for user %s on %s", config->users[usr].username, config->servers[srv].name);
+         ret = 1;
+      }
 
-         pgmoneta_close_ssl(ssl);
-         pgmoneta_disconnect(socket);
-         socket = 0;
+      pgmoneta_close_ssl(ssl);
+      pgmoneta_disconnect(socket);
+      socket = 0;
+
+      if (create_slot && slot_status == SLOT_NOT_FOUND)
+      {
+         auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket);
 
-         if (create_slot && slot_status == SLOT_NOT_FOUND)
+         if (auth == AUTH_SUCCESS)
          {
-            auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket);
+            pgmoneta_log_trace("CREATE_SLOT: %s/%s", config->servers[srv].name, config->servers[srv].wal_slot);
 
-            if (auth == AUTH_SUCCESS)
+            pgmoneta_create_replication_slot_message(config->servers[srv].wal_slot, &slot_request_msg, config->servers[srv].version);
+            if (pgmoneta_write_message(ssl, socket, slot_request_msg) == MESSAGE_STATUS_OK)
             {
-               pgmoneta_log_trace("CREATE_SLOT: %s/%s", config->servers[srv].name, config->servers[srv].wal_slot);
-
-               pgmoneta_create_replication_slot_message(config->servers[srv].wal_slot, &slot_request_msg, config->servers[srv].version);
-               if (pgmoneta_write_message(ssl, socket, slot_request_msg) == MESSAGE_STATUS_OK)
+               if (pgmoneta_read_block_message(ssl, socket, &slot_response_msg) == MESSAGE_STATUS_OK)
                {
-                  if (pgmoneta_read_block_message(ssl, socket, &slot_response_msg) == MESSAGE_STATUS_OK)
-                  {
-                     pgmoneta_log_info("Created replication slot %s on %s", config->servers[srv].wal_slot, config->servers[srv].name);
-                  }
-                  else
-                  {
-                     pgmoneta_log_error("Could not read CREATE_REPLICATION_SLOT response for %s", config->servers[srv].name);
-                  }
+                  pgmoneta_log_info("Created replication slot %s on %s", config->servers[srv].wal_slot, config->servers[srv].name);
                }
                else
                {
-                  pgmoneta_log_error("Could not write CREATE_REPLICATION_SLOT request for %s", config->servers[srv].name);
+                  pgmoneta_log_error("Could not read CREATE_REPLICATION_SLOT response for %s", config->servers[srv].name);
                }
-
-               pgmoneta_free_message(slot_request_msg);
-               slot_request_msg = NULL;
-
-               pgmoneta_clear_message();
-               slot_response_msg = NULL;
             }
             else
             {
-               pgmoneta_log_error("Authentication failed for user on %s", config->servers[srv].name);
+               pgmoneta_log_error("Could not write CREATE_REPLICATION_SLOT request for %s", config->servers[srv].name);
             }
 
-server_done:
-            pgmoneta_close_ssl(ssl);
-            pgmoneta_disconnect(socket);
+            pgmoneta_free_message(slot_request_msg);
+            slot_request_msg = NULL;
+
+            pgmoneta_clear_message();
+            slot_response_msg = NULL;
          }
-      }
-      else
-      {
-         pgmoneta_log_error("Invalid user for %s", config->servers[srv].name);
+         else
+         {
+            pgmoneta_log_error("Authentication failed for user on %s", config->servers[srv].name);
+         }
+
+server_done:
+         pgmoneta_close_ssl(ssl);
+         pgmoneta_disconnect(socket);
       }
    }
-
-   pgmoneta_memory_destroy();
+   else
+   {
+      pgmoneta_log_error("Invalid user for %s", config->servers[srv].name);
+   }
 
    return ret;
 }
@@ -43,6 +43,7 @@
 #include <unistd.h>
 
 #define OPT_COLOR 1000
+#define OPT_STATS 1001
 
 static void
 version(void)
@@ -59,12 +60,12 @@ usage(void)
    printf("\n");
 
    printf("Usage:\n");
-   printf("  pgmoneta-walinfo <file>\n");
+   printf("  pgmoneta-walinfo <file|directory>\n");
    printf("\n");
    printf("Options:\n");
    printf("  -c, --config CONFIG_FILE Set the path to the pgmoneta.conf file\n");
    printf("  -o, --output FILE        Output file\n");
-   printf("  -F, --format             Output format (raw, json)\n");
+   printf("  -F, --format             Output format (raw, json, csv)\n");
    printf("  -L, --logfile FILE       Set the log file\n");
    printf("  -q, --quiet              No output only result\n");
    printf("      --color              Use colors (on, off)\n");
@@ -73,6 +74,8 @@ usage(void)
    printf("  -e, --end                Filter on an end LSN\n");
    printf("  -x, --xid                Filter on an XID\n");
    printf("  -l, --limit              Limit number of outputs\n");
+   printf("      --stats              Display aggregated statistics instead of the records\n");
+   printf("  -w, --workers            Number of segments decoded in parallel\n");
    printf("  -v, --verbose            Output result\n");
    printf("  -V, --version            Display version information\n");
    printf("  -?, --help               Display help\n");
@@ -102,8 +105,11 @@ main(int argc, char** argv)
    uint64_t end_lsn_low = 0;
    struct deque* xids = NULL;
    uint32_t limit = 0;
+   int workers = -1;
+   bool stats = false;
    bool verbose = false;
    enum value_type type = ValueString;
+   bool csv = false;
    size_t size;
    struct configuration* config = NULL;
 
@@ -128,13 +134,15 @@ main(int argc, char** argv)
          {"end", required_argument, 0, 'e'},
          {"xid", required_argument, 0, 'x'},
          {"limit", required_argument, 0, 'l'},
+         {"workers", required_argument, 0, 'w'},
+         {"stats", no_argument, 0, OPT_STATS},
          {"verbose", no_argument, 0, 'v'},
          {"version", no_argument, 0, 'V'},
          {"help", no_argument, 0, '?'},
          {0, 0, 0, 0}
       };
 
-      c = getopt_long(argc, argv, "c:qvV?:o:F:L:r:s:e:x:l:",
+      c = getopt_long(argc, argv, "c:qvV?:o:F:L:r:s:e:x:l:w:",
                       long_options, &option_index);
 
       if (c == -1)
@@ -157,6 +165,10 @@ main(int argc, char** argv)
             {
                type = ValueJSON;
             }
+            else if (!strcmp(format, "csv"))
+            {
+               csv = true;
+            }
             else
             {
                type = ValueString;
@@ -244,6 +256,12 @@ main(int argc, char** argv)
          case 'l':
             limit = pgmoneta_atoi(optarg);
             break;
+         case 'w':
+            workers = pgmoneta_atoi(optarg);
+            break;
+         case OPT_STATS:
+            stats = true;
+            break;
          case 'v':
             verbose = true;
             break;
@@ -305,12 +323,25 @@ main(int argc, char** argv)
       exit(1);
    }
 
+   if (workers == -1)
+   {
+      workers = config->workers;
+   }
+
    if (optind < argc)
    {
       char* file_path = argv[optind];
 
-      if (pgmoneta_describe_walfile(file_path, type, output, quiet, color,
-                                    rms, start_lsn, end_lsn, xids, limit))
+      if (stats)
+      {
+         if (pgmoneta_describe_walfile_stats(file_path, type, output, rms, start_lsn, end_lsn, xids, limit, workers))
+         {
+            fprintf(stderr, "Error while reading/describing WAL file\n");
+            goto error;
+         }
+      }
+      else if (pgmoneta_describe_walfile(file_path, type, csv, output, quiet, color,
+                                         rms, start_lsn, end_lsn, xids, limit, workers))
       {
          fprintf(stderr, "Error while reading/describing WAL file\n");
          goto error;
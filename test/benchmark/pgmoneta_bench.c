@@ -0,0 +1,790 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <aes.h>
+#include <bzip2_compression.h>
+#include <configuration.h>
+#include <gzip_compression.h>
+#include <json.h>
+#include <logging.h>
+#include <lz4_compression.h>
+#include <security.h>
+#include <sha256.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+#include <workers.h>
+#include <zstandard_compression.h>
+
+/* system */
+#include <dirent.h>
+#include <err.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#define BENCH_PAGE_SIZE     8192
+#define BENCH_RELATION_SIZE (8 * 1024 * 1024)
+#define BENCH_WAL_SIZE      (16 * 1024 * 1024)
+#define BENCH_MAX_WORKERS   16
+#define BENCH_MAX_LEVELS    5
+
+/** @struct bench_backend
+ * Defines a backend that is measured
+ */
+struct bench_backend
+{
+   char* name;                                       /**< The name */
+   int compression;                                  /**< The compression type, COMPRESSION_NONE if none */
+   int encryption;                                   /**< The encryption mode, ENCRYPTION_NONE if none */
+   int levels[BENCH_MAX_LEVELS];                     /**< The levels, 0 terminated */
+   int (*run)(char* d, char* m, struct workers* w);  /**< Process the files of a directory, or of a manifest */
+};
+
+static int bench_zstd(char* d, char* m, struct workers* w);
+static int bench_sha256(char* d, char* m, struct workers* w);
+
+static struct bench_backend backends[] =
+{
+   {"gzip", COMPRESSION_CLIENT_GZIP, ENCRYPTION_NONE, {1, 6, 9}, pgmoneta_gzip_data},
+   {"zstd", COMPRESSION_CLIENT_ZSTD, ENCRYPTION_NONE, {1, 3, 9, 19}, bench_zstd},
+   {"lz4", COMPRESSION_CLIENT_LZ4, ENCRYPTION_NONE, {1, 6, 12}, pgmoneta_lz4c_data},
+   {"bzip2", COMPRESSION_CLIENT_BZIP2, ENCRYPTION_NONE, {1, 9}, pgmoneta_bzip2_data},
+   {"aes-256-gcm", COMPRESSION_NONE, ENCRYPTION_AES_256_GCM, {1}, pgmoneta_encrypt_data},
+   {"aes-256-ctr", COMPRESSION_NONE, ENCRYPTION_AES_256_CTR, {1}, pgmoneta_encrypt_data},
+   {"sha256", COMPRESSION_NONE, ENCRYPTION_NONE, {1}, bench_sha256},
+};
+
+static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+static char* words[] =
+{
+   "postgresql", "backup", "restore", "segment", "relation", "tablespace", "checkpoint",
+   "vacuum", "index", "tuple", "commit", "replica", "archive", "manifest", "timeline", "pgmoneta",
+};
+
+static void
+version(void)
+{
+   printf("pgmoneta_bench %s\n", VERSION);
+   exit(1);
+}
+
+static void
+usage(void)
+{
+   printf("pgmoneta_bench %s\n", VERSION);
+   printf("  Measure the compression, encryption and hashing backends\n");
+   printf("\n");
+
+   printf("Usage:\n");
+   printf("  pgmoneta_bench [ -d DIRECTORY ] [ -s SIZE ] [ -w WORKERS ] [ -b BACKENDS ] [ -o FILE ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -d, --directory DIRECTORY The work directory (default /tmp/pgmoneta_bench)\n");
+   printf("  -s, --size SIZE           The size of each corpus in MB (default 64)\n");
+   printf("  -w, --workers WORKERS     The comma separated worker counts (default 0,4)\n");
+   printf("  -b, --backends BACKENDS   The comma separated backends (default all)\n");
+   printf("                            gzip, zstd, lz4, bzip2, aes-256-gcm, aes-256-ctr, sha256\n");
+   printf("  -o, --output FILE         The JSON output file (default stdout)\n");
+   printf("  -V, --version             Display version information\n");
+   printf("  -?, --help                Display help\n");
+   printf("\n");
+   printf("pgmoneta: %s\n", PGMONETA_HOMEPAGE);
+   printf("Report bugs: %s\n", PGMONETA_ISSUES);
+}
+
+static uint64_t
+bench_random(void)
+{
+   // xorshift64*, so the corpora are the same for every run
+   seed ^= seed >> 12;
+   seed ^= seed << 25;
+   seed ^= seed >> 27;
+   return seed * 0x2545F4914F6CDD1DULL;
+}
+
+static void
+bench_page(unsigned char* page, uint64_t lsn, uint32_t* id)
+{
+   int lower;
+   int upper;
+   int length;
+   int fill;
+   char tuple[256];
+
+   memset(page, 0, BENCH_PAGE_SIZE);
+
+   // a page header followed by the line pointers, and the tuples from the end
+   lower = 24;
+   upper = BENCH_PAGE_SIZE;
+   fill = 60 + (int)(bench_random() % 41);
+
+   while (upper - lower > BENCH_PAGE_SIZE * (100 - fill) / 100 + 256)
+   {
+      memset(&tuple[0], 0, sizeof(tuple));
+
+      // the tuple header, an increasing key, a timestamp like value and some text
+      length = 23 + 1;
+      memcpy(&tuple[0], id, sizeof(uint32_t));
+      tuple[18] = 3;
+      tuple[22] = 24;
+      memcpy(&tuple[length], id, sizeof(uint32_t));
+      length += 8;
+      *(uint64_t*)&tuple[length] = 700000000000000ULL + (uint64_t)(*id) * 1000 + bench_random() % 1000;
+      length += 8;
+      for (int i = 0; i < 1 + (int)(bench_random() % 6) && length < 200; i++)
+      {
+         char* word = words[bench_random() % (sizeof(words) / sizeof(words[0]))];
+         memcpy(&tuple[length], word, strlen(word));
+         length += strlen(word) + 1;
+      }
+      if (bench_random() % 4 == 0)
+      {
+         // incompressible data, like a hash or a UUID
+         for (int i = 0; i < 16; i++)
+         {
+            tuple[length++] = (char)bench_random();
+         }
+      }
+      length = (length + 7) & ~7;
+
+      upper -= length;
+      memcpy(page + upper, &tuple[0], length);
+      *(uint32_t*)(page + lower) = (uint32_t)upper | ((uint32_t)length << 17);
+      lower += 4;
+
+      (*id)++;
+   }
+
+   *(uint64_t*)page = lsn;
+   *(uint16_t*)(page + 12) = (uint16_t)lower;
+   *(uint16_t*)(page + 14) = (uint16_t)upper;
+   *(uint16_t*)(page + 16) = BENCH_PAGE_SIZE;
+   *(uint16_t*)(page + 18) = BENCH_PAGE_SIZE | 4;
+}
+
+static int
+bench_relation(char* path, size_t size)
+{
+   static uint32_t id = 1;
+   FILE* file = NULL;
+   unsigned char page[BENCH_PAGE_SIZE];
+
+   file = fopen(path, "wb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   for (size_t offset = 0; offset < size; offset += BENCH_PAGE_SIZE)
+   {
+      bench_page(&page[0], 0x100000000ULL + offset, &id);
+      if (fwrite(&page[0], 1, BENCH_PAGE_SIZE, file) != BENCH_PAGE_SIZE)
+      {
+         goto error;
+      }
+   }
+
+   fclose(file);
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static int
+bench_wal(char* path, size_t size, uint64_t start)
+{
+   static uint32_t id = 1;
+   static uint32_t xid = 1000;
+   FILE* file = NULL;
+   unsigned char* segment = NULL;
+   unsigned char fpi[BENCH_PAGE_SIZE];
+   size_t used;
+   size_t offset = 0;
+   uint32_t length;
+
+   segment = (unsigned char*)calloc(1, size);
+   if (segment == NULL)
+   {
+      goto error;
+   }
+
+   // a segment that was switched before it was full has a zero filled tail
+   used = size - (bench_random() % 4 == 0 ? size / 4 : 0);
+
+   while (offset + 64 + BENCH_PAGE_SIZE < used)
+   {
+      if (offset % BENCH_PAGE_SIZE == 0)
+      {
+         // the page header
+         *(uint16_t*)(segment + offset) = 0xD116;
+         *(uint32_t*)(segment + offset + 4) = 1;
+         *(uint64_t*)(segment + offset + 8) = start + offset;
+         offset += 24;
+      }
+
+      if (bench_random() % 16 == 0)
+      {
+         // a full page image after a checkpoint
+         bench_page(&fpi[0], start + offset, &id);
+         length = 24 + 20 + BENCH_PAGE_SIZE / 2;
+         memcpy(segment + offset + 44, &fpi[0], BENCH_PAGE_SIZE / 2);
+      }
+      else
+      {
+         // an insert or update with a block reference and a tuple
+         length = 24 + 20 + 32 + (uint32_t)(bench_random() % 96);
+         for (uint32_t i = 44; i < length; i++)
+         {
+            segment[offset + i] = (i % 8 == 0) ? (unsigned char)bench_random() : (unsigned char)(id + i);
+         }
+         id++;
+      }
+
+      *(uint32_t*)(segment + offset) = length;
+      *(uint32_t*)(segment + offset + 4) = xid;
+      *(uint64_t*)(segment + offset + 8) = start + offset;
+      segment[offset + 16] = (unsigned char)(bench_random() % 4) << 4;
+      segment[offset + 17] = 10;
+      *(uint32_t*)(segment + offset + 20) = (uint32_t)bench_random();
+      *(uint32_t*)(segment + offset + 24) = 1663;
+      *(uint32_t*)(segment + offset + 28) = 5;
+      *(uint32_t*)(segment + offset + 32) = 16384 + (uint32_t)(bench_random() % 8);
+      *(uint32_t*)(segment + offset + 36) = (uint32_t)(bench_random() % 4096);
+
+      if (bench_random() % 8 == 0)
+      {
+         xid++;
+      }
+
+      offset += (length + 7) & ~7;
+   }
+
+   file = fopen(path, "wb");
+   if (file == NULL || fwrite(segment, 1, size, file) != size)
+   {
+      goto error;
+   }
+
+   fclose(file);
+   free(segment);
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   free(segment);
+
+   return 1;
+}
+
+static int
+bench_corpus(char* directory, char* name, size_t size)
+{
+   char path[MAX_PATH];
+   bool wal = !strcmp(name, "wal");
+   size_t file_size = wal ? BENCH_WAL_SIZE : BENCH_RELATION_SIZE;
+
+   memset(&path[0], 0, sizeof(path));
+   snprintf(&path[0], sizeof(path), "%s/%s", directory, name);
+
+   if (pgmoneta_mkdir(&path[0]))
+   {
+      goto error;
+   }
+
+   for (size_t i = 0; i * file_size < size; i++)
+   {
+      memset(&path[0], 0, sizeof(path));
+      if (wal)
+      {
+         snprintf(&path[0], sizeof(path), "%s/%s/0000000100000000%08zX", directory, name, i + 1);
+         if (bench_wal(&path[0], file_size, (i + 1) * file_size))
+         {
+            goto error;
+         }
+      }
+      else
+      {
+         snprintf(&path[0], sizeof(path), "%s/%s/%zu", directory, name, 16384 + i);
+         if (bench_relation(&path[0], file_size))
+         {
+            goto error;
+         }
+      }
+   }
+
+   return 0;
+
+error:
+   warnx("Could not create the %s corpus in %s", name, directory);
+
+   return 1;
+}
+
+static int
+bench_zstd(char* d, char* m, struct workers* w)
+{
+   pgmoneta_zstandardc_data(d, m, w);
+
+   return 0;
+}
+
+static void
+bench_sha256_file(struct worker_input* wi)
+{
+   char* sha256 = NULL;
+
+   if (pgmoneta_sha256_file(wi->from, &sha256))
+   {
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+
+   free(sha256);
+   free(wi);
+}
+
+static int
+bench_sha256(char* d, char* m, struct workers* w)
+{
+   DIR* dir = NULL;
+   struct dirent* entry;
+   char path[MAX_PATH];
+   struct worker_input* wi = NULL;
+
+   if (!(dir = opendir(d)))
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type != DT_REG)
+      {
+         continue;
+      }
+
+      memset(&path[0], 0, sizeof(path));
+      snprintf(&path[0], sizeof(path), "%s/%s", d, entry->d_name);
+
+      if (pgmoneta_create_worker_input(d, &path[0], NULL, 0, w, &wi))
+      {
+         goto error;
+      }
+
+      if (w != NULL)
+      {
+         pgmoneta_workers_add(w, bench_sha256_file, wi);
+      }
+      else
+      {
+         bench_sha256_file(wi);
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return 1;
+}
+
+static double
+bench_cpu(void)
+{
+   struct rusage usage;
+
+   // the worker threads are a part of the process
+   getrusage(RUSAGE_SELF, &usage);
+
+   return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+          usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+static int
+bench_run(char* directory, char* corpus, struct bench_backend* backend, int level, int number_of_workers, struct json* results)
+{
+   char from[MAX_PATH];
+   char to[MAX_PATH];
+   bool ok = true;
+   unsigned long input;
+   unsigned long output;
+   double elapsed;
+   double cpu;
+   struct timespec start_t;
+   struct timespec end_t;
+   struct workers* workers = NULL;
+   struct json* result = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&from[0], 0, sizeof(from));
+   snprintf(&from[0], sizeof(from), "%s/%s", directory, corpus);
+   memset(&to[0], 0, sizeof(to));
+   snprintf(&to[0], sizeof(to), "%s/run", directory);
+
+   // the backends work in place, so every run gets a fresh copy of the corpus
+   pgmoneta_delete_directory(&to[0]);
+   if (pgmoneta_copy_directory(&from[0], &to[0], NULL, NULL))
+   {
+      goto error;
+   }
+   sync();
+
+   input = pgmoneta_directory_size(&to[0]);
+
+   config->compression_type = backend->compression;
+   config->compression_level = level;
+   config->encryption = backend->encryption;
+
+   if (number_of_workers > 0 && pgmoneta_workers_initialize(number_of_workers, &workers))
+   {
+      goto error;
+   }
+
+   cpu = bench_cpu();
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   /* The corpus has no manifest, so the backends walk the directory */
+   if (backend->run(&to[0], NULL, workers))
+   {
+      ok = false;
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      ok = ok && workers->outcome;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+   cpu = bench_cpu() - cpu;
+
+   pgmoneta_workers_destroy(workers);
+   workers = NULL;
+
+   elapsed = (end_t.tv_sec - start_t.tv_sec) + (end_t.tv_nsec - start_t.tv_nsec) / 1000000000.0;
+   output = pgmoneta_directory_size(&to[0]);
+
+   if (pgmoneta_json_create(&result))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(result, "corpus", (uintptr_t)corpus, ValueString);
+   pgmoneta_json_put(result, "backend", (uintptr_t)backend->name, ValueString);
+   pgmoneta_json_put(result, "level", (uintptr_t)level, ValueInt32);
+   pgmoneta_json_put(result, "workers", (uintptr_t)number_of_workers, ValueInt32);
+   pgmoneta_json_put(result, "success", (uintptr_t)ok, ValueBool);
+   pgmoneta_json_put(result, "input_bytes", (uintptr_t)input, ValueUInt64);
+   pgmoneta_json_put(result, "output_bytes", (uintptr_t)output, ValueUInt64);
+   pgmoneta_json_put(result, "ratio", pgmoneta_value_from_double(output > 0 ? (double)input / output : 0.0), ValueDouble);
+   pgmoneta_json_put(result, "seconds", pgmoneta_value_from_double(elapsed), ValueDouble);
+   pgmoneta_json_put(result, "cpu_seconds", pgmoneta_value_from_double(cpu), ValueDouble);
+   pgmoneta_json_put(result, "mb_per_second", pgmoneta_value_from_double(elapsed > 0 ? input / (1024.0 * 1024.0) / elapsed : 0.0), ValueDouble);
+   pgmoneta_json_put(result, "mb_per_cpu_second", pgmoneta_value_from_double(cpu > 0 ? input / (1024.0 * 1024.0) / cpu : 0.0), ValueDouble);
+
+   pgmoneta_json_append(results, (uintptr_t)result, ValueJSON);
+
+   fprintf(stderr, "%-6s %-12s level %2d workers %2d: %8.1f MB/s %6.2f cpu s ratio %.2f%s\n",
+           corpus, backend->name, level, number_of_workers,
+           elapsed > 0 ? input / (1024.0 * 1024.0) / elapsed : 0.0, cpu,
+           output > 0 ? (double)input / output : 0.0, ok ? "" : " (failed)");
+
+   pgmoneta_delete_directory(&to[0]);
+
+   return 0;
+
+error:
+   pgmoneta_workers_destroy(workers);
+   pgmoneta_delete_directory(&to[0]);
+
+   return 1;
+}
+
+static bool
+bench_selected(char* list, char* name)
+{
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   bool found = false;
+
+   if (list == NULL)
+   {
+      return true;
+   }
+
+   copy = strdup(list);
+   if (copy == NULL)
+   {
+      return false;
+   }
+
+   for (token = strtok_r(copy, ",", &saveptr); !found && token != NULL; token = strtok_r(NULL, ",", &saveptr))
+   {
+      found = !strcmp(token, name);
+   }
+
+   free(copy);
+
+   return found;
+}
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int option_index = 0;
+   int number_of_workers = 0;
+   int workers[BENCH_MAX_WORKERS];
+   char* directory = "/tmp/pgmoneta_bench";
+   char* list = NULL;
+   char* output = NULL;
+   char* worker_list = "0,4";
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   char* key = NULL;
+   char* s = NULL;
+   char* corpora[] = {"relation", "wal"};
+   size_t size = 64;
+   size_t shmem_size;
+   bool encryption = true;
+   FILE* file = NULL;
+   struct json* json = NULL;
+   struct json* results = NULL;
+   struct configuration* config = NULL;
+
+   while (1)
+   {
+      static struct option long_options[] =
+      {
+         {"directory", required_argument, 0, 'd'},
+         {"size", required_argument, 0, 's'},
+         {"workers", required_argument, 0, 'w'},
+         {"backends", required_argument, 0, 'b'},
+         {"output", required_argument, 0, 'o'},
+         {"version", no_argument, 0, 'V'},
+         {"help", no_argument, 0, '?'},
+         {0, 0, 0, 0}
+      };
+
+      c = getopt_long(argc, argv, "V?d:s:w:b:o:", long_options, &option_index);
+
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'd':
+            directory = optarg;
+            break;
+         case 's':
+            size = (size_t)pgmoneta_atoi(optarg);
+            break;
+         case 'w':
+            worker_list = optarg;
+            break;
+         case 'b':
+            list = optarg;
+            break;
+         case 'o':
+            output = optarg;
+            break;
+         case 'V':
+            version();
+            exit(0);
+         case '?':
+            usage();
+            exit(0);
+         default:
+            break;
+      }
+   }
+
+   if (size == 0)
+   {
+      errx(1, "Invalid size");
+   }
+   size *= 1024 * 1024;
+
+   copy = strdup(worker_list);
+   for (token = strtok_r(copy, ",", &saveptr); token != NULL && number_of_workers < BENCH_MAX_WORKERS; token = strtok_r(NULL, ",", &saveptr))
+   {
+      workers[number_of_workers++] = pgmoneta_atoi(token);
+   }
+   free(copy);
+
+   shmem_size = sizeof(struct configuration);
+   if (pgmoneta_create_shared_memory(shmem_size, HUGEPAGE_OFF, &shmem))
+   {
+      errx(1, "Error creating shared memory");
+   }
+
+   pgmoneta_init_configuration(shmem);
+   config = (struct configuration*)shmem;
+   config->log_type = PGMONETA_LOGGING_TYPE_CONSOLE;
+   config->log_level = PGMONETA_LOGGING_LEVEL_WARN;
+
+   if (pgmoneta_start_logging())
+   {
+      errx(1, "Error starting logging");
+   }
+
+   // the encryption backends use the master key of the user
+   if (pgmoneta_get_master_key(&key))
+   {
+      warnx("No master key, so the encryption backends are skipped");
+      encryption = false;
+   }
+   free(key);
+
+   pgmoneta_delete_directory(directory);
+   if (pgmoneta_mkdir(directory))
+   {
+      warnx("Could not create %s", directory);
+      goto error;
+   }
+
+   for (int i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++)
+   {
+      if (bench_corpus(directory, corpora[i], size))
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_json_create(&json) || pgmoneta_json_create(&results))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(json, "version", (uintptr_t)VERSION, ValueString);
+   pgmoneta_json_put(json, "timestamp", (uintptr_t)time(NULL), ValueInt64);
+   pgmoneta_json_put(json, "cpus", (uintptr_t)sysconf(_SC_NPROCESSORS_ONLN), ValueInt32);
+   pgmoneta_json_put(json, "corpus_bytes", (uintptr_t)size, ValueUInt64);
+   pgmoneta_json_put(json, "sha256_multi_buffer", (uintptr_t)pgmoneta_sha256_multi_buffer(), ValueBool);
+
+   for (int i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++)
+   {
+      for (int j = 0; j < (int)(sizeof(backends) / sizeof(backends[0])); j++)
+      {
+         if (!bench_selected(list, backends[j].name) ||
+             (backends[j].encryption != ENCRYPTION_NONE && !encryption))
+         {
+            continue;
+         }
+
+         for (int k = 0; k < BENCH_MAX_LEVELS && backends[j].levels[k] != 0; k++)
+         {
+            for (int l = 0; l < number_of_workers; l++)
+            {
+               if (bench_run(directory, corpora[i], &backends[j], backends[j].levels[k], workers[l], results))
+               {
+                  warnx("Could not run %s on the %s corpus", backends[j].name, corpora[i]);
+               }
+            }
+         }
+      }
+   }
+
+   pgmoneta_json_put(json, "results", (uintptr_t)results, ValueJSON);
+   results = NULL;
+
+   s = pgmoneta_json_to_string(json, FORMAT_JSON, NULL, 0);
+
+   if (output != NULL)
+   {
+      file = fopen(output, "w");
+      if (file == NULL)
+      {
+         warnx("Could not open %s", output);
+         goto error;
+      }
+      fprintf(file, "%s\n", s);
+      fclose(file);
+   }
+   else
+   {
+      printf("%s\n", s);
+   }
+
+   free(s);
+   pgmoneta_json_destroy(json);
+
+   pgmoneta_delete_directory(directory);
+
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return 0;
+
+error:
+   free(s);
+   pgmoneta_json_destroy(results);
+   pgmoneta_json_destroy(json);
+
+   pgmoneta_delete_directory(directory);
+
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return 1;
+}
@@ -0,0 +1,846 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <configuration.h>
+#include <deque.h>
+#include <json.h>
+#include <logging.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+
+/* system */
+#include <err.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_THREADS   64
+#define BENCH_KEY_LENGTH    64
+#define BENCH_MAX_RETRIES   1000000
+
+/** @struct bench_art_thread
+ * Defines the slice of keys a thread inserts into or searches a concurrent tree
+ */
+struct bench_art_thread
+{
+   struct art* tree;   /**< The tree */
+   char** keys;        /**< The keys */
+   uint64_t start;     /**< The first key */
+   uint64_t end;       /**< The key after the last */
+   bool search;        /**< Search rather than insert */
+   bool outcome;       /**< The outcome */
+};
+
+/** @struct bench_deque_thread
+ * Defines a thread adding to and polling a shared deque
+ */
+struct bench_deque_thread
+{
+   struct deque* deque;  /**< The deque */
+   uint64_t operations;  /**< The number of adds, each followed by a poll */
+   bool outcome;         /**< The outcome */
+};
+
+static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+static void
+version(void)
+{
+   printf("pgmoneta_bench_containers %s\n", VERSION);
+   exit(1);
+}
+
+static void
+usage(void)
+{
+   printf("pgmoneta_bench_containers %s\n", VERSION);
+   printf("  Measure the ART, deque, JSON and value containers\n");
+   printf("\n");
+
+   printf("Usage:\n");
+   printf("  pgmoneta_bench_containers [ -k KEYS ] [ -t THREADS ] [ -n OPERATIONS ] [ -m MANIFEST ] [ -o FILE ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -k, --keys KEYS            The largest number of keys, from 1000 by factors of 10 (default 1000000)\n");
+   printf("  -t, --threads THREADS      The comma separated thread counts (default 1,2,4,8)\n");
+   printf("  -n, --operations OPERATIONS The number of deque and value operations (default 1000000)\n");
+   printf("  -m, --manifest MANIFEST    A backup_manifest to parse (default a generated one)\n");
+   printf("  -f, --files FILES          The number of files of the generated manifest (default 100000)\n");
+   printf("  -o, --output FILE          The JSON output file (default stdout)\n");
+   printf("  -V, --version              Display version information\n");
+   printf("  -?, --help                 Display help\n");
+   printf("\n");
+   printf("pgmoneta: %s\n", PGMONETA_HOMEPAGE);
+   printf("Report bugs: %s\n", PGMONETA_ISSUES);
+}
+
+static uint64_t
+bench_random(void)
+{
+   // xorshift64*, so the runs are reproducible
+   seed ^= seed >> 12;
+   seed ^= seed << 25;
+   seed ^= seed >> 27;
+
+   return seed * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+bench_now(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+
+   return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static void
+bench_result(struct json* results, char* benchmark, char* variant, char* operation, uint64_t size, int threads, uint64_t operations, double elapsed, bool ok)
+{
+   struct json* result = NULL;
+
+   if (pgmoneta_json_create(&result))
+   {
+      return;
+   }
+
+   pgmoneta_json_put(result, "benchmark", (uintptr_t)benchmark, ValueString);
+   pgmoneta_json_put(result, "variant", (uintptr_t)variant, ValueString);
+   pgmoneta_json_put(result, "operation", (uintptr_t)operation, ValueString);
+   pgmoneta_json_put(result, "size", (uintptr_t)size, ValueUInt64);
+   pgmoneta_json_put(result, "threads", (uintptr_t)threads, ValueInt32);
+   pgmoneta_json_put(result, "operations", (uintptr_t)operations, ValueUInt64);
+   pgmoneta_json_put(result, "success", (uintptr_t)ok, ValueBool);
+   pgmoneta_json_put(result, "seconds", pgmoneta_value_from_double(elapsed), ValueDouble);
+   pgmoneta_json_put(result, "operations_per_second", pgmoneta_value_from_double(elapsed > 0 ? operations / elapsed : 0.0), ValueDouble);
+
+   pgmoneta_json_append(results, (uintptr_t)result, ValueJSON);
+
+   fprintf(stderr, "%-6s %-10s %-10s size %9" PRIu64 " threads %2d: %12.0f ops/s %8.4f s%s\n",
+           benchmark, variant, operation, size, threads,
+           elapsed > 0 ? operations / elapsed : 0.0, elapsed, ok ? "" : " (failed)");
+}
+
+static int
+bench_compare_keys(const void* a, const void* b)
+{
+   return strcmp(*(char**)a, *(char**)b);
+}
+
+/**
+ * Keys shaped like the relation paths of a manifest, in random order
+ */
+static char**
+bench_keys(uint64_t number_of_keys)
+{
+   char** keys = NULL;
+   char key[BENCH_KEY_LENGTH];
+
+   keys = calloc(number_of_keys, sizeof(char*));
+   if (keys == NULL)
+   {
+      return NULL;
+   }
+
+   for (uint64_t i = 0; i < number_of_keys; i++)
+   {
+      memset(&key[0], 0, sizeof(key));
+      snprintf(&key[0], sizeof(key), "base/%u/%" PRIu64 "%s", 16384 + (unsigned int)(bench_random() % 8),
+               16384 + i, (bench_random() % 4) == 0 ? "_fsm" : "");
+      keys[i] = strdup(&key[0]);
+      if (keys[i] == NULL)
+      {
+         goto error;
+      }
+   }
+
+   for (uint64_t i = number_of_keys - 1; i > 0; i--)
+   {
+      uint64_t j = bench_random() % (i + 1);
+      char* t = keys[i];
+
+      keys[i] = keys[j];
+      keys[j] = t;
+   }
+
+   return keys;
+
+error:
+   for (uint64_t i = 0; i < number_of_keys; i++)
+   {
+      free(keys[i]);
+   }
+   free(keys);
+
+   return NULL;
+}
+
+static int
+bench_art_count(void* data, const char* key, struct value* value)
+{
+   (void)key;
+   (void)value;
+
+   (*(uint64_t*)data)++;
+
+   return 0;
+}
+
+static void*
+bench_art_worker(void* arg)
+{
+   struct bench_art_thread* t = (struct bench_art_thread*)arg;
+
+   t->outcome = true;
+
+   for (uint64_t i = t->start; i < t->end; i++)
+   {
+      if (t->search)
+      {
+         if (pgmoneta_art_search(t->tree, t->keys[i]) != (uintptr_t)i)
+         {
+            t->outcome = false;
+         }
+      }
+      else if (pgmoneta_art_insert(t->tree, t->keys[i], (uintptr_t)i, ValueUInt64))
+      {
+         t->outcome = false;
+      }
+   }
+
+   return NULL;
+}
+
+static int
+bench_art(uint64_t number_of_keys, int* threads, int number_of_threads, struct json* results)
+{
+   char** keys = NULL;
+   char** sorted = NULL;
+   uintptr_t* values = NULL;
+   uint64_t count = 0;
+   double start;
+   bool ok;
+   pthread_t tids[BENCH_MAX_THREADS];
+   struct bench_art_thread args[BENCH_MAX_THREADS];
+   struct art* tree = NULL;
+
+   keys = bench_keys(number_of_keys);
+   if (keys == NULL)
+   {
+      goto error;
+   }
+
+   // the default tree, one thread
+   if (pgmoneta_art_create(&tree))
+   {
+      goto error;
+   }
+
+   ok = true;
+   start = bench_now();
+   for (uint64_t i = 0; i < number_of_keys; i++)
+   {
+      ok = pgmoneta_art_insert(tree, keys[i], (uintptr_t)i, ValueUInt64) == 0 && ok;
+   }
+   bench_result(results, "art", "default", "insert", number_of_keys, 1, number_of_keys, bench_now() - start, ok);
+
+   ok = true;
+   start = bench_now();
+   for (uint64_t i = 0; i < number_of_keys; i++)
+   {
+      ok = pgmoneta_art_search(tree, keys[i]) == (uintptr_t)i && ok;
+   }
+   bench_result(results, "art", "default", "search", number_of_keys, 1, number_of_keys, bench_now() - start, ok);
+
+   start = bench_now();
+   ok = pgmoneta_art_iterate(tree, bench_art_count, &count) == 0 && count == number_of_keys;
+   bench_result(results, "art", "default", "iterate", number_of_keys, 1, number_of_keys, bench_now() - start, ok);
+
+   start = bench_now();
+   pgmoneta_art_destroy(tree);
+   tree = NULL;
+   bench_result(results, "art", "default", "destroy", number_of_keys, 1, number_of_keys, bench_now() - start, true);
+
+   // the bulk load from sorted keys
+   sorted = malloc(number_of_keys * sizeof(char*));
+   values = malloc(number_of_keys * sizeof(uintptr_t));
+   if (sorted == NULL || values == NULL)
+   {
+      goto error;
+   }
+   memcpy(sorted, keys, number_of_keys * sizeof(char*));
+   qsort(sorted, number_of_keys, sizeof(char*), bench_compare_keys);
+   for (uint64_t i = 0; i < number_of_keys; i++)
+   {
+      values[i] = (uintptr_t)i;
+   }
+
+   start = bench_now();
+   ok = pgmoneta_art_create_sorted(sorted, values, ValueUInt64, number_of_keys, &tree) == 0;
+   bench_result(results, "art", "sorted", "insert", number_of_keys, 1, number_of_keys, bench_now() - start, ok);
+   pgmoneta_art_destroy(tree);
+   tree = NULL;
+
+   // the concurrent tree, with each thread taking a slice of the keys
+   for (int t = 0; t < number_of_threads; t++)
+   {
+      int n = threads[t];
+
+      for (int s = 0; s < 2; s++)
+      {
+         if (s == 0 && pgmoneta_art_create_concurrent(&tree))
+         {
+            goto error;
+         }
+
+         start = bench_now();
+         for (int i = 0; i < n; i++)
+         {
+            args[i].tree = tree;
+            args[i].keys = keys;
+            args[i].start = number_of_keys * i / n;
+            args[i].end = number_of_keys * (i + 1) / n;
+            args[i].search = s == 1;
+            args[i].outcome = false;
+            pthread_create(&tids[i], NULL, bench_art_worker, &args[i]);
+         }
+
+         ok = true;
+         for (int i = 0; i < n; i++)
+         {
+            pthread_join(tids[i], NULL);
+            ok = ok && args[i].outcome;
+         }
+         bench_result(results, "art", "concurrent", s == 0 ? "insert" : "search", number_of_keys, n, number_of_keys, bench_now() - start, ok);
+      }
+
+      pgmoneta_art_destroy(tree);
+      tree = NULL;
+   }
+
+   for (uint64_t i = 0; i < number_of_keys; i++)
+   {
+      free(keys[i]);
+   }
+   free(keys);
+   free(sorted);
+   free(values);
+
+   return 0;
+
+error:
+   pgmoneta_art_destroy(tree);
+   if (keys != NULL)
+   {
+      for (uint64_t i = 0; i < number_of_keys; i++)
+      {
+         free(keys[i]);
+      }
+   }
+   free(keys);
+   free(sorted);
+   free(values);
+
+   return 1;
+}
+
+static void*
+bench_deque_worker(void* arg)
+{
+   int retries;
+   struct bench_deque_thread* t = (struct bench_deque_thread*)arg;
+
+   t->outcome = true;
+
+   for (uint64_t i = 0; i < t->operations; i++)
+   {
+      if (pgmoneta_deque_add(t->deque, NULL, (uintptr_t)(i + 1), ValueUInt64))
+      {
+         t->outcome = false;
+      }
+      // another thread may take this value, but there is always one left for the poll,
+      // though an add in flight on the lock free ring can hide it for a moment
+      retries = 0;
+      while (pgmoneta_deque_poll(t->deque, NULL) == 0)
+      {
+         if (++retries == BENCH_MAX_RETRIES)
+         {
+            t->outcome = false;
+            break;
+         }
+         sched_yield();
+      }
+   }
+
+   return NULL;
+}
+
+static int
+bench_deque(uint64_t operations, int* threads, int number_of_threads, struct json* results)
+{
+   char* variants[] = {"mutex", "lock_free"};
+   double start;
+   bool ok;
+   pthread_t tids[BENCH_MAX_THREADS];
+   struct bench_deque_thread args[BENCH_MAX_THREADS];
+   struct deque* deque = NULL;
+
+   for (int v = 0; v < 2; v++)
+   {
+      for (int t = 0; t < number_of_threads; t++)
+      {
+         int n = threads[t];
+
+         if ((v == 0 && pgmoneta_deque_create(true, &deque)) ||
+             (v == 1 && pgmoneta_deque_create_lock_free(0, &deque)))
+         {
+            goto error;
+         }
+
+         start = bench_now();
+         for (int i = 0; i < n; i++)
+         {
+            args[i].deque = deque;
+            args[i].operations = operations / n;
+            args[i].outcome = false;
+            pthread_create(&tids[i], NULL, bench_deque_worker, &args[i]);
+         }
+
+         ok = true;
+         for (int i = 0; i < n; i++)
+         {
+            pthread_join(tids[i], NULL);
+            ok = ok && args[i].outcome;
+         }
+         bench_result(results, "deque", variants[v], "add_poll", operations, n, 2 * (operations / n) * n, bench_now() - start, ok);
+
+         pgmoneta_deque_destroy(deque);
+         deque = NULL;
+      }
+   }
+
+   return 0;
+
+error:
+   pgmoneta_deque_destroy(deque);
+
+   return 1;
+}
+
+static int
+bench_value(uint64_t operations, struct json* results)
+{
+   char* s = NULL;
+   double start;
+   bool ok = true;
+   struct value* value = NULL;
+
+   start = bench_now();
+   for (uint64_t i = 0; i < operations; i++)
+   {
+      ok = pgmoneta_value_create(ValueInt64, (uintptr_t)i, &value) == 0 && ok;
+      pgmoneta_value_destroy(value);
+      value = NULL;
+   }
+   bench_result(results, "value", "int64", "create", operations, 1, operations, bench_now() - start, ok);
+
+   ok = true;
+   start = bench_now();
+   for (uint64_t i = 0; i < operations; i++)
+   {
+      ok = pgmoneta_value_create(ValueString, (uintptr_t)"base/16384/16385", &value) == 0 && ok;
+      pgmoneta_value_destroy(value);
+      value = NULL;
+   }
+   bench_result(results, "value", "string", "create", operations, 1, operations, bench_now() - start, ok);
+
+   ok = true;
+   start = bench_now();
+   for (uint64_t i = 0; i < operations; i++)
+   {
+      ok = pgmoneta_value_create(ValueDouble, pgmoneta_value_from_double(i / 3.0), &value) == 0 && ok;
+      s = pgmoneta_value_to_string(value, FORMAT_JSON, NULL, 0);
+      ok = s != NULL && ok;
+      free(s);
+      pgmoneta_value_destroy(value);
+      value = NULL;
+   }
+   bench_result(results, "value", "double", "to_string", operations, 1, operations, bench_now() - start, ok);
+
+   return 0;
+}
+
+/**
+ * Write a manifest in the format of PostgreSQL
+ */
+static int
+bench_manifest(char* path, uint64_t files)
+{
+   char checksum[65];
+   FILE* file = NULL;
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+   fprintf(file, "{ \"PostgreSQL-Backup-Manifest-Version\": 2,\n\"System-Identifier\": 7416347593216340742,\n\"Files\": [\n");
+   for (uint64_t i = 0; i < files; i++)
+   {
+      for (int j = 0; j < 64; j++)
+      {
+         checksum[j] = "0123456789abcdef"[bench_random() % 16];
+      }
+      checksum[64] = '\0';
+
+      fprintf(file, "{ \"Path\": \"base/%u/%" PRIu64 "\", \"Size\": %" PRIu64 ", \"Last-Modified\": \"2025-01-01 00:00:00 GMT\", \"Checksum-Algorithm\": \"SHA256\", \"Checksum\": \"%s\" }%s\n",
+              16384 + (unsigned int)(i % 8), 16384 + i, (bench_random() % 1024) * 8192, &checksum[0],
+              i + 1 < files ? "," : "");
+   }
+   fprintf(file, "],\n\"WAL-Ranges\": [\n{ \"Timeline\": 1, \"Start-LSN\": \"0/2000028\", \"End-LSN\": \"0/2000138\" }\n],\n");
+   fprintf(file, "\"Manifest-Checksum\": \"0000000000000000000000000000000000000000000000000000000000000000\"}\n");
+
+   fclose(file);
+
+   return 0;
+}
+
+static char*
+bench_read(char* path)
+{
+   char* s = NULL;
+   long size;
+   FILE* file = NULL;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      return NULL;
+   }
+
+   fseek(file, 0, SEEK_END);
+   size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+
+   s = calloc(1, size + 1);
+   if (s != NULL && fread(s, 1, size, file) != (size_t)size)
+   {
+      free(s);
+      s = NULL;
+   }
+
+   fclose(file);
+
+   return s;
+}
+
+static int
+bench_json(char* manifest, uint64_t files, struct json* results)
+{
+   char path[MAX_PATH];
+   char* content = NULL;
+   char* s = NULL;
+   char* key_path[] = {"Files"};
+   uint64_t count = 0;
+   uint64_t size;
+   double start;
+   bool ok;
+   struct json* json = NULL;
+   struct json* item = NULL;
+   struct json_reader* reader = NULL;
+
+   memset(&path[0], 0, sizeof(path));
+   if (manifest != NULL)
+   {
+      snprintf(&path[0], sizeof(path), "%s", manifest);
+   }
+   else
+   {
+      snprintf(&path[0], sizeof(path), "/tmp/pgmoneta_bench_containers.%d", getpid());
+      if (bench_manifest(&path[0], files))
+      {
+         warnx("Could not create %s", &path[0]);
+         goto error;
+      }
+   }
+
+   content = bench_read(&path[0]);
+   if (content == NULL)
+   {
+      warnx("Could not read %s", &path[0]);
+      goto error;
+   }
+   size = strlen(content);
+
+   start = bench_now();
+   ok = pgmoneta_json_parse_string(content, &json) == 0;
+   bench_result(results, "json", "manifest", "parse", size, 1, size, bench_now() - start, ok);
+
+   if (ok)
+   {
+      start = bench_now();
+      s = pgmoneta_json_to_string(json, FORMAT_JSON_COMPACT, NULL, 0);
+      bench_result(results, "json", "manifest", "serialize", size, 1, size, bench_now() - start, s != NULL);
+      free(s);
+      s = NULL;
+
+      start = bench_now();
+      pgmoneta_json_destroy(json);
+      json = NULL;
+      bench_result(results, "json", "manifest", "destroy", size, 1, size, bench_now() - start, true);
+   }
+
+   // the streaming reader, as the manifest code reads the files
+   start = bench_now();
+   ok = pgmoneta_json_reader_init(&path[0], &reader) == 0 && pgmoneta_json_locate(reader, key_path, 1) == 0;
+   while (ok && pgmoneta_json_next_array_item(reader, &item))
+   {
+      count++;
+      pgmoneta_json_destroy(item);
+      item = NULL;
+   }
+   bench_result(results, "json", "manifest", "stream", size, 1, count, bench_now() - start, ok && count > 0);
+   pgmoneta_json_reader_close(reader);
+
+   if (manifest == NULL)
+   {
+      unlink(&path[0]);
+   }
+   free(content);
+
+   return 0;
+
+error:
+   if (manifest == NULL)
+   {
+      unlink(&path[0]);
+   }
+   free(content);
+   pgmoneta_json_destroy(json);
+
+   return 1;
+}
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int option_index = 0;
+   int number_of_threads = 0;
+   int threads[BENCH_MAX_THREADS];
+   char* thread_list = "1,2,4,8";
+   char* manifest = NULL;
+   char* output = NULL;
+   char* copy = NULL;
+   char* token = NULL;
+   char* saveptr = NULL;
+   char* s = NULL;
+   uint64_t max_keys = 1000000;
+   uint64_t operations = 1000000;
+   uint64_t files = 100000;
+   size_t shmem_size;
+   FILE* file = NULL;
+   struct json* json = NULL;
+   struct json* results = NULL;
+   struct configuration* config = NULL;
+
+   while (1)
+   {
+      static struct option long_options[] =
+      {
+         {"keys", required_argument, 0, 'k'},
+         {"threads", required_argument, 0, 't'},
+         {"operations", required_argument, 0, 'n'},
+         {"manifest", required_argument, 0, 'm'},
+         {"files", required_argument, 0, 'f'},
+         {"output", required_argument, 0, 'o'},
+         {"version", no_argument, 0, 'V'},
+         {"help", no_argument, 0, '?'},
+         {0, 0, 0, 0}
+      };
+
+      c = getopt_long(argc, argv, "V?k:t:n:m:f:o:", long_options, &option_index);
+
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'k':
+            max_keys = strtoull(optarg, NULL, 10);
+            break;
+         case 't':
+            thread_list = optarg;
+            break;
+         case 'n':
+            operations = strtoull(optarg, NULL, 10);
+            break;
+         case 'm':
+            manifest = optarg;
+            break;
+         case 'f':
+            files = strtoull(optarg, NULL, 10);
+            break;
+         case 'o':
+            output = optarg;
+            break;
+         case 'V':
+            version();
+            exit(0);
+         case '?':
+            usage();
+            exit(0);
+         default:
+            break;
+      }
+   }
+
+   if (max_keys < 1000 || operations == 0 || files == 0)
+   {
+      errx(1, "Invalid number of keys, operations or files");
+   }
+
+   copy = strdup(thread_list);
+   for (token = strtok_r(copy, ",", &saveptr); token != NULL && number_of_threads < BENCH_MAX_THREADS; token = strtok_r(NULL, ",", &saveptr))
+   {
+      int n = pgmoneta_atoi(token);
+
+      if (n > 0 && n <= BENCH_MAX_THREADS)
+      {
+         threads[number_of_threads++] = n;
+      }
+   }
+   free(copy);
+
+   if (number_of_threads == 0)
+   {
+      errx(1, "Invalid thread counts");
+   }
+
+   shmem_size = sizeof(struct configuration);
+   if (pgmoneta_create_shared_memory(shmem_size, HUGEPAGE_OFF, &shmem))
+   {
+      errx(1, "Error creating shared memory");
+   }
+
+   pgmoneta_init_configuration(shmem);
+   config = (struct configuration*)shmem;
+   config->log_type = PGMONETA_LOGGING_TYPE_CONSOLE;
+   config->log_level = PGMONETA_LOGGING_LEVEL_WARN;
+
+   if (pgmoneta_start_logging())
+   {
+      errx(1, "Error starting logging");
+   }
+
+   if (pgmoneta_json_create(&json) || pgmoneta_json_create(&results))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(json, "version", (uintptr_t)VERSION, ValueString);
+   pgmoneta_json_put(json, "timestamp", (uintptr_t)time(NULL), ValueInt64);
+   pgmoneta_json_put(json, "cpus", (uintptr_t)sysconf(_SC_NPROCESSORS_ONLN), ValueInt32);
+
+   for (uint64_t keys = 1000; keys <= max_keys; keys *= 10)
+   {
+      if (bench_art(keys, &threads[0], number_of_threads, results))
+      {
+         warnx("Could not run the ART benchmark with %" PRIu64 " keys", keys);
+      }
+   }
+
+   if (bench_deque(operations, &threads[0], number_of_threads, results))
+   {
+      warnx("Could not run the deque benchmark");
+   }
+
+   if (bench_value(operations, results))
+   {
+      warnx("Could not run the value benchmark");
+   }
+
+   if (bench_json(manifest, files, results))
+   {
+      warnx("Could not run the JSON benchmark");
+   }
+
+   pgmoneta_json_put(json, "results", (uintptr_t)results, ValueJSON);
+   results = NULL;
+
+   s = pgmoneta_json_to_string(json, FORMAT_JSON, NULL, 0);
+
+   if (output != NULL)
+   {
+      file = fopen(output, "w");
+      if (file == NULL)
+      {
+         warnx("Could not open %s", output);
+         goto error;
+      }
+      fprintf(file, "%s\n", s);
+      fclose(file);
+   }
+   else
+   {
+      printf("%s\n", s);
+   }
+
+   free(s);
+   pgmoneta_json_destroy(json);
+
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return 0;
+
+error:
+   free(s);
+   pgmoneta_json_destroy(results);
+   pgmoneta_json_destroy(json);
+
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return 1;
+}
@@ -0,0 +1,646 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <configuration.h>
+#include <json.h>
+#include <logging.h>
+#include <memory.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+#include <wal.h>
+
+/* system */
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define BENCH_SEGMENT_SIZE  (16 * 1024 * 1024)
+#define BENCH_MESSAGE_SIZE  (128 * 1024)
+#define BENCH_HEADER_SIZE   (1 + 4 + 1 + 8 + 8 + 8)
+#define BENCH_PAGE_SIZE     8192
+
+/** @struct bench_source
+ * Defines the replication source, which sends CopyData messages of generated or recorded WAL
+ */
+struct bench_source
+{
+   int socket;            /**< The socket */
+   char* recorded;        /**< The directory of recorded WAL segments, or NULL to generate */
+   size_t size;           /**< The number of bytes to generate */
+   size_t segsize;        /**< The segment size */
+   size_t message_size;   /**< The WAL bytes per message */
+   uint64_t start;        /**< The position of the first message */
+   bool outcome;          /**< The outcome */
+};
+
+static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+static char* words[] =
+{
+   "postgresql", "backup", "restore", "segment", "relation", "tablespace", "checkpoint",
+   "vacuum", "index", "tuple", "commit", "replica", "archive", "manifest", "timeline", "pgmoneta",
+};
+
+static void
+version(void)
+{
+   printf("pgmoneta_bench_wal %s\n", VERSION);
+   exit(1);
+}
+
+static void
+usage(void)
+{
+   printf("pgmoneta_bench_wal %s\n", VERSION);
+   printf("  Measure the WAL receiver against a synthetic replication source\n");
+   printf("\n");
+
+   printf("Usage:\n");
+   printf("  pgmoneta_bench_wal [ -c CONFIG_FILE ] [ -s SERVER ] [ -d DIRECTORY ] [ -z SIZE ] [ -m SIZE ] [ -r DIRECTORY ] [ -o FILE ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -c, --config CONFIG_FILE  A pgmoneta.conf with the settings to measure\n");
+   printf("  -s, --server SERVER       The server of the configuration (default the first)\n");
+   printf("  -d, --directory DIRECTORY The base directory (default /tmp/pgmoneta_bench_wal)\n");
+   printf("  -z, --size SIZE           The WAL to generate in MB (default 1024)\n");
+   printf("  -m, --message SIZE        The WAL bytes per message (default 131072)\n");
+   printf("  -r, --recorded DIRECTORY  Replay the WAL segments of a directory instead\n");
+   printf("  -o, --output FILE         The JSON output file (default stdout)\n");
+   printf("  -V, --version             Display version information\n");
+   printf("  -?, --help                Display help\n");
+   printf("\n");
+   printf("pgmoneta: %s\n", PGMONETA_HOMEPAGE);
+   printf("Report bugs: %s\n", PGMONETA_ISSUES);
+}
+
+static uint64_t
+bench_random(void)
+{
+   // xorshift64*, so the runs are reproducible
+   seed ^= seed >> 12;
+   seed ^= seed << 25;
+   seed ^= seed >> 27;
+
+   return seed * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * A segment of pages with a header, some words and some noise, which compresses
+ * about as well as WAL does
+ */
+static void
+bench_segment(unsigned char* segment, size_t segsize, uint64_t lsn)
+{
+   size_t offset = 0;
+
+   for (size_t page = 0; page < segsize; page += BENCH_PAGE_SIZE)
+   {
+      memset(segment + page, 0, BENCH_PAGE_SIZE);
+      pgmoneta_write_int64(segment + page + 8, (int64_t)(lsn + page));
+
+      offset = page + 24;
+      while (offset + 64 < page + BENCH_PAGE_SIZE)
+      {
+         if (bench_random() % 3 == 0)
+         {
+            for (int i = 0; i < 32; i++)
+            {
+               segment[offset++] = (unsigned char)bench_random();
+            }
+         }
+         else
+         {
+            char* word = words[bench_random() % (sizeof(words) / sizeof(words[0]))];
+
+            memcpy(segment + offset, word, strlen(word));
+            offset += strlen(word) + (bench_random() % 8);
+         }
+      }
+   }
+}
+
+static int
+bench_send(int socket, void* data, size_t size)
+{
+   size_t offset = 0;
+   ssize_t n;
+
+   while (offset < size)
+   {
+      n = write(socket, (char*)data + offset, size - offset);
+      if (n == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return 1;
+      }
+      offset += n;
+   }
+
+   return 0;
+}
+
+static int
+bench_send_segment(struct bench_source* source, unsigned char* segment, uint64_t* position, unsigned char* message)
+{
+   size_t bytes;
+   struct timespec t;
+
+   for (size_t offset = 0; offset < source->segsize; offset += bytes)
+   {
+      bytes = source->message_size;
+      if (offset + bytes > source->segsize)
+      {
+         bytes = source->segsize - offset;
+      }
+
+      clock_gettime(CLOCK_REALTIME, &t);
+
+      pgmoneta_write_byte(message, 'd');
+      pgmoneta_write_int32(message + 1, (int32_t)(4 + 1 + 8 + 8 + 8 + bytes));
+      pgmoneta_write_byte(message + 5, 'w');
+      pgmoneta_write_int64(message + 6, (int64_t)*position);
+      pgmoneta_write_int64(message + 14, (int64_t)(*position + bytes));
+      pgmoneta_write_int64(message + 22, (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000);
+      memcpy(message + BENCH_HEADER_SIZE, segment + offset, bytes);
+
+      if (bench_send(source->socket, message, BENCH_HEADER_SIZE + bytes))
+      {
+         return 1;
+      }
+
+      *position += bytes;
+   }
+
+   return 0;
+}
+
+static void*
+bench_source_run(void* arg)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   char path[MAX_PATH];
+   unsigned char done[32];
+   unsigned char* segment = NULL;
+   unsigned char* message = NULL;
+   uint64_t position;
+   FILE* file = NULL;
+   struct bench_source* source = (struct bench_source*)arg;
+
+   source->outcome = false;
+   position = source->start;
+
+   segment = malloc(source->segsize);
+   message = malloc(BENCH_HEADER_SIZE + source->message_size);
+   if (segment == NULL || message == NULL)
+   {
+      goto done;
+   }
+
+   if (source->recorded != NULL)
+   {
+      if (pgmoneta_get_wal_files(source->recorded, &number_of_files, &files))
+      {
+         warnx("Could not list %s", source->recorded);
+         goto done;
+      }
+
+      for (int i = 0; i < number_of_files; i++)
+      {
+         memset(&path[0], 0, sizeof(path));
+         snprintf(&path[0], sizeof(path), "%s/%s", source->recorded, files[i]);
+
+         // only complete and uncompressed segments can be sent as they are
+         if (pgmoneta_get_file_size(&path[0]) != source->segsize)
+         {
+            continue;
+         }
+
+         file = fopen(&path[0], "r");
+         if (file == NULL || fread(segment, 1, source->segsize, file) != source->segsize)
+         {
+            warnx("Could not read %s", &path[0]);
+            goto done;
+         }
+         fclose(file);
+         file = NULL;
+
+         if (bench_send_segment(source, segment, &position, message))
+         {
+            goto done;
+         }
+      }
+   }
+   else
+   {
+      bench_segment(segment, source->segsize, position);
+
+      while (position - source->start < source->size)
+      {
+         if (bench_send_segment(source, segment, &position, message))
+         {
+            goto done;
+         }
+      }
+   }
+
+   /*
+    * CopyDone ends the stream and, as from a server, CommandComplete and
+    * ReadyForQuery follow it; the receiver only takes a message once more
+    * bytes are behind it
+    */
+   pgmoneta_write_byte(&done[0], 'c');
+   pgmoneta_write_int32(&done[1], 4);
+   pgmoneta_write_byte(&done[5], 'C');
+   pgmoneta_write_int32(&done[6], 20);
+   memcpy(&done[10], "START_STREAMING", 16);
+   pgmoneta_write_byte(&done[26], 'Z');
+   pgmoneta_write_int32(&done[27], 5);
+   pgmoneta_write_byte(&done[31], 'I');
+   source->outcome = bench_send(source->socket, &done[0], sizeof(done)) == 0;
+
+done:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(segment);
+   free(message);
+
+   shutdown(source->socket, SHUT_WR);
+
+   return NULL;
+}
+
+static void*
+bench_drain_run(void* arg)
+{
+   char buffer[8192];
+   int socket = *(int*)arg;
+
+   // the status reports and the CopyDone of the receiver
+   while (read(socket, &buffer[0], sizeof(buffer)) > 0)
+   {
+   }
+
+   return NULL;
+}
+
+static double
+bench_cpu(int who)
+{
+   struct rusage usage;
+
+   getrusage(who, &usage);
+
+   return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+          usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+/**
+ * The upper bound of the latency bucket holding the given fraction of the messages
+ */
+static double
+bench_percentile(struct wal_replay* replay, double fraction)
+{
+   uint64_t count = 0;
+
+   for (int i = 0; i < WAL_REPLAY_BUCKETS; i++)
+   {
+      count += replay->latency[i];
+      if (count > 0 && count >= fraction * replay->messages)
+      {
+         return (double)(1ULL << i);
+      }
+   }
+
+   return 0.0;
+}
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int option_index = 0;
+   int srv = 0;
+   int sockets[2] = {-1, -1};
+   char* configuration_path = NULL;
+   char* server = NULL;
+   char* directory = "/tmp/pgmoneta_bench_wal";
+   char* recorded = NULL;
+   char* output = NULL;
+   char* s = NULL;
+   size_t size = 1024;
+   size_t message_size = BENCH_MESSAGE_SIZE;
+   size_t shmem_size;
+   double thread_cpu = 0.0;
+   double process_cpu;
+   bool ok;
+   pthread_t source_thread;
+   pthread_t drain_thread;
+   FILE* file = NULL;
+   struct bench_source source;
+   struct wal_replay replay;
+   struct json* json = NULL;
+   struct configuration* config = NULL;
+
+   while (1)
+   {
+      static struct option long_options[] =
+      {
+         {"config", required_argument, 0, 'c'},
+         {"server", required_argument, 0, 's'},
+         {"directory", required_argument, 0, 'd'},
+         {"size", required_argument, 0, 'z'},
+         {"message", required_argument, 0, 'm'},
+         {"recorded", required_argument, 0, 'r'},
+         {"output", required_argument, 0, 'o'},
+         {"version", no_argument, 0, 'V'},
+         {"help", no_argument, 0, '?'},
+         {0, 0, 0, 0}
+      };
+
+      c = getopt_long(argc, argv, "V?c:s:d:z:m:r:o:", long_options, &option_index);
+
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'c':
+            configuration_path = optarg;
+            break;
+         case 's':
+            server = optarg;
+            break;
+         case 'd':
+            directory = optarg;
+            break;
+         case 'z':
+            size = (size_t)pgmoneta_atoi(optarg);
+            break;
+         case 'm':
+            message_size = (size_t)pgmoneta_atoi(optarg);
+            break;
+         case 'r':
+            recorded = optarg;
+            break;
+         case 'o':
+            output = optarg;
+            break;
+         case 'V':
+            version();
+            exit(0);
+         case '?':
+            usage();
+            exit(0);
+         default:
+            break;
+      }
+   }
+
+   if (size == 0 || message_size == 0)
+   {
+      errx(1, "Invalid size");
+   }
+
+   shmem_size = sizeof(struct configuration);
+   if (pgmoneta_create_shared_memory(shmem_size, HUGEPAGE_OFF, &shmem))
+   {
+      errx(1, "Error creating shared memory");
+   }
+
+   pgmoneta_init_configuration(shmem);
+   config = (struct configuration*)shmem;
+
+   if (configuration_path != NULL)
+   {
+      if (pgmoneta_read_configuration(shmem, configuration_path) || pgmoneta_validate_configuration(shmem))
+      {
+         errx(1, "Invalid configuration %s", configuration_path);
+      }
+   }
+   else
+   {
+      config->number_of_servers = 1;
+      snprintf(config->servers[0].name, MISC_LENGTH, "%s", "bench");
+   }
+
+   if (server != NULL)
+   {
+      srv = -1;
+      for (int i = 0; srv == -1 && i < config->number_of_servers; i++)
+      {
+         if (!strcmp(config->servers[i].name, server))
+         {
+            srv = i;
+         }
+      }
+      if (srv == -1)
+      {
+         errx(1, "Unknown server %s", server);
+      }
+   }
+
+   // the WAL is always written below the work directory, never to a real base directory
+   memset(config->base_dir, 0, MAX_PATH);
+   snprintf(config->base_dir, MAX_PATH, "%s", directory);
+
+   if (config->servers[srv].wal_size <= 0)
+   {
+      config->servers[srv].wal_size = BENCH_SEGMENT_SIZE;
+   }
+
+   // generated WAL has no records to index
+   if (recorded == NULL)
+   {
+      config->wal_index = false;
+   }
+
+   config->log_type = PGMONETA_LOGGING_TYPE_CONSOLE;
+   config->log_level = PGMONETA_LOGGING_LEVEL_WARN;
+
+   if (pgmoneta_start_logging())
+   {
+      errx(1, "Error starting logging");
+   }
+
+   pgmoneta_memory_init();
+
+   pgmoneta_delete_directory(directory);
+   if (pgmoneta_mkdir(directory))
+   {
+      warnx("Could not create %s", directory);
+      goto error;
+   }
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, &sockets[0]))
+   {
+      warnx("Could not create the replication source");
+      goto error;
+   }
+
+   memset(&source, 0, sizeof(struct bench_source));
+   source.socket = sockets[0];
+   source.recorded = recorded;
+   source.segsize = config->servers[srv].wal_size;
+   source.size = ((size * 1024 * 1024 + source.segsize - 1) / source.segsize) * source.segsize;
+   source.message_size = message_size;
+   source.start = source.segsize;
+
+   pthread_create(&source_thread, NULL, bench_source_run, &source);
+   pthread_create(&drain_thread, NULL, bench_drain_run, &sockets[0]);
+
+   process_cpu = bench_cpu(RUSAGE_SELF);
+#ifdef RUSAGE_THREAD
+   thread_cpu = bench_cpu(RUSAGE_THREAD);
+#endif
+
+   // the receiver closes its socket
+   ok = pgmoneta_wal_replay(srv, sockets[1], 1, source.start, &replay) == 0;
+   sockets[1] = -1;
+
+#ifdef RUSAGE_THREAD
+   thread_cpu = bench_cpu(RUSAGE_THREAD) - thread_cpu;
+#endif
+
+   pthread_join(source_thread, NULL);
+   pthread_join(drain_thread, NULL);
+   process_cpu = bench_cpu(RUSAGE_SELF) - process_cpu;
+
+   close(sockets[0]);
+   sockets[0] = -1;
+
+   ok = ok && source.outcome;
+
+   if (pgmoneta_json_create(&json))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(json, "version", (uintptr_t)VERSION, ValueString);
+   pgmoneta_json_put(json, "timestamp", (uintptr_t)time(NULL), ValueInt64);
+   pgmoneta_json_put(json, "cpus", (uintptr_t)sysconf(_SC_NPROCESSORS_ONLN), ValueInt32);
+   pgmoneta_json_put(json, "source", (uintptr_t)(recorded != NULL ? "recorded" : "generated"), ValueString);
+   pgmoneta_json_put(json, "compression", (uintptr_t)config->compression_type, ValueInt32);
+   pgmoneta_json_put(json, "encryption", (uintptr_t)config->encryption, ValueInt32);
+   pgmoneta_json_put(json, "wal_stream_compression", (uintptr_t)config->wal_stream_compression, ValueBool);
+   pgmoneta_json_put(json, "wal_fanout_size", (uintptr_t)config->wal_fanout_size, ValueInt32);
+   pgmoneta_json_put(json, "segment_size", (uintptr_t)source.segsize, ValueUInt64);
+   pgmoneta_json_put(json, "message_size", (uintptr_t)message_size, ValueUInt64);
+   pgmoneta_json_put(json, "success", (uintptr_t)ok, ValueBool);
+   pgmoneta_json_put(json, "messages", (uintptr_t)replay.messages, ValueUInt64);
+   pgmoneta_json_put(json, "bytes", (uintptr_t)replay.bytes, ValueUInt64);
+   pgmoneta_json_put(json, "seconds", pgmoneta_value_from_double(replay.elapsed), ValueDouble);
+   pgmoneta_json_put(json, "mb_per_second", pgmoneta_value_from_double(replay.elapsed > 0 ? replay.bytes / (1024.0 * 1024.0) / replay.elapsed : 0.0), ValueDouble);
+   pgmoneta_json_put(json, "receiver_cpu_seconds", pgmoneta_value_from_double(thread_cpu), ValueDouble);
+   pgmoneta_json_put(json, "process_cpu_seconds", pgmoneta_value_from_double(process_cpu), ValueDouble);
+   pgmoneta_json_put(json, "latency_average_us", pgmoneta_value_from_double(replay.messages > 0 ? replay.latency_total * 1000000.0 / replay.messages : 0.0), ValueDouble);
+   pgmoneta_json_put(json, "latency_p50_us", pgmoneta_value_from_double(bench_percentile(&replay, 0.50)), ValueDouble);
+   pgmoneta_json_put(json, "latency_p99_us", pgmoneta_value_from_double(bench_percentile(&replay, 0.99)), ValueDouble);
+   pgmoneta_json_put(json, "latency_max_us", pgmoneta_value_from_double(replay.latency_max * 1000000.0), ValueDouble);
+
+   fprintf(stderr, "%" PRIu64 " messages, %" PRIu64 " bytes: %.1f MB/s, %.2f receiver cpu s, latency average %.1f us p99 < %.0f us max %.1f us%s\n",
+           replay.messages, replay.bytes,
+           replay.elapsed > 0 ? replay.bytes / (1024.0 * 1024.0) / replay.elapsed : 0.0, thread_cpu,
+           replay.messages > 0 ? replay.latency_total * 1000000.0 / replay.messages : 0.0,
+           bench_percentile(&replay, 0.99), replay.latency_max * 1000000.0, ok ? "" : " (failed)");
+
+   s = pgmoneta_json_to_string(json, FORMAT_JSON, NULL, 0);
+
+   if (output != NULL)
+   {
+      file = fopen(output, "w");
+      if (file == NULL)
+      {
+         warnx("Could not open %s", output);
+         goto error;
+      }
+      fprintf(file, "%s\n", s);
+      fclose(file);
+   }
+   else
+   {
+      printf("%s\n", s);
+   }
+
+   free(s);
+   pgmoneta_json_destroy(json);
+
+   pgmoneta_delete_directory(directory);
+
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return ok ? 0 : 1;
+
+error:
+   free(s);
+   pgmoneta_json_destroy(json);
+
+   if (sockets[0] != -1)
+   {
+      close(sockets[0]);
+   }
+   if (sockets[1] != -1)
+   {
+      close(sockets[1]);
+   }
+
+   pgmoneta_delete_directory(directory);
+
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return 1;
+}
@@ -0,0 +1,630 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <configuration.h>
+#include <deque.h>
+#include <json.h>
+#include <logging.h>
+#include <memory.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+#include <walfile.h>
+#include <walfile/wal_reader.h>
+
+/* system */
+#include <err.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MODE_DECODE   0
+#define BENCH_MODE_DESCRIBE 1
+#define BENCH_MODE_JSON     2
+#define BENCH_MODES         3
+
+/** @struct bench_segment
+ * Defines a WAL segment of the corpus, held in memory so only the decoding is timed
+ */
+struct bench_segment
+{
+   char name[MISC_LENGTH];   /**< The name of the segment */
+   char group[MAX_PATH];     /**< The directory of the segment below the corpus, like 17/heap */
+   char* data;               /**< The segment */
+   size_t size;              /**< The size of the segment */
+};
+
+static char* modes[] = {"decode", "describe", "json"};
+
+static void
+version(void)
+{
+   printf("pgmoneta_bench_walfile %s\n", VERSION);
+   exit(1);
+}
+
+static void
+usage(void)
+{
+   printf("pgmoneta_bench_walfile %s\n", VERSION);
+   printf("  Measure the WAL decoder and the resource manager descriptions against a corpus of WAL segments\n");
+   printf("\n");
+
+   printf("Usage:\n");
+   printf("  pgmoneta_bench_walfile -d DIRECTORY [ -m MODES ] [ -i ITERATIONS ] [ -o FILE ] [ -b FILE ] [ -t PERCENT ]\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -d, --directory DIRECTORY The corpus, with the segments of each workload in a directory\n");
+   printf("  -m, --modes MODES         The modes, a list of decode, describe and json (default all)\n");
+   printf("  -i, --iterations N        The runs over each workload, the fastest is kept (default 3)\n");
+   printf("  -o, --output FILE         The JSON output file (default stdout)\n");
+   printf("  -b, --baseline FILE       A previous JSON output to compare against\n");
+   printf("  -t, --tolerance PERCENT   The allowed slowdown against the baseline (default 10)\n");
+   printf("  -V, --version             Display version information\n");
+   printf("  -?, --help                Display help\n");
+   printf("\n");
+   printf("pgmoneta: %s\n", PGMONETA_HOMEPAGE);
+   printf("Report bugs: %s\n", PGMONETA_ISSUES);
+}
+
+static double
+bench_now(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+
+   return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static int
+bench_load(char* corpus, char* group, struct bench_segment** segments, int* number_of_segments)
+{
+   int number_of_files = 0;
+   int number_of_directories = 0;
+   char** files = NULL;
+   char** directories = NULL;
+   char* path = NULL;
+   char* sub = NULL;
+   struct bench_segment* s = NULL;
+
+   path = pgmoneta_append(path, corpus);
+   if (strlen(group) > 0)
+   {
+      path = pgmoneta_append(path, "/");
+      path = pgmoneta_append(path, group);
+   }
+
+   if (pgmoneta_get_wal_files(path, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      char* file = NULL;
+      FILE* f = NULL;
+
+      // only plain segments, the decoder itself is measured
+      if (strlen(files[i]) != 24 || strspn(files[i], "0123456789ABCDEF") != 24)
+      {
+         continue;
+      }
+
+      s = realloc(*segments, (*number_of_segments + 1) * sizeof(struct bench_segment));
+      if (s == NULL)
+      {
+         goto error;
+      }
+      *segments = s;
+      s = &(*segments)[*number_of_segments];
+      memset(s, 0, sizeof(struct bench_segment));
+
+      snprintf(s->name, sizeof(s->name), "%s", files[i]);
+      snprintf(s->group, sizeof(s->group), "%s", strlen(group) > 0 ? group : ".");
+
+      file = pgmoneta_append(file, path);
+      file = pgmoneta_append(file, "/");
+      file = pgmoneta_append(file, files[i]);
+
+      s->size = pgmoneta_get_file_size(file);
+      s->data = malloc(s->size);
+      f = fopen(file, "rb");
+
+      if (s->data == NULL || f == NULL || fread(s->data, 1, s->size, f) != s->size)
+      {
+         warnx("Could not read %s", file);
+         if (f != NULL)
+         {
+            fclose(f);
+         }
+         free(s->data);
+         free(file);
+         goto error;
+      }
+
+      fclose(f);
+      free(file);
+      (*number_of_segments)++;
+   }
+
+   if (pgmoneta_get_directories(path, &number_of_directories, &directories))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_directories; i++)
+   {
+      sub = NULL;
+      if (strlen(group) > 0)
+      {
+         sub = pgmoneta_append(sub, group);
+         sub = pgmoneta_append(sub, "/");
+      }
+      sub = pgmoneta_append(sub, directories[i]);
+
+      if (bench_load(corpus, sub, segments, number_of_segments))
+      {
+         goto error;
+      }
+
+      free(sub);
+      sub = NULL;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   for (int i = 0; i < number_of_directories; i++)
+   {
+      free(directories[i]);
+   }
+   free(directories);
+   free(path);
+
+   return 0;
+
+error:
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   for (int i = 0; i < number_of_directories; i++)
+   {
+      free(directories[i]);
+   }
+   free(directories);
+   free(sub);
+   free(path);
+
+   return 1;
+}
+
+static int
+bench_decode(struct bench_segment* segment, int mode, FILE* sink, uint64_t* records)
+{
+   struct walfile* wf = NULL;
+   struct deque_iterator* iter = NULL;
+
+   if (pgmoneta_read_walfile_buffer(-1, segment->name, segment->data, segment->size, &wf))
+   {
+      return 1;
+   }
+
+   *records += pgmoneta_deque_size(wf->records);
+
+   if (mode != BENCH_MODE_DECODE)
+   {
+      if (pgmoneta_deque_iterator_create(wf->records, &iter))
+      {
+         pgmoneta_destroy_walfile(wf);
+         return 1;
+      }
+
+      while (pgmoneta_deque_iterator_next(iter))
+      {
+         struct decoded_xlog_record* record = (struct decoded_xlog_record*)iter->value->data;
+
+         pgmoneta_wal_record_display(record, wf->long_phd->std.xlp_magic, mode == BENCH_MODE_JSON ? ValueJSON : ValueString,
+                                     sink, false, false, NULL, 0, 0, NULL, 0);
+      }
+
+      pgmoneta_deque_iterator_destroy(iter);
+   }
+
+   pgmoneta_destroy_walfile(wf);
+
+   return 0;
+}
+
+static void
+bench_result(struct json* results, char* group, int mode, int segments, uint64_t records, uint64_t bytes, double elapsed, bool ok)
+{
+   struct json* result = NULL;
+
+   if (pgmoneta_json_create(&result))
+   {
+      return;
+   }
+
+   pgmoneta_json_put(result, "workload", (uintptr_t)group, ValueString);
+   pgmoneta_json_put(result, "mode", (uintptr_t)modes[mode], ValueString);
+   pgmoneta_json_put(result, "segments", (uintptr_t)segments, ValueInt32);
+   pgmoneta_json_put(result, "records", (uintptr_t)records, ValueUInt64);
+   pgmoneta_json_put(result, "bytes", (uintptr_t)bytes, ValueUInt64);
+   pgmoneta_json_put(result, "success", (uintptr_t)ok, ValueBool);
+   pgmoneta_json_put(result, "seconds", pgmoneta_value_from_double(elapsed), ValueDouble);
+   pgmoneta_json_put(result, "records_per_second", pgmoneta_value_from_double(elapsed > 0 ? records / elapsed : 0.0), ValueDouble);
+   pgmoneta_json_put(result, "mb_per_second", pgmoneta_value_from_double(elapsed > 0 ? bytes / (1024.0 * 1024.0) / elapsed : 0.0), ValueDouble);
+
+   fprintf(stderr, "%-24s %-8s %4d segments %10" PRIu64 " records: %12.0f records/s %8.1f MB/s%s\n",
+           group, modes[mode], segments, records,
+           elapsed > 0 ? records / elapsed : 0.0, elapsed > 0 ? bytes / (1024.0 * 1024.0) / elapsed : 0.0,
+           ok ? "" : " (failed)");
+
+   pgmoneta_json_append(results, (uintptr_t)result, ValueJSON);
+}
+
+/**
+ * Compare the records per second with a baseline of the same corpus
+ * @return The number of results slower than the tolerance allows
+ */
+static int
+bench_compare(struct json* results, char* baseline, int tolerance)
+{
+   int regressions = 0;
+   struct json* base = NULL;
+   struct json* base_results = NULL;
+   struct json_iterator* iter = NULL;
+   struct json_iterator* base_iter = NULL;
+
+   if (pgmoneta_json_read_file(baseline, &base) || base == NULL)
+   {
+      warnx("Could not read the baseline %s", baseline);
+      return 1;
+   }
+
+   base_results = (struct json*)pgmoneta_json_get(base, "results");
+
+   if (base_results == NULL || pgmoneta_json_iterator_create(results, &iter))
+   {
+      pgmoneta_json_destroy(base);
+      return 1;
+   }
+
+   while (pgmoneta_json_iterator_next(iter))
+   {
+      struct json* result = (struct json*)iter->value->data;
+      char* workload = (char*)pgmoneta_json_get(result, "workload");
+      char* mode = (char*)pgmoneta_json_get(result, "mode");
+      double current = pgmoneta_value_to_double(pgmoneta_json_get(result, "records_per_second"));
+
+      if (pgmoneta_json_iterator_create(base_results, &base_iter))
+      {
+         break;
+      }
+
+      while (pgmoneta_json_iterator_next(base_iter))
+      {
+         struct json* b = (struct json*)base_iter->value->data;
+         double previous = 0.0;
+
+         if (strcmp(workload, (char*)pgmoneta_json_get(b, "workload")) || strcmp(mode, (char*)pgmoneta_json_get(b, "mode")))
+         {
+            continue;
+         }
+
+         previous = pgmoneta_value_to_double(pgmoneta_json_get(b, "records_per_second"));
+
+         if (previous > 0 && current < previous * (100 - tolerance) / 100.0)
+         {
+            fprintf(stderr, "Regression: %s %s %.0f records/s, baseline %.0f records/s\n", workload, mode, current, previous);
+            regressions++;
+         }
+      }
+
+      pgmoneta_json_iterator_destroy(base_iter);
+      base_iter = NULL;
+   }
+
+   pgmoneta_json_iterator_destroy(iter);
+   pgmoneta_json_destroy(base);
+
+   return regressions;
+}
+
+int
+main(int argc, char** argv)
+{
+   int c;
+   int option_index = 0;
+   int iterations = 3;
+   int tolerance = 10;
+   int number_of_segments = 0;
+   int regressions = 0;
+   bool selected[BENCH_MODES] = {true, true, true};
+   bool ok = true;
+   char* corpus = NULL;
+   char* mode_list = NULL;
+   char* output = NULL;
+   char* baseline = NULL;
+   char* s = NULL;
+   size_t shmem_size;
+   FILE* file = NULL;
+   FILE* sink = NULL;
+   struct bench_segment* segments = NULL;
+   struct json* json = NULL;
+   struct json* results = NULL;
+   struct configuration* config = NULL;
+
+   while (1)
+   {
+      static struct option long_options[] =
+      {
+         {"directory", required_argument, 0, 'd'},
+         {"modes", required_argument, 0, 'm'},
+         {"iterations", required_argument, 0, 'i'},
+         {"output", required_argument, 0, 'o'},
+         {"baseline", required_argument, 0, 'b'},
+         {"tolerance", required_argument, 0, 't'},
+         {"version", no_argument, 0, 'V'},
+         {"help", no_argument, 0, '?'},
+         {0, 0, 0, 0}
+      };
+
+      c = getopt_long(argc, argv, "V?d:m:i:o:b:t:", long_options, &option_index);
+
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'd':
+            corpus = optarg;
+            break;
+         case 'm':
+            mode_list = optarg;
+            break;
+         case 'i':
+            iterations = pgmoneta_atoi(optarg);
+            break;
+         case 'o':
+            output = optarg;
+            break;
+         case 'b':
+            baseline = optarg;
+            break;
+         case 't':
+            tolerance = pgmoneta_atoi(optarg);
+            break;
+         case 'V':
+            version();
+            exit(0);
+         case '?':
+            usage();
+            exit(0);
+         default:
+            break;
+      }
+   }
+
+   if (corpus == NULL || iterations <= 0 || tolerance < 0 || tolerance >= 100)
+   {
+      usage();
+      exit(1);
+   }
+
+   if (mode_list != NULL)
+   {
+      char* copy = strdup(mode_list);
+      char* saveptr = NULL;
+
+      memset(selected, 0, sizeof(selected));
+      for (char* token = strtok_r(copy, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr))
+      {
+         for (int m = 0; m < BENCH_MODES; m++)
+         {
+            if (!strcmp(token, modes[m]))
+            {
+               selected[m] = true;
+            }
+         }
+      }
+      free(copy);
+   }
+
+   shmem_size = sizeof(struct configuration);
+   if (pgmoneta_create_shared_memory(shmem_size, HUGEPAGE_OFF, &shmem))
+   {
+      errx(1, "Error creating shared memory");
+   }
+
+   pgmoneta_init_configuration(shmem);
+   config = (struct configuration*)shmem;
+   config->log_type = PGMONETA_LOGGING_TYPE_CONSOLE;
+   config->log_level = PGMONETA_LOGGING_LEVEL_WARN;
+
+   if (pgmoneta_start_logging())
+   {
+      errx(1, "Error starting logging");
+   }
+
+   pgmoneta_memory_init();
+
+   if (bench_load(corpus, "", &segments, &number_of_segments) || number_of_segments == 0)
+   {
+      warnx("No WAL segments in %s", corpus);
+      goto error;
+   }
+
+   // the descriptions are formatted like walinfo does, but not kept
+   sink = fopen("/dev/null", "w");
+   if (sink == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_create(&json) || pgmoneta_json_create(&results))
+   {
+      goto error;
+   }
+
+   pgmoneta_json_put(json, "version", (uintptr_t)VERSION, ValueString);
+   pgmoneta_json_put(json, "timestamp", (uintptr_t)time(NULL), ValueInt64);
+   pgmoneta_json_put(json, "cpus", (uintptr_t)sysconf(_SC_NPROCESSORS_ONLN), ValueInt32);
+   pgmoneta_json_put(json, "corpus", (uintptr_t)corpus, ValueString);
+
+   // the segments are loaded by directory, so a workload is a run of segments with the same group
+   for (int first = 0; first < number_of_segments;)
+   {
+      int last = first;
+
+      while (last < number_of_segments && !strcmp(segments[last].group, segments[first].group))
+      {
+         last++;
+      }
+
+      for (int m = 0; m < BENCH_MODES; m++)
+      {
+         double best = 0.0;
+         uint64_t records = 0;
+         uint64_t bytes = 0;
+         bool success = true;
+
+         if (!selected[m])
+         {
+            continue;
+         }
+
+         for (int i = 0; i < iterations; i++)
+         {
+            double start = bench_now();
+            double elapsed = 0.0;
+
+            records = 0;
+            bytes = 0;
+
+            for (int n = first; n < last; n++)
+            {
+               if (bench_decode(&segments[n], m, sink, &records))
+               {
+                  success = false;
+               }
+               bytes += segments[n].size;
+            }
+
+            elapsed = bench_now() - start;
+            if (i == 0 || elapsed < best)
+            {
+               best = elapsed;
+            }
+         }
+
+         bench_result(results, segments[first].group, m, last - first, records, bytes, best, success);
+         ok = ok && success;
+      }
+
+      first = last;
+   }
+
+   if (baseline != NULL)
+   {
+      regressions = bench_compare(results, baseline, tolerance);
+      pgmoneta_json_put(json, "regressions", (uintptr_t)regressions, ValueInt32);
+   }
+
+   pgmoneta_json_put(json, "results", (uintptr_t)results, ValueJSON);
+   results = NULL;
+
+   s = pgmoneta_json_to_string(json, FORMAT_JSON, NULL, 0);
+
+   if (output != NULL)
+   {
+      file = fopen(output, "w");
+      if (file == NULL)
+      {
+         warnx("Could not open %s", output);
+         goto error;
+      }
+      fprintf(file, "%s\n", s);
+      fclose(file);
+   }
+   else
+   {
+      printf("%s\n", s);
+   }
+
+   free(s);
+   pgmoneta_json_destroy(json);
+   fclose(sink);
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      free(segments[i].data);
+   }
+   free(segments);
+
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return ok && regressions == 0 ? 0 : 1;
+
+error:
+   free(s);
+   pgmoneta_json_destroy(results);
+   pgmoneta_json_destroy(json);
+   if (sink != NULL)
+   {
+      fclose(sink);
+   }
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      free(segments[i].data);
+   }
+   free(segments);
+
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+
+   return 1;
+}
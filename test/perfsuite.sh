@@ -0,0 +1,523 @@
+#!/bin/bash
+#
+# Copyright (C) 2025 The pgmoneta community
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list
+# of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice, this
+# list of conditions and the following disclaimer in the documentation and/or other
+# materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors may
+# be used to endorse or promote products derived from this software without specific
+# prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+# THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+# TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+set -e
+
+OS=$(uname)
+
+THIS_FILE=$(realpath "$0")
+FILE_OWNER=$(ls -l "$THIS_FILE" | awk '{print $3}')
+USER=$(whoami)
+
+PORT=5432
+PGPASSWORD="password"
+
+EXECUTABLE_DIRECTORY=$(pwd)/src
+
+LOG_DIRECTORY=$(pwd)/log
+PGCTL_LOG_FILE=$LOG_DIRECTORY/perf-logfile
+PGMONETA_LOG_FILE=$LOG_DIRECTORY/pgmoneta-perf.log
+
+POSTGRES_OPERATION_DIR=$(pwd)/pgmoneta-perf-postgresql
+DATA_DIRECTORY=$POSTGRES_OPERATION_DIR/data
+
+PGMONETA_OPERATION_DIR=$(pwd)/pgmoneta-perfsuite
+RESTORE_DIRECTORY=$PGMONETA_OPERATION_DIR/restore
+BACKUP_DIRECTORY=$PGMONETA_OPERATION_DIR/backup
+CONFIGURATION_DIRECTORY=$PGMONETA_OPERATION_DIR/conf
+
+# The pgbench scale factors, the number of transactions run between the full and the
+# incremental backup, the allowed slowdown in percent and the shortest duration compared
+PERF_SCALES=${PERF_SCALES:-"1 10 50"}
+PERF_TRANSACTIONS=${PERF_TRANSACTIONS:-10000}
+PERF_TOLERANCE=${PERF_TOLERANCE:-20}
+PERF_MIN_SECONDS=${PERF_MIN_SECONDS:-1}
+PERF_RESULTS=${PERF_RESULTS:-$(pwd)/perfsuite-results.tsv}
+PERF_BASELINE=${PERF_BASELINE:-$(pwd)/perfsuite-baseline.tsv}
+
+RETENTION_INTERVAL=10
+
+########################### UTILS ############################
+is_port_in_use() {
+    local port=$1
+    if [[ "$OS" == "Linux" ]]; then
+        ss -tuln | grep $port > /dev/null 2>&1
+    elif [[ "$OS" == "Darwin" ]]; then
+        lsof -i:$port > /dev/null 2>&1
+    fi
+    return $?
+}
+
+next_available_port() {
+    local port=$1
+    while true; do
+        is_port_in_use $port
+        if [ $? -ne 0 ]; then
+            echo "$port"
+            return 0
+        else
+            port=$((port + 1))
+        fi
+    done
+}
+
+now() {
+    date +%s.%N
+}
+
+log_offset() {
+    wc -l < $PGMONETA_LOG_FILE | tr -d ' '
+}
+
+# Print the workflow nodes logged after the offset as name, seconds, bytes in, bytes out
+# and files, summed per node
+workflow_nodes() {
+    local offset=$1
+    tail -n +$((offset + 1)) $PGMONETA_LOG_FILE | \
+        sed -n -E 's/.* ([A-Z][A-Za-z0-9 ]*): ([0-9.]+) seconds, ([0-9]+) bytes in, ([0-9]+) bytes out, ([0-9]+) files.*/\1\t\2\t\3\t\4\t\5/p' | \
+        awk -F'\t' '{ if (!($1 in s)) { o[n++] = $1 } s[$1] += $2; i[$1] += $3; b[$1] += $4; f[$1] += $5 }
+                    END { for (k = 0; k < n; k++) { printf "%s\t%.4f\t%d\t%d\t%d\n", o[k], s[o[k]], i[o[k]], b[o[k]], f[o[k]] } }'
+}
+
+# Record an operation as scale, operation, name, seconds, bytes in, bytes out and files.
+# The name is 'total' for the wall clock time of the operation
+record() {
+    local scale=$1
+    local operation=$2
+    local seconds=$3
+    local offset=$4
+    printf "%s\t%s\ttotal\t%.4f\t0\t0\t0\n" $scale $operation $seconds >> $PERF_RESULTS
+    workflow_nodes $offset | while IFS= read -r line; do
+        printf "%s\t%s\t%s\n" $scale $operation "$line" >> $PERF_RESULTS
+    done
+    echo "$operation (scale $scale) ... $seconds seconds"
+}
+
+##############################################################
+
+############### CHECK POSTGRES DEPENDENCIES ##################
+check_command() {
+    if which $1 > /dev/null 2>&1; then
+        echo "check $1 in path ... ok"
+        return 0
+    else
+        echo "check $1 in path ... not present"
+        return 1
+    fi
+}
+
+check_postgres_version() {
+    version=$(psql --version | awk '{print $3}')
+    major_version=$(echo "$version" | cut -d'.' -f1)
+    required_major_version=$1
+    if [ "$major_version" -ge "$required_major_version" ]; then
+        echo "check postgresql version: $version ... ok"
+        return 0
+    else
+        echo "check postgresql version: $version ... not ok"
+        return 1
+    fi
+}
+
+check_system_requirements() {
+    echo -e "\e[34mCheck System Requirements \e[0m"
+    echo "check system os ... $OS"
+    for c in initdb pg_ctl psql pgbench; do
+        check_command $c
+        if [ $? -ne 0 ]; then
+            exit 1
+        fi
+    done
+    check_postgres_version 17
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+    echo ""
+}
+
+initialize_log_files() {
+    echo -e "\e[34mInitialize Performance logfiles \e[0m"
+    mkdir -p $LOG_DIRECTORY
+    echo "create log directory ... $LOG_DIRECTORY"
+    touch $PGMONETA_LOG_FILE
+    echo "create log file ... $PGMONETA_LOG_FILE"
+    touch $PGCTL_LOG_FILE
+    echo "create log file ... $PGCTL_LOG_FILE"
+    rm -f "$PERF_RESULTS"
+    echo ""
+}
+##############################################################
+
+##################### POSTGRES OPERATIONS ####################
+set_postgresql_conf() {
+    local name=$1
+    local expression=$2
+    local value=$3
+    error_out=$(sed -i "$expression" $DATA_DIRECTORY/postgresql.conf 2>&1)
+    if [ $? -ne 0 ]; then
+        echo "setting $name ... $error_out"
+        clean
+        exit 1
+    else
+        echo "setting $name ... $value"
+    fi
+}
+
+create_cluster() {
+    local port=$1
+    echo -e "\e[34mInitializing Cluster \e[0m"
+    initdb -k -D $DATA_DIRECTORY 2> /dev/null
+    set +e
+    set_postgresql_conf password_encryption "s/^#\s*password_encryption\s*=\s*\(md5\|scram-sha-256\)/password_encryption = scram-sha-256/" scram-sha-256
+    set_postgresql_conf unix_socket_directories "s|#unix_socket_directories = '/var/run/postgresql'|unix_socket_directories = '/tmp'|" "'/tmp'"
+    set_postgresql_conf shared_buffers "s/shared_buffers = 128MB/shared_buffers = 2GB/" 2GB
+    set_postgresql_conf port "s/#port = 5432/port = $port/" $port
+    set_postgresql_conf wal_level "s/#wal_level = replica/wal_level = replica/" replica
+    set_postgresql_conf wal_log_hints "s/#wal_log_hints = off/wal_log_hints = on/" on
+    set_postgresql_conf max_wal_size "s/max_wal_size = 1GB/max_wal_size = 16GB/" 16GB
+    set_postgresql_conf min_wal_size "s/min_wal_size = 80MB/min_wal_size = 2GB/" 2GB
+    set_postgresql_conf summarize_wal "s/#summarize_wal = off/summarize_wal = on/" on
+    set -e
+    echo ""
+}
+
+initialize_hba_configuration() {
+    echo -e "\e[34mCreate HBA Configuration \e[0m"
+    echo "
+    local   all              all                                     trust
+    local   replication      all                                     trust
+    host    postgres         repl            127.0.0.1/32            scram-sha-256
+    host    postgres         repl            ::1/128                 scram-sha-256
+    host    replication      repl            127.0.0.1/32            scram-sha-256
+    host    replication      repl            ::1/128                 scram-sha-256
+    " > $DATA_DIRECTORY/pg_hba.conf
+    echo "initialize hba configuration at $DATA_DIRECTORY/pg_hba.conf ... ok"
+    echo ""
+}
+
+initialize_cluster() {
+    echo -e "\e[34mInitializing Cluster \e[0m"
+    set +e
+    pg_ctl -D $DATA_DIRECTORY -l $PGCTL_LOG_FILE start
+    if [ $? -ne 0 ]; then
+        clean
+        exit 1
+    fi
+    pg_isready -h localhost -p $PORT
+    if [ $? -eq 0 ]; then
+        echo "postgres server is accepting requests ... ok"
+    else
+        echo "postgres server is not accepting response ... not ok"
+        clean
+        exit 1
+    fi
+    err_out=$(psql -h /tmp -p $PORT -U $USER -d postgres -c "CREATE ROLE repl WITH LOGIN REPLICATION PASSWORD '$PGPASSWORD';" 2>&1)
+    if [ $? -ne 0 ]; then
+        echo "create role repl ... $err_out"
+        clean
+        exit 1
+    else
+        echo "create role repl ... ok"
+    fi
+    err_out=$(psql -h /tmp -p $PORT -U $USER -d postgres -c "SELECT pg_create_physical_replication_slot('repl', true, false);" 2>&1)
+    if [ $? -ne 0 ]; then
+        echo "create replication slot for repl ... $err_out"
+        clean
+        exit 1
+    else
+        echo "create replication slot for repl ... ok"
+    fi
+    set -e
+    echo ""
+}
+
+clean_logs() {
+    if [ -d $LOG_DIRECTORY ]; then
+        rm -r $LOG_DIRECTORY
+        echo "remove log directory $LOG_DIRECTORY ... ok"
+    else
+        echo "$LOG_DIRECTORY not present ... ok"
+    fi
+}
+
+clean() {
+    echo -e "\e[34mClean Performance Resources \e[0m"
+    if [ -f $DATA_DIRECTORY/postmaster.pid ]; then
+        pg_ctl -D $DATA_DIRECTORY -l $PGCTL_LOG_FILE stop || true
+    fi
+
+    if [ -d $POSTGRES_OPERATION_DIR ]; then
+        rm -r $POSTGRES_OPERATION_DIR
+        echo "remove postgres operations directory $POSTGRES_OPERATION_DIR ... ok"
+    else
+      echo "$POSTGRES_OPERATION_DIR not present ... ok"
+    fi
+
+    if [ -d $PGMONETA_OPERATION_DIR ]; then
+        rm -r $PGMONETA_OPERATION_DIR
+        echo "remove pgmoneta operations directory $PGMONETA_OPERATION_DIR ... ok"
+    else
+        echo "$PGMONETA_OPERATION_DIR not present ... ok"
+    fi
+}
+
+##############################################################
+
+#################### PGMONETA OPERATIONS #####################
+pgmoneta_initialize_configuration() {
+    echo -e "\e[34mInitialize pgmoneta configuration files \e[0m"
+    mkdir -p $RESTORE_DIRECTORY
+    echo "create restore directory $RESTORE_DIRECTORY ... ok"
+    mkdir -p $CONFIGURATION_DIRECTORY
+    echo "create configuration directory $CONFIGURATION_DIRECTORY ... ok"
+    touch $CONFIGURATION_DIRECTORY/pgmoneta.conf $CONFIGURATION_DIRECTORY/pgmoneta_users.conf
+    echo "create pgmoneta.conf and pgmoneta_users.conf inside $CONFIGURATION_DIRECTORY ... ok"
+    cat << EOF > $CONFIGURATION_DIRECTORY/pgmoneta.conf
+[pgmoneta]
+host = localhost
+metrics = 5001
+
+base_dir = $BACKUP_DIRECTORY
+
+compression = zstd
+
+retention = 7
+retention_interval = $RETENTION_INTERVAL
+
+log_type = file
+log_level = debug1
+log_path = $PGMONETA_LOG_FILE
+
+unix_socket_dir = /tmp/
+
+[primary]
+host = localhost
+port = $PORT
+user = repl
+wal_slot = repl
+EOF
+    echo "add performance configuration to pgmoneta.conf ... ok"
+    $EXECUTABLE_DIRECTORY/pgmoneta-admin master-key -P $PGPASSWORD || true
+    $EXECUTABLE_DIRECTORY/pgmoneta-admin -f $CONFIGURATION_DIRECTORY/pgmoneta_users.conf -U repl -P $PGPASSWORD user add
+    echo "add user repl to pgmoneta_users.conf file ... ok"
+    echo ""
+}
+
+# Run a pgmoneta-cli command and record its time and workflow nodes
+timed_cli() {
+    local scale=$1
+    local operation=$2
+    shift 2
+    local offset=$(log_offset)
+    local start=$(now)
+    $EXECUTABLE_DIRECTORY/pgmoneta-cli -c $CONFIGURATION_DIRECTORY/pgmoneta.conf "$@" > /dev/null
+    if [ $? -ne 0 ]; then
+        echo "$operation (scale $scale) ... not ok"
+        return 1
+    fi
+    local end=$(now)
+    record $scale $operation $(echo "$start $end" | awk '{ printf "%.4f", $2 - $1 }') $offset
+}
+
+# Retention runs on its own timer, so wait for its next run and record its nodes
+timed_retention() {
+    local scale=$1
+    local offset=$(log_offset)
+    local waited=0
+    local seconds
+    while [ $waited -lt $((RETENTION_INTERVAL * 6)) ]; do
+        sleep 1
+        waited=$((waited + 1))
+        if workflow_nodes $offset | grep -q "^Retention"; then
+            seconds=$(workflow_nodes $offset | awk -F'\t' '{ s += $2 } END { printf "%.4f", s }')
+            record $scale retention $seconds $offset
+            return 0
+        fi
+    done
+    echo "retention (scale $scale) ... not ok"
+    return 1
+}
+
+execute_scale() {
+    local scale=$1
+    echo -e "\e[34mScale $scale \e[0m"
+
+    pgbench -h /tmp -p $PORT -U $USER -i -q -s $scale postgres > /dev/null 2>&1 || return 1
+    echo "pgbench initialize (scale $scale) ... ok"
+
+    timed_cli $scale backup backup primary || return 1
+
+    pgbench -h /tmp -p $PORT -U $USER -c 4 -t $((PERF_TRANSACTIONS / 4)) postgres > /dev/null 2>&1 || return 1
+    echo "pgbench $PERF_TRANSACTIONS transactions (scale $scale) ... ok"
+
+    timed_cli $scale incremental_backup backup primary newest || return 1
+    timed_cli $scale restore restore primary newest current $RESTORE_DIRECTORY/restore-$scale || return 1
+    timed_cli $scale verify verify primary newest $RESTORE_DIRECTORY/verify-$scale all || return 1
+    timed_cli $scale archive archive primary newest current $RESTORE_DIRECTORY/archive-$scale || return 1
+    timed_retention $scale || return 1
+
+    # the incremental backup first, then its parent
+    timed_cli $scale delete delete primary newest || return 1
+    timed_cli $scale delete delete primary newest || return 1
+
+    rm -rf "${RESTORE_DIRECTORY:?}"/*-"${scale:?}"
+    echo ""
+}
+
+execute_perfcases() {
+    echo -e "\e[34mExecute Performance cases \e[0m"
+    local failed=0
+
+    echo "starting pgmoneta server in daemon mode (wait time = 5 seconds)"
+    $EXECUTABLE_DIRECTORY/pgmoneta -c $CONFIGURATION_DIRECTORY/pgmoneta.conf -u $CONFIGURATION_DIRECTORY/pgmoneta_users.conf -d
+    sleep 5
+
+    $EXECUTABLE_DIRECTORY/pgmoneta-cli -c $CONFIGURATION_DIRECTORY/pgmoneta.conf ping > /dev/null
+    if [ $? -eq 0 ]; then
+        echo "pgmoneta server started ... ok"
+    else
+        echo "pgmoneta server not started ... not ok"
+        return 1
+    fi
+    echo ""
+
+    for scale in $PERF_SCALES; do
+        execute_scale $scale
+        if [ $? -ne 0 ]; then
+            failed=1
+            break
+        fi
+    done
+
+    echo "running shutdown cli command"
+    $EXECUTABLE_DIRECTORY/pgmoneta-cli -c $CONFIGURATION_DIRECTORY/pgmoneta.conf shutdown > /dev/null
+    echo "shutdown pgmoneta server ... ok"
+    echo ""
+    return $failed
+}
+
+# Compare the results with the baseline. Entries faster than PERF_MIN_SECONDS in the
+# baseline are left out since their noise is larger than the tolerance
+compare_baseline() {
+    echo -e "\e[34mCompare with Baseline \e[0m"
+    if [ ! -f $PERF_BASELINE ]; then
+        echo "baseline $PERF_BASELINE not present ... skipped"
+        echo ""
+        return 0
+    fi
+    awk -F'\t' -v tolerance=$PERF_TOLERANCE -v minimum=$PERF_MIN_SECONDS '
+        NR == FNR { base[$1 FS $2 FS $3] = $4; next }
+        {
+           key = $1 FS $2 FS $3
+           if (!(key in base) || base[key] < minimum) { next }
+           change = ($4 - base[key]) * 100 / base[key]
+           status = "ok"
+           if (change > tolerance) { status = "regression"; failed = 1 }
+           printf "%s (scale %s) %s: %.4f -> %.4f seconds (%+.1f%%) ... %s\n", $2, $1, $3, base[key], $4, change, status
+        }
+        END { exit failed }' $PERF_BASELINE $PERF_RESULTS
+    local ret=$?
+    echo ""
+    return $ret
+}
+##############################################################
+
+run_perf() {
+    local save_baseline=$1
+    local failed
+    # Check if the user is pgmoneta
+    if [ "$FILE_OWNER" == "$USER" ]; then
+        ## Postgres operations
+        check_system_requirements
+
+        initialize_log_files
+
+        PORT=$(next_available_port $PORT)
+        create_cluster $PORT
+
+        initialize_hba_configuration
+        initialize_cluster
+
+        ## pgmoneta operations
+        pgmoneta_initialize_configuration
+        set +e
+        execute_perfcases
+        failed=$?
+        set -e
+
+        # clean cluster
+        clean
+
+        if [ $failed -ne 0 ]; then
+            echo "performance suite ... not ok"
+            exit 1
+        fi
+
+        echo "results written to $PERF_RESULTS"
+        if [ "$save_baseline" == "true" ]; then
+            cp $PERF_RESULTS $PERF_BASELINE
+            echo "baseline written to $PERF_BASELINE"
+        else
+            set +e
+            compare_baseline
+            failed=$?
+            set -e
+            if [ $failed -ne 0 ]; then
+                echo "performance suite ... regression"
+                exit 1
+            fi
+        fi
+    else
+        echo "user should be $FILE_OWNER"
+        exit 1
+    fi
+}
+
+usage() {
+    echo "Usage: $0 [sub-command]"
+    echo "Subcommand:"
+    echo " baseline        run the performance suite and store the results as the baseline"
+    echo " clean           clean up performance suite environment"
+    exit 1
+}
+
+if [ $# -gt 1 ]; then
+    usage  # More than one argument, show usage and exit
+elif [ $# -eq 1 ]; then
+    if [ "$1" == "clean" ]; then
+        clean
+        clean_logs
+    elif [ "$1" == "baseline" ]; then
+        run_perf true
+    else
+        echo "Invalid parameter: $1"
+        usage  # If an invalid parameter is provided, show usage and exit
+    fi
+else
+    run_perf false
+fi
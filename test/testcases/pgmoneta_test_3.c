@@ -0,0 +1,852 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pgmoneta.h>
+#include <art.h>
+#include <configuration.h>
+#include <csv.h>
+#include <fanout.h>
+#include <info.h>
+#include <logging.h>
+#include <manifest.h>
+#include <memory.h>
+#include <page.h>
+#include <shmem.h>
+#include <streamer.h>
+#include <utils.h>
+#include <walfile.h>
+#include <walpack.h>
+#include <workers.h>
+
+#include "pgmoneta_test_3.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FANOUT_CHUNK   4096
+#define FANOUT_CHUNKS  64
+
+#define PAGE_BLOCK_SIZE 8192
+#define PAGE_LOWER      12
+#define PAGE_UPPER      14
+
+#define WALPACK_SEGMENTS 2
+#define WALPACK_TRAIL    "/pgmoneta-testsuite/backup/primary/wal/"
+
+#define WORKERS_TASKS 64
+
+#define ART_THREADS 4
+#define ART_KEYS    2000
+
+struct fanout_test
+{
+   unsigned char* buffer; /**< The bytes received */
+   size_t size;           /**< The number of bytes received */
+   int writes;            /**< The number of writes */
+   int fail_after;        /**< Fail the writes after this many, or -1 */
+};
+
+struct fanout_test_data
+{
+   struct fanout_test* test; /**< The state owned by the test */
+};
+
+struct art_test
+{
+   struct art* tree; /**< The concurrent tree */
+   int thread;       /**< The number of the thread */
+};
+
+static size_t shmem_size = 0;
+
+static void
+unit_setup(void)
+{
+   struct configuration* config;
+
+   shmem_size = sizeof(struct configuration);
+   ck_assert_msg(pgmoneta_create_shared_memory(shmem_size, HUGEPAGE_OFF, &shmem) == 0, "couldn't create the shared memory");
+
+   pgmoneta_init_configuration(shmem);
+   config = (struct configuration*)shmem;
+   config->log_type = PGMONETA_LOGGING_TYPE_CONSOLE;
+   config->log_level = PGMONETA_LOGGING_LEVEL_FATAL;
+
+   pgmoneta_start_logging();
+   pgmoneta_memory_init();
+}
+
+static void
+unit_teardown(void)
+{
+   pgmoneta_memory_destroy();
+   pgmoneta_stop_logging();
+   pgmoneta_destroy_shared_memory(shmem, shmem_size);
+   shmem = NULL;
+}
+
+static int
+fanout_test_open(struct fanout_sink* sink, char* filename, int segsize)
+{
+   return 0;
+}
+
+static int
+fanout_test_write(struct fanout_sink* sink, void* data, size_t size)
+{
+   struct fanout_test* test = ((struct fanout_test_data*)sink->data)->test;
+
+   test->writes++;
+   if (test->fail_after >= 0 && test->writes > test->fail_after)
+   {
+      return 1;
+   }
+
+   memcpy(test->buffer + test->size, data, size);
+   test->size += size;
+
+   return 0;
+}
+
+static int
+fanout_test_close(struct fanout_sink* sink, char* filename, bool partial)
+{
+   return 0;
+}
+
+static void
+workers_test_count(struct worker_input* wi)
+{
+   atomic_fetch_add((atomic_int*)wi->argument, 1);
+
+   free(wi);
+}
+
+static void*
+art_test_insert(void* arg)
+{
+   char key[MISC_LENGTH];
+   struct art_test* test = (struct art_test*)arg;
+
+   for (int i = 0; i < ART_KEYS; i++)
+   {
+      snprintf(key, sizeof(key), "node_%d_%d", test->thread, i);
+      pgmoneta_art_insert(test->tree, key, (uintptr_t)i, ValueInt32);
+   }
+
+   return NULL;
+}
+
+static struct fanout_sink*
+fanout_test_sink(char* name, struct fanout_test* test)
+{
+   struct fanout_sink* sink = NULL;
+   struct fanout_test_data* data = NULL;
+
+   sink = (struct fanout_sink*)calloc(1, sizeof(struct fanout_sink));
+   data = (struct fanout_test_data*)calloc(1, sizeof(struct fanout_test_data));
+   ck_assert_msg(sink != NULL && data != NULL, "couldn't allocate the sink");
+
+   data->test = test;
+
+   snprintf(sink->name, sizeof(sink->name), "%s", name);
+   sink->open = fanout_test_open;
+   sink->write = fanout_test_write;
+   sink->close = fanout_test_close;
+   sink->data = data;
+
+   return sink;
+}
+
+static char*
+unit_directory(void)
+{
+   char* directory = NULL;
+
+   directory = strdup("/tmp/pgmoneta_test_XXXXXX");
+   ck_assert_msg(directory != NULL && mkdtemp(directory) != NULL, "couldn't create the work directory");
+
+   return directory;
+}
+
+static void
+page_fill(unsigned char* page, int seed, uint16_t lower, uint16_t upper)
+{
+   for (int i = 0; i < PAGE_BLOCK_SIZE; i++)
+   {
+      page[i] = (unsigned char)((i * 7 + seed) | 1);
+   }
+
+   memcpy(page + PAGE_LOWER, &lower, sizeof(uint16_t));
+   memcpy(page + PAGE_UPPER, &upper, sizeof(uint16_t));
+}
+
+static bool
+walpack_magic(char* path, char* magic)
+{
+   char m[WALPACK_MAGIC_SIZE];
+   bool result = false;
+   FILE* file = NULL;
+
+   file = fopen(path, "rb");
+   if (file != NULL)
+   {
+      result = fread(m, 1, WALPACK_MAGIC_SIZE, file) == WALPACK_MAGIC_SIZE && !memcmp(m, magic, WALPACK_MAGIC_SIZE);
+      fclose(file);
+   }
+
+   return result;
+}
+
+static void
+walpack_compare(char* pack, char* original, char* extracted, int number_of_segments, char** segments)
+{
+   char* from = NULL;
+   char* to = NULL;
+
+   pgmoneta_delete_directory(extracted);
+   ck_assert_msg(pgmoneta_mkdir(extracted) == 0, "couldn't create %s", extracted);
+   ck_assert_msg(pgmoneta_walpack_extract_range(pack, extracted, "", NULL) == 0, "couldn't extract %s", pack);
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      from = pgmoneta_append(NULL, original);
+      from = pgmoneta_append(from, segments[i]);
+      to = pgmoneta_append(NULL, extracted);
+      to = pgmoneta_append(to, segments[i]);
+
+      ck_assert_msg(pgmoneta_compare_files(from, to), "%s differs from %s", to, from);
+
+      free(from);
+      free(to);
+   }
+}
+
+static void
+manifest_write(char* manifest, char* rows[][MANIFEST_COLUMN_COUNT], int number_of_rows)
+{
+   struct csv_writer* writer = NULL;
+
+   ck_assert_msg(pgmoneta_csv_writer_init(manifest, &writer) == 0, "couldn't create %s", manifest);
+
+   for (int i = 0; i < number_of_rows; i++)
+   {
+      ck_assert_msg(pgmoneta_csv_write(writer, MANIFEST_COLUMN_COUNT, rows[i]) == 0, "couldn't write %s", manifest);
+   }
+
+   pgmoneta_csv_writer_destroy(writer);
+}
+
+static void
+manifest_compare(char* manifest)
+{
+   int cols = 0;
+   uint32_t number_of_rows = 0;
+   char** row = NULL;
+   struct csv_reader* reader = NULL;
+   struct manifest_map* map = NULL;
+   struct manifest_map_entry* entry = NULL;
+
+   ck_assert_msg(pgmoneta_manifest_map_open(manifest, &map) == 0, "couldn't map %s", manifest);
+   ck_assert_msg(pgmoneta_csv_reader_init(manifest, &reader) == 0, "couldn't read %s", manifest);
+
+   while (pgmoneta_csv_next_row(reader, &cols, &row))
+   {
+      entry = pgmoneta_manifest_map_find(map, row[MANIFEST_PATH_INDEX]);
+
+      ck_assert_msg(entry != NULL, "%s isn't in the map", row[MANIFEST_PATH_INDEX]);
+      ck_assert_msg(!strcmp(pgmoneta_manifest_map_path(map, entry), row[MANIFEST_PATH_INDEX]), "the path of %s differs", row[MANIFEST_PATH_INDEX]);
+      ck_assert_msg(!strcmp(pgmoneta_manifest_map_checksum(map, entry), row[MANIFEST_CHECKSUM_INDEX]), "the checksum of %s differs", row[MANIFEST_PATH_INDEX]);
+      ck_assert_msg(entry->size == strtoll(row[MANIFEST_SIZE_INDEX], NULL, 10), "the size of %s differs", row[MANIFEST_PATH_INDEX]);
+
+      number_of_rows++;
+
+      free(row);
+      row = NULL;
+   }
+
+   ck_assert_msg(map->number_of_files == number_of_rows, "the map has %u files, the manifest %u", map->number_of_files, number_of_rows);
+
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_manifest_map_close(map);
+}
+
+// a sink that fails while the producer keeps writing must not hold back the others
+START_TEST(test_pgmoneta_fanout_failed_sink)
+{
+   int failures = 0;
+   unsigned char* stream = NULL;
+   struct fanout* fanout = NULL;
+   struct fanout_test healthy;
+   struct fanout_test failing;
+
+   stream = (unsigned char*)malloc(FANOUT_CHUNK * FANOUT_CHUNKS);
+   ck_assert_msg(stream != NULL, "couldn't allocate the stream");
+   for (size_t i = 0; i < FANOUT_CHUNK * FANOUT_CHUNKS; i++)
+   {
+      stream[i] = (unsigned char)(i * 31 + (i >> 8));
+   }
+
+   memset(&healthy, 0, sizeof(struct fanout_test));
+   healthy.buffer = (unsigned char*)malloc(FANOUT_CHUNK * FANOUT_CHUNKS);
+   healthy.fail_after = -1;
+
+   memset(&failing, 0, sizeof(struct fanout_test));
+   failing.buffer = (unsigned char*)malloc(FANOUT_CHUNK * FANOUT_CHUNKS);
+   failing.fail_after = 3;
+
+   ck_assert_msg(healthy.buffer != NULL && failing.buffer != NULL, "couldn't allocate the buffers");
+
+   // the smallest ring, so the producer wraps it many times
+   ck_assert_msg(pgmoneta_fanout_create(1, &fanout) == 0, "couldn't create the fan-out");
+   ck_assert_msg(pgmoneta_fanout_add(fanout, fanout_test_sink("healthy", &healthy)) == 0, "couldn't add the healthy sink");
+   ck_assert_msg(pgmoneta_fanout_add(fanout, fanout_test_sink("failing", &failing)) == 0, "couldn't add the failing sink");
+
+   ck_assert_msg(pgmoneta_fanout_open(fanout, "000000010000000000000001", FANOUT_CHUNK * FANOUT_CHUNKS) == 0, "open failed");
+
+   for (int i = 0; i < FANOUT_CHUNKS; i++)
+   {
+      if (pgmoneta_fanout_write(fanout, stream + i * FANOUT_CHUNK, FANOUT_CHUNK))
+      {
+         failures++;
+      }
+   }
+
+   // the failing sink can't fall a full ring behind before it fails
+   ck_assert_msg(pgmoneta_fanout_close(fanout, "000000010000000000000001", false) == 1, "the failure wasn't reported");
+   ck_assert_msg(failures > 0, "the writes didn't report the failure");
+
+   // returns once both sinks have stopped, and times out the test otherwise
+   pgmoneta_fanout_destroy(fanout);
+
+   ck_assert_msg(healthy.size == FANOUT_CHUNK * FANOUT_CHUNKS, "the healthy sink got %zu bytes", healthy.size);
+   ck_assert_msg(!memcmp(healthy.buffer, stream, healthy.size), "the healthy sink got different bytes");
+   ck_assert_msg(failing.size < healthy.size, "the failing sink got all the bytes");
+   ck_assert_msg(!memcmp(failing.buffer, stream, failing.size), "the failing sink got different bytes");
+
+   free(healthy.buffer);
+   free(failing.buffer);
+   free(stream);
+}
+END_TEST
+
+// zero pages, zeroed holes and non-zero holes come back identical from pack and unpack
+START_TEST(test_pgmoneta_page_round_trip)
+{
+   char* directory = NULL;
+   char* relation = NULL;
+   char* original = NULL;
+   char* other = NULL;
+   unsigned char page[PAGE_BLOCK_SIZE];
+   FILE* file = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   config->servers[0].block_size = PAGE_BLOCK_SIZE;
+
+   directory = unit_directory();
+
+   relation = pgmoneta_append(relation, directory);
+   relation = pgmoneta_append(relation, "/base/1/");
+   ck_assert_msg(pgmoneta_mkdir(relation) == 0, "couldn't create %s", relation);
+   relation = pgmoneta_append(relation, "16384");
+
+   original = pgmoneta_append(original, directory);
+   original = pgmoneta_append(original, "/original");
+
+   other = pgmoneta_append(other, directory);
+   other = pgmoneta_append(other, "/base/1/pg_filenode.map");
+
+   file = fopen(relation, "wb");
+   ck_assert_msg(file != NULL, "couldn't create %s", relation);
+
+   // a zero page
+   memset(page, 0, sizeof(page));
+   fwrite(page, 1, sizeof(page), file);
+
+   // a page with a zeroed hole
+   page_fill(page, 1, 200, 6000);
+   memset(page + 200, 0, 6000 - 200);
+   fwrite(page, 1, sizeof(page), file);
+
+   // a page whose hole isn't zero
+   page_fill(page, 2, 200, 6000);
+   memset(page + 200, 0, 6000 - 200);
+   page[3000] = 0x5a;
+   fwrite(page, 1, sizeof(page), file);
+
+   // a page whose hole runs to the end of the page
+   page_fill(page, 3, 512, PAGE_BLOCK_SIZE);
+   memset(page + 512, 0, PAGE_BLOCK_SIZE - 512);
+   fwrite(page, 1, sizeof(page), file);
+
+   // a page without a valid hole
+   page_fill(page, 4, 6000, 200);
+   fwrite(page, 1, sizeof(page), file);
+
+   memset(page, 0, sizeof(page));
+   fwrite(page, 1, sizeof(page), file);
+   fwrite(page, 1, sizeof(page), file);
+
+   fclose(file);
+
+   // not a relation file, so it is left alone
+   file = fopen(other, "wb");
+   ck_assert_msg(file != NULL, "couldn't create %s", other);
+   memset(page, 0, sizeof(page));
+   fwrite(page, 1, sizeof(page), file);
+   fclose(file);
+
+   ck_assert_msg(pgmoneta_copy_file(relation, original, NULL) == 0, "couldn't copy %s", relation);
+
+   ck_assert_msg(pgmoneta_page_pack(0, directory, NULL) == 0, "pack failed");
+   ck_assert_msg(pgmoneta_page_is_packed(relation), "%s wasn't packed", relation);
+   ck_assert_msg(pgmoneta_get_file_size(relation) < pgmoneta_get_file_size(original), "%s didn't shrink", relation);
+   ck_assert_msg(!pgmoneta_page_is_packed(other), "%s was packed", other);
+   ck_assert_msg(pgmoneta_get_file_size(other) == PAGE_BLOCK_SIZE, "%s changed", other);
+
+   ck_assert_msg(pgmoneta_page_unpack(directory, NULL) == 0, "unpack failed");
+   ck_assert_msg(!pgmoneta_page_is_packed(relation), "%s is still packed", relation);
+   ck_assert_msg(pgmoneta_compare_files(relation, original), "%s differs after unpack", relation);
+
+   pgmoneta_delete_directory(directory);
+
+   free(directory);
+   free(relation);
+   free(original);
+   free(other);
+}
+END_TEST
+
+// real segments, and one that can't be decoded, come back byte for byte from a pack and a compacted pack
+START_TEST(test_pgmoneta_walpack_round_trip)
+{
+   char* directory = NULL;
+   char* source = NULL;
+   char* original = NULL;
+   char* wal = NULL;
+   char* extracted = NULL;
+   char* backup = NULL;
+   char* from = NULL;
+   char* to = NULL;
+   char* pack = NULL;
+   char* found = NULL;
+   char* name = NULL;
+   char* segments[WALPACK_SEGMENTS + 1];
+   int number_of_segments = 0;
+   int number_of_files = 0;
+   char** files = NULL;
+   int number_of_members = 0;
+   char** members = NULL;
+   uint32_t timeline;
+   uint32_t log;
+   uint32_t seg;
+   uint32_t next_timeline = 0;
+   uint32_t next_log = 0;
+   uint32_t next_seg = 0;
+   uint32_t wal_size = 0;
+   unsigned char* broken = NULL;
+   FILE* file = NULL;
+   struct walfile* wf = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&segments[0], 0, sizeof(segments));
+
+   directory = unit_directory();
+
+   source = pgmoneta_append(NULL, project_directory);
+   source = pgmoneta_append(source, WALPACK_TRAIL);
+
+   original = pgmoneta_append(NULL, directory);
+   original = pgmoneta_append(original, "/original/");
+   wal = pgmoneta_append(NULL, directory);
+   wal = pgmoneta_append(wal, "/wal/");
+   extracted = pgmoneta_append(NULL, directory);
+   extracted = pgmoneta_append(extracted, "/extracted/");
+
+   ck_assert_msg(pgmoneta_mkdir(original) == 0 && pgmoneta_mkdir(wal) == 0, "couldn't create the directories");
+
+   // the segments archived by the suites before, decoded as the originals
+   ck_assert_msg(pgmoneta_get_wal_files(source, &number_of_files, &files) == 0, "couldn't list %s", source);
+
+   for (int i = 0; i < number_of_files && number_of_segments < WALPACK_SEGMENTS; i++)
+   {
+      name = pgmoneta_walfile_segment_name(files[i]);
+
+      if (name == NULL || strlen(name) != 24 || pgmoneta_is_walpack(files[i]) ||
+          sscanf(name, "%08X%08X%08X", &timeline, &log, &seg) != 3)
+      {
+         free(name);
+         name = NULL;
+         continue;
+      }
+
+      // only a run of consecutive segments is packed
+      if (number_of_segments > 0 && (timeline != next_timeline || log != next_log || seg != next_seg))
+      {
+         for (int j = 0; j < number_of_segments; j++)
+         {
+            free(segments[j]);
+            segments[j] = NULL;
+         }
+         number_of_segments = 0;
+      }
+
+      from = pgmoneta_append(NULL, source);
+      from = pgmoneta_append(from, files[i]);
+      to = pgmoneta_append(NULL, original);
+      to = pgmoneta_append(to, name);
+
+      ck_assert_msg(pgmoneta_destreamer_file(from, to) == 0, "couldn't decode %s", from);
+
+      // reading the segment sets the version of the server from its magic
+      ck_assert_msg(pgmoneta_read_walfile(-1, to, &wf) == 0, "couldn't read %s", to);
+      wal_size = wf->long_phd->xlp_seg_size;
+      pgmoneta_destroy_walfile(wf);
+      wf = NULL;
+
+      segments[number_of_segments++] = name;
+      name = NULL;
+
+      next_timeline = timeline;
+      next_log = log;
+      next_seg = seg + 1;
+      if (next_seg == 0x100000000ULL / wal_size)
+      {
+         next_log++;
+         next_seg = 0;
+      }
+
+      free(from);
+      free(to);
+      from = NULL;
+      to = NULL;
+   }
+
+   ck_assert_msg(number_of_segments > 0, "no WAL segments in %s", source);
+
+   // the next segment can't be decoded, so it is stored as is
+   name = (char*)malloc(MISC_LENGTH);
+   ck_assert_msg(name != NULL, "couldn't allocate the name");
+   snprintf(name, MISC_LENGTH, "%08X%08X%08X", next_timeline, next_log, next_seg);
+   segments[number_of_segments++] = name;
+   name = NULL;
+
+   broken = (unsigned char*)malloc(wal_size);
+   ck_assert_msg(broken != NULL, "couldn't allocate the broken segment");
+   for (uint32_t i = 0; i < wal_size; i++)
+   {
+      broken[i] = (unsigned char)(i * 131 + 7);
+   }
+
+   to = pgmoneta_append(NULL, original);
+   to = pgmoneta_append(to, segments[number_of_segments - 1]);
+   file = fopen(to, "wb");
+   ck_assert_msg(file != NULL, "couldn't create %s", to);
+   ck_assert_msg(fwrite(broken, 1, wal_size, file) == wal_size, "couldn't write %s", to);
+   fclose(file);
+   free(to);
+   to = NULL;
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      from = pgmoneta_append(NULL, original);
+      from = pgmoneta_append(from, segments[i]);
+      to = pgmoneta_append(NULL, wal);
+      to = pgmoneta_append(to, segments[i]);
+
+      ck_assert_msg(pgmoneta_copy_file(from, to, NULL) == 0, "couldn't copy %s", from);
+
+      free(from);
+      free(to);
+      from = NULL;
+      to = NULL;
+   }
+
+   config->servers[0].wal_size = wal_size;
+   config->wal_pack = number_of_segments;
+   config->wal_compaction = true;
+
+   ck_assert_msg(pgmoneta_walpack_directory(0, wal) == 0, "pack failed");
+
+   pack = pgmoneta_append(NULL, wal);
+   pack = pgmoneta_append(pack, segments[number_of_segments - 1]);
+   pack = pgmoneta_append(pack, WALPACK_SUFFIX);
+
+   ck_assert_msg(walpack_magic(pack, WALPACK_MAGIC), "%s isn't a pack", pack);
+   ck_assert_msg(pgmoneta_walpack_members(pack, &number_of_members, &members) == 0, "couldn't read %s", pack);
+   ck_assert_msg(number_of_members == number_of_segments, "%s has %d segments", pack, number_of_members);
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      to = pgmoneta_append(NULL, wal);
+      to = pgmoneta_append(to, segments[i]);
+      ck_assert_msg(!pgmoneta_exists(to), "%s wasn't removed", to);
+      free(to);
+      to = NULL;
+
+      found = pgmoneta_walpack_find(wal, segments[i]);
+      ck_assert_msg(found != NULL && !strcmp(found, pack), "%s isn't found in %s", segments[i], pack);
+      free(found);
+      found = NULL;
+   }
+
+   walpack_compare(pack, original, extracted, number_of_segments, segments);
+
+   // a full backup after the pack, so it is compacted
+   snprintf(config->base_dir, sizeof(config->base_dir), "%s/base", directory);
+   snprintf(config->servers[0].name, sizeof(config->servers[0].name), "primary");
+
+   backup = pgmoneta_get_server_backup(0);
+   backup = pgmoneta_append(backup, "20250101000000");
+   ck_assert_msg(pgmoneta_mkdir(backup) == 0, "couldn't create %s", backup);
+   pgmoneta_create_info(backup, "20250101000000", VALID_TRUE);
+   pgmoneta_update_info_string(backup, INFO_WAL, "FFFFFFFFFFFFFFFFFFFFFFFF");
+
+   ck_assert_msg(pgmoneta_walpack_compact(0, wal) == 0, "compact failed");
+   ck_assert_msg(walpack_magic(pack, WALPACK_MAGIC_COMPACT), "%s wasn't compacted", pack);
+
+   walpack_compare(pack, original, extracted, number_of_segments, segments);
+
+   // a single segment too
+   to = pgmoneta_append(NULL, extracted);
+   to = pgmoneta_append(to, "single");
+   ck_assert_msg(pgmoneta_walpack_extract(pack, segments[0], to) == 0, "couldn't extract %s", segments[0]);
+   from = pgmoneta_append(NULL, original);
+   from = pgmoneta_append(from, segments[0]);
+   ck_assert_msg(pgmoneta_compare_files(from, to), "%s differs from %s", to, from);
+
+   pgmoneta_delete_directory(directory);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   for (int i = 0; i < number_of_members; i++)
+   {
+      free(members[i]);
+   }
+   free(members);
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      free(segments[i]);
+   }
+
+   free(broken);
+   free(from);
+   free(to);
+   free(pack);
+   free(backup);
+   free(extracted);
+   free(wal);
+   free(original);
+   free(source);
+   free(directory);
+}
+END_TEST
+
+// the map follows the CSV manifest, when it is built and after the manifest changes
+START_TEST(test_pgmoneta_manifest_map)
+{
+   char* directory = NULL;
+   char* manifest = NULL;
+   char* map_path = NULL;
+   struct manifest_map* map = NULL;
+   char* first[][MANIFEST_COLUMN_COUNT] = {
+      {"PG_VERSION", "4a2f1c0b", "3"},
+      {"base/1/16384", "9e107d9d", "8192"},
+      {"base/1/16384_fsm", "e4d909c2", "24576"},
+      {"global/pg_control", "d41d8cd9", "8192"},
+      {"postgresql.conf", "0cc175b9", "29686"},
+   };
+   char* second[][MANIFEST_COLUMN_COUNT] = {
+      {"PG_VERSION", "4a2f1c0b", "3"},
+      {"base/1/16384", "92eb5ffe", "16384"},
+      {"base/1/16384_fsm", "e4d909c2", "24576"},
+      {"base/1/16385", "c4ca4238", "0"},
+      {"postgresql.conf", "0cc175b9", "29686"},
+   };
+   char* unsorted[][MANIFEST_COLUMN_COUNT] = {
+      {"postgresql.conf", "0cc175b9", "29686"},
+      {"PG_VERSION", "4a2f1c0b", "3"},
+   };
+
+   directory = unit_directory();
+
+   manifest = pgmoneta_append(NULL, directory);
+   manifest = pgmoneta_append(manifest, "/backup.manifest");
+   map_path = pgmoneta_append(NULL, manifest);
+   map_path = pgmoneta_append(map_path, MANIFEST_MAP_SUFFIX);
+
+   manifest_write(manifest, first, sizeof(first) / sizeof(first[0]));
+   ck_assert_msg(pgmoneta_manifest_map_create(manifest) == 0, "couldn't create the map");
+   ck_assert_msg(pgmoneta_exists(map_path), "%s wasn't written", map_path);
+   manifest_compare(manifest);
+
+   ck_assert_msg(pgmoneta_manifest_map_open(manifest, &map) == 0, "couldn't map %s", manifest);
+   ck_assert_msg(pgmoneta_manifest_map_find(map, "base/1/16385") == NULL, "found a file that isn't in the manifest");
+   ck_assert_msg(pgmoneta_manifest_map_find(map, "base") == NULL, "found a directory");
+   pgmoneta_manifest_map_close(map);
+   map = NULL;
+
+   // rewritten right away, so likely within the same tick of the clock as the map
+   manifest_write(manifest, second, sizeof(second) / sizeof(second[0]));
+   manifest_compare(manifest);
+
+   ck_assert_msg(pgmoneta_manifest_map_open(manifest, &map) == 0, "couldn't map %s", manifest);
+   ck_assert_msg(pgmoneta_manifest_map_find(map, "global/pg_control") == NULL, "found a file removed from the manifest");
+   pgmoneta_manifest_map_close(map);
+   map = NULL;
+
+   // a manifest that isn't sorted is read as it is, and never through an earlier map
+   manifest_write(manifest, unsorted, sizeof(unsorted) / sizeof(unsorted[0]));
+   ck_assert_msg(pgmoneta_manifest_map_open(manifest, &map) == 1, "mapped a manifest that isn't sorted");
+   ck_assert_msg(!pgmoneta_exists(map_path), "%s is still there", map_path);
+
+   pgmoneta_delete_directory(directory);
+
+   free(map_path);
+   free(manifest);
+   free(directory);
+}
+END_TEST
+
+// destroying a pool leaves the workers of another pool running
+START_TEST(test_pgmoneta_workers_concurrent_pools)
+{
+   atomic_int count;
+   struct worker_input* wi = NULL;
+   struct workers* first = NULL;
+   struct workers* second = NULL;
+
+   atomic_init(&count, 0);
+
+   ck_assert_msg(pgmoneta_workers_initialize(2, &first) == 0, "couldn't create the first pool");
+   ck_assert_msg(pgmoneta_workers_initialize(2, &second) == 0, "couldn't create the second pool");
+
+   pgmoneta_workers_destroy(first);
+
+   for (int i = 0; i < WORKERS_TASKS; i++)
+   {
+      ck_assert_msg(pgmoneta_create_worker_input(NULL, NULL, NULL, 0, second, &wi) == 0, "couldn't create the input");
+      wi->argument = &count;
+      ck_assert_msg(pgmoneta_workers_add(second, workers_test_count, wi) == 0, "couldn't add task %d", i);
+   }
+
+   pgmoneta_workers_wait(second);
+   ck_assert_msg(atomic_load(&count) == WORKERS_TASKS, "ran %d of %d tasks", atomic_load(&count), WORKERS_TASKS);
+
+   pgmoneta_workers_destroy(second);
+}
+END_TEST
+
+// a concurrent tree is printed while it is inserted into, and prints like a plain one after
+START_TEST(test_pgmoneta_art_concurrent_to_string)
+{
+   char key[MISC_LENGTH];
+   char* str = NULL;
+   char* expected = NULL;
+   struct art* tree = NULL;
+   struct art* plain = NULL;
+   pthread_t threads[ART_THREADS];
+   struct art_test tests[ART_THREADS];
+
+   ck_assert_msg(pgmoneta_art_create_concurrent(&tree) == 0, "couldn't create the concurrent tree");
+   ck_assert_msg(pgmoneta_art_create(&plain) == 0, "couldn't create the tree");
+
+   for (int t = 0; t < ART_THREADS; t++)
+   {
+      tests[t].tree = tree;
+      tests[t].thread = t;
+      pthread_create(&threads[t], NULL, art_test_insert, &tests[t]);
+   }
+
+   for (int i = 0; i < 50; i++)
+   {
+      str = pgmoneta_art_to_string(tree, FORMAT_JSON, NULL, 0);
+      ck_assert_msg(str != NULL, "couldn't print the tree");
+      free(str);
+   }
+
+   for (int t = 0; t < ART_THREADS; t++)
+   {
+      pthread_join(threads[t], NULL);
+
+      for (int i = 0; i < ART_KEYS; i++)
+      {
+         snprintf(key, sizeof(key), "node_%d_%d", t, i);
+         pgmoneta_art_insert(plain, key, (uintptr_t)i, ValueInt32);
+      }
+   }
+
+   str = pgmoneta_art_to_string(tree, FORMAT_JSON, NULL, 0);
+   expected = pgmoneta_art_to_string(plain, FORMAT_JSON, NULL, 0);
+   ck_assert_msg(str != NULL && expected != NULL && !strcmp(str, expected), "the concurrent tree prints differently");
+
+   free(str);
+   free(expected);
+   pgmoneta_art_destroy(plain);
+   pgmoneta_art_destroy(tree);
+}
+END_TEST
+
+Suite*
+pgmoneta_test3_suite(char* dir)
+{
+   Suite* s;
+   TCase* tc_core;
+
+   memset(project_directory, 0, sizeof(project_directory));
+   memcpy(project_directory, dir, strlen(dir));
+
+   s = suite_create("pgmoneta_test3");
+
+   tc_core = tcase_create("Core");
+
+   tcase_set_timeout(tc_core, 60);
+   tcase_add_checked_fixture(tc_core, unit_setup, unit_teardown);
+   tcase_add_test(tc_core, test_pgmoneta_fanout_failed_sink);
+   tcase_add_test(tc_core, test_pgmoneta_page_round_trip);
+   tcase_add_test(tc_core, test_pgmoneta_walpack_round_trip);
+   tcase_add_test(tc_core, test_pgmoneta_manifest_map);
+   tcase_add_test(tc_core, test_pgmoneta_workers_concurrent_pools);
+   tcase_add_test(tc_core, test_pgmoneta_art_concurrent_to_string);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
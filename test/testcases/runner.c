@@ -29,6 +29,7 @@
 
 #include "pgmoneta_test_1.h"
 #include "pgmoneta_test_2.h"
+#include "pgmoneta_test_3.h"
 
 int
 main(int argc, char* argv[])
@@ -43,13 +44,16 @@ main(int argc, char* argv[])
    int number_failed;
    Suite* s1;
    Suite* s2;
+   Suite* s3;
    SRunner* sr;
 
    s1 = pgmoneta_test1_suite(argv[1]);
    s2 = pgmoneta_test2_suite(argv[1]);
+   s3 = pgmoneta_test3_suite(argv[1]);
 
    sr = srunner_create(s1);
    srunner_add_suite(sr, s2);
+   srunner_add_suite(sr, s3);
 
    // Run the tests in verbose mode
    srunner_run_all(sr, CK_VERBOSE);
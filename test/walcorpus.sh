@@ -0,0 +1,215 @@
+#!/bin/bash
+#
+# Copyright (C) 2025 The pgmoneta community
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list
+# of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice, this
+# list of conditions and the following disclaimer in the documentation and/or other
+# materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors may
+# be used to endorse or promote products derived from this software without specific
+# prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+# THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+# TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+set -e
+
+OS=$(uname)
+
+PORT=5432
+
+# The PostgreSQL versions, the directory of the corpus and the size of each workload
+WAL_CORPUS_VERSIONS=${WAL_CORPUS_VERSIONS:-"13 14 15 16 17"}
+WAL_CORPUS_DIRECTORY=${WAL_CORPUS_DIRECTORY:-$(pwd)/walcorpus}
+WAL_CORPUS_ROWS=${WAL_CORPUS_ROWS:-200000}
+WAL_CORPUS_OPERATION_DIR=$(pwd)/pgmoneta-walcorpus
+
+BENCH=$(pwd)/test/pgmoneta_bench_walfile
+WAL_BASELINE=${WAL_BASELINE:-$(pwd)/walcorpus-baseline.json}
+WAL_RESULTS=${WAL_RESULTS:-$(pwd)/walcorpus-results.json}
+WAL_TOLERANCE=${WAL_TOLERANCE:-10}
+
+########################### UTILS ############################
+is_port_in_use() {
+    local port=$1
+    if [[ "$OS" == "Linux" ]]; then
+        ss -tuln | grep $port > /dev/null 2>&1
+    elif [[ "$OS" == "Darwin" ]]; then
+        lsof -i:$port > /dev/null 2>&1
+    fi
+    return $?
+}
+
+next_available_port() {
+    local port=$1
+    while true; do
+        is_port_in_use $port
+        if [ $? -ne 0 ]; then
+            echo "$port"
+            return 0
+        else
+            port=$((port + 1))
+        fi
+    done
+}
+
+# The bin directory of a PostgreSQL version, from PG<version>_BIN or the usual package locations
+postgres_bin() {
+    local version=$1
+    local variable="PG${version}_BIN"
+    for d in "${!variable}" /usr/pgsql-$version/bin /usr/lib/postgresql/$version/bin /opt/homebrew/opt/postgresql@$version/bin; do
+        if [ -n "$d" ] && [ -x "$d/initdb" ]; then
+            echo "$d"
+            return 0
+        fi
+    done
+    return 1
+}
+
+##############################################################
+
+######################### WORKLOADS ##########################
+workload_heap() {
+    $PSQL -c "CREATE TABLE heap (id int, payload text)"
+    $PSQL -c "INSERT INTO heap SELECT g, md5(g::text) FROM generate_series(1, $WAL_CORPUS_ROWS) g"
+    $PSQL -c "UPDATE heap SET payload = payload || 'x' WHERE id % 3 = 0"
+    $PSQL -c "DELETE FROM heap WHERE id % 5 = 0"
+    $PSQL -c "VACUUM heap"
+}
+
+workload_btree() {
+    $PSQL -c "CREATE TABLE btree (id int, k text)"
+    $PSQL -c "CREATE INDEX btree_id ON btree (id)"
+    $PSQL -c "CREATE INDEX btree_k ON btree (k)"
+    $PSQL -c "INSERT INTO btree SELECT (random() * 1000000000)::int, md5(g::text) FROM generate_series(1, $WAL_CORPUS_ROWS) g"
+    $PSQL -c "DELETE FROM btree WHERE id % 7 = 0"
+    $PSQL -c "VACUUM btree"
+}
+
+# Each checkpoint makes the next change of every page write a full page image
+workload_fpi() {
+    $PSQL -c "CREATE TABLE fpi (id int PRIMARY KEY, payload text)"
+    $PSQL -c "INSERT INTO fpi SELECT g, md5(g::text) FROM generate_series(1, $WAL_CORPUS_ROWS) g"
+    for i in 1 2 3 4; do
+        $PSQL -c "CHECKPOINT"
+        $PSQL -c "UPDATE fpi SET payload = md5(payload) WHERE id % 50 = $i"
+    done
+}
+
+workload_xact() {
+    $PSQL -c "CREATE TABLE xact (id int PRIMARY KEY, n int)"
+    $PSQL -c "INSERT INTO xact SELECT g, 0 FROM generate_series(1, 1000) g"
+    echo "\\set id random(1, 1000)
+BEGIN;
+UPDATE xact SET n = n + 1 WHERE id = :id;
+SAVEPOINT s;
+INSERT INTO xact VALUES (:id + 1000000 * (random() * 1000)::int, 0) ON CONFLICT DO NOTHING;
+COMMIT;" > $WAL_CORPUS_OPERATION_DIR/xact.sql
+    $BIN/pgbench -h /tmp -p $PORT -n -c 4 -t $((WAL_CORPUS_ROWS / 40)) -f $WAL_CORPUS_OPERATION_DIR/xact.sql postgres > /dev/null
+}
+
+##############################################################
+
+# Run a workload on a new cluster and keep the segments it wrote
+record_workload() {
+    local version=$1
+    local workload=$2
+    local data=$WAL_CORPUS_OPERATION_DIR/data
+    local target=$WAL_CORPUS_DIRECTORY/$version/$workload
+    local start=""
+
+    rm -rf $data
+    $BIN/initdb -k -D $data > /dev/null
+    echo "port = $PORT" >> $data/postgresql.conf
+    echo "unix_socket_directories = '/tmp'" >> $data/postgresql.conf
+    echo "full_page_writes = on" >> $data/postgresql.conf
+    echo "wal_level = replica" >> $data/postgresql.conf
+    echo "max_wal_size = 4GB" >> $data/postgresql.conf
+    $BIN/pg_ctl -D $data -l $WAL_CORPUS_OPERATION_DIR/logfile -w start > /dev/null
+
+    PSQL="$BIN/psql -h /tmp -p $PORT -q -X -v ON_ERROR_STOP=1 -d postgres"
+    start=$($PSQL -At -c "SELECT pg_walfile_name(pg_current_wal_lsn())")
+
+    workload_$workload
+
+    $PSQL -c "SELECT pg_switch_wal()" > /dev/null
+    $BIN/pg_ctl -D $data -w stop > /dev/null
+
+    rm -rf $target
+    mkdir -p $target
+    for f in $(ls $data/pg_wal | grep -E '^[0-9A-F]{24}$'); do
+        if [[ ! "$f" < "$start" ]]; then
+            cp $data/pg_wal/$f $target/
+        fi
+    done
+    rm -rf $data
+
+    echo "$version/$workload ... $(ls $target | wc -l | tr -d ' ') segments"
+}
+
+create() {
+    mkdir -p $WAL_CORPUS_OPERATION_DIR $WAL_CORPUS_DIRECTORY
+    PORT=$(next_available_port $PORT)
+    for version in $WAL_CORPUS_VERSIONS; do
+        if ! BIN=$(postgres_bin $version); then
+            echo "PostgreSQL $version ... not present, set PG${version}_BIN"
+            continue
+        fi
+        for workload in heap btree fpi xact; do
+            record_workload $version $workload
+        done
+    done
+    rm -rf $WAL_CORPUS_OPERATION_DIR
+}
+
+run() {
+    if [ ! -d $WAL_CORPUS_DIRECTORY ]; then
+        echo "No corpus in $WAL_CORPUS_DIRECTORY, run '$0 create' first"
+        exit 1
+    fi
+    if [ "$1" == "baseline" ]; then
+        $BENCH -d $WAL_CORPUS_DIRECTORY -o $WAL_BASELINE
+    elif [ -f $WAL_BASELINE ]; then
+        $BENCH -d $WAL_CORPUS_DIRECTORY -o $WAL_RESULTS -b $WAL_BASELINE -t $WAL_TOLERANCE
+    else
+        $BENCH -d $WAL_CORPUS_DIRECTORY -o $WAL_RESULTS
+    fi
+}
+
+clean() {
+    for version in $WAL_CORPUS_VERSIONS; do
+        if BIN=$(postgres_bin $version) && [ -d $WAL_CORPUS_OPERATION_DIR/data ]; then
+            $BIN/pg_ctl -D $WAL_CORPUS_OPERATION_DIR/data -w stop > /dev/null 2>&1 || true
+        fi
+    done
+    rm -rf $WAL_CORPUS_OPERATION_DIR
+}
+
+case "$1" in
+    create)
+        create
+        ;;
+    baseline)
+        run baseline
+        ;;
+    clean)
+        clean
+        ;;
+    *)
+        run
+        ;;
+esac